@@ -0,0 +1,245 @@
+/*
+ * startup-profile - time a typical client's startup, and report what
+ * serializes it
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+/* give up on accounts whose contact lists haven't arrived by then */
+#define TIMEOUT_SECONDS 60
+
+typedef struct {
+    GMainLoop *loop;
+    /* NULL-terminated object paths of the accounts to wait for, or NULL
+     * for every valid account */
+    gchar **only;
+    guint pending;
+} Context;
+
+static void
+one_fewer (Context *ctx)
+{
+  if (--ctx->pending == 0)
+    g_main_loop_quit (ctx->loop);
+}
+
+static void
+contact_list_state_cb (TpConnection *connection,
+    GParamSpec *pspec G_GNUC_UNUSED,
+    gpointer user_data)
+{
+  Context *ctx = user_data;
+
+  switch (tp_connection_get_contact_list_state (connection))
+    {
+      case TP_CONTACT_LIST_STATE_SUCCESS:
+      case TP_CONTACT_LIST_STATE_FAILURE:
+        g_signal_handlers_disconnect_by_func (connection,
+            contact_list_state_cb, user_data);
+        one_fewer (ctx);
+        break;
+
+      default:
+        break;
+    }
+}
+
+static void
+connection_prepared_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  TpConnection *connection = (TpConnection *) object;
+  Context *ctx = user_data;
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish (object, res, &error))
+    {
+      g_printerr ("Error preparing %s: %s\n",
+          tp_proxy_get_object_path (connection), error->message);
+      g_clear_error (&error);
+      one_fewer (ctx);
+      return;
+    }
+
+  /* the feature is prepared as soon as we know whether there is a contact
+   * list, but the roster itself might take longer */
+  g_signal_connect (connection, "notify::contact-list-state",
+      G_CALLBACK (contact_list_state_cb), ctx);
+  contact_list_state_cb (connection, NULL, ctx);
+}
+
+static gboolean
+wanted (Context *ctx,
+    TpAccount *account)
+{
+  const gchar *path = tp_proxy_get_object_path (account);
+  guint i;
+
+  if (ctx->only == NULL)
+    return TRUE;
+
+  for (i = 0; ctx->only[i] != NULL; i++)
+    {
+      if (!tp_strdiff (ctx->only[i], path))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+account_manager_prepared_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GQuark features[] = { TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  TpAccountManager *manager = (TpAccountManager *) object;
+  Context *ctx = user_data;
+  GList *accounts, *l;
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish (object, res, &error))
+    {
+      g_printerr ("Error preparing AM: %s\n", error->message);
+      g_clear_error (&error);
+      g_main_loop_quit (ctx->loop);
+      return;
+    }
+
+  /* hold one reference to the main loop ourselves, so it doesn't stop
+   * while we're still going through the accounts */
+  ctx->pending = 1;
+
+  accounts = tp_account_manager_dup_valid_accounts (manager);
+
+  for (l = accounts; l != NULL; l = l->next)
+    {
+      TpAccount *account = l->data;
+      TpConnection *connection = tp_account_get_connection (account);
+
+      if (connection == NULL || !wanted (ctx, account))
+        continue;
+
+      /* this has normally been done already, because the factory has the
+       * feature, in which case it finishes immediately; but it's how a
+       * client would ensure it otherwise */
+      ctx->pending++;
+      tp_proxy_prepare_async (connection, features, connection_prepared_cb,
+          ctx);
+    }
+
+  g_list_free_full (accounts, g_object_unref);
+  one_fewer (ctx);
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  Context *ctx = user_data;
+
+  g_printerr ("Gave up waiting for %u connection(s) after %u seconds\n",
+      ctx->pending, TIMEOUT_SECONDS);
+  g_main_loop_quit (ctx->loop);
+  return FALSE;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  gchar *trace_file = NULL;
+  GOptionEntry entries[] = {
+      { "trace", 't', 0, G_OPTION_ARG_FILENAME, &trace_file,
+        "Also write the timeline to FILE, for about:tracing or Perfetto",
+        "FILE" },
+      { NULL }
+  };
+  GOptionContext *options;
+  TpAccountManager *manager;
+  TpSimpleClientFactory *factory;
+  Context ctx = { NULL, NULL, 0 };
+  GError *error = NULL;
+  gchar *report;
+  int ret = 0;
+
+  /* before anything else, so that the first proxy's calls are recorded */
+  tp_debug_set_tracing (TRUE);
+  tp_debug_set_flags (g_getenv ("EXAMPLE_DEBUG"));
+
+  options = g_option_context_new ("[ACCOUNT_OBJECT_PATH...]");
+  g_option_context_set_summary (options,
+      "Prepare the account manager, every valid account (or only the "
+      "given accounts) and their connections' contact lists, as a client "
+      "would when it starts, then print the critical path.");
+  g_option_context_add_main_entries (options, entries, NULL);
+
+  if (!g_option_context_parse (options, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      g_option_context_free (options);
+      return 2;
+    }
+
+  g_option_context_free (options);
+
+  if (argc > 1)
+    ctx.only = argv + 1;
+
+  ctx.loop = g_main_loop_new (NULL, FALSE);
+
+  manager = tp_account_manager_dup ();
+  factory = tp_proxy_get_factory (manager);
+  tp_simple_client_factory_add_account_features_varargs (factory,
+      TP_ACCOUNT_FEATURE_CONNECTION,
+      0);
+  tp_simple_client_factory_add_connection_features_varargs (factory,
+      TP_CONNECTION_FEATURE_CONTACT_LIST,
+      0);
+  tp_simple_client_factory_add_contact_features_varargs (factory,
+      TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_AVATAR_TOKEN,
+      TP_CONTACT_FEATURE_PRESENCE,
+      TP_CONTACT_FEATURE_CONTACT_GROUPS,
+      TP_CONTACT_FEATURE_INVALID);
+
+  tp_proxy_prepare_async (manager, NULL, account_manager_prepared_cb, &ctx);
+  g_timeout_add_seconds (TIMEOUT_SECONDS, timeout_cb, &ctx);
+
+  g_main_loop_run (ctx.loop);
+
+  tp_debug_set_tracing (FALSE);
+
+  report = tp_debug_dup_trace_critical_path ();
+  g_print ("%s", report);
+  g_free (report);
+
+  if (trace_file != NULL)
+    {
+      gchar *events = tp_debug_dup_trace_events ();
+
+      if (!g_file_set_contents (trace_file, events, -1, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          g_clear_error (&error);
+          ret = 1;
+        }
+
+      g_free (events);
+      g_free (trace_file);
+    }
+
+  g_object_unref (manager);
+  g_main_loop_unref (ctx.loop);
+
+  return ret;
+}
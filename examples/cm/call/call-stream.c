@@ -171,11 +171,29 @@ finalize (GObject *object)
   G_OBJECT_CLASS (example_call_stream_parent_class)->finalize (object);
 }
 
+static GPtrArray *
+stream_add_local_candidates (TpBaseMediaCallStream *media_stream,
+    const GPtrArray *candidates,
+    GError **error)
+{
+  GPtrArray *accepted = g_ptr_array_sized_new (candidates->len);
+  guint i;
+
+  /* There is no real network protocol here, so every candidate is good
+   * enough to send to the simulated peer. */
+  for (i = 0; i < candidates->len; i++)
+    g_ptr_array_add (accepted, g_ptr_array_index (candidates, i));
+
+  return accepted;
+}
+
 static void
 example_call_stream_class_init (ExampleCallStreamClass *klass)
 {
   GObjectClass *object_class = (GObjectClass *) klass;
   TpBaseCallStreamClass *stream_class = (TpBaseCallStreamClass *) klass;
+  TpBaseMediaCallStreamClass *media_class =
+      (TpBaseMediaCallStreamClass *) klass;
   GParamSpec *param_spec;
 
   g_type_class_add_private (klass, sizeof (ExampleCallStreamPrivate));
@@ -187,6 +205,7 @@ example_call_stream_class_init (ExampleCallStreamClass *klass)
 
   stream_class->request_receiving = stream_request_receiving;
   stream_class->set_sending = stream_set_sending;
+  media_class->add_local_candidates = stream_add_local_candidates;
 
   param_spec = g_param_spec_uint ("simulation-delay", "Simulation delay",
       "Delay between simulated network events",
@@ -44,6 +44,7 @@ enum
 {
   PROP_ACCOUNT = 1,
   PROP_SIMULATION_DELAY,
+  PROP_LAZY_GROUP_CHANNELS,
   N_PROPS
 };
 
@@ -51,6 +52,7 @@ struct _ExampleContactListConnectionPrivate
 {
   gchar *account;
   guint simulation_delay;
+  gboolean lazy_group_channels;
   ExampleContactList *contact_list;
   gboolean away;
 };
@@ -82,6 +84,10 @@ get_property (GObject *object,
       g_value_set_uint (value, self->priv->simulation_delay);
       break;
 
+    case PROP_LAZY_GROUP_CHANNELS:
+      g_value_set_boolean (value, self->priv->lazy_group_channels);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, spec);
     }
@@ -107,6 +113,10 @@ set_property (GObject *object,
       self->priv->simulation_delay = g_value_get_uint (value);
       break;
 
+    case PROP_LAZY_GROUP_CHANNELS:
+      self->priv->lazy_group_channels = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, spec);
     }
@@ -208,6 +218,7 @@ create_channel_managers (TpBaseConnection *conn)
           EXAMPLE_TYPE_CONTACT_LIST,
           "connection", conn,
           "simulation-delay", self->priv->simulation_delay,
+          "lazy-group-channels", self->priv->lazy_group_channels,
           NULL));
 
   g_signal_connect (self->priv->contact_list, "alias-updated",
@@ -456,6 +467,14 @@ example_contact_list_connection_class_init (
   g_object_class_install_property (object_class, PROP_SIMULATION_DELAY,
       param_spec);
 
+  param_spec = g_param_spec_boolean ("lazy-group-channels",
+      "Lazy group channels",
+      "Whether group channels are only created when requested",
+      FALSE,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_LAZY_GROUP_CHANNELS,
+      param_spec);
+
   tp_contacts_mixin_class_init (object_class,
       G_STRUCT_OFFSET (ExampleContactListConnectionClass, contacts_mixin));
 
@@ -177,6 +177,20 @@ finally:
     }
 }
 
+static void
+send_messages (GObject *object,
+    guint n_messages,
+    TpMessage * const *messages,
+    const TpMessageSendingFlags *flags)
+{
+  guint i;
+
+  /* A real protocol could put all these messages in one network write; we
+   * just echo each one in turn */
+  for (i = 0; i < n_messages; i++)
+    send_message (object, messages[i], flags[i]);
+}
+
 static gboolean
 send_chat_state (GObject *object,
     TpChannelChatState state,
@@ -213,6 +227,7 @@ constructor (GType type,
       TP_MESSAGE_PART_SUPPORT_FLAG_MULTIPLE_ATTACHMENTS,
       TP_DELIVERY_REPORTING_SUPPORT_FLAG_RECEIVE_FAILURES,
       content_types);
+  tp_message_mixin_implement_send_batch (object, send_messages);
 
   tp_message_mixin_implement_send_chat_state (object, send_chat_state);
 
@@ -0,0 +1,51 @@
+/*
+ * avatars.h - header for synthetic avatar downloads
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_AVATARS_H__
+#define __EXAMPLE_SYNTHETIC_AVATARS_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticAvatars ExampleSyntheticAvatars;
+typedef struct _ExampleSyntheticAvatarsClass ExampleSyntheticAvatarsClass;
+
+struct _ExampleSyntheticAvatarsClass {
+    TpBaseAvatarsClass parent_class;
+};
+
+struct _ExampleSyntheticAvatars {
+    TpBaseAvatars parent;
+};
+
+GType example_synthetic_avatars_get_type (void);
+
+#define EXAMPLE_TYPE_SYNTHETIC_AVATARS \
+  (example_synthetic_avatars_get_type ())
+#define EXAMPLE_SYNTHETIC_AVATARS(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), EXAMPLE_TYPE_SYNTHETIC_AVATARS, \
+                              ExampleSyntheticAvatars))
+#define EXAMPLE_SYNTHETIC_AVATARS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), EXAMPLE_TYPE_SYNTHETIC_AVATARS, \
+                           ExampleSyntheticAvatarsClass))
+#define EXAMPLE_IS_SYNTHETIC_AVATARS(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), EXAMPLE_TYPE_SYNTHETIC_AVATARS))
+#define EXAMPLE_IS_SYNTHETIC_AVATARS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), EXAMPLE_TYPE_SYNTHETIC_AVATARS))
+#define EXAMPLE_SYNTHETIC_AVATARS_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_SYNTHETIC_AVATARS, \
+                              ExampleSyntheticAvatarsClass))
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,721 @@
+/*
+ * conn.c - a synthetic connection
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include "conn.h"
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#include "avatars.h"
+#include "contact-list.h"
+#include "protocol.h"
+#include "room-manager.h"
+
+static void init_avatars (gpointer, gpointer);
+
+G_DEFINE_TYPE_WITH_CODE (ExampleSyntheticConnection,
+    example_synthetic_connection,
+    TP_TYPE_BASE_CONNECTION,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_AVATARS,
+      init_avatars);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACTS,
+      tp_contacts_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACT_LIST,
+      tp_base_contact_list_mixin_list_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_PRESENCE,
+      tp_presence_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      tp_presence_mixin_simple_presence_iface_init))
+
+/* this array must be kept in sync with the enum
+ * ExampleSyntheticPresence in conn.h */
+static const TpPresenceStatusSpec _statuses[] = {
+      { "offline", TP_CONNECTION_PRESENCE_TYPE_OFFLINE, FALSE, NULL },
+      { "unknown", TP_CONNECTION_PRESENCE_TYPE_UNKNOWN, FALSE, NULL },
+      { "error", TP_CONNECTION_PRESENCE_TYPE_ERROR, FALSE, NULL },
+      { "away", TP_CONNECTION_PRESENCE_TYPE_AWAY, TRUE, NULL },
+      { "available", TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, TRUE, NULL },
+      { NULL }
+};
+
+/* the presences that contacts on the roster move between */
+static const ExampleSyntheticPresence simulated_presences[] = {
+    EXAMPLE_SYNTHETIC_PRESENCE_OFFLINE,
+    EXAMPLE_SYNTHETIC_PRESENCE_AWAY,
+    EXAMPLE_SYNTHETIC_PRESENCE_AVAILABLE
+};
+
+static const char *mime_types[] = { "image/png", NULL };
+static TpDBusPropertiesMixinPropImpl conn_avatars_properties[] = {
+      { "MinimumAvatarWidth", GUINT_TO_POINTER (1), NULL },
+      { "MinimumAvatarHeight", GUINT_TO_POINTER (1), NULL },
+      { "RecommendedAvatarWidth", GUINT_TO_POINTER (64), NULL },
+      { "RecommendedAvatarHeight", GUINT_TO_POINTER (64), NULL },
+      { "MaximumAvatarWidth", GUINT_TO_POINTER (96), NULL },
+      { "MaximumAvatarHeight", GUINT_TO_POINTER (96), NULL },
+      { "MaximumAvatarBytes", GUINT_TO_POINTER (8192), NULL },
+      /* special-cased - it's the only one with a non-guint value */
+      { "SupportedAvatarMIMETypes", NULL, NULL },
+      { NULL }
+};
+
+enum
+{
+  PROP_ACCOUNT = 1,
+  PROP_SCENARIO,
+  N_PROPS
+};
+
+struct _ExampleSyntheticConnectionPrivate
+{
+  gchar *account;
+  ExampleSyntheticScenario *scenario;
+  GRand *rand;
+
+  ExampleSyntheticContactList *contact_list;
+  TpBaseAvatars *avatars;
+  gboolean away;
+
+  /* GUINT_TO_POINTER (contact) => GUINT_TO_POINTER (ExampleSyntheticPresence)
+   * for roster contacts who are not offline */
+  GHashTable *presences;
+  guint n_avatar_changes;
+
+  ExampleSyntheticRate presence_changes;
+  ExampleSyntheticRate avatar_changes;
+  guint tick_id;
+};
+
+static void
+example_synthetic_connection_init (ExampleSyntheticConnection *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EXAMPLE_TYPE_SYNTHETIC_CONNECTION,
+      ExampleSyntheticConnectionPrivate);
+
+  self->priv->presences = g_hash_table_new (NULL, NULL);
+}
+
+static void
+get_property (GObject *object,
+              guint property_id,
+              GValue *value,
+              GParamSpec *spec)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+
+  switch (property_id)
+    {
+    case PROP_ACCOUNT:
+      g_value_set_string (value, self->priv->account);
+      break;
+
+    case PROP_SCENARIO:
+      g_value_set_pointer (value, self->priv->scenario);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, spec);
+    }
+}
+
+static void
+set_property (GObject *object,
+              guint property_id,
+              const GValue *value,
+              GParamSpec *spec)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+
+  switch (property_id)
+    {
+    case PROP_ACCOUNT:
+      g_free (self->priv->account);
+      self->priv->account = g_value_dup_string (value);
+      break;
+
+    case PROP_SCENARIO:
+      g_assert (self->priv->scenario == NULL);
+
+      if (g_value_get_pointer (value) == NULL)
+        self->priv->scenario = example_synthetic_scenario_new ();
+      else
+        self->priv->scenario = example_synthetic_scenario_copy (
+            g_value_get_pointer (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, spec);
+    }
+}
+
+static void
+stop_ticking (ExampleSyntheticConnection *self)
+{
+  if (self->priv->tick_id != 0)
+    {
+      g_source_remove (self->priv->tick_id);
+      self->priv->tick_id = 0;
+    }
+}
+
+static void
+dispose (GObject *object)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+
+  stop_ticking (self);
+  tp_clear_object (&self->priv->avatars);
+
+  G_OBJECT_CLASS (example_synthetic_connection_parent_class)->dispose (
+      object);
+}
+
+static void
+finalize (GObject *object)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+
+  tp_contacts_mixin_finalize (object);
+  tp_presence_mixin_finalize (object);
+  g_free (self->priv->account);
+  example_synthetic_scenario_free (self->priv->scenario);
+  g_rand_free (self->priv->rand);
+  g_hash_table_unref (self->priv->presences);
+
+  G_OBJECT_CLASS (example_synthetic_connection_parent_class)->finalize (
+      object);
+}
+
+static gchar *
+get_unique_connection_name (TpBaseConnection *conn)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (conn);
+
+  return g_strdup_printf ("%s@%p", self->priv->account, self);
+}
+
+static gchar *
+example_synthetic_normalize_id (TpHandleRepoIface *repo G_GNUC_UNUSED,
+    const gchar *id,
+    gpointer context G_GNUC_UNUSED,
+    GError **error)
+{
+  gchar *normal = NULL;
+
+  if (example_synthetic_protocol_check_id (id, &normal, error))
+    return normal;
+  else
+    return NULL;
+}
+
+static void
+create_handle_repos (TpBaseConnection *conn,
+                     TpHandleRepoIface *repos[TP_NUM_HANDLE_TYPES])
+{
+  repos[TP_HANDLE_TYPE_CONTACT] = tp_dynamic_handle_repo_new
+      (TP_HANDLE_TYPE_CONTACT, example_synthetic_normalize_id, NULL);
+
+  repos[TP_HANDLE_TYPE_ROOM] = tp_dynamic_handle_repo_new
+      (TP_HANDLE_TYPE_ROOM, example_synthetic_normalize_id, NULL);
+}
+
+static GPtrArray *
+create_channel_managers (TpBaseConnection *conn)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (conn);
+  GPtrArray *ret = g_ptr_array_sized_new (2);
+
+  self->priv->contact_list = EXAMPLE_SYNTHETIC_CONTACT_LIST (g_object_new (
+          EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST,
+          "connection", conn,
+          "size", self->priv->scenario->roster_size,
+          NULL));
+  g_ptr_array_add (ret, self->priv->contact_list);
+
+  g_ptr_array_add (ret, g_object_new (EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER,
+        "connection", conn,
+        NULL));
+
+  return ret;
+}
+
+static TpHandle
+pick_roster_contact (ExampleSyntheticConnection *self)
+{
+  const GArray *roster = example_synthetic_contact_list_get_roster (
+      self->priv->contact_list);
+
+  return g_array_index (roster, TpHandle,
+      g_rand_int_range (self->priv->rand, 0, roster->len));
+}
+
+static ExampleSyntheticPresence
+get_presence (ExampleSyntheticConnection *self,
+    TpHandle contact)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->presences,
+        GUINT_TO_POINTER (contact)));
+}
+
+static void
+set_presence (ExampleSyntheticConnection *self,
+    TpHandle contact,
+    ExampleSyntheticPresence presence)
+{
+  if (presence == EXAMPLE_SYNTHETIC_PRESENCE_OFFLINE)
+    g_hash_table_remove (self->priv->presences, GUINT_TO_POINTER (contact));
+  else
+    g_hash_table_insert (self->priv->presences, GUINT_TO_POINTER (contact),
+        GUINT_TO_POINTER (presence));
+}
+
+/* Move @n randomly-chosen contacts to a different presence, and tell clients
+ * about all of them in one PresencesChanged signal */
+static void
+change_presences (ExampleSyntheticConnection *self,
+    guint n)
+{
+  GHashTable *changes = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) tp_presence_status_free);
+  guint k;
+
+  for (k = 0; k < n; k++)
+    {
+      TpHandle contact = pick_roster_contact (self);
+      ExampleSyntheticPresence presence;
+
+      do
+        presence = simulated_presences[g_rand_int_range (self->priv->rand, 0,
+            G_N_ELEMENTS (simulated_presences))];
+      while (presence == get_presence (self, contact));
+
+      set_presence (self, contact, presence);
+      g_hash_table_insert (changes, GUINT_TO_POINTER (contact),
+          tp_presence_status_new (presence, NULL));
+    }
+
+  tp_presence_mixin_emit_presence_update ((GObject *) self, changes);
+  g_hash_table_unref (changes);
+}
+
+static void
+change_avatar (ExampleSyntheticConnection *self)
+{
+  gchar *token = g_strdup_printf ("synthetic-%u",
+      ++self->priv->n_avatar_changes);
+
+  tp_base_avatars_set_token (self->priv->avatars,
+      pick_roster_contact (self), token);
+  g_free (token);
+}
+
+static gboolean
+tick_cb (gpointer data)
+{
+  ExampleSyntheticConnection *self = data;
+  gint64 now = g_get_monotonic_time ();
+  guint n;
+
+  n = example_synthetic_rate_take (&self->priv->presence_changes, now);
+
+  if (n > 0)
+    change_presences (self, n);
+
+  for (n = example_synthetic_rate_take (&self->priv->avatar_changes, now);
+      n > 0;
+      n--)
+    change_avatar (self);
+
+  return TRUE;
+}
+
+/* Give everyone on the roster a presence and an avatar to start with,
+ * then start changing them */
+static void
+start_ticking (ExampleSyntheticConnection *self)
+{
+  const GArray *roster = example_synthetic_contact_list_get_roster (
+      self->priv->contact_list);
+  guint i;
+
+  for (i = 0; i < roster->len; i++)
+    {
+      TpHandle contact = g_array_index (roster, TpHandle, i);
+
+      set_presence (self, contact,
+          simulated_presences[g_rand_int_range (self->priv->rand, 0,
+            G_N_ELEMENTS (simulated_presences))]);
+      tp_base_avatars_set_token (self->priv->avatars, contact, "");
+    }
+
+  if (roster->len == 0)
+    return;
+
+  example_synthetic_rate_init (&self->priv->presence_changes,
+      self->priv->scenario->presence_rate);
+  example_synthetic_rate_init (&self->priv->avatar_changes,
+      self->priv->scenario->avatar_rate);
+  self->priv->tick_id = g_timeout_add (EXAMPLE_SYNTHETIC_TICK_MS, tick_cb,
+      self);
+}
+
+static gboolean
+start_connecting (TpBaseConnection *conn,
+                  GError **error)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (conn);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
+      TP_HANDLE_TYPE_CONTACT);
+  TpHandle self_handle;
+
+  self_handle = tp_handle_ensure (contact_repo, self->priv->account,
+      NULL, error);
+
+  if (self_handle == 0)
+    return FALSE;
+
+  tp_base_connection_set_self_handle (conn, self_handle);
+
+  /* the contact list and the rooms fill themselves in when this emits
+   * StatusChanged */
+  tp_base_connection_change_status (conn, TP_CONNECTION_STATUS_CONNECTED,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+
+  start_ticking (self);
+  return TRUE;
+}
+
+static void
+shut_down (TpBaseConnection *conn)
+{
+  stop_ticking (EXAMPLE_SYNTHETIC_CONNECTION (conn));
+  tp_base_connection_finish_shutdown (conn);
+}
+
+static void
+avatars_fill_contact_attributes (GObject *object,
+    const GArray *contacts,
+    GHashTable *attributes)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle contact = g_array_index (contacts, TpHandle, i);
+      const gchar *token = tp_base_avatars_get_token (self->priv->avatars,
+          contact);
+
+      if (token != NULL)
+        tp_contacts_mixin_set_contact_attribute (attributes, contact,
+            TP_TOKEN_CONNECTION_INTERFACE_AVATARS_TOKEN,
+            tp_g_value_slice_new_string (token));
+    }
+}
+
+static void
+constructed (GObject *object)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+  void (*chain_up) (GObject *) =
+    G_OBJECT_CLASS (example_synthetic_connection_parent_class)->constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  /* the scenario property is construct-only, but might not have been set */
+  if (self->priv->scenario == NULL)
+    self->priv->scenario = example_synthetic_scenario_new ();
+
+  if (self->priv->scenario->seed == 0)
+    self->priv->rand = g_rand_new ();
+  else
+    self->priv->rand = g_rand_new_with_seed (self->priv->scenario->seed);
+
+  self->priv->avatars = g_object_new (EXAMPLE_TYPE_SYNTHETIC_AVATARS,
+      "connection", self,
+      NULL);
+
+  tp_contacts_mixin_init (object,
+      G_STRUCT_OFFSET (ExampleSyntheticConnection, contacts_mixin));
+
+  tp_base_connection_register_with_contacts_mixin (base);
+  tp_base_contact_list_mixin_register_with_contacts_mixin (base);
+
+  tp_contacts_mixin_add_contact_attributes_iface (object,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+      avatars_fill_contact_attributes);
+
+  tp_presence_mixin_init (object,
+      G_STRUCT_OFFSET (ExampleSyntheticConnection, presence_mixin));
+  tp_presence_mixin_simple_presence_register_with_contacts_mixin (object);
+}
+
+static gboolean
+status_available (GObject *object,
+                  guint index_)
+{
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+
+  return tp_base_connection_check_connected (base, NULL);
+}
+
+static GHashTable *
+get_contact_statuses (GObject *object,
+                      const GArray *contacts,
+                      GError **error)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+  guint i;
+  GHashTable *result = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) tp_presence_status_free);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle contact = g_array_index (contacts, guint, i);
+      ExampleSyntheticPresence presence;
+
+      /* room members who aren't on the roster appear offline, as they
+       * would if we didn't have a presence subscription to them */
+      if (contact == tp_base_connection_get_self_handle (base))
+        presence = (self->priv->away ? EXAMPLE_SYNTHETIC_PRESENCE_AWAY
+            : EXAMPLE_SYNTHETIC_PRESENCE_AVAILABLE);
+      else
+        presence = get_presence (self, contact);
+
+      g_hash_table_insert (result, GUINT_TO_POINTER (contact),
+          tp_presence_status_new (presence, NULL));
+    }
+
+  return result;
+}
+
+static gboolean
+set_own_status (GObject *object,
+                const TpPresenceStatus *status,
+                GError **error)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (object);
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+  gboolean away = (status->index == EXAMPLE_SYNTHETIC_PRESENCE_AWAY);
+
+  if (self->priv->away != away)
+    {
+      self->priv->away = away;
+      tp_presence_mixin_emit_one_presence_update (object,
+          tp_base_connection_get_self_handle (base), status);
+    }
+
+  return TRUE;
+}
+
+static const gchar *interfaces_always_present[] = {
+    TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+    TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
+    TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST,
+    TP_IFACE_CONNECTION_INTERFACE_PRESENCE,
+    TP_IFACE_CONNECTION_INTERFACE_REQUESTS,
+    TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+    NULL };
+
+const gchar * const *
+example_synthetic_connection_get_possible_interfaces (void)
+{
+  /* in this example CM we don't have any extra interfaces that are sometimes,
+   * but not always, present */
+  return interfaces_always_present;
+}
+
+static GPtrArray *
+get_interfaces_always_present (TpBaseConnection *base)
+{
+  GPtrArray *interfaces;
+  guint i;
+
+  interfaces = TP_BASE_CONNECTION_CLASS (
+      example_synthetic_connection_parent_class)->
+      get_interfaces_always_present (base);
+
+  for (i = 0; interfaces_always_present[i] != NULL; i++)
+    g_ptr_array_add (interfaces, (gchar *) interfaces_always_present[i]);
+
+  return interfaces;
+}
+
+static void
+conn_avatars_properties_getter (GObject *object,
+    GQuark interface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  GQuark q_mime_types = g_quark_from_static_string (
+      "SupportedAvatarMIMETypes");
+
+  if (name == q_mime_types)
+    g_value_set_static_boxed (value, mime_types);
+  else
+    g_value_set_uint (value, GPOINTER_TO_UINT (getter_data));
+}
+
+static void
+example_synthetic_connection_class_init (
+    ExampleSyntheticConnectionClass *klass)
+{
+  TpBaseConnectionClass *base_class = (TpBaseConnectionClass *) klass;
+  GObjectClass *object_class = (GObjectClass *) klass;
+  GParamSpec *param_spec;
+
+  object_class->get_property = get_property;
+  object_class->set_property = set_property;
+  object_class->constructed = constructed;
+  object_class->dispose = dispose;
+  object_class->finalize = finalize;
+  g_type_class_add_private (klass,
+      sizeof (ExampleSyntheticConnectionPrivate));
+
+  base_class->create_handle_repos = create_handle_repos;
+  base_class->get_unique_connection_name = get_unique_connection_name;
+  base_class->create_channel_managers = create_channel_managers;
+  base_class->start_connecting = start_connecting;
+  base_class->shut_down = shut_down;
+  base_class->get_interfaces_always_present = get_interfaces_always_present;
+
+  param_spec = g_param_spec_string ("account", "Account name",
+      "The username of this user", NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_ACCOUNT, param_spec);
+
+  param_spec = g_param_spec_pointer ("scenario", "Scenario",
+      "The ExampleSyntheticScenario to simulate, which is copied",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SCENARIO, param_spec);
+
+  tp_contacts_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (ExampleSyntheticConnectionClass, contacts_mixin));
+
+  tp_presence_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (ExampleSyntheticConnectionClass, presence_mixin),
+      status_available, get_contact_statuses, set_own_status, _statuses);
+  tp_presence_mixin_simple_presence_init_dbus_properties (object_class);
+
+  tp_base_contact_list_mixin_class_init (base_class);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS,
+      conn_avatars_properties_getter, NULL, conn_avatars_properties);
+}
+
+/*
+ * example_synthetic_connection_get_scenario:
+ *
+ * Returns: what this connection is simulating
+ */
+const ExampleSyntheticScenario *
+example_synthetic_connection_get_scenario (ExampleSyntheticConnection *self)
+{
+  return self->priv->scenario;
+}
+
+/*
+ * example_synthetic_connection_next_seed:
+ *
+ * Returns: a seed for something else's random events, such as a room's,
+ *  which is the same every time if the scenario has a seed
+ */
+guint32
+example_synthetic_connection_next_seed (ExampleSyntheticConnection *self)
+{
+  return g_rand_int (self->priv->rand);
+}
+
+static void
+get_known_avatar_tokens (TpSvcConnectionInterfaceAvatars *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (iface);
+  TpBaseConnection *base = TP_BASE_CONNECTION (iface);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_CONTACT);
+  GError *error = NULL;
+  GHashTable *result;
+  guint i;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (base, context);
+
+  if (!tp_handles_are_valid (contact_repo, contacts, FALSE, &error))
+    {
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+      return;
+    }
+
+  result = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle contact = g_array_index (contacts, TpHandle, i);
+      const gchar *token = tp_base_avatars_get_token (self->priv->avatars,
+          contact);
+
+      if (token != NULL)
+        g_hash_table_insert (result, GUINT_TO_POINTER (contact),
+            (gchar *) token);
+    }
+
+  tp_svc_connection_interface_avatars_return_from_get_known_avatar_tokens (
+      context, result);
+  g_hash_table_unref (result);
+}
+
+static void
+request_avatars (TpSvcConnectionInterfaceAvatars *iface,
+    const GArray *contacts,
+    DBusGMethodInvocation *context)
+{
+  ExampleSyntheticConnection *self = EXAMPLE_SYNTHETIC_CONNECTION (iface);
+  TpBaseConnection *base = TP_BASE_CONNECTION (iface);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_CONTACT);
+  GError *error = NULL;
+
+  TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (base, context);
+
+  if (!tp_handles_are_valid (contact_repo, contacts, FALSE, &error))
+    {
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+      return;
+    }
+
+  tp_base_avatars_request_avatars (self->priv->avatars, contacts);
+  tp_svc_connection_interface_avatars_return_from_request_avatars (context);
+}
+
+static void
+init_avatars (gpointer g_iface,
+    gpointer iface_data G_GNUC_UNUSED)
+{
+  TpSvcConnectionInterfaceAvatarsClass *klass = g_iface;
+
+#define IMPLEMENT(x) tp_svc_connection_interface_avatars_implement_##x (\
+    klass, x)
+  IMPLEMENT(get_known_avatar_tokens);
+  IMPLEMENT(request_avatars);
+#undef IMPLEMENT
+}
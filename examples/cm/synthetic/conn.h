@@ -0,0 +1,78 @@
+/*
+ * conn.h - header for a synthetic connection
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_CONN_H__
+#define __EXAMPLE_SYNTHETIC_CONN_H__
+
+#include <glib-object.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "scenario.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticConnection ExampleSyntheticConnection;
+typedef struct _ExampleSyntheticConnectionClass
+    ExampleSyntheticConnectionClass;
+typedef struct _ExampleSyntheticConnectionPrivate
+    ExampleSyntheticConnectionPrivate;
+
+struct _ExampleSyntheticConnectionClass {
+    TpBaseConnectionClass parent_class;
+    TpPresenceMixinClass presence_mixin;
+    TpContactsMixinClass contacts_mixin;
+};
+
+struct _ExampleSyntheticConnection {
+    TpBaseConnection parent;
+    TpPresenceMixin presence_mixin;
+    TpContactsMixin contacts_mixin;
+
+    ExampleSyntheticConnectionPrivate *priv;
+};
+
+GType example_synthetic_connection_get_type (void);
+
+#define EXAMPLE_TYPE_SYNTHETIC_CONNECTION \
+  (example_synthetic_connection_get_type ())
+#define EXAMPLE_SYNTHETIC_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), EXAMPLE_TYPE_SYNTHETIC_CONNECTION, \
+                              ExampleSyntheticConnection))
+#define EXAMPLE_SYNTHETIC_CONNECTION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), EXAMPLE_TYPE_SYNTHETIC_CONNECTION, \
+                           ExampleSyntheticConnectionClass))
+#define EXAMPLE_IS_SYNTHETIC_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), EXAMPLE_TYPE_SYNTHETIC_CONNECTION))
+#define EXAMPLE_IS_SYNTHETIC_CONNECTION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), EXAMPLE_TYPE_SYNTHETIC_CONNECTION))
+#define EXAMPLE_SYNTHETIC_CONNECTION_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_SYNTHETIC_CONNECTION, \
+                              ExampleSyntheticConnectionClass))
+
+/* this enum must be kept in sync with the array _statuses in conn.c */
+typedef enum {
+    EXAMPLE_SYNTHETIC_PRESENCE_OFFLINE = 0,
+    EXAMPLE_SYNTHETIC_PRESENCE_UNKNOWN,
+    EXAMPLE_SYNTHETIC_PRESENCE_ERROR,
+    EXAMPLE_SYNTHETIC_PRESENCE_AWAY,
+    EXAMPLE_SYNTHETIC_PRESENCE_AVAILABLE
+} ExampleSyntheticPresence;
+
+const ExampleSyntheticScenario *example_synthetic_connection_get_scenario (
+    ExampleSyntheticConnection *self);
+guint32 example_synthetic_connection_next_seed (
+    ExampleSyntheticConnection *self);
+
+const gchar * const *example_synthetic_connection_get_possible_interfaces (
+    void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * connection-manager.c - a synthetic load-generating connection manager
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "connection-manager.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "protocol.h"
+
+G_DEFINE_TYPE (ExampleSyntheticConnectionManager,
+    example_synthetic_connection_manager,
+    TP_TYPE_BASE_CONNECTION_MANAGER)
+
+static void
+example_synthetic_connection_manager_init (
+    ExampleSyntheticConnectionManager *self)
+{
+}
+
+static void
+example_synthetic_connection_manager_constructed (GObject *object)
+{
+  ExampleSyntheticConnectionManager *self =
+    EXAMPLE_SYNTHETIC_CONNECTION_MANAGER (object);
+  TpBaseConnectionManager *base = (TpBaseConnectionManager *) self;
+  void (*constructed) (GObject *) =
+    ((GObjectClass *)
+        example_synthetic_connection_manager_parent_class)->constructed;
+  TpBaseProtocol *protocol;
+
+  if (constructed != NULL)
+    constructed (object);
+
+  protocol = g_object_new (EXAMPLE_TYPE_SYNTHETIC_PROTOCOL,
+      "name", "example",
+      NULL);
+  tp_base_connection_manager_add_protocol (base, protocol);
+  g_object_unref (protocol);
+}
+
+static void
+example_synthetic_connection_manager_class_init (
+    ExampleSyntheticConnectionManagerClass *klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  TpBaseConnectionManagerClass *base_class =
+      (TpBaseConnectionManagerClass *) klass;
+
+  object_class->constructed = example_synthetic_connection_manager_constructed;
+  base_class->cm_dbus_name = "example_synthetic";
+}
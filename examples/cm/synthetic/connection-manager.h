@@ -0,0 +1,58 @@
+/*
+ * connection-manager.h - header for a synthetic connection manager
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_CONNECTION_MANAGER_H__
+#define __EXAMPLE_SYNTHETIC_CONNECTION_MANAGER_H__
+
+#include <glib-object.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticConnectionManager
+    ExampleSyntheticConnectionManager;
+typedef struct _ExampleSyntheticConnectionManagerClass
+    ExampleSyntheticConnectionManagerClass;
+
+struct _ExampleSyntheticConnectionManagerClass {
+    TpBaseConnectionManagerClass parent_class;
+};
+
+struct _ExampleSyntheticConnectionManager {
+    TpBaseConnectionManager parent;
+};
+
+GType example_synthetic_connection_manager_get_type (void);
+
+/* TYPE MACROS */
+#define EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER \
+  (example_synthetic_connection_manager_get_type ())
+#define EXAMPLE_SYNTHETIC_CONNECTION_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                              EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER, \
+                              ExampleSyntheticConnectionManager))
+#define EXAMPLE_SYNTHETIC_CONNECTION_MANAGER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), \
+                           EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER, \
+                           ExampleSyntheticConnectionManagerClass))
+#define EXAMPLE_IS_SYNTHETIC_CONNECTION_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+                              EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER))
+#define EXAMPLE_IS_SYNTHETIC_CONNECTION_MANAGER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), \
+                           EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER))
+#define EXAMPLE_SYNTHETIC_CONNECTION_MANAGER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                              EXAMPLE_TYPE_SYNTHETIC_CONNECTION_MANAGER, \
+                              ExampleSyntheticConnectionManagerClass))
+
+G_END_DECLS
+
+#endif
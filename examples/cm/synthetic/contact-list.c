@@ -0,0 +1,266 @@
+/*
+ * contact-list.c - a synthetic contact list
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include "contact-list.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_DEFINE_TYPE (ExampleSyntheticContactList,
+    example_synthetic_contact_list,
+    TP_TYPE_BASE_CONTACT_LIST)
+
+enum
+{
+  PROP_SIZE = 1,
+  N_PROPS
+};
+
+struct _ExampleSyntheticContactListPrivate
+{
+  TpBaseConnection *conn;
+  guint size;
+
+  /* The same handles twice: the array is for picking one at random, and
+   * the set is for everything else */
+  GArray *roster;
+  TpHandleSet *contacts;
+
+  gulong status_changed_id;
+};
+
+static void
+example_synthetic_contact_list_init (ExampleSyntheticContactList *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST, ExampleSyntheticContactListPrivate);
+
+  self->priv->roster = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+}
+
+static void
+example_synthetic_contact_list_close_all (ExampleSyntheticContactList *self)
+{
+  tp_clear_pointer (&self->priv->contacts, tp_handle_set_destroy);
+  g_array_set_size (self->priv->roster, 0);
+
+  if (self->priv->status_changed_id != 0)
+    {
+      g_signal_handler_disconnect (self->priv->conn,
+          self->priv->status_changed_id);
+      self->priv->status_changed_id = 0;
+    }
+}
+
+static void
+dispose (GObject *object)
+{
+  ExampleSyntheticContactList *self = EXAMPLE_SYNTHETIC_CONTACT_LIST (object);
+
+  example_synthetic_contact_list_close_all (self);
+  tp_clear_object (&self->priv->conn);
+
+  ((GObjectClass *) example_synthetic_contact_list_parent_class)->dispose (
+    object);
+}
+
+static void
+finalize (GObject *object)
+{
+  ExampleSyntheticContactList *self = EXAMPLE_SYNTHETIC_CONTACT_LIST (object);
+
+  g_array_unref (self->priv->roster);
+
+  ((GObjectClass *) example_synthetic_contact_list_parent_class)->finalize (
+    object);
+}
+
+static void
+get_property (GObject *object,
+              guint property_id,
+              GValue *value,
+              GParamSpec *pspec)
+{
+  ExampleSyntheticContactList *self = EXAMPLE_SYNTHETIC_CONTACT_LIST (object);
+
+  switch (property_id)
+    {
+    case PROP_SIZE:
+      g_value_set_uint (value, self->priv->size);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+set_property (GObject *object,
+              guint property_id,
+              const GValue *value,
+              GParamSpec *pspec)
+{
+  ExampleSyntheticContactList *self = EXAMPLE_SYNTHETIC_CONTACT_LIST (object);
+
+  switch (property_id)
+    {
+    case PROP_SIZE:
+      self->priv->size = g_value_get_uint (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+/* Invent the whole roster at once, as a server would send it: everyone is
+ * subscribed in both directions, and nobody is ever added or removed */
+static void
+receive_roster (ExampleSyntheticContactList *self)
+{
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      self->priv->conn, TP_HANDLE_TYPE_CONTACT);
+  guint i;
+
+  g_array_set_size (self->priv->roster, self->priv->size);
+
+  for (i = 0; i < self->priv->size; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u@synthetic", i);
+      TpHandle handle = tp_handle_ensure (contact_repo, id, NULL, NULL);
+
+      g_assert (handle != 0);
+      g_array_index (self->priv->roster, TpHandle, i) = handle;
+      tp_handle_set_add (self->priv->contacts, handle);
+      g_free (id);
+    }
+
+  tp_base_contact_list_set_list_received ((TpBaseContactList *) self);
+}
+
+static void
+status_changed_cb (TpBaseConnection *conn,
+    guint status,
+    guint reason,
+    ExampleSyntheticContactList *self)
+{
+  switch (status)
+    {
+    case TP_CONNECTION_STATUS_CONNECTED:
+      receive_roster (self);
+      break;
+
+    case TP_CONNECTION_STATUS_DISCONNECTED:
+      example_synthetic_contact_list_close_all (self);
+      /* we were keeping the connection alive until now */
+      tp_clear_object (&self->priv->conn);
+      break;
+    }
+}
+
+static void
+constructed (GObject *object)
+{
+  ExampleSyntheticContactList *self = EXAMPLE_SYNTHETIC_CONTACT_LIST (object);
+  void (*chain_up) (GObject *) =
+      ((GObjectClass *) example_synthetic_contact_list_parent_class)->
+      constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  g_object_get (self,
+      "connection", &self->priv->conn,
+      NULL);
+  g_assert (self->priv->conn != NULL);
+
+  self->priv->contacts = tp_handle_set_new (tp_base_connection_get_handles (
+        self->priv->conn, TP_HANDLE_TYPE_CONTACT));
+
+  self->priv->status_changed_id = g_signal_connect (self->priv->conn,
+      "status-changed", (GCallback) status_changed_cb, self);
+}
+
+static TpHandleSet *
+example_synthetic_contact_list_dup_contacts (TpBaseContactList *contact_list)
+{
+  ExampleSyntheticContactList *self =
+    EXAMPLE_SYNTHETIC_CONTACT_LIST (contact_list);
+
+  return tp_handle_set_copy (self->priv->contacts);
+}
+
+static void
+example_synthetic_contact_list_dup_states (TpBaseContactList *contact_list,
+    TpHandle contact,
+    TpSubscriptionState *subscribe,
+    TpSubscriptionState *publish,
+    gchar **publish_request)
+{
+  ExampleSyntheticContactList *self =
+    EXAMPLE_SYNTHETIC_CONTACT_LIST (contact_list);
+  TpSubscriptionState state = TP_SUBSCRIPTION_STATE_NO;
+
+  if (self->priv->contacts != NULL &&
+      tp_handle_set_is_member (self->priv->contacts, contact))
+    state = TP_SUBSCRIPTION_STATE_YES;
+
+  if (subscribe != NULL)
+    *subscribe = state;
+
+  if (publish != NULL)
+    *publish = state;
+
+  if (publish_request != NULL)
+    *publish_request = NULL;
+}
+
+/*
+ * example_synthetic_contact_list_get_roster:
+ *
+ * Returns: (element-type TpHandle): everyone on the roster, which is
+ *  empty until the connection is connected
+ */
+const GArray *
+example_synthetic_contact_list_get_roster (ExampleSyntheticContactList *self)
+{
+  return self->priv->roster;
+}
+
+static void
+example_synthetic_contact_list_class_init (
+    ExampleSyntheticContactListClass *klass)
+{
+  TpBaseContactListClass *contact_list_class =
+    (TpBaseContactListClass *) klass;
+  GObjectClass *object_class = (GObjectClass *) klass;
+
+  object_class->constructed = constructed;
+  object_class->dispose = dispose;
+  object_class->finalize = finalize;
+  object_class->get_property = get_property;
+  object_class->set_property = set_property;
+
+  g_object_class_install_property (object_class, PROP_SIZE,
+      g_param_spec_uint ("size", "Size",
+        "The number of contacts on the roster",
+        0, G_MAXUINT32, 100,
+        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  contact_list_class->dup_contacts =
+    example_synthetic_contact_list_dup_contacts;
+  contact_list_class->dup_states = example_synthetic_contact_list_dup_states;
+  contact_list_class->get_contact_list_persists =
+    tp_base_contact_list_true_func;
+
+  g_type_class_add_private (klass,
+      sizeof (ExampleSyntheticContactListPrivate));
+}
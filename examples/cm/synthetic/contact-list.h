@@ -0,0 +1,59 @@
+/*
+ * contact-list.h - header for a synthetic contact list
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_CONTACT_LIST_H__
+#define __EXAMPLE_SYNTHETIC_CONTACT_LIST_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticContactList ExampleSyntheticContactList;
+typedef struct _ExampleSyntheticContactListClass
+    ExampleSyntheticContactListClass;
+typedef struct _ExampleSyntheticContactListPrivate
+    ExampleSyntheticContactListPrivate;
+
+struct _ExampleSyntheticContactListClass {
+    TpBaseContactListClass parent_class;
+};
+
+struct _ExampleSyntheticContactList {
+    TpBaseContactList parent;
+
+    ExampleSyntheticContactListPrivate *priv;
+};
+
+GType example_synthetic_contact_list_get_type (void);
+
+#define EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST \
+  (example_synthetic_contact_list_get_type ())
+#define EXAMPLE_SYNTHETIC_CONTACT_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST, \
+                              ExampleSyntheticContactList))
+#define EXAMPLE_SYNTHETIC_CONTACT_LIST_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST, \
+                           ExampleSyntheticContactListClass))
+#define EXAMPLE_IS_SYNTHETIC_CONTACT_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST))
+#define EXAMPLE_IS_SYNTHETIC_CONTACT_LIST_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST))
+#define EXAMPLE_SYNTHETIC_CONTACT_LIST_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST, \
+                              ExampleSyntheticContactListClass))
+
+const GArray *example_synthetic_contact_list_get_roster (
+    ExampleSyntheticContactList *self);
+
+G_END_DECLS
+
+#endif
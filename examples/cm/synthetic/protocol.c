@@ -0,0 +1,205 @@
+/*
+ * protocol.c - a synthetic Protocol
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include "protocol.h"
+
+#include <string.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "conn.h"
+#include "contact-list.h"
+#include "room-manager.h"
+#include "scenario.h"
+
+G_DEFINE_TYPE (ExampleSyntheticProtocol,
+    example_synthetic_protocol,
+    TP_TYPE_BASE_PROTOCOL)
+
+static void
+example_synthetic_protocol_init (
+    ExampleSyntheticProtocol *self)
+{
+}
+
+/* Contacts and rooms both look like name@server, with nothing more to it:
+ * the IDs this CM makes up are already normalized, and it doesn't need to
+ * be any cleverer than that. */
+gboolean
+example_synthetic_protocol_check_id (const gchar *id,
+    gchar **normal,
+    GError **error)
+{
+  const gchar *at;
+
+  g_return_val_if_fail (id != NULL, FALSE);
+
+  at = strchr (id, '@');
+
+  if (at == NULL || at == id || at[1] == '\0' || strchr (at + 1, '@') != NULL)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE,
+          "ID must look like aaa@bbb");
+      return FALSE;
+    }
+
+  if (normal != NULL)
+    *normal = g_utf8_strdown (id, -1);
+
+  return TRUE;
+}
+
+static gboolean
+account_param_filter (const TpCMParamSpec *paramspec,
+                      GValue *value,
+                      GError **error)
+{
+  const gchar *id = g_value_get_string (value);
+
+  return example_synthetic_protocol_check_id (id, NULL, error);
+}
+
+static const TpCMParamSpec example_synthetic_example_params[] = {
+  { "account", "s", G_TYPE_STRING,
+    TP_CONN_MGR_PARAM_FLAG_REQUIRED | TP_CONN_MGR_PARAM_FLAG_REGISTER,
+    NULL,                               /* no default */
+    0,                                  /* unused, formerly struct offset */
+    account_param_filter,
+    NULL,                               /* filter data, unused here */
+    NULL },                             /* setter data, now unused */
+  { "scenario", "s", G_TYPE_STRING,
+    0,                                  /* optional, no default */
+    NULL,                               /* no default */
+    0,                                  /* unused, formerly struct offset */
+    NULL,                               /* no filter */
+    NULL,                               /* filter data, unused here */
+    NULL },                             /* setter data, now unused */
+  { NULL }
+};
+
+static const TpCMParamSpec *
+get_parameters (TpBaseProtocol *self)
+{
+  return example_synthetic_example_params;
+}
+
+static TpBaseConnection *
+new_connection (TpBaseProtocol *protocol,
+    GHashTable *asv,
+    GError **error)
+{
+  ExampleSyntheticConnection *conn;
+  ExampleSyntheticScenario *scenario;
+  const gchar *account;
+  const gchar *filename;
+
+  account = tp_asv_get_string (asv, "account");
+  /* telepathy-glib checked this for us */
+  g_assert (account != NULL);
+
+  /* read the scenario now, so that a broken one makes RequestConnection
+   * fail, rather than leaving a connection that does nothing */
+  filename = tp_asv_get_string (asv, "scenario");
+
+  if (tp_str_empty (filename))
+    scenario = example_synthetic_scenario_new ();
+  else
+    scenario = example_synthetic_scenario_new_from_file (filename, error);
+
+  if (scenario == NULL)
+    return NULL;
+
+  conn = EXAMPLE_SYNTHETIC_CONNECTION (
+      g_object_new (EXAMPLE_TYPE_SYNTHETIC_CONNECTION,
+        "account", account,
+        "protocol", tp_base_protocol_get_name (protocol),
+        "scenario", scenario,
+        NULL));
+
+  example_synthetic_scenario_free (scenario);
+  return (TpBaseConnection *) conn;
+}
+
+static gchar *
+normalize_contact (TpBaseProtocol *self G_GNUC_UNUSED,
+    const gchar *contact,
+    GError **error)
+{
+  gchar *normal;
+
+  if (example_synthetic_protocol_check_id (contact, &normal, error))
+    return normal;
+  else
+    return NULL;
+}
+
+static gchar *
+identify_account (TpBaseProtocol *self G_GNUC_UNUSED,
+    GHashTable *asv,
+    GError **error)
+{
+  const gchar *account = tp_asv_get_string (asv, "account");
+
+  if (account != NULL)
+    return normalize_contact (self, account, error);
+
+  g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+      "'account' parameter not given");
+  return NULL;
+}
+
+static void
+get_connection_details (TpBaseProtocol *self G_GNUC_UNUSED,
+    GStrv *connection_interfaces,
+    GType **channel_managers,
+    gchar **icon_name,
+    gchar **english_name,
+    gchar **vcard_field)
+{
+  if (connection_interfaces != NULL)
+    {
+      *connection_interfaces = g_strdupv (
+          (GStrv) example_synthetic_connection_get_possible_interfaces ());
+    }
+
+  if (channel_managers != NULL)
+    {
+      GType types[] = { EXAMPLE_TYPE_SYNTHETIC_CONTACT_LIST,
+          EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER, G_TYPE_INVALID };
+
+      *channel_managers = g_memdup (types, sizeof (types));
+    }
+
+  if (icon_name != NULL)
+    *icon_name = g_strdup ("face-smile");
+
+  if (english_name != NULL)
+    *english_name = g_strdup ("Synthetic load generator");
+
+  if (vcard_field != NULL)
+    *vcard_field = g_strdup ("x-telepathy-example");
+}
+
+static void
+example_synthetic_protocol_class_init (
+    ExampleSyntheticProtocolClass *klass)
+{
+  TpBaseProtocolClass *base_class =
+      (TpBaseProtocolClass *) klass;
+
+  base_class->get_parameters = get_parameters;
+  base_class->new_connection = new_connection;
+
+  base_class->normalize_contact = normalize_contact;
+  base_class->identify_account = identify_account;
+  base_class->get_connection_details = get_connection_details;
+}
@@ -0,0 +1,61 @@
+/*
+ * protocol.h - header for a synthetic Protocol
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef EXAMPLE_SYNTHETIC_PROTOCOL_H
+#define EXAMPLE_SYNTHETIC_PROTOCOL_H
+
+#include <glib-object.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticProtocol
+    ExampleSyntheticProtocol;
+typedef struct _ExampleSyntheticProtocolClass
+    ExampleSyntheticProtocolClass;
+
+struct _ExampleSyntheticProtocolClass {
+    TpBaseProtocolClass parent_class;
+};
+
+struct _ExampleSyntheticProtocol {
+    TpBaseProtocol parent;
+};
+
+GType example_synthetic_protocol_get_type (void);
+
+#define EXAMPLE_TYPE_SYNTHETIC_PROTOCOL \
+    (example_synthetic_protocol_get_type ())
+#define EXAMPLE_SYNTHETIC_PROTOCOL(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+        EXAMPLE_TYPE_SYNTHETIC_PROTOCOL, \
+        ExampleSyntheticProtocol))
+#define EXAMPLE_SYNTHETIC_PROTOCOL_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_CAST ((klass), \
+        EXAMPLE_TYPE_SYNTHETIC_PROTOCOL, \
+        ExampleSyntheticProtocolClass))
+#define EXAMPLE_IS_SYNTHETIC_PROTOCOL(obj) \
+    (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+        EXAMPLE_TYPE_SYNTHETIC_PROTOCOL))
+#define EXAMPLE_IS_SYNTHETIC_PROTOCOL_CLASS(klass) \
+    (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+        EXAMPLE_TYPE_SYNTHETIC_PROTOCOL))
+#define EXAMPLE_SYNTHETIC_PROTOCOL_GET_CLASS(obj) \
+    (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+        EXAMPLE_TYPE_SYNTHETIC_PROTOCOL, \
+        ExampleSyntheticProtocolClass))
+
+gboolean example_synthetic_protocol_check_id (const gchar *id,
+    gchar **normal,
+    GError **error);
+
+G_END_DECLS
+
+#endif
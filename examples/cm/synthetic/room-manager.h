@@ -0,0 +1,56 @@
+/*
+ * room-manager.h - header for a synthetic channel manager for chatrooms
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_ROOM_MANAGER_H__
+#define __EXAMPLE_SYNTHETIC_ROOM_MANAGER_H__
+
+#include <glib-object.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticRoomManager ExampleSyntheticRoomManager;
+typedef struct _ExampleSyntheticRoomManagerClass
+    ExampleSyntheticRoomManagerClass;
+typedef struct _ExampleSyntheticRoomManagerPrivate
+    ExampleSyntheticRoomManagerPrivate;
+
+struct _ExampleSyntheticRoomManagerClass {
+    GObjectClass parent_class;
+};
+
+struct _ExampleSyntheticRoomManager {
+    GObject parent;
+
+    ExampleSyntheticRoomManagerPrivate *priv;
+};
+
+GType example_synthetic_room_manager_get_type (void);
+
+/* TYPE MACROS */
+#define EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER \
+  (example_synthetic_room_manager_get_type ())
+#define EXAMPLE_SYNTHETIC_ROOM_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER, \
+                              ExampleSyntheticRoomManager))
+#define EXAMPLE_SYNTHETIC_ROOM_MANAGER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER, \
+                           ExampleSyntheticRoomManagerClass))
+#define EXAMPLE_IS_SYNTHETIC_ROOM_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER))
+#define EXAMPLE_IS_SYNTHETIC_ROOM_MANAGER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER))
+#define EXAMPLE_SYNTHETIC_ROOM_MANAGER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_MANAGER, \
+                              ExampleSyntheticRoomManagerClass))
+
+G_END_DECLS
+
+#endif
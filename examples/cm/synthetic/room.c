@@ -0,0 +1,457 @@
+/*
+ * room.c - a synthetic chatroom channel
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include "room.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#include "scenario.h"
+
+G_DEFINE_TYPE_WITH_CODE (ExampleSyntheticRoomChannel,
+    example_synthetic_room_channel,
+    TP_TYPE_BASE_CHANNEL,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_TEXT,
+      tp_message_mixin_text_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_INTERFACE_MESSAGES,
+      tp_message_mixin_messages_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_INTERFACE_GROUP,
+      tp_group_mixin_iface_init);)
+
+/* type definition stuff */
+
+enum
+{
+  PROP_SIZE = 1,
+  PROP_CHURN_RATE,
+  PROP_MESSAGE_RATE,
+  PROP_SEED,
+  N_PROPS
+};
+
+struct _ExampleSyntheticRoomChannelPrivate
+{
+  guint size;
+  gdouble churn_rate;
+  gdouble message_rate;
+  guint32 seed;
+
+  GRand *rand;
+  ExampleSyntheticRate churn;
+  ExampleSyntheticRate messages;
+  guint tick_id;
+  guint n_messages;
+
+  /* Everyone who could be in the room, twice as many as are in it at once;
+   * the first priv->size of them are members, and the rest are not */
+  TpHandle *pool;
+};
+
+static GPtrArray *
+example_synthetic_room_channel_get_interfaces (TpBaseChannel *self)
+{
+  GPtrArray *interfaces;
+
+  interfaces = TP_BASE_CHANNEL_CLASS (
+      example_synthetic_room_channel_parent_class)->get_interfaces (self);
+
+  g_ptr_array_add (interfaces, TP_IFACE_CHANNEL_INTERFACE_GROUP);
+  g_ptr_array_add (interfaces, TP_IFACE_CHANNEL_INTERFACE_MESSAGES);
+  return interfaces;
+};
+
+static void
+example_synthetic_room_channel_init (ExampleSyntheticRoomChannel *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL, ExampleSyntheticRoomChannelPrivate);
+}
+
+/* If @handle is in @undo, it is taken out of it, since the two changes
+ * cancel out; otherwise it goes into @into */
+static void
+record_change (TpIntset *into,
+    TpIntset *undo,
+    TpHandle handle)
+{
+  if (tp_intset_is_member (undo, handle))
+    tp_intset_remove (undo, handle);
+  else
+    tp_intset_add (into, handle);
+}
+
+/* Have @n members leave and @n non-members join, in a single
+ * MembersChanged signal */
+static void
+churn (ExampleSyntheticRoomChannel *self,
+    guint n)
+{
+  TpHandle *pool = self->priv->pool;
+  guint size = self->priv->size;
+  TpIntset *added = tp_intset_new ();
+  TpIntset *removed = tp_intset_new ();
+  guint k;
+
+  for (k = 0; k < n; k++)
+    {
+      guint i = g_rand_int_range (self->priv->rand, 0, size);
+      guint j = g_rand_int_range (self->priv->rand, size, 2 * size);
+      TpHandle leaving = pool[i];
+
+      pool[i] = pool[j];
+      pool[j] = leaving;
+
+      record_change (removed, added, leaving);
+      record_change (added, removed, pool[i]);
+    }
+
+  tp_group_mixin_change_members ((GObject *) self, "", added, removed, NULL,
+      NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+
+  tp_intset_destroy (added);
+  tp_intset_destroy (removed);
+}
+
+static void
+receive_message (ExampleSyntheticRoomChannel *self)
+{
+  TpBaseConnection *conn = tp_base_channel_get_connection (
+      TP_BASE_CHANNEL (self));
+  TpMessage *message = tp_cm_message_new (conn, 1);
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  gchar *text;
+  guint part;
+
+  tp_cm_message_set_sender (message,
+      self->priv->pool[g_rand_int_range (self->priv->rand, 0,
+          self->priv->size)]);
+  tp_message_set_int64 (message, 0, "message-sent", now);
+  tp_message_set_int64 (message, 0, "message-received", now);
+
+  text = g_strdup_printf ("Synthetic message #%u", ++self->priv->n_messages);
+  part = tp_message_append_part (message);
+  tp_message_set_string (message, part, "content-type", "text/plain");
+  tp_message_set_string (message, part, "content", text);
+  g_free (text);
+
+  tp_message_mixin_take_received ((GObject *) self, message);
+}
+
+static gboolean
+tick_cb (gpointer data)
+{
+  ExampleSyntheticRoomChannel *self = data;
+  TpBaseConnection *conn = tp_base_channel_get_connection (
+      TP_BASE_CHANNEL (self));
+  gint64 now = g_get_monotonic_time ();
+  guint n;
+
+  if (tp_base_connection_get_status (conn) != TP_CONNECTION_STATUS_CONNECTED)
+    {
+      self->priv->tick_id = 0;
+      return FALSE;
+    }
+
+  n = example_synthetic_rate_take (&self->priv->churn, now);
+
+  if (n > 0)
+    churn (self, n);
+
+  for (n = example_synthetic_rate_take (&self->priv->messages, now);
+      n > 0;
+      n--)
+    receive_message (self);
+
+  return TRUE;
+}
+
+/* Everyone is already there when we arrive */
+static void
+join_room (ExampleSyntheticRoomChannel *self)
+{
+  TpBaseConnection *conn = tp_base_channel_get_connection (
+      TP_BASE_CHANNEL (self));
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
+      TP_HANDLE_TYPE_CONTACT);
+  TpIntset *added = tp_intset_new ();
+  guint i;
+
+  self->priv->pool = g_new (TpHandle, 2 * self->priv->size);
+
+  for (i = 0; i < 2 * self->priv->size; i++)
+    {
+      gchar *id = g_strdup_printf ("member%u@synthetic", i);
+
+      self->priv->pool[i] = tp_handle_ensure (contact_repo, id, NULL, NULL);
+      g_assert (self->priv->pool[i] != 0);
+      g_free (id);
+
+      if (i < self->priv->size)
+        tp_intset_add (added, self->priv->pool[i]);
+    }
+
+  tp_intset_add (added, tp_base_connection_get_self_handle (conn));
+  tp_group_mixin_change_members ((GObject *) self, "", added, NULL, NULL,
+      NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_intset_destroy (added);
+
+  /* with nobody else in the room, there's nobody to churn or speak */
+  if (self->priv->size == 0)
+    return;
+
+  example_synthetic_rate_init (&self->priv->churn, self->priv->churn_rate);
+  example_synthetic_rate_init (&self->priv->messages,
+      self->priv->message_rate);
+  self->priv->tick_id = g_timeout_add (EXAMPLE_SYNTHETIC_TICK_MS, tick_cb,
+      self);
+}
+
+static void
+send_message (GObject *object,
+    TpMessage *message,
+    TpMessageSendingFlags flags)
+{
+  /* Nobody else is really there, so all we do is claim to have sent it */
+  tp_message_mixin_sent (object, message, flags, "", NULL);
+}
+
+static void
+constructed (GObject *object)
+{
+  static TpChannelTextMessageType const types[] = {
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_ACTION,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NOTICE
+  };
+  static const gchar * const content_types[] = { "text/plain", NULL };
+  ExampleSyntheticRoomChannel *self = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object);
+  TpBaseConnection *conn = tp_base_channel_get_connection (
+      TP_BASE_CHANNEL (self));
+  void (*chain_up) (GObject *) =
+      ((GObjectClass *) example_synthetic_room_channel_parent_class)->
+      constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  self->priv->rand = g_rand_new_with_seed (self->priv->seed);
+
+  tp_base_channel_register (TP_BASE_CHANNEL (self));
+
+  tp_message_mixin_init (object,
+      G_STRUCT_OFFSET (ExampleSyntheticRoomChannel, message_mixin), conn);
+
+  tp_message_mixin_implement_sending (object, send_message,
+      G_N_ELEMENTS (types), types,
+      0, /* no TpMessagePartSupportFlags */
+      0, /* no TpDeliveryReportingSupportFlags */
+      content_types);
+
+  /* Unlike the channelspecific example, everyone uses their global
+   * handle here */
+  tp_group_mixin_init (object,
+      G_STRUCT_OFFSET (ExampleSyntheticRoomChannel, group),
+      tp_base_connection_get_handles (conn, TP_HANDLE_TYPE_CONTACT),
+      tp_base_connection_get_self_handle (conn));
+
+  tp_group_mixin_change_flags (object, TP_CHANNEL_GROUP_FLAG_PROPERTIES, 0);
+
+  join_room (self);
+}
+
+static void
+get_property (GObject *object,
+              guint property_id,
+              GValue *value,
+              GParamSpec *pspec)
+{
+  ExampleSyntheticRoomChannel *self = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object);
+
+  switch (property_id)
+    {
+    case PROP_SIZE:
+      g_value_set_uint (value, self->priv->size);
+      break;
+    case PROP_CHURN_RATE:
+      g_value_set_double (value, self->priv->churn_rate);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_double (value, self->priv->message_rate);
+      break;
+    case PROP_SEED:
+      g_value_set_uint (value, self->priv->seed);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+set_property (GObject *object,
+              guint property_id,
+              const GValue *value,
+              GParamSpec *pspec)
+{
+  ExampleSyntheticRoomChannel *self = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object);
+
+  switch (property_id)
+    {
+    case PROP_SIZE:
+      self->priv->size = g_value_get_uint (value);
+      break;
+    case PROP_CHURN_RATE:
+      self->priv->churn_rate = g_value_get_double (value);
+      break;
+    case PROP_MESSAGE_RATE:
+      self->priv->message_rate = g_value_get_double (value);
+      break;
+    case PROP_SEED:
+      self->priv->seed = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+stop_ticking (ExampleSyntheticRoomChannel *self)
+{
+  if (self->priv->tick_id != 0)
+    {
+      g_source_remove (self->priv->tick_id);
+      self->priv->tick_id = 0;
+    }
+}
+
+static void
+example_synthetic_room_channel_close (TpBaseChannel *base)
+{
+  stop_ticking (EXAMPLE_SYNTHETIC_ROOM_CHANNEL (base));
+  tp_base_channel_destroyed (base);
+}
+
+static void
+dispose (GObject *object)
+{
+  stop_ticking (EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object));
+
+  ((GObjectClass *) example_synthetic_room_channel_parent_class)->dispose (
+      object);
+}
+
+static void
+finalize (GObject *object)
+{
+  ExampleSyntheticRoomChannel *self = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object);
+
+  g_free (self->priv->pool);
+  g_rand_free (self->priv->rand);
+  tp_message_mixin_finalize (object);
+  tp_group_mixin_finalize (object);
+
+  ((GObjectClass *) example_synthetic_room_channel_parent_class)->finalize (
+      object);
+}
+
+static gboolean
+add_member (GObject *object,
+            TpHandle handle,
+            const gchar *message,
+            GError **error)
+{
+  g_set_error (error, TP_ERROR, TP_ERROR_PERMISSION_DENIED,
+      "Nobody can be invited to a synthetic room");
+  return FALSE;
+}
+
+static gboolean
+remove_member_with_reason (GObject *object,
+                           TpHandle handle,
+                           const gchar *message,
+                           guint reason,
+                           GError **error)
+{
+  ExampleSyntheticRoomChannel *self = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (object);
+
+  if (handle == self->group.self_handle)
+    {
+      example_synthetic_room_channel_close (TP_BASE_CHANNEL (self));
+      return TRUE;
+    }
+
+  g_set_error (error, TP_ERROR, TP_ERROR_PERMISSION_DENIED,
+      "You can't eject other users from this channel");
+  return FALSE;
+}
+
+static void
+example_synthetic_room_channel_class_init (
+    ExampleSyntheticRoomChannelClass *klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  TpBaseChannelClass *base_class = TP_BASE_CHANNEL_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass,
+      sizeof (ExampleSyntheticRoomChannelPrivate));
+
+  object_class->constructed = constructed;
+  object_class->set_property = set_property;
+  object_class->get_property = get_property;
+  object_class->dispose = dispose;
+  object_class->finalize = finalize;
+
+  base_class->channel_type = TP_IFACE_CHANNEL_TYPE_TEXT;
+  base_class->target_handle_type = TP_HANDLE_TYPE_ROOM;
+  base_class->get_interfaces = example_synthetic_room_channel_get_interfaces;
+
+  base_class->close = example_synthetic_room_channel_close;
+
+  param_spec = g_param_spec_uint ("size", "Size",
+      "How many other people are in the room at any one time",
+      0, G_MAXINT32 / 2, 50,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SIZE, param_spec);
+
+  param_spec = g_param_spec_double ("churn-rate", "Churn rate",
+      "How many people leave (and as many join) per second",
+      0, G_MAXDOUBLE, 1,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CHURN_RATE,
+      param_spec);
+
+  param_spec = g_param_spec_double ("message-rate", "Message rate",
+      "How many messages are received per second",
+      0, G_MAXDOUBLE, 1,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_MESSAGE_RATE,
+      param_spec);
+
+  param_spec = g_param_spec_uint ("seed", "Seed",
+      "Seed for the room's sequence of random events",
+      0, G_MAXUINT32, 0,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SEED, param_spec);
+
+  tp_group_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (ExampleSyntheticRoomChannelClass, group_class),
+      add_member,
+      NULL);
+  tp_group_mixin_class_allow_self_removal (object_class);
+  tp_group_mixin_class_set_remove_with_reason_func (object_class,
+      remove_member_with_reason);
+  tp_group_mixin_init_dbus_properties (object_class);
+
+  tp_message_mixin_init_dbus_properties (object_class);
+}
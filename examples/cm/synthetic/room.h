@@ -0,0 +1,61 @@
+/*
+ * room.h - header for a synthetic chatroom channel
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __EXAMPLE_SYNTHETIC_ROOM_H__
+#define __EXAMPLE_SYNTHETIC_ROOM_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ExampleSyntheticRoomChannel ExampleSyntheticRoomChannel;
+typedef struct _ExampleSyntheticRoomChannelClass
+    ExampleSyntheticRoomChannelClass;
+typedef struct _ExampleSyntheticRoomChannelPrivate
+    ExampleSyntheticRoomChannelPrivate;
+
+GType example_synthetic_room_channel_get_type (void);
+
+#define EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL \
+  (example_synthetic_room_channel_get_type ())
+#define EXAMPLE_SYNTHETIC_ROOM_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL, \
+                               ExampleSyntheticRoomChannel))
+#define EXAMPLE_SYNTHETIC_ROOM_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL, \
+                            ExampleSyntheticRoomChannelClass))
+#define EXAMPLE_IS_SYNTHETIC_ROOM_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL))
+#define EXAMPLE_IS_SYNTHETIC_ROOM_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL))
+#define EXAMPLE_SYNTHETIC_ROOM_CHANNEL_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_SYNTHETIC_ROOM_CHANNEL, \
+                              ExampleSyntheticRoomChannelClass))
+
+struct _ExampleSyntheticRoomChannelClass {
+    TpBaseChannelClass parent_class;
+
+    TpGroupMixinClass group_class;
+};
+
+struct _ExampleSyntheticRoomChannel {
+    TpBaseChannel parent;
+
+    TpMessageMixin message_mixin;
+    TpGroupMixin group;
+
+    ExampleSyntheticRoomChannelPrivate *priv;
+};
+
+G_END_DECLS
+
+#endif
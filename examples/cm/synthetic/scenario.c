@@ -0,0 +1,181 @@
+/*
+ * scenario.c - the synthetic load scenario
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include "scenario.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+ExampleSyntheticScenario *
+example_synthetic_scenario_new (void)
+{
+  ExampleSyntheticScenario *scenario = g_slice_new0 (ExampleSyntheticScenario);
+
+  scenario->roster_size = 100;
+  scenario->presence_rate = 10;
+  scenario->avatar_rate = 0;
+  scenario->rooms_autojoin = 0;
+  scenario->room_size = 50;
+  scenario->room_churn_rate = 1;
+  scenario->room_message_rate = 1;
+  scenario->seed = 0;
+
+  return scenario;
+}
+
+/* Replace *value with the key's value if it is there, and fail if it is
+ * there but is not a non-negative number */
+static gboolean
+get_rate (GKeyFile *key_file,
+    const gchar *group,
+    const gchar *key,
+    gdouble *value,
+    GError **error)
+{
+  GError *e = NULL;
+  gdouble d;
+
+  if (!g_key_file_has_key (key_file, group, key, NULL))
+    return TRUE;
+
+  d = g_key_file_get_double (key_file, group, key, &e);
+
+  if (e != NULL)
+    {
+      g_propagate_error (error, e);
+      return FALSE;
+    }
+
+  if (d < 0)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "[%s] %s must not be negative", group, key);
+      return FALSE;
+    }
+
+  *value = d;
+  return TRUE;
+}
+
+static gboolean
+get_count (GKeyFile *key_file,
+    const gchar *group,
+    const gchar *key,
+    guint max,
+    guint *value,
+    GError **error)
+{
+  GError *e = NULL;
+  guint64 u;
+
+  if (!g_key_file_has_key (key_file, group, key, NULL))
+    return TRUE;
+
+  u = g_key_file_get_uint64 (key_file, group, key, &e);
+
+  if (e != NULL)
+    {
+      g_propagate_error (error, e);
+      return FALSE;
+    }
+
+  if (u > max)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "[%s] %s is too large", group, key);
+      return FALSE;
+    }
+
+  *value = u;
+  return TRUE;
+}
+
+ExampleSyntheticScenario *
+example_synthetic_scenario_new_from_file (const gchar *filename,
+    GError **error)
+{
+  ExampleSyntheticScenario *scenario = example_synthetic_scenario_new ();
+  GKeyFile *key_file = g_key_file_new ();
+  guint seed = 0;
+
+  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE,
+        error))
+    goto error;
+
+  if (!get_count (key_file, "Roster", "Size", G_MAXINT32,
+        &scenario->roster_size, error) ||
+      !get_rate (key_file, "Presence", "ChangesPerSecond",
+        &scenario->presence_rate, error) ||
+      !get_rate (key_file, "Avatars", "UpdatesPerSecond",
+        &scenario->avatar_rate, error) ||
+      !get_count (key_file, "Rooms", "AutoJoin", G_MAXINT32,
+        &scenario->rooms_autojoin, error) ||
+      !get_count (key_file, "Rooms", "Members", G_MAXINT32 / 2,
+        &scenario->room_size, error) ||
+      !get_rate (key_file, "Rooms", "ChurnPerSecond",
+        &scenario->room_churn_rate, error) ||
+      !get_rate (key_file, "Rooms", "MessagesPerSecond",
+        &scenario->room_message_rate, error) ||
+      !get_count (key_file, "Random", "Seed", G_MAXUINT32, &seed,
+        error))
+    goto error;
+
+  scenario->seed = seed;
+  g_key_file_free (key_file);
+  return scenario;
+
+error:
+  g_prefix_error (error, "Unable to load scenario '%s': ", filename);
+  g_key_file_free (key_file);
+  example_synthetic_scenario_free (scenario);
+  return NULL;
+}
+
+ExampleSyntheticScenario *
+example_synthetic_scenario_copy (const ExampleSyntheticScenario *scenario)
+{
+  return g_slice_dup (ExampleSyntheticScenario, scenario);
+}
+
+void
+example_synthetic_scenario_free (ExampleSyntheticScenario *scenario)
+{
+  g_slice_free (ExampleSyntheticScenario, scenario);
+}
+
+void
+example_synthetic_rate_init (ExampleSyntheticRate *rate,
+    gdouble per_second)
+{
+  rate->rate = per_second;
+  rate->owed = 0;
+  rate->last_time = g_get_monotonic_time ();
+}
+
+/* Return how many events are due between the last call and @now, a time
+ * from g_get_monotonic_time() */
+guint
+example_synthetic_rate_take (ExampleSyntheticRate *rate,
+    gint64 now)
+{
+  guint n;
+
+  rate->owed += rate->rate * (now - rate->last_time) / G_USEC_PER_SEC;
+  rate->last_time = now;
+
+  /* don't let a stall (or a huge rate) build up an unbounded backlog */
+  if (rate->owed > G_MAXUINT16)
+    rate->owed = G_MAXUINT16;
+
+  n = (guint) rate->owed;
+  rate->owed -= n;
+  return n;
+}
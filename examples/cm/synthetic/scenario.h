@@ -0,0 +1,81 @@
+/*
+ * scenario.h - header for the synthetic load scenario
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef EXAMPLE_SYNTHETIC_SCENARIO_H
+#define EXAMPLE_SYNTHETIC_SCENARIO_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Everything a synthetic connection does by itself, read from a GKeyFile
+ * like this (which shows the defaults):
+ *
+ *   [Roster]
+ *   Size=100
+ *
+ *   [Presence]
+ *   ChangesPerSecond=10
+ *
+ *   [Avatars]
+ *   UpdatesPerSecond=0
+ *
+ *   [Rooms]
+ *   AutoJoin=0
+ *   Members=50
+ *   ChurnPerSecond=1
+ *   MessagesPerSecond=1
+ *
+ *   [Random]
+ *   Seed=0
+ *
+ * Rates are per connection, except that the [Rooms] rates apply to each
+ * room separately. Each churn event is one member leaving and another
+ * joining. A seed of 0 means a different sequence of events every time. */
+typedef struct {
+    guint roster_size;
+    gdouble presence_rate;
+    gdouble avatar_rate;
+
+    guint rooms_autojoin;
+    guint room_size;
+    gdouble room_churn_rate;
+    gdouble room_message_rate;
+
+    guint32 seed;
+} ExampleSyntheticScenario;
+
+ExampleSyntheticScenario *example_synthetic_scenario_new (void);
+ExampleSyntheticScenario *example_synthetic_scenario_new_from_file (
+    const gchar *filename,
+    GError **error);
+ExampleSyntheticScenario *example_synthetic_scenario_copy (
+    const ExampleSyntheticScenario *scenario);
+void example_synthetic_scenario_free (ExampleSyntheticScenario *scenario);
+
+/* Used to turn rates into a number of events per tick, carrying fractions
+ * of an event over to the next tick */
+typedef struct {
+    gdouble rate;
+    gdouble owed;
+    gint64 last_time;
+} ExampleSyntheticRate;
+
+void example_synthetic_rate_init (ExampleSyntheticRate *rate,
+    gdouble per_second);
+guint example_synthetic_rate_take (ExampleSyntheticRate *rate,
+    gint64 now);
+
+/* how often the simulation looks at its rates, in milliseconds */
+#define EXAMPLE_SYNTHETIC_TICK_MS 100
+
+G_END_DECLS
+
+#endif
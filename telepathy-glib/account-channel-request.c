@@ -130,6 +130,34 @@ typedef enum
   ACTION_TYPE_OBSERVE
 } ActionType;
 
+/* Requests which are going to be handled by us need a Handler, and
+ * registering one costs a few D-Bus round-trips. So that sending many of
+ * them at once doesn't register as many Handlers, requests on the same
+ * account share one, unless they need it to be configured specially, and
+ * HandleChannels is routed to the right request by object path. */
+typedef struct {
+    gsize refcount;
+    TpAccount *account;
+    TpBaseClient *handler;
+    /* owned ChannelRequest path => borrowed TpAccountChannelRequest, for
+     * requests waiting to be handled */
+    GHashTable *requests;
+    /* owned Channel path => borrowed TpAccountChannelRequest, for
+     * channels we are handling */
+    GHashTable *channels;
+} SharedHandler;
+
+static GQuark
+shared_handler_quark (void)
+{
+  static GQuark q = 0;
+
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string ("tp-account-channel-request-handler");
+
+  return q;
+}
+
 struct _TpAccountChannelRequestPrivate
 {
   TpAccount *account;
@@ -141,6 +169,8 @@ struct _TpAccountChannelRequestPrivate
   gint64 user_action_time;
 
   TpBaseClient *handler;
+  /* if not NULL, handler belongs to this */
+  SharedHandler *shared;
   gboolean ensure;
   GCancellable *cancellable;
   GSimpleAsyncResult *result;
@@ -173,6 +203,132 @@ tp_account_channel_request_init (TpAccountChannelRequest *self)
       TpAccountChannelRequestPrivate);
 }
 
+static void handle_channels (TpSimpleHandler *handler,
+    TpAccount *account,
+    TpConnection *connection,
+    GList *channels,
+    GList *requests_satisfied,
+    gint64 user_action_time,
+    TpHandleChannelsContext *context,
+    gpointer user_data);
+
+static void
+shared_handle_channels (TpSimpleHandler *handler,
+    TpAccount *account,
+    TpConnection *connection,
+    GList *channels,
+    GList *requests_satisfied,
+    gint64 user_action_time,
+    TpHandleChannelsContext *context,
+    gpointer user_data)
+{
+  SharedHandler *shared = user_data;
+  TpAccountChannelRequest *self = NULL;
+  GList *l;
+
+  /* A channel we are already handling is being re-handled, even if one of
+   * our own requests is being satisfied by it: that request will be told
+   * the channel is not its to handle, just as if it had its own Handler. */
+  if (channels != NULL)
+    self = g_hash_table_lookup (shared->channels,
+        tp_proxy_get_object_path (channels->data));
+
+  for (l = requests_satisfied; self == NULL && l != NULL; l = l->next)
+    self = g_hash_table_lookup (shared->requests,
+        tp_proxy_get_object_path (l->data));
+
+  if (self == NULL)
+    {
+      GError error = { TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "These channels do not satisfy any of our requests" };
+
+      DEBUG ("%s", error.message);
+      tp_handle_channels_context_fail (context, &error);
+      return;
+    }
+
+  handle_channels (handler, account, connection, channels,
+      requests_satisfied, user_action_time, context, self);
+}
+
+static SharedHandler *
+shared_handler_ensure (TpAccount *account,
+    GError **error)
+{
+  SharedHandler *shared = g_object_get_qdata (G_OBJECT (account),
+      shared_handler_quark ());
+
+  if (shared != NULL)
+    {
+      shared->refcount++;
+      return shared;
+    }
+
+  shared = g_slice_new0 (SharedHandler);
+  shared->refcount = 1;
+  shared->account = account;
+  shared->requests = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  shared->channels = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  shared->handler = tp_simple_handler_new_with_factory (
+      tp_proxy_get_factory (account), TRUE, FALSE,
+      "TpGLibRequestAndHandle", TRUE, shared_handle_channels, shared, NULL);
+  _tp_base_client_set_only_for_account (shared->handler, account);
+
+  if (!tp_base_client_register (shared->handler, error))
+    {
+      g_object_unref (shared->handler);
+      g_hash_table_unref (shared->requests);
+      g_hash_table_unref (shared->channels);
+      g_slice_free (SharedHandler, shared);
+      return NULL;
+    }
+
+  g_object_set_qdata (G_OBJECT (account), shared_handler_quark (), shared);
+  return shared;
+}
+
+static void
+shared_handler_forget (SharedHandler *shared,
+    GHashTable *table,
+    const gchar *path,
+    TpAccountChannelRequest *self)
+{
+  if (path != NULL && g_hash_table_lookup (table, path) == self)
+    g_hash_table_remove (table, path);
+}
+
+static void
+shared_handler_release (TpAccountChannelRequest *self)
+{
+  SharedHandler *shared = self->priv->shared;
+
+  if (shared == NULL)
+    return;
+
+  self->priv->shared = NULL;
+
+  if (self->priv->chan_request != NULL)
+    shared_handler_forget (shared, shared->requests,
+        tp_proxy_get_object_path (self->priv->chan_request), self);
+
+  if (self->priv->channel != NULL)
+    shared_handler_forget (shared, shared->channels,
+        tp_proxy_get_object_path (self->priv->channel), self);
+
+  if (--shared->refcount > 0)
+    return;
+
+  g_object_set_qdata (G_OBJECT (shared->account), shared_handler_quark (),
+      NULL);
+  tp_base_client_unregister (shared->handler);
+  g_object_unref (shared->handler);
+  g_hash_table_unref (shared->requests);
+  g_hash_table_unref (shared->channels);
+  g_slice_free (SharedHandler, shared);
+}
+
 static void
 request_disconnect (TpAccountChannelRequest *self)
 {
@@ -199,6 +355,7 @@ tp_account_channel_request_dispose (GObject *object)
     G_OBJECT_CLASS (tp_account_channel_request_parent_class)->dispose;
 
   request_disconnect (self);
+  shared_handler_release (self);
 
   if (self->priv->cancel_id != 0)
     g_cancellable_disconnect (self->priv->cancellable, self->priv->cancel_id);
@@ -675,6 +832,10 @@ complete_result (TpAccountChannelRequest *self)
 
   request_disconnect (self);
 
+  if (self->priv->shared != NULL && self->priv->chan_request != NULL)
+    shared_handler_forget (self->priv->shared, self->priv->shared->requests,
+        tp_proxy_get_object_path (self->priv->chan_request), self);
+
   g_simple_async_result_complete_in_idle (self->priv->result);
 
   tp_clear_object (&self->priv->result);
@@ -708,6 +869,11 @@ acr_channel_invalidated_cb (TpProxy *chan,
 {
   /* Channel has been destroyed, we can remove the Handler */
   DEBUG ("Channel has been invalidated (%s), unref ourself", message);
+
+  if (self->priv->shared != NULL)
+    shared_handler_forget (self->priv->shared, self->priv->shared->channels,
+        tp_proxy_get_object_path (chan), self);
+
   g_object_unref (self);
 }
 
@@ -757,6 +923,10 @@ handle_channels (TpSimpleHandler *handler,
 
       g_signal_connect (channel, "invalidated",
           G_CALLBACK (acr_channel_invalidated_cb), self);
+
+      if (self->priv->shared != NULL)
+        g_hash_table_insert (self->priv->shared->channels,
+            g_strdup (tp_proxy_get_object_path (channel)), self);
     }
 
   handle_request_complete (self, channel, context);
@@ -950,6 +1120,10 @@ acr_request_cb (TpChannelDispatcher *cd,
   _tp_channel_request_set_channel_factory (self->priv->chan_request,
       self->priv->factory);
 
+  if (self->priv->shared != NULL)
+    g_hash_table_insert (self->priv->shared->requests,
+        g_strdup (channel_request_path), self);
+
   self->priv->invalidated_sig = g_signal_connect (self->priv->chan_request,
       "invalidated", G_CALLBACK (acr_channel_request_invalidated_cb), self);
 
@@ -1053,23 +1227,38 @@ request_and_handle_channel_async (TpAccountChannelRequest *self,
         callback, user_data))
     return;
 
-  /* Create a temp handler */
-  self->priv->handler = tp_simple_handler_new_with_factory (
-      tp_proxy_get_factory (self->priv->account), TRUE, FALSE,
-      "TpGLibRequestAndHandle", TRUE, handle_channels, self, NULL);
-  _tp_base_client_set_only_for_account (self->priv->handler,
-      self->priv->account);
-
-  _tp_base_client_set_channel_factory (self->priv->handler,
-      self->priv->factory);
+  if (self->priv->factory == NULL && self->priv->delegated_channel_cb == NULL)
+    {
+      /* Use the account's shared temp handler */
+      self->priv->shared = shared_handler_ensure (self->priv->account,
+          &error);
 
-  if (self->priv->delegated_channel_cb != NULL)
+      if (self->priv->shared != NULL)
+        self->priv->handler = g_object_ref (self->priv->shared->handler);
+    }
+  else
     {
-      tp_base_client_set_delegated_channels_callback (self->priv->handler,
-          delegated_channels_cb, self, NULL);
+      /* Create a temp handler */
+      self->priv->handler = tp_simple_handler_new_with_factory (
+          tp_proxy_get_factory (self->priv->account), TRUE, FALSE,
+          "TpGLibRequestAndHandle", TRUE, handle_channels, self, NULL);
+      _tp_base_client_set_only_for_account (self->priv->handler,
+          self->priv->account);
+
+      _tp_base_client_set_channel_factory (self->priv->handler,
+          self->priv->factory);
+
+      if (self->priv->delegated_channel_cb != NULL)
+        {
+          tp_base_client_set_delegated_channels_callback (
+              self->priv->handler, delegated_channels_cb, self, NULL);
+        }
+
+      if (!tp_base_client_register (self->priv->handler, &error))
+        tp_clear_object (&self->priv->handler);
     }
 
-  if (!tp_base_client_register (self->priv->handler, &error))
+  if (self->priv->handler == NULL)
     {
       DEBUG ("Failed to register temp handler: %s", error->message);
 
@@ -2044,7 +2233,7 @@ tp_account_channel_request_set_request_property (
   g_return_if_fail (TP_IS_ACCOUNT_CHANNEL_REQUEST (self));
   g_return_if_fail (!self->priv->requested);
 
-  v = g_slice_new0 (GValue);
+  v = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
   dbus_g_value_parse_g_variant (value, v);
 
   g_hash_table_insert (self->priv->request, g_strdup (name), v);
@@ -112,6 +112,15 @@ struct _TpAccountManagerPrivate {
   gchar *most_available_status;
   gchar *most_available_status_message;
 
+  /* TpConnectionPresenceType => set of borrowed TpAccount from accounts
+   * whose current presence is of that type, so that the most available
+   * account can be found without looking at all of them. Unexpected
+   * presence types are counted as UNKNOWN, like
+   * tp_connection_presence_type_cmp_availability() does. */
+  GHashTable *accounts_by_presence[TP_NUM_CONNECTION_PRESENCE_TYPES];
+  /* borrowed TpAccount from accounts => the index above it is in */
+  GHashTable *account_presences;
+
   /* requested presence, could be different
    * from the actual one. */
   TpConnectionPresenceType requested_presence;
@@ -119,6 +128,16 @@ struct _TpAccountManagerPrivate {
   gchar *requested_status_message;
 
   guint n_preparing_accounts;
+
+  /* Set by tp_account_manager_set_lazy_accounts(): owned object path =>
+   * itself, for every valid account which is not yet in accounts;
+   * NULL unless accounts are being prepared lazily */
+  GHashTable *lazy_paths;
+  /* owned object paths from lazy_paths which we have not started
+   * preparing yet, in the order the account manager listed them */
+  GQueue lazy_queue;
+  guint max_preparing_lazy_accounts;
+  guint n_preparing_lazy_accounts;
 };
 
 typedef struct {
@@ -208,6 +227,7 @@ static void
 tp_account_manager_init (TpAccountManager *self)
 {
   TpAccountManagerPrivate *priv;
+  guint i;
 
   priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_ACCOUNT_MANAGER,
       TpAccountManagerPrivate);
@@ -218,6 +238,11 @@ tp_account_manager_init (TpAccountManager *self)
 
   priv->accounts = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) g_object_unref);
+
+  for (i = 0; i < TP_NUM_CONNECTION_PRESENCE_TYPES; i++)
+    priv->accounts_by_presence[i] = g_hash_table_new (NULL, NULL);
+
+  priv->account_presences = g_hash_table_new (NULL, NULL);
   self->priv->legacy_accounts = g_hash_table_new_full (
       g_str_hash, g_str_equal, g_free, g_object_unref);
 }
@@ -257,6 +282,7 @@ _tp_account_manager_name_owner_cb (TpDBusDaemon *proxy,
 }
 
 static void insert_account (TpAccountManager *self, TpAccount *account);
+static void forget_account (TpAccountManager *self, TpAccount *account);
 
 static void
 validity_changed_account_prepared_cb (GObject *object,
@@ -287,6 +313,9 @@ OUT:
   g_object_unref (self);
 }
 
+static void lazy_accounts_forget (TpAccountManager *self,
+    const gchar *path);
+
 static void
 _tp_account_manager_validity_changed_cb (TpAccountManager *proxy,
     const gchar *path,
@@ -302,13 +331,16 @@ _tp_account_manager_validity_changed_cb (TpAccountManager *proxy,
 
   if (!valid)
     {
+      /* If we hadn't got round to preparing it, don't */
+      lazy_accounts_forget (manager, path);
+
       /* If account became invalid, but we didn't have it anyway, ignore. */
       account = g_hash_table_lookup (priv->accounts, path);
       if (account == NULL)
         return;
 
       g_object_ref (account);
-      g_hash_table_remove (priv->accounts, path);
+      forget_account (manager, account);
 
       g_signal_emit (manager, signals[ACCOUNT_VALIDITY_CHANGED], 0,
           account, FALSE);
@@ -318,6 +350,12 @@ _tp_account_manager_validity_changed_cb (TpAccountManager *proxy,
       return;
     }
 
+  /* If it's waiting to be prepared lazily, the signal will be emitted when
+   * that happens */
+  if (priv->lazy_paths != NULL &&
+      g_hash_table_lookup (priv->lazy_paths, path) != NULL)
+    return;
+
   account = tp_simple_client_factory_ensure_account (
       tp_proxy_get_factory (manager), path, NULL, &error);
   if (account == NULL)
@@ -338,48 +376,69 @@ _tp_account_manager_validity_changed_cb (TpAccountManager *proxy,
   g_object_unref (account);
 }
 
+static void
+account_presences_remove (TpAccountManager *self,
+    TpAccount *account)
+{
+  gpointer bucket;
+
+  if (!g_hash_table_lookup_extended (self->priv->account_presences, account,
+          NULL, &bucket))
+    return;
+
+  g_hash_table_remove (
+      self->priv->accounts_by_presence[GPOINTER_TO_UINT (bucket)], account);
+  g_hash_table_remove (self->priv->account_presences, account);
+}
+
+static void
+account_presences_set (TpAccountManager *self,
+    TpAccount *account,
+    TpConnectionPresenceType presence)
+{
+  guint bucket = presence;
+
+  if (bucket >= TP_NUM_CONNECTION_PRESENCE_TYPES)
+    bucket = TP_CONNECTION_PRESENCE_TYPE_UNKNOWN;
+
+  account_presences_remove (self, account);
+  g_hash_table_add (self->priv->accounts_by_presence[bucket], account);
+  g_hash_table_insert (self->priv->account_presences, account,
+      GUINT_TO_POINTER (bucket));
+}
+
 static void
 _tp_account_manager_update_most_available_presence (TpAccountManager *manager)
 {
+  /* Presence types more available than OFFLINE, most available first. If
+   * there are none, use an account having UNSET as presence as the 'best'
+   * one, see tp_account_manager_get_most_available_presence() */
+  static const TpConnectionPresenceType by_availability[] = {
+      TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+      TP_CONNECTION_PRESENCE_TYPE_BUSY,
+      TP_CONNECTION_PRESENCE_TYPE_AWAY,
+      TP_CONNECTION_PRESENCE_TYPE_EXTENDED_AWAY,
+      TP_CONNECTION_PRESENCE_TYPE_HIDDEN,
+      TP_CONNECTION_PRESENCE_TYPE_UNSET
+  };
   TpAccountManagerPrivate *priv = manager->priv;
-  TpConnectionPresenceType presence = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
   TpAccount *account = NULL;
-  GHashTableIter iter;
-  gpointer value;
-  TpAccount *has_unset_presence = NULL;
-
-  /* this presence is equal to the presence of the account with the
-   * highest availability */
+  guint i;
 
-  g_hash_table_iter_init (&iter, priv->accounts);
-  while (g_hash_table_iter_next (&iter, NULL, &value))
+  for (i = 0; i < G_N_ELEMENTS (by_availability); i++)
     {
-      TpAccount *a = TP_ACCOUNT (value);
-      TpConnectionPresenceType p;
+      GHashTable *bucket = priv->accounts_by_presence[by_availability[i]];
+      GHashTableIter iter;
+      gpointer key;
 
-      p = tp_account_get_current_presence (a, NULL, NULL);
+      g_hash_table_iter_init (&iter, bucket);
 
-      if (p == TP_CONNECTION_PRESENCE_TYPE_UNSET)
+      /* any of them will do */
+      if (g_hash_table_iter_next (&iter, &key, NULL))
         {
-          has_unset_presence = a;
-          /* There is no point comparing the presence as UNSET is the
-           * 'smallest' presence of all */
-          continue;
+          account = key;
+          break;
         }
-
-      if (tp_connection_presence_type_cmp_availability (p, presence) > 0)
-        {
-          account = a;
-          presence = p;
-        }
-    }
-
-  if (presence == TP_CONNECTION_PRESENCE_TYPE_OFFLINE &&
-      has_unset_presence != NULL)
-    {
-      /* Use an account having UNSET as presence as the 'best' one,
-       * see tp_account_manager_get_most_available_presence() */
-      account = has_unset_presence;
     }
 
   priv->most_available_account = account;
@@ -402,6 +461,20 @@ _tp_account_manager_update_most_available_presence (TpAccountManager *manager)
       priv->most_available_status_message);
 }
 
+/* The caller must hold a reference to @account */
+static void
+forget_account (TpAccountManager *self,
+    TpAccount *account)
+{
+  account_presences_remove (self, account);
+  g_hash_table_remove (self->priv->accounts,
+      tp_proxy_get_object_path (account));
+
+  /* don't keep a dangling pointer to it */
+  if (self->priv->most_available_account == account)
+    _tp_account_manager_update_most_available_presence (self);
+}
+
 static void
 _tp_account_manager_check_core_ready (TpAccountManager *manager)
 {
@@ -464,25 +537,131 @@ OUT:
 }
 
 static void
-_tp_account_manager_got_all_cb (TpProxy *proxy,
-    GHashTable *properties,
-    const GError *error,
-    gpointer user_data,
-    GObject *weak_object)
+lazy_accounts_forget (TpAccountManager *self,
+    const gchar *path)
 {
-  TpAccountManager *manager = TP_ACCOUNT_MANAGER (weak_object);
-  GPtrArray *valid_accounts;
-  guint i;
+  GList *link;
 
-  if (error != NULL)
+  if (self->priv->lazy_paths == NULL ||
+      !g_hash_table_remove (self->priv->lazy_paths, path))
+    return;
+
+  link = g_queue_find_custom (&self->priv->lazy_queue, path,
+      (GCompareFunc) g_strcmp0);
+
+  if (link != NULL)
     {
-      DEBUG ("Failed to get account manager properties: %s", error->message);
-      tp_proxy_invalidate (proxy, error);
+      g_free (link->data);
+      g_queue_delete_link (&self->priv->lazy_queue, link);
+    }
+}
+
+static void lazy_accounts_pump (TpAccountManager *self);
+
+static void
+lazy_account_prepared_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  TpAccountManager *self = user_data;
+  TpAccount *account = (TpAccount *) object;
+  const gchar *path = tp_proxy_get_object_path (account);
+  GError *error = NULL;
+
+  self->priv->n_preparing_lazy_accounts--;
+
+  if (self->priv->dispose_run)
+    goto OUT;
+
+  if (!tp_proxy_prepare_finish (object, res, &error))
+    {
+      DEBUG ("Error preparing account %s: %s", path, error->message);
+      g_clear_error (&error);
+      g_hash_table_remove (self->priv->lazy_paths, path);
+    }
+  /* It could have become invalid while we were preparing it, in which case
+   * it will no longer be in lazy_paths */
+  else if (g_hash_table_remove (self->priv->lazy_paths, path) &&
+      tp_account_is_valid (account) &&
+      tp_proxy_get_invalidated (account) == NULL)
+    {
+      DEBUG ("Account %s was prepared lazily", path);
+      insert_account (self, account);
+      _tp_account_manager_update_most_available_presence (self);
+      g_signal_emit (self, signals[ACCOUNT_VALIDITY_CHANGED], 0,
+          account, TRUE);
+    }
+
+  lazy_accounts_pump (self);
+
+OUT:
+  g_object_unref (self);
+}
+
+static void
+lazy_accounts_start_preparing (TpAccountManager *self,
+    const gchar *path)
+{
+  TpAccount *account;
+  GArray *features;
+  GError *error = NULL;
+
+  account = tp_simple_client_factory_ensure_account (
+      tp_proxy_get_factory (self), path, NULL, &error);
+  if (account == NULL)
+    {
+      DEBUG ("failed to create TpAccount: %s", error->message);
+      g_clear_error (&error);
+      g_hash_table_remove (self->priv->lazy_paths, path);
       return;
     }
 
-  valid_accounts = tp_asv_get_boxed (properties, "ValidAccounts",
-      TP_ARRAY_TYPE_OBJECT_PATH_LIST);
+  features = tp_simple_client_factory_dup_account_features (
+      tp_proxy_get_factory (self), account);
+
+  self->priv->n_preparing_lazy_accounts++;
+  tp_proxy_prepare_async (account, (GQuark *) features->data,
+      lazy_account_prepared_cb, g_object_ref (self));
+
+  g_array_unref (features);
+  g_object_unref (account);
+}
+
+static void
+lazy_accounts_pump (TpAccountManager *self)
+{
+  while (self->priv->n_preparing_lazy_accounts <
+          self->priv->max_preparing_lazy_accounts &&
+      !g_queue_is_empty (&self->priv->lazy_queue))
+    {
+      gchar *path = g_queue_pop_head (&self->priv->lazy_queue);
+
+      lazy_accounts_start_preparing (self, path);
+      g_free (path);
+    }
+
+  DEBUG ("%u accounts being prepared in the background, %u waiting",
+      self->priv->n_preparing_lazy_accounts,
+      g_queue_get_length (&self->priv->lazy_queue));
+}
+
+static void
+object_path_list_free (gpointer paths)
+{
+  g_boxed_free (TP_ARRAY_TYPE_OBJECT_PATH_LIST, paths);
+}
+
+/*
+ * prepare_initial_accounts:
+ * @bulk: (allow-none): account path => its properties, from
+ *  GetAccountProperties
+ */
+static void
+prepare_initial_accounts (TpAccountManager *manager,
+    const GPtrArray *valid_accounts,
+    GHashTable *bulk)
+{
+  guint i;
 
   for (i = 0; i < valid_accounts->len; i++)
     {
@@ -492,7 +671,8 @@ _tp_account_manager_got_all_cb (TpProxy *proxy,
       GError *e = NULL;
 
       account = tp_simple_client_factory_ensure_account (
-          tp_proxy_get_factory (manager), path, NULL, &e);
+          tp_proxy_get_factory (manager), path,
+          bulk == NULL ? NULL : g_hash_table_lookup (bulk, path), &e);
       if (account == NULL)
         {
           DEBUG ("failed to create TpAccount: %s", e->message);
@@ -514,6 +694,90 @@ _tp_account_manager_got_all_cb (TpProxy *proxy,
   _tp_account_manager_check_core_ready (manager);
 }
 
+static void
+got_account_properties_cb (TpAccountManager *manager,
+    GHashTable *properties,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  const GPtrArray *valid_accounts = user_data;
+
+  if (error != NULL)
+    {
+      /* each TpAccount will just have to fetch its own properties */
+      DEBUG ("GetAccountProperties failed, presumably not implemented: %s",
+          error->message);
+      properties = NULL;
+    }
+  else
+    {
+      DEBUG ("Got properties of %u accounts in bulk",
+          g_hash_table_size (properties));
+    }
+
+  prepare_initial_accounts (manager, valid_accounts, properties);
+}
+
+static void
+_tp_account_manager_got_all_cb (TpProxy *proxy,
+    GHashTable *properties,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  TpAccountManager *manager = TP_ACCOUNT_MANAGER (weak_object);
+  GPtrArray *valid_accounts;
+  guint i;
+
+  if (error != NULL)
+    {
+      DEBUG ("Failed to get account manager properties: %s", error->message);
+      tp_proxy_invalidate (proxy, error);
+      return;
+    }
+
+  valid_accounts = tp_asv_get_boxed (properties, "ValidAccounts",
+      TP_ARRAY_TYPE_OBJECT_PATH_LIST);
+
+  if (manager->priv->lazy_paths != NULL)
+    {
+      /* Don't make any TpAccount objects yet: each of them would call
+       * GetAll straight away */
+      for (i = 0; i < valid_accounts->len; i++)
+        {
+          const gchar *path = g_ptr_array_index (valid_accounts, i);
+
+          if (g_hash_table_lookup (manager->priv->accounts, path) != NULL ||
+              g_hash_table_lookup (manager->priv->lazy_paths, path) != NULL)
+            continue;
+
+          g_hash_table_add (manager->priv->lazy_paths, g_strdup (path));
+          g_queue_push_tail (&manager->priv->lazy_queue, g_strdup (path));
+        }
+
+      DEBUG ("%u accounts to be prepared lazily",
+          g_hash_table_size (manager->priv->lazy_paths));
+
+      lazy_accounts_pump (manager);
+      _tp_account_manager_check_core_ready (manager);
+      return;
+    }
+
+  if (valid_accounts->len > 0)
+    {
+      /* Ask for all their properties at once, rather than making each
+       * TpAccount call GetAll */
+      tp_cli_account_manager_call_get_account_properties (manager, -1,
+          valid_accounts, got_account_properties_cb,
+          g_boxed_copy (TP_ARRAY_TYPE_OBJECT_PATH_LIST, valid_accounts),
+          object_path_list_free, G_OBJECT (manager));
+      return;
+    }
+
+  _tp_account_manager_check_core_ready (manager);
+}
+
 static void
 _tp_account_manager_constructed (GObject *object)
 {
@@ -541,6 +805,7 @@ _tp_account_manager_finalize (GObject *object)
 {
   TpAccountManager *manager = TP_ACCOUNT_MANAGER (object);
   TpAccountManagerPrivate *priv = manager->priv;
+  guint i;
 
   g_free (priv->most_available_status);
   g_free (priv->most_available_status_message);
@@ -548,6 +813,15 @@ _tp_account_manager_finalize (GObject *object)
   g_free (priv->requested_status);
   g_free (priv->requested_status_message);
 
+  for (i = 0; i < TP_NUM_CONNECTION_PRESENCE_TYPES; i++)
+    g_hash_table_unref (priv->accounts_by_presence[i]);
+
+  g_hash_table_unref (priv->account_presences);
+
+  tp_clear_pointer (&priv->lazy_paths, g_hash_table_unref);
+  g_queue_foreach (&priv->lazy_queue, (GFunc) g_free, NULL);
+  g_queue_clear (&priv->lazy_queue);
+
   G_OBJECT_CLASS (tp_account_manager_parent_class)->finalize (object);
 }
 
@@ -873,6 +1147,12 @@ tp_account_manager_can_set_default (void)
  * will be created the first time this function is called, using a new
  * #TpAutomaticClientFactory as its #TpProxy:factory.
  *
+ * The cached #TpAccountManager is shared by every thread, and its callbacks
+ * run in the main context of the thread that created it. A worker thread
+ * with its own thread-default main context should instead create a
+ * #TpSimpleClientFactory there, and call
+ * tp_account_manager_new_with_factory().
+ *
  * Returns: (transfer full): an account manager proxy on the starter or session
  *          bus, or %NULL if it wasn't possible to get a dbus daemon proxy for
  *          the appropriate bus
@@ -932,6 +1212,13 @@ _tp_account_manager_account_presence_changed_cb (TpAccount *account,
   gchar *s;
   gchar *msg;
 
+  /* It might have been removed from our accounts since we connected */
+  if (g_hash_table_lookup (priv->accounts,
+          tp_proxy_get_object_path (account)) != account)
+    return;
+
+  account_presences_set (manager, account, presence);
+
   if (tp_connection_presence_type_cmp_availability (presence,
           priv->most_available_presence) > 0)
     {
@@ -985,8 +1272,7 @@ _tp_account_manager_account_invalidated_cb (TpProxy *proxy,
     return;
 
   g_object_ref (account);
-  g_hash_table_remove (priv->accounts,
-      tp_proxy_get_object_path (account));
+  forget_account (manager, account);
 
   g_signal_emit (manager, signals[ACCOUNT_REMOVED], 0, account);
   g_object_unref (account);
@@ -1012,6 +1298,8 @@ insert_account (TpAccountManager *self,
   g_hash_table_insert (self->priv->accounts,
       g_strdup (tp_proxy_get_object_path (account)),
       g_object_ref (account));
+  account_presences_set (self, account,
+      tp_account_get_current_presence (account, NULL, NULL));
 
   /* If a global presence has been requested, set in on new accounts as well */
   if (self->priv->requested_presence != TP_CONNECTION_PRESENCE_TYPE_UNSET)
@@ -1179,6 +1467,32 @@ tp_account_manager_dup_valid_accounts (TpAccountManager *manager)
   return ret;
 }
 
+
+/* save the requested presence, to use it in case we create new accounts or
+ * some accounts become ready. */
+static void
+save_requested_presence (TpAccountManager *manager,
+    TpConnectionPresenceType type,
+    const gchar *status,
+    const gchar *message)
+{
+  TpAccountManagerPrivate *priv = manager->priv;
+
+  priv->requested_presence = type;
+
+  if (tp_strdiff (priv->requested_status, status))
+    {
+      g_free (priv->requested_status);
+      priv->requested_status = g_strdup (status);
+    }
+
+  if (tp_strdiff (priv->requested_status_message, message))
+    {
+      g_free (priv->requested_status_message);
+      priv->requested_status_message = g_strdup (message);
+    }
+}
+
 /**
  * tp_account_manager_set_all_requested_presences:
  * @manager: a #TpAccountManager
@@ -1226,21 +1540,239 @@ tp_account_manager_set_all_requested_presences (TpAccountManager *manager,
             NULL, NULL);
     }
 
-  /* save the requested presence, to use it in case we create new accounts or
-   * some accounts become ready. */
-  priv->requested_presence = type;
+  save_requested_presence (manager, type, status, message);
+}
 
-  if (tp_strdiff (priv->requested_status, status))
+typedef struct {
+    TpConnectionPresenceType type;
+    gchar *status;
+    gchar *message;
+    guint max_in_flight;
+    guint max_jitter_ms;
+    /* owned TpAccount, not yet requested */
+    GQueue pending;
+    /* requested or waiting for their jitter to expire */
+    guint in_flight;
+    /* owned TpAccount => owned GError */
+    GHashTable *failures;
+} SetAllPresences;
+
+static void
+set_all_presences_free (gpointer p)
+{
+  SetAllPresences *data = p;
+  TpAccount *account;
+
+  g_assert (data->in_flight == 0);
+
+  while ((account = g_queue_pop_head (&data->pending)) != NULL)
+    g_object_unref (account);
+
+  g_free (data->status);
+  g_free (data->message);
+  g_hash_table_unref (data->failures);
+  g_slice_free (SetAllPresences, data);
+}
+
+typedef struct {
+    GSimpleAsyncResult *result;
+    TpAccount *account;
+} SetAllPresencesItem;
+
+static void set_all_presences_continue (GSimpleAsyncResult *result);
+
+static void
+set_all_presences_request_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  SetAllPresences *data = g_simple_async_result_get_op_res_gpointer (result);
+  GError *error = NULL;
+
+  if (!tp_account_request_presence_finish (TP_ACCOUNT (source), res, &error))
     {
-      g_free (priv->requested_status);
-      priv->requested_status = g_strdup (status);
+      DEBUG ("failed to request presence on %s: %s",
+          tp_proxy_get_object_path (source), error->message);
+      g_hash_table_insert (data->failures, g_object_ref (source), error);
     }
 
-  if (tp_strdiff (priv->requested_status_message, message))
+  data->in_flight--;
+  set_all_presences_continue (result);
+  g_object_unref (result);
+}
+
+static gboolean
+set_all_presences_request (gpointer p)
+{
+  SetAllPresencesItem *item = p;
+  SetAllPresences *data = g_simple_async_result_get_op_res_gpointer (
+      item->result);
+
+  /* the result's ref is passed on to the callback */
+  tp_account_request_presence_async (item->account, data->type,
+      data->status, data->message, set_all_presences_request_cb,
+      item->result);
+
+  g_object_unref (item->account);
+  g_slice_free (SetAllPresencesItem, item);
+  return FALSE;
+}
+
+static void
+set_all_presences_continue (GSimpleAsyncResult *result)
+{
+  SetAllPresences *data = g_simple_async_result_get_op_res_gpointer (result);
+
+  while (!g_queue_is_empty (&data->pending) &&
+      (data->max_in_flight == 0 || data->in_flight < data->max_in_flight))
     {
-      g_free (priv->requested_status_message);
-      priv->requested_status_message = g_strdup (message);
+      SetAllPresencesItem *item = g_slice_new (SetAllPresencesItem);
+
+      item->result = g_object_ref (result);
+      item->account = g_queue_pop_head (&data->pending);
+      data->in_flight++;
+
+      /* spreading the requests out means that the connections don't all
+       * broadcast their new presence at the same moment */
+      if (data->max_jitter_ms > 0)
+        _tp_timeout_add (TP_LATENCY_CLASS_BULK,
+            g_random_int_range (0, data->max_jitter_ms + 1),
+            set_all_presences_request, item);
+      else
+        set_all_presences_request (item);
+    }
+
+  if (data->in_flight == 0)
+    g_simple_async_result_complete_in_idle (result);
+}
+
+/**
+ * tp_account_manager_set_all_requested_presences_async:
+ * @manager: a #TpAccountManager
+ * @type: a presence type to request
+ * @status: a status to request
+ * @message: a status message to request
+ * @max_in_flight: the maximum number of accounts whose presence is being
+ *  requested at any one time, or 0 for no limit
+ * @max_jitter_ms: if non-zero, wait a random time of up to this many
+ *  milliseconds before making each request
+ * @callback: a callback to call when every request has finished
+ * @user_data: data to pass to @callback
+ *
+ * The same as tp_account_manager_set_all_requested_presences(), but
+ * limits the number of requests made at the same time, and reports the
+ * result of each request.
+ *
+ * With many accounts, requesting a presence on all of them at once makes
+ * every connection broadcast its new presence at the same moment; setting
+ * @max_in_flight and @max_jitter_ms spreads the requests out.
+ *
+ * As with tp_account_manager_set_all_requested_presences(), only the
+ * accounts whose %TP_ACCOUNT_FEATURE_CORE is already prepared are changed,
+ * and the requested presence is remembered for accounts that appear later.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_account_manager_set_all_requested_presences_async (
+    TpAccountManager *manager,
+    TpConnectionPresenceType type,
+    const gchar *status,
+    const gchar *message,
+    guint max_in_flight,
+    guint max_jitter_ms,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result;
+  SetAllPresences *data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (TP_IS_ACCOUNT_MANAGER (manager));
+
+  DEBUG ("request presence, type: %d, status: %s, message: %s, "
+      "at most %u at a time", type, status, message, max_in_flight);
+
+  result = g_simple_async_result_new (G_OBJECT (manager), callback,
+      user_data, tp_account_manager_set_all_requested_presences_async);
+
+  data = g_slice_new0 (SetAllPresences);
+  data->type = type;
+  data->status = g_strdup (status);
+  data->message = g_strdup (message);
+  data->max_in_flight = max_in_flight;
+  data->max_jitter_ms = max_jitter_ms;
+  g_queue_init (&data->pending);
+  data->failures = g_hash_table_new_full (NULL, NULL, g_object_unref,
+      (GDestroyNotify) g_error_free);
+  g_simple_async_result_set_op_res_gpointer (result, data,
+      set_all_presences_free);
+
+  g_hash_table_iter_init (&iter, manager->priv->accounts);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      if (tp_proxy_is_prepared (value, TP_ACCOUNT_FEATURE_CORE))
+        g_queue_push_tail (&data->pending, g_object_ref (value));
     }
+
+  save_requested_presence (manager, type, status, message);
+
+  set_all_presences_continue (result);
+  g_object_unref (result);
+}
+
+/**
+ * tp_account_manager_set_all_requested_presences_finish:
+ * @manager: a #TpAccountManager
+ * @result: the result passed to the callback of
+ *  tp_account_manager_set_all_requested_presences_async()
+ * @failures: (out) (transfer container) (allow-none) (element-type
+ *  TelepathyGLib.Account GLib.Error): if not %NULL, used to return a map
+ *  from each account whose request failed to how it failed, which must be
+ *  freed with g_hash_table_unref()
+ * @error: used to report the first failure, if any
+ *
+ * Finish an operation started by
+ * tp_account_manager_set_all_requested_presences_async().
+ *
+ * Returns: %TRUE if the presence was requested successfully on every
+ *  account
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_account_manager_set_all_requested_presences_finish (
+    TpAccountManager *manager,
+    GAsyncResult *result,
+    GHashTable **failures,
+    GError **error)
+{
+  GSimpleAsyncResult *simple = (GSimpleAsyncResult *) result;
+  SetAllPresences *data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_val_if_fail (TP_IS_ACCOUNT_MANAGER (manager), FALSE);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+        G_OBJECT (manager),
+        tp_account_manager_set_all_requested_presences_async), FALSE);
+
+  data = g_simple_async_result_get_op_res_gpointer (simple);
+
+  if (failures != NULL)
+    *failures = g_hash_table_ref (data->failures);
+
+  g_hash_table_iter_init (&iter, data->failures);
+
+  if (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      g_propagate_error (error, g_error_copy (value));
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 /**
@@ -1453,6 +1985,194 @@ tp_account_manager_create_account_finish (TpAccountManager *manager,
       tp_account_manager_create_account_finish, /* do not copy */);
 }
 
+/**
+ * tp_account_manager_set_lazy_accounts:
+ * @manager: a #TpAccountManager
+ * @max_preparing: the maximum number of accounts to prepare at the same
+ *  time in the background, or 0 to only prepare them on demand
+ *
+ * Normally, %TP_ACCOUNT_MANAGER_FEATURE_CORE is not prepared until a
+ * #TpAccount has been created and prepared for every valid account, each
+ * of which needs its own D-Bus round-trips. With a large number of accounts,
+ * this can take a long time.
+ *
+ * After this function has been called, %TP_ACCOUNT_MANAGER_FEATURE_CORE is
+ * prepared as soon as the account manager has listed the valid accounts.
+ * Their object paths are available from
+ * tp_account_manager_dup_valid_account_paths() straight away, but their
+ * #TpAccount objects are only created and prepared when
+ * tp_account_manager_prepare_account_async() is called, or in the
+ * background, at most @max_preparing at a time. As each account is
+ * prepared, it is added to tp_account_manager_dup_valid_accounts() and
+ * #TpAccountManager::account-validity-changed is emitted for it.
+ *
+ * This must be called before %TP_ACCOUNT_MANAGER_FEATURE_CORE has been
+ * prepared; it may be called again later to change @max_preparing.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_account_manager_set_lazy_accounts (TpAccountManager *manager,
+    guint max_preparing)
+{
+  TpAccountManagerPrivate *priv;
+
+  g_return_if_fail (TP_IS_ACCOUNT_MANAGER (manager));
+
+  priv = manager->priv;
+
+  if (priv->lazy_paths == NULL)
+    {
+      g_return_if_fail (!tp_proxy_is_prepared (manager,
+            TP_ACCOUNT_MANAGER_FEATURE_CORE));
+      g_return_if_fail (priv->n_preparing_accounts == 0);
+
+      priv->lazy_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, NULL);
+    }
+
+  priv->max_preparing_lazy_accounts = max_preparing;
+  lazy_accounts_pump (manager);
+}
+
+/**
+ * tp_account_manager_dup_valid_account_paths:
+ * @manager: a #TpAccountManager
+ *
+ * Return the object paths of all the valid accounts in @manager, including
+ * those which tp_account_manager_set_lazy_accounts() means have not been
+ * prepared yet, and so are not in tp_account_manager_dup_valid_accounts().
+ *
+ * Like tp_account_manager_dup_valid_accounts(), this is empty until
+ * %TP_ACCOUNT_MANAGER_FEATURE_CORE has been prepared.
+ *
+ * Returns: (transfer full): a newly allocated %NULL-terminated array of
+ *  object paths, in no particular order
+ *
+ * Since: 0.UNRELEASED
+ */
+GStrv
+tp_account_manager_dup_valid_account_paths (TpAccountManager *manager)
+{
+  GPtrArray *paths;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_return_val_if_fail (TP_IS_ACCOUNT_MANAGER (manager), NULL);
+
+  paths = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, manager->priv->accounts);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (paths, g_strdup (key));
+
+  if (manager->priv->lazy_paths != NULL)
+    {
+      g_hash_table_iter_init (&iter, manager->priv->lazy_paths);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (paths, g_strdup (key));
+    }
+
+  g_ptr_array_add (paths, NULL);
+  return (GStrv) g_ptr_array_free (paths, FALSE);
+}
+
+/**
+ * tp_account_manager_prepare_account_async:
+ * @manager: a #TpAccountManager
+ * @path: the object path of an account
+ * @callback: a callback to call when the account has been prepared
+ * @user_data: data to pass to @callback
+ *
+ * Create (if necessary) and prepare the #TpAccount at @path, with
+ * %TP_ACCOUNT_FEATURE_CORE and all the features previously passed to
+ * tp_simple_client_factory_add_account_features() for @manager's
+ * #TpProxy:factory.
+ *
+ * If tp_account_manager_set_lazy_accounts() was called, and @path has not
+ * been prepared yet, it skips the queue of accounts waiting to be prepared
+ * in the background.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_account_manager_prepare_account_async (TpAccountManager *manager,
+    const gchar *path,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *res;
+  TpAccount *account;
+  GArray *features;
+  GError *error = NULL;
+
+  g_return_if_fail (TP_IS_ACCOUNT_MANAGER (manager));
+  g_return_if_fail (path != NULL);
+
+  res = g_simple_async_result_new (G_OBJECT (manager), callback, user_data,
+      tp_account_manager_prepare_account_async);
+
+  account = tp_simple_client_factory_ensure_account (
+      tp_proxy_get_factory (manager), path, NULL, &error);
+  if (account == NULL)
+    {
+      g_simple_async_result_take_error (res, error);
+      g_simple_async_result_complete_in_idle (res);
+      g_object_unref (res);
+      return;
+    }
+
+  if (manager->priv->lazy_paths != NULL)
+    {
+      GList *link = g_queue_find_custom (&manager->priv->lazy_queue, path,
+          (GCompareFunc) g_strcmp0);
+
+      /* If it's still waiting in the queue, start preparing it now, so it
+       * gets added to the valid accounts as soon as it's ready */
+      if (link != NULL)
+        {
+          DEBUG ("%s is wanted now", path);
+          g_free (link->data);
+          g_queue_delete_link (&manager->priv->lazy_queue, link);
+          lazy_accounts_start_preparing (manager, path);
+        }
+    }
+
+  /* Give account's ref to the result */
+  g_simple_async_result_set_op_res_gpointer (res, account, g_object_unref);
+
+  features = tp_simple_client_factory_dup_account_features (
+      tp_proxy_get_factory (manager), account);
+
+  tp_proxy_prepare_async (account, (GQuark *) features->data,
+      create_account_prepared_cb, res);
+
+  g_array_unref (features);
+}
+
+/**
+ * tp_account_manager_prepare_account_finish:
+ * @manager: a #TpAccountManager
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes tp_account_manager_prepare_account_async().
+ *
+ * Returns: (transfer full): the prepared #TpAccount, or %NULL on error
+ *
+ * Since: 0.UNRELEASED
+ */
+TpAccount *
+tp_account_manager_prepare_account_finish (TpAccountManager *manager,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_return_copy_pointer (manager,
+      tp_account_manager_prepare_account_async, g_object_ref);
+}
+
 /**
  * tp_account_manager_is_prepared: (skip)
  * @manager: a #TpAccountManager
@@ -106,9 +106,47 @@ _TP_AVAILABLE_IN_0_20
 GList *tp_account_manager_dup_valid_accounts (TpAccountManager *manager)
   G_GNUC_WARN_UNUSED_RESULT;
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_account_manager_set_lazy_accounts (TpAccountManager *manager,
+    guint max_preparing);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GStrv tp_account_manager_dup_valid_account_paths (TpAccountManager *manager)
+  G_GNUC_WARN_UNUSED_RESULT;
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_account_manager_prepare_account_async (TpAccountManager *manager,
+    const gchar *path,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpAccount *tp_account_manager_prepare_account_finish (
+    TpAccountManager *manager,
+    GAsyncResult *result,
+    GError **error);
+
 void tp_account_manager_set_all_requested_presences (TpAccountManager *manager,
     TpConnectionPresenceType type, const gchar *status, const gchar *message);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_account_manager_set_all_requested_presences_async (
+    TpAccountManager *manager,
+    TpConnectionPresenceType type,
+    const gchar *status,
+    const gchar *message,
+    guint max_in_flight,
+    guint max_jitter_ms,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_account_manager_set_all_requested_presences_finish (
+    TpAccountManager *manager,
+    GAsyncResult *result,
+    GHashTable **failures,
+    GError **error);
+
 TpConnectionPresenceType tp_account_manager_get_most_available_presence (
     TpAccountManager *manager, gchar **status, gchar **message);
 
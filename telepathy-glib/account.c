@@ -132,6 +132,10 @@ struct _TpAccountPrivate {
   gchar *display_name;
   GStrv supersedes;
 
+  /* the parameters as received, or NULL if not known yet; shared with
+   * callers of tp_account_dup_parameters_vardict() */
+  GVariant *parameters_vardict;
+  /* the same as a{sv}, or NULL if not built yet */
   GHashTable *parameters;
 
   gchar *storage_provider;
@@ -141,6 +145,11 @@ struct _TpAccountPrivate {
   GStrv uri_schemes;
 
   gboolean connection_prepared;
+
+  /* owned qualified name => owned GValue, as returned by
+   * AccountManager.GetAccountProperties; or NULL if we have to ask the
+   * account itself */
+  GHashTable *bulk_properties;
 };
 
 G_DEFINE_TYPE (TpAccount, tp_account, TP_TYPE_PROXY)
@@ -191,6 +200,7 @@ enum {
   PROP_STORAGE_RESTRICTIONS,
   PROP_SUPERSEDES,
   PROP_URI_SCHEMES,
+  PROP_BULK_PROPERTIES,
   N_PROPS
 };
 
@@ -569,6 +579,42 @@ _tp_account_set_connection (TpAccount *account,
     g_object_notify (G_OBJECT (account), "connection");
 }
 
+/*
+ * dup_bulk_properties:
+ * @self: an account
+ * @iface: a D-Bus interface
+ *
+ * Returns: (transfer container): a table mapping the unqualified names of
+ *  @iface's properties to their values, borrowed from the properties that
+ *  the account manager gave us in bulk, or %NULL if it did not give us any
+ */
+static GHashTable *
+dup_bulk_properties (TpAccount *self,
+    const gchar *iface)
+{
+  GHashTable *ret;
+  GHashTableIter iter;
+  gpointer k, v;
+  gsize len = strlen (iface);
+
+  if (self->priv->bulk_properties == NULL)
+    return NULL;
+
+  ret = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_iter_init (&iter, self->priv->bulk_properties);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      const gchar *name = k;
+
+      if (strncmp (name, iface, len) == 0 && name[len] == '.' &&
+          strchr (name + len + 1, '.') == NULL)
+        g_hash_table_insert (ret, (gchar *) name + len + 1, v);
+    }
+
+  return ret;
+}
+
 static void
 _tp_account_got_all_storage_cb (TpProxy *proxy,
     GHashTable *properties,
@@ -611,29 +657,162 @@ tp_account_prepare_storage_async (TpProxy *proxy,
 {
   TpAccount *self = TP_ACCOUNT (proxy);
   GSimpleAsyncResult *result;
+  GHashTable *properties;
 
   result = g_simple_async_result_new ((GObject *) proxy, callback, user_data,
       tp_account_prepare_storage_async);
 
   g_assert (self->priv->storage_provider == NULL);
 
+  properties = dup_bulk_properties (self, TP_IFACE_ACCOUNT_INTERFACE_STORAGE);
+
+  if (properties != NULL)
+    {
+      /* an account without Storage has none of its properties, which is the
+       * same as GetAll failing */
+      _tp_account_got_all_storage_cb (proxy,
+          g_hash_table_size (properties) > 0 ? properties : NULL,
+          NULL, result, (GObject *) self);
+      g_hash_table_unref (properties);
+      g_object_unref (result);
+      return;
+    }
+
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_ACCOUNT_INTERFACE_STORAGE,
       _tp_account_got_all_storage_cb, result, g_object_unref, G_OBJECT (self));
 }
 
+/* Replace *field with a copy of @value, unless they are equal. Returns
+ * TRUE if *field changed. */
+static gboolean
+update_string (gchar **field,
+    const gchar *value)
+{
+  if (!tp_strdiff (*field, value))
+    return FALSE;
+
+  g_free (*field);
+  *field = g_strdup (value);
+  return TRUE;
+}
+
+/* The same as update_string(), but taking ownership of @value */
+static gboolean
+update_string_take (gchar **field,
+    gchar *value)
+{
+  if (!tp_strdiff (*field, value))
+    {
+      g_free (value);
+      return FALSE;
+    }
+
+  g_free (*field);
+  *field = value;
+  return TRUE;
+}
+
+typedef enum {
+    PRESENCE_CHANGED_TYPE = (1 << 0),
+    PRESENCE_CHANGED_STATUS = (1 << 1),
+    PRESENCE_CHANGED_MESSAGE = (1 << 2)
+} PresenceChanges;
+
+/* Update a presence from the (uss) called @key in @properties, if any.
+ * Returns: what changed */
+static PresenceChanges
+update_presence (GHashTable *properties,
+    const gchar *key,
+    TpConnectionPresenceType *type,
+    gchar **status,
+    gchar **message)
+{
+  GValueArray *arr = tp_asv_get_boxed (properties, key,
+      TP_STRUCT_TYPE_SIMPLE_PRESENCE);
+  TpConnectionPresenceType new_type;
+  const gchar *new_status;
+  const gchar *new_message;
+  PresenceChanges changes = 0;
+
+  if (arr == NULL)
+    return 0;
+
+  tp_value_array_unpack (arr, 3,
+      &new_type,
+      &new_status,
+      &new_message);
+
+  if (new_type != *type)
+    {
+      *type = new_type;
+      changes |= PRESENCE_CHANGED_TYPE;
+    }
+
+  if (update_string (status, new_status))
+    changes |= PRESENCE_CHANGED_STATUS;
+
+  if (update_string (message, new_message))
+    changes |= PRESENCE_CHANGED_MESSAGE;
+
+  return changes;
+}
+
+static void
+notify_presence (TpAccount *self,
+    PresenceChanges changes,
+    const gchar *type_property,
+    const gchar *status_property,
+    const gchar *message_property)
+{
+  if (changes & PRESENCE_CHANGED_TYPE)
+    g_object_notify (G_OBJECT (self), type_property);
+
+  if (changes & PRESENCE_CHANGED_STATUS)
+    g_object_notify (G_OBJECT (self), status_property);
+
+  if (changes & PRESENCE_CHANGED_MESSAGE)
+    g_object_notify (G_OBJECT (self), message_property);
+}
+
+/* Returns: TRUE if @a and @b, either of which may be %NULL, have the same
+ * keys and values as one another */
+static gboolean
+asv_equal (const GHashTable *a,
+    const GHashTable *b)
+{
+  GVariant *va, *vb;
+  gboolean ret;
+
+  if (tp_asv_size (a) == 0 || tp_asv_size (b) == 0)
+    return (tp_asv_size (a) == tp_asv_size (b));
+
+  if (tp_asv_size (a) != tp_asv_size (b))
+    return FALSE;
+
+  va = _tp_asv_to_vardict (a);
+  vb = _tp_asv_to_vardict (b);
+  ret = g_variant_equal (va, vb);
+  g_variant_unref (va);
+  g_variant_unref (vb);
+  return ret;
+}
+
+/* Only properties whose values really change are copied and notified:
+ * the AccountManager tends to send the whole set of properties, or at
+ * least all of the presence, whenever anything changes. */
 static void
 _tp_account_update (TpAccount *account,
     GHashTable *properties)
 {
   TpProxy *proxy = TP_PROXY (account);
   TpAccountPrivate *priv = account->priv;
-  GValueArray *arr;
   TpConnectionStatus old_s = priv->connection_status;
+  TpConnectionStatusReason old_reason = priv->reason;
+  gchar *old_error = g_strdup (priv->error);
   gboolean status_changed = FALSE;
-  gboolean presence_changed = FALSE;
-  const gchar *status;
-  const gchar *message;
+  gboolean details_changed = FALSE;
+  PresenceChanges presence_changes;
 
   tp_proxy_add_interfaces (proxy, tp_asv_get_strv (properties, "Interfaces"));
 
@@ -648,12 +827,10 @@ _tp_account_update (TpAccount *account,
 
   if (g_hash_table_lookup (properties, "ConnectionStatusReason") != NULL)
     {
-      TpConnectionStatusReason old = priv->reason;
-
       priv->reason =
         tp_asv_get_uint32 (properties, "ConnectionStatusReason", NULL);
 
-      if (old != priv->reason)
+      if (old_reason != priv->reason)
         status_changed = TRUE;
     }
 
@@ -665,12 +842,8 @@ _tp_account_update (TpAccount *account,
       if (tp_str_empty (new_error))
         new_error = NULL;
 
-      if (tp_strdiff (new_error, priv->error))
-        {
-          tp_clear_pointer (&priv->error, g_free);
-          priv->error = g_strdup (new_error);
-          status_changed = TRUE;
-        }
+      if (update_string (&priv->error, new_error))
+        status_changed = TRUE;
     }
 
   if (g_hash_table_lookup (properties, "ConnectionErrorDetails") != NULL)
@@ -678,8 +851,7 @@ _tp_account_update (TpAccount *account,
       const GHashTable *details = tp_asv_get_boxed (properties,
           "ConnectionErrorDetails", TP_HASH_TYPE_STRING_VARIANT_MAP);
 
-      if ((details != NULL && tp_asv_size (details) > 0) ||
-          tp_asv_size (priv->error_details) > 0)
+      if (!asv_equal (details, priv->error_details))
         {
           g_hash_table_remove_all (priv->error_details);
 
@@ -690,6 +862,7 @@ _tp_account_update (TpAccount *account,
                 (GBoxedCopyFunc) tp_g_value_slice_dup);
 
           status_changed = TRUE;
+          details_changed = TRUE;
         }
     }
 
@@ -699,7 +872,12 @@ _tp_account_update (TpAccount *account,
         {
           /* our connection status is CONNECTED - clear any error we may
            * have recorded previously */
-          g_hash_table_remove_all (priv->error_details);
+          if (tp_asv_size (priv->error_details) > 0)
+            {
+              g_hash_table_remove_all (priv->error_details);
+              details_changed = TRUE;
+            }
+
           tp_clear_pointer (&priv->error, g_free);
         }
       else if (priv->error == NULL)
@@ -719,161 +897,83 @@ _tp_account_update (TpAccount *account,
         }
     }
 
-  if (g_hash_table_lookup (properties, "CurrentPresence") != NULL)
-    {
-      presence_changed = TRUE;
-      arr = tp_asv_get_boxed (properties, "CurrentPresence",
-          TP_STRUCT_TYPE_SIMPLE_PRESENCE);
-
-      tp_value_array_unpack (arr, 3,
-          &priv->cur_presence,
-          &status,
-          &message);
-      g_free (priv->cur_status);
-      priv->cur_status = g_strdup (status);
-      g_free (priv->cur_message);
-      priv->cur_message = g_strdup (message);
-    }
-
-  if (g_hash_table_lookup (properties, "RequestedPresence") != NULL)
-    {
-      arr = tp_asv_get_boxed (properties, "RequestedPresence",
-          TP_STRUCT_TYPE_SIMPLE_PRESENCE);
-
-      tp_value_array_unpack (arr, 3,
-          &priv->requested_presence,
-          &status,
-          &message);
-      g_free (priv->requested_status);
-      priv->requested_status = g_strdup (status);
-      g_free (priv->requested_message);
-      priv->requested_message = g_strdup (message);
-
-      g_object_notify (G_OBJECT (account), "requested-presence-type");
-      g_object_notify (G_OBJECT (account), "requested-status");
-      g_object_notify (G_OBJECT (account), "requested-status-message");
-    }
+  presence_changes = update_presence (properties, "CurrentPresence",
+      &priv->cur_presence, &priv->cur_status, &priv->cur_message);
 
-  if (g_hash_table_lookup (properties, "AutomaticPresence") != NULL)
-    {
-      arr = tp_asv_get_boxed (properties, "AutomaticPresence",
-          TP_STRUCT_TYPE_SIMPLE_PRESENCE);
-
-      tp_value_array_unpack (arr, 3,
-          &priv->auto_presence,
-          &status,
-          &message);
-      g_free (priv->auto_status);
-      priv->auto_status = g_strdup (status);
-      g_free (priv->auto_message);
-      priv->auto_message = g_strdup (message);
-
-      g_object_notify (G_OBJECT (account), "automatic-presence-type");
-      g_object_notify (G_OBJECT (account), "automatic-status");
-      g_object_notify (G_OBJECT (account), "automatic-status-message");
-    }
+  notify_presence (account,
+      update_presence (properties, "RequestedPresence",
+        &priv->requested_presence, &priv->requested_status,
+        &priv->requested_message),
+      "requested-presence-type", "requested-status",
+      "requested-status-message");
 
-  if (g_hash_table_lookup (properties, "DisplayName") != NULL)
-    {
-      gchar *old = priv->display_name;
+  notify_presence (account,
+      update_presence (properties, "AutomaticPresence",
+        &priv->auto_presence, &priv->auto_status, &priv->auto_message),
+      "automatic-presence-type", "automatic-status",
+      "automatic-status-message");
 
-      priv->display_name =
-        g_strdup (tp_asv_get_string (properties, "DisplayName"));
+  if (g_hash_table_lookup (properties, "DisplayName") != NULL &&
+      update_string (&priv->display_name,
+        tp_asv_get_string (properties, "DisplayName")))
+    g_object_notify (G_OBJECT (account), "display-name");
 
-      if (tp_strdiff (old, priv->display_name))
-        g_object_notify (G_OBJECT (account), "display-name");
-
-      g_free (old);
-    }
-
-  if (g_hash_table_lookup (properties, "Nickname") != NULL)
-    {
-      gchar *old = priv->nickname;
-
-      priv->nickname = g_strdup (tp_asv_get_string (properties, "Nickname"));
-
-      if (tp_strdiff (old, priv->nickname))
-        g_object_notify (G_OBJECT (account), "nickname");
-
-      g_free (old);
-    }
+  if (g_hash_table_lookup (properties, "Nickname") != NULL &&
+      update_string (&priv->nickname,
+        tp_asv_get_string (properties, "Nickname")))
+    g_object_notify (G_OBJECT (account), "nickname");
 
   if (g_hash_table_lookup (properties, "Supersedes") != NULL)
     {
-      GStrv old = priv->supersedes;
       GPtrArray *new_arr = tp_asv_get_boxed (properties, "Supersedes",
           TP_ARRAY_TYPE_OBJECT_PATH_LIST);
-      gboolean changed = FALSE;
+      guint new_len = (new_arr == NULL ? 0 : new_arr->len);
+      gboolean changed;
       guint i;
 
-      if (new_arr == NULL)
-        {
-          priv->supersedes = g_new0 (gchar *, 1);
-        }
+      if (priv->supersedes == NULL)
+        changed = (new_len > 0);
       else
-        {
-          priv->supersedes = g_new0 (gchar *, new_arr->len + 1);
+        changed = (g_strv_length (priv->supersedes) != new_len);
 
-          for (i = 0; i < new_arr->len; i++)
-            priv->supersedes[i] = g_strdup (g_ptr_array_index (new_arr, i));
-        }
-
-      if (new_arr == NULL || new_arr->len == 0)
-        {
-          changed = (old != NULL && *old != NULL);
-        }
-      else if (old == NULL || *old == NULL ||
-          g_strv_length (old) != new_arr->len)
+      for (i = 0; !changed && i < new_len; i++)
         {
-          changed = TRUE;
+          if (tp_strdiff (priv->supersedes[i],
+                g_ptr_array_index (new_arr, i)))
+            changed = TRUE;
         }
-      else
+
+      if (changed || priv->supersedes == NULL)
         {
-          for (i = 0; i < new_arr->len; i++)
-            {
-              if (tp_strdiff (old[i], priv->supersedes[i]))
-                {
-                  changed = TRUE;
-                  break;
-                }
-            }
+          g_strfreev (priv->supersedes);
+          priv->supersedes = g_new0 (gchar *, new_len + 1);
+
+          for (i = 0; i < new_len; i++)
+            priv->supersedes[i] = g_strdup (g_ptr_array_index (new_arr, i));
         }
 
       if (changed)
         g_object_notify (G_OBJECT (account), "supersedes");
-
-      g_strfreev (old);
     }
 
-  if (g_hash_table_lookup (properties, "NormalizedName") != NULL)
-    {
-      gchar *old = priv->normalized_name;
-
-      priv->normalized_name = g_strdup (tp_asv_get_string (properties,
-            "NormalizedName"));
-
-      if (tp_strdiff (old, priv->normalized_name))
-        g_object_notify (G_OBJECT (account), "normalized-name");
-
-      g_free (old);
-    }
+  if (g_hash_table_lookup (properties, "NormalizedName") != NULL &&
+      update_string (&priv->normalized_name,
+        tp_asv_get_string (properties, "NormalizedName")))
+    g_object_notify (G_OBJECT (account), "normalized-name");
 
   if (g_hash_table_lookup (properties, "Icon") != NULL)
     {
-      const gchar *icon_name;
-      gchar *old = priv->icon_name;
-
-      icon_name = tp_asv_get_string (properties, "Icon");
+      const gchar *icon_name = tp_asv_get_string (properties, "Icon");
+      gboolean changed;
 
       if (tp_str_empty (icon_name))
-        priv->icon_name = g_strdup_printf ("im-%s", priv->proto_name);
+        changed = update_string_take (&priv->icon_name,
+            g_strdup_printf ("im-%s", priv->proto_name));
       else
-        priv->icon_name = g_strdup (icon_name);
+        changed = update_string (&priv->icon_name, icon_name);
 
-      if (tp_strdiff (old, priv->icon_name))
+      if (changed)
         g_object_notify (G_OBJECT (account), "icon-name");
-
-      g_free (old);
     }
 
   if (g_hash_table_lookup (properties, "Enabled") != NULL)
@@ -888,20 +988,13 @@ _tp_account_update (TpAccount *account,
 
   if (g_hash_table_lookup (properties, "Service") != NULL)
     {
-      const gchar *service;
-      gchar *old = priv->service;
-
-      service = tp_asv_get_string (properties, "Service");
+      const gchar *service = tp_asv_get_string (properties, "Service");
 
       if (tp_str_empty (service))
-        priv->service = g_strdup (priv->proto_name);
-      else
-        priv->service = g_strdup (service);
+        service = priv->proto_name;
 
-      if (tp_strdiff (old, priv->service))
+      if (update_string (&priv->service, service))
         g_object_notify (G_OBJECT (account), "service");
-
-      g_free (old);
     }
 
   if (g_hash_table_lookup (properties, "Valid") != NULL)
@@ -921,11 +1014,23 @@ _tp_account_update (TpAccount *account,
       parameters = tp_asv_get_boxed (properties, "Parameters",
           TP_HASH_TYPE_STRING_VARIANT_MAP);
 
-      if (priv->parameters != NULL)
-        g_hash_table_unref (priv->parameters);
+      if (parameters != NULL)
+        {
+          GVariant *vardict = _tp_asv_to_vardict (parameters);
 
-      priv->parameters = g_boxed_copy (TP_HASH_TYPE_STRING_VARIANT_MAP,
-          parameters);
+          if (priv->parameters_vardict == NULL ||
+              !g_variant_equal (vardict, priv->parameters_vardict))
+            {
+              tp_clear_pointer (&priv->parameters_vardict, g_variant_unref);
+              priv->parameters_vardict = vardict;
+              /* rebuilt from the variant if anyone asks for it */
+              tp_clear_pointer (&priv->parameters, g_hash_table_unref);
+            }
+          else
+            {
+              g_variant_unref (vardict);
+            }
+        }
       /* this isn't a property, so we don't notify */
     }
 
@@ -935,19 +1040,28 @@ _tp_account_update (TpAccount *account,
           old_s, priv->connection_status, priv->reason, priv->error,
           priv->error_details);
 
-      g_object_notify (G_OBJECT (account), "connection-status");
-      g_object_notify (G_OBJECT (account), "connection-status-reason");
-      g_object_notify (G_OBJECT (account), "connection-error");
-      g_object_notify (G_OBJECT (account), "connection-error-details");
+      if (old_s != priv->connection_status)
+        g_object_notify (G_OBJECT (account), "connection-status");
+
+      if (old_reason != priv->reason)
+        g_object_notify (G_OBJECT (account), "connection-status-reason");
+
+      if (tp_strdiff (old_error, priv->error))
+        g_object_notify (G_OBJECT (account), "connection-error");
+
+      if (details_changed)
+        g_object_notify (G_OBJECT (account), "connection-error-details");
     }
 
-  if (presence_changed)
+  g_free (old_error);
+
+  if (presence_changes != 0)
     {
       g_signal_emit (account, signals[PRESENCE_CHANGED], 0,
           priv->cur_presence, priv->cur_status, priv->cur_message);
-      g_object_notify (G_OBJECT (account), "current-presence-type");
-      g_object_notify (G_OBJECT (account), "current-status");
-      g_object_notify (G_OBJECT (account), "current-status-message");
+      notify_presence (account, presence_changes,
+          "current-presence-type", "current-status",
+          "current-status-message");
     }
 
   if (g_hash_table_lookup (properties, "Connection") != NULL)
@@ -1049,14 +1163,22 @@ addressing_props_changed (TpAccount *self,
 {
   const gchar * const * v;
 
-  if (self->priv->uri_schemes == NULL)
-    /* We did not fetch the initial value yet, ignoring */
-    return;
-
   v = tp_asv_get_strv (changed_properties, "URISchemes");
   if (v == NULL)
     return;
 
+  if (self->priv->uri_schemes == NULL)
+    {
+      /* We did not fetch the initial value yet, so ignore this; but if we
+       * are going to use the account manager's copy, keep it up to date */
+      if (self->priv->bulk_properties != NULL)
+        g_hash_table_insert (self->priv->bulk_properties,
+            g_strdup (TP_PROP_ACCOUNT_INTERFACE_ADDRESSING_URI_SCHEMES),
+            tp_g_value_slice_new_boxed (G_TYPE_STRV, v));
+
+      return;
+    }
+
   g_strfreev (self->priv->uri_schemes);
   self->priv->uri_schemes = g_strdupv ((GStrv) v);
 
@@ -1122,10 +1244,64 @@ _tp_account_constructed (GObject *object)
   tp_cli_dbus_properties_connect_to_properties_changed (self,
       dbus_properties_changed_cb, NULL, NULL, object, NULL);
 
+  if (priv->bulk_properties != NULL)
+    {
+      GHashTable *properties = dup_bulk_properties (self, TP_IFACE_ACCOUNT);
+
+      DEBUG ("Account manager gave us the properties of %s",
+          tp_proxy_get_object_path (self));
+      _tp_account_got_all_cb ((TpProxy *) self, properties, NULL, NULL,
+          object);
+      g_hash_table_unref (properties);
+      return;
+    }
+
   tp_cli_dbus_properties_call_get_all (self, -1, TP_IFACE_ACCOUNT,
       _tp_account_got_all_cb, NULL, NULL, G_OBJECT (self));
 }
 
+static void
+_tp_account_set_property (GObject *object,
+    guint prop_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpAccount *self = TP_ACCOUNT (object);
+
+  switch (prop_id)
+    {
+      case PROP_BULK_PROPERTIES:
+        {
+          GHashTable *properties = g_value_get_boxed (value);
+
+          g_assert (self->priv->bulk_properties == NULL);
+
+          /* Only a complete set of properties is useful, and anything from
+           * GetAccountProperties has at least Account.Interfaces */
+          if (properties != NULL &&
+              g_hash_table_lookup (properties,
+                TP_PROP_ACCOUNT_INTERFACES) != NULL)
+            {
+              GHashTableIter iter;
+              gpointer k, v;
+
+              self->priv->bulk_properties = g_hash_table_new_full (
+                  g_str_hash, g_str_equal, g_free,
+                  (GDestroyNotify) tp_g_value_slice_free);
+              g_hash_table_iter_init (&iter, properties);
+
+              while (g_hash_table_iter_next (&iter, &k, &v))
+                g_hash_table_insert (self->priv->bulk_properties,
+                    g_strdup (k), tp_g_value_slice_dup (v));
+            }
+        }
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
 static void
 _tp_account_get_property (GObject *object,
     guint prop_id,
@@ -1292,12 +1468,14 @@ _tp_account_finalize (GObject *object)
   g_free (priv->service);
 
   tp_clear_pointer (&priv->parameters, g_hash_table_unref);
+  tp_clear_pointer (&priv->parameters_vardict, g_variant_unref);
   tp_clear_pointer (&priv->error_details, g_hash_table_unref);
 
   g_free (priv->storage_provider);
   tp_clear_pointer (&priv->storage_identifier, tp_g_value_slice_free);
 
   g_strfreev (priv->uri_schemes);
+  tp_clear_pointer (&priv->bulk_properties, g_hash_table_unref);
 
   /* free any data held directly by the object here */
   if (G_OBJECT_CLASS (tp_account_parent_class)->finalize != NULL)
@@ -1314,6 +1492,7 @@ tp_account_class_init (TpAccountClass *klass)
 
   object_class->constructed = _tp_account_constructed;
   object_class->get_property = _tp_account_get_property;
+  object_class->set_property = _tp_account_set_property;
   object_class->dispose = _tp_account_dispose;
   object_class->finalize = _tp_account_finalize;
 
@@ -2122,6 +2301,17 @@ tp_account_class_init (TpAccountClass *klass)
         G_TYPE_STRV,
         G_PARAM_STATIC_STRINGS | G_PARAM_READABLE));
 
+  /* Not a public property: TpAccountManager uses this, via the immutable
+   * properties passed to tp_simple_client_factory_ensure_account(), to hand
+   * over what it got from GetAccountProperties. If set, the account makes no
+   * GetAll calls of its own. */
+  g_object_class_install_property (object_class, PROP_BULK_PROPERTIES,
+      g_param_spec_boxed ("bulk-properties",
+        "Bulk properties",
+        "Qualified properties returned by GetAccountProperties",
+        TP_HASH_TYPE_QUALIFIED_PROPERTY_VALUE_MAP,
+        G_PARAM_STATIC_STRINGS | G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
   /**
    * TpAccount::status-changed:
    * @account: the #TpAccount
@@ -2234,13 +2424,15 @@ tp_account_new (TpDBusDaemon *bus_daemon,
     const gchar *object_path,
     GError **error)
 {
-  return _tp_account_new_with_factory (NULL, bus_daemon, object_path, error);
+  return _tp_account_new_with_factory (NULL, bus_daemon, object_path, NULL,
+      error);
 }
 
 TpAccount *
 _tp_account_new_with_factory (TpSimpleClientFactory *factory,
     TpDBusDaemon *bus_daemon,
     const gchar *object_path,
+    const GHashTable *immutable_properties,
     GError **error)
 {
   TpAccount *self;
@@ -2260,6 +2452,7 @@ _tp_account_new_with_factory (TpSimpleClientFactory *factory,
           "bus-name", TP_ACCOUNT_MANAGER_BUS_NAME,
           "object-path", object_path,
           "factory", factory,
+          "bulk-properties", immutable_properties,
           NULL));
 
   return self;
@@ -2562,6 +2755,13 @@ tp_account_get_parameters (TpAccount *account)
 {
   g_return_val_if_fail (TP_IS_ACCOUNT (account), NULL);
 
+  /* the variant is canonical; this is only built for callers of this
+   * older API, and kept until the parameters change */
+  if (account->priv->parameters == NULL &&
+      account->priv->parameters_vardict != NULL)
+    account->priv->parameters = _tp_asv_from_vardict (
+        account->priv->parameters_vardict);
+
   return account->priv->parameters;
 }
 
@@ -2592,7 +2792,34 @@ tp_account_dup_parameters_vardict (TpAccount *account)
 {
   g_return_val_if_fail (TP_IS_ACCOUNT (account), NULL);
 
-  return _tp_asv_to_vardict (account->priv->parameters);
+  if (tp_account_get_parameters_vardict (account) == NULL)
+    return NULL;
+
+  return g_variant_ref (account->priv->parameters_vardict);
+}
+
+/**
+ * tp_account_get_parameters_vardict:
+ * @account: a #TpAccount
+ *
+ * The same as tp_account_dup_parameters_vardict(), but without taking a
+ * reference. The same immutable variant is shared by all callers until the
+ * parameters change, so reading them repeatedly does not copy them.
+ *
+ * The returned variant is not necessarily valid after the main loop is next
+ * re-entered; reference it with g_variant_ref() if it must be kept.
+ *
+ * Returns: (transfer none): the dictionary of
+ *  parameters on @account, of type %G_VARIANT_TYPE_VARDICT
+ *
+ * Since: 0.UNRELEASED
+ */
+GVariant *
+tp_account_get_parameters_vardict (TpAccount *account)
+{
+  g_return_val_if_fail (TP_IS_ACCOUNT (account), NULL);
+
+  return account->priv->parameters_vardict;
 }
 
 /**
@@ -4334,12 +4561,25 @@ tp_account_prepare_addressing_async (TpProxy *proxy,
 {
   TpAccount *self = TP_ACCOUNT (proxy);
   GSimpleAsyncResult *result;
+  GHashTable *properties;
 
   result = g_simple_async_result_new ((GObject *) proxy, callback, user_data,
       tp_account_prepare_addressing_async);
 
   g_assert (self->priv->uri_schemes == NULL);
 
+  properties = dup_bulk_properties (self,
+      TP_IFACE_ACCOUNT_INTERFACE_ADDRESSING);
+
+  if (properties != NULL)
+    {
+      _tp_account_got_all_addressing_cb (proxy, properties, NULL, result,
+          NULL);
+      g_hash_table_unref (properties);
+      g_object_unref (result);
+      return;
+    }
+
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_ACCOUNT_INTERFACE_ADDRESSING,
       _tp_account_got_all_addressing_cb, result, g_object_unref, NULL);
@@ -230,6 +230,8 @@ TpConnectionPresenceType tp_account_get_automatic_presence (
 const GHashTable *tp_account_get_parameters (TpAccount *account);
 _TP_AVAILABLE_IN_0_18
 GVariant *tp_account_dup_parameters_vardict (TpAccount *account);
+_TP_AVAILABLE_IN_UNRELEASED
+GVariant *tp_account_get_parameters_vardict (TpAccount *account);
 
 const gchar *tp_account_get_nickname (TpAccount *account);
 
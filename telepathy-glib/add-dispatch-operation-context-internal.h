@@ -66,6 +66,7 @@ void _tp_add_dispatch_operation_context_prepare_async (
     const GQuark *account_features,
     const GQuark *connection_features,
     const GQuark *channel_features,
+    guint timeout_ms,
     GAsyncReadyCallback callback,
     gpointer user_data);
 
@@ -55,6 +55,7 @@
 
 #define DEBUG_FLAG TP_DEBUG_CLIENT
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/proxy-internal.h"
 #include "telepathy-glib/util-internal.h"
 
 struct _TpAddDispatchOperationContextClass {
@@ -77,12 +78,8 @@ enum {
 struct _TpAddDispatchOperationContextPrivate
 {
   TpAddDispatchOperationContextState state;
-  GSimpleAsyncResult *result;
   DBusGMethodInvocation *dbus_context;
-
-  /* Number of calls we are waiting they return. Once they have all returned
-   * the context is considered as prepared */
-  guint num_pending;
+  gboolean preparing;
 };
 
 static void
@@ -140,12 +137,6 @@ tp_add_dispatch_operation_context_dispose (GObject *object)
       self->dispatch_operation = NULL;
     }
 
-  if (self->priv->result != NULL)
-    {
-      g_object_unref (self->priv->result);
-      self->priv->result = NULL;
-    }
-
   if (dispose != NULL)
     dispose (object);
 }
@@ -436,173 +427,44 @@ _tp_add_dispatch_operation_context_get_state (
   return self->priv->state;
 }
 
-static gboolean
-context_is_prepared (TpAddDispatchOperationContext *self)
-{
-  return self->priv->num_pending == 0;
-}
-
-static void
-context_check_prepare (TpAddDispatchOperationContext *self)
-{
-  if (!context_is_prepared (self))
-    return;
-
-  /*  is prepared */
-  g_simple_async_result_complete (self->priv->result);
-
-  g_object_unref (self->priv->result);
-  self->priv->result = NULL;
-}
-
-static void
-cdo_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpAddDispatchOperationContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare ChannelDispatchOperation: %s", error->message);
-
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-account_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpAddDispatchOperationContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare account: %s", error->message);
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-conn_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpAddDispatchOperationContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare connection: %s", error->message);
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-adoc_channel_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpAddDispatchOperationContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare channel: %s", error->message);
-
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-context_prepare (TpAddDispatchOperationContext *self,
-    const GQuark *account_features,
-    const GQuark *connection_features,
-    const GQuark *channel_features)
-{
-  GQuark cdo_features[] = { TP_CHANNEL_DISPATCH_OPERATION_FEATURE_CORE, 0 };
-  guint i;
-
-  self->priv->num_pending = 3;
-
-  tp_proxy_prepare_async (self->account, account_features,
-      account_prepare_cb, g_object_ref (self));
-
-  tp_proxy_prepare_async (self->connection, connection_features,
-      conn_prepare_cb, g_object_ref (self));
-
-  tp_proxy_prepare_async (self->dispatch_operation, cdo_features,
-      cdo_prepare_cb, g_object_ref (self));
-
-  for (i = 0; i < self->channels->len; i++)
-    {
-      TpChannel *channel = g_ptr_array_index (self->channels, i);
-
-      self->priv->num_pending++;
-
-      tp_proxy_prepare_async (channel, channel_features,
-          adoc_channel_prepare_cb, g_object_ref (self));
-    }
-}
-
 void
 _tp_add_dispatch_operation_context_prepare_async (
     TpAddDispatchOperationContext *self,
     const GQuark *account_features,
     const GQuark *connection_features,
     const GQuark *channel_features,
+    guint timeout_ms,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
+  GQuark cdo_features[] = { TP_CHANNEL_DISPATCH_OPERATION_FEATURE_CORE, 0 };
+  GSimpleAsyncResult *result;
+  TpProxyPrepareMany *prepare;
+  guint i;
+
   g_return_if_fail (TP_IS_ADD_DISPATCH_OPERATION_CONTEXT (self));
   /* This is only used once, by TpBaseClient, so for simplicity, we only
    * allow one asynchronous preparation */
-  g_return_if_fail (self->priv->result == NULL);
+  g_return_if_fail (!self->priv->preparing);
 
-  self->priv->result = g_simple_async_result_new (G_OBJECT (self),
+  self->priv->preparing = TRUE;
+  result = g_simple_async_result_new (G_OBJECT (self),
       callback, user_data, _tp_add_dispatch_operation_context_prepare_async);
+  prepare = _tp_proxy_prepare_many_new (result);
+  g_object_unref (result);
+
+  _tp_proxy_prepare_many_add (prepare, self->account, account_features);
+  _tp_proxy_prepare_many_add (prepare, self->connection,
+      connection_features);
+
+  _tp_proxy_prepare_many_add (prepare, self->dispatch_operation,
+      cdo_features);
+
+  for (i = 0; i < self->channels->len; i++)
+    _tp_proxy_prepare_many_add (prepare,
+        g_ptr_array_index (self->channels, i), channel_features);
 
-  context_prepare (self, account_features, connection_features,
-      channel_features);
+  _tp_proxy_prepare_many_start (prepare, timeout_ms);
 }
 
 gboolean
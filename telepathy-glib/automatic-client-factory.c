@@ -146,6 +146,13 @@ typedef struct {
 
 static ChannelTypeMapping *channel_type_mapping = NULL;
 
+/* borrowed channel type => borrowed ChannelTypeMapping */
+static GHashTable *mappings_by_channel_type = NULL;
+
+/* GType => owned GArray of GQuark: the features we add for a channel of
+ * exactly that type, including the standard ones */
+static GHashTable *features_by_gtype = NULL;
+
 static gboolean
 check_for_messages (
     const gchar *object_path,
@@ -207,9 +214,46 @@ build_channel_type_mapping (void)
       { NULL }
   };
 
+  GQuark standard_features[] = {
+      TP_CHANNEL_FEATURE_GROUP,
+      TP_CHANNEL_FEATURE_PASSWORD,
+  };
+  ChannelTypeMapping *m;
+  GArray *features;
+
   g_return_if_fail (channel_type_mapping == NULL);
 
   channel_type_mapping = g_memdup (i_hate_c, sizeof i_hate_c);
+
+  /* Work out everything that doesn't depend on the channel now, so that
+   * creating a proxy is just a couple of hash lookups */
+  mappings_by_channel_type = g_hash_table_new (g_str_hash, g_str_equal);
+  features_by_gtype = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_array_unref);
+
+  features = g_array_new (FALSE, FALSE, sizeof (GQuark));
+  g_array_append_vals (features, standard_features,
+      G_N_ELEMENTS (standard_features));
+  g_hash_table_insert (features_by_gtype, GSIZE_TO_POINTER (TP_TYPE_CHANNEL),
+      features);
+
+  for (m = channel_type_mapping; m->channel_type != NULL; m++)
+    {
+      guint j;
+
+      g_hash_table_insert (mappings_by_channel_type,
+          (gchar *) m->channel_type, m);
+
+      features = g_array_new (FALSE, FALSE, sizeof (GQuark));
+      g_array_append_vals (features, standard_features,
+          G_N_ELEMENTS (standard_features));
+
+      for (j = 0; m->features[j] != 0; j++)
+        g_array_append_val (features, m->features[j]);
+
+      g_hash_table_insert (features_by_gtype, GSIZE_TO_POINTER (m->gtype),
+          features);
+    }
 }
 
 static TpChannel *
@@ -220,21 +264,17 @@ create_channel_impl (TpSimpleClientFactory *self,
     GError **error)
 {
   const gchar *chan_type;
-  ChannelTypeMapping *m;
+  ChannelTypeMapping *m = NULL;
 
   chan_type = tp_asv_get_string (properties, TP_PROP_CHANNEL_CHANNEL_TYPE);
 
-  for (m = channel_type_mapping; m->channel_type != NULL; m++)
-    {
-      if (tp_strdiff (chan_type, m->channel_type))
-        continue;
+  if (chan_type != NULL)
+    m = g_hash_table_lookup (mappings_by_channel_type, chan_type);
 
-      if (m->check_properties != NULL &&
-          !m->check_properties (object_path, properties))
-        break;
-
-      return m->new_func (self, conn, object_path, properties, error);
-    }
+  if (m != NULL &&
+      (m->check_properties == NULL ||
+       m->check_properties (object_path, properties)))
+    return m->new_func (self, conn, object_path, properties, error);
 
   /* Chainup on parent implementation as fallback */
   return chainup->create_channel (self, conn, object_path, properties, error);
@@ -245,24 +285,23 @@ dup_channel_features_impl (TpSimpleClientFactory *self,
     TpChannel *channel)
 {
   GArray *features;
-  GQuark standard_features[] = {
-      TP_CHANNEL_FEATURE_GROUP,
-      TP_CHANNEL_FEATURE_PASSWORD,
-  };
-  ChannelTypeMapping *m;
+  GType type;
 
   /* Chainup to get desired features for all channel types */
   features = chainup->dup_channel_features (self, channel);
 
-  g_array_append_vals (features, standard_features, G_N_ELEMENTS (standard_features));
-
-  for (m = channel_type_mapping; m->channel_type != NULL; m++)
+  /* Use the features of the most specific class we know about; every
+   * channel is at least a TpChannel, so this always finds something */
+  for (type = G_OBJECT_TYPE (channel);
+      type != 0;
+      type = g_type_parent (type))
     {
-      if (G_TYPE_CHECK_INSTANCE_TYPE (channel, m->gtype))
+      GArray *ours = g_hash_table_lookup (features_by_gtype,
+          GSIZE_TO_POINTER (type));
+
+      if (ours != NULL)
         {
-          guint j;
-          for (j = 0; m->features[j] != 0; j++)
-            g_array_append_val (features, m->features[j]);
+          g_array_append_vals (features, ours->data, ours->len);
           break;
         }
     }
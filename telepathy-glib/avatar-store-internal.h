@@ -0,0 +1,44 @@
+/*<private_header>*/
+/* Content-addressed store for cached avatars (internal)
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_AVATAR_STORE_INTERNAL_H__
+#define __TP_AVATAR_STORE_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*TpAvatarStoreWriteCb) (const GError *error,
+    gpointer user_data);
+
+void _tp_avatar_store_write_async (const gchar *filename,
+    const gchar *mime_filename,
+    GBytes *data,
+    const gchar *mime_type,
+    TpAvatarStoreWriteCb callback,
+    gpointer user_data);
+
+gboolean _tp_avatar_store_lookup (const gchar *filename,
+    const gchar *mime_filename,
+    gchar **mime_type);
+
+G_END_DECLS
+
+#endif
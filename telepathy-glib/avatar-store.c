@@ -0,0 +1,428 @@
+/* Content-addressed store for cached avatars
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/avatar-store-internal.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+# include <unistd.h>
+#endif
+
+#include <telepathy-glib/util-internal.h>
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CONTACTS
+#include "telepathy-glib/debug-internal.h"
+
+/*
+ * Avatars are cached as $XDG_CACHE_HOME/telepathy/avatars/CM/PROTOCOL/TOKEN,
+ * with the MIME type in TOKEN.mime next to it. Those are hard links to
+ * avatars/by-content/SHA1, so that the same image, used by several
+ * contacts or on several accounts, is only stored once; the filesystem's
+ * link count acts as the reference count.
+ *
+ * All writing is done by one thread, which takes everything that has been
+ * queued since it last woke up, writes it, and then reports back to each
+ * main context once for the whole batch.
+ */
+
+/* the most writes we report back with a single idle callback */
+#define MAX_BATCH 64
+
+/* how many recently-used avatar filenames we remember the MIME types of */
+#define LRU_SIZE 256
+
+typedef struct {
+    gchar *filename;
+    gchar *mime_filename;
+    GBytes *data;
+    gchar *mime_type;
+    TpAvatarStoreWriteCb callback;
+    gpointer user_data;
+    GMainContext *context;
+    GError *error;
+} WriteJob;
+
+typedef struct {
+    /* owned, and also the key in lru_table */
+    gchar *filename;
+    gchar *mime_type;
+    /* the link in lru_queue whose data is this entry */
+    GList *link;
+} LruEntry;
+
+/* both of these are only set once, in ensure_writer() */
+static GAsyncQueue *write_queue = NULL;
+static gchar *content_dir = NULL;
+
+/* protects lru_table and lru_queue */
+static GMutex lru_lock;
+/* borrowed filename => owned LruEntry */
+static GHashTable *lru_table = NULL;
+/* LruEntry, most recently used first */
+static GQueue lru_queue = G_QUEUE_INIT;
+
+static void
+write_job_free (WriteJob *job)
+{
+  g_free (job->filename);
+  g_free (job->mime_filename);
+  g_bytes_unref (job->data);
+  g_free (job->mime_type);
+  g_main_context_unref (job->context);
+  g_clear_error (&job->error);
+  g_slice_free (WriteJob, job);
+}
+
+static void
+lru_entry_free (gpointer p)
+{
+  LruEntry *entry = p;
+
+  g_free (entry->filename);
+  g_free (entry->mime_type);
+  g_slice_free (LruEntry, entry);
+}
+
+/* Remember that @filename has MIME type @mime_type, which may be NULL if
+ * it's unknown. */
+static void
+lru_insert (const gchar *filename,
+    const gchar *mime_type)
+{
+  LruEntry *entry;
+
+  g_mutex_lock (&lru_lock);
+
+  if (lru_table == NULL)
+    lru_table = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+        lru_entry_free);
+
+  entry = g_hash_table_lookup (lru_table, filename);
+
+  if (entry != NULL)
+    {
+      g_free (entry->mime_type);
+      entry->mime_type = g_strdup (mime_type);
+      g_queue_unlink (&lru_queue, entry->link);
+      g_queue_push_head_link (&lru_queue, entry->link);
+    }
+  else
+    {
+      entry = g_slice_new0 (LruEntry);
+      entry->filename = g_strdup (filename);
+      entry->mime_type = g_strdup (mime_type);
+      g_queue_push_head (&lru_queue, entry);
+      entry->link = lru_queue.head;
+      g_hash_table_insert (lru_table, entry->filename, entry);
+
+      if (g_queue_get_length (&lru_queue) > LRU_SIZE)
+        {
+          LruEntry *oldest = g_queue_pop_tail (&lru_queue);
+
+          g_hash_table_remove (lru_table, oldest->filename);
+        }
+    }
+
+  g_mutex_unlock (&lru_lock);
+}
+
+/* Returns: TRUE and sets *mime_type if @filename is in the LRU */
+static gboolean
+lru_lookup (const gchar *filename,
+    gchar **mime_type)
+{
+  LruEntry *entry = NULL;
+
+  g_mutex_lock (&lru_lock);
+
+  if (lru_table != NULL)
+    entry = g_hash_table_lookup (lru_table, filename);
+
+  if (entry != NULL)
+    {
+      g_queue_unlink (&lru_queue, entry->link);
+      g_queue_push_head_link (&lru_queue, entry->link);
+      *mime_type = g_strdup (entry->mime_type);
+    }
+
+  g_mutex_unlock (&lru_lock);
+
+  return (entry != NULL);
+}
+
+static void
+lru_remove (const gchar *filename)
+{
+  LruEntry *entry;
+
+  g_mutex_lock (&lru_lock);
+
+  if (lru_table != NULL &&
+      (entry = g_hash_table_lookup (lru_table, filename)) != NULL)
+    {
+      g_queue_delete_link (&lru_queue, entry->link);
+      g_hash_table_remove (lru_table, filename);
+    }
+
+  g_mutex_unlock (&lru_lock);
+}
+
+/* Make @target another name for @source, or failing that, a copy of
+ * @contents. */
+static gboolean
+link_or_write (const gchar *source,
+    const gchar *target,
+    gconstpointer contents,
+    gsize len,
+    GError **error)
+{
+  if (g_unlink (target) != 0 && errno != ENOENT)
+    DEBUG ("couldn't remove old %s: %s", target, g_strerror (errno));
+
+#ifdef G_OS_UNIX
+  if (link (source, target) == 0)
+    return TRUE;
+
+  DEBUG ("couldn't link %s to %s, copying instead: %s", target, source,
+      g_strerror (errno));
+#endif
+
+  return g_file_set_contents (target, contents, len, error);
+}
+
+static void
+write_job_run (WriteJob *job)
+{
+  gchar *checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA1,
+      job->data);
+  gchar *blob = g_build_filename (content_dir, checksum, NULL);
+  gchar *blob_mime = g_strconcat (blob, ".mime", NULL);
+  gchar *dir = g_path_get_dirname (job->filename);
+  gchar *old_mime = NULL;
+  gsize len;
+  gconstpointer data = g_bytes_get_data (job->data, &len);
+
+  if (g_mkdir_with_parents (content_dir, 0700) == -1 ||
+      g_mkdir_with_parents (dir, 0700) == -1)
+    {
+      g_set_error (&job->error, G_FILE_ERROR,
+          g_file_error_from_errno (errno),
+          "Error creating avatar cache dir: %s", g_strerror (errno));
+      goto out;
+    }
+
+  /* the image itself: only written if we've never seen it before */
+  if (g_file_test (blob, G_FILE_TEST_EXISTS))
+    DEBUG ("%s is already stored as %s", job->filename, blob);
+  else if (!g_file_set_contents (blob, data, len, &job->error))
+    goto out;
+
+  if (!link_or_write (blob, job->filename, data, len, &job->error))
+    goto out;
+
+  /* the MIME type: the same image normally has the same MIME type, but
+   * if not, this token gets a file of its own */
+  if (!g_file_get_contents (blob_mime, &old_mime, NULL, NULL))
+    {
+      if (!g_file_set_contents (blob_mime, job->mime_type, -1, &job->error))
+        goto out;
+
+      old_mime = g_strdup (job->mime_type);
+    }
+
+  if (!tp_strdiff (old_mime, job->mime_type))
+    link_or_write (blob_mime, job->mime_filename, job->mime_type,
+        strlen (job->mime_type), &job->error);
+  else
+    g_file_set_contents (job->mime_filename, job->mime_type, -1,
+        &job->error);
+
+out:
+  g_free (old_mime);
+  g_free (dir);
+  g_free (blob_mime);
+  g_free (blob);
+  g_free (checksum);
+}
+
+static gboolean
+complete_jobs_cb (gpointer data)
+{
+  GPtrArray *jobs = data;
+  guint i;
+
+  for (i = 0; i < jobs->len; i++)
+    {
+      WriteJob *job = g_ptr_array_index (jobs, i);
+
+      if (job->error == NULL)
+        lru_insert (job->filename, job->mime_type);
+      else
+        lru_remove (job->filename);
+
+      job->callback (job->error, job->user_data);
+    }
+
+  return FALSE;
+}
+
+static gpointer
+writer_thread (gpointer unused G_GNUC_UNUSED)
+{
+  for (;;)
+    {
+      GPtrArray *batch = g_ptr_array_new ();
+      WriteJob *job = g_async_queue_pop (write_queue);
+      guint i;
+
+      do
+        {
+          write_job_run (job);
+          g_ptr_array_add (batch, job);
+        }
+      while (batch->len < MAX_BATCH &&
+          (job = g_async_queue_try_pop (write_queue)) != NULL);
+
+      DEBUG ("wrote %u avatars", batch->len);
+
+      /* Report back to each main context once */
+      while (batch->len > 0)
+        {
+          GMainContext *context = ((WriteJob *) batch->pdata[0])->context;
+          GPtrArray *jobs = g_ptr_array_new_with_free_func (
+              (GDestroyNotify) write_job_free);
+          GSource *source;
+
+          for (i = 0; i < batch->len; )
+            {
+              job = g_ptr_array_index (batch, i);
+
+              if (job->context == context)
+                g_ptr_array_add (jobs, g_ptr_array_remove_index (batch, i));
+              else
+                i++;
+            }
+
+          source = _tp_idle_source_new (TP_LATENCY_CLASS_BULK);
+          g_source_set_callback (source, complete_jobs_cb, jobs,
+              (GDestroyNotify) g_ptr_array_unref);
+          g_source_attach (source, context);
+          g_source_unref (source);
+        }
+
+      g_ptr_array_unref (batch);
+    }
+
+  return NULL;
+}
+
+static void
+ensure_writer (void)
+{
+  static gsize started = 0;
+
+  if (g_once_init_enter (&started))
+    {
+      content_dir = g_build_filename (g_get_user_cache_dir (),
+          "telepathy", "avatars", "by-content", NULL);
+      write_queue = g_async_queue_new ();
+      g_thread_unref (g_thread_new ("tp-avatar-store", writer_thread, NULL));
+      g_once_init_leave (&started, 1);
+    }
+}
+
+/*
+ * _tp_avatar_store_write_async:
+ * @filename: where the avatar should be found
+ * @mime_filename: where its MIME type should be found
+ * @data: the avatar
+ * @mime_type: its MIME type
+ * @callback: called in the thread-default main context when the files
+ *  have been written
+ * @user_data: passed to @callback
+ *
+ * Store an avatar, sharing the data with any identical avatar that has
+ * already been stored.
+ */
+void
+_tp_avatar_store_write_async (const gchar *filename,
+    const gchar *mime_filename,
+    GBytes *data,
+    const gchar *mime_type,
+    TpAvatarStoreWriteCb callback,
+    gpointer user_data)
+{
+  WriteJob *job = g_slice_new0 (WriteJob);
+
+  ensure_writer ();
+
+  job->filename = g_strdup (filename);
+  job->mime_filename = g_strdup (mime_filename);
+  job->data = g_bytes_ref (data);
+  job->mime_type = g_strdup (mime_type);
+  job->callback = callback;
+  job->user_data = user_data;
+  job->context = g_main_context_ref_thread_default ();
+
+  g_async_queue_push (write_queue, job);
+}
+
+/*
+ * _tp_avatar_store_lookup:
+ * @filename: where the avatar would be
+ * @mime_filename: where its MIME type would be
+ * @mime_type: (out) (transfer full): used to return the MIME type, or
+ *  %NULL if it's unknown
+ *
+ * Returns: %TRUE if the avatar is stored at @filename
+ */
+gboolean
+_tp_avatar_store_lookup (const gchar *filename,
+    const gchar *mime_filename,
+    gchar **mime_type)
+{
+  GError *error = NULL;
+
+  if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+    {
+      lru_remove (filename);
+      return FALSE;
+    }
+
+  if (lru_lookup (filename, mime_type))
+    return TRUE;
+
+  if (!g_file_get_contents (mime_filename, mime_type, NULL, &error))
+    {
+      DEBUG ("Error reading avatar MIME type (%s): %s", mime_filename,
+          error ? error->message : "No error message");
+      *mime_type = NULL;
+      g_clear_error (&error);
+    }
+
+  lru_insert (filename, *mime_type);
+  return TRUE;
+}
@@ -0,0 +1,1016 @@
+/*
+ * base-avatars.c - caching and batching for Connection.Interface.Avatars
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:base-avatars
+ * @title: TpBaseAvatars
+ * @short_description: fetch, cache and send contacts' avatars on behalf
+ *  of a connection
+ * @see_also: #TpSvcConnectionInterfaceAvatars, #TpBaseConnection
+ *
+ * Connection managers implementing #TpSvcConnectionInterfaceAvatars can
+ * subclass #TpBaseAvatars to handle RequestAvatars. The subclass only has
+ * to implement #TpBaseAvatarsClass.fetch_avatars, which downloads several
+ * contacts' avatars from the server, and report each of them with
+ * tp_base_avatars_avatar_fetched() or tp_base_avatars_fetch_failed().
+ * #TpBaseAvatars takes care of:
+ *
+ * <itemizedlist>
+ *  <listitem><para>keeping the avatars it has fetched in a cache on disk,
+ *    keyed by token, so that an avatar is only downloaded once however
+ *    many times, and on however many connections, it is requested;
+ *    </para></listitem>
+ *  <listitem><para>only downloading an avatar once when several contacts
+ *    share its token, or a contact is requested again before the first
+ *    download finishes;</para></listitem>
+ *  <listitem><para>passing all the contacts requested during one main loop
+ *    iteration to a single call to #TpBaseAvatarsClass.fetch_avatars, and
+ *    optionally not starting the next batch until the previous one has
+ *    finished (see tp_base_avatars_set_max_batch_size());</para></listitem>
+ *  <listitem><para>emitting AvatarRetrieved at most once per contact per
+ *    main loop iteration, using
+ *    tp_base_connection_emit_avatar_retrieved().</para></listitem>
+ * </itemizedlist>
+ *
+ * To know which avatars are already cached or being downloaded,
+ * #TpBaseAvatars needs to know each contact's current avatar token, so the
+ * connection manager should call tp_base_avatars_set_token() whenever it
+ * learns one, instead of emitting AvatarUpdated itself. Its implementation of
+ * RequestAvatars can then be:
+ *
+ * |[
+ * static void
+ * my_connection_request_avatars (TpSvcConnectionInterfaceAvatars *iface,
+ *     const GArray *contacts,
+ *     DBusGMethodInvocation *context)
+ * {
+ *   MyConnection *self = MY_CONNECTION (iface);
+ *   GError *error = NULL;
+ *
+ *   TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (TP_BASE_CONNECTION (self),
+ *       context);
+ *
+ *   if (!tp_handles_are_valid (self->priv->contact_repo, contacts, FALSE,
+ *         &error))
+ *     {
+ *       dbus_g_method_return_error (context, error);
+ *       g_error_free (error);
+ *       return;
+ *     }
+ *
+ *   tp_base_avatars_request_avatars (self->priv->avatars, contacts);
+ *   tp_svc_connection_interface_avatars_return_from_request_avatars (
+ *       context);
+ * }
+ * ]|
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpBaseAvatars:
+ *
+ * An object fetching and caching avatars for a #TpBaseConnection.
+ * There are no public fields.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpBaseAvatarsClass:
+ * @fetch_avatars: start downloading the avatars of some contacts; must be
+ *  implemented by subclasses
+ *
+ * The class of a #TpBaseAvatars.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpBaseAvatarsFetchFunc:
+ * @self: the avatar helper
+ * @contacts: a #GArray of #TpHandle, the contacts whose avatars should be
+ *  downloaded; none of them appears twice, or in a previous batch that has
+ *  not finished yet
+ *
+ * Signature of the function that starts downloading avatars. For each
+ * contact in @contacts, the subclass must later call either
+ * tp_base_avatars_avatar_fetched() or tp_base_avatars_fetch_failed(),
+ * unless the connection is disconnected first.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/base-avatars.h"
+
+#include <string.h>
+
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/intset.h>
+#include <telepathy-glib/svc-connection.h>
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CONNECTION
+#include "telepathy-glib/avatar-store-internal.h"
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
+
+G_DEFINE_ABSTRACT_TYPE (TpBaseAvatars, tp_base_avatars, G_TYPE_OBJECT)
+
+enum {
+    PROP_CONNECTION = 1,
+    N_PROPS
+};
+
+/* A contact whose avatar is being downloaded, or is about to be */
+typedef struct {
+    /* owned, the token we thought the contact had when we asked for it,
+     * or NULL if it wasn't known */
+    gchar *token;
+    /* TpHandle, other contacts that had the same token and are waiting
+     * for this download instead of doing their own */
+    GArray *waiters;
+    /* TRUE if passed to fetch_avatars, FALSE if still in fetch_queue */
+    gboolean in_flight;
+} Fetch;
+
+/* An AvatarRetrieved signal that we will emit when we next get to run */
+typedef struct {
+    gchar *token;
+    GBytes *data;
+    gchar *mime_type;
+} Emission;
+
+/* An avatar that has been fetched but is still being written out, so
+ * that the cache on disk can't answer for it yet */
+typedef struct {
+    GBytes *data;
+    gchar *mime_type;
+} Recent;
+
+typedef struct {
+    GWeakRef self;
+    gchar *token;
+} WriteData;
+
+struct _TpBaseAvatarsPrivate
+{
+  /* weak reference */
+  TpBaseConnection *connection;
+  /* the most contacts passed to fetch_avatars at once, or 0 for no limit */
+  guint max_batch_size;
+
+  /* TpHandle => owned token, for every contact whose token we know */
+  GHashTable *tokens;
+  /* owned, where we cache avatars, or NULL if not known yet, or "" if we
+   * can't (for instance because the connection isn't on D-Bus yet) */
+  gchar *cache_dir;
+
+  /* TpHandle => owned Fetch */
+  GHashTable *fetches;
+  /* owned token => TpHandle whose Fetch is downloading it */
+  GHashTable *fetches_by_token;
+  /* TpHandle, everyone in fetches that isn't in flight yet, in the order
+   * they were requested */
+  GArray *fetch_queue;
+  /* the number of Fetches that are in flight */
+  guint n_in_flight;
+  /* every contact in fetches, and every contact waiting for one */
+  TpIntset *requested;
+  guint fetch_idle_id;
+
+  /* TpHandle => owned Emission */
+  GHashTable *emissions;
+  guint emit_idle_id;
+
+  /* owned token => owned Recent */
+  GHashTable *recent;
+};
+
+static void
+fetch_free (gpointer p)
+{
+  Fetch *fetch = p;
+
+  g_free (fetch->token);
+  g_array_unref (fetch->waiters);
+  g_slice_free (Fetch, fetch);
+}
+
+static void
+emission_free (gpointer p)
+{
+  Emission *emission = p;
+
+  g_free (emission->token);
+  g_bytes_unref (emission->data);
+  g_free (emission->mime_type);
+  g_slice_free (Emission, emission);
+}
+
+static void
+recent_free (gpointer p)
+{
+  Recent *recent = p;
+
+  g_bytes_unref (recent->data);
+  g_free (recent->mime_type);
+  g_slice_free (Recent, recent);
+}
+
+static void
+tp_base_avatars_init (TpBaseAvatars *self)
+{
+  TpBaseAvatarsPrivate *priv;
+
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_BASE_AVATARS,
+      TpBaseAvatarsPrivate);
+  priv = self->priv;
+
+  priv->tokens = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  priv->fetches = g_hash_table_new_full (NULL, NULL, NULL, fetch_free);
+  priv->fetches_by_token = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  priv->fetch_queue = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  priv->requested = tp_intset_new ();
+  priv->emissions = g_hash_table_new_full (NULL, NULL, NULL, emission_free);
+  priv->recent = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      recent_free);
+}
+
+static void
+tp_base_avatars_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpBaseAvatars *self = TP_BASE_AVATARS (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_value_set_object (value, self->priv->connection);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_base_avatars_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpBaseAvatars *self = TP_BASE_AVATARS (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_assert (self->priv->connection == NULL);
+        self->priv->connection = g_value_get_object (value);
+        g_assert (self->priv->connection != NULL);
+        g_object_add_weak_pointer (G_OBJECT (self->priv->connection),
+            (gpointer *) &self->priv->connection);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_base_avatars_dispose (GObject *object)
+{
+  TpBaseAvatars *self = TP_BASE_AVATARS (object);
+  TpBaseAvatarsPrivate *priv = self->priv;
+
+  if (priv->connection != NULL)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (priv->connection),
+          (gpointer *) &priv->connection);
+      priv->connection = NULL;
+    }
+
+  if (priv->fetch_idle_id != 0)
+    {
+      _tp_source_remove (priv->fetch_idle_id);
+      priv->fetch_idle_id = 0;
+    }
+
+  if (priv->emit_idle_id != 0)
+    {
+      _tp_source_remove (priv->emit_idle_id);
+      priv->emit_idle_id = 0;
+    }
+
+  G_OBJECT_CLASS (tp_base_avatars_parent_class)->dispose (object);
+}
+
+static void
+tp_base_avatars_finalize (GObject *object)
+{
+  TpBaseAvatars *self = TP_BASE_AVATARS (object);
+  TpBaseAvatarsPrivate *priv = self->priv;
+
+  g_hash_table_unref (priv->tokens);
+  g_free (priv->cache_dir);
+  g_hash_table_unref (priv->fetches);
+  g_hash_table_unref (priv->fetches_by_token);
+  g_array_unref (priv->fetch_queue);
+  tp_intset_destroy (priv->requested);
+  g_hash_table_unref (priv->emissions);
+  g_hash_table_unref (priv->recent);
+
+  G_OBJECT_CLASS (tp_base_avatars_parent_class)->finalize (object);
+}
+
+static void
+tp_base_avatars_class_init (TpBaseAvatarsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (TpBaseAvatarsPrivate));
+
+  object_class->get_property = tp_base_avatars_get_property;
+  object_class->set_property = tp_base_avatars_set_property;
+  object_class->dispose = tp_base_avatars_dispose;
+  object_class->finalize = tp_base_avatars_finalize;
+
+  /**
+   * TpBaseAvatars:connection:
+   *
+   * The connection whose contacts' avatars are fetched, which must
+   * implement #TpSvcConnectionInterfaceAvatars. #TpBaseAvatars does not
+   * keep a reference to it.
+   *
+   * Since: 0.UNRELEASED
+   */
+  g_object_class_install_property (object_class, PROP_CONNECTION,
+      g_param_spec_object ("connection", "Connection",
+        "The connection whose contacts' avatars are fetched",
+        TP_TYPE_BASE_CONNECTION,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * tp_base_avatars_get_connection:
+ * @self: an avatar helper
+ *
+ * <!-- -->
+ *
+ * Returns: (transfer none): the value of #TpBaseAvatars:connection, or
+ *  %NULL if it has been disposed
+ *
+ * Since: 0.UNRELEASED
+ */
+TpBaseConnection *
+tp_base_avatars_get_connection (TpBaseAvatars *self)
+{
+  g_return_val_if_fail (TP_IS_BASE_AVATARS (self), NULL);
+
+  return self->priv->connection;
+}
+
+/**
+ * tp_base_avatars_set_max_batch_size:
+ * @self: an avatar helper
+ * @max_batch_size: the most contacts to pass to each call to
+ *  #TpBaseAvatarsClass.fetch_avatars, or 0 for no limit
+ *
+ * Limit how many avatars are downloaded at once. If @max_batch_size is
+ * nonzero, #TpBaseAvatarsClass.fetch_avatars is given at most that many
+ * contacts, and is not called again until every one of them has been
+ * reported with tp_base_avatars_avatar_fetched() or
+ * tp_base_avatars_fetch_failed(); contacts requested in the meantime
+ * wait, in the order they were requested.
+ *
+ * This bounds the bandwidth used to download avatars while logging in,
+ * when clients typically request the avatars of all the contacts they
+ * are about to show.
+ *
+ * The default is 0.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_avatars_set_max_batch_size (TpBaseAvatars *self,
+    guint max_batch_size)
+{
+  g_return_if_fail (TP_IS_BASE_AVATARS (self));
+
+  self->priv->max_batch_size = max_batch_size;
+}
+
+/* Returns TRUE if we should still be doing things on behalf of the
+ * connection */
+static gboolean
+tp_base_avatars_is_active (TpBaseAvatars *self)
+{
+  return (self->priv->connection != NULL &&
+      self->priv->connection->status != TP_CONNECTION_STATUS_DISCONNECTED);
+}
+
+/**
+ * tp_base_avatars_set_token:
+ * @self: an avatar helper
+ * @contact: a contact
+ * @token: the token of @contact's current avatar, "" if @contact is known
+ *  to have no avatar, or %NULL if it is not known
+ *
+ * Record @contact's avatar token, and emit AvatarUpdated if @token is not
+ * %NULL and differs from the token previously recorded. The connection
+ * manager should call this whenever it learns a contact's token, and use
+ * tp_base_avatars_get_token() to implement GetKnownAvatarTokens and the
+ * avatar token contact attribute.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_avatars_set_token (TpBaseAvatars *self,
+    TpHandle contact,
+    const gchar *token)
+{
+  TpBaseAvatarsPrivate *priv;
+  gpointer key = GUINT_TO_POINTER (contact);
+
+  g_return_if_fail (TP_IS_BASE_AVATARS (self));
+  g_return_if_fail (contact != 0);
+
+  priv = self->priv;
+
+  if (token == NULL)
+    {
+      g_hash_table_remove (priv->tokens, key);
+      return;
+    }
+
+  if (!tp_strdiff (g_hash_table_lookup (priv->tokens, key), token))
+    return;
+
+  g_hash_table_insert (priv->tokens, key, g_strdup (token));
+
+  /* a client that becomes interested later gets the token from the
+   * contact attributes */
+  if (tp_base_avatars_is_active (self) &&
+      tp_base_connection_is_contact_interesting (priv->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS, contact) &&
+      !tp_base_connection_emit_unicast_signal (priv->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS,
+        TP_IFACE_CONNECTION_INTERFACE_AVATARS, "AvatarUpdated",
+        g_variant_new ("(us)", contact, token)))
+    tp_svc_connection_interface_avatars_emit_avatar_updated (
+        priv->connection, contact, token);
+}
+
+/**
+ * tp_base_avatars_get_token:
+ * @self: an avatar helper
+ * @contact: a contact
+ *
+ * <!-- -->
+ *
+ * Returns: the token last recorded for @contact by
+ *  tp_base_avatars_set_token() or tp_base_avatars_avatar_fetched(), or
+ *  %NULL if it is not known
+ *
+ * Since: 0.UNRELEASED
+ */
+const gchar *
+tp_base_avatars_get_token (TpBaseAvatars *self,
+    TpHandle contact)
+{
+  g_return_val_if_fail (TP_IS_BASE_AVATARS (self), NULL);
+
+  return g_hash_table_lookup (self->priv->tokens,
+      GUINT_TO_POINTER (contact));
+}
+
+/* Returns the directory where we cache avatars, or NULL if we can't */
+static const gchar *
+tp_base_avatars_get_cache_dir (TpBaseAvatars *self)
+{
+  TpBaseAvatarsPrivate *priv = self->priv;
+
+  if (priv->cache_dir == NULL && priv->connection != NULL &&
+      priv->connection->object_path != NULL)
+    {
+      /* the object path is .../Connection/CM/PROTOCOL/ACCOUNT, so this is
+       * CM/PROTOCOL/ACCOUNT */
+      const gchar *cm_name = priv->connection->object_path +
+          strlen (TP_CONN_OBJECT_PATH_BASE);
+      gchar **parts = g_strsplit (cm_name, "/", 3);
+
+      if (parts[0] != NULL && parts[1] != NULL)
+        priv->cache_dir = g_build_filename (g_get_user_cache_dir (),
+            "telepathy", "cm-avatars", parts[0], parts[1], NULL);
+      else
+        priv->cache_dir = g_strdup ("");
+
+      g_strfreev (parts);
+    }
+
+  if (tp_str_empty (priv->cache_dir))
+    return NULL;
+
+  return priv->cache_dir;
+}
+
+static gboolean
+tp_base_avatars_build_filenames (TpBaseAvatars *self,
+    const gchar *token,
+    gchar **filename,
+    gchar **mime_filename)
+{
+  const gchar *dir = tp_base_avatars_get_cache_dir (self);
+  gchar *escaped;
+
+  if (dir == NULL)
+    return FALSE;
+
+  escaped = tp_escape_as_identifier (token);
+  *filename = g_build_filename (dir, escaped, NULL);
+  *mime_filename = g_strconcat (*filename, ".mime", NULL);
+  g_free (escaped);
+  return TRUE;
+}
+
+/* If we have the avatar whose token is @token, returns TRUE and sets
+ * @data and @mime_type */
+static gboolean
+tp_base_avatars_lookup (TpBaseAvatars *self,
+    const gchar *token,
+    GBytes **data,
+    gchar **mime_type)
+{
+  Recent *recent = g_hash_table_lookup (self->priv->recent, token);
+  GMappedFile *mapped;
+  gchar *filename;
+  gchar *mime_filename;
+  gboolean ret = FALSE;
+
+  if (recent != NULL)
+    {
+      *data = g_bytes_ref (recent->data);
+      *mime_type = g_strdup (recent->mime_type);
+      return TRUE;
+    }
+
+  if (!tp_base_avatars_build_filenames (self, token, &filename,
+        &mime_filename))
+    return FALSE;
+
+  if (_tp_avatar_store_lookup (filename, mime_filename, mime_type))
+    {
+      mapped = g_mapped_file_new (filename, FALSE, NULL);
+
+      if (mapped != NULL)
+        {
+          DEBUG ("found avatar '%s' in %s", token, filename);
+          *data = g_mapped_file_get_bytes (mapped);
+          g_mapped_file_unref (mapped);
+          ret = TRUE;
+        }
+      else
+        {
+          g_free (*mime_type);
+          *mime_type = NULL;
+        }
+    }
+
+  g_free (filename);
+  g_free (mime_filename);
+  return ret;
+}
+
+static void
+avatar_written_cb (const GError *error,
+    gpointer user_data)
+{
+  WriteData *wd = user_data;
+  TpBaseAvatars *self = g_weak_ref_get (&wd->self);
+
+  if (error != NULL)
+    DEBUG ("failed to cache avatar '%s': %s", wd->token, error->message);
+
+  /* if it failed, we'll have to download it again next time */
+  if (self != NULL)
+    {
+      g_hash_table_remove (self->priv->recent, wd->token);
+      g_object_unref (self);
+    }
+
+  g_weak_ref_clear (&wd->self);
+  g_free (wd->token);
+  g_slice_free (WriteData, wd);
+}
+
+static void
+tp_base_avatars_store (TpBaseAvatars *self,
+    const gchar *token,
+    GBytes *data,
+    const gchar *mime_type)
+{
+  Recent *recent;
+  WriteData *wd;
+  gchar *filename;
+  gchar *mime_filename;
+
+  if (!tp_base_avatars_build_filenames (self, token, &filename,
+        &mime_filename))
+    return;
+
+  recent = g_slice_new (Recent);
+  recent->data = g_bytes_ref (data);
+  recent->mime_type = g_strdup (mime_type);
+  g_hash_table_insert (self->priv->recent, g_strdup (token), recent);
+
+  wd = g_slice_new (WriteData);
+  g_weak_ref_init (&wd->self, self);
+  wd->token = g_strdup (token);
+
+  _tp_avatar_store_write_async (filename, mime_filename, data, mime_type,
+      avatar_written_cb, wd);
+
+  g_free (filename);
+  g_free (mime_filename);
+}
+
+static gboolean
+emit_idle_cb (gpointer user_data)
+{
+  TpBaseAvatars *self = user_data;
+  TpBaseAvatarsPrivate *priv = self->priv;
+  GHashTable *emissions = priv->emissions;
+  GHashTableIter iter;
+  gpointer k, v;
+
+  priv->emit_idle_id = 0;
+  priv->emissions = g_hash_table_new_full (NULL, NULL, NULL, emission_free);
+
+  if (!tp_base_avatars_is_active (self))
+    goto out;
+
+  g_hash_table_iter_init (&iter, emissions);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      Emission *emission = v;
+      GArray *avatar = g_array_new (FALSE, FALSE, sizeof (gchar));
+      gsize len;
+      gconstpointer data = g_bytes_get_data (emission->data, &len);
+
+      g_array_append_vals (avatar, data, len);
+      tp_base_connection_emit_avatar_retrieved (priv->connection,
+          GPOINTER_TO_UINT (k), emission->token, avatar,
+          emission->mime_type);
+      g_array_unref (avatar);
+    }
+
+out:
+  g_hash_table_unref (emissions);
+  return FALSE;
+}
+
+/* Arrange to emit AvatarRetrieved for @contact; if we already meant to,
+ * only the most recent avatar is sent */
+static void
+tp_base_avatars_queue_emission (TpBaseAvatars *self,
+    TpHandle contact,
+    const gchar *token,
+    GBytes *data,
+    const gchar *mime_type)
+{
+  TpBaseAvatarsPrivate *priv = self->priv;
+  Emission *emission = g_slice_new (Emission);
+
+  emission->token = g_strdup (token);
+  emission->data = g_bytes_ref (data);
+  emission->mime_type = g_strdup (mime_type != NULL ? mime_type : "");
+  g_hash_table_insert (priv->emissions, GUINT_TO_POINTER (contact),
+      emission);
+
+  if (priv->emit_idle_id == 0)
+    priv->emit_idle_id = _tp_idle_add (TP_LATENCY_CLASS_NORMAL,
+        emit_idle_cb, self);
+}
+
+static gboolean
+fetch_idle_cb (gpointer user_data)
+{
+  TpBaseAvatars *self = user_data;
+  TpBaseAvatarsPrivate *priv = self->priv;
+  TpBaseAvatarsClass *cls = TP_BASE_AVATARS_GET_CLASS (self);
+  GArray *batch;
+  guint n = priv->fetch_queue->len;
+  guint i;
+
+  priv->fetch_idle_id = 0;
+
+  if (!tp_base_avatars_is_active (self))
+    return FALSE;
+
+  if (priv->max_batch_size != 0)
+    {
+      /* wait for the current batch to finish */
+      if (priv->n_in_flight > 0)
+        return FALSE;
+
+      n = MIN (n, priv->max_batch_size);
+    }
+
+  if (n == 0)
+    return FALSE;
+
+  batch = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle), n);
+  g_array_append_vals (batch, priv->fetch_queue->data, n);
+  g_array_remove_range (priv->fetch_queue, 0, n);
+
+  for (i = 0; i < n; i++)
+    {
+      Fetch *fetch = g_hash_table_lookup (priv->fetches,
+          GUINT_TO_POINTER (g_array_index (batch, TpHandle, i)));
+
+      g_assert (fetch != NULL);
+      fetch->in_flight = TRUE;
+    }
+
+  priv->n_in_flight += n;
+
+  DEBUG ("fetching %u avatars, %u more waiting", n, priv->fetch_queue->len);
+
+  g_object_ref (self);
+  cls->fetch_avatars (self, batch);
+  g_object_unref (self);
+
+  g_array_unref (batch);
+  return FALSE;
+}
+
+static void
+tp_base_avatars_schedule_fetch (TpBaseAvatars *self)
+{
+  TpBaseAvatarsPrivate *priv = self->priv;
+
+  if (priv->fetch_idle_id == 0 && priv->fetch_queue->len > 0)
+    priv->fetch_idle_id = _tp_idle_add (TP_LATENCY_CLASS_NORMAL,
+        fetch_idle_cb, self);
+}
+
+static void
+tp_base_avatars_request_one (TpBaseAvatars *self,
+    TpHandle contact)
+{
+  TpBaseAvatarsPrivate *priv = self->priv;
+  const gchar *token;
+  gpointer fetcher;
+  Fetch *fetch;
+  GBytes *data;
+  gchar *mime_type;
+
+  /* we'll get to it */
+  if (tp_intset_is_member (priv->requested, contact))
+    return;
+
+  token = g_hash_table_lookup (priv->tokens, GUINT_TO_POINTER (contact));
+
+  /* no avatar */
+  if (token != NULL && *token == '\0')
+    return;
+
+  if (token != NULL &&
+      tp_base_avatars_lookup (self, token, &data, &mime_type))
+    {
+      tp_base_avatars_queue_emission (self, contact, token, data, mime_type);
+      g_bytes_unref (data);
+      g_free (mime_type);
+      return;
+    }
+
+  tp_intset_add (priv->requested, contact);
+
+  if (token != NULL &&
+      g_hash_table_lookup_extended (priv->fetches_by_token, token, NULL,
+        &fetcher))
+    {
+      fetch = g_hash_table_lookup (priv->fetches, fetcher);
+      g_assert (fetch != NULL);
+      g_array_append_val (fetch->waiters, contact);
+      return;
+    }
+
+  fetch = g_slice_new0 (Fetch);
+  fetch->token = g_strdup (token);
+  fetch->waiters = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  g_hash_table_insert (priv->fetches, GUINT_TO_POINTER (contact), fetch);
+
+  if (token != NULL)
+    g_hash_table_insert (priv->fetches_by_token, g_strdup (token),
+        GUINT_TO_POINTER (contact));
+
+  g_array_append_val (priv->fetch_queue, contact);
+}
+
+/**
+ * tp_base_avatars_request_avatars:
+ * @self: an avatar helper
+ * @contacts: a #GArray of valid contact #TpHandle
+ *
+ * Arrange for AvatarRetrieved to be emitted for each of @contacts that has
+ * an avatar, taking it from the cache if possible, and otherwise calling
+ * #TpBaseAvatarsClass.fetch_avatars in a later main loop iteration.
+ * This is meant to be called by the connection's implementation of
+ * RequestAvatars, which can return immediately afterwards.
+ *
+ * Contacts whose token has been set to "" with tp_base_avatars_set_token()
+ * are ignored.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_avatars_request_avatars (TpBaseAvatars *self,
+    const GArray *contacts)
+{
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_AVATARS (self));
+  g_return_if_fail (contacts != NULL);
+
+  if (!tp_base_avatars_is_active (self))
+    return;
+
+  for (i = 0; i < contacts->len; i++)
+    tp_base_avatars_request_one (self,
+        g_array_index (contacts, TpHandle, i));
+
+  tp_base_avatars_schedule_fetch (self);
+}
+
+/* Forget about the Fetch for @contact, returning the contacts that were
+ * waiting for it, or NULL if there was none */
+static GArray *
+tp_base_avatars_finish_fetch (TpBaseAvatars *self,
+    TpHandle contact)
+{
+  TpBaseAvatarsPrivate *priv = self->priv;
+  gpointer key = GUINT_TO_POINTER (contact);
+  Fetch *fetch = g_hash_table_lookup (priv->fetches, key);
+  GArray *waiters;
+  guint i;
+
+  if (fetch == NULL)
+    return NULL;
+
+  if (fetch->in_flight)
+    {
+      g_assert (priv->n_in_flight > 0);
+      priv->n_in_flight--;
+    }
+  else
+    {
+      /* the subclass answered before we asked, which is fine */
+      for (i = 0; i < priv->fetch_queue->len; i++)
+        {
+          if (g_array_index (priv->fetch_queue, TpHandle, i) == contact)
+            {
+              g_array_remove_index (priv->fetch_queue, i);
+              break;
+            }
+        }
+    }
+
+  if (fetch->token != NULL)
+    g_hash_table_remove (priv->fetches_by_token, fetch->token);
+
+  waiters = g_array_ref (fetch->waiters);
+  g_hash_table_remove (priv->fetches, key);
+  tp_intset_remove (priv->requested, contact);
+
+  for (i = 0; i < waiters->len; i++)
+    tp_intset_remove (priv->requested,
+        g_array_index (waiters, TpHandle, i));
+
+  return waiters;
+}
+
+/**
+ * tp_base_avatars_avatar_fetched:
+ * @self: an avatar helper
+ * @contact: a contact
+ * @token: the token of @avatar
+ * @avatar: the image data
+ * @mime_type: the MIME type of @avatar, or %NULL if unknown
+ *
+ * Report that @contact's avatar has been downloaded, normally in response
+ * to #TpBaseAvatarsClass.fetch_avatars. This records @token as @contact's
+ * token, as if by tp_base_avatars_set_token(), stores @avatar in the
+ * cache, and arranges for AvatarRetrieved to be emitted for @contact and for
+ * every other contact which was waiting for an avatar with the same token.
+ *
+ * This may also be called for avatars that were not requested, for
+ * instance if the protocol sends them along with the contact list.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_avatars_avatar_fetched (TpBaseAvatars *self,
+    TpHandle contact,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type)
+{
+  GBytes *data;
+  GArray *waiters;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_AVATARS (self));
+  g_return_if_fail (contact != 0);
+  g_return_if_fail (!tp_str_empty (token));
+  g_return_if_fail (avatar != NULL);
+
+  DEBUG ("contact #%u: '%s', %u bytes", contact, token, avatar->len);
+
+  tp_base_avatars_set_token (self, contact, token);
+  waiters = tp_base_avatars_finish_fetch (self, contact);
+
+  if (!tp_base_avatars_is_active (self))
+    goto out;
+
+  data = g_bytes_new (avatar->data, avatar->len);
+  tp_base_avatars_store (self, token, data, mime_type);
+  tp_base_avatars_queue_emission (self, contact, token, data, mime_type);
+
+  for (i = 0; waiters != NULL && i < waiters->len; i++)
+    {
+      TpHandle waiter = g_array_index (waiters, TpHandle, i);
+
+      /* if the avatar turned out to have changed, the other contacts need
+       * to have theirs downloaded after all */
+      if (!tp_strdiff (tp_base_avatars_get_token (self, waiter), token))
+        tp_base_avatars_queue_emission (self, waiter, token, data,
+            mime_type);
+      else
+        tp_base_avatars_request_one (self, waiter);
+    }
+
+  g_bytes_unref (data);
+  tp_base_avatars_schedule_fetch (self);
+
+out:
+  tp_clear_pointer (&waiters, g_array_unref);
+}
+
+/**
+ * tp_base_avatars_fetch_failed:
+ * @self: an avatar helper
+ * @contact: a contact passed to #TpBaseAvatarsClass.fetch_avatars
+ *
+ * Report that @contact's avatar could not be downloaded. No AvatarRetrieved
+ * signal is emitted for it, or for the contacts which were waiting for the
+ * same avatar; they can be requested again later.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_avatars_fetch_failed (TpBaseAvatars *self,
+    TpHandle contact)
+{
+  GArray *waiters;
+
+  g_return_if_fail (TP_IS_BASE_AVATARS (self));
+
+  DEBUG ("contact #%u", contact);
+
+  waiters = tp_base_avatars_finish_fetch (self, contact);
+
+  if (waiters != NULL)
+    {
+      DEBUG ("%u other contacts were waiting for it", waiters->len);
+      g_array_unref (waiters);
+    }
+
+  if (tp_base_avatars_is_active (self))
+    tp_base_avatars_schedule_fetch (self);
+}
@@ -0,0 +1,106 @@
+/*
+ * base-avatars.h - caching and batching for Connection.Interface.Avatars
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if defined (TP_DISABLE_SINGLE_INCLUDE) && !defined (_TP_IN_META_HEADER) && !defined (_TP_COMPILATION)
+#error "Only <telepathy-glib/telepathy-glib.h> and <telepathy-glib/telepathy-glib-dbus.h> can be included directly."
+#endif
+
+#ifndef __TP_BASE_AVATARS_H__
+#define __TP_BASE_AVATARS_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/defs.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpBaseAvatars TpBaseAvatars;
+typedef struct _TpBaseAvatarsClass TpBaseAvatarsClass;
+typedef struct _TpBaseAvatarsPrivate TpBaseAvatarsPrivate;
+
+typedef void (*TpBaseAvatarsFetchFunc) (TpBaseAvatars *self,
+    const GArray *contacts);
+
+struct _TpBaseAvatarsClass {
+    /*< private >*/
+    GObjectClass parent_class;
+
+    /*< public >*/
+    TpBaseAvatarsFetchFunc fetch_avatars;
+};
+
+struct _TpBaseAvatars {
+    /*< private >*/
+    GObject parent;
+    TpBaseAvatarsPrivate *priv;
+};
+
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_base_avatars_get_type (void);
+
+#define TP_TYPE_BASE_AVATARS \
+  (tp_base_avatars_get_type ())
+#define TP_BASE_AVATARS(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TYPE_BASE_AVATARS, \
+                               TpBaseAvatars))
+#define TP_BASE_AVATARS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TYPE_BASE_AVATARS, \
+                            TpBaseAvatarsClass))
+#define TP_IS_BASE_AVATARS(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TYPE_BASE_AVATARS))
+#define TP_IS_BASE_AVATARS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TYPE_BASE_AVATARS))
+#define TP_BASE_AVATARS_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TYPE_BASE_AVATARS, \
+                              TpBaseAvatarsClass))
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpBaseConnection *tp_base_avatars_get_connection (TpBaseAvatars *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_avatars_set_max_batch_size (TpBaseAvatars *self,
+    guint max_batch_size);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_avatars_set_token (TpBaseAvatars *self,
+    TpHandle contact,
+    const gchar *token);
+_TP_AVAILABLE_IN_UNRELEASED
+const gchar *tp_base_avatars_get_token (TpBaseAvatars *self,
+    TpHandle contact);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_avatars_request_avatars (TpBaseAvatars *self,
+    const GArray *contacts);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_avatars_avatar_fetched (TpBaseAvatars *self,
+    TpHandle contact,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_avatars_fetch_failed (TpBaseAvatars *self,
+    TpHandle contact);
+
+G_END_DECLS
+
+#endif
@@ -115,6 +115,7 @@
 #include "telepathy-glib/exportable-channel.h"
 #include "telepathy-glib/gtypes.h"
 #include "telepathy-glib/interfaces.h"
+#include "telepathy-glib/intset.h"
 #include "telepathy-glib/svc-call.h"
 #include "telepathy-glib/svc-channel.h"
 #include "telepathy-glib/svc-properties-interface.h"
@@ -132,6 +133,8 @@ G_DEFINE_ABSTRACT_TYPE_WITH_CODE (TpBaseCallChannel, tp_base_call_channel,
         dtmf_iface_init)
   )
 
+static void flush_member_changes (TpBaseCallChannel *self);
+
 /* properties */
 enum
 {
@@ -155,6 +158,8 @@ enum
 
   PROP_INITIAL_TONES,
 
+  PROP_TIMELINE,
+
   LAST_PROPERTY
 };
 
@@ -182,8 +187,45 @@ struct _TpBaseCallChannelPrivate
 
   /* TpHandle => TpCallMemberFlags */
   GHashTable *call_members;
+
+  /* number of tp_base_call_channel_begin_batch() calls not yet matched by
+   * tp_base_call_channel_end_batch() */
+  guint batch_depth;
+  /* While batching: members updated (TpHandle => TpCallMemberFlags) or
+   * removed since the last CallMembersChanged, and the reason for the
+   * latest of those changes, or NULL if there have been none. A member
+   * is in at most one of batch_updates and batch_removed: whichever
+   * happened last. */
+  GHashTable *batch_updates;
+  TpIntset *batch_removed;
+  GValueArray *batch_reason;
+
+  /* g_get_monotonic_time() when the channel was created */
+  gint64 creation_time;
+  /* GArray of TimelineEvent, oldest first */
+  GArray *timeline;
 };
 
+typedef struct
+{
+  const gchar *event;
+  gchar *detail;
+  /* microseconds since creation_time */
+  gint64 offset;
+} TimelineEvent;
+
+/* A call that is put on hold over and over again should not make us grow
+ * without bound; setup is long over by the time this fills. */
+#define MAX_TIMELINE_EVENTS 256
+
+static void
+timeline_event_clear (gpointer p)
+{
+  TimelineEvent *ev = p;
+
+  g_free (ev->detail);
+}
+
 static void tp_base_call_channel_accept_real (TpBaseCallChannel *self);
 
 GHashTable *
@@ -234,6 +276,10 @@ tp_base_call_channel_init (TpBaseCallChannel *self)
   self->priv->reason = _tp_base_call_state_reason_new (0, 0, "", "");
   self->priv->details = tp_asv_new (NULL, NULL);
   self->priv->call_members = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  self->priv->creation_time = g_get_monotonic_time ();
+  self->priv->timeline = g_array_new (FALSE, FALSE, sizeof (TimelineEvent));
+  g_array_set_clear_func (self->priv->timeline, timeline_event_clear);
 }
 
 static void
@@ -246,6 +292,9 @@ tp_base_call_channel_constructed (GObject *obj)
       != NULL)
     G_OBJECT_CLASS (tp_base_call_channel_parent_class)->constructed (obj);
 
+  _tp_base_call_channel_add_timeline_event (self, "created",
+      tp_base_channel_is_requested (base) ? "outgoing" : "incoming");
+
   if (tp_base_channel_is_requested (base))
     {
       tp_base_call_channel_set_state (self,
@@ -276,6 +325,9 @@ tp_base_call_channel_dispose (GObject *object)
 
   tp_clear_pointer (&self->priv->contents, content_list_destroy);
   tp_clear_pointer (&self->priv->call_members, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->batch_updates, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->batch_removed, tp_intset_destroy);
+  tp_clear_pointer (&self->priv->batch_reason, tp_value_array_free);
 
   if (G_OBJECT_CLASS (tp_base_call_channel_parent_class)->dispose)
     G_OBJECT_CLASS (tp_base_call_channel_parent_class)->dispose (object);
@@ -291,6 +343,7 @@ tp_base_call_channel_finalize (GObject *object)
   g_free (self->priv->initial_audio_name);
   g_free (self->priv->initial_video_name);
   g_free (self->priv->initial_tones);
+  g_array_unref (self->priv->timeline);
 
   G_OBJECT_CLASS (tp_base_call_channel_parent_class)->finalize (object);
 }
@@ -302,6 +355,8 @@ tp_base_call_channel_close (TpBaseChannel *base)
 
   DEBUG ("Closing call channel %s", tp_base_channel_get_object_path (base));
 
+  flush_member_changes (self);
+
   /* shutdown all our contents */
   tp_clear_pointer (&self->priv->contents, content_list_destroy);
 
@@ -382,6 +437,9 @@ tp_base_call_channel_get_property (GObject *object,
       case PROP_INITIAL_TONES:
         g_value_set_string (value, self->priv->initial_tones);
         break;
+      case PROP_TIMELINE:
+        g_value_take_variant (value, tp_base_call_channel_dup_timeline (self));
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -709,6 +767,25 @@ tp_base_call_channel_class_init (TpBaseCallChannelClass *klass)
   g_object_class_install_property (object_class, PROP_INITIAL_TONES,
       param_spec);
 
+  /**
+   * TpBaseCallChannel:timeline:
+   *
+   * The milestones reached while setting up this call, as a #GVariant of
+   * type a(ssx): an event name, a detail such as the new call state or the
+   * object path of the content or stream concerned, and the number of
+   * microseconds between the creation of the channel and the event.
+   *
+   * See tp_base_call_channel_dup_timeline() for the events recorded.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_variant ("timeline", "Timeline",
+      "Milestones reached while setting up the call",
+      G_VARIANT_TYPE ("a(ssx)"), NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TIMELINE,
+      param_spec);
+
   tp_dbus_properties_mixin_implement_interface (object_class,
       TP_IFACE_QUARK_CHANNEL_TYPE_CALL,
       tp_dbus_properties_mixin_getter_gobject_properties,
@@ -761,6 +838,8 @@ tp_base_call_channel_flags_changed (TpBaseCallChannel *self,
     const gchar *dbus_reason,
     const gchar *message)
 {
+  flush_member_changes (self);
+
   tp_value_array_free (self->priv->reason);
   self->priv->reason = _tp_base_call_state_reason_new (actor_handle, reason,
       dbus_reason, message);
@@ -803,6 +882,10 @@ tp_base_call_channel_set_state (TpBaseCallChannel *self,
 
   g_return_if_fail (TP_IS_BASE_CALL_CHANNEL (self));
 
+  /* so that clients see which members the call had when its state
+   * changed */
+  flush_member_changes (self);
+
   old_state = self->priv->state;
 
   self->priv->state = state;
@@ -829,6 +912,8 @@ tp_base_call_channel_set_state (TpBaseCallChannel *self,
   DEBUG ("state changed from %s => %s",
       call_state_to_string (old_state),
       call_state_to_string (self->priv->state));
+  _tp_base_call_channel_add_timeline_event (self, "call-state",
+      call_state_to_string (self->priv->state));
 
   /* Move from INITIALISING to INITIALISED if we are already connected */
   if (self->priv->state == TP_CALL_STATE_INITIALISING &&
@@ -845,6 +930,8 @@ tp_base_call_channel_set_state (TpBaseCallChannel *self,
       DEBUG ("state changed from %s => %s (bumped)",
           call_state_to_string (TP_CALL_STATE_INITIALISING),
           call_state_to_string (self->priv->state));
+      _tp_base_call_channel_add_timeline_event (self, "call-state",
+          call_state_to_string (self->priv->state));
     }
 
   /* Move from ACCEPTED to ACTIVE if we are already connected */
@@ -862,6 +949,8 @@ tp_base_call_channel_set_state (TpBaseCallChannel *self,
       DEBUG ("state changed from %s => %s (bumped)",
           call_state_to_string (TP_CALL_STATE_ACCEPTED),
           call_state_to_string (self->priv->state));
+      _tp_base_call_channel_add_timeline_event (self, "call-state",
+          call_state_to_string (self->priv->state));
     }
 }
 
@@ -979,6 +1068,7 @@ _tp_base_call_channel_remove_content_internal (TpBaseCallChannel *self,
 
   path = tp_base_call_content_get_object_path (
       TP_BASE_CALL_CONTENT (content));
+  flush_member_changes (self);
   tp_svc_channel_type_call_emit_content_removed (self, path, reason_array);
 
   _tp_base_call_content_deinit (TP_BASE_CALL_CONTENT (content));
@@ -1081,10 +1171,121 @@ tp_base_call_channel_add_content (TpBaseCallChannel *self,
         }
     }
 
+  flush_member_changes (self);
   tp_svc_channel_type_call_emit_content_added (self,
      tp_base_call_content_get_object_path (content));
 }
 
+static void
+batch_set_reason (TpBaseCallChannel *self,
+    TpHandle actor_handle,
+    TpCallStateChangeReason reason,
+    const gchar *dbus_reason,
+    const gchar *message)
+{
+  tp_clear_pointer (&self->priv->batch_reason, tp_value_array_free);
+  self->priv->batch_reason = _tp_base_call_state_reason_new (actor_handle,
+      reason, dbus_reason, message);
+}
+
+/* Emit a single CallMembersChanged for the changes batched since it was
+ * last emitted, if any */
+static void
+flush_member_changes (TpBaseCallChannel *self)
+{
+  GHashTable *updates = self->priv->batch_updates;
+  TpIntset *removed_set = self->priv->batch_removed;
+  GValueArray *reason_array = self->priv->batch_reason;
+  GHashTable *identifiers;
+  GArray *removed;
+
+  if (reason_array == NULL)
+    return;
+
+  self->priv->batch_updates = NULL;
+  self->priv->batch_removed = NULL;
+  self->priv->batch_reason = NULL;
+
+  if (updates == NULL)
+    updates = g_hash_table_new (NULL, NULL);
+
+  if (removed_set != NULL)
+    removed = tp_intset_to_array (removed_set);
+  else
+    removed = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+
+  DEBUG ("%u members updated and %u removed since the batch began",
+      g_hash_table_size (updates), removed->len);
+
+  identifiers = _tp_base_call_dup_member_identifiers (
+      tp_base_channel_get_connection ((TpBaseChannel *) self),
+      updates);
+
+  tp_svc_channel_type_call_emit_call_members_changed (self,
+      updates, identifiers, removed, reason_array);
+
+  g_hash_table_unref (updates);
+  g_hash_table_unref (identifiers);
+  g_array_unref (removed);
+  tp_clear_pointer (&removed_set, tp_intset_destroy);
+  tp_value_array_free (reason_array);
+}
+
+/**
+ * tp_base_call_channel_begin_batch:
+ * @self: a #TpBaseCallChannel
+ *
+ * Start collecting changes to the call's members, rather than signalling
+ * each one as it happens. This is useful for conference calls, where many
+ * members may join, leave or change their #TpCallMemberFlags at once.
+ *
+ * Until the matching call to tp_base_call_channel_end_batch(), calls to
+ * tp_base_call_channel_update_member_flags() and
+ * tp_base_call_channel_remove_member() update
+ * #TpBaseCallChannel:call-members but only record which members were
+ * affected. The changes are signalled together, with the reason given for
+ * the last of them. If a member is updated and later removed during the
+ * batch (or vice versa), only the later change is signalled.
+ *
+ * Pending changes are also signalled early, before the call's state changes
+ * or a content is added or removed, so that clients see them in the same
+ * order as they happened.
+ *
+ * Calls to this function may be nested; the changes are signalled when the
+ * outermost batch ends.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_call_channel_begin_batch (TpBaseCallChannel *self)
+{
+  g_return_if_fail (TP_IS_BASE_CALL_CHANNEL (self));
+
+  self->priv->batch_depth++;
+}
+
+/**
+ * tp_base_call_channel_end_batch:
+ * @self: a #TpBaseCallChannel
+ *
+ * End a batch of changes started by tp_base_call_channel_begin_batch().
+ * If this is the outermost batch, emit a single CallMembersChanged signal
+ * describing every change to the call's members made during the batch.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_call_channel_end_batch (TpBaseCallChannel *self)
+{
+  g_return_if_fail (TP_IS_BASE_CALL_CHANNEL (self));
+  g_return_if_fail (self->priv->batch_depth > 0);
+
+  if (--self->priv->batch_depth > 0)
+    return;
+
+  flush_member_changes (self);
+}
+
 /**
  * tp_base_call_channel_update_member_flags:
  * @self: a #TpBaseCallChannel
@@ -1134,6 +1335,21 @@ tp_base_call_channel_update_member_flags (TpBaseCallChannel *self,
       GUINT_TO_POINTER (contact),
       GUINT_TO_POINTER (new_flags));
 
+  if (self->priv->batch_depth > 0)
+    {
+      if (self->priv->batch_updates == NULL)
+        self->priv->batch_updates = g_hash_table_new (NULL, NULL);
+
+      g_hash_table_insert (self->priv->batch_updates,
+          GUINT_TO_POINTER (contact), GUINT_TO_POINTER (new_flags));
+
+      if (self->priv->batch_removed != NULL)
+        tp_intset_remove (self->priv->batch_removed, contact);
+
+      batch_set_reason (self, actor_handle, reason, dbus_reason, message);
+      return;
+    }
+
   updates = g_hash_table_new (NULL, NULL);
   g_hash_table_insert (updates,
       GUINT_TO_POINTER (contact),
@@ -1192,6 +1408,21 @@ tp_base_call_channel_remove_member (TpBaseCallChannel *self,
 
   DEBUG ("Member %d removed", contact);
 
+  if (self->priv->batch_depth > 0)
+    {
+      if (self->priv->batch_removed == NULL)
+        self->priv->batch_removed = tp_intset_new ();
+
+      tp_intset_add (self->priv->batch_removed, contact);
+
+      if (self->priv->batch_updates != NULL)
+        g_hash_table_remove (self->priv->batch_updates,
+            GUINT_TO_POINTER (contact));
+
+      batch_set_reason (self, actor_handle, reason, dbus_reason, message);
+      return;
+    }
+
   reason_array = _tp_base_call_state_reason_new (actor_handle, reason,
       dbus_reason, message);
   empty_table = g_hash_table_new (NULL, NULL);
@@ -1276,6 +1507,56 @@ tp_base_call_channel_is_accepted (TpBaseCallChannel *self)
   return self->priv->accepted;
 }
 
+/**
+ * tp_base_call_channel_dup_timeline:
+ * @self: a #TpBaseCallChannel
+ *
+ * Return the milestones this call has reached, as a #GVariant of type
+ * a(ssx). Each element is an event name, a detail string, and the time of
+ * the event, in microseconds since the channel was created. Events are in
+ * the order in which they happened. They include:
+ *
+ * <itemizedlist>
+ * <listitem>"created", with detail "outgoing" or "incoming"</listitem>
+ * <listitem>"call-state", with the new #TpCallState's name, such as
+ *  "ACCEPTED" or "ACTIVE", as detail</listitem>
+ * <listitem>"media-description-offered", "media-description-accepted" and
+ *  "media-description-rejected", with the media description's object path
+ *  as detail</listitem>
+ * <listitem>"first-local-candidate", with the stream's object path as
+ *  detail</listitem>
+ * <listitem>"sending-started" and "receiving-started", with the stream's
+ *  object path as detail</listitem>
+ * </itemizedlist>
+ *
+ * Each event is also logged to the #TP_DEBUG_CALL debug domain, and so to
+ * #TpDebugSender if there is one.
+ *
+ * Returns: (transfer full): the timeline, which is not floating
+ * Since: 0.UNRELEASED
+ */
+GVariant *
+tp_base_call_channel_dup_timeline (TpBaseCallChannel *self)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_BASE_CALL_CHANNEL (self), NULL);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssx)"));
+
+  for (i = 0; i < self->priv->timeline->len; i++)
+    {
+      TimelineEvent *ev = &g_array_index (self->priv->timeline,
+          TimelineEvent, i);
+
+      g_variant_builder_add (&builder, "(ssx)", ev->event, ev->detail,
+          ev->offset);
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 /* DBus method implementation */
 
 static void
@@ -1575,3 +1856,40 @@ _tp_base_call_channel_get_initial_tones (TpBaseCallChannel *self)
 
   return self->priv->initial_tones;
 }
+
+/*
+ * _tp_base_call_channel_add_timeline_event:
+ * @self: (allow-none): a #TpBaseCallChannel, or %NULL to do nothing, for
+ *  the convenience of contents and streams not yet added to a channel
+ * @event: a static string naming what happened
+ * @detail: (allow-none): what it happened to, or %NULL
+ *
+ * Record that @event happened now, in #TpBaseCallChannel:timeline.
+ */
+void
+_tp_base_call_channel_add_timeline_event (TpBaseCallChannel *self,
+    const gchar *event,
+    const gchar *detail)
+{
+  TimelineEvent ev;
+
+  if (self == NULL)
+    return;
+
+  g_return_if_fail (TP_IS_BASE_CALL_CHANNEL (self));
+
+  ev.event = event;
+  ev.detail = g_strdup (detail != NULL ? detail : "");
+  ev.offset = g_get_monotonic_time () - self->priv->creation_time;
+
+  DEBUG ("+%" G_GINT64_FORMAT ".%03" G_GINT64_FORMAT " ms: %s %s",
+      ev.offset / 1000, ev.offset % 1000, ev.event, ev.detail);
+
+  if (self->priv->timeline->len >= MAX_TIMELINE_EVENTS)
+    {
+      g_free (ev.detail);
+      return;
+    }
+
+  g_array_append_val (self->priv->timeline, ev);
+}
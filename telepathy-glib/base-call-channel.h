@@ -144,12 +144,20 @@ void tp_base_call_channel_remove_member (TpBaseCallChannel *self,
 _TP_AVAILABLE_IN_0_18
 GHashTable *tp_base_call_channel_get_call_members (TpBaseCallChannel *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_call_channel_begin_batch (TpBaseCallChannel *self);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_call_channel_end_batch (TpBaseCallChannel *self);
+
 _TP_AVAILABLE_IN_0_18
 void tp_base_call_channel_remote_accept (TpBaseCallChannel *self);
 
 _TP_AVAILABLE_IN_0_18
 gboolean tp_base_call_channel_is_accepted (TpBaseCallChannel *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+GVariant *tp_base_call_channel_dup_timeline (TpBaseCallChannel *self);
+
 G_END_DECLS
 
 #endif /* #ifndef __TP_BASE_CALL_CHANNEL_H__*/
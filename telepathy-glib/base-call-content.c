@@ -823,6 +823,18 @@ _tp_base_call_content_get_channel (TpBaseCallContent *self)
   return self->priv->channel;
 }
 
+void
+_tp_base_call_content_add_timeline_event (TpBaseCallContent *self,
+    const gchar *event,
+    const gchar *detail)
+{
+  g_return_if_fail (TP_IS_BASE_CALL_CONTENT (self));
+
+  /* the channel may be NULL if we haven't been added to it yet */
+  _tp_base_call_channel_add_timeline_event (self->priv->channel, event,
+      detail);
+}
+
 void
 _tp_base_call_content_deinit (TpBaseCallContent *self)
 {
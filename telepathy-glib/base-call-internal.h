@@ -45,6 +45,9 @@ void _tp_base_call_content_deinit (TpBaseCallContent *self);
 void _tp_base_call_content_remove_stream_internal (TpBaseCallContent *self,
     TpBaseCallStream *stream,
     const GValueArray *reason_array);
+void _tp_base_call_content_add_timeline_event (TpBaseCallContent *self,
+    const gchar *event,
+    const gchar *detail);
 
 /* Implemented in base-media-call-content.c */
 gboolean _tp_base_media_call_content_ready_to_accept (
@@ -82,6 +85,9 @@ void _tp_base_call_channel_remove_content_internal (TpBaseCallChannel *self,
 gboolean _tp_base_call_channel_is_locally_accepted (TpBaseCallChannel *self);
 gboolean _tp_base_call_channel_is_connected (TpBaseCallChannel *self);
 const gchar *_tp_base_call_channel_get_initial_tones (TpBaseCallChannel *self);
+void _tp_base_call_channel_add_timeline_event (TpBaseCallChannel *self,
+    const gchar *event,
+    const gchar *detail);
 
 /* Implemented in base-media-call-channel.c */
 void _tp_base_media_call_channel_endpoint_state_changed (
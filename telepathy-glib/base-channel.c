@@ -311,8 +311,11 @@
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/svc-channel.h>
 #include <telepathy-glib/svc-generic.h>
+#include <telepathy-glib/base-connection-internal.h>
+#include <telepathy-glib/dbus-internal.h>
 #include <telepathy-glib/debug-internal.h>
 #include <telepathy-glib/util.h>
+#include <telepathy-glib/variant-util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_CHANNEL
 
@@ -340,6 +343,9 @@ struct _TpBaseChannelPrivate
   TpBaseConnection *conn;
 
   char *object_path;
+  /* TRUE if we generated object_path from the connection's path and an
+   * escaped suffix, so it doesn't need validating again */
+  gboolean object_path_trusted;
 
   TpHandle target;
   TpHandle initiator;
@@ -363,6 +369,29 @@ G_DEFINE_TYPE_WITH_CODE (TpBaseChannel, tp_base_channel,
     G_IMPLEMENT_INTERFACE (TP_TYPE_EXPORTABLE_CHANNEL, NULL);
     )
 
+/* Pin @handle, or release a pin, if it is nonzero and its repo exists */
+static void
+pin_handle (TpBaseChannel *chan,
+    TpHandleType handle_type,
+    TpHandle handle,
+    gboolean pin)
+{
+  TpHandleRepoIface *repo;
+
+  if (handle == 0 || chan->priv->conn == NULL)
+    return;
+
+  repo = tp_base_connection_get_handles (chan->priv->conn, handle_type);
+
+  if (repo == NULL)
+    return;
+
+  if (pin)
+    tp_handle_pin (repo, handle);
+  else
+    tp_handle_unpin (repo, handle);
+}
+
 /**
  * tp_base_channel_register:
  * @chan: a channel
@@ -380,7 +409,12 @@ tp_base_channel_register (TpBaseChannel *chan)
   g_assert (chan->priv->object_path != NULL);
   g_return_if_fail (!chan->priv->registered);
 
-  tp_dbus_daemon_register_object (bus, chan->priv->object_path, chan);
+  if (chan->priv->object_path_trusted)
+    _tp_dbus_daemon_register_trusted_object (bus, chan->priv->object_path,
+        chan);
+  else
+    tp_dbus_daemon_register_object (bus, chan->priv->object_path, chan);
+
   chan->priv->registered = TRUE;
 }
 
@@ -416,6 +450,27 @@ tp_base_channel_destroyed (TpBaseChannel *chan)
   g_object_unref (chan);
 }
 
+/*
+ * _tp_base_channel_unregister:
+ * @chan: a channel
+ *
+ * Remove @chan from the bus without closing it. This is called for every
+ * channel when the connection is disconnected, before the channel managers
+ * close them: StatusChanged tells clients that all the channels have gone,
+ * so there's no need to send Closed, MembersChanged and so on for each one
+ * on its way out.
+ */
+void
+_tp_base_channel_unregister (TpBaseChannel *chan)
+{
+  if (chan->priv->registered)
+    {
+      tp_dbus_daemon_unregister_object (
+          tp_base_connection_get_dbus_daemon (chan->priv->conn), chan);
+      chan->priv->registered = FALSE;
+    }
+}
+
 /**
  * tp_base_channel_reopened:
  * @chan: a channel
@@ -501,14 +556,21 @@ tp_base_channel_reopened_with_requested (TpBaseChannel *chan,
   g_object_ref (chan);
 
   if (priv->initiator != initiator)
-    priv->initiator = initiator;
+    {
+      pin_handle (chan, TP_HANDLE_TYPE_CONTACT, initiator, TRUE);
+      pin_handle (chan, TP_HANDLE_TYPE_CONTACT, priv->initiator, FALSE);
+      priv->initiator = initiator;
+    }
 
   priv->requested = requested;
   priv->respawning = TRUE;
 
   tp_svc_channel_emit_closed (chan);
 
-  if (!priv->registered)
+  /* nothing can come back on the bus while the connection is going away */
+  if (!priv->registered &&
+      tp_base_connection_get_status (priv->conn) !=
+        TP_CONNECTION_STATUS_DISCONNECTED)
     tp_base_channel_register (chan);
 
   g_object_unref (chan);
@@ -727,28 +789,6 @@ tp_base_channel_is_respawning (TpBaseChannel *chan)
   return chan->priv->respawning;
 }
 
-/*
- * tp_base_channel_fill_basic_immutable_properties:
- *
- * Specifies the immutable properties supported for this Channel object, by
- * using tp_dbus_properties_mixin_fill_properties_hash().
- */
-static void
-tp_base_channel_fill_basic_immutable_properties (TpBaseChannel *chan, GHashTable *properties)
-{
-  tp_dbus_properties_mixin_fill_properties_hash (G_OBJECT (chan),
-      properties,
-      TP_IFACE_CHANNEL, "ChannelType",
-      TP_IFACE_CHANNEL, "TargetHandleType",
-      TP_IFACE_CHANNEL, "TargetHandle",
-      TP_IFACE_CHANNEL, "TargetID",
-      TP_IFACE_CHANNEL, "InitiatorHandle",
-      TP_IFACE_CHANNEL, "InitiatorID",
-      TP_IFACE_CHANNEL, "Requested",
-      TP_IFACE_CHANNEL, "Interfaces",
-      NULL);
-}
-
 static gchar *
 tp_base_channel_get_basic_object_path_suffix (TpBaseChannel *self)
 {
@@ -810,8 +850,135 @@ tp_base_channel_constructed (GObject *object)
 
       chan->priv->object_path = g_strdup_printf ("%s/%s",
           tp_base_connection_get_object_path (conn), base_path);
+      /* the connection's path was checked when it was registered */
+      chan->priv->object_path_trusted =
+          (klass->get_object_path_suffix ==
+            tp_base_channel_get_basic_object_path_suffix &&
+           tp_base_connection_get_object_path (conn) != NULL);
       g_free (base_path);
     }
+
+  /* keep these valid even if their repos reclaim handles */
+  pin_handle (chan, klass->target_handle_type, chan->priv->target, TRUE);
+  pin_handle (chan, TP_HANDLE_TYPE_CONTACT, chan->priv->initiator, TRUE);
+}
+
+static const gchar *
+tp_base_channel_get_handle_id (TpBaseChannel *chan,
+    TpHandleType handle_type,
+    TpHandle handle)
+{
+  TpHandleRepoIface *repo;
+
+  if (handle == 0)
+    return "";
+
+  repo = tp_base_connection_get_handles (chan->priv->conn, handle_type);
+  g_assert (repo != NULL);
+  return tp_handle_inspect (repo, handle);
+}
+
+/* The same values as tp_dbus_properties_mixin_getter_gobject_properties()
+ * would get via tp_base_channel_get_property(), but without a GValue, so
+ * that GetAll() on the Channel interface can be answered directly */
+static GVariant *
+tp_base_channel_get_channel_property (GObject *object,
+    GQuark iface G_GNUC_UNUSED,
+    GQuark name,
+    gpointer getter_data)
+{
+  TpBaseChannel *chan = TP_BASE_CHANNEL (object);
+  TpBaseChannelClass *klass = TP_BASE_CHANNEL_GET_CLASS (chan);
+  const gchar *prop = g_quark_to_string (name);
+
+  if (!tp_strdiff (prop, "TargetHandleType"))
+    {
+      return g_variant_new_uint32 (klass->target_handle_type);
+    }
+  else if (!tp_strdiff (prop, "TargetHandle"))
+    {
+      return g_variant_new_uint32 (chan->priv->target);
+    }
+  else if (!tp_strdiff (prop, "TargetID"))
+    {
+      g_assert (chan->priv->target == 0 ||
+          klass->target_handle_type != TP_HANDLE_TYPE_NONE);
+      return g_variant_new_string (tp_base_channel_get_handle_id (chan,
+            klass->target_handle_type, chan->priv->target));
+    }
+  else if (!tp_strdiff (prop, "ChannelType"))
+    {
+      return g_variant_new_string (klass->channel_type);
+    }
+  else if (!tp_strdiff (prop, "Interfaces"))
+    {
+      GPtrArray *interfaces = klass->get_interfaces (chan);
+      GVariant *ret = g_variant_new_strv (
+          (const gchar * const *) interfaces->pdata, interfaces->len);
+
+      g_ptr_array_unref (interfaces);
+      return ret;
+    }
+  else if (!tp_strdiff (prop, "Requested"))
+    {
+      return g_variant_new_boolean (chan->priv->requested);
+    }
+  else if (!tp_strdiff (prop, "InitiatorHandle"))
+    {
+      return g_variant_new_uint32 (chan->priv->initiator);
+    }
+  else if (!tp_strdiff (prop, "InitiatorID"))
+    {
+      return g_variant_new_string (tp_base_channel_get_handle_id (chan,
+            TP_HANDLE_TYPE_CONTACT, chan->priv->initiator));
+    }
+
+  g_return_val_if_reached (NULL);
+}
+
+/*
+ * tp_base_channel_fill_basic_immutable_properties:
+ *
+ * Specifies the immutable properties supported for this Channel object.
+ * The values are the same as tp_dbus_properties_mixin_fill_properties_hash()
+ * would get via tp_base_channel_get_property(), but are filled in directly,
+ * since this is done for every channel announced or listed.
+ */
+static void
+tp_base_channel_fill_basic_immutable_properties (TpBaseChannel *chan, GHashTable *properties)
+{
+  TpBaseChannelClass *klass = TP_BASE_CHANNEL_GET_CLASS (chan);
+  _TpAsvBuilder builder;
+  GPtrArray *interfaces;
+
+  g_assert (chan->priv->target == 0 ||
+      klass->target_handle_type != TP_HANDLE_TYPE_NONE);
+
+  _tp_asv_builder_init (&builder);
+  g_value_set_static_string (_tp_asv_builder_add (&builder,
+        TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING), klass->channel_type);
+  _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE,
+      klass->target_handle_type);
+  _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_TARGET_HANDLE,
+      chan->priv->target);
+  _tp_asv_builder_add_string (&builder, TP_PROP_CHANNEL_TARGET_ID,
+      tp_base_channel_get_handle_id (chan, klass->target_handle_type,
+          chan->priv->target));
+  _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_INITIATOR_HANDLE,
+      chan->priv->initiator);
+  _tp_asv_builder_add_string (&builder, TP_PROP_CHANNEL_INITIATOR_ID,
+      tp_base_channel_get_handle_id (chan, TP_HANDLE_TYPE_CONTACT,
+          chan->priv->initiator));
+  _tp_asv_builder_add_boolean (&builder, TP_PROP_CHANNEL_REQUESTED,
+      chan->priv->requested);
+
+  interfaces = klass->get_interfaces (chan);
+  g_ptr_array_add (interfaces, NULL);
+  g_value_set_boxed (_tp_asv_builder_add (&builder,
+        TP_PROP_CHANNEL_INTERFACES, G_TYPE_STRV), interfaces->pdata);
+  g_ptr_array_unref (interfaces);
+
+  _tp_asv_builder_end_into (&builder, properties);
 }
 
 static void
@@ -961,6 +1128,10 @@ tp_base_channel_dispose (GObject *object)
       tp_base_channel_destroyed (chan);
     }
 
+  pin_handle (chan, TP_BASE_CHANNEL_GET_CLASS (chan)->target_handle_type,
+      priv->target, FALSE);
+  pin_handle (chan, TP_HANDLE_TYPE_CONTACT, priv->initiator, FALSE);
+
   tp_clear_object (&priv->conn);
 
   if (G_OBJECT_CLASS (tp_base_channel_parent_class)->dispose)
@@ -1066,6 +1237,10 @@ tp_base_channel_class_init (TpBaseChannelClass *tp_base_channel_class)
   tp_base_channel_class->dbus_props_class.interfaces = prop_interfaces;
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (TpBaseChannelClass, dbus_props_class));
+  tp_dbus_properties_mixin_class_set_variant_getter (object_class,
+      TP_IFACE_CHANNEL, tp_base_channel_get_channel_property);
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_CHANNEL);
   tp_base_channel_class->fill_immutable_properties =
       tp_base_channel_fill_basic_immutable_properties;
   tp_base_channel_class->get_object_path_suffix =
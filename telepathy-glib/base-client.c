@@ -235,6 +235,7 @@ enum {
 enum {
   SIGNAL_REQUEST_ADDED,
   SIGNAL_REQUEST_REMOVED,
+  SIGNAL_OBSERVER_RECOVERY_PROGRESS,
   N_SIGNALS
 };
 
@@ -272,7 +273,10 @@ struct _TpBaseClientPrivate
   /* array of g_strdup(token), plus NULL included in length */
   GPtrArray *handler_caps;
 
-  GList *pending_requests;
+  /* reffed TpChannelRequest, in the order they were added */
+  GQueue pending_requests;
+  /* borrowed object path => borrowed link in pending_requests */
+  GHashTable *pending_requests_by_path;
   /* Channels actually handled by THIS observer.
    * borrowed path (gchar *) => reffed TpChannel */
   GHashTable *my_chans;
@@ -292,6 +296,19 @@ struct _TpBaseClientPrivate
   TpBaseClientDelegatedChannelsCb delegated_channels_cb;
   gpointer delegated_channels_data;
   GDestroyNotify delegated_channels_destroy;
+
+  /* milliseconds, or 0 to wait for as long as it takes */
+  guint prepare_timeout;
+
+  /* see tp_base_client_set_observer_recovery_pacing(); 0 for no limit */
+  guint recovery_max_in_flight;
+  /* reffed TpObserveChannelsContext for recovered channels, waiting to be
+   * prepared; text channels are prepared before the others */
+  GQueue recovery_text_queue;
+  GQueue recovery_queue;
+  /* number of recovered contexts being prepared, and that have been */
+  guint recovery_in_flight;
+  guint recovery_done;
 };
 
 /*
@@ -1013,7 +1030,7 @@ tp_base_client_get_pending_requests (TpBaseClient *self)
 {
   g_return_val_if_fail (self->priv->flags & CLIENT_IS_HANDLER, NULL);
 
-  return g_list_copy (self->priv->pending_requests);
+  return g_list_copy (self->priv->pending_requests.head);
 }
 
 /**
@@ -1080,7 +1097,7 @@ tp_base_client_dup_pending_requests (TpBaseClient *self)
 {
   g_return_val_if_fail (self->priv->flags & CLIENT_IS_HANDLER, NULL);
 
-  return _tp_g_list_copy_deep (self->priv->pending_requests,
+  return _tp_g_list_copy_deep (self->priv->pending_requests.head,
       (GCopyFunc) g_object_ref, NULL);
 }
 
@@ -1128,6 +1145,12 @@ tp_base_client_init (TpBaseClient *self)
   self->priv->my_chans = g_hash_table_new_full (g_str_hash, g_str_equal,
       NULL, g_object_unref);
 
+  g_queue_init (&self->priv->pending_requests);
+  g_queue_init (&self->priv->recovery_text_queue);
+  g_queue_init (&self->priv->recovery_queue);
+  self->priv->pending_requests_by_path = g_hash_table_new (g_str_hash,
+      g_str_equal);
+
   self->priv->account_features = g_array_new (TRUE, FALSE, sizeof (GQuark));
   self->priv->connection_features = g_array_new (TRUE, FALSE, sizeof (GQuark));
   self->priv->channel_features = g_array_new (TRUE, FALSE, sizeof (GQuark));
@@ -1148,8 +1171,32 @@ tp_base_client_dispose (GObject *object)
   tp_clear_object (&self->priv->only_for_account);
   tp_clear_object (&self->priv->channel_factory);
 
-  g_list_free_full (self->priv->pending_requests, g_object_unref);
-  self->priv->pending_requests = NULL;
+  if (self->priv->pending_requests_by_path != NULL)
+    g_hash_table_remove_all (self->priv->pending_requests_by_path);
+
+  g_queue_foreach (&self->priv->pending_requests, (GFunc) g_object_unref,
+      NULL);
+  g_queue_clear (&self->priv->pending_requests);
+
+  if (self->priv->recovery_text_queue.length > 0 ||
+      self->priv->recovery_queue.length > 0)
+    {
+      GError error = { TP_ERROR, TP_ERROR_CANCELLED,
+          "The Observer was disposed before observing these channels" };
+      GQueue *queues[] = { &self->priv->recovery_text_queue,
+          &self->priv->recovery_queue };
+      TpObserveChannelsContext *ctx;
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (queues); i++)
+        {
+          while ((ctx = g_queue_pop_head (queues[i])) != NULL)
+            {
+              tp_observe_channels_context_fail (ctx, &error);
+              g_object_unref (ctx);
+            }
+        }
+    }
 
   if (self->priv->my_chans != NULL &&
       g_hash_table_size (self->priv->my_chans) > 0)
@@ -1182,6 +1229,7 @@ tp_base_client_finalize (GObject *object)
   g_ptr_array_unref (self->priv->approver_filters);
   g_ptr_array_unref (self->priv->handler_filters);
   g_ptr_array_unref (self->priv->handler_caps);
+  g_hash_table_unref (self->priv->pending_requests_by_path);
 
   g_free (self->priv->bus_name);
   g_free (self->priv->object_path);
@@ -1687,6 +1735,34 @@ tp_base_client_class_init (TpBaseClientClass *cls)
       G_TYPE_NONE, 3,
       TP_TYPE_CHANNEL_REQUEST, G_TYPE_STRING, G_TYPE_STRING);
 
+  /**
+   * TpBaseClient::observer-recovery-progress:
+   * @self: a #TpBaseClient
+   * @n_observed: the number of recovered channel bundles that have been
+   *  passed to #TpBaseClientClass.observe_channels so far
+   * @n_remaining: the number of recovered channel bundles that are still
+   *  waiting to be prepared
+   *
+   * Emitted each time a bundle of channels that already existed when @self
+   * was registered has been prepared and passed to
+   * #TpBaseClientClass.observe_channels, if
+   * tp_base_client_set_observer_recovery_pacing() has been called with a
+   * non-zero limit.
+   *
+   * The channel dispatcher does not say how many channels it will recover,
+   * so @n_remaining only counts those it has told @self about so far. When it
+   * reaches 0, @self has caught up with the channel dispatcher.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_OBSERVER_RECOVERY_PROGRESS] = g_signal_new (
+      "observer-recovery-progress", G_OBJECT_CLASS_TYPE (cls),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 2,
+      G_TYPE_UINT, G_TYPE_UINT);
+
   cls->dbus_properties_class.interfaces = prop_ifaces;
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (TpBaseClientClass, dbus_properties_class));
@@ -1747,46 +1823,50 @@ context_prepare_cb (GObject *source,
     }
 }
 
-static GArray *
-dup_features_for_account (TpBaseClient *self,
-    TpAccount *account)
+/* Merge the features @factory_features asked for by the factory, which we
+ * own, with the deprecated features set on @self instead, and intern the
+ * result. The same sets are asked for over and over again, so in the
+ * common case this is a couple of lookups. */
+static const GQuark *
+intern_features (GArray *factory_features,
+    GArray *self_features)
 {
-  GArray *features;
+  const GQuark *ret;
 
-  features = tp_simple_client_factory_dup_account_features (self->priv->factory,
-      account);
+  g_assert (factory_features != NULL);
 
-  g_assert (features != NULL);
+  ret = _tp_quark_array_intern_union (
+      _tp_quark_array_intern ((GQuark *) factory_features->data,
+        factory_features->len),
+      _tp_quark_array_intern ((GQuark *) self_features->data,
+        self_features->len));
 
-  /* Deprecated - Merge features set on self instead of factory */
-  _tp_quark_array_merge (features,
-      (GQuark *) self->priv->account_features->data,
-      self->priv->account_features->len);
+  g_array_unref (factory_features);
+  return ret;
+}
 
-  return features;
+static const GQuark *
+get_features_for_account (TpBaseClient *self,
+    TpAccount *account)
+{
+  return intern_features (
+      tp_simple_client_factory_dup_account_features (self->priv->factory,
+        account),
+      self->priv->account_features);
 }
 
-static GArray *
-dup_features_for_connection (TpBaseClient *self,
+static const GQuark *
+get_features_for_connection (TpBaseClient *self,
     TpConnection *connection)
 {
-  GArray *features;
-
-  features = tp_simple_client_factory_dup_connection_features (
-      self->priv->factory, connection);
-
-  g_assert (features != NULL);
-
-  /* Deprecated - Merge features set on self instead of factory */
-  _tp_quark_array_merge (features,
-      (GQuark *) self->priv->connection_features->data,
-      self->priv->connection_features->len);
-
-  return features;
+  return intern_features (
+      tp_simple_client_factory_dup_connection_features (self->priv->factory,
+        connection),
+      self->priv->connection_features);
 }
 
-static GArray *
-dup_features_for_channel (TpBaseClient *self,
+static const GQuark *
+get_features_for_channel (TpBaseClient *self,
     TpChannel *channel)
 {
   GArray *features;
@@ -1799,14 +1879,7 @@ dup_features_for_channel (TpBaseClient *self,
     features = tp_simple_client_factory_dup_channel_features (
         self->priv->factory, channel);
 
-  g_assert (features != NULL);
-
-  /* Deprecated - Merge features set on self instead of factory */
-  _tp_quark_array_merge (features,
-      (GQuark *) self->priv->channel_features->data,
-      self->priv->channel_features->len);
-
-  return features;
+  return intern_features (features, self->priv->channel_features);
 }
 
 static TpChannel *
@@ -1893,6 +1966,71 @@ error:
   return NULL;
 }
 
+/* @channel is the one whose features are used for all of @ctx's channels;
+ * see ensure_account_connection_channels() */
+static void
+observe_channels_context_prepare (TpBaseClient *self,
+    TpObserveChannelsContext *ctx,
+    TpChannel *channel,
+    GAsyncReadyCallback callback)
+{
+  _tp_observe_channels_context_prepare_async (ctx,
+      get_features_for_account (self, ctx->account),
+      get_features_for_connection (self, ctx->connection),
+      get_features_for_channel (self, channel),
+      self->priv->prepare_timeout,
+      callback, self);
+}
+
+static void observer_recovery_pump (TpBaseClient *self);
+
+static void
+recovery_context_prepare_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpBaseClient *self = user_data;
+
+  g_assert (self->priv->recovery_in_flight > 0);
+  self->priv->recovery_in_flight--;
+  self->priv->recovery_done++;
+
+  context_prepare_cb (source, result, user_data);
+
+  g_signal_emit (self, signals[SIGNAL_OBSERVER_RECOVERY_PROGRESS], 0,
+      self->priv->recovery_done,
+      self->priv->recovery_in_flight +
+          self->priv->recovery_text_queue.length +
+          self->priv->recovery_queue.length);
+
+  observer_recovery_pump (self);
+}
+
+static void
+observer_recovery_pump (TpBaseClient *self)
+{
+  guint max = self->priv->recovery_max_in_flight;
+
+  while (max == 0 || self->priv->recovery_in_flight < max)
+    {
+      TpObserveChannelsContext *ctx;
+
+      ctx = g_queue_pop_head (&self->priv->recovery_text_queue);
+
+      if (ctx == NULL)
+        ctx = g_queue_pop_head (&self->priv->recovery_queue);
+
+      if (ctx == NULL)
+        break;
+
+      self->priv->recovery_in_flight++;
+      observe_channels_context_prepare (self, ctx,
+          g_ptr_array_index (ctx->channels, ctx->channels->len - 1),
+          recovery_context_prepare_cb);
+      g_object_unref (ctx);
+    }
+}
+
 static void
 _tp_base_client_observe_channels (TpSvcClientObserver *iface,
     const gchar *account_path,
@@ -1913,9 +2051,6 @@ _tp_base_client_observe_channels (TpSvcClientObserver *iface,
   TpChannelDispatchOperation *dispatch_operation = NULL;
   guint i;
   TpChannel *channel = NULL;
-  GArray *account_features;
-  GArray *connection_features;
-  GArray *channel_features;
   GHashTable *request_props;
 
   if (!(self->priv->flags & CLIENT_IS_OBSERVER))
@@ -1983,20 +2118,25 @@ _tp_base_client_observe_channels (TpSvcClientObserver *iface,
   ctx = _tp_observe_channels_context_new (account, connection, channels,
       dispatch_operation, requests, observer_info, context);
 
-  account_features = dup_features_for_account (self, account);
-  connection_features = dup_features_for_connection (self, connection);
-  channel_features = dup_features_for_channel (self, channel);
-
-  _tp_observe_channels_context_prepare_async (ctx,
-      (GQuark *) account_features->data,
-      (GQuark *) connection_features->data,
-      (GQuark *) channel_features->data,
-      context_prepare_cb, self);
+  if (self->priv->recovery_max_in_flight > 0 &&
+      tp_observe_channels_context_is_recovering (ctx))
+    {
+      /* the channel dispatcher is not waiting for recovered channels before
+       * dispatching anything, so they can wait for their turn */
+      if (tp_channel_get_channel_type_id (channel) ==
+          TP_IFACE_QUARK_CHANNEL_TYPE_TEXT)
+        g_queue_push_tail (&self->priv->recovery_text_queue, ctx);
+      else
+        g_queue_push_tail (&self->priv->recovery_queue, ctx);
 
-  g_object_unref (ctx);
-  g_array_unref (account_features);
-  g_array_unref (connection_features);
-  g_array_unref (channel_features);
+      observer_recovery_pump (self);
+    }
+  else
+    {
+      observe_channels_context_prepare (self, ctx, channel,
+          context_prepare_cb);
+      g_object_unref (ctx);
+    }
 
 out:
   g_clear_object (&account);
@@ -2091,9 +2231,9 @@ _tp_base_client_add_dispatch_operation (TpSvcClientApprover *iface,
   GPtrArray *channels = NULL;
   TpChannelDispatchOperation *dispatch_operation = NULL;
   TpChannel *channel = NULL;
-  GArray *account_features;
-  GArray *connection_features;
-  GArray *channel_features;
+  const GQuark *account_features;
+  const GQuark *connection_features;
+  const GQuark *channel_features;
 
   if (!(self->priv->flags & CLIENT_IS_APPROVER))
     {
@@ -2157,20 +2297,18 @@ _tp_base_client_add_dispatch_operation (TpSvcClientApprover *iface,
   ctx = _tp_add_dispatch_operation_context_new (account, connection, channels,
       dispatch_operation, context);
 
-  account_features = dup_features_for_account (self, account);
-  connection_features = dup_features_for_connection (self, connection);
-  channel_features = dup_features_for_channel (self, channel);
+  account_features = get_features_for_account (self, account);
+  connection_features = get_features_for_connection (self, connection);
+  channel_features = get_features_for_channel (self, channel);
 
   _tp_add_dispatch_operation_context_prepare_async (ctx,
-      (GQuark *) account_features->data,
-      (GQuark *) connection_features->data,
-      (GQuark *) channel_features->data,
+      account_features,
+      connection_features,
+      channel_features,
+      self->priv->prepare_timeout,
       add_dispatch_context_prepare_cb, self);
 
   g_object_unref (ctx);
-  g_array_unref (account_features);
-  g_array_unref (connection_features);
-  g_array_unref (channel_features);
 
 out:
   g_clear_object (&account);
@@ -2406,17 +2544,13 @@ static TpChannelRequest *
 find_request_by_path (TpBaseClient *self,
     const gchar *path)
 {
-  GList *l;
+  GList *link = g_hash_table_lookup (self->priv->pending_requests_by_path,
+      path);
 
-  for (l = self->priv->pending_requests; l != NULL; l = g_list_next (l))
-    {
-      TpChannelRequest *request = l->data;
-
-      if (!tp_strdiff (tp_proxy_get_object_path (request), path))
-        return request;
-    }
+  if (link == NULL)
+    return NULL;
 
-  return NULL;
+  return link->data;
 }
 
 static void
@@ -2438,9 +2572,9 @@ _tp_base_client_handle_channels (TpSvcClientHandler *iface,
   GPtrArray *channels = NULL, *requests = NULL;
   guint i;
   TpChannel *channel = NULL;
-  GArray *account_features;
-  GArray *connection_features;
-  GArray *channel_features;
+  const GQuark *account_features;
+  const GQuark *connection_features;
+  const GQuark *channel_features;
   GHashTable *request_props;
 
   if (!(self->priv->flags & CLIENT_IS_HANDLER))
@@ -2506,20 +2640,18 @@ _tp_base_client_handle_channels (TpSvcClientHandler *iface,
   ctx = _tp_handle_channels_context_new (account, connection, channels,
       requests, user_action_time, handler_info, context);
 
-  account_features = dup_features_for_account (self, account);
-  connection_features = dup_features_for_connection (self, connection);
-  channel_features = dup_features_for_channel (self, channel);
+  account_features = get_features_for_account (self, account);
+  connection_features = get_features_for_connection (self, connection);
+  channel_features = get_features_for_channel (self, channel);
 
   _tp_handle_channels_context_prepare_async (ctx,
-      (GQuark *) account_features->data,
-      (GQuark *) connection_features->data,
-      (GQuark *) channel_features->data,
+      account_features,
+      connection_features,
+      channel_features,
+      self->priv->prepare_timeout,
       handle_channels_context_prepare_cb, self);
 
   g_object_unref (ctx);
-  g_array_unref (account_features);
-  g_array_unref (connection_features);
-  g_array_unref (channel_features);
 
 out:
   g_clear_object (&account);
@@ -2607,7 +2739,7 @@ _tp_base_client_add_request (TpSvcClientInterfaceRequests *iface,
   TpAccount *account = NULL;
   GError *error = NULL;
   channel_request_prepare_account_ctx *ctx;
-  GArray *account_features;
+  const GQuark *account_features;
 
   request = _tp_simple_client_factory_ensure_channel_request (
       self->priv->factory, path, properties, &error);
@@ -2632,18 +2764,27 @@ _tp_base_client_add_request (TpSvcClientInterfaceRequests *iface,
   if (account == NULL)
     goto err;
 
-  self->priv->pending_requests = g_list_append (self->priv->pending_requests,
-      request);
+  if (find_request_by_path (self, tp_proxy_get_object_path (request)) != NULL)
+    {
+      /* the factory gave us the same object, and we already have a ref */
+      g_object_unref (request);
+    }
+  else
+    {
+      g_queue_push_tail (&self->priv->pending_requests, request);
+      g_hash_table_insert (self->priv->pending_requests_by_path,
+          (gchar *) tp_proxy_get_object_path (request),
+          self->priv->pending_requests.tail);
+    }
 
   ctx = channel_request_prepare_account_ctx_new (self, request);
 
-  account_features = dup_features_for_account (self, account);
+  account_features = get_features_for_account (self, account);
 
   tp_proxy_prepare_async (account,
-      (GQuark *) account_features->data,
+      account_features,
       channel_request_account_prepare_cb, ctx);
 
-  g_array_unref (account_features);
 
   tp_svc_client_interface_requests_return_from_add_request (context);
   return;
@@ -2675,11 +2816,13 @@ _tp_base_client_remove_request (TpSvcClientInterfaceRequests *iface,
       return;
     }
 
-  self->priv->pending_requests = g_list_remove (self->priv->pending_requests,
-      request);
+  g_queue_delete_link (&self->priv->pending_requests,
+      g_hash_table_lookup (self->priv->pending_requests_by_path, path));
+  g_hash_table_remove (self->priv->pending_requests_by_path, path);
 
   g_signal_emit (self, signals[SIGNAL_REQUEST_REMOVED], 0, request,
       error, reason);
+  g_object_unref (request);
 
   tp_svc_client_interface_requests_return_from_remove_request (context);
 }
@@ -3169,24 +3312,33 @@ gboolean
 tp_base_client_is_handling_channel (TpBaseClient *self,
     TpChannel *channel)
 {
-  GList *channels, *l;
-  gboolean found = FALSE;
+  GHashTable *clients;
+  GHashTableIter iter;
+  gpointer value;
+  const gchar *path;
 
   g_return_val_if_fail (TP_IS_BASE_CLIENT (self), FALSE);
   g_return_val_if_fail (self->priv->flags & CLIENT_IS_HANDLER, FALSE);
 
-  channels = tp_base_client_dup_handled_channels (self);
-  for (l = channels; l != NULL && !found; l = g_list_next (l))
-    {
-      TpChannel *chan = l->data;
+  if (clients_slot == -1 || self->priv->libdbus == NULL)
+    return FALSE;
+
+  path = tp_proxy_get_object_path (channel);
+  clients = dbus_connection_get_data (self->priv->libdbus, clients_slot);
 
-      if (!tp_strdiff (tp_proxy_get_object_path (channel),
-            tp_proxy_get_object_path (chan)))
-        found = TRUE;
+  if (clients == NULL)
+    return FALSE;
+
+  /* look in each client's table of channels, rather than building the
+   * whole set of handled channels */
+  g_hash_table_iter_init (&iter, clients);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      if (g_hash_table_lookup (value, path) != NULL)
+        return TRUE;
     }
 
-  g_list_free_full (channels, g_object_unref);
-  return found;
+  return FALSE;
 }
 
 void
@@ -3479,3 +3631,72 @@ tp_base_client_set_delegated_channels_callback (TpBaseClient *self,
   self->priv->delegated_channels_data = user_data;
   self->priv->delegated_channels_destroy = destroy;
 }
+
+/**
+ * tp_base_client_set_prepare_timeout:
+ * @self: a #TpBaseClient
+ * @timeout_ms: how long to wait, in milliseconds, or 0 to wait for as long
+ *  as it takes
+ *
+ * Set an upper bound on how long @self waits for the account, connection,
+ * channels and channel dispatch operation to be prepared before calling
+ * #TpBaseClientClass.observe_channels,
+ * #TpBaseClientClass.add_dispatch_operation or
+ * #TpBaseClientClass.handle_channels. When it expires, the method is called
+ * anyway; features are only ever prepared if possible, so implementations
+ * should check with tp_proxy_is_prepared() before relying on one.
+ *
+ * This is useful for Observers which must respond before the channel
+ * dispatcher gives up on them, even if a connection manager is slow.
+ *
+ * Proxies which already have every requested feature are not asked to
+ * prepare them again, so the timeout only matters when something has to be
+ * fetched.
+ *
+ * This may be called at any time, and affects subsequent calls.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_client_set_prepare_timeout (TpBaseClient *self,
+    guint timeout_ms)
+{
+  g_return_if_fail (TP_IS_BASE_CLIENT (self));
+
+  self->priv->prepare_timeout = timeout_ms;
+}
+
+/**
+ * tp_base_client_set_observer_recovery_pacing:
+ * @self: a #TpBaseClient
+ * @max_in_flight: the maximum number of recovered channel bundles to prepare
+ *  at the same time, or 0 for no limit
+ *
+ * When an Observer set up with tp_base_client_set_observer_recover() is
+ * registered, the channel dispatcher tells it about every channel that
+ * already exists, all at once. Preparing every account, connection and
+ * channel involved at the same time can take so long, on a system with
+ * many accounts, that the preparation times out.
+ *
+ * If @max_in_flight is non-zero, only that many of these recovered bundles
+ * are prepared at once, and the others wait for their turn; text channels
+ * are prepared before any others.
+ * #TpBaseClient::observer-recovery-progress is emitted as each one is passed
+ * to #TpBaseClientClass.observe_channels. Channels which are not being
+ * recovered are never delayed.
+ *
+ * The limit is 0 by default. This may be called at any time, and affects
+ * subsequent calls; recovered channels already waiting are prepared as
+ * the new limit allows.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_client_set_observer_recovery_pacing (TpBaseClient *self,
+    guint max_in_flight)
+{
+  g_return_if_fail (TP_IS_BASE_CLIENT (self));
+
+  self->priv->recovery_max_in_flight = max_in_flight;
+  observer_recovery_pump (self);
+}
@@ -221,6 +221,14 @@ GList *tp_base_client_dup_handled_channels (TpBaseClient *self);
 gboolean tp_base_client_is_handling_channel (TpBaseClient *self,
     TpChannel *channel);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_client_set_prepare_timeout (TpBaseClient *self,
+    guint timeout_ms);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_client_set_observer_recovery_pacing (TpBaseClient *self,
+    guint max_in_flight);
+
 _TP_AVAILABLE_IN_0_16
 void tp_base_client_delegate_channels_async (TpBaseClient *self,
     GList *channels,
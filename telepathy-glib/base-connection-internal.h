@@ -23,6 +23,8 @@
 #define __TP_BASE_CONNECTION_INTERNAL_H__
 
 #include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/base-connection-manager.h>
+#include <telepathy-glib/base-channel.h>
 
 G_BEGIN_DECLS
 
@@ -33,6 +35,32 @@ void _tp_base_connection_set_handle_repo (TpBaseConnection *self,
 gpointer _tp_base_connection_find_channel_manager (TpBaseConnection *self,
     GType type);
 
+void _tp_base_connection_set_connection_manager (TpBaseConnection *self,
+    TpBaseConnectionManager *cm);
+void _tp_base_connection_start_connecting (TpBaseConnection *self);
+
+void _tp_base_connection_add_contact_interests (TpBaseConnection *self,
+    const gchar *unique_name,
+    const gchar * const *tokens,
+    const GArray *contacts);
+
+void _tp_base_connection_hold_handles (TpBaseConnection *self,
+    const gchar *unique_name,
+    TpHandleType handle_type,
+    const GArray *handles);
+
+gboolean _tp_base_connection_has_unicast_signals (TpBaseConnection *self,
+    GQuark token);
+
+/* implemented in base-channel.c */
+void _tp_base_channel_unregister (TpBaseChannel *chan);
+
+/* implemented in base-connection-manager.c */
+gboolean _tp_base_connection_manager_admit (TpBaseConnectionManager *self,
+    TpBaseConnection *conn);
+void _tp_base_connection_manager_release (TpBaseConnectionManager *self,
+    TpBaseConnection *conn);
+
 G_END_DECLS
 
 #endif
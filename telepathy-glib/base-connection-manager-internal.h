@@ -0,0 +1,36 @@
+/*<private_header>*/
+/* TpBaseConnectionManager (internals)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_BASE_CONNECTION_MANAGER_INTERNAL_H__
+#define __TP_BASE_CONNECTION_MANAGER_INTERNAL_H__
+
+#include <telepathy-glib/base-connection-manager.h>
+
+G_BEGIN_DECLS
+
+void _tp_base_connection_manager_set_handoff (TpBaseConnectionManager *self,
+    gboolean handoff);
+
+gchar *_tp_base_connection_manager_dup_bus_name (
+    TpBaseConnectionManager *self);
+
+G_END_DECLS
+
+#endif
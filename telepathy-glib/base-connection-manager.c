@@ -37,13 +37,18 @@
 
 #include <string.h>
 
+#include <dbus/dbus.h>
 #include <dbus/dbus-protocol.h>
 
 #include <telepathy-glib/telepathy-glib.h>
 
 #define DEBUG_FLAG TP_DEBUG_PARAMS
+#include "telepathy-glib/base-connection-internal.h"
+#include "telepathy-glib/base-connection-manager-internal.h"
 #include "telepathy-glib/base-protocol-internal.h"
+#include "telepathy-glib/dbus-internal.h"
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/metrics-internal.h"
 
 /**
  * TpCMProtocolSpec:
@@ -292,7 +297,9 @@ G_DEFINE_ABSTRACT_TYPE_WITH_CODE(TpBaseConnectionManager,
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
       tp_dbus_properties_mixin_iface_init);
     G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_CONNECTION_MANAGER,
-        service_iface_init))
+        service_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_METRICS1,
+      _tp_metrics_iface_init))
 
 struct _TpBaseConnectionManagerPrivate
 {
@@ -302,10 +309,27 @@ struct _TpBaseConnectionManagerPrivate
   GHashTable *connections;
   /* true after tp_base_connection_manager_register is called */
   gboolean registered;
+  /* if TRUE, tp_base_connection_manager_register() takes the bus name
+   * from a running instance and lets a later one take it from us */
+  gboolean handoff;
    /* dup'd string => ref to TpBaseProtocol */
   GHashTable *protocols;
 
   TpDBusDaemon *dbus_daemon;
+
+  /* at most this many connections may be connecting at once, or 0 for
+   * no limit */
+  guint max_connecting;
+  /* used as a set: borrowed TpBaseConnection * which have been allowed to
+   * start connecting, and haven't finished yet */
+  GHashTable *connecting;
+  /* reffed TpBaseConnection * waiting their turn, oldest first */
+  GQueue waiting;
+  /* TRUE while we are starting connections from the waiting queue */
+  gboolean admitting;
+  /* protects max_connecting, connecting, waiting and admitting, which
+   * connections bound to other threads' main contexts use */
+  GMutex admission_lock;
 };
 
 enum
@@ -349,6 +373,9 @@ tp_base_connection_manager_dispose (GObject *object)
       priv->protocols = NULL;
     }
 
+  g_queue_foreach (&priv->waiting, (GFunc) g_object_unref, NULL);
+  g_queue_clear (&priv->waiting);
+
   if (dispose != NULL)
     dispose (object);
 }
@@ -360,6 +387,8 @@ tp_base_connection_manager_finalize (GObject *object)
   TpBaseConnectionManagerPrivate *priv = self->priv;
 
   g_hash_table_unref (priv->connections);
+  g_hash_table_unref (priv->connecting);
+  g_mutex_clear (&priv->admission_lock);
 
   G_OBJECT_CLASS (tp_base_connection_manager_parent_class)->finalize (object);
 }
@@ -598,6 +627,8 @@ tp_base_connection_manager_class_init (TpBaseConnectionManagerClass *klass)
       TP_IFACE_QUARK_CONNECTION_MANAGER,
       tp_dbus_properties_mixin_getter_gobject_properties, NULL,
       cm_properties);
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_CONNECTION_MANAGER);
 }
 
 static void
@@ -609,10 +640,52 @@ tp_base_connection_manager_init (TpBaseConnectionManager *self)
   self->priv = priv;
 
   priv->connections = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->connecting = g_hash_table_new (NULL, NULL);
+  g_queue_init (&priv->waiting);
+  g_mutex_init (&priv->admission_lock);
   priv->protocols = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, g_object_unref);
 }
 
+typedef struct {
+    TpBaseConnectionManager *self;
+    TpBaseConnection *conn;
+} ForgetConnection;
+
+static gboolean
+release_connection_cb (gpointer conn)
+{
+  g_object_unref (conn);
+  return FALSE;
+}
+
+/* Called in our own main context (the global default), even if @conn is
+ * bound to another */
+static gboolean
+forget_connection_cb (gpointer data)
+{
+  ForgetConnection *forget = data;
+  TpBaseConnectionManagerPrivate *priv = forget->self->priv;
+
+  g_assert (g_hash_table_lookup (priv->connections, forget->conn));
+  g_hash_table_remove (priv->connections, forget->conn);
+
+  DEBUG ("dereferenced connection");
+  if (g_hash_table_size (priv->connections) == 0)
+    {
+      g_signal_emit (forget->self, signals[NO_MORE_CONNECTIONS], 0);
+    }
+
+  /* drop the ref that priv->connections had in the connection's own main
+   * context, so that it is disposed by the thread that uses it */
+  g_main_context_invoke (tp_base_connection_get_main_context (forget->conn),
+      release_connection_cb, forget->conn);
+
+  g_object_unref (forget->self);
+  g_slice_free (ForgetConnection, forget);
+  return FALSE;
+}
+
 /**
  * connection_shutdown_finished_cb:
  * @conn: #TpBaseConnection
@@ -626,27 +699,18 @@ static void
 connection_shutdown_finished_cb (TpBaseConnection *conn,
                                  gpointer data)
 {
-  TpBaseConnectionManager *self = TP_BASE_CONNECTION_MANAGER (data);
-  TpBaseConnectionManagerPrivate *priv = self->priv;
+  ForgetConnection *forget = g_slice_new (ForgetConnection);
 
-  /* temporary ref, because disconnecting this signal handler might release
+  /* take a ref, because disconnecting this signal handler might release
    * the last ref */
-  g_object_ref (self);
-
-  g_assert (g_hash_table_lookup (priv->connections, conn));
-  g_hash_table_remove (priv->connections, conn);
-
-  DEBUG ("dereferenced connection");
-  if (g_hash_table_size (priv->connections) == 0)
-    {
-      g_signal_emit (self, signals[NO_MORE_CONNECTIONS], 0);
-    }
+  forget->self = g_object_ref (data);
+  forget->conn = conn;
 
   g_signal_handlers_disconnect_by_func (conn,
       connection_shutdown_finished_cb, data);
 
-  g_object_unref (conn);
-  g_object_unref (self);
+  /* if @conn is bound to another thread's main context, this is queued */
+  g_main_context_invoke (NULL, forget_connection_cb, forget);
 }
 
 /* Parameter parsing */
@@ -1055,6 +1119,8 @@ tp_base_connection_manager_request_connection (TpSvcConnectionManager *iface,
       goto ERROR;
     }
 
+  _tp_base_connection_set_connection_manager (conn, self);
+
   /* bind to status change signals from the connection object */
   g_signal_connect_data (conn, "shutdown-finished",
       G_CALLBACK (connection_shutdown_finished_cb),
@@ -1124,8 +1190,13 @@ tp_base_connection_manager_register (TpBaseConnectionManager *self)
   string = g_string_new (TP_CM_BUS_NAME_BASE);
   g_string_append (string, cls->cm_dbus_name);
 
-  if (!tp_dbus_daemon_request_name (self->priv->dbus_daemon, string->str,
-        TRUE, &error))
+  if (!_tp_dbus_daemon_request_name_with_flags (self->priv->dbus_daemon,
+        string->str, TRUE,
+        DBUS_NAME_FLAG_DO_NOT_QUEUE |
+        (self->priv->handoff ?
+          DBUS_NAME_FLAG_ALLOW_REPLACEMENT | DBUS_NAME_FLAG_REPLACE_EXISTING :
+          0),
+        &error))
     goto except;
 
   g_string_assign (string, TP_CM_OBJECT_PATH_BASE);
@@ -1178,6 +1249,39 @@ except:
   return FALSE;
 }
 
+/*
+ * _tp_base_connection_manager_set_handoff:
+ * @self: the connection manager, not yet registered
+ * @handoff: whether to hand the bus name over between instances
+ *
+ * If @handoff is %TRUE, tp_base_connection_manager_register() will take the
+ * well-known name from a running instance of this connection manager which
+ * also allowed it, and will in turn allow a later instance to take it. The
+ * last owner receives NameLost; it is up to the caller to notice that and
+ * wind down.
+ */
+void
+_tp_base_connection_manager_set_handoff (TpBaseConnectionManager *self,
+    gboolean handoff)
+{
+  g_return_if_fail (TP_IS_BASE_CONNECTION_MANAGER (self));
+  g_return_if_fail (!self->priv->registered);
+
+  self->priv->handoff = handoff;
+}
+
+/* Returns the well-known name which @self registers. */
+gchar *
+_tp_base_connection_manager_dup_bus_name (TpBaseConnectionManager *self)
+{
+  TpBaseConnectionManagerClass *cls;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION_MANAGER (self), NULL);
+
+  cls = TP_BASE_CONNECTION_MANAGER_GET_CLASS (self);
+  return g_strconcat (TP_CM_BUS_NAME_BASE, cls->cm_dbus_name, NULL);
+}
+
 static void
 service_iface_init (gpointer g_iface, gpointer iface_data)
 {
@@ -1232,3 +1336,198 @@ tp_base_connection_manager_add_protocol (TpBaseConnectionManager *self,
       g_strdup (tp_base_protocol_get_name (protocol)),
       g_object_ref (protocol));
 }
+
+static gboolean
+has_room_to_connect (TpBaseConnectionManager *self)
+{
+  return (self->priv->max_connecting == 0 ||
+      g_hash_table_size (self->priv->connecting) <
+          self->priv->max_connecting);
+}
+
+static gboolean
+start_connecting_cb (gpointer conn)
+{
+  _tp_base_connection_start_connecting (conn);
+  return FALSE;
+}
+
+static void
+admit_waiting (TpBaseConnectionManager *self)
+{
+  g_mutex_lock (&self->priv->admission_lock);
+
+  /* starting a connection can make it finish synchronously, which calls
+   * back into _tp_base_connection_manager_release(); the loop below will
+   * notice the room that makes */
+  if (self->priv->admitting)
+    {
+      g_mutex_unlock (&self->priv->admission_lock);
+      return;
+    }
+
+  self->priv->admitting = TRUE;
+
+  while (has_room_to_connect (self) &&
+      !g_queue_is_empty (&self->priv->waiting))
+    {
+      TpBaseConnection *conn = g_queue_pop_head (&self->priv->waiting);
+
+      DEBUG ("%p may start connecting now; %u still waiting", conn,
+          g_queue_get_length (&self->priv->waiting));
+
+      g_hash_table_add (self->priv->connecting, conn);
+      g_mutex_unlock (&self->priv->admission_lock);
+
+      /* this happens immediately unless @conn is bound to another thread's
+       * main context; the queue's ref is released afterwards */
+      g_main_context_invoke_full (tp_base_connection_get_main_context (conn),
+          G_PRIORITY_DEFAULT, start_connecting_cb, conn, g_object_unref);
+
+      g_mutex_lock (&self->priv->admission_lock);
+    }
+
+  self->priv->admitting = FALSE;
+  g_mutex_unlock (&self->priv->admission_lock);
+}
+
+/*
+ * _tp_base_connection_manager_admit:
+ * @self: the connection manager which created @conn
+ * @conn: a connection whose Connect() method has been called
+ *
+ * Returns: %TRUE if @conn may start connecting immediately; if %FALSE, it
+ *  has been queued, and _tp_base_connection_start_connecting() will be
+ *  called on it when there is room
+ */
+gboolean
+_tp_base_connection_manager_admit (TpBaseConnectionManager *self,
+    TpBaseConnection *conn)
+{
+  g_mutex_lock (&self->priv->admission_lock);
+
+  if (has_room_to_connect (self) && g_queue_is_empty (&self->priv->waiting))
+    {
+      g_hash_table_add (self->priv->connecting, conn);
+      g_mutex_unlock (&self->priv->admission_lock);
+      return TRUE;
+    }
+
+  DEBUG ("%u connections are already connecting; %p must wait behind %u "
+      "others", g_hash_table_size (self->priv->connecting), conn,
+      g_queue_get_length (&self->priv->waiting));
+  g_queue_push_tail (&self->priv->waiting, g_object_ref (conn));
+  g_mutex_unlock (&self->priv->admission_lock);
+  return FALSE;
+}
+
+/*
+ * _tp_base_connection_manager_release:
+ * @self: the connection manager which created @conn
+ * @conn: a connection which has finished connecting, successfully or not,
+ *  or has been disconnected while it was waiting to start
+ *
+ * Let the next waiting connection, if any, start connecting.
+ */
+void
+_tp_base_connection_manager_release (TpBaseConnectionManager *self,
+    TpBaseConnection *conn)
+{
+  GList *link;
+  gboolean was_connecting;
+
+  g_mutex_lock (&self->priv->admission_lock);
+  link = g_queue_find (&self->priv->waiting, conn);
+
+  if (link != NULL)
+    {
+      g_queue_delete_link (&self->priv->waiting, link);
+      g_mutex_unlock (&self->priv->admission_lock);
+      g_object_unref (conn);
+      return;
+    }
+
+  was_connecting = g_hash_table_remove (self->priv->connecting, conn);
+  g_mutex_unlock (&self->priv->admission_lock);
+
+  if (was_connecting)
+    admit_waiting (self);
+}
+
+/**
+ * tp_base_connection_manager_set_max_connecting:
+ * @self: a connection manager
+ * @max_connecting: the maximum number of connections that may be
+ *  connecting at the same time, or 0 for no limit
+ *
+ * Limit how many of the connections created by @self may be in the
+ * process of connecting at once, across all protocols. If a connection's
+ * Connect() method is called while that many are connecting, it remains
+ * in state #TP_INTERNAL_CONNECTION_STATUS_NEW, and its
+ * #TpBaseConnectionClass.start_connecting is not called, until another
+ * connection becomes connected or disconnected. Waiting connections start in
+ * the order that Connect() was called.
+ *
+ * This avoids starting hundreds of network handshakes at once when every
+ * account is brought online together, for instance after a network problem
+ * is resolved.
+ *
+ * The default is 0, meaning no limit.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_manager_set_max_connecting (TpBaseConnectionManager *self,
+    guint max_connecting)
+{
+  g_return_if_fail (TP_IS_BASE_CONNECTION_MANAGER (self));
+
+  g_mutex_lock (&self->priv->admission_lock);
+  self->priv->max_connecting = max_connecting;
+  g_mutex_unlock (&self->priv->admission_lock);
+  admit_waiting (self);
+}
+
+/**
+ * tp_base_connection_manager_get_max_connecting:
+ * @self: a connection manager
+ *
+ * <!-- -->
+ *
+ * Returns: the limit set by tp_base_connection_manager_set_max_connecting()
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_base_connection_manager_get_max_connecting (TpBaseConnectionManager *self)
+{
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION_MANAGER (self), 0);
+
+  return self->priv->max_connecting;
+}
+
+/**
+ * tp_base_connection_manager_get_n_waiting_connections:
+ * @self: a connection manager
+ *
+ * <!-- -->
+ *
+ * Returns: the number of connections whose Connect() method has been called,
+ *  but which are waiting for others to finish connecting before they start,
+ *  as described in tp_base_connection_manager_set_max_connecting()
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_base_connection_manager_get_n_waiting_connections (
+    TpBaseConnectionManager *self)
+{
+  guint n;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION_MANAGER (self), 0);
+
+  g_mutex_lock (&self->priv->admission_lock);
+  n = g_queue_get_length (&self->priv->waiting);
+  g_mutex_unlock (&self->priv->admission_lock);
+  return n;
+}
@@ -105,6 +105,17 @@ TpDBusDaemon *tp_base_connection_manager_get_dbus_daemon (
 void tp_base_connection_manager_add_protocol (TpBaseConnectionManager *self,
     TpBaseProtocol *protocol);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_manager_set_max_connecting (
+    TpBaseConnectionManager *self,
+    guint max_connecting);
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_base_connection_manager_get_max_connecting (
+    TpBaseConnectionManager *self);
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_base_connection_manager_get_n_waiting_connections (
+    TpBaseConnectionManager *self);
+
 /* TYPE MACROS */
 #define TP_TYPE_BASE_CONNECTION_MANAGER \
   (tp_base_connection_manager_get_type ())
@@ -248,25 +248,33 @@
 #include <telepathy-glib/base-connection.h>
 #include <telepathy-glib/base-connection-internal.h>
 
+#include <errno.h>
 #include <string.h>
 
 #include <dbus/dbus-glib-lowlevel.h>
+#include <glib/gstdio.h>
 
 #include <telepathy-glib/channel-factory-iface.h>
 #include <telepathy-glib/channel-manager.h>
 #include <telepathy-glib/connection-manager.h>
 #include <telepathy-glib/contacts-mixin.h>
+#include <telepathy-glib/contacts-mixin-internal.h>
 #include <telepathy-glib/dbus-properties-mixin.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/dbus-internal.h>
 #include <telepathy-glib/exportable-channel.h>
 #include <telepathy-glib/gtypes.h>
+#include <telepathy-glib/handle-repo-dynamic.h>
+#include <telepathy-glib/handle-repo-internal.h>
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/svc-generic.h>
 #include <telepathy-glib/util.h>
 
 #define DEBUG_FLAG TP_DEBUG_CONNECTION
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/metrics-internal.h"
+#include "telepathy-glib/timer-wheel-internal.h"
+#include "telepathy-glib/util-internal.h"
 #include "telepathy-glib/variant-util-internal.h"
 
 static void conn_iface_init (gpointer, gpointer);
@@ -280,7 +288,9 @@ G_DEFINE_ABSTRACT_TYPE_WITH_CODE(TpBaseConnection,
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
       tp_dbus_properties_mixin_iface_init);
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_REQUESTS,
-      requests_iface_init))
+      requests_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_METRICS1,
+      _tp_metrics_iface_init))
 
 enum
 {
@@ -292,6 +302,7 @@ enum
     PROP_DBUS_DAEMON,
     PROP_HAS_IMMORTAL_HANDLES,
     PROP_ACCOUNT_PATH_SUFFIX,
+    PROP_MAIN_CONTEXT,
     N_PROPS
 };
 
@@ -332,6 +343,18 @@ struct _ChannelRequest
    * satisfied by that channel has a different method.
    */
   unsigned yours : 1;
+
+  /* only meaningful for METHOD_ENSURE_CHANNEL; TRUE if the request had a
+   * target and no properties other than ChannelType and the target, so
+   * that the channel satisfying it can satisfy later such requests via
+   * priv->ensured_channels */
+  unsigned basic : 1;
+
+  /* our link in priv->channel_requests, or NULL if not queued */
+  GList *link;
+  /* (owned) "handle_type:handle:channel_type", the key for
+   * priv->channel_requests_by_target */
+  gchar *target_key;
 };
 
 static ChannelRequest *
@@ -356,6 +379,8 @@ channel_request_new (DBusGMethodInvocation *context,
   ret->handle = handle;
   ret->suppress_handler = suppress_handler;
   ret->yours = FALSE;
+  ret->target_key = g_strdup_printf ("%u:%u:%s", handle_type, handle,
+      channel_type);
 
   DEBUG("New channel request at %p: ctype=%s htype=%d handle=%d suppress=%d",
         ret, channel_type, handle_type, handle, suppress_handler);
@@ -367,10 +392,12 @@ static void
 channel_request_free (ChannelRequest *request)
 {
   g_assert (NULL == request->context);
+  g_assert (NULL == request->link);
   DEBUG("Freeing channel request at %p: ctype=%s htype=%d handle=%d "
         "suppress=%d", request, request->channel_type, request->handle_type,
         request->handle, request->suppress_handler);
   g_free (request->channel_type);
+  g_free (request->target_key);
   g_slice_free (ChannelRequest, request);
 }
 
@@ -386,10 +413,59 @@ channel_request_cancel (gpointer data, gpointer user_data)
 
   dbus_g_method_return_error (request->context, &error);
   request->context = NULL;
+  request->link = NULL;
 
   channel_request_free (request);
 }
 
+/* A channel that has satisfied an EnsureChannel call, and so would satisfy
+ * any later call for the same target with Yours=False */
+typedef struct {
+    gchar *object_path;
+    /* from _tp_dbus_method_return_template_new(), with Yours=False */
+    DBusMessage *reply;
+} EnsuredChannel;
+
+static void
+ensured_channel_free (gpointer p)
+{
+  EnsuredChannel *ensured = p;
+
+  g_free (ensured->object_path);
+  dbus_message_unref (ensured->reply);
+  g_slice_free (EnsuredChannel, ensured);
+}
+
+/* A token added with tp_base_connection_add_possible_client_interest() */
+typedef struct {
+    GQuark token;
+    /* number of clients whose count for @token is nonzero */
+    guint n_clients;
+    /* TRUE if tp_base_connection_set_unicast_signals() was called */
+    gboolean unicast;
+} PossibleInterest;
+
+/* The interests of one client, indexed like priv->possible_interests */
+typedef struct {
+    /* sum of counts[] */
+    gsize total;
+    /* number of elements in counts, which may be fewer than the number of
+     * possible interests; the rest are implicitly zero */
+    guint n_counts;
+    /* counts[i] is the number of times this client has added an interest
+     * in possible_interests[i] without removing it */
+    gsize *counts;
+} ClientInterests;
+
+static void
+client_interests_free (gpointer p)
+{
+  ClientInterests *ci = p;
+
+  g_free (ci->counts);
+  g_slice_free (ClientInterests, ci);
+}
+
 struct _TpBaseConnectionPrivate
 {
   const gchar *self_id;
@@ -403,17 +479,39 @@ struct _TpBaseConnectionPrivate
   GPtrArray *channel_factories;
   /* array of (TpChannelManager *) */
   GPtrArray *channel_managers;
-  /* array of (ChannelRequest *) */
-  GPtrArray *channel_requests;
+  /* (ChannelRequest *), in the order they were made */
+  GQueue channel_requests;
+  /* (owned) ChannelRequest.target_key => (owned) GQueue of borrowed
+   * (ChannelRequest *) from channel_requests, in the same order */
+  GHashTable *channel_requests_by_target;
+  /* (owned) ChannelRequest.target_key => (owned) EnsuredChannel, for each
+   * open channel that has satisfied a basic EnsureChannel call */
+  GHashTable *ensured_channels;
+  /* (owned) "handle_type:TargetID" => GUINT_TO_POINTER (handle), for each
+   * TargetID that tp_handle_ensure() has turned into a handle in a repo
+   * that never reclaims handles, so the handle is valid for as long as
+   * the connection is */
+  GHashTable *resolved_target_ids;
+  /* (owned) key from request_shape_new() => GUINT_TO_POINTER (index in
+   * channel_managers + 1) of the manager that accepted the most recent
+   * channel request of that shape */
+  GHashTable *request_shapes;
+  /* (owned) object path => (owned) GValueArray from get_channel_details(),
+   * for every channel; NULL until the Channels property is first read,
+   * then kept up to date as channels appear and close */
+  GHashTable *channel_details;
+  /* (owned) PendingNewChannel, in the order they were announced by the
+   * channel managers and factories, waiting for new_channels_idle_id */
+  GPtrArray *pending_new_channels;
+  guint new_channels_idle_id;
 
   TpHandleRepoIface *handles[TP_NUM_HANDLE_TYPES];
 
-  /* Created in constructed, this is an array of static strings which
-   * represent the interfaces on this connection.
-   *
-   * Note that this is a GArray of gchar*, not a GPtrArray,
-   * so that we can use GArray's convenient auto-null-termination. */
-  GArray *interfaces;
+  /* Set in constructed, this is a NULL-terminated array of strings which
+   * represent the interfaces on this connection. It comes from
+   * _tp_strv_intern_concat(), so connections with the same interfaces
+   * share one copy, and it must not be modified or freed. */
+  const gchar * const *interfaces;
 
   /* Array of DBusGMethodInvocation * representing Disconnect calls.
    * If NULL and we are in a state != DISCONNECTED, then we have not started
@@ -425,25 +523,68 @@ struct _TpBaseConnectionPrivate
   GPtrArray *disconnect_requests;
 
   TpDBusDaemon *bus_proxy;
+  /* the main context we are bound to, or NULL for the global default */
+  GMainContext *main_context;
+  /* the connection manager that created us, if any (weak ref) */
+  TpBaseConnectionManager *cm;
+  /* TRUE if Connect() has been called, but cm hasn't admitted us yet */
+  gboolean connect_queued;
   /* TRUE after constructor() returns */
   gboolean been_constructed;
   /* TRUE if on D-Bus */
   gboolean been_registered;
 
-  /* g_strdup (unique name) => gsize total count
-   *
-   * This is derivable from @client_interests: e.g. if
-   *    client_interests = { LOCATION => { ":1.23" => 5, ":1.42" => 2 },
-   *                         MAIL_NOTIFICATION => { ":1.23" => 1 } }
-   * then it implies
-   *    interested_clients = { ":1.23" => 6, ":1.42" => 2 }
-   */
+  /* The handles passed to the most recent successful InspectHandles call,
+   * and a reply to it with no destination or reply serial, to be copied
+   * if the same handles are inspected again. If the repository reclaims
+   * handles, they are kept in inspect_cache_pins while they are cached, so
+   * none of them can be reclaimed and reused for a different identifier
+   * once its generation wraps around; otherwise that is NULL. */
+  TpHandleType inspect_cache_type;
+  GArray *inspect_cache_handles;
+  TpHandleSet *inspect_cache_pins;
+  DBusMessage *inspect_cache_reply;
+
+  /* PossibleInterest, in the order they were added */
+  GArray *possible_interests;
+  /* GQuark token => GUINT_TO_POINTER (index in possible_interests + 1) */
+  GHashTable *interest_indices;
+  /* g_strdup (unique name) => owned ClientInterests, for each client with
+   * a nonzero total, whose name owner we are watching */
   GHashTable *interested_clients;
-  /* GQuark iface => GHashTable {
-   *    unique name borrowed from interested_clients => gsize count } */
-  GHashTable *client_interests;
+  /* GQuark token => owned GHashTable (TpHandle => GUINT_TO_POINTER (number
+   * of clients interested in it)), for each token added with
+   * tp_base_connection_add_possible_contact_interest() */
+  GHashTable *contact_interests;
+  /* g_strdup (unique name) => owned GHashTable (GQuark token => owned
+   * TpIntset), for each client with an interest in particular contacts,
+   * whose name owner we are watching */
+  GHashTable *contact_interested_clients;
+  /* g_strdup (unique name) => itself, for each client that has called
+   * HoldHandles on a repo that reclaims handles, whose name owner we are
+   * watching */
+  GHashTable *holding_clients;
 
   gchar *account_path_suffix;
+
+  /* avatars at least this long are passed in files to interested clients,
+   * or 0 to always send them inline */
+  gsize avatar_file_threshold;
+  /* private directory for avatar files, or NULL if not created yet */
+  gchar *avatar_dir;
+  /* owned token => owned path of the file in avatar_dir containing it */
+  GHashTable *avatar_files;
+
+  /* owned capability hash => owned GPtrArray of GValueArray, a
+   * TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST whose free function frees
+   * its elements, so that it can be shared with g_ptr_array_ref() */
+  GHashTable *capability_sets;
+  /* TpHandle => borrowed GPtrArray from capability_sets */
+  GHashTable *contact_capability_sets;
+
+  /* set of timer IDs from tp_base_connection_add_timeout() for timeouts
+   * that haven't been removed yet, or NULL if there have never been any */
+  GHashTable *timeouts;
 };
 
 static const gchar * const *tp_base_connection_get_interfaces (
@@ -453,6 +594,18 @@ static gboolean
 tp_base_connection_ensure_dbus (TpBaseConnection *self,
     GError **error)
 {
+  if (self->priv->bus_proxy == NULL && self->priv->main_context != NULL)
+    {
+      /* dbus-glib dispatches each bus connection's messages in one main
+       * context, so our method calls (and our channels') can only reach us
+       * in main_context if we have a bus connection of our own */
+      self->priv->bus_proxy = _tp_dbus_daemon_dup_for_context (
+          self->priv->main_context, error);
+
+      if (self->priv->bus_proxy == NULL)
+        return FALSE;
+    }
+
   if (self->priv->bus_proxy == NULL)
     {
       self->priv->bus_proxy = tp_dbus_daemon_dup (error);
@@ -507,6 +660,10 @@ tp_base_connection_get_property (GObject *object,
       g_value_set_string (value, self->priv->account_path_suffix);
       break;
 
+    case PROP_MAIN_CONTEXT:
+      g_value_set_boxed (value, self->priv->main_context);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -549,6 +706,16 @@ tp_base_connection_set_property (GObject      *object,
       self->priv->account_path_suffix = g_value_dup_string (value);
       break;
 
+    case PROP_MAIN_CONTEXT:
+      g_assert (self->priv->main_context == NULL);  /* construct-only */
+      self->priv->main_context = g_value_dup_boxed (value);
+
+      /* binding to the global default is the same as not binding */
+      if (self->priv->main_context == g_main_context_default ())
+        tp_clear_pointer (&self->priv->main_context, g_main_context_unref);
+
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -560,6 +727,11 @@ static void tp_base_connection_interested_name_owner_changed_cb (
     const gchar *unique_name,
     const gchar *new_owner,
     gpointer user_data);
+static void tp_base_connection_holder_name_owner_changed_cb (
+    TpDBusDaemon *it,
+    const gchar *unique_name,
+    const gchar *new_owner,
+    gpointer user_data);
 
 static void
 tp_base_connection_unregister (TpBaseConnection *self)
@@ -589,6 +761,15 @@ tp_base_connection_unregister (TpBaseConnection *self)
               tp_base_connection_interested_name_owner_changed_cb, self);
           g_hash_table_iter_remove (&iter);
         }
+
+      g_hash_table_iter_init (&iter, self->priv->holding_clients);
+
+      while (g_hash_table_iter_next (&iter, &k, NULL))
+        {
+          tp_dbus_daemon_cancel_name_owner_watch (priv->bus_proxy, k,
+              tp_base_connection_holder_name_owner_changed_cb, self);
+          g_hash_table_iter_remove (&iter);
+        }
     }
 }
 
@@ -609,6 +790,16 @@ tp_base_connection_dispose (GObject *object)
 
   tp_base_connection_unregister (self);
 
+  if (priv->cm != NULL)
+    {
+      /* normally done when we were disconnected, but make sure the CM
+       * doesn't keep a pointer to us in case we were never connected */
+      _tp_base_connection_manager_release (priv->cm, self);
+      g_object_remove_weak_pointer (G_OBJECT (priv->cm),
+          (gpointer *) &priv->cm);
+      priv->cm = NULL;
+    }
+
   tp_clear_object (&priv->bus_proxy);
 
   g_ptr_array_foreach (priv->channel_factories, (GFunc) g_object_unref, NULL);
@@ -619,19 +810,74 @@ tp_base_connection_dispose (GObject *object)
   g_ptr_array_unref (priv->channel_managers);
   priv->channel_managers = NULL;
 
-  if (priv->channel_requests)
+  if (priv->new_channels_idle_id != 0)
+    {
+      _tp_source_remove (priv->new_channels_idle_id);
+      priv->new_channels_idle_id = 0;
+    }
+
+  tp_clear_pointer (&priv->pending_new_channels, g_ptr_array_unref);
+  tp_clear_pointer (&priv->channel_details, g_hash_table_unref);
+
+  if (priv->timeouts != NULL)
+    {
+      GHashTable *timeouts = priv->timeouts;
+      GHashTableIter iter;
+      gpointer k;
+
+      /* so that connection_timeout_free() leaves the table alone */
+      priv->timeouts = NULL;
+      g_hash_table_iter_init (&iter, timeouts);
+
+      while (g_hash_table_iter_next (&iter, &k, NULL))
+        _tp_timer_wheel_remove (priv->main_context, GPOINTER_TO_UINT (k));
+
+      g_hash_table_unref (timeouts);
+    }
+
+  if (priv->channel_requests_by_target)
     {
-      g_assert (priv->channel_requests->len == 0);
-      g_ptr_array_unref (priv->channel_requests);
-      priv->channel_requests = NULL;
+      g_assert (g_queue_is_empty (&priv->channel_requests));
+      g_hash_table_unref (priv->channel_requests_by_target);
+      priv->channel_requests_by_target = NULL;
     }
 
+  tp_clear_pointer (&priv->ensured_channels, g_hash_table_unref);
+  tp_clear_pointer (&priv->resolved_target_ids, g_hash_table_unref);
+  tp_clear_pointer (&priv->request_shapes, g_hash_table_unref);
+
+  tp_clear_pointer (&priv->inspect_cache_handles, g_array_unref);
+  tp_clear_pointer (&priv->inspect_cache_pins, tp_handle_set_destroy);
+  tp_clear_pointer (&priv->inspect_cache_reply, dbus_message_unref);
+
   for (i = 0; i < TP_NUM_HANDLE_TYPES; i++)
     tp_clear_object (priv->handles + i);
 
-  if (priv->interfaces)
+  if (priv->avatar_files != NULL)
+    {
+      GHashTableIter iter;
+      gpointer path;
+
+      g_hash_table_iter_init (&iter, priv->avatar_files);
+
+      while (g_hash_table_iter_next (&iter, NULL, &path))
+        g_unlink (path);
+
+      g_hash_table_unref (priv->avatar_files);
+      priv->avatar_files = NULL;
+    }
+
+  tp_clear_pointer (&priv->contact_capability_sets, g_hash_table_unref);
+  tp_clear_pointer (&priv->capability_sets, g_hash_table_unref);
+
+  if (priv->avatar_dir != NULL)
     {
-      g_array_unref (priv->interfaces);
+      if (g_rmdir (priv->avatar_dir) != 0)
+        DEBUG ("unable to remove %s: %s", priv->avatar_dir,
+            g_strerror (errno));
+
+      g_free (priv->avatar_dir);
+      priv->avatar_dir = NULL;
     }
 
   if (G_OBJECT_CLASS (tp_base_connection_parent_class)->dispose)
@@ -647,9 +893,14 @@ tp_base_connection_finalize (GObject *object)
   g_free (priv->protocol);
   g_free (self->bus_name);
   g_free (self->object_path);
-  g_hash_table_unref (priv->client_interests);
+  g_array_unref (priv->possible_interests);
+  g_hash_table_unref (priv->interest_indices);
   g_hash_table_unref (priv->interested_clients);
+  g_hash_table_unref (priv->contact_interests);
+  g_hash_table_unref (priv->contact_interested_clients);
+  g_hash_table_unref (priv->holding_clients);
   g_free (priv->account_path_suffix);
+  tp_clear_pointer (&priv->main_context, g_main_context_unref);
 
   G_OBJECT_CLASS (tp_base_connection_parent_class)->finalize (object);
 }
@@ -743,7 +994,6 @@ get_channel_details (GObject *obj)
 {
   GValueArray *structure;
   GHashTable *table;
-  GValue *value;
   gchar *object_path;
 
   g_object_get (obj,
@@ -760,20 +1010,16 @@ get_channel_details (GObject *obj)
     }
   else
     {
-     table = g_hash_table_new_full (g_str_hash, g_str_equal,
-          NULL, (GDestroyNotify) tp_g_value_slice_free);
-
-      value = tp_g_value_slice_new (G_TYPE_UINT);
-      g_object_get_property (obj, "handle", value);
-      g_hash_table_insert (table, TP_PROP_CHANNEL_TARGET_HANDLE, value);
-
-      value = tp_g_value_slice_new (G_TYPE_UINT);
-      g_object_get_property (obj, "handle-type", value);
-      g_hash_table_insert (table, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, value);
-
-      value = tp_g_value_slice_new (G_TYPE_STRING);
-      g_object_get_property (obj, "channel-type", value);
-      g_hash_table_insert (table, TP_PROP_CHANNEL_CHANNEL_TYPE, value);
+      _TpAsvBuilder builder;
+
+      _tp_asv_builder_init (&builder);
+      g_object_get_property (obj, "handle", _tp_asv_builder_add (&builder,
+            TP_PROP_CHANNEL_TARGET_HANDLE, G_TYPE_UINT));
+      g_object_get_property (obj, "handle-type", _tp_asv_builder_add (
+            &builder, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT));
+      g_object_get_property (obj, "channel-type", _tp_asv_builder_add (
+            &builder, TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING));
+      table = _tp_asv_builder_end (&builder);
     }
 
   structure = tp_value_array_build (2,
@@ -788,6 +1034,211 @@ get_channel_details (GObject *obj)
 }
 
 
+static void
+channel_details_cache_add (TpBaseConnection *self,
+    GValueArray *details)
+{
+  const gchar *object_path;
+
+  if (self->priv->channel_details == NULL)
+    return;
+
+  tp_value_array_unpack (details, 1, &object_path);
+  g_hash_table_insert (self->priv->channel_details, g_strdup (object_path),
+      g_boxed_copy (TP_STRUCT_TYPE_CHANNEL_DETAILS, details));
+}
+
+static void
+channel_details_cache_remove (TpBaseConnection *self,
+    const gchar *object_path)
+{
+  if (self->priv->channel_details != NULL)
+    g_hash_table_remove (self->priv->channel_details, object_path);
+}
+
+/* A channel that has been announced by a channel manager or factory, but
+ * not yet signalled with NewChannels/NewChannel: announcements made during
+ * one main loop dispatch (a MUC join creating several channels, or a contact
+ * list announcing all its groups) are sent together in one signal. */
+typedef struct {
+    GValueArray *details;
+    gchar *object_path;
+    gchar *channel_type;
+    guint handle_type;
+    guint handle;
+    gboolean suppress_handler;
+} PendingNewChannel;
+
+static void
+pending_new_channel_free (gpointer p)
+{
+  PendingNewChannel *pending = p;
+
+  tp_value_array_free (pending->details);
+  g_free (pending->object_path);
+  g_free (pending->channel_type);
+  g_slice_free (PendingNewChannel, pending);
+}
+
+/*
+ * flush_new_channels:
+ * @self: a connection
+ *
+ * Emit NewChannels, then NewChannel for each channel, for every channel
+ * announced since the last time this was called. This must be called before
+ * any signal that could otherwise overtake a pending announcement, such as
+ * ChannelClosed.
+ */
+static void
+flush_new_channels (TpBaseConnection *self)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  GPtrArray *pending = priv->pending_new_channels;
+  GPtrArray *array;
+  guint i;
+
+  if (priv->new_channels_idle_id != 0)
+    {
+      _tp_source_remove (priv->new_channels_idle_id);
+      priv->new_channels_idle_id = 0;
+    }
+
+  if (pending == NULL || pending->len == 0)
+    return;
+
+  /* steal the queue in case a signal handler announces more channels */
+  priv->pending_new_channels = NULL;
+
+  array = g_ptr_array_sized_new (pending->len);
+
+  for (i = 0; i < pending->len; i++)
+    {
+      PendingNewChannel *item = g_ptr_array_index (pending, i);
+
+      channel_details_cache_add (self, item->details);
+      g_ptr_array_add (array, item->details);
+    }
+
+  DEBUG ("announcing %u new channels", array->len);
+  tp_svc_connection_interface_requests_emit_new_channels (self, array);
+  g_ptr_array_unref (array);
+
+  for (i = 0; i < pending->len; i++)
+    {
+      PendingNewChannel *item = g_ptr_array_index (pending, i);
+
+      tp_svc_connection_emit_new_channel (self, item->object_path,
+          item->channel_type, item->handle_type, item->handle,
+          item->suppress_handler);
+    }
+
+  g_ptr_array_unref (pending);
+}
+
+static gboolean
+flush_new_channels_cb (gpointer data)
+{
+  TpBaseConnection *self = data;
+
+  self->priv->new_channels_idle_id = 0;
+  flush_new_channels (self);
+  return FALSE;
+}
+
+/*
+ * queue_new_channel:
+ * @self: a connection
+ * @channel: a new channel, implementing #TpExportableChannel or
+ *  #TpChannelIface
+ * @object_path: (transfer full): the channel's object path
+ * @channel_type: (transfer full): the channel's type
+ * @handle_type: the channel's target handle type
+ * @handle: the channel's target handle
+ * @suppress_handler: the suppress_handler argument for NewChannel
+ *
+ * Arrange for @channel to be signalled by flush_new_channels(), which will
+ * happen when we next return to the main loop, if not sooner. Requests
+ * satisfied by @channel should already have been answered.
+ */
+static void
+queue_new_channel (TpBaseConnection *self,
+    GObject *channel,
+    gchar *object_path,
+    gchar *channel_type,
+    guint handle_type,
+    guint handle,
+    gboolean suppress_handler)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  PendingNewChannel *pending = g_slice_new (PendingNewChannel);
+
+  pending->details = get_channel_details (channel);
+  pending->object_path = object_path;
+  pending->channel_type = channel_type;
+  pending->handle_type = handle_type;
+  pending->handle = handle;
+  pending->suppress_handler = suppress_handler;
+
+  if (priv->pending_new_channels == NULL)
+    priv->pending_new_channels = g_ptr_array_new_with_free_func (
+        pending_new_channel_free);
+
+  g_ptr_array_add (priv->pending_new_channels, pending);
+
+  if (priv->new_channels_idle_id == 0)
+    priv->new_channels_idle_id = _tp_idle_add_full (
+        TP_LATENCY_CLASS_INTERACTIVE, flush_new_channels_cb, self, NULL);
+}
+
+static void
+channel_requests_add (TpBaseConnection *self,
+    ChannelRequest *request)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  GQueue *same_target;
+
+  g_assert (request->link == NULL);
+
+  g_queue_push_tail (&priv->channel_requests, request);
+  request->link = priv->channel_requests.tail;
+
+  same_target = g_hash_table_lookup (priv->channel_requests_by_target,
+      request->target_key);
+
+  if (same_target == NULL)
+    {
+      same_target = g_queue_new ();
+      g_hash_table_insert (priv->channel_requests_by_target,
+          g_strdup (request->target_key), same_target);
+    }
+
+  g_queue_push_tail (same_target, request);
+}
+
+static void
+channel_requests_remove (TpBaseConnection *self,
+    ChannelRequest *request)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  GQueue *same_target;
+
+  g_assert (request->link != NULL);
+
+  g_queue_delete_link (&priv->channel_requests, request->link);
+  request->link = NULL;
+
+  same_target = g_hash_table_lookup (priv->channel_requests_by_target,
+      request->target_key);
+  g_assert (same_target != NULL);
+
+  /* there are rarely many outstanding requests for the same channel */
+  g_queue_remove (same_target, request);
+
+  if (g_queue_is_empty (same_target))
+    g_hash_table_remove (priv->channel_requests_by_target,
+        request->target_key);
+}
+
 static GPtrArray *
 find_matching_channel_requests (TpBaseConnection *conn,
                                 const gchar *channel_type,
@@ -798,7 +1249,9 @@ find_matching_channel_requests (TpBaseConnection *conn,
 {
   TpBaseConnectionPrivate *priv = conn->priv;
   GPtrArray *requests;
-  guint i;
+  GQueue *same_target;
+  GList *l;
+  gchar *target_key;
 
   requests = g_ptr_array_sized_new (1);
 
@@ -809,8 +1262,7 @@ find_matching_channel_requests (TpBaseConnection *conn,
        * satisfy the request for which it was returned as EXISTING).
        */
       g_assert (handle == 0);
-      g_assert (channel_request == NULL ||
-          tp_g_ptr_array_contains (priv->channel_requests, channel_request));
+      g_assert (channel_request == NULL || channel_request->link != NULL);
 
       if (channel_request)
         {
@@ -827,18 +1279,17 @@ find_matching_channel_requests (TpBaseConnection *conn,
   /* for identifiable channels (those which are to a particular handle),
    * satisfy any queued requests.
    */
-  for (i = 0; i < priv->channel_requests->len; i++)
+  target_key = g_strdup_printf ("%u:%u:%s", handle_type, handle,
+      channel_type);
+  same_target = g_hash_table_lookup (priv->channel_requests_by_target,
+      target_key);
+  g_free (target_key);
+
+  for (l = (same_target == NULL ? NULL : same_target->head);
+       l != NULL;
+       l = l->next)
     {
-      ChannelRequest *request = g_ptr_array_index (priv->channel_requests, i);
-
-      if (tp_strdiff (request->channel_type, channel_type))
-        continue;
-
-      if (handle_type != request->handle_type)
-        continue;
-
-      if (handle != request->handle)
-        continue;
+      ChannelRequest *request = l->data;
 
       if (request->suppress_handler && suppress_handler)
         *suppress_handler = TRUE;
@@ -856,14 +1307,44 @@ find_matching_channel_requests (TpBaseConnection *conn,
 }
 
 
+static void
+ensured_channels_add (TpBaseConnection *self,
+    const gchar *target_key,
+    const gchar *object_path,
+    GHashTable *properties)
+{
+  EnsuredChannel *ensured;
+  GVariant *vardict;
+
+  if (g_hash_table_lookup (self->priv->ensured_channels, target_key) != NULL)
+    return;
+
+  vardict = _tp_asv_to_vardict (properties);
+
+  ensured = g_slice_new (EnsuredChannel);
+  ensured->object_path = g_strdup (object_path);
+  ensured->reply = _tp_dbus_method_return_template_new (
+      g_variant_new ("(bo@a{sv})", FALSE, object_path, vardict));
+  g_hash_table_insert (self->priv->ensured_channels, g_strdup (target_key),
+      ensured);
+
+  g_variant_unref (vardict);
+}
+
+static gboolean
+ensured_channel_has_path (gpointer k G_GNUC_UNUSED,
+    gpointer v,
+    gpointer object_path)
+{
+  return !tp_strdiff (((EnsuredChannel *) v)->object_path, object_path);
+}
+
 static void
 satisfy_request (TpBaseConnection *conn,
                  ChannelRequest *request,
                  GObject *channel,
                  const gchar *object_path)
 {
-  TpBaseConnectionPrivate *priv = conn->priv;
-
   DEBUG ("completing queued request %p with success, "
       "channel_type=%s, handle_type=%u, "
       "handle=%u, suppress_handler=%u", request, request->channel_type,
@@ -900,6 +1381,11 @@ satisfy_request (TpBaseConnection *conn,
               NULL);
           tp_svc_connection_interface_requests_return_from_ensure_channel (
               request->context, request->yours, object_path, properties);
+
+          if (request->basic)
+            ensured_channels_add (conn, request->target_key, object_path,
+                properties);
+
           g_hash_table_unref (properties);
         }
         break;
@@ -909,7 +1395,7 @@ satisfy_request (TpBaseConnection *conn,
     }
   request->context = NULL;
 
-  g_ptr_array_remove (priv->channel_requests, request);
+  channel_requests_remove (conn, request);
 
   channel_request_free (request);
 }
@@ -935,7 +1421,7 @@ factory_satisfy_requests (TpBaseConnection *conn,
       "handle", &handle,
       NULL);
 
-  DEBUG ("called for %s", object_path);
+  TRACE ("called for %s", object_path);
 
   tmp = find_matching_channel_requests (conn, channel_type, handle_type,
                                         handle, channel_request,
@@ -945,23 +1431,18 @@ factory_satisfy_requests (TpBaseConnection *conn,
     satisfy_request (conn, g_ptr_array_index (tmp, i), G_OBJECT (chan),
         object_path);
 
+  g_ptr_array_unref (tmp);
+
   if (is_new)
     {
-      GPtrArray *array = g_ptr_array_sized_new (1);
-
-      g_ptr_array_add (array, get_channel_details (G_OBJECT (chan)));
-      tp_svc_connection_interface_requests_emit_new_channels (conn, array);
-      tp_value_array_free (g_ptr_array_index (array, 0));
-      g_ptr_array_unref (array);
-
-      tp_svc_connection_emit_new_channel (conn, object_path, channel_type,
+      queue_new_channel (conn, G_OBJECT (chan), object_path, channel_type,
           handle_type, handle, suppress_handler);
     }
-
-  g_ptr_array_unref (tmp);
-
-  g_free (object_path);
-  g_free (channel_type);
+  else
+    {
+      g_free (object_path);
+      g_free (channel_type);
+    }
 }
 
 
@@ -970,8 +1451,6 @@ fail_channel_request (TpBaseConnection *conn,
                       ChannelRequest *request,
                       GError *error)
 {
-  TpBaseConnectionPrivate *priv = conn->priv;
-
   DEBUG ("completing queued request %p with error, channel_type=%s, "
       "handle_type=%u, handle=%u, suppress_handler=%u",
       request, request->channel_type,
@@ -980,7 +1459,7 @@ fail_channel_request (TpBaseConnection *conn,
   dbus_g_method_return_error (request->context, error);
   request->context = NULL;
 
-  g_ptr_array_remove (priv->channel_requests, request);
+  channel_requests_remove (conn, request);
 
   channel_request_free (request);
 }
@@ -998,8 +1477,13 @@ factory_channel_closed_cb (GObject *channel,
       "object-path", &object_path,
       NULL);
 
-  tp_svc_connection_interface_requests_emit_channel_closed (conn,
-      object_path);
+  flush_new_channels (conn);
+  channel_details_cache_remove (conn, object_path);
+
+  /* StatusChanged has already said that every channel is closing */
+  if (conn->status != TP_CONNECTION_STATUS_DISCONNECTED)
+    tp_svc_connection_interface_requests_emit_channel_closed (conn,
+        object_path);
 
   g_free (object_path);
 }
@@ -1161,7 +1645,6 @@ manager_new_channels_cb (TpChannelManager *manager,
                          GHashTable *channels,
                          TpBaseConnection *self)
 {
-  GPtrArray *array;
   ManagerNewChannelContext context = { self, g_hash_table_new (NULL, NULL) };
   GHashTableIter iter;
   gpointer key, value;
@@ -1174,22 +1657,8 @@ manager_new_channels_cb (TpChannelManager *manager,
    * that will have to be signalled with suppress_handler = TRUE */
   g_hash_table_foreach (channels, manager_new_channel, &context);
 
-  /* Emit NewChannels */
-  array = g_ptr_array_sized_new (g_hash_table_size (channels));
-  g_hash_table_iter_init (&iter, channels);
-
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      g_ptr_array_add (array, get_channel_details (G_OBJECT (key)));
-    }
-
-  tp_svc_connection_interface_requests_emit_new_channels (self,
-      array);
-
-  g_ptr_array_foreach (array, (GFunc) tp_value_array_free, NULL);
-  g_ptr_array_unref (array);
-
-  /* Emit NewChannel */
+  /* Queue NewChannels and NewChannel, to be emitted together with any other
+   * channels announced before we return to the main loop */
   g_hash_table_iter_init (&iter, channels);
 
   while (g_hash_table_iter_next (&iter, &key, &value))
@@ -1202,11 +1671,8 @@ manager_new_channels_cb (TpChannelManager *manager,
       exportable_channel_get_old_info (TP_EXPORTABLE_CHANNEL (key),
           &object_path, &channel_type, &handle_type, &handle);
 
-      tp_svc_connection_emit_new_channel (self, object_path, channel_type,
+      queue_new_channel (self, G_OBJECT (key), object_path, channel_type,
           handle_type, handle, suppress_handler);
-
-      g_free (object_path);
-      g_free (channel_type);
     }
 
   g_hash_table_unref (context.suppress_handler);
@@ -1262,6 +1728,15 @@ manager_channel_closed_cb (TpChannelManager *manager,
   g_assert (path != NULL);
   g_assert (TP_IS_BASE_CONNECTION (self));
 
+  flush_new_channels (self);
+  channel_details_cache_remove (self, path);
+
+  /* StatusChanged has already said that every channel is closing */
+  if (self->status == TP_CONNECTION_STATUS_DISCONNECTED)
+    return;
+
+  g_hash_table_foreach_remove (self->priv->ensured_channels,
+      ensured_channel_has_path, (gpointer) path);
   tp_svc_connection_interface_requests_emit_channel_closed (self, path);
 }
 
@@ -1292,19 +1767,14 @@ tp_base_connection_create_interfaces_array (TpBaseConnection *self)
   TpBaseConnectionPrivate *priv = self->priv;
   TpBaseConnectionClass *klass = TP_BASE_CONNECTION_GET_CLASS (self);
   GPtrArray *always;
-  guint i;
 
   g_assert (priv->interfaces == NULL);
 
   always = klass->get_interfaces_always_present (self);
+  g_ptr_array_add (always, NULL);
 
-  priv->interfaces = g_array_sized_new (TRUE, FALSE, sizeof (gchar *),
-      always->len);
-  for (i = 0; i < always->len; i++)
-    {
-      g_array_append_val (priv->interfaces,
-          g_ptr_array_index (always, i));
-    }
+  priv->interfaces = _tp_strv_intern_concat (
+      (const gchar * const *) always->pdata, NULL);
 
   g_ptr_array_unref (always);
 }
@@ -1371,6 +1841,11 @@ tp_base_connection_constructor (GType type, guint n_construct_properties,
 
   tp_base_connection_create_interfaces_array (self);
 
+  if (TP_IS_SVC_CONNECTION_INTERFACE_AVATARS (self))
+    tp_base_connection_add_possible_client_interest (self,
+        g_quark_from_static_string (
+            TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES));
+
   priv->been_constructed = TRUE;
 
   return (GObject *) self;
@@ -1396,39 +1871,948 @@ tp_base_connection_add_possible_client_interest (TpBaseConnection *self,
     GQuark token)
 {
   gpointer p = GUINT_TO_POINTER (token);
+  PossibleInterest pi = { token, 0, FALSE };
 
   g_return_if_fail (TP_IS_BASE_CONNECTION (self));
   g_return_if_fail (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW);
 
-  if (g_hash_table_lookup (self->priv->client_interests, p) == NULL)
-    g_hash_table_insert (self->priv->client_interests, p,
-        g_hash_table_new (g_str_hash, g_str_equal));
+  if (g_hash_table_lookup (self->priv->interest_indices, p) == NULL)
+    {
+      g_array_append_val (self->priv->possible_interests, pi);
+      g_hash_table_insert (self->priv->interest_indices, p,
+          GUINT_TO_POINTER (self->priv->possible_interests->len));
+    }
 }
 
-/* D-Bus properties for the Requests interface */
-
-static void
-factory_get_channel_details_foreach (TpChannelIface *chan,
-                                     gpointer data)
+/* Returns the PossibleInterest for @token, and its index in
+ * possible_interests, or %NULL if clients can't usefully be interested in
+ * @token */
+static PossibleInterest *
+tp_base_connection_lookup_possible_interest (TpBaseConnection *self,
+    const gchar *token,
+    guint *index)
 {
-  GPtrArray *details = data;
+  GQuark q = g_quark_try_string (token);
+  guint i;
 
-  g_ptr_array_add (details, get_channel_details (G_OBJECT (chan)));
-}
+  /* we can only declare an interest in known quarks, so if it's not one,
+   * clearly this token is not useful */
+  if (q == 0)
+    return NULL;
 
+  i = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->interest_indices,
+        GUINT_TO_POINTER (q)));
 
-static void
-manager_get_channel_details_foreach (TpExportableChannel *chan,
-                                     gpointer data)
-{
-  GPtrArray *details = data;
+  /* declaring an interest in this token has no effect */
+  if (i == 0)
+    return NULL;
 
-  g_ptr_array_add (details, get_channel_details (G_OBJECT (chan)));
+  *index = i - 1;
+  return &g_array_index (self->priv->possible_interests, PossibleInterest,
+      i - 1);
 }
 
-
-static GPtrArray *
-conn_requests_get_channel_details (TpBaseConnection *self)
+/**
+ * tp_base_connection_add_possible_contact_interest:
+ * @self: a connection
+ * @token: a quark corresponding to a D-Bus interface with per-contact
+ *  signals, such as %TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE
+ *
+ * Declare that clients of this connection are only assumed to want
+ * @token's per-contact signals for contacts they have asked about, so that
+ * tp_base_connection_is_contact_interesting() can be used to avoid
+ * computing and emitting the others.
+ *
+ * A client is interested in a contact for @token if it has asked for
+ * @token's attributes for that contact with GetContactAttributes,
+ * GetContactByID or GetContactListAttributes, or if
+ * tp_base_connection_add_contact_interest() was called on its behalf,
+ * until it calls RemoveClientInterest with @token or leaves the bus. A
+ * client that calls AddClientInterest with @token is interested in every
+ * contact, so this also calls
+ * tp_base_connection_add_possible_client_interest().
+ *
+ * Clients that rely on the signals without doing any of those will miss
+ * changes, so connection managers should only call this for interfaces
+ * where that is acceptable, such as the presence of the members of large
+ * chatrooms. Like tp_base_connection_add_possible_client_interest(), this
+ * must be called from the #GObjectClass<!-- -->.constructed or
+ * #GObjectClass<!-- -->.constructor callback.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_add_possible_contact_interest (TpBaseConnection *self,
+    GQuark token)
+{
+  gpointer p = GUINT_TO_POINTER (token);
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW);
+
+  tp_base_connection_add_possible_client_interest (self, token);
+
+  if (g_hash_table_lookup (self->priv->contact_interests, p) == NULL)
+    g_hash_table_insert (self->priv->contact_interests, p,
+        g_hash_table_new (NULL, NULL));
+}
+
+static void tp_base_connection_contact_interested_name_owner_changed_cb (
+    TpDBusDaemon *it, const gchar *unique_name, const gchar *new_owner,
+    gpointer user_data);
+
+/* Forget @unique_name's interest in particular contacts for @token, or
+ * for every token if @token is 0 */
+static void
+tp_base_connection_forget_contact_interests (TpBaseConnection *self,
+    const gchar *unique_name,
+    GQuark token)
+{
+  GHashTable *client = g_hash_table_lookup (
+      self->priv->contact_interested_clients, unique_name);
+  GHashTableIter iter;
+  gpointer k, v;
+
+  if (client == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, client);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      GHashTable *counts;
+      TpIntsetFastIter set_iter;
+      TpHandle contact;
+
+      if (token != 0 && GPOINTER_TO_UINT (k) != token)
+        continue;
+
+      counts = g_hash_table_lookup (self->priv->contact_interests, k);
+      g_assert (counts != NULL);
+
+      tp_intset_fast_iter_init (&set_iter, v);
+
+      while (tp_intset_fast_iter_next (&set_iter, &contact))
+        {
+          gpointer c = GUINT_TO_POINTER (contact);
+          guint n = GPOINTER_TO_UINT (g_hash_table_lookup (counts, c));
+
+          if (n <= 1)
+            g_hash_table_remove (counts, c);
+          else
+            g_hash_table_insert (counts, c, GUINT_TO_POINTER (n - 1));
+        }
+
+      g_hash_table_iter_remove (&iter);
+    }
+
+  if (g_hash_table_size (client) == 0)
+    {
+      g_hash_table_remove (self->priv->contact_interested_clients,
+          unique_name);
+      tp_dbus_daemon_cancel_name_owner_watch (self->priv->bus_proxy,
+          unique_name,
+          tp_base_connection_contact_interested_name_owner_changed_cb, self);
+    }
+}
+
+static void
+tp_base_connection_contact_interested_name_owner_changed_cb (
+    TpDBusDaemon *it G_GNUC_UNUSED,
+    const gchar *unique_name,
+    const gchar *new_owner,
+    gpointer user_data)
+{
+  /* as for tp_base_connection_interested_name_owner_changed_cb() */
+  if (!tp_str_empty (new_owner))
+    return;
+
+  tp_base_connection_forget_contact_interests (user_data, unique_name, 0);
+}
+
+/**
+ * tp_base_connection_add_contact_interest:
+ * @self: a #TpBaseConnection
+ * @unique_name: the unique bus name of a D-Bus client
+ * @token: a token added with
+ *  tp_base_connection_add_possible_contact_interest()
+ * @contacts: (element-type guint): contact handles
+ *
+ * Record that the given client is interested in @token's signals for
+ * @contacts, as if it had asked for their attributes with
+ * GetContactAttributes. Adding the same contact more than once has no
+ * further effect. If @token was not added with
+ * tp_base_connection_add_possible_contact_interest(), do nothing.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_add_contact_interest (TpBaseConnection *self,
+    const gchar *unique_name,
+    const gchar *token,
+    const GArray *contacts)
+{
+  GQuark q;
+  GHashTable *counts;
+  GHashTable *client;
+  TpIntset *set;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (unique_name != NULL);
+  g_return_if_fail (token != NULL);
+  g_return_if_fail (contacts != NULL);
+
+  q = g_quark_try_string (token);
+
+  if (q == 0)
+    return;
+
+  counts = g_hash_table_lookup (self->priv->contact_interests,
+      GUINT_TO_POINTER (q));
+
+  if (counts == NULL || contacts->len == 0)
+    return;
+
+  client = g_hash_table_lookup (self->priv->contact_interested_clients,
+      unique_name);
+
+  if (client == NULL)
+    {
+      client = g_hash_table_new_full (NULL, NULL, NULL,
+          (GDestroyNotify) tp_intset_destroy);
+      g_hash_table_insert (self->priv->contact_interested_clients,
+          g_strdup (unique_name), client);
+      tp_dbus_daemon_watch_name_owner (self->priv->bus_proxy, unique_name,
+          tp_base_connection_contact_interested_name_owner_changed_cb, self,
+          NULL);
+    }
+
+  set = g_hash_table_lookup (client, GUINT_TO_POINTER (q));
+
+  if (set == NULL)
+    {
+      set = tp_intset_new ();
+      g_hash_table_insert (client, GUINT_TO_POINTER (q), set);
+    }
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle contact = g_array_index (contacts, TpHandle, i);
+      gpointer c = GUINT_TO_POINTER (contact);
+
+      if (contact == 0 || tp_intset_is_member (set, contact))
+        continue;
+
+      tp_intset_add (set, contact);
+      g_hash_table_insert (counts, c, GUINT_TO_POINTER (
+            GPOINTER_TO_UINT (g_hash_table_lookup (counts, c)) + 1));
+    }
+}
+
+/*
+ * Add a contact interest for each of @tokens that is a possible contact
+ * interest. This is how the Contacts and ContactList interfaces record
+ * which contacts a client has asked about.
+ */
+void
+_tp_base_connection_add_contact_interests (TpBaseConnection *self,
+    const gchar *unique_name,
+    const gchar * const *tokens,
+    const GArray *contacts)
+{
+  if (unique_name == NULL || tokens == NULL ||
+      g_hash_table_size (self->priv->contact_interests) == 0)
+    return;
+
+  for (; *tokens != NULL; tokens++)
+    tp_base_connection_add_contact_interest (self, unique_name, *tokens,
+        contacts);
+}
+
+/**
+ * tp_base_connection_is_contact_interesting:
+ * @self: a #TpBaseConnection
+ * @token: a quark corresponding to a D-Bus interface
+ * @contact: a contact handle
+ *
+ * Return whether any client might want @token's per-contact signals for
+ * @contact. Connection managers and mixins can use this to avoid
+ * computing and emitting changes that nobody will look at.
+ *
+ * This is always %TRUE unless @token was added with
+ * tp_base_connection_add_possible_contact_interest(); otherwise it is %TRUE
+ * if @contact is the self-handle, some client has added @token with
+ * AddClientInterest, or some client is interested in @contact as described
+ * there.
+ *
+ * Returns: %TRUE if signals about @contact for @token should be emitted
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_base_connection_is_contact_interesting (TpBaseConnection *self,
+    GQuark token,
+    TpHandle contact)
+{
+  GHashTable *counts;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), TRUE);
+
+  counts = g_hash_table_lookup (self->priv->contact_interests,
+      GUINT_TO_POINTER (token));
+
+  if (counts == NULL || contact == self->self_handle)
+    return TRUE;
+
+  if (g_hash_table_lookup (counts, GUINT_TO_POINTER (contact)) != NULL)
+    return TRUE;
+
+  /* a client with a plain interest in @token wants every contact */
+  i = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->interest_indices,
+        GUINT_TO_POINTER (token)));
+  g_assert (i != 0);
+
+  return (g_array_index (self->priv->possible_interests, PossibleInterest,
+        i - 1).n_clients > 0);
+}
+
+/**
+ * tp_base_connection_set_unicast_signals:
+ * @self: a connection
+ * @token: a quark corresponding to a D-Bus interface, or a token
+ *  representing part of a D-Bus interface
+ *
+ * Arrange for signals emitted with tp_base_connection_emit_unicast_signal()
+ * for @token to be sent only to the clients that have registered an
+ * interest in it, as separate messages addressed to each, rather than
+ * being broadcast. This also calls
+ * tp_base_connection_add_possible_client_interest().
+ *
+ * Every process with a match rule for a broadcast signal is woken up to
+ * receive it, whether it is interested or not. For high-volume signals
+ * such as PresencesChanged, sending them only to interested clients saves
+ * most of those wakeups.
+ *
+ * The clients that receive them are those that have called
+ * AddClientInterest with @token, and, if @token was also added with
+ * tp_base_connection_add_possible_contact_interest(), those that have an
+ * interest in any contact. Clients that expect these signals without doing
+ * either will no longer receive them, so connection managers should only
+ * call this for interfaces whose clients are known to register. Like
+ * tp_base_connection_add_possible_client_interest(), this must be called
+ * from the #GObjectClass<!-- -->.constructed or
+ * #GObjectClass<!-- -->.constructor callback.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_set_unicast_signals (TpBaseConnection *self,
+    GQuark token)
+{
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW);
+
+  tp_base_connection_add_possible_client_interest (self, token);
+
+  i = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->interest_indices,
+        GUINT_TO_POINTER (token)));
+  g_assert (i != 0);
+  g_array_index (self->priv->possible_interests, PossibleInterest,
+      i - 1).unicast = TRUE;
+}
+
+/* Returns 1 + the index of @token in possible_interests if its signals
+ * should be unicast now, or 0 otherwise */
+static guint
+tp_base_connection_get_unicast_index (TpBaseConnection *self,
+    GQuark token)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  guint i;
+
+  if (self->object_path == NULL || priv->bus_proxy == NULL)
+    return 0;
+
+  i = GPOINTER_TO_UINT (g_hash_table_lookup (priv->interest_indices,
+        GUINT_TO_POINTER (token)));
+
+  if (i == 0 ||
+      !g_array_index (priv->possible_interests, PossibleInterest,
+        i - 1).unicast)
+    return 0;
+
+  return i;
+}
+
+/*
+ * _tp_base_connection_has_unicast_signals:
+ *
+ * Returns: %TRUE if tp_base_connection_emit_unicast_signal() would send
+ *  signals for @token, so that callers can avoid building a #GVariant
+ *  that would only be thrown away
+ */
+gboolean
+_tp_base_connection_has_unicast_signals (TpBaseConnection *self,
+    GQuark token)
+{
+  return (tp_base_connection_get_unicast_index (self, token) != 0);
+}
+
+/**
+ * tp_base_connection_emit_unicast_signal:
+ * @self: a connection
+ * @token: a quark corresponding to the interface of the signal, or to a
+ *  token representing part of it
+ * @iface: the D-Bus interface of the signal
+ * @member: the name of the signal
+ * @args: a tuple containing the signal's arguments; if it is floating, it
+ *  is consumed
+ *
+ * If tp_base_connection_set_unicast_signals() has been called for @token,
+ * send the signal @member on @iface from @self's object path to each client
+ * interested in @token, as described there, and return %TRUE. The signal
+ * is only serialized once, however many clients receive it.
+ *
+ * Otherwise, or if @self is not on the bus, do nothing and return %FALSE;
+ * the caller should emit the signal in the usual way, for instance with
+ * the appropriate tp_svc_ function.
+ *
+ * Returns: %TRUE if the signal was dealt with
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_base_connection_emit_unicast_signal (TpBaseConnection *self,
+    GQuark token,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args)
+{
+  TpBaseConnectionPrivate *priv;
+  DBusConnection *dbc;
+  DBusMessage *message;
+  GHashTableIter iter;
+  gpointer k, v;
+  guint i, n_sent = 0;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), FALSE);
+  g_return_val_if_fail (iface != NULL, FALSE);
+  g_return_val_if_fail (member != NULL, FALSE);
+  g_return_val_if_fail (args != NULL, FALSE);
+
+  priv = self->priv;
+  g_variant_ref_sink (args);
+  i = tp_base_connection_get_unicast_index (self, token);
+
+  if (i == 0)
+    {
+      g_variant_unref (args);
+      return FALSE;
+    }
+
+  dbc = dbus_g_connection_get_connection (
+      tp_proxy_get_dbus_connection (priv->bus_proxy));
+  message = _tp_dbus_message_new_signal (self->object_path, iface, member,
+      args);
+  g_variant_unref (args);
+
+  g_hash_table_iter_init (&iter, priv->interested_clients);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      ClientInterests *ci = v;
+      DBusMessage *copy;
+
+      if (i > ci->n_counts || ci->counts[i - 1] == 0)
+        continue;
+
+      copy = dbus_message_copy (message);
+      dbus_message_set_destination (copy, k);
+      dbus_connection_send (dbc, copy, NULL);
+      dbus_message_unref (copy);
+      n_sent++;
+    }
+
+  g_hash_table_iter_init (&iter, priv->contact_interested_clients);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      ClientInterests *ci = g_hash_table_lookup (priv->interested_clients, k);
+      DBusMessage *copy;
+
+      /* already sent to it above */
+      if (ci != NULL && i <= ci->n_counts && ci->counts[i - 1] > 0)
+        continue;
+
+      if (g_hash_table_lookup (v, GUINT_TO_POINTER (token)) == NULL)
+        continue;
+
+      copy = dbus_message_copy (message);
+      dbus_message_set_destination (copy, k);
+      dbus_connection_send (dbc, copy, NULL);
+      dbus_message_unref (copy);
+      n_sent++;
+    }
+
+  TRACE ("sent %s.%s to %u interested clients", iface, member, n_sent);
+  dbus_message_unref (message);
+  return TRUE;
+}
+
+/**
+ * tp_base_connection_set_avatar_file_threshold:
+ * @self: a connection implementing %TP_IFACE_CONNECTION_INTERFACE_AVATARS
+ * @min_size: the size in bytes from which avatars are passed in files, or 0
+ *  to always pass them inline
+ *
+ * Arrange for tp_base_connection_emit_avatar_retrieved() to write avatars of
+ * at least @min_size bytes into a file only readable by this user, and emit
+ * AvatarFileRetrieved with its path instead of AvatarRetrieved, while some
+ * client has an interest in
+ * %TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES.
+ *
+ * This avoids copying large avatars through the bus daemon, which is often
+ * the bottleneck when all of a user's contacts' avatars are retrieved at
+ * once. The files are deleted when the connection is disposed.
+ *
+ * The default is 0, so that connection managers which do not call this
+ * function behave as before. This may be called at any time.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_set_avatar_file_threshold (TpBaseConnection *self,
+    gsize min_size)
+{
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (TP_IS_SVC_CONNECTION_INTERFACE_AVATARS (self));
+
+  self->priv->avatar_file_threshold = min_size;
+}
+
+/* Returns the path of a file containing @avatar, which was retrieved with
+ * @token, writing it if necessary, or %NULL if that is not possible */
+static const gchar *
+tp_base_connection_ensure_avatar_file (TpBaseConnection *self,
+    const gchar *token,
+    const GArray *avatar)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  GError *error = NULL;
+  gchar *basename;
+  gchar *path;
+
+  if (priv->avatar_files == NULL)
+    priv->avatar_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, g_free);
+
+  /* the same token always means the same image, so each one only needs
+   * to be written once, however many contacts share it */
+  path = g_hash_table_lookup (priv->avatar_files, token);
+
+  if (path != NULL)
+    return path;
+
+  if (priv->avatar_dir == NULL)
+    {
+      gchar *dir = g_build_filename (g_get_user_runtime_dir (),
+          "telepathy-avatars-XXXXXX", NULL);
+
+      if (g_mkdtemp_full (dir, 0700) == NULL)
+        {
+          DEBUG ("unable to create %s: %s", dir, g_strerror (errno));
+          g_free (dir);
+          return NULL;
+        }
+
+      priv->avatar_dir = dir;
+    }
+
+  /* tokens are chosen by the protocol, so don't use them as filenames */
+  basename = g_compute_checksum_for_string (G_CHECKSUM_SHA1, token, -1);
+  path = g_build_filename (priv->avatar_dir, basename, NULL);
+  g_free (basename);
+
+  /* this writes a temporary file and renames it, so clients never see a
+   * partly-written avatar */
+  if (!g_file_set_contents (path, avatar->data, avatar->len, &error))
+    {
+      DEBUG ("unable to write avatar %s: %s", token, error->message);
+      g_clear_error (&error);
+      g_free (path);
+      return NULL;
+    }
+
+  g_hash_table_insert (priv->avatar_files, g_strdup (token), path);
+  return path;
+}
+
+/**
+ * tp_base_connection_emit_avatar_retrieved:
+ * @self: a connection implementing %TP_IFACE_CONNECTION_INTERFACE_AVATARS
+ * @contact: the contact whose avatar has been retrieved
+ * @token: the token corresponding to @avatar
+ * @avatar: the image data
+ * @mime_type: the MIME type of @avatar, or "" if unknown
+ *
+ * Emit AvatarRetrieved for @contact, or AvatarFileRetrieved if @avatar is
+ * large enough and a client is interested in it; see
+ * tp_base_connection_set_avatar_file_threshold(). Connection managers should
+ * call this instead of
+ * tp_svc_connection_interface_avatars_emit_avatar_retrieved().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_emit_avatar_retrieved (TpBaseConnection *self,
+    TpHandle contact,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type)
+{
+  TpBaseConnectionPrivate *priv;
+  PossibleInterest *pi;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (TP_IS_SVC_CONNECTION_INTERFACE_AVATARS (self));
+  g_return_if_fail (token != NULL);
+  g_return_if_fail (avatar != NULL);
+
+  priv = self->priv;
+
+  if (mime_type == NULL)
+    mime_type = "";
+
+  if (priv->avatar_file_threshold > 0 &&
+      avatar->len >= priv->avatar_file_threshold)
+    {
+      pi = tp_base_connection_lookup_possible_interest (self,
+          TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES, &i);
+
+      if (pi != NULL && pi->n_clients > 0)
+        {
+          const gchar *path = tp_base_connection_ensure_avatar_file (self,
+              token, avatar);
+
+          if (path != NULL)
+            {
+              tp_svc_connection_interface_avatars_emit_avatar_file_retrieved (
+                  self, contact, token, path, mime_type);
+              return;
+            }
+
+          /* otherwise fall back to sending it inline */
+        }
+    }
+
+  tp_svc_connection_interface_avatars_emit_avatar_retrieved (self, contact,
+      token, avatar, mime_type);
+}
+
+/**
+ * tp_base_connection_add_capability_set:
+ * @self: a connection
+ * @hash: an opaque string identifying a set of capabilities, such as an
+ *  XMPP entity capabilities hash
+ * @classes: (element-type GValueArray): the capabilities identified by
+ *  @hash, a %TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST
+ *
+ * Remember that @hash stands for @classes, so that contacts with the same
+ * capabilities can be given them with
+ * tp_base_connection_set_contacts_capability_set(). The same #GPtrArray is
+ * then used in GetContactCapabilities replies, the ContactCapabilitiesChanged
+ * signal and the contact attributes for all of them, rather than each
+ * contact having a copy that has to be computed separately.
+ *
+ * A hash is assumed to always stand for the same capabilities, so if @hash
+ * has already been added, this does nothing.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_add_capability_set (TpBaseConnection *self,
+    const gchar *hash,
+    const GPtrArray *classes)
+{
+  GPtrArray *copy;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (hash != NULL);
+  g_return_if_fail (classes != NULL);
+
+  if (g_hash_table_contains (self->priv->capability_sets, hash))
+    return;
+
+  /* not g_boxed_copy(), so that the copy frees its elements when its last
+   * reference is released */
+  copy = g_ptr_array_new_full (classes->len,
+      (GDestroyNotify) tp_value_array_free);
+
+  for (i = 0; i < classes->len; i++)
+    g_ptr_array_add (copy, g_boxed_copy (
+          TP_STRUCT_TYPE_REQUESTABLE_CHANNEL_CLASS,
+          g_ptr_array_index (classes, i)));
+
+  g_hash_table_insert (self->priv->capability_sets, g_strdup (hash), copy);
+}
+
+/**
+ * tp_base_connection_has_capability_set:
+ * @self: a connection
+ * @hash: an opaque string identifying a set of capabilities
+ *
+ * <!-- -->
+ *
+ * Returns: %TRUE if @hash has been added with
+ *  tp_base_connection_add_capability_set(), so connection managers that
+ *  discover the capabilities for a hash by asking the contact need not do
+ *  so again
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_base_connection_has_capability_set (TpBaseConnection *self,
+    const gchar *hash)
+{
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), FALSE);
+  g_return_val_if_fail (hash != NULL, FALSE);
+
+  return g_hash_table_contains (self->priv->capability_sets, hash);
+}
+
+/**
+ * tp_base_connection_set_contacts_capability_set:
+ * @self: a connection implementing
+ *  %TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES
+ * @contacts: (element-type TpHandle): contact handles
+ * @hash: (allow-none): a hash added with
+ *  tp_base_connection_add_capability_set(), or %NULL if @contacts have no
+ *  capabilities
+ *
+ * Record that each of @contacts has the capabilities identified by @hash,
+ * and emit ContactCapabilitiesChanged once for those whose capabilities
+ * have changed.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_set_contacts_capability_set (TpBaseConnection *self,
+    const GArray *contacts,
+    const gchar *hash)
+{
+  TpBaseConnectionPrivate *priv;
+  GPtrArray *classes = NULL;
+  GPtrArray *none = NULL;
+  GHashTable *changed;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (TP_IS_SVC_CONNECTION_INTERFACE_CONTACT_CAPABILITIES (
+        self));
+  g_return_if_fail (contacts != NULL);
+
+  priv = self->priv;
+
+  if (hash != NULL)
+    {
+      classes = g_hash_table_lookup (priv->capability_sets, hash);
+      g_return_if_fail (classes != NULL);
+    }
+  else
+    {
+      none = g_ptr_array_new ();
+    }
+
+  /* the values are borrowed, so emitting the signal copies nothing */
+  changed = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle contact = g_array_index (contacts, TpHandle, i);
+      gpointer key = GUINT_TO_POINTER (contact);
+
+      if (g_hash_table_lookup (priv->contact_capability_sets, key) ==
+          classes)
+        continue;
+
+      if (classes != NULL)
+        {
+          g_hash_table_insert (priv->contact_capability_sets, key, classes);
+          g_hash_table_insert (changed, key, classes);
+        }
+      else
+        {
+          g_hash_table_remove (priv->contact_capability_sets, key);
+          g_hash_table_insert (changed, key, none);
+        }
+    }
+
+  if (g_hash_table_size (changed) > 0)
+    {
+      GArray *changed_contacts = g_array_sized_new (FALSE, FALSE,
+          sizeof (TpHandle), g_hash_table_size (changed));
+      GHashTableIter iter;
+      gpointer key;
+
+      tp_svc_connection_interface_contact_capabilities_emit_contact_capabilities_changed (
+          self, changed);
+
+      g_hash_table_iter_init (&iter, changed);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          TpHandle contact = GPOINTER_TO_UINT (key);
+
+          g_array_append_val (changed_contacts, contact);
+        }
+
+      /* does nothing unless the capability sets were registered with the
+       * Contacts mixin */
+      tp_contacts_mixin_emit_contact_attributes_changed (G_OBJECT (self),
+          TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES,
+          changed_contacts);
+      g_array_unref (changed_contacts);
+    }
+
+  g_hash_table_unref (changed);
+
+  if (none != NULL)
+    g_ptr_array_unref (none);
+}
+
+/**
+ * tp_base_connection_dup_contact_capabilities:
+ * @self: a connection
+ * @contacts: (element-type TpHandle): contact handles
+ *
+ * Return the capabilities recorded for @contacts with
+ * tp_base_connection_set_contacts_capability_set(), suitable for replying
+ * to GetContactCapabilities. Contacts for which capabilities have not been
+ * recorded are omitted, so the caller can add them itself.
+ *
+ * Contacts with the same capabilities share the same #GPtrArray, so the
+ * values in the result must not be modified, and it must be freed with
+ * g_hash_table_unref() rather than tp_clear_boxed() or g_boxed_free().
+ *
+ * Returns: (transfer full) (element-type guint GLib.PtrArray): a map from
+ *  contact handles to %TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST values
+ *
+ * Since: 0.UNRELEASED
+ */
+GHashTable *
+tp_base_connection_dup_contact_capabilities (TpBaseConnection *self,
+    const GArray *contacts)
+{
+  GHashTable *ret;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), NULL);
+  g_return_val_if_fail (contacts != NULL, NULL);
+
+  ret = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      gpointer key = GUINT_TO_POINTER (g_array_index (contacts, TpHandle, i));
+      GPtrArray *classes = g_hash_table_lookup (
+          self->priv->contact_capability_sets, key);
+
+      if (classes != NULL)
+        g_hash_table_insert (ret, key, g_ptr_array_ref (classes));
+    }
+
+  return ret;
+}
+
+static void
+tp_base_connection_fill_capability_sets (GObject *obj,
+    const GArray *contacts,
+    TpContactAttributesBuilder *builder)
+{
+  TpBaseConnection *self = TP_BASE_CONNECTION (obj);
+  guint column = _tp_contact_attributes_builder_add_column (builder,
+      TP_TOKEN_CONNECTION_INTERFACE_CONTACT_CAPABILITIES_CAPABILITIES);
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      GPtrArray *classes = g_hash_table_lookup (
+          self->priv->contact_capability_sets,
+          GUINT_TO_POINTER (g_array_index (contacts, TpHandle, i)));
+
+      /* capability sets are never freed before the connection is, so
+       * there's no need to copy them into the attributes */
+      if (classes != NULL)
+        g_value_set_static_boxed (_tp_contact_attributes_builder_init_value (
+              builder, column, i, TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST),
+            classes);
+    }
+}
+
+/**
+ * tp_base_connection_register_capability_sets_with_contacts_mixin: (skip)
+ * @self: a connection implementing
+ *  %TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES and using the
+ *  Contacts mixin
+ *
+ * Fill in the ContactCapabilities interface's contact attribute from the
+ * capabilities recorded with tp_base_connection_set_contacts_capability_set().
+ * The Contacts mixin should be initialized before this function is called.
+ * Changes are also signalled by the Contacts interface's
+ * ContactAttributesChanged signal.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_register_capability_sets_with_contacts_mixin (
+    TpBaseConnection *self)
+{
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+
+  _tp_contacts_mixin_add_contact_attributes_columns (G_OBJECT (self),
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES,
+      tp_base_connection_fill_capability_sets);
+  /* it only reads the capability sets, which are only changed from the
+   * main thread */
+  tp_contacts_mixin_set_contact_attributes_thread_safe (G_OBJECT (self),
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES);
+  /* tp_base_connection_set_contacts_capability_set() signals every
+   * change */
+  tp_contacts_mixin_set_contact_attributes_notified (G_OBJECT (self),
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES);
+}
+
+/* D-Bus properties for the Requests interface */
+
+static void
+factory_get_channel_details_foreach (TpChannelIface *chan,
+                                     gpointer data)
+{
+  GPtrArray *details = data;
+
+  g_ptr_array_add (details, get_channel_details (G_OBJECT (chan)));
+}
+
+
+static void
+manager_get_channel_details_foreach (TpExportableChannel *chan,
+                                     gpointer data)
+{
+  GPtrArray *details = data;
+
+  g_ptr_array_add (details, get_channel_details (G_OBJECT (chan)));
+}
+
+
+static GPtrArray *
+conn_requests_list_channel_details (TpBaseConnection *self)
 {
   TpBaseConnectionPrivate *priv = self->priv;
   /* guess that each ChannelManager and each ChannelFactory has two
@@ -1460,6 +2844,47 @@ conn_requests_get_channel_details (TpBaseConnection *self)
   return details;
 }
 
+static GPtrArray *
+conn_requests_get_channel_details (TpBaseConnection *self)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  GPtrArray *details;
+  GHashTableIter iter;
+  gpointer value;
+
+  if (priv->channel_details == NULL)
+    {
+      /* From now on, we keep track of the channels as they come and go,
+       * rather than asking every channel for its properties every time */
+      GPtrArray *all = conn_requests_list_channel_details (self);
+      guint i;
+
+      priv->channel_details = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, (GDestroyNotify) tp_value_array_free);
+
+      for (i = 0; i < all->len; i++)
+        {
+          GValueArray *va = g_ptr_array_index (all, i);
+          const gchar *object_path;
+
+          tp_value_array_unpack (va, 1, &object_path);
+          g_hash_table_insert (priv->channel_details,
+              g_strdup (object_path), va);
+        }
+
+      g_ptr_array_unref (all);
+    }
+
+  details = g_ptr_array_sized_new (g_hash_table_size (priv->channel_details));
+  g_hash_table_iter_init (&iter, priv->channel_details);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    g_ptr_array_add (details,
+        g_boxed_copy (TP_STRUCT_TYPE_CHANNEL_DETAILS, value));
+
+  return details;
+}
+
 
 static void
 get_requestables_foreach (TpChannelManager *manager,
@@ -1510,6 +2935,8 @@ conn_requests_get_dbus_property (GObject *object,
 
   if (name == g_quark_from_static_string ("Channels"))
     {
+      /* don't list channels that haven't been announced yet */
+      flush_new_channels (self);
       g_value_take_boxed (value, conn_requests_get_channel_details (self));
     }
   else if (name == g_quark_from_static_string ("RequestableChannelClasses"))
@@ -1671,7 +3098,11 @@ tp_base_connection_class_init (TpBaseConnectionClass *klass)
    *
    * This property is not useful to use directly. Its value is %TRUE, to
    * indicate that this version of telepathy-glib never unreferences handles
-   * until the connection becomes disconnected.
+   * until the connection becomes disconnected. Handles in a repository
+   * that reclaims them, as described for
+   * tp_dynamic_handle_repo_set_reclaim_after(), can stop being valid, but
+   * a stale handle is reported as invalid rather than naming a different
+   * identifier.
    *
    * Since: 0.13.8
    */
@@ -1702,6 +3133,38 @@ tp_base_connection_class_init (TpBaseConnectionClass *klass)
   g_object_class_install_property (object_class, PROP_ACCOUNT_PATH_SUFFIX,
       param_spec);
 
+  /**
+   * TpBaseConnection:main-context:
+   *
+   * The main context to which this connection is bound, or %NULL for the
+   * global default main context. Read-only except during construction.
+   *
+   * A connection manager with many connections can bind each connection
+   * to a main context run by a worker thread, so that its connections do
+   * not all share one CPU core. If this property is set and
+   * #TpBaseConnection:dbus-daemon is not, the connection opens a private
+   * connection to the starter or session bus whose messages are
+   * dispatched in this main context, so that D-Bus method calls on the
+   * connection and its channels are handled by the worker thread.
+   *
+   * The worker thread must make this its thread-default main context with
+   * g_main_context_push_thread_default() before it runs it, since the
+   * connection's deferred work, and that of the channel managers, channels
+   * and mixins it owns, is attached to the thread-default main context.
+   * Once it has been registered with tp_base_connection_register(), the
+   * connection and the objects it owns, including its handle repositories,
+   * must only be used from that thread. #TpBaseConnectionManager takes
+   * care of talking to it from its own thread.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_boxed ("main-context", "Main context",
+      "The main context to which this connection is bound",
+      G_TYPE_MAIN_CONTEXT,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_MAIN_CONTEXT,
+      param_spec);
+
   /* signal definitions */
 
   /**
@@ -1794,11 +3257,29 @@ tp_base_connection_init (TpBaseConnection *self)
       priv->handles[i] = NULL;
     }
 
-  priv->channel_requests = g_ptr_array_new ();
-  priv->client_interests = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) g_hash_table_unref);
+  g_queue_init (&priv->channel_requests);
+  priv->channel_requests_by_target = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) g_queue_free);
+  priv->ensured_channels = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, ensured_channel_free);
+  priv->resolved_target_ids = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, NULL);
+  priv->request_shapes = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  priv->possible_interests = g_array_new (FALSE, FALSE,
+      sizeof (PossibleInterest));
+  priv->interest_indices = g_hash_table_new (NULL, NULL);
   priv->interested_clients = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, client_interests_free);
+  priv->contact_interests = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_hash_table_unref);
+  priv->contact_interested_clients = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
+  priv->holding_clients = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, NULL);
+  priv->capability_sets = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_ptr_array_unref);
+  priv->contact_capability_sets = g_hash_table_new (NULL, NULL);
 }
 
 static gchar *
@@ -1941,15 +3422,32 @@ tp_base_connection_register (TpBaseConnection *self,
   return TRUE;
 }
 
+static void
+unregister_base_channel_foreach (TpExportableChannel *channel,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  if (TP_IS_BASE_CHANNEL (channel))
+    _tp_base_channel_unregister (TP_BASE_CHANNEL (channel));
+}
+
 static void
 tp_base_connection_close_all_channels (TpBaseConnection *self)
 {
   TpBaseConnectionPrivate *priv = self->priv;
+  guint i;
 
-  /* We deliberately don't iterate over channel managers here -
-   * they don't need this, and are expected to listen to
-   * TpSvcConnection::status-changed on the connection for themselves.
+  /* Channel managers don't need to be told to close their channels: they
+   * are expected to listen to TpSvcConnection::status-changed on the
+   * connection for themselves. However, if a connection with thousands of
+   * channels sent Closed and MembersChanged for each one, followed by our
+   * ChannelClosed, clients would be flooded with signals that
+   * StatusChanged makes redundant; so take all their channels off the bus
+   * first, in one go, and anything they emit while closing stays local.
    */
+  for (i = 0; i < priv->channel_managers->len; i++)
+    tp_channel_manager_foreach_channel (
+        g_ptr_array_index (priv->channel_managers, i),
+        unregister_base_channel_foreach, NULL);
 
   G_GNUC_BEGIN_IGNORE_DEPRECATIONS
   /* trigger close_all on all channel factories */
@@ -2015,35 +3513,103 @@ conn_status_reason_from_g_error (GError *error)
   return TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED;
 }
 
+/* Call start_connecting; if it fails, disconnect and return FALSE. */
+static gboolean
+tp_base_connection_start_connecting (TpBaseConnection *self,
+    GError **error)
+{
+  TpBaseConnectionClass *cls = TP_BASE_CONNECTION_GET_CLASS (self);
+  GError *local_error = NULL;
+
+  if (cls->start_connecting (self, &local_error))
+    {
+      if (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW)
+        {
+          tp_base_connection_change_status (self,
+            TP_CONNECTION_STATUS_CONNECTING,
+            TP_CONNECTION_STATUS_REASON_REQUESTED);
+        }
+
+      return TRUE;
+    }
+
+  if (self->status != TP_CONNECTION_STATUS_DISCONNECTED)
+    {
+      tp_base_connection_change_status (self,
+        TP_CONNECTION_STATUS_DISCONNECTED,
+        conn_status_reason_from_g_error (local_error));
+    }
+
+  g_propagate_error (error, local_error);
+  return FALSE;
+}
+
+/*
+ * _tp_base_connection_set_connection_manager:
+ * @self: a connection in state #TP_INTERNAL_CONNECTION_STATUS_NEW
+ * @cm: the connection manager which created @self
+ *
+ * Ask @cm for permission before starting to connect, via
+ * _tp_base_connection_manager_admit(), so that it can limit how many
+ * connections are connecting at once.
+ */
+void
+_tp_base_connection_set_connection_manager (TpBaseConnection *self,
+    TpBaseConnectionManager *cm)
+{
+  g_return_if_fail (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW);
+  g_return_if_fail (self->priv->cm == NULL);
+
+  self->priv->cm = cm;
+  g_object_add_weak_pointer (G_OBJECT (cm), (gpointer *) &self->priv->cm);
+}
+
+/*
+ * _tp_base_connection_start_connecting:
+ * @self: a connection whose Connect() method was called, but which was not
+ *  admitted by its connection manager at the time
+ *
+ * Do what Connect() would have done, now that the connection manager has
+ * room for another connection attempt.
+ */
+void
+_tp_base_connection_start_connecting (TpBaseConnection *self)
+{
+  GError *error = NULL;
+
+  g_return_if_fail (self->priv->connect_queued);
+  self->priv->connect_queued = FALSE;
+
+  g_return_if_fail (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW);
+
+  if (!tp_base_connection_start_connecting (self, &error))
+    {
+      DEBUG ("failed to start connecting: %s", error->message);
+      g_error_free (error);
+    }
+}
+
 static void
 tp_base_connection_connect (TpSvcConnection *iface,
                             DBusGMethodInvocation *context)
 {
   TpBaseConnection *self = TP_BASE_CONNECTION (iface);
-  TpBaseConnectionClass *cls = TP_BASE_CONNECTION_GET_CLASS (self);
   GError *error = NULL;
 
   g_assert (TP_IS_BASE_CONNECTION (self));
 
-  if (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW)
+  if (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW &&
+      !self->priv->connect_queued)
     {
-      if (cls->start_connecting (self, &error))
+      if (self->priv->cm != NULL &&
+          !_tp_base_connection_manager_admit (self->priv->cm, self))
         {
-          if (self->status == TP_INTERNAL_CONNECTION_STATUS_NEW)
-            {
-              tp_base_connection_change_status (self,
-                TP_CONNECTION_STATUS_CONNECTING,
-                TP_CONNECTION_STATUS_REASON_REQUESTED);
-            }
+          /* we stay NEW until the CM calls
+           * _tp_base_connection_start_connecting() */
+          self->priv->connect_queued = TRUE;
         }
-      else
+      else if (!tp_base_connection_start_connecting (self, &error))
         {
-          if (self->status != TP_CONNECTION_STATUS_DISCONNECTED)
-            {
-              tp_base_connection_change_status (self,
-                TP_CONNECTION_STATUS_DISCONNECTED,
-                conn_status_reason_from_g_error (error));
-            }
           dbus_g_method_return_error (context, error);
           g_error_free (error);
           return;
@@ -2087,7 +3653,7 @@ tp_base_connection_get_interfaces (TpBaseConnection *self)
 {
   g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), NULL);
 
-  return (const gchar * const *)(self->priv->interfaces->data);
+  return self->priv->interfaces;
 }
 
 static void
@@ -2220,13 +3786,72 @@ tp_base_connection_check_connected (TpBaseConnection *self,
   return FALSE;
 }
 
-static void
-tp_base_connection_dbus_get_status (TpSvcConnection *iface,
-    DBusGMethodInvocation *context)
-{
-  tp_svc_connection_return_from_get_status (
-      context, tp_base_connection_get_status (
-        (TpBaseConnection *) iface));
+static void
+tp_base_connection_dbus_get_status (TpSvcConnection *iface,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_connection_return_from_get_status (
+      context, tp_base_connection_get_status (
+        (TpBaseConnection *) iface));
+}
+
+static void
+tp_base_connection_holder_name_owner_changed_cb (
+    TpDBusDaemon *it G_GNUC_UNUSED,
+    const gchar *unique_name,
+    const gchar *new_owner,
+    gpointer user_data)
+{
+  TpBaseConnection *self = user_data;
+  guint i;
+
+  /* We don't care about the initial report that :1.42 is owned by :1.42. */
+  if (!tp_str_empty (new_owner))
+    return;
+
+  DEBUG ("%s exited, releasing the handles it held", unique_name);
+
+  for (i = 0; i < TP_NUM_HANDLE_TYPES; i++)
+    {
+      if (self->priv->handles[i] != NULL)
+        _tp_dynamic_handle_repo_forget_client (self->priv->handles[i],
+            unique_name);
+    }
+
+  g_hash_table_remove (self->priv->holding_clients, unique_name);
+
+  tp_dbus_daemon_cancel_name_owner_watch (self->priv->bus_proxy,
+      unique_name, tp_base_connection_holder_name_owner_changed_cb, self);
+}
+
+/*
+ * Hold @handles, which must be valid, on behalf of the client
+ * @unique_name until it releases them or leaves the bus, as if it had
+ * called HoldHandles.
+ */
+void
+_tp_base_connection_hold_handles (TpBaseConnection *self,
+    const gchar *unique_name,
+    TpHandleType handle_type,
+    const GArray *handles)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  TpHandleRepoIface *repo = priv->handles[handle_type];
+
+  /* Handles only need holding if they might otherwise be reclaimed */
+  if (!_tp_dynamic_handle_repo_is_reclaiming (repo))
+    return;
+
+  _tp_handle_repo_client_hold (repo, unique_name, handles);
+
+  if (!g_hash_table_contains (priv->holding_clients, unique_name))
+    {
+      gchar *name = g_strdup (unique_name);
+
+      g_hash_table_insert (priv->holding_clients, name, name);
+      tp_dbus_daemon_watch_name_owner (priv->bus_proxy, name,
+          tp_base_connection_holder_name_owner_changed_cb, self, NULL);
+    }
 }
 
 static void
@@ -2238,6 +3863,7 @@ tp_base_connection_hold_handles (TpSvcConnection *iface,
   TpBaseConnection *self = TP_BASE_CONNECTION (iface);
   TpBaseConnectionPrivate *priv;
   GError *error = NULL;
+  gchar *sender;
 
   g_assert (TP_IS_BASE_CONNECTION (self));
 
@@ -2253,9 +3879,50 @@ tp_base_connection_hold_handles (TpSvcConnection *iface,
       return;
     }
 
+  sender = dbus_g_method_get_sender (context);
+  _tp_base_connection_hold_handles (self, sender, handle_type, handles);
+  g_free (sender);
+
   tp_svc_connection_return_from_hold_handles (context);
 }
 
+/* Returns a reply to InspectHandles (@handles), with no destination or
+ * reply serial. The identifiers are appended straight from @repo, rather
+ * than being collected into a #GValue for dbus-glib to marshal. */
+static DBusMessage *
+inspect_handles_build_reply (TpHandleRepoIface *repo,
+    const GArray *handles)
+{
+  DBusMessage *reply = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  DBusMessageIter iter, sub;
+  guint i;
+
+  if (reply == NULL)
+    ERROR ("Out of memory");
+
+  dbus_message_iter_init_append (reply, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+        DBUS_TYPE_STRING_AS_STRING, &sub))
+    ERROR ("Out of memory");
+
+  for (i = 0; i < handles->len; i++)
+    {
+      TpHandle handle = g_array_index (handles, TpHandle, i);
+      const gchar *id = tp_handle_inspect (repo, handle);
+
+      g_assert (id != NULL);
+
+      if (!dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING, &id))
+        ERROR ("Out of memory");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &sub))
+    ERROR ("Out of memory");
+
+  return reply;
+}
+
 static void
 tp_base_connection_inspect_handles (TpSvcConnection *iface,
                                     guint handle_type,
@@ -2265,8 +3932,8 @@ tp_base_connection_inspect_handles (TpSvcConnection *iface,
   TpBaseConnection *self = TP_BASE_CONNECTION (iface);
   TpBaseConnectionPrivate *priv = self->priv;
   GError *error = NULL;
-  const gchar **ret;
-  guint i;
+  DBusMessage *skeleton, *reply;
+  const gchar *destination;
 
   g_assert (TP_IS_BASE_CONNECTION (self));
 
@@ -2282,25 +3949,51 @@ tp_base_connection_inspect_handles (TpSvcConnection *iface,
       return;
     }
 
-  ret = g_new (const gchar *, handles->len + 1);
-
-  for (i = 0; i < handles->len; i++)
+  if (priv->inspect_cache_reply == NULL ||
+      priv->inspect_cache_type != handle_type ||
+      priv->inspect_cache_handles->len != handles->len ||
+      memcmp (priv->inspect_cache_handles->data, handles->data,
+        handles->len * sizeof (TpHandle)) != 0)
     {
-      TpHandle handle;
-      const gchar *tmp;
+      TpHandleRepoIface *repo = priv->handles[handle_type];
 
-      handle = g_array_index (handles, TpHandle, i);
-      tmp = tp_handle_inspect (priv->handles[handle_type], handle);
-      g_assert (tmp != NULL);
+      tp_clear_pointer (&priv->inspect_cache_handles, g_array_unref);
+      tp_clear_pointer (&priv->inspect_cache_pins, tp_handle_set_destroy);
+      tp_clear_pointer (&priv->inspect_cache_reply, dbus_message_unref);
 
-      ret[i] = tmp;
+      priv->inspect_cache_type = handle_type;
+      priv->inspect_cache_handles = g_array_sized_new (FALSE, FALSE,
+          sizeof (TpHandle), handles->len);
+      g_array_append_vals (priv->inspect_cache_handles, handles->data,
+          handles->len);
+
+      if (_tp_dynamic_handle_repo_is_reclaiming (repo))
+        priv->inspect_cache_pins = tp_handle_set_new_from_array (repo,
+            handles);
+
+      priv->inspect_cache_reply = inspect_handles_build_reply (repo,
+          handles);
     }
 
-  ret[i] = NULL;
+  skeleton = dbus_g_method_get_reply (context);
+  reply = dbus_message_copy (priv->inspect_cache_reply);
+
+  if (reply == NULL ||
+      !dbus_message_set_reply_serial (reply,
+        dbus_message_get_reply_serial (skeleton)))
+    ERROR ("Out of memory");
+
+  destination = dbus_message_get_destination (skeleton);
 
-  tp_svc_connection_return_from_inspect_handles (context, ret);
+  /* peer-to-peer connections have no sender */
+  if (destination != NULL && !dbus_message_set_destination (reply,
+        destination))
+    ERROR ("Out of memory");
 
-  g_free (ret);
+  dbus_message_unref (skeleton);
+
+  /* this takes ownership of the message */
+  dbus_g_method_send_reply (context, reply);
 }
 
 /*
@@ -2467,6 +4160,7 @@ tp_base_connection_request_channel (TpSvcConnection *iface,
   guint i;
   ChannelRequest *request;
   GHashTable *request_properties;
+  _TpAsvBuilder builder;
   gboolean claimed_by_channel_manager = FALSE;
   TpHandleRepoIface *handle_repo = NULL;
 
@@ -2511,25 +4205,26 @@ tp_base_connection_request_channel (TpSvcConnection *iface,
 
   request = channel_request_new (context, METHOD_REQUEST_CHANNEL,
       type, handle_type, handle, suppress_handler);
-  g_ptr_array_add (priv->channel_requests, request);
+  channel_requests_add (self, request);
 
   /* First try the channel managers */
 
-  request_properties = tp_asv_new (
-      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING, type,
-      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT, handle_type,
-      NULL);
+  _tp_asv_builder_init (&builder);
+  _tp_asv_builder_add_string (&builder, TP_PROP_CHANNEL_CHANNEL_TYPE, type);
+  _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE,
+      handle_type);
 
   if (handle != 0)
     {
-      tp_asv_set_uint32 (request_properties,
-          TP_PROP_CHANNEL_TARGET_HANDLE, handle);
+      _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_TARGET_HANDLE,
+          handle);
       g_assert (handle_repo != NULL);
-      tp_asv_set_string (request_properties,
-          TP_PROP_CHANNEL_TARGET_ID,
+      _tp_asv_builder_add_string (&builder, TP_PROP_CHANNEL_TARGET_ID,
           tp_handle_inspect (handle_repo, handle));
     }
 
+  request_properties = _tp_asv_builder_end (&builder);
+
   for (i = 0; i < priv->channel_managers->len; i++)
     {
       TpChannelManager *manager = TP_CHANNEL_MANAGER (
@@ -2569,16 +4264,16 @@ tp_base_connection_request_channel (TpSvcConnection *iface,
             g_assert (NULL != chan);
             factory_satisfy_requests (self, factory, chan, request, FALSE);
             /* factory_satisfy_requests should remove the request */
-            g_assert (!tp_g_ptr_array_contains (priv->channel_requests,
-                  request));
+            g_assert (g_queue_find (&priv->channel_requests,
+                  request) == NULL);
             return;
           }
         case TP_CHANNEL_FACTORY_REQUEST_STATUS_CREATED:
           g_assert (NULL != chan);
           /* the signal handler should have completed the queued request
            * and freed the ChannelRequest already */
-          g_assert (!tp_g_ptr_array_contains (priv->channel_requests,
-                request));
+          g_assert (g_queue_find (&priv->channel_requests,
+                request) == NULL);
           return;
         case TP_CHANNEL_FACTORY_REQUEST_STATUS_QUEUED:
           DEBUG ("queued request, channel_type=%s, handle_type=%u, "
@@ -2633,7 +4328,7 @@ ERROR:
   request->context = NULL;
   g_error_free (error);
 
-  g_ptr_array_remove (priv->channel_requests, request);
+  channel_requests_remove (self, request);
   channel_request_free (request);
 }
 
@@ -2659,6 +4354,15 @@ tp_base_connection_release_handles (TpSvcConnection *iface,
       return;
     }
 
+  if (_tp_dynamic_handle_repo_is_reclaiming (priv->handles[handle_type]))
+    {
+      gchar *sender = dbus_g_method_get_sender (context);
+
+      _tp_handle_repo_client_release (priv->handles[handle_type], sender,
+          handles);
+      g_free (sender);
+    }
+
   tp_svc_connection_return_from_release_handles (context);
 }
 
@@ -2780,6 +4484,25 @@ tp_base_connection_dbus_request_handles (TpSvcConnection *iface,
       return;
     }
 
+  if (!_tp_handle_repo_has_async_normalization (handle_repo))
+    {
+      /* tp_handle_ensure_async() would give the same results, but this
+       * resolves them all in one pass without a main loop round-trip for
+       * each name */
+      GArray *handles = g_array_sized_new (FALSE, TRUE, sizeof (guint),
+          count);
+
+      if (!tp_handle_ensure_many (handle_repo, names, NULL, handles, &error))
+        {
+          g_array_unref (handles);
+          goto error;
+        }
+
+      tp_svc_connection_return_from_request_handles (context, handles);
+      g_array_unref (handles);
+      return;
+    }
+
   request = g_slice_new0 (RequestHandlesData);
   request->handles = g_array_sized_new (FALSE, TRUE, sizeof (guint), count);
   request->n_pending = count;
@@ -2863,12 +4586,22 @@ void
 tp_base_connection_set_self_handle (TpBaseConnection *self,
                                     TpHandle self_handle)
 {
+  TpHandleRepoIface *contact_repo = self->priv->handles[
+      TP_HANDLE_TYPE_CONTACT];
+
   if (self->status == TP_CONNECTION_STATUS_CONNECTED)
     g_return_if_fail (self_handle != 0);
 
   if (self->self_handle == self_handle)
     return;
 
+  /* keep it valid even if the contact repo reclaims handles */
+  if (contact_repo != NULL && self_handle != 0)
+    tp_handle_pin (contact_repo, self_handle);
+
+  if (contact_repo != NULL && self->self_handle != 0)
+    tp_handle_unpin (contact_repo, self->self_handle);
+
   self->self_handle = self_handle;
   self->priv->self_id = NULL;
 
@@ -3165,6 +4898,11 @@ tp_base_connection_change_status (TpBaseConnection *self,
       if (self->priv->disconnect_requests == NULL)
         self->priv->disconnect_requests = g_ptr_array_sized_new (0);
 
+      /* announce any channels that are still pending, so clients don't
+       * see them closed before they were created */
+      flush_new_channels (self);
+      g_hash_table_remove_all (priv->ensured_channels);
+
       /* remove all channels and shut down all factories, so we don't get
        * any race conditions where method calls are delivered to a channel
        * after we've started disconnecting
@@ -3207,12 +4945,12 @@ tp_base_connection_change_status (TpBaseConnection *self,
       /* cancel all queued channel requests that weren't already cancelled by
        * the channel managers.
        */
-      if (priv->channel_requests->len > 0)
+      if (!g_queue_is_empty (&priv->channel_requests))
         {
-          g_ptr_array_foreach (priv->channel_requests, (GFunc)
+          g_hash_table_remove_all (priv->channel_requests_by_target);
+          g_queue_foreach (&priv->channel_requests, (GFunc)
             channel_request_cancel, NULL);
-          g_ptr_array_remove_range (priv->channel_requests, 0,
-            priv->channel_requests->len);
+          g_queue_clear (&priv->channel_requests);
         }
 
       if (prev_status != TP_INTERNAL_CONNECTION_STATUS_NEW)
@@ -3232,6 +4970,13 @@ tp_base_connection_change_status (TpBaseConnection *self,
       g_assert_not_reached ();
     }
 
+  /* we're not connecting (or waiting to) any more, so let someone else */
+  if (priv->cm != NULL && status != TP_CONNECTION_STATUS_CONNECTING)
+    {
+      priv->connect_queued = FALSE;
+      _tp_base_connection_manager_release (priv->cm, self);
+    }
+
   g_object_unref (self);
 }
 
@@ -3262,8 +5007,8 @@ tp_base_connection_add_interfaces (TpBaseConnection *self,
   g_return_if_fail (self->status != TP_CONNECTION_STATUS_CONNECTED);
   g_return_if_fail (self->status != TP_CONNECTION_STATUS_DISCONNECTED);
 
-  for (; interfaces != NULL && *interfaces != NULL; interfaces++)
-    g_array_append_val (priv->interfaces, *interfaces);
+  priv->interfaces = _tp_strv_intern_concat (priv->interfaces,
+      (const gchar * const *) interfaces);
 }
 
 static void
@@ -3274,8 +5019,8 @@ tp_base_connection_interested_name_owner_changed_cb (
     gpointer user_data)
 {
   TpBaseConnection *self = user_data;
-  GHashTableIter iter;
-  gpointer q, hash;
+  ClientInterests *ci;
+  guint i;
 
   /* We don't care about the initial report that :1.42 is owned by :1.42. */
   if (!tp_str_empty (new_owner))
@@ -3283,23 +5028,28 @@ tp_base_connection_interested_name_owner_changed_cb (
 
   /* Failing that, @unique_name must have crashed... */
 
-  g_hash_table_iter_init (&iter, self->priv->client_interests);
+  ci = g_hash_table_lookup (self->priv->interested_clients, unique_name);
 
-  while (g_hash_table_iter_next (&iter, &q, &hash))
+  for (i = 0; ci != NULL && i < ci->n_counts; i++)
     {
-      if (g_hash_table_remove (hash, unique_name) &&
-          g_hash_table_size (hash) == 0)
+      PossibleInterest *pi;
+
+      if (ci->counts[i] == 0)
+        continue;
+
+      ci->counts[i] = 0;
+      pi = &g_array_index (self->priv->possible_interests, PossibleInterest,
+          i);
+
+      if (--pi->n_clients == 0)
         {
-          const gchar *s = g_quark_to_string (GPOINTER_TO_UINT (q));
+          const gchar *s = g_quark_to_string (pi->token);
 
-          DEBUG ("%s was the last client interested in %s", unique_name, s);
-          g_signal_emit (self, signals[CLIENTS_UNINTERESTED],
-              (GQuark) GPOINTER_TO_UINT (q), s);
+          TRACE ("%s was the last client interested in %s", unique_name, s);
+          g_signal_emit (self, signals[CLIENTS_UNINTERESTED], pi->token, s);
         }
     }
 
-  /* this has to be done last, because the keys in the other hashes are
-   * borrowed from here */
   g_hash_table_remove (self->priv->interested_clients, unique_name);
 
   tp_dbus_daemon_cancel_name_owner_watch (self->priv->bus_proxy,
@@ -3312,80 +5062,61 @@ tp_base_connection_add_client_interest_impl (TpBaseConnection *self,
     const gchar * const *interests,
     gboolean only_if_uninterested)
 {
-  gpointer name_in_hash, count_p;
-  gsize total;
+  ClientInterests *ci;
   const gchar * const *interest;
   gboolean was_there;
 
-  if (g_hash_table_lookup_extended (self->priv->interested_clients,
-        unique_name, &name_in_hash, &count_p))
-    {
-      total = GPOINTER_TO_SIZE (count_p);
-      was_there = TRUE;
-    }
-  else
+  ci = g_hash_table_lookup (self->priv->interested_clients, unique_name);
+  was_there = (ci != NULL);
+
+  if (ci == NULL)
     {
-      name_in_hash = g_strdup (unique_name);
-      total = 0;
-      g_hash_table_insert (self->priv->interested_clients, name_in_hash,
-          GSIZE_TO_POINTER (total));
-      was_there = FALSE;
+      ci = g_slice_new0 (ClientInterests);
+      g_hash_table_insert (self->priv->interested_clients,
+          g_strdup (unique_name), ci);
     }
 
   for (interest = interests; *interest != NULL; interest++)
     {
-      GQuark q = g_quark_try_string (*interest);
-      GHashTable *clients;
-      gsize count;
+      PossibleInterest *pi;
+      guint i;
 
-      if (q == 0)
-        {
-          /* we can only declare an interest in known quarks, so clearly this
-           * one is not useful */
-          continue;
-        }
+      pi = tp_base_connection_lookup_possible_interest (self, *interest, &i);
 
-      clients = g_hash_table_lookup (self->priv->client_interests,
-            GUINT_TO_POINTER (q));
+      if (pi == NULL)
+        continue;
 
-      if (clients == NULL)
+      if (i >= ci->n_counts)
         {
-          /* declaring an interest in this token has no effect */
-          continue;
-        }
+          guint n = self->priv->possible_interests->len;
 
-      count = GPOINTER_TO_SIZE (g_hash_table_lookup (clients, unique_name));
+          ci->counts = g_renew (gsize, ci->counts, n);
+          memset (ci->counts + ci->n_counts, 0,
+              (n - ci->n_counts) * sizeof (gsize));
+          ci->n_counts = n;
+        }
 
-      if (count > 0 && only_if_uninterested)
+      if (ci->counts[i] > 0 && only_if_uninterested)
         {
           /* that client is already interested - nothing to do */
           continue;
         }
 
-      /* name_in_hash is borrowed from interested_clients so we have to
-       * keep using the same one */
-      g_hash_table_insert (clients, name_in_hash,
-          GSIZE_TO_POINTER (++count));
-      total++;
+      ci->total++;
 
-      if (count == 1 && g_hash_table_size (clients) == 1)
+      if (ci->counts[i]++ == 0 && pi->n_clients++ == 0)
         {
           /* Transition from 0 to 1 interests in total; the signal detail is
            * the token. */
           DEBUG ("%s is the first to be interested in %s", unique_name,
               *interest);
-          g_signal_emit (self, signals[CLIENTS_INTERESTED], q, *interest);
+          g_signal_emit (self, signals[CLIENTS_INTERESTED], pi->token,
+              *interest);
         }
     }
 
-  if (total > 0)
+  if (ci->total > 0)
     {
-      /* name_in_hash is borrowed by client_interests so we have to keep
-       * using the same one */
-      g_hash_table_steal (self->priv->interested_clients, name_in_hash);
-      g_hash_table_insert (self->priv->interested_clients, name_in_hash,
-          GSIZE_TO_POINTER (total));
-
       if (!was_there)
         {
           tp_dbus_daemon_watch_name_owner (self->priv->bus_proxy, unique_name,
@@ -3462,8 +5193,7 @@ tp_base_connection_dbus_remove_client_interest (TpSvcConnection *svc,
   gchar *unique_name = NULL;
   const gchar **interest;
   TpBaseConnection *self = (TpBaseConnection *) svc;
-  gpointer name_in_hash, count_p;
-  gsize total;
+  ClientInterests *ci;
 
   g_return_if_fail (TP_IS_BASE_CONNECTION (self));
   g_return_if_fail (self->priv->bus_proxy != NULL);
@@ -3475,8 +5205,17 @@ tp_base_connection_dbus_remove_client_interest (TpSvcConnection *svc,
 
   /* this method isn't really meant to fail, so we might as well return now */
 
-  if (!g_hash_table_lookup_extended (self->priv->interested_clients,
-        unique_name, &name_in_hash, &count_p))
+  for (interest = interests; *interest != NULL; interest++)
+    {
+      GQuark q = g_quark_try_string (*interest);
+
+      if (q != 0)
+        tp_base_connection_forget_contact_interests (self, unique_name, q);
+    }
+
+  ci = g_hash_table_lookup (self->priv->interested_clients, unique_name);
+
+  if (ci == NULL)
     {
       /* unique_name doesn't own any client interests. Strictly speaking this
        * is an error, but it's probably ignoring the reply anyway, so we
@@ -3484,33 +5223,17 @@ tp_base_connection_dbus_remove_client_interest (TpSvcConnection *svc,
       goto finally;
     }
 
-  total = GPOINTER_TO_SIZE (count_p);
-
   for (interest = interests; *interest != NULL; interest++)
     {
-      GQuark q = g_quark_try_string (*interest);
-      GHashTable *clients;
-      gsize count;
+      PossibleInterest *pi;
+      guint i;
 
-      if (q == 0)
-        {
-          /* we can only declare an interest in known quarks, so clearly this
-           * one is not useful */
-          continue;
-        }
-
-      clients = g_hash_table_lookup (self->priv->client_interests,
-            GUINT_TO_POINTER (q));
-
-      if (clients == NULL)
-        {
-          /* declaring an interest in this token has no effect */
-          continue;
-        }
+      pi = tp_base_connection_lookup_possible_interest (self, *interest, &i);
 
-      count = GPOINTER_TO_SIZE (g_hash_table_lookup (clients, unique_name));
+      if (pi == NULL)
+        continue;
 
-      if (count == 0)
+      if (i >= ci->n_counts || ci->counts[i] == 0)
         {
           /* strictly speaking, this is an error, but nobody will be waiting
            * for a reply anyway */
@@ -3519,31 +5242,19 @@ tp_base_connection_dbus_remove_client_interest (TpSvcConnection *svc,
           continue;
         }
 
-      total--;
-
-      if (count == 1)
-        {
-          g_hash_table_remove (clients, unique_name);
+      ci->total--;
 
-          if (g_hash_table_size (clients) == 0)
-            {
-              /* transition from 1 to 0 total interest-counts */
-              DEBUG ("%s was the last client interested in %s", unique_name,
-                  *interest);
-              g_signal_emit (self, signals[CLIENTS_UNINTERESTED], q,
-                  *interest);
-            }
-        }
-      else
+      if (--ci->counts[i] == 0 && --pi->n_clients == 0)
         {
-          /* name_in_hash is borrowed from interested_clients so we have to
-           * keep using the same one */
-          g_hash_table_insert (clients, name_in_hash,
-              GSIZE_TO_POINTER (--count));
+          /* transition from 1 to 0 total interest-counts */
+          DEBUG ("%s was the last client interested in %s", unique_name,
+              *interest);
+          g_signal_emit (self, signals[CLIENTS_UNINTERESTED], pi->token,
+              *interest);
         }
     }
 
-  if (total == 0)
+  if (ci->total == 0)
     {
       g_hash_table_remove (self->priv->interested_clients, unique_name);
 
@@ -3700,6 +5411,39 @@ conn_requests_check_basic_properties (TpBaseConnection *self,
 }
 
 
+/* Equivalent to tp_handle_ensure (@handles, @target_id, NULL, @error), but
+ * without normalizing @target_id again if it has been requested before */
+static TpHandle
+conn_requests_resolve_target_id (TpBaseConnection *self,
+    TpHandleRepoIface *handles,
+    TpHandleType target_handle_type,
+    const gchar *target_id,
+    GError **error)
+{
+  TpBaseConnectionPrivate *priv = self->priv;
+  gchar *key = g_strdup_printf ("%u:%s", target_handle_type, target_id);
+  TpHandle handle = GPOINTER_TO_UINT (g_hash_table_lookup (
+        priv->resolved_target_ids, key));
+
+  if (handle != 0)
+    {
+      g_free (key);
+      return handle;
+    }
+
+  handle = tp_handle_ensure (handles, target_id, NULL, error);
+
+  /* a reclaimed handle could be reused for a different identifier */
+  if (handle != 0 && !_tp_dynamic_handle_repo_is_reclaiming (handles))
+    g_hash_table_insert (priv->resolved_target_ids, key,
+        GUINT_TO_POINTER (handle));
+  else
+    g_free (key);
+
+  return handle;
+}
+
+
 /*
  * @target_handle: non-zero if a TargetHandle property was in the request;
  *                 zero if TargetHandle was not in the request.
@@ -3756,7 +5500,8 @@ conn_requests_requestotron_validate_handle (TpBaseConnection *self,
       if (target_handle == 0)
         {
           /* Turn TargetID into TargetHandle */
-          target_handle = tp_handle_ensure (handles, target_id, NULL, &error);
+          target_handle = conn_requests_resolve_target_id (self, handles,
+              target_handle_type, target_id, &error);
 
           if (target_handle == 0)
             {
@@ -3828,6 +5573,32 @@ conn_requests_requestotron_validate_handle (TpBaseConnection *self,
 }
 
 
+/* Returns a key for priv->request_shapes identifying requests for
+ * @type and @target_handle_type with the same set of properties, whatever
+ * their values */
+static gchar *
+request_shape_new (GHashTable *requested_properties,
+    const gchar *type,
+    TpHandleType target_handle_type)
+{
+  GString *shape = g_string_new (type);
+  GList *names = g_list_sort (g_hash_table_get_keys (requested_properties),
+      (GCompareFunc) strcmp);
+  GList *l;
+
+  g_string_append_printf (shape, ":%u", target_handle_type);
+
+  for (l = names; l != NULL; l = l->next)
+    {
+      g_string_append_c (shape, ':');
+      g_string_append (shape, l->data);
+    }
+
+  g_list_free (names);
+  return g_string_free (shape, FALSE);
+}
+
+
 static void
 conn_requests_offer_request (TpBaseConnection *self,
                              GHashTable *requested_properties,
@@ -3844,7 +5615,8 @@ conn_requests_offer_request (TpBaseConnection *self,
   TpChannelManagerRequestFunc func;
   ChannelRequest *request;
   gboolean suppress_handler;
-  guint i;
+  gchar *shape;
+  guint previous, i;
 
   switch (method)
     {
@@ -3864,22 +5636,71 @@ conn_requests_offer_request (TpBaseConnection *self,
 
   request = channel_request_new (context, method,
       type, target_handle_type, target_handle, suppress_handler);
-  g_ptr_array_add (priv->channel_requests, request);
+
+  /* ChannelType, TargetHandleType, TargetHandle and TargetID, and nothing
+   * else: any channel manager would return the same channel again as long
+   * as it's open, so there's no need to ask */
+  if (method == METHOD_ENSURE_CHANNEL &&
+      target_handle_type != TP_HANDLE_TYPE_NONE &&
+      g_hash_table_size (requested_properties) == 4)
+    {
+      EnsuredChannel *ensured = g_hash_table_lookup (priv->ensured_channels,
+          request->target_key);
+
+      if (ensured != NULL)
+        {
+          DEBUG ("request %p satisfied by existing channel %s", request,
+              ensured->object_path);
+          _tp_dbus_g_method_return_template (context, ensured->reply);
+          request->context = NULL;
+          channel_request_free (request);
+          return;
+        }
+
+      request->basic = TRUE;
+    }
+
+  channel_requests_add (self, request);
+
+  /* Try the manager that accepted the last request like this one first:
+   * when there are a lot of channel managers, most of them only decline
+   * requests for channel types they don't know about */
+  shape = request_shape_new (requested_properties, type, target_handle_type);
+  previous = GPOINTER_TO_UINT (g_hash_table_lookup (priv->request_shapes,
+        shape));
+
+  if (previous != 0 && func (TP_CHANNEL_MANAGER (g_ptr_array_index (
+            priv->channel_managers, previous - 1)),
+        request, requested_properties))
+    {
+      g_free (shape);
+      return;
+    }
 
   for (i = 0; i < priv->channel_managers->len; i++)
     {
       TpChannelManager *manager = TP_CHANNEL_MANAGER (
           g_ptr_array_index (priv->channel_managers, i));
 
+      if (i + 1 == previous)
+        continue;
+
       if (func (manager, request, requested_properties))
-        return;
+        {
+          g_hash_table_insert (priv->request_shapes, shape,
+              GUINT_TO_POINTER (i + 1));
+          return;
+        }
     }
 
+  g_hash_table_remove (priv->request_shapes, shape);
+  g_free (shape);
+
   /* Nobody accepted the request */
   tp_dbus_g_method_return_not_implemented (context);
   request->context = NULL;
 
-  g_ptr_array_remove (priv->channel_requests, request);
+  channel_requests_remove (self, request);
   channel_request_free (request);
 }
 
@@ -3996,10 +5817,12 @@ tp_base_connection_channel_manager_iter_next (TpChannelManagerIter *iter,
 
 static void
 tp_base_connection_fill_contact_attributes (GObject *obj,
-  const GArray *contacts, GHashTable *attributes_hash)
+  const GArray *contacts, TpContactAttributesBuilder *builder)
 {
   TpBaseConnection *self = TP_BASE_CONNECTION (obj);
   TpBaseConnectionPrivate *priv = self->priv;
+  guint column = _tp_contact_attributes_builder_add_column (builder,
+      TP_TOKEN_CONNECTION_CONTACT_ID);
   guint i;
 
   for (i = 0; i < contacts->len; i++)
@@ -4011,9 +5834,8 @@ tp_base_connection_fill_contact_attributes (GObject *obj,
       tmp = tp_handle_inspect (priv->handles[TP_HANDLE_TYPE_CONTACT], handle);
       g_assert (tmp != NULL);
 
-      tp_contacts_mixin_set_contact_attribute (attributes_hash,
-          handle, TP_TOKEN_CONNECTION_CONTACT_ID,
-          tp_g_value_slice_new_string (tmp));
+      g_value_set_string (_tp_contact_attributes_builder_init_value (builder,
+            column, i, G_TYPE_STRING), tmp);
     }
 }
 
@@ -4031,9 +5853,159 @@ tp_base_connection_register_with_contacts_mixin (TpBaseConnection *self)
 {
   g_return_if_fail (TP_IS_BASE_CONNECTION (self));
 
-  tp_contacts_mixin_add_contact_attributes_iface (G_OBJECT (self),
+  _tp_contacts_mixin_add_contact_attributes_columns (G_OBJECT (self),
       TP_IFACE_CONNECTION,
       tp_base_connection_fill_contact_attributes);
+
+  /* looking up identifiers in a dynamic repository doesn't change it */
+  if (TP_IS_DYNAMIC_HANDLE_REPO (
+        self->priv->handles[TP_HANDLE_TYPE_CONTACT]))
+    tp_contacts_mixin_set_contact_attributes_thread_safe (G_OBJECT (self),
+        TP_IFACE_CONNECTION);
+}
+
+/**
+ * TpBaseConnectionAddressToIdFunc:
+ * @self: a connection
+ * @vcard_field: the vCard field of @address, such as
+ *  <literal>tel</literal> or <literal>x-jabber</literal>, or %NULL if
+ *  @address is a URI
+ * @address: a vCard address or URI
+ * @user_data: the data passed to
+ *  tp_base_connection_dup_contacts_by_addresses()
+ * @error: used to raise an error if @address does not identify a contact
+ *
+ * Signature of a function turning a vCard address or a URI into the
+ * identifier of a contact on @self, which will be normalized in the usual
+ * way by its contact handle repository. This must not make any network
+ * requests.
+ *
+ * Returns: (transfer full): a contact identifier, or %NULL if @address
+ *  is not valid or not understood
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * tp_base_connection_dup_contacts_by_addresses: (skip)
+ * @self: a connection, which must use the Contacts mixin
+ * @vcard_field: the vCard field of all of @addresses, or %NULL if they are
+ *  URIs
+ * @addresses: a %NULL-terminated array of vCard addresses or URIs
+ * @address_to_id: used to turn each of @addresses into a contact
+ *  identifier
+ * @user_data: passed to @address_to_id
+ * @interfaces: the interfaces for which the caller wants contact
+ *  attributes, as for GetContactAttributes
+ * @sender: the unique name of the caller, or %NULL
+ * @requested: (out) (transfer full) (element-type utf8 uint): used to
+ *  return a map from those @addresses that identify a contact to its
+ *  handle
+ * @attributes: (out) (transfer full): used to return a map from each
+ *  handle in @requested to its contact attributes, as returned by
+ *  tp_contacts_mixin_get_contact_attributes()
+ * @error: used to raise an error if @self is not connected
+ *
+ * Resolve many addresses to contacts, and get all their contact attributes
+ * at once; this is what the GetContactsByVCardField and GetContactsByURI
+ * methods on the Addressing interface do, so connection managers
+ * implementing that interface can reply with @requested and @attributes.
+ *
+ * Addresses which @address_to_id rejects, or whose identifiers are not
+ * valid, are left out of @requested. Duplicate addresses and addresses
+ * which identify the same contact are only looked up once. The attributes
+ * of the Connection and Addressing interfaces are always included. If
+ * @sender is not %NULL, it is also recorded as being interested in the
+ * contacts' attributes of @interfaces, as if it had called
+ * GetContactAttributes.
+ *
+ * Returns: %TRUE on success, or %FALSE if @self is not connected
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_base_connection_dup_contacts_by_addresses (TpBaseConnection *self,
+    const gchar *vcard_field,
+    const gchar * const *addresses,
+    TpBaseConnectionAddressToIdFunc address_to_id,
+    gpointer user_data,
+    const gchar * const *interfaces,
+    const gchar *sender,
+    GHashTable **requested,
+    GHashTable **attributes,
+    GError **error)
+{
+  const gchar *assumed[] = { TP_IFACE_CONNECTION,
+      TP_IFACE_CONNECTION_INTERFACE_ADDRESSING, NULL };
+  TpHandleRepoIface *contact_repo;
+  TpHandleSet *contacts;
+  GArray *handles;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), FALSE);
+  g_return_val_if_fail (addresses != NULL, FALSE);
+  g_return_val_if_fail (address_to_id != NULL, FALSE);
+  g_return_val_if_fail (requested != NULL, FALSE);
+  g_return_val_if_fail (attributes != NULL, FALSE);
+
+  if (!tp_base_connection_check_connected (self, error))
+    return FALSE;
+
+  contact_repo = self->priv->handles[TP_HANDLE_TYPE_CONTACT];
+  contacts = tp_handle_set_new (contact_repo);
+  *requested = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+
+  for (i = 0; addresses[i] != NULL; i++)
+    {
+      TpHandle handle;
+      gchar *id;
+      GError *e = NULL;
+
+      if (g_hash_table_lookup (*requested, addresses[i]) != NULL)
+        continue;
+
+      id = address_to_id (self, vcard_field, addresses[i], user_data, &e);
+
+      if (id == NULL)
+        {
+          DEBUG ("ignoring %s '%s': %s",
+              vcard_field != NULL ? vcard_field : "URI", addresses[i],
+              e->message);
+          g_clear_error (&e);
+          continue;
+        }
+
+      handle = tp_handle_ensure (contact_repo, id, NULL, &e);
+
+      if (handle == 0)
+        {
+          DEBUG ("ignoring '%s', which resolved to invalid ID '%s': %s",
+              addresses[i], id, e->message);
+          g_clear_error (&e);
+          g_free (id);
+          continue;
+        }
+
+      g_hash_table_insert (*requested, g_strdup (addresses[i]),
+          GUINT_TO_POINTER (handle));
+      tp_handle_set_add (contacts, handle);
+      g_free (id);
+    }
+
+  /* one attributes lookup for all of them, rather than one per address */
+  handles = tp_handle_set_to_array (contacts);
+
+  if (sender != NULL)
+    _tp_base_connection_add_contact_interests (self, sender, interfaces,
+        handles);
+
+  *attributes = tp_contacts_mixin_get_contact_attributes ((GObject *) self,
+      handles, (const gchar **) interfaces, assumed, NULL);
+
+  g_array_unref (handles);
+  tp_handle_set_destroy (contacts);
+  return TRUE;
 }
 
 /**
@@ -4056,6 +6028,144 @@ tp_base_connection_get_dbus_daemon (TpBaseConnection *self)
   return self->priv->bus_proxy;
 }
 
+/**
+ * tp_base_connection_get_main_context:
+ * @self: a connection
+ *
+ * Return the main context to which @self is bound, as described for
+ * #TpBaseConnection:main-context.
+ *
+ * Returns: (transfer none): the value of #TpBaseConnection:main-context if
+ *  it was set, or the global default main context otherwise
+ *
+ * Since: 0.UNRELEASED
+ */
+GMainContext *
+tp_base_connection_get_main_context (TpBaseConnection *self)
+{
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), NULL);
+
+  if (self->priv->main_context == NULL)
+    return g_main_context_default ();
+
+  return self->priv->main_context;
+}
+
+typedef struct {
+    TpBaseConnection *self;
+    guint id;
+    GSourceFunc function;
+    gpointer data;
+    GDestroyNotify notify;
+} ConnectionTimeout;
+
+static gboolean
+connection_timeout_cb (gpointer p)
+{
+  ConnectionTimeout *timeout = p;
+
+  return timeout->function (timeout->data);
+}
+
+static void
+connection_timeout_free (gpointer p)
+{
+  ConnectionTimeout *timeout = p;
+  TpBaseConnectionPrivate *priv = timeout->self->priv;
+
+  if (priv->timeouts != NULL)
+    g_hash_table_remove (priv->timeouts, GUINT_TO_POINTER (timeout->id));
+
+  if (timeout->notify != NULL)
+    timeout->notify (timeout->data);
+
+  g_slice_free (ConnectionTimeout, timeout);
+}
+
+/**
+ * tp_base_connection_add_timeout:
+ * @self: a connection
+ * @interval_ms: the time between calls to @function, in milliseconds
+ * @function: called every @interval_ms until it returns %FALSE
+ * @data: data for @function
+ * @notify: (allow-none): called on @data when the timeout is removed
+ *
+ * Like g_timeout_add_full() with %G_PRIORITY_DEFAULT, but for timeouts
+ * such as keepalives, reconnection and typing notifications in
+ * #TpBaseConnection:main-context, of which a connection manager with
+ * many connections can have thousands. Rather than being a #GSource of
+ * its own, each timeout is kept in a timer wheel that is shared by every
+ * connection bound to the same main context, so that the main loop only
+ * has one source to look at however many timeouts there are, and adding
+ * or removing one takes constant time.
+ *
+ * In return, timeouts are less precise: @function may be called up to 50
+ * milliseconds late (but never early), and timeouts that become due
+ * close together are run together. This is not suitable for media
+ * timing, such as the gaps between DTMF tones.
+ *
+ * Timeouts that haven't been removed by the time @self is disposed are
+ * removed then.
+ *
+ * Returns: a non-zero ID for the timeout, to be passed to
+ *  tp_base_connection_remove_timeout()
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_base_connection_add_timeout (TpBaseConnection *self,
+    guint interval_ms,
+    GSourceFunc function,
+    gpointer data,
+    GDestroyNotify notify)
+{
+  TpBaseConnectionPrivate *priv;
+  ConnectionTimeout *timeout;
+
+  g_return_val_if_fail (TP_IS_BASE_CONNECTION (self), 0);
+  g_return_val_if_fail (function != NULL, 0);
+
+  priv = self->priv;
+  g_return_val_if_fail (!priv->dispose_has_run, 0);
+
+  if (priv->timeouts == NULL)
+    priv->timeouts = g_hash_table_new (NULL, NULL);
+
+  timeout = g_slice_new (ConnectionTimeout);
+  timeout->self = self;
+  timeout->function = function;
+  timeout->data = data;
+  timeout->notify = notify;
+  timeout->id = _tp_timer_wheel_add (priv->main_context, interval_ms,
+      connection_timeout_cb, timeout, connection_timeout_free);
+
+  g_hash_table_add (priv->timeouts, GUINT_TO_POINTER (timeout->id));
+  return timeout->id;
+}
+
+/**
+ * tp_base_connection_remove_timeout:
+ * @self: a connection
+ * @id: an ID returned by tp_base_connection_add_timeout() for @self
+ *
+ * Remove a timeout, as if its function had returned %FALSE and with the
+ * same restrictions as g_source_remove(): it must not have been removed
+ * already.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_connection_remove_timeout (TpBaseConnection *self,
+    guint id)
+{
+  g_return_if_fail (TP_IS_BASE_CONNECTION (self));
+  g_return_if_fail (self->priv->timeouts != NULL);
+  g_return_if_fail (g_hash_table_contains (self->priv->timeouts,
+        GUINT_TO_POINTER (id)));
+
+  _tp_timer_wheel_remove (self->priv->main_context, id);
+}
+
 gpointer
 _tp_base_connection_find_channel_manager (TpBaseConnection *self,
     GType type)
@@ -183,6 +183,24 @@ void tp_base_connection_dbus_request_handles (TpSvcConnection *iface,
 
 void tp_base_connection_register_with_contacts_mixin (TpBaseConnection *self);
 
+typedef gchar *(*TpBaseConnectionAddressToIdFunc) (TpBaseConnection *self,
+    const gchar *vcard_field,
+    const gchar *address,
+    gpointer user_data,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_base_connection_dup_contacts_by_addresses (TpBaseConnection *self,
+    const gchar *vcard_field,
+    const gchar * const *addresses,
+    TpBaseConnectionAddressToIdFunc address_to_id,
+    gpointer user_data,
+    const gchar * const *interfaces,
+    const gchar *sender,
+    GHashTable **requested,
+    GHashTable **attributes,
+    GError **error);
+
 
 typedef struct _TpChannelManagerIter TpChannelManagerIter;
 
@@ -233,6 +251,15 @@ gboolean tp_base_connection_channel_manager_iter_next (
   } G_STMT_END
 
 TpDBusDaemon *tp_base_connection_get_dbus_daemon (TpBaseConnection *self);
+_TP_AVAILABLE_IN_UNRELEASED
+GMainContext *tp_base_connection_get_main_context (TpBaseConnection *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_base_connection_add_timeout (TpBaseConnection *self,
+    guint interval_ms, GSourceFunc function, gpointer data,
+    GDestroyNotify notify);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_remove_timeout (TpBaseConnection *self, guint id);
 
 void tp_base_connection_add_client_interest (TpBaseConnection *self,
     const gchar *unique_name, const gchar *token,
@@ -241,6 +268,58 @@ void tp_base_connection_add_client_interest (TpBaseConnection *self,
 void tp_base_connection_add_possible_client_interest (TpBaseConnection *self,
     GQuark token);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_add_possible_contact_interest (TpBaseConnection *self,
+    GQuark token);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_add_contact_interest (TpBaseConnection *self,
+    const gchar *unique_name,
+    const gchar *token,
+    const GArray *contacts);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_base_connection_is_contact_interesting (TpBaseConnection *self,
+    GQuark token,
+    TpHandle contact);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_set_unicast_signals (TpBaseConnection *self,
+    GQuark token);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_base_connection_emit_unicast_signal (TpBaseConnection *self,
+    GQuark token,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_set_avatar_file_threshold (TpBaseConnection *self,
+    gsize min_size);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_emit_avatar_retrieved (TpBaseConnection *self,
+    TpHandle contact,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_add_capability_set (TpBaseConnection *self,
+    const gchar *hash,
+    const GPtrArray *classes);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_base_connection_has_capability_set (TpBaseConnection *self,
+    const gchar *hash);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_set_contacts_capability_set (TpBaseConnection *self,
+    const GArray *contacts,
+    const gchar *hash);
+_TP_AVAILABLE_IN_UNRELEASED
+GHashTable *tp_base_connection_dup_contact_capabilities (
+    TpBaseConnection *self,
+    const GArray *contacts);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_connection_register_capability_sets_with_contacts_mixin (
+    TpBaseConnection *self);
+
 _TP_AVAILABLE_IN_0_24
 const gchar *tp_base_connection_get_account_path_suffix (
     TpBaseConnection *self);
@@ -31,7 +31,10 @@
 
 #include <telepathy-glib/base-connection-internal.h>
 #include <telepathy-glib/contact-list-channel-internal.h>
+#include <telepathy-glib/contacts-mixin-internal.h>
 #include <telepathy-glib/handle-repo-internal.h>
+#include <telepathy-glib/presence-mixin-internal.h>
+#include <telepathy-glib/_gen/tp-svc-connection-variant.h>
 
 /**
  * SECTION:base-contact-list
@@ -265,6 +268,10 @@
 #define DEBUG_FLAG TP_DEBUG_CONTACT_LISTS
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/util-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+typedef struct _RosterUpdate RosterUpdate;
+typedef struct _RosterSnapshot RosterSnapshot;
 
 struct _TpBaseContactListPrivate
 {
@@ -281,6 +288,15 @@ struct _TpBaseContactListPrivate
   TpHandleRepoIface *group_repo;
   /* handle borrowed from channel => referenced TpContactGroupChannel */
   GHashTable *groups;
+  /* If lazy-group-channels is TRUE, the groups that exist, whether or not
+   * there is a channel for them in @groups; NULL otherwise */
+  TpHandleSet *known_groups;
+  /* contact handle => (owned) TpHandleSet of the groups it is in, for
+   * contacts in at least one group; kept up to date by groups_changed,
+   * groups_removed and group_renamed, so that filling in the ContactGroups
+   * attribute doesn't need to call dup_contact_groups. NULL if we are not
+   * a TpContactGroupList. */
+  GHashTable *contact_groups;
 
   /* borrowed TpExportableChannel => GSList of gpointer (request tokens) that
    * will be satisfied by that channel when the contact list has been
@@ -295,6 +311,10 @@ struct _TpBaseContactListPrivate
    * waiting for the contact list to (fail to) be downloaded.
    */
   GQueue blocked_contact_requests;
+  /* borrowed identifiers of every blocked contact, as returned by
+   * RequestBlockedContacts, or NULL if blocking has changed since it was
+   * last needed */
+  GHashTable *blocked_contact_ids;
 
   gulong status_changed_id;
 
@@ -308,6 +328,93 @@ struct _TpBaseContactListPrivate
   /* TRUE if the contact list must be downloaded at connection. Default is
    * TRUE. */
   gboolean download_at_connection;
+  /* TRUE if group channels are only created when requested. Default is
+   * FALSE. */
+  gboolean lazy_group_channels;
+
+  /* number of tp_base_contact_list_begin_batch() calls not yet matched by
+   * tp_base_contact_list_end_batch() */
+  guint batch_depth;
+  /* While batching: contacts changed, removed, or with changed blocking
+   * state since the batch began, or NULL if none. A contact is in at most
+   * one of batch_changed and batch_removed: whichever happened last. */
+  TpHandleSet *batch_changed;
+  TpHandleSet *batch_removed;
+  TpHandleSet *batch_blocking;
+  /* While batching: GroupsChange structs, oldest first */
+  GQueue batch_groups;
+
+  /* maximum time in milliseconds to spend on a change to the contact list
+   * before returning to the main loop, or 0 to do it all at once */
+  guint time_slice;
+  /* a change to the contact list that is being worked through in idle
+   * callbacks, or NULL; while this is non-NULL, it holds a batch open */
+  RosterUpdate *roster_update;
+
+  /* incremented whenever a change to the contact list is signalled */
+  guint64 roster_version;
+  /* the contact list as D-Bus clients have been told about it, or NULL */
+  RosterSnapshot *snapshot;
+};
+
+/* The contacts and their states as of roster_version, so that several
+ * clients fetching a large contact list in quick succession don't each
+ * make the subclass look up every contact again. It is patched from each
+ * RosterUpdate as it is signalled, and only used while no batch is open,
+ * so it is never ahead of or behind what clients have seen. */
+struct _RosterSnapshot {
+    guint64 version;
+    TpHandleSet *contacts;
+    /* TpHandle => owned CachedStates, for each of @contacts */
+    GHashTable *states;
+    /* @contacts as an array, shared by everyone who asks for it until the
+     * next change; or NULL if nobody has asked yet */
+    GArray *array;
+};
+
+typedef struct {
+    guint8 subscribe;
+    guint8 publish;
+    /* NULL if empty */
+    gchar *publish_request;
+} CachedStates;
+
+/* A call to tp_base_contact_list_groups_changed() deferred until the end of
+ * a batch */
+typedef struct {
+    TpHandleSet *contacts;
+    GStrv added;
+    GStrv removed;
+} GroupsChange;
+
+/* The working state of tp_base_contact_list_contacts_changed_internal(),
+ * which might be spread over several main loop iterations if there is a
+ * time slice */
+struct _RosterUpdate {
+    /* owned copies, or NULL */
+    TpHandleSet *changed;
+    TpHandleSet *removed;
+    gboolean is_initial_roster;
+
+    /* position in @changed */
+    TpIntsetFastIter iter;
+
+    /* contacts to be added to or removed from the list channels in bulk */
+    TpIntset *pub;
+    TpIntset *unpub;
+    TpIntset *unsub;
+    TpIntset *sub;
+    TpIntset *sub_rp;
+    TpIntset *store;
+
+    /* the arguments to ContactsChanged and ContactsChangedWithID */
+    GHashTable *changes;
+    GHashTable *change_ids;
+
+    /* roster_version before this update */
+    guint64 base_version;
+
+    guint idle_id;
 };
 
 struct _TpBaseContactListClassPrivate
@@ -425,6 +532,33 @@ G_DEFINE_INTERFACE (TpMutableContactList, tp_mutable_contact_list,
 G_DEFINE_INTERFACE (TpBlockableContactList, tp_blockable_contact_list,
     TP_TYPE_BASE_CONTACT_LIST)
 
+/**
+ * TP_TYPE_VERSIONED_CONTACT_LIST:
+ *
+ * Interface representing a #TpBaseContactList which can tell what has
+ * changed since an earlier version of the contact list, possibly one seen
+ * in a previous connection. This lets clients which cache the contact list
+ * avoid downloading all of it again.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpVersionedContactListInterface:
+ * @parent: the parent interface
+ * @dup_version: the implementation of
+ *  tp_base_contact_list_dup_version(); must always be implemented
+ * @dup_changes_since: the implementation of
+ *  tp_base_contact_list_dup_changes_since(); must always be implemented
+ *
+ * The interface vtable for a %TP_TYPE_VERSIONED_CONTACT_LIST.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+G_DEFINE_INTERFACE (TpVersionedContactList, tp_versioned_contact_list,
+    TP_TYPE_BASE_CONTACT_LIST)
+
 /**
  * TP_TYPE_CONTACT_GROUP_LIST:
  *
@@ -523,12 +657,17 @@ G_DEFINE_INTERFACE (TpMutableContactGroupList, tp_mutable_contact_group_list,
 enum {
     PROP_CONNECTION = 1,
     PROP_DOWNLOAD_AT_CONNECTION,
+    PROP_LAZY_GROUP_CHANNELS,
+    PROP_TIME_SLICE,
     N_PROPS
 };
 
 static void
 tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
     TpHandleSet *changed, TpHandleSet *removed, gboolean is_initial_roster);
+static void tp_base_contact_list_finish_list_received (
+    TpBaseContactList *self);
+static void tp_base_contact_list_flush_batch (TpBaseContactList *self);
 
 static void
 tp_base_contact_list_init (TpBaseContactList *self)
@@ -539,6 +678,272 @@ tp_base_contact_list_init (TpBaseContactList *self)
       g_object_unref);
   self->priv->channel_requests = g_hash_table_new (NULL, NULL);
   g_queue_init (&self->priv->blocked_contact_requests);
+  g_queue_init (&self->priv->batch_groups);
+}
+
+static void
+groups_change_free (GroupsChange *change)
+{
+  tp_handle_set_destroy (change->contacts);
+  g_strfreev (change->added);
+  g_strfreev (change->removed);
+  g_slice_free (GroupsChange, change);
+}
+
+static RosterUpdate *
+roster_update_new (TpHandleSet *changed,
+    TpHandleSet *removed,
+    gboolean is_initial_roster)
+{
+  RosterUpdate *update = g_slice_new0 (RosterUpdate);
+
+  if (changed != NULL)
+    {
+      update->changed = tp_handle_set_copy (changed);
+      tp_intset_fast_iter_init (&update->iter,
+          tp_handle_set_peek (update->changed));
+    }
+
+  if (removed != NULL)
+    update->removed = tp_handle_set_copy (removed);
+
+  update->is_initial_roster = is_initial_roster;
+
+  update->pub = tp_intset_new ();
+  update->unpub = tp_intset_new ();
+  update->unsub = tp_intset_new ();
+  update->sub = tp_intset_new ();
+  update->sub_rp = tp_intset_new ();
+  update->store = tp_intset_new ();
+
+  update->changes = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) tp_value_array_free);
+  update->change_ids = g_hash_table_new (NULL, NULL);
+
+  return update;
+}
+
+static void
+roster_update_free (RosterUpdate *update)
+{
+  if (update->idle_id != 0)
+    _tp_source_remove (update->idle_id);
+
+  tp_clear_pointer (&update->changed, tp_handle_set_destroy);
+  tp_clear_pointer (&update->removed, tp_handle_set_destroy);
+
+  tp_intset_destroy (update->pub);
+  tp_intset_destroy (update->unpub);
+  tp_intset_destroy (update->unsub);
+  tp_intset_destroy (update->sub);
+  tp_intset_destroy (update->sub_rp);
+  tp_intset_destroy (update->store);
+
+  g_hash_table_unref (update->changes);
+  g_hash_table_unref (update->change_ids);
+  g_slice_free (RosterUpdate, update);
+}
+
+static void
+cached_states_free (gpointer p)
+{
+  CachedStates *states = p;
+
+  g_free (states->publish_request);
+  g_slice_free (CachedStates, states);
+}
+
+static RosterSnapshot *
+roster_snapshot_new (TpHandleRepoIface *contact_repo,
+    guint64 version)
+{
+  RosterSnapshot *snapshot = g_slice_new0 (RosterSnapshot);
+
+  snapshot->version = version;
+  snapshot->contacts = tp_handle_set_new (contact_repo);
+  snapshot->states = g_hash_table_new_full (NULL, NULL, NULL,
+      cached_states_free);
+  return snapshot;
+}
+
+static void
+roster_snapshot_free (RosterSnapshot *snapshot)
+{
+  tp_handle_set_destroy (snapshot->contacts);
+  g_hash_table_unref (snapshot->states);
+  tp_clear_pointer (&snapshot->array, g_array_unref);
+  g_slice_free (RosterSnapshot, snapshot);
+}
+
+static void
+roster_snapshot_set (RosterSnapshot *snapshot,
+    TpHandle contact,
+    TpSubscriptionState subscribe,
+    TpSubscriptionState publish,
+    const gchar *publish_request)
+{
+  CachedStates *states = g_slice_new (CachedStates);
+
+  states->subscribe = subscribe;
+  states->publish = publish;
+  states->publish_request = tp_str_empty (publish_request) ? NULL :
+      g_strdup (publish_request);
+
+  tp_handle_set_add (snapshot->contacts, contact);
+  g_hash_table_insert (snapshot->states, GUINT_TO_POINTER (contact),
+      states);
+}
+
+/* Returns @self's snapshot if it is up to date, or NULL */
+static RosterSnapshot *
+tp_base_contact_list_get_snapshot (TpBaseContactList *self)
+{
+  RosterSnapshot *snapshot = self->priv->snapshot;
+
+  /* while a batch is open, the subclass has changed things that clients
+   * have not been told about yet */
+  if (snapshot == NULL ||
+      snapshot->version != self->priv->roster_version ||
+      self->priv->batch_depth > 0)
+    return NULL;
+
+  return snapshot;
+}
+
+/* Returns @self's snapshot, making a new one if necessary; or NULL if the
+ * contact list is in the middle of changing */
+static RosterSnapshot *
+tp_base_contact_list_ensure_snapshot (TpBaseContactList *self)
+{
+  RosterSnapshot *snapshot = tp_base_contact_list_get_snapshot (self);
+  TpHandleSet *contacts;
+  TpIntsetFastIter iter;
+  TpHandle contact;
+
+  if (snapshot != NULL || self->priv->batch_depth > 0)
+    return snapshot;
+
+  tp_clear_pointer (&self->priv->snapshot, roster_snapshot_free);
+  snapshot = roster_snapshot_new (self->priv->contact_repo,
+      self->priv->roster_version);
+  contacts = tp_base_contact_list_dup_contacts (self);
+  tp_intset_fast_iter_init (&iter, tp_handle_set_peek (contacts));
+
+  while (tp_intset_fast_iter_next (&iter, &contact))
+    {
+      TpSubscriptionState subscribe = TP_SUBSCRIPTION_STATE_NO;
+      TpSubscriptionState publish = TP_SUBSCRIPTION_STATE_NO;
+      gchar *publish_request = NULL;
+
+      tp_base_contact_list_dup_states (self, contact,
+          &subscribe, &publish, &publish_request);
+      roster_snapshot_set (snapshot, contact, subscribe, publish,
+          publish_request);
+      g_free (publish_request);
+    }
+
+  tp_handle_set_destroy (contacts);
+  self->priv->snapshot = snapshot;
+  return snapshot;
+}
+
+/* Returns: (transfer full): the contacts in @snapshot as an array, in
+ * ascending order */
+static GArray *
+roster_snapshot_dup_array (RosterSnapshot *snapshot)
+{
+  if (snapshot->array == NULL)
+    snapshot->array = tp_handle_set_to_array (snapshot->contacts);
+
+  return g_array_ref (snapshot->array);
+}
+
+/* Bring the snapshot, if any, up to date with @update, which has just been
+ * signalled */
+static void
+tp_base_contact_list_patch_snapshot (TpBaseContactList *self,
+    RosterUpdate *update)
+{
+  RosterSnapshot *snapshot = self->priv->snapshot;
+  GHashTableIter iter;
+  gpointer k, v;
+
+  if (update->is_initial_roster)
+    {
+      /* everyone is in update->changes, so start again from there */
+      tp_clear_pointer (&self->priv->snapshot, roster_snapshot_free);
+      snapshot = roster_snapshot_new (self->priv->contact_repo,
+          update->base_version);
+      self->priv->snapshot = snapshot;
+    }
+  else if (snapshot == NULL || snapshot->version != update->base_version)
+    {
+      /* it was already out of date; it'll be rebuilt when next needed */
+      tp_clear_pointer (&self->priv->snapshot, roster_snapshot_free);
+      return;
+    }
+
+  if (update->removed != NULL)
+    {
+      TpIntsetFastIter it;
+      TpHandle contact;
+
+      tp_intset_fast_iter_init (&it, tp_handle_set_peek (update->removed));
+
+      while (tp_intset_fast_iter_next (&it, &contact))
+        {
+          tp_handle_set_remove (snapshot->contacts, contact);
+          g_hash_table_remove (snapshot->states, GUINT_TO_POINTER (contact));
+        }
+    }
+
+  /* the states have already been looked up, to signal them */
+  g_hash_table_iter_init (&iter, update->changes);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      guint subscribe, publish;
+      const gchar *publish_request;
+
+      tp_value_array_unpack (v, 3, &subscribe, &publish, &publish_request);
+      roster_snapshot_set (snapshot, GPOINTER_TO_UINT (k), subscribe,
+          publish, publish_request);
+    }
+
+  tp_clear_pointer (&snapshot->array, g_array_unref);
+  snapshot->version = update->base_version + 1;
+}
+
+/* The state as seen by D-Bus clients. While the initial roster is still
+ * being worked through in a series of time slices, the contact list has
+ * been received as far as the subclass is concerned, but clients are not
+ * told so until the initial ContactsChanged has been emitted. */
+static TpContactListState
+tp_base_contact_list_get_dbus_state (TpBaseContactList *self,
+    GError **error)
+{
+  if (self->priv->roster_update != NULL &&
+      self->priv->roster_update->is_initial_roster)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_NOT_YET,
+          "Contact list not downloaded yet");
+      return TP_CONTACT_LIST_STATE_WAITING;
+    }
+
+  return tp_base_contact_list_get_state (self, error);
+}
+
+static void
+tp_base_contact_list_discard_batch (TpBaseContactList *self)
+{
+  GroupsChange *change;
+
+  tp_clear_pointer (&self->priv->batch_changed, tp_handle_set_destroy);
+  tp_clear_pointer (&self->priv->batch_removed, tp_handle_set_destroy);
+  tp_clear_pointer (&self->priv->batch_blocking, tp_handle_set_destroy);
+
+  while ((change = g_queue_pop_head (&self->priv->batch_groups)) != NULL)
+    groups_change_free (change);
 }
 
 static void
@@ -601,10 +1006,23 @@ tp_base_contact_list_free_contents (TpBaseContactList *self)
       "Unable to complete channel request due to disconnection");
   tp_base_contact_list_fail_blocked_contact_requests (self, &error);
 
+  /* nobody is listening for changes any more */
+  if (self->priv->roster_update != NULL)
+    {
+      tp_clear_pointer (&self->priv->roster_update, roster_update_free);
+      self->priv->batch_depth--;
+    }
+
+  tp_base_contact_list_discard_batch (self);
+  tp_clear_pointer (&self->priv->snapshot, roster_snapshot_free);
+  tp_clear_pointer (&self->priv->blocked_contact_ids, g_hash_table_unref);
+
   for (i = 0; i < TP_NUM_LIST_HANDLES; i++)
     tp_clear_object (self->priv->lists + i);
 
   tp_clear_pointer (&self->priv->groups, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->known_groups, tp_handle_set_destroy);
+  tp_clear_pointer (&self->priv->contact_groups, g_hash_table_unref);
   tp_clear_object (&self->priv->contact_repo);
 
   if (self->priv->group_repo != NULL)
@@ -668,6 +1086,14 @@ tp_base_contact_list_get_property (GObject *object,
       g_value_set_boolean (value, self->priv->download_at_connection);
       break;
 
+    case PROP_LAZY_GROUP_CHANNELS:
+      g_value_set_boolean (value, self->priv->lazy_group_channels);
+      break;
+
+    case PROP_TIME_SLICE:
+      g_value_set_uint (value, self->priv->time_slice);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -693,6 +1119,14 @@ tp_base_contact_list_set_property (GObject *object,
       self->priv->download_at_connection = g_value_get_boolean (value);
       break;
 
+    case PROP_LAZY_GROUP_CHANNELS:
+      self->priv->lazy_group_channels = g_value_get_boolean (value);
+      break;
+
+    case PROP_TIME_SLICE:
+      self->priv->time_slice = g_value_get_uint (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -836,6 +1270,12 @@ tp_base_contact_list_constructed (GObject *object)
 
       _tp_base_connection_set_handle_repo (self->priv->conn,
           TP_HANDLE_TYPE_GROUP, self->priv->group_repo);
+
+      if (self->priv->lazy_group_channels)
+        self->priv->known_groups = tp_handle_set_new (self->priv->group_repo);
+
+      self->priv->contact_groups = g_hash_table_new_full (NULL, NULL, NULL,
+          (GDestroyNotify) tp_handle_set_destroy);
     }
 
   if (TP_IS_MUTABLE_CONTACT_GROUP_LIST (self))
@@ -913,6 +1353,12 @@ tp_blockable_contact_list_default_init (TpBlockableContactListInterface *iface)
   /* there's no default for the other virtual methods */
 }
 
+static void
+tp_versioned_contact_list_default_init (TpVersionedContactListInterface *iface)
+{
+  /* there's no default for any of the virtual methods */
+}
+
 static void
 tp_contact_group_list_default_init (TpContactGroupListInterface *iface)
 {
@@ -987,6 +1433,58 @@ tp_base_contact_list_class_init (TpBaseContactListClass *cls)
         "Whether the roster should be automatically downloaded at connection",
         TRUE,
         G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TpBaseContactList:lazy-group-channels:
+   *
+   * If %TRUE, the legacy ContactList channels representing groups are not
+   * created when the groups are, but only when a client requests one with
+   * EnsureChannel. Clients using the ContactGroups connection interface never
+   * do that, so connections with many groups can avoid exporting an object
+   * per group.
+   *
+   * This defaults to %FALSE, because older clients expect to be told about
+   * every group channel with NewChannels.
+   *
+   * Since: 0.UNRELEASED
+   */
+  g_object_class_install_property (object_class, PROP_LAZY_GROUP_CHANNELS,
+      g_param_spec_boolean ("lazy-group-channels", "Lazy group channels",
+        "Whether group channels are only created when requested",
+        FALSE,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * TpBaseContactList:time-slice:
+   *
+   * The longest time, in milliseconds, to spend working through a change
+   * to the contact list before returning to the main loop, or 0 to do all
+   * the work at once.
+   *
+   * Working out the new state of every contact in a large roster, as
+   * tp_base_contact_list_set_list_received() and
+   * tp_base_contact_list_contacts_changed() do, can take long enough that
+   * the connection manager stops responding to D-Bus calls meanwhile. If
+   * this property is non-zero, a large change is instead worked through a
+   * few contacts at a time in idle callbacks. Clients still see a single
+   * ContactsChanged signal: until it has been emitted, the contact list
+   * is still %TP_CONTACT_LIST_STATE_WAITING from their point of view, and
+   * further changes made by the subclass are batched as if by
+   * tp_base_contact_list_begin_batch().
+   *
+   * While a change is being worked through, #TpBaseContactListDupStatesFunc
+   * may be called for contacts some time after the change was reported, so
+   * it must reflect the contacts' current states, not necessarily their
+   * states at the time of the change.
+   *
+   * Since: 0.UNRELEASED
+   */
+  g_object_class_install_property (object_class, PROP_TIME_SLICE,
+      g_param_spec_uint ("time-slice", "Time slice",
+        "Longest time in milliseconds to spend on a change to the contact "
+        "list without returning to the main loop, or 0 for no limit",
+        0, G_MAXUINT, 0,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -1037,11 +1535,16 @@ tp_base_contact_list_type_foreach_channel_class (GType type,
     TpChannelManagerTypeChannelClassFunc func,
     gpointer user_data)
 {
-  GHashTable *table = tp_asv_new (
-      TP_PROP_CHANNEL_CHANNEL_TYPE,
-          G_TYPE_STRING, TP_IFACE_CHANNEL_TYPE_CONTACT_LIST,
-      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT, TP_HANDLE_TYPE_LIST,
-      NULL);
+  _TpAsvBuilder builder;
+  GHashTable *table;
+
+  _tp_asv_builder_init (&builder);
+  g_value_set_static_string (_tp_asv_builder_add (&builder,
+        TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING),
+      TP_IFACE_CHANNEL_TYPE_CONTACT_LIST);
+  _tp_asv_builder_add_uint32 (&builder, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE,
+      TP_HANDLE_TYPE_LIST);
+  table = _tp_asv_builder_end (&builder);
 
   func (type, table, allowed_properties, user_data);
 
@@ -1123,6 +1626,59 @@ tp_base_contact_list_new_channel (TpBaseContactList *self,
   return chan;
 }
 
+/* Return TRUE if the group @handle exists, whether or not it has a channel
+ * in lazy-group-channels mode */
+static gboolean
+tp_base_contact_list_has_group (TpBaseContactList *self,
+    TpHandle handle)
+{
+  if (self->priv->known_groups != NULL)
+    return tp_handle_set_is_member (self->priv->known_groups, handle);
+
+  return (g_hash_table_lookup (self->priv->groups,
+        GUINT_TO_POINTER (handle)) != NULL);
+}
+
+/* Record that @contacts have been added to, or removed from, @group in
+ * the contact_groups index */
+static void
+tp_base_contact_list_index_group_members (TpBaseContactList *self,
+    const TpIntset *contacts,
+    TpHandle group,
+    gboolean add)
+{
+  TpIntsetFastIter iter;
+  TpHandle contact;
+
+  tp_intset_fast_iter_init (&iter, contacts);
+
+  while (tp_intset_fast_iter_next (&iter, &contact))
+    {
+      TpHandleSet *groups = g_hash_table_lookup (self->priv->contact_groups,
+          GUINT_TO_POINTER (contact));
+
+      if (add)
+        {
+          if (groups == NULL)
+            {
+              groups = tp_handle_set_new (self->priv->group_repo);
+              g_hash_table_insert (self->priv->contact_groups,
+                  GUINT_TO_POINTER (contact), groups);
+            }
+
+          tp_handle_set_add (groups, group);
+        }
+      else if (groups != NULL)
+        {
+          tp_handle_set_remove (groups, group);
+
+          if (tp_handle_set_is_empty (groups))
+            g_hash_table_remove (self->priv->contact_groups,
+                GUINT_TO_POINTER (contact));
+        }
+    }
+}
+
 static void
 tp_base_contact_list_announce_channel (TpBaseContactList *self,
     gpointer channel,
@@ -1266,6 +1822,23 @@ tp_base_contact_list_request_helper (TpChannelManager *manager,
           tp_base_contact_list_new_channel (self, handle_type, handle,
               request_token);
         }
+      else if (self->priv->known_groups != NULL &&
+          tp_handle_set_is_member (self->priv->known_groups, handle))
+        {
+          /* the group exists, but in lazy-group-channels mode its channel
+           * isn't created until somebody asks for it */
+          gpointer channel = tp_base_contact_list_new_channel (self,
+              handle_type, handle, request_token);
+          TpHandleSet *members = tp_base_contact_list_dup_group_members (
+              self, tp_handle_inspect (self->priv->group_repo, handle));
+
+          tp_group_mixin_change_members (channel, "",
+              tp_handle_set_peek (members), NULL, NULL, NULL, 0,
+              TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+          tp_handle_set_destroy (members);
+
+          tp_base_contact_list_announce_channel (self, channel, NULL);
+        }
       else
         {
           if (TP_IS_MUTABLE_CONTACT_GROUP_LIST (self))
@@ -1900,13 +2473,17 @@ tp_base_contact_list_set_list_failed (TpBaseContactList *self,
  * If implemented, tp_base_contact_list_dup_blocked_contacts() must also
  * give correct results when entering this method.
  *
+ * If #TpBaseContactList:time-slice is non-zero, the initial contact list
+ * might be signalled to clients after this method returns; it counts as
+ * having been received as soon as this method is called, as far as the
+ * subclass is concerned.
+ *
  * Since: 0.13.0
  */
 void
 tp_base_contact_list_set_list_received (TpBaseContactList *self)
 {
   TpHandleSet *contacts;
-  guint i;
 
   g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
   g_return_if_fail (self->priv->state != TP_CONTACT_LIST_STATE_SUCCESS);
@@ -1953,7 +2530,36 @@ tp_base_contact_list_set_list_received (TpBaseContactList *self)
       g_free (tmp);
     }
 
+  /* the rest of the work is done by
+   * tp_base_contact_list_finish_list_received(), once the initial
+   * ContactsChanged has been emitted */
   tp_base_contact_list_contacts_changed_internal (self, contacts, NULL, TRUE);
+  tp_handle_set_destroy (contacts);
+}
+
+/* Return a new reference to the map from each blocked contact to its
+ * identifier, which is only rebuilt when blocking changes, so that every
+ * client calling RequestBlockedContacts after connecting doesn't cost a
+ * map of the whole deny list */
+static GHashTable *
+tp_base_contact_list_dup_blocked_contact_ids (TpBaseContactList *self)
+{
+  if (self->priv->blocked_contact_ids == NULL)
+    {
+      TpHandleSet *blocked = tp_base_contact_list_dup_blocked_contacts (self);
+
+      self->priv->blocked_contact_ids =
+        tp_handle_set_to_identifier_map (blocked);
+      tp_handle_set_destroy (blocked);
+    }
+
+  return g_hash_table_ref (self->priv->blocked_contact_ids);
+}
+
+static void
+tp_base_contact_list_finish_list_received (TpBaseContactList *self)
+{
+  guint i;
 
   if (tp_base_contact_list_can_block (self))
     {
@@ -1969,7 +2575,7 @@ tp_base_contact_list_set_list_received (TpBaseContactList *self)
 
       if (DEBUGGING)
         {
-          gchar *tmp = tp_intset_dump (tp_handle_set_peek (contacts));
+          gchar *tmp = tp_intset_dump (tp_handle_set_peek (blocked));
 
           DEBUG ("Initially blocked contacts: %s", tmp);
           g_free (tmp);
@@ -1980,7 +2586,8 @@ tp_base_contact_list_set_list_received (TpBaseContactList *self)
       if (self->priv->svc_contact_blocking &&
           self->priv->blocked_contact_requests.length > 0)
         {
-          GHashTable *map = tp_handle_set_to_identifier_map (blocked);
+          GHashTable *map = tp_base_contact_list_dup_blocked_contact_ids (
+              self);
           DBusGMethodInvocation *context;
 
           while ((context = g_queue_pop_head (
@@ -2025,8 +2632,6 @@ tp_base_contact_list_set_list_received (TpBaseContactList *self)
       g_strfreev (groups);
     }
 
-  tp_handle_set_destroy (contacts);
-
   /* emit this last, so people can distinguish between the initial state
    * and subsequent changes */
   tp_svc_connection_interface_contact_list_emit_contact_list_state_changed (
@@ -2080,68 +2685,170 @@ tp_base_contact_list_contacts_changed (TpBaseContactList *self,
     TpHandleSet *changed,
     TpHandleSet *removed)
 {
+  g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
+
+  if (self->priv->batch_depth > 0 &&
+      tp_base_contact_list_get_state (self, NULL) ==
+        TP_CONTACT_LIST_STATE_SUCCESS)
+    {
+      TpHandleSet **batch_changed = &self->priv->batch_changed;
+      TpHandleSet **batch_removed = &self->priv->batch_removed;
+
+      if (*batch_changed == NULL)
+        *batch_changed = tp_handle_set_new (self->priv->contact_repo);
+
+      if (*batch_removed == NULL)
+        *batch_removed = tp_handle_set_new (self->priv->contact_repo);
+
+      /* whatever happened to a contact most recently wins */
+      if (changed != NULL)
+        {
+          tp_intset_union_update (tp_handle_set_peek (*batch_changed),
+              tp_handle_set_peek (changed));
+          tp_intset_difference_update (tp_handle_set_peek (*batch_removed),
+              tp_handle_set_peek (changed));
+        }
+
+      if (removed != NULL)
+        {
+          tp_intset_union_update (tp_handle_set_peek (*batch_removed),
+              tp_handle_set_peek (removed));
+          tp_intset_difference_update (tp_handle_set_peek (*batch_changed),
+              tp_handle_set_peek (removed));
+        }
+
+      return;
+    }
+
   tp_base_contact_list_contacts_changed_internal (self, changed, removed,
       FALSE);
 }
 
-static void
-tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
-    TpHandleSet *changed,
-    TpHandleSet *removed,
-    gboolean is_initial_roster)
+/**
+ * tp_base_contact_list_begin_batch:
+ * @self: the contact list manager
+ *
+ * Start collecting changes to the contact list, rather than signalling each
+ * one as it happens. This is useful for protocols where a change to the
+ * roster arrives as many small messages, each of which would otherwise
+ * result in its own ContactsChanged signal.
+ *
+ * Until the matching call to tp_base_contact_list_end_batch(), calls to
+ * tp_base_contact_list_contacts_changed(),
+ * tp_base_contact_list_contact_blocking_changed(),
+ * tp_base_contact_list_groups_changed() and their convenience wrappers
+ * only record which contacts were affected. If a contact is changed and
+ * later removed during the batch (or vice versa), only the later change
+ * is signalled.
+ *
+ * Calls to this function may be nested; signals are emitted when the
+ * outermost batch ends.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_contact_list_begin_batch (TpBaseContactList *self)
 {
-  GHashTable *changes;
-  GHashTable *change_ids;
-  GArray *removals;
-  GHashTable *removal_ids;
-  TpIntsetFastIter iter;
-  TpIntset *pub, *sub, *sub_rp, *unpub, *unsub, *store;
-  GObject *sub_chan, *pub_chan, *stored_chan;
-  TpHandle self_handle;
-  TpHandle contact;
+  g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
 
+  self->priv->batch_depth++;
+}
+
+/**
+ * tp_base_contact_list_end_batch:
+ * @self: the contact list manager
+ *
+ * End a batch of changes started by tp_base_contact_list_begin_batch().
+ * If this is the outermost batch, emit a single set of signals describing
+ * every change made during the batch.
+ *
+ * The contacts' states are read back from the subclass at this point, so
+ * #TpBaseContactListDupStatesFunc and similar functions must reflect the
+ * final state of every contact involved.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_base_contact_list_end_batch (TpBaseContactList *self)
+{
   g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
+  g_return_if_fail (self->priv->batch_depth > 0);
 
-  /* don't do anything if we're disconnecting, or if we haven't had the
-   * initial contact list yet */
-  if (tp_base_contact_list_get_state (self, NULL) !=
-      TP_CONTACT_LIST_STATE_SUCCESS)
+  if (--self->priv->batch_depth > 0)
     return;
 
-  self_handle = tp_base_connection_get_self_handle (self->priv->conn),
+  tp_base_contact_list_flush_batch (self);
+}
 
-  sub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_SUBSCRIBE];
-  pub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_PUBLISH];
-  stored_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_STORED];
+static void
+tp_base_contact_list_flush_batch (TpBaseContactList *self)
+{
+  TpHandleSet *changed, *removed, *blocking;
+  GQueue groups = self->priv->batch_groups;
+  GroupsChange *change;
+
+  /* if there is a time slice, signalling the changed contacts might start
+   * a new batch, which must not replay our group changes again */
+  g_queue_init (&self->priv->batch_groups);
+
+  changed = self->priv->batch_changed;
+  removed = self->priv->batch_removed;
+  blocking = self->priv->batch_blocking;
+  self->priv->batch_changed = NULL;
+  self->priv->batch_removed = NULL;
+  self->priv->batch_blocking = NULL;
+
+  if (changed != NULL || removed != NULL)
+    tp_base_contact_list_contacts_changed_internal (self, changed, removed,
+        FALSE);
+
+  if (blocking != NULL)
+    tp_base_contact_list_contact_blocking_changed (self, blocking);
+
+  /* groups are replayed in order, since adding a contact to a group and
+   * then removing it again is not the same as doing so the other way
+   * round */
+  while ((change = g_queue_pop_head (&groups)) != NULL)
+    {
+      tp_base_contact_list_groups_changed (self, change->contacts,
+          (const gchar * const *) change->added,
+          g_strv_length (change->added),
+          (const gchar * const *) change->removed,
+          g_strv_length (change->removed));
+      groups_change_free (change);
+    }
 
-  g_return_if_fail (G_IS_OBJECT (sub_chan));
-  g_return_if_fail (G_IS_OBJECT (pub_chan));
-  /* stored_chan can legitimately be NULL, though */
-
-  /* For some changes, we emit signals one by one, because the actor is
-   * different every time. However, for these sets of changes, we do them all
-   * at once, since they'll share an actor. */
-  pub = tp_intset_new ();
-  unpub = tp_intset_new ();
-  unsub = tp_intset_new ();
-  sub = tp_intset_new ();
-  sub_rp = tp_intset_new ();
-  store = tp_intset_new ();
-
-  changes = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) tp_value_array_free);
-  change_ids = g_hash_table_new (NULL, NULL);
+  tp_clear_pointer (&changed, tp_handle_set_destroy);
+  tp_clear_pointer (&removed, tp_handle_set_destroy);
+  tp_clear_pointer (&blocking, tp_handle_set_destroy);
+}
 
-  if (changed != NULL)
-    tp_intset_fast_iter_init (&iter, tp_handle_set_peek (changed));
+/* Work out the new states of contacts in @update->changed, stopping when
+ * they have all been done (returning TRUE) or when the monotonic time
+ * @deadline has passed (returning FALSE). If @deadline is 0, carry on
+ * until they have all been done. */
+static gboolean
+tp_base_contact_list_roster_update_step (TpBaseContactList *self,
+    RosterUpdate *update,
+    gint64 deadline)
+{
+  GObject *sub_chan, *pub_chan;
+  TpHandle contact;
+  guint n = 0;
+
+  if (update->changed == NULL)
+    return TRUE;
+
+  sub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_SUBSCRIBE];
+  pub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_PUBLISH];
 
-  while (changed != NULL && tp_intset_fast_iter_next (&iter, &contact))
+  while (tp_intset_fast_iter_next (&update->iter, &contact))
     {
       TpSubscriptionState subscribe = TP_SUBSCRIPTION_STATE_NO;
       TpSubscriptionState publish = TP_SUBSCRIPTION_STATE_NO;
       gchar *publish_request = NULL;
 
-      tp_intset_add (store, contact);
+      tp_intset_add (update->store, contact);
 
       tp_base_contact_list_dup_states (self, contact,
           &subscribe, &publish, &publish_request);
@@ -2159,7 +2866,7 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
         {
         case TP_SUBSCRIPTION_STATE_NO:
         case TP_SUBSCRIPTION_STATE_UNKNOWN:
-          tp_intset_add (unpub, contact);
+          tp_intset_add (update->unpub, contact);
           break;
 
         case TP_SUBSCRIPTION_STATE_ASK:
@@ -2190,7 +2897,7 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
           break;
 
         case TP_SUBSCRIPTION_STATE_YES:
-          tp_intset_add (pub, contact);
+          tp_intset_add (update->pub, contact);
           break;
 
         default:
@@ -2201,7 +2908,7 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
         {
         case TP_SUBSCRIPTION_STATE_NO:
         case TP_SUBSCRIPTION_STATE_UNKNOWN:
-          tp_intset_add (unsub, contact);
+          tp_intset_add (update->unsub, contact);
           break;
 
         case TP_SUBSCRIPTION_STATE_REMOVED_REMOTELY:
@@ -2218,13 +2925,13 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
           break;
 
         case TP_SUBSCRIPTION_STATE_ASK:
-          tp_intset_add (sub_rp, contact);
+          tp_intset_add (update->sub_rp, contact);
           break;
 
         case TP_SUBSCRIPTION_STATE_YES:
-          if (is_initial_roster)
+          if (update->is_initial_roster)
             {
-              tp_intset_add (sub, contact);
+              tp_intset_add (update->sub, contact);
             }
           else
             {
@@ -2244,7 +2951,7 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
           g_assert_not_reached ();
         }
 
-      g_hash_table_insert (changes, GUINT_TO_POINTER (contact),
+      g_hash_table_insert (update->changes, GUINT_TO_POINTER (contact),
           tp_value_array_build (3,
             G_TYPE_UINT, subscribe,
             G_TYPE_UINT, publish,
@@ -2252,25 +2959,58 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
             G_TYPE_INVALID));
       g_free (publish_request);
 
-      g_hash_table_insert (change_ids, GUINT_TO_POINTER (contact),
+      g_hash_table_insert (update->change_ids, GUINT_TO_POINTER (contact),
           (gchar *) tp_handle_inspect (self->priv->contact_repo, contact));
+
+      /* reading the clock after every contact would cost more than it
+       * saves */
+      if (deadline != 0 && (++n % 64) == 0 &&
+          g_get_monotonic_time () >= deadline)
+        return FALSE;
     }
 
+  return TRUE;
+}
+
+/* Emit the signals for @update, once every changed contact has been
+ * looked at */
+static void
+tp_base_contact_list_roster_update_finish (TpBaseContactList *self,
+    RosterUpdate *update)
+{
+  GArray *removals;
+  GHashTable *removal_ids;
+  GObject *sub_chan, *pub_chan, *stored_chan;
+  TpHandle self_handle;
+
+  self_handle = tp_base_connection_get_self_handle (self->priv->conn);
+
+  sub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_SUBSCRIBE];
+  pub_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_PUBLISH];
+  stored_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_STORED];
+
   removal_ids = g_hash_table_new (NULL, NULL);
 
-  if (removed != NULL)
+  if (update->removed != NULL)
     {
       guint i;
 
-      tp_intset_union_update (unsub, tp_handle_set_peek (removed));
-      tp_intset_union_update (unpub, tp_handle_set_peek (removed));
+      tp_intset_union_update (update->unsub,
+          tp_handle_set_peek (update->removed));
+      tp_intset_union_update (update->unpub,
+          tp_handle_set_peek (update->removed));
 
-      removals = tp_handle_set_to_array (removed);
+      removals = tp_handle_set_to_array (update->removed);
 
       for (i = 0; i < removals->len; i++)
         {
           TpHandle handle = g_array_index (removals, guint, i);
 
+          /* contacts who aren't on the list aren't in any groups either */
+          if (self->priv->contact_groups != NULL)
+            g_hash_table_remove (self->priv->contact_groups,
+                GUINT_TO_POINTER (handle));
+
           g_hash_table_insert (removal_ids, GUINT_TO_POINTER (handle),
               (gchar *) tp_handle_inspect (self->priv->contact_repo, handle));
         }
@@ -2284,65 +3024,153 @@ tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
    * whether it was our idea, or caused by an unknown contact or by server
    * failure, since those are all represented as No. */
   tp_group_mixin_change_members (sub_chan, "",
-      NULL, unsub, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+      NULL, update->unsub, NULL, NULL, 0,
+      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
   tp_group_mixin_change_members (pub_chan, "",
-      NULL, unpub, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+      NULL, update->unpub, NULL, NULL, 0,
+      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
 
   /* pub is the set of contacts changing to publish=Yes (i.e. contacts we'll
    * allow to see our presence), which was presumably our idea. */
   tp_group_mixin_change_members (pub_chan, "",
-      pub, NULL, NULL, NULL, self_handle, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+      update->pub, NULL, NULL, NULL, self_handle,
+      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+
+  /* sub is the set of contacts with subscribe=Yes while retrieving the
+   * initial roster. We don't know if the contacts were already in the roster
+   * or if they were added while we were offline, so the actor is 0.
+   * Having all the initial contacts grouped together means we emit a single
+   * MembersChanged and one MembersChangedDetailed for the whole roster. */
+  tp_group_mixin_change_members (sub_chan, "", update->sub, NULL, NULL, NULL,
+      0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+
+  /* sub_rp is the set of contacts changing to subscribe=Ask, which was
+   * presumably our idea. */
+  tp_group_mixin_change_members (sub_chan, "", NULL, NULL, NULL,
+      update->sub_rp, self_handle, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+
+  /* We use actor 0 for the stored list, since people can land on the stored
+   * list for a variety of reasons (if someone has requested we publish to
+   * them, they're temporarily claimed to be stored). */
+  if (stored_chan != NULL)
+    {
+      tp_group_mixin_change_members (stored_chan, "",
+          update->store,
+          update->removed == NULL ? NULL :
+              tp_handle_set_peek (update->removed),
+          NULL, NULL,
+          0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+    }
+
+  if (g_hash_table_size (update->changes) > 0 || removals->len > 0)
+    {
+      DEBUG ("ContactsChanged([%u changed], [%u removed])",
+          g_hash_table_size (update->changes), removals->len);
+
+      if (self->priv->svc_contact_list)
+        {
+          _tp_presence_mixin_flush_pending ((GObject *) self->priv->conn);
+          tp_svc_connection_interface_contact_list_emit_contacts_changed_with_id (
+              self->priv->conn, update->changes, update->change_ids,
+              removal_ids);
+          tp_svc_connection_interface_contact_list_emit_contacts_changed (
+              self->priv->conn, update->changes, removals);
+        }
+    }
+
+  g_hash_table_unref (removal_ids);
+  g_array_unref (removals);
+
+  tp_base_contact_list_patch_snapshot (self, update);
+
+  if (update->is_initial_roster)
+    tp_base_contact_list_finish_list_received (self);
+}
+
+static gint64
+tp_base_contact_list_get_deadline (TpBaseContactList *self)
+{
+  if (self->priv->time_slice == 0)
+    return 0;
+
+  return g_get_monotonic_time () +
+      self->priv->time_slice * G_TIME_SPAN_MILLISECOND;
+}
+
+static gboolean
+tp_base_contact_list_roster_update_cb (gpointer data)
+{
+  TpBaseContactList *self = data;
+  RosterUpdate *update = self->priv->roster_update;
+
+  if (!tp_base_contact_list_roster_update_step (self, update,
+        tp_base_contact_list_get_deadline (self)))
+    return TRUE;
+
+  /* returning FALSE removes the source */
+  update->idle_id = 0;
+  self->priv->roster_update = NULL;
+
+  /* let go of our batch before signalling, so that anything
+   * tp_base_contact_list_finish_list_received() signals comes before
+   * ContactListStateChanged, just as it would have done without a time
+   * slice */
+  self->priv->batch_depth--;
+
+  tp_base_contact_list_roster_update_finish (self, update);
+  roster_update_free (update);
+
+  /* now signal whatever else happened to the contact list meanwhile,
+   * unless the subclass has a batch of its own open */
+  if (self->priv->batch_depth == 0)
+    tp_base_contact_list_flush_batch (self);
+
+  return FALSE;
+}
+
+static void
+tp_base_contact_list_contacts_changed_internal (TpBaseContactList *self,
+    TpHandleSet *changed,
+    TpHandleSet *removed,
+    gboolean is_initial_roster)
+{
+  RosterUpdate *update;
+
+  g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
+
+  /* don't do anything if we're disconnecting, or if we haven't had the
+   * initial contact list yet */
+  if (tp_base_contact_list_get_state (self, NULL) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
+    return;
 
-  /* sub is the set of contacts with subscribe=Yes while retrieving the
-   * initial roster. We don't know if the contacts were already in the roster
-   * or if they were added while we were offline, so the actor is 0.
-   * Having all the initial contacts grouped together means we emit a single
-   * MembersChanged and one MembersChangedDetailed for the whole roster. */
-  tp_group_mixin_change_members (sub_chan, "", sub, NULL, NULL, NULL, 0,
-      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  g_return_if_fail (G_IS_OBJECT (self->priv->lists[TP_LIST_HANDLE_SUBSCRIBE]));
+  g_return_if_fail (G_IS_OBJECT (self->priv->lists[TP_LIST_HANDLE_PUBLISH]));
+  /* the stored channel can legitimately be NULL, though */
 
-  /* sub_rp is the set of contacts changing to subscribe=Ask, which was
-   * presumably our idea. */
-  tp_group_mixin_change_members (sub_chan, "", NULL, NULL, NULL, sub_rp,
-      self_handle, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  /* while an update is in progress, its batch catches all other changes */
+  g_return_if_fail (self->priv->roster_update == NULL);
 
-  /* We use actor 0 for the stored list, since people can land on the stored
-   * list for a variety of reasons (if someone has requested we publish to
-   * them, they're temporarily claimed to be stored). */
-  if (stored_chan != NULL)
-    {
-      tp_group_mixin_change_members (stored_chan, "",
-          store,
-          removed == NULL ? NULL : tp_handle_set_peek (removed),
-          NULL, NULL,
-          0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
-    }
+  update = roster_update_new (changed, removed, is_initial_roster);
+  update->base_version = self->priv->roster_version++;
 
-  if (g_hash_table_size (changes) > 0 || removals->len > 0)
+  if (!tp_base_contact_list_roster_update_step (self, update,
+        tp_base_contact_list_get_deadline (self)))
     {
-      DEBUG ("ContactsChanged([%u changed], [%u removed])",
-          g_hash_table_size (changes), removals->len);
-
-      if (self->priv->svc_contact_list)
-        {
-          tp_svc_connection_interface_contact_list_emit_contacts_changed_with_id (
-              self->priv->conn, changes, change_ids, removal_ids);
-          tp_svc_connection_interface_contact_list_emit_contacts_changed (
-              self->priv->conn, changes, removals);
-        }
+      DEBUG ("Used up our %ums time slice; continuing later",
+          self->priv->time_slice);
+
+      /* anything else that happens to the contact list before we have
+       * finished must be signalled afterwards */
+      self->priv->batch_depth++;
+      self->priv->roster_update = update;
+      update->idle_id = _tp_idle_add (TP_LATENCY_CLASS_BULK,
+          tp_base_contact_list_roster_update_cb, self);
+      return;
     }
 
-  tp_intset_destroy (pub);
-  tp_intset_destroy (unpub);
-  tp_intset_destroy (unsub);
-  tp_intset_destroy (sub_rp);
-  tp_intset_destroy (sub);
-  tp_intset_destroy (store);
-
-  g_hash_table_unref (changes);
-  g_hash_table_unref (change_ids);
-  g_hash_table_unref (removal_ids);
-  g_array_unref (removals);
+  tp_base_contact_list_roster_update_finish (self, update);
+  roster_update_free (update);
 }
 
 /**
@@ -2424,14 +3252,13 @@ tp_base_contact_list_contact_blocking_changed (TpBaseContactList *self,
 {
   TpHandleSet *now_blocked;
   TpIntset *blocked, *unblocked;
-  GHashTable *blocked_contacts, *unblocked_contacts;
-  TpIntsetFastIter iter;
   GObject *deny_chan;
-  TpHandle handle;
 
   g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
   g_return_if_fail (changed != NULL);
 
+  tp_clear_pointer (&self->priv->blocked_contact_ids, g_hash_table_unref);
+
   /* don't do anything if we're disconnecting, or if we haven't had the
    * initial contact list yet */
   if (tp_base_contact_list_get_state (self, NULL) !=
@@ -2440,37 +3267,37 @@ tp_base_contact_list_contact_blocking_changed (TpBaseContactList *self,
 
   g_return_if_fail (tp_base_contact_list_can_block (self));
 
+  if (self->priv->batch_depth > 0)
+    {
+      if (self->priv->batch_blocking == NULL)
+        self->priv->batch_blocking = tp_handle_set_copy (changed);
+      else
+        tp_intset_union_update (
+            tp_handle_set_peek (self->priv->batch_blocking),
+            tp_handle_set_peek (changed));
+
+      return;
+    }
+
   deny_chan = (GObject *) self->priv->lists[TP_LIST_HANDLE_DENY];
   g_return_if_fail (G_IS_OBJECT (deny_chan));
 
   now_blocked = tp_base_contact_list_dup_blocked_contacts (self);
 
-  blocked = tp_intset_new ();
-  unblocked = tp_intset_new ();
-  blocked_contacts = g_hash_table_new (NULL, NULL);
-  unblocked_contacts = g_hash_table_new (NULL, NULL);
-
-  tp_intset_fast_iter_init (&iter, tp_handle_set_peek (changed));
+  /* whole chunks at a time, rather than a membership test per contact */
+  blocked = tp_intset_intersection (tp_handle_set_peek (changed),
+      tp_handle_set_peek (now_blocked));
+  unblocked = tp_intset_difference (tp_handle_set_peek (changed),
+      tp_handle_set_peek (now_blocked));
 
-  while (tp_intset_fast_iter_next (&iter, &handle))
+  if (DEBUGGING)
     {
-      const char *id = tp_handle_inspect (self->priv->contact_repo, handle);
-
-      if (tp_handle_set_is_member (now_blocked, handle))
-        {
-          tp_intset_add (blocked, handle);
-          g_hash_table_insert (blocked_contacts, GUINT_TO_POINTER (handle),
-              (gpointer) id);
-        }
-      else
-        {
-          tp_intset_add (unblocked, handle);
-          g_hash_table_insert (unblocked_contacts, GUINT_TO_POINTER (handle),
-              (gpointer) id);
-        }
+      gchar *b = tp_intset_dump (blocked);
+      gchar *u = tp_intset_dump (unblocked);
 
-      DEBUG ("Contact %s: blocked=%c", id,
-          tp_handle_set_is_member (now_blocked, handle) ? 'Y' : 'N');
+      DEBUG ("Contacts blocked: %s; unblocked: %s", b, u);
+      g_free (b);
+      g_free (u);
     }
 
   tp_group_mixin_change_members (deny_chan, "",
@@ -2479,15 +3306,25 @@ tp_base_contact_list_contact_blocking_changed (TpBaseContactList *self,
       TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
 
   if (self->priv->svc_contact_blocking &&
-      (g_hash_table_size (blocked_contacts) > 0 ||
-       g_hash_table_size (unblocked_contacts) > 0))
-    tp_svc_connection_interface_contact_blocking_emit_blocked_contacts_changed (
-        self->priv->conn, blocked_contacts, unblocked_contacts);
+      (!tp_intset_is_empty (blocked) || !tp_intset_is_empty (unblocked)))
+    {
+      GHashTable *blocked_contacts = g_hash_table_new (NULL, NULL);
+      GHashTable *unblocked_contacts = g_hash_table_new (NULL, NULL);
+
+      _tp_handle_repo_add_identifiers (self->priv->contact_repo, blocked,
+          blocked_contacts);
+      _tp_handle_repo_add_identifiers (self->priv->contact_repo, unblocked,
+          unblocked_contacts);
+
+      tp_svc_connection_interface_contact_blocking_emit_blocked_contacts_changed (
+          self->priv->conn, blocked_contacts, unblocked_contacts);
+
+      g_hash_table_unref (blocked_contacts);
+      g_hash_table_unref (unblocked_contacts);
+    }
 
   tp_intset_destroy (blocked);
   tp_intset_destroy (unblocked);
-  g_hash_table_unref (blocked_contacts);
-  g_hash_table_unref (unblocked_contacts);
   tp_handle_set_destroy (now_blocked);
 }
 
@@ -3708,6 +4545,27 @@ tp_base_contact_list_groups_created (TpBaseContactList *self,
           gpointer c = g_hash_table_lookup (self->priv->groups,
               GUINT_TO_POINTER (handle));
 
+          if (self->priv->known_groups != NULL)
+            {
+              if (!tp_handle_set_is_member (self->priv->known_groups,
+                    handle))
+                {
+                  tp_handle_set_add (self->priv->known_groups, handle);
+                  g_ptr_array_add (actually_created,
+                      (gchar *) tp_handle_inspect (self->priv->group_repo,
+                        handle));
+                }
+
+              /* don't make a channel, but if someone asked for one while
+               * the group was being created, give it to them */
+              if (c != NULL &&
+                  g_hash_table_lookup_extended (self->priv->channel_requests,
+                    c, NULL, NULL))
+                tp_base_contact_list_announce_channel (self, c, NULL);
+
+              continue;
+            }
+
           if (c == NULL)
             c = tp_base_contact_list_new_channel (self, TP_HANDLE_TYPE_GROUP,
                 handle, NULL);
@@ -3807,7 +4665,7 @@ tp_base_contact_list_groups_removed (TpBaseContactList *self,
           gpointer c = g_hash_table_lookup (self->priv->groups,
               GUINT_TO_POINTER (handle));
 
-          if (c != NULL)
+          if (tp_base_contact_list_has_group (self, handle))
             {
               gchar *name;
               TpHandleSet *group_members;
@@ -3828,17 +4686,27 @@ tp_base_contact_list_groups_removed (TpBaseContactList *self,
               while (tp_intset_fast_iter_next (&iter, &contact))
                 tp_handle_set_add (old_members, contact);
 
-              /* Remove members if any: presumably the self-handle is the
-               * actor. */
-              tp_group_mixin_change_members (c, "",
-                  NULL, tp_handle_set_peek (group_members), NULL, NULL,
-                  tp_base_connection_get_self_handle (self->priv->conn),
-                  TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+              tp_base_contact_list_index_group_members (self,
+                  tp_handle_set_peek (group_members), handle, FALSE);
+
+              if (self->priv->known_groups != NULL)
+                tp_handle_set_remove (self->priv->known_groups, handle);
 
-              tp_channel_manager_emit_channel_closed_for_object (self, c);
-              _tp_base_contact_list_channel_close (c);
-              g_hash_table_remove (self->priv->groups,
-                  GUINT_TO_POINTER (handle));
+              /* in lazy-group-channels mode, there might not be a channel */
+              if (c != NULL)
+                {
+                  /* Remove members if any: presumably the self-handle is
+                   * the actor. */
+                  tp_group_mixin_change_members (c, "",
+                      NULL, tp_handle_set_peek (group_members), NULL, NULL,
+                      tp_base_connection_get_self_handle (self->priv->conn),
+                      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+
+                  tp_channel_manager_emit_channel_closed_for_object (self, c);
+                  _tp_base_contact_list_channel_close (c);
+                  g_hash_table_remove (self->priv->groups,
+                      GUINT_TO_POINTER (handle));
+                }
 
               tp_handle_set_destroy (group_members);
             }
@@ -3931,26 +4799,40 @@ tp_base_contact_list_group_renamed (TpBaseContactList *self,
   new_chan = g_hash_table_lookup (self->priv->groups,
       GUINT_TO_POINTER (new_handle));
 
-  if (new_chan == NULL)
+  /* in lazy-group-channels mode, only replace a channel that somebody
+   * requested */
+  if (new_chan == NULL &&
+      (self->priv->known_groups == NULL || old_chan != NULL))
     {
       new_chan = tp_base_contact_list_new_channel (self, TP_HANDLE_TYPE_GROUP,
           new_handle, NULL);
     }
 
-  if (g_hash_table_lookup_extended (self->priv->channel_requests, new_chan,
+  if (new_chan != NULL &&
+      g_hash_table_lookup_extended (self->priv->channel_requests, new_chan,
         NULL, NULL))
     {
       /* the channel hasn't been announced yet: do so */
       tp_base_contact_list_announce_channel (self, new_chan, NULL);
     }
 
+  if (self->priv->known_groups != NULL)
+    {
+      tp_handle_set_remove (self->priv->known_groups, old_handle);
+      tp_handle_set_add (self->priv->known_groups, new_handle);
+    }
+
   old_members = tp_base_contact_list_dup_group_members (self, old_name);
 
   /* move the members - presumably the self-handle is the actor */
   set = tp_handle_set_peek (old_members);
-  tp_group_mixin_change_members (new_chan, "", set, NULL, NULL, NULL,
-      tp_base_connection_get_self_handle (self->priv->conn),
-      TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_base_contact_list_index_group_members (self, set, old_handle, FALSE);
+  tp_base_contact_list_index_group_members (self, set, new_handle, TRUE);
+
+  if (new_chan != NULL)
+    tp_group_mixin_change_members (new_chan, "", set, NULL, NULL, NULL,
+        tp_base_connection_get_self_handle (self->priv->conn),
+        TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
 
   if (old_chan != NULL)
     {
@@ -4082,6 +4964,24 @@ tp_base_contact_list_groups_changed (TpBaseContactList *self,
   if (self->priv->state != TP_CONTACT_LIST_STATE_SUCCESS)
     return;
 
+  if (self->priv->batch_depth > 0)
+    {
+      GroupsChange *change = g_slice_new0 (GroupsChange);
+
+      change->contacts = tp_handle_set_copy (contacts);
+      change->added = g_new0 (gchar *, n_added + 1);
+      change->removed = g_new0 (gchar *, n_removed + 1);
+
+      for (i = 0; i < n_added; i++)
+        change->added[i] = g_strdup (added[i]);
+
+      for (i = 0; i < n_removed; i++)
+        change->removed[i] = g_strdup (removed[i]);
+
+      g_queue_push_tail (&self->priv->batch_groups, change);
+      return;
+    }
+
   DEBUG ("Changing up to %u contacts, adding %" G_GSSIZE_FORMAT
       " groups, removing %" G_GSSIZE_FORMAT,
       tp_handle_set_size (contacts), n_added, n_removed);
@@ -4103,6 +5003,21 @@ tp_base_contact_list_groups_changed (TpBaseContactList *self,
       c = g_hash_table_lookup (self->priv->groups,
           GUINT_TO_POINTER (handle));
 
+      if (handle != 0 && tp_base_contact_list_has_group (self, handle))
+        tp_base_contact_list_index_group_members (self,
+            tp_handle_set_peek (contacts), handle, TRUE);
+
+      if (c == NULL && tp_base_contact_list_has_group (self, handle))
+        {
+          /* lazy-group-channels mode: there's no channel to tell us
+           * whether this was a no-op, so assume it wasn't unless there are
+           * no contacts */
+          if (!tp_handle_set_is_empty (contacts))
+            g_ptr_array_add (really_added, (gchar *) added[i]);
+
+          continue;
+        }
+
       if (c == NULL)
         {
           DEBUG ("No channel for group '%s', it must be invalid?", added[i]);
@@ -4129,6 +5044,19 @@ tp_base_contact_list_groups_changed (TpBaseContactList *self,
       c = g_hash_table_lookup (self->priv->groups,
           GUINT_TO_POINTER (handle));
 
+      if (handle != 0 && tp_base_contact_list_has_group (self, handle))
+        tp_base_contact_list_index_group_members (self,
+            tp_handle_set_peek (contacts), handle, FALSE);
+
+      if (c == NULL && tp_base_contact_list_has_group (self, handle))
+        {
+          /* as above */
+          if (!tp_handle_set_is_empty (contacts))
+            g_ptr_array_add (really_removed, (gchar *) removed[i]);
+
+          continue;
+        }
+
       if (c == NULL)
         {
           DEBUG ("Group '%s' doesn't exist", removed[i]);
@@ -4605,16 +5533,13 @@ tp_base_contact_list_emulate_rename_group (TpBaseContactList *self,
     gpointer user_data)
 {
   TpHandle old_handle;
-  gpointer old_channel;
   GSimpleAsyncResult *result;
   TpHandleSet *old_members;
 
   old_handle = tp_handle_lookup (self->priv->group_repo, old_name, NULL,
       NULL);
   g_return_if_fail (old_handle != 0);
-  old_channel = g_hash_table_lookup (self->priv->groups,
-      GUINT_TO_POINTER (old_handle));
-  g_return_if_fail (old_channel != NULL);
+  g_return_if_fail (tp_base_contact_list_has_group (self, old_handle));
 
   result = g_simple_async_result_new ((GObject *) self, callback, user_data,
       tp_base_contact_list_emulate_rename_group);
@@ -4824,6 +5749,233 @@ tp_base_contact_list_remove_group_finish (TpBaseContactList *self,
   return mutable_groups_iface->remove_group_finish (self, result, error);
 }
 
+/**
+ * TpBaseContactListDupVersionFunc:
+ * @self: a contact list manager
+ *
+ * Signature of a virtual method that returns the current version of the
+ * contact list.
+ *
+ * Returns: (transfer full): an opaque version token
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * tp_base_contact_list_dup_version:
+ * @self: a contact list manager
+ *
+ * Return an opaque token identifying the current version of the contact
+ * list, which can later be passed to
+ * tp_base_contact_list_dup_changes_since(), possibly in a later connection
+ * to the same account.
+ *
+ * If the #TpBaseContactList subclass does not implement
+ * %TP_TYPE_VERSIONED_CONTACT_LIST, or the contact list has not been
+ * retrieved yet, this method returns %NULL.
+ *
+ * For implementations of %TP_TYPE_VERSIONED_CONTACT_LIST, this is a virtual
+ * method, implemented using #TpVersionedContactListInterface.dup_version.
+ * It must always be implemented.
+ *
+ * Returns: (transfer full): a version token, or %NULL
+ *
+ * Since: 0.UNRELEASED
+ */
+gchar *
+tp_base_contact_list_dup_version (TpBaseContactList *self)
+{
+  TpVersionedContactListInterface *iface;
+
+  g_return_val_if_fail (TP_IS_BASE_CONTACT_LIST (self), NULL);
+
+  if (!TP_IS_VERSIONED_CONTACT_LIST (self) ||
+      tp_base_contact_list_get_state (self, NULL) !=
+        TP_CONTACT_LIST_STATE_SUCCESS)
+    return NULL;
+
+  iface = TP_VERSIONED_CONTACT_LIST_GET_INTERFACE (self);
+  g_return_val_if_fail (iface != NULL, NULL);
+  g_return_val_if_fail (iface->dup_version != NULL, NULL);
+
+  return iface->dup_version (self);
+}
+
+/**
+ * TpBaseContactListDupChangesSinceFunc:
+ * @self: a contact list manager
+ * @version: a version token previously returned by
+ *  tp_base_contact_list_dup_version()
+ *
+ * Signature of a virtual method that returns the contacts which changed
+ * since a version of the contact list.
+ *
+ * Returns: (transfer full): a new #TpHandleSet of contact handles, or %NULL
+ *  if @version is not known
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * tp_base_contact_list_dup_changes_since:
+ * @self: a contact list manager
+ * @version: a version token previously returned by
+ *  tp_base_contact_list_dup_version()
+ *
+ * Return the contacts on the contact list which were added to it, or whose
+ * subscription states, groups or other contact list information changed,
+ * since @version. Contacts which were removed from the contact list need
+ * not be included. It is incorrect to call this method before
+ * tp_base_contact_list_set_list_received() has been called, after the
+ * connection has disconnected, or on a #TpBaseContactList that does not
+ * implement %TP_TYPE_VERSIONED_CONTACT_LIST.
+ *
+ * If the subclass does not know what has changed since @version (for
+ * instance because it is too old), it returns %NULL, and the whole contact
+ * list must be downloaded again.
+ *
+ * For implementations of %TP_TYPE_VERSIONED_CONTACT_LIST, this is a virtual
+ * method, implemented using
+ * #TpVersionedContactListInterface.dup_changes_since.
+ * It must always be implemented.
+ *
+ * Returns: (transfer full): a new #TpHandleSet of contact handles, or %NULL
+ *
+ * Since: 0.UNRELEASED
+ */
+TpHandleSet *
+tp_base_contact_list_dup_changes_since (TpBaseContactList *self,
+    const gchar *version)
+{
+  TpVersionedContactListInterface *iface =
+    TP_VERSIONED_CONTACT_LIST_GET_INTERFACE (self);
+
+  g_return_val_if_fail (iface != NULL, NULL);
+  g_return_val_if_fail (iface->dup_changes_since != NULL, NULL);
+  g_return_val_if_fail (version != NULL, NULL);
+  g_return_val_if_fail (tp_base_contact_list_get_state (self, NULL) ==
+      TP_CONTACT_LIST_STATE_SUCCESS, NULL);
+
+  return iface->dup_changes_since (self, version);
+}
+
+static void
+tp_base_contact_list_mixin_get_contact_list_changes_since (
+    TpSvcConnectionInterfaceContactList *svc,
+    const gchar *version,
+    const gchar **interfaces,
+    DBusGMethodInvocation *context)
+{
+  TpBaseContactList *self = _tp_base_connection_find_channel_manager (
+      (TpBaseConnection *) svc, TP_TYPE_BASE_CONTACT_LIST);
+  TpContactsMixin *contacts_mixin = TP_CONTACTS_MIXIN (svc);
+  GError *error = NULL;
+  const gchar *assumed[] = { TP_IFACE_CONNECTION,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST, NULL };
+  TpHandleSet *all;
+  TpIntset *changed, *unchanged;
+  TpIntsetFastIter iter;
+  TpHandle handle;
+  GArray *changed_array;
+  GHashTable *attributes, *unchanged_ids;
+  gchar *sender, *new_version;
+
+  g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
+  g_return_if_fail (contacts_mixin != NULL);
+
+  if (tp_base_contact_list_get_dbus_state (self, &error)
+      != TP_CONTACT_LIST_STATE_SUCCESS)
+    goto error;
+
+  new_version = tp_base_contact_list_dup_version (self);
+
+  if (new_version == NULL)
+    {
+      g_set_error_literal (&error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+          "This contact list does not have versions");
+      goto error;
+    }
+
+  all = tp_base_contact_list_dup_contacts (self);
+
+  if (version[0] == '\0')
+    {
+      changed = tp_intset_copy (tp_handle_set_peek (all));
+    }
+  else
+    {
+      TpHandleSet *since = tp_base_contact_list_dup_changes_since (self,
+          version);
+
+      if (since == NULL)
+        {
+          g_set_error (&error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+              "Unknown contact list version '%s'", version);
+          tp_handle_set_destroy (all);
+          g_free (new_version);
+          goto error;
+        }
+
+      /* ignore contacts that have since been removed */
+      changed = tp_intset_intersection (tp_handle_set_peek (since),
+          tp_handle_set_peek (all));
+      tp_handle_set_destroy (since);
+    }
+
+  DEBUG ("%u of %u contacts changed since '%s'", tp_intset_size (changed),
+      tp_handle_set_size (all), version);
+
+  sender = dbus_g_method_get_sender (context);
+  changed_array = tp_intset_to_array (changed);
+  attributes = tp_contacts_mixin_get_contact_attributes (
+      (GObject *) self->priv->conn, changed_array, interfaces, assumed,
+      sender);
+
+  unchanged = tp_intset_difference (tp_handle_set_peek (all), changed);
+  unchanged_ids = g_hash_table_new (NULL, NULL);
+  tp_intset_fast_iter_init (&iter, unchanged);
+
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    g_hash_table_insert (unchanged_ids, GUINT_TO_POINTER (handle),
+        (gchar *) tp_handle_inspect (self->priv->contact_repo, handle));
+
+  tp_svc_connection_interface_contact_list_return_from_get_contact_list_changes_since (
+      context, attributes, unchanged_ids, new_version);
+
+  g_hash_table_unref (unchanged_ids);
+  g_hash_table_unref (attributes);
+  tp_intset_destroy (unchanged);
+  tp_intset_destroy (changed);
+  g_array_unref (changed_array);
+  tp_handle_set_destroy (all);
+  g_free (sender);
+  g_free (new_version);
+  return;
+
+error:
+  dbus_g_method_return_error (context, error);
+  g_clear_error (&error);
+}
+
+/* Returns: (transfer full): every contact on the list, in ascending order;
+ * this is shared with any other callers until the list changes, so it must
+ * not be modified */
+static GArray *
+tp_base_contact_list_dup_contacts_array (TpBaseContactList *self)
+{
+  RosterSnapshot *snapshot = tp_base_contact_list_ensure_snapshot (self);
+  TpHandleSet *set;
+  GArray *contacts;
+
+  if (snapshot != NULL)
+    return roster_snapshot_dup_array (snapshot);
+
+  set = tp_base_contact_list_dup_contacts (self);
+  contacts = tp_handle_set_to_array (set);
+  tp_handle_set_destroy (set);
+  return contacts;
+}
+
 static void
 tp_base_contact_list_mixin_get_contact_list_attributes (
     TpSvcConnectionInterfaceContactList *svc,
@@ -4839,7 +5991,7 @@ tp_base_contact_list_mixin_get_contact_list_attributes (
   g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
   g_return_if_fail (contacts_mixin != NULL);
 
-  if (tp_base_contact_list_get_state (self, &error)
+  if (tp_base_contact_list_get_dbus_state (self, &error)
       != TP_CONTACT_LIST_STATE_SUCCESS)
     {
       dbus_g_method_return_error (context, error);
@@ -4847,31 +5999,74 @@ tp_base_contact_list_mixin_get_contact_list_attributes (
     }
   else
     {
-      TpHandleSet *set;
       GArray *contacts;
       const gchar *assumed[] = { TP_IFACE_CONNECTION,
           TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST, NULL };
       gchar *sender = NULL;
       GHashTable *result;
 
-      if (hold)
-        sender = dbus_g_method_get_sender (context);
+      sender = dbus_g_method_get_sender (context);
 
-      set = tp_base_contact_list_dup_contacts (self);
-      contacts = tp_handle_set_to_array (set);
+      contacts = tp_base_contact_list_dup_contacts_array (self);
+      _tp_base_connection_add_contact_interests (self->priv->conn, sender,
+          (const gchar * const *) interfaces, contacts);
       result = tp_contacts_mixin_get_contact_attributes (
           (GObject *) self->priv->conn, contacts, interfaces, assumed,
-          sender);
+          hold ? sender : NULL);
       tp_svc_connection_interface_contact_list_return_from_get_contact_list_attributes (
           context, result);
 
       g_array_unref (contacts);
-      tp_handle_set_destroy (set);
       g_free (sender);
       g_hash_table_unref (result);
     }
 }
 
+static void
+tp_base_contact_list_mixin_get_contact_list_attributes_variant (
+    GObject *svc,
+    GVariant *in_args,
+    TpSvcInvocation *invocation)
+{
+  TpBaseContactList *self = _tp_base_connection_find_channel_manager (
+      (TpBaseConnection *) svc, TP_TYPE_BASE_CONTACT_LIST);
+  GError *error = NULL;
+
+  g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
+  g_return_if_fail (TP_CONTACTS_MIXIN (svc) != NULL);
+
+  if (tp_base_contact_list_get_dbus_state (self, &error)
+      != TP_CONTACT_LIST_STATE_SUCCESS)
+    {
+      _tp_svc_invocation_return_error (invocation, error);
+      g_clear_error (&error);
+    }
+  else
+    {
+      GArray *contacts;
+      const gchar *assumed[] = { TP_IFACE_CONNECTION,
+          TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST, NULL };
+      const gchar **interfaces;
+      gboolean hold;
+      GVariant *result;
+
+      g_variant_get (in_args, "(^a&sb)", &interfaces, &hold);
+
+      contacts = tp_base_contact_list_dup_contacts_array (self);
+      _tp_base_connection_add_contact_interests (self->priv->conn,
+          _tp_svc_invocation_get_sender (invocation),
+          (const gchar * const *) interfaces, contacts);
+      result = _tp_contacts_mixin_dup_contact_attributes_variant (
+          (GObject *) self->priv->conn, contacts, interfaces, assumed,
+          hold ? _tp_svc_invocation_get_sender (invocation) : NULL);
+      _tp_svc_invocation_return_variant (invocation,
+          g_variant_new_tuple (&result, 1));
+
+      g_array_unref (contacts);
+      g_free (interfaces);
+    }
+}
+
 /**
  * TpBaseContactListSetContactGroupsFunc:
  * @self: a contact list manager
@@ -5316,6 +6511,7 @@ typedef enum {
     LP_CAN_CHANGE_CONTACT_LIST,
     LP_REQUEST_USES_MESSAGE,
     LP_DOWNLOAD_AT_CONNECTION,
+    LP_CONTACT_LIST_VERSION,
     NUM_LIST_PROPERTIES
 } ListProp;
 
@@ -5325,6 +6521,7 @@ static TpDBusPropertiesMixinPropImpl known_list_props[] = {
     { "CanChangeContactList", GINT_TO_POINTER (LP_CAN_CHANGE_CONTACT_LIST) },
     { "RequestUsesMessage", GINT_TO_POINTER (LP_REQUEST_USES_MESSAGE) },
     { "DownloadAtConnection", GINT_TO_POINTER (LP_DOWNLOAD_AT_CONNECTION) },
+    { "ContactListVersion", GINT_TO_POINTER (LP_CONTACT_LIST_VERSION) },
     { NULL }
 };
 
@@ -5346,7 +6543,8 @@ tp_base_contact_list_get_list_dbus_property (GObject *conn,
     {
     case LP_CONTACT_LIST_STATE:
       g_return_if_fail (G_VALUE_HOLDS_UINT (value));
-      g_value_set_uint (value, self->priv->state);
+      g_value_set_uint (value,
+          tp_base_contact_list_get_dbus_state (self, NULL));
       break;
 
     case LP_CONTACT_LIST_PERSISTS:
@@ -5372,6 +6570,17 @@ tp_base_contact_list_get_list_dbus_property (GObject *conn,
       g_value_set_boolean (value, self->priv->download_at_connection);
       break;
 
+    case LP_CONTACT_LIST_VERSION:
+        {
+          gchar *version;
+
+          g_return_if_fail (G_VALUE_HOLDS_STRING (value));
+          version = tp_base_contact_list_dup_version (self);
+          g_value_take_string (value,
+              version != NULL ? version : g_strdup (""));
+        }
+      break;
+
     default:
       g_return_if_reached ();
     }
@@ -5380,19 +6589,31 @@ tp_base_contact_list_get_list_dbus_property (GObject *conn,
 static void
 tp_base_contact_list_fill_list_contact_attributes (GObject *obj,
   const GArray *contacts,
-  GHashTable *attributes_hash)
+  TpContactAttributesBuilder *builder)
 {
   TpBaseContactList *self = _tp_base_connection_find_channel_manager (
       (TpBaseConnection *) obj, TP_TYPE_BASE_CONTACT_LIST);
+  guint publish_column, subscribe_column, publish_request_column;
+  RosterSnapshot *snapshot;
   guint i;
 
   g_return_if_fail (TP_IS_BASE_CONTACT_LIST (self));
   g_return_if_fail (self->priv->conn != NULL);
 
   /* just omit the attributes if the contact list hasn't come in yet */
-  if (self->priv->state != TP_CONTACT_LIST_STATE_SUCCESS)
+  if (tp_base_contact_list_get_dbus_state (self, NULL) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
     return;
 
+  publish_column = _tp_contact_attributes_builder_add_column (builder,
+      TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH);
+  subscribe_column = _tp_contact_attributes_builder_add_column (builder,
+      TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_SUBSCRIBE);
+  publish_request_column = _tp_contact_attributes_builder_add_column (
+      builder, TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH_REQUEST);
+
+  snapshot = tp_base_contact_list_get_snapshot (self);
+
   for (i = 0; i < contacts->len; i++)
     {
       TpSubscriptionState subscribe = TP_SUBSCRIPTION_STATE_NO;
@@ -5402,16 +6623,29 @@ tp_base_contact_list_fill_list_contact_attributes (GObject *obj,
 
       handle = g_array_index (contacts, TpHandle, i);
 
-      tp_base_contact_list_dup_states (self, handle,
-          &subscribe, &publish, &publish_request);
+      if (snapshot != NULL)
+        {
+          CachedStates *states = g_hash_table_lookup (snapshot->states,
+              GUINT_TO_POINTER (handle));
 
-      tp_contacts_mixin_set_contact_attribute (attributes_hash,
-          handle, TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH,
-          tp_g_value_slice_new_uint (publish));
+          /* anyone else is not on the list, so their states are No */
+          if (states != NULL)
+            {
+              subscribe = states->subscribe;
+              publish = states->publish;
+              publish_request = g_strdup (states->publish_request);
+            }
+        }
+      else
+        {
+          tp_base_contact_list_dup_states (self, handle,
+              &subscribe, &publish, &publish_request);
+        }
 
-      tp_contacts_mixin_set_contact_attribute (attributes_hash,
-          handle, TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_SUBSCRIBE,
-          tp_g_value_slice_new_uint (subscribe));
+      g_value_set_uint (_tp_contact_attributes_builder_init_value (builder,
+            publish_column, i, G_TYPE_UINT), publish);
+      g_value_set_uint (_tp_contact_attributes_builder_init_value (builder,
+            subscribe_column, i, G_TYPE_UINT), subscribe);
 
       if (tp_str_empty (publish_request) ||
           publish != TP_SUBSCRIPTION_STATE_ASK)
@@ -5420,9 +6654,9 @@ tp_base_contact_list_fill_list_contact_attributes (GObject *obj,
         }
       else
         {
-          tp_contacts_mixin_set_contact_attribute (attributes_hash,
-              handle, TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH_REQUEST,
-              tp_g_value_slice_new_take_string (publish_request));
+          g_value_take_string (_tp_contact_attributes_builder_init_value (
+                builder, publish_request_column, i, G_TYPE_STRING),
+              publish_request);
         }
     }
 }
@@ -5471,6 +6705,7 @@ tp_base_contact_list_mixin_list_iface_init (
 #define IMPLEMENT(x) tp_svc_connection_interface_contact_list_implement_##x (\
   klass, tp_base_contact_list_mixin_##x)
   IMPLEMENT (get_contact_list_attributes);
+  IMPLEMENT (get_contact_list_changes_since);
   IMPLEMENT (request_subscription);
   IMPLEMENT (authorize_publication);
   IMPLEMENT (remove_contacts);
@@ -5478,6 +6713,10 @@ tp_base_contact_list_mixin_list_iface_init (
   IMPLEMENT (unpublish);
   IMPLEMENT (download);
 #undef IMPLEMENT
+
+  /* this can be large, so calls routed past dbus-glib skip the GValues */
+  _tp_svc_connection_interface_contact_list_implement_get_contact_list_attributes_variant (
+      klass, tp_base_contact_list_mixin_get_contact_list_attributes_variant);
 }
 
 /**
@@ -5814,17 +7053,14 @@ tp_base_contact_list_mixin_rename_group (
       (TpBaseConnection *) svc, TP_TYPE_BASE_CONTACT_LIST);
   GError *error = NULL;
   TpHandle old_handle;
-  gpointer old_channel;
   TpHandle new_handle = 0;
 
   if (!tp_base_contact_list_check_group_change (self, NULL, &error))
     goto sync_exit;
 
   old_handle = tp_handle_lookup (self->priv->group_repo, before, NULL, NULL);
-  old_channel = g_hash_table_lookup (self->priv->groups,
-      GUINT_TO_POINTER (old_handle));
 
-  if (old_handle == 0 || old_channel == NULL)
+  if (old_handle == 0 || !tp_base_contact_list_has_group (self, old_handle))
     {
       g_set_error (&error, TP_ERROR, TP_ERROR_DOES_NOT_EXIST,
           "Group '%s' does not exist", before);
@@ -5836,8 +7072,7 @@ tp_base_contact_list_mixin_rename_group (
   if (new_handle == 0)
     goto sync_exit;
 
-  if (g_hash_table_lookup (self->priv->groups, GUINT_TO_POINTER (new_handle))
-      != NULL)
+  if (tp_base_contact_list_has_group (self, new_handle))
     {
       g_set_error (&error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
           "Group '%s' already exists",
@@ -5901,7 +7136,8 @@ tp_base_contact_list_get_group_dbus_property (GObject *conn,
     case GP_GROUPS:
       g_return_if_fail (G_VALUE_HOLDS (value, G_TYPE_STRV));
 
-      if (self->priv->state == TP_CONTACT_LIST_STATE_SUCCESS)
+      if (tp_base_contact_list_get_dbus_state (self, NULL) ==
+          TP_CONTACT_LIST_STATE_SUCCESS)
         g_value_take_boxed (value, tp_base_contact_list_dup_groups (self));
 
       break;
@@ -5925,19 +7161,40 @@ tp_base_contact_list_fill_groups_contact_attributes (GObject *obj,
   g_return_if_fail (self->priv->conn != NULL);
 
   /* just omit the attributes if the contact list hasn't come in yet */
-  if (self->priv->state != TP_CONTACT_LIST_STATE_SUCCESS)
+  if (tp_base_contact_list_get_dbus_state (self, NULL) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
     return;
 
   for (i = 0; i < contacts->len; i++)
     {
-      TpHandle handle;
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+      TpHandleSet *groups = g_hash_table_lookup (self->priv->contact_groups,
+          GUINT_TO_POINTER (handle));
+      GPtrArray *names;
 
-      handle = g_array_index (contacts, TpHandle, i);
+      /* use the index rather than calling dup_contact_groups, which could
+       * be expensive, once per contact */
+      names = g_ptr_array_sized_new (
+          groups == NULL ? 1 : tp_handle_set_size (groups) + 1);
+
+      if (groups != NULL)
+        {
+          TpIntsetFastIter iter;
+          TpHandle group;
+
+          tp_intset_fast_iter_init (&iter, tp_handle_set_peek (groups));
+
+          while (tp_intset_fast_iter_next (&iter, &group))
+            g_ptr_array_add (names, g_strdup (tp_handle_inspect (
+                    self->priv->group_repo, group)));
+        }
+
+      g_ptr_array_add (names, NULL);
 
       tp_contacts_mixin_set_contact_attribute (attributes_hash,
           handle, TP_TOKEN_CONNECTION_INTERFACE_CONTACT_GROUPS_GROUPS,
           tp_g_value_slice_new_take_boxed (G_TYPE_STRV,
-            tp_base_contact_list_dup_contact_groups (self, handle)));
+            g_ptr_array_free (names, FALSE)));
     }
 }
 
@@ -5956,7 +7213,8 @@ tp_base_contact_list_fill_blocking_contact_attributes (GObject *obj,
   g_return_if_fail (self->priv->conn != NULL);
 
   /* just omit the attributes if the contact list hasn't come in yet */
-  if (self->priv->state != TP_CONTACT_LIST_STATE_SUCCESS)
+  if (tp_base_contact_list_get_dbus_state (self, NULL) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
     return;
 
   blocked = tp_base_contact_list_dup_blocked_contacts (self);
@@ -6024,7 +7282,7 @@ tp_base_contact_list_mixin_request_blocked_contacts (
 
   ERROR_IF_BLOCKING_NOT_SUPPORTED (self, context);
 
-  switch (self->priv->state)
+  switch (tp_base_contact_list_get_dbus_state (self, NULL))
     {
     case TP_CONTACT_LIST_STATE_NONE:
     case TP_CONTACT_LIST_STATE_WAITING:
@@ -6038,13 +7296,11 @@ tp_base_contact_list_mixin_request_blocked_contacts (
 
     case TP_CONTACT_LIST_STATE_SUCCESS:
       {
-        TpHandleSet *blocked = tp_base_contact_list_dup_blocked_contacts (self);
-        GHashTable *map = tp_handle_set_to_identifier_map (blocked);
+        GHashTable *map = tp_base_contact_list_dup_blocked_contact_ids (self);
 
         tp_svc_connection_interface_contact_blocking_return_from_request_blocked_contacts (context, map);
 
         g_hash_table_unref (map);
-        tp_handle_set_destroy (blocked);
         break;
       }
 
@@ -6285,7 +7541,7 @@ tp_base_contact_list_mixin_register_with_contacts_mixin (
   g_return_if_fail (g_type_is_a (type,
         TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACT_LIST));
 
-  tp_contacts_mixin_add_contact_attributes_iface (object,
+  _tp_contacts_mixin_add_contact_attributes_columns (object,
       TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST,
       tp_base_contact_list_fill_list_contact_attributes);
 
@@ -90,6 +90,11 @@ void tp_base_contact_list_one_contact_changed (TpBaseContactList *self,
 void tp_base_contact_list_one_contact_removed (TpBaseContactList *self,
     TpHandle removed);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_contact_list_begin_batch (TpBaseContactList *self);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_base_contact_list_end_batch (TpBaseContactList *self);
+
 /* ---- Implemented by subclasses for ContactList (mandatory read-only
  * things) ---- */
 
@@ -366,6 +371,48 @@ struct _TpBlockableContactListInterface {
     TpBaseContactListBlockContactsWithAbuseFunc block_contacts_with_abuse_async;
 };
 
+/* ---- versioned contact lists ---- */
+
+#define TP_TYPE_VERSIONED_CONTACT_LIST \
+  (tp_versioned_contact_list_get_type ())
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_versioned_contact_list_get_type (void) G_GNUC_CONST;
+
+#define TP_IS_VERSIONED_CONTACT_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+  TP_TYPE_VERSIONED_CONTACT_LIST))
+
+#define TP_VERSIONED_CONTACT_LIST_GET_INTERFACE(obj) \
+  (G_TYPE_INSTANCE_GET_INTERFACE ((obj), \
+  TP_TYPE_VERSIONED_CONTACT_LIST, TpVersionedContactListInterface))
+
+typedef struct _TpVersionedContactListInterface
+    TpVersionedContactListInterface;
+
+typedef gchar *(*TpBaseContactListDupVersionFunc) (
+    TpBaseContactList *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gchar *tp_base_contact_list_dup_version (TpBaseContactList *self);
+
+typedef TpHandleSet *(*TpBaseContactListDupChangesSinceFunc) (
+    TpBaseContactList *self,
+    const gchar *version);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpHandleSet *tp_base_contact_list_dup_changes_since (
+    TpBaseContactList *self,
+    const gchar *version);
+
+struct _TpVersionedContactListInterface {
+    GTypeInterface parent;
+
+    /* mandatory to implement */
+
+    TpBaseContactListDupVersionFunc dup_version;
+    TpBaseContactListDupChangesSinceFunc dup_changes_since;
+};
+
 /* ---- Called by subclasses for ContactGroups ---- */
 
 void tp_base_contact_list_groups_created (TpBaseContactList *self,
@@ -525,6 +525,9 @@ offer_finished_cb (GObject *source,
           &local_properties, &error))
     {
       DEBUG ("Offer failed: %s", error->message);
+      _tp_base_call_content_add_timeline_event (
+          (TpBaseCallContent *) self, "media-description-rejected",
+          tp_call_content_media_description_get_object_path (md));
       g_simple_async_result_take_error (self->priv->current_offer_result,
           error);
       goto out;
@@ -532,6 +535,9 @@ offer_finished_cb (GObject *source,
 
   DEBUG ("Accepted offer: %s",
       tp_call_content_media_description_get_object_path (md));
+  _tp_base_call_content_add_timeline_event ((TpBaseCallContent *) self,
+      "media-description-accepted",
+      tp_call_content_media_description_get_object_path (md));
 
   /* Accepted, update local and remote MediaDescription */
   remote_properties = _tp_call_content_media_description_dup_properties (md);
@@ -593,6 +599,8 @@ next_offer (TpBaseMediaCallContent *self)
       self->priv->current_offer);
 
   DEBUG ("emitting NewMediaDescriptionOffer: %s", object_path);
+  _tp_base_call_content_add_timeline_event ((TpBaseCallContent *) self,
+      "media-description-offered", object_path);
   tp_svc_call_content_interface_media_emit_new_media_description_offer (self,
       object_path, properties);
   g_hash_table_unref (properties);
@@ -166,6 +166,7 @@
 #include "telepathy-glib/util-internal.h"
 
 static void call_stream_media_iface_init (gpointer, gpointer);
+static void flush_local_candidates (TpBaseMediaCallStream *self);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (TpBaseMediaCallStream,
     tp_base_media_call_stream, TP_TYPE_BASE_CALL_STREAM,
@@ -186,7 +187,8 @@ enum
   PROP_RELAY_INFO,
   PROP_HAS_SERVER_INFO,
   PROP_ENDPOINTS,
-  PROP_ICE_RESTART_PENDING
+  PROP_ICE_RESTART_PENDING,
+  PROP_CANDIDATE_BATCH_WINDOW
 };
 
 /* private structure */
@@ -197,6 +199,13 @@ struct _TpBaseMediaCallStreamPrivate
   TpStreamTransportType transport;
   /* GPtrArray of owned GValueArray (dbus struct) */
   GPtrArray *local_candidates;
+  /* GPtrArray of owned GValueArray (dbus struct): candidates which are
+   * already in local_candidates but for which LocalCandidatesAdded has not
+   * been emitted yet */
+  GPtrArray *pending_candidates;
+  /* milliseconds, or 0 to emit LocalCandidatesAdded straight away */
+  guint candidate_batch_window;
+  guint flush_candidates_id;
   gchar *username;
   gchar *password;
   /* GPtrArray of owned GValueArray (dbus struct) */
@@ -236,6 +245,8 @@ tp_base_media_call_stream_init (TpBaseMediaCallStream *self)
 
   self->priv->local_candidates = g_ptr_array_new_with_free_func (
       (GDestroyNotify) tp_value_array_free);
+  self->priv->pending_candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
   self->priv->username = g_strdup ("");
   self->priv->password = g_strdup ("");
   self->priv->receiving_requests = tp_intset_new ();
@@ -257,6 +268,12 @@ tp_base_media_call_stream_dispose (GObject *object)
 
   tp_clear_pointer (&self->priv->endpoints, _tp_object_list_free);
 
+  if (self->priv->flush_candidates_id != 0)
+    {
+      g_source_remove (self->priv->flush_candidates_id);
+      self->priv->flush_candidates_id = 0;
+    }
+
   if (G_OBJECT_CLASS (tp_base_media_call_stream_parent_class)->dispose)
     G_OBJECT_CLASS (tp_base_media_call_stream_parent_class)->dispose (object);
 }
@@ -267,6 +284,7 @@ tp_base_media_call_stream_finalize (GObject *object)
   TpBaseMediaCallStream *self = TP_BASE_MEDIA_CALL_STREAM (object);
 
   tp_clear_pointer (&self->priv->local_candidates, g_ptr_array_unref);
+  tp_clear_pointer (&self->priv->pending_candidates, g_ptr_array_unref);
   tp_clear_pointer (&self->priv->stun_servers, g_ptr_array_unref);
   tp_clear_pointer (&self->priv->relay_info, g_ptr_array_unref);
   tp_clear_pointer (&self->priv->username, g_free);
@@ -344,6 +362,9 @@ tp_base_media_call_stream_get_property (GObject *object,
       case PROP_ICE_RESTART_PENDING:
         g_value_set_boolean (value, self->priv->ice_restart_pending);
         break;
+      case PROP_CANDIDATE_BATCH_WINDOW:
+        g_value_set_uint (value, self->priv->candidate_batch_window);
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -363,6 +384,14 @@ tp_base_media_call_stream_set_property (GObject *object,
       case PROP_TRANSPORT:
         self->priv->transport = g_value_get_uint (value);
         break;
+      case PROP_CANDIDATE_BATCH_WINDOW:
+        self->priv->candidate_batch_window = g_value_get_uint (value);
+
+        /* don't sit on candidates gathered under the old setting any
+         * longer than we now would */
+        if (self->priv->candidate_batch_window == 0)
+          flush_local_candidates (self);
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -550,6 +579,33 @@ tp_base_media_call_stream_class_init (TpBaseMediaCallStreamClass *klass)
   g_object_class_install_property (object_class, PROP_ICE_RESTART_PENDING,
       param_spec);
 
+  /**
+   * TpBaseMediaCallStream:candidate-batch-window:
+   *
+   * The number of milliseconds for which to hold back local candidates
+   * added by the streaming implementation, so that candidates trickled in
+   * one at a time are announced in a single LocalCandidatesAdded signal
+   * rather than one signal each. Queued candidates are sorted by
+   * component, and are always announced before FinishInitialCandidates
+   * returns, or if this property is set back to 0.
+   *
+   * Candidates are added to #TpBaseMediaCallStream:local-candidates, and
+   * passed to #TpBaseMediaCallStreamClass.add_local_candidates, as soon as
+   * they arrive, whatever the value of this property.
+   *
+   * The default is 0, meaning that LocalCandidatesAdded is emitted for each
+   * call to AddCandidates.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_uint ("candidate-batch-window",
+      "Candidate batch window",
+      "Milliseconds for which to coalesce LocalCandidatesAdded signals",
+      0, G_MAXUINT, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CANDIDATE_BATCH_WINDOW,
+      param_spec);
+
   tp_dbus_properties_mixin_implement_interface (object_class,
       TP_IFACE_QUARK_CALL_STREAM_INTERFACE_MEDIA,
       tp_dbus_properties_mixin_getter_gobject_properties,
@@ -1074,9 +1130,13 @@ tp_base_media_call_stream_get_receiving_state (TpBaseMediaCallStream *self)
  * tp_base_media_call_stream_get_local_candidates:
  * @self: a #TpBaseMediaCallStream
  *
- * <!-- -->
+ * Return the local candidates added so far. Unlike reading
+ * #TpBaseMediaCallStream:local-candidates, this does not copy them; the
+ * array includes any candidates whose announcement is being held back by
+ * #TpBaseMediaCallStream:candidate-batch-window.
  *
- * Returns: the value of #TpBaseMediaCallStream:local-candidates as a #GtrArray
+ * Returns: (transfer none): the value of
+ *  #TpBaseMediaCallStream:local-candidates as a #GPtrArray
  * Since: 0.17.5
  */
 GPtrArray *
@@ -1221,6 +1281,10 @@ tp_base_media_call_stream_complete_sending_state_change (
 
   self->priv->sending_state = state;
 
+  if (state == TP_STREAM_FLOW_STATE_STARTED)
+    _tp_base_call_channel_add_timeline_event (channel, "sending-started",
+        tp_base_call_stream_get_object_path ((TpBaseCallStream *) self));
+
   if (channel != NULL && TP_IS_BASE_MEDIA_CALL_CHANNEL (channel))
     _tp_base_media_call_channel_streams_sending_state_changed (
         TP_BASE_MEDIA_CALL_CHANNEL (channel), TRUE);
@@ -1308,6 +1372,10 @@ tp_base_media_call_stream_complete_receiving_state_change (
   self->priv->receiving_state = state;
   g_object_notify (G_OBJECT (self), "receiving-state");
 
+  if (state == TP_STREAM_FLOW_STATE_STARTED)
+    _tp_base_call_channel_add_timeline_event (channel, "receiving-started",
+        tp_base_call_stream_get_object_path ((TpBaseCallStream *) self));
+
   if (channel != NULL && TP_IS_BASE_MEDIA_CALL_CHANNEL (channel))
     _tp_base_media_call_channel_streams_receiving_state_changed (
         TP_BASE_MEDIA_CALL_CHANNEL (channel), TRUE);
@@ -1394,6 +1462,15 @@ tp_base_media_call_stream_set_credentials (TpSvcCallStreamInterfaceMedia *iface,
   self->priv->local_candidates = g_ptr_array_new_with_free_func (
       (GDestroyNotify) tp_value_array_free);
 
+  /* candidates queued under the old credentials are no use to anyone */
+  if (self->priv->flush_candidates_id != 0)
+    {
+      g_source_remove (self->priv->flush_candidates_id);
+      self->priv->flush_candidates_id = 0;
+    }
+
+  g_ptr_array_set_size (self->priv->pending_candidates, 0);
+
   g_object_notify (G_OBJECT (self), "local-candidates");
   g_object_notify (G_OBJECT (self), "local-credentials");
 
@@ -1403,6 +1480,61 @@ tp_base_media_call_stream_set_credentials (TpSvcCallStreamInterfaceMedia *iface,
   tp_svc_call_stream_interface_media_return_from_set_credentials (context);
 }
 
+static gint
+compare_candidate_components (gconstpointer a,
+    gconstpointer b)
+{
+  GValueArray * const *ca = a;
+  GValueArray * const *cb = b;
+  guint component_a, component_b;
+
+  tp_value_array_unpack (*ca, 1, &component_a);
+  tp_value_array_unpack (*cb, 1, &component_b);
+
+  if (component_a < component_b)
+    return -1;
+
+  return (component_a > component_b);
+}
+
+static void
+flush_local_candidates (TpBaseMediaCallStream *self)
+{
+  GPtrArray *pending = self->priv->pending_candidates;
+
+  if (self->priv->flush_candidates_id != 0)
+    {
+      g_source_remove (self->priv->flush_candidates_id);
+      self->priv->flush_candidates_id = 0;
+    }
+
+  if (pending->len == 0)
+    return;
+
+  DEBUG ("Announcing %u queued candidates on stream %s", pending->len,
+      tp_base_call_stream_get_object_path ((TpBaseCallStream *) self));
+
+  /* g_ptr_array_sort() is stable, so each component's candidates stay in
+   * the order they were gathered */
+  g_ptr_array_sort (pending, compare_candidate_components);
+
+  self->priv->pending_candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+  tp_svc_call_stream_interface_media_emit_local_candidates_added (self,
+      pending);
+  g_ptr_array_unref (pending);
+}
+
+static gboolean
+flush_local_candidates_cb (gpointer user_data)
+{
+  TpBaseMediaCallStream *self = user_data;
+
+  self->priv->flush_candidates_id = 0;
+  flush_local_candidates (self);
+  return FALSE;
+}
+
 static void
 tp_base_media_call_stream_add_candidates (TpSvcCallStreamInterfaceMedia *iface,
     const GPtrArray *candidates,
@@ -1412,6 +1544,7 @@ tp_base_media_call_stream_add_candidates (TpSvcCallStreamInterfaceMedia *iface,
   TpBaseMediaCallStreamClass *klass =
       TP_BASE_MEDIA_CALL_STREAM_GET_CLASS (self);
   GPtrArray *accepted_candidates = NULL;
+  gboolean had_candidates = (self->priv->local_candidates->len > 0);
   guint i;
   GError *error = NULL;
 
@@ -1445,8 +1578,35 @@ tp_base_media_call_stream_add_candidates (TpSvcCallStreamInterfaceMedia *iface,
       G_GNUC_END_IGNORE_DEPRECATIONS
     }
 
-  tp_svc_call_stream_interface_media_emit_local_candidates_added (self,
-      accepted_candidates);
+  if (!had_candidates && self->priv->local_candidates->len > 0)
+    _tp_base_call_channel_add_timeline_event (
+        _tp_base_call_stream_get_channel ((TpBaseCallStream *) self),
+        "first-local-candidate",
+        tp_base_call_stream_get_object_path ((TpBaseCallStream *) self));
+
+  if (self->priv->candidate_batch_window == 0)
+    {
+      tp_svc_call_stream_interface_media_emit_local_candidates_added (self,
+          accepted_candidates);
+    }
+  else
+    {
+      for (i = 0; i < accepted_candidates->len; i++)
+        {
+          GValueArray *c = g_ptr_array_index (accepted_candidates, i);
+
+          G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+          g_ptr_array_add (self->priv->pending_candidates,
+              g_value_array_copy (c));
+          G_GNUC_END_IGNORE_DEPRECATIONS
+        }
+
+      if (self->priv->flush_candidates_id == 0)
+        self->priv->flush_candidates_id = g_timeout_add (
+            self->priv->candidate_batch_window, flush_local_candidates_cb,
+            self);
+    }
+
   tp_svc_call_stream_interface_media_return_from_add_candidates (context);
 
   g_ptr_array_unref (accepted_candidates);
@@ -1462,6 +1622,10 @@ tp_base_media_call_stream_finish_initial_candidates (
       TP_BASE_MEDIA_CALL_STREAM_GET_CLASS (self);
   GError *error = NULL;
 
+  /* the initial candidates must all have been announced by the time the
+   * streaming implementation hears that we're done */
+  flush_local_candidates (self);
+
   if (klass->finish_initial_candidates != NULL)
     if (!klass->finish_initial_candidates (self, &error))
       {
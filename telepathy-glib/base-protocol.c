@@ -539,10 +539,10 @@ tp_cm_param_filter_string_nonempty (const TpCMParamSpec *paramspec,
  *  tp_base_protocol_new_connection(), which all subclasses must provide;
  *  see the documentation of that method for details
  * @normalize_contact: a callback used to implement the NormalizeContact
- *  D-Bus method; it must either return a newly allocated string that is the
- *  normalized version of @contact, or raise an error via @error and
- *  return %NULL. If not implemented, %TP_ERROR_NOT_IMPLEMENTED will be raised
- *  instead.
+ *  and NormalizeContacts D-Bus methods; it must either return a newly
+ *  allocated string that is the normalized version of @contact, or raise an
+ *  error via @error and return %NULL. If not implemented,
+ *  %TP_ERROR_NOT_IMPLEMENTED will be raised instead.
  * @identify_account: a callback used to implement the IdentifyAccount
  *  D-Bus method; it takes as input a map from strings to #GValue<!---->s,
  *  and must either return a newly allocated string that represents the
@@ -610,6 +610,12 @@ struct _TpBaseProtocolPrivate
   gchar *english_name;
   gchar *vcard_field;
   AvatarSpecs avatar_specs;
+
+  /* the result of get_parameters() that parameter_index was built from */
+  const TpCMParamSpec *indexed_parameters;
+  /* borrowed parameter name => GUINT_TO_POINTER (1 + its index) */
+  GHashTable *parameter_index;
+  guint n_parameters;
 };
 
 enum
@@ -903,6 +909,7 @@ tp_base_protocol_finalize (GObject *object)
   g_free (self->priv->vcard_field);
 
   g_strfreev (self->priv->avatar_specs.supported_mime_types);
+  tp_clear_pointer (&self->priv->parameter_index, g_hash_table_unref);
 
   if (self->priv->requestable_channel_classes != NULL)
     g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST,
@@ -1284,6 +1291,17 @@ tp_base_protocol_class_init (TpBaseProtocolClass *klass)
   klass->dbus_properties_class.interfaces = prop_interfaces;
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (TpBaseProtocolClass, dbus_properties_class));
+
+  /* all of these are immutable; clients (and the CM's own
+   * ConnectionManager.Protocols) ask for them repeatedly */
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_PROTOCOL);
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_PROTOCOL_INTERFACE_PRESENCE);
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_PROTOCOL_INTERFACE_AVATARS);
+  tp_dbus_properties_mixin_class_set_immutable (object_class,
+      TP_IFACE_PROTOCOL_INTERFACE_ADDRESSING);
 }
 
 static void
@@ -1348,65 +1366,85 @@ tp_base_protocol_get_parameters (TpBaseProtocol *self)
   return cls->get_parameters (self);
 }
 
+/* get_parameters() typically returns a static array, so index it by name
+ * the first time it's needed, and validate each request's parameters against
+ * that. If a subclass returns a different array, we index that instead. */
+static GHashTable *
+tp_base_protocol_get_parameter_index (TpBaseProtocol *self,
+    const TpCMParamSpec *parameters)
+{
+  guint i;
+
+  if (self->priv->parameter_index != NULL &&
+      self->priv->indexed_parameters == parameters)
+    return self->priv->parameter_index;
+
+  tp_clear_pointer (&self->priv->parameter_index, g_hash_table_unref);
+  self->priv->parameter_index = g_hash_table_new (g_str_hash, g_str_equal);
+  self->priv->indexed_parameters = parameters;
+
+  for (i = 0; parameters[i].name != NULL; i++)
+    g_hash_table_insert (self->priv->parameter_index,
+        (gpointer) parameters[i].name, GUINT_TO_POINTER (i + 1));
+
+  self->priv->n_parameters = i;
+  return self->priv->parameter_index;
+}
+
+/* Check that every parameter in @asv is in @index, and if so, fill in
+ * @supplied[i] with the value given for the i'th parameter. */
 static gboolean
-_tp_cm_param_spec_check_all_allowed (const TpCMParamSpec *parameters,
+_tp_cm_param_spec_check_all_allowed (GHashTable *index,
     GHashTable *asv,
+    const GValue **supplied,
     GError **error)
 {
-  GHashTable *tmp = g_hash_table_new (g_str_hash, g_str_equal);
-  const TpCMParamSpec *iter;
-  gboolean ret = TRUE;
-
-  tp_g_hash_table_update (tmp, asv, NULL, NULL);
+  GString *error_str = NULL;
+  GHashTableIter h_iter;
+  gpointer k, v;
+  gchar *error_txt;
 
-  for (iter = parameters; iter->name != NULL; iter++)
-    {
-      g_hash_table_remove (tmp, iter->name);
-    }
+  g_hash_table_iter_init (&h_iter, asv);
 
-  if (g_hash_table_size (tmp) != 0)
+  while (g_hash_table_iter_next (&h_iter, &k, &v))
     {
-      gchar *error_txt;
-      GString *error_str = g_string_new ("unknown parameters provided:");
-      GHashTableIter h_iter;
-      gpointer k;
-
-      g_hash_table_iter_init (&h_iter, tmp);
+      guint i = GPOINTER_TO_UINT (g_hash_table_lookup (index, k));
 
-      while (g_hash_table_iter_next (&h_iter, &k, NULL))
+      if (i > 0)
         {
-          g_string_append_c (error_str, ' ');
-          g_string_append (error_str, k);
+          supplied[i - 1] = v;
+          continue;
         }
 
-      error_txt = g_string_free (error_str, FALSE);
+      if (error_str == NULL)
+        error_str = g_string_new ("unknown parameters provided:");
 
-      DEBUG ("%s", error_txt);
-      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "%s", error_txt);
-      g_free (error_txt);
-      ret = FALSE;
+      g_string_append_c (error_str, ' ');
+      g_string_append (error_str, k);
     }
 
-  g_hash_table_unref (tmp);
+  if (error_str == NULL)
+    return TRUE;
 
-  return ret;
+  error_txt = g_string_free (error_str, FALSE);
+
+  DEBUG ("%s", error_txt);
+  g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+      "%s", error_txt);
+  g_free (error_txt);
+  return FALSE;
 }
 
+/* @value is the member of @asv named after @param_spec */
 static GValue *
 _tp_cm_param_spec_coerce (const TpCMParamSpec *param_spec,
     GHashTable *asv,
+    const GValue *value,
     GError **error)
 {
   const gchar *name = param_spec->name;
-  const GValue *value = tp_asv_lookup (asv, name);
 
-  if (tp_asv_lookup (asv, name) == NULL)
-    {
-      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "%s not found in parameters", name);
-      return NULL;
-    }
+  g_assert (value != NULL);
 
   switch (param_spec->dtype[0])
     {
@@ -1568,16 +1606,20 @@ tp_base_protocol_sanitize_parameters (TpBaseProtocol *self,
     GError **error)
 {
   GHashTable *combined;
+  GHashTable *index;
   const TpCMParamSpec *parameters;
+  const GValue **supplied;
   guint i;
   guint mandatory_flag;
 
   parameters = tp_base_protocol_get_parameters (self);
+  index = tp_base_protocol_get_parameter_index (self, parameters);
+  supplied = g_new0 (const GValue *, self->priv->n_parameters + 1);
 
   combined = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, (GDestroyNotify) tp_g_value_slice_free);
 
-  if (!_tp_cm_param_spec_check_all_allowed (parameters, asv, error))
+  if (!_tp_cm_param_spec_check_all_allowed (index, asv, supplied, error))
     goto except;
 
   if (tp_asv_get_boolean (asv, "register", NULL))
@@ -1593,11 +1635,11 @@ tp_base_protocol_sanitize_parameters (TpBaseProtocol *self,
     {
       const gchar *name = parameters[i].name;
 
-      if (tp_asv_lookup (asv, name) != NULL)
+      if (supplied[i] != NULL)
         {
           /* coerce to the expected type */
           GValue *coerced = _tp_cm_param_spec_coerce (parameters + i, asv,
-              error);
+              supplied[i], error);
 
           if (coerced == NULL)
             goto except;
@@ -1664,9 +1706,11 @@ tp_base_protocol_sanitize_parameters (TpBaseProtocol *self,
         }
     }
 
+  g_free (supplied);
   return combined;
 
 except:
+  g_free (supplied);
   g_hash_table_unref (combined);
   return NULL;
 }
@@ -1753,6 +1797,72 @@ protocol_normalize_contact (TpSvcProtocol *protocol,
     }
 }
 
+static void
+protocol_normalize_contacts (TpSvcProtocol *protocol,
+    const gchar **contacts,
+    DBusGMethodInvocation *context)
+{
+  TpBaseProtocol *self = TP_BASE_PROTOCOL (protocol);
+  TpBaseProtocolClass *cls = TP_BASE_PROTOCOL_GET_CLASS (self);
+  GHashTable *normalized;
+  GHashTable *errors;
+  guint i;
+
+  g_return_if_fail (cls != NULL);
+
+  if (cls->normalize_contact == NULL)
+    {
+      GError *error = g_error_new_literal (TP_ERROR,
+          TP_ERROR_NOT_IMPLEMENTED,
+          "This Protocol does not implement NormalizeContact");
+
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+      return;
+    }
+
+  /* the keys are borrowed from @contacts */
+  normalized = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  errors = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) tp_value_array_free);
+
+  for (i = 0; contacts != NULL && contacts[i] != NULL; i++)
+    {
+      GError *error = NULL;
+      gchar *ret;
+
+      if (g_hash_table_contains (normalized, contacts[i]) ||
+          g_hash_table_contains (errors, contacts[i]))
+        continue;
+
+      ret = cls->normalize_contact (self, contacts[i], &error);
+
+      if (ret != NULL)
+        {
+          g_hash_table_insert (normalized, (gchar *) contacts[i], ret);
+        }
+      else
+        {
+          const gchar *name = TP_ERROR_STR_INVALID_HANDLE;
+
+          if (error->domain == TP_ERROR)
+            name = tp_error_get_dbus_name (error->code);
+
+          g_hash_table_insert (errors, (gchar *) contacts[i],
+              tp_value_array_build (2,
+                G_TYPE_STRING, name,
+                G_TYPE_STRING, error->message,
+                G_TYPE_INVALID));
+          g_error_free (error);
+        }
+    }
+
+  tp_svc_protocol_return_from_normalize_contacts (context, normalized,
+      errors);
+  g_hash_table_unref (normalized);
+  g_hash_table_unref (errors);
+}
+
 static void
 protocol_identify_account (TpSvcProtocol *protocol,
     GHashTable *parameters,
@@ -1879,6 +1989,7 @@ protocol_iface_init (TpSvcProtocolClass *cls)
 {
 #define IMPLEMENT(x) tp_svc_protocol_implement_##x (cls, protocol_##x)
   IMPLEMENT (normalize_contact);
+  IMPLEMENT (normalize_contacts);
   IMPLEMENT (identify_account);
 #undef IMPLEMENT
 }
@@ -196,15 +196,22 @@ struct _TpBaseRoomConfigPrivate {
     TpIntset *mutable_properties;
     gboolean configuration_retrieved;
 
-    /* Contains elements of TpBaseRoomConfigProperty which are known to have
-     * changed since we last emitted PropertiesChanged.
+    /* Contains elements of TpBaseRoomConfigProperty which have been set to
+     * a different value since we last emitted PropertiesChanged.
      */
     TpIntset *changed_properties;
+    /* For each of changed_properties, the value we last emitted, so that a
+     * property which has been changed back by then is not signalled.
+     */
+    GValue *emitted_values[TP_NUM_BASE_ROOM_CONFIG_PROPERTIES];
     /* These two properties are not elements of TpBaseRoomConfigProperty; we
-     * track 'em separately.
+     * track 'em separately. emitted_can_update_configuration is only
+     * meaningful if can_update_configuration_changed is TRUE, and
+     * emitted_mutable_properties is NULL until mutable_properties changes.
      */
     gboolean can_update_configuration_changed;
-    gboolean mutable_properties_changed;
+    gboolean emitted_can_update_configuration;
+    TpIntset *emitted_mutable_properties;
 
     /* Details of a pending update, or both NULL if no call to
      * UpdateConfiguration is in progress.
@@ -241,6 +248,30 @@ static gboolean tp_base_room_config_update_finish (
     GAsyncResult *result,
     GError **error);
 
+/* The TpBaseRoomConfigProperty enum is used to index into this array: be
+ * careful! */
+static TpDBusPropertiesMixinPropImpl room_config_properties[] = {
+  /* Configuration */
+  { "Anonymous", "anonymous", NULL, },
+  { "InviteOnly", "invite-only", NULL },
+  { "Limit", "limit", NULL },
+  { "Moderated", "moderated", NULL },
+  { "Title", "title", NULL },
+  { "Description", "description", NULL },
+  { "Persistent", "persistent", NULL },
+  { "Private", "private", NULL },
+  { "PasswordProtected", "password-protected", NULL },
+  { "Password", "password", NULL },
+  { "PasswordHint", "password-hint", NULL },
+
+  /* Meta-data */
+  { "CanUpdateConfiguration", "can-update-configuration", NULL },
+  { "MutableProperties", "mutable-properties", NULL },
+  { "ConfigurationRetrieved", "configuration-retrieved", NULL },
+
+  { NULL }
+};
+
 static void
 tp_base_room_config_init (TpBaseRoomConfig *self)
 {
@@ -265,11 +296,10 @@ add_properties_from_intset (
   tp_intset_fast_iter_init (&iter, properties);
   while (tp_intset_fast_iter_next (&iter, &i))
     {
-      const gchar *property_name = _tp_enum_to_nick (
-          TP_TYPE_BASE_ROOM_CONFIG_PROPERTY, i);
-
-      g_assert (property_name != NULL);
-      g_ptr_array_add (property_names, (gchar *) property_name);
+      g_assert (i < TP_NUM_BASE_ROOM_CONFIG_PROPERTIES);
+      /* the nicknames are the D-Bus property names, in the same order */
+      g_ptr_array_add (property_names,
+          (gchar *) room_config_properties[i].name);
     }
 }
 
@@ -356,6 +386,27 @@ channel_died_cb (
   priv->channel = NULL;
 }
 
+/* Called from set_property just before @id first changes after
+ * PropertiesChanged was emitted, to remember the value that clients have */
+static void
+mark_changed (TpBaseRoomConfig *self,
+    TpBaseRoomConfigProperty id,
+    guint property_id,
+    GParamSpec *pspec)
+{
+  TpBaseRoomConfigPrivate *priv = self->priv;
+  GValue *value;
+
+  if (tp_intset_is_member (priv->changed_properties, id))
+    return;
+
+  value = tp_g_value_slice_new (G_PARAM_SPEC_VALUE_TYPE (pspec));
+  tp_base_room_config_get_property ((GObject *) self, property_id, value,
+      pspec);
+  priv->emitted_values[id] = value;
+  tp_intset_add (priv->changed_properties, id);
+}
+
 static void
 tp_base_room_config_set_property (
     GObject *object,
@@ -387,8 +438,8 @@ tp_base_room_config_set_property (
       { \
         gboolean lowercase = g_value_get_boolean (value); \
         if (!priv->lowercase != !lowercase) \
-          tp_intset_add (priv->changed_properties, \
-              TP_BASE_ROOM_CONFIG_ ## uppercase); \
+          mark_changed (self, TP_BASE_ROOM_CONFIG_ ## uppercase, \
+              property_id, pspec); \
         priv->lowercase = lowercase; \
         break; \
       }
@@ -397,8 +448,8 @@ tp_base_room_config_set_property (
       { \
         gchar *lowercase = g_value_dup_string (value); \
         if (tp_strdiff (priv->lowercase, lowercase)) \
-          tp_intset_add (priv->changed_properties, \
-              TP_BASE_ROOM_CONFIG_ ## uppercase); \
+          mark_changed (self, TP_BASE_ROOM_CONFIG_ ## uppercase, \
+              property_id, pspec); \
         g_free (priv->lowercase); \
         priv->lowercase = lowercase; \
         break; \
@@ -414,8 +465,7 @@ CASE_BOOL (INVITE_ONLY, invite_only)
         guint limit = g_value_get_uint (value);
 
         if (limit != priv->limit)
-          tp_intset_add (priv->changed_properties,
-              TP_BASE_ROOM_CONFIG_LIMIT);
+          mark_changed (self, TP_BASE_ROOM_CONFIG_LIMIT, property_id, pspec);
 
         priv->limit = limit;
         break;
@@ -438,8 +488,13 @@ CASE_STRING (PASSWORD_HINT, password_hint)
       {
         gboolean can_update_configuration = g_value_get_boolean (value);
 
-        if (!priv->can_update_configuration != !can_update_configuration)
-          priv->can_update_configuration_changed = TRUE;
+        if (!priv->can_update_configuration != !can_update_configuration &&
+            !priv->can_update_configuration_changed)
+          {
+            priv->emitted_can_update_configuration =
+                priv->can_update_configuration;
+            priv->can_update_configuration_changed = TRUE;
+          }
 
         priv->can_update_configuration = can_update_configuration;
         break;
@@ -508,6 +563,7 @@ tp_base_room_config_finalize (GObject *object)
   TpBaseRoomConfig *self = TP_BASE_ROOM_CONFIG (object);
   GObjectClass *parent_class = tp_base_room_config_parent_class;
   TpBaseRoomConfigPrivate *priv = self->priv;
+  guint i;
 
   g_free (priv->title);
   g_free (priv->description);
@@ -515,6 +571,10 @@ tp_base_room_config_finalize (GObject *object)
   g_free (priv->password_hint);
   tp_intset_destroy (priv->mutable_properties);
   tp_intset_destroy (priv->changed_properties);
+  tp_clear_pointer (&priv->emitted_mutable_properties, tp_intset_destroy);
+
+  for (i = 0; i < TP_NUM_BASE_ROOM_CONFIG_PROPERTIES; i++)
+    tp_clear_pointer (&priv->emitted_values[i], tp_g_value_slice_free);
 
   if (priv->update_configuration_ctx != NULL)
     {
@@ -674,30 +734,6 @@ room_config_getter (
   g_object_get_property ((GObject *) self, getter_data, value);
 }
 
-/* The TpBaseRoomConfigProperty enum is used to index into this array: be
- * careful! */
-static TpDBusPropertiesMixinPropImpl room_config_properties[] = {
-  /* Configuration */
-  { "Anonymous", "anonymous", NULL, },
-  { "InviteOnly", "invite-only", NULL },
-  { "Limit", "limit", NULL },
-  { "Moderated", "moderated", NULL },
-  { "Title", "title", NULL },
-  { "Description", "description", NULL },
-  { "Persistent", "persistent", NULL },
-  { "Private", "private", NULL },
-  { "PasswordProtected", "password-protected", NULL },
-  { "Password", "password", NULL },
-  { "PasswordHint", "password-hint", NULL },
-
-  /* Meta-data */
-  { "CanUpdateConfiguration", "can-update-configuration", NULL },
-  { "MutableProperties", "mutable-properties", NULL },
-  { "ConfigurationRetrieved", "configuration-retrieved", NULL },
-
-  { NULL }
-};
-
 /**
  * tp_base_room_config_register_class:
  * @base_channel_class: the class structure for a subclass of #TpBaseChannel
@@ -723,50 +759,65 @@ tp_base_room_config_register_class (
       room_config_getter, NULL, room_config_properties);
 }
 
-/* This is almost copy-pasta from _tp_dbus_properties_mixin_find_prop_impl,
- * except this operates on the IfaceInfo structure…
+/* Indexes into room_config_properties, built on first use: from
+ * unqualified D-Bus property names to TpBaseRoomConfigProperty values plus
+ * one, and from the latter to the D-Bus type information.
  */
+static GHashTable *property_ids = NULL;
 static TpDBusPropertiesMixinPropInfo *
-find_prop_info (
-    TpDBusPropertiesMixinIfaceInfo *iface_info,
-    const gchar *property_name)
+    property_infos[TP_NUM_BASE_ROOM_CONFIG_PROPERTIES];
+
+static gboolean
+ensure_property_index (void)
 {
-  GQuark prop_quark = g_quark_try_string (property_name);
-  TpDBusPropertiesMixinPropInfo *prop_info;
+  TpDBusPropertiesMixinIfaceInfo *iface_info;
+  guint i;
+
+  if (G_LIKELY (property_ids != NULL))
+    return TRUE;
 
-  if (prop_quark == 0)
-    return NULL;
+  iface_info = tp_svc_interface_get_dbus_properties_info (
+      TP_TYPE_SVC_CHANNEL_INTERFACE_ROOM_CONFIG);
+  g_return_val_if_fail (iface_info != NULL, FALSE);
+
+  property_ids = g_hash_table_new (g_str_hash, g_str_equal);
 
-  for (prop_info = iface_info->props;
-       prop_info->name != 0;
-       prop_info++)
+  for (i = 0; i < TP_NUM_BASE_ROOM_CONFIG_PROPERTIES; i++)
     {
-      if (prop_info->name == prop_quark)
-        return prop_info;
+      GQuark prop_quark = g_quark_from_static_string (
+          room_config_properties[i].name);
+      TpDBusPropertiesMixinPropInfo *prop_info;
+
+      g_hash_table_insert (property_ids,
+          (gchar *) room_config_properties[i].name, GUINT_TO_POINTER (i + 1));
+
+      for (prop_info = iface_info->props;
+           prop_info->name != 0;
+           prop_info++)
+        {
+          if (prop_info->name == prop_quark)
+            {
+              property_infos[i] = prop_info;
+              break;
+            }
+        }
     }
 
-  return NULL;
+  return TRUE;
 }
 
 static gboolean
 validate_property_type (
+    guint property_id,
     const gchar *property_name,
     const GValue *value,
     GError **error)
 {
-  static TpDBusPropertiesMixinIfaceInfo *iface_info = NULL;
-  TpDBusPropertiesMixinPropInfo *prop_info;
-
-  if (G_UNLIKELY (iface_info == NULL))
-    iface_info = tp_svc_interface_get_dbus_properties_info (
-          TP_TYPE_SVC_CHANNEL_INTERFACE_ROOM_CONFIG);
-
-  g_return_val_if_fail (iface_info != NULL, FALSE);
+  TpDBusPropertiesMixinPropInfo *prop_info = property_infos[property_id];
 
   /* If we recognise the property name, but it's not registered with
    * TpDBusPropertiesMixin, then something is really screw-y.
    */
-  prop_info = find_prop_info (iface_info, property_name);
   g_return_val_if_fail (prop_info != NULL, FALSE);
 
   /* TODO: transform types just like TpDBusPropertiesMixin does. We only
@@ -794,16 +845,18 @@ validate_property (
     GError **error)
 {
   TpBaseRoomConfigPrivate *priv = self->priv;
-  gint property_id;
+  guint property_id = GPOINTER_TO_UINT (g_hash_table_lookup (property_ids,
+        property_name));
 
-  if (!_tp_enum_from_nick (TP_TYPE_BASE_ROOM_CONFIG_PROPERTY,
-          property_name, &property_id))
+  if (property_id == 0)
     {
       g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
           "'%s' is not a known RoomConfig property.", property_name);
       return FALSE;
     }
 
+  property_id--;
+
   if (!tp_intset_is_member (priv->mutable_properties, property_id))
     {
       g_set_error (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
@@ -811,7 +864,7 @@ validate_property (
       return FALSE;
     }
 
-  if (!validate_property_type (property_name, value, error))
+  if (!validate_property_type (property_id, property_name, value, error))
     return FALSE;
 
   g_hash_table_insert (validated_properties,
@@ -842,6 +895,14 @@ validate_properties (
   GHashTableIter iter;
   gpointer k, v;
 
+  if (!ensure_property_index ())
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_CONFUSED,
+          "Internal error: RoomConfig properties are not registered");
+      g_hash_table_unref (validated_properties);
+      return NULL;
+    }
+
   g_hash_table_iter_init (&iter, properties);
   while (g_hash_table_iter_next (&iter, &k, &v))
     {
@@ -1102,42 +1163,33 @@ tp_base_room_config_set_property_mutable (
     gboolean is_mutable)
 {
   TpBaseRoomConfigPrivate *priv = self->priv;
-  gboolean changed = FALSE;
 
   g_return_if_fail (TP_IS_BASE_ROOM_CONFIG (self));
   g_return_if_fail (property_id < TP_NUM_BASE_ROOM_CONFIG_PROPERTIES);
 
+  if (!tp_intset_is_member (priv->mutable_properties, property_id) ==
+      !is_mutable)
+    return;
+
+  if (priv->emitted_mutable_properties == NULL)
+    priv->emitted_mutable_properties = tp_intset_copy (
+        priv->mutable_properties);
+
   /* Grr. Damn _add and _remove functions for being asymmetrical. */
-  if (!is_mutable)
-    {
-      changed = tp_intset_remove (priv->mutable_properties, property_id);
-    }
-  else if (!tp_intset_is_member (priv->mutable_properties, property_id))
-    {
-      tp_intset_add (priv->mutable_properties, property_id);
-      changed = TRUE;
-    }
+  if (is_mutable)
+    tp_intset_add (priv->mutable_properties, property_id);
+  else
+    tp_intset_remove (priv->mutable_properties, property_id);
 
-  if (changed)
-    {
-      g_object_notify ((GObject *) self, "mutable-properties");
-      priv->mutable_properties_changed = TRUE;
-   }
+  g_object_notify ((GObject *) self, "mutable-properties");
 }
 
-/**
- * tp_base_room_config_emit_properties_changed:
- * @self: a #TpBaseRoomConfig object.
- *
- * Signal the new values of properties which have been modified since the last
- * call to this method, if any. This includes changes made by calling
- * tp_base_room_config_set_can_update_configuration() and
- * tp_base_room_config_set_property_mutable(), as well as changes to any of the
- * (writeable) GObject properties on this object.
- */
-void
-tp_base_room_config_emit_properties_changed (
-    TpBaseRoomConfig *self)
+/* Emits PropertiesChanged for whatever has really changed since last time,
+ * plus @extra (which may be NULL) if it is not already included */
+static void
+tp_base_room_config_emit_properties_changed_with (
+    TpBaseRoomConfig *self,
+    const gchar *extra)
 {
   TpBaseRoomConfigPrivate *priv;
 
@@ -1152,28 +1204,68 @@ tp_base_room_config_emit_properties_changed (
     }
   else
     {
+      GObjectClass *object_class = G_OBJECT_GET_CLASS (self);
       GPtrArray *changed = g_ptr_array_new ();
+      TpIntsetFastIter iter;
+      guint i;
+
+      tp_intset_fast_iter_init (&iter, priv->changed_properties);
+      while (tp_intset_fast_iter_next (&iter, &i))
+        {
+          GParamSpec *pspec = g_object_class_find_property (object_class,
+              room_config_properties[i].getter_data);
+          GValue value = G_VALUE_INIT;
+
+          g_assert (pspec != NULL);
+          g_assert (priv->emitted_values[i] != NULL);
+
+          g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+          g_object_get_property ((GObject *) self, pspec->name, &value);
+
+          if (g_param_values_cmp (pspec, &value, priv->emitted_values[i]) != 0)
+            g_ptr_array_add (changed,
+                (gchar *) room_config_properties[i].name);
+
+          g_value_unset (&value);
+          tp_clear_pointer (&priv->emitted_values[i], tp_g_value_slice_free);
+        }
 
-      add_properties_from_intset (changed, priv->changed_properties);
       tp_intset_clear (priv->changed_properties);
 
-      if (priv->mutable_properties_changed)
+      if (priv->emitted_mutable_properties != NULL)
         {
-          g_ptr_array_add (changed, "MutableProperties");
-          priv->mutable_properties_changed = FALSE;
+          if (!tp_intset_is_equal (priv->emitted_mutable_properties,
+                  priv->mutable_properties))
+            g_ptr_array_add (changed, "MutableProperties");
+
+          tp_clear_pointer (&priv->emitted_mutable_properties,
+              tp_intset_destroy);
         }
 
       if (priv->can_update_configuration_changed)
         {
-          g_ptr_array_add (changed, "CanUpdateConfiguration");
+          if (!priv->emitted_can_update_configuration !=
+              !priv->can_update_configuration)
+            g_ptr_array_add (changed, "CanUpdateConfiguration");
+
           priv->can_update_configuration_changed = FALSE;
         }
 
+      if (extra != NULL)
+        g_ptr_array_add (changed, (gchar *) extra);
+
       if (changed->len > 0)
         {
           g_ptr_array_add (changed, NULL);
-          DEBUG ("emitting PropertiesChanged for %s",
-              g_strjoinv (", ", (gchar **) changed->pdata));
+
+          if (DEBUGGING)
+            {
+              gchar *names = g_strjoinv (", ", (gchar **) changed->pdata);
+
+              DEBUG ("emitting PropertiesChanged for %s", names);
+              g_free (names);
+            }
+
           tp_dbus_properties_mixin_emit_properties_changed (
               G_OBJECT (priv->channel),
               TP_IFACE_CHANNEL_INTERFACE_ROOM_CONFIG,
@@ -1184,6 +1276,27 @@ tp_base_room_config_emit_properties_changed (
     }
 }
 
+/**
+ * tp_base_room_config_emit_properties_changed:
+ * @self: a #TpBaseRoomConfig object.
+ *
+ * Signal the new values of properties which have been modified since the last
+ * call to this method, if any. This includes changes made by calling
+ * tp_base_room_config_set_can_update_configuration() and
+ * tp_base_room_config_set_property_mutable(), as well as changes to any of the
+ * (writeable) GObject properties on this object.
+ *
+ * Changed in 0.UNRELEASED: properties which have been changed and then
+ * set back to the value they had when this method was last called are no
+ * longer signalled.
+ */
+void
+tp_base_room_config_emit_properties_changed (
+    TpBaseRoomConfig *self)
+{
+  tp_base_room_config_emit_properties_changed_with (self, NULL);
+}
+
 /**
  * tp_base_room_config_set_retrieved:
  * @self: a #TpBaseRoomConfig object
@@ -1194,6 +1307,12 @@ tp_base_room_config_emit_properties_changed (
  *
  * It is safe to call this function more than once; second and subsequent calls
  * are equivalent to calling tp_base_room_config_emit_properties_changed().
+ *
+ * Changed in 0.UNRELEASED: the change to
+ * #TpBaseRoomConfig:configuration-retrieved is signalled in the same
+ * PropertiesChanged signal as the queued property changes, rather than in a
+ * second signal, which halves the signals a connection manager joining
+ * many rooms emits.
  */
 void
 tp_base_room_config_set_retrieved (
@@ -1211,15 +1330,15 @@ tp_base_room_config_set_retrieved (
       g_return_if_reached ();
     }
 
-  /* Flush any pending property changes */
-  tp_base_room_config_emit_properties_changed (self);
-
-  if (!priv->configuration_retrieved)
+  /* Flush any pending property changes, in the same signal */
+  if (priv->configuration_retrieved)
+    {
+      tp_base_room_config_emit_properties_changed_with (self, NULL);
+    }
+  else
     {
       priv->configuration_retrieved = TRUE;
-      tp_dbus_properties_mixin_emit_properties_changed_varargs (
-          G_OBJECT (priv->channel),
-          TP_IFACE_CHANNEL_INTERFACE_ROOM_CONFIG,
-          "ConfigurationRetrieved", NULL);
+      tp_base_room_config_emit_properties_changed_with (self,
+          "ConfigurationRetrieved");
     }
 }
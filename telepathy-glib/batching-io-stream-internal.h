@@ -0,0 +1,51 @@
+/*<private_header>*/
+/* A GIOStream which coalesces small writes (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_BATCHING_IO_STREAM_INTERNAL_H__
+#define __TP_BATCHING_IO_STREAM_INTERNAL_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpBatchingIOStream _TpBatchingIOStream;
+typedef struct _TpBatchingIOStreamClass _TpBatchingIOStreamClass;
+
+#define _TP_TYPE_BATCHING_IO_STREAM (_tp_batching_io_stream_get_type ())
+#define _TP_BATCHING_IO_STREAM(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), _TP_TYPE_BATCHING_IO_STREAM, \
+                               _TpBatchingIOStream))
+
+GType _tp_batching_io_stream_get_type (void) G_GNUC_CONST;
+
+_TpBatchingIOStream *_tp_batching_io_stream_new (GIOStream *base_stream,
+    guint max_delay_ms,
+    gsize max_bytes);
+
+void _tp_batching_io_stream_count_message (_TpBatchingIOStream *self);
+
+void _tp_batching_io_stream_get_stats (_TpBatchingIOStream *self,
+    guint64 *messages,
+    guint64 *bytes,
+    guint64 *writes);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,914 @@
+/* A GIOStream which coalesces small writes
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/batching-io-stream-internal.h"
+
+#include <telepathy-glib/gnio-util.h>
+#include <telepathy-glib/util.h>
+#include <telepathy-glib/util-internal.h>
+
+#define DEBUG_FLAG TP_DEBUG_CHANNEL
+#include "telepathy-glib/debug-internal.h"
+
+#ifdef HAVE_GIO_UNIX
+#include <gio/gunixconnection.h>
+#endif
+
+/* The output stream accepts asynchronous writes straight into a buffer, and
+ * only writes the buffer to the underlying stream when it has been waiting
+ * for max_delay_ms, when it reaches max_bytes, or when it is flushed or
+ * closed: much like Nagle's algorithm, this turns a burst of small D-Bus
+ * messages into one write. If max_bytes are waiting while an earlier batch
+ * is still being written, the next write doesn't complete until that batch
+ * has gone, so a slow peer throttles the writer.
+ *
+ * GDBusConnection only writes synchronously while authenticating, before
+ * the first message; synchronous writes go straight through. GDBus only
+ * sends credentials with the NUL byte which starts authentication if its
+ * stream is a GUnixConnection, which this one isn't, so we do it on its
+ * behalf.
+ *
+ * Everything else, including reading, is passed through to the underlying
+ * stream, counting the bytes. The counters are read from another thread
+ * than the GDBus worker's, hence the lock. */
+
+G_LOCK_DEFINE_STATIC (stats);
+
+/* ---- output ---- */
+
+typedef struct {
+    GOutputStream parent;
+
+    GOutputStream *base;
+    /* if not NULL, the first byte is sent with our credentials on this */
+    GSocketConnection *credentials_connection;
+    guint max_delay_ms;
+    gsize max_bytes;
+
+    /* accepted but not yet given to @base */
+    GByteArray *pending;
+    /* being written to @base, if not empty */
+    GByteArray *in_flight;
+    gsize in_flight_written;
+
+    GMainContext *context;
+    GSource *timeout;
+    /* a write which is waiting for @pending to have room */
+    GSimpleAsyncResult *blocked_write;
+    /* flushes and closes waiting for everything to be written */
+    GQueue flush_waiters;
+    /* once set, every later operation fails with it */
+    GError *error;
+
+    /* protected by the stats lock */
+    guint64 bytes;
+    guint64 writes;
+} _TpBatchingOutputStream;
+
+typedef GOutputStreamClass _TpBatchingOutputStreamClass;
+
+static GType _tp_batching_output_stream_get_type (void);
+
+G_DEFINE_TYPE (_TpBatchingOutputStream, _tp_batching_output_stream,
+    G_TYPE_OUTPUT_STREAM)
+
+static void
+_tp_batching_output_stream_init (_TpBatchingOutputStream *self)
+{
+  self->pending = g_byte_array_new ();
+  self->in_flight = g_byte_array_new ();
+  g_queue_init (&self->flush_waiters);
+}
+
+static void
+_tp_batching_output_stream_finalize (GObject *object)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) object;
+
+  g_assert (self->blocked_write == NULL);
+  g_assert (g_queue_is_empty (&self->flush_waiters));
+
+  if (self->timeout != NULL)
+    {
+      g_source_destroy (self->timeout);
+      g_source_unref (self->timeout);
+    }
+
+  g_byte_array_unref (self->pending);
+  g_byte_array_unref (self->in_flight);
+  tp_clear_pointer (&self->context, g_main_context_unref);
+  g_clear_error (&self->error);
+  tp_clear_object (&self->credentials_connection);
+  g_object_unref (self->base);
+
+  G_OBJECT_CLASS (_tp_batching_output_stream_parent_class)->finalize (
+      object);
+}
+
+static void
+output_count_written (_TpBatchingOutputStream *self,
+    gsize n)
+{
+  G_LOCK (stats);
+  self->bytes += n;
+  self->writes++;
+  G_UNLOCK (stats);
+}
+
+static void output_start_flush (_TpBatchingOutputStream *self);
+
+static gboolean
+output_timeout_cb (gpointer user_data)
+{
+  _TpBatchingOutputStream *self = user_data;
+
+  tp_clear_pointer (&self->timeout, g_source_unref);
+  output_start_flush (self);
+  return FALSE;
+}
+
+static void
+output_arm_timeout (_TpBatchingOutputStream *self)
+{
+  if (self->timeout != NULL || self->pending->len == 0)
+    return;
+
+  self->timeout = g_timeout_source_new (self->max_delay_ms);
+  g_source_set_callback (self->timeout, output_timeout_cb, self, NULL);
+  g_source_attach (self->timeout, self->context);
+}
+
+/* Complete whatever was waiting for the batches to be written. Everything
+ * that doesn't depend on the callbacks must be done before this is
+ * called, since they are likely to write again. */
+static void
+output_wake (_TpBatchingOutputStream *self)
+{
+  if (self->blocked_write != NULL &&
+      (self->error != NULL || self->pending->len < self->max_bytes))
+    {
+      GSimpleAsyncResult *result = self->blocked_write;
+
+      self->blocked_write = NULL;
+
+      if (self->error != NULL)
+        g_simple_async_result_set_from_error (result, self->error);
+
+      g_simple_async_result_complete (result);
+      g_object_unref (result);
+    }
+
+  if (self->error != NULL ||
+      (self->pending->len == 0 && self->in_flight->len == 0))
+    {
+      GSimpleAsyncResult *result;
+
+      while ((result = g_queue_pop_head (&self->flush_waiters)) != NULL)
+        {
+          if (self->error != NULL)
+            g_simple_async_result_set_from_error (result, self->error);
+
+          g_simple_async_result_complete (result);
+          g_object_unref (result);
+        }
+    }
+}
+
+static void output_write_in_flight (_TpBatchingOutputStream *self);
+
+static void
+base_write_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  _TpBatchingOutputStream *self = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+
+  if (n < 0)
+    {
+      DEBUG ("Failed to write %u bytes: %s",
+          self->in_flight->len - (guint) self->in_flight_written,
+          error->message);
+
+      if (self->error == NULL)
+        self->error = error;
+      else
+        g_error_free (error);
+
+      g_byte_array_set_size (self->in_flight, 0);
+      g_byte_array_set_size (self->pending, 0);
+      output_wake (self);
+      goto out;
+    }
+
+  output_count_written (self, n);
+  self->in_flight_written += n;
+
+  if (self->in_flight_written < self->in_flight->len)
+    {
+      output_write_in_flight (self);
+      goto out;
+    }
+
+  g_byte_array_set_size (self->in_flight, 0);
+
+  if (self->pending->len >= self->max_bytes ||
+      !g_queue_is_empty (&self->flush_waiters))
+    output_start_flush (self);
+  else
+    output_arm_timeout (self);
+
+  output_wake (self);
+
+out:
+  g_object_unref (self);
+}
+
+static void
+output_write_in_flight (_TpBatchingOutputStream *self)
+{
+  g_output_stream_write_async (self->base,
+      self->in_flight->data + self->in_flight_written,
+      self->in_flight->len - self->in_flight_written, G_PRIORITY_DEFAULT,
+      NULL, base_write_cb, g_object_ref (self));
+}
+
+static void
+output_start_flush (_TpBatchingOutputStream *self)
+{
+  GByteArray *tmp;
+
+  if (self->in_flight->len > 0 || self->pending->len == 0)
+    return;
+
+  if (self->timeout != NULL)
+    {
+      g_source_destroy (self->timeout);
+      tp_clear_pointer (&self->timeout, g_source_unref);
+    }
+
+  tmp = self->in_flight;
+  self->in_flight = self->pending;
+  self->pending = tmp;
+  self->in_flight_written = 0;
+
+  output_write_in_flight (self);
+}
+
+static void
+output_write_async (GOutputStream *stream,
+    const void *buffer,
+    gsize count,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) stream;
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
+      output_write_async);
+
+  if (self->error != NULL)
+    {
+      g_simple_async_result_set_from_error (result, self->error);
+      goto out;
+    }
+
+  if (self->context == NULL)
+    self->context = g_main_context_ref_thread_default ();
+
+  g_byte_array_append (self->pending, buffer, count);
+  g_simple_async_result_set_op_res_gssize (result, count);
+
+  if (self->pending->len >= self->max_bytes)
+    {
+      output_start_flush (self);
+
+      if (self->pending->len >= self->max_bytes)
+        {
+          /* the previous batch is still being written */
+          self->blocked_write = result;
+          return;
+        }
+    }
+  else
+    {
+      output_arm_timeout (self);
+    }
+
+out:
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+static gssize
+output_write_finish (GOutputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+      G_OBJECT (stream), output_write_async), -1);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return -1;
+
+  return g_simple_async_result_get_op_res_gssize (simple);
+}
+
+static void
+output_flush_async (GOutputStream *stream,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) stream;
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
+      output_flush_async);
+
+  if (self->error != NULL)
+    {
+      g_simple_async_result_set_from_error (result, self->error);
+    }
+  else if (self->pending->len > 0 || self->in_flight->len > 0)
+    {
+      g_queue_push_tail (&self->flush_waiters, result);
+      output_start_flush (self);
+      return;
+    }
+
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+static gboolean
+output_flush_finish (GOutputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (stream, output_flush_async)
+}
+
+/* The underlying stream belongs to the underlying GIOStream, which closes
+ * it: closing only has to write what is left. */
+static void
+output_close_async (GOutputStream *stream,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  output_flush_async (stream, io_priority, cancellable, callback, user_data);
+}
+
+static gboolean
+output_close_finish (GOutputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (stream, output_flush_async)
+}
+
+static gboolean
+output_write_pending_sync (_TpBatchingOutputStream *self,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gsize written;
+
+  if (self->error != NULL)
+    {
+      g_propagate_error (error, g_error_copy (self->error));
+      return FALSE;
+    }
+
+  if (self->in_flight->len > 0)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_PENDING,
+          "An asynchronous write is still in progress");
+      return FALSE;
+    }
+
+  if (self->pending->len == 0)
+    return TRUE;
+
+  if (!g_output_stream_write_all (self->base, self->pending->data,
+        self->pending->len, &written, cancellable, error))
+    return FALSE;
+
+  output_count_written (self, written);
+  g_byte_array_set_size (self->pending, 0);
+  return TRUE;
+}
+
+static gssize
+output_write_fn (GOutputStream *stream,
+    const void *buffer,
+    gsize count,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) stream;
+  gssize n;
+
+  if (!output_write_pending_sync (self, cancellable, error))
+    return -1;
+
+  if (self->credentials_connection != NULL && count > 0)
+    {
+      GSocketConnection *connection = self->credentials_connection;
+      gboolean ok;
+
+      self->credentials_connection = NULL;
+      ok = tp_unix_connection_send_credentials_with_byte (connection,
+          ((const guchar *) buffer)[0], cancellable, error);
+      g_object_unref (connection);
+
+      if (!ok)
+        return -1;
+
+      output_count_written (self, 1);
+      return 1;
+    }
+
+  n = g_output_stream_write (self->base, buffer, count, cancellable, error);
+
+  if (n > 0)
+    output_count_written (self, n);
+
+  return n;
+}
+
+static gboolean
+output_flush_fn (GOutputStream *stream,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) stream;
+
+  return output_write_pending_sync (self, cancellable, error) &&
+    g_output_stream_flush (self->base, cancellable, error);
+}
+
+static gboolean
+output_close_fn (GOutputStream *stream,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpBatchingOutputStream *self = (_TpBatchingOutputStream *) stream;
+
+  return output_write_pending_sync (self, cancellable, error);
+}
+
+static void
+_tp_batching_output_stream_class_init (_TpBatchingOutputStreamClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+
+  object_class->finalize = _tp_batching_output_stream_finalize;
+
+  cls->write_fn = output_write_fn;
+  cls->flush = output_flush_fn;
+  cls->close_fn = output_close_fn;
+  cls->write_async = output_write_async;
+  cls->write_finish = output_write_finish;
+  cls->flush_async = output_flush_async;
+  cls->flush_finish = output_flush_finish;
+  cls->close_async = output_close_async;
+  cls->close_finish = output_close_finish;
+}
+
+/* ---- input ---- */
+
+typedef struct {
+    GInputStream parent;
+
+    GInputStream *base;
+
+    /* protected by the stats lock */
+    guint64 bytes;
+} _TpCountingInputStream;
+
+typedef GInputStreamClass _TpCountingInputStreamClass;
+
+static GType _tp_counting_input_stream_get_type (void);
+
+G_DEFINE_TYPE (_TpCountingInputStream, _tp_counting_input_stream,
+    G_TYPE_INPUT_STREAM)
+
+static void
+_tp_counting_input_stream_init (_TpCountingInputStream *self)
+{
+}
+
+static void
+_tp_counting_input_stream_finalize (GObject *object)
+{
+  _TpCountingInputStream *self = (_TpCountingInputStream *) object;
+
+  g_object_unref (self->base);
+
+  G_OBJECT_CLASS (_tp_counting_input_stream_parent_class)->finalize (
+      object);
+}
+
+static void
+input_count_read (_TpCountingInputStream *self,
+    gssize n)
+{
+  if (n <= 0)
+    return;
+
+  G_LOCK (stats);
+  self->bytes += n;
+  G_UNLOCK (stats);
+}
+
+static gssize
+input_read_fn (GInputStream *stream,
+    void *buffer,
+    gsize count,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpCountingInputStream *self = (_TpCountingInputStream *) stream;
+  gssize n;
+
+  n = g_input_stream_read (self->base, buffer, count, cancellable, error);
+  input_count_read (self, n);
+  return n;
+}
+
+static void
+base_read_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  _TpCountingInputStream *self = (_TpCountingInputStream *)
+    g_async_result_get_source_object (G_ASYNC_RESULT (result));
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (G_INPUT_STREAM (source), res, &error);
+
+  if (n < 0)
+    {
+      g_simple_async_result_take_error (result, error);
+    }
+  else
+    {
+      input_count_read (self, n);
+      g_simple_async_result_set_op_res_gssize (result, n);
+    }
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+  g_object_unref (self);
+}
+
+static void
+input_read_async (GInputStream *stream,
+    void *buffer,
+    gsize count,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  _TpCountingInputStream *self = (_TpCountingInputStream *) stream;
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
+      input_read_async);
+
+  g_input_stream_read_async (self->base, buffer, count, io_priority,
+      cancellable, base_read_cb, result);
+}
+
+static gssize
+input_read_finish (GInputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+      G_OBJECT (stream), input_read_async), -1);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return -1;
+
+  return g_simple_async_result_get_op_res_gssize (simple);
+}
+
+/* as for the output stream, there's nothing to do here */
+static gboolean
+input_close_fn (GInputStream *stream,
+    GCancellable *cancellable,
+    GError **error)
+{
+  return TRUE;
+}
+
+static void
+input_close_async (GInputStream *stream,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (stream), callback, user_data,
+      input_close_async);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+static gboolean
+input_close_finish (GInputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (stream, input_close_async)
+}
+
+static void
+_tp_counting_input_stream_class_init (_TpCountingInputStreamClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+
+  object_class->finalize = _tp_counting_input_stream_finalize;
+
+  cls->read_fn = input_read_fn;
+  cls->close_fn = input_close_fn;
+  cls->read_async = input_read_async;
+  cls->read_finish = input_read_finish;
+  cls->close_async = input_close_async;
+  cls->close_finish = input_close_finish;
+}
+
+/* ---- the GIOStream ---- */
+
+struct _TpBatchingIOStream {
+    GIOStream parent;
+
+    GIOStream *base;
+    _TpCountingInputStream *input;
+    _TpBatchingOutputStream *output;
+
+    /* protected by the stats lock */
+    guint64 messages;
+};
+
+struct _TpBatchingIOStreamClass {
+    GIOStreamClass parent_class;
+};
+
+G_DEFINE_TYPE (_TpBatchingIOStream, _tp_batching_io_stream, G_TYPE_IO_STREAM)
+
+static void
+_tp_batching_io_stream_init (_TpBatchingIOStream *self)
+{
+}
+
+static void
+_tp_batching_io_stream_finalize (GObject *object)
+{
+  _TpBatchingIOStream *self = (_TpBatchingIOStream *) object;
+
+  g_object_unref (self->input);
+  g_object_unref (self->output);
+  g_object_unref (self->base);
+
+  G_OBJECT_CLASS (_tp_batching_io_stream_parent_class)->finalize (object);
+}
+
+static GInputStream *
+io_get_input_stream (GIOStream *stream)
+{
+  return G_INPUT_STREAM (((_TpBatchingIOStream *) stream)->input);
+}
+
+static GOutputStream *
+io_get_output_stream (GIOStream *stream)
+{
+  return G_OUTPUT_STREAM (((_TpBatchingIOStream *) stream)->output);
+}
+
+static gboolean
+io_close_fn (GIOStream *stream,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpBatchingIOStream *self = (_TpBatchingIOStream *) stream;
+  GError *flush_error = NULL;
+
+  /* try to write whatever is left, but close the base stream regardless */
+  if (!g_output_stream_close (G_OUTPUT_STREAM (self->output), cancellable,
+        &flush_error))
+    {
+      DEBUG ("Failed to write the last batch: %s", flush_error->message);
+    }
+
+  g_input_stream_close (G_INPUT_STREAM (self->input), NULL, NULL);
+
+  if (!g_io_stream_close (self->base, cancellable, error))
+    {
+      g_clear_error (&flush_error);
+      return FALSE;
+    }
+
+  if (flush_error != NULL)
+    {
+      g_propagate_error (error, flush_error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+base_closed_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  GError *error = NULL;
+
+  if (!g_io_stream_close_finish (G_IO_STREAM (source), res, &error))
+    g_simple_async_result_take_error (result, error);
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+static void
+output_closed_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  _TpBatchingIOStream *self = (_TpBatchingIOStream *)
+    g_async_result_get_source_object (G_ASYNC_RESULT (result));
+  GError *error = NULL;
+
+  if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), res, &error))
+    {
+      DEBUG ("Failed to write the last batch: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_input_stream_close (G_INPUT_STREAM (self->input), NULL, NULL);
+  g_io_stream_close_async (self->base, G_PRIORITY_DEFAULT, NULL,
+      base_closed_cb, result);
+  g_object_unref (self);
+}
+
+static void
+io_close_async (GIOStream *stream,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  _TpBatchingIOStream *self = (_TpBatchingIOStream *) stream;
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
+      io_close_async);
+
+  g_output_stream_close_async (G_OUTPUT_STREAM (self->output), io_priority,
+      cancellable, output_closed_cb, result);
+}
+
+static gboolean
+io_close_finish (GIOStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (stream, io_close_async)
+}
+
+static void
+_tp_batching_io_stream_class_init (_TpBatchingIOStreamClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+  GIOStreamClass *stream_class = G_IO_STREAM_CLASS (cls);
+
+  object_class->finalize = _tp_batching_io_stream_finalize;
+
+  stream_class->get_input_stream = io_get_input_stream;
+  stream_class->get_output_stream = io_get_output_stream;
+  stream_class->close_fn = io_close_fn;
+  stream_class->close_async = io_close_async;
+  stream_class->close_finish = io_close_finish;
+}
+
+/*
+ * _tp_batching_io_stream_new:
+ * @base_stream: the stream to wrap
+ * @max_delay_ms: the longest time an asynchronous write is kept waiting
+ *  to be batched with the next ones
+ * @max_bytes: how many bytes are batched before they are written anyway
+ *
+ * Returns: (transfer full): a new stream reading from and writing to
+ *  @base_stream, which is closed when the new stream is
+ */
+_TpBatchingIOStream *
+_tp_batching_io_stream_new (GIOStream *base_stream,
+    guint max_delay_ms,
+    gsize max_bytes)
+{
+  _TpBatchingIOStream *self;
+
+  g_return_val_if_fail (G_IS_IO_STREAM (base_stream), NULL);
+  g_return_val_if_fail (max_bytes > 0, NULL);
+
+  self = g_object_new (_TP_TYPE_BATCHING_IO_STREAM, NULL);
+  self->base = g_object_ref (base_stream);
+
+  self->input = g_object_new (_tp_counting_input_stream_get_type (), NULL);
+  self->input->base = g_object_ref (
+      g_io_stream_get_input_stream (base_stream));
+
+  self->output = g_object_new (_tp_batching_output_stream_get_type (), NULL);
+  self->output->base = g_object_ref (
+      g_io_stream_get_output_stream (base_stream));
+  self->output->max_delay_ms = max_delay_ms;
+  self->output->max_bytes = max_bytes;
+
+#ifdef HAVE_GIO_UNIX
+  if (G_IS_UNIX_CONNECTION (base_stream))
+    self->output->credentials_connection = g_object_ref (base_stream);
+#endif
+
+  return self;
+}
+
+/*
+ * _tp_batching_io_stream_count_message:
+ * @self: a stream
+ *
+ * Count a D-Bus message sent or received on @self. This may be called from
+ * any thread.
+ */
+void
+_tp_batching_io_stream_count_message (_TpBatchingIOStream *self)
+{
+  G_LOCK (stats);
+  self->messages++;
+  G_UNLOCK (stats);
+}
+
+/*
+ * _tp_batching_io_stream_get_stats:
+ * @self: a stream
+ * @messages: (out): the number of times
+ *  _tp_batching_io_stream_count_message() has been called
+ * @bytes: (out): the number of bytes read or written
+ * @writes: (out): the number of writes made to the underlying stream
+ *
+ * This may be called from any thread.
+ */
+void
+_tp_batching_io_stream_get_stats (_TpBatchingIOStream *self,
+    guint64 *messages,
+    guint64 *bytes,
+    guint64 *writes)
+{
+  G_LOCK (stats);
+  *messages = self->messages;
+  *bytes = self->input->bytes + self->output->bytes;
+  *writes = self->output->writes;
+  G_UNLOCK (stats);
+}
@@ -411,10 +411,13 @@ call_state_changed_cb (TpChannel *channel,
   self->priv->state_reason = _tp_call_state_reason_new (reason);
   self->priv->state_details = g_hash_table_ref (details);
 
+  /* so that they are all up to date by the time any is notified */
+  g_object_freeze_notify ((GObject *) self);
   g_object_notify ((GObject *) self, "state");
   g_object_notify ((GObject *) self, "flags");
   g_object_notify ((GObject *) self, "state-reason");
   g_object_notify ((GObject *) self, "state-details");
+  g_object_thaw_notify ((GObject *) self);
 
   g_signal_emit (self, _signals[STATE_CHANGED], 0, self->priv->state,
       self->priv->flags, self->priv->state_reason, self->priv->state_details);
@@ -635,8 +638,10 @@ hold_state_changed_cb (TpChannel *proxy,
   self->priv->hold_state = arg_HoldState;
   self->priv->hold_state_reason = arg_Reason;
 
+  g_object_freeze_notify (G_OBJECT (proxy));
   g_object_notify (G_OBJECT (proxy), "hold-state");
   g_object_notify (G_OBJECT (proxy), "hold-state-reason");
+  g_object_thaw_notify (G_OBJECT (proxy));
 }
 
 static void
@@ -866,7 +871,10 @@ tp_call_channel_class_init (TpCallChannelClass *klass)
    * part of this call.
    *
    * It is NOT guaranteed that %TP_CALL_CONTENT_FEATURE_CORE is prepared on
-   * those objects.
+   * those objects. Since 0.UNRELEASED, nothing is fetched for a content
+   * until it is prepared with tp_proxy_prepare_async(), so that a call
+   * with many contents doesn't cost a round-trip for each one that the
+   * user interface never looks at.
    *
    * Since: 0.17.5
    */
@@ -111,6 +111,8 @@ enum
   PROP_ENABLE_METRICS,
 };
 
+typedef struct _CodecList CodecList;
+
 /* private structure */
 struct _TpCallContentMediaDescriptionPrivate
 {
@@ -121,8 +123,8 @@ struct _TpCallContentMediaDescriptionPrivate
   GPtrArray *interfaces;
   gboolean further_negotiation_required;
   gboolean has_remote_information;
-  /* GPtrArray of owned GValueArray */
-  GPtrArray *codecs;
+  /* owned; shared with other descriptions once interned */
+  CodecList *codecs;
   TpHandle remote_contact;
   /* TpHandle -> reffed GArray<uint> */
   GHashTable *ssrcs;
@@ -142,8 +144,289 @@ struct _TpCallContentMediaDescriptionPrivate
   GSimpleAsyncResult *result;
   GCancellable *cancellable;
   guint handler_id;
+
+  /* owned a{sv} returned by _tp_call_content_media_description_dup_properties,
+   * or NULL if it needs rebuilding */
+  GHashTable *properties;
+};
+
+/* Codec lists
+ *
+ * A conference call typically has one media description per participant,
+ * all listing the same codecs, and each description's codecs get marshalled
+ * every time its properties are read. So rather than a GPtrArray of
+ * GValueArray per description, we keep the codecs in a refcounted structure
+ * which can be hashed and compared. When a description's properties are
+ * first needed its list is interned, so identical lists from different
+ * descriptions are detected and share one copy, which is only marshalled
+ * once. Appending to an interned list copies it first.
+ *
+ * Like the rest of the service-side classes, this is only used from the
+ * main thread, so there is no locking. */
+
+typedef struct
+{
+  guint identifier;
+  gchar *name;
+  guint clock_rate;
+  guint channels;
+  gboolean updated;
+  /* owned string => owned string */
+  GHashTable *parameters;
+} Codec;
+
+struct _CodecList
+{
+  guint ref_count;
+  /* of Codec */
+  GArray *codecs;
+  /* TRUE if we're in interned_codec_lists, and must not change */
+  gboolean interned;
+  /* only valid if interned */
+  guint hash;
+  /* GPtrArray of owned GValueArray, or NULL if not yet marshalled */
+  GPtrArray *marshalled;
 };
 
+/* CodecList => itself, borrowed: lists remove themselves when freed */
+static GHashTable *interned_codec_lists = NULL;
+
+static void
+codec_clear (gpointer p)
+{
+  Codec *codec = p;
+
+  g_free (codec->name);
+  g_hash_table_unref (codec->parameters);
+}
+
+static CodecList *
+codec_list_new (void)
+{
+  CodecList *list = g_slice_new0 (CodecList);
+
+  list->ref_count = 1;
+  list->codecs = g_array_new (FALSE, FALSE, sizeof (Codec));
+  g_array_set_clear_func (list->codecs, codec_clear);
+  return list;
+}
+
+static CodecList *
+codec_list_ref (CodecList *list)
+{
+  list->ref_count++;
+  return list;
+}
+
+static void
+codec_list_unref (CodecList *list)
+{
+  if (--list->ref_count > 0)
+    return;
+
+  if (list->interned)
+    {
+      g_hash_table_remove (interned_codec_lists, list);
+
+      if (g_hash_table_size (interned_codec_lists) == 0)
+        tp_clear_pointer (&interned_codec_lists, g_hash_table_unref);
+    }
+
+  g_array_unref (list->codecs);
+  tp_clear_pointer (&list->marshalled, g_ptr_array_unref);
+  g_slice_free (CodecList, list);
+}
+
+static void
+codec_list_append (CodecList *list,
+    guint identifier,
+    const gchar *name,
+    guint clock_rate,
+    guint channels,
+    gboolean updated,
+    GHashTable *parameters)
+{
+  Codec codec;
+
+  g_assert (!list->interned);
+
+  codec.identifier = identifier;
+  codec.name = g_strdup (name);
+  codec.clock_rate = clock_rate;
+  codec.channels = channels;
+  codec.updated = updated;
+  codec.parameters = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+
+  if (parameters != NULL)
+    tp_g_hash_table_update (codec.parameters, parameters,
+        (GBoxedCopyFunc) g_strdup, (GBoxedCopyFunc) g_strdup);
+
+  g_array_append_val (list->codecs, codec);
+}
+
+static CodecList *
+codec_list_copy (CodecList *list)
+{
+  CodecList *copy = codec_list_new ();
+  guint i;
+
+  for (i = 0; i < list->codecs->len; i++)
+    {
+      Codec *codec = &g_array_index (list->codecs, Codec, i);
+
+      codec_list_append (copy, codec->identifier, codec->name,
+          codec->clock_rate, codec->channels, codec->updated,
+          codec->parameters);
+    }
+
+  return copy;
+}
+
+static guint
+codec_list_hash (gconstpointer p)
+{
+  const CodecList *list = p;
+  guint hash = list->codecs->len;
+  guint i;
+
+  for (i = 0; i < list->codecs->len; i++)
+    {
+      Codec *codec = &g_array_index (list->codecs, Codec, i);
+      GHashTableIter iter;
+      gpointer k, v;
+      guint parameters_hash = 0;
+
+      /* parameters are unordered, so combine them commutatively */
+      g_hash_table_iter_init (&iter, codec->parameters);
+
+      while (g_hash_table_iter_next (&iter, &k, &v))
+        parameters_hash += g_str_hash (k) ^ (g_str_hash (v) * 31);
+
+      hash = hash * 33 + codec->identifier;
+      hash = hash * 33 + g_str_hash (codec->name != NULL ? codec->name : "");
+      hash = hash * 33 + codec->clock_rate;
+      hash = hash * 33 + codec->channels;
+      hash = hash * 33 + (codec->updated ? 1 : 0);
+      hash = hash * 33 + parameters_hash;
+    }
+
+  return hash;
+}
+
+static gboolean
+codec_list_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const CodecList *list_a = a;
+  const CodecList *list_b = b;
+  guint i;
+
+  if (list_a == list_b)
+    return TRUE;
+
+  if (list_a->codecs->len != list_b->codecs->len)
+    return FALSE;
+
+  for (i = 0; i < list_a->codecs->len; i++)
+    {
+      Codec *codec_a = &g_array_index (list_a->codecs, Codec, i);
+      Codec *codec_b = &g_array_index (list_b->codecs, Codec, i);
+      GHashTableIter iter;
+      gpointer k, v;
+
+      if (codec_a->identifier != codec_b->identifier ||
+          tp_strdiff (codec_a->name, codec_b->name) ||
+          codec_a->clock_rate != codec_b->clock_rate ||
+          codec_a->channels != codec_b->channels ||
+          !codec_a->updated != !codec_b->updated ||
+          g_hash_table_size (codec_a->parameters) !=
+              g_hash_table_size (codec_b->parameters))
+        return FALSE;
+
+      g_hash_table_iter_init (&iter, codec_a->parameters);
+
+      while (g_hash_table_iter_next (&iter, &k, &v))
+        {
+          if (tp_strdiff (v, g_hash_table_lookup (codec_b->parameters, k)))
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static guint
+interned_codec_list_hash (gconstpointer p)
+{
+  return ((const CodecList *) p)->hash;
+}
+
+/* Steals @list, and returns a reference to an interned list equal to it,
+ * which may be @list or may be one which was already interned. */
+static CodecList *
+codec_list_intern (CodecList *list)
+{
+  CodecList *existing;
+
+  if (list->interned)
+    return list;
+
+  list->hash = codec_list_hash (list);
+
+  if (interned_codec_lists == NULL)
+    interned_codec_lists = g_hash_table_new (interned_codec_list_hash,
+        codec_list_equal);
+
+  existing = g_hash_table_lookup (interned_codec_lists, list);
+
+  if (existing != NULL)
+    {
+      DEBUG ("reusing identical list of %u codecs", list->codecs->len);
+      codec_list_unref (list);
+      return codec_list_ref (existing);
+    }
+
+  list->interned = TRUE;
+  g_hash_table_add (interned_codec_lists, list);
+  return list;
+}
+
+/* Returns: (transfer none): a TP_ARRAY_TYPE_CODEC_LIST */
+static GPtrArray *
+codec_list_get_marshalled (CodecList *list)
+{
+  guint i;
+
+  if (list->marshalled != NULL)
+    return list->marshalled;
+
+  list->marshalled = g_ptr_array_new_full (list->codecs->len,
+      (GDestroyNotify) tp_value_array_free);
+
+  for (i = 0; i < list->codecs->len; i++)
+    {
+      Codec *codec = &g_array_index (list->codecs, Codec, i);
+
+      g_ptr_array_add (list->marshalled, tp_value_array_build (6,
+          G_TYPE_UINT, codec->identifier,
+          G_TYPE_STRING, codec->name,
+          G_TYPE_UINT, codec->clock_rate,
+          G_TYPE_UINT, codec->channels,
+          G_TYPE_BOOLEAN, codec->updated,
+          TP_HASH_TYPE_STRING_STRING_MAP, codec->parameters,
+          G_TYPE_INVALID));
+    }
+
+  return list->marshalled;
+}
+
+static void
+invalidate_properties (TpCallContentMediaDescription *self)
+{
+  tp_clear_pointer (&self->priv->properties, g_hash_table_unref);
+}
+
 static void
 tp_call_content_media_description_init (TpCallContentMediaDescription *self)
 {
@@ -156,8 +439,7 @@ tp_call_content_media_description_init (TpCallContentMediaDescription *self)
 
   self->priv->ssrcs = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify) g_array_unref);
-  self->priv->codecs = g_ptr_array_new_with_free_func (
-      (GDestroyNotify) tp_value_array_free);
+  self->priv->codecs = codec_list_new ();
 
   self->priv->header_extensions = g_ptr_array_new_with_free_func (
       (GDestroyNotify) tp_value_array_free);
@@ -172,7 +454,8 @@ tp_call_content_media_description_dispose (GObject *object)
 
   g_assert (self->priv->result == NULL);
 
-  tp_clear_pointer (&self->priv->codecs, g_ptr_array_unref);
+  tp_clear_pointer (&self->priv->codecs, codec_list_unref);
+  tp_clear_pointer (&self->priv->properties, g_hash_table_unref);
   tp_clear_pointer (&self->priv->ssrcs, g_hash_table_unref);
   g_clear_object (&self->priv->dbus_daemon);
 
@@ -223,7 +506,9 @@ tp_call_content_media_description_get_property (GObject *object,
         g_value_set_boolean (value, self->priv->has_remote_information);
         break;
       case PROP_CODECS:
-        g_value_set_boxed (value, self->priv->codecs);
+        self->priv->codecs = codec_list_intern (self->priv->codecs);
+        g_value_set_boxed (value,
+            codec_list_get_marshalled (self->priv->codecs));
         break;
       case PROP_REMOTE_CONTACT:
         g_value_set_uint (value, self->priv->remote_contact);
@@ -287,12 +572,15 @@ tp_call_content_media_description_set_property (GObject *object,
         break;
       case PROP_FURTHER_NEGOTIATION_REQUIRED:
         self->priv->further_negotiation_required = g_value_get_boolean (value);
+        invalidate_properties (self);
         break;
       case PROP_HAS_REMOTE_INFORMATION:
         self->priv->has_remote_information = g_value_get_boolean (value);
+        invalidate_properties (self);
         break;
       case PROP_REMOTE_CONTACT:
         self->priv->remote_contact = g_value_get_uint (value);
+        invalidate_properties (self);
         break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -760,6 +1048,7 @@ tp_call_content_media_description_add_ssrc (TpCallContentMediaDescription *self,
         return;
     }
   g_array_append_val (array, ssrc);
+  invalidate_properties (self);
 }
 
 /**
@@ -789,17 +1078,18 @@ tp_call_content_media_description_append_codec (
 {
   g_return_if_fail (TP_IS_CALL_CONTENT_MEDIA_DESCRIPTION (self));
 
-  if (parameters == NULL)
-    parameters = g_hash_table_new (g_str_hash, g_str_equal);
+  if (self->priv->codecs->interned)
+    {
+      /* other descriptions may be sharing it */
+      CodecList *copy = codec_list_copy (self->priv->codecs);
 
-  g_ptr_array_add (self->priv->codecs, tp_value_array_build (6,
-      G_TYPE_UINT, identifier,
-      G_TYPE_STRING, name,
-      G_TYPE_UINT, clock_rate,
-      G_TYPE_UINT, channels,
-      G_TYPE_BOOLEAN, updated,
-      TP_HASH_TYPE_STRING_STRING_MAP, parameters,
-      G_TYPE_INVALID));
+      codec_list_unref (self->priv->codecs);
+      self->priv->codecs = copy;
+    }
+
+  codec_list_append (self->priv->codecs, identifier, name, clock_rate,
+      channels, updated, parameters);
+  invalidate_properties (self);
 }
 
 static void
@@ -814,6 +1104,7 @@ add_interface (TpCallContentMediaDescription *self,
       self->priv->interfaces->len - 1);
   g_ptr_array_add (self->priv->interfaces, (gchar *) interface);
   g_ptr_array_add (self->priv->interfaces, NULL);
+  invalidate_properties (self);
 }
 
 /**
@@ -1166,7 +1457,14 @@ _tp_call_content_media_description_dup_properties (
 {
   g_return_val_if_fail (TP_IS_CALL_CONTENT_MEDIA_DESCRIPTION (self), NULL);
 
-  return tp_asv_new (
+  /* Nothing modifies the returned hash table, so we can keep handing out
+   * the same one until something changes. */
+  if (self->priv->properties != NULL)
+    return g_hash_table_ref (self->priv->properties);
+
+  self->priv->codecs = codec_list_intern (self->priv->codecs);
+
+  self->priv->properties = tp_asv_new (
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_INTERFACES,
           G_TYPE_STRV, self->priv->interfaces->pdata,
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_FURTHER_NEGOTIATION_REQUIRED,
@@ -1174,12 +1472,15 @@ _tp_call_content_media_description_dup_properties (
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_HAS_REMOTE_INFORMATION,
           G_TYPE_BOOLEAN, self->priv->has_remote_information,
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_CODECS,
-          TP_ARRAY_TYPE_CODEC_LIST, self->priv->codecs,
+          TP_ARRAY_TYPE_CODEC_LIST,
+              codec_list_get_marshalled (self->priv->codecs),
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_REMOTE_CONTACT,
           G_TYPE_UINT, self->priv->remote_contact,
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_SSRCS,
           TP_HASH_TYPE_CONTACT_SSRCS_MAP, self->priv->ssrcs,
       NULL);
+
+  return g_hash_table_ref (self->priv->properties);
 }
 
 static void
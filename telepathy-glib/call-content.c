@@ -62,7 +62,6 @@
 #define DEBUG_FLAG TP_DEBUG_CALL
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/call-internal.h"
-#include "telepathy-glib/proxy-internal.h"
 #include "telepathy-glib/util-internal.h"
 
 #include "_gen/tp-cli-call-content-body.h"
@@ -217,6 +216,7 @@ got_all_properties_cb (TpProxy *proxy,
     GObject *weak_object)
 {
   TpCallContent *self = (TpCallContent *) proxy;
+  GSimpleAsyncResult *result = user_data;
   const gchar * const *interfaces;
   GPtrArray *streams;
   guint i;
@@ -224,8 +224,8 @@ got_all_properties_cb (TpProxy *proxy,
   if (error != NULL)
     {
       DEBUG ("Could not get the call content properties: %s", error->message);
-      _tp_proxy_set_feature_prepared (proxy,
-          TP_CALL_CONTENT_FEATURE_CORE, FALSE);
+      g_simple_async_result_set_from_error (result, error);
+      g_simple_async_result_complete (result);
       return;
     }
 
@@ -261,7 +261,7 @@ got_all_properties_cb (TpProxy *proxy,
           tones_stopped_cb, NULL, NULL, NULL, NULL);
     }
 
-  _tp_proxy_set_feature_prepared (proxy, TP_CALL_CONTENT_FEATURE_CORE, TRUE);
+  g_simple_async_result_complete (result);
 }
 
 struct _SendTonesData
@@ -340,7 +340,7 @@ send_tones_cancelled_cb (GCancellable *cancellable,
     SendTonesData *data)
 {
   /* Cancel in idle for thread-safeness */
-  g_idle_add (send_tones_cancelled_idle_cb, data);
+  _tp_idle_add (TP_LATENCY_CLASS_NORMAL, send_tones_cancelled_idle_cb, data);
 }
 
 static void
@@ -416,12 +416,16 @@ maybe_send_tones (TpCallContent *self)
       self->priv->current_tones->tones, multiple_tones_cb, NULL, NULL, NULL);
 }
 
+/* TpCallChannel makes one of these for each content when it is prepared,
+ * so nothing is asked of the CM until this feature is */
 static void
-tp_call_content_constructed (GObject *obj)
+tp_call_content_prepare_core_async (TpProxy *proxy,
+    const TpProxyFeature *feature,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
-  TpCallContent *self = (TpCallContent *) obj;
-
-  ((GObjectClass *) tp_call_content_parent_class)->constructed (obj);
+  TpCallContent *self = (TpCallContent *) proxy;
+  GSimpleAsyncResult *result;
 
   /* Connect signals for mutable properties */
   tp_cli_call_content_connect_to_streams_added (self,
@@ -429,9 +433,12 @@ tp_call_content_constructed (GObject *obj)
   tp_cli_call_content_connect_to_streams_removed (self,
       streams_removed_cb, NULL, NULL, G_OBJECT (self), NULL);
 
+  result = g_simple_async_result_new ((GObject *) self, callback, user_data,
+      tp_call_content_prepare_core_async);
+
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_CALL_CONTENT,
-      got_all_properties_cb, NULL, NULL, G_OBJECT (self));
+      got_all_properties_cb, result, g_object_unref, G_OBJECT (self));
 }
 
 static void
@@ -530,8 +537,8 @@ tp_call_content_list_features (TpProxyClass *cls G_GNUC_UNUSED)
   if (G_LIKELY (features[0].name != 0))
     return features;
 
-  /* started from constructed */
   features[FEAT_CORE].name = TP_CALL_CONTENT_FEATURE_CORE;
+  features[FEAT_CORE].prepare_async = tp_call_content_prepare_core_async;
   features[FEAT_CORE].core = TRUE;
 
   /* assert that the terminator at the end is there */
@@ -547,7 +554,6 @@ tp_call_content_class_init (TpCallContentClass *klass)
   TpProxyClass *proxy_class = (TpProxyClass *) klass;
   GParamSpec *param_spec;
 
-  gobject_class->constructed = tp_call_content_constructed;
   gobject_class->get_property = tp_call_content_get_property;
   gobject_class->set_property = tp_call_content_set_property;
   gobject_class->dispose = tp_call_content_dispose;
@@ -627,7 +633,9 @@ tp_call_content_class_init (TpCallContentClass *klass)
    * part of this content.
    *
    * It is NOT guaranteed that %TP_CALL_STREAM_FEATURE_CORE is prepared on
-   * those objects.
+   * those objects. Since 0.UNRELEASED, nothing is fetched for a stream
+   * until it is prepared with tp_proxy_prepare_async(), and this list is
+   * only filled in once %TP_CALL_CONTENT_FEATURE_CORE is prepared.
    *
    * Since: 0.17.5
    */
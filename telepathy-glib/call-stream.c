@@ -60,7 +60,6 @@
 #define DEBUG_FLAG TP_DEBUG_CALL
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/call-internal.h"
-#include "telepathy-glib/proxy-internal.h"
 #include "telepathy-glib/util-internal.h"
 
 #include "_gen/tp-cli-call-stream-body.h"
@@ -185,6 +184,7 @@ got_all_properties_cb (TpProxy *proxy,
     GObject *weak_object)
 {
   TpCallStream *self = (TpCallStream *) proxy;
+  GSimpleAsyncResult *result = user_data;
   const gchar * const *interfaces;
   GHashTable *remote_members;
   GHashTable *identifiers;
@@ -193,8 +193,8 @@ got_all_properties_cb (TpProxy *proxy,
   if (error != NULL)
     {
       DEBUG ("Could not get the call stream properties: %s", error->message);
-      _tp_proxy_set_feature_prepared (proxy,
-          TP_CALL_STREAM_FEATURE_CORE, FALSE);
+      g_simple_async_result_set_from_error (result, error);
+      g_simple_async_result_complete (result);
       return;
     }
 
@@ -218,15 +218,19 @@ got_all_properties_cb (TpProxy *proxy,
   update_remote_members (self, contacts, NULL);
   g_hash_table_unref (contacts);
 
-  _tp_proxy_set_feature_prepared (proxy, TP_CALL_STREAM_FEATURE_CORE, TRUE);
+  g_simple_async_result_complete (result);
 }
 
+/* TpCallContent makes one of these for each stream when it is prepared,
+ * so nothing is asked of the CM until this feature is */
 static void
-tp_call_stream_constructed (GObject *obj)
+tp_call_stream_prepare_core_async (TpProxy *proxy,
+    const TpProxyFeature *feature,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
-  TpCallStream *self = (TpCallStream *) obj;
-
-  ((GObjectClass *) tp_call_stream_parent_class)->constructed (obj);
+  TpCallStream *self = (TpCallStream *) proxy;
+  GSimpleAsyncResult *result;
 
   /* Connect signals for mutable properties */
   tp_cli_call_stream_connect_to_remote_members_changed (self,
@@ -234,9 +238,12 @@ tp_call_stream_constructed (GObject *obj)
   tp_cli_call_stream_connect_to_local_sending_state_changed (self,
       local_sending_state_changed_cb, NULL, NULL, G_OBJECT (self), NULL);
 
+  result = g_simple_async_result_new ((GObject *) self, callback, user_data,
+      tp_call_stream_prepare_core_async);
+
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_CALL_STREAM,
-      got_all_properties_cb, NULL, NULL, G_OBJECT (self));
+      got_all_properties_cb, result, g_object_unref, G_OBJECT (self));
 }
 
 static void
@@ -317,8 +324,8 @@ tp_call_stream_list_features (TpProxyClass *cls G_GNUC_UNUSED)
   if (G_LIKELY (features[0].name != 0))
     return features;
 
-  /* started from constructed */
   features[FEAT_CORE].name = TP_CALL_STREAM_FEATURE_CORE;
+  features[FEAT_CORE].prepare_async = tp_call_stream_prepare_core_async;
   features[FEAT_CORE].core = TRUE;
 
   /* assert that the terminator at the end is there */
@@ -334,7 +341,6 @@ tp_call_stream_class_init (TpCallStreamClass *klass)
   TpProxyClass *proxy_class = (TpProxyClass *) klass;
   GParamSpec *param_spec;
 
-  gobject_class->constructed = tp_call_stream_constructed;
   gobject_class->get_property = tp_call_stream_get_property;
   gobject_class->set_property = tp_call_stream_set_property;
   gobject_class->dispose = tp_call_stream_dispose;
@@ -30,6 +30,11 @@ G_BEGIN_DECLS
 TpCapabilities * _tp_capabilities_new (const GPtrArray *classes,
     gboolean contact_specific);
 
+guint _tp_capabilities_classes_hash (const GPtrArray *classes);
+gboolean _tp_capabilities_has_classes (TpCapabilities *self,
+    const GPtrArray *classes,
+    gboolean contact_specific);
+
 G_END_DECLS
 
 #endif
@@ -31,6 +31,7 @@
 
 #define DEBUG_FLAG TP_DEBUG_CONNECTION
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
 #include "telepathy-glib/variant-util-internal.h"
 
 /**
@@ -72,12 +73,48 @@ enum {
     N_PROPS
 };
 
+/* Answers to the common questions, worked out once when the object is
+ * constructed, since UIs tend to ask them for every contact on every
+ * redraw. Questions with a free-form argument, like a particular tube
+ * service, still have to look through the classes. */
+typedef enum {
+    FEATURE_TEXT_CHATS = (1 << 0),
+    FEATURE_TEXT_CHATROOMS = (1 << 1),
+    FEATURE_SMS = (1 << 2),
+    FEATURE_AUDIO_CALL_CONTACT = (1 << 3),
+    FEATURE_AUDIO_CALL_ROOM = (1 << 4),
+    FEATURE_AUDIO_CALL_NONE = (1 << 5),
+    FEATURE_AUDIO_VIDEO_CALL_CONTACT = (1 << 6),
+    FEATURE_AUDIO_VIDEO_CALL_ROOM = (1 << 7),
+    FEATURE_AUDIO_VIDEO_CALL_NONE = (1 << 8),
+    FEATURE_FILE_TRANSFER = (1 << 9),
+    FEATURE_FILE_TRANSFER_URI = (1 << 10),
+    FEATURE_FILE_TRANSFER_DESCRIPTION = (1 << 11),
+    FEATURE_FILE_TRANSFER_INITIAL_OFFSET = (1 << 12),
+    FEATURE_FILE_TRANSFER_TIMESTAMP = (1 << 13),
+    FEATURE_STREAM_TUBES_CONTACT = (1 << 14),
+    FEATURE_STREAM_TUBES_ROOM = (1 << 15),
+    FEATURE_DBUS_TUBES_CONTACT = (1 << 16),
+    FEATURE_DBUS_TUBES_ROOM = (1 << 17)
+} Features;
+
 struct _TpCapabilitiesPrivate {
     GPtrArray *classes;
     gboolean contact_specific;
     GVariant *classes_variant;
+    Features features;
+    /* (ba(a{sv}as)) under which we are in shared_capabilities, or NULL */
+    GVariant *shared_key;
 };
 
+/* Contacts on the same connection usually have one of a handful of sets of
+ * capabilities, so _tp_capabilities_new() hands out the same immutable
+ * object for identical sets rather than building one per contact.
+ *
+ * owned GVariant (ba(a{sv}as)) => owned GWeakRef to TpCapabilities */
+static GHashTable *shared_capabilities = NULL;
+G_LOCK_DEFINE_STATIC (shared_capabilities);
+
 /**
  * tp_capabilities_get_channel_classes:
  * @self: a #TpCapabilities object
@@ -115,6 +152,8 @@ tp_capabilities_is_specific_to_contact (TpCapabilities *self)
   return self->priv->contact_specific;
 }
 
+static Features compute_features (TpCapabilities *self);
+
 static void
 tp_capabilities_constructed (GObject *object)
 {
@@ -126,6 +165,8 @@ tp_capabilities_constructed (GObject *object)
 
   if (chain_up != NULL)
     chain_up (object);
+
+  self->priv->features = compute_features (self);
 }
 
 static void
@@ -142,6 +183,32 @@ tp_capabilities_dispose (GObject *object)
 
   tp_clear_pointer (&self->priv->classes_variant, g_variant_unref);
 
+  if (self->priv->shared_key != NULL)
+    {
+      GWeakRef *weak;
+
+      G_LOCK (shared_capabilities);
+
+      /* Our weak ref has already been cleared; but an identical object
+       * might have replaced us in the meantime, in which case leave it be */
+      weak = g_hash_table_lookup (shared_capabilities,
+          self->priv->shared_key);
+
+      if (weak != NULL)
+        {
+          GObject *other = g_weak_ref_get (weak);
+
+          if (other == NULL)
+            g_hash_table_remove (shared_capabilities, self->priv->shared_key);
+          else
+            g_object_unref (other);
+        }
+
+      G_UNLOCK (shared_capabilities);
+
+      tp_clear_pointer (&self->priv->shared_key, g_variant_unref);
+    }
+
   ((GObjectClass *) tp_capabilities_parent_class)->dispose (object);
 }
 
@@ -284,13 +351,38 @@ tp_capabilities_init (TpCapabilities *self)
       TpCapabilitiesPrivate);
 }
 
-/* NULL-safe for @classes */
+static guint
+serialized_variant_hash (gconstpointer v)
+{
+  const guchar *data = g_variant_get_data ((GVariant *) v);
+  gsize size = g_variant_get_size ((GVariant *) v);
+  guint hash = 5381;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    hash = hash * 33 + data[i];
+
+  return hash;
+}
+
+static void
+weak_ref_free (gpointer p)
+{
+  g_weak_ref_clear (p);
+  g_slice_free (GWeakRef, p);
+}
+
+/* NULL-safe for @classes. The result may be shared with other callers who
+ * asked for the same thing, which is fine since it is immutable. */
 TpCapabilities *
 _tp_capabilities_new (const GPtrArray *classes,
     gboolean contact_specific)
 {
   GPtrArray *empty = NULL;
-  TpCapabilities *self;
+  TpCapabilities *self = NULL;
+  GVariant *classes_variant;
+  GVariant *key;
+  GWeakRef *weak;
 
   if (classes == NULL)
     {
@@ -298,17 +390,152 @@ _tp_capabilities_new (const GPtrArray *classes,
       classes = empty;
     }
 
+  classes_variant = _tp_boxed_to_variant (
+      TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, "a(a{sv}as)",
+      (gpointer) classes);
+  key = g_variant_ref_sink (g_variant_new ("(b@a(a{sv}as))",
+        contact_specific, classes_variant));
+  g_variant_unref (classes_variant);
+
+  G_LOCK (shared_capabilities);
+
+  if (shared_capabilities != NULL)
+    {
+      weak = g_hash_table_lookup (shared_capabilities, key);
+
+      if (weak != NULL)
+        self = g_weak_ref_get (weak);
+    }
+
+  G_UNLOCK (shared_capabilities);
+
+  if (self != NULL)
+    goto out;
+
   self = g_object_new (TP_TYPE_CAPABILITIES,
       "channel-classes", classes,
       "contact-specific", contact_specific,
       NULL);
 
+  weak = g_slice_new0 (GWeakRef);
+  g_weak_ref_init (weak, self);
+  self->priv->shared_key = g_variant_ref (key);
+
+  G_LOCK (shared_capabilities);
+
+  if (shared_capabilities == NULL)
+    shared_capabilities = g_hash_table_new_full (serialized_variant_hash,
+        g_variant_equal, (GDestroyNotify) g_variant_unref, weak_ref_free);
+
+  g_hash_table_replace (shared_capabilities, g_variant_ref (key), weak);
+
+  G_UNLOCK (shared_capabilities);
+
+out:
+  g_variant_unref (key);
+
   if (empty != NULL)
     g_ptr_array_unref (empty);
 
   return self;
 }
 
+static guint
+fixed_value_hash (const GValue *value)
+{
+  if (G_VALUE_HOLDS_STRING (value))
+    return g_str_hash (g_value_get_string (value));
+  else if (G_VALUE_HOLDS_UINT (value))
+    return g_value_get_uint (value);
+
+  /* anything else is rare enough in fixed properties not to matter */
+  return 0;
+}
+
+/*
+ * _tp_capabilities_classes_hash:
+ * @classes: (allow-none): a #TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST
+ *
+ * Hash @classes without converting them to a #GVariant, so that contacts'
+ * capabilities can be looked up cheaply whenever they are received. Classes
+ * which are equal according to _tp_capabilities_has_classes() have the same
+ * hash.
+ *
+ * Returns: a hash of @classes
+ */
+guint
+_tp_capabilities_classes_hash (const GPtrArray *classes)
+{
+  guint hash = 5381;
+  guint i;
+
+  if (classes == NULL)
+    return hash;
+
+  for (i = 0; i < classes->len; i++)
+    {
+      GValueArray *arr = g_ptr_array_index (classes, i);
+      GHashTable *fixed;
+      const gchar * const *allowed;
+      GHashTableIter iter;
+      gpointer key, value;
+      guint fixed_hash = 0;
+      guint j;
+
+      tp_value_array_unpack (arr, 2,
+          &fixed,
+          &allowed);
+
+      /* the order of the fixed properties is not significant */
+      g_hash_table_iter_init (&iter, fixed);
+
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        fixed_hash += g_str_hash (key) ^ fixed_value_hash (value);
+
+      hash = hash * 33 + fixed_hash;
+
+      for (j = 0; allowed != NULL && allowed[j] != NULL; j++)
+        hash = hash * 33 + g_str_hash (allowed[j]);
+    }
+
+  return hash;
+}
+
+/*
+ * _tp_capabilities_has_classes:
+ * @self: a #TpCapabilities
+ * @classes: (allow-none): a #TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST
+ * @contact_specific: whether @self should be specific to a contact
+ *
+ * Returns: %TRUE if @self is what _tp_capabilities_new() would return
+ *  for @classes and @contact_specific
+ */
+gboolean
+_tp_capabilities_has_classes (TpCapabilities *self,
+    const GPtrArray *classes,
+    gboolean contact_specific)
+{
+  guint n_classes = (classes == NULL ? 0 : classes->len);
+  guint i;
+
+  if (!self->priv->contact_specific != !contact_specific ||
+      self->priv->classes->len != n_classes)
+    return FALSE;
+
+  for (i = 0; i < n_classes; i++)
+    {
+      GValueArray *ours = g_ptr_array_index (self->priv->classes, i);
+      GValueArray *theirs = g_ptr_array_index (classes, i);
+
+      if (!_tp_asv_equal (g_value_get_boxed (ours->values + 0),
+              g_value_get_boxed (theirs->values + 0)) ||
+          !_tp_g_value_equal (ours->values + 1, theirs->values + 1))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gboolean
 supports_simple_channel (TpCapabilities *self,
     const gchar *expected_chan_type,
@@ -316,8 +543,6 @@ supports_simple_channel (TpCapabilities *self,
 {
   guint i;
 
-  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
-
   for (i = 0; i < self->priv->classes->len; i++)
     {
       GValueArray *arr = g_ptr_array_index (self->priv->classes, i);
@@ -371,8 +596,9 @@ supports_simple_channel (TpCapabilities *self,
 gboolean
 tp_capabilities_supports_text_chats (TpCapabilities *self)
 {
-  return supports_simple_channel (self, TP_IFACE_CHANNEL_TYPE_TEXT,
-      TP_HANDLE_TYPE_CONTACT);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_TEXT_CHATS) != 0;
 }
 
 /**
@@ -402,8 +628,9 @@ tp_capabilities_supports_text_chats (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_text_chatrooms (TpCapabilities *self)
 {
-  return supports_simple_channel (self, TP_IFACE_CHANNEL_TYPE_TEXT,
-      TP_HANDLE_TYPE_ROOM);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_TEXT_CHATROOMS) != 0;
 }
 
 /**
@@ -428,10 +655,16 @@ tp_capabilities_supports_text_chatrooms (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_sms (TpCapabilities *self)
 {
-  guint i;
-
   g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
 
+  return (self->priv->features & FEATURE_SMS) != 0;
+}
+
+static gboolean
+supports_sms (TpCapabilities *self)
+{
+  guint i;
+
   for (i = 0; i < self->priv->classes->len; i++)
     {
       GValueArray *arr = g_ptr_array_index (self->priv->classes, i);
@@ -482,7 +715,6 @@ tp_capabilities_supports_sms (TpCapabilities *self)
     }
 
   return FALSE;
-
 }
 
 static gboolean
@@ -493,8 +725,6 @@ supports_call_full (TpCapabilities *self,
 {
   guint i;
 
-  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
-
   for (i = 0; i < self->priv->classes->len; i++)
     {
       GValueArray *arr = g_ptr_array_index (self->priv->classes, i);
@@ -581,7 +811,19 @@ gboolean
 tp_capabilities_supports_audio_call (TpCapabilities *self,
     TpHandleType handle_type)
 {
-  return supports_call_full (self, handle_type, TRUE, FALSE);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  switch (handle_type)
+    {
+      case TP_HANDLE_TYPE_CONTACT:
+        return (self->priv->features & FEATURE_AUDIO_CALL_CONTACT) != 0;
+      case TP_HANDLE_TYPE_ROOM:
+        return (self->priv->features & FEATURE_AUDIO_CALL_ROOM) != 0;
+      case TP_HANDLE_TYPE_NONE:
+        return (self->priv->features & FEATURE_AUDIO_CALL_NONE) != 0;
+      default:
+        return supports_call_full (self, handle_type, TRUE, FALSE);
+    }
 }
 
 /**
@@ -611,7 +853,19 @@ gboolean
 tp_capabilities_supports_audio_video_call (TpCapabilities *self,
     TpHandleType handle_type)
 {
-  return supports_call_full (self, handle_type, TRUE, TRUE);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  switch (handle_type)
+    {
+      case TP_HANDLE_TYPE_CONTACT:
+        return (self->priv->features & FEATURE_AUDIO_VIDEO_CALL_CONTACT) != 0;
+      case TP_HANDLE_TYPE_ROOM:
+        return (self->priv->features & FEATURE_AUDIO_VIDEO_CALL_ROOM) != 0;
+      case TP_HANDLE_TYPE_NONE:
+        return (self->priv->features & FEATURE_AUDIO_VIDEO_CALL_NONE) != 0;
+      default:
+        return supports_call_full (self, handle_type, TRUE, TRUE);
+    }
 }
 
 typedef enum {
@@ -628,8 +882,6 @@ supports_file_transfer (TpCapabilities *self,
 {
   guint i;
 
-  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
-
   for (i = 0; i < self->priv->classes->len; i++)
     {
       GValueArray *arr = g_ptr_array_index (self->priv->classes, i);
@@ -719,7 +971,9 @@ supports_file_transfer (TpCapabilities *self,
 gboolean
 tp_capabilities_supports_file_transfer (TpCapabilities *self)
 {
-  return supports_file_transfer (self, FT_CAP_FLAGS_NONE);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_FILE_TRANSFER) != 0;
 }
 
 /**
@@ -737,7 +991,9 @@ tp_capabilities_supports_file_transfer (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_file_transfer_uri (TpCapabilities *self)
 {
-  return supports_file_transfer (self, FT_CAP_FLAG_URI);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_FILE_TRANSFER_URI) != 0;
 }
 
 /**
@@ -755,7 +1011,9 @@ tp_capabilities_supports_file_transfer_uri (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_file_transfer_description (TpCapabilities *self)
 {
-  return supports_file_transfer (self, FT_CAP_FLAG_DESCRIPTION);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_FILE_TRANSFER_DESCRIPTION) != 0;
 }
 
 /**
@@ -775,7 +1033,9 @@ tp_capabilities_supports_file_transfer_description (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_file_transfer_initial_offset (TpCapabilities *self)
 {
-  return supports_file_transfer (self, FT_CAP_FLAG_OFFSET);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_FILE_TRANSFER_INITIAL_OFFSET) != 0;
 }
 
 /**
@@ -793,9 +1053,17 @@ tp_capabilities_supports_file_transfer_initial_offset (TpCapabilities *self)
 gboolean
 tp_capabilities_supports_file_transfer_timestamp (TpCapabilities *self)
 {
-  return supports_file_transfer (self, FT_CAP_FLAG_DATE);
+  g_return_val_if_fail (TP_IS_CAPABILITIES (self), FALSE);
+
+  return (self->priv->features & FEATURE_FILE_TRANSFER_TIMESTAMP) != 0;
 }
 
+static gboolean supports_tubes (TpCapabilities *self,
+    const gchar *expected_channel_type,
+    TpHandleType expected_handle_type,
+    const gchar *service_prop,
+    const gchar *expected_service);
+
 static gboolean
 tp_capabilities_supports_tubes_common (TpCapabilities *self,
     const gchar *expected_channel_type,
@@ -809,6 +1077,35 @@ tp_capabilities_supports_tubes_common (TpCapabilities *self,
   g_return_val_if_fail (expected_handle_type == TP_HANDLE_TYPE_CONTACT ||
       expected_handle_type == TP_HANDLE_TYPE_ROOM, FALSE);
 
+  /* the service only makes a difference for contacts' capabilities */
+  if (expected_service == NULL || !self->priv->contact_specific)
+    {
+      Features feature;
+
+      if (!tp_strdiff (expected_channel_type,
+            TP_IFACE_CHANNEL_TYPE_STREAM_TUBE))
+        feature = (expected_handle_type == TP_HANDLE_TYPE_CONTACT ?
+            FEATURE_STREAM_TUBES_CONTACT : FEATURE_STREAM_TUBES_ROOM);
+      else
+        feature = (expected_handle_type == TP_HANDLE_TYPE_CONTACT ?
+            FEATURE_DBUS_TUBES_CONTACT : FEATURE_DBUS_TUBES_ROOM);
+
+      return (self->priv->features & feature) != 0;
+    }
+
+  return supports_tubes (self, expected_channel_type, expected_handle_type,
+      service_prop, expected_service);
+}
+
+static gboolean
+supports_tubes (TpCapabilities *self,
+    const gchar *expected_channel_type,
+    TpHandleType expected_handle_type,
+    const gchar *service_prop,
+    const gchar *expected_service)
+{
+  guint i;
+
   for (i = 0; i < self->priv->classes->len; i++)
     {
       GValueArray *arr = g_ptr_array_index (self->priv->classes, i);
@@ -849,6 +1146,63 @@ tp_capabilities_supports_tubes_common (TpCapabilities *self,
   return FALSE;
 }
 
+static Features
+compute_features (TpCapabilities *self)
+{
+  Features features = 0;
+
+#define CHECK(feature, condition) \
+  if (condition) \
+    features |= feature
+
+  CHECK (FEATURE_TEXT_CHATS, supports_simple_channel (self,
+        TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_CONTACT));
+  CHECK (FEATURE_TEXT_CHATROOMS, supports_simple_channel (self,
+        TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_ROOM));
+  CHECK (FEATURE_SMS, supports_sms (self));
+
+  CHECK (FEATURE_AUDIO_CALL_CONTACT, supports_call_full (self,
+        TP_HANDLE_TYPE_CONTACT, TRUE, FALSE));
+  CHECK (FEATURE_AUDIO_CALL_ROOM, supports_call_full (self,
+        TP_HANDLE_TYPE_ROOM, TRUE, FALSE));
+  CHECK (FEATURE_AUDIO_CALL_NONE, supports_call_full (self,
+        TP_HANDLE_TYPE_NONE, TRUE, FALSE));
+  CHECK (FEATURE_AUDIO_VIDEO_CALL_CONTACT, supports_call_full (self,
+        TP_HANDLE_TYPE_CONTACT, TRUE, TRUE));
+  CHECK (FEATURE_AUDIO_VIDEO_CALL_ROOM, supports_call_full (self,
+        TP_HANDLE_TYPE_ROOM, TRUE, TRUE));
+  CHECK (FEATURE_AUDIO_VIDEO_CALL_NONE, supports_call_full (self,
+        TP_HANDLE_TYPE_NONE, TRUE, TRUE));
+
+  CHECK (FEATURE_FILE_TRANSFER, supports_file_transfer (self,
+        FT_CAP_FLAGS_NONE));
+  CHECK (FEATURE_FILE_TRANSFER_URI, supports_file_transfer (self,
+        FT_CAP_FLAG_URI));
+  CHECK (FEATURE_FILE_TRANSFER_DESCRIPTION, supports_file_transfer (self,
+        FT_CAP_FLAG_DESCRIPTION));
+  CHECK (FEATURE_FILE_TRANSFER_INITIAL_OFFSET, supports_file_transfer (self,
+        FT_CAP_FLAG_OFFSET));
+  CHECK (FEATURE_FILE_TRANSFER_TIMESTAMP, supports_file_transfer (self,
+        FT_CAP_FLAG_DATE));
+
+  CHECK (FEATURE_STREAM_TUBES_CONTACT, supports_tubes (self,
+        TP_IFACE_CHANNEL_TYPE_STREAM_TUBE, TP_HANDLE_TYPE_CONTACT,
+        NULL, NULL));
+  CHECK (FEATURE_STREAM_TUBES_ROOM, supports_tubes (self,
+        TP_IFACE_CHANNEL_TYPE_STREAM_TUBE, TP_HANDLE_TYPE_ROOM,
+        NULL, NULL));
+  CHECK (FEATURE_DBUS_TUBES_CONTACT, supports_tubes (self,
+        TP_IFACE_CHANNEL_TYPE_DBUS_TUBE, TP_HANDLE_TYPE_CONTACT,
+        NULL, NULL));
+  CHECK (FEATURE_DBUS_TUBES_ROOM, supports_tubes (self,
+        TP_IFACE_CHANNEL_TYPE_DBUS_TUBE, TP_HANDLE_TYPE_ROOM,
+        NULL, NULL));
+
+#undef CHECK
+
+  return features;
+}
+
 /**
  * tp_capabilities_supports_stream_tubes:
  * @self: a #TpCapabilities object
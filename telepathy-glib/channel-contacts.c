@@ -241,6 +241,10 @@ struct _ContactsQueueItem
   GPtrArray *contacts;
   GPtrArray *ids;
   GArray *handles;
+  /* Handles this item removes from the group, if it is a MembersChanged
+   * item; used to avoid upgrading contacts which will be gone by the time
+   * the batch they are part of is complete */
+  GArray *removed;
 };
 
 static void
@@ -249,28 +253,43 @@ contacts_queue_item_free (ContactsQueueItem *item)
   tp_clear_pointer (&item->contacts, g_ptr_array_unref);
   tp_clear_pointer (&item->ids, g_ptr_array_unref);
   tp_clear_pointer (&item->handles, g_array_unref);
+  tp_clear_pointer (&item->removed, g_array_unref);
   g_slice_free (ContactsQueueItem, item);
 }
 
+static gboolean
+contacts_queue_item_is_upgrade (ContactsQueueItem *item)
+{
+  return item->ids == NULL && item->handles == NULL;
+}
+
 static void process_contacts_queue (TpChannel *self);
 
 static void
 contacts_queue_head_ready (TpChannel *self,
     const GError *error)
 {
-  GSimpleAsyncResult *result = self->priv->current_contacts_queue_result;
+  GQueue *batch = &self->priv->current_contacts_queue_results;
+  GList *l;
 
   if (error != NULL)
+    DEBUG ("Error preparing channel contacts queue item: %s", error->message);
+
+  /* Items stay in the batch while their callbacks run, so that anything
+   * they queue waits for the whole batch to be complete */
+  for (l = batch->head; l != NULL; l = l->next)
     {
-      DEBUG ("Error preparing channel contacts queue item: %s", error->message);
-      g_simple_async_result_set_from_error (result, error);
+      GSimpleAsyncResult *result = l->data;
+
+      if (error != NULL)
+        g_simple_async_result_set_from_error (result, error);
+      g_simple_async_result_complete (result);
     }
-  g_simple_async_result_complete (result);
 
-  self->priv->current_contacts_queue_result = NULL;
-  process_contacts_queue (self);
+  while (!g_queue_is_empty (batch))
+    g_object_unref (g_queue_pop_head (batch));
 
-  g_object_unref (result);
+  process_contacts_queue (self);
 }
 
 static void
@@ -343,15 +362,84 @@ contacts_queue_item_idle_cb (gpointer user_data)
   return FALSE;
 }
 
+/* Returns the contacts that all items of the current batch need to be
+ * upgraded, each of them once. A contact only needed by one item is skipped
+ * if a later item of the batch removes it from the group (without it being
+ * added back after that): nobody will see it as a member once the batch is
+ * complete, so there is no point in waiting for its features. */
+static GPtrArray *
+dup_batch_contacts (TpChannel *self)
+{
+  GQueue *batch = &self->priv->current_contacts_queue_results;
+  GPtrArray *contacts = g_ptr_array_new_with_free_func (g_object_unref);
+  GHashTable *seen = g_hash_table_new (NULL, NULL);
+  GHashTable *gone = g_hash_table_new (NULL, NULL);
+  GList *l;
+  guint i;
+
+  /* Walk backwards, so that when looking at an item, gone contains the
+   * handles removed by later items of the batch */
+  for (l = batch->tail; l != NULL; l = l->prev)
+    {
+      ContactsQueueItem *item = g_simple_async_result_get_op_res_gpointer (
+          l->data);
+
+      if (item->contacts != NULL)
+        {
+          for (i = 0; i < item->contacts->len; i++)
+            {
+              TpContact *contact = g_ptr_array_index (item->contacts, i);
+              gpointer key = GUINT_TO_POINTER (tp_contact_get_handle (
+                    contact));
+
+              if (g_hash_table_contains (gone, key))
+                {
+                  DEBUG ("not upgrading %s: it leaves the group later",
+                      tp_contact_get_identifier (contact));
+                  continue;
+                }
+
+              if (g_hash_table_contains (seen, contact))
+                continue;
+
+              g_hash_table_add (seen, contact);
+              g_ptr_array_add (contacts, g_object_ref (contact));
+            }
+
+          /* This item is where they were last added */
+          for (i = 0; i < item->contacts->len; i++)
+            {
+              TpContact *contact = g_ptr_array_index (item->contacts, i);
+
+              g_hash_table_remove (gone,
+                  GUINT_TO_POINTER (tp_contact_get_handle (contact)));
+            }
+        }
+
+      if (item->removed != NULL)
+        {
+          for (i = 0; i < item->removed->len; i++)
+            g_hash_table_add (gone, GUINT_TO_POINTER (
+                  g_array_index (item->removed, TpHandle, i)));
+        }
+    }
+
+  g_hash_table_unref (seen);
+  g_hash_table_unref (gone);
+
+  return contacts;
+}
+
 static void
 process_contacts_queue (TpChannel *self)
 {
+  GQueue *batch = &self->priv->current_contacts_queue_results;
   GSimpleAsyncResult *result;
   ContactsQueueItem *item;
   GArray *features;
   const GError *error = NULL;
 
-  if (self->priv->current_contacts_queue_result != NULL)
+  if (!g_queue_is_empty (batch))
     return;
 
   /* self can't die while there are queued items because item->result keeps a
@@ -376,9 +464,22 @@ process_contacts_queue (TpChannel *self)
   if (result == NULL)
     return;
 
-  self->priv->current_contacts_queue_result = result;
+  g_queue_push_tail (batch, result);
   item = g_simple_async_result_get_op_res_gpointer (result);
 
+  /* Consecutive items which only need contacts to be upgraded are prepared
+   * together: after a netsplit in a big room, this is one round-trip instead
+   * of one per MembersChanged. Their results are still completed one by one,
+   * in order, so signals are not reordered. */
+  if (contacts_queue_item_is_upgrade (item))
+    {
+      while ((result = g_queue_peek_head (self->priv->contacts_queue)) != NULL
+          && contacts_queue_item_is_upgrade (
+              g_simple_async_result_get_op_res_gpointer (result)))
+        g_queue_push_tail (batch,
+            g_queue_pop_head (self->priv->contacts_queue));
+    }
+
   features = tp_simple_client_factory_dup_contact_features (
       tp_proxy_get_factory (self->priv->connection), self->priv->connection);
 
@@ -386,17 +487,33 @@ process_contacts_queue (TpChannel *self)
    * CMs. by_id and by_handle are used only by TpTextChannel and are needed for
    * older CMs that does not give both message-sender and message-sender-id */
   G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  if (item->contacts != NULL && item->contacts->len > 0)
+  if (contacts_queue_item_is_upgrade (item))
     {
-      g_assert (item->ids == NULL);
-      g_assert (item->handles == NULL);
+      GPtrArray *contacts = dup_batch_contacts (self);
 
-      tp_connection_upgrade_contacts (self->priv->connection,
-          item->contacts->len, (TpContact **) item->contacts->pdata,
-          features->len, (TpContactFeature *) features->data,
-          contacts_queue_item_upgraded_cb,
-          item, NULL,
-          (GObject *) self);
+      if (contacts->len > 0)
+        {
+          DEBUG ("upgrading %u contacts for %u queued items", contacts->len,
+              g_queue_get_length (batch));
+
+          tp_connection_upgrade_contacts (self->priv->connection,
+              contacts->len, (TpContact **) contacts->pdata,
+              features->len, (TpContactFeature *) features->data,
+              contacts_queue_item_upgraded_cb,
+              NULL, NULL,
+              (GObject *) self);
+        }
+      else
+        {
+          /* It can happen there is no contact to prepare, and can still be
+           * useful in order to not reorder some events.
+           * We have to use an idle though, to guarantee callback is never
+           * called without reentering mainloop first. */
+          _tp_idle_add (TP_LATENCY_CLASS_NORMAL, contacts_queue_item_idle_cb,
+              self);
+        }
+
+      g_ptr_array_unref (contacts);
     }
   else if (item->ids != NULL && item->ids->len > 0)
     {
@@ -424,11 +541,8 @@ process_contacts_queue (TpChannel *self)
     }
   else
     {
-      /* It can happen there is no contact to prepare, and can still be useful
-       * in order to not reorder some events.
-       * We have to use an idle though, to guarantee callback is never called
-       * without reentering mainloop first. */
-      g_idle_add (contacts_queue_item_idle_cb, self);
+      _tp_idle_add (TP_LATENCY_CLASS_NORMAL, contacts_queue_item_idle_cb,
+          self);
     }
   G_GNUC_END_IGNORE_DEPRECATIONS
 
@@ -440,6 +554,7 @@ contacts_queue_item (TpChannel *self,
     GPtrArray *contacts,
     GPtrArray *ids,
     GArray *handles,
+    GArray *removed,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
@@ -449,6 +564,7 @@ contacts_queue_item (TpChannel *self,
   item->contacts = contacts != NULL ? g_ptr_array_ref (contacts) : NULL;
   item->ids = ids != NULL ? g_ptr_array_ref (ids) : NULL;
   item->handles = handles != NULL ? g_array_ref (handles) : NULL;
+  item->removed = removed != NULL ? g_array_ref (removed) : NULL;
   result = g_simple_async_result_new ((GObject *) self,
       callback, user_data, contacts_queue_item);
 
@@ -465,7 +581,8 @@ _tp_channel_contacts_queue_prepare_async (TpChannel *self,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
-  contacts_queue_item (self, contacts, NULL, NULL, callback, user_data);
+  contacts_queue_item (self, contacts, NULL, NULL, NULL, callback,
+      user_data);
 }
 
 void
@@ -474,7 +591,7 @@ _tp_channel_contacts_queue_prepare_by_id_async (TpChannel *self,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
-  contacts_queue_item (self, NULL, ids, NULL, callback, user_data);
+  contacts_queue_item (self, NULL, ids, NULL, NULL, callback, user_data);
 }
 
 void
@@ -483,7 +600,8 @@ _tp_channel_contacts_queue_prepare_by_handle_async (TpChannel *self,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
-  contacts_queue_item (self, NULL, NULL, handles, callback, user_data);
+  contacts_queue_item (self, NULL, NULL, handles, NULL, callback,
+      user_data);
 }
 
 gboolean
@@ -677,7 +795,7 @@ _tp_channel_contacts_members_changed (TpChannel *self,
   if (data->actor != NULL)
     g_ptr_array_add (contacts, data->actor);
 
-  _tp_channel_contacts_queue_prepare_async (self, contacts,
+  contacts_queue_item (self, contacts, NULL, NULL, data->removed,
       members_changed_prepared_cb, data);
 
   g_ptr_array_unref (contacts);
@@ -1516,6 +1516,267 @@ tp_channel_dispatch_operation_claim_with_finish (
       tp_channel_dispatch_operation_claim_with_async)
 }
 
+typedef struct {
+    GSimpleAsyncResult *result;
+    /* owned, or NULL for HandleWith */
+    TpBaseClient *client;
+    /* owned TpChannelDispatchOperation, so that none of them can be
+     * disposed before its call returns */
+    GList *operations;
+    /* owned TpChannelDispatchOperation */
+    GList *failed;
+    guint n_pending;
+} Batch;
+
+static Batch *
+batch_new (GList *operations,
+    TpBaseClient *client,
+    GAsyncReadyCallback callback,
+    gpointer user_data,
+    gpointer source_tag)
+{
+  Batch *batch = g_slice_new0 (Batch);
+
+  batch->result = g_simple_async_result_new (NULL, callback, user_data,
+      source_tag);
+  batch->operations = _tp_object_list_copy (operations);
+
+  if (client != NULL)
+    batch->client = g_object_ref (client);
+
+  /* held until every call has been made, so that none of them can complete
+   * the batch early */
+  batch->n_pending = 1;
+  return batch;
+}
+
+static void
+batch_complete_one (Batch *batch)
+{
+  if (--batch->n_pending > 0)
+    return;
+
+  if (batch->failed != NULL)
+    {
+      TpChannelDispatchOperation *first;
+
+      batch->failed = g_list_reverse (batch->failed);
+      first = batch->failed->data;
+
+      g_simple_async_result_set_error (batch->result, TP_ERROR,
+          TP_ERROR_NOT_AVAILABLE, "%u of %u dispatch operations failed, "
+          "including %s", g_list_length (batch->failed),
+          g_list_length (batch->operations),
+          tp_proxy_get_object_path (first));
+
+      g_simple_async_result_set_op_res_gpointer (batch->result,
+          batch->failed, (GDestroyNotify) _tp_object_list_free);
+    }
+
+  g_simple_async_result_complete_in_idle (batch->result);
+
+  g_object_unref (batch->result);
+  g_clear_object (&batch->client);
+  _tp_object_list_free (batch->operations);
+  g_slice_free (Batch, batch);
+}
+
+static void
+batch_call_cb (TpChannelDispatchOperation *self,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Batch *batch = user_data;
+
+  if (error != NULL)
+    {
+      DEBUG ("%s failed: %s", tp_proxy_get_object_path (self),
+          error->message);
+      batch->failed = g_list_prepend (batch->failed, g_object_ref (self));
+    }
+  else if (batch->client != NULL)
+    {
+      _tp_base_client_now_handling_channels (batch->client,
+          self->priv->channels);
+    }
+
+  batch_complete_one (batch);
+}
+
+/**
+ * tp_channel_dispatch_operation_handle_many_with_async:
+ * @operations: (element-type TelepathyGLib.ChannelDispatchOperation): a list
+ *  of #TpChannelDispatchOperation
+ * @handler: (allow-none): The well-known bus name (starting with
+ * #TP_CLIENT_BUS_NAME_BASE) of the channel handler that should handle the
+ * channels, or %NULL if the client has no preferred channel handler
+ * @callback: a callback to call when all the calls have returned
+ * @user_data: data to pass to @callback
+ *
+ * Called by an approver to accept several channel bundles at once, and
+ * request that @handler be used to handle all of them. This is equivalent
+ * to calling tp_channel_dispatch_operation_handle_with_async() on each of
+ * @operations, except that all the calls are made before any of them
+ * returns, and @callback is called once, when the last of them has
+ * returned.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_channel_dispatch_operation_handle_many_with_async (GList *operations,
+    const gchar *handler,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  Batch *batch;
+  GList *l;
+
+  for (l = operations; l != NULL; l = l->next)
+    g_return_if_fail (TP_IS_CHANNEL_DISPATCH_OPERATION (l->data));
+
+  batch = batch_new (operations, NULL, callback, user_data,
+      tp_channel_dispatch_operation_handle_many_with_async);
+
+  for (l = batch->operations; l != NULL; l = l->next)
+    {
+      batch->n_pending++;
+      tp_cli_channel_dispatch_operation_call_handle_with (l->data, -1,
+          handler != NULL ? handler : "", batch_call_cb, batch, NULL, NULL);
+    }
+
+  batch_complete_one (batch);
+}
+
+static gboolean
+batch_finish (GAsyncResult *result,
+    gpointer source_tag,
+    GList **failed,
+    GError **error)
+{
+  GSimpleAsyncResult *simple;
+
+  if (failed != NULL)
+    *failed = NULL;
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result, NULL,
+        source_tag), FALSE);
+
+  simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  if (!g_simple_async_result_propagate_error (simple, error))
+    return TRUE;
+
+  if (failed != NULL)
+    *failed = _tp_object_list_copy (
+        g_simple_async_result_get_op_res_gpointer (simple));
+
+  return FALSE;
+}
+
+/**
+ * tp_channel_dispatch_operation_handle_many_with_finish:
+ * @result: a #GAsyncResult
+ * @failed: (out) (allow-none) (transfer full) (element-type TelepathyGLib.ChannelDispatchOperation):
+ *  if not %NULL, used to return those of the operations whose HandleWith()
+ *  call failed, in the order they were given, or %NULL if none failed
+ * @error: a #GError to fill
+ *
+ * Finishes an async call to
+ * tp_channel_dispatch_operation_handle_many_with_async(). The
+ * operations that are not in @failed were handled successfully.
+ *
+ * Returns: %TRUE if every HandleWith() call was successful, otherwise
+ *  %FALSE
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_channel_dispatch_operation_handle_many_with_finish (GAsyncResult *result,
+    GList **failed,
+    GError **error)
+{
+  return batch_finish (result,
+      tp_channel_dispatch_operation_handle_many_with_async, failed, error);
+}
+
+/**
+ * tp_channel_dispatch_operation_claim_many_with_async:
+ * @operations: (element-type TelepathyGLib.ChannelDispatchOperation): a list
+ *  of #TpChannelDispatchOperation
+ * @client: the #TpBaseClient claiming @operations
+ * @callback: a callback to call when all the calls have returned
+ * @user_data: data to pass to @callback
+ *
+ * Called by an approver to claim the channels of several dispatch
+ * operations at once for handling internally. This is equivalent to
+ * calling tp_channel_dispatch_operation_claim_with_async() on each of
+ * @operations, except that all the calls are made before any of them
+ * returns, and @callback is called once, when the last of them has
+ * returned; @client is told about the channels of each operation as soon
+ * as that operation has been claimed.
+ *
+ * %TP_CHANNEL_DISPATCH_OPERATION_FEATURE_CORE must be prepared on each of
+ * @operations before calling this function.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_channel_dispatch_operation_claim_many_with_async (GList *operations,
+    TpBaseClient *client,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  Batch *batch;
+  GList *l;
+
+  g_return_if_fail (TP_IS_BASE_CLIENT (client));
+
+  for (l = operations; l != NULL; l = l->next)
+    {
+      g_return_if_fail (TP_IS_CHANNEL_DISPATCH_OPERATION (l->data));
+      g_return_if_fail (tp_proxy_is_prepared (l->data,
+            TP_CHANNEL_DISPATCH_OPERATION_FEATURE_CORE));
+    }
+
+  batch = batch_new (operations, client, callback, user_data,
+      tp_channel_dispatch_operation_claim_many_with_async);
+
+  for (l = batch->operations; l != NULL; l = l->next)
+    {
+      batch->n_pending++;
+      tp_cli_channel_dispatch_operation_call_claim (l->data, -1,
+          batch_call_cb, batch, NULL, NULL);
+    }
+
+  batch_complete_one (batch);
+}
+
+/**
+ * tp_channel_dispatch_operation_claim_many_with_finish:
+ * @result: a #GAsyncResult
+ * @failed: (out) (allow-none) (transfer full) (element-type TelepathyGLib.ChannelDispatchOperation):
+ *  if not %NULL, used to return those of the operations whose Claim() call
+ *  failed, in the order they were given, or %NULL if none failed
+ * @error: a #GError to fill
+ *
+ * Finishes an async call to
+ * tp_channel_dispatch_operation_claim_many_with_async(). The operations
+ * that are not in @failed were claimed successfully.
+ *
+ * Returns: %TRUE if every Claim() call was successful, otherwise %FALSE
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_channel_dispatch_operation_claim_many_with_finish (GAsyncResult *result,
+    GList **failed,
+    GError **error)
+{
+  return batch_finish (result,
+      tp_channel_dispatch_operation_claim_many_with_async, failed, error);
+}
+
 static void
 channel_close_cb (GObject *source,
     GAsyncResult *result,
@@ -174,6 +174,32 @@ gboolean tp_channel_dispatch_operation_claim_with_finish (
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_channel_dispatch_operation_handle_many_with_async (
+    GList *operations,
+    const gchar *handler,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_channel_dispatch_operation_handle_many_with_finish (
+    GAsyncResult *result,
+    GList **failed,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_channel_dispatch_operation_claim_many_with_async (
+    GList *operations,
+    TpBaseClient *client,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_channel_dispatch_operation_claim_many_with_finish (
+    GAsyncResult *result,
+    GList **failed,
+    GError **error);
+
 /* Reject API */
 
 _TP_AVAILABLE_IN_0_16
@@ -25,6 +25,8 @@
 
 #include <telepathy-glib/channel.h>
 
+#include "telepathy-glib/chat-state-map-internal.h"
+
 G_BEGIN_DECLS
 
 typedef void (*TpChannelProc) (TpChannel *self);
@@ -39,8 +41,6 @@ typedef struct {
 typedef struct _ContactsQueueItem ContactsQueueItem;
 
 struct _TpChannelPrivate {
-    gulong conn_invalidated_id;
-
     TpConnection *connection;
 
     /* GQueue of TpChannelProc */
@@ -52,6 +52,9 @@ struct _TpChannelPrivate {
     gchar *identifier;
     /* owned string (iface + "." + prop) => slice-allocated GValue */
     GHashTable *channel_properties;
+    /* channel_properties as a vardict, built on demand and dropped whenever
+     * channel_properties changes; owned or NULL */
+    GVariant *channel_properties_vardict;
 
     /* Set until introspection discovers which to use; both NULL after one has
      * been disconnected.
@@ -91,12 +94,16 @@ struct _TpChannelPrivate {
 
     /* Queue of GSimpleAsyncResult with ContactsQueueItem payload */
     GQueue *contacts_queue;
-    /* Item currently being prepared, not part of contacts_queue anymore */
-    GSimpleAsyncResult *current_contacts_queue_result;
+    /* Items currently being prepared together, in the order they were
+     * queued; not part of contacts_queue anymore */
+    GQueue current_contacts_queue_results;
 
-    /* NULL, or TpHandle => TpChannelChatState;
-     * if non-NULL, we're watching for ChatStateChanged */
-    GHashTable *chat_states;
+    /* if non-NULL, we're watching for ChatStateChanged */
+    _TpChatStateMap *chat_states;
+    /* NULL, or PendingChatState for each contact whose chat-state-changed
+     * is waiting for chat_states_idle_id */
+    GArray *pending_chat_states;
+    guint chat_states_idle_id;
 
     /* These are really booleans, but gboolean is signed. Thanks, GLib */
 
@@ -107,6 +114,17 @@ struct _TpChannelPrivate {
     unsigned exists:1;
     /* GetGroupFlags has returned */
     unsigned have_group_flags:1;
+    /* channel-properties was set at construct time, typically from
+     * the channel dispatcher */
+    unsigned properties_supplied:1;
+    /* ... and contained every Channel property introspection looks for, so
+     * there is no need to call GetInterfaces just to check the channel
+     * exists */
+    unsigned properties_complete:1;
+
+    /* Number of method calls introspection had to make to fill in
+     * properties that were not supplied at construct time */
+    guint fallback_round_trips;
 
     TpChannelPasswordFlags password_flags;
 };
@@ -118,6 +136,7 @@ void _tp_channel_abort_introspection (TpChannel *self,
     const gchar *debug,
     const GError *error);
 GHashTable *_tp_channel_get_immutable_properties (TpChannel *self);
+void _tp_channel_connection_invalidated (TpChannel *self);
 
 /* channel-group.c internals */
 
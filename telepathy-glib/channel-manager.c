@@ -135,6 +135,11 @@
  *
  * If the implementation does not want to handle the request, it should return
  * %FALSE to allow the request to be offered to another channel manager.
+ * Since 0.UNRELEASED, #TpBaseConnection offers each request to the channel
+ * manager that accepted the previous request with the same ChannelType,
+ * TargetHandleType and set of properties before any other, so the decision
+ * whether to return %FALSE should not depend on the values of the other
+ * properties.
  *
  * Implementations may assume the following of @request_properties:
  *
@@ -117,6 +117,8 @@ static guint signals[N_SIGNALS] = { 0 };
 
 struct _TpChannelRequestPrivate {
     GHashTable *immutable_properties;
+    /* immutable_properties as a vardict, built on first use; owned or NULL */
+    GVariant *immutable_properties_vardict;
 
     TpClientChannelFactory *channel_factory;
     gboolean succeeded_with_chan_fired;
@@ -349,6 +351,8 @@ tp_channel_request_dispose (GObject *object)
     G_OBJECT_CLASS (tp_channel_request_parent_class)->dispose;
 
   tp_clear_pointer (&self->priv->immutable_properties, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->immutable_properties_vardict,
+      g_variant_unref);
 
   tp_clear_object (&self->priv->channel_factory);
   tp_clear_object (&self->priv->account);
@@ -732,7 +736,12 @@ tp_channel_request_dup_immutable_properties (TpChannelRequest *self)
   if (self->priv->immutable_properties == NULL)
     return NULL;
 
-  return _tp_asv_to_vardict (self->priv->immutable_properties);
+  /* immutable_properties can only be set once, so this never goes stale */
+  if (self->priv->immutable_properties_vardict == NULL)
+    self->priv->immutable_properties_vardict = _tp_asv_to_vardict (
+        self->priv->immutable_properties);
+
+  return g_variant_ref (self->priv->immutable_properties_vardict);
 }
 
 void
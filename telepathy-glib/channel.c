@@ -32,6 +32,7 @@
 #include <telepathy-glib/util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_CHANNEL
+#include "telepathy-glib/connection-internal.h"
 #include "telepathy-glib/dbus-internal.h"
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/proxy-internal.h"
@@ -495,7 +496,34 @@ tp_channel_dup_immutable_properties (TpChannel *self)
 {
   g_return_val_if_fail (TP_IS_CHANNEL (self), NULL);
 
-  return _tp_asv_to_vardict (self->priv->channel_properties);
+  return g_variant_ref (tp_channel_get_immutable_properties_vardict (self));
+}
+
+/**
+ * tp_channel_get_immutable_properties_vardict:
+ * @self: a channel
+ *
+ * The same as tp_channel_dup_immutable_properties(), but without taking a
+ * reference. This is cheaper for bindings that read the properties often,
+ * since they don't need to copy or reference the result.
+ *
+ * The returned variant is not necessarily valid after the main loop is next
+ * re-entered; reference it with g_variant_ref() if it must be kept.
+ *
+ * Returns: (transfer none): a dictionary where the keys are strings,
+ *  D-Bus interface name + "." + property name.
+ * Since: 0.UNRELEASED
+ */
+GVariant *
+tp_channel_get_immutable_properties_vardict (TpChannel *self)
+{
+  g_return_val_if_fail (TP_IS_CHANNEL (self), NULL);
+
+  if (self->priv->channel_properties_vardict == NULL)
+    self->priv->channel_properties_vardict = _tp_asv_to_vardict (
+        self->priv->channel_properties);
+
+  return self->priv->channel_properties_vardict;
 }
 
 static void
@@ -584,16 +612,10 @@ TpChannelChatState
 tp_channel_get_chat_state (TpChannel *self,
     TpHandle contact)
 {
-  gpointer value;
-
   g_return_val_if_fail (TP_IS_CHANNEL (self), 0);
 
-  if (self->priv->chat_states != NULL &&
-      g_hash_table_lookup_extended (self->priv->chat_states,
-        GUINT_TO_POINTER (contact), NULL, &value))
-    {
-      return GPOINTER_TO_UINT (value);
-    }
+  if (self->priv->chat_states != NULL)
+    return _tp_chat_state_map_get (self->priv->chat_states, contact);
 
   return TP_CHANNEL_CHAT_STATE_INACTIVE;
 }
@@ -606,6 +628,40 @@ tp_channel_get_chat_state (TpChannel *self,
  * still all be fine. */
 
 
+static void
+_tp_channel_properties_changed (TpChannel *self)
+{
+  tp_clear_pointer (&self->priv->channel_properties_vardict,
+      g_variant_unref);
+}
+
+/* Takes ownership of @key and @value */
+static void
+_tp_channel_insert_property (TpChannel *self,
+    gchar *key,
+    GValue *value)
+{
+  g_hash_table_insert (self->priv->channel_properties, key, value);
+  _tp_channel_properties_changed (self);
+}
+
+/* Called whenever introspection has to make a method call to find out
+ * something that could have been in the immutable properties. */
+static void
+_tp_channel_note_round_trip (TpChannel *self,
+    const gchar *method)
+{
+  self->priv->fallback_round_trips++;
+
+  if (self->priv->properties_supplied)
+    DEBUG ("%p: immutable properties were incomplete, so calling %s "
+        "(round-trip #%u); the CM should include all immutable "
+        "properties when announcing channels", self, method,
+        self->priv->fallback_round_trips);
+  else
+    DEBUG ("%p: calling %s", self, method);
+}
+
 static void
 _tp_channel_maybe_set_channel_type (TpChannel *self,
                                     const gchar *type)
@@ -616,7 +672,7 @@ _tp_channel_maybe_set_channel_type (TpChannel *self,
     return;
 
   self->priv->channel_type = q;
-  g_hash_table_insert (self->priv->channel_properties,
+  _tp_channel_insert_property (self,
       g_strdup (TP_PROP_CHANNEL_CHANNEL_TYPE),
       tp_g_value_slice_new_static_string (g_quark_to_string (q)));
 
@@ -633,7 +689,7 @@ _tp_channel_maybe_set_handle (TpChannel *self,
   if (valid)
     {
       self->priv->handle = handle;
-      g_hash_table_insert (self->priv->channel_properties,
+      _tp_channel_insert_property (self,
           g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE),
           tp_g_value_slice_new_uint (handle));
     }
@@ -648,7 +704,7 @@ _tp_channel_maybe_set_handle_type (TpChannel *self,
   if (valid)
     {
       self->priv->handle_type = handle_type;
-      g_hash_table_insert (self->priv->channel_properties,
+      _tp_channel_insert_property (self,
           g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE),
           tp_g_value_slice_new_uint (handle_type));
     }
@@ -662,7 +718,7 @@ _tp_channel_maybe_set_identifier (TpChannel *self,
   if (identifier != NULL && self->priv->identifier == NULL)
     {
       self->priv->identifier = g_strdup (identifier);
-      g_hash_table_insert (self->priv->channel_properties,
+      _tp_channel_insert_property (self,
           g_strdup (TP_PROP_CHANNEL_TARGET_ID),
           tp_g_value_slice_new_string (identifier));
     }
@@ -677,7 +733,7 @@ _tp_channel_maybe_set_interfaces (TpChannel *self,
 
   tp_proxy_add_interfaces ((TpProxy *) self, interfaces);
 
-  g_hash_table_insert (self->priv->channel_properties,
+  _tp_channel_insert_property (self,
       g_strdup (TP_PROP_CHANNEL_INTERFACES),
       tp_g_value_slice_new_boxed (G_TYPE_STRV, interfaces));
 }
@@ -725,9 +781,13 @@ tp_channel_set_property (GObject *object,
                * can only happen at construct time, before anyone has
                * connected to it */
 
+              self->priv->properties_supplied =
+                  (g_hash_table_size (asv) > 0);
+
               tp_g_hash_table_update (self->priv->channel_properties,
                   asv, (GBoxedCopyFunc) g_strdup,
                   (GBoxedCopyFunc) tp_g_value_slice_dup);
+              _tp_channel_properties_changed (self);
 
               u = tp_asv_get_uint32 (self->priv->channel_properties,
                   TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, &valid);
@@ -775,23 +835,148 @@ _tp_channel_abort_introspection (TpChannel *self,
   tp_proxy_invalidate ((TpProxy *) self, error);
 }
 
+typedef struct {
+    TpHandle contact;
+    /* the state we last signalled */
+    TpChannelChatState state;
+} PendingChatState;
+
+/* Signal the change to @contact's state, if any, since we queued it */
 static void
-tp_channel_chat_state_changed_cb (TpChannel *self,
-    guint contact,
-    guint state,
+tp_channel_flush_chat_state (TpChannel *self,
+    TpHandle contact)
+{
+  GArray *pending = self->priv->pending_chat_states;
+  guint i;
+
+  if (pending == NULL)
+    return;
+
+  for (i = 0; i < pending->len; i++)
+    {
+      TpChannelChatState old_state, state;
+
+      if (g_array_index (pending, PendingChatState, i).contact != contact)
+        continue;
+
+      old_state = g_array_index (pending, PendingChatState, i).state;
+      g_array_remove_index_fast (pending, i);
+      state = _tp_chat_state_map_get (self->priv->chat_states, contact);
+
+      if (state != old_state)
+        g_signal_emit (self, signals[SIGNAL_CHAT_STATE_CHANGED], 0,
+            contact, state);
+
+      return;
+    }
+}
+
+static gboolean
+tp_channel_flush_chat_states_cb (gpointer user_data)
+{
+  TpChannel *self = user_data;
+  GArray *pending = self->priv->pending_chat_states;
+  guint i;
+
+  self->priv->chat_states_idle_id = 0;
+
+  if (pending == NULL)
+    return FALSE;
+
+  /* signal handlers might change our state, or dispose us */
+  self->priv->pending_chat_states = NULL;
+  g_object_ref (self);
+
+  for (i = 0; i < pending->len; i++)
+    {
+      PendingChatState *p = &g_array_index (pending, PendingChatState, i);
+      TpChannelChatState state;
+
+      state = _tp_chat_state_map_get (self->priv->chat_states, p->contact);
+
+      /* if someone went from Composing to Paused and back in one go,
+       * nothing has changed as far as our caller is concerned */
+      if (state != p->state)
+        g_signal_emit (self, signals[SIGNAL_CHAT_STATE_CHANGED], 0,
+            p->contact, state);
+    }
+
+  /* keep the array for next time, unless more changes arrived meanwhile */
+  if (self->priv->pending_chat_states == NULL)
+    {
+      g_array_set_size (pending, 0);
+      self->priv->pending_chat_states = pending;
+    }
+  else
+    {
+      g_array_unref (pending);
+    }
+
+  g_object_unref (self);
+  return FALSE;
+}
+
+static void
+tp_channel_chat_state_changed_cb (TpProxy *proxy,
+    GVariant *args,
     gpointer unused G_GNUC_UNUSED,
     GObject *object G_GNUC_UNUSED)
 {
-  g_hash_table_insert (self->priv->chat_states,
-      GUINT_TO_POINTER (contact), GUINT_TO_POINTER (state));
+  TpChannel *self = (TpChannel *) proxy;
+  TpChannelChatState old_state;
+  PendingChatState p;
+  guint contact;
+  guint state;
+  guint i;
+
+  g_variant_get (args, "(uu)", &contact, &state);
+  old_state = _tp_chat_state_map_get (self->priv->chat_states, contact);
 
   G_GNUC_BEGIN_IGNORE_DEPRECATIONS
   /* Don't emit the signal until we've had the initial state */
   if (!tp_proxy_is_prepared (self, TP_CHANNEL_FEATURE_CHAT_STATES))
-    return;
+    {
+      _tp_chat_state_map_set (self->priv->chat_states, contact, state);
+      return;
+    }
   G_GNUC_END_IGNORE_DEPRECATIONS
 
-  g_signal_emit (self, signals[SIGNAL_CHAT_STATE_CHANGED], 0, contact, state);
+  /* Leaving is signalled straight away, after whatever came before it, so
+   * that nobody sees a contact who has left still typing */
+  if (state == TP_CHANNEL_CHAT_STATE_GONE)
+    {
+      tp_channel_flush_chat_state (self, contact);
+
+      if (_tp_chat_state_map_set (self->priv->chat_states, contact, state))
+        g_signal_emit (self, signals[SIGNAL_CHAT_STATE_CHANGED], 0,
+            contact, state);
+
+      return;
+    }
+
+  if (!_tp_chat_state_map_set (self->priv->chat_states, contact, state))
+    return;
+
+  /* Otherwise, in a busy chatroom, several changes arrive at once; signal
+   * each contact's latest state once they have all been processed */
+  if (self->priv->pending_chat_states == NULL)
+    self->priv->pending_chat_states = g_array_new (FALSE, FALSE,
+        sizeof (PendingChatState));
+
+  for (i = 0; i < self->priv->pending_chat_states->len; i++)
+    {
+      if (g_array_index (self->priv->pending_chat_states, PendingChatState,
+            i).contact == contact)
+        return;
+    }
+
+  p.contact = contact;
+  p.state = old_state;
+  g_array_append_val (self->priv->pending_chat_states, p);
+
+  if (self->priv->chat_states_idle_id == 0)
+    self->priv->chat_states_idle_id = _tp_idle_add (TP_LATENCY_CLASS_NORMAL,
+        tp_channel_flush_chat_states_cb, self);
 }
 
 static void
@@ -806,8 +991,14 @@ tp_channel_get_initial_chat_states_cb (TpProxy *proxy,
 
   if (error == NULL && G_VALUE_HOLDS (value, TP_HASH_TYPE_CHAT_STATE_MAP))
     {
-      tp_g_hash_table_update (self->priv->chat_states,
-          g_value_get_boxed (value), NULL, NULL);
+      GHashTableIter iter;
+      gpointer k, v;
+
+      g_hash_table_iter_init (&iter, g_value_get_boxed (value));
+
+      while (g_hash_table_iter_next (&iter, &k, &v))
+        _tp_chat_state_map_set (self->priv->chat_states,
+            GPOINTER_TO_UINT (k), GPOINTER_TO_UINT (v));
     }
   /* else just ignore it and assume everyone was initially in the default
    * Inactive state, unless we already saw a signal for them */
@@ -830,8 +1021,8 @@ tp_channel_prepare_chat_states_async (TpProxy *proxy,
   g_assert (self->priv->chat_states == NULL);
 
   /* chat states? yes please! */
-  self->priv->chat_states = g_hash_table_new (NULL, NULL);
-  tp_cli_channel_interface_chat_state_connect_to_chat_state_changed (
+  self->priv->chat_states = _tp_chat_state_map_new ();
+  _tp_cli_channel_interface_chat_state_connect_to_chat_state_changed_vardict (
       self, tp_channel_chat_state_changed_cb, NULL, NULL, NULL,
       NULL);
 
@@ -913,13 +1104,16 @@ _tp_channel_get_interfaces (TpChannel *self)
   if (tp_asv_lookup (self->priv->channel_properties,
           TP_PROP_CHANNEL_INTERFACES) != NULL &&
       (self->priv->exists ||
+       self->priv->properties_complete ||
        tp_proxy_has_interface_by_id (self,
           TP_IFACE_QUARK_CHANNEL_INTERFACE_GROUP)))
     {
       /* If we already know the channel's interfaces, and either have already
-       * successfully called a method on the channel (so know it's alive) or
-       * are going to call one on it when we introspect the Group properties,
-       * then we don't need to do anything here.
+       * successfully called a method on the channel (so know it's alive),
+       * were given a complete set of immutable properties (so whoever
+       * announced it has just told us it exists), or are going to call one
+       * on it when we introspect the Group properties, then we don't need to
+       * do anything here.
        */
       _tp_channel_continue_introspection (self);
     }
@@ -927,6 +1121,10 @@ _tp_channel_get_interfaces (TpChannel *self)
     {
       /* either we don't know the Interfaces, or we just want to verify the
        * channel's existence */
+      if (tp_asv_lookup (self->priv->channel_properties,
+              TP_PROP_CHANNEL_INTERFACES) == NULL)
+        _tp_channel_note_round_trip (self, "GetInterfaces");
+
       tp_cli_channel_call_get_interfaces (self, -1,
           tp_channel_got_interfaces_cb, NULL, NULL, NULL);
     }
@@ -969,7 +1167,7 @@ _tp_channel_get_channel_type (TpChannel *self)
 {
   if (self->priv->channel_type == 0)
     {
-      DEBUG ("%p: calling GetChannelType", self);
+      _tp_channel_note_round_trip (self, "GetChannelType");
       tp_cli_channel_call_get_channel_type (self, -1,
           tp_channel_got_channel_type_cb, NULL, NULL, NULL);
     }
@@ -999,11 +1197,11 @@ tp_channel_got_handle_cb (TpChannel *self,
       self->priv->handle_type = handle_type;
       self->priv->handle = handle;
 
-      g_hash_table_insert (self->priv->channel_properties,
+      _tp_channel_insert_property (self,
           g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE_TYPE),
           tp_g_value_slice_new_uint (handle_type));
 
-      g_hash_table_insert (self->priv->channel_properties,
+      _tp_channel_insert_property (self,
           g_strdup (TP_PROP_CHANNEL_TARGET_HANDLE),
           tp_g_value_slice_new_uint (handle));
 
@@ -1026,7 +1224,7 @@ _tp_channel_get_handle (TpChannel *self)
       || (self->priv->handle == 0 &&
           self->priv->handle_type != TP_HANDLE_TYPE_NONE))
     {
-      DEBUG ("%p: calling GetHandle", self);
+      _tp_channel_note_round_trip (self, "GetHandle");
       tp_cli_channel_call_get_handle (self, -1,
           tp_channel_got_handle_cb, NULL, NULL, NULL);
     }
@@ -1092,7 +1290,7 @@ _tp_channel_get_identifier (TpChannel *self)
     {
       GArray handles = {(gchar *) &self->priv->handle, 1};
 
-      DEBUG ("%p: calling InspectHandles", self);
+      _tp_channel_note_round_trip (self, "InspectHandles");
       tp_cli_connection_call_inspect_handles (self->priv->connection, -1,
           self->priv->handle_type, &handles,
           tp_channel_got_identifier_cb, g_object_ref (self), NULL, NULL);
@@ -1144,7 +1342,7 @@ _tp_channel_got_properties (TpProxy *proxy,
 
       if (valid)
         {
-          g_hash_table_insert (self->priv->channel_properties,
+          _tp_channel_insert_property (self,
               g_strdup (TP_PROP_CHANNEL_INITIATOR_HANDLE),
               tp_g_value_slice_new_uint (u));
         }
@@ -1153,7 +1351,7 @@ _tp_channel_got_properties (TpProxy *proxy,
 
       if (s != NULL)
         {
-          g_hash_table_insert (self->priv->channel_properties,
+          _tp_channel_insert_property (self,
               g_strdup (TP_PROP_CHANNEL_INITIATOR_ID),
               tp_g_value_slice_new_string (s));
         }
@@ -1162,7 +1360,7 @@ _tp_channel_got_properties (TpProxy *proxy,
 
       if (valid)
         {
-          g_hash_table_insert (self->priv->channel_properties,
+          _tp_channel_insert_property (self,
               g_strdup (TP_PROP_CHANNEL_REQUESTED),
               tp_g_value_slice_new_boolean (b));
         }
@@ -1219,11 +1417,17 @@ _tp_channel_get_properties (TpChannel *self)
       if (!valid)
         goto missing;
 
+      if (self->priv->properties_supplied &&
+          tp_asv_get_boxed (self->priv->channel_properties,
+            TP_PROP_CHANNEL_INTERFACES, G_TYPE_STRV) != NULL)
+        self->priv->properties_complete = TRUE;
+
       _tp_channel_continue_introspection (self);
       return;
     }
 
 missing:
+  _tp_channel_note_round_trip (self, "GetAll");
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_CHANNEL, _tp_channel_got_properties, NULL, NULL, NULL);
 }
@@ -1291,32 +1495,25 @@ tp_channel_closed_cb (TpChannel *self,
     }
 }
 
-static void
-tp_channel_connection_invalidated_cb (TpConnection *conn,
-                                      guint domain,
-                                      guint code,
-                                      gchar *message,
-                                      TpChannel *self)
+/*
+ * _tp_channel_connection_invalidated:
+ * @self: a channel, which has been invalidated by
+ *  _tp_proxy_invalidate_many() together with the other channels on its
+ *  connection
+ *
+ * Called by the #TpConnection when it is invalidated, instead of each of
+ * its channels connecting to #TpProxy::invalidated. The caller holds a
+ * ref to @self, since g_object_notify() calls out to user code.
+ */
+void
+_tp_channel_connection_invalidated (TpChannel *self)
 {
-  const GError e = { domain, code, message };
-
-  g_signal_handler_disconnect (conn, self->priv->conn_invalidated_id);
-  self->priv->conn_invalidated_id = 0;
-
-  /* tp_proxy_invalidate and g_object_notify call out to user code - add a
-   * temporary ref to ensure that we don't become finalized while doing so */
-  g_object_ref (self);
-
-  tp_proxy_invalidate ((TpProxy *) self, &e);
-
   /* this channel's handle is now meaningless */
   if (self->priv->handle != 0)
     {
       self->priv->handle = 0;
       g_object_notify ((GObject *) self, "handle");
     }
-
-  g_object_unref (self);
 }
 
 static GObject *
@@ -1330,10 +1527,9 @@ tp_channel_constructor (GType type,
   GError *error = NULL;
   TpProxySignalConnection *sc;
 
-  /* If our TpConnection dies, so do we. */
-  self->priv->conn_invalidated_id = g_signal_connect (self->priv->connection,
-      "invalidated", G_CALLBACK (tp_channel_connection_invalidated_cb),
-      self);
+  /* If our TpConnection dies, so do we: it invalidates all its channels
+   * together */
+  _tp_connection_add_channel (self->priv->connection, self);
 
   /* Connect to my own Closed signal and self-destruct when it arrives.
    * The channel hasn't had a chance to become invalid yet (it was just
@@ -1386,8 +1582,13 @@ tp_channel_constructor (GType type,
    * (b) priv->exists is TRUE (i.e. either GetAll, GetHandle or GetChannelType
    * has succeeded).
    *
-   * This means the channel never becomes ready until we re-enter the
-   * main loop, and we always verify that the channel does actually exist. */
+   * If we were given a complete set of immutable properties (as the channel
+   * dispatcher does with HandleChannels and friends), we trust whoever gave
+   * them to us that the channel exists, and skip the call: if the connection
+   * is already prepared, CORE can then be prepared without any round-trips.
+   * Otherwise, this means the channel never becomes ready until we re-enter
+   * the main loop, and we always verify that the channel does actually
+   * exist. */
   g_queue_push_tail (self->priv->introspect_needed,
       _tp_channel_get_interfaces);
 
@@ -1413,6 +1614,7 @@ tp_channel_init (TpChannel *self)
   self->priv->channel_properties = g_hash_table_new_full (g_str_hash,
       g_str_equal, g_free, (GDestroyNotify) tp_g_value_slice_free);
   self->priv->contacts_queue = g_queue_new ();
+  g_queue_init (&self->priv->current_contacts_queue_results);
 }
 
 static void
@@ -1422,15 +1624,16 @@ tp_channel_dispose (GObject *object)
 
   DEBUG ("%p", self);
 
+  if (self->priv->chat_states_idle_id != 0)
+    {
+      _tp_source_remove (self->priv->chat_states_idle_id);
+      self->priv->chat_states_idle_id = 0;
+    }
+
   if (self->priv->connection == NULL)
     goto finally;
 
-  if (self->priv->conn_invalidated_id != 0)
-    g_signal_handler_disconnect (self->priv->connection,
-        self->priv->conn_invalidated_id);
-
-  self->priv->conn_invalidated_id = 0;
-
+  _tp_connection_remove_channel (self->priv->connection, self);
   g_clear_object (&self->priv->connection);
   g_clear_object (&self->priv->target_contact);
   g_clear_object (&self->priv->initiator_contact);
@@ -1462,8 +1665,10 @@ tp_channel_finalize (GObject *object)
   tp_clear_pointer (&self->priv->group_remote_pending, tp_intset_destroy);
   tp_clear_pointer (&self->priv->group_handle_owners, g_hash_table_unref);
   tp_clear_pointer (&self->priv->introspect_needed, g_queue_free);
-  tp_clear_pointer (&self->priv->chat_states, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->chat_states, _tp_chat_state_map_free);
+  tp_clear_pointer (&self->priv->pending_chat_states, g_array_unref);
   tp_clear_pointer (&self->priv->channel_properties, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->channel_properties_vardict, g_variant_unref);
   tp_clear_pointer (&self->priv->contacts_queue, g_queue_free);
 
   g_free (self->priv->identifier);
@@ -1929,6 +2134,11 @@ tp_channel_class_init (TpChannelClass *klass)
    * Emitted when a contact's chat state changes after tp_proxy_prepare_async()
    * has finished preparing the feature %TP_CHANNEL_FEATURE_CHAT_STATES.
    *
+   * Changed in 0.UNRELEASED: changes that arrive together are signalled
+   * from the main loop, once per contact with their latest state, and not
+   * at all if that is the state they started with. A contact becoming
+   * %TP_CHANNEL_CHAT_STATE_GONE is still signalled immediately.
+   *
    * Since: 0.11.3
    * Deprecated: Use #TpTextChannel::contact-chat-state-changed instead
    */
@@ -118,6 +118,8 @@ _TP_AVAILABLE_IN_0_20
 TpConnection *tp_channel_get_connection (TpChannel *self);
 _TP_AVAILABLE_IN_0_20
 GVariant *tp_channel_dup_immutable_properties (TpChannel *self);
+_TP_AVAILABLE_IN_UNRELEASED
+GVariant *tp_channel_get_immutable_properties_vardict (TpChannel *self);
 
 void tp_channel_leave_async (TpChannel *self,
     TpChannelGroupChangeReason reason,
@@ -0,0 +1,54 @@
+/*<private_header>*/
+/* Compact per-contact chat states (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_CHAT_STATE_MAP_INTERNAL_H__
+#define __TP_CHAT_STATE_MAP_INTERNAL_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/enums.h>
+#include <telepathy-glib/handle.h>
+#include <telepathy-glib/intset.h>
+
+G_BEGIN_DECLS
+
+/* A map from contact handles to chat states, in which every contact not
+ * mentioned is Inactive; see chat-state-map.c */
+typedef struct _TpChatStateMap _TpChatStateMap;
+
+_TpChatStateMap *_tp_chat_state_map_new (void);
+void _tp_chat_state_map_free (_TpChatStateMap *map);
+
+TpChannelChatState _tp_chat_state_map_get (const _TpChatStateMap *map,
+    TpHandle handle);
+gboolean _tp_chat_state_map_set (_TpChatStateMap *map,
+    TpHandle handle,
+    TpChannelChatState state);
+
+/* the handles whose state is anything but Inactive, Gone included */
+const TpIntset *_tp_chat_state_map_peek_active (const _TpChatStateMap *map);
+
+/* a new TpHandle => TpChannelChatState table of the active handles, of
+ * the D-Bus type a{uu} */
+GHashTable *_tp_chat_state_map_dup_hash (const _TpChatStateMap *map);
+
+G_END_DECLS
+
+#endif
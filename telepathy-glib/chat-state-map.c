@@ -0,0 +1,160 @@
+/* Compact per-contact chat states
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/chat-state-map-internal.h"
+
+#include <string.h>
+
+#include <telepathy-glib/util.h>
+
+/*
+ * Chat states change several times a minute for everyone who is typing in
+ * a chatroom, so the common case should not allocate at all. Contact
+ * handles are small integers, allocated densely by nearly every
+ * connection manager, so each state is one byte in an array indexed by
+ * handle, which only grows; handles too big for that, or states too big
+ * for a byte, go in a hash table instead. The handles whose state is not
+ * Inactive, usually a handful, are also kept in a TpIntset so that they
+ * can be listed without looking at everyone else.
+ */
+
+/* the highest handle + 1 kept in the array, bounding it to 64 KiB */
+#define MAX_DENSE (1 << 16)
+
+/* in the array, 0 means Inactive and anything else is the state + 1 */
+#define MAX_DENSE_STATE (G_MAXUINT8 - 1)
+
+struct _TpChatStateMap {
+    guint8 *dense;
+    guint n_dense;
+    /* NULL, or TpHandle => TpChannelChatState */
+    GHashTable *sparse;
+    TpIntset *active;
+};
+
+_TpChatStateMap *
+_tp_chat_state_map_new (void)
+{
+  _TpChatStateMap *map = g_slice_new0 (_TpChatStateMap);
+
+  map->active = tp_intset_new ();
+  return map;
+}
+
+void
+_tp_chat_state_map_free (_TpChatStateMap *map)
+{
+  g_free (map->dense);
+  tp_clear_pointer (&map->sparse, g_hash_table_unref);
+  tp_intset_destroy (map->active);
+  g_slice_free (_TpChatStateMap, map);
+}
+
+TpChannelChatState
+_tp_chat_state_map_get (const _TpChatStateMap *map,
+    TpHandle handle)
+{
+  gpointer value;
+
+  if (handle < map->n_dense && map->dense[handle] != 0)
+    return map->dense[handle] - 1;
+
+  if (map->sparse != NULL &&
+      g_hash_table_lookup_extended (map->sparse, GUINT_TO_POINTER (handle),
+        NULL, &value))
+    return GPOINTER_TO_UINT (value);
+
+  return TP_CHANNEL_CHAT_STATE_INACTIVE;
+}
+
+/* Returns: %TRUE if @handle's state was not already @state */
+gboolean
+_tp_chat_state_map_set (_TpChatStateMap *map,
+    TpHandle handle,
+    TpChannelChatState state)
+{
+  gboolean dense = (handle < MAX_DENSE && state <= MAX_DENSE_STATE);
+
+  if (_tp_chat_state_map_get (map, handle) == state)
+    return FALSE;
+
+  /* forget the old state, wherever it was */
+  if (handle < map->n_dense)
+    map->dense[handle] = 0;
+
+  if (map->sparse != NULL)
+    g_hash_table_remove (map->sparse, GUINT_TO_POINTER (handle));
+
+  if (state == TP_CHANNEL_CHAT_STATE_INACTIVE)
+    {
+      tp_intset_remove (map->active, handle);
+      return TRUE;
+    }
+
+  tp_intset_add (map->active, handle);
+
+  if (dense)
+    {
+      if (handle >= map->n_dense)
+        {
+          guint n = MIN (MAX_DENSE, MAX (64, MAX (handle + 1,
+                  map->n_dense * 2)));
+
+          map->dense = g_realloc (map->dense, n);
+          memset (map->dense + map->n_dense, 0, n - map->n_dense);
+          map->n_dense = n;
+        }
+
+      map->dense[handle] = state + 1;
+    }
+  else
+    {
+      if (map->sparse == NULL)
+        map->sparse = g_hash_table_new (NULL, NULL);
+
+      g_hash_table_insert (map->sparse, GUINT_TO_POINTER (handle),
+          GUINT_TO_POINTER (state));
+    }
+
+  return TRUE;
+}
+
+const TpIntset *
+_tp_chat_state_map_peek_active (const _TpChatStateMap *map)
+{
+  return map->active;
+}
+
+GHashTable *
+_tp_chat_state_map_dup_hash (const _TpChatStateMap *map)
+{
+  GHashTable *ret = g_hash_table_new (NULL, NULL);
+  TpIntsetFastIter iter;
+  TpHandle handle;
+
+  tp_intset_fast_iter_init (&iter, map->active);
+
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    g_hash_table_insert (ret, GUINT_TO_POINTER (handle),
+        GUINT_TO_POINTER (_tp_chat_state_map_get (map, handle)));
+
+  return ret;
+}
@@ -0,0 +1,49 @@
+/*<private_header>*/
+/* A GInputStream which checksums what is read through it (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_CHECKSUM_INPUT_STREAM_INTERNAL_H__
+#define __TP_CHECKSUM_INPUT_STREAM_INTERNAL_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpChecksumInputStream _TpChecksumInputStream;
+typedef struct _TpChecksumInputStreamClass _TpChecksumInputStreamClass;
+
+#define _TP_TYPE_CHECKSUM_INPUT_STREAM (_tp_checksum_input_stream_get_type ())
+#define _TP_CHECKSUM_INPUT_STREAM(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), _TP_TYPE_CHECKSUM_INPUT_STREAM, \
+                               _TpChecksumInputStream))
+
+GType _tp_checksum_input_stream_get_type (void) G_GNUC_CONST;
+
+_TpChecksumInputStream *_tp_checksum_input_stream_new (
+    GInputStream *base_stream,
+    GChecksumType checksum_type);
+
+guint64 _tp_checksum_input_stream_get_bytes (_TpChecksumInputStream *self);
+
+const gchar *_tp_checksum_input_stream_get_string (
+    _TpChecksumInputStream *self);
+
+G_END_DECLS
+
+#endif
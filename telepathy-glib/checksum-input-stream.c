@@ -0,0 +1,219 @@
+/* A GInputStream which checksums what is read through it
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/checksum-input-stream-internal.h"
+
+#include <telepathy-glib/util.h>
+
+/* This passes everything through to the base stream, feeding each buffer
+ * to a GChecksum as it goes by, so that a file can be hashed while it is
+ * being transferred rather than read again afterwards. Closing it closes
+ * the base stream, as for any GFilterInputStream.
+ *
+ * Reads must not be made from more than one thread at once, which GIO
+ * ensures anyway by only allowing one pending operation per stream. */
+
+struct _TpChecksumInputStream {
+    GFilterInputStream parent;
+
+    GChecksum *checksum;
+    guint64 bytes;
+};
+
+struct _TpChecksumInputStreamClass {
+    GFilterInputStreamClass parent_class;
+};
+
+G_DEFINE_TYPE (_TpChecksumInputStream, _tp_checksum_input_stream,
+    G_TYPE_FILTER_INPUT_STREAM)
+
+static void
+_tp_checksum_input_stream_init (_TpChecksumInputStream *self)
+{
+}
+
+static void
+_tp_checksum_input_stream_finalize (GObject *object)
+{
+  _TpChecksumInputStream *self = (_TpChecksumInputStream *) object;
+
+  g_checksum_free (self->checksum);
+
+  G_OBJECT_CLASS (_tp_checksum_input_stream_parent_class)->finalize (
+      object);
+}
+
+static GInputStream *
+get_base (_TpChecksumInputStream *self)
+{
+  return g_filter_input_stream_get_base_stream ((GFilterInputStream *) self);
+}
+
+static void
+checksum_update (_TpChecksumInputStream *self,
+    gconstpointer buffer,
+    gssize n)
+{
+  if (n <= 0)
+    return;
+
+  g_checksum_update (self->checksum, buffer, n);
+  self->bytes += n;
+}
+
+static gssize
+checksum_read_fn (GInputStream *stream,
+    void *buffer,
+    gsize count,
+    GCancellable *cancellable,
+    GError **error)
+{
+  _TpChecksumInputStream *self = (_TpChecksumInputStream *) stream;
+  gssize n;
+
+  n = g_input_stream_read (get_base (self), buffer, count, cancellable,
+      error);
+  checksum_update (self, buffer, n);
+  return n;
+}
+
+static gssize
+checksum_skip (GInputStream *stream,
+    gsize count,
+    GCancellable *cancellable,
+    GError **error)
+{
+  /* skipped data still has to be hashed, so read it instead */
+  gchar buffer[8192];
+
+  return checksum_read_fn (stream, buffer, MIN (count, sizeof (buffer)),
+      cancellable, error);
+}
+
+static void
+base_read_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result = user_data;
+  _TpChecksumInputStream *self = (_TpChecksumInputStream *)
+    g_async_result_get_source_object (G_ASYNC_RESULT (result));
+  /* the caller's buffer, until we replace it with the result */
+  gconstpointer buffer = g_simple_async_result_get_op_res_gpointer (result);
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (G_INPUT_STREAM (source), res, &error);
+
+  if (n < 0)
+    {
+      g_simple_async_result_take_error (result, error);
+    }
+  else
+    {
+      checksum_update (self, buffer, n);
+      g_simple_async_result_set_op_res_gssize (result, n);
+    }
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+  g_object_unref (self);
+}
+
+static void
+checksum_read_async (GInputStream *stream,
+    void *buffer,
+    gsize count,
+    int io_priority,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  _TpChecksumInputStream *self = (_TpChecksumInputStream *) stream;
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback, user_data,
+      checksum_read_async);
+  g_simple_async_result_set_op_res_gpointer (result, buffer, NULL);
+
+  g_input_stream_read_async (get_base (self), buffer, count, io_priority,
+      cancellable, base_read_cb, result);
+}
+
+static gssize
+checksum_read_finish (GInputStream *stream,
+    GAsyncResult *result,
+    GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+      G_OBJECT (stream), checksum_read_async), -1);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return -1;
+
+  return g_simple_async_result_get_op_res_gssize (simple);
+}
+
+static void
+_tp_checksum_input_stream_class_init (_TpChecksumInputStreamClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+  GInputStreamClass *input_class = G_INPUT_STREAM_CLASS (cls);
+
+  object_class->finalize = _tp_checksum_input_stream_finalize;
+
+  input_class->read_fn = checksum_read_fn;
+  input_class->skip = checksum_skip;
+  input_class->read_async = checksum_read_async;
+  input_class->read_finish = checksum_read_finish;
+}
+
+_TpChecksumInputStream *
+_tp_checksum_input_stream_new (GInputStream *base_stream,
+    GChecksumType checksum_type)
+{
+  _TpChecksumInputStream *self;
+
+  g_return_val_if_fail (G_IS_INPUT_STREAM (base_stream), NULL);
+
+  self = g_object_new (_TP_TYPE_CHECKSUM_INPUT_STREAM,
+      "base-stream", base_stream,
+      NULL);
+  self->checksum = g_checksum_new (checksum_type);
+  return self;
+}
+
+/* The number of bytes read so far */
+guint64
+_tp_checksum_input_stream_get_bytes (_TpChecksumInputStream *self)
+{
+  return self->bytes;
+}
+
+/* The checksum of everything read so far, as lower-case hex; once this has
+ * been called, no more can be read */
+const gchar *
+_tp_checksum_input_stream_get_string (_TpChecksumInputStream *self)
+{
+  return g_checksum_get_string (self->checksum);
+}
@@ -58,6 +58,10 @@ struct _TpCMMessage {
 TpMessage * _tp_cm_message_new_from_parts (TpBaseConnection *conn,
     const GPtrArray *parts);
 
+GHashTable *_tp_cm_message_get_content_streams (TpMessage *self);
+void _tp_cm_message_set_content_streams (TpMessage *self,
+    GHashTable *streams);
+
 G_END_DECLS
 
 #endif /* __TP_CM_MESSAGE_INTERNAL_H__ */
@@ -55,6 +55,10 @@ G_DEFINE_TYPE (TpCMMessage, tp_cm_message, TP_TYPE_MESSAGE)
 struct _TpCMMessagePrivate
 {
   TpBaseConnection *connection;
+  /* pinned, or 0 */
+  TpHandle sender;
+  /* part number => owned GInputStream, or NULL if no part is streamed */
+  GHashTable *content_streams;
 };
 
 static void
@@ -64,7 +68,19 @@ tp_cm_message_dispose (GObject *object)
   void (*dispose) (GObject *) =
     G_OBJECT_CLASS (tp_cm_message_parent_class)->dispose;
 
+  if (self->priv->sender != 0)
+    {
+      TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+          self->priv->connection, TP_HANDLE_TYPE_CONTACT);
+
+      if (contact_repo != NULL)
+        tp_handle_unpin (contact_repo, self->priv->sender);
+
+      self->priv->sender = 0;
+    }
+
   tp_clear_object (&self->priv->connection);
+  tp_clear_pointer (&self->priv->content_streams, g_hash_table_unref);
 
   if (dispose != NULL)
     dispose (object);
@@ -254,11 +270,116 @@ tp_cm_message_set_sender (TpMessage *self,
   contact_repo = tp_base_connection_get_handles (cm_msg->priv->connection,
       TP_HANDLE_TYPE_CONTACT);
 
+  /* keep it valid for as long as the message is pending */
+  tp_handle_pin (contact_repo, handle);
+
+  if (cm_msg->priv->sender != 0)
+    tp_handle_unpin (contact_repo, cm_msg->priv->sender);
+
+  cm_msg->priv->sender = handle;
+
   id = tp_handle_inspect (contact_repo, handle);
   if (id != NULL)
     tp_message_set_string (self, 0, "message-sender-id", id);
 }
 
+/**
+ * tp_cm_message_set_content_stream:
+ * @self: a #TpCMMessage
+ * @part: a part number, which must be strictly greater than 0 and less than
+ *  the number returned by tp_message_count_parts()
+ * @stream: the content of the part
+ * @size: the number of bytes that will be read from @stream, or 0 if unknown
+ *
+ * Make @stream the content of part @part of @self, instead of a "content"
+ * key. The part is announced with "needs-retrieval" set to %TRUE and, if
+ * @size is non-zero, with "size" set to @size; @stream is not read until a
+ * client calls GetPendingMessageContent() for that part, so large
+ * attachments don't have to be held in memory or sent with every
+ * MessageReceived and PendingMessages.
+ *
+ * If @stream is a #GSeekable that can seek, it is rewound and read again
+ * each time the content is retrieved; otherwise, the content is kept in
+ * memory after it has been read for the first time.
+ *
+ * This only makes sense for received messages: the content of messages that
+ * are sent is always given to the connection manager in full.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_cm_message_set_content_stream (TpMessage *self,
+    guint part,
+    GInputStream *stream,
+    guint64 size)
+{
+  TpCMMessage *cm_msg;
+
+  g_return_if_fail (TP_IS_CM_MESSAGE (self));
+  g_return_if_fail (part > 0);
+  g_return_if_fail (part < self->parts->len);
+  g_return_if_fail (G_IS_INPUT_STREAM (stream));
+  g_return_if_fail (tp_message_is_mutable (self));
+
+  cm_msg = (TpCMMessage *) self;
+
+  if (cm_msg->priv->content_streams == NULL)
+    cm_msg->priv->content_streams = g_hash_table_new_full (NULL, NULL,
+        NULL, g_object_unref);
+
+  g_hash_table_insert (cm_msg->priv->content_streams,
+      GUINT_TO_POINTER (part), g_object_ref (stream));
+
+  tp_message_delete_key (self, part, "content");
+  tp_message_set_boolean (self, part, "needs-retrieval", TRUE);
+
+  if (size != 0)
+    tp_message_set_uint64 (self, part, "size", size);
+  else
+    tp_message_delete_key (self, part, "size");
+}
+
+/*
+ * _tp_cm_message_get_content_streams:
+ * @self: a #TpCMMessage
+ *
+ * Returns: (transfer none): a map from part numbers to the #GInputStream
+ *  set with tp_cm_message_set_content_stream(), or %NULL if there are none
+ */
+GHashTable *
+_tp_cm_message_get_content_streams (TpMessage *self)
+{
+  g_return_val_if_fail (TP_IS_CM_MESSAGE (self), NULL);
+
+  return ((TpCMMessage *) self)->priv->content_streams;
+}
+
+/*
+ * _tp_cm_message_set_content_streams:
+ * @self: a #TpCMMessage
+ * @streams: (allow-none): a map as returned by
+ *  _tp_cm_message_get_content_streams(), or %NULL
+ *
+ * Make @self share @streams, for instance with the copy it was read from.
+ * The parts of @self are expected to already describe them.
+ */
+void
+_tp_cm_message_set_content_streams (TpMessage *self,
+    GHashTable *streams)
+{
+  TpCMMessage *cm_msg;
+
+  g_return_if_fail (TP_IS_CM_MESSAGE (self));
+
+  cm_msg = (TpCMMessage *) self;
+
+  if (streams != NULL)
+    g_hash_table_ref (streams);
+
+  tp_clear_pointer (&cm_msg->priv->content_streams, g_hash_table_unref);
+  cm_msg->priv->content_streams = streams;
+}
+
 TpMessage *
 _tp_cm_message_new_from_parts (TpBaseConnection *conn,
     const GPtrArray *parts)
@@ -27,6 +27,7 @@
 
 
 #include <glib.h>
+#include <gio/gio.h>
 
 #include <telepathy-glib/base-connection.h>
 #include <telepathy-glib/defs.h>
@@ -64,6 +65,12 @@ void tp_cm_message_take_message (TpMessage *self,
     const gchar *key,
     TpMessage *message);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_cm_message_set_content_stream (TpMessage *self,
+    guint part,
+    GInputStream *stream,
+    guint64 size);
+
 TpHandle tp_cm_message_get_sender (TpMessage *self);
 void tp_cm_message_set_sender (TpMessage *self,
     TpHandle handle);
@@ -33,30 +33,76 @@
 #include "telepathy-glib/contact-internal.h"
 #include "telepathy-glib/util-internal.h"
 
+/* One or more ContactsChangedWithID signals. A handle appears in at most
+ * one of changes and removals: whichever happened last. */
 typedef struct
 {
+  /* TpHandle => owned GValueArray (subscription states) */
   GHashTable *changes;
+  /* TpHandle => owned identifier, for the keys of changes */
   GHashTable *identifiers;
+  /* TpHandle => owned identifier */
   GHashTable *removals;
   GPtrArray *new_contacts;
 } ContactsChangedItem;
 
 static ContactsChangedItem *
-contacts_changed_item_new (GHashTable *changes,
-    GHashTable *identifiers,
-    GHashTable *removals)
+contacts_changed_item_new (void)
 {
   ContactsChangedItem *item;
 
   item = g_slice_new0 (ContactsChangedItem);
-  item->changes = g_hash_table_ref (changes);
-  item->identifiers = g_hash_table_ref (identifiers);
-  item->removals = g_hash_table_ref (removals);
+  item->changes = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) tp_value_array_free);
+  item->identifiers = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  item->removals = g_hash_table_new_full (NULL, NULL, NULL, g_free);
   item->new_contacts = g_ptr_array_new_with_free_func (g_object_unref);
 
   return item;
 }
 
+/* Add a ContactsChangedWithID signal to @item, replacing anything @item
+ * already said about the same contacts.
+ *
+ * Returns: the number of contacts whose earlier change was replaced */
+static guint
+contacts_changed_item_merge (ContactsChangedItem *item,
+    GHashTable *changes,
+    GHashTable *identifiers,
+    GHashTable *removals)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  guint superseded = 0;
+
+  g_hash_table_iter_init (&iter, changes);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (g_hash_table_remove (item->removals, key) ||
+          g_hash_table_lookup (item->changes, key) != NULL)
+        superseded++;
+
+      g_hash_table_insert (item->changes, key,
+          g_boxed_copy (G_TYPE_VALUE_ARRAY, value));
+      g_hash_table_insert (item->identifiers, key,
+          g_strdup (g_hash_table_lookup (identifiers, key)));
+    }
+
+  g_hash_table_iter_init (&iter, removals);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (g_hash_table_remove (item->changes, key))
+        {
+          g_hash_table_remove (item->identifiers, key);
+          superseded++;
+        }
+
+      g_hash_table_insert (item->removals, key, g_strdup (value));
+    }
+
+  return superseded;
+}
+
 static void
 contacts_changed_item_free (ContactsChangedItem *item)
 {
@@ -74,6 +120,113 @@ _tp_connection_contacts_changed_queue_free (GQueue *queue)
   g_queue_free (queue);
 }
 
+/* Returns: the set of roster contacts in @group, creating it if @create */
+static GHashTable *
+roster_group_set (TpConnection *self,
+    const gchar *group,
+    gboolean create)
+{
+  GHashTable *set = g_hash_table_lookup (self->priv->roster_by_group, group);
+
+  if (set == NULL && create)
+    {
+      set = g_hash_table_new (NULL, NULL);
+      g_hash_table_insert (self->priv->roster_by_group, g_strdup (group),
+          set);
+    }
+
+  return set;
+}
+
+static gboolean
+roster_contains (TpConnection *self,
+    TpContact *contact)
+{
+  return (self->priv->roster != NULL &&
+      g_hash_table_lookup (self->priv->roster,
+        GUINT_TO_POINTER (tp_contact_get_handle (contact))) == contact);
+}
+
+/* Add @contact to the indexes of the roster under its current subscription
+ * states and groups, if it is on the roster. @self may be %NULL, for a
+ * contact whose connection has gone away. */
+void
+_tp_connection_roster_index_contact (TpConnection *self,
+    TpContact *contact)
+{
+  TpSubscriptionState subscribe, publish;
+  const gchar * const *groups;
+
+  if (self == NULL || !roster_contains (self, contact))
+    return;
+
+  subscribe = tp_contact_get_subscribe_state (contact);
+  publish = tp_contact_get_publish_state (contact);
+
+  if (subscribe < TP_NUM_SUBSCRIPTION_STATES)
+    g_hash_table_add (self->priv->roster_by_subscribe[subscribe], contact);
+
+  if (publish < TP_NUM_SUBSCRIPTION_STATES)
+    g_hash_table_add (self->priv->roster_by_publish[publish], contact);
+
+  for (groups = tp_contact_get_contact_groups (contact);
+      groups != NULL && *groups != NULL;
+      groups++)
+    g_hash_table_add (roster_group_set (self, *groups, TRUE), contact);
+}
+
+/* The reverse of _tp_connection_roster_index_contact(): it must be called
+ * before @contact's subscription states or groups change, and before it is
+ * removed from the roster */
+void
+_tp_connection_roster_unindex_contact (TpConnection *self,
+    TpContact *contact)
+{
+  TpSubscriptionState subscribe, publish;
+  const gchar * const *groups;
+
+  if (self == NULL || !roster_contains (self, contact))
+    return;
+
+  subscribe = tp_contact_get_subscribe_state (contact);
+  publish = tp_contact_get_publish_state (contact);
+
+  if (subscribe < TP_NUM_SUBSCRIPTION_STATES)
+    g_hash_table_remove (self->priv->roster_by_subscribe[subscribe], contact);
+
+  if (publish < TP_NUM_SUBSCRIPTION_STATES)
+    g_hash_table_remove (self->priv->roster_by_publish[publish], contact);
+
+  for (groups = tp_contact_get_contact_groups (contact);
+      groups != NULL && *groups != NULL;
+      groups++)
+    {
+      GHashTable *set = roster_group_set (self, *groups, FALSE);
+
+      if (set == NULL)
+        continue;
+
+      g_hash_table_remove (set, contact);
+
+      if (g_hash_table_size (set) == 0)
+        g_hash_table_remove (self->priv->roster_by_group, *groups);
+    }
+}
+
+void
+_tp_connection_roster_index_clear (TpConnection *self)
+{
+  guint i;
+
+  g_hash_table_remove_all (self->priv->roster_by_group);
+
+  for (i = 0; i < TP_NUM_SUBSCRIPTION_STATES; i++)
+    {
+      g_hash_table_remove_all (self->priv->roster_by_subscribe[i]);
+      g_hash_table_remove_all (self->priv->roster_by_publish[i]);
+    }
+}
+
 static void process_queued_contacts_changed (TpConnection *self);
 
 static void
@@ -102,12 +255,15 @@ contacts_changed_head_ready (TpConnection *self)
       contact = g_hash_table_lookup (self->priv->roster, key);
       if (contact == NULL)
         {
-          DEBUG ("handle %u removed but not in our table - broken CM",
+          /* either a broken CM, or the contact was added and removed
+           * again while we were busy */
+          DEBUG ("handle %u removed but not in our table",
               GPOINTER_TO_UINT (key));
           continue;
         }
 
       g_ptr_array_add (removed, g_object_ref (contact));
+      _tp_connection_roster_unindex_contact (self, contact);
       g_hash_table_remove (self->priv->roster, key);
     }
 
@@ -120,11 +276,15 @@ contacts_changed_head_ready (TpConnection *self)
       g_hash_table_insert (self->priv->roster,
           GUINT_TO_POINTER (tp_contact_get_handle (contact)),
           g_object_ref (contact));
+      _tp_connection_roster_index_contact (self, contact);
     }
 
   DEBUG ("roster changed: %d added, %d removed", added->len, removed->len);
   if (added->len > 0 || removed->len > 0)
-    g_signal_emit_by_name (self, "contact-list-changed", added, removed);
+    {
+      self->priv->roster_generation++;
+      g_signal_emit_by_name (self, "contact-list-changed", added, removed);
+    }
 
   g_ptr_array_unref (added);
   g_ptr_array_unref (removed);
@@ -201,6 +361,7 @@ contacts_changed_cb (TpConnection *self,
     gpointer user_data,
     GObject *weak_object)
 {
+  GQueue *queue = self->priv->contacts_changed_queue;
   ContactsChangedItem *item;
 
   /* Ignore ContactsChanged signal if we didn't receive initial roster yet */
@@ -209,15 +370,94 @@ contacts_changed_cb (TpConnection *self,
 
   /* We need a queue to make sure we don't reorder signals if we get a 2nd
    * ContactsChanged signal before the previous one finished preparing TpContact
-   * objects. */
-  item = contacts_changed_item_new (changes, identifiers, removals);
-  g_queue_push_tail (self->priv->contacts_changed_queue, item);
+   * objects. Only the head of the queue is being worked on, so anything
+   * that arrives in the meantime is merged into a single item behind it:
+   * that way, a contact that changes repeatedly is only upgraded once, in
+   * its latest state. */
+  if (queue->length >= 2)
+    {
+      guint superseded;
+
+      item = g_queue_peek_tail (queue);
+      superseded = contacts_changed_item_merge (item, changes, identifiers,
+          removals);
+
+      self->priv->contacts_changed_merged_signals++;
+      self->priv->contacts_changed_merged_contacts += superseded;
+      DEBUG ("merged ContactsChanged into pending changes, replacing %u",
+          superseded);
+      return;
+    }
+
+  item = contacts_changed_item_new ();
+  contacts_changed_item_merge (item, changes, identifiers, removals);
+  g_queue_push_tail (queue, item);
 
   /* If this is the only item in the queue, we can process it right away */
   if (self->priv->contacts_changed_queue->length == 1)
     process_queued_contacts_changed (self);
 }
 
+/* Add the contact @handle to the roster, giving it @asv if not NULL */
+static TpContact *
+roster_add_contact (TpConnection *self,
+    TpHandle handle,
+    const gchar *id,
+    GHashTable *asv,
+    GArray *features)
+{
+  TpContact *contact;
+  GError *e = NULL;
+
+  contact = tp_simple_client_factory_ensure_contact (
+      tp_proxy_get_factory (self), self, handle, id);
+
+  /* ensure_contact() can fail for obsolete CMs that don't have
+   * ImmortalHandles */
+  if (contact == NULL)
+    return NULL;
+
+  if (asv != NULL &&
+      !_tp_contact_set_attributes (contact, asv,
+          features->len, (TpContactFeature *) features->data, &e))
+    {
+      DEBUG ("Error setting contact attributes: %s", e->message);
+      g_clear_error (&e);
+    }
+
+  /* Give the contact ref to the table */
+  g_hash_table_insert (self->priv->roster, GUINT_TO_POINTER (handle),
+      contact);
+  self->priv->roster_generation++;
+  _tp_connection_roster_index_contact (self, contact);
+  return contact;
+}
+
+/* Called when every contact in the roster has its attributes */
+static void
+roster_fetched (TpConnection *self,
+    GSimpleAsyncResult *result)
+{
+  /* emit initial set if roster is not empty */
+  if (g_hash_table_size (self->priv->roster) != 0)
+    {
+      GPtrArray *added;
+      GPtrArray *removed;
+
+      added = tp_connection_dup_contact_list (self);
+      removed = g_ptr_array_new ();
+      g_signal_emit_by_name (self, "contact-list-changed", added, removed);
+      g_ptr_array_unref (added);
+      g_ptr_array_unref (removed);
+    }
+
+  self->priv->contact_list_state = TP_CONTACT_LIST_STATE_SUCCESS;
+  g_object_notify ((GObject *) self, "contact-list-state");
+
+  if (result != NULL)
+    g_simple_async_result_complete_in_idle (result);
+}
+
 static void
 got_contact_list_attributes_cb (TpConnection *self,
     GHashTable *attributes,
@@ -236,7 +476,10 @@ got_contact_list_attributes_cb (TpConnection *self,
       g_object_notify ((GObject *) self, "contact-list-state");
 
       if (result != NULL)
-        g_simple_async_result_set_from_error (result, error);
+        {
+          g_simple_async_result_set_from_error (result, error);
+          g_simple_async_result_complete_in_idle (result);
+        }
 
       goto OUT;
     }
@@ -247,53 +490,149 @@ got_contact_list_attributes_cb (TpConnection *self,
   g_hash_table_iter_init (&iter, attributes);
   while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      TpHandle handle = GPOINTER_TO_UINT (key);
-      const gchar *id = tp_asv_get_string (value,
-          TP_TOKEN_CONNECTION_CONTACT_ID);
-      TpContact *contact;
-      GError *e = NULL;
+      roster_add_contact (self, GPOINTER_TO_UINT (key),
+          tp_asv_get_string (value, TP_TOKEN_CONNECTION_CONTACT_ID),
+          value, features);
+    }
 
-      contact = tp_simple_client_factory_ensure_contact (
-          tp_proxy_get_factory (self), self, handle, id);
+  roster_fetched (self, result);
 
-      /* ensure_contact() can fail for obsolete CMs that don't have
-       * ImmortalHandles */
-      if (contact == NULL)
-         continue;
+OUT:
+  tp_clear_object (&result);
+}
 
-      if (!_tp_contact_set_attributes (contact, value,
-              features->len, (TpContactFeature *) features->data, &e))
-        {
-          DEBUG ("Error setting contact attributes: %s", e->message);
-          g_clear_error (&e);
-        }
+static void
+get_contact_list_attributes (TpConnection *self,
+    GArray *features,
+    GSimpleAsyncResult *result)
+{
+  const gchar **supported_interfaces;
 
-      /* Give the contact ref to the table */
-      g_hash_table_insert (self->priv->roster, key, contact);
+  supported_interfaces = _tp_contacts_bind_to_signals (self, features->len,
+      (TpContactFeature *) features->data);
+
+  tp_cli_connection_interface_contact_list_call_get_contact_list_attributes (
+      self, -1, supported_interfaces, TRUE,
+      got_contact_list_attributes_cb,
+      g_array_ref (features), (GDestroyNotify) g_array_unref,
+      result ? g_object_ref (result) : NULL);
+
+  g_free (supported_interfaces);
+}
+
+typedef struct {
+    TpConnection *self;
+    GSimpleAsyncResult *result;
+} RosterUpgrade;
+
+static void
+roster_upgraded_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  RosterUpgrade *upgrade = user_data;
+  GError *error = NULL;
+
+  /* if this fails, the contacts are still on the roster, just without
+   * all the features */
+  if (!tp_connection_upgrade_contacts_finish (upgrade->self, res, NULL,
+          &error))
+    {
+      DEBUG ("Error getting attributes of uncached contacts: %s",
+          error->message);
+      g_clear_error (&error);
     }
 
-  /* emit initial set if roster is not empty */
-  if (g_hash_table_size (self->priv->roster) != 0)
+  roster_fetched (upgrade->self, upgrade->result);
+
+  g_object_unref (upgrade->self);
+  tp_clear_object (&upgrade->result);
+  g_slice_free (RosterUpgrade, upgrade);
+}
+
+static void
+got_contact_list_changes_cb (TpConnection *self,
+    GHashTable *changed,
+    GHashTable *unchanged,
+    const gchar *new_version,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GSimpleAsyncResult *result = (GSimpleAsyncResult *) weak_object;
+  GArray *features = user_data;
+  TpContactAttributesCache *cache;
+  GHashTableIter iter;
+  gpointer key, value;
+  GPtrArray *uncached;
+
+  cache = _tp_connection_get_contact_attributes_cache (self);
+
+  if (error != NULL)
     {
-      GPtrArray *added;
-      GPtrArray *removed;
+      /* The CM doesn't support versions, or doesn't know about ours: get
+       * the whole contact list instead */
+      DEBUG ("Can't get changes to the roster: %s", error->message);
 
-      added = tp_connection_dup_contact_list (self);
-      removed = g_ptr_array_new ();
-      g_signal_emit_by_name (self, "contact-list-changed", added, removed);
-      g_ptr_array_unref (added);
-      g_ptr_array_unref (removed);
+      if (cache != NULL)
+        _tp_contact_attributes_cache_set_roster_version (cache, NULL);
+
+      get_contact_list_attributes (self, features, result);
+      goto OUT;
     }
 
-  self->priv->contact_list_state = TP_CONTACT_LIST_STATE_SUCCESS;
-  g_object_notify ((GObject *) self, "contact-list-state");
+  DEBUG ("roster fetched with %u changed and %u unchanged contacts",
+      g_hash_table_size (changed), g_hash_table_size (unchanged));
+  self->priv->roster_fetched = TRUE;
 
-OUT:
-  if (result != NULL)
+  g_hash_table_iter_init (&iter, changed);
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      g_simple_async_result_complete_in_idle (result);
-      g_object_unref (result);
+      roster_add_contact (self, GPOINTER_TO_UINT (key),
+          tp_asv_get_string (value, TP_TOKEN_CONNECTION_CONTACT_ID),
+          value, features);
     }
+
+  /* Contacts which haven't changed get the attributes we cached last time;
+   * those missing from the cache are looked up afterwards */
+  uncached = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, unchanged);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      TpContact *contact = roster_add_contact (self, GPOINTER_TO_UINT (key),
+          value, NULL, features);
+
+      if (contact != NULL &&
+          !_tp_contact_set_attributes_from_cache (contact, features->len,
+              (TpContactFeature *) features->data))
+        g_ptr_array_add (uncached, contact);
+    }
+
+  if (cache != NULL)
+    _tp_contact_attributes_cache_set_roster_version (cache, new_version);
+
+  if (uncached->len > 0)
+    {
+      RosterUpgrade *upgrade = g_slice_new0 (RosterUpgrade);
+
+      DEBUG ("%u unchanged contacts were not cached", uncached->len);
+      upgrade->self = g_object_ref (self);
+      upgrade->result = result ? g_object_ref (result) : NULL;
+
+      tp_connection_upgrade_contacts_async (self, uncached->len,
+          (TpContact **) uncached->pdata, features->len,
+          (TpContactFeature *) features->data, roster_upgraded_cb, upgrade);
+    }
+  else
+    {
+      roster_fetched (self, result);
+    }
+
+  g_ptr_array_unref (uncached);
+
+OUT:
+  tp_clear_object (&result);
 }
 
 static void
@@ -301,8 +640,8 @@ prepare_roster (TpConnection *self,
     GSimpleAsyncResult *result)
 {
   TpContactFeature feature_states = TP_CONTACT_FEATURE_SUBSCRIPTION_STATES;
+  TpContactAttributesCache *cache;
   GArray *features;
-  const gchar **supported_interfaces;
 
   DEBUG ("CM has the roster for connection %s, fetch it now.",
       tp_proxy_get_object_path (self));
@@ -317,16 +656,33 @@ prepare_roster (TpConnection *self,
    * TpContact to bind to change notification. */
   g_array_append_val (features, feature_states);
 
-  supported_interfaces = _tp_contacts_bind_to_signals (self, features->len,
-      (TpContactFeature *) features->data);
+  cache = _tp_connection_get_contact_attributes_cache (self);
 
-  tp_cli_connection_interface_contact_list_call_get_contact_list_attributes (
-      self, -1, supported_interfaces, TRUE,
-      got_contact_list_attributes_cb,
-      features, (GDestroyNotify) g_array_unref,
-      result ? g_object_ref (result) : NULL);
+  /* If we have the attributes from last time, we only need to download
+   * what has changed since then. If the CM can't do that, we'll fall back
+   * to downloading everything. */
+  if (cache != NULL)
+    {
+      const gchar *version = _tp_contact_attributes_cache_get_roster_version (
+          cache);
+      const gchar **supported_interfaces = _tp_contacts_bind_to_signals (
+          self, features->len, (TpContactFeature *) features->data);
 
-  g_free (supported_interfaces);
+      DEBUG ("asking for roster changes since '%s'",
+          version != NULL ? version : "");
+
+      tp_cli_connection_interface_contact_list_call_get_contact_list_changes_since (
+          self, -1, version != NULL ? version : "", supported_interfaces,
+          got_contact_list_changes_cb,
+          features, (GDestroyNotify) g_array_unref,
+          result ? g_object_ref (result) : NULL);
+
+      g_free (supported_interfaces);
+      return;
+    }
+
+  get_contact_list_attributes (self, features, result);
+  g_array_unref (features);
 }
 
 static void
@@ -780,6 +1136,237 @@ tp_connection_dup_contact_list (TpConnection *self)
   return _tp_contacts_from_values (self->priv->roster);
 }
 
+/**
+ * tp_connection_get_contact_list_generation:
+ * @self: a #TpConnection
+ *
+ * Return a number which changes whenever contacts are added to or removed
+ * from the contact list returned by tp_connection_dup_contact_list(). A
+ * caller which keeps its own copy of the contact list can compare this with
+ * the value it saw last time, to know whether the copy is still up to date
+ * without fetching the contact list again.
+ *
+ * Changes to the contacts themselves, such as their
+ * #TpContact:subscribe-state, do not change this number.
+ *
+ * Returns: the current generation of the contact list
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_connection_get_contact_list_generation (TpConnection *self)
+{
+  g_return_val_if_fail (TP_IS_CONNECTION (self), 0);
+
+  return self->priv->roster_generation;
+}
+
+typedef struct {
+    TpConnection *connection;
+    guint generation;
+    GHashTableIter iter;
+} RealContactListIter;
+
+G_STATIC_ASSERT (sizeof (RealContactListIter) <= sizeof (TpContactListIter));
+
+/**
+ * TpContactListIter:
+ *
+ * An opaque structure representing iteration in undefined order over the
+ * contacts of a connection's contact list, without copying it. Must be
+ * initialized with tp_connection_contact_list_iter_init().
+ *
+ * Usage is similar to #GHashTableIter:
+ *
+ * <informalexample><programlisting>
+ * TpContactListIter iter;
+ * TpContact *contact;
+ *
+ * tp_connection_contact_list_iter_init (&amp;iter, connection);
+ *
+ * while (tp_contact_list_iter_next (&amp;iter, &amp;contact))
+ *   {
+ *     printf ("%s\n", tp_contact_get_identifier (contact));
+ *   }
+ * </programlisting></informalexample>
+ *
+ * The iterator becomes invalid when contacts are added to or removed from
+ * the contact list, which only happens when the main loop is re-entered.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * tp_connection_contact_list_iter_init:
+ * @iter: an iterator to be initialized
+ * @self: a #TpConnection
+ *
+ * Initialize @iter to iterate over the contacts that
+ * tp_connection_dup_contact_list() would return, without allocating
+ * anything.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_contact_list_iter_init (TpContactListIter *iter,
+    TpConnection *self)
+{
+  RealContactListIter *real = (RealContactListIter *) iter;
+
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (TP_IS_CONNECTION (self));
+  g_return_if_fail (self->priv->roster != NULL);
+
+  real->connection = self;
+  real->generation = self->priv->roster_generation;
+  g_hash_table_iter_init (&real->iter, self->priv->roster);
+}
+
+/**
+ * tp_contact_list_iter_next:
+ * @iter: an iterator initialized with tp_connection_contact_list_iter_init()
+ * @contact: (out) (allow-none) (transfer none): used to return the next
+ *  contact
+ *
+ * Advance @iter to the next contact on the contact list. The contact is
+ * borrowed: the caller must take a reference to it if it is kept after the
+ * main loop is re-entered.
+ *
+ * Returns: %FALSE if the end of the contact list has been reached
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_contact_list_iter_next (TpContactListIter *iter,
+    TpContact **contact)
+{
+  RealContactListIter *real = (RealContactListIter *) iter;
+  gpointer value;
+
+  g_return_val_if_fail (iter != NULL, FALSE);
+  g_return_val_if_fail (TP_IS_CONNECTION (real->connection), FALSE);
+  /* contacts were added or removed since the iterator was initialized */
+  g_return_val_if_fail (
+      real->generation == real->connection->priv->roster_generation, FALSE);
+
+  if (!g_hash_table_iter_next (&real->iter, NULL, &value))
+    return FALSE;
+
+  if (contact != NULL)
+    *contact = value;
+
+  return TRUE;
+}
+
+static GPtrArray *
+contacts_from_set (GHashTable *set)
+{
+  GPtrArray *contacts = g_ptr_array_new_full (
+      set == NULL ? 0 : g_hash_table_size (set), g_object_unref);
+  GHashTableIter iter;
+  gpointer key;
+
+  if (set == NULL)
+    return contacts;
+
+  g_hash_table_iter_init (&iter, set);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (contacts, g_object_ref (key));
+
+  return contacts;
+}
+
+/**
+ * tp_connection_dup_contacts_by_subscribe_state:
+ * @self: a #TpConnection
+ * @state: a subscription state
+ *
+ * Return the contacts on the contact list whose #TpContact:subscribe-state
+ * is @state. This does not look at every contact on the contact list, so it
+ * is cheaper than filtering the result of tp_connection_dup_contact_list().
+ *
+ * %TP_CONTACT_FEATURE_SUBSCRIPTION_STATES must have been added to the
+ * connection's factory with tp_simple_client_factory_add_contact_features()
+ * for this to be meaningful.
+ *
+ * Returns: (transfer container) (type GLib.PtrArray) (element-type TelepathyGLib.Contact):
+ *  a new #GPtrArray of #TpContact. Use g_ptr_array_unref() when done.
+ *
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_connection_dup_contacts_by_subscribe_state (TpConnection *self,
+    TpSubscriptionState state)
+{
+  g_return_val_if_fail (TP_IS_CONNECTION (self), NULL);
+  g_return_val_if_fail (state < TP_NUM_SUBSCRIPTION_STATES, NULL);
+
+  return contacts_from_set (self->priv->roster_by_subscribe[state]);
+}
+
+/**
+ * tp_connection_dup_contacts_by_publish_state:
+ * @self: a #TpConnection
+ * @state: a subscription state
+ *
+ * The same as tp_connection_dup_contacts_by_subscribe_state(), but for
+ * #TpContact:publish-state, for instance to list the contacts who have
+ * asked to see the user's presence.
+ *
+ * Returns: (transfer container) (type GLib.PtrArray) (element-type TelepathyGLib.Contact):
+ *  a new #GPtrArray of #TpContact. Use g_ptr_array_unref() when done.
+ *
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_connection_dup_contacts_by_publish_state (TpConnection *self,
+    TpSubscriptionState state)
+{
+  g_return_val_if_fail (TP_IS_CONNECTION (self), NULL);
+  g_return_val_if_fail (state < TP_NUM_SUBSCRIPTION_STATES, NULL);
+
+  return contacts_from_set (self->priv->roster_by_publish[state]);
+}
+
+/**
+ * tp_connection_get_contact_list_queue_stats:
+ * @self: a #TpConnection
+ * @queued: (out) (allow-none): used to return the number of batches of
+ *  changes to the contact list which have not been applied yet, including
+ *  any that is being applied
+ * @merged_signals: (out) (allow-none): used to return the number of
+ *  contact list change signals which were merged into an earlier batch
+ *  rather than being applied separately
+ * @merged_contacts: (out) (allow-none): used to return the number of
+ *  contact changes which were replaced by a later change, before either was
+ *  applied
+ *
+ * Return statistics about how much #TpConnection::contact-list-changed is
+ * lagging behind the connection manager. Changes that arrive while earlier
+ * changes are still being applied are merged, so that each contact is only
+ * updated in its latest state.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_get_contact_list_queue_stats (TpConnection *self,
+    guint *queued,
+    guint64 *merged_signals,
+    guint64 *merged_contacts)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  if (queued != NULL)
+    *queued = self->priv->contacts_changed_queue->length;
+
+  if (merged_signals != NULL)
+    *merged_signals = self->priv->contacts_changed_merged_signals;
+
+  if (merged_contacts != NULL)
+    *merged_contacts = self->priv->contacts_changed_merged_contacts;
+}
+
 static void
 generic_callback (TpConnection *self,
     const GError *error,
@@ -1143,6 +1730,39 @@ tp_connection_get_contact_groups (TpConnection *self)
   return (const gchar * const *) self->priv->contact_groups->pdata;
 }
 
+/**
+ * tp_connection_dup_contacts_in_group:
+ * @self: a #TpConnection
+ * @group: the name of a group, usually one of those returned by
+ *  tp_connection_get_contact_groups()
+ *
+ * Return the contacts on the contact list which are members of @group.
+ * This does not look at every contact on the contact list, so it is
+ * cheaper than filtering the result of tp_connection_dup_contact_list().
+ *
+ * %TP_CONTACT_FEATURE_CONTACT_GROUPS must have been added to the
+ * connection's factory with tp_simple_client_factory_add_contact_features()
+ * for this to be meaningful.
+ *
+ * Returns: (transfer container) (type GLib.PtrArray) (element-type TelepathyGLib.Contact):
+ *  a new #GPtrArray of #TpContact, empty if @group has no members. Use
+ *  g_ptr_array_unref() when done.
+ *
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_connection_dup_contacts_in_group (TpConnection *self,
+    const gchar *group)
+{
+  g_return_val_if_fail (TP_IS_CONNECTION (self), NULL);
+  g_return_val_if_fail (group != NULL, NULL);
+
+  if (self->priv->roster_by_group == NULL)
+    return contacts_from_set (NULL);
+
+  return contacts_from_set (roster_group_set (self, group, FALSE));
+}
+
 #define contact_groups_generic_async(method) \
   G_STMT_START { \
     GSimpleAsyncResult *result; \
@@ -1628,10 +2248,11 @@ void
 _tp_connection_set_contact_blocked (TpConnection *self,
     TpContact *contact)
 {
-  gboolean blocked;
+  gboolean blocked = FALSE;
 
-  blocked = tp_g_ptr_array_contains (self->priv->blocked_contacts,
-      contact);
+  if (self->priv->blocked_handles != NULL)
+    blocked = tp_intset_is_member (self->priv->blocked_handles,
+        tp_contact_get_handle (contact));
 
   _tp_contact_set_is_blocked (contact, blocked);
 }
@@ -1664,6 +2285,33 @@ blocked_changed_head_ready (TpConnection *self)
   process_queued_blocked_changed (self);
 }
 
+/* Drop the contacts whose handles are no longer in blocked_handles from
+ * blocked_contacts in one pass, keeping the others in order, rather than
+ * searching the array for each of them */
+static void
+remove_unblocked_contacts (TpConnection *self)
+{
+  GPtrArray *blocked = self->priv->blocked_contacts;
+  guint i, n = 0;
+
+  for (i = 0; i < blocked->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (blocked, i);
+
+      if (tp_intset_is_member (self->priv->blocked_handles,
+            tp_contact_get_handle (contact)))
+        {
+          /* move it down, and the unblocked contact it replaces up into
+           * the part that will be freed */
+          blocked->pdata[i] = blocked->pdata[n];
+          blocked->pdata[n++] = contact;
+        }
+    }
+
+  /* unrefs the unblocked contacts */
+  g_ptr_array_set_size (blocked, n);
+}
+
 static void
 blocked_contacts_upgraded_cb (GObject *object,
     GAsyncResult *result,
@@ -1704,6 +2352,7 @@ blocked_contacts_upgraded_cb (GObject *object,
 
           g_ptr_array_add (self->priv->blocked_contacts,
               g_object_ref (contact));
+          tp_intset_add (self->priv->blocked_handles, handle);
 
           g_ptr_array_add (added, contact);
         }
@@ -1717,7 +2366,7 @@ blocked_contacts_upgraded_cb (GObject *object,
            * last ref. */
           g_ptr_array_add (removed, g_object_ref (contact));
 
-          g_ptr_array_remove (self->priv->blocked_contacts, contact);
+          tp_intset_remove (self->priv->blocked_handles, handle);
         }
       else
         {
@@ -1725,6 +2374,9 @@ blocked_contacts_upgraded_cb (GObject *object,
         }
     }
 
+  if (removed->len > 0)
+    remove_unblocked_contacts (self);
+
   g_object_notify (G_OBJECT (self), "blocked-contacts");
 
   g_signal_emit_by_name (self, "blocked-contacts-changed", added, removed);
@@ -53,6 +53,34 @@ gboolean tp_connection_get_request_uses_message (TpConnection *self);
 _TP_AVAILABLE_IN_0_16
 GPtrArray *tp_connection_dup_contact_list (TpConnection *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_connection_get_contact_list_generation (TpConnection *self);
+
+typedef struct {
+    /*<private>*/
+    gpointer _dummy[16];
+} TpContactListIter;
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_contact_list_iter_init (TpContactListIter *iter,
+    TpConnection *self);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_contact_list_iter_next (TpContactListIter *iter,
+    TpContact **contact);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_connection_dup_contacts_by_subscribe_state (TpConnection *self,
+    TpSubscriptionState state);
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_connection_dup_contacts_by_publish_state (TpConnection *self,
+    TpSubscriptionState state);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_get_contact_list_queue_stats (TpConnection *self,
+    guint *queued,
+    guint64 *merged_signals,
+    guint64 *merged_contacts);
+
 _TP_AVAILABLE_IN_0_16
 void tp_connection_request_subscription_async (TpConnection *self,
     guint n_contacts,
@@ -120,6 +148,9 @@ _TP_AVAILABLE_IN_0_16
 TpContactMetadataStorageType tp_connection_get_group_storage (TpConnection *self);
 _TP_AVAILABLE_IN_0_16
 const gchar * const *tp_connection_get_contact_groups (TpConnection *self);
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_connection_dup_contacts_in_group (TpConnection *self,
+    const gchar *group);
 
 _TP_AVAILABLE_IN_0_16
 void tp_connection_set_group_members_async (TpConnection *self,
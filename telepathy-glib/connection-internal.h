@@ -24,10 +24,14 @@
 #define TP_CONNECTION_INTERNAL_H
 
 #include <telepathy-glib/capabilities.h>
+#include <telepathy-glib/channel.h>
 #include <telepathy-glib/connection.h>
 #include <telepathy-glib/contact.h>
 #include <telepathy-glib/intset.h>
 
+#include <telepathy-glib/connection-introspection-cache-internal.h>
+#include <telepathy-glib/contact-attributes-cache-internal.h>
+
 G_BEGIN_DECLS
 
 typedef void (*TpConnectionProc) (TpConnection *self);
@@ -51,6 +55,37 @@ struct _TpConnectionPrivate {
 
     /* GArray of GQuark */
     GArray *contact_attribute_interfaces;
+    /* GArray of GQuark: the subset of contact_attribute_interfaces whose
+     * changes are signalled by ContactAttributesChanged; non-NULL if
+     * contact_attribute_interfaces is */
+    GArray *contact_attributes_changed_interfaces;
+    /* maximum number of handles per GetContactAttributes call, or 0 for
+     * no limit; and how many such calls may be pending per request */
+    guint contact_attributes_batch_size;
+    guint contact_attributes_max_in_flight;
+
+    /* Queue of owned UpgradeRequest, waiting to be merged into one call
+     * to tp_connection_upgrade_contacts() by upgrade_idle_id */
+    GQueue upgrade_queue;
+    guint upgrade_idle_id;
+
+    /* Queue of owned ByIdRequest, waiting to be merged into one call to
+     * tp_connection_get_contacts_by_id() by by_id_idle_id */
+    GQueue by_id_queue;
+    guint by_id_idle_id;
+
+    /* owned identifier => handle, for identifiers which have recently been
+     * resolved to a handle, either as requested or normalized; only used
+     * if has_immortal_handles, and bounded by MAX_ID_HANDLES */
+    GHashTable *id_handles;
+
+    /* opened on demand if contact_attributes_cache_enabled */
+    TpContactAttributesCache *contact_attributes_cache;
+    gboolean contact_attributes_cache_enabled;
+
+    /* results of introspection shared with other processes, or NULL if
+     * the factory did not enable that */
+    TpConnectionIntrospectionCache *introspection_cache;
 
     /* items are GQuarks that represent arguments to
      * Connection.AddClientInterests */
@@ -65,8 +100,35 @@ struct _TpConnectionPrivate {
     GQueue capabilities_queue;
 
     TpAvatarRequirements *avatar_requirements;
+    /* handles whose avatars are to be requested, most urgent first; may
+     * contain duplicates */
     GArray *avatar_request_queue;
+    /* idle or, between throttled batches, timeout */
     guint avatar_request_idle_id;
+    /* if TRUE, only request avatars that are wanted, see
+     * tp_connection_set_lazy_avatar_data() */
+    gboolean lazy_avatar_data;
+
+    /* see tp_connection_set_contact_notification_batching() */
+    gboolean batch_contact_notifications;
+    /* TpContactFeature => owned set of ref'd TpContact that have changed
+     * since contacts_changed_idle_id was queued */
+    GHashTable *pending_contacts_changed;
+    guint contacts_changed_idle_id;
+
+    /* see tp_connection_set_location_update_filter(); 0 means no limit */
+    guint location_min_interval_ms;
+    guint location_min_distance_m;
+
+    /* owned presence message => owned guint, the number of TpContact
+     * sharing it; see _tp_connection_ref_presence_message() */
+    GHashTable *presence_messages;
+
+    /* _tp_capabilities_classes_hash() => owned GPtrArray of owned
+     * contact-specific TpCapabilities with those classes; see
+     * _tp_connection_dup_contact_capabilities() */
+    GHashTable *contact_capabilities;
+    guint n_contact_capabilities;
 
     TpContactInfoFlags contact_info_flags;
     GList *contact_info_supported_fields;
@@ -83,8 +145,24 @@ struct _TpConnectionPrivate {
     gboolean request_uses_message;
     /* TpHandle => ref to TpContact */
     GHashTable *roster;
-    /* Queue of owned ContactsChangedItem */
+    /* incremented whenever contacts are added to or removed from @roster */
+    guint roster_generation;
+    /* indexes of @roster, maintained by _tp_connection_roster_index_contact()
+     * and _tp_connection_roster_unindex_contact(): owned group name =>
+     * owned set of borrowed TpContact, and TpSubscriptionState => owned set
+     * of borrowed TpContact */
+    GHashTable *roster_by_group;
+    GHashTable *roster_by_subscribe[TP_NUM_SUBSCRIPTION_STATES];
+    GHashTable *roster_by_publish[TP_NUM_SUBSCRIPTION_STATES];
+    /* set of borrowed TpChannel on this connection, which remove themselves
+     * in dispose; all of them are invalidated in one pass when we are */
+    GHashTable *channels;
+    /* Queue of owned ContactsChangedItem: the head is being applied, and
+     * there is at most one more item, into which later changes are merged */
     GQueue *contacts_changed_queue;
+    /* statistics for tp_connection_get_contact_list_queue_stats() */
+    guint64 contacts_changed_merged_signals;
+    guint64 contacts_changed_merged_contacts;
     gboolean roster_fetched;
     gboolean contact_list_properties_fetched;
 
@@ -99,12 +177,28 @@ struct _TpConnectionPrivate {
     /* ContactBlocking properies */
     TpContactBlockingCapabilities contact_blocking_capabilities;
     GPtrArray *blocked_contacts;
+    /* the handles of blocked_contacts, so that checking whether one contact
+     * is blocked doesn't mean looking at all of them */
+    TpIntset *blocked_handles;
     gboolean blocked_contacts_fetched;
 
     /* Aliasing */
     TpConnectionAliasFlags alias_flags;
 
+    /* ContactInfo requests made by tp_connection_request_contact_info_async,
+     * which at most MAX_CONTACT_INFO_REQUESTS_IN_FLIGHT at a time:
+     * borrowed TpContact => owned ContactInfoFetch, for each contact whose
+     * info is being or waiting to be requested */
+    GHashTable *contact_info_fetches;
+    /* borrowed ContactInfoFetch waiting to be requested */
+    GQueue contact_info_fetch_queue;
+    guint contact_info_fetches_in_flight;
+
     TpProxyPendingCall *introspection_call;
+    /* Get(Contacts, ContactAttributeInterfaces), sent together with the
+     * first GetAll(Connection); it is also introspection_call while
+     * introspection is waiting for it */
+    TpProxyPendingCall *early_contact_attribute_interfaces_call;
 
     unsigned ready:1;
     unsigned ready_enough_for_contacts:1;
@@ -122,6 +216,7 @@ struct _TpConnectionPrivate {
     unsigned introspecting_self_contact:1;
     unsigned tracking_contacts_changed:1;
     unsigned tracking_contact_groups_changed:1;
+    unsigned tracking_contact_attributes_changed:1;
 };
 
 void _tp_connection_status_reason_to_gerror (TpConnectionStatusReason reason,
@@ -146,8 +241,38 @@ void _tp_connection_remove_contact (TpConnection *self, TpHandle handle,
     TpContact *contact);
 TpContact *_tp_connection_lookup_contact (TpConnection *self, TpHandle handle);
 
+void _tp_connection_remember_id_handle (TpConnection *self,
+    const gchar *id,
+    TpHandle handle);
+TpHandle _tp_connection_lookup_id_handle (TpConnection *self,
+    const gchar *id);
+
 void _tp_connection_set_account (TpConnection *self, TpAccount *account);
 
+/* Used by channel.c instead of connecting to TpProxy::invalidated */
+void _tp_connection_add_channel (TpConnection *self, TpChannel *channel);
+void _tp_connection_remove_channel (TpConnection *self, TpChannel *channel);
+
+TpContactAttributesCache *_tp_connection_get_contact_attributes_cache (
+    TpConnection *self);
+
+void _tp_connection_emit_contact_attributes_received (TpConnection *self,
+    GPtrArray *contacts,
+    guint n_done,
+    guint n_total);
+
+void _tp_connection_queue_contact_changed (TpConnection *self,
+    TpContact *contact,
+    TpContactFeature feature);
+
+const gchar *_tp_connection_ref_presence_message (TpConnection *self,
+    const gchar *message);
+void _tp_connection_unref_presence_message (TpConnection *self,
+    const gchar *message);
+
+TpCapabilities *_tp_connection_dup_contact_capabilities (TpConnection *self,
+    const GPtrArray *classes) G_GNUC_WARN_UNUSED_RESULT;
+
 /* connection-contact-info.c */
 void _tp_connection_prepare_contact_info_async (TpProxy *proxy,
     const TpProxyFeature *feature,
@@ -177,6 +302,11 @@ void _tp_connection_prepare_contact_groups_async (TpProxy *proxy,
     GAsyncReadyCallback callback,
     gpointer user_data);
 void _tp_connection_contacts_changed_queue_free (GQueue *queue);
+void _tp_connection_roster_index_contact (TpConnection *self,
+    TpContact *contact);
+void _tp_connection_roster_unindex_contact (TpConnection *self,
+    TpContact *contact);
+void _tp_connection_roster_index_clear (TpConnection *self);
 void _tp_connection_blocked_changed_queue_free (GQueue *queue);
 
 void _tp_connection_prepare_contact_blocking_async (TpProxy *proxy,
@@ -0,0 +1,68 @@
+/*<private_header>*/
+/* Introspection results for connections, shared between client processes
+ * (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_CONNECTION_INTROSPECTION_CACHE_INTERNAL_H__
+#define __TP_CONNECTION_INTROSPECTION_CACHE_INTERNAL_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/capabilities.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpConnectionIntrospectionCache TpConnectionIntrospectionCache;
+
+TpConnectionIntrospectionCache *_tp_connection_introspection_cache_new (
+    const gchar *object_path,
+    const gchar *unique_name);
+
+void _tp_connection_introspection_cache_free (
+    TpConnectionIntrospectionCache *self);
+
+gboolean _tp_connection_introspection_cache_has_attribute_interfaces (
+    TpConnectionIntrospectionCache *self);
+
+gboolean _tp_connection_introspection_cache_check_interfaces (
+    TpConnectionIntrospectionCache *self,
+    const gchar * const *interfaces);
+
+GArray *_tp_connection_introspection_cache_dup_contact_attribute_interfaces (
+    TpConnectionIntrospectionCache *self,
+    GArray **changed_interfaces);
+
+void _tp_connection_introspection_cache_set_contact_attribute_interfaces (
+    TpConnectionIntrospectionCache *self,
+    GArray *interfaces,
+    GArray *changed_interfaces);
+
+TpCapabilities *_tp_connection_introspection_cache_dup_capabilities (
+    TpConnectionIntrospectionCache *self);
+
+void _tp_connection_introspection_cache_set_requestable_channel_classes (
+    TpConnectionIntrospectionCache *self,
+    const GPtrArray *classes);
+
+void _tp_connection_introspection_cache_discard (
+    TpConnectionIntrospectionCache *self);
+
+G_END_DECLS
+
+#endif
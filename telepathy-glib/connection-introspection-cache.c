@@ -0,0 +1,466 @@
+/* Introspection results for connections, shared between client processes
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/connection-introspection-cache-internal.h"
+
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/gtypes.h>
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CONNECTION
+#include "telepathy-glib/capabilities-internal.h"
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+/* The file contains a single GVariant of this type: a format version, the
+ * unique name of the connection manager whose connection it describes, the
+ * Connection's Interfaces once it was CONNECTED, and if known, its
+ * ContactAttributeInterfaces, ContactAttributesChangedInterfaces and
+ * RequestableChannelClasses.
+ *
+ * It lives in the user's runtime directory, which is on a tmpfs on most
+ * systems and only lasts as long as the user's session, so every client that
+ * maps it shares the same pages. None of these properties can change while
+ * the connection is CONNECTED, so the only thing a client has to check is
+ * that the Interfaces it gets from GetAll(Connection), which it needs
+ * anyway, are the same as they were for the client that wrote the file. */
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_TYPE "(usasm(asas)ma(a{sv}as))"
+
+struct _TpConnectionIntrospectionCache {
+    gchar *filename;
+    gchar *unique_name;
+    /* NULL if not known */
+    gchar **interfaces;
+    /* both NULL if not known */
+    gchar **contact_attribute_interfaces;
+    gchar **contact_attributes_changed_interfaces;
+    /* a(a{sv}as), or NULL if not known */
+    GVariant *classes;
+    /* TRUE if @interfaces matched the connection's actual interfaces, so
+     * the rest can be trusted */
+    gboolean valid;
+    /* TRUE if the file needs writing */
+    gboolean changed;
+    guint save_id;
+};
+
+static gboolean
+strv_equal (const gchar * const *a,
+    const gchar * const *b)
+{
+  guint i;
+
+  for (i = 0; a[i] != NULL && b[i] != NULL; i++)
+    {
+      if (tp_strdiff (a[i], b[i]))
+        return FALSE;
+    }
+
+  return (a[i] == NULL && b[i] == NULL);
+}
+
+static void
+cache_forget (TpConnectionIntrospectionCache *self)
+{
+  tp_clear_pointer (&self->interfaces, g_strfreev);
+  tp_clear_pointer (&self->contact_attribute_interfaces, g_strfreev);
+  tp_clear_pointer (&self->contact_attributes_changed_interfaces,
+      g_strfreev);
+  tp_clear_pointer (&self->classes, g_variant_unref);
+  self->valid = FALSE;
+}
+
+static void
+cache_load (TpConnectionIntrospectionCache *self)
+{
+  GMappedFile *mapped;
+  GBytes *bytes;
+  GVariant *top;
+  GVariant *unique_name;
+  GVariant *maybe;
+  guint32 version;
+  GError *error = NULL;
+
+  mapped = g_mapped_file_new (self->filename, FALSE, &error);
+
+  if (mapped == NULL)
+    {
+      DEBUG ("no introspection cached in %s: %s", self->filename,
+          error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  top = g_variant_ref_sink (g_variant_new_from_bytes (
+        G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+  /* the bytes keep the file mapped for as long as we need it */
+  g_bytes_unref (bytes);
+  g_mapped_file_unref (mapped);
+
+  g_variant_get_child (top, 0, "u", &version);
+  unique_name = g_variant_get_child_value (top, 1);
+
+  if (version != CACHE_FORMAT_VERSION)
+    {
+      DEBUG ("ignoring %s with unknown version %u", self->filename,
+          version);
+    }
+  else if (tp_strdiff (g_variant_get_string (unique_name, NULL),
+        self->unique_name))
+    {
+      /* a previous connection with the same object path, or garbage */
+      DEBUG ("ignoring %s written for %s, not %s", self->filename,
+          g_variant_get_string (unique_name, NULL), self->unique_name);
+    }
+  else
+    {
+      GVariant *child;
+
+      g_variant_get_child (top, 2, "^as", &self->interfaces);
+
+      maybe = g_variant_get_child_value (top, 3);
+      child = g_variant_get_maybe (maybe);
+
+      if (child != NULL)
+        {
+          g_variant_get (child, "(^as^as)",
+              &self->contact_attribute_interfaces,
+              &self->contact_attributes_changed_interfaces);
+          g_variant_unref (child);
+        }
+
+      g_variant_unref (maybe);
+
+      maybe = g_variant_get_child_value (top, 4);
+      self->classes = g_variant_get_maybe (maybe);
+      g_variant_unref (maybe);
+
+      DEBUG ("loaded %s", self->filename);
+    }
+
+  g_variant_unref (unique_name);
+  g_variant_unref (top);
+}
+
+/*
+ * _tp_connection_introspection_cache_new:
+ * @object_path: a connection's object path
+ * @unique_name: the unique name of the connection manager
+ *
+ * Load whatever another client found out about the connection at
+ * @object_path, if it was owned by @unique_name. Nothing that was loaded
+ * is available until _tp_connection_introspection_cache_check_interfaces()
+ * has succeeded.
+ *
+ * Returns: a new cache
+ */
+TpConnectionIntrospectionCache *
+_tp_connection_introspection_cache_new (const gchar *object_path,
+    const gchar *unique_name)
+{
+  TpConnectionIntrospectionCache *self = g_slice_new0 (
+      TpConnectionIntrospectionCache);
+  gchar *escaped = tp_escape_as_identifier (object_path);
+
+  self->filename = g_build_filename (g_get_user_runtime_dir (),
+      "telepathy", "connections", escaped, NULL);
+  self->unique_name = g_strdup (unique_name);
+  g_free (escaped);
+
+  cache_load (self);
+  return self;
+}
+
+static void
+cache_save (TpConnectionIntrospectionCache *self)
+{
+  GVariant *top;
+  GVariant *contact_attribute_interfaces = NULL;
+  gchar *dir;
+  GError *error = NULL;
+
+  self->changed = FALSE;
+
+  /* there's nothing to check the rest against until we know this */
+  if (self->interfaces == NULL)
+    return;
+
+  if (self->contact_attribute_interfaces != NULL)
+    contact_attribute_interfaces = g_variant_new ("(^as^as)",
+        self->contact_attribute_interfaces,
+        self->contact_attributes_changed_interfaces);
+
+  top = g_variant_ref_sink (g_variant_new ("(us^asm@(asas)m@a(a{sv}as))",
+        CACHE_FORMAT_VERSION, self->unique_name, self->interfaces,
+        contact_attribute_interfaces, self->classes));
+
+  dir = g_path_get_dirname (self->filename);
+
+  if (g_mkdir_with_parents (dir, 0700) == -1)
+    {
+      DEBUG ("Error creating connection introspection cache dir: %s",
+          g_strerror (errno));
+    }
+  else if (!g_file_set_contents (self->filename, g_variant_get_data (top),
+        g_variant_get_size (top), &error))
+    {
+      DEBUG ("Error writing %s: %s", self->filename, error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      DEBUG ("saved %s", self->filename);
+    }
+
+  g_free (dir);
+  g_variant_unref (top);
+}
+
+static gboolean
+cache_save_cb (gpointer data)
+{
+  TpConnectionIntrospectionCache *self = data;
+
+  self->save_id = 0;
+  cache_save (self);
+  return FALSE;
+}
+
+static void
+cache_schedule_save (TpConnectionIntrospectionCache *self)
+{
+  self->changed = TRUE;
+
+  /* the interesting results tend to arrive together, during
+   * introspection, so only write them once */
+  if (self->save_id == 0)
+    self->save_id = _tp_idle_add (TP_LATENCY_CLASS_NORMAL, cache_save_cb,
+        self);
+}
+
+void
+_tp_connection_introspection_cache_free (
+    TpConnectionIntrospectionCache *self)
+{
+  if (self->save_id != 0)
+    {
+      _tp_source_remove (self->save_id);
+      self->save_id = 0;
+    }
+
+  if (self->changed)
+    cache_save (self);
+
+  cache_forget (self);
+  g_free (self->filename);
+  g_free (self->unique_name);
+  g_slice_free (TpConnectionIntrospectionCache, self);
+}
+
+/*
+ * _tp_connection_introspection_cache_has_attribute_interfaces:
+ * @self: a cache
+ *
+ * Returns: %TRUE if the file had ContactAttributeInterfaces, which will be
+ *  available if the interfaces turn out to match
+ */
+gboolean
+_tp_connection_introspection_cache_has_attribute_interfaces (
+    TpConnectionIntrospectionCache *self)
+{
+  return (self->contact_attribute_interfaces != NULL);
+}
+
+/*
+ * _tp_connection_introspection_cache_check_interfaces:
+ * @self: a cache
+ * @interfaces: the Interfaces of the connection, now that it is CONNECTED
+ *
+ * Check that what was loaded describes a connection with @interfaces. If
+ * not, forget it, and start again from @interfaces.
+ *
+ * Returns: %TRUE if the rest of the cache can be used
+ */
+gboolean
+_tp_connection_introspection_cache_check_interfaces (
+    TpConnectionIntrospectionCache *self,
+    const gchar * const *interfaces)
+{
+  if (self->valid)
+    return TRUE;
+
+  if (self->interfaces != NULL && strv_equal (self->interfaces, interfaces))
+    {
+      DEBUG ("%s is still valid", self->filename);
+      self->valid = TRUE;
+      return TRUE;
+    }
+
+  if (self->interfaces != NULL)
+    DEBUG ("%s is out of date, replacing it", self->filename);
+
+  cache_forget (self);
+  self->interfaces = g_strdupv ((gchar **) interfaces);
+  self->valid = TRUE;
+  cache_schedule_save (self);
+  return FALSE;
+}
+
+static GArray *
+strv_to_quarks (const gchar * const *strv)
+{
+  GArray *arr = g_array_sized_new (FALSE, FALSE, sizeof (GQuark),
+      g_strv_length ((gchar **) strv));
+  guint i;
+
+  for (i = 0; strv[i] != NULL; i++)
+    {
+      /* the file is only as trustworthy as the clients writing it */
+      if (tp_dbus_check_valid_interface_name (strv[i], NULL))
+        {
+          GQuark q = g_quark_from_string (strv[i]);
+
+          g_array_append_val (arr, q);
+        }
+    }
+
+  return arr;
+}
+
+static gchar **
+quarks_to_strv (GArray *quarks)
+{
+  gchar **strv = g_new0 (gchar *, quarks->len + 1);
+  guint i;
+
+  for (i = 0; i < quarks->len; i++)
+    strv[i] = g_strdup (g_quark_to_string (
+          g_array_index (quarks, GQuark, i)));
+
+  return strv;
+}
+
+/*
+ * _tp_connection_introspection_cache_dup_contact_attribute_interfaces:
+ * @self: a cache
+ * @changed_interfaces: (out) (transfer full): used to return the
+ *  ContactAttributesChangedInterfaces, as an array of #GQuark, if the
+ *  return is non-%NULL
+ *
+ * Returns: (transfer full): the ContactAttributeInterfaces, as an array of
+ *  #GQuark, or %NULL if not known
+ */
+GArray *
+_tp_connection_introspection_cache_dup_contact_attribute_interfaces (
+    TpConnectionIntrospectionCache *self,
+    GArray **changed_interfaces)
+{
+  if (!self->valid || self->contact_attribute_interfaces == NULL)
+    return NULL;
+
+  *changed_interfaces = strv_to_quarks (
+      (const gchar * const *) self->contact_attributes_changed_interfaces);
+  return strv_to_quarks (
+      (const gchar * const *) self->contact_attribute_interfaces);
+}
+
+void
+_tp_connection_introspection_cache_set_contact_attribute_interfaces (
+    TpConnectionIntrospectionCache *self,
+    GArray *interfaces,
+    GArray *changed_interfaces)
+{
+  if (self->contact_attribute_interfaces != NULL)
+    return;
+
+  self->contact_attribute_interfaces = quarks_to_strv (interfaces);
+  self->contact_attributes_changed_interfaces = quarks_to_strv (
+      changed_interfaces);
+  cache_schedule_save (self);
+}
+
+/*
+ * _tp_connection_introspection_cache_dup_capabilities:
+ * @self: a cache
+ *
+ * Returns: (transfer full): the connection's capabilities, or %NULL if not
+ *  known
+ */
+TpCapabilities *
+_tp_connection_introspection_cache_dup_capabilities (
+    TpConnectionIntrospectionCache *self)
+{
+  TpCapabilities *capabilities;
+  GValue value = G_VALUE_INIT;
+
+  if (!self->valid || self->classes == NULL)
+    return NULL;
+
+  dbus_g_value_parse_g_variant (self->classes, &value);
+  capabilities = _tp_capabilities_new (g_value_get_boxed (&value), FALSE);
+  g_value_unset (&value);
+  return capabilities;
+}
+
+void
+_tp_connection_introspection_cache_set_requestable_channel_classes (
+    TpConnectionIntrospectionCache *self,
+    const GPtrArray *classes)
+{
+  if (self->classes != NULL)
+    return;
+
+  self->classes = g_variant_ref_sink (_tp_boxed_to_variant (
+        TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, "a(a{sv}as)",
+        (gpointer) classes));
+  cache_schedule_save (self);
+}
+
+/*
+ * _tp_connection_introspection_cache_discard:
+ * @self: a cache
+ *
+ * Forget everything, and remove the file, because the connection has gone
+ * away.
+ */
+void
+_tp_connection_introspection_cache_discard (
+    TpConnectionIntrospectionCache *self)
+{
+  if (self->save_id != 0)
+    {
+      _tp_source_remove (self->save_id);
+      self->save_id = 0;
+    }
+
+  self->changed = FALSE;
+  cache_forget (self);
+
+  if (g_unlink (self->filename) != 0 && errno != ENOENT)
+    DEBUG ("Error removing %s: %s", self->filename, g_strerror (errno));
+}
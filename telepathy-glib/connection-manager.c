@@ -36,8 +36,10 @@
 
 #define DEBUG_FLAG TP_DEBUG_MANAGER
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/manager-file-cache-internal.h"
 #include "telepathy-glib/protocol-internal.h"
 #include "telepathy-glib/util-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
 
 #include "telepathy-glib/_gen/tp-cli-connection-manager-body.h"
 
@@ -1006,7 +1008,8 @@ tp_connection_manager_name_owner_changed_cb (TpDBusDaemon *bus,
       g_signal_emit (self, signals[SIGNAL_ACTIVATED], 0);
 
       if (self->priv->introspect_idle_id == 0)
-        self->priv->introspect_idle_id = g_idle_add (
+        self->priv->introspect_idle_id = _tp_idle_add (
+            TP_LATENCY_CLASS_NORMAL,
             tp_connection_manager_idle_introspect, self);
     }
 
@@ -1020,7 +1023,8 @@ tp_connection_manager_name_owner_changed_cb (TpDBusDaemon *bus,
 
       /* now we know whether we're running or not, we can try reading the
        * .manager file... */
-      self->priv->manager_file_read_idle_id = g_idle_add (
+      self->priv->manager_file_read_idle_id = _tp_idle_add (
+          TP_LATENCY_CLASS_NORMAL,
           tp_connection_manager_idle_read_manager_file, self);
 
       if (self->priv->want_activation && self->priv->introspect_idle_id == 0)
@@ -1029,7 +1033,8 @@ tp_connection_manager_name_owner_changed_cb (TpDBusDaemon *bus,
               "activation",
               self->name);
           /* ... but if activation was requested, we should also do that */
-          self->priv->introspect_idle_id = g_idle_add (
+          self->priv->introspect_idle_id = _tp_idle_add (
+              TP_LATENCY_CLASS_NORMAL,
               tp_connection_manager_idle_introspect, self);
         }
 
@@ -1040,6 +1045,22 @@ tp_connection_manager_name_owner_changed_cb (TpDBusDaemon *bus,
   g_object_unref (self);
 }
 
+static void
+tp_connection_manager_add_protocol (TpDBusDaemon *dbus_daemon,
+    const gchar *cm_name,
+    GHashTable *protocols,
+    const gchar *name,
+    GHashTable *immutables)
+{
+  TpProtocol *proto_object;
+
+  proto_object = tp_protocol_new (dbus_daemon, cm_name, name,
+      immutables, NULL);
+  g_assert (proto_object != NULL);
+
+  g_hash_table_insert (protocols, g_strdup (name), proto_object);
+}
+
 static gboolean
 tp_connection_manager_read_file (TpDBusDaemon *dbus_daemon,
     const gchar *cm_name,
@@ -1051,21 +1072,51 @@ tp_connection_manager_read_file (TpDBusDaemon *dbus_daemon,
   GKeyFile *file;
   gchar **groups = NULL;
   gchar **group;
-  TpProtocol *proto_object;
   GHashTable *protocols = NULL;
+  /* owned protocol name => owned immutable properties */
+  GHashTable *parsed = NULL;
   GStrv interfaces = NULL;
+  GVariant *cached;
+
+  protocols = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_object_unref);
+
+  if (_tp_manager_file_cache_lookup (filename, &interfaces, &cached))
+    {
+      GVariantIter iter;
+      const gchar *name;
+      GVariant *vardict;
+
+      g_variant_iter_init (&iter, cached);
+
+      while (g_variant_iter_loop (&iter, "{&s@a{sv}}", &name, &vardict))
+        {
+          GHashTable *immutables = _tp_asv_from_vardict (vardict);
+
+          tp_connection_manager_add_protocol (dbus_daemon, cm_name,
+              protocols, name, immutables);
+          g_hash_table_unref (immutables);
+        }
+
+      g_variant_unref (cached);
+      goto finally;
+    }
 
   file = g_key_file_new ();
 
   if (!g_key_file_load_from_file (file, filename, G_KEY_FILE_NONE, error))
-    return FALSE;
+    {
+      g_key_file_free (file);
+      g_hash_table_unref (protocols);
+      return FALSE;
+    }
 
   /* if missing, it's not an error, so ignore @error */
   interfaces = g_key_file_get_string_list (file, "ConnectionManager",
       "Interfaces", NULL, NULL);
 
-  protocols = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
-      g_object_unref);
+  parsed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_hash_table_unref);
 
   groups = g_key_file_get_groups (file, NULL);
 
@@ -1083,20 +1134,22 @@ tp_connection_manager_read_file (TpDBusDaemon *dbus_daemon,
       if (immutables == NULL)
         continue;
 
-      proto_object = tp_protocol_new (dbus_daemon, cm_name, name,
-          immutables, NULL);
-      g_assert (proto_object != NULL);
+      tp_connection_manager_add_protocol (dbus_daemon, cm_name, protocols,
+          name, immutables);
 
-      /* steals @name */
-      g_hash_table_insert (protocols, name, proto_object);
-
-      g_hash_table_unref (immutables);
+      /* steals @name and @immutables */
+      g_hash_table_insert (parsed, name, immutables);
     }
 
 success:
   g_strfreev (groups);
   g_key_file_free (file);
 
+  _tp_manager_file_cache_store (filename,
+      (const gchar * const *) interfaces, parsed);
+  g_hash_table_unref (parsed);
+
+finally:
   if (protocols_out != NULL)
     *protocols_out = protocols;
   else
@@ -1311,10 +1364,10 @@ tp_connection_manager_finalize (GObject *object)
   g_free (self->priv->manager_file);
 
   if (self->priv->manager_file_read_idle_id != 0)
-    g_source_remove (self->priv->manager_file_read_idle_id);
+    _tp_source_remove (self->priv->manager_file_read_idle_id);
 
   if (self->priv->introspect_idle_id != 0)
-    g_source_remove (self->priv->introspect_idle_id);
+    _tp_source_remove (self->priv->introspect_idle_id);
 
   if (self->priv->pending_protocols != NULL)
     {
@@ -1396,7 +1449,8 @@ tp_connection_manager_set_property (GObject *object,
             }
 
           if (self->priv->manager_file_read_idle_id == 0)
-            self->priv->manager_file_read_idle_id = g_idle_add (
+            self->priv->manager_file_read_idle_id = _tp_idle_add (
+                TP_LATENCY_CLASS_NORMAL,
                 tp_connection_manager_idle_read_manager_file, self);
         }
       else
@@ -1418,7 +1472,8 @@ tp_connection_manager_set_property (GObject *object,
                * but we are now. Try it when idle
                */
               if (self->priv->introspect_idle_id == 0)
-                self->priv->introspect_idle_id = g_idle_add (
+                self->priv->introspect_idle_id = _tp_idle_add (
+                    TP_LATENCY_CLASS_NORMAL,
                     tp_connection_manager_idle_introspect, self);
             }
         }
@@ -1707,7 +1762,8 @@ tp_connection_manager_activate (TpConnectionManager *self)
       if (self->priv->introspect_idle_id == 0)
         {
           DEBUG ("%s: adding idle introspection", self->name);
-          self->priv->introspect_idle_id = g_idle_add (
+          self->priv->introspect_idle_id = _tp_idle_add (
+              TP_LATENCY_CLASS_NORMAL,
               tp_connection_manager_idle_introspect, self);
         }
       else
@@ -1752,6 +1808,16 @@ typedef struct
   size_t base_len;
   gsize refcount;
   gsize cms_to_ready;
+  /* for tp_list_connection_managers_full_async(): called for each CM as
+   * soon as it's prepared, or when the deadline is reached */
+  TpConnectionManagerFoundCb found_callback;
+  gpointer found_user_data;
+  /* borrowed TpConnectionManager => itself, for those already passed to
+   * found_callback */
+  GHashTable *found;
+  /* -1 to wait for every CM for as long as it takes */
+  gint timeout_ms;
+  guint timeout_id;
   unsigned getting_names:1;
   unsigned had_weak_object:1;
 } _ListContext;
@@ -1785,9 +1851,22 @@ list_context_unref (_ListContext *list_context)
     }
 
   g_hash_table_unref (list_context->table);
+  g_hash_table_unref (list_context->found);
   g_slice_free (_ListContext, list_context);
 }
 
+static void
+list_context_found (_ListContext *list_context,
+    TpConnectionManager *cm)
+{
+  if (list_context->found_callback == NULL ||
+      g_hash_table_lookup (list_context->found, cm) != NULL)
+    return;
+
+  g_hash_table_insert (list_context->found, cm, cm);
+  list_context->found_callback (cm, list_context->found_user_data);
+}
+
 static void
 all_cms_prepared (_ListContext *list_context)
 {
@@ -1798,6 +1877,14 @@ all_cms_prepared (_ListContext *list_context)
 
   g_assert (list_context->callback != NULL);
 
+  if (list_context->timeout_id != 0)
+    {
+      /* the context is still referenced by our caller, so this can't be
+       * the last unref */
+      g_source_remove (list_context->timeout_id);
+      list_context->timeout_id = 0;
+    }
+
   g_ptr_array_add (list_context->arr, NULL);
   cms = (TpConnectionManager **) list_context->arr->pdata;
 
@@ -1811,6 +1898,27 @@ all_cms_prepared (_ListContext *list_context)
     }
 
   list_context->callback = NULL;
+  list_context->found_callback = NULL;
+}
+
+static gboolean
+list_context_deadline_cb (gpointer user_data)
+{
+  _ListContext *list_context = user_data;
+  guint i;
+
+  list_context->timeout_id = 0;
+
+  DEBUG ("Gave up waiting for %" G_GSIZE_FORMAT " CM(s) after %d ms; they "
+      "will carry on being prepared in the background",
+      list_context->cms_to_ready, list_context->timeout_ms);
+
+  for (i = 0; i < list_context->arr->len; i++)
+    list_context_found (list_context,
+        g_ptr_array_index (list_context->arr, i));
+
+  all_cms_prepared (list_context);
+  return FALSE;
 }
 
 static void
@@ -1837,12 +1945,19 @@ tp_list_connection_managers_cm_prepared (GObject *source,
 
   list_context->cms_to_ready--;
 
-  if (list_context->cms_to_ready == 0)
+  if (list_context->callback == NULL)
+    {
+      DEBUG ("%s: prepared after the deadline", cm->name);
+    }
+  else if (list_context->cms_to_ready == 0)
     {
+      list_context_found (list_context, cm);
       all_cms_prepared (list_context);
     }
   else
     {
+      list_context_found (list_context, cm);
+
       DEBUG ("We still need to prepare %" G_GSIZE_FORMAT " CM(s)",
           list_context->cms_to_ready);
     }
@@ -1924,6 +2039,14 @@ tp_list_connection_managers_got_names (TpDBusDaemon *bus_daemon,
           return;
         }
 
+      if (list_context->timeout_ms >= 0)
+        {
+          list_context->refcount++;
+          list_context->timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+              list_context->timeout_ms, list_context_deadline_cb,
+              list_context, (GDestroyNotify) list_context_unref);
+        }
+
       for (i = 0; i < list_context->cms_to_ready; i++)
         {
           TpConnectionManager *cm = g_ptr_array_index (list_context->arr, i);
@@ -1944,6 +2067,15 @@ tp_list_connection_managers_got_names (TpDBusDaemon *bus_daemon,
     }
 }
 
+static void list_connection_managers_start (TpDBusDaemon *bus_daemon,
+    gint timeout_ms,
+    TpConnectionManagerFoundCb found_callback,
+    gpointer found_user_data,
+    TpConnectionManagerListCb callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object);
+
 /**
  * tp_list_connection_managers:
  * @bus_daemon: proxy for the D-Bus daemon
@@ -1974,6 +2106,20 @@ tp_list_connection_managers (TpDBusDaemon *bus_daemon,
                              gpointer user_data,
                              GDestroyNotify destroy,
                              GObject *weak_object)
+{
+  list_connection_managers_start (bus_daemon, -1, NULL, NULL, callback,
+      user_data, destroy, weak_object);
+}
+
+static void
+list_connection_managers_start (TpDBusDaemon *bus_daemon,
+    gint timeout_ms,
+    TpConnectionManagerFoundCb found_callback,
+    gpointer found_user_data,
+    TpConnectionManagerListCb callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object)
 {
   _ListContext *list_context = g_slice_new0 (_ListContext);
 
@@ -1988,6 +2134,10 @@ tp_list_connection_managers (TpDBusDaemon *bus_daemon,
       g_object_unref);
   list_context->arr = NULL;
   list_context->cms_to_ready = 0;
+  list_context->found_callback = found_callback;
+  list_context->found_user_data = found_user_data;
+  list_context->found = g_hash_table_new (NULL, NULL);
+  list_context->timeout_ms = timeout_ms;
 
   if (weak_object != NULL)
     {
@@ -2051,6 +2201,64 @@ void
 tp_list_connection_managers_async (TpDBusDaemon *dbus_daemon,
     GAsyncReadyCallback callback,
     gpointer user_data)
+{
+  tp_list_connection_managers_full_async (dbus_daemon, -1, NULL, NULL,
+      callback, user_data);
+}
+
+/**
+ * TpConnectionManagerFoundCb:
+ * @cm: a connection manager
+ * @user_data: the @found_user_data passed to
+ *  tp_list_connection_managers_full_async()
+ *
+ * Signature of a callback called by tp_list_connection_managers_full_async()
+ * for each connection manager, as soon as it is available.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * tp_list_connection_managers_full_async:
+ * @dbus_daemon: (allow-none): a #TpDBusDaemon, or %NULL to use
+ *  tp_dbus_daemon_dup()
+ * @timeout_ms: how long to wait for connection managers to be prepared,
+ *  in milliseconds, or -1 to wait for as long as it takes
+ * @found_callback: (allow-none): called for each connection manager as
+ *  soon as its %TP_CONNECTION_MANAGER_FEATURE_CORE feature has been
+ *  prepared or @timeout_ms has elapsed, whichever comes first; or %NULL
+ * @found_user_data: data to pass to @found_callback
+ * @callback: a callback to call with a list of CMs
+ * @user_data: data to pass to @callback
+ *
+ * Like tp_list_connection_managers_async(), but without letting one slow
+ * connection manager hold up the whole list.
+ *
+ * Connection managers which are not running are prepared from their
+ * .manager files, which is fast; running connection managers which have no
+ * .manager file have to be introspected over D-Bus. If @timeout_ms elapses
+ * first, @callback is called anyway: any connection managers which are not
+ * yet prepared are included in the list, and will carry on preparing in the
+ * background. Use tp_proxy_prepare_async() on them, or connect to
+ * #TpConnectionManager::got-info, to be notified when they are ready.
+ * The same signal is emitted when a connection manager whose information
+ * came from a .manager file is later introspected live.
+ *
+ * @found_callback is called once per connection manager, always before
+ * @callback, so that the user interface can show connection managers as they
+ * appear instead of waiting for the complete list.
+ *
+ * Finish this operation with tp_list_connection_managers_finish().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_list_connection_managers_full_async (TpDBusDaemon *dbus_daemon,
+    gint timeout_ms,
+    TpConnectionManagerFoundCb found_callback,
+    gpointer found_user_data,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
   GSimpleAsyncResult *result;
   GError *error = NULL;
@@ -2060,6 +2268,8 @@ tp_list_connection_managers_async (TpDBusDaemon *dbus_daemon,
   else
     g_object_ref (dbus_daemon);
 
+  /* this uses the same source tag as tp_list_connection_managers_async(),
+   * so that tp_list_connection_managers_finish() also works for this */
   result = g_simple_async_result_new (NULL, callback, user_data,
       tp_list_connection_managers_async);
 
@@ -2071,10 +2281,9 @@ tp_list_connection_managers_async (TpDBusDaemon *dbus_daemon,
     }
   else
     {
-      G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-      tp_list_connection_managers (dbus_daemon,
-          list_connection_managers_async_cb, result, g_object_unref, NULL);
-      G_GNUC_END_IGNORE_DEPRECATIONS
+      list_connection_managers_start (dbus_daemon, timeout_ms,
+          found_callback, found_user_data, list_connection_managers_async_cb,
+          result, g_object_unref, NULL);
       g_object_unref (dbus_daemon);
     }
 }
@@ -2084,7 +2293,9 @@ tp_list_connection_managers_async (TpDBusDaemon *dbus_daemon,
  * @result: the result of tp_list_connection_managers_async()
  * @error: used to raise an error if the operation failed
  *
- * Finish listing the available connection managers.
+ * Finish listing the available connection managers, after
+ * tp_list_connection_managers_async() or
+ * tp_list_connection_managers_full_async().
  *
  * Free the list after use, for instance with
  * <literal>g_list_free_full (list, g_object_unref)</literal>.
@@ -132,6 +132,17 @@ _TP_AVAILABLE_IN_0_18
 GList *tp_list_connection_managers_finish (GAsyncResult *result,
     GError **error);
 
+typedef void (*TpConnectionManagerFoundCb) (TpConnectionManager *cm,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_list_connection_managers_full_async (TpDBusDaemon *dbus_daemon,
+    gint timeout_ms,
+    TpConnectionManagerFoundCb found_callback,
+    gpointer found_user_data,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
 #ifndef TP_DISABLE_DEPRECATED
 typedef void (*TpConnectionManagerWhenReadyCb) (TpConnectionManager *cm,
     const GError *error, gpointer user_data, GObject *weak_object);
@@ -40,6 +40,7 @@
 
 #define DEBUG_FLAG TP_DEBUG_CONNECTION
 #include "telepathy-glib/capabilities-internal.h"
+#include "telepathy-glib/channel-internal.h"
 #include "telepathy-glib/connection-internal.h"
 #include "telepathy-glib/connection-contact-list.h"
 #include "telepathy-glib/dbus-internal.h"
@@ -305,6 +306,8 @@ enum {
   SIGNAL_GROUP_RENAMED,
   SIGNAL_CONTACT_LIST_CHANGED,
   SIGNAL_BLOCKED_CONTACTS_CHANGED,
+  SIGNAL_CONTACT_ATTRIBUTES_RECEIVED,
+  SIGNAL_CONTACTS_CHANGED,
   N_SIGNALS
 };
 
@@ -556,6 +559,11 @@ tp_connection_get_rcc_cb (TpProxy *proxy,
   self->priv->capabilities = _tp_capabilities_new (g_value_get_boxed (value),
       FALSE);
 
+  if (self->priv->introspection_cache != NULL &&
+      self->priv->introspecting_after_connected)
+    _tp_connection_introspection_cache_set_requestable_channel_classes (
+        self->priv->introspection_cache, g_value_get_boxed (value));
+
 finally:
   while ((result = g_queue_pop_head (&self->priv->capabilities_queue)) != NULL)
     {
@@ -570,6 +578,22 @@ static void
 _tp_connection_do_get_capabilities_async (TpConnection *self,
     GSimpleAsyncResult *result)
 {
+  if (self->priv->capabilities == NULL &&
+      self->priv->introspection_cache != NULL)
+    {
+      /* NULL unless another process already asked this connection */
+      self->priv->capabilities =
+          _tp_connection_introspection_cache_dup_capabilities (
+              self->priv->introspection_cache);
+
+      if (self->priv->capabilities != NULL)
+        {
+          DEBUG ("%s: using cached capabilities",
+              tp_proxy_get_object_path (self));
+          g_object_notify ((GObject *) self, "capabilities");
+        }
+    }
+
   if (self->priv->capabilities != NULL)
     {
       /* been there, done that, bored now */
@@ -716,67 +740,165 @@ tp_connection_continue_introspection (TpConnection *self)
     }
 }
 
+/* Returns NULL if @strv is NULL */
+static GArray *
+interfaces_to_quarks (TpConnection *self,
+    const gchar *property,
+    const gchar * const *strv)
+{
+  const gchar * const *iter;
+  GArray *arr;
+
+  if (strv == NULL)
+    return NULL;
+
+  arr = g_array_sized_new (FALSE, FALSE, sizeof (GQuark),
+      g_strv_length ((gchar **) strv));
+
+  for (iter = strv; *iter != NULL; iter++)
+    {
+      if (tp_dbus_check_valid_interface_name (*iter, NULL))
+        {
+          GQuark q = g_quark_from_string (*iter);
+
+          DEBUG ("%p: %s has %s", self, property, *iter);
+          g_array_append_val (arr, q);
+        }
+      else
+        {
+          DEBUG ("%p: ignoring invalid interface: %s", self,
+              *iter);
+        }
+    }
+
+  return arr;
+}
+
+/* Returns NULL if @error is set or @properties doesn't have
+ * ContactAttributeInterfaces; otherwise, sets @changed_interfaces to the
+ * ContactAttributesChangedInterfaces, which older connection managers
+ * don't have */
+static GArray *
+dup_contact_attribute_interfaces (TpConnection *self,
+    GHashTable *properties,
+    const GError *error,
+    GArray **changed_interfaces)
+{
+  GArray *arr;
+
+  if (error != NULL)
+    {
+      DEBUG ("%p: GetAll(Contacts) failed with "
+          "%s %d: %s", self, g_quark_to_string (error->domain), error->code,
+          error->message);
+      return NULL;
+    }
+
+  arr = interfaces_to_quarks (self, "ContactAttributeInterfaces",
+      tp_asv_get_strv (properties, "ContactAttributeInterfaces"));
+
+  if (arr == NULL)
+    {
+      DEBUG ("%p: ContactAttributeInterfaces missing or of the wrong type, "
+          "ignoring", self);
+      return NULL;
+    }
+
+  *changed_interfaces = interfaces_to_quarks (self,
+      "ContactAttributesChangedInterfaces",
+      tp_asv_get_strv (properties, "ContactAttributesChangedInterfaces"));
+
+  if (*changed_interfaces == NULL)
+    *changed_interfaces = g_array_sized_new (FALSE, FALSE, sizeof (GQuark),
+        0);
+
+  return arr;
+}
+
 static void
 got_contact_attribute_interfaces (TpProxy *proxy,
-                                  const GValue *value,
+                                  GHashTable *properties,
                                   const GError *error,
                                   gpointer user_data G_GNUC_UNUSED,
                                   GObject *weak_object G_GNUC_UNUSED)
 {
   TpConnection *self = TP_CONNECTION (proxy);
   GArray *arr;
+  GArray *changed = NULL;
 
   g_assert (self->priv->introspection_call != NULL);
   self->priv->introspection_call = NULL;
 
-  if (error == NULL && G_VALUE_HOLDS (value, G_TYPE_STRV))
-    {
-      gchar **interfaces = g_value_get_boxed (value);
-      gchar **iter;
+  arr = dup_contact_attribute_interfaces (self, properties, error, &changed);
 
-      arr = g_array_sized_new (FALSE, FALSE, sizeof (GQuark),
-          interfaces == NULL ? 0 : g_strv_length (interfaces));
-
-      if (interfaces != NULL)
-        {
-          for (iter = interfaces; *iter != NULL; iter++)
-            {
-              if (tp_dbus_check_valid_interface_name (*iter, NULL))
-                {
-                  GQuark q = g_quark_from_string (*iter);
-
-                  DEBUG ("%p: ContactAttributeInterfaces has %s", self,
-                      *iter);
-                  g_array_append_val (arr, q);
-                }
-              else
-                {
-                  DEBUG ("%p: ignoring invalid interface: %s", self,
-                      *iter);
-                }
-            }
-        }
-    }
-  else
+  if (arr == NULL)
     {
-      if (error == NULL)
-        DEBUG ("%p: ContactAttributeInterfaces had wrong type %s, "
-            "ignoring", self, G_VALUE_TYPE_NAME (value));
-      else
-        DEBUG ("%p: Get(Contacts, ContactAttributeInterfaces) failed with "
-            "%s %d: %s", self, g_quark_to_string (error->domain), error->code,
-            error->message);
-
       arr = g_array_sized_new (FALSE, FALSE, sizeof (GQuark), 0);
+      changed = g_array_sized_new (FALSE, FALSE, sizeof (GQuark), 0);
+    }
+  else if (self->priv->introspection_cache != NULL)
+    {
+      _tp_connection_introspection_cache_set_contact_attribute_interfaces (
+          self->priv->introspection_cache, arr, changed);
     }
 
   g_assert (self->priv->contact_attribute_interfaces == NULL);
   self->priv->contact_attribute_interfaces = arr;
+  self->priv->contact_attributes_changed_interfaces = changed;
   self->priv->ready_enough_for_contacts = TRUE;
 
   tp_connection_continue_introspection (self);
 }
 
+static void introspect_contacts (TpConnection *self);
+
+static void
+got_early_contact_attribute_interfaces (TpProxy *proxy,
+    GHashTable *properties,
+    const GError *error,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  TpConnection *self = TP_CONNECTION (proxy);
+  gboolean waiting;
+  GArray *arr;
+  GArray *changed = NULL;
+
+  g_assert (self->priv->early_contact_attribute_interfaces_call != NULL);
+  waiting = (self->priv->introspection_call ==
+      self->priv->early_contact_attribute_interfaces_call);
+  self->priv->early_contact_attribute_interfaces_call = NULL;
+
+  if (waiting)
+    self->priv->introspection_call = NULL;
+
+  /* If there turns out to be no Contacts interface, this fails, and we
+   * never needed it anyway */
+  arr = dup_contact_attribute_interfaces (self, properties, error,
+      &changed);
+
+  if (arr != NULL)
+    {
+      g_assert (self->priv->contact_attribute_interfaces == NULL);
+      self->priv->contact_attribute_interfaces = arr;
+      self->priv->contact_attributes_changed_interfaces = changed;
+      self->priv->ready_enough_for_contacts = TRUE;
+
+      /* they can't change, even before the connection is CONNECTED */
+      if (self->priv->introspection_cache != NULL)
+        _tp_connection_introspection_cache_set_contact_attribute_interfaces (
+            self->priv->introspection_cache, arr, changed);
+    }
+
+  if (!waiting)
+    return;
+
+  if (arr != NULL)
+    tp_connection_continue_introspection (self);
+  else
+    introspect_contacts (self);
+}
+
 static void
 introspect_contacts (TpConnection *self)
 {
@@ -788,9 +910,19 @@ introspect_contacts (TpConnection *self)
     }
 
   g_assert (self->priv->introspection_call == NULL);
-  self->priv->introspection_call = tp_cli_dbus_properties_call_get (self, -1,
-       TP_IFACE_CONNECTION_INTERFACE_CONTACTS, "ContactAttributeInterfaces",
-       got_contact_attribute_interfaces, NULL, NULL, NULL);
+
+  if (self->priv->early_contact_attribute_interfaces_call != NULL)
+    {
+      /* We already asked, at the same time as GetAll(Connection); the
+       * reply is on its way */
+      self->priv->introspection_call =
+          self->priv->early_contact_attribute_interfaces_call;
+      return;
+    }
+
+  self->priv->introspection_call = tp_cli_dbus_properties_call_get_all (
+      self, -1, TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
+      got_contact_attribute_interfaces, NULL, NULL, NULL);
 }
 
 static void
@@ -1056,6 +1188,11 @@ tp_connection_status_changed (TpConnection *self,
           /* We thought we knew what was going on, but now the connection has
            * gone to CONNECTED and all bets are off. Start again! */
           DEBUG ("Cancelling pre-CONNECTED introspection and starting again");
+
+          if (self->priv->introspection_call ==
+              self->priv->early_contact_attribute_interfaces_call)
+            self->priv->early_contact_attribute_interfaces_call = NULL;
+
           tp_proxy_pending_call_cancel (self->priv->introspection_call);
           self->priv->introspection_call = NULL;
           g_list_free (self->priv->introspect_needed);
@@ -1204,13 +1341,17 @@ _tp_connection_status_reason_to_gerror (TpConnectionStatusReason reason,
 }
 
 static void
-tp_connection_status_changed_cb (TpConnection *self,
-                                 guint status,
-                                 guint reason,
-                                 gpointer user_data,
-                                 GObject *weak_object)
+tp_connection_status_changed_cb (TpProxy *proxy,
+    GVariant *args,
+    gpointer user_data,
+    GObject *weak_object)
 {
+  TpConnection *self = (TpConnection *) proxy;
   TpConnectionStatus prev_status = self->priv->status;
+  guint status;
+  guint reason;
+
+  g_variant_get (args, "(uu)", &status, &reason);
 
   /* The status is initially attempted to be discovered starting in the
    * constructor. If we don't have the reply for that call yet, ignore this
@@ -1228,6 +1369,11 @@ tp_connection_status_changed_cb (TpConnection *self,
     {
       GError *error = NULL;
 
+      /* nobody else should use what we found out about this connection */
+      if (self->priv->introspection_cache != NULL)
+        _tp_connection_introspection_cache_discard (
+            self->priv->introspection_cache);
+
       if (self->priv->connection_error == NULL)
         {
           _tp_connection_status_reason_to_gerror (reason, prev_status,
@@ -1262,12 +1408,14 @@ tp_connection_status_changed_cb (TpConnection *self,
 }
 
 static void
-tp_connection_got_status_cb (TpConnection *self,
-                             guint status,
-                             const GError *error,
-                             gpointer unused,
-                             GObject *user_object)
+tp_connection_got_status_cb (TpProxy *proxy,
+    GVariant *out_args,
+    const GError *error,
+    gpointer unused,
+    GObject *user_object)
 {
+  TpConnection *self = (TpConnection *) proxy;
+
   DEBUG ("%p", self);
 
   g_assert (self->priv->introspection_call != NULL);
@@ -1275,6 +1423,9 @@ tp_connection_got_status_cb (TpConnection *self,
 
   if (error == NULL)
     {
+      guint status;
+
+      g_variant_get (out_args, "(u)", &status);
       DEBUG ("%p: Initial status is %d", self, status);
       tp_connection_status_changed (self, status,
           TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED);
@@ -1296,9 +1447,54 @@ tp_connection_got_status_cb (TpConnection *self,
     }
 }
 
+static void
+tp_connection_invalidate_channels (TpConnection *self)
+{
+  GPtrArray *channels;
+  GHashTableIter iter;
+  gpointer channel;
+  guint i;
+
+  if (self->priv->channels == NULL ||
+      g_hash_table_size (self->priv->channels) == 0)
+    return;
+
+  /* Invalidating each channel separately, from its own handler for our
+   * invalidated signal, made tearing down a connection with thousands of
+   * channels quadratic; instead, mark them all invalid in one pass. The
+   * refs keep them alive while their invalidated handlers run. */
+  channels = g_ptr_array_new_full (g_hash_table_size (self->priv->channels),
+      g_object_unref);
+  g_hash_table_iter_init (&iter, self->priv->channels);
+
+  while (g_hash_table_iter_next (&iter, &channel, NULL))
+    g_ptr_array_add (channels, g_object_ref (channel));
+
+  DEBUG ("%p: invalidating %u channels", self, channels->len);
+  _tp_proxy_invalidate_many (channels, tp_proxy_get_invalidated (self));
+
+  for (i = 0; i < channels->len; i++)
+    _tp_channel_connection_invalidated (g_ptr_array_index (channels, i));
+
+  g_ptr_array_unref (channels);
+}
+
 static void
 tp_connection_invalidated (TpConnection *self)
 {
+  tp_connection_invalidate_channels (self);
+  tp_clear_pointer (&self->priv->id_handles, g_hash_table_unref);
+
+  if (self->priv->early_contact_attribute_interfaces_call != NULL)
+    {
+      if (self->priv->early_contact_attribute_interfaces_call !=
+          self->priv->introspection_call)
+        tp_proxy_pending_call_cancel (
+            self->priv->early_contact_attribute_interfaces_call);
+
+      self->priv->early_contact_attribute_interfaces_call = NULL;
+    }
+
   if (self->priv->introspection_call != NULL)
     {
       DEBUG ("Cancelling introspection");
@@ -1317,9 +1513,15 @@ tp_connection_invalidated (TpConnection *self)
    * a ref on the TpConnection to use its TpContact, this would avoid the
    * refcycle completely. */
   if (self->priv->roster != NULL)
-    g_hash_table_remove_all (self->priv->roster);
+    {
+      _tp_connection_roster_index_clear (self);
+      g_hash_table_remove_all (self->priv->roster);
+      self->priv->roster_generation++;
+    }
+
   g_clear_object (&self->priv->self_contact);
   tp_clear_pointer (&self->priv->blocked_contacts, g_ptr_array_unref);
+  tp_clear_pointer (&self->priv->blocked_handles, tp_intset_destroy);
 }
 
 static gboolean
@@ -1361,6 +1563,45 @@ _tp_connection_extract_properties (TpConnection *self,
   return TRUE;
 }
 
+/* Called when we know the connection is CONNECTED and has @interfaces,
+ * before acting on them. */
+static void
+use_introspection_cache (TpConnection *self,
+    const gchar **interfaces)
+{
+  TpConnectionIntrospectionCache *cache = self->priv->introspection_cache;
+
+  if (_tp_connection_introspection_cache_check_interfaces (cache,
+        (const gchar * const *) interfaces))
+    {
+      GArray *arr;
+      GArray *changed;
+
+      if (self->priv->contact_attribute_interfaces != NULL)
+        return;
+
+      arr =
+          _tp_connection_introspection_cache_dup_contact_attribute_interfaces (
+              cache, &changed);
+
+      if (arr != NULL)
+        {
+          DEBUG ("%p: using cached ContactAttributeInterfaces", self);
+          self->priv->contact_attribute_interfaces = arr;
+          self->priv->contact_attributes_changed_interfaces = changed;
+          self->priv->ready_enough_for_contacts = TRUE;
+        }
+    }
+  else if (self->priv->contact_attribute_interfaces != NULL)
+    {
+      /* we got these from the connection manager before we knew what to
+       * check against */
+      _tp_connection_introspection_cache_set_contact_attribute_interfaces (
+          cache, self->priv->contact_attribute_interfaces,
+          self->priv->contact_attributes_changed_interfaces);
+    }
+}
+
 static void
 _tp_connection_got_properties (TpProxy *proxy,
     GHashTable *asv,
@@ -1391,6 +1632,10 @@ _tp_connection_got_properties (TpProxy *proxy,
         &self_handle,
         &interfaces))
     {
+      if (status == TP_CONNECTION_STATUS_CONNECTED &&
+          self->priv->introspection_cache != NULL)
+        use_introspection_cache (self, interfaces);
+
       tp_connection_add_interfaces_from_introspection (self, interfaces);
 
       if (status == TP_CONNECTION_STATUS_CONNECTED)
@@ -1427,7 +1672,7 @@ _tp_connection_got_properties (TpProxy *proxy,
           /* get my initial status */
           DEBUG ("Calling GetStatus");
           self->priv->introspection_call =
-            tp_cli_connection_call_get_status (self, -1,
+            _tp_cli_connection_call_get_status_vardict (self, -1,
               tp_connection_got_status_cb, NULL, NULL, NULL);
         }
       else
@@ -1444,6 +1689,25 @@ static gboolean _tp_connection_parse (const gchar *path_or_bus_name,
     gchar **protocol,
     gchar **cm_name);
 
+static void
+tp_connection_trim (GObject *object,
+    TpTrimLevel level)
+{
+  TpConnection *self = TP_CONNECTION (object);
+
+  /* the attributes we loaded from disk are only kept to speed up
+   * preparing contacts; freeing it writes out anything that changed, and
+   * it is loaded again the next time it is needed */
+  if (level == TP_TRIM_LEVEL_COMPLETE &&
+      self->priv->contact_attributes_cache != NULL)
+    {
+      DEBUG ("%s: dropping contact attributes cache",
+          tp_proxy_get_object_path (self));
+      tp_clear_pointer (&self->priv->contact_attributes_cache,
+          _tp_contact_attributes_cache_free);
+    }
+}
+
 static void
 tp_connection_constructed (GObject *object)
 {
@@ -1461,7 +1725,7 @@ tp_connection_constructed (GObject *object)
   /* Connect to my own StatusChanged signal.
    * The connection hasn't had a chance to become invalid yet, so we can
    * assume that this signal connection will work */
-  tp_cli_connection_connect_to_status_changed (self,
+  _tp_cli_connection_connect_to_status_changed_vardict (self,
       tp_connection_status_changed_cb, NULL, NULL, NULL, NULL);
   tp_cli_connection_connect_to_connection_error (self,
       tp_connection_connection_error_cb, NULL, NULL, NULL, NULL);
@@ -1475,19 +1739,43 @@ tp_connection_constructed (GObject *object)
   g_assert (_tp_connection_parse (object_path, '/',
       &(self->priv->proto_name), &(self->priv->cm_name)));
 
+  if (_tp_simple_client_factory_get_introspection_cache_enabled (
+        tp_proxy_get_factory (self)))
+    self->priv->introspection_cache = _tp_connection_introspection_cache_new (
+        object_path, tp_proxy_get_bus_name (self));
+
   tp_cli_dbus_properties_call_get_all (self, -1,
       TP_IFACE_CONNECTION, _tp_connection_got_properties, NULL, NULL, NULL);
 
+  /* Almost every connection manager has the Contacts interface, so ask for
+   * its properties straight away, rather than waiting to see the
+   * Interfaces in the reply to GetAll(Connection): this saves a round-trip
+   * before CORE is ready. If there is no Contacts interface, the call
+   * just fails and is ignored. If another process already found out, we
+   * will most likely be able to use its answer instead, and only ask
+   * during introspection if not. */
+  if (self->priv->introspection_cache == NULL ||
+      !_tp_connection_introspection_cache_has_attribute_interfaces (
+        self->priv->introspection_cache))
+    self->priv->early_contact_attribute_interfaces_call =
+        tp_cli_dbus_properties_call_get_all (self, -1,
+            TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
+            got_early_contact_attribute_interfaces, NULL, NULL, NULL);
+
   /* Give a chance to TpAccount to know about invalidated connection before we
    * unref all roster contacts. This is to let applications properly remove all
    * contacts at once instead of getting weak notify on each. */
   g_signal_connect_after (self, "invalidated",
       G_CALLBACK (tp_connection_invalidated), NULL);
+
+  _tp_register_trimmable (self, tp_connection_trim);
 }
 
 static void
 tp_connection_init (TpConnection *self)
 {
+  guint i;
+
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_CONNECTION,
       TpConnectionPrivate);
 
@@ -1500,12 +1788,24 @@ tp_connection_init (TpConnection *self)
   g_ptr_array_add (self->priv->contact_groups, NULL);
   self->priv->roster = g_hash_table_new_full (g_direct_hash, g_direct_equal,
       NULL, g_object_unref);
+  self->priv->roster_by_group = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < TP_NUM_SUBSCRIPTION_STATES; i++)
+    {
+      self->priv->roster_by_subscribe[i] = g_hash_table_new (NULL, NULL);
+      self->priv->roster_by_publish[i] = g_hash_table_new (NULL, NULL);
+    }
+
+  self->priv->channels = g_hash_table_new (NULL, NULL);
   self->priv->contacts_changed_queue = g_queue_new ();
 
   g_queue_init (&self->priv->capabilities_queue);
+  g_queue_init (&self->priv->contact_info_fetch_queue);
 
   self->priv->blocked_contacts = g_ptr_array_new_with_free_func (
       g_object_unref);
+  self->priv->blocked_handles = tp_intset_new ();
 
   self->priv->blocked_changed_queue = g_queue_new ();
 }
@@ -1533,6 +1833,9 @@ tp_connection_finalize (GObject *object)
       self->priv->contact_attribute_interfaces = NULL;
     }
 
+  tp_clear_pointer (&self->priv->contact_attributes_changed_interfaces,
+      g_array_unref);
+
   g_free (self->priv->connection_error);
   self->priv->connection_error = NULL;
 
@@ -1550,7 +1853,7 @@ tp_connection_finalize (GObject *object)
 
   if (self->priv->avatar_request_idle_id != 0)
     {
-      g_source_remove (self->priv->avatar_request_idle_id);
+      _tp_source_remove (self->priv->avatar_request_idle_id);
       self->priv->avatar_request_idle_id = 0;
     }
 
@@ -1559,8 +1862,16 @@ tp_connection_finalize (GObject *object)
 
   tp_clear_pointer (&self->priv->balance_currency, g_free);
   tp_clear_pointer (&self->priv->balance_uri, g_free);
+  tp_clear_pointer (&self->priv->presence_messages, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->contact_capabilities, g_hash_table_unref);
   tp_clear_pointer (&self->priv->cm_name, g_free);
   tp_clear_pointer (&self->priv->proto_name, g_free);
+  /* each channel holds a ref to us, so this is empty by now */
+  tp_clear_pointer (&self->priv->channels, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->id_handles, g_hash_table_unref);
+  /* each tp_connection_request_contact_info_async() holds a ref to us, so
+   * this is empty by now */
+  tp_clear_pointer (&self->priv->contact_info_fetches, g_hash_table_unref);
 
   ((GObjectClass *) tp_connection_parent_class)->finalize (object);
 }
@@ -1578,6 +1889,7 @@ static void
 tp_connection_dispose (GObject *object)
 {
   TpConnection *self = TP_CONNECTION (object);
+  guint i;
 
   DEBUG ("%p", object);
 
@@ -1590,6 +1902,16 @@ tp_connection_dispose (GObject *object)
 
   tp_clear_pointer (&self->priv->contact_groups, g_ptr_array_unref);
   tp_clear_pointer (&self->priv->roster, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->roster_by_group, g_hash_table_unref);
+
+  for (i = 0; i < TP_NUM_SUBSCRIPTION_STATES; i++)
+    {
+      tp_clear_pointer (&self->priv->roster_by_subscribe[i],
+          g_hash_table_unref);
+      tp_clear_pointer (&self->priv->roster_by_publish[i],
+          g_hash_table_unref);
+    }
+
   tp_clear_pointer (&self->priv->contacts_changed_queue,
       _tp_connection_contacts_changed_queue_free);
   tp_clear_pointer (&self->priv->blocked_changed_queue,
@@ -1605,6 +1927,19 @@ tp_connection_dispose (GObject *object)
   tp_clear_object (&self->priv->capabilities);
   tp_clear_pointer (&self->priv->avatar_requirements,
       tp_avatar_requirements_destroy);
+  tp_clear_pointer (&self->priv->contact_attributes_cache,
+      _tp_contact_attributes_cache_free);
+  tp_clear_pointer (&self->priv->introspection_cache,
+      _tp_connection_introspection_cache_free);
+
+  if (self->priv->contacts_changed_idle_id != 0)
+    {
+      _tp_source_remove (self->priv->contacts_changed_idle_id);
+      self->priv->contacts_changed_idle_id = 0;
+    }
+
+  tp_clear_pointer (&self->priv->pending_contacts_changed,
+      g_hash_table_unref);
 
   if (self->priv->interests != NULL)
     {
@@ -1641,6 +1976,7 @@ tp_connection_dispose (GObject *object)
     }
 
   tp_clear_pointer (&self->priv->blocked_contacts, g_ptr_array_unref);
+  tp_clear_pointer (&self->priv->blocked_handles, tp_intset_destroy);
   g_clear_object (&self->priv->self_contact);
 
   ((GObjectClass *) tp_connection_parent_class)->dispose (object);
@@ -2365,6 +2701,256 @@ tp_connection_class_init (TpConnectionClass *klass)
       NULL, NULL, NULL,
       G_TYPE_NONE, 2, G_TYPE_PTR_ARRAY, G_TYPE_PTR_ARRAY);
 
+  /**
+   * TpConnection::contact-attributes-received:
+   * @self: a #TpConnection
+   * @contacts: (type GLib.PtrArray) (element-type TelepathyGLib.Contact):
+   *  a #GPtrArray of #TpContact whose attributes have just been received
+   * @n_done: how many of the contacts in the request have now been received
+   * @n_total: how many contacts there are in the request
+   *
+   * Emitted while a request made with tp_connection_get_contacts_by_handle(),
+   * tp_connection_upgrade_contacts_async() or similar functions is in
+   * progress, each time a reply from the connection manager has been applied
+   * to @contacts. If the request is split into batches (see
+   * tp_connection_set_contact_attributes_batching()), this lets the contacts
+   * be displayed before the whole request has finished.
+   *
+   * Features that are not retrieved with the contact attributes, such as
+   * %TP_CONTACT_FEATURE_AVATAR_DATA, might not be prepared yet on @contacts.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_CONTACT_ATTRIBUTES_RECEIVED] = g_signal_new (
+      "contact-attributes-received",
+      G_OBJECT_CLASS_TYPE (klass),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 3, G_TYPE_PTR_ARRAY, G_TYPE_UINT, G_TYPE_UINT);
+
+  /**
+   * TpConnection::contacts-changed:
+   * @self: a #TpConnection
+   * @contacts: (type GLib.PtrArray) (element-type TelepathyGLib.Contact):
+   *  a #GPtrArray of #TpContact that have changed
+   * @feature: the #TpContactFeature whose properties have changed on
+   *  @contacts
+   *
+   * Emitted once per main loop iteration and per feature, if
+   * tp_connection_set_contact_notification_batching() has been used,
+   * instead of the #GObject::notify signals and other change notification
+   * signals of each #TpContact.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_CONTACTS_CHANGED] = g_signal_new (
+      "contacts-changed",
+      G_OBJECT_CLASS_TYPE (klass),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 2, G_TYPE_PTR_ARRAY, G_TYPE_UINT);
+}
+
+void
+_tp_connection_emit_contact_attributes_received (TpConnection *self,
+    GPtrArray *contacts,
+    guint n_done,
+    guint n_total)
+{
+  g_signal_emit (self, signals[SIGNAL_CONTACT_ATTRIBUTES_RECEIVED], 0,
+      contacts, n_done, n_total);
+}
+
+static gboolean
+contacts_changed_idle_cb (gpointer user_data)
+{
+  TpConnection *self = user_data;
+  GHashTable *pending = self->priv->pending_contacts_changed;
+  guint feature;
+
+  self->priv->contacts_changed_idle_id = 0;
+  self->priv->pending_contacts_changed = NULL;
+
+  g_object_ref (self);
+
+  for (feature = 0; feature < TP_NUM_CONTACT_FEATURES; feature++)
+    {
+      GHashTable *set = g_hash_table_lookup (pending,
+          GUINT_TO_POINTER (feature));
+      GPtrArray *contacts;
+      GHashTableIter iter;
+      gpointer contact;
+
+      if (set == NULL)
+        continue;
+
+      contacts = g_ptr_array_new_full (g_hash_table_size (set),
+          g_object_unref);
+      g_hash_table_iter_init (&iter, set);
+
+      while (g_hash_table_iter_next (&iter, &contact, NULL))
+        g_ptr_array_add (contacts, g_object_ref (contact));
+
+      DEBUG ("%u contacts changed for feature %u", contacts->len, feature);
+      g_signal_emit (self, signals[SIGNAL_CONTACTS_CHANGED], 0,
+          contacts, feature);
+      g_ptr_array_unref (contacts);
+    }
+
+  g_hash_table_unref (pending);
+  g_object_unref (self);
+  return FALSE;
+}
+
+/* Called by contact.c instead of notifying changes to @feature on @contact,
+ * if batch_contact_notifications is set */
+void
+_tp_connection_queue_contact_changed (TpConnection *self,
+    TpContact *contact,
+    TpContactFeature feature)
+{
+  GHashTable *set;
+
+  if (self->priv->pending_contacts_changed == NULL)
+    self->priv->pending_contacts_changed = g_hash_table_new_full (NULL, NULL,
+        NULL, (GDestroyNotify) g_hash_table_unref);
+
+  set = g_hash_table_lookup (self->priv->pending_contacts_changed,
+      GUINT_TO_POINTER (feature));
+
+  if (set == NULL)
+    {
+      set = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+      g_hash_table_insert (self->priv->pending_contacts_changed,
+          GUINT_TO_POINTER (feature), set);
+    }
+
+  if (!g_hash_table_contains (set, contact))
+    g_hash_table_add (set, g_object_ref (contact));
+
+  if (self->priv->contacts_changed_idle_id == 0)
+    self->priv->contacts_changed_idle_id = _tp_idle_add (
+        TP_LATENCY_CLASS_NORMAL, contacts_changed_idle_cb, self);
+}
+
+/*
+ * _tp_connection_ref_presence_message:
+ * @self: a connection
+ * @message: a presence message
+ *
+ * Most contacts have one of a few presence messages, often the empty
+ * string, so contacts share a single copy of each message.
+ *
+ * Returns: a copy of @message, owned by @self, which must be released
+ *  with _tp_connection_unref_presence_message()
+ */
+const gchar *
+_tp_connection_ref_presence_message (TpConnection *self,
+    const gchar *message)
+{
+  gpointer key, value;
+  guint *refs;
+
+  if (message == NULL || message[0] == '\0')
+    return "";
+
+  if (self->priv->presence_messages == NULL)
+    self->priv->presence_messages = g_hash_table_new_full (g_str_hash,
+        g_str_equal, g_free, g_free);
+
+  if (g_hash_table_lookup_extended (self->priv->presence_messages, message,
+        &key, &value))
+    {
+      refs = value;
+      (*refs)++;
+      return key;
+    }
+
+  key = g_strdup (message);
+  refs = g_new (guint, 1);
+  *refs = 1;
+  g_hash_table_insert (self->priv->presence_messages, key, refs);
+  return key;
+}
+
+void
+_tp_connection_unref_presence_message (TpConnection *self,
+    const gchar *message)
+{
+  guint *refs;
+
+  if (message[0] == '\0')
+    return;
+
+  g_return_if_fail (self->priv->presence_messages != NULL);
+
+  refs = g_hash_table_lookup (self->priv->presence_messages, message);
+  g_return_if_fail (refs != NULL);
+
+  if (--(*refs) == 0)
+    g_hash_table_remove (self->priv->presence_messages, message);
+}
+
+/* Beyond this many distinct sets of contact capabilities, new sets are not
+ * remembered by the connection (although _tp_capabilities_new() still shares
+ * them while they are in use) */
+#define MAX_CONTACT_CAPABILITIES 64
+
+/*
+ * _tp_connection_dup_contact_capabilities:
+ * @self: a connection
+ * @classes: the requestable channel classes of one of @self's contacts
+ *
+ * Most contacts on a connection have one of a handful of sets of
+ * capabilities, so @self keeps the #TpCapabilities for each set it has seen,
+ * looked up by _tp_capabilities_classes_hash(). This means that each time a
+ * contact's capabilities are received, they can usually be matched to an
+ * existing object without converting them to a #GVariant.
+ *
+ * Returns: (transfer full): a contact-specific #TpCapabilities for @classes
+ */
+TpCapabilities *
+_tp_connection_dup_contact_capabilities (TpConnection *self,
+    const GPtrArray *classes)
+{
+  guint hash = _tp_capabilities_classes_hash (classes);
+  TpCapabilities *capabilities;
+  GPtrArray *bucket = NULL;
+  guint i;
+
+  if (self->priv->contact_capabilities == NULL)
+    self->priv->contact_capabilities = g_hash_table_new_full (NULL, NULL,
+        NULL, (GDestroyNotify) g_ptr_array_unref);
+  else
+    bucket = g_hash_table_lookup (self->priv->contact_capabilities,
+        GUINT_TO_POINTER (hash));
+
+  for (i = 0; bucket != NULL && i < bucket->len; i++)
+    {
+      capabilities = g_ptr_array_index (bucket, i);
+
+      if (_tp_capabilities_has_classes (capabilities, classes, TRUE))
+        return g_object_ref (capabilities);
+    }
+
+  capabilities = _tp_capabilities_new (classes, TRUE);
+
+  if (self->priv->n_contact_capabilities < MAX_CONTACT_CAPABILITIES)
+    {
+      if (bucket == NULL)
+        {
+          bucket = g_ptr_array_new_with_free_func (g_object_unref);
+          g_hash_table_insert (self->priv->contact_capabilities,
+              GUINT_TO_POINTER (hash), bucket);
+        }
+
+      g_ptr_array_add (bucket, g_object_ref (capabilities));
+      self->priv->n_contact_capabilities++;
+    }
+
+  return capabilities;
 }
 
 /**
@@ -3275,6 +3861,87 @@ _tp_connection_add_contact (TpConnection *self,
     }
 }
 
+/* Identifiers are remembered for this many handles at most; beyond that,
+ * an arbitrary one is forgotten for each new one */
+#define MAX_ID_HANDLES 10000
+
+/*
+ * _tp_connection_remember_id_handle:
+ * @self: a connection
+ * @id: an identifier, either normalized or as requested from the CM
+ * @handle: the handle to which the CM resolved @id
+ *
+ * Remember that @id corresponds to @handle, so that
+ * tp_connection_get_contacts_by_id() does not need to ask the CM again.
+ * This does nothing unless @self has immortal handles, since otherwise
+ * @handle might become invalid.
+ */
+void
+_tp_connection_remember_id_handle (TpConnection *self,
+    const gchar *id,
+    TpHandle handle)
+{
+  if (id == NULL || handle == 0 || !self->priv->has_immortal_handles ||
+      tp_proxy_get_invalidated (self) != NULL)
+    return;
+
+  if (self->priv->id_handles == NULL)
+    self->priv->id_handles = g_hash_table_new_full (g_str_hash,
+        g_str_equal, g_free, NULL);
+
+  if (g_hash_table_size (self->priv->id_handles) >= MAX_ID_HANDLES &&
+      !g_hash_table_contains (self->priv->id_handles, id))
+    {
+      GHashTableIter iter;
+
+      g_hash_table_iter_init (&iter, self->priv->id_handles);
+
+      if (g_hash_table_iter_next (&iter, NULL, NULL))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  g_hash_table_insert (self->priv->id_handles, g_strdup (id),
+      GUINT_TO_POINTER (handle));
+}
+
+/*
+ * _tp_connection_lookup_id_handle:
+ * @self: a connection
+ * @id: an identifier
+ *
+ * Returns: the handle that @id was recently resolved to, or 0
+ */
+TpHandle
+_tp_connection_lookup_id_handle (TpConnection *self,
+    const gchar *id)
+{
+  if (self->priv->id_handles == NULL)
+    return 0;
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->id_handles, id));
+}
+
+void
+_tp_connection_add_channel (TpConnection *self,
+    TpChannel *channel)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+  g_return_if_fail (TP_IS_CHANNEL (channel));
+
+  if (self->priv->channels != NULL)
+    g_hash_table_add (self->priv->channels, channel);
+}
+
+void
+_tp_connection_remove_channel (TpConnection *self,
+    TpChannel *channel)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  if (self->priv->channels != NULL)
+    g_hash_table_remove (self->priv->channels, channel);
+}
+
 
 /**
  * tp_connection_is_ready: (skip)
@@ -3618,6 +4285,196 @@ tp_connection_get_balance (TpConnection *self,
   return TRUE;
 }
 
+/**
+ * tp_connection_set_contact_attributes_batching:
+ * @self: a #TpConnection
+ * @batch_size: the maximum number of contacts whose attributes are
+ *  requested with one D-Bus call, or 0 to request all the contacts in one
+ *  call (the default)
+ * @max_in_flight: the maximum number of such calls that may be pending at
+ *  the same time for one request (0 is treated as 1)
+ *
+ * Arrange for requests for more than @batch_size contacts, made with
+ * functions like tp_connection_upgrade_contacts_async(), to be split into
+ * several GetContactAttributes calls. The replies to these calls are
+ * smaller, so neither the connection manager nor this process blocks for
+ * long while building or decoding them, and the memory they need at any
+ * time is bounded by @batch_size and @max_in_flight.
+ *
+ * #TpConnection::contact-attributes-received is emitted as each reply
+ * arrives. The request's callback is still only called once, when
+ * everything has finished.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_contact_attributes_batching (TpConnection *self,
+    guint batch_size,
+    guint max_in_flight)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  self->priv->contact_attributes_batch_size = batch_size;
+  self->priv->contact_attributes_max_in_flight = MAX (max_in_flight, 1);
+}
+
+/**
+ * tp_connection_set_contact_attributes_cache_enabled:
+ * @self: a #TpConnection
+ * @enabled: %TRUE to use the cache
+ *
+ * Enable or disable a persistent cache of contact attributes, stored in
+ * g_get_user_cache_dir() and keyed by the object path of
+ * #TpConnection:account (or of @self, if it has no account) and by
+ * contact identifier.
+ *
+ * When enabled, contacts requested again with
+ * tp_connection_upgrade_contacts_async() or similar functions get the
+ * attributes they had last time straight away, before the connection
+ * manager has been asked for them. When its reply arrives, only the
+ * contacts whose attributes have really changed are updated, and only
+ * those contacts have change notifications emitted for them.
+ *
+ * The cache is disabled by default.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_contact_attributes_cache_enabled (TpConnection *self,
+    gboolean enabled)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  self->priv->contact_attributes_cache_enabled = enabled;
+
+  if (!enabled)
+    tp_clear_pointer (&self->priv->contact_attributes_cache,
+        _tp_contact_attributes_cache_free);
+}
+
+/**
+ * tp_connection_set_lazy_avatar_data:
+ * @self: a #TpConnection
+ * @lazy: %TRUE to only download avatars that are wanted
+ *
+ * By default, preparing %TP_CONTACT_FEATURE_AVATAR_DATA on a contact
+ * downloads its avatar straight away, if it is not already in the cache.
+ * If @lazy is %TRUE, the cache is still used, but avatars that are not in
+ * it are only downloaded for contacts that have been passed to
+ * tp_contact_request_avatar_data_async(), or marked as visible with
+ * tp_connection_set_contacts_visible().
+ *
+ * Downloads for visible contacts are made first. In lazy mode, at most
+ * a few dozen avatars are asked for at once, with a short delay between
+ * requests, so that the connection manager's bandwidth is spent on the
+ * avatars that are actually being shown.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_lazy_avatar_data (TpConnection *self,
+    gboolean lazy)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  self->priv->lazy_avatar_data = lazy;
+}
+
+/**
+ * tp_connection_set_contact_notification_batching:
+ * @self: a #TpConnection
+ * @enabled: %TRUE to batch change notifications
+ *
+ * If @enabled is %TRUE, changes to the #TpContact objects of @self, such as
+ * those caused by a roster-wide presence update, are not notified on each
+ * contact. Instead, #TpConnection::contacts-changed is emitted once per main
+ * loop iteration for each #TpContactFeature that has changed, listing all
+ * the contacts that have changed. This avoids the storm of individual
+ * notifications which is otherwise emitted when thousands of contacts change
+ * at the same time.
+ *
+ * Contacts for which tp_contact_set_notify_individually() has been called
+ * still have their individual #GObject::notify signals and other change
+ * signals emitted too, for example for an open chat window.
+ *
+ * While batching is enabled, when @self is disposed, the #TpContact:handle
+ * of each of its contacts silently becomes 0, again except for contacts
+ * for which tp_contact_set_notify_individually() has been called.
+ *
+ * Batching is disabled by default.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_contact_notification_batching (TpConnection *self,
+    gboolean enabled)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  self->priv->batch_contact_notifications = enabled;
+}
+
+/**
+ * tp_connection_set_location_update_filter:
+ * @self: a #TpConnection
+ * @min_interval_ms: the minimum time between changes to a contact's
+ *  location, in milliseconds, or 0
+ * @min_distance_m: the minimum distance, in metres, that a contact must
+ *  move for its location to change, or 0
+ *
+ * Limit how often the #TpContact:location of @self's contacts changes in
+ * response to the connection manager's updates, for contacts that share
+ * their location every few seconds.
+ *
+ * If @min_interval_ms is non-zero, an update received less than
+ * @min_interval_ms after the contact's location last changed is held
+ * back until that time has passed; if more updates arrive in the
+ * meantime, only the most recent one is applied.
+ *
+ * If @min_distance_m is non-zero, an update is ignored if the only
+ * difference is that the contact's latitude and longitude have moved by
+ * less than @min_distance_m, or that its accuracy or timestamp have
+ * changed. Updates which do not have both a latitude and a longitude, or
+ * which change any other part of the location, are never ignored.
+ *
+ * Locations retrieved with %TP_CONTACT_FEATURE_LOCATION are always used
+ * straight away. By default, neither limit is applied.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_location_update_filter (TpConnection *self,
+    guint min_interval_ms,
+    guint min_distance_m)
+{
+  g_return_if_fail (TP_IS_CONNECTION (self));
+
+  self->priv->location_min_interval_ms = min_interval_ms;
+  self->priv->location_min_distance_m = min_distance_m;
+}
+
+TpContactAttributesCache *
+_tp_connection_get_contact_attributes_cache (TpConnection *self)
+{
+  if (!self->priv->contact_attributes_cache_enabled)
+    return NULL;
+
+  if (self->priv->contact_attributes_cache == NULL)
+    {
+      const gchar *path;
+
+      if (self->priv->account != NULL)
+        path = tp_proxy_get_object_path (self->priv->account);
+      else
+        path = tp_proxy_get_object_path (self);
+
+      self->priv->contact_attributes_cache =
+          _tp_contact_attributes_cache_new (path);
+    }
+
+  return self->priv->contact_attributes_cache;
+}
+
 /**
  * tp_connection_get_balance_uri:
  * @self: a #TpConnection
@@ -348,6 +348,28 @@ gboolean tp_connection_get_balance (TpConnection *self,
 _TP_AVAILABLE_IN_0_16
 const gchar * tp_connection_get_balance_uri (TpConnection *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_contact_attributes_batching (TpConnection *self,
+    guint batch_size,
+    guint max_in_flight);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_contact_attributes_cache_enabled (TpConnection *self,
+    gboolean enabled);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_lazy_avatar_data (TpConnection *self,
+    gboolean lazy);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_contact_notification_batching (TpConnection *self,
+    gboolean enabled);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_location_update_filter (TpConnection *self,
+    guint min_interval_ms,
+    guint min_distance_m);
+
 _TP_AVAILABLE_IN_0_18
 void tp_connection_disconnect_async (TpConnection *self,
     GAsyncReadyCallback callback,
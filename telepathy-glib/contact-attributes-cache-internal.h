@@ -0,0 +1,56 @@
+/*<private_header>*/
+/* On-disk cache of contact attributes (internal)
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_CONTACT_ATTRIBUTES_CACHE_INTERNAL_H__
+#define __TP_CONTACT_ATTRIBUTES_CACHE_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpContactAttributesCache TpContactAttributesCache;
+
+TpContactAttributesCache *_tp_contact_attributes_cache_new (
+    const gchar *object_path);
+
+void _tp_contact_attributes_cache_free (TpContactAttributesCache *self);
+
+GHashTable *_tp_contact_attributes_cache_lookup (
+    TpContactAttributesCache *self,
+    const gchar *identifier,
+    guint *features);
+
+gboolean _tp_contact_attributes_cache_update (TpContactAttributesCache *self,
+    const gchar *identifier,
+    GHashTable *asv,
+    guint features);
+
+void _tp_contact_attributes_cache_save (TpContactAttributesCache *self);
+
+const gchar *_tp_contact_attributes_cache_get_roster_version (
+    TpContactAttributesCache *self);
+
+void _tp_contact_attributes_cache_set_roster_version (
+    TpContactAttributesCache *self,
+    const gchar *version);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,489 @@
+/* On-disk cache of contact attributes
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/contact-attributes-cache-internal.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CONTACTS
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+/* The file contains a single GVariant of this type: a format version, and
+ * a dictionary mapping contact identifiers to the features for which the
+ * attributes are known, and the attributes themselves. The dictionary is
+ * sorted by identifier, so we can look contacts up directly in the mapped
+ * file without parsing all of it. */
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_TYPE "(ua{s(ua{sv})})"
+#define ENTRY_TYPE "(ua{sv})"
+
+/* how long to wait after a change before writing the file */
+#define SAVE_DELAY_SECONDS 5
+
+/* The version of the contact list that the cached attributes describe is
+ * kept in a separate file, next to the attributes, which is only written
+ * once the attributes have been. */
+#define ROSTER_VERSION_SUFFIX ".roster-version"
+
+struct _TpContactAttributesCache {
+    gchar *filename;
+    /* a{s(ua{sv})}, sorted by key, or NULL if there was no valid file */
+    GVariant *entries;
+    /* owned identifier => owned (ua{sv}), newer than entries */
+    GHashTable *changed;
+    guint save_id;
+    gchar *roster_version_filename;
+    /* the last roster version we were told about, or NULL */
+    gchar *roster_version;
+    /* TRUE if roster_version has not been written out yet */
+    gboolean roster_version_changed;
+};
+
+TpContactAttributesCache *
+_tp_contact_attributes_cache_new (const gchar *object_path)
+{
+  TpContactAttributesCache *self = g_slice_new0 (TpContactAttributesCache);
+  gchar *escaped = tp_escape_as_identifier (object_path);
+  GMappedFile *mapped;
+  GError *error = NULL;
+
+  self->filename = g_build_filename (g_get_user_cache_dir (),
+      "telepathy", "contact-attributes", escaped, NULL);
+  self->changed = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_variant_unref);
+  self->roster_version_filename = g_strconcat (self->filename,
+      ROSTER_VERSION_SUFFIX, NULL);
+  g_free (escaped);
+
+  if (!g_file_get_contents (self->roster_version_filename,
+        &self->roster_version, NULL, NULL))
+    self->roster_version = NULL;
+
+  mapped = g_mapped_file_new (self->filename, FALSE, &error);
+
+  if (mapped == NULL)
+    {
+      DEBUG ("no contact attributes cached in %s: %s", self->filename,
+          error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      GBytes *bytes = g_mapped_file_get_bytes (mapped);
+      GVariant *top = g_variant_ref_sink (g_variant_new_from_bytes (
+            G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+      guint32 version;
+
+      /* the bytes keep the file mapped for as long as we need it */
+      g_bytes_unref (bytes);
+      g_mapped_file_unref (mapped);
+
+      g_variant_get_child (top, 0, "u", &version);
+
+      if (version == CACHE_FORMAT_VERSION)
+        self->entries = g_variant_get_child_value (top, 1);
+      else
+        DEBUG ("ignoring %s with unknown version %u", self->filename,
+            version);
+
+      g_variant_unref (top);
+    }
+
+  return self;
+}
+
+void
+_tp_contact_attributes_cache_free (TpContactAttributesCache *self)
+{
+  if (self->save_id != 0)
+    {
+      g_source_remove (self->save_id);
+      self->save_id = 0;
+    }
+
+  _tp_contact_attributes_cache_save (self);
+
+  tp_clear_pointer (&self->entries, g_variant_unref);
+  g_hash_table_unref (self->changed);
+  g_free (self->filename);
+  g_free (self->roster_version_filename);
+  g_free (self->roster_version);
+  g_slice_free (TpContactAttributesCache, self);
+}
+
+/* Returns: (transfer full): a (ua{sv}), or NULL */
+static GVariant *
+cache_lookup_entry (TpContactAttributesCache *self,
+    const gchar *identifier)
+{
+  GVariant *entry = g_hash_table_lookup (self->changed, identifier);
+  gsize lo, hi;
+
+  if (entry != NULL)
+    return g_variant_ref (entry);
+
+  if (self->entries == NULL)
+    return NULL;
+
+  lo = 0;
+  hi = g_variant_n_children (self->entries);
+
+  while (lo < hi)
+    {
+      gsize mid = lo + (hi - lo) / 2;
+      GVariant *child = g_variant_get_child_value (self->entries, mid);
+      const gchar *key;
+      gint cmp;
+
+      g_variant_get_child (child, 0, "&s", &key);
+      cmp = strcmp (identifier, key);
+
+      if (cmp == 0)
+        entry = g_variant_get_child_value (child, 1);
+      else if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+
+      g_variant_unref (child);
+
+      if (entry != NULL)
+        return entry;
+    }
+
+  return NULL;
+}
+
+/*
+ * _tp_contact_attributes_cache_lookup:
+ * @self: a cache
+ * @identifier: a contact identifier
+ * @features: (out): used to return the ContactFeatureFlags for which the
+ *  returned attributes are complete
+ *
+ * Returns: (transfer full): the attributes last seen for @identifier, or
+ *  %NULL if there are none
+ */
+GHashTable *
+_tp_contact_attributes_cache_lookup (TpContactAttributesCache *self,
+    const gchar *identifier,
+    guint *features)
+{
+  GVariant *entry = cache_lookup_entry (self, identifier);
+  GVariant *attributes;
+  GHashTable *asv;
+
+  if (entry == NULL)
+    return NULL;
+
+  g_variant_get (entry, "(u@a{sv})", features, &attributes);
+  asv = _tp_asv_from_vardict (attributes);
+
+  g_variant_unref (attributes);
+  g_variant_unref (entry);
+  return asv;
+}
+
+static gint
+compare_strings (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (a, b);
+}
+
+/* Returns: (transfer full): an a{sv} with the contents of @dict, sorted by
+ * key so that equal dictionaries are serialized identically */
+static GVariant *
+build_sorted_vardict (GHashTable *dict)
+{
+  GVariantBuilder builder;
+  GList *keys = g_list_sort (g_hash_table_get_keys (dict), compare_strings);
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (l = keys; l != NULL; l = l->next)
+    g_variant_builder_add (&builder, "{sv}", l->data,
+        g_hash_table_lookup (dict, l->data));
+
+  g_list_free (keys);
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static gboolean
+cache_save_cb (gpointer data)
+{
+  TpContactAttributesCache *self = data;
+
+  self->save_id = 0;
+  _tp_contact_attributes_cache_save (self);
+  return FALSE;
+}
+
+static void
+cache_schedule_save (TpContactAttributesCache *self)
+{
+  if (self->save_id == 0)
+    self->save_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+        cache_save_cb, self);
+}
+
+/*
+ * _tp_contact_attributes_cache_get_roster_version:
+ * @self: a cache
+ *
+ * Returns: the version of the contact list passed to the last call to
+ *  _tp_contact_attributes_cache_set_roster_version(), possibly in a
+ *  previous process, or %NULL if there is none
+ */
+const gchar *
+_tp_contact_attributes_cache_get_roster_version (
+    TpContactAttributesCache *self)
+{
+  return self->roster_version;
+}
+
+/*
+ * _tp_contact_attributes_cache_set_roster_version:
+ * @self: a cache
+ * @version: (allow-none): the version of the contact list whose contacts'
+ *  attributes have all been passed to _tp_contact_attributes_cache_update(),
+ *  or %NULL to forget any version
+ *
+ * Remember @version alongside the cached attributes.
+ */
+void
+_tp_contact_attributes_cache_set_roster_version (
+    TpContactAttributesCache *self,
+    const gchar *version)
+{
+  if (!tp_strdiff (self->roster_version, version))
+    return;
+
+  /* Forget the old version straight away: if we crash before the new
+   * attributes are written, it would no longer describe them. */
+  if (g_unlink (self->roster_version_filename) != 0 && errno != ENOENT)
+    DEBUG ("Error removing %s: %s", self->roster_version_filename,
+        g_strerror (errno));
+
+  g_free (self->roster_version);
+  self->roster_version = g_strdup (version);
+  self->roster_version_changed = (version != NULL);
+
+  if (self->roster_version_changed)
+    cache_schedule_save (self);
+}
+
+/*
+ * _tp_contact_attributes_cache_update:
+ * @self: a cache
+ * @identifier: a contact identifier
+ * @asv: attributes that were just received for @identifier
+ * @features: the ContactFeatureFlags for which @asv is complete
+ *
+ * Record @asv as the latest attributes for @identifier.
+ *
+ * Returns: %TRUE if this changed what is cached for @identifier
+ */
+gboolean
+_tp_contact_attributes_cache_update (TpContactAttributesCache *self,
+    const gchar *identifier,
+    GHashTable *asv,
+    guint features)
+{
+  GVariant *old_entry = cache_lookup_entry (self, identifier);
+  GVariant *old_attributes = NULL;
+  GVariant *new_attributes;
+  GVariant *attributes;
+  /* borrowed key => owned value */
+  GHashTable *merged = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) g_variant_unref);
+  guint old_features = 0;
+  gboolean changed;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  new_attributes = _tp_asv_to_vardict (asv);
+
+  if (old_entry != NULL)
+    {
+      g_variant_get (old_entry, "(u@a{sv})", &old_features, &old_attributes);
+
+      /* if the new attributes only cover some of the features we had,
+       * keep the old attributes that they don't replace */
+      if ((features & old_features) != old_features)
+        {
+          g_variant_iter_init (&iter, old_attributes);
+
+          while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+            g_hash_table_insert (merged, (gchar *) key, value);
+        }
+    }
+
+  g_variant_iter_init (&iter, new_attributes);
+
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    g_hash_table_insert (merged, (gchar *) key, value);
+
+  /* the keys are borrowed from old_attributes and new_attributes, which
+   * are still alive */
+  attributes = build_sorted_vardict (merged);
+  features |= old_features;
+
+  changed = (old_entry == NULL || features != old_features ||
+      !g_variant_equal (attributes, old_attributes));
+
+  if (changed)
+    {
+      g_hash_table_replace (self->changed, g_strdup (identifier),
+          g_variant_ref_sink (g_variant_new ("(u@a{sv})", features,
+              attributes)));
+      cache_schedule_save (self);
+    }
+
+  g_hash_table_unref (merged);
+  g_variant_unref (attributes);
+  g_variant_unref (new_attributes);
+  tp_clear_pointer (&old_attributes, g_variant_unref);
+  tp_clear_pointer (&old_entry, g_variant_unref);
+  return changed;
+}
+
+/* Returns: %TRUE if the attributes on disk are now up to date */
+static gboolean
+cache_save_entries (TpContactAttributesCache *self)
+{
+  gboolean ret = FALSE;
+  GHashTable *all;
+  GHashTableIter changed_iter;
+  gpointer k, v;
+  GVariantBuilder builder;
+  GVariant *top;
+  GList *keys, *l;
+  guint n_entries;
+  gchar *dir;
+  GError *error = NULL;
+
+  if (g_hash_table_size (self->changed) == 0)
+    return TRUE;
+
+  /* owned identifier => owned (ua{sv}) */
+  all = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_variant_unref);
+
+  if (self->entries != NULL)
+    {
+      GVariantIter iter;
+      gchar *key;
+      GVariant *entry;
+
+      g_variant_iter_init (&iter, self->entries);
+
+      while (g_variant_iter_next (&iter, "{s@" ENTRY_TYPE "}", &key, &entry))
+        g_hash_table_insert (all, key, entry);
+    }
+
+  g_hash_table_iter_init (&changed_iter, self->changed);
+
+  while (g_hash_table_iter_next (&changed_iter, &k, &v))
+    g_hash_table_replace (all, g_strdup (k), g_variant_ref (v));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s" ENTRY_TYPE "}"));
+  keys = g_list_sort (g_hash_table_get_keys (all), compare_strings);
+
+  for (l = keys; l != NULL; l = l->next)
+    g_variant_builder_add (&builder, "{s@" ENTRY_TYPE "}", l->data,
+        g_hash_table_lookup (all, l->data));
+
+  n_entries = g_hash_table_size (all);
+  g_list_free (keys);
+  top = g_variant_ref_sink (g_variant_new ("(u@a{s" ENTRY_TYPE "})",
+        CACHE_FORMAT_VERSION, g_variant_builder_end (&builder)));
+  g_hash_table_unref (all);
+
+  dir = g_path_get_dirname (self->filename);
+
+  if (g_mkdir_with_parents (dir, 0700) == -1)
+    {
+      DEBUG ("Error creating contact attributes cache dir: %s",
+          g_strerror (errno));
+    }
+  else if (!g_file_set_contents (self->filename, g_variant_get_data (top),
+        g_variant_get_size (top), &error))
+    {
+      DEBUG ("Error writing %s: %s", self->filename, error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      DEBUG ("saved %u contacts to %s", n_entries, self->filename);
+      ret = TRUE;
+    }
+
+  g_free (dir);
+
+  /* from now on, look things up in what we just wrote */
+  tp_clear_pointer (&self->entries, g_variant_unref);
+  self->entries = g_variant_get_child_value (top, 1);
+  g_hash_table_remove_all (self->changed);
+  g_variant_unref (top);
+  return ret;
+}
+
+/*
+ * _tp_contact_attributes_cache_save:
+ * @self: a cache
+ *
+ * Write any changes to disk now.
+ */
+void
+_tp_contact_attributes_cache_save (TpContactAttributesCache *self)
+{
+  GError *error = NULL;
+
+  if (!cache_save_entries (self))
+    {
+      /* the version on disk, if any, was already removed; don't write one
+       * that would not match the attributes */
+      self->roster_version_changed = FALSE;
+      return;
+    }
+
+  if (!self->roster_version_changed)
+    return;
+
+  if (!g_file_set_contents (self->roster_version_filename,
+        self->roster_version, -1, &error))
+    {
+      DEBUG ("Error writing %s: %s", self->roster_version_filename,
+          error->message);
+      g_clear_error (&error);
+    }
+
+  self->roster_version_changed = FALSE;
+}
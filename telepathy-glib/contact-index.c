@@ -0,0 +1,632 @@
+/*
+ * A typeahead search index over a connection's contact list
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:contact-index
+ * @title: TpContactIndex
+ * @short_description: search a connection's contact list as the user types
+ * @see_also: tp_connection_dup_contact_list()
+ *
+ * A #TpContactIndex keeps the contacts returned by
+ * tp_connection_dup_contact_list() sorted by every word of their aliases
+ * and identifiers, so that tp_contact_index_search() can find the contacts
+ * matching what the user has typed so far without looking at every
+ * contact. It follows #TpConnection::contact-list-changed and the
+ * #TpContact:alias of each contact, so it never needs to be rebuilt.
+ *
+ * Matching ignores case and accents: "ger" finds a contact whose alias is
+ * "Géraldine".
+ *
+ * For the index to be populated, %TP_CONNECTION_FEATURE_CONTACT_LIST must be
+ * prepared on the connection; for aliases to be searched,
+ * %TP_CONTACT_FEATURE_ALIAS should be added to the connection's factory with
+ * tp_simple_client_factory_add_contact_features(). Otherwise, contacts are
+ * only found by their identifiers.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpContactIndex:
+ *
+ * Data structure representing a search index over a contact list.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpContactIndexClass:
+ *
+ * The class of a #TpContactIndex.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/contact-index.h"
+
+#include <string.h>
+
+#include <telepathy-glib/contact.h>
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CONTACTS
+#include "telepathy-glib/debug-internal.h"
+
+struct _TpContactIndexClass {
+    /*<private>*/
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (TpContactIndex, tp_contact_index, G_TYPE_OBJECT)
+
+enum {
+    PROP_CONNECTION = 1,
+    N_PROPS
+};
+
+/* How good a match is, best first */
+typedef enum {
+    RANK_ALIAS_START,
+    RANK_ALIAS_WORD,
+    RANK_IDENTIFIER_START,
+    RANK_IDENTIFIER_WORD
+} Rank;
+
+/* One contact in the index */
+typedef struct {
+    /* owned */
+    TpContact *contact;
+    gulong alias_changed_id;
+    /* owned, folded with fold_for_search() */
+    gchar *alias;
+    gchar *identifier;
+    /* borrowed GSequenceIter pointing to each of our IndexKeys */
+    GPtrArray *keys;
+} IndexedContact;
+
+/* A place where a word starts in @contact's alias or identifier */
+typedef struct {
+    /* borrowed from @contact->alias or @contact->identifier: the rest of
+     * the string, starting at the word */
+    const gchar *key;
+    Rank rank;
+    /* borrowed */
+    IndexedContact *contact;
+} IndexKey;
+
+struct _TpContactIndexPrivate
+{
+  TpConnection *connection;
+  gulong contact_list_changed_id;
+
+  /* borrowed TpContact => owned IndexedContact */
+  GHashTable *contacts;
+  /* owned IndexKey, sorted by index_key_cmp() */
+  GSequence *keys;
+};
+
+/* Returns a copy of @s that is case-folded and has had its accents
+ * removed, so that both the indexed strings and the query can be compared
+ * with strcmp() */
+static gchar *
+fold_for_search (const gchar *s)
+{
+  gchar *folded = g_utf8_casefold (s, -1);
+  gchar *decomposed = g_utf8_normalize (folded, -1, G_NORMALIZE_ALL);
+  GString *ret;
+  const gchar *p;
+
+  /* only fails on invalid UTF-8, which we just search as-is */
+  if (decomposed == NULL)
+    return folded;
+
+  ret = g_string_sized_new (strlen (decomposed));
+
+  for (p = decomposed; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+
+      if (!g_unichar_ismark (c))
+        g_string_append_unichar (ret, c);
+    }
+
+  g_free (decomposed);
+  g_free (folded);
+  return g_string_free (ret, FALSE);
+}
+
+static gint
+index_key_cmp (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  const IndexKey *left = a;
+  const IndexKey *right = b;
+  gint ret = strcmp (left->key, right->key);
+
+  if (ret != 0)
+    return ret;
+
+  if (left->rank != right->rank)
+    return (left->rank < right->rank ? -1 : 1);
+
+  /* a probe with contact == NULL sorts before every real key */
+  if (left->contact != right->contact)
+    return (left->contact < right->contact ? -1 : 1);
+
+  return 0;
+}
+
+static void
+index_key_free (gpointer p)
+{
+  g_slice_free (IndexKey, p);
+}
+
+static void
+add_keys (TpContactIndex *self,
+    IndexedContact *ic,
+    const gchar *folded,
+    Rank start_rank,
+    Rank word_rank)
+{
+  gboolean in_word = FALSE;
+  const gchar *p;
+
+  for (p = folded; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      gboolean is_word = g_unichar_isalnum (g_utf8_get_char (p));
+
+      if (is_word && !in_word)
+        {
+          IndexKey *key = g_slice_new (IndexKey);
+
+          key->key = p;
+          key->rank = (p == folded ? start_rank : word_rank);
+          key->contact = ic;
+          g_ptr_array_add (ic->keys, g_sequence_insert_sorted (self->priv->keys,
+                key, index_key_cmp, NULL));
+        }
+
+      in_word = is_word;
+    }
+
+  /* a string that starts with punctuation can still be found by typing
+   * it from the beginning */
+  if (*folded != '\0' && !g_unichar_isalnum (g_utf8_get_char (folded)))
+    {
+      IndexKey *key = g_slice_new (IndexKey);
+
+      key->key = folded;
+      key->rank = start_rank;
+      key->contact = ic;
+      g_ptr_array_add (ic->keys, g_sequence_insert_sorted (self->priv->keys,
+            key, index_key_cmp, NULL));
+    }
+}
+
+static void
+indexed_contact_remove_keys (IndexedContact *ic)
+{
+  guint i;
+
+  for (i = 0; i < ic->keys->len; i++)
+    g_sequence_remove (g_ptr_array_index (ic->keys, i));
+
+  g_ptr_array_set_size (ic->keys, 0);
+}
+
+static void
+indexed_contact_update_keys (TpContactIndex *self,
+    IndexedContact *ic)
+{
+  const gchar *alias = tp_contact_get_alias (ic->contact);
+
+  indexed_contact_remove_keys (ic);
+  g_free (ic->alias);
+  g_free (ic->identifier);
+
+  ic->alias = fold_for_search (alias != NULL ? alias : "");
+  ic->identifier = fold_for_search (tp_contact_get_identifier (ic->contact));
+
+  add_keys (self, ic, ic->alias, RANK_ALIAS_START, RANK_ALIAS_WORD);
+
+  /* the alias defaults to the identifier, which we don't need twice */
+  if (tp_strdiff (ic->alias, ic->identifier))
+    add_keys (self, ic, ic->identifier, RANK_IDENTIFIER_START,
+        RANK_IDENTIFIER_WORD);
+}
+
+static void
+indexed_contact_free (gpointer p)
+{
+  IndexedContact *ic = p;
+
+  indexed_contact_remove_keys (ic);
+  g_signal_handler_disconnect (ic->contact, ic->alias_changed_id);
+  g_object_unref (ic->contact);
+  g_ptr_array_unref (ic->keys);
+  g_free (ic->alias);
+  g_free (ic->identifier);
+  g_slice_free (IndexedContact, ic);
+}
+
+static void
+contact_alias_changed_cb (TpContact *contact,
+    GParamSpec *pspec G_GNUC_UNUSED,
+    gpointer user_data)
+{
+  TpContactIndex *self = user_data;
+  IndexedContact *ic = g_hash_table_lookup (self->priv->contacts, contact);
+
+  g_return_if_fail (ic != NULL);
+  indexed_contact_update_keys (self, ic);
+}
+
+static void
+tp_contact_index_add (TpContactIndex *self,
+    TpContact *contact)
+{
+  IndexedContact *ic;
+
+  if (g_hash_table_contains (self->priv->contacts, contact))
+    return;
+
+  ic = g_slice_new0 (IndexedContact);
+  ic->contact = g_object_ref (contact);
+  ic->keys = g_ptr_array_new ();
+  ic->alias_changed_id = g_signal_connect (contact, "notify::alias",
+      G_CALLBACK (contact_alias_changed_cb), self);
+  g_hash_table_insert (self->priv->contacts, contact, ic);
+
+  indexed_contact_update_keys (self, ic);
+}
+
+static void
+contact_list_changed_cb (TpConnection *connection,
+    GPtrArray *added,
+    GPtrArray *removed,
+    gpointer user_data)
+{
+  TpContactIndex *self = user_data;
+  guint i;
+
+  for (i = 0; i < removed->len; i++)
+    g_hash_table_remove (self->priv->contacts,
+        g_ptr_array_index (removed, i));
+
+  for (i = 0; i < added->len; i++)
+    tp_contact_index_add (self, g_ptr_array_index (added, i));
+}
+
+static void
+tp_contact_index_init (TpContactIndex *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      TP_TYPE_CONTACT_INDEX, TpContactIndexPrivate);
+
+  self->priv->keys = g_sequence_new (index_key_free);
+  self->priv->contacts = g_hash_table_new_full (NULL, NULL, NULL,
+      indexed_contact_free);
+}
+
+static void
+tp_contact_index_dispose (GObject *object)
+{
+  TpContactIndex *self = TP_CONTACT_INDEX (object);
+  void (*dispose) (GObject *) =
+    G_OBJECT_CLASS (tp_contact_index_parent_class)->dispose;
+
+  /* this drops the keys too */
+  g_hash_table_remove_all (self->priv->contacts);
+
+  if (self->priv->connection != NULL)
+    {
+      g_signal_handler_disconnect (self->priv->connection,
+          self->priv->contact_list_changed_id);
+      g_clear_object (&self->priv->connection);
+    }
+
+  if (dispose != NULL)
+    dispose (object);
+}
+
+static void
+tp_contact_index_finalize (GObject *object)
+{
+  TpContactIndex *self = TP_CONTACT_INDEX (object);
+  void (*finalize) (GObject *) =
+    G_OBJECT_CLASS (tp_contact_index_parent_class)->finalize;
+
+  g_hash_table_unref (self->priv->contacts);
+  g_sequence_free (self->priv->keys);
+
+  if (finalize != NULL)
+    finalize (object);
+}
+
+static void
+tp_contact_index_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpContactIndex *self = TP_CONTACT_INDEX (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_value_set_object (value, self->priv->connection);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_contact_index_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpContactIndex *self = TP_CONTACT_INDEX (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_assert (self->priv->connection == NULL); /* construct only */
+        self->priv->connection = g_value_dup_object (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_contact_index_constructed (GObject *object)
+{
+  TpContactIndex *self = TP_CONTACT_INDEX (object);
+  void (*chain_up) (GObject *) =
+    ((GObjectClass *) tp_contact_index_parent_class)->constructed;
+  GPtrArray *contacts;
+  guint i;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  g_assert (TP_IS_CONNECTION (self->priv->connection));
+
+  self->priv->contact_list_changed_id = g_signal_connect (
+      self->priv->connection, "contact-list-changed",
+      G_CALLBACK (contact_list_changed_cb), self);
+
+  /* whatever has already been retrieved */
+  contacts = tp_connection_dup_contact_list (self->priv->connection);
+
+  for (i = 0; i < contacts->len; i++)
+    tp_contact_index_add (self, g_ptr_array_index (contacts, i));
+
+  DEBUG ("indexed %u contacts with %u keys", contacts->len,
+      g_sequence_get_length (self->priv->keys));
+  g_ptr_array_unref (contacts);
+}
+
+static void
+tp_contact_index_class_init (TpContactIndexClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (cls, sizeof (TpContactIndexPrivate));
+
+  object_class->get_property = tp_contact_index_get_property;
+  object_class->set_property = tp_contact_index_set_property;
+  object_class->constructed = tp_contact_index_constructed;
+  object_class->dispose = tp_contact_index_dispose;
+  object_class->finalize = tp_contact_index_finalize;
+
+  /**
+   * TpContactIndex:connection:
+   *
+   * The #TpConnection whose contact list is indexed.
+   * Read-only except during construction.
+   *
+   * This property can't be %NULL.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_object ("connection", "TpConnection",
+      "TpConnection whose contact list is indexed",
+      TP_TYPE_CONNECTION,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONNECTION,
+      param_spec);
+}
+
+/**
+ * tp_contact_index_new:
+ * @connection: a #TpConnection
+ *
+ * Create an index over @connection's contact list. It contains the contacts
+ * that tp_connection_dup_contact_list() returns now, and is kept up to date
+ * from then on.
+ *
+ * Returns: (transfer full): a new #TpContactIndex
+ * Since: 0.UNRELEASED
+ */
+TpContactIndex *
+tp_contact_index_new (TpConnection *connection)
+{
+  g_return_val_if_fail (TP_IS_CONNECTION (connection), NULL);
+
+  return g_object_new (TP_TYPE_CONTACT_INDEX,
+      "connection", connection,
+      NULL);
+}
+
+/**
+ * tp_contact_index_get_connection:
+ * @self: a #TpContactIndex
+ *
+ * Return the #TpContactIndex:connection property.
+ *
+ * Returns: (transfer none): the value of #TpContactIndex:connection
+ * Since: 0.UNRELEASED
+ */
+TpConnection *
+tp_contact_index_get_connection (TpContactIndex *self)
+{
+  g_return_val_if_fail (TP_IS_CONTACT_INDEX (self), NULL);
+
+  return self->priv->connection;
+}
+
+/**
+ * tp_contact_index_get_n_contacts:
+ * @self: a #TpContactIndex
+ *
+ * <!-- -->
+ *
+ * Returns: the number of contacts in the index
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_contact_index_get_n_contacts (TpContactIndex *self)
+{
+  g_return_val_if_fail (TP_IS_CONTACT_INDEX (self), 0);
+
+  return g_hash_table_size (self->priv->contacts);
+}
+
+static gint
+match_cmp (gconstpointer a,
+    gconstpointer b)
+{
+  const IndexKey *left = *(IndexKey * const *) a;
+  const IndexKey *right = *(IndexKey * const *) b;
+  gint ret;
+
+  if (left->rank != right->rank)
+    return (left->rank < right->rank ? -1 : 1);
+
+  ret = strcmp (left->contact->alias, right->contact->alias);
+
+  if (ret != 0)
+    return ret;
+
+  return strcmp (left->contact->identifier, right->contact->identifier);
+}
+
+/**
+ * tp_contact_index_search:
+ * @self: a #TpContactIndex
+ * @query: what the user has typed so far
+ * @max_results: the most contacts to return, or 0 for no limit
+ *
+ * Find the contacts with a word in their alias or identifier that starts
+ * with @query, ignoring case and accents. @query may span several words:
+ * "john sm" finds "John Smith".
+ *
+ * Contacts whose aliases start with @query come first, followed by those
+ * with another word of their alias starting with @query, then by those
+ * matched by their identifier in the same way. Within each group, contacts
+ * are sorted by alias.
+ *
+ * Returns: (transfer container) (element-type TelepathyGLib.Contact): a new
+ *  #GPtrArray of matching #TpContact, which holds a reference to each one.
+ *  Use g_ptr_array_unref() when done.
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_contact_index_search (TpContactIndex *self,
+    const gchar *query,
+    guint max_results)
+{
+  GPtrArray *ret = g_ptr_array_new_with_free_func (g_object_unref);
+  /* borrowed IndexedContact => borrowed IndexKey, the best for it */
+  GHashTable *best;
+  GHashTableIter iter;
+  GPtrArray *matches;
+  GSequenceIter *it;
+  IndexKey probe = { NULL, RANK_ALIAS_START, NULL };
+  gchar *folded;
+  gpointer v;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_CONTACT_INDEX (self), ret);
+  g_return_val_if_fail (query != NULL, ret);
+
+  folded = fold_for_search (query);
+
+  if (*folded == '\0')
+    {
+      g_free (folded);
+      return ret;
+    }
+
+  /* The keys starting with @folded are consecutive, beginning at the
+   * first key that sorts after the probe */
+  probe.key = folded;
+  best = g_hash_table_new (NULL, NULL);
+
+  for (it = g_sequence_search (self->priv->keys, &probe, index_key_cmp,
+        NULL);
+      !g_sequence_iter_is_end (it);
+      it = g_sequence_iter_next (it))
+    {
+      IndexKey *key = g_sequence_get (it);
+      IndexKey *previous;
+
+      if (!g_str_has_prefix (key->key, folded))
+        break;
+
+      previous = g_hash_table_lookup (best, key->contact);
+
+      if (previous == NULL || key->rank < previous->rank)
+        g_hash_table_insert (best, key->contact, key);
+    }
+
+  matches = g_ptr_array_sized_new (g_hash_table_size (best));
+  g_hash_table_iter_init (&iter, best);
+
+  while (g_hash_table_iter_next (&iter, NULL, &v))
+    g_ptr_array_add (matches, v);
+
+  g_ptr_array_sort (matches, match_cmp);
+
+  for (i = 0; i < matches->len; i++)
+    {
+      IndexKey *key = g_ptr_array_index (matches, i);
+
+      if (max_results != 0 && i >= max_results)
+        break;
+
+      g_ptr_array_add (ret, g_object_ref (key->contact->contact));
+    }
+
+  g_ptr_array_unref (matches);
+  g_hash_table_unref (best);
+  g_free (folded);
+  return ret;
+}
@@ -0,0 +1,80 @@
+/*
+ * A typeahead search index over a connection's contact list
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if defined (TP_DISABLE_SINGLE_INCLUDE) && !defined (_TP_IN_META_HEADER) && !defined (_TP_COMPILATION)
+#error "Only <telepathy-glib/telepathy-glib.h> and <telepathy-glib/telepathy-glib-dbus.h> can be included directly."
+#endif
+
+#ifndef __TP_CONTACT_INDEX_H__
+#define __TP_CONTACT_INDEX_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/defs.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpContactIndex TpContactIndex;
+typedef struct _TpContactIndexClass TpContactIndexClass;
+typedef struct _TpContactIndexPrivate TpContactIndexPrivate;
+
+struct _TpContactIndex {
+  /*<private>*/
+  GObject parent;
+  TpContactIndexPrivate *priv;
+};
+
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_contact_index_get_type (void);
+
+#define TP_TYPE_CONTACT_INDEX \
+  (tp_contact_index_get_type ())
+#define TP_CONTACT_INDEX(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TYPE_CONTACT_INDEX, \
+                               TpContactIndex))
+#define TP_CONTACT_INDEX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TYPE_CONTACT_INDEX, \
+                            TpContactIndexClass))
+#define TP_IS_CONTACT_INDEX(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TYPE_CONTACT_INDEX))
+#define TP_IS_CONTACT_INDEX_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TYPE_CONTACT_INDEX))
+#define TP_CONTACT_INDEX_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TYPE_CONTACT_INDEX, \
+                              TpContactIndexClass))
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpContactIndex *tp_contact_index_new (TpConnection *connection);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpConnection *tp_contact_index_get_connection (TpContactIndex *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_contact_index_get_n_contacts (TpContactIndex *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_contact_index_search (TpContactIndex *self,
+    const gchar *query,
+    guint max_results) G_GNUC_WARN_UNUSED_RESULT;
+
+G_END_DECLS
+
+#endif
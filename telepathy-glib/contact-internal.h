@@ -35,6 +35,10 @@ gboolean _tp_contact_set_attributes (TpContact *contact,
     const TpContactFeature *features,
     GError **error);
 
+gboolean _tp_contact_set_attributes_from_cache (TpContact *contact,
+    guint n_features,
+    const TpContactFeature *features);
+
 const gchar **_tp_contacts_bind_to_signals (TpConnection *connection,
     guint n_features,
     const TpContactFeature *features);
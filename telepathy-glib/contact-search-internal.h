@@ -30,8 +30,9 @@ G_BEGIN_DECLS
 
 TpContactSearchResult *_tp_contact_search_result_new (const gchar *identifier);
 
-void _tp_contact_search_result_insert_field (TpContactSearchResult *self,
-    TpContactInfoField *field);
+void _tp_contact_search_result_set_raw_fields (TpContactSearchResult *self,
+    GHashTable *reply,
+    GPtrArray *raw_fields);
 
 G_END_DECLS
 
@@ -70,8 +70,13 @@ G_DEFINE_TYPE (TpContactSearchResult,
 struct _TpContactSearchResultPrivate
 {
   gchar *identifier;
-  /* List of TpContactInfoField. The list and its contents are owned by us. */
+  /* List of TpContactInfoField. The list and its contents are owned by us.
+   * Built from raw_fields when first needed. */
   GList *fields;
+  /* The SearchResultReceived payload this result came from, reffed, and
+   * our a(sasas) within it, borrowed; both %NULL once fields is built */
+  GHashTable *reply;
+  GPtrArray *raw_fields;
 };
 
 enum /* properties */
@@ -138,6 +143,8 @@ tp_contact_search_result_dispose (GObject *object)
   tp_clear_pointer (&self->priv->identifier, g_free);
 
   tp_clear_pointer (&self->priv->fields, tp_contact_info_list_free);
+  self->priv->raw_fields = NULL;
+  tp_clear_pointer (&self->priv->reply, g_hash_table_unref);
 
   G_OBJECT_CLASS (tp_contact_search_result_parent_class)->dispose (object);
 }
@@ -188,13 +195,57 @@ _tp_contact_search_result_new (const gchar *identifier)
       NULL);
 }
 
+/*
+ * _tp_contact_search_result_set_raw_fields:
+ * @self: a new search result
+ * @reply: the map from identifiers to Contact_Info_Field lists, as received
+ *  in SearchResultsReceived; a reference is taken
+ * @raw_fields: the value in @reply for @self's identifier
+ *
+ * Remember where @self's fields are, without decoding them. Most
+ * applications only look at a few of a large number of results, so the
+ * #TpContactInfoField list is only built when one of the accessors needs
+ * it.
+ */
 void
-_tp_contact_search_result_insert_field (TpContactSearchResult *self,
-    TpContactInfoField *field)
+_tp_contact_search_result_set_raw_fields (TpContactSearchResult *self,
+    GHashTable *reply,
+    GPtrArray *raw_fields)
 {
   g_return_if_fail (TP_IS_CONTACT_SEARCH_RESULT (self));
+  g_return_if_fail (self->priv->fields == NULL);
+  g_return_if_fail (self->priv->reply == NULL);
+
+  self->priv->reply = g_hash_table_ref (reply);
+  self->priv->raw_fields = raw_fields;
+}
+
+static void
+ensure_fields (TpContactSearchResult *self)
+{
+  GPtrArray *info = self->priv->raw_fields;
+  guint i;
+
+  if (self->priv->reply == NULL)
+    return;
+
+  /* fields have always been listed in the opposite order to the D-Bus
+   * message, so keep doing that */
+  for (i = 0; i < info->len; i++)
+    {
+      const gchar *field;
+      gchar **parameters;
+      gchar **values;
+
+      tp_value_array_unpack (g_ptr_array_index (info, i), 3,
+          &field, &parameters, &values);
+
+      self->priv->fields = g_list_prepend (self->priv->fields,
+          tp_contact_info_field_new (field, parameters, values));
+    }
 
-  self->priv->fields = g_list_append (self->priv->fields, field);
+  self->priv->raw_fields = NULL;
+  tp_clear_pointer (&self->priv->reply, g_hash_table_unref);
 }
 
 /**
@@ -235,6 +286,7 @@ tp_contact_search_result_get_field (TpContactSearchResult *self,
 
   g_return_val_if_fail (TP_IS_CONTACT_SEARCH_RESULT (self), NULL);
 
+  ensure_fields (self);
   l = g_list_find_custom (self->priv->fields,
       field,
       find_tp_contact_info_field);
@@ -259,6 +311,7 @@ tp_contact_search_result_get_fields (TpContactSearchResult *self)
 {
   g_return_val_if_fail (TP_IS_CONTACT_SEARCH_RESULT (self), NULL);
 
+  ensure_fields (self);
   return g_list_copy (self->priv->fields);
 }
 
@@ -278,6 +331,7 @@ tp_contact_search_result_dup_fields (TpContactSearchResult *self)
 {
   g_return_val_if_fail (TP_IS_CONTACT_SEARCH_RESULT (self), NULL);
 
+  ensure_fields (self);
   return _tp_g_list_copy_deep (self->priv->fields,
       (GCopyFunc) tp_contact_info_field_copy, NULL);
 }
@@ -162,22 +162,10 @@ _search_results_received (TpChannel *channel,
   while (g_hash_table_iter_next (&iter, (gpointer) &contact, (gpointer) &info))
     {
       TpContactSearchResult *search_result;
-      char *field;
-      char **parameters;
-      char **values;
-      gint i;
 
+      /* the fields are only decoded if someone asks for them */
       search_result = _tp_contact_search_result_new (contact);
-
-      for (i = info->len - 1; i >= 0; i--)
-        {
-          TpContactInfoField *contact_field;
-          tp_value_array_unpack (g_ptr_array_index (info, i), 3,
-              &field, &parameters, &values);
-
-          contact_field = tp_contact_info_field_new (field, parameters, values);
-          _tp_contact_search_result_insert_field (search_result, contact_field);
-        }
+      _tp_contact_search_result_set_raw_fields (search_result, result, info);
       results = g_list_prepend (results, search_result);
     }
 
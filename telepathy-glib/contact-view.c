@@ -0,0 +1,785 @@
+/*
+ * A sorted, filtered view of a connection's contact list
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:contact-view
+ * @title: TpContactView
+ * @short_description: a connection's contact list, sorted and filtered
+ * @see_also: tp_connection_dup_contact_list(),
+ *  tp_connection_set_contact_notification_batching()
+ *
+ * A #TpContactView keeps the contacts returned by
+ * tp_connection_dup_contact_list() that pass a filter, sorted by a
+ * comparison function, both provided by the caller. When contacts are
+ * added to or removed from the contact list, or change in a way that may
+ * affect the filter or the sort order, the view only moves the contacts
+ * that have changed, and reports each change with one of the
+ * #TpContactView::contact-inserted, #TpContactView::contact-removed and
+ * #TpContactView::contact-moved signals. A user interface can apply these
+ * to its own list of rows, instead of sorting the whole roster again.
+ *
+ * If tp_connection_set_contact_notification_batching() has been used,
+ * the view is updated from #TpConnection::contacts-changed, so a change
+ * to k of the n contacts in the view costs O(k log n) calls to the
+ * comparison function, however many properties of each contact changed.
+ * Otherwise, it is updated from the #GObject::notify signals of each
+ * contact.
+ *
+ * For the view to be populated, %TP_CONNECTION_FEATURE_CONTACT_LIST must be
+ * prepared on the connection, and the features that the filter and the
+ * comparison function rely on should be added to the connection's factory
+ * with tp_simple_client_factory_add_contact_features().
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpContactView:
+ *
+ * Data structure representing a sorted, filtered view of a contact list.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpContactViewClass:
+ *
+ * The class of a #TpContactView.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpContactViewFilterFunc:
+ * @contact: a #TpContact on the contact list
+ * @user_data: the user data passed to tp_contact_view_new()
+ *
+ * Signature of a function deciding whether @contact is shown by a
+ * #TpContactView. It must only depend on the properties of @contact.
+ *
+ * Returns: %TRUE if @contact should be in the view
+ * Since: 0.UNRELEASED
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/contact-view.h"
+
+#include <telepathy-glib/util.h>
+
+#include "telepathy-glib/connection-internal.h"
+
+#define DEBUG_FLAG TP_DEBUG_CONTACTS
+#include "telepathy-glib/debug-internal.h"
+
+struct _TpContactViewClass {
+    /*<private>*/
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (TpContactView, tp_contact_view, G_TYPE_OBJECT)
+
+enum {
+    PROP_CONNECTION = 1,
+    N_PROPS
+};
+
+enum {
+    SIGNAL_CONTACT_INSERTED,
+    SIGNAL_CONTACT_REMOVED,
+    SIGNAL_CONTACT_MOVED,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = { 0 };
+
+/* One contact on the contact list, whether it passes the filter or not */
+typedef struct {
+    /* owned */
+    TpContact *contact;
+    gulong notify_id;
+    /* borrowed; NULL if @contact does not pass the filter */
+    GSequenceIter *iter;
+    /* TRUE while @contact is waiting to be moved as part of a batch of
+     * changes, so its position may be wrong */
+    gboolean dirty;
+} ViewedContact;
+
+struct _TpContactViewPrivate
+{
+  TpConnection *connection;
+  gulong contact_list_changed_id;
+  gulong contacts_changed_id;
+
+  GCompareDataFunc sort_func;
+  TpContactViewFilterFunc filter_func;
+  gpointer user_data;
+  GDestroyNotify destroy;
+
+  /* borrowed TpContact => owned ViewedContact */
+  GHashTable *contacts;
+  /* borrowed ViewedContact, sorted by viewed_contact_cmp() except for
+   * those which are dirty */
+  GSequence *view;
+};
+
+static gint
+viewed_contact_cmp (TpContactView *self,
+    const ViewedContact *left,
+    const ViewedContact *right)
+{
+  gint ret = self->priv->sort_func (left->contact, right->contact,
+      self->priv->user_data);
+
+  if (ret != 0)
+    return ret;
+
+  /* contacts that compare equal are kept in a consistent order, so that
+   * the view is the same however it was reached */
+  if (left->contact != right->contact)
+    return (left->contact < right->contact ? -1 : 1);
+
+  return 0;
+}
+
+static gint
+viewed_contact_sequence_cmp (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data)
+{
+  return viewed_contact_cmp (user_data, a, b);
+}
+
+static gboolean
+viewed_contact_passes (TpContactView *self,
+    ViewedContact *vc)
+{
+  if (self->priv->filter_func == NULL)
+    return TRUE;
+
+  return self->priv->filter_func (vc->contact, self->priv->user_data);
+}
+
+/* Returns the place where @vc, which is not in the view, should be
+ * inserted. The dirty contacts are skipped: they will be moved later, so
+ * only the contacts which are not dirty have to stay in order. */
+static GSequenceIter *
+find_insert_position (TpContactView *self,
+    ViewedContact *vc)
+{
+  /* every clean contact before @begin sorts before @vc, and every clean
+   * contact from @end onwards sorts after it */
+  GSequenceIter *begin = g_sequence_get_begin_iter (self->priv->view);
+  GSequenceIter *end = g_sequence_get_end_iter (self->priv->view);
+
+  while (begin != end)
+    {
+      GSequenceIter *mid = g_sequence_range_get_midpoint (begin, end);
+      GSequenceIter *probe = mid;
+      ViewedContact *other = NULL;
+
+      while (probe != end)
+        {
+          other = g_sequence_get (probe);
+
+          if (!other->dirty)
+            break;
+
+          probe = g_sequence_iter_next (probe);
+        }
+
+      /* if everything from @mid to @end is dirty, the answer is at or
+       * before @mid */
+      if (probe == end || viewed_contact_cmp (self, vc, other) < 0)
+        end = mid;
+      else
+        begin = g_sequence_iter_next (probe);
+    }
+
+  return begin;
+}
+
+static void
+tp_contact_view_insert (TpContactView *self,
+    ViewedContact *vc)
+{
+  vc->iter = g_sequence_insert_before (find_insert_position (self, vc), vc);
+  g_signal_emit (self, signals[SIGNAL_CONTACT_INSERTED], 0, vc->contact,
+      (guint) g_sequence_iter_get_position (vc->iter));
+}
+
+static void
+tp_contact_view_remove (TpContactView *self,
+    ViewedContact *vc)
+{
+  guint position = g_sequence_iter_get_position (vc->iter);
+
+  g_sequence_remove (vc->iter);
+  vc->iter = NULL;
+  g_signal_emit (self, signals[SIGNAL_CONTACT_REMOVED], 0, vc->contact,
+      position);
+}
+
+/* Put @vc back where it belongs after it has changed */
+static void
+tp_contact_view_update (TpContactView *self,
+    ViewedContact *vc)
+{
+  gboolean passes = viewed_contact_passes (self, vc);
+  guint old_position, new_position;
+
+  if (vc->iter == NULL)
+    {
+      if (passes)
+        tp_contact_view_insert (self, vc);
+
+      return;
+    }
+
+  if (!passes)
+    {
+      vc->dirty = FALSE;
+      tp_contact_view_remove (self, vc);
+      return;
+    }
+
+  old_position = g_sequence_iter_get_position (vc->iter);
+  g_sequence_remove (vc->iter);
+  vc->dirty = FALSE;
+  vc->iter = g_sequence_insert_before (find_insert_position (self, vc), vc);
+  new_position = g_sequence_iter_get_position (vc->iter);
+
+  if (old_position != new_position)
+    g_signal_emit (self, signals[SIGNAL_CONTACT_MOVED], 0, vc->contact,
+        old_position, new_position);
+}
+
+static void
+viewed_contact_free (gpointer p)
+{
+  ViewedContact *vc = p;
+
+  /* the view itself is emptied by the caller */
+  g_signal_handler_disconnect (vc->contact, vc->notify_id);
+  g_object_unref (vc->contact);
+  g_slice_free (ViewedContact, vc);
+}
+
+static void
+contact_notify_cb (TpContact *contact,
+    GParamSpec *pspec G_GNUC_UNUSED,
+    gpointer user_data)
+{
+  TpContactView *self = user_data;
+  ViewedContact *vc = g_hash_table_lookup (self->priv->contacts, contact);
+
+  g_return_if_fail (vc != NULL);
+
+  /* this contact is in the next TpConnection::contacts-changed too */
+  if (self->priv->connection->priv->batch_contact_notifications)
+    return;
+
+  tp_contact_view_update (self, vc);
+}
+
+static void
+contacts_changed_cb (TpConnection *connection,
+    GPtrArray *contacts,
+    TpContactFeature feature G_GNUC_UNUSED,
+    gpointer user_data)
+{
+  TpContactView *self = user_data;
+  GPtrArray *changed = g_ptr_array_sized_new (contacts->len);
+  guint i;
+
+  /* None of the changed contacts can be used to find where the others go
+   * until it has been moved itself, so they are all marked first */
+  for (i = 0; i < contacts->len; i++)
+    {
+      ViewedContact *vc = g_hash_table_lookup (self->priv->contacts,
+          g_ptr_array_index (contacts, i));
+
+      /* not on the contact list */
+      if (vc == NULL)
+        continue;
+
+      if (vc->iter != NULL)
+        vc->dirty = TRUE;
+
+      g_ptr_array_add (changed, vc);
+    }
+
+  for (i = 0; i < changed->len; i++)
+    tp_contact_view_update (self, g_ptr_array_index (changed, i));
+
+  g_ptr_array_unref (changed);
+}
+
+static void
+tp_contact_view_add (TpContactView *self,
+    TpContact *contact,
+    gboolean emit)
+{
+  ViewedContact *vc;
+
+  if (g_hash_table_contains (self->priv->contacts, contact))
+    return;
+
+  vc = g_slice_new0 (ViewedContact);
+  vc->contact = g_object_ref (contact);
+  vc->notify_id = g_signal_connect (contact, "notify",
+      G_CALLBACK (contact_notify_cb), self);
+  g_hash_table_insert (self->priv->contacts, contact, vc);
+
+  if (!viewed_contact_passes (self, vc))
+    return;
+
+  if (emit)
+    tp_contact_view_insert (self, vc);
+  else
+    vc->iter = g_sequence_append (self->priv->view, vc);
+}
+
+static void
+contact_list_changed_cb (TpConnection *connection,
+    GPtrArray *added,
+    GPtrArray *removed,
+    gpointer user_data)
+{
+  TpContactView *self = user_data;
+  guint i;
+
+  for (i = 0; i < removed->len; i++)
+    {
+      ViewedContact *vc = g_hash_table_lookup (self->priv->contacts,
+          g_ptr_array_index (removed, i));
+
+      if (vc == NULL)
+        continue;
+
+      if (vc->iter != NULL)
+        tp_contact_view_remove (self, vc);
+
+      g_hash_table_remove (self->priv->contacts, vc->contact);
+    }
+
+  for (i = 0; i < added->len; i++)
+    tp_contact_view_add (self, g_ptr_array_index (added, i), TRUE);
+}
+
+static gint
+identifier_cmp (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  return g_strcmp0 (tp_contact_get_identifier ((TpContact *) a),
+      tp_contact_get_identifier ((TpContact *) b));
+}
+
+static void
+tp_contact_view_init (TpContactView *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      TP_TYPE_CONTACT_VIEW, TpContactViewPrivate);
+
+  self->priv->sort_func = identifier_cmp;
+  self->priv->view = g_sequence_new (NULL);
+  self->priv->contacts = g_hash_table_new_full (NULL, NULL, NULL,
+      viewed_contact_free);
+}
+
+static void
+tp_contact_view_dispose (GObject *object)
+{
+  TpContactView *self = TP_CONTACT_VIEW (object);
+  void (*dispose) (GObject *) =
+    G_OBJECT_CLASS (tp_contact_view_parent_class)->dispose;
+
+  g_sequence_remove_range (g_sequence_get_begin_iter (self->priv->view),
+      g_sequence_get_end_iter (self->priv->view));
+  g_hash_table_remove_all (self->priv->contacts);
+
+  if (self->priv->connection != NULL)
+    {
+      g_signal_handler_disconnect (self->priv->connection,
+          self->priv->contact_list_changed_id);
+      g_signal_handler_disconnect (self->priv->connection,
+          self->priv->contacts_changed_id);
+      g_clear_object (&self->priv->connection);
+    }
+
+  if (self->priv->destroy != NULL)
+    {
+      GDestroyNotify destroy = self->priv->destroy;
+
+      self->priv->destroy = NULL;
+      destroy (self->priv->user_data);
+    }
+
+  if (dispose != NULL)
+    dispose (object);
+}
+
+static void
+tp_contact_view_finalize (GObject *object)
+{
+  TpContactView *self = TP_CONTACT_VIEW (object);
+  void (*finalize) (GObject *) =
+    G_OBJECT_CLASS (tp_contact_view_parent_class)->finalize;
+
+  g_hash_table_unref (self->priv->contacts);
+  g_sequence_free (self->priv->view);
+
+  if (finalize != NULL)
+    finalize (object);
+}
+
+static void
+tp_contact_view_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpContactView *self = TP_CONTACT_VIEW (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_value_set_object (value, self->priv->connection);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_contact_view_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpContactView *self = TP_CONTACT_VIEW (object);
+
+  switch (property_id)
+    {
+      case PROP_CONNECTION:
+        g_assert (self->priv->connection == NULL); /* construct only */
+        self->priv->connection = g_value_dup_object (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_contact_view_constructed (GObject *object)
+{
+  TpContactView *self = TP_CONTACT_VIEW (object);
+  void (*chain_up) (GObject *) =
+    ((GObjectClass *) tp_contact_view_parent_class)->constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  g_assert (TP_IS_CONNECTION (self->priv->connection));
+
+  self->priv->contact_list_changed_id = g_signal_connect (
+      self->priv->connection, "contact-list-changed",
+      G_CALLBACK (contact_list_changed_cb), self);
+  self->priv->contacts_changed_id = g_signal_connect (
+      self->priv->connection, "contacts-changed",
+      G_CALLBACK (contacts_changed_cb), self);
+}
+
+static void
+tp_contact_view_class_init (TpContactViewClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (cls, sizeof (TpContactViewPrivate));
+
+  object_class->get_property = tp_contact_view_get_property;
+  object_class->set_property = tp_contact_view_set_property;
+  object_class->constructed = tp_contact_view_constructed;
+  object_class->dispose = tp_contact_view_dispose;
+  object_class->finalize = tp_contact_view_finalize;
+
+  /**
+   * TpContactView:connection:
+   *
+   * The #TpConnection whose contact list is viewed.
+   * Read-only except during construction.
+   *
+   * This property can't be %NULL.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_object ("connection", "TpConnection",
+      "TpConnection whose contact list is viewed",
+      TP_TYPE_CONNECTION,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONNECTION,
+      param_spec);
+
+  /**
+   * TpContactView::contact-inserted:
+   * @self: a #TpContactView
+   * @contact: (type TelepathyGLib.Contact): the #TpContact that was inserted
+   * @position: the position of @contact in the view
+   *
+   * Emitted when @contact enters the view, because it was added to the
+   * contact list or now passes the filter. The contacts that were at
+   * @position or later have moved one place towards the end.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_CONTACT_INSERTED] = g_signal_new ("contact-inserted",
+      G_OBJECT_CLASS_TYPE (cls),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 2, TP_TYPE_CONTACT, G_TYPE_UINT);
+
+  /**
+   * TpContactView::contact-removed:
+   * @self: a #TpContactView
+   * @contact: (type TelepathyGLib.Contact): the #TpContact that was removed
+   * @position: the position @contact had in the view
+   *
+   * Emitted when @contact leaves the view, because it was removed from the
+   * contact list or no longer passes the filter. The contacts that were
+   * after @position have moved one place towards the start.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_CONTACT_REMOVED] = g_signal_new ("contact-removed",
+      G_OBJECT_CLASS_TYPE (cls),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 2, TP_TYPE_CONTACT, G_TYPE_UINT);
+
+  /**
+   * TpContactView::contact-moved:
+   * @self: a #TpContactView
+   * @contact: (type TelepathyGLib.Contact): the #TpContact that moved
+   * @old_position: the position @contact had in the view
+   * @new_position: the position of @contact in the view
+   *
+   * Emitted when a change to @contact has changed its place in the sort
+   * order. This is equivalent to @contact being removed from @old_position,
+   * then inserted at @new_position.
+   *
+   * Changes which do not move @contact are not signalled by the view.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIGNAL_CONTACT_MOVED] = g_signal_new ("contact-moved",
+      G_OBJECT_CLASS_TYPE (cls),
+      G_SIGNAL_RUN_LAST,
+      0,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 3, TP_TYPE_CONTACT, G_TYPE_UINT, G_TYPE_UINT);
+}
+
+/**
+ * tp_contact_view_new:
+ * @connection: a #TpConnection
+ * @sort_func: (allow-none): a function to compare two #TpContact, or %NULL
+ *  to sort contacts by their identifiers
+ * @filter_func: (allow-none): a function deciding which contacts are in
+ *  the view, or %NULL to include every contact
+ * @user_data: user data for @sort_func and @filter_func
+ * @destroy: (allow-none): called to free @user_data when the view is
+ *  disposed
+ *
+ * Create a view of @connection's contact list. It contains the contacts
+ * that tp_connection_dup_contact_list() returns now, and is kept up to date
+ * from then on.
+ *
+ * @sort_func and @filter_func must only depend on the properties of the
+ * contacts they are given, so that the view knows when to call them again.
+ *
+ * Returns: (transfer full): a new #TpContactView
+ * Since: 0.UNRELEASED
+ */
+TpContactView *
+tp_contact_view_new (TpConnection *connection,
+    GCompareDataFunc sort_func,
+    TpContactViewFilterFunc filter_func,
+    gpointer user_data,
+    GDestroyNotify destroy)
+{
+  TpContactView *self;
+  GPtrArray *contacts;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_CONNECTION (connection), NULL);
+
+  self = g_object_new (TP_TYPE_CONTACT_VIEW,
+      "connection", connection,
+      NULL);
+
+  if (sort_func != NULL)
+    self->priv->sort_func = sort_func;
+
+  self->priv->filter_func = filter_func;
+  self->priv->user_data = user_data;
+  self->priv->destroy = destroy;
+
+  /* whatever has already been retrieved; nobody is listening yet, so
+   * sort it all at once */
+  contacts = tp_connection_dup_contact_list (connection);
+
+  for (i = 0; i < contacts->len; i++)
+    tp_contact_view_add (self, g_ptr_array_index (contacts, i), FALSE);
+
+  g_sequence_sort (self->priv->view, viewed_contact_sequence_cmp, self);
+
+  DEBUG ("%u of %u contacts in view",
+      g_sequence_get_length (self->priv->view), contacts->len);
+  g_ptr_array_unref (contacts);
+  return self;
+}
+
+/**
+ * tp_contact_view_get_connection:
+ * @self: a #TpContactView
+ *
+ * Return the #TpContactView:connection property.
+ *
+ * Returns: (transfer none): the value of #TpContactView:connection
+ * Since: 0.UNRELEASED
+ */
+TpConnection *
+tp_contact_view_get_connection (TpContactView *self)
+{
+  g_return_val_if_fail (TP_IS_CONTACT_VIEW (self), NULL);
+
+  return self->priv->connection;
+}
+
+/**
+ * tp_contact_view_get_n_contacts:
+ * @self: a #TpContactView
+ *
+ * <!-- -->
+ *
+ * Returns: the number of contacts in the view
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_contact_view_get_n_contacts (TpContactView *self)
+{
+  g_return_val_if_fail (TP_IS_CONTACT_VIEW (self), 0);
+
+  return g_sequence_get_length (self->priv->view);
+}
+
+/**
+ * tp_contact_view_get_contact:
+ * @self: a #TpContactView
+ * @position: a position in the view, less than
+ *  tp_contact_view_get_n_contacts()
+ *
+ * <!-- -->
+ *
+ * Returns: (transfer none): the contact at @position
+ * Since: 0.UNRELEASED
+ */
+TpContact *
+tp_contact_view_get_contact (TpContactView *self,
+    guint position)
+{
+  ViewedContact *vc;
+
+  g_return_val_if_fail (TP_IS_CONTACT_VIEW (self), NULL);
+  g_return_val_if_fail (position < g_sequence_get_length (self->priv->view),
+      NULL);
+
+  vc = g_sequence_get (g_sequence_get_iter_at_pos (self->priv->view,
+        position));
+  return vc->contact;
+}
+
+/**
+ * tp_contact_view_get_position:
+ * @self: a #TpContactView
+ * @contact: a #TpContact
+ *
+ * <!-- -->
+ *
+ * Returns: the position of @contact in the view, or -1 if it is not in
+ *  the view
+ * Since: 0.UNRELEASED
+ */
+gint
+tp_contact_view_get_position (TpContactView *self,
+    TpContact *contact)
+{
+  ViewedContact *vc;
+
+  g_return_val_if_fail (TP_IS_CONTACT_VIEW (self), -1);
+  g_return_val_if_fail (TP_IS_CONTACT (contact), -1);
+
+  vc = g_hash_table_lookup (self->priv->contacts, contact);
+
+  if (vc == NULL || vc->iter == NULL)
+    return -1;
+
+  return g_sequence_iter_get_position (vc->iter);
+}
+
+/**
+ * tp_contact_view_dup_contacts:
+ * @self: a #TpContactView
+ *
+ * Return the contacts in the view, in order.
+ *
+ * Returns: (transfer container) (element-type TelepathyGLib.Contact): a new
+ *  #GPtrArray of #TpContact, which holds a reference to each one.
+ *  Use g_ptr_array_unref() when done.
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_contact_view_dup_contacts (TpContactView *self)
+{
+  GPtrArray *ret;
+  GSequenceIter *iter;
+
+  g_return_val_if_fail (TP_IS_CONTACT_VIEW (self), NULL);
+
+  ret = g_ptr_array_new_full (g_sequence_get_length (self->priv->view),
+      g_object_unref);
+
+  for (iter = g_sequence_get_begin_iter (self->priv->view);
+      !g_sequence_iter_is_end (iter);
+      iter = g_sequence_iter_next (iter))
+    {
+      ViewedContact *vc = g_sequence_get (iter);
+
+      g_ptr_array_add (ret, g_object_ref (vc->contact));
+    }
+
+  return ret;
+}
@@ -0,0 +1,95 @@
+/*
+ * A sorted, filtered view of a connection's contact list
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if defined (TP_DISABLE_SINGLE_INCLUDE) && !defined (_TP_IN_META_HEADER) && !defined (_TP_COMPILATION)
+#error "Only <telepathy-glib/telepathy-glib.h> and <telepathy-glib/telepathy-glib-dbus.h> can be included directly."
+#endif
+
+#ifndef __TP_CONTACT_VIEW_H__
+#define __TP_CONTACT_VIEW_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/contact.h>
+#include <telepathy-glib/defs.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpContactView TpContactView;
+typedef struct _TpContactViewClass TpContactViewClass;
+typedef struct _TpContactViewPrivate TpContactViewPrivate;
+
+struct _TpContactView {
+  /*<private>*/
+  GObject parent;
+  TpContactViewPrivate *priv;
+};
+
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_contact_view_get_type (void);
+
+#define TP_TYPE_CONTACT_VIEW \
+  (tp_contact_view_get_type ())
+#define TP_CONTACT_VIEW(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TYPE_CONTACT_VIEW, \
+                               TpContactView))
+#define TP_CONTACT_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TYPE_CONTACT_VIEW, \
+                            TpContactViewClass))
+#define TP_IS_CONTACT_VIEW(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TYPE_CONTACT_VIEW))
+#define TP_IS_CONTACT_VIEW_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TYPE_CONTACT_VIEW))
+#define TP_CONTACT_VIEW_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TYPE_CONTACT_VIEW, \
+                              TpContactViewClass))
+
+typedef gboolean (*TpContactViewFilterFunc) (TpContact *contact,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpContactView *tp_contact_view_new (TpConnection *connection,
+    GCompareDataFunc sort_func,
+    TpContactViewFilterFunc filter_func,
+    gpointer user_data,
+    GDestroyNotify destroy);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpConnection *tp_contact_view_get_connection (TpContactView *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_contact_view_get_n_contacts (TpContactView *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpContact *tp_contact_view_get_contact (TpContactView *self,
+    guint position);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gint tp_contact_view_get_position (TpContactView *self,
+    TpContact *contact);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_contact_view_dup_contacts (TpContactView *self)
+    G_GNUC_WARN_UNUSED_RESULT;
+
+G_END_DECLS
+
+#endif
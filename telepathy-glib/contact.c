@@ -32,6 +32,7 @@
 #include <telepathy-glib/util.h>
 
 #define DEBUG_FLAG TP_DEBUG_CONTACTS
+#include "telepathy-glib/avatar-store-internal.h"
 #include "telepathy-glib/base-contact-list-internal.h"
 #include "telepathy-glib/connection-contact-list.h"
 #include "telepathy-glib/connection-internal.h"
@@ -39,6 +40,7 @@
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/util-internal.h"
 #include "telepathy-glib/variant-util-internal.h"
+#include "telepathy-glib/_gen/tp-cli-connection-vardict.h"
 
 static const gchar *
 nonnull (const gchar *s)
@@ -224,6 +226,29 @@ typedef enum {
     CONTACT_FEATURE_FLAG_CONTACT_BLOCKING = 1 << TP_CONTACT_FEATURE_CONTACT_BLOCKING,
 } ContactFeatureFlags;
 
+/* The Location keys that change whenever a contact moves, which are stored
+ * in ContactLocation rather than in a hash table */
+typedef enum {
+    LOCATION_FIELD_LAT = 1 << 0,
+    LOCATION_FIELD_LON = 1 << 1,
+    LOCATION_FIELD_ACCURACY = 1 << 2,
+    LOCATION_FIELD_TIMESTAMP = 1 << 3
+} LocationField;
+
+#define LOCATION_FIELDS_POSITION (LOCATION_FIELD_LAT | LOCATION_FIELD_LON)
+
+typedef struct {
+    /* LocationField */
+    guint fields;
+    gdouble lat;
+    gdouble lon;
+    gdouble accuracy;
+    gint64 timestamp;
+    /* owned string => slice-allocated GValue, for the keys not in @fields,
+     * or NULL if there are none */
+    GHashTable *extra;
+} ContactLocation;
+
 struct _TpContactPrivate {
     /* basics */
     TpConnection *connection;
@@ -238,14 +263,32 @@ struct _TpContactPrivate {
     gchar *avatar_token;
     GFile *avatar_file;
     gchar *avatar_mime_type;
+    /* if TRUE, the application is showing this contact's avatar */
+    gboolean avatar_visible;
+    /* owned GSimpleAsyncResult from tp_contact_request_avatar_data_async(),
+     * completed when avatar_file is up to date */
+    GQueue avatar_data_requests;
 
     /* presence */
-    TpConnectionPresenceType presence_type;
-    gchar *presence_status;
-    gchar *presence_message;
-
-    /* location */
-    GHashTable *location;
+    /* a TpConnectionPresenceType */
+    guint8 presence_type;
+    /* interned with g_intern_string() */
+    const gchar *presence_status;
+    /* shared with other contacts, see
+     * _tp_connection_ref_presence_message() */
+    const gchar *presence_message;
+
+    /* location, valid if we have CONTACT_FEATURE_FLAG_LOCATION */
+    ContactLocation location;
+    /* location as an a{sv} and as a vardict, or NULL if not built yet */
+    GHashTable *location_asv;
+    GVariant *location_vardict;
+    /* g_get_monotonic_time() when the location last changed */
+    gint64 location_changed_at;
+    /* an update held back by tp_connection_set_location_update_filter(),
+     * valid if location_pending_id is non-zero */
+    ContactLocation location_pending;
+    guint location_pending_id;
 
     /* client types */
     gchar **client_types;
@@ -267,6 +310,9 @@ struct _TpContactPrivate {
 
     /* ContactBlocking */
     gboolean is_blocked;
+
+    /* see tp_contact_set_notify_individually() */
+    gboolean notify_individually;
 };
 
 
@@ -542,6 +588,52 @@ tp_contact_get_presence_message (TpContact *self)
       self->priv->presence_message);
 }
 
+static void
+contact_location_clear (ContactLocation *location)
+{
+  tp_clear_pointer (&location->extra, g_hash_table_unref);
+  location->fields = 0;
+}
+
+static GHashTable *
+contact_location_to_asv (const ContactLocation *location)
+{
+  /* tp_asv_new() does not free its keys, but the extra keys belong to
+   * @location, which may be freed before the caller is done with this */
+  GHashTable *asv = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) tp_g_value_slice_free);
+
+  if (location->fields & LOCATION_FIELD_LAT)
+    g_hash_table_insert (asv, g_strdup ("lat"),
+        tp_g_value_slice_new_double (location->lat));
+
+  if (location->fields & LOCATION_FIELD_LON)
+    g_hash_table_insert (asv, g_strdup ("lon"),
+        tp_g_value_slice_new_double (location->lon));
+
+  if (location->fields & LOCATION_FIELD_ACCURACY)
+    g_hash_table_insert (asv, g_strdup ("accuracy"),
+        tp_g_value_slice_new_double (location->accuracy));
+
+  if (location->fields & LOCATION_FIELD_TIMESTAMP)
+    g_hash_table_insert (asv, g_strdup ("timestamp"),
+        tp_g_value_slice_new_int64 (location->timestamp));
+
+  if (location->extra != NULL)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+
+      g_hash_table_iter_init (&iter, location->extra);
+
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        g_hash_table_insert (asv, g_strdup (key),
+            tp_g_value_slice_dup (value));
+    }
+
+  return asv;
+}
+
 /**
  * tp_contact_get_location:
  * @self: a contact
@@ -562,7 +654,18 @@ tp_contact_get_location (TpContact *self)
 {
   g_return_val_if_fail (self != NULL, NULL);
 
-  return self->priv->location;
+  if (!(self->priv->has_features & CONTACT_FEATURE_FLAG_LOCATION))
+    return NULL;
+
+  /* We guarantee that, if we've fetched a location for a contact, the
+   * :location property is non-NULL. This is mainly because Empathy assumed
+   * this and would crash if not.
+   */
+  if (self->priv->location_asv == NULL)
+    self->priv->location_asv = contact_location_to_asv (
+        &self->priv->location);
+
+  return self->priv->location_asv;
 }
 
 /**
@@ -585,10 +688,42 @@ tp_contact_dup_location (TpContact *self)
 {
   g_return_val_if_fail (self != NULL, NULL);
 
-  if (self->priv->location == NULL)
+  if (tp_contact_get_location_vardict (self) == NULL)
+    return NULL;
+
+  return g_variant_ref (self->priv->location_vardict);
+}
+
+/**
+ * tp_contact_get_location_vardict:
+ * @self: a contact
+ *
+ * The same as tp_contact_dup_location(), but without taking a reference.
+ * The variant is built once and kept until the location changes, so
+ * reading it repeatedly, for instance via #TpContact:location-vardict,
+ * does not copy the location each time.
+ *
+ * The returned variant is not necessarily valid after the main loop is next
+ * re-entered; reference it with g_variant_ref() if it must be kept.
+ *
+ * Returns: (transfer none): a variant of type %G_VARIANT_TYPE_VARDICT, or
+ *  %NULL if the location is unspecified
+ *
+ * Since: 0.UNRELEASED
+ */
+GVariant *
+tp_contact_get_location_vardict (TpContact *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (tp_contact_get_location (self) == NULL)
     return NULL;
 
-  return _tp_asv_to_vardict (self->priv->location);
+  if (self->priv->location_vardict == NULL)
+    self->priv->location_vardict = _tp_asv_to_vardict (
+        self->priv->location_asv);
+
+  return self->priv->location_vardict;
 }
 
 /**
@@ -681,6 +816,30 @@ tp_contact_dup_contact_info (TpContact *self)
       (GCopyFunc) tp_contact_info_field_copy, NULL);
 }
 
+/**
+ * tp_contact_peek_contact_info:
+ * @self: a #TpContact
+ *
+ * The same as tp_contact_dup_contact_info(), but without copying the list
+ * or its contents. Neither may be modified.
+ *
+ * The returned list is not necessarily valid after the main loop is next
+ * re-entered; copy it with tp_contact_dup_contact_info() if it must be
+ * kept.
+ *
+ * Returns: (element-type TelepathyGLib.ContactInfoField) (transfer none):
+ *  a #GList of #TpContactInfoField, or %NULL if the feature is not yet
+ *  prepared.
+ * Since: 0.UNRELEASED
+ */
+const GList *
+tp_contact_peek_contact_info (TpContact *self)
+{
+  g_return_val_if_fail (TP_IS_CONTACT (self), NULL);
+
+  return self->priv->contact_info;
+}
+
 /**
  * tp_contact_get_subscribe_state:
  * @self: a #TpContact
@@ -875,6 +1034,44 @@ tp_contact_set_contact_groups_finish (TpContact *self,
   _tp_implement_finish_void (self, tp_contact_set_contact_groups_finish);
 }
 
+/**
+ * tp_contact_set_notify_individually:
+ * @self: a #TpContact
+ * @enabled: %TRUE if changes to @self should always be notified on @self
+ *
+ * If tp_connection_set_contact_notification_batching() has been used,
+ * changes to @self are normally only reported by
+ * #TpConnection::contacts-changed. If @enabled is %TRUE, the usual
+ * #GObject::notify signals and other change signals are emitted on @self
+ * too. This is useful for the few contacts that a user interface is
+ * showing in detail.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contact_set_notify_individually (TpContact *self,
+    gboolean enabled)
+{
+  g_return_if_fail (TP_IS_CONTACT (self));
+
+  self->priv->notify_individually = enabled;
+}
+
+/* Returns: TRUE if the caller should emit change notifications for @feature
+ * on @self itself */
+static gboolean
+contact_should_notify (TpContact *self,
+    TpContactFeature feature)
+{
+  TpConnection *connection = self->priv->connection;
+
+  if (connection == NULL || !connection->priv->batch_contact_notifications)
+    return TRUE;
+
+  _tp_connection_queue_contact_changed (connection, self, feature);
+  return self->priv->notify_individually;
+}
+
 void
 _tp_contact_connection_disposed (TpContact *contact)
 {
@@ -882,7 +1079,26 @@ _tp_contact_connection_disposed (TpContact *contact)
    * and will never have one again. */
   g_assert (contact->priv->handle != 0);
   contact->priv->handle = 0;
-  g_object_notify ((GObject *) contact, "handle");
+
+  /* with batching, the application has said it doesn't want a notify
+   * signal per contact, and there is no point in batching this one: the
+   * connection is going away, and all its contacts change together */
+  if (contact->priv->connection == NULL ||
+      !contact->priv->connection->priv->batch_contact_notifications ||
+      contact->priv->notify_individually)
+    g_object_notify ((GObject *) contact, "handle");
+
+  /* ... so its avatar will never arrive either */
+  while (!g_queue_is_empty (&contact->priv->avatar_data_requests))
+    {
+      GSimpleAsyncResult *result = g_queue_pop_head (
+          &contact->priv->avatar_data_requests);
+
+      g_simple_async_result_set_error (result, TP_ERROR, TP_ERROR_CANCELLED,
+          "The connection has gone away");
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+    }
 }
 
 static void
@@ -900,8 +1116,26 @@ tp_contact_dispose (GObject *object)
       self->priv->handle = 0;
     }
 
+  if (self->priv->presence_message != NULL)
+    {
+      g_assert (self->priv->connection != NULL);
+
+      _tp_connection_unref_presence_message (self->priv->connection,
+          self->priv->presence_message);
+      self->priv->presence_message = NULL;
+    }
+
+  if (self->priv->location_pending_id != 0)
+    {
+      _tp_source_remove (self->priv->location_pending_id);
+      self->priv->location_pending_id = 0;
+    }
+
   tp_clear_object (&self->priv->connection);
-  tp_clear_pointer (&self->priv->location, g_hash_table_unref);
+  contact_location_clear (&self->priv->location);
+  contact_location_clear (&self->priv->location_pending);
+  tp_clear_pointer (&self->priv->location_asv, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->location_vardict, g_variant_unref);
   tp_clear_object (&self->priv->capabilities);
   tp_clear_object (&self->priv->avatar_file);
   tp_clear_pointer (&self->priv->contact_groups, g_ptr_array_unref);
@@ -919,8 +1153,6 @@ tp_contact_finalize (GObject *object)
   g_free (self->priv->alias);
   g_free (self->priv->avatar_token);
   g_free (self->priv->avatar_mime_type);
-  g_free (self->priv->presence_status);
-  g_free (self->priv->presence_message);
   g_strfreev (self->priv->client_types);
   tp_contact_info_list_free (self->priv->contact_info);
   g_free (self->priv->publish_request);
@@ -987,7 +1219,7 @@ tp_contact_get_property (GObject *object,
       break;
 
     case PROP_LOCATION_VARDICT:
-      g_value_take_variant (value, tp_contact_dup_location (self));
+      g_value_set_variant (value, tp_contact_get_location_vardict (self));
       break;
 
     case PROP_CAPABILITIES:
@@ -1507,6 +1739,7 @@ _tp_contact_new (TpConnection *connection,
   self->priv->connection = g_object_ref (connection);
   self->priv->handle = handle;
   self->priv->identifier = g_strdup (identifier);
+  _tp_connection_remember_id_handle (connection, identifier, handle);
 
   return self;
 }
@@ -1592,6 +1825,7 @@ tp_connection_dup_contact_if_possible (TpConnection *connection,
         {
           /* new object, I suppose we'll have to believe the caller */
           ret->priv->identifier = g_strdup (identifier);
+          _tp_connection_remember_id_handle (connection, identifier, handle);
         }
     }
   else
@@ -1700,6 +1934,20 @@ struct _ContactsContext {
 
     /* TRUE if all contacts already have IDs */
     gboolean contacts_have_ids;
+
+    /* Only used if GetContactAttributes is split into several calls: */
+    /* owned container of borrowed interface names */
+    const gchar **attr_interfaces;
+    /* TRUE if we are creating the contacts from the replies */
+    gboolean attr_hold;
+    /* if attr_hold, owned TpContact or NULL, parallel to handles */
+    GPtrArray *attr_slots;
+    /* index into handles of the first contact not yet requested */
+    guint attr_next_offset;
+    /* number of contacts whose attributes have been received */
+    guint attr_done;
+    guint attr_in_flight;
+    gboolean attr_failed;
 };
 
 /* This code (and lots of telepathy-glib, really) won't work if this
@@ -1782,6 +2030,7 @@ static void
 contacts_context_unref (gpointer p)
 {
   ContactsContext *c = p;
+  guint i;
 
   if ((--c->refcount) > 0)
     return;
@@ -1813,6 +2062,21 @@ contacts_context_unref (gpointer p)
 
   tp_clear_pointer (&c->request_errors, g_hash_table_unref);
 
+  g_free (c->attr_interfaces);
+  c->attr_interfaces = NULL;
+
+  if (c->attr_slots != NULL)
+    {
+      for (i = 0; i < c->attr_slots->len; i++)
+        {
+          if (g_ptr_array_index (c->attr_slots, i) != NULL)
+            g_object_unref (g_ptr_array_index (c->attr_slots, i));
+        }
+
+      g_ptr_array_unref (c->attr_slots);
+      c->attr_slots = NULL;
+    }
+
   if (c->destroy != NULL)
     c->destroy (c->user_data);
 
@@ -2227,6 +2491,8 @@ contacts_inspected (TpConnection *connection,
           if (contact->priv->identifier == NULL)
             {
               contact->priv->identifier = g_strdup (ids[i]);
+              _tp_connection_remember_id_handle (c->connection, ids[i],
+                  contact->priv->handle);
             }
           else if (tp_strdiff (contact->priv->identifier, ids[i]))
             {
@@ -2312,7 +2578,9 @@ contacts_requested_aliases (TpConnection *connection,
           contact->priv->has_features |= CONTACT_FEATURE_FLAG_ALIAS;
           g_free (contact->priv->alias);
           contact->priv->alias = g_strdup (alias);
-          g_object_notify ((GObject *) contact, "alias");
+
+          if (contact_should_notify (contact, TP_CONTACT_FEATURE_ALIAS))
+            g_object_notify ((GObject *) contact, "alias");
         }
     }
   else
@@ -2359,7 +2627,8 @@ contacts_got_aliases (TpConnection *connection,
                   contact->priv->handle);
             }
 
-          g_object_notify ((GObject *) contact, "alias");
+          if (contact_should_notify (contact, TP_CONTACT_FEATURE_ALIAS))
+            g_object_notify ((GObject *) contact, "alias");
         }
     }
   else if ((error->domain == TP_ERROR &&
@@ -2386,18 +2655,20 @@ contacts_got_aliases (TpConnection *connection,
 
 
 static void
-contacts_aliases_changed (TpConnection *connection,
-                          const GPtrArray *alias_structs,
-                          gpointer user_data G_GNUC_UNUSED,
-                          GObject *weak_object G_GNUC_UNUSED)
+contacts_aliases_changed (TpProxy *proxy,
+    GVariant *args,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
 {
-  guint i;
+  TpConnection *connection = (TpConnection *) proxy;
+  GVariantIter *iter;
+  TpHandle handle;
+  const gchar *alias;
+
+  g_variant_get (args, "(a(us))", &iter);
 
-  for (i = 0; i < alias_structs->len; i++)
+  while (g_variant_iter_loop (iter, "(u&s)", &handle, &alias))
     {
-      GValueArray *pair = g_ptr_array_index (alias_structs, i);
-      TpHandle handle = g_value_get_uint (pair->values + 0);
-      const gchar *alias = g_value_get_string (pair->values + 1);
       TpContact *contact = _tp_connection_lookup_contact (connection, handle);
 
       if (contact != NULL)
@@ -2407,9 +2678,13 @@ contacts_aliases_changed (TpConnection *connection,
               contact->priv->identifier, contact->priv->alias, alias);
           g_free (contact->priv->alias);
           contact->priv->alias = g_strdup (alias);
-          g_object_notify ((GObject *) contact, "alias");
+
+          if (contact_should_notify (contact, TP_CONTACT_FEATURE_ALIAS))
+            g_object_notify ((GObject *) contact, "alias");
         }
     }
+
+  g_variant_iter_free (iter);
 }
 
 
@@ -2420,8 +2695,8 @@ contacts_bind_to_aliases_changed (TpConnection *connection)
     {
       connection->priv->tracking_aliases_changed = TRUE;
 
-      tp_cli_connection_interface_aliasing_connect_to_aliases_changed (
-          connection, contacts_aliases_changed, NULL, NULL, NULL, NULL);
+      _tp_cli_connection_interface_aliasing_connect_to_aliases_changed_vardict
+        (connection, contacts_aliases_changed, NULL, NULL, NULL, NULL);
     }
 }
 
@@ -2456,28 +2731,33 @@ contacts_get_aliases (ContactsContext *c)
 
 
 static void
-contact_maybe_set_simple_presence (TpContact *contact,
-                                   GValueArray *presence)
+contact_set_simple_presence (TpContact *contact,
+    guint type,
+    const gchar *status,
+    const gchar *message)
 {
-  guint type;
-  const gchar *status;
-  const gchar *message;
-
-  if (contact == NULL)
-    return;
-
-  g_return_if_fail (presence != NULL);
   contact->priv->has_features |= CONTACT_FEATURE_FLAG_PRESENCE;
+  contact->priv->presence_type = type;
 
-  tp_value_array_unpack (presence, 3, &type, &status, &message);
+  /* In the common case, only the type has changed, and none of this needs
+   * to allocate anything */
+  if (tp_strdiff (contact->priv->presence_status, status))
+    contact->priv->presence_status = g_intern_string (status);
 
-  contact->priv->presence_type = type;
+  if (tp_strdiff (contact->priv->presence_message, message))
+    {
+      const gchar *old = contact->priv->presence_message;
 
-  g_free (contact->priv->presence_status);
-  contact->priv->presence_status = g_strdup (status);
+      contact->priv->presence_message = _tp_connection_ref_presence_message (
+          contact->priv->connection, message);
 
-  g_free (contact->priv->presence_message);
-  contact->priv->presence_message = g_strdup (message);
+      if (old != NULL)
+        _tp_connection_unref_presence_message (contact->priv->connection,
+            old);
+    }
+
+  if (!contact_should_notify (contact, TP_CONTACT_FEATURE_PRESENCE))
+    return;
 
   g_object_notify ((GObject *) contact, "presence-type");
   g_object_notify ((GObject *) contact, "presence-status");
@@ -2490,151 +2770,429 @@ contact_maybe_set_simple_presence (TpContact *contact,
 }
 
 static void
-contact_maybe_set_location (TpContact *self,
-    GHashTable *location)
+contact_maybe_set_simple_presence (TpContact *contact,
+                                   GValueArray *presence)
 {
-  if (self == NULL)
-    return;
+  guint type;
+  const gchar *status;
+  const gchar *message;
 
-  if (self->priv->location != NULL)
-    g_hash_table_unref (self->priv->location);
+  if (contact == NULL)
+    return;
 
-  /* We guarantee that, if we've fetched a location for a contact, the
-   * :location property is non-NULL. This is mainly because Empathy assumed
-   * this and would crash if not.
-   */
-  if (location == NULL)
-    location = tp_asv_new (NULL, NULL);
-  else
-    g_hash_table_ref (location);
+  g_return_if_fail (presence != NULL);
 
-  self->priv->has_features |= CONTACT_FEATURE_FLAG_LOCATION;
-  self->priv->location = location;
-  g_object_notify ((GObject *) self, "location");
-  g_object_notify ((GObject *) self, "location-vardict");
+  tp_value_array_unpack (presence, 3, &type, &status, &message);
+  contact_set_simple_presence (contact, type, status, message);
 }
 
 static void
-contact_set_capabilities (TpContact *self,
-    TpCapabilities *capabilities)
+contact_location_parse (ContactLocation *location,
+    GHashTable *asv)
 {
-  tp_clear_object (&self->priv->capabilities);
-
-  self->priv->has_features |= CONTACT_FEATURE_FLAG_CAPABILITIES;
-  self->priv->capabilities = g_object_ref (capabilities);
-  g_object_notify ((GObject *) self, "capabilities");
-}
+  GHashTableIter iter;
+  gpointer key, value;
 
-static void
-contact_maybe_set_capabilities (TpContact *self,
-    GPtrArray *arr)
-{
-  TpCapabilities *capabilities;
+  location->fields = 0;
+  location->extra = NULL;
 
-  if (self == NULL || arr == NULL)
+  if (asv == NULL)
     return;
 
-  capabilities = _tp_capabilities_new (arr, TRUE);
-  contact_set_capabilities (self, capabilities);
-  g_object_unref (capabilities);
-}
-
-
-static void
-contacts_presences_changed (TpConnection *connection,
-                            GHashTable *presences,
-                            gpointer user_data G_GNUC_UNUSED,
-                            GObject *weak_object G_GNUC_UNUSED)
-{
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, presences);
+  g_hash_table_iter_init (&iter, asv);
 
   while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      TpContact *contact = _tp_connection_lookup_contact (connection,
-          GPOINTER_TO_UINT (key));
+      if (G_VALUE_HOLDS_DOUBLE (value) && !tp_strdiff (key, "lat"))
+        {
+          location->fields |= LOCATION_FIELD_LAT;
+          location->lat = g_value_get_double (value);
+        }
+      else if (G_VALUE_HOLDS_DOUBLE (value) && !tp_strdiff (key, "lon"))
+        {
+          location->fields |= LOCATION_FIELD_LON;
+          location->lon = g_value_get_double (value);
+        }
+      else if (G_VALUE_HOLDS_DOUBLE (value) &&
+          !tp_strdiff (key, "accuracy"))
+        {
+          location->fields |= LOCATION_FIELD_ACCURACY;
+          location->accuracy = g_value_get_double (value);
+        }
+      else if (G_VALUE_HOLDS_INT64 (value) &&
+          !tp_strdiff (key, "timestamp"))
+        {
+          location->fields |= LOCATION_FIELD_TIMESTAMP;
+          location->timestamp = g_value_get_int64 (value);
+        }
+      else
+        {
+          if (location->extra == NULL)
+            location->extra = g_hash_table_new_full (g_str_hash,
+                g_str_equal, g_free, (GDestroyNotify) tp_g_value_slice_free);
 
-      contact_maybe_set_simple_presence (contact, value);
+          g_hash_table_insert (location->extra, g_strdup (key),
+              tp_g_value_slice_dup (value));
+        }
     }
 }
 
+/* Values of types that _tp_g_value_equal() doesn't know how to compare are
+ * considered to differ, so locations containing them always count as having
+ * changed */
+static gboolean
+contact_location_extra_equal (const ContactLocation *a,
+    const ContactLocation *b)
+{
+  if (a->extra == NULL || b->extra == NULL)
+    return (a->extra == b->extra);
+
+  return _tp_asv_equal (a->extra, b->extra);
+}
 
-static void
-contacts_got_simple_presence (TpConnection *connection,
-                              GHashTable *presences,
-                              const GError *error,
-                              gpointer user_data,
-                              GObject *weak_object)
+static gboolean
+contact_location_equal (const ContactLocation *a,
+    const ContactLocation *b)
 {
-  ContactsContext *c = user_data;
+  if (a->fields != b->fields)
+    return FALSE;
 
-  if (error == NULL)
-    {
-      contacts_presences_changed (connection, presences, NULL, NULL);
-    }
-  else
-    {
-      /* never mind, we can live without presences */
-      DEBUG ("GetPresences failed with %s %u: %s",
-          g_quark_to_string (error->domain), error->code, error->message);
-    }
+  if ((a->fields & LOCATION_FIELD_LAT) && a->lat != b->lat)
+    return FALSE;
 
-  contacts_context_continue (c);
+  if ((a->fields & LOCATION_FIELD_LON) && a->lon != b->lon)
+    return FALSE;
+
+  if ((a->fields & LOCATION_FIELD_ACCURACY) && a->accuracy != b->accuracy)
+    return FALSE;
+
+  if ((a->fields & LOCATION_FIELD_TIMESTAMP) &&
+      a->timestamp != b->timestamp)
+    return FALSE;
+
+  return contact_location_extra_equal (a, b);
 }
 
+#define EARTH_RADIUS_M 6371000.0
 
-static void
-contacts_bind_to_presences_changed (TpConnection *connection)
+/* cos(x) for |x| <= pi/2, to within 3e-5, which is plenty for comparing
+ * distances; telepathy-glib does not otherwise need libm */
+static gdouble
+approx_cos (gdouble x)
 {
-  if (!connection->priv->tracking_presences_changed)
-    {
-      connection->priv->tracking_presences_changed = TRUE;
+  gdouble x2 = x * x;
 
-      tp_cli_connection_interface_simple_presence_connect_to_presences_changed
-        (connection, contacts_presences_changed, NULL, NULL, NULL, NULL);
-    }
+  return 1 - x2 / 2 * (1 - x2 / 12 * (1 - x2 / 30 * (1 - x2 / 56)));
 }
 
-static void
-contacts_get_simple_presence (ContactsContext *c)
+/* Returns TRUE if @b only differs from @a by moving less than @metres, or
+ * by its accuracy or timestamp */
+static gboolean
+contact_location_is_near (const ContactLocation *a,
+    const ContactLocation *b,
+    guint metres)
 {
-  guint i;
+  gdouble dlat, dlon, mean_lat, x, y;
 
-  g_assert (c->handles->len == c->contacts->len);
+  if ((a->fields & LOCATION_FIELDS_POSITION) != LOCATION_FIELDS_POSITION ||
+      (b->fields & LOCATION_FIELDS_POSITION) != LOCATION_FIELDS_POSITION)
+    return FALSE;
 
-  contacts_bind_to_presences_changed (c->connection);
+  if (!contact_location_extra_equal (a, b))
+    return FALSE;
 
-  for (i = 0; i < c->contacts->len; i++)
-    {
-      TpContact *contact = g_ptr_array_index (c->contacts, i);
+  dlon = b->lon - a->lon;
 
-      if ((contact->priv->has_features & CONTACT_FEATURE_FLAG_PRESENCE) == 0)
-        {
-          c->refcount++;
-          tp_cli_connection_interface_simple_presence_call_get_presences (
-              c->connection, -1,
-              c->handles, contacts_got_simple_presence,
-              c, contacts_context_unref, c->weak_object);
-          return;
-        }
-    }
+  if (dlon > 180)
+    dlon -= 360;
+  else if (dlon < -180)
+    dlon += 360;
 
-  contacts_context_continue (c);
+  dlat = (b->lat - a->lat) * G_PI / 180;
+  dlon = dlon * G_PI / 180;
+  mean_lat = CLAMP ((a->lat + b->lat) / 2, -90, 90) * G_PI / 180;
+
+  /* an equirectangular projection is accurate enough over the short
+   * distances this is meant for */
+  x = dlon * approx_cos (mean_lat) * EARTH_RADIUS_M;
+  y = dlat * EARTH_RADIUS_M;
+
+  return (x * x + y * y < (gdouble) metres * metres);
 }
 
 static void
-contacts_location_updated (TpConnection *connection,
-    guint handle,
-    GHashTable *location,
-    gpointer user_data G_GNUC_UNUSED,
+contact_cancel_pending_location (TpContact *self)
+{
+  if (self->priv->location_pending_id != 0)
+    {
+      _tp_source_remove (self->priv->location_pending_id);
+      self->priv->location_pending_id = 0;
+    }
+
+  contact_location_clear (&self->priv->location_pending);
+}
+
+/* Takes ownership of @location's contents */
+static void
+contact_set_location (TpContact *self,
+    ContactLocation *location)
+{
+  contact_cancel_pending_location (self);
+
+  if ((self->priv->has_features & CONTACT_FEATURE_FLAG_LOCATION) &&
+      contact_location_equal (&self->priv->location, location))
+    {
+      contact_location_clear (location);
+      return;
+    }
+
+  contact_location_clear (&self->priv->location);
+  self->priv->location = *location;
+  tp_clear_pointer (&self->priv->location_asv, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->location_vardict, g_variant_unref);
+
+  self->priv->has_features |= CONTACT_FEATURE_FLAG_LOCATION;
+  self->priv->location_changed_at = g_get_monotonic_time ();
+
+  if (!contact_should_notify (self, TP_CONTACT_FEATURE_LOCATION))
+    return;
+
+  g_object_notify ((GObject *) self, "location");
+  g_object_notify ((GObject *) self, "location-vardict");
+}
+
+static gboolean
+contact_pending_location_cb (gpointer data)
+{
+  TpContact *self = data;
+  ContactLocation location = self->priv->location_pending;
+
+  self->priv->location_pending_id = 0;
+  self->priv->location_pending.extra = NULL;
+  self->priv->location_pending.fields = 0;
+
+  contact_set_location (self, &location);
+  return FALSE;
+}
+
+/* If @is_update is TRUE, @location came from LocationUpdated and is
+ * subject to tp_connection_set_location_update_filter() */
+static void
+contact_maybe_set_location (TpContact *self,
+    GHashTable *location,
+    gboolean is_update)
+{
+  TpConnection *connection;
+  ContactLocation parsed;
+
+  if (self == NULL)
+    return;
+
+  contact_location_parse (&parsed, location);
+  connection = self->priv->connection;
+
+  if (is_update && connection != NULL &&
+      (self->priv->has_features & CONTACT_FEATURE_FLAG_LOCATION))
+    {
+      guint min_distance = connection->priv->location_min_distance_m;
+      guint min_interval = connection->priv->location_min_interval_ms;
+      gint64 now, due;
+
+      if (min_distance > 0 &&
+          contact_location_is_near (&self->priv->location, &parsed,
+              min_distance))
+        {
+          DEBUG ("%s has moved less than %um, ignoring",
+              self->priv->identifier, min_distance);
+          /* any update that was held back is superseded too */
+          contact_cancel_pending_location (self);
+          contact_location_clear (&parsed);
+          return;
+        }
+
+      now = g_get_monotonic_time ();
+      due = self->priv->location_changed_at +
+          (gint64) min_interval * 1000;
+
+      if (min_interval > 0 && now < due)
+        {
+          contact_location_clear (&self->priv->location_pending);
+          self->priv->location_pending = parsed;
+
+          if (self->priv->location_pending_id == 0)
+            self->priv->location_pending_id = _tp_timeout_add (
+                TP_LATENCY_CLASS_BULK, (due - now + 999) / 1000,
+                contact_pending_location_cb, self);
+
+          return;
+        }
+    }
+
+  contact_set_location (self, &parsed);
+}
+
+static void
+contact_set_capabilities (TpContact *self,
+    TpCapabilities *capabilities)
+{
+  /* capabilities are shared, so an unchanged set is the same object */
+  if ((self->priv->has_features & CONTACT_FEATURE_FLAG_CAPABILITIES) &&
+      self->priv->capabilities == capabilities)
+    return;
+
+  tp_clear_object (&self->priv->capabilities);
+
+  self->priv->has_features |= CONTACT_FEATURE_FLAG_CAPABILITIES;
+  self->priv->capabilities = g_object_ref (capabilities);
+
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_CAPABILITIES))
+    g_object_notify ((GObject *) self, "capabilities");
+}
+
+static void
+contact_maybe_set_capabilities (TpContact *self,
+    GPtrArray *arr)
+{
+  TpCapabilities *capabilities;
+
+  if (self == NULL || arr == NULL)
+    return;
+
+  if (self->priv->connection != NULL)
+    capabilities = _tp_connection_dup_contact_capabilities (
+        self->priv->connection, arr);
+  else
+    capabilities = _tp_capabilities_new (arr, TRUE);
+
+  contact_set_capabilities (self, capabilities);
+  g_object_unref (capabilities);
+}
+
+
+static void
+contacts_presences_changed (TpConnection *connection,
+                            GHashTable *presences,
+                            gpointer user_data G_GNUC_UNUSED,
+                            GObject *weak_object G_GNUC_UNUSED)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, presences);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      TpContact *contact = _tp_connection_lookup_contact (connection,
+          GPOINTER_TO_UINT (key));
+
+      contact_maybe_set_simple_presence (contact, value);
+    }
+}
+
+static void
+contacts_presences_changed_vardict (TpProxy *proxy,
+    GVariant *args,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  TpConnection *connection = (TpConnection *) proxy;
+  GVariantIter *iter;
+  TpHandle handle;
+  guint type;
+  const gchar *status;
+  const gchar *message;
+
+  g_variant_get (args, "(a{u(uss)})", &iter);
+
+  while (g_variant_iter_loop (iter, "{u(u&s&s)}", &handle, &type, &status,
+        &message))
+    {
+      TpContact *contact = _tp_connection_lookup_contact (connection,
+          handle);
+
+      if (contact != NULL)
+        contact_set_simple_presence (contact, type, status, message);
+    }
+
+  g_variant_iter_free (iter);
+}
+
+
+static void
+contacts_got_simple_presence (TpConnection *connection,
+                              GHashTable *presences,
+                              const GError *error,
+                              gpointer user_data,
+                              GObject *weak_object)
+{
+  ContactsContext *c = user_data;
+
+  if (error == NULL)
+    {
+      contacts_presences_changed (connection, presences, NULL, NULL);
+    }
+  else
+    {
+      /* never mind, we can live without presences */
+      DEBUG ("GetPresences failed with %s %u: %s",
+          g_quark_to_string (error->domain), error->code, error->message);
+    }
+
+  contacts_context_continue (c);
+}
+
+
+static void
+contacts_bind_to_presences_changed (TpConnection *connection)
+{
+  if (!connection->priv->tracking_presences_changed)
+    {
+      connection->priv->tracking_presences_changed = TRUE;
+
+      _tp_cli_connection_interface_simple_presence_connect_to_presences_changed_vardict
+        (connection, contacts_presences_changed_vardict, NULL, NULL, NULL,
+         NULL);
+    }
+}
+
+static void
+contacts_get_simple_presence (ContactsContext *c)
+{
+  guint i;
+
+  g_assert (c->handles->len == c->contacts->len);
+
+  contacts_bind_to_presences_changed (c->connection);
+
+  for (i = 0; i < c->contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (c->contacts, i);
+
+      if ((contact->priv->has_features & CONTACT_FEATURE_FLAG_PRESENCE) == 0)
+        {
+          c->refcount++;
+          tp_cli_connection_interface_simple_presence_call_get_presences (
+              c->connection, -1,
+              c->handles, contacts_got_simple_presence,
+              c, contacts_context_unref, c->weak_object);
+          return;
+        }
+    }
+
+  contacts_context_continue (c);
+}
+
+static void
+contacts_location_updated (TpConnection *connection,
+    guint handle,
+    GHashTable *location,
+    gpointer user_data G_GNUC_UNUSED,
     GObject *weak_object G_GNUC_UNUSED)
 {
   TpContact *contact = _tp_connection_lookup_contact (connection,
           GPOINTER_TO_UINT (handle));
 
-  contact_maybe_set_location (contact, location);
+  contact_maybe_set_location (contact, location, TRUE);
 }
 
 static void
@@ -2664,7 +3222,9 @@ contact_maybe_set_client_types (TpContact *self,
 
   self->priv->has_features |= CONTACT_FEATURE_FLAG_CLIENT_TYPES;
   self->priv->client_types = g_strdupv ((gchar **) types);
-  g_object_notify ((GObject *) self, "client-types");
+
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_CLIENT_TYPES))
+    g_object_notify ((GObject *) self, "client-types");
 }
 
 static void
@@ -2827,8 +3387,6 @@ typedef struct {
     TpConnection *connection;
     gchar *token;
     GFile *file;
-    GBytes *data;
-    GFile *mime_file;
     gchar *mime_type;
 } WriteAvatarData;
 
@@ -2839,39 +3397,42 @@ write_avatar_data_free (WriteAvatarData *avatar_data)
   g_clear_object (&avatar_data->connection);
   tp_clear_pointer (&avatar_data->token, g_free);
   g_clear_object (&avatar_data->file);
-  tp_clear_pointer (&avatar_data->data, g_bytes_unref);
-  g_clear_object (&avatar_data->mime_file);
   tp_clear_pointer (&avatar_data->mime_type, g_free);
 
   g_slice_free (WriteAvatarData, avatar_data);
 }
 
 static void
-mime_file_written (GObject *source_object,
-    GAsyncResult *res,
+contact_complete_avatar_data_requests (TpContact *self)
+{
+  GSimpleAsyncResult *result;
+
+  while ((result = g_queue_pop_head (&self->priv->avatar_data_requests))
+      != NULL)
+    {
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+    }
+}
+
+static void
+avatar_stored (const GError *error,
     gpointer user_data)
 {
-  GError *error = NULL;
   WriteAvatarData *avatar_data = user_data;
-  GFile *file = G_FILE (source_object);
   TpContact *self;
-  gchar *path = g_file_get_path (file);
+  gchar *path = g_file_get_path (avatar_data->file);
 
-  g_assert (file == avatar_data->mime_file);
-
-  if (!g_file_replace_contents_finish (file, res, NULL, &error))
+  if (error != NULL)
     {
-      DEBUG ("Failed to store MIME type in cache (%s): %s", path,
+      DEBUG ("Failed to store avatar in cache (%s): %s", path,
           error->message);
-      g_clear_error (&error);
     }
   else
     {
-      DEBUG ("Contact avatar MIME type stored in cache: %s", path);
+      DEBUG ("Contact avatar stored in cache: %s", path);
     }
 
-  g_free (path);
-
   self = g_weak_ref_get (&avatar_data->contact);
 
   if (self == NULL)
@@ -2883,14 +3444,13 @@ mime_file_written (GObject *source_object,
       DEBUG ("Contact's avatar token has changed from %s to %s, "
           "this avatar is no longer relevant",
           avatar_data->token, nonnull (self->priv->avatar_token));
+      g_object_unref (self);
     }
   else
     {
-      gchar *data_path = g_file_get_path (avatar_data->file);
-
       DEBUG ("Saved avatar '%s' of MIME type '%s' still used by '%s' to '%s'",
           avatar_data->token, avatar_data->mime_type,
-          self->priv->identifier, data_path);
+          self->priv->identifier, path);
       g_clear_object (&self->priv->avatar_file);
       self->priv->avatar_file = g_object_ref (avatar_data->file);
 
@@ -2899,65 +3459,34 @@ mime_file_written (GObject *source_object,
 
       /* Notify both property changes together once both files have been
        * written */
-      g_object_notify ((GObject *) self, "avatar-mime-type");
-      g_object_notify ((GObject *) self, "avatar-file");
+      if (contact_should_notify (self, TP_CONTACT_FEATURE_AVATAR_DATA))
+        {
+          g_object_notify ((GObject *) self, "avatar-mime-type");
+          g_object_notify ((GObject *) self, "avatar-file");
+        }
 
+      contact_complete_avatar_data_requests (self);
       g_object_unref (self);
-      g_free (data_path);
-    }
-
-  write_avatar_data_free (avatar_data);
-}
-
-static void
-avatar_file_written (GObject *source_object,
-    GAsyncResult *res,
-    gpointer user_data)
-{
-  GError *error = NULL;
-  WriteAvatarData *avatar_data = user_data;
-  GFile *file = G_FILE (source_object);
-  gchar *path = g_file_get_path (file);
-
-  g_assert (file == avatar_data->file);
-
-  if (!g_file_replace_contents_finish (file, res, NULL, &error))
-    {
-      DEBUG ("Failed to store avatar in cache (%s): %s",
-          path, error->message);
-      DEBUG ("Storing the MIME type anyway");
-      g_clear_error (&error);
-    }
-  else
-    {
-      DEBUG ("Contact avatar stored in cache: %s",
-          path);
     }
 
-  g_file_replace_contents_async (avatar_data->mime_file,
-      avatar_data->mime_type, strlen (avatar_data->mime_type),
-      NULL, FALSE, G_FILE_CREATE_PRIVATE|G_FILE_CREATE_REPLACE_DESTINATION,
-      NULL, mime_file_written, avatar_data);
-
   g_free (path);
+  write_avatar_data_free (avatar_data);
 }
 
 static void
-contact_avatar_retrieved (TpConnection *connection,
+contact_avatar_data_retrieved (TpConnection *connection,
     guint handle,
     const gchar *token,
-    const GArray *avatar,
-    const gchar *mime_type,
-    gpointer user_data G_GNUC_UNUSED,
-    GObject *weak_object G_GNUC_UNUSED)
+    GBytes *data,
+    const gchar *mime_type)
 {
   TpContact *self = _tp_connection_lookup_contact (connection, handle);
   gchar *filename;
   gchar *mime_filename;
   WriteAvatarData *avatar_data;
 
-  DEBUG ("token '%s', %u bytes, MIME type '%s'",
-      token, avatar->len, mime_type);
+  DEBUG ("token '%s', %" G_GSIZE_FORMAT " bytes, MIME type '%s'",
+      token, g_bytes_get_size (data), mime_type);
 
   if (self == NULL)
     DEBUG ("handle #%u is not associated with any TpContact", handle);
@@ -2972,7 +3501,8 @@ contact_avatar_retrieved (TpConnection *connection,
       contact_set_avatar_token (self, token, FALSE);
     }
 
-  if (!build_avatar_filename (connection, token, TRUE, &filename,
+  /* the avatar store creates the directory itself */
+  if (!build_avatar_filename (connection, token, FALSE, &filename,
       &mime_filename))
     {
       DEBUG ("failed to set up cache");
@@ -2986,45 +3516,167 @@ contact_avatar_retrieved (TpConnection *connection,
   g_weak_ref_set (&avatar_data->contact, self);
   avatar_data->token = g_strdup (token);
   avatar_data->file = g_file_new_for_path (filename);
-  /* g_file_replace_contents_async() doesn't copy its argument, see
-   * <https://bugzilla.gnome.org/show_bug.cgi?id=690525>, so we have
-   * to keep a copy around */
-  avatar_data->data = g_bytes_new (avatar->data, avatar->len);
-  avatar_data->mime_file = g_file_new_for_path (mime_filename);
   avatar_data->mime_type = g_strdup (mime_type);
 
-  g_file_replace_contents_async (avatar_data->file,
-      g_bytes_get_data (avatar_data->data, NULL), avatar->len,
-      NULL, FALSE, G_FILE_CREATE_PRIVATE|G_FILE_CREATE_REPLACE_DESTINATION,
-      NULL, avatar_file_written, avatar_data);
+  _tp_avatar_store_write_async (filename, mime_filename, data, mime_type,
+      avatar_stored, avatar_data);
 
   g_free (filename);
   g_free (mime_filename);
 }
 
-static gboolean
-connection_avatar_request_idle_cb (gpointer user_data)
+static void
+contact_avatar_retrieved (TpConnection *connection,
+    guint handle,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
 {
-  TpConnection *connection = user_data;
-
-  DEBUG ("Request %d avatars", connection->priv->avatar_request_queue->len);
-
-  tp_cli_connection_interface_avatars_call_request_avatars (connection, -1,
-      connection->priv->avatar_request_queue, NULL, NULL, NULL, NULL);
+  GBytes *data = g_bytes_new (avatar->data, avatar->len);
 
-  g_array_unref (connection->priv->avatar_request_queue);
-  connection->priv->avatar_request_queue = NULL;
-  connection->priv->avatar_request_idle_id = 0;
-
-  return FALSE;
+  contact_avatar_data_retrieved (connection, handle, token, data, mime_type);
+  g_bytes_unref (data);
 }
 
 static void
-contact_update_avatar_data (TpContact *self)
-{
-  TpConnection *connection;
-  gchar *filename = NULL;
-  gchar *mime_filename = NULL;
+contact_avatar_file_retrieved (TpConnection *connection,
+    guint handle,
+    const gchar *token,
+    const gchar *path,
+    const gchar *mime_type,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  GMappedFile *mapped;
+  GBytes *data;
+
+  /* the CM never modifies the file once it has told us about it, so we
+   * can copy it into our cache straight from the mapping */
+  mapped = g_mapped_file_new (path, FALSE, &error);
+
+  if (mapped == NULL)
+    {
+      DEBUG ("unable to read avatar '%s' from %s: %s", token, path,
+          error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  data = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+
+  contact_avatar_data_retrieved (connection, handle, token, data, mime_type);
+  g_bytes_unref (data);
+}
+
+/* in lazy mode, the most avatars to ask for at once, and how long to wait
+ * before asking for more */
+#define LAZY_AVATAR_BATCH_SIZE 20
+#define LAZY_AVATAR_INTERVAL_MS 500
+
+static gboolean
+contact_wants_avatar_data (TpContact *self)
+{
+  return (self->priv->avatar_visible ||
+      !g_queue_is_empty (&self->priv->avatar_data_requests));
+}
+
+static gboolean
+connection_avatar_request_idle_cb (gpointer user_data)
+{
+  TpConnection *connection = user_data;
+  GArray *queue = connection->priv->avatar_request_queue;
+  gboolean lazy = connection->priv->lazy_avatar_data;
+  guint max = (lazy ? LAZY_AVATAR_BATCH_SIZE : G_MAXUINT);
+  GArray *handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  TpIntset *seen = tp_intset_new ();
+  guint i;
+
+  connection->priv->avatar_request_idle_id = 0;
+
+  for (i = 0; i < queue->len && handles->len < max; i++)
+    {
+      TpHandle handle = g_array_index (queue, TpHandle, i);
+
+      if (tp_intset_is_member (seen, handle))
+        continue;
+
+      tp_intset_add (seen, handle);
+
+      /* in lazy mode, don't bother with contacts that have scrolled out of
+       * view, or gone away, since they were queued */
+      if (lazy)
+        {
+          TpContact *contact = _tp_connection_lookup_contact (connection,
+              handle);
+
+          if (contact == NULL || !contact_wants_avatar_data (contact))
+            continue;
+        }
+
+      g_array_append_val (handles, handle);
+    }
+
+  g_array_remove_range (queue, 0, i);
+
+  if (handles->len > 0)
+    {
+      DEBUG ("Request %u avatars", handles->len);
+
+      tp_cli_connection_interface_avatars_call_request_avatars (connection,
+          -1, handles, NULL, NULL, NULL, NULL);
+    }
+
+  if (queue->len > 0)
+    {
+      DEBUG ("%u more avatars to request later", queue->len);
+      connection->priv->avatar_request_idle_id = _tp_timeout_add (
+          TP_LATENCY_CLASS_BULK, LAZY_AVATAR_INTERVAL_MS,
+          connection_avatar_request_idle_cb, connection);
+    }
+  else
+    {
+      g_array_unref (queue);
+      connection->priv->avatar_request_queue = NULL;
+    }
+
+  tp_intset_destroy (seen);
+  g_array_unref (handles);
+  return FALSE;
+}
+
+/* Queue this contact. We do this to group contacts for the RequestAvatars
+ * call */
+static void
+contact_queue_avatar_request (TpContact *self,
+    gboolean urgent)
+{
+  TpConnection *connection = self->priv->connection;
+
+  if (connection->priv->avatar_request_queue == NULL)
+    connection->priv->avatar_request_queue = g_array_new (FALSE, FALSE,
+        sizeof (TpHandle));
+
+  if (urgent)
+    g_array_prepend_val (connection->priv->avatar_request_queue,
+        self->priv->handle);
+  else
+    g_array_append_val (connection->priv->avatar_request_queue,
+        self->priv->handle);
+
+  if (connection->priv->avatar_request_idle_id == 0)
+    connection->priv->avatar_request_idle_id = _tp_idle_add (
+        TP_LATENCY_CLASS_BULK, connection_avatar_request_idle_cb, connection);
+}
+
+static void
+contact_update_avatar_data (TpContact *self)
+{
+  gchar *filename = NULL;
+  gchar *mime_filename = NULL;
 
   /* If token is NULL, it means that CM doesn't know the token. In that case we
    * have to request the avatar data to get the token. This happens with XMPP
@@ -3043,9 +3695,13 @@ contact_update_avatar_data (TpContact *self)
 
       DEBUG ("contact#%u has no avatar", self->priv->handle);
 
-      g_object_notify ((GObject *) self, "avatar-file");
-      g_object_notify ((GObject *) self, "avatar-mime-type");
+      if (contact_should_notify (self, TP_CONTACT_FEATURE_AVATAR_DATA))
+        {
+          g_object_notify ((GObject *) self, "avatar-file");
+          g_object_notify ((GObject *) self, "avatar-mime-type");
+        }
 
+      contact_complete_avatar_data_requests (self);
       return;
     }
 
@@ -3053,46 +3709,38 @@ contact_update_avatar_data (TpContact *self)
   if (build_avatar_filename (self->priv->connection, self->priv->avatar_token,
           FALSE, &filename, &mime_filename))
     {
-      if (g_file_test (filename, G_FILE_TEST_EXISTS))
-        {
-          GError *error = NULL;
+      gchar *mime_type;
 
+      if (_tp_avatar_store_lookup (filename, mime_filename, &mime_type))
+        {
           tp_clear_object (&self->priv->avatar_file);
           self->priv->avatar_file = g_file_new_for_path (filename);
 
           g_free (self->priv->avatar_mime_type);
-          if (!g_file_get_contents (mime_filename, &self->priv->avatar_mime_type,
-              NULL, &error))
-            {
-              DEBUG ("Error reading avatar MIME type (%s): %s", mime_filename,
-                  error ? error->message : "No error message");
-              self->priv->avatar_mime_type = NULL;
-              g_clear_error (&error);
-            }
+          self->priv->avatar_mime_type = mime_type;
 
           DEBUG ("contact#%u avatar found in cache: %s, %s",
               self->priv->handle, filename, self->priv->avatar_mime_type);
 
-          g_object_notify ((GObject *) self, "avatar-file");
-          g_object_notify ((GObject *) self, "avatar-mime_type");
+          if (contact_should_notify (self, TP_CONTACT_FEATURE_AVATAR_DATA))
+            {
+              g_object_notify ((GObject *) self, "avatar-file");
+              g_object_notify ((GObject *) self, "avatar-mime_type");
+            }
 
+          contact_complete_avatar_data_requests (self);
           goto out;
         }
     }
 
-  /* Not found in cache, queue this contact. We do this to group contacts
-   * for the AvatarRequest call */
-  connection = self->priv->connection;
-  if (connection->priv->avatar_request_queue == NULL)
-    connection->priv->avatar_request_queue = g_array_new (FALSE, FALSE,
-        sizeof (TpHandle));
-
-  g_array_append_val (connection->priv->avatar_request_queue,
-      self->priv->handle);
-
-  if (connection->priv->avatar_request_idle_id == 0)
-    connection->priv->avatar_request_idle_id = g_idle_add (
-        connection_avatar_request_idle_cb, connection);
+  /* Not found in cache. In lazy mode, only download it if someone is going
+   * to look at it. */
+  if (!self->priv->connection->priv->lazy_avatar_data ||
+      contact_wants_avatar_data (self))
+    contact_queue_avatar_request (self, self->priv->avatar_visible);
+  else
+    DEBUG ("contact#%u avatar not in cache, not requesting it yet",
+        self->priv->handle);
 
 out:
 
@@ -3120,6 +3768,12 @@ contacts_bind_to_avatar_retrieved (TpConnection *connection)
 
       tp_cli_connection_interface_avatars_connect_to_avatar_retrieved
         (connection, contact_avatar_retrieved, NULL, NULL, NULL, NULL);
+      tp_cli_connection_interface_avatars_connect_to_avatar_file_retrieved
+        (connection, contact_avatar_file_retrieved, NULL, NULL, NULL, NULL);
+
+      /* let the CM pass large avatars to us in files, if it can */
+      tp_connection_add_client_interest (connection,
+          TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES);
     }
 }
 
@@ -3155,7 +3809,9 @@ contact_set_avatar_token (TpContact *self, const gchar *new_token,
   self->priv->has_features |= CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
   g_free (self->priv->avatar_token);
   self->priv->avatar_token = g_strdup (new_token);
-  g_object_notify ((GObject *) self, "avatar-token");
+
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_AVATAR_TOKEN))
+    g_object_notify ((GObject *) self, "avatar-token");
 
   if (request && tp_contact_has_feature (self, TP_CONTACT_FEATURE_AVATAR_DATA))
     contact_update_avatar_data (self);
@@ -3282,7 +3938,8 @@ contact_maybe_set_info (TpContact *self,
     }
   /* else we don't know, but an empty list is perfectly valid. */
 
-  g_object_notify ((GObject *) self, "contact-info");
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_CONTACT_INFO))
+    g_object_notify ((GObject *) self, "contact-info");
 }
 
 static void
@@ -3590,765 +4247,1650 @@ tp_connection_refresh_contact_info (TpConnection *self,
   g_array_unref (handles);
 }
 
-static void
-contact_set_subscription_states (TpContact *self,
-    TpSubscriptionState subscribe,
-    TpSubscriptionState publish,
-    const gchar *publish_request)
-{
-  if (publish_request == NULL)
-    publish_request = "";
+/* How many RequestContactInfo calls tp_connection_request_contact_info_async()
+ * makes at the same time on each connection; vCards are often fetched from
+ * the server one by one, so more than this would just queue up in the CM */
+#define MAX_CONTACT_INFO_REQUESTS_IN_FLIGHT 8
 
-  DEBUG ("contact#%u state changed: subscribe=%c publish=%c '%s'",
-      self->priv->handle,
-      _tp_base_contact_list_presence_state_to_letter (subscribe),
-      _tp_base_contact_list_presence_state_to_letter (publish),
-      publish_request);
+typedef struct _ContactInfoBatch ContactInfoBatch;
 
-  self->priv->has_features |= CONTACT_FEATURE_FLAG_STATES;
+/* One RequestContactInfo call, shared by every batch that wants @contact */
+typedef struct
+{
+  TpContact *contact;
+  /* NULL while waiting in contact_info_fetch_queue */
+  TpProxyPendingCall *call;
+  /* our link in contact_info_fetch_queue, or NULL */
+  GList *queue_link;
+  /* borrowed ContactInfoBatch waiting for this */
+  GPtrArray *batches;
+} ContactInfoFetch;
 
-  g_free (self->priv->publish_request);
+/* One call to tp_connection_request_contact_info_async() */
+struct _ContactInfoBatch
+{
+  TpConnection *connection;
+  GSimpleAsyncResult *result;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  /* owned TpContact => owned GError */
+  GHashTable *failures;
+  /* borrowed ContactInfoFetch still to be answered */
+  GPtrArray *fetches;
+};
 
-  self->priv->subscribe = subscribe;
-  self->priv->publish = publish;
-  self->priv->publish_request = g_strdup (publish_request);
+static void
+contact_info_fetch_free (gpointer p)
+{
+  ContactInfoFetch *fetch = p;
 
-  g_object_notify ((GObject *) self, "subscribe-state");
-  g_object_notify ((GObject *) self, "publish-state");
-  g_object_notify ((GObject *) self, "publish-request");
+  g_assert (fetch->call == NULL);
+  g_assert (fetch->queue_link == NULL);
 
-  g_signal_emit (self, signals[SIGNAL_SUBSCRIPTION_STATES_CHANGED], 0,
-      self->priv->subscribe, self->priv->publish, self->priv->publish_request);
+  g_object_unref (fetch->contact);
+  g_ptr_array_unref (fetch->batches);
+  g_slice_free (ContactInfoFetch, fetch);
 }
 
-void
-_tp_contact_set_subscription_states (TpContact *self,
-    GValueArray *value_array)
+static void
+contact_info_batch_complete (ContactInfoBatch *batch,
+    const GError *error)
 {
-  TpSubscriptionState subscribe;
-  TpSubscriptionState publish;
-  const gchar *publish_request;
+  if (batch->cancelled_id != 0)
+    g_cancellable_disconnect (batch->cancellable, batch->cancelled_id);
 
-  tp_value_array_unpack (value_array, 3,
-      &subscribe, &publish, &publish_request);
+  if (error != NULL)
+    g_simple_async_result_set_from_error (batch->result, error);
+  else
+    g_simple_async_result_set_op_res_gpointer (batch->result,
+        g_hash_table_ref (batch->failures),
+        (GDestroyNotify) g_hash_table_unref);
 
-  contact_set_subscription_states (self, subscribe, publish, publish_request);
+  g_simple_async_result_complete_in_idle (batch->result);
+
+  g_object_unref (batch->result);
+  tp_clear_object (&batch->cancellable);
+  g_hash_table_unref (batch->failures);
+  g_ptr_array_unref (batch->fetches);
+  g_object_unref (batch->connection);
+  g_slice_free (ContactInfoBatch, batch);
 }
 
+static void contact_info_fetches_pump (TpConnection *connection);
+
 static void
-contacts_changed_cb (TpConnection *connection,
-    GHashTable *changes,
-    const GArray *removals,
+contact_info_fetch_cb (TpConnection *connection,
+    const GPtrArray *contact_info,
+    const GError *error,
     gpointer user_data,
-    GObject *weak_object)
+    GObject *weak_object G_GNUC_UNUSED)
 {
-  GHashTableIter iter;
-  gpointer key, value;
+  ContactInfoFetch *fetch = user_data;
   guint i;
 
-  g_hash_table_iter_init (&iter, changes);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      TpHandle handle = GPOINTER_TO_UINT (key);
-      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
+  g_object_ref (connection);
 
-      if (contact != NULL)
-        _tp_contact_set_subscription_states (contact, value);
-    }
+  fetch->call = NULL;
+  connection->priv->contact_info_fetches_in_flight--;
+  /* later requests for the same contact make a new call */
+  g_hash_table_steal (connection->priv->contact_info_fetches, fetch->contact);
 
-  for (i = 0; i < removals->len; i++)
+  if (error != NULL)
+    DEBUG ("Failed to request ContactInfo for %s: %s",
+        tp_contact_get_identifier (fetch->contact), error->message);
+  else
+    contact_maybe_set_info (fetch->contact, contact_info);
+
+  for (i = 0; i < fetch->batches->len; i++)
     {
-      TpHandle handle = g_array_index (removals, TpHandle, i);
-      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
+      ContactInfoBatch *batch = g_ptr_array_index (fetch->batches, i);
 
-      if (contact == NULL)
-        continue;
+      g_ptr_array_remove_fast (batch->fetches, fetch);
 
-      contact_set_subscription_states (contact, TP_SUBSCRIPTION_STATE_NO,
-          TP_SUBSCRIPTION_STATE_NO, NULL);
+      if (error != NULL)
+        g_hash_table_insert (batch->failures, g_object_ref (fetch->contact),
+            g_error_copy (error));
+
+      if (batch->fetches->len == 0)
+        contact_info_batch_complete (batch, NULL);
     }
+
+  contact_info_fetch_free (fetch);
+  contact_info_fetches_pump (connection);
+  g_object_unref (connection);
 }
 
 static void
-contacts_bind_to_contacts_changed (TpConnection *connection)
+contact_info_fetches_pump (TpConnection *connection)
 {
-  if (!connection->priv->tracking_contacts_changed)
-    {
-      connection->priv->tracking_contacts_changed = TRUE;
+  GQueue *queue = &connection->priv->contact_info_fetch_queue;
 
-      tp_cli_connection_interface_contact_list_connect_to_contacts_changed
-        (connection, contacts_changed_cb, NULL, NULL, NULL, NULL);
+  while (connection->priv->contact_info_fetches_in_flight <
+        MAX_CONTACT_INFO_REQUESTS_IN_FLIGHT &&
+      !g_queue_is_empty (queue))
+    {
+      ContactInfoFetch *fetch = g_queue_pop_head (queue);
+
+      fetch->queue_link = NULL;
+      connection->priv->contact_info_fetches_in_flight++;
+      /* as in tp_contact_request_contact_info_async() */
+      fetch->call =
+        tp_cli_connection_interface_contact_info_call_request_contact_info (
+            connection, 60*60*1000, fetch->contact->priv->handle,
+            contact_info_fetch_cb, fetch, NULL, NULL);
     }
 }
 
+/* Nobody wants the answer to @fetch any more */
 static void
-contact_maybe_set_contact_groups (TpContact *self,
-    GStrv contact_groups)
+contact_info_fetch_abandon (TpConnection *connection,
+    ContactInfoFetch *fetch)
 {
-  gchar **iter;
-
-  if (self == NULL || contact_groups == NULL)
-    return;
-
-  self->priv->has_features |= CONTACT_FEATURE_FLAG_CONTACT_GROUPS;
-
-  tp_clear_pointer (&self->priv->contact_groups, g_ptr_array_unref);
-  self->priv->contact_groups = g_ptr_array_new_full (
-      g_strv_length (contact_groups) + 1, g_free);
-
-  for (iter = contact_groups; *iter != NULL; iter++)
-    g_ptr_array_add (self->priv->contact_groups, g_strdup (*iter));
-  g_ptr_array_add (self->priv->contact_groups, NULL);
+  if (fetch->call != NULL)
+    {
+      tp_proxy_pending_call_cancel (fetch->call);
+      fetch->call = NULL;
+      connection->priv->contact_info_fetches_in_flight--;
+    }
+  else
+    {
+      g_queue_delete_link (&connection->priv->contact_info_fetch_queue,
+          fetch->queue_link);
+      fetch->queue_link = NULL;
+    }
 
-  g_object_notify ((GObject *) self, "contact-groups");
+  g_hash_table_remove (connection->priv->contact_info_fetches,
+      fetch->contact);
 }
 
 static void
-contact_groups_changed_cb (TpConnection *connection,
-    const GArray *contacts,
-    const gchar **added,
-    const gchar **removed,
-    gpointer user_data,
-    GObject *weak_object)
+contact_info_batch_cancelled_cb (GCancellable *cancellable,
+    ContactInfoBatch *batch)
 {
+  TpConnection *connection = g_object_ref (batch->connection);
+  GError *error = NULL;
   guint i;
 
-  for (i = 0; i < contacts->len; i++)
-    {
-      TpHandle handle = g_array_index (contacts, TpHandle, i);
-      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
-      const gchar **iter;
-      guint j;
-
-      if (contact == NULL || contact->priv->contact_groups == NULL)
-        continue;
-
-      /* Remove the ending NULL */
-      g_ptr_array_remove_index_fast (contact->priv->contact_groups,
-          contact->priv->contact_groups->len - 1);
+  /* as in contact_info_request_cancelled_cb() */
+  if (batch->cancelled_id != 0)
+    g_signal_handler_disconnect (batch->cancellable, batch->cancelled_id);
+  batch->cancelled_id = 0;
 
-      /* Remove old groups */
-      for (iter = removed; *iter != NULL; iter++)
-        {
-          for (j = 0; j < contact->priv->contact_groups->len; j++)
-            {
-              const gchar *str;
+  if (!g_cancellable_set_error_if_cancelled (cancellable, &error))
+    g_assert_not_reached ();
 
-              str = g_ptr_array_index (contact->priv->contact_groups, j);
-              if (!tp_strdiff (str, *iter))
-                {
-                  g_ptr_array_remove_index_fast (contact->priv->contact_groups, j);
-                  break;
-                }
-            }
-        }
+  DEBUG ("Request ContactInfo for %u contacts cancelled",
+      batch->fetches->len);
 
-      /* Add new groups */
-      for (iter = added; *iter != NULL; iter++)
-        g_ptr_array_add (contact->priv->contact_groups, g_strdup (*iter));
+  for (i = 0; i < batch->fetches->len; i++)
+    {
+      ContactInfoFetch *fetch = g_ptr_array_index (batch->fetches, i);
 
-      /* Add back the ending NULL */
-      g_ptr_array_add (contact->priv->contact_groups, NULL);
+      g_ptr_array_remove_fast (fetch->batches, batch);
 
-      g_object_notify ((GObject *) contact, "contact-groups");
-      g_signal_emit (contact, signals[SIGNAL_CONTACT_GROUPS_CHANGED], 0,
-          added, removed);
+      if (fetch->batches->len == 0)
+        contact_info_fetch_abandon (connection, fetch);
     }
-}
 
-static void
-contacts_bind_to_contact_groups_changed (TpConnection *connection)
-{
-  if (!connection->priv->tracking_contact_groups_changed)
-    {
-      connection->priv->tracking_contact_groups_changed = TRUE;
+  g_ptr_array_set_size (batch->fetches, 0);
+  contact_info_batch_complete (batch, error);
+  g_clear_error (&error);
 
-      tp_cli_connection_interface_contact_groups_connect_to_groups_changed
-        (connection, contact_groups_changed_cb, NULL, NULL, NULL, NULL);
-    }
+  contact_info_fetches_pump (connection);
+  g_object_unref (connection);
 }
 
-static gboolean
-contacts_context_supports_iface (ContactsContext *context,
-    GQuark iface)
+/**
+ * tp_connection_request_contact_info_async:
+ * @self: a #TpConnection
+ * @n_contacts: The number of contacts in @contacts
+ * @contacts: (array length=n_contacts): An array of #TpContact objects
+ *  associated with @self
+ * @cancellable: optional #GCancellable object, %NULL to ignore
+ * @callback: a callback to call when the info of every contact in
+ *  @contacts has been received, or could not be
+ * @user_data: data to pass to @callback
+ *
+ * Request the contact info of each contact in @contacts, as
+ * tp_contact_request_contact_info_async() does for one contact, but as a
+ * single operation.
+ *
+ * The #TpContact:contact-info property of each contact is updated as soon as
+ * its info arrives, emitting "notify::contact-info", without waiting for the
+ * other contacts; @callback is called once they have all been answered.
+ *
+ * Only a few requests are sent to the connection manager at a time, so that
+ * requesting the info of a whole directory does not flood it or the server.
+ * A contact whose info is already being requested, by this operation or by
+ * another call to this function, is not requested again.
+ *
+ * If @cancellable is cancelled, @callback is called with
+ * %G_IO_ERROR_CANCELLED, and the requests that no other operation is
+ * waiting for are cancelled too. The info that has already arrived is
+ * kept.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_request_contact_info_async (TpConnection *self,
+    guint n_contacts,
+    TpContact * const *contacts,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
-  GArray *contact_attribute_interfaces =
-      context->connection->priv->contact_attribute_interfaces;
+  ContactInfoBatch *batch;
+  GError *error = NULL;
   guint i;
 
-  if (!tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
-    return FALSE;
-
-  if (contact_attribute_interfaces == NULL)
-    return FALSE;
+  g_return_if_fail (TP_IS_CONNECTION (self));
+  g_return_if_fail (n_contacts == 0 || contacts != NULL);
 
-  for (i = 0; i < contact_attribute_interfaces->len; i++)
+  for (i = 0; i < n_contacts; i++)
     {
-      GQuark q = g_array_index (contact_attribute_interfaces, GQuark, i);
-
-      if (q == iface)
-        return TRUE;
+      g_return_if_fail (TP_IS_CONTACT (contacts[i]));
+      g_return_if_fail (contacts[i]->priv->connection == self);
     }
 
-  return FALSE;
-}
-
-static void
-contacts_context_queue_features (ContactsContext *context)
-{
-  ContactFeatureFlags feature_flags = context->wanted;
+  contacts_bind_to_contact_info_changed (self);
 
-  /* Start slow path for requested features that are not in
-   * ContactAttributeInterfaces */
+  batch = g_slice_new0 (ContactInfoBatch);
+  batch->connection = g_object_ref (self);
+  batch->result = g_simple_async_result_new (G_OBJECT (self), callback,
+      user_data, tp_connection_request_contact_info_finish);
+  batch->failures = g_hash_table_new_full (NULL, NULL, g_object_unref,
+      (GDestroyNotify) g_error_free);
+  batch->fetches = g_ptr_array_sized_new (n_contacts);
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_ALIAS) != 0 &&
-      !contacts_context_supports_iface (context,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING) &&
-      tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING))
+  if (g_cancellable_set_error_if_cancelled (cancellable, &error))
     {
-      g_queue_push_tail (&context->todo, contacts_get_aliases);
+      contact_info_batch_complete (batch, error);
+      g_clear_error (&error);
+      return;
     }
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_PRESENCE) != 0 &&
-      !contacts_context_supports_iface (context,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
+  if (self->priv->contact_info_fetches == NULL)
+    self->priv->contact_info_fetches = g_hash_table_new_full (NULL, NULL,
+        NULL, contact_info_fetch_free);
+
+  for (i = 0; i < n_contacts; i++)
     {
-      if (tp_proxy_has_interface_by_id (context->connection,
-            TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
+      ContactInfoFetch *fetch = g_hash_table_lookup (
+          self->priv->contact_info_fetches, contacts[i]);
+
+      if (fetch == NULL)
         {
-          g_queue_push_tail (&context->todo, contacts_get_simple_presence);
+          fetch = g_slice_new0 (ContactInfoFetch);
+          fetch->contact = g_object_ref (contacts[i]);
+          fetch->batches = g_ptr_array_new ();
+          g_hash_table_insert (self->priv->contact_info_fetches,
+              fetch->contact, fetch);
+          g_queue_push_tail (&self->priv->contact_info_fetch_queue, fetch);
+          fetch->queue_link = self->priv->contact_info_fetch_queue.tail;
         }
-#if 0
-      /* FIXME: Before doing this for the first time, we'd need to download
-       * from the CM the definition of what each status actually *means* */
-      else if (tp_proxy_has_interface_by_id (context->connection,
-            TP_IFACE_QUARK_CONNECTION_INTERFACE_PRESENCE))
+      else if (fetch->batches->len > 0 &&
+          g_ptr_array_index (fetch->batches, fetch->batches->len - 1) ==
+            batch)
         {
-          g_queue_push_tail (&context->todo, contacts_get_complex_presence);
+          /* @contacts has this contact more than once */
+          continue;
         }
-#endif
-    }
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_TOKEN) != 0 &&
-      !contacts_context_supports_iface (context,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS) &&
-      tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS))
-    {
-      g_queue_push_tail (&context->todo, contacts_get_avatar_tokens);
+      g_ptr_array_add (fetch->batches, batch);
+      g_ptr_array_add (batch->fetches, fetch);
     }
 
-  /* There is no contact attribute for avatar data, always use slow path */
-  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0 &&
-      tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS))
+  DEBUG ("%u contacts, %u requests in flight, %u queued", n_contacts,
+      self->priv->contact_info_fetches_in_flight,
+      self->priv->contact_info_fetch_queue.length);
+
+  if (batch->fetches->len == 0)
     {
-      g_queue_push_tail (&context->todo, contacts_get_avatar_data);
+      contact_info_batch_complete (batch, NULL);
+      return;
     }
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_LOCATION) != 0 &&
-      !contacts_context_supports_iface (context,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION) &&
-      tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION))
+  if (cancellable != NULL)
     {
-      WARNING ("%s supports Location but not Contacts! Where did you find "
-          "this CM? TP_CONTACT_FEATURE_LOCATION is not gonna work",
-          tp_proxy_get_object_path (context->connection));
+      batch->cancellable = g_object_ref (cancellable);
+      batch->cancelled_id = g_cancellable_connect (cancellable,
+          G_CALLBACK (contact_info_batch_cancelled_cb), batch, NULL);
     }
 
-  /* Don't implement slow path for ContactCapabilities as Contacts is now
-   * mandatory so any CM supporting ContactCapabilities will implement
-   * Contacts as well.
-   *
-   * But if ContactCapabilities is NOT supported, we fallback to connection
-   * capabilities.
-   * */
+  contact_info_fetches_pump (self);
+}
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_CAPABILITIES) != 0 &&
-      !tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_CAPABILITIES))
-    {
-      DEBUG ("Connection doesn't support ContactCapabilities; fallback to "
-          "connection capabilities");
+/**
+ * tp_connection_request_contact_info_finish:
+ * @self: a #TpConnection
+ * @result: a #GAsyncResult
+ * @failures: (out) (allow-none) (transfer full) (element-type TelepathyGLib.Contact GLib.Error):
+ *  used to return a map from each contact whose info could not be
+ *  retrieved to the reason why
+ * @error: a #GError to be filled
+ *
+ * Finishes tp_connection_request_contact_info_async(). The info of each
+ * contact that is not in @failures can be accessed using
+ * tp_contact_dup_contact_info().
+ *
+ * Returns: %TRUE if the operation was not cancelled, even if the info of
+ *  some contacts could not be retrieved
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_connection_request_contact_info_finish (TpConnection *self,
+    GAsyncResult *result,
+    GHashTable **failures,
+    GError **error)
+{
+  _tp_implement_finish_copy_pointer (self,
+      tp_connection_request_contact_info_finish, g_hash_table_ref, failures);
+}
 
-      g_queue_push_tail (&context->todo, contacts_get_conn_capabilities);
-    }
+/**
+ * tp_contact_request_avatar_data_async:
+ * @self: a #TpContact
+ * @callback: a callback to call when the request is satisfied
+ * @user_data: data to pass to @callback
+ *
+ * Make sure that #TpContact:avatar-file and #TpContact:avatar-mime-type are
+ * up to date for the contact's current #TpContact:avatar-token, downloading
+ * the avatar from the network if it is not already cached, even if
+ * tp_connection_set_lazy_avatar_data() has been used.
+ *
+ * If %TP_CONTACT_FEATURE_AVATAR_DATA is not yet set on @self, it will be
+ * set before @callback is called.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contact_request_avatar_data_async (TpContact *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GSimpleAsyncResult *result;
 
-  if ((feature_flags & CONTACT_FEATURE_FLAG_CONTACT_INFO) != 0 &&
-      !contacts_context_supports_iface (context,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO) &&
-      tp_proxy_has_interface_by_id (context->connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO))
+  g_return_if_fail (TP_IS_CONTACT (self));
+
+  result = g_simple_async_result_new ((GObject *) self, callback,
+      user_data, tp_contact_request_avatar_data_finish);
+
+  if (self->priv->handle == 0)
     {
-      g_queue_push_tail (&context->todo, contacts_get_contact_info);
+      g_simple_async_result_set_error (result, TP_ERROR, TP_ERROR_CANCELLED,
+          "The connection has gone away");
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+      return;
     }
+
+  contacts_bind_to_avatar_updated (self->priv->connection);
+  contacts_bind_to_avatar_retrieved (self->priv->connection);
+  self->priv->has_features |= CONTACT_FEATURE_FLAG_AVATAR_DATA;
+
+  g_queue_push_tail (&self->priv->avatar_data_requests, result);
+
+  /* If the token is unknown, the CM will tell us when it sends us the
+   * avatar */
+  if (self->priv->avatar_token == NULL)
+    contact_queue_avatar_request (self, self->priv->avatar_visible);
+  else
+    contact_update_avatar_data (self);
 }
 
-static gboolean
-tp_contact_set_attributes (TpContact *contact,
-    GHashTable *asv,
-    ContactFeatureFlags wanted,
-    ContactFeatureFlags getting,
+/**
+ * tp_contact_request_avatar_data_finish:
+ * @self: a #TpContact
+ * @result: a #GAsyncResult
+ * @error: a #GError to be filled
+ *
+ * Finishes tp_contact_request_avatar_data_async(). If the operation was
+ * successful, tp_contact_get_avatar_file() returns the avatar, or %NULL if
+ * @self has no avatar.
+ *
+ * Returns: %TRUE if the request was successful, otherwise %FALSE
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_contact_request_avatar_data_finish (TpContact *self,
+    GAsyncResult *result,
     GError **error)
 {
-  TpConnection *connection = tp_contact_get_connection (contact);
-  const gchar *s;
-  gpointer boxed;
+  _tp_implement_finish_void (self, tp_contact_request_avatar_data_finish);
+}
 
-  /* Identifier */
-  s = tp_asv_get_string (asv, TP_TOKEN_CONNECTION_CONTACT_ID);
+/**
+ * tp_connection_set_contacts_visible:
+ * @self: a #TpConnection
+ * @n_contacts: The number of contacts in @contacts
+ * @contacts: (array length=n_contacts): An array of #TpContact objects
+ *  associated with @self
+ * @visible: %TRUE if the application is now showing these contacts'
+ *  avatars, %FALSE if it has stopped doing so
+ *
+ * Give a hint about which avatars matter. Avatars of visible contacts that
+ * have %TP_CONTACT_FEATURE_AVATAR_DATA are downloaded before any others,
+ * and if tp_connection_set_lazy_avatar_data() has been used, only theirs
+ * (and those explicitly requested with
+ * tp_contact_request_avatar_data_async()) are downloaded at all.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_connection_set_contacts_visible (TpConnection *self,
+    guint n_contacts,
+    TpContact * const *contacts,
+    gboolean visible)
+{
+  guint i;
 
-  if (s == NULL)
+  g_return_if_fail (TP_IS_CONNECTION (self));
+  g_return_if_fail (n_contacts == 0 || contacts != NULL);
+
+  for (i = 0; i < n_contacts; i++)
     {
-       g_set_error (error, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
-          "Connection manager %s is broken: contact #%u in the "
-          "GetContactAttributes result has no contact-id",
-          tp_proxy_get_bus_name (connection), contact->priv->handle);
+      g_return_if_fail (TP_IS_CONTACT (contacts[i]));
+      g_return_if_fail (contacts[i]->priv->connection == self);
+    }
 
-      return FALSE;
+  for (i = 0; i < n_contacts; i++)
+    {
+      TpContact *contact = contacts[i];
+      gboolean was_visible = contact->priv->avatar_visible;
+
+      contact->priv->avatar_visible = visible;
+
+      /* Visible contacts whose avatar we were not going to download now
+       * jump the queue */
+      if (visible && !was_visible &&
+          contact->priv->handle != 0 &&
+          (contact->priv->has_features & CONTACT_FEATURE_FLAG_AVATAR_DATA)
+            != 0)
+        contact_update_avatar_data (contact);
     }
+}
 
-  DEBUG ("#%u: \"%s\"", contact->priv->handle, s);
+static void
+contact_set_subscription_states (TpContact *self,
+    TpSubscriptionState subscribe,
+    TpSubscriptionState publish,
+    const gchar *publish_request)
+{
+  if (publish_request == NULL)
+    publish_request = "";
 
-  {
-    GHashTableIter iter;
-    gpointer k, v;
+  DEBUG ("contact#%u state changed: subscribe=%c publish=%c '%s'",
+      self->priv->handle,
+      _tp_base_contact_list_presence_state_to_letter (subscribe),
+      _tp_base_contact_list_presence_state_to_letter (publish),
+      publish_request);
 
-    g_hash_table_iter_init (&iter, asv);
+  _tp_connection_roster_unindex_contact (self->priv->connection, self);
 
-    while (g_hash_table_iter_next (&iter, &k, &v))
-      {
-        gchar *str = g_strdup_value_contents (v);
+  self->priv->has_features |= CONTACT_FEATURE_FLAG_STATES;
 
-        DEBUG ("- %s => %s", (const gchar *) k, str);
-        g_free (str);
-      }
-  }
+  g_free (self->priv->publish_request);
 
-  if (contact->priv->identifier == NULL)
-    {
-      contact->priv->identifier = g_strdup (s);
-    }
-  else if (tp_strdiff (contact->priv->identifier, s))
-    {
-      g_set_error (error, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
-          "Connection manager %s is broken: contact #%u identifier "
-          "changed from %s to %s",
-          tp_proxy_get_bus_name (connection), contact->priv->handle,
-          contact->priv->identifier, s);
+  self->priv->subscribe = subscribe;
+  self->priv->publish = publish;
+  self->priv->publish_request = g_strdup (publish_request);
 
-      return FALSE;
-    }
+  _tp_connection_roster_index_contact (self->priv->connection, self);
 
-  /* Alias */
-  if (wanted & CONTACT_FEATURE_FLAG_ALIAS)
-    {
-      s = tp_asv_get_string (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_ALIASING_ALIAS);
+  if (!contact_should_notify (self, TP_CONTACT_FEATURE_SUBSCRIPTION_STATES))
+    return;
 
-      if (s == NULL)
-        {
-          if (getting & CONTACT_FEATURE_FLAG_ALIAS)
-            {
-              WARNING ("%s supposedly implements Contacts and Aliasing, but "
-                  "omitted " TP_TOKEN_CONNECTION_INTERFACE_ALIASING_ALIAS,
-                  tp_proxy_get_object_path (connection));
-            }
-        }
-      else
-        {
-          contact->priv->has_features |= CONTACT_FEATURE_FLAG_ALIAS;
-          g_free (contact->priv->alias);
-          contact->priv->alias = g_strdup (s);
-          g_object_notify ((GObject *) contact, "alias");
-        }
-    }
-
-  /* Avatar */
-  if (wanted & CONTACT_FEATURE_FLAG_AVATAR_TOKEN)
-    {
-      s = tp_asv_get_string (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_AVATARS_TOKEN);
-      contact_set_avatar_token (contact, s, TRUE);
-    }
+  g_object_notify ((GObject *) self, "subscribe-state");
+  g_object_notify ((GObject *) self, "publish-state");
+  g_object_notify ((GObject *) self, "publish-request");
 
-  if (wanted & CONTACT_FEATURE_FLAG_AVATAR_DATA)
-    {
-      /* There is no attribute for the avatar data, this will set the avatar
-       * from cache or start the avatar request if its missing from cache. */
-      contact_maybe_update_avatar_data (contact);
-    }
+  g_signal_emit (self, signals[SIGNAL_SUBSCRIPTION_STATES_CHANGED], 0,
+      self->priv->subscribe, self->priv->publish, self->priv->publish_request);
+}
 
-  /* Presence */
-  if (wanted & CONTACT_FEATURE_FLAG_PRESENCE)
-    {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_SIMPLE_PRESENCE_PRESENCE,
-          TP_STRUCT_TYPE_SIMPLE_PRESENCE);
+void
+_tp_contact_set_subscription_states (TpContact *self,
+    GValueArray *value_array)
+{
+  TpSubscriptionState subscribe;
+  TpSubscriptionState publish;
+  const gchar *publish_request;
 
-      if (boxed == NULL)
-        {
-          if (getting & CONTACT_FEATURE_FLAG_PRESENCE)
-            {
-              WARNING ("%s supposedly implements Contacts and SimplePresence, "
-                  "but omitted the mandatory "
-                  TP_TOKEN_CONNECTION_INTERFACE_SIMPLE_PRESENCE_PRESENCE
-                  " attribute",
-                  tp_proxy_get_object_path (connection));
-            }
-        }
-      else
-        {
-          contact_maybe_set_simple_presence (contact, boxed);
-        }
-    }
+  tp_value_array_unpack (value_array, 3,
+      &subscribe, &publish, &publish_request);
 
-  /* Location */
-  if (wanted & CONTACT_FEATURE_FLAG_LOCATION)
-    {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_LOCATION_LOCATION,
-          TP_HASH_TYPE_LOCATION);
-      contact_maybe_set_location (contact, boxed);
-    }
+  contact_set_subscription_states (self, subscribe, publish, publish_request);
+}
 
-  /* Capabilities */
-  if (wanted & CONTACT_FEATURE_FLAG_CAPABILITIES)
-    {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_CAPABILITIES_CAPABILITIES,
-          TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST);
-      contact_maybe_set_capabilities (contact, boxed);
-    }
+static void
+contacts_changed_cb (TpConnection *connection,
+    GHashTable *changes,
+    const GArray *removals,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
 
-  /* ContactInfo */
-  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_INFO)
+  g_hash_table_iter_init (&iter, changes);
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_INFO_INFO,
-          TP_ARRAY_TYPE_CONTACT_INFO_FIELD_LIST);
-      contact_maybe_set_info (contact, boxed);
-    }
+      TpHandle handle = GPOINTER_TO_UINT (key);
+      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
 
-  /* ClientTypes */
-  if (wanted & CONTACT_FEATURE_FLAG_CLIENT_TYPES)
-    {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_CLIENT_TYPES_CLIENT_TYPES,
-          G_TYPE_STRV);
-      contact_maybe_set_client_types (contact, boxed);
+      if (contact != NULL)
+        _tp_contact_set_subscription_states (contact, value);
     }
 
-  /* ContactList subscription states */
-  if (wanted & CONTACT_FEATURE_FLAG_STATES)
+  for (i = 0; i < removals->len; i++)
     {
-      TpSubscriptionState subscribe;
-      TpSubscriptionState publish;
-      const gchar *publish_request;
-      gboolean subscribe_valid = FALSE;
-      gboolean publish_valid = FALSE;
+      TpHandle handle = g_array_index (removals, TpHandle, i);
+      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
 
-      subscribe = tp_asv_get_uint32 (asv,
-            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_SUBSCRIBE,
-            &subscribe_valid);
-      publish = tp_asv_get_uint32 (asv,
-            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH,
-            &publish_valid);
-      publish_request = tp_asv_get_string (asv,
-            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH_REQUEST);
+      if (contact == NULL)
+        continue;
 
-      if (subscribe_valid && publish_valid)
-        {
-          contact_set_subscription_states (contact, subscribe, publish,
-              publish_request);
-        }
+      contact_set_subscription_states (contact, TP_SUBSCRIPTION_STATE_NO,
+          TP_SUBSCRIPTION_STATE_NO, NULL);
     }
+}
 
-  /* ContactGroups */
-  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_GROUPS)
+static void
+contacts_bind_to_contacts_changed (TpConnection *connection)
+{
+  if (!connection->priv->tracking_contacts_changed)
     {
-      boxed = tp_asv_get_boxed (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_GROUPS_GROUPS,
-          G_TYPE_STRV);
-      contact_maybe_set_contact_groups (contact, boxed);
+      connection->priv->tracking_contacts_changed = TRUE;
+
+      tp_cli_connection_interface_contact_list_connect_to_contacts_changed
+        (connection, contacts_changed_cb, NULL, NULL, NULL, NULL);
     }
+}
 
-  /* ContactBlocking */
-  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_BLOCKING)
-    {
-      gboolean is_blocked, valid;
+static void
+contact_maybe_set_contact_groups (TpContact *self,
+    GStrv contact_groups)
+{
+  gchar **iter;
 
-      is_blocked = tp_asv_get_boolean (asv,
-          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_BLOCKING_BLOCKED, &valid);
+  if (self == NULL || contact_groups == NULL)
+    return;
 
-      if (valid)
-        _tp_contact_set_is_blocked (contact, is_blocked);
-    }
+  _tp_connection_roster_unindex_contact (self->priv->connection, self);
 
-  return TRUE;
-}
+  self->priv->has_features |= CONTACT_FEATURE_FLAG_CONTACT_GROUPS;
 
-static gboolean get_feature_flags (guint n_features,
-    const TpContactFeature *features, ContactFeatureFlags *flags);
+  tp_clear_pointer (&self->priv->contact_groups, g_ptr_array_unref);
+  self->priv->contact_groups = g_ptr_array_new_full (
+      g_strv_length (contact_groups) + 1, g_free);
 
-gboolean
-_tp_contact_set_attributes (TpContact *contact,
-    GHashTable *asv,
-    guint n_features,
-    const TpContactFeature *features,
-    GError **error)
-{
-  ContactFeatureFlags feature_flags = 0;
+  for (iter = contact_groups; *iter != NULL; iter++)
+    g_ptr_array_add (self->priv->contact_groups, g_strdup (*iter));
+  g_ptr_array_add (self->priv->contact_groups, NULL);
 
-  if (!get_feature_flags (n_features, features, &feature_flags))
-    return FALSE;
+  _tp_connection_roster_index_contact (self->priv->connection, self);
 
-  return tp_contact_set_attributes (contact, asv, feature_flags,
-      0 /* can't know what we expected to get */, error);
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_CONTACT_GROUPS))
+    g_object_notify ((GObject *) self, "contact-groups");
 }
 
 static void
-contacts_got_attributes (TpConnection *connection,
-                         GHashTable *attributes,
-                         const GError *error,
-                         gpointer user_data,
-                         GObject *weak_object)
+contact_groups_changed_cb (TpConnection *connection,
+    const GArray *contacts,
+    const gchar **added,
+    const gchar **removed,
+    gpointer user_data,
+    GObject *weak_object)
 {
-  ContactsContext *c = user_data;
   guint i;
 
-  DEBUG ("%p: reply from GetContactAttributes: %s",
-      c, (error == NULL ? "OK" : error->message));
-
-  if (error != NULL)
+  for (i = 0; i < contacts->len; i++)
     {
-      contacts_context_fail (c, error);
-      return;
-    }
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+      TpContact *contact = _tp_connection_lookup_contact (connection, handle);
+      const gchar **iter;
+      guint j;
 
-  i = 0;
+      if (contact == NULL || contact->priv->contact_groups == NULL)
+        continue;
 
-  if (c->signature == CB_BY_HANDLE && c->contacts->len == 0)
-    {
-      while (i < c->handles->len)
-        {
-          TpHandle handle = g_array_index (c->handles, guint, i);
-          GHashTable *asv = g_hash_table_lookup (attributes,
-              GUINT_TO_POINTER (handle));
+      _tp_connection_roster_unindex_contact (connection, contact);
 
-          if (asv == NULL)
-            {
-              /* not in the hash table => not valid */
-              g_array_append_val (c->invalid, handle);
-              g_array_remove_index_fast (c->handles, i);
-            }
-          else
+      /* Remove the ending NULL */
+      g_ptr_array_remove_index_fast (contact->priv->contact_groups,
+          contact->priv->contact_groups->len - 1);
+
+      /* Remove old groups */
+      for (iter = removed; *iter != NULL; iter++)
+        {
+          for (j = 0; j < contact->priv->contact_groups->len; j++)
             {
-              TpContact *contact = tp_contact_ensure (connection, handle);
+              const gchar *str;
 
-              g_ptr_array_add (c->contacts, contact);
-              i++;
+              str = g_ptr_array_index (contact->priv->contact_groups, j);
+              if (!tp_strdiff (str, *iter))
+                {
+                  g_ptr_array_remove_index_fast (contact->priv->contact_groups, j);
+                  break;
+                }
             }
         }
-    }
 
-  g_assert (c->contacts->len == c->handles->len);
+      /* Add new groups */
+      for (iter = added; *iter != NULL; iter++)
+        g_ptr_array_add (contact->priv->contact_groups, g_strdup (*iter));
 
-  for (i = 0; i < c->handles->len; i++)
-    {
-      TpContact *contact = g_ptr_array_index (c->contacts, i);
-      GHashTable *asv = g_hash_table_lookup (attributes,
-          GUINT_TO_POINTER (contact->priv->handle));
-      GError *e = NULL;
+      /* Add back the ending NULL */
+      g_ptr_array_add (contact->priv->contact_groups, NULL);
 
-      if (asv == NULL)
-        {
-          g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
-              "We hold a ref to handle #%u but it appears to be invalid",
-              contact->priv->handle);
-        }
-      else
-        {
-          /* set up the contact with its attributes */
-          tp_contact_set_attributes (contact, asv, c->wanted, c->getting, &e);
-        }
+      _tp_connection_roster_index_contact (connection, contact);
 
-      if (e != NULL)
-        {
-          contacts_context_fail (c, e);
-          g_error_free (e);
-          return;
-        }
+      if (!contact_should_notify (contact,
+            TP_CONTACT_FEATURE_CONTACT_GROUPS))
+        continue;
+
+      g_object_notify ((GObject *) contact, "contact-groups");
+      g_signal_emit (contact, signals[SIGNAL_CONTACT_GROUPS_CHANGED], 0,
+          added, removed);
     }
+}
 
-  contacts_context_continue (c);
+static void
+contacts_bind_to_contact_groups_changed (TpConnection *connection)
+{
+  if (!connection->priv->tracking_contact_groups_changed)
+    {
+      connection->priv->tracking_contact_groups_changed = TRUE;
+
+      tp_cli_connection_interface_contact_groups_connect_to_groups_changed
+        (connection, contact_groups_changed_cb, NULL, NULL, NULL, NULL);
+    }
 }
 
-static const gchar **
-contacts_bind_to_signals (TpConnection *connection,
-    ContactFeatureFlags wanted,
-    ContactFeatureFlags *getting)
+static gboolean
+contacts_context_supports_iface (ContactsContext *context,
+    GQuark iface)
 {
   GArray *contact_attribute_interfaces =
-      connection->priv->contact_attribute_interfaces;
-  GPtrArray *array;
+      context->connection->priv->contact_attribute_interfaces;
   guint i;
-  guint len = 0;
-
-  if (getting != NULL)
-    *getting = 0;
-
-  if (contact_attribute_interfaces != NULL)
-      len = contact_attribute_interfaces->len;
 
-  g_assert (tp_proxy_has_interface_by_id (connection,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS));
+  if (!tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+    return FALSE;
 
-  array = g_ptr_array_sized_new (len);
+  if (contact_attribute_interfaces == NULL)
+    return FALSE;
 
-  for (i = 0; i < len; i++)
+  for (i = 0; i < contact_attribute_interfaces->len; i++)
     {
       GQuark q = g_array_index (contact_attribute_interfaces, GQuark, i);
 
-      if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_ALIAS) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_ALIASING);
-              contacts_bind_to_aliases_changed (connection);
+      if (q == iface)
+        return TRUE;
+    }
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_ALIAS;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_AVATAR_TOKEN) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_AVATARS);
-              contacts_bind_to_avatar_updated (connection);
+  return FALSE;
+}
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
-            }
+static void
+contacts_context_queue_features (ContactsContext *context)
+{
+  ContactFeatureFlags feature_flags = context->wanted;
 
-          if ((wanted & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0)
-            {
-              contacts_bind_to_avatar_retrieved (connection);
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_PRESENCE) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE);
-              contacts_bind_to_presences_changed (connection);
+  /* Start slow path for requested features that are not in
+   * ContactAttributeInterfaces */
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_PRESENCE;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_LOCATION) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_LOCATION);
-              contacts_bind_to_location_updated (connection);
+  if ((feature_flags & CONTACT_FEATURE_FLAG_ALIAS) != 0 &&
+      !contacts_context_supports_iface (context,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING) &&
+      tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING))
+    {
+      g_queue_push_tail (&context->todo, contacts_get_aliases);
+    }
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_LOCATION;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_CAPABILITIES)
+  if ((feature_flags & CONTACT_FEATURE_FLAG_PRESENCE) != 0 &&
+      !contacts_context_supports_iface (context,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
+    {
+      if (tp_proxy_has_interface_by_id (context->connection,
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
         {
-          if ((wanted & CONTACT_FEATURE_FLAG_CAPABILITIES) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES);
-              contacts_bind_to_capabilities_updated (connection);
-
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_CAPABILITIES;
-            }
+          g_queue_push_tail (&context->todo, contacts_get_simple_presence);
         }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO)
+#if 0
+      /* FIXME: Before doing this for the first time, we'd need to download
+       * from the CM the definition of what each status actually *means* */
+      else if (tp_proxy_has_interface_by_id (context->connection,
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_PRESENCE))
         {
-          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_INFO) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO);
-              contacts_bind_to_contact_info_changed (connection);
-
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_CONTACT_INFO;
-            }
+          g_queue_push_tail (&context->todo, contacts_get_complex_presence);
         }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CLIENT_TYPES)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_CLIENT_TYPES) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CLIENT_TYPES);
-              contacts_bind_to_client_types_updated (connection);
+#endif
+    }
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_CLIENT_TYPES;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_LIST)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_STATES) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST);
-              contacts_bind_to_contacts_changed (connection);
+  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_TOKEN) != 0 &&
+      !contacts_context_supports_iface (context,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS) &&
+      tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS))
+    {
+      g_queue_push_tail (&context->todo, contacts_get_avatar_tokens);
+    }
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_STATES;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_GROUPS)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_GROUPS) != 0)
-            {
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS);
-              contacts_bind_to_contact_groups_changed (connection);
+  /* There is no contact attribute for avatar data, always use slow path */
+  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0 &&
+      tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS))
+    {
+      g_queue_push_tail (&context->todo, contacts_get_avatar_data);
+    }
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_CONTACT_GROUPS;
-            }
-        }
-      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_BLOCKING)
-        {
-          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_BLOCKING) != 0)
-            {
-              GQuark features[] = { TP_CONNECTION_FEATURE_CONTACT_BLOCKING, 0 };
+  if ((feature_flags & CONTACT_FEATURE_FLAG_LOCATION) != 0 &&
+      !contacts_context_supports_iface (context,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION) &&
+      tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION))
+    {
+      WARNING ("%s supports Location but not Contacts! Where did you find "
+          "this CM? TP_CONTACT_FEATURE_LOCATION is not gonna work",
+          tp_proxy_get_object_path (context->connection));
+    }
 
-              g_ptr_array_add (array,
-                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_BLOCKING);
+  /* Don't implement slow path for ContactCapabilities as Contacts is now
+   * mandatory so any CM supporting ContactCapabilities will implement
+   * Contacts as well.
+   *
+   * But if ContactCapabilities is NOT supported, we fallback to connection
+   * capabilities.
+   * */
 
-              /* The BlockedContactsChanged signal is already handled by
-               * connection-contact-list.c so we just have to prepare
-               * TP_CONNECTION_FEATURE_CONTACT_BLOCKING to make sure it's
-               * connected. */
-              if (!tp_proxy_is_prepared (connection,
-                    TP_CONNECTION_FEATURE_CONTACT_BLOCKING))
-                {
-                  tp_proxy_prepare_async (connection, features, NULL, NULL);
-                }
+  if ((feature_flags & CONTACT_FEATURE_FLAG_CAPABILITIES) != 0 &&
+      !tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_CAPABILITIES))
+    {
+      DEBUG ("Connection doesn't support ContactCapabilities; fallback to "
+          "connection capabilities");
 
-              if (getting != NULL)
-                *getting |= CONTACT_FEATURE_FLAG_CONTACT_BLOCKING;
-            }
-        }
+      g_queue_push_tail (&context->todo, contacts_get_conn_capabilities);
+    }
+
+  if ((feature_flags & CONTACT_FEATURE_FLAG_CONTACT_INFO) != 0 &&
+      !contacts_context_supports_iface (context,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO) &&
+      tp_proxy_has_interface_by_id (context->connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO))
+    {
+      g_queue_push_tail (&context->todo, contacts_get_contact_info);
+    }
+}
+
+/* Update @contact's @wanted features from @asv. Features in @getting were
+ * requested from the connection manager, so their mandatory attributes
+ * should be there. @is_update is %TRUE if @asv is a change notification
+ * rather than the result of asking. */
+static void
+contact_apply_attributes (TpContact *contact,
+    GHashTable *asv,
+    ContactFeatureFlags wanted,
+    ContactFeatureFlags getting,
+    gboolean is_update)
+{
+  TpConnection *connection = tp_contact_get_connection (contact);
+  const gchar *s;
+  gpointer boxed;
+
+  /* Alias */
+  if (wanted & CONTACT_FEATURE_FLAG_ALIAS)
+    {
+      s = tp_asv_get_string (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_ALIASING_ALIAS);
+
+      if (s == NULL)
+        {
+          if (getting & CONTACT_FEATURE_FLAG_ALIAS)
+            {
+              WARNING ("%s supposedly implements Contacts and Aliasing, but "
+                  "omitted " TP_TOKEN_CONNECTION_INTERFACE_ALIASING_ALIAS,
+                  tp_proxy_get_object_path (connection));
+            }
+        }
+      else
+        {
+          contact->priv->has_features |= CONTACT_FEATURE_FLAG_ALIAS;
+          g_free (contact->priv->alias);
+          contact->priv->alias = g_strdup (s);
+
+          if (contact_should_notify (contact, TP_CONTACT_FEATURE_ALIAS))
+            g_object_notify ((GObject *) contact, "alias");
+        }
+    }
+
+  /* Avatar */
+  if (wanted & CONTACT_FEATURE_FLAG_AVATAR_TOKEN)
+    {
+      s = tp_asv_get_string (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_AVATARS_TOKEN);
+      contact_set_avatar_token (contact, s, TRUE);
+    }
+
+  if (wanted & CONTACT_FEATURE_FLAG_AVATAR_DATA)
+    {
+      /* There is no attribute for the avatar data, this will set the avatar
+       * from cache or start the avatar request if its missing from cache. */
+      contact_maybe_update_avatar_data (contact);
+    }
+
+  /* Presence */
+  if (wanted & CONTACT_FEATURE_FLAG_PRESENCE)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_SIMPLE_PRESENCE_PRESENCE,
+          TP_STRUCT_TYPE_SIMPLE_PRESENCE);
+
+      if (boxed == NULL)
+        {
+          if (getting & CONTACT_FEATURE_FLAG_PRESENCE)
+            {
+              WARNING ("%s supposedly implements Contacts and SimplePresence, "
+                  "but omitted the mandatory "
+                  TP_TOKEN_CONNECTION_INTERFACE_SIMPLE_PRESENCE_PRESENCE
+                  " attribute",
+                  tp_proxy_get_object_path (connection));
+            }
+        }
+      else
+        {
+          contact_maybe_set_simple_presence (contact, boxed);
+        }
+    }
+
+  /* Location */
+  if (wanted & CONTACT_FEATURE_FLAG_LOCATION)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_LOCATION_LOCATION,
+          TP_HASH_TYPE_LOCATION);
+      contact_maybe_set_location (contact, boxed, is_update);
+    }
+
+  /* Capabilities */
+  if (wanted & CONTACT_FEATURE_FLAG_CAPABILITIES)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_CAPABILITIES_CAPABILITIES,
+          TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST);
+      contact_maybe_set_capabilities (contact, boxed);
+    }
+
+  /* ContactInfo */
+  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_INFO)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_INFO_INFO,
+          TP_ARRAY_TYPE_CONTACT_INFO_FIELD_LIST);
+      contact_maybe_set_info (contact, boxed);
+    }
+
+  /* ClientTypes */
+  if (wanted & CONTACT_FEATURE_FLAG_CLIENT_TYPES)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_CLIENT_TYPES_CLIENT_TYPES,
+          G_TYPE_STRV);
+      contact_maybe_set_client_types (contact, boxed);
+    }
+
+  /* ContactList subscription states */
+  if (wanted & CONTACT_FEATURE_FLAG_STATES)
+    {
+      TpSubscriptionState subscribe;
+      TpSubscriptionState publish;
+      const gchar *publish_request;
+      gboolean subscribe_valid = FALSE;
+      gboolean publish_valid = FALSE;
+
+      subscribe = tp_asv_get_uint32 (asv,
+            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_SUBSCRIBE,
+            &subscribe_valid);
+      publish = tp_asv_get_uint32 (asv,
+            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH,
+            &publish_valid);
+      publish_request = tp_asv_get_string (asv,
+            TP_TOKEN_CONNECTION_INTERFACE_CONTACT_LIST_PUBLISH_REQUEST);
+
+      if (subscribe_valid && publish_valid)
+        {
+          contact_set_subscription_states (contact, subscribe, publish,
+              publish_request);
+        }
+    }
+
+  /* ContactGroups */
+  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_GROUPS)
+    {
+      boxed = tp_asv_get_boxed (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_GROUPS_GROUPS,
+          G_TYPE_STRV);
+      contact_maybe_set_contact_groups (contact, boxed);
+    }
+
+  /* ContactBlocking */
+  if (wanted & CONTACT_FEATURE_FLAG_CONTACT_BLOCKING)
+    {
+      gboolean is_blocked, valid;
+
+      is_blocked = tp_asv_get_boolean (asv,
+          TP_TOKEN_CONNECTION_INTERFACE_CONTACT_BLOCKING_BLOCKED, &valid);
+
+      if (valid)
+        _tp_contact_set_is_blocked (contact, is_blocked);
+    }
+}
+
+static gboolean
+tp_contact_set_attributes (TpContact *contact,
+    GHashTable *asv,
+    ContactFeatureFlags wanted,
+    ContactFeatureFlags getting,
+    GError **error)
+{
+  TpConnection *connection = tp_contact_get_connection (contact);
+  TpContactAttributesCache *cache;
+  const gchar *s;
+
+  /* Identifier */
+  s = tp_asv_get_string (asv, TP_TOKEN_CONNECTION_CONTACT_ID);
+
+  if (s == NULL)
+    {
+       g_set_error (error, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+          "Connection manager %s is broken: contact #%u in the "
+          "GetContactAttributes result has no contact-id",
+          tp_proxy_get_bus_name (connection), contact->priv->handle);
+
+      return FALSE;
+    }
+
+  DEBUG ("#%u: \"%s\"", contact->priv->handle, s);
+
+  {
+    GHashTableIter iter;
+    gpointer k, v;
+
+    g_hash_table_iter_init (&iter, asv);
+
+    while (g_hash_table_iter_next (&iter, &k, &v))
+      {
+        gchar *str = g_strdup_value_contents (v);
+
+        DEBUG ("- %s => %s", (const gchar *) k, str);
+        g_free (str);
+      }
+  }
+
+  if (contact->priv->identifier == NULL)
+    {
+      contact->priv->identifier = g_strdup (s);
+      _tp_connection_remember_id_handle (contact->priv->connection, s,
+          contact->priv->handle);
+    }
+  else if (tp_strdiff (contact->priv->identifier, s))
+    {
+      g_set_error (error, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+          "Connection manager %s is broken: contact #%u identifier "
+          "changed from %s to %s",
+          tp_proxy_get_bus_name (connection), contact->priv->handle,
+          contact->priv->identifier, s);
+
+      return FALSE;
+    }
+
+  cache = _tp_connection_get_contact_attributes_cache (connection);
+
+  if (cache != NULL &&
+      !_tp_contact_attributes_cache_update (cache, contact->priv->identifier,
+          asv, wanted) &&
+      (contact->priv->has_features & wanted) == wanted)
+    {
+      DEBUG ("#%u: unchanged since it was cached", contact->priv->handle);
+      return TRUE;
+    }
+
+  contact_apply_attributes (contact, asv, wanted, getting, FALSE);
+  return TRUE;
+}
+
+static gboolean get_feature_flags (guint n_features,
+    const TpContactFeature *features, ContactFeatureFlags *flags);
+
+gboolean
+_tp_contact_set_attributes (TpContact *contact,
+    GHashTable *asv,
+    guint n_features,
+    const TpContactFeature *features,
+    GError **error)
+{
+  ContactFeatureFlags feature_flags = 0;
+
+  if (!get_feature_flags (n_features, features, &feature_flags))
+    return FALSE;
+
+  return tp_contact_set_attributes (contact, asv, feature_flags,
+      0 /* can't know what we expected to get */, error);
+}
+
+/*
+ * _tp_contact_set_attributes_from_cache:
+ * @contact: a contact
+ * @n_features: the number of features
+ * @features: features for which attributes are wanted
+ *
+ * Give @contact the attributes it had last time, if they are in the
+ * connection's contact attributes cache and cover all of @features.
+ *
+ * Returns: %TRUE if @contact now has @features
+ */
+gboolean
+_tp_contact_set_attributes_from_cache (TpContact *contact,
+    guint n_features,
+    const TpContactFeature *features)
+{
+  TpContactAttributesCache *cache;
+  ContactFeatureFlags wanted = 0;
+  GHashTable *asv;
+  guint cached_features;
+  GError *error = NULL;
+  gboolean ret;
+
+  cache = _tp_connection_get_contact_attributes_cache (
+      contact->priv->connection);
+
+  if (cache == NULL || contact->priv->identifier == NULL ||
+      !get_feature_flags (n_features, features, &wanted))
+    return FALSE;
+
+  asv = _tp_contact_attributes_cache_lookup (cache,
+      contact->priv->identifier, &cached_features);
+
+  if (asv == NULL)
+    return FALSE;
+
+  if ((cached_features & wanted) != wanted)
+    {
+      g_hash_table_unref (asv);
+      return FALSE;
+    }
+
+  ret = tp_contact_set_attributes (contact, asv, wanted, 0, &error);
+
+  if (!ret)
+    {
+      DEBUG ("ignoring cached attributes: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_hash_table_unref (asv);
+  return ret;
+}
+
+static void
+contacts_got_attributes (TpConnection *connection,
+                         GHashTable *attributes,
+                         const GError *error,
+                         gpointer user_data,
+                         GObject *weak_object)
+{
+  ContactsContext *c = user_data;
+  guint i;
+
+  DEBUG ("%p: reply from GetContactAttributes: %s",
+      c, (error == NULL ? "OK" : error->message));
+
+  if (error != NULL)
+    {
+      contacts_context_fail (c, error);
+      return;
+    }
+
+  i = 0;
+
+  if (c->signature == CB_BY_HANDLE && c->contacts->len == 0)
+    {
+      while (i < c->handles->len)
+        {
+          TpHandle handle = g_array_index (c->handles, guint, i);
+          GHashTable *asv = g_hash_table_lookup (attributes,
+              GUINT_TO_POINTER (handle));
+
+          if (asv == NULL)
+            {
+              /* not in the hash table => not valid */
+              g_array_append_val (c->invalid, handle);
+              g_array_remove_index_fast (c->handles, i);
+            }
+          else
+            {
+              TpContact *contact = tp_contact_ensure (connection, handle);
+
+              g_ptr_array_add (c->contacts, contact);
+              i++;
+            }
+        }
+    }
+
+  g_assert (c->contacts->len == c->handles->len);
+
+  for (i = 0; i < c->handles->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (c->contacts, i);
+      GHashTable *asv = g_hash_table_lookup (attributes,
+          GUINT_TO_POINTER (contact->priv->handle));
+      GError *e = NULL;
+
+      if (asv == NULL)
+        {
+          g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+              "We hold a ref to handle #%u but it appears to be invalid",
+              contact->priv->handle);
+        }
+      else
+        {
+          /* set up the contact with its attributes */
+          tp_contact_set_attributes (contact, asv, c->wanted, c->getting, &e);
+        }
+
+      if (e != NULL)
+        {
+          contacts_context_fail (c, e);
+          g_error_free (e);
+          return;
+        }
+    }
+
+  _tp_connection_emit_contact_attributes_received (connection, c->contacts,
+      c->handles->len, c->handles->len);
+
+  contacts_context_continue (c);
+}
+
+typedef struct {
+    ContactsContext *context;
+    /* the contacts in this batch are handles[offset:offset + len] */
+    guint offset;
+    guint len;
+} AttributesBatch;
+
+static void
+attributes_batch_free (gpointer p)
+{
+  AttributesBatch *batch = p;
+
+  contacts_context_unref (batch->context);
+  g_slice_free (AttributesBatch, batch);
+}
+
+static void contacts_get_attributes_batches (ContactsContext *c);
+
+static void
+contacts_got_attributes_batch (TpConnection *connection,
+    GHashTable *attributes,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  AttributesBatch *batch = user_data;
+  ContactsContext *c = batch->context;
+  GPtrArray *received;
+  GError *e = NULL;
+  guint i;
+
+  DEBUG ("%p: reply from GetContactAttributes for %u-%u of %u: %s",
+      c, batch->offset, batch->offset + batch->len, c->handles->len,
+      (error == NULL ? "OK" : error->message));
+
+  c->attr_in_flight--;
+
+  /* we've already given up */
+  if (c->attr_failed)
+    return;
+
+  if (error != NULL)
+    {
+      c->attr_failed = TRUE;
+      contacts_context_fail (c, error);
+      return;
+    }
+
+  received = g_ptr_array_sized_new (batch->len);
+
+  for (i = batch->offset; i < batch->offset + batch->len; i++)
+    {
+      TpHandle handle = g_array_index (c->handles, TpHandle, i);
+      GHashTable *asv = g_hash_table_lookup (attributes,
+          GUINT_TO_POINTER (handle));
+      TpContact *contact;
+
+      if (c->attr_hold)
+        {
+          /* not in the hash table => not valid; we sort those out when
+           * every batch has come back */
+          if (asv == NULL)
+            continue;
+
+          contact = tp_contact_ensure (connection, handle);
+          g_assert (g_ptr_array_index (c->attr_slots, i) == NULL);
+          g_ptr_array_index (c->attr_slots, i) = contact;
+        }
+      else
+        {
+          contact = g_ptr_array_index (c->contacts, i);
+
+          if (asv == NULL)
+            {
+              g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+                  "We hold a ref to handle #%u but it appears to be invalid",
+                  handle);
+              break;
+            }
+        }
+
+      if (!tp_contact_set_attributes (contact, asv, c->wanted, c->getting,
+            &e))
+        break;
+
+      g_ptr_array_add (received, contact);
+    }
+
+  if (e != NULL)
+    {
+      c->attr_failed = TRUE;
+      contacts_context_fail (c, e);
+      g_error_free (e);
+      g_ptr_array_unref (received);
+      return;
+    }
+
+  c->attr_done += batch->len;
+  _tp_connection_emit_contact_attributes_received (connection, received,
+      c->attr_done, c->handles->len);
+  g_ptr_array_unref (received);
+
+  if (c->attr_next_offset < c->handles->len)
+    {
+      contacts_get_attributes_batches (c);
+      return;
+    }
+
+  if (c->attr_in_flight > 0)
+    return;
+
+  if (c->attr_hold)
+    {
+      guint j = 0;
+
+      /* Move the contacts we created into place, in the order their handles
+       * were given, and move the handles that turned out to be invalid
+       * to the other array */
+      g_assert (c->contacts->len == 0);
+
+      for (i = 0; i < c->handles->len; i++)
+        {
+          TpHandle handle = g_array_index (c->handles, TpHandle, i);
+          TpContact *contact = g_ptr_array_index (c->attr_slots, i);
+
+          if (contact == NULL)
+            {
+              g_array_append_val (c->invalid, handle);
+            }
+          else
+            {
+              g_ptr_array_add (c->contacts, contact);
+              g_ptr_array_index (c->attr_slots, i) = NULL;
+              g_array_index (c->handles, TpHandle, j++) = handle;
+            }
+        }
+
+      g_array_set_size (c->handles, j);
+    }
+
+  g_assert (c->contacts->len == c->handles->len);
+  contacts_context_continue (c);
+}
+
+/* Send GetContactAttributes calls until there are as many pending as we
+ * are allowed, or there are no more contacts to ask about */
+static void
+contacts_get_attributes_batches (ContactsContext *c)
+{
+  TpConnectionPrivate *priv = c->connection->priv;
+  guint max_in_flight = MAX (priv->contact_attributes_max_in_flight, 1);
+
+  while (c->attr_in_flight < max_in_flight &&
+      c->attr_next_offset < c->handles->len)
+    {
+      AttributesBatch *batch = g_slice_new0 (AttributesBatch);
+      GArray *handles;
+
+      batch->context = c;
+      c->refcount++;
+      batch->offset = c->attr_next_offset;
+      batch->len = MIN (priv->contact_attributes_batch_size,
+          c->handles->len - batch->offset);
+
+      c->attr_next_offset += batch->len;
+      c->attr_in_flight++;
+
+      handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+          batch->len);
+      g_array_append_vals (handles,
+          &g_array_index (c->handles, TpHandle, batch->offset), batch->len);
+
+      DEBUG ("%p: calling GetContactAttributes for %u-%u of %u", c,
+          batch->offset, batch->offset + batch->len, c->handles->len);
+
+      tp_cli_connection_interface_contacts_call_get_contact_attributes (
+          c->connection, -1, handles, c->attr_interfaces, c->attr_hold,
+          contacts_got_attributes_batch, batch, attributes_batch_free,
+          c->weak_object);
+      g_array_unref (handles);
+    }
+}
+
+/* The features whose attributes are all from @interface, if they are
+ * kept up to date by one of the six change notification signals that
+ * ContactAttributesChanged can replace */
+static ContactFeatureFlags
+contact_attributes_changed_features (GQuark interface)
+{
+  if (interface == TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING)
+    return CONTACT_FEATURE_FLAG_ALIAS;
+  else if (interface == TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS)
+    return CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
+  else if (interface == TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE)
+    return CONTACT_FEATURE_FLAG_PRESENCE;
+  else if (interface == TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION)
+    return CONTACT_FEATURE_FLAG_LOCATION;
+  else if (interface ==
+      TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_CAPABILITIES)
+    return CONTACT_FEATURE_FLAG_CAPABILITIES;
+  else if (interface == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO)
+    return CONTACT_FEATURE_FLAG_CONTACT_INFO;
+
+  return 0;
+}
+
+static void
+contacts_attributes_changed (TpConnection *connection,
+    GHashTable *attributes,
+    gpointer user_data G_GNUC_UNUSED,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_hash_table_iter_init (&iter, attributes);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      TpContact *contact = _tp_connection_lookup_contact (connection,
+          GPOINTER_TO_UINT (key));
+      const gchar * const *changed;
+      ContactFeatureFlags features = 0;
+      guint i;
+
+      if (contact == NULL)
+        continue;
+
+      changed = tp_asv_get_boxed (value,
+          TP_TOKEN_CONNECTION_INTERFACE_CONTACTS_CHANGED_INTERFACES,
+          G_TYPE_STRV);
+
+      if (changed == NULL)
+        {
+          DEBUG ("contact#%u: no changed-interfaces, ignoring",
+              GPOINTER_TO_UINT (key));
+          continue;
+        }
+
+      for (i = 0; changed[i] != NULL; i++)
+        features |= contact_attributes_changed_features (
+            g_quark_try_string (changed[i]));
+
+      /* the other features will get the new attributes when they are
+       * prepared, if ever */
+      features &= contact->priv->has_features;
+
+      /* these are not cached, as with the interfaces' own signals: the
+       * cache only has to be good enough to show something while asking
+       * for the current attributes */
+      if (features != 0)
+        contact_apply_attributes (contact, value, features, 0, TRUE);
+    }
+}
+
+/* Returns %TRUE if changes to @interface's attributes are signalled by
+ * ContactAttributesChanged, having made sure we are listening to it, or
+ * %FALSE if the caller should bind to @interface's own signals */
+static gboolean
+contacts_bind_to_contact_attributes_changed (TpConnection *connection,
+    GQuark interface)
+{
+  GArray *changed_interfaces =
+      connection->priv->contact_attributes_changed_interfaces;
+  guint i;
+
+  if (changed_interfaces == NULL)
+    return FALSE;
+
+  for (i = 0; i < changed_interfaces->len; i++)
+    {
+      if (g_array_index (changed_interfaces, GQuark, i) == interface)
+        break;
+    }
+
+  if (i == changed_interfaces->len)
+    return FALSE;
+
+  if (!connection->priv->tracking_contact_attributes_changed)
+    {
+      connection->priv->tracking_contact_attributes_changed = TRUE;
+
+      tp_cli_connection_interface_contacts_connect_to_contact_attributes_changed
+        (connection, contacts_attributes_changed, NULL, NULL, NULL, NULL);
+    }
+
+  return TRUE;
+}
+
+static const gchar **
+contacts_bind_to_signals (TpConnection *connection,
+    ContactFeatureFlags wanted,
+    ContactFeatureFlags *getting)
+{
+  GArray *contact_attribute_interfaces =
+      connection->priv->contact_attribute_interfaces;
+  GPtrArray *array;
+  guint i;
+  guint len = 0;
+
+  if (getting != NULL)
+    *getting = 0;
+
+  if (contact_attribute_interfaces != NULL)
+      len = contact_attribute_interfaces->len;
+
+  g_assert (tp_proxy_has_interface_by_id (connection,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS));
+
+  array = g_ptr_array_sized_new (len);
+
+  for (i = 0; i < len; i++)
+    {
+      GQuark q = g_array_index (contact_attribute_interfaces, GQuark, i);
+
+      if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_ALIAS) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_ALIASING);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_aliases_changed (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_ALIAS;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_AVATAR_TOKEN) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_AVATARS);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_avatar_updated (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
+            }
+
+          if ((wanted & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0)
+            {
+              contacts_bind_to_avatar_retrieved (connection);
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_PRESENCE) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_presences_changed (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_PRESENCE;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_LOCATION) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_LOCATION);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_location_updated (connection);
+              else
+                /* the connection manager only tells interested clients */
+                tp_connection_add_client_interest (connection,
+                    TP_IFACE_CONNECTION_INTERFACE_LOCATION);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_LOCATION;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_CAPABILITIES)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_CAPABILITIES) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_capabilities_updated (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_CAPABILITIES;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_INFO)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_INFO) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO);
+
+              if (!contacts_bind_to_contact_attributes_changed (
+                    connection, q))
+                contacts_bind_to_contact_info_changed (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_CONTACT_INFO;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CLIENT_TYPES)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_CLIENT_TYPES) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CLIENT_TYPES);
+              contacts_bind_to_client_types_updated (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_CLIENT_TYPES;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_LIST)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_STATES) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST);
+              contacts_bind_to_contacts_changed (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_STATES;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_GROUPS)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_GROUPS) != 0)
+            {
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS);
+              contacts_bind_to_contact_groups_changed (connection);
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_CONTACT_GROUPS;
+            }
+        }
+      else if (q == TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACT_BLOCKING)
+        {
+          if ((wanted & CONTACT_FEATURE_FLAG_CONTACT_BLOCKING) != 0)
+            {
+              GQuark features[] = { TP_CONNECTION_FEATURE_CONTACT_BLOCKING, 0 };
+
+              g_ptr_array_add (array,
+                  TP_IFACE_CONNECTION_INTERFACE_CONTACT_BLOCKING);
+
+              /* The BlockedContactsChanged signal is already handled by
+               * connection-contact-list.c so we just have to prepare
+               * TP_CONNECTION_FEATURE_CONTACT_BLOCKING to make sure it's
+               * connected. */
+              if (!tp_proxy_is_prepared (connection,
+                    TP_CONNECTION_FEATURE_CONTACT_BLOCKING))
+                {
+                  tp_proxy_prepare_async (connection, features, NULL, NULL);
+                }
+
+              if (getting != NULL)
+                *getting |= CONTACT_FEATURE_FLAG_CONTACT_BLOCKING;
+            }
+        }
     }
 
   g_ptr_array_add (array, NULL);
@@ -4366,151 +5908,602 @@ _tp_contacts_bind_to_signals (TpConnection *connection,
   ContactFeatureFlags feature_flags = 0;
 
   if (!get_feature_flags (n_features, features, &feature_flags))
-    return NULL;
+    return NULL;
+
+  return contacts_bind_to_signals (connection, feature_flags, NULL);
+}
+
+/* Give contacts the attributes they had last time, while we wait for the
+ * connection manager to tell us what they are now */
+static void
+contacts_prefill_from_cache (ContactsContext *c,
+    TpContactAttributesCache *cache)
+{
+  guint i;
+
+  for (i = 0; i < c->contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (c->contacts, i);
+      GHashTable *asv;
+      guint features;
+      GError *error = NULL;
+
+      if (contact->priv->identifier == NULL ||
+          (contact->priv->has_features & c->getting) == c->getting)
+        continue;
+
+      asv = _tp_contact_attributes_cache_lookup (cache,
+          contact->priv->identifier, &features);
+
+      if (asv == NULL)
+        continue;
+
+      DEBUG ("#%u: using cached attributes", contact->priv->handle);
+
+      if (!tp_contact_set_attributes (contact, asv, features & c->getting, 0,
+            &error))
+        {
+          DEBUG ("ignoring cached attributes: %s", error->message);
+          g_clear_error (&error);
+        }
+
+      g_hash_table_unref (asv);
+    }
+}
+
+static void
+contacts_get_attributes (ContactsContext *context)
+{
+  TpContactAttributesCache *cache;
+  const gchar **supported_interfaces;
+  guint batch_size;
+  guint i;
+
+  /* tp_connection_get_contact_attributes insists that you have at least one
+   * handle; skip it if we don't (can only happen if we started from IDs) */
+  if (context->handles->len == 0)
+    {
+      contacts_context_continue (context);
+      return;
+    }
+
+  supported_interfaces = contacts_bind_to_signals (context->connection,
+      context->wanted, &context->getting);
+
+  if (supported_interfaces[0] == NULL &&
+      !(context->signature == CB_BY_HANDLE && context->contacts->len == 0) &&
+      context->contacts_have_ids)
+    {
+      /* We're not going to do anything useful: we're not holding/inspecting
+       * the handles, and we're not inspecting any extended interfaces
+       * either. Skip it. */
+      g_free (supported_interfaces);
+      contacts_context_continue (context);
+      return;
+    }
+
+  for (i = 0; supported_interfaces[i] != NULL; i++)
+    DEBUG ("- %s", supported_interfaces[i]);
+
+  cache = _tp_connection_get_contact_attributes_cache (context->connection);
+
+  if (cache != NULL)
+    contacts_prefill_from_cache (context, cache);
+
+  batch_size = context->connection->priv->contact_attributes_batch_size;
+
+  if (batch_size != 0 && context->handles->len > batch_size)
+    {
+      DEBUG ("splitting GetContactAttributes for %u contacts into batches "
+          "of %u", context->handles->len, batch_size);
+
+      /* The Hold parameter is only true if we started from handles, and we
+       * don't already have all the contacts we need. */
+      context->attr_interfaces = supported_interfaces;
+      context->attr_hold = (context->signature == CB_BY_HANDLE &&
+          context->contacts->len == 0);
+
+      if (context->attr_hold)
+        {
+          context->attr_slots = g_ptr_array_sized_new (context->handles->len);
+          g_ptr_array_set_size (context->attr_slots, context->handles->len);
+        }
+
+      contacts_get_attributes_batches (context);
+      return;
+    }
+
+  /* The Hold parameter is only true if we started from handles, and we don't
+   * already have all the contacts we need. */
+  context->refcount++;
+  DEBUG ("calling GetContactAttributes");
+
+  tp_cli_connection_interface_contacts_call_get_contact_attributes (
+      context->connection, -1, context->handles, supported_interfaces,
+      (context->signature == CB_BY_HANDLE && context->contacts->len == 0),
+      contacts_got_attributes,
+      context, contacts_context_unref, context->weak_object);
+  g_free (supported_interfaces);
+}
+
+/*
+ * Returns a new GPtrArray of borrowed references to TpContacts,
+ * or NULL if any contacts could not be found.
+ */
+static GPtrArray *
+lookup_all_contacts (ContactsContext *context)
+{
+  GPtrArray *contacts = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < context->handles->len; i++)
+    {
+      TpContact *contact = _tp_connection_lookup_contact (context->connection,
+          g_array_index (context->handles, TpHandle, i));
+      if (contact != NULL)
+        {
+          g_ptr_array_add (contacts, contact);
+        }
+      else
+        {
+          g_ptr_array_unref (contacts);
+          contacts = NULL;
+          break;
+        }
+    }
+
+  return contacts;
+}
+
+/* If every ID in @context was recently resolved to a handle for which we
+ * still have a TpContact, fill in @context's handles and return those
+ * contacts, borrowed; otherwise return %NULL */
+static GPtrArray *
+lookup_all_contacts_by_id (ContactsContext *context)
+{
+  GPtrArray *contacts;
+  guint i;
+
+  /* -1 because NULL terminator is explicit */
+  for (i = 0; i < context->request_ids->len - 1; i++)
+    {
+      TpHandle handle = _tp_connection_lookup_id_handle (context->connection,
+          g_ptr_array_index (context->request_ids, i));
+
+      if (handle == 0)
+        {
+          g_array_set_size (context->handles, 0);
+          return NULL;
+        }
+
+      g_array_append_val (context->handles, handle);
+    }
+
+  contacts = lookup_all_contacts (context);
+
+  if (contacts == NULL)
+    g_array_set_size (context->handles, 0);
+
+  return contacts;
+}
+
+static gboolean
+get_feature_flags (guint n_features,
+    const TpContactFeature *features,
+    ContactFeatureFlags *flags)
+{
+  ContactFeatureFlags feature_flags = 0;
+  guint i;
+
+  for (i = 0; i < n_features; i++)
+    {
+      g_return_val_if_fail (features[i] < TP_NUM_CONTACT_FEATURES, FALSE);
+      feature_flags |= (1 << features[i]);
+    }
+
+  /* Force AVATAR_TOKEN if we have AVATAR_DATA */
+  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0)
+    feature_flags |= CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
+
+  *flags = feature_flags;
+
+  return TRUE;
+}
+
+static void
+contacts_context_remove_common_features (ContactsContext *context)
+{
+  ContactFeatureFlags minimal_feature_flags = 0xFFFFFFFF;
+  guint i;
+
+  context->contacts_have_ids = TRUE;
+
+  for (i = 0; i < context->contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (context->contacts, i);
+
+      minimal_feature_flags &= contact->priv->has_features;
+
+      if (contact->priv->identifier == NULL)
+        context->contacts_have_ids = FALSE;
+    }
+
+  context->wanted &= (~minimal_feature_flags);
+}
+
+
+/**
+ * tp_connection_get_contacts_by_handle:
+ * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
+ *  feature prepared
+ * @n_handles: The number of handles in @handles (must be at least 1)
+ * @handles: (array length=n_handles) (element-type uint): An array of handles
+ *  of type %TP_HANDLE_TYPE_CONTACT representing the desired contacts
+ * @n_features: The number of features in @features (may be 0)
+ * @features: (array length=n_features) (allow-none) (element-type uint): An array of features that
+ *  must be ready for use (if supported) before the callback is called (may
+ *  be %NULL if @n_features is 0)
+ * @callback: A user callback to call when the contacts are ready
+ * @user_data: Data to pass to the callback
+ * @destroy: Called to destroy @user_data either after @callback has been
+ *  called, or if the operation is cancelled
+ * @weak_object: (allow-none): An object to pass to the callback, which will be
+ *  weakly referenced; if this object is destroyed, the operation will be
+ *  cancelled
+ *
+ * Create a number of #TpContact objects and make asynchronous method calls
+ * to hold their handles and ensure that all the features specified in
+ * @features are ready for use (if they are supported at all).
+ *
+ * It is not an error to put features in @features even if the connection
+ * manager doesn't support them - users of this method should have a static
+ * list of features they would like to use if possible, and use it for all
+ * connection managers.
+ *
+ * Since: 0.7.18
+ * Deprecated: Use tp_simple_client_factory_ensure_contact() instead.
+ */
+void
+tp_connection_get_contacts_by_handle (TpConnection *self,
+                                      guint n_handles,
+                                      const TpHandle *handles,
+                                      guint n_features,
+                                      const TpContactFeature *features,
+                                      TpConnectionContactsByHandleCb callback,
+                                      gpointer user_data,
+                                      GDestroyNotify destroy,
+                                      GObject *weak_object)
+{
+  ContactFeatureFlags feature_flags = 0;
+  ContactsContext *context;
+  GPtrArray *contacts;
+
+  /* As an implementation detail, this method actually starts working slightly
+   * before we're officially ready. We use this to get the TpContact for the
+   * Connection. */
+  g_return_if_fail (self->priv->ready_enough_for_contacts);
+
+  g_return_if_fail (tp_proxy_get_invalidated (self) == NULL);
+  g_return_if_fail (n_handles >= 1);
+  g_return_if_fail (handles != NULL);
+  g_return_if_fail (n_features == 0 || features != NULL);
+  g_return_if_fail (callback != NULL);
+
+  if (!get_feature_flags (n_features, features, &feature_flags))
+    return;
 
-  return contacts_bind_to_signals (connection, feature_flags, NULL);
-}
+  context = contacts_context_new (self, n_handles, feature_flags,
+      CB_BY_HANDLE, user_data, destroy, weak_object);
+  context->callback.by_handle = callback;
 
-static void
-contacts_get_attributes (ContactsContext *context)
-{
-  const gchar **supported_interfaces;
-  guint i;
+  g_array_append_vals (context->handles, handles, n_handles);
 
-  /* tp_connection_get_contact_attributes insists that you have at least one
-   * handle; skip it if we don't (can only happen if we started from IDs) */
-  if (context->handles->len == 0)
+  contacts = lookup_all_contacts (context);
+
+  if (contacts != NULL)
     {
-      contacts_context_continue (context);
+      /* We have already held (and possibly inspected) handles, so we can
+       * skip that. */
+
+      g_ptr_array_foreach (contacts, (GFunc) g_object_ref, NULL);
+      tp_g_ptr_array_extend (context->contacts, contacts);
+
+      contacts_context_remove_common_features (context);
+
+      /* We do need to retrieve any features that aren't there yet, though. */
+      if (tp_proxy_has_interface_by_id (self,
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+        {
+          g_queue_push_head (&context->todo, contacts_get_attributes);
+        }
+
+      contacts_context_queue_features (context);
+
+      _tp_idle_add_full (TP_LATENCY_CLASS_NORMAL,
+          contacts_context_idle_continue, context, contacts_context_unref);
+
+      g_ptr_array_unref (contacts);
       return;
     }
 
-  supported_interfaces = contacts_bind_to_signals (context->connection,
-      context->wanted, &context->getting);
-
-  if (supported_interfaces[0] == NULL &&
-      !(context->signature == CB_BY_HANDLE && context->contacts->len == 0) &&
-      context->contacts_have_ids)
+  if (tp_proxy_has_interface_by_id (self,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
     {
-      /* We're not going to do anything useful: we're not holding/inspecting
-       * the handles, and we're not inspecting any extended interfaces
-       * either. Skip it. */
-      g_free (supported_interfaces);
-      contacts_context_continue (context);
+      /* we support the Contacts interface, so we can hold the handles and
+       * simultaneously inspect them. After that, we'll fill in any
+       * features that are necessary (this becomes a no-op if Contacts
+       * will give us everything). */
+      g_queue_push_head (&context->todo, contacts_get_attributes);
+      contacts_context_queue_features (context);
+      _tp_idle_add_full (TP_LATENCY_CLASS_NORMAL,
+          contacts_context_idle_continue, context, contacts_context_unref);
       return;
     }
 
-  /* The Hold parameter is only true if we started from handles, and we don't
-   * already have all the contacts we need. */
-  context->refcount++;
-  DEBUG ("calling GetContactAttributes");
+  /* if we haven't already returned, we're on the slow path */
+  DEBUG ("slow path");
 
-  for (i = 0; supported_interfaces[i] != NULL; i++)
-    DEBUG ("- %s", supported_interfaces[i]);
+  /* Before we return anything we'll want to inspect the handles */
+  g_queue_push_head (&context->todo, contacts_inspect);
 
-  tp_cli_connection_interface_contacts_call_get_contact_attributes (
-      context->connection, -1, context->handles, supported_interfaces,
-      (context->signature == CB_BY_HANDLE && context->contacts->len == 0),
-      contacts_got_attributes,
-      context, contacts_context_unref, context->weak_object);
-  g_free (supported_interfaces);
+  /* After that we'll get the features */
+  contacts_context_queue_features (context);
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  /* but first, we need to hold onto them */
+  tp_connection_hold_handles (self, -1,
+      TP_HANDLE_TYPE_CONTACT, n_handles, handles,
+      contacts_held_handles, context, contacts_context_unref, weak_object);
+  G_GNUC_END_IGNORE_DEPRECATIONS
 }
 
-/*
- * Returns a new GPtrArray of borrowed references to TpContacts,
- * or NULL if any contacts could not be found.
+
+/**
+ * tp_connection_upgrade_contacts:
+ * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
+ *  feature prepared
+ * @n_contacts: The number of contacts in @contacts (must be at least 1)
+ * @contacts: (array length=n_contacts): An array of #TpContact objects
+ *  associated with @self
+ * @n_features: The number of features in @features (must be at least 1)
+ * @features: (array length=n_features): An array of features that must be
+ *  ready for use (if supported) before the callback is called
+ * @callback: A user callback to call when the contacts are ready
+ * @user_data: Data to pass to the callback
+ * @destroy: Called to destroy @user_data either after @callback has been
+ *  called, or if the operation is cancelled
+ * @weak_object: (allow-none): An object to pass to the callback, which will be
+ *  weakly referenced; if this object is destroyed, the operation will be
+ *  cancelled
+ *
+ * Given several #TpContact objects, make asynchronous method calls
+ * ensure that all the features specified in @features are ready for use
+ * (if they are supported at all).
+ *
+ * It is not an error to put features in @features even if the connection
+ * manager doesn't support them - users of this method should have a static
+ * list of features they would like to use if possible, and use it for all
+ * connection managers.
+ *
+ * Since: 0.7.18
+ * Deprecated: Use tp_connection_upgrade_contacts_async() instead.
  */
-static GPtrArray *
-lookup_all_contacts (ContactsContext *context)
+void
+tp_connection_upgrade_contacts (TpConnection *self,
+                                guint n_contacts,
+                                TpContact * const *contacts,
+                                guint n_features,
+                                const TpContactFeature *features,
+                                TpConnectionUpgradeContactsCb callback,
+                                gpointer user_data,
+                                GDestroyNotify destroy,
+                                GObject *weak_object)
 {
-  GPtrArray *contacts = g_ptr_array_new ();
+  ContactFeatureFlags feature_flags = 0;
+  ContactsContext *context;
   guint i;
 
-  for (i = 0; i < context->handles->len; i++)
+  /* As an implementation detail, this method actually starts working slightly
+   * before we're officially ready. We use this to get the TpContact for the
+   * Connection. */
+  g_return_if_fail (self->priv->ready_enough_for_contacts);
+  g_return_if_fail (n_contacts >= 1);
+  g_return_if_fail (contacts != NULL);
+  g_return_if_fail (n_features == 0 || features != NULL);
+  g_return_if_fail (callback != NULL);
+
+  for (i = 0; i < n_contacts; i++)
     {
-      TpContact *contact = _tp_connection_lookup_contact (context->connection,
-          g_array_index (context->handles, TpHandle, i));
-      if (contact != NULL)
-        {
-          g_ptr_array_add (contacts, contact);
-        }
-      else
-        {
-          g_ptr_array_unref (contacts);
-          contacts = NULL;
-          break;
-        }
+      g_return_if_fail (contacts[i]->priv->connection == self);
+      g_return_if_fail (contacts[i]->priv->identifier != NULL);
+    }
+
+  if (!get_feature_flags (n_features, features, &feature_flags))
+    return;
+
+  context = contacts_context_new (self, n_contacts, feature_flags,
+      CB_UPGRADE, user_data, destroy, weak_object);
+  context->callback.upgrade = callback;
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      g_ptr_array_add (context->contacts, g_object_ref (contacts[i]));
+      g_array_append_val (context->handles, contacts[i]->priv->handle);
+    }
+
+  g_assert (context->handles->len == n_contacts);
+
+  contacts_context_remove_common_features (context);
+
+  if (tp_proxy_has_interface_by_id (self,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+    {
+      g_queue_push_head (&context->todo, contacts_get_attributes);
+    }
+
+  contacts_context_queue_features (context);
+
+  /* use an idle to make sure the callback is called after we return,
+   * even if all the contacts actually have all the features, just to be
+   * consistent */
+  _tp_idle_add_full (TP_LATENCY_CLASS_NORMAL,
+      contacts_context_idle_continue, context, contacts_context_unref);
+}
+
+
+static void
+contacts_requested_one_handle (TpConnection *connection,
+                               TpHandleType handle_type,
+                               guint n_handles,
+                               const TpHandle *handles,
+                               const gchar * const *ids,
+                               const GError *error,
+                               gpointer user_data,
+                               GObject *weak_object)
+{
+  ContactsContext *c = user_data;
+
+  if (error == NULL)
+    {
+      TpContact *contact;
+
+      g_assert (handle_type == TP_HANDLE_TYPE_CONTACT);
+      /* -1 because NULL terminator is explicit */
+      g_assert (c->next_index < c->request_ids->len - 1);
+
+      g_assert (n_handles == 1);
+      g_assert (handles[0] != 0);
+
+      contact = tp_contact_ensure (connection, handles[0]);
+      _tp_connection_remember_id_handle (connection,
+          g_ptr_array_index (c->request_ids, c->next_index), handles[0]);
+      g_array_append_val (c->handles, handles[0]);
+      g_ptr_array_add (c->contacts, contact);
+      c->next_index++;
+    }
+  else if (error->domain == TP_ERROR &&
+      (error->code == TP_ERROR_INVALID_HANDLE ||
+       error->code == TP_ERROR_NOT_AVAILABLE ||
+       error->code == TP_ERROR_INVALID_ARGUMENT))
+    {
+      g_hash_table_insert (c->request_errors,
+          g_ptr_array_index (c->request_ids, c->next_index),
+          g_error_copy (error));
+      /* shift the rest of the IDs down one and do not increment next_index */
+      g_ptr_array_remove_index (c->request_ids, c->next_index);
+    }
+  else
+    {
+      contacts_context_fail (c, error);
+      return;
     }
 
-  return contacts;
+  contacts_context_continue (c);
 }
 
-static gboolean
-get_feature_flags (guint n_features,
-    const TpContactFeature *features,
-    ContactFeatureFlags *flags)
-{
-  ContactFeatureFlags feature_flags = 0;
-  guint i;
-
-  for (i = 0; i < n_features; i++)
-    {
-      g_return_val_if_fail (features[i] < TP_NUM_CONTACT_FEATURES, FALSE);
-      feature_flags |= (1 << features[i]);
-    }
 
-  /* Force AVATAR_TOKEN if we have AVATAR_DATA */
-  if ((feature_flags & CONTACT_FEATURE_FLAG_AVATAR_DATA) != 0)
-    feature_flags |= CONTACT_FEATURE_FLAG_AVATAR_TOKEN;
+static void
+contacts_request_one_handle (ContactsContext *c)
+{
+  const gchar *ids[] = { NULL, NULL };
 
-  *flags = feature_flags;
+  ids[0] = g_ptr_array_index (c->request_ids, c->next_index);
+  g_assert (ids[0] != NULL);
 
-  return TRUE;
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  c->refcount++;
+  tp_connection_request_handles (c->connection, -1,
+      TP_HANDLE_TYPE_CONTACT, ids,
+      contacts_requested_one_handle, c, contacts_context_unref,
+      c->weak_object);
+  G_GNUC_END_IGNORE_DEPRECATIONS
 }
 
+
 static void
-contacts_context_remove_common_features (ContactsContext *context)
+contacts_requested_handles (TpConnection *connection,
+                            TpHandleType handle_type,
+                            guint n_handles,
+                            const TpHandle *handles,
+                            const gchar * const *ids,
+                            const GError *error,
+                            gpointer user_data,
+                            GObject *weak_object)
 {
-  ContactFeatureFlags minimal_feature_flags = 0xFFFFFFFF;
-  guint i;
+  ContactsContext *c = user_data;
 
-  context->contacts_have_ids = TRUE;
+  g_assert (handle_type == TP_HANDLE_TYPE_CONTACT);
+  g_assert (weak_object == c->weak_object);
 
-  for (i = 0; i < context->contacts->len; i++)
+  if (error == NULL)
     {
-      TpContact *contact = g_ptr_array_index (context->contacts, i);
+      guint i;
 
-      minimal_feature_flags &= contact->priv->has_features;
+      for (i = 0; i < n_handles; i++)
+        {
+          TpContact *contact = tp_contact_ensure (connection, handles[i]);
 
-      if (contact->priv->identifier == NULL)
-        context->contacts_have_ids = FALSE;
+          /* remember the IDs as the caller spelled them, too */
+          _tp_connection_remember_id_handle (connection,
+              g_ptr_array_index (c->request_ids, i), handles[i]);
+          g_array_append_val (c->handles, handles[i]);
+          g_ptr_array_add (c->contacts, contact);
+        }
     }
+  else if (error->domain == TP_ERROR &&
+      (error->code == TP_ERROR_INVALID_HANDLE ||
+       error->code == TP_ERROR_NOT_AVAILABLE ||
+       error->code == TP_ERROR_INVALID_ARGUMENT))
+    {
+      /* One of the strings is bad. We don't know which, so split them. */
+      guint i;
 
-  context->wanted &= (~minimal_feature_flags);
+      DEBUG ("A handle was bad, trying to recover: %s %u: %s",
+          g_quark_to_string (error->domain), error->code, error->message);
+
+      /* -1 because NULL terminator is explicit */
+      for (i = 0; i < c->request_ids->len - 1; i++)
+        {
+          g_queue_push_head (&c->todo, contacts_request_one_handle);
+        }
+
+      g_assert (c->next_index == 0);
+    }
+  else
+    {
+      DEBUG ("RequestHandles failed: %s %u: %s",
+          g_quark_to_string (error->domain), error->code, error->message);
+      contacts_context_fail (c, error);
+      return;
+    }
+
+  contacts_context_continue (c);
 }
 
 
 /**
- * tp_connection_get_contacts_by_handle:
+ * tp_connection_get_contacts_by_id:
  * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
  *  feature prepared
- * @n_handles: The number of handles in @handles (must be at least 1)
- * @handles: (array length=n_handles) (element-type uint): An array of handles
- *  of type %TP_HANDLE_TYPE_CONTACT representing the desired contacts
+ * @n_ids: The number of IDs in @ids (must be at least 1)
+ * @ids: (array length=n_ids) (transfer none): An array of strings representing
+ *  the desired contacts by their
+ *  identifiers in the IM protocol (XMPP JIDs, SIP URIs, MSN Passports,
+ *  AOL screen-names etc.)
  * @n_features: The number of features in @features (may be 0)
- * @features: (array length=n_features) (allow-none) (element-type uint): An array of features that
- *  must be ready for use (if supported) before the callback is called (may
- *  be %NULL if @n_features is 0)
+ * @features: (array length=n_features) (allow-none): An array of features
+ *  that must be ready for use (if supported)
+ *  before the callback is called (may be %NULL if @n_features is 0)
  * @callback: A user callback to call when the contacts are ready
  * @user_data: Data to pass to the callback
  * @destroy: Called to destroy @user_data either after @callback has been
  *  called, or if the operation is cancelled
- * @weak_object: (allow-none): An object to pass to the callback, which will be
- *  weakly referenced; if this object is destroyed, the operation will be
+ * @weak_object: (allow-none): An object to pass to the callback, which will
+ *  be weakly referenced; if this object is destroyed, the operation will be
  *  cancelled
  *
  * Create a number of #TpContact objects and make asynchronous method calls
- * to hold their handles and ensure that all the features specified in
+ * to obtain their handles and ensure that all the features specified in
  * @features are ready for use (if they are supported at all).
  *
  * It is not an error to put features in @features even if the connection
@@ -4519,56 +6512,65 @@ contacts_context_remove_common_features (ContactsContext *context)
  * connection managers.
  *
  * Since: 0.7.18
- * Deprecated: Use tp_simple_client_factory_ensure_contact() instead.
+ * Deprecated: Use tp_connection_dup_contact_by_id_async() instead.
  */
 void
-tp_connection_get_contacts_by_handle (TpConnection *self,
-                                      guint n_handles,
-                                      const TpHandle *handles,
-                                      guint n_features,
-                                      const TpContactFeature *features,
-                                      TpConnectionContactsByHandleCb callback,
-                                      gpointer user_data,
-                                      GDestroyNotify destroy,
-                                      GObject *weak_object)
+tp_connection_get_contacts_by_id (TpConnection *self,
+                                  guint n_ids,
+                                  const gchar * const *ids,
+                                  guint n_features,
+                                  const TpContactFeature *features,
+                                  TpConnectionContactsByIdCb callback,
+                                  gpointer user_data,
+                                  GDestroyNotify destroy,
+                                  GObject *weak_object)
 {
   ContactFeatureFlags feature_flags = 0;
   ContactsContext *context;
   GPtrArray *contacts;
+  guint i;
 
-  /* As an implementation detail, this method actually starts working slightly
-   * before we're officially ready. We use this to get the TpContact for the
-   * Connection. */
-  g_return_if_fail (self->priv->ready_enough_for_contacts);
-
-  g_return_if_fail (tp_proxy_get_invalidated (self) == NULL);
-  g_return_if_fail (n_handles >= 1);
-  g_return_if_fail (handles != NULL);
+  g_return_if_fail (tp_proxy_is_prepared (self,
+        TP_CONNECTION_FEATURE_CONNECTED));
+  g_return_if_fail (n_ids >= 1);
+  g_return_if_fail (ids != NULL);
+  g_return_if_fail (ids[0] != NULL);
   g_return_if_fail (n_features == 0 || features != NULL);
   g_return_if_fail (callback != NULL);
 
   if (!get_feature_flags (n_features, features, &feature_flags))
     return;
 
-  context = contacts_context_new (self, n_handles, feature_flags,
-      CB_BY_HANDLE, user_data, destroy, weak_object);
-  context->callback.by_handle = callback;
+  context = contacts_context_new (self, n_ids, feature_flags,
+      CB_BY_ID, user_data, destroy, weak_object);
+  context->callback.by_id = callback;
+  context->request_errors = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_error_free);
 
-  g_array_append_vals (context->handles, handles, n_handles);
+  context->request_ids = g_ptr_array_sized_new (n_ids);
 
-  contacts = lookup_all_contacts (context);
+  for (i = 0; i < n_ids; i++)
+    {
+      g_return_if_fail (ids[i] != NULL);
+      g_ptr_array_add (context->request_ids, g_strdup (ids[i]));
+    }
+
+  g_ptr_array_add (context->request_ids, NULL);
+
+  contacts = lookup_all_contacts_by_id (context);
 
   if (contacts != NULL)
     {
-      /* We have already held (and possibly inspected) handles, so we can
-       * skip that. */
+      /* We have resolved all these IDs recently, so we can skip
+       * RequestHandles, and the D-Bus calls altogether if the contacts
+       * already have the features. */
+      DEBUG ("all %u IDs were already known", n_ids);
 
       g_ptr_array_foreach (contacts, (GFunc) g_object_ref, NULL);
       tp_g_ptr_array_extend (context->contacts, contacts);
 
       contacts_context_remove_common_features (context);
 
-      /* We do need to retrieve any features that aren't there yet, though. */
       if (tp_proxy_has_interface_by_id (self,
             TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
         {
@@ -4577,65 +6579,188 @@ tp_connection_get_contacts_by_handle (TpConnection *self,
 
       contacts_context_queue_features (context);
 
-      g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-          contacts_context_idle_continue, context, contacts_context_unref);
+      _tp_idle_add_full (TP_LATENCY_CLASS_NORMAL,
+          contacts_context_idle_continue, context, contacts_context_unref);
+
+      g_ptr_array_unref (contacts);
+      return;
+    }
+
+  /* set up the queue of feature introspection */
+
+  if (tp_proxy_has_interface_by_id (self,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+    {
+      g_queue_push_head (&context->todo, contacts_get_attributes);
+    }
+  else
+    {
+      g_queue_push_head (&context->todo, contacts_inspect);
+    }
+
+  contacts_context_queue_features (context);
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  /* but first, we need to get the handles in the first place */
+  tp_connection_request_handles (self, -1,
+      TP_HANDLE_TYPE_CONTACT,
+      (const gchar * const *) context->request_ids->pdata,
+      contacts_requested_handles, context, contacts_context_unref,
+      weak_object);
+  G_GNUC_END_IGNORE_DEPRECATIONS
+}
+
+typedef struct {
+    GSimpleAsyncResult *result;
+    gchar *id;
+    ContactFeatureFlags features;
+} ByIdRequest;
+
+static void
+by_id_request_free (gpointer p)
+{
+  ByIdRequest *request = p;
+
+  g_object_unref (request->result);
+  g_free (request->id);
+  g_slice_free (ByIdRequest, request);
+}
+
+static void
+by_id_requests_free (gpointer p)
+{
+  GQueue *requests = p;
+
+  g_queue_free_full (requests, by_id_request_free);
+}
+
+static void
+got_contacts_by_id_merged_cb (TpConnection *self,
+    guint n_contacts,
+    TpContact * const *contacts,
+    const gchar * const *requested_ids,
+    GHashTable *failed_id_errors,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GQueue *requests = user_data;
+  GList *l;
+  guint i;
+
+  for (l = requests->head; l != NULL; l = l->next)
+    {
+      ByIdRequest *request = l->data;
+      TpContact *contact = NULL;
+      GError *e = NULL;
+
+      if (error != NULL)
+        {
+          g_simple_async_result_set_from_error (request->result, error);
+          g_simple_async_result_complete_in_idle (request->result);
+          continue;
+        }
+
+      for (i = 0; i < n_contacts; i++)
+        {
+          if (!tp_strdiff (requested_ids[i], request->id))
+            {
+              contact = contacts[i];
+              break;
+            }
+        }
+
+      if (contact != NULL)
+        {
+          g_simple_async_result_set_op_res_gpointer (request->result,
+              g_object_ref (contact), g_object_unref);
+        }
+      else if (g_hash_table_lookup (failed_id_errors, request->id) != NULL)
+        {
+          g_simple_async_result_set_from_error (request->result,
+              g_hash_table_lookup (failed_id_errors, request->id));
+        }
+      else
+        {
+          g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+              "We requested id '%s', but got neither a contact nor an "
+              "error for it - Broken CM", request->id);
+          g_simple_async_result_take_error (request->result, e);
+        }
+
+      g_simple_async_result_complete_in_idle (request->result);
+    }
+}
+
+static gboolean
+get_contacts_by_id_idle_cb (gpointer user_data)
+{
+  TpConnection *self = user_data;
+  GQueue *requests = g_queue_new ();
+  GHashTable *seen = g_hash_table_new (g_str_hash, g_str_equal);
+  GPtrArray *ids = g_ptr_array_new ();
+  GArray *features = g_array_new (FALSE, FALSE, sizeof (TpContactFeature));
+  ContactFeatureFlags feature_flags = 0;
+  TpContactFeature feature;
+  GList *l;
+
+  /* take everything that was queued during the last main loop iteration */
+  *requests = self->priv->by_id_queue;
+  g_queue_init (&self->priv->by_id_queue);
+  self->priv->by_id_idle_id = 0;
+
+  for (l = requests->head; l != NULL; l = l->next)
+    {
+      ByIdRequest *request = l->data;
+
+      if (!g_hash_table_contains (seen, request->id))
+        {
+          g_hash_table_add (seen, request->id);
+          g_ptr_array_add (ids, request->id);
+        }
 
-      g_ptr_array_unref (contacts);
-      return;
+      feature_flags |= request->features;
     }
 
-  if (tp_proxy_has_interface_by_id (self,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+  for (feature = 0; feature < TP_NUM_CONTACT_FEATURES; feature++)
     {
-      /* we support the Contacts interface, so we can hold the handles and
-       * simultaneously inspect them. After that, we'll fill in any
-       * features that are necessary (this becomes a no-op if Contacts
-       * will give us everything). */
-      g_queue_push_head (&context->todo, contacts_get_attributes);
-      contacts_context_queue_features (context);
-      g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-          contacts_context_idle_continue, context, contacts_context_unref);
-      return;
+      if ((feature_flags & (1 << feature)) != 0)
+        g_array_append_val (features, feature);
     }
 
-  /* if we haven't already returned, we're on the slow path */
-  DEBUG ("slow path");
-
-  /* Before we return anything we'll want to inspect the handles */
-  g_queue_push_head (&context->todo, contacts_inspect);
-
-  /* After that we'll get the features */
-  contacts_context_queue_features (context);
+  DEBUG ("merged %u requests by ID into one for %u IDs",
+      g_queue_get_length (requests), ids->len);
 
   G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  /* but first, we need to hold onto them */
-  tp_connection_hold_handles (self, -1,
-      TP_HANDLE_TYPE_CONTACT, n_handles, handles,
-      contacts_held_handles, context, contacts_context_unref, weak_object);
+  tp_connection_get_contacts_by_id (self,
+      ids->len, (const gchar * const *) ids->pdata,
+      features->len, (const TpContactFeature *) features->data,
+      got_contacts_by_id_merged_cb,
+      requests, by_id_requests_free, NULL);
   G_GNUC_END_IGNORE_DEPRECATIONS
-}
 
+  g_array_unref (features);
+  g_ptr_array_unref (ids);
+  g_hash_table_unref (seen);
+  return FALSE;
+}
 
 /**
- * tp_connection_upgrade_contacts:
+ * tp_connection_dup_contact_by_id_async:
  * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
  *  feature prepared
- * @n_contacts: The number of contacts in @contacts (must be at least 1)
- * @contacts: (array length=n_contacts): An array of #TpContact objects
- *  associated with @self
- * @n_features: The number of features in @features (must be at least 1)
- * @features: (array length=n_features): An array of features that must be
- *  ready for use (if supported) before the callback is called
- * @callback: A user callback to call when the contacts are ready
+ * @id: A strings representing the desired contact by its
+ *  identifier in the IM protocol (an XMPP JID, SIP URI, MSN Passport,
+ *  AOL screen-name etc.)
+ * @n_features: The number of features in @features (may be 0)
+ * @features: (array length=n_features) (allow-none): An array of features
+ *  that must be ready for use (if supported)
+ *  before the callback is called (may be %NULL if @n_features is 0)
+ * @callback: A user callback to call when the contact is ready
  * @user_data: Data to pass to the callback
- * @destroy: Called to destroy @user_data either after @callback has been
- *  called, or if the operation is cancelled
- * @weak_object: (allow-none): An object to pass to the callback, which will be
- *  weakly referenced; if this object is destroyed, the operation will be
- *  cancelled
  *
- * Given several #TpContact objects, make asynchronous method calls
- * ensure that all the features specified in @features are ready for use
+ * Create a #TpContact object and make any asynchronous method calls necessary
+ * to ensure that all the features specified in @features are ready for use
  * (if they are supported at all).
  *
  * It is not an error to put features in @features even if the connection
@@ -4643,435 +6768,526 @@ tp_connection_get_contacts_by_handle (TpConnection *self,
  * list of features they would like to use if possible, and use it for all
  * connection managers.
  *
- * Since: 0.7.18
- * Deprecated: Use tp_connection_upgrade_contacts_async() instead.
+ * If @id was recently resolved to a contact which already has all of
+ * @features, no D-Bus calls are made. Calls made during the same main loop
+ * iteration are otherwise merged: the union of their identifiers is
+ * looked up, with the union of their features, by a single set of D-Bus
+ * calls, and then each of them completes.
+ *
+ * Since: 0.19.0
  */
 void
-tp_connection_upgrade_contacts (TpConnection *self,
-                                guint n_contacts,
-                                TpContact * const *contacts,
-                                guint n_features,
-                                const TpContactFeature *features,
-                                TpConnectionUpgradeContactsCb callback,
-                                gpointer user_data,
-                                GDestroyNotify destroy,
-                                GObject *weak_object)
+tp_connection_dup_contact_by_id_async (TpConnection *self,
+    const gchar *id,
+    guint n_features,
+    const TpContactFeature *features,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
+  ByIdRequest *request;
   ContactFeatureFlags feature_flags = 0;
-  ContactsContext *context;
-  guint i;
+  TpHandle handle;
 
-  /* As an implementation detail, this method actually starts working slightly
-   * before we're officially ready. We use this to get the TpContact for the
-   * Connection. */
-  g_return_if_fail (self->priv->ready_enough_for_contacts);
-  g_return_if_fail (n_contacts >= 1);
-  g_return_if_fail (contacts != NULL);
+  /* the same checks as tp_connection_get_contacts_by_id(), done now so they
+   * are blamed on the right caller */
+  g_return_if_fail (tp_proxy_is_prepared (self,
+        TP_CONNECTION_FEATURE_CONNECTED));
+  g_return_if_fail (id != NULL);
   g_return_if_fail (n_features == 0 || features != NULL);
-  g_return_if_fail (callback != NULL);
-
-  for (i = 0; i < n_contacts; i++)
-    {
-      g_return_if_fail (contacts[i]->priv->connection == self);
-      g_return_if_fail (contacts[i]->priv->identifier != NULL);
-    }
 
   if (!get_feature_flags (n_features, features, &feature_flags))
     return;
 
-  context = contacts_context_new (self, n_contacts, feature_flags,
-      CB_UPGRADE, user_data, destroy, weak_object);
-  context->callback.upgrade = callback;
-
-  for (i = 0; i < n_contacts; i++)
-    {
-      g_ptr_array_add (context->contacts, g_object_ref (contacts[i]));
-      g_array_append_val (context->handles, contacts[i]->priv->handle);
-    }
-
-  g_assert (context->handles->len == n_contacts);
+  request = g_slice_new0 (ByIdRequest);
+  request->result = g_simple_async_result_new ((GObject *) self, callback,
+      user_data, tp_connection_dup_contact_by_id_async);
+  request->id = g_strdup (id);
+  request->features = feature_flags;
 
-  contacts_context_remove_common_features (context);
+  handle = _tp_connection_lookup_id_handle (self, id);
 
-  if (tp_proxy_has_interface_by_id (self,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
+  if (handle != 0)
     {
-      g_queue_push_head (&context->todo, contacts_get_attributes);
+      TpContact *contact = _tp_connection_lookup_contact (self, handle);
+
+      if (contact != NULL &&
+          (contact->priv->has_features & feature_flags) == feature_flags)
+        {
+          /* we already have everything the caller asked for */
+          g_simple_async_result_set_op_res_gpointer (request->result,
+              g_object_ref (contact), g_object_unref);
+          g_simple_async_result_complete_in_idle (request->result);
+          by_id_request_free (request);
+          return;
+        }
     }
 
-  contacts_context_queue_features (context);
+  g_queue_push_tail (&self->priv->by_id_queue, request);
 
-  /* use an idle to make sure the callback is called after we return,
-   * even if all the contacts actually have all the features, just to be
-   * consistent */
-  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
-      contacts_context_idle_continue, context, contacts_context_unref);
+  if (self->priv->by_id_idle_id == 0)
+    self->priv->by_id_idle_id = _tp_idle_add_full (
+        TP_LATENCY_CLASS_NORMAL, get_contacts_by_id_idle_cb,
+        g_object_ref (self), g_object_unref);
+}
+
+/**
+ * tp_connection_dup_contact_by_id_finish:
+ * @self: a #TpConnection
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes tp_connection_dup_contact_by_id_async().
+ *
+ * Returns: (transfer full): a #TpContact or %NULL on error.
+ * Since: 0.19.0
+ */
+TpContact *
+tp_connection_dup_contact_by_id_finish (TpConnection *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_return_copy_pointer (self,
+      tp_connection_dup_contact_by_id_async, g_object_ref);
 }
 
+typedef struct {
+    TpConnection *connection;
+    GSimpleAsyncResult *result;
+    GArray *features;
+    /* owned address => owned TpContact */
+    GHashTable *contacts;
+} ByAddressRequest;
 
 static void
-contacts_requested_one_handle (TpConnection *connection,
-                               TpHandleType handle_type,
-                               guint n_handles,
-                               const TpHandle *handles,
-                               const gchar * const *ids,
-                               const GError *error,
-                               gpointer user_data,
-                               GObject *weak_object)
+by_address_request_free (ByAddressRequest *request)
 {
-  ContactsContext *c = user_data;
-
-  if (error == NULL)
-    {
-      TpContact *contact;
+  g_object_unref (request->connection);
+  g_object_unref (request->result);
+  g_array_unref (request->features);
+  tp_clear_pointer (&request->contacts, g_hash_table_unref);
+  g_slice_free (ByAddressRequest, request);
+}
 
-      g_assert (handle_type == TP_HANDLE_TYPE_CONTACT);
-      /* -1 because NULL terminator is explicit */
-      g_assert (c->next_index < c->request_ids->len - 1);
+static void
+by_address_request_complete (ByAddressRequest *request)
+{
+  g_simple_async_result_set_op_res_gpointer (request->result,
+      request->contacts, (GDestroyNotify) g_hash_table_unref);
+  request->contacts = NULL;
+  g_simple_async_result_complete (request->result);
+  by_address_request_free (request);
+}
 
-      g_assert (n_handles == 1);
-      g_assert (handles[0] != 0);
+static void
+contacts_by_address_upgraded_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  ByAddressRequest *request = user_data;
+  GError *error = NULL;
 
-      contact = tp_contact_ensure (connection, handles[0]);
-      g_array_append_val (c->handles, handles[0]);
-      g_ptr_array_add (c->contacts, contact);
-      c->next_index++;
-    }
-  else if (error->domain == TP_ERROR &&
-      (error->code == TP_ERROR_INVALID_HANDLE ||
-       error->code == TP_ERROR_NOT_AVAILABLE ||
-       error->code == TP_ERROR_INVALID_ARGUMENT))
+  /* the contacts still exist, just without all the features */
+  if (!tp_connection_upgrade_contacts_finish (request->connection, res, NULL,
+          &error))
     {
-      g_hash_table_insert (c->request_errors,
-          g_ptr_array_index (c->request_ids, c->next_index),
-          g_error_copy (error));
-      /* shift the rest of the IDs down one and do not increment next_index */
-      g_ptr_array_remove_index (c->request_ids, c->next_index);
-    }
-  else
-    {
-      contacts_context_fail (c, error);
-      return;
+      DEBUG ("Error upgrading contacts found by address: %s",
+          error->message);
+      g_clear_error (&error);
     }
 
-  contacts_context_continue (c);
+  by_address_request_complete (request);
 }
 
-
 static void
-contacts_request_one_handle (ContactsContext *c)
+got_contacts_by_address_cb (TpConnection *self,
+    GHashTable *requested,
+    GHashTable *attributes,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
 {
-  const gchar *ids[] = { NULL, NULL };
-
-  ids[0] = g_ptr_array_index (c->request_ids, c->next_index);
-  g_assert (ids[0] != NULL);
-
-  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  c->refcount++;
-  tp_connection_request_handles (c->connection, -1,
-      TP_HANDLE_TYPE_CONTACT, ids,
-      contacts_requested_one_handle, c, contacts_context_unref,
-      c->weak_object);
-  G_GNUC_END_IGNORE_DEPRECATIONS
-}
+  ByAddressRequest *request = user_data;
+  const TpContactFeature *features =
+      (const TpContactFeature *) request->features->data;
+  guint n_features = request->features->len;
+  GPtrArray *incomplete;
+  GHashTable *seen;
+  GHashTableIter iter;
+  gpointer key, value;
 
+  if (error != NULL)
+    {
+      g_simple_async_result_set_from_error (request->result, error);
+      g_simple_async_result_complete (request->result);
+      by_address_request_free (request);
+      return;
+    }
 
-static void
-contacts_requested_handles (TpConnection *connection,
-                            TpHandleType handle_type,
-                            guint n_handles,
-                            const TpHandle *handles,
-                            const gchar * const *ids,
-                            const GError *error,
-                            gpointer user_data,
-                            GObject *weak_object)
-{
-  ContactsContext *c = user_data;
+  request->contacts = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+  incomplete = g_ptr_array_new ();
+  seen = g_hash_table_new (NULL, NULL);
 
-  g_assert (handle_type == TP_HANDLE_TYPE_CONTACT);
-  g_assert (weak_object == c->weak_object);
+  g_hash_table_iter_init (&iter, requested);
 
-  if (error == NULL)
+  while (g_hash_table_iter_next (&iter, &key, &value))
     {
+      TpHandle handle = GPOINTER_TO_UINT (value);
+      GHashTable *asv = g_hash_table_lookup (attributes, value);
+      const gchar *id = NULL;
+      TpContact *contact;
+      GError *e = NULL;
       guint i;
 
-      for (i = 0; i < n_handles; i++)
+      if (asv != NULL)
+        id = tp_asv_get_string (asv, TP_TOKEN_CONNECTION_CONTACT_ID);
+
+      if (id == NULL)
         {
-          TpContact *contact = tp_contact_ensure (connection, handles[i]);
+          DEBUG ("CM didn't give us the identifier of handle %u for '%s'",
+              handle, (const gchar *) key);
+          continue;
+        }
 
-          g_array_append_val (c->handles, handles[i]);
-          g_ptr_array_add (c->contacts, contact);
+      contact = tp_simple_client_factory_ensure_contact (
+          tp_proxy_get_factory (self), self, handle, id);
+
+      if (contact == NULL)
+        continue;
+
+      if (!_tp_contact_set_attributes (contact, asv, n_features, features,
+            &e))
+        {
+          DEBUG ("Error setting contact attributes: %s", e->message);
+          g_clear_error (&e);
         }
-    }
-  else if (error->domain == TP_ERROR &&
-      (error->code == TP_ERROR_INVALID_HANDLE ||
-       error->code == TP_ERROR_NOT_AVAILABLE ||
-       error->code == TP_ERROR_INVALID_ARGUMENT))
-    {
-      /* One of the strings is bad. We don't know which, so split them. */
-      guint i;
 
-      DEBUG ("A handle was bad, trying to recover: %s %u: %s",
-          g_quark_to_string (error->domain), error->code, error->message);
+      g_hash_table_insert (request->contacts, g_strdup (key), contact);
+
+      /* the attributes gave us almost everything, but some features need
+       * other calls, which tp_connection_upgrade_contacts_async() knows
+       * how to make */
+      for (i = 0; i < n_features; i++)
+        {
+          if (!tp_contact_has_feature (contact, features[i]))
+            {
+              if (g_hash_table_lookup (seen, contact) == NULL)
+                {
+                  g_hash_table_insert (seen, contact, contact);
+                  g_ptr_array_add (incomplete, contact);
+                }
 
-      /* -1 because NULL terminator is explicit */
-      for (i = 0; i < c->request_ids->len - 1; i++)
-        {
-          g_queue_push_head (&c->todo, contacts_request_one_handle);
+              break;
+            }
         }
-
-      g_assert (c->next_index == 0);
     }
+
+  if (incomplete->len > 0)
+    tp_connection_upgrade_contacts_async (self, incomplete->len,
+        (TpContact * const *) incomplete->pdata, n_features, features,
+        contacts_by_address_upgraded_cb, request);
   else
+    by_address_request_complete (request);
+
+  g_hash_table_unref (seen);
+  g_ptr_array_unref (incomplete);
+}
+
+/* @vcard_field is NULL for URIs */
+static void
+dup_contacts_by_addresses (TpConnection *self,
+    const gchar *vcard_field,
+    const gchar * const *addresses,
+    guint n_features,
+    const TpContactFeature *features,
+    GAsyncReadyCallback callback,
+    gpointer user_data,
+    gpointer source_tag)
+{
+  ByAddressRequest *request;
+  const gchar **interfaces;
+
+  /* Addressing requires Contacts, but don't crash if the CM forgot */
+  if (!tp_proxy_has_interface_by_id (self,
+          TP_IFACE_QUARK_CONNECTION_INTERFACE_ADDRESSING) ||
+      !tp_proxy_has_interface_by_id (self,
+          TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
     {
-      DEBUG ("RequestHandles failed: %s %u: %s",
-          g_quark_to_string (error->domain), error->code, error->message);
-      contacts_context_fail (c, error);
+      g_simple_async_report_error_in_idle ((GObject *) self, callback,
+          user_data, TP_DBUS_ERRORS, TP_DBUS_ERROR_NO_INTERFACE,
+          "Connection does not implement Addressing and Contacts");
       return;
     }
 
-  contacts_context_continue (c);
-}
+  interfaces = _tp_contacts_bind_to_signals (self, n_features, features);
+
+  /* invalid features, which get_feature_flags() has already warned about */
+  if (interfaces == NULL)
+    return;
+
+  request = g_slice_new0 (ByAddressRequest);
+  request->connection = g_object_ref (self);
+  request->result = g_simple_async_result_new ((GObject *) self, callback,
+      user_data, source_tag);
+  request->features = g_array_sized_new (FALSE, FALSE,
+      sizeof (TpContactFeature), n_features);
+  g_array_append_vals (request->features, features, n_features);
+
+  /* the callback is always called, so it frees the request */
+  if (vcard_field == NULL)
+    tp_cli_connection_interface_addressing_call_get_contacts_by_uri (self,
+        -1, (const gchar **) addresses, interfaces,
+        got_contacts_by_address_cb, request, NULL, NULL);
+  else
+    tp_cli_connection_interface_addressing_call_get_contacts_by_vcard_field (
+        self, -1, vcard_field, (const gchar **) addresses, interfaces,
+        got_contacts_by_address_cb, request, NULL, NULL);
 
+  g_free (interfaces);
+}
 
 /**
- * tp_connection_get_contacts_by_id:
+ * tp_connection_dup_contacts_by_uris_async:
  * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
  *  feature prepared
- * @n_ids: The number of IDs in @ids (must be at least 1)
- * @ids: (array length=n_ids) (transfer none): An array of strings representing
- *  the desired contacts by their
- *  identifiers in the IM protocol (XMPP JIDs, SIP URIs, MSN Passports,
- *  AOL screen-names etc.)
+ * @uris: (array zero-terminated=1): the URIs of the desired contacts, such
+ *  as <literal>tel:+15551234567</literal> or
+ *  <literal>xmpp:alice@example.com</literal>
  * @n_features: The number of features in @features (may be 0)
  * @features: (array length=n_features) (allow-none): An array of features
  *  that must be ready for use (if supported)
  *  before the callback is called (may be %NULL if @n_features is 0)
  * @callback: A user callback to call when the contacts are ready
  * @user_data: Data to pass to the callback
- * @destroy: Called to destroy @user_data either after @callback has been
- *  called, or if the operation is cancelled
- * @weak_object: (allow-none): An object to pass to the callback, which will
- *  be weakly referenced; if this object is destroyed, the operation will be
- *  cancelled
  *
- * Create a number of #TpContact objects and make asynchronous method calls
- * to obtain their handles and ensure that all the features specified in
- * @features are ready for use (if they are supported at all).
+ * Find the contacts identified by all of @uris, using the Addressing
+ * interface, and make any asynchronous method calls necessary to ensure
+ * that all the features specified in @features are ready for use (if they
+ * are supported at all).
  *
- * It is not an error to put features in @features even if the connection
- * manager doesn't support them - users of this method should have a static
- * list of features they would like to use if possible, and use it for all
- * connection managers.
+ * This resolves all of @uris with a single D-Bus call, which also returns
+ * the contact attributes for @features, so it is much faster than looking
+ * up each URI separately. Only if some features cannot be obtained from
+ * contact attributes are the contacts then passed to
+ * tp_connection_upgrade_contacts_async().
  *
- * Since: 0.7.18
- * Deprecated: Use tp_connection_dup_contact_by_id_async() instead.
+ * If the connection does not have the Addressing interface, this fails
+ * with %TP_DBUS_ERROR_NO_INTERFACE.
+ *
+ * Since: 0.UNRELEASED
  */
 void
-tp_connection_get_contacts_by_id (TpConnection *self,
-                                  guint n_ids,
-                                  const gchar * const *ids,
-                                  guint n_features,
-                                  const TpContactFeature *features,
-                                  TpConnectionContactsByIdCb callback,
-                                  gpointer user_data,
-                                  GDestroyNotify destroy,
-                                  GObject *weak_object)
+tp_connection_dup_contacts_by_uris_async (TpConnection *self,
+    const gchar * const *uris,
+    guint n_features,
+    const TpContactFeature *features,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
 {
-  ContactFeatureFlags feature_flags = 0;
-  ContactsContext *context;
-  guint i;
-
   g_return_if_fail (tp_proxy_is_prepared (self,
         TP_CONNECTION_FEATURE_CONNECTED));
-  g_return_if_fail (n_ids >= 1);
-  g_return_if_fail (ids != NULL);
-  g_return_if_fail (ids[0] != NULL);
+  g_return_if_fail (uris != NULL);
   g_return_if_fail (n_features == 0 || features != NULL);
-  g_return_if_fail (callback != NULL);
-
-  if (!get_feature_flags (n_features, features, &feature_flags))
-    return;
-
-  context = contacts_context_new (self, n_ids, feature_flags,
-      CB_BY_ID, user_data, destroy, weak_object);
-  context->callback.by_id = callback;
-  context->request_errors = g_hash_table_new_full (g_str_hash, g_str_equal,
-      g_free, (GDestroyNotify) g_error_free);
-
-  context->request_ids = g_ptr_array_sized_new (n_ids);
-
-  for (i = 0; i < n_ids; i++)
-    {
-      g_return_if_fail (ids[i] != NULL);
-      g_ptr_array_add (context->request_ids, g_strdup (ids[i]));
-    }
-
-  g_ptr_array_add (context->request_ids, NULL);
-
-  /* set up the queue of feature introspection */
-
-  if (tp_proxy_has_interface_by_id (self,
-        TP_IFACE_QUARK_CONNECTION_INTERFACE_CONTACTS))
-    {
-      g_queue_push_head (&context->todo, contacts_get_attributes);
-    }
-  else
-    {
-      g_queue_push_head (&context->todo, contacts_inspect);
-    }
-
-  contacts_context_queue_features (context);
 
-  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  /* but first, we need to get the handles in the first place */
-  tp_connection_request_handles (self, -1,
-      TP_HANDLE_TYPE_CONTACT,
-      (const gchar * const *) context->request_ids->pdata,
-      contacts_requested_handles, context, contacts_context_unref,
-      weak_object);
-  G_GNUC_END_IGNORE_DEPRECATIONS
+  dup_contacts_by_addresses (self, NULL, uris, n_features, features,
+      callback, user_data, tp_connection_dup_contacts_by_uris_async);
 }
 
-static void
-got_contact_by_id_fallback_cb (TpConnection *self,
-    guint n_contacts,
-    TpContact * const *contacts,
-    const gchar * const *requested_ids,
-    GHashTable *failed_id_errors,
-    const GError *error,
-    gpointer user_data,
-    GObject *weak_object)
+/**
+ * tp_connection_dup_contacts_by_uris_finish:
+ * @self: a #TpConnection
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes tp_connection_dup_contacts_by_uris_async().
+ *
+ * Returns: (transfer full) (element-type utf8 TelepathyGLib.Contact): a map
+ *  from each of the URIs that identified a contact to that #TpContact, or
+ *  %NULL on error. URIs which the connection manager did not understand
+ *  are left out.
+ * Since: 0.UNRELEASED
+ */
+GHashTable *
+tp_connection_dup_contacts_by_uris_finish (TpConnection *self,
+    GAsyncResult *result,
+    GError **error)
 {
-  const gchar *id = user_data;
-  GSimpleAsyncResult *result = (GSimpleAsyncResult *) weak_object;
-  GError *e = NULL;
-
-  if (error != NULL)
-    {
-      g_simple_async_result_set_from_error (result, error);
-    }
-  else if (g_hash_table_size (failed_id_errors) > 0)
-    {
-      e = g_hash_table_lookup (failed_id_errors, id);
-
-      if (e == NULL)
-        {
-          g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
-              "We requested 1 id, and got an error for another id - Broken CM");
-          g_simple_async_result_take_error (result, e);
-        }
-      else
-        {
-          g_simple_async_result_set_from_error (result, e);
-        }
-    }
-  else if (n_contacts != 1 || contacts[0] == NULL)
-    {
-      g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
-          "We requested 1 id, but no contacts and no error - Broken CM");
-      g_simple_async_result_take_error (result, e);
-    }
-  else
-    {
-      g_simple_async_result_set_op_res_gpointer (result,
-          g_object_ref (contacts[0]), g_object_unref);
-    }
-
-  g_simple_async_result_complete_in_idle (result);
-  g_object_unref (result);
+  _tp_implement_finish_return_copy_pointer (self,
+      tp_connection_dup_contacts_by_uris_async, g_hash_table_ref);
 }
 
 /**
- * tp_connection_dup_contact_by_id_async:
+ * tp_connection_dup_contacts_by_vcard_field_async:
  * @self: A connection, which must have the %TP_CONNECTION_FEATURE_CONNECTED
  *  feature prepared
- * @id: A strings representing the desired contact by its
- *  identifier in the IM protocol (an XMPP JID, SIP URI, MSN Passport,
- *  AOL screen-name etc.)
+ * @vcard_field: the vCard field of all of @addresses, in lower case, such
+ *  as <literal>tel</literal> or <literal>x-jabber</literal>; this must not
+ *  be <literal>url</literal>, for which
+ *  tp_connection_dup_contacts_by_uris_async() should be used instead
+ * @addresses: (array zero-terminated=1): the addresses of the desired
+ *  contacts
  * @n_features: The number of features in @features (may be 0)
  * @features: (array length=n_features) (allow-none): An array of features
  *  that must be ready for use (if supported)
  *  before the callback is called (may be %NULL if @n_features is 0)
- * @callback: A user callback to call when the contact is ready
+ * @callback: A user callback to call when the contacts are ready
  * @user_data: Data to pass to the callback
  *
- * Create a #TpContact object and make any asynchronous method calls necessary
- * to ensure that all the features specified in @features are ready for use
- * (if they are supported at all).
- *
- * It is not an error to put features in @features even if the connection
- * manager doesn't support them - users of this method should have a static
- * list of features they would like to use if possible, and use it for all
- * connection managers.
+ * The same as tp_connection_dup_contacts_by_uris_async(), but for vCard
+ * addresses.
  *
- * Since: 0.19.0
+ * Since: 0.UNRELEASED
  */
 void
-tp_connection_dup_contact_by_id_async (TpConnection *self,
-    const gchar *id,
+tp_connection_dup_contacts_by_vcard_field_async (TpConnection *self,
+    const gchar *vcard_field,
+    const gchar * const *addresses,
     guint n_features,
     const TpContactFeature *features,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
-  GSimpleAsyncResult *result;
-
-  result = g_simple_async_result_new ((GObject *) self, callback, user_data,
-      tp_connection_dup_contact_by_id_async);
+  g_return_if_fail (tp_proxy_is_prepared (self,
+        TP_CONNECTION_FEATURE_CONNECTED));
+  g_return_if_fail (vcard_field != NULL);
+  g_return_if_fail (addresses != NULL);
+  g_return_if_fail (n_features == 0 || features != NULL);
 
-  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  tp_connection_get_contacts_by_id (self,
-      1, &id,
-      n_features, features,
-      got_contact_by_id_fallback_cb,
-      g_strdup (id), g_free, G_OBJECT (result));
-  G_GNUC_END_IGNORE_DEPRECATIONS
+  dup_contacts_by_addresses (self, vcard_field, addresses, n_features,
+      features, callback, user_data,
+      tp_connection_dup_contacts_by_vcard_field_async);
 }
 
 /**
- * tp_connection_dup_contact_by_id_finish:
+ * tp_connection_dup_contacts_by_vcard_field_finish:
  * @self: a #TpConnection
  * @result: a #GAsyncResult
  * @error: a #GError to fill
  *
- * Finishes tp_connection_dup_contact_by_id_async().
+ * Finishes tp_connection_dup_contacts_by_vcard_field_async().
  *
- * Returns: (transfer full): a #TpContact or %NULL on error.
- * Since: 0.19.0
+ * Returns: (transfer full) (element-type utf8 TelepathyGLib.Contact): a map
+ *  from each of the addresses that identified a contact to that
+ *  #TpContact, or %NULL on error
+ * Since: 0.UNRELEASED
  */
-TpContact *
-tp_connection_dup_contact_by_id_finish (TpConnection *self,
+GHashTable *
+tp_connection_dup_contacts_by_vcard_field_finish (TpConnection *self,
     GAsyncResult *result,
     GError **error)
 {
   _tp_implement_finish_return_copy_pointer (self,
-      tp_connection_dup_contact_by_id_async, g_object_ref);
+      tp_connection_dup_contacts_by_vcard_field_async, g_hash_table_ref);
+}
+
+typedef struct {
+    GSimpleAsyncResult *result;
+    /* owned TpContact, as passed to tp_connection_upgrade_contacts_async() */
+    GPtrArray *contacts;
+    ContactFeatureFlags features;
+} UpgradeRequest;
+
+static void
+upgrade_request_free (gpointer p)
+{
+  UpgradeRequest *request = p;
+
+  g_object_unref (request->result);
+  g_ptr_array_unref (request->contacts);
+  g_slice_free (UpgradeRequest, request);
+}
+
+static void
+upgrade_requests_free (gpointer p)
+{
+  GQueue *requests = p;
+
+  g_queue_free_full (requests, upgrade_request_free);
 }
 
 static void
-upgrade_contacts_fallback_cb (TpConnection *connection,
+upgrade_contacts_merged_cb (TpConnection *connection,
     guint n_contacts,
     TpContact * const *contacts,
     const GError *error,
     gpointer user_data,
     GObject *weak_object)
 {
-  GSimpleAsyncResult *result = user_data;
-  GPtrArray *contacts_array;
+  GQueue *requests = user_data;
+  GList *l;
+
+  for (l = requests->head; l != NULL; l = l->next)
+    {
+      UpgradeRequest *request = l->data;
+
+      g_simple_async_result_set_op_res_gpointer (request->result,
+          g_ptr_array_ref (request->contacts),
+          (GDestroyNotify) g_ptr_array_unref);
+
+      if (error != NULL)
+        g_simple_async_result_set_from_error (request->result, error);
+
+      g_simple_async_result_complete_in_idle (request->result);
+    }
+}
+
+static gboolean
+upgrade_contacts_idle_cb (gpointer user_data)
+{
+  TpConnection *self = user_data;
+  GQueue *requests = g_queue_new ();
+  GHashTable *seen = g_hash_table_new (NULL, NULL);
+  GPtrArray *contacts = g_ptr_array_new ();
+  GArray *features = g_array_new (FALSE, FALSE, sizeof (TpContactFeature));
+  ContactFeatureFlags feature_flags = 0;
+  TpContactFeature feature;
+  GList *l;
   guint i;
 
-  contacts_array = g_ptr_array_new_full (n_contacts, g_object_unref);
-  for (i = 0; i < n_contacts; i++)
-    g_ptr_array_add (contacts_array, g_object_ref (contacts[i]));
+  /* take everything that was queued during the last main loop iteration */
+  *requests = self->priv->upgrade_queue;
+  g_queue_init (&self->priv->upgrade_queue);
+  self->priv->upgrade_idle_id = 0;
 
-  g_simple_async_result_set_op_res_gpointer (result, contacts_array,
-      (GDestroyNotify) g_ptr_array_unref);
+  for (l = requests->head; l != NULL; l = l->next)
+    {
+      UpgradeRequest *request = l->data;
 
-  if (error != NULL)
-    g_simple_async_result_set_from_error (result, error);
+      for (i = 0; i < request->contacts->len; i++)
+        {
+          TpContact *contact = g_ptr_array_index (request->contacts, i);
 
-  g_simple_async_result_complete_in_idle (result);
+          if (!g_hash_table_contains (seen, contact))
+            {
+              g_hash_table_add (seen, contact);
+              g_ptr_array_add (contacts, contact);
+            }
+        }
+
+      feature_flags |= request->features;
+    }
+
+  for (feature = 0; feature < TP_NUM_CONTACT_FEATURES; feature++)
+    {
+      if ((feature_flags & (1 << feature)) != 0)
+        g_array_append_val (features, feature);
+    }
+
+  DEBUG ("merged %u upgrade requests into one for %u contacts",
+      g_queue_get_length (requests), contacts->len);
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  tp_connection_upgrade_contacts (self,
+      contacts->len, (TpContact * const *) contacts->pdata,
+      features->len, (const TpContactFeature *) features->data,
+      upgrade_contacts_merged_cb,
+      requests, upgrade_requests_free, NULL);
+  G_GNUC_END_IGNORE_DEPRECATIONS
+
+  g_array_unref (features);
+  g_ptr_array_unref (contacts);
+  g_hash_table_unref (seen);
+  return FALSE;
 }
 
 /**
@@ -5096,6 +7312,10 @@ upgrade_contacts_fallback_cb (TpConnection *connection,
  * list of features they would like to use if possible, and use it for all
  * connection managers.
  *
+ * Calls made during the same main loop iteration are merged: the union of
+ * their contacts is upgraded to the union of their features with a single
+ * set of D-Bus calls, and then each of them completes.
+ *
  * Since: 0.19.0
  */
 void
@@ -5107,18 +7327,41 @@ tp_connection_upgrade_contacts_async (TpConnection *self,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
-  GSimpleAsyncResult *result;
+  UpgradeRequest *request;
+  ContactFeatureFlags feature_flags = 0;
+  guint i;
+
+  /* the same checks as tp_connection_upgrade_contacts(), done now so they
+   * are blamed on the right caller */
+  g_return_if_fail (self->priv->ready_enough_for_contacts);
+  g_return_if_fail (n_contacts >= 1);
+  g_return_if_fail (contacts != NULL);
+  g_return_if_fail (n_features == 0 || features != NULL);
 
-  result = g_simple_async_result_new ((GObject *) self, callback, user_data,
-      tp_connection_upgrade_contacts_async);
+  for (i = 0; i < n_contacts; i++)
+    {
+      g_return_if_fail (contacts[i]->priv->connection == self);
+      g_return_if_fail (contacts[i]->priv->identifier != NULL);
+    }
 
-  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-  tp_connection_upgrade_contacts (self,
-      n_contacts, contacts,
-      n_features, features,
-      upgrade_contacts_fallback_cb,
-      result, g_object_unref, NULL);
-  G_GNUC_END_IGNORE_DEPRECATIONS
+  if (!get_feature_flags (n_features, features, &feature_flags))
+    return;
+
+  request = g_slice_new0 (UpgradeRequest);
+  request->result = g_simple_async_result_new ((GObject *) self, callback,
+      user_data, tp_connection_upgrade_contacts_async);
+  request->contacts = g_ptr_array_new_full (n_contacts, g_object_unref);
+  request->features = feature_flags;
+
+  for (i = 0; i < n_contacts; i++)
+    g_ptr_array_add (request->contacts, g_object_ref (contacts[i]));
+
+  g_queue_push_tail (&self->priv->upgrade_queue, request);
+
+  if (self->priv->upgrade_idle_id == 0)
+    self->priv->upgrade_idle_id = _tp_idle_add_full (
+        TP_LATENCY_CLASS_NORMAL, upgrade_contacts_idle_cb, g_object_ref (self),
+        g_object_unref);
 }
 
 /**
@@ -5158,7 +7401,8 @@ _tp_contact_set_is_blocked (TpContact *self,
 
   self->priv->is_blocked = is_blocked;
 
-  g_object_notify ((GObject *) self, "is-blocked");
+  if (contact_should_notify (self, TP_CONTACT_FEATURE_CONTACT_BLOCKING))
+    g_object_notify ((GObject *) self, "is-blocked");
 }
 
 /**
@@ -84,6 +84,10 @@ TpHandle tp_contact_get_handle (TpContact *self);
 const gchar *tp_contact_get_identifier (TpContact *self);
 gboolean tp_contact_has_feature (TpContact *self, TpContactFeature feature);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contact_set_notify_individually (TpContact *self,
+    gboolean enabled);
+
 /* TP_CONTACT_FEATURE_ALIAS */
 const gchar *tp_contact_get_alias (TpContact *self);
 
@@ -99,6 +103,8 @@ const gchar *tp_contact_get_presence_message (TpContact *self);
 GHashTable *tp_contact_get_location (TpContact *self);
 _TP_AVAILABLE_IN_0_20
 GVariant *tp_contact_dup_location (TpContact *self);
+_TP_AVAILABLE_IN_UNRELEASED
+GVariant *tp_contact_get_location_vardict (TpContact *self);
 
 /* TP_CONTACT_FEATURE_CAPABILITIES */
 TpCapabilities *tp_contact_get_capabilities (TpContact *self);
@@ -107,6 +113,21 @@ TpCapabilities *tp_contact_get_capabilities (TpContact *self);
 GFile *tp_contact_get_avatar_file (TpContact *self);
 const gchar *tp_contact_get_avatar_mime_type (TpContact *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contact_request_avatar_data_async (TpContact *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_contact_request_avatar_data_finish (TpContact *self,
+    GAsyncResult *result,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_set_contacts_visible (TpConnection *self,
+    guint n_contacts,
+    TpContact * const *contacts,
+    gboolean visible);
+
 /* TP_CONTACT_FEATURE_INFO */
 #ifndef TP_DISABLE_DEPRECATED
 _TP_DEPRECATED_IN_0_20_FOR (tp_contact_dup_contact_info)
@@ -115,6 +136,8 @@ GList *tp_contact_get_contact_info (TpContact *self);
 
 _TP_AVAILABLE_IN_0_20
 GList *tp_contact_dup_contact_info (TpContact *self);
+_TP_AVAILABLE_IN_UNRELEASED
+const GList *tp_contact_peek_contact_info (TpContact *self);
 
 void tp_contact_request_contact_info_async (TpContact *self,
     GCancellable *cancellable, GAsyncReadyCallback callback,
@@ -126,6 +149,15 @@ gboolean tp_contact_request_contact_info_finish (TpContact *self,
 void tp_connection_refresh_contact_info (TpConnection *self,
     guint n_contacts, TpContact * const *contacts);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_request_contact_info_async (TpConnection *self,
+    guint n_contacts, TpContact * const *contacts,
+    GCancellable *cancellable, GAsyncReadyCallback callback,
+    gpointer user_data);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_connection_request_contact_info_finish (TpConnection *self,
+    GAsyncResult *result, GHashTable **failures, GError **error);
+
 /* TP_CONTACT_FEATURE_CLIENT_TYPES */
 const gchar * const *
 /* this comment stops gtkdoc denying that this function exists */
@@ -198,6 +230,32 @@ TpContact *tp_connection_dup_contact_by_id_finish (TpConnection *self,
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_dup_contacts_by_uris_async (TpConnection *self,
+    const gchar * const *uris,
+    guint n_features,
+    const TpContactFeature *features,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+_TP_AVAILABLE_IN_UNRELEASED
+GHashTable *tp_connection_dup_contacts_by_uris_finish (TpConnection *self,
+    GAsyncResult *result,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_connection_dup_contacts_by_vcard_field_async (TpConnection *self,
+    const gchar *vcard_field,
+    const gchar * const *addresses,
+    guint n_features,
+    const TpContactFeature *features,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+_TP_AVAILABLE_IN_UNRELEASED
+GHashTable *tp_connection_dup_contacts_by_vcard_field_finish (
+    TpConnection *self,
+    GAsyncResult *result,
+    GError **error);
+
 _TP_AVAILABLE_IN_0_20
 void tp_connection_upgrade_contacts_async (TpConnection *self,
     guint n_contacts,
@@ -0,0 +1,67 @@
+/*<private_header>*/
+/* Contacts mixin - internals (for use by our own attribute providers)
+ *
+ * Copyright © 2008-2010 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_CONTACTS_MIXIN_INTERNAL_H__
+#define __TP_CONTACTS_MIXIN_INTERNAL_H__
+
+#include <telepathy-glib/contacts-mixin.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpContactAttributesBuilder TpContactAttributesBuilder;
+
+/*
+ * TpContactsMixinFillColumnsFunc:
+ * @obj: An object implementing the Contacts interface with this mixin
+ * @contacts: The contact handles for which attributes are requested, all
+ *  valid
+ * @builder: the attributes being built, into which the attribute for
+ *  the contact at index i in @contacts is stored at position i
+ *
+ * Like #TpContactsMixinFillContactAttributesFunc, but storing attributes
+ * in per-attribute columns rather than in a hash table per contact.
+ */
+typedef void (*TpContactsMixinFillColumnsFunc) (GObject *obj,
+    const GArray *contacts,
+    TpContactAttributesBuilder *builder);
+
+void _tp_contacts_mixin_add_contact_attributes_columns (GObject *obj,
+    const gchar *interface,
+    TpContactsMixinFillColumnsFunc fill_columns);
+
+guint _tp_contact_attributes_builder_add_column (
+    TpContactAttributesBuilder *self,
+    const gchar *attribute);
+
+GValue *_tp_contact_attributes_builder_init_value (
+    TpContactAttributesBuilder *self,
+    guint column,
+    guint position,
+    GType type);
+
+GVariant *_tp_contacts_mixin_dup_contact_attributes_variant (GObject *obj,
+    const GArray *handles,
+    const gchar **interfaces,
+    const gchar **assumed_interfaces,
+    const gchar *sender);
+
+G_END_DECLS
+
+#endif
@@ -51,34 +51,314 @@
 #include "config.h"
 
 #include <telepathy-glib/contacts-mixin.h>
+#include <telepathy-glib/contacts-mixin-internal.h>
 
 #include <dbus/dbus-glib-lowlevel.h>
 #include <dbus/dbus-glib.h>
+#include <string.h>
 
 #include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/base-connection-internal.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/enums.h>
 #include <telepathy-glib/errors.h>
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/intset.h>
 
 #define DEBUG_FLAG TP_DEBUG_CONNECTION
 
 #include "debug-internal.h"
+#include "util-internal.h"
+#include "telepathy-glib/_gen/tp-svc-connection-variant.h"
 
 struct _TpContactsMixinPrivate
 {
-  /* String interface name -> FillContactAttributes func */
+  /* String interface name -> owned AttributesProvider */
   GHashTable *interfaces;
+  /* runs FillChunks for thread-safe providers, or NULL */
+  GThreadPool *fill_pool;
 };
 
+/* Exactly one of the functions is non-NULL */
+typedef struct {
+    TpContactsMixinFillContactAttributesFunc fill_hash;
+    TpContactsMixinFillColumnsFunc fill_columns;
+    /* TRUE if the function can be called from another thread, for part of
+     * the contacts at a time, while the main thread waits */
+    gboolean thread_safe;
+    /* TRUE if changes are signalled by ContactAttributesChanged */
+    gboolean notified;
+} AttributesProvider;
+
+/* Don't bother with threads unless each of them gets at least this many
+ * contacts */
+#define MIN_CONTACTS_PER_CHUNK 256
+
+static void
+attributes_provider_free (gpointer p)
+{
+  g_slice_free (AttributesProvider, p);
+}
+
+typedef struct {
+    /* interned, so g_quark_to_string() is valid forever */
+    GQuark attribute;
+    /* one per contact; unset (zero-filled) if the contact doesn't have
+     * this attribute */
+    GValue *values;
+} AttributeColumn;
+
+/*
+ * TpContactAttributesBuilder:
+ *
+ * Attributes for a list of contacts, stored by attribute rather than by
+ * contact so that each attribute costs one allocation for the whole list,
+ * instead of a key, a value and a hash table node per contact.
+ */
+struct _TpContactAttributesBuilder {
+    guint n_contacts;
+    /* AttributeColumn */
+    GArray *columns;
+};
+
+static void
+contact_attributes_builder_init (TpContactAttributesBuilder *self,
+    guint n_contacts)
+{
+  self->n_contacts = n_contacts;
+  self->columns = g_array_new (FALSE, FALSE, sizeof (AttributeColumn));
+}
+
+/*
+ * _tp_contact_attributes_builder_add_column:
+ * @self: a builder, as passed to a #TpContactsMixinFillColumnsFunc
+ * @attribute: a contact attribute name
+ *
+ * Returns: a column in which to store @attribute for each contact; it is
+ *  the same column every time for the same attribute
+ */
+guint
+_tp_contact_attributes_builder_add_column (TpContactAttributesBuilder *self,
+    const gchar *attribute)
+{
+  GQuark quark = g_quark_from_string (attribute);
+  AttributeColumn column;
+  guint i;
+
+  for (i = 0; i < self->columns->len; i++)
+    {
+      if (g_array_index (self->columns, AttributeColumn, i).attribute == quark)
+        return i;
+    }
+
+  column.attribute = quark;
+  column.values = g_new0 (GValue, self->n_contacts);
+  g_array_append_val (self->columns, column);
+  return i;
+}
+
+/*
+ * _tp_contact_attributes_builder_init_value:
+ * @self: a builder, as passed to a #TpContactsMixinFillColumnsFunc
+ * @column: a column returned by _tp_contact_attributes_builder_add_column()
+ * @position: the index of a contact in the array passed to the
+ *  #TpContactsMixinFillColumnsFunc
+ * @type: the type of the attribute
+ *
+ * Returns: (transfer none): a #GValue of type @type, owned by @self, which
+ *  the caller should set to the attribute for the contact at @position;
+ *  any previous value for it is discarded
+ */
+GValue *
+_tp_contact_attributes_builder_init_value (TpContactAttributesBuilder *self,
+    guint column,
+    guint position,
+    GType type)
+{
+  GValue *value;
+
+  g_return_val_if_fail (column < self->columns->len, NULL);
+  g_return_val_if_fail (position < self->n_contacts, NULL);
+
+  value = g_array_index (self->columns, AttributeColumn, column).values +
+      position;
+
+  if (G_IS_VALUE (value))
+    g_value_unset (value);
+
+  return g_value_init (value, type);
+}
+
+/* Free the builder's contents, including any values still in it */
+static void
+contact_attributes_builder_clear (TpContactAttributesBuilder *self)
+{
+  guint i, j;
+
+  for (j = 0; j < self->columns->len; j++)
+    {
+      AttributeColumn *column = &g_array_index (self->columns,
+          AttributeColumn, j);
+
+      for (i = 0; i < self->n_contacts; i++)
+        {
+          if (G_IS_VALUE (column->values + i))
+            g_value_unset (column->values + i);
+        }
+
+      g_free (column->values);
+    }
+
+  g_array_unref (self->columns);
+}
+
+/* Move the attributes from @chunk, which was built for the contacts from
+ * @offset onwards in @self's list, into @self, and free @chunk's contents */
+static void
+contact_attributes_builder_merge (TpContactAttributesBuilder *self,
+    TpContactAttributesBuilder *chunk,
+    guint offset)
+{
+  guint i, j;
+
+  g_assert (offset + chunk->n_contacts <= self->n_contacts);
+
+  for (j = 0; j < chunk->columns->len; j++)
+    {
+      AttributeColumn *from = &g_array_index (chunk->columns,
+          AttributeColumn, j);
+      /* this can move the other columns, so look it up afterwards */
+      guint column = _tp_contact_attributes_builder_add_column (self,
+          g_quark_to_string (from->attribute));
+      GValue *to = g_array_index (self->columns, AttributeColumn,
+          column).values + offset;
+
+      for (i = 0; i < chunk->n_contacts; i++)
+        {
+          if (!G_IS_VALUE (from->values + i))
+            continue;
+
+          if (G_IS_VALUE (to + i))
+            g_value_unset (to + i);
+
+          to[i] = from->values[i];
+          memset (from->values + i, '\0', sizeof (GValue));
+        }
+    }
+
+  contact_attributes_builder_clear (chunk);
+}
+
+/* Move the attributes into @result, which must contain an attributes hash
+ * for each of @contacts, and free the builder's contents. Attributes that
+ * are already in @result take precedence. */
+static void
+contact_attributes_builder_finish (TpContactAttributesBuilder *self,
+    const GArray *contacts,
+    GHashTable *result)
+{
+  guint i, j;
+
+  g_assert (contacts->len == self->n_contacts);
+
+  for (i = 0; i < self->n_contacts; i++)
+    {
+      GHashTable *attr_hash = g_hash_table_lookup (result,
+          GUINT_TO_POINTER (g_array_index (contacts, TpHandle, i)));
+
+      for (j = 0; j < self->columns->len; j++)
+        {
+          AttributeColumn *column = &g_array_index (self->columns,
+              AttributeColumn, j);
+          const gchar *name = g_quark_to_string (column->attribute);
+          GValue *value;
+
+          if (!G_IS_VALUE (column->values + i) ||
+              g_hash_table_contains (attr_hash, name))
+            continue;
+
+          /* steal the contents, rather than copying them */
+          value = _tp_slice_new_tagged (_TP_ALLOC_GVALUE, GValue);
+          *value = column->values[i];
+          memset (column->values + i, '\0', sizeof (GValue));
+          g_hash_table_insert (attr_hash, (gchar *) name, value);
+        }
+    }
+
+  contact_attributes_builder_clear (self);
+}
+
+/* Build the a{ua{sv}} for @contacts from @self and @hashes, which may be
+ * %NULL, and free the builder's contents; as for
+ * contact_attributes_builder_finish(), @hashes take precedence */
+static GVariant *
+contact_attributes_builder_end (TpContactAttributesBuilder *self,
+    const GArray *contacts,
+    GHashTable *hashes)
+{
+  GVariantBuilder vb;
+  guint i, j;
+
+  g_assert (contacts->len == self->n_contacts);
+
+  g_variant_builder_init (&vb, G_VARIANT_TYPE ("a{ua{sv}}"));
+
+  for (i = 0; i < self->n_contacts; i++)
+    {
+      TpHandle contact = g_array_index (contacts, TpHandle, i);
+      GHashTable *attr_hash = NULL;
+
+      if (hashes != NULL)
+        attr_hash = g_hash_table_lookup (hashes, GUINT_TO_POINTER (contact));
+
+      g_variant_builder_open (&vb, G_VARIANT_TYPE ("{ua{sv}}"));
+      g_variant_builder_add (&vb, "u", contact);
+      g_variant_builder_open (&vb, G_VARIANT_TYPE_VARDICT);
+
+      for (j = 0; j < self->columns->len; j++)
+        {
+          AttributeColumn *column = &g_array_index (self->columns,
+              AttributeColumn, j);
+          const gchar *name = g_quark_to_string (column->attribute);
+
+          if (!G_IS_VALUE (column->values + i) ||
+              (attr_hash != NULL && g_hash_table_contains (attr_hash, name)))
+            continue;
+
+          g_variant_builder_add (&vb, "{sv}", name,
+              dbus_g_value_build_g_variant (column->values + i));
+        }
+
+      if (attr_hash != NULL)
+        {
+          GHashTableIter iter;
+          gpointer k, v;
+
+          g_hash_table_iter_init (&iter, attr_hash);
+
+          while (g_hash_table_iter_next (&iter, &k, &v))
+            g_variant_builder_add (&vb, "{sv}", k,
+                dbus_g_value_build_g_variant (v));
+        }
+
+      g_variant_builder_close (&vb);
+      g_variant_builder_close (&vb);
+    }
+
+  contact_attributes_builder_clear (self);
+  return g_variant_builder_end (&vb);
+}
+
 enum {
   MIXIN_DP_CONTACT_ATTRIBUTE_INTERFACES,
+  MIXIN_DP_CONTACT_ATTRIBUTES_CHANGED_INTERFACES,
   NUM_MIXIN_CONTACTS_DBUS_PROPERTIES
 };
 
 static TpDBusPropertiesMixinPropImpl known_contacts_props[] = {
   { "ContactAttributeInterfaces", NULL, NULL },
+  { "ContactAttributesChangedInterfaces", NULL, NULL },
   { NULL }
 };
 
@@ -104,6 +384,8 @@ tp_presence_mixin_get_contacts_dbus_property (GObject *object,
     {
       q[MIXIN_DP_CONTACT_ATTRIBUTE_INTERFACES] =
         g_quark_from_static_string ("ContactAttributeInterfaces");
+      q[MIXIN_DP_CONTACT_ATTRIBUTES_CHANGED_INTERFACES] =
+        g_quark_from_static_string ("ContactAttributesChangedInterfaces");
     }
 
   g_return_if_fail (object != NULL);
@@ -129,6 +411,27 @@ tp_presence_mixin_get_contacts_dbus_property (GObject *object,
           }
       g_value_take_boxed (value, interfaces);
     }
+  else if (name == q[MIXIN_DP_CONTACT_ATTRIBUTES_CHANGED_INTERFACES])
+    {
+      GPtrArray *interfaces = g_ptr_array_new ();
+      GHashTableIter iter;
+      gpointer key, value_;
+
+      g_assert (G_VALUE_HOLDS (value, G_TYPE_STRV));
+
+      g_hash_table_iter_init (&iter, self->priv->interfaces);
+
+      while (g_hash_table_iter_next (&iter, &key, &value_))
+        {
+          AttributesProvider *provider = value_;
+
+          if (provider->notified)
+            g_ptr_array_add (interfaces, g_strdup (key));
+        }
+
+      g_ptr_array_add (interfaces, NULL);
+      g_value_take_boxed (value, g_ptr_array_free (interfaces, FALSE));
+    }
   else
     {
       g_assert_not_reached ();
@@ -245,7 +548,7 @@ tp_contacts_mixin_init (GObject *obj, gsize offset)
 
   mixin->priv = g_slice_new0 (TpContactsMixinPrivate);
   mixin->priv->interfaces = g_hash_table_new_full (g_str_hash, g_str_equal,
-    g_free, NULL);
+    g_free, attributes_provider_free);
 }
 
 /**
@@ -265,10 +568,253 @@ tp_contacts_mixin_finalize (GObject *obj)
   DEBUG ("%p", obj);
 
   /* free any data held directly by the object here */
+  if (mixin->priv->fill_pool != NULL)
+    g_thread_pool_free (mixin->priv->fill_pool, FALSE, TRUE);
+
   g_hash_table_unref (mixin->priv->interfaces);
   g_slice_free (TpContactsMixinPrivate, mixin->priv);
 }
 
+static void
+ensure_attribute_hashes (GHashTable **hashes,
+    const GArray *contacts)
+{
+  guint i;
+
+  if (*hashes != NULL)
+    return;
+
+  *hashes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      /* keys are interned by tp_contacts_mixin_set_contact_attribute()
+       * or the builder, so they are not freed */
+      g_hash_table_insert (*hashes,
+          GUINT_TO_POINTER (g_array_index (contacts, TpHandle, i)),
+          g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+            (GDestroyNotify) tp_g_value_slice_free));
+    }
+}
+
+typedef struct {
+    GMutex mutex;
+    GCond cond;
+    guint pending;
+} FillBatch;
+
+typedef struct {
+    FillBatch *batch;
+    GObject *obj;
+    AttributesProvider *provider;
+    /* a copy of part of the contacts */
+    GArray *contacts;
+    /* the index of contacts[0] in the whole list */
+    guint offset;
+    /* for fill_hash: borrowed from the caller, who only reads the outer
+     * table while the chunks run; each chunk only touches its own
+     * contacts' attributes hashes */
+    GHashTable *hashes;
+    /* for fill_columns: just for these contacts, merged afterwards */
+    TpContactAttributesBuilder builder;
+} FillChunk;
+
+static void
+fill_chunk (FillChunk *chunk)
+{
+  if (chunk->provider->fill_columns != NULL)
+    chunk->provider->fill_columns (chunk->obj, chunk->contacts,
+        &chunk->builder);
+  else
+    chunk->provider->fill_hash (chunk->obj, chunk->contacts, chunk->hashes);
+}
+
+static void
+fill_thread_func (gpointer data,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  FillChunk *chunk = data;
+
+  fill_chunk (chunk);
+
+  g_mutex_lock (&chunk->batch->mutex);
+
+  if (--chunk->batch->pending == 0)
+    g_cond_signal (&chunk->batch->cond);
+
+  g_mutex_unlock (&chunk->batch->mutex);
+}
+
+/* Call @provider for @contacts, into @builder or @hashes as appropriate;
+ * if it is thread-safe and there are enough contacts, split them between
+ * this thread and the fill pool. */
+static void
+fill_from_provider (TpContactsMixin *self,
+    GObject *obj,
+    AttributesProvider *provider,
+    const GArray *contacts,
+    TpContactAttributesBuilder *builder,
+    GHashTable *hashes)
+{
+  FillBatch batch;
+  FillChunk *chunks;
+  guint n_chunks = 0;
+  guint i;
+
+  if (provider->thread_safe && self->priv->fill_pool != NULL)
+    n_chunks = MIN (
+        (guint) g_thread_pool_get_max_threads (self->priv->fill_pool) + 1,
+        contacts->len / MIN_CONTACTS_PER_CHUNK);
+
+  if (n_chunks < 2)
+    {
+      if (provider->fill_columns != NULL)
+        provider->fill_columns (obj, contacts, builder);
+      else
+        provider->fill_hash (obj, contacts, hashes);
+
+      return;
+    }
+
+  chunks = g_new0 (FillChunk, n_chunks);
+  g_mutex_init (&batch.mutex);
+  g_cond_init (&batch.cond);
+  batch.pending = n_chunks - 1;
+
+  for (i = 0; i < n_chunks; i++)
+    {
+      FillChunk *chunk = chunks + i;
+      /* chunk i is [i * len / n_chunks, (i + 1) * len / n_chunks), so the
+       * chunks differ in size by at most one and end exactly at len */
+      guint end = (guint64) (i + 1) * contacts->len / n_chunks;
+      guint n;
+
+      chunk->offset = (guint64) i * contacts->len / n_chunks;
+      n = end - chunk->offset;
+      chunk->batch = &batch;
+      chunk->obj = obj;
+      chunk->provider = provider;
+      chunk->contacts = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+          n);
+      g_array_append_vals (chunk->contacts,
+          &g_array_index (contacts, TpHandle, chunk->offset), n);
+      chunk->hashes = hashes;
+
+      if (provider->fill_columns != NULL)
+        contact_attributes_builder_init (&chunk->builder, n);
+
+      /* this thread does the first chunk itself */
+      if (i > 0)
+        g_thread_pool_push (self->priv->fill_pool, chunk, NULL);
+    }
+
+  fill_chunk (chunks);
+
+  g_mutex_lock (&batch.mutex);
+
+  while (batch.pending > 0)
+    g_cond_wait (&batch.cond, &batch.mutex);
+
+  g_mutex_unlock (&batch.mutex);
+
+  for (i = 0; i < n_chunks; i++)
+    {
+      if (provider->fill_columns != NULL)
+        contact_attributes_builder_merge (builder, &chunks[i].builder,
+            chunks[i].offset);
+
+      g_array_unref (chunks[i].contacts);
+    }
+
+  g_mutex_clear (&batch.mutex);
+  g_cond_clear (&batch.cond);
+  g_free (chunks);
+}
+
+/* Returns the valid, distinct contacts among @handles, having filled in
+ * @builder with their column-based attributes and @hashes with their
+ * other attributes. @hashes is only created, with an attributes hash per
+ * contact, if @want_hashes is %TRUE or some provider needs it. */
+static GArray *
+collect_contact_attributes (GObject *obj,
+    const GArray *handles,
+    const gchar **interfaces,
+    const gchar **assumed_interfaces,
+    gboolean want_hashes,
+    TpContactAttributesBuilder *builder,
+    GHashTable **hashes)
+{
+  guint i, pass;
+  TpBaseConnection *conn = TP_BASE_CONNECTION (obj);
+  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
+        TP_HANDLE_TYPE_CONTACT);
+  GArray *valid_handles;
+  TpIntset *seen;
+  const gchar **lists[] = { assumed_interfaces, interfaces };
+
+  valid_handles = g_array_sized_new (TRUE, TRUE, sizeof (TpHandle),
+      handles->len);
+  seen = tp_intset_new ();
+
+  for (i = 0 ; i < handles->len ; i++)
+    {
+      TpHandle h = g_array_index (handles, TpHandle, i);
+
+      if (tp_handle_is_valid (contact_repo, h, NULL) &&
+          !tp_intset_is_member (seen, h))
+        {
+          tp_intset_add (seen, h);
+          g_array_append_val (valid_handles, h);
+        }
+    }
+
+  tp_intset_destroy (seen);
+
+  /* First let the providers that support it fill per-attribute columns;
+   * then call the others, which fill in per-contact hash tables directly. */
+  contact_attributes_builder_init (builder, valid_handles->len);
+  *hashes = NULL;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      guint l;
+
+      if (pass == 1 && want_hashes)
+        ensure_attribute_hashes (hashes, valid_handles);
+
+      for (l = 0; l < G_N_ELEMENTS (lists); l++)
+        {
+          for (i = 0; lists[l] != NULL && lists[l][i] != NULL; i++)
+            {
+              AttributesProvider *provider = g_hash_table_lookup (
+                  self->priv->interfaces, lists[l][i]);
+
+              if (provider == NULL)
+                {
+                  if (pass == 0)
+                    DEBUG ("non-inspectable %sinterface %s given; ignoring",
+                        (l == 0 ? "assumed " : ""), lists[l][i]);
+                }
+              else if (pass == 0 && provider->fill_columns != NULL)
+                {
+                  fill_from_provider (self, obj, provider, valid_handles,
+                      builder, NULL);
+                }
+              else if (pass == 1 && provider->fill_hash != NULL)
+                {
+                  ensure_attribute_hashes (hashes, valid_handles);
+                  fill_from_provider (self, obj, provider, valid_handles,
+                      NULL, *hashes);
+                }
+            }
+        }
+    }
+
+  return valid_handles;
+}
+
 /**
  * tp_contacts_mixin_get_contact_attributes: (skip)
  * @obj: A connection instance that uses this mixin. The connection must be connected.
@@ -298,63 +844,64 @@ tp_contacts_mixin_get_contact_attributes (GObject *obj,
     const gchar **assumed_interfaces,
     const gchar *sender)
 {
-  GHashTable *result;
-  guint i;
-  TpBaseConnection *conn = TP_BASE_CONNECTION (obj);
-  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
-  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
-        TP_HANDLE_TYPE_CONTACT);
+  GHashTable *result = NULL;
+  TpContactAttributesBuilder builder;
   GArray *valid_handles;
-  TpContactsMixinFillContactAttributesFunc func;
 
   g_return_val_if_fail (TP_IS_BASE_CONNECTION (obj), NULL);
   g_return_val_if_fail (TP_CONTACTS_MIXIN_OFFSET (obj) != 0, NULL);
-  g_return_val_if_fail (tp_base_connection_check_connected (conn, NULL), NULL);
+  g_return_val_if_fail (tp_base_connection_check_connected (
+        TP_BASE_CONNECTION (obj), NULL), NULL);
 
-  /* Setup handle array and hash with valid handles, optionally holding them */
-  valid_handles = g_array_sized_new (TRUE, TRUE, sizeof (TpHandle),
-      handles->len);
-  result = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
-      (GDestroyNotify) g_hash_table_unref);
+  valid_handles = collect_contact_attributes (obj, handles, interfaces,
+      assumed_interfaces, TRUE, &builder, &result);
+  contact_attributes_builder_finish (&builder, valid_handles, result);
 
-  for (i = 0 ; i < handles->len ; i++)
-    {
-      TpHandle h;
-      h = g_array_index (handles, TpHandle, i);
-      if (tp_handle_is_valid (contact_repo, h, NULL))
-        {
-          GHashTable *attr_hash = g_hash_table_new_full (g_str_hash,
-              g_str_equal, g_free, (GDestroyNotify) tp_g_value_slice_free);
-          g_array_append_val (valid_handles, h);
-          g_hash_table_insert (result, GUINT_TO_POINTER(h), attr_hash);
-        }
-    }
+  if (sender != NULL)
+    _tp_base_connection_hold_handles (TP_BASE_CONNECTION (obj), sender,
+        TP_HANDLE_TYPE_CONTACT, valid_handles);
 
-  for (i = 0; assumed_interfaces != NULL && assumed_interfaces[i] != NULL; i++)
-    {
-      func = g_hash_table_lookup (self->priv->interfaces, assumed_interfaces[i]);
+  g_array_unref (valid_handles);
 
-      if (func == NULL)
-        DEBUG ("non-inspectable assumed interface %s given; ignoring",
-            assumed_interfaces[i]);
-      else
-        func (obj, valid_handles, result);
-    }
+  return result;
+}
 
-  for (i = 0; interfaces != NULL && interfaces[i] != NULL; i++)
-    {
+/*
+ * _tp_contacts_mixin_dup_contact_attributes_variant:
+ *
+ * The same as tp_contacts_mixin_get_contact_attributes(), but building the
+ * a{ua{sv}} for D-Bus directly, without a hash table per contact unless an
+ * attribute provider needs them. If @sender is not %NULL, the valid handles
+ * are held on its behalf.
+ *
+ * Returns: (transfer full): a floating a{ua{sv}}
+ */
+GVariant *
+_tp_contacts_mixin_dup_contact_attributes_variant (GObject *obj,
+    const GArray *handles,
+    const gchar **interfaces,
+    const gchar **assumed_interfaces,
+    const gchar *sender)
+{
+  GHashTable *hashes = NULL;
+  TpContactAttributesBuilder builder;
+  GArray *valid_handles;
+  GVariant *ret;
 
-      func = g_hash_table_lookup (self->priv->interfaces, interfaces[i]);
+  valid_handles = collect_contact_attributes (obj, handles, interfaces,
+      assumed_interfaces, FALSE, &builder, &hashes);
+  ret = contact_attributes_builder_end (&builder, valid_handles, hashes);
 
-      if (func == NULL)
-        DEBUG ("non-inspectable interface %s given; ignoring", interfaces[i]);
-      else
-        func (obj, valid_handles, result);
-    }
+  if (sender != NULL)
+    _tp_base_connection_hold_handles (TP_BASE_CONNECTION (obj), sender,
+        TP_HANDLE_TYPE_CONTACT, valid_handles);
 
   g_array_unref (valid_handles);
 
-  return result;
+  if (hashes != NULL)
+    g_hash_table_unref (hashes);
+
+  return ret;
 }
 
 static void
@@ -367,9 +914,15 @@ tp_contacts_mixin_get_contact_attributes_impl (
 {
   TpBaseConnection *conn = TP_BASE_CONNECTION (iface);
   GHashTable *result;
+  gchar *sender;
 
   TP_BASE_CONNECTION_ERROR_IF_NOT_CONNECTED (conn, context);
 
+  sender = dbus_g_method_get_sender (context);
+  _tp_base_connection_add_contact_interests (conn, sender,
+      (const gchar * const *) interfaces, handles);
+  g_free (sender);
+
   result = tp_contacts_mixin_get_contact_attributes (G_OBJECT (conn),
       handles, interfaces, always_included_interfaces, NULL);
 
@@ -379,11 +932,63 @@ tp_contacts_mixin_get_contact_attributes_impl (
   g_hash_table_unref (result);
 }
 
+/* Copy the handles out of an "au" */
+static GArray *
+handles_from_variant (GVariant *au)
+{
+  gsize n;
+  const guint32 *handles = g_variant_get_fixed_array (au, &n,
+      sizeof (guint32));
+  GArray *ret = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle), n);
+
+  g_array_append_vals (ret, handles, n);
+  return ret;
+}
+
+static void
+tp_contacts_mixin_get_contact_attributes_variant (GObject *obj,
+    GVariant *in_args,
+    TpSvcInvocation *invocation)
+{
+  TpBaseConnection *conn = TP_BASE_CONNECTION (obj);
+  GVariant *au;
+  const gchar **interfaces;
+  gboolean hold;
+  GArray *handles;
+  GVariant *result;
+  GError *error = NULL;
+
+  if (!tp_base_connection_check_connected (conn, &error))
+    {
+      _tp_svc_invocation_return_error (invocation, error);
+      g_error_free (error);
+      return;
+    }
+
+  g_variant_get (in_args, "(@au^a&sb)", &au, &interfaces, &hold);
+  handles = handles_from_variant (au);
+
+  _tp_base_connection_add_contact_interests (conn,
+      _tp_svc_invocation_get_sender (invocation),
+      (const gchar * const *) interfaces, handles);
+
+  result = _tp_contacts_mixin_dup_contact_attributes_variant (obj, handles,
+      interfaces, always_included_interfaces, NULL);
+  _tp_svc_invocation_return_variant (invocation,
+      g_variant_new_tuple (&result, 1));
+
+  g_array_unref (handles);
+  g_free (interfaces);
+  g_variant_unref (au);
+}
+
+/* Exactly one of context and invocation is non-NULL */
 typedef struct
 {
   TpBaseConnection *conn;
   GStrv interfaces;
   DBusGMethodInvocation *context;
+  TpSvcInvocation *invocation;
 } GetContactByIdData;
 
 static void
@@ -397,12 +1002,17 @@ ensure_handle_cb (GObject *source,
   GArray *handles;
   GHashTable *attributes;
   GHashTable *ret;
+  gchar *sender;
   GError *error = NULL;
 
   handle = tp_handle_ensure_finish (contact_repo, result, &error);
   if (handle == 0)
     {
-      dbus_g_method_return_error (data->context, error);
+      if (data->invocation != NULL)
+        _tp_svc_invocation_return_error (data->invocation, error);
+      else
+        dbus_g_method_return_error (data->context, error);
+
       g_clear_error (&error);
       goto out;
     }
@@ -410,6 +1020,34 @@ ensure_handle_cb (GObject *source,
   handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
   g_array_append_val (handles, handle);
 
+  if (data->invocation != NULL)
+    {
+      GVariant *all, *asv;
+
+      _tp_base_connection_add_contact_interests (data->conn,
+          _tp_svc_invocation_get_sender (data->invocation),
+          (const gchar * const *) data->interfaces, handles);
+
+      all = _tp_contacts_mixin_dup_contact_attributes_variant (
+          G_OBJECT (data->conn), handles, (const gchar **) data->interfaces,
+          always_included_interfaces, NULL);
+      g_variant_ref_sink (all);
+      g_variant_get_child (all, 0, "{u@a{sv}}", NULL, &asv);
+
+      _tp_svc_invocation_return_variant (data->invocation,
+          g_variant_new ("(u@a{sv})", handle, asv));
+
+      g_variant_unref (asv);
+      g_variant_unref (all);
+      g_array_unref (handles);
+      goto out;
+    }
+
+  sender = dbus_g_method_get_sender (data->context);
+  _tp_base_connection_add_contact_interests (data->conn, sender,
+      (const gchar * const *) data->interfaces, handles);
+  g_free (sender);
+
   attributes = tp_contacts_mixin_get_contact_attributes (G_OBJECT (data->conn),
       handles, (const gchar **) data->interfaces, always_included_interfaces,
       NULL);
@@ -452,6 +1090,34 @@ tp_contacts_mixin_get_contact_by_id_impl (
       ensure_handle_cb, data);
 }
 
+static void
+tp_contacts_mixin_get_contact_by_id_variant (GObject *obj,
+    GVariant *in_args,
+    TpSvcInvocation *invocation)
+{
+  TpBaseConnection *conn = TP_BASE_CONNECTION (obj);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
+      TP_HANDLE_TYPE_CONTACT);
+  GetContactByIdData *data;
+  const gchar *id;
+  GError *error = NULL;
+
+  if (!tp_base_connection_check_connected (conn, &error))
+    {
+      _tp_svc_invocation_return_error (invocation, error);
+      g_error_free (error);
+      return;
+    }
+
+  data = g_slice_new0 (GetContactByIdData);
+  data->conn = g_object_ref (conn);
+  g_variant_get (in_args, "(&s^as)", &id, &data->interfaces);
+  data->invocation = invocation;
+
+  tp_handle_ensure_async (contact_repo, conn, id, NULL,
+      ensure_handle_cb, data);
+}
+
 /**
  * tp_contacts_mixin_iface_init: (skip)
  * @g_iface: A pointer to the #TpSvcConnectionInterfaceContacts in an object
@@ -476,6 +1142,14 @@ tp_contacts_mixin_iface_init (gpointer g_iface, gpointer iface_data)
   IMPLEMENT(get_contact_attributes);
   IMPLEMENT(get_contact_by_id);
 #undef IMPLEMENT
+
+  /* calls routed past dbus-glib use these instead */
+#define IMPLEMENT(x) \
+  _tp_svc_connection_interface_contacts_implement_##x##_variant ( \
+    klass, tp_contacts_mixin_##x##_variant)
+  IMPLEMENT(get_contact_attributes);
+  IMPLEMENT(get_contact_by_id);
+#undef IMPLEMENT
 }
 
 /**
@@ -499,12 +1173,243 @@ tp_contacts_mixin_add_contact_attributes_iface (GObject *obj,
     TpContactsMixinFillContactAttributesFunc fill_contact_attributes)
 {
   TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+  AttributesProvider *provider;
 
   g_assert (g_hash_table_lookup (self->priv->interfaces, interface) == NULL);
   g_assert (fill_contact_attributes != NULL);
 
+  provider = g_slice_new0 (AttributesProvider);
+  provider->fill_hash = fill_contact_attributes;
   g_hash_table_insert (self->priv->interfaces, g_strdup (interface),
-    fill_contact_attributes);
+    provider);
+}
+
+/*
+ * _tp_contacts_mixin_add_contact_attributes_columns:
+ * @obj: An instance of the implementation that uses this mixin
+ * @interface: Name of the interface that has ContactAttributes
+ * @fill_columns: Contact attribute filler function
+ *
+ * Like tp_contacts_mixin_add_contact_attributes_iface(), but for
+ * providers that store attributes in a #TpContactAttributesBuilder.
+ */
+void
+_tp_contacts_mixin_add_contact_attributes_columns (GObject *obj,
+    const gchar *interface,
+    TpContactsMixinFillColumnsFunc fill_columns)
+{
+  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+  AttributesProvider *provider;
+
+  g_assert (g_hash_table_lookup (self->priv->interfaces, interface) == NULL);
+  g_assert (fill_columns != NULL);
+
+  provider = g_slice_new0 (AttributesProvider);
+  provider->fill_columns = fill_columns;
+  g_hash_table_insert (self->priv->interfaces, g_strdup (interface),
+    provider);
+}
+
+/**
+ * tp_contacts_mixin_set_contact_attributes_thread_safe: (skip)
+ * @obj: An instance of the implementation that uses this mixin
+ * @interface: Name of an interface that was added with
+ *  tp_contacts_mixin_add_contact_attributes_iface()
+ *
+ * Declare that the filler function for @interface may be called from
+ * another thread, for part of the contacts at a time, so that large
+ * requests can be split between several threads if
+ * tp_contacts_mixin_set_fill_threaded() has been called.
+ *
+ * The main thread is blocked while this happens, so the function may read
+ * @obj and other state that is only changed from the main thread; but it
+ * must not change anything except the attributes of the contacts it was
+ * given, emit signals, take or release references to @obj, or wait for the
+ * main loop. Functions that only look up attributes they already have in
+ * memory, such as capabilities, contact information or locations, are
+ * usually suitable. Filler functions run one interface at a time, so the
+ * function is never called in parallel with another interface's.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contacts_mixin_set_contact_attributes_thread_safe (GObject *obj,
+    const gchar *interface)
+{
+  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+  AttributesProvider *provider = g_hash_table_lookup (self->priv->interfaces,
+      interface);
+
+  g_return_if_fail (provider != NULL);
+
+  provider->thread_safe = TRUE;
+}
+
+/**
+ * tp_contacts_mixin_set_fill_threaded: (skip)
+ * @obj: An instance of the implementation that uses this mixin
+ * @max_threads: the maximum number of threads to use in addition to the
+ *  main thread, or 0 to fill all attributes in the main thread
+ *
+ * Split the work of filling in each thread-safe interface's attributes
+ * (see tp_contacts_mixin_set_contact_attributes_thread_safe()) for a large
+ * number of contacts between the main thread and a pool of up to
+ * @max_threads worker threads, merging the results into the reply as
+ * before. Requests for a few contacts are still handled entirely in the
+ * main thread. By default, no threads are used.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contacts_mixin_set_fill_threaded (GObject *obj,
+    guint max_threads)
+{
+  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+
+  if (max_threads == 0)
+    {
+      if (self->priv->fill_pool != NULL)
+        {
+          g_thread_pool_free (self->priv->fill_pool, FALSE, TRUE);
+          self->priv->fill_pool = NULL;
+        }
+
+      return;
+    }
+
+  if (self->priv->fill_pool != NULL)
+    {
+      g_thread_pool_set_max_threads (self->priv->fill_pool, max_threads,
+          NULL);
+      return;
+    }
+
+  self->priv->fill_pool = g_thread_pool_new (fill_thread_func, NULL,
+      max_threads, FALSE, NULL);
+}
+
+/**
+ * tp_contacts_mixin_set_contact_attributes_notified: (skip)
+ * @obj: An instance of the implementation that uses this mixin
+ * @interface: Name of an interface that was added with
+ *  tp_contacts_mixin_add_contact_attributes_iface()
+ *
+ * Declare that every change to @interface's contact attributes will be
+ * signalled by calling tp_contacts_mixin_emit_contact_attributes_changed(),
+ * so that @interface is listed in the ContactAttributesChangedInterfaces
+ * property and clients need not bind to its own change notification
+ * signals. This should be called before the connection is exported on
+ * D-Bus, since that property cannot change.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contacts_mixin_set_contact_attributes_notified (GObject *obj,
+    const gchar *interface)
+{
+  TpContactsMixin *self = TP_CONTACTS_MIXIN (obj);
+  AttributesProvider *provider = g_hash_table_lookup (self->priv->interfaces,
+      interface);
+
+  g_return_if_fail (provider != NULL);
+
+  provider->notified = TRUE;
+}
+
+/**
+ * tp_contacts_mixin_emit_contact_attributes_changed: (skip)
+ * @obj: An instance of the implementation that uses this mixin
+ * @interface: Name of an interface that was passed to
+ *  tp_contacts_mixin_set_contact_attributes_notified()
+ * @contacts: (element-type TpHandle): contacts whose attributes from
+ *  @interface have changed
+ *
+ * Emit ContactAttributesChanged for @contacts, with their attributes from
+ * @interface as filled in by its filler function, just as
+ * GetContactAttributes would return them. This should be called after the
+ * new values have been stored, in addition to emitting @interface's own
+ * change notification signals for older clients.
+ *
+ * Contacts that no client is interested in, as determined by
+ * tp_base_connection_is_contact_interesting(), are left out. Nothing is
+ * emitted if @interface's changes are not signalled this way, if @obj has
+ * no contacts mixin, or if it is not connected.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_contacts_mixin_emit_contact_attributes_changed (GObject *obj,
+    const gchar *interface,
+    const GArray *contacts)
+{
+  TpBaseConnection *conn;
+  TpContactsMixin *self;
+  AttributesProvider *provider;
+  const gchar *interfaces[] = { interface, NULL };
+  GQuark token;
+  GArray *interesting;
+  GHashTable *attributes;
+  GHashTableIter iter;
+  gpointer key;
+  guint i;
+
+  g_return_if_fail (TP_IS_BASE_CONNECTION (obj));
+  g_return_if_fail (interface != NULL);
+  g_return_if_fail (contacts != NULL);
+
+  conn = TP_BASE_CONNECTION (obj);
+
+  /* the presence mixin calls this whether the contacts mixin is there or
+   * not */
+  if (TP_CONTACTS_MIXIN_OFFSET (obj) == 0)
+    return;
+
+  self = TP_CONTACTS_MIXIN (obj);
+  provider = g_hash_table_lookup (self->priv->interfaces, interface);
+
+  if (provider == NULL || !provider->notified || contacts->len == 0 ||
+      tp_base_connection_get_status (conn) != TP_CONNECTION_STATUS_CONNECTED)
+    return;
+
+  token = g_quark_from_string (interface);
+  interesting = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      contacts->len);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle h = g_array_index (contacts, TpHandle, i);
+
+      if (tp_base_connection_is_contact_interesting (conn, token, h))
+        g_array_append_val (interesting, h);
+    }
+
+  if (interesting->len == 0)
+    {
+      DEBUG ("no client is interested in any of these %u contacts",
+          contacts->len);
+      g_array_unref (interesting);
+      return;
+    }
+
+  attributes = tp_contacts_mixin_get_contact_attributes (obj, interesting,
+      interfaces, always_included_interfaces, NULL);
+
+  g_hash_table_iter_init (&iter, attributes);
+
+  /* interfaces outlives the signal, so there's no need to copy it */
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    tp_contacts_mixin_set_contact_attribute (attributes,
+        GPOINTER_TO_UINT (key),
+        TP_TOKEN_CONNECTION_INTERFACE_CONTACTS_CHANGED_INTERFACES,
+        tp_g_value_slice_new_static_boxed (G_TYPE_STRV, interfaces));
+
+  DEBUG ("%s changed for %u contacts", interface,
+      g_hash_table_size (attributes));
+  tp_svc_connection_interface_contacts_emit_contact_attributes_changed (obj,
+      attributes);
+
+  g_hash_table_unref (attributes);
+  g_array_unref (interesting);
 }
 
 /**
@@ -536,6 +1441,9 @@ tp_contacts_mixin_set_contact_attribute (GHashTable *contact_attributes,
   g_assert (attributes != NULL);
   g_assert (G_IS_VALUE (value));
 
-  g_hash_table_insert (attributes, g_strdup (attribute), value);
+  /* there are only a few distinct attribute names, so rather than copying
+   * the name for every contact, use one permanent copy */
+  g_hash_table_insert (attributes, (gchar *) g_intern_string (attribute),
+      value);
 }
 
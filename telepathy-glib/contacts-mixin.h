@@ -110,6 +110,20 @@ void tp_contacts_mixin_add_contact_attributes_iface (GObject *obj,
 void tp_contacts_mixin_set_contact_attribute (GHashTable *contact_attributes,
     TpHandle handle, const gchar *attribute, GValue *value);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contacts_mixin_set_contact_attributes_thread_safe (GObject *obj,
+    const gchar *interface);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contacts_mixin_set_fill_threaded (GObject *obj,
+    guint max_threads);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contacts_mixin_set_contact_attributes_notified (GObject *obj,
+    const gchar *interface);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_contacts_mixin_emit_contact_attributes_changed (GObject *obj,
+    const gchar *interface,
+    const GArray *contacts);
+
 GHashTable *tp_contacts_mixin_get_contact_attributes (GObject *obj,
     const GArray *handles, const gchar **interfaces, const gchar **assumed_interfaces,
     const gchar *sender);
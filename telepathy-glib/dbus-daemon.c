@@ -24,12 +24,18 @@
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/dbus-internal.h>
 
+#include <string.h>
+
 #include <dbus/dbus.h>
 #include <dbus/dbus-glib-lowlevel.h>
 
+#include <telepathy-glib/defs.h>
 #include <telepathy-glib/errors.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/proxy-internal.h>
 #include <telepathy-glib/proxy-subclass.h>
+#include <telepathy-glib/svc-variant-internal.h>
+#include <telepathy-glib/util-internal.h>
 #include <telepathy-glib/util.h>
 
 #include "telepathy-glib/_gen/tp-cli-dbus-daemon-body.h"
@@ -67,18 +73,105 @@ struct _TpDBusDaemon
   TpDBusDaemonPrivate *priv;
 };
 
+/* see noc_namespaces */
+#define N_NOC_NAMESPACES 3
+
+typedef enum {
+    ARG0_NAMESPACE_UNKNOWN = 0,
+    ARG0_NAMESPACE_SUPPORTED,
+    ARG0_NAMESPACE_UNSUPPORTED
+} Arg0NamespaceSupport;
+
 struct _TpDBusDaemonPrivate
 {
   /* dup'd name => _NameOwnerWatch */
   GHashTable *name_owner_watches;
   /* reffed */
   DBusConnection *libdbus;
+
+  /* index into noc_namespaces => number of watched names matched by
+   * that namespace's rule */
+  guint namespace_watches[N_NOC_NAMESPACES];
+  Arg0NamespaceSupport arg0namespace;
+
+  /* Names whose first watch was added while lookup_batch_id was pending;
+   * their owners are looked up together when it runs. Dup'd */
+  GPtrArray *pending_lookups;
+  guint lookup_batch_id;
+
+  /* if we were returned by tp_dbus_daemon_dup() for a thread-default main
+   * context other than the global default, that context, whose private
+   * bus connection we close in dispose; owned */
+  GMainContext *private_context;
 };
 
 G_DEFINE_TYPE (TpDBusDaemon, tp_dbus_daemon, TP_TYPE_PROXY)
 
 static gpointer starter_bus_daemon = NULL;
 
+G_LOCK_DEFINE_STATIC (context_bus_daemons);
+/* borrowed GMainContext * => borrowed TpDBusDaemon *, for the
+ * thread-default main contexts other than the global default for which
+ * tp_dbus_daemon_dup() has been called */
+static GHashTable *context_bus_daemons = NULL;
+
+/*
+ * _tp_dbus_daemon_dup_for_context:
+ * @context: a main context other than the global default
+ * @error: used to raise an error if %NULL is returned
+ *
+ * Return the #TpDBusDaemon that tp_dbus_daemon_dup() would return in a
+ * thread whose thread-default main context is @context. This can be
+ * called from any thread, for instance before the thread that will run
+ * @context has started.
+ *
+ * Returns: (transfer full): a proxy for a private bus connection whose
+ *  messages are dispatched in @context, or %NULL
+ */
+TpDBusDaemon *
+_tp_dbus_daemon_dup_for_context (GMainContext *context,
+    GError **error)
+{
+  TpDBusDaemon *self = NULL;
+  DBusGConnection *conn;
+
+  G_LOCK (context_bus_daemons);
+
+  if (context_bus_daemons != NULL)
+    self = g_hash_table_lookup (context_bus_daemons, context);
+
+  if (self != NULL)
+    g_object_ref (self);
+
+  G_UNLOCK (context_bus_daemons);
+
+  if (self != NULL)
+    return self;
+
+  /* dbus-glib dispatches all of a bus connection's messages in one main
+   * context, so this context needs a bus connection of its own */
+  dbus_threads_init_default ();
+  conn = dbus_g_bus_get_private (DBUS_BUS_STARTER, context, error);
+
+  if (conn == NULL)
+    return NULL;
+
+  self = tp_dbus_daemon_new (conn);
+  dbus_g_connection_unref (conn);
+  self->priv->private_context = g_main_context_ref (context);
+  _tp_proxy_set_main_context (self, context);
+
+  G_LOCK (context_bus_daemons);
+
+  if (context_bus_daemons == NULL)
+    context_bus_daemons = g_hash_table_new (NULL, NULL);
+
+  g_hash_table_insert (context_bus_daemons, context, self);
+  G_UNLOCK (context_bus_daemons);
+
+  return self;
+}
+
 /**
  * tp_dbus_daemon_dup:
  * @error: Used to indicate error if %NULL is returned
@@ -94,6 +187,14 @@ static gpointer starter_bus_daemon = NULL;
  * be returned by this function repeatedly, as long as at least one reference
  * exists.
  *
+ * Since 0.UNRELEASED, if this is called from a thread whose thread-default
+ * main context (see g_main_context_push_thread_default()) is not the global
+ * default, the result is a separate, private connection to the same bus,
+ * whose messages are dispatched in that main context, cached for that
+ * context. Proxies created in that thread with this #TpDBusDaemon receive
+ * replies and signals there, without involving the global default main
+ * context.
+ *
  * Returns: (transfer full): a reference to a proxy for signals and method
  *  calls on the bus daemon, or %NULL
  *
@@ -102,8 +203,12 @@ static gpointer starter_bus_daemon = NULL;
 TpDBusDaemon *
 tp_dbus_daemon_dup (GError **error)
 {
+  GMainContext *context = g_main_context_get_thread_default ();
   DBusGConnection *conn;
 
+  if (context != NULL && context != g_main_context_default ())
+    return _tp_dbus_daemon_dup_for_context (context, error);
+
   if (starter_bus_daemon != NULL)
     return g_object_ref (starter_bus_daemon);
 
@@ -329,7 +434,8 @@ _tp_dbus_daemon_name_owner_changed_filter (DBusConnection *libdbus,
   if (dbus_message_is_signal (message, DBUS_INTERFACE_DBUS,
         "NameOwnerChanged") &&
       dbus_message_has_sender (message, DBUS_SERVICE_DBUS))
-    g_idle_add_full (G_PRIORITY_HIGH, noc_idle_context_invoke,
+    _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+        noc_idle_context_invoke,
         noc_idle_context_new (libdbus, message),
         noc_idle_context_free);
 
@@ -340,6 +446,8 @@ typedef struct {
     TpDBusDaemon *self;
     gchar *name;
     DBusMessage *reply;
+    /* if not NULL, the owner is already known, and there is no reply */
+    gchar *owner;
     gsize refs;
 } GetNameOwnerContext;
 
@@ -352,6 +460,7 @@ get_name_owner_context_new (TpDBusDaemon *self,
   context->self = g_object_ref (self);
   context->name = g_strdup (name);
   context->reply = NULL;
+  context->owner = NULL;
   context->refs = 1;
   return context;
 }
@@ -365,6 +474,7 @@ get_name_owner_context_unref (gpointer data)
     {
       g_object_unref (context->self);
       g_free (context->name);
+      g_free (context->owner);
 
       if (context->reply != NULL)
         dbus_message_unref (context->reply);
@@ -379,7 +489,12 @@ _tp_dbus_daemon_get_name_owner_idle (gpointer data)
   GetNameOwnerContext *context = data;
   const gchar *owner = "";
 
-  if (context->reply == NULL)
+  if (context->owner != NULL)
+    {
+      owner = context->owner;
+      DEBUG ("ListNames says the owner of %s is '%s'", context->name, owner);
+    }
+  else if (context->reply == NULL)
     {
       DEBUG ("Connection disconnected or no reply to GetNameOwner(%s)",
           context->name);
@@ -448,6 +563,122 @@ _tp_dbus_daemon_get_noc_rule (const gchar *name)
       "arg0='%s'", name);
 }
 
+/* Prefixes of well-known names of which a process often watches many at
+ * once, such as all the connections or all the clients. All the names under
+ * one of these share a single arg0namespace match rule, if the bus daemon
+ * supports them (dbus-daemon >= 1.5). The trailing "." is not part of the
+ * namespace. */
+static const gchar * const noc_namespaces[] = {
+    TP_CONN_BUS_NAME_BASE,
+    TP_CM_BUS_NAME_BASE,
+    TP_CLIENT_BUS_NAME_BASE
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (noc_namespaces) == N_NOC_NAMESPACES);
+
+static gint
+_tp_dbus_daemon_find_noc_namespace (const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (noc_namespaces); i++)
+    {
+      if (g_str_has_prefix (name, noc_namespaces[i]))
+        return i;
+    }
+
+  return -1;
+}
+
+static inline gchar *
+_tp_dbus_daemon_get_noc_namespace_rule (guint i)
+{
+  return g_strdup_printf ("type='signal',"
+      "sender='" DBUS_SERVICE_DBUS "',"
+      "path='" DBUS_PATH_DBUS "',"
+      "interface='"DBUS_INTERFACE_DBUS "',"
+      "member='NameOwnerChanged',"
+      "arg0namespace='%.*s'", (int) strlen (noc_namespaces[i]) - 1,
+      noc_namespaces[i]);
+}
+
+static void
+_tp_dbus_daemon_add_noc_match (TpDBusDaemon *self,
+    const gchar *name)
+{
+  gint i = _tp_dbus_daemon_find_noc_namespace (name);
+  DBusError error = DBUS_ERROR_INIT;
+  gchar *match_rule;
+
+  if (i >= 0 && self->priv->arg0namespace == ARG0_NAMESPACE_SUPPORTED)
+    {
+      if (self->priv->namespace_watches[i]++ > 0)
+        return;
+
+      match_rule = _tp_dbus_daemon_get_noc_namespace_rule (i);
+      DEBUG ("Adding match rule %s", match_rule);
+      dbus_bus_add_match (self->priv->libdbus, match_rule, NULL);
+      g_free (match_rule);
+      return;
+    }
+
+  if (i >= 0 && self->priv->arg0namespace == ARG0_NAMESPACE_UNKNOWN)
+    {
+      /* The first time, find out whether the bus daemon understands
+       * arg0namespace; this is the only time that watching a name blocks */
+      match_rule = _tp_dbus_daemon_get_noc_namespace_rule (i);
+      DEBUG ("Adding match rule %s", match_rule);
+      dbus_bus_add_match (self->priv->libdbus, match_rule, &error);
+      g_free (match_rule);
+
+      if (!dbus_error_is_set (&error))
+        {
+          self->priv->arg0namespace = ARG0_NAMESPACE_SUPPORTED;
+          self->priv->namespace_watches[i] = 1;
+          return;
+        }
+
+      DEBUG ("Falling back to a match rule per name: %s: %s",
+          error.name, error.message);
+      dbus_error_free (&error);
+      self->priv->arg0namespace = ARG0_NAMESPACE_UNSUPPORTED;
+    }
+
+  /* We want to be notified about name owner changes for this one.
+   * Assume the match addition will succeed; there's no good way to cope
+   * with failure here... */
+  match_rule = _tp_dbus_daemon_get_noc_rule (name);
+  DEBUG ("Adding match rule %s", match_rule);
+  dbus_bus_add_match (self->priv->libdbus, match_rule, NULL);
+  g_free (match_rule);
+}
+
+static void
+_tp_dbus_daemon_remove_noc_match (TpDBusDaemon *self,
+    const gchar *name)
+{
+  gint i = _tp_dbus_daemon_find_noc_namespace (name);
+  gchar *match_rule;
+
+  if (i >= 0 && self->priv->arg0namespace == ARG0_NAMESPACE_SUPPORTED)
+    {
+      g_return_if_fail (self->priv->namespace_watches[i] > 0);
+
+      if (--self->priv->namespace_watches[i] > 0)
+        return;
+
+      match_rule = _tp_dbus_daemon_get_noc_namespace_rule (i);
+    }
+  else
+    {
+      match_rule = _tp_dbus_daemon_get_noc_rule (name);
+    }
+
+  DEBUG ("Removing match rule %s", match_rule);
+  dbus_bus_remove_match (self->priv->libdbus, match_rule, NULL);
+  g_free (match_rule);
+}
+
 static void
 _tp_dbus_daemon_get_name_owner_notify (DBusPendingCall *pc,
                                        gpointer data)
@@ -462,13 +693,222 @@ _tp_dbus_daemon_get_name_owner_notify (DBusPendingCall *pc,
   /* We have to do the real work in an idle, so we don't break re-entrant
    * calls (the dbus-glib event source isn't re-entrant) */
   context->refs++;
-  g_idle_add_full (G_PRIORITY_HIGH, _tp_dbus_daemon_get_name_owner_idle,
+  _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+      _tp_dbus_daemon_get_name_owner_idle,
       context, get_name_owner_context_unref);
 
   if (pc != NULL)
     dbus_pending_call_unref (pc);
 }
 
+static void
+_tp_dbus_daemon_send_get_name_owner (TpDBusDaemon *self,
+    const gchar *name)
+{
+  DBusMessage *message;
+  DBusPendingCall *pc = NULL;
+  GetNameOwnerContext *context = get_name_owner_context_new (self, name);
+
+  message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+      DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "GetNameOwner");
+
+  if (message == NULL)
+    ERROR ("Out of memory");
+
+  /* We already checked that @name was in (a small subset of) UTF-8,
+   * so OOM is the only thing that can go wrong. The use of &name here
+   * is because libdbus is strange. */
+  if (!dbus_message_append_args (message,
+        DBUS_TYPE_STRING, &name,
+        DBUS_TYPE_INVALID))
+    ERROR ("Out of memory");
+
+  if (!dbus_connection_send_with_reply (self->priv->libdbus,
+      message, &pc, -1))
+    ERROR ("Out of memory");
+  /* pc is unreffed by _tp_dbus_daemon_get_name_owner_notify */
+  dbus_message_unref (message);
+
+  if (pc == NULL || dbus_pending_call_get_completed (pc))
+    {
+      /* pc can be NULL when the connection is already disconnected */
+      _tp_dbus_daemon_get_name_owner_notify (pc, context);
+      get_name_owner_context_unref (context);
+    }
+  else if (!dbus_pending_call_set_notify (pc,
+        _tp_dbus_daemon_get_name_owner_notify,
+        context, get_name_owner_context_unref))
+    {
+      ERROR ("Out of memory");
+    }
+}
+
+typedef struct {
+    TpDBusDaemon *self;
+    /* dup'd names */
+    GPtrArray *names;
+} LookupBatchContext;
+
+static void
+lookup_batch_context_free (gpointer data)
+{
+  LookupBatchContext *context = data;
+
+  g_object_unref (context->self);
+  g_ptr_array_unref (context->names);
+  g_slice_free (LookupBatchContext, context);
+}
+
+static void
+_tp_dbus_daemon_lookup_batch_notify (DBusPendingCall *pc,
+    gpointer data)
+{
+  LookupBatchContext *context = data;
+  TpDBusDaemon *self = context->self;
+  DBusMessage *reply = NULL;
+  GHashTable *present = NULL;
+  char **names = NULL;
+  int n_names;
+  guint i;
+
+  /* we recycle this function for the case where the connection is already
+   * disconnected: in that case we use pc = NULL */
+  if (pc != NULL)
+    reply = dbus_pending_call_steal_reply (pc);
+
+  if (reply != NULL &&
+      dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+      dbus_message_get_args (reply, NULL,
+        DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &names, &n_names,
+        DBUS_TYPE_INVALID))
+    {
+      present = g_hash_table_new (g_str_hash, g_str_equal);
+
+      for (i = 0; names[i] != NULL; i++)
+        g_hash_table_add (present, names[i]);
+    }
+  else
+    {
+      DEBUG ("ListNames failed, looking up owners one by one");
+    }
+
+  for (i = 0; i < context->names->len; i++)
+    {
+      const gchar *name = g_ptr_array_index (context->names, i);
+      GetNameOwnerContext *gno_context;
+
+      if (present == NULL ||
+          (name[0] != ':' && g_hash_table_contains (present, name)))
+        {
+          /* only GetNameOwner can tell us who owns a well-known name */
+          _tp_dbus_daemon_send_get_name_owner (self, name);
+          continue;
+        }
+
+      /* The name either doesn't exist, or is a unique name, which is its
+       * own owner. Deliver that in an idle, just like a reply to
+       * GetNameOwner at this point in the message stream, so that it comes
+       * before any NameOwnerChanged signal that follows. */
+      gno_context = get_name_owner_context_new (self, name);
+      gno_context->owner = g_strdup (
+          g_hash_table_contains (present, name) ? name : "");
+      _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+      _tp_dbus_daemon_get_name_owner_idle,
+          gno_context, get_name_owner_context_unref);
+    }
+
+  tp_clear_pointer (&present, g_hash_table_unref);
+  dbus_free_string_array (names);   /* NULL-safe */
+
+  if (reply != NULL)
+    dbus_message_unref (reply);
+
+  if (pc != NULL)
+    dbus_pending_call_unref (pc);
+}
+
+static gboolean
+_tp_dbus_daemon_lookup_batch_cb (gpointer data)
+{
+  TpDBusDaemon *self = data;
+  GPtrArray *lookups = self->priv->pending_lookups;
+
+  self->priv->lookup_batch_id = 0;
+  self->priv->pending_lookups = NULL;
+
+  if (lookups == NULL)
+    return FALSE;
+
+  if (lookups->len == 1)
+    {
+      _tp_dbus_daemon_send_get_name_owner (self,
+          g_ptr_array_index (lookups, 0));
+      g_ptr_array_unref (lookups);
+    }
+  else
+    {
+      LookupBatchContext *context = g_slice_new (LookupBatchContext);
+      DBusMessage *message;
+      DBusPendingCall *pc = NULL;
+
+      /* One ListNames call tells us which of the names exist, and the
+       * owners of the unique names among them, which are usually most of
+       * them */
+      DEBUG ("Looking up %u name owners with ListNames", lookups->len);
+      context->self = g_object_ref (self);
+      context->names = lookups;
+
+      message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
+          DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "ListNames");
+
+      if (message == NULL)
+        ERROR ("Out of memory");
+
+      if (!dbus_connection_send_with_reply (self->priv->libdbus,
+          message, &pc, -1))
+        ERROR ("Out of memory");
+      /* pc is unreffed by _tp_dbus_daemon_lookup_batch_notify */
+      dbus_message_unref (message);
+
+      if (pc == NULL || dbus_pending_call_get_completed (pc))
+        {
+          /* pc can be NULL when the connection is already disconnected */
+          _tp_dbus_daemon_lookup_batch_notify (pc, context);
+          lookup_batch_context_free (context);
+        }
+      else if (!dbus_pending_call_set_notify (pc,
+            _tp_dbus_daemon_lookup_batch_notify, context,
+            lookup_batch_context_free))
+        {
+          ERROR ("Out of memory");
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+_tp_dbus_daemon_look_up_name_owner (TpDBusDaemon *self,
+    const gchar *name)
+{
+  if (self->priv->lookup_batch_id == 0)
+    {
+      /* Look up the first name straight away, as we always did, but hold
+       * back any more names that are watched before we get back to the main
+       * loop, which are usually part of the same burst */
+      _tp_dbus_daemon_send_get_name_owner (self, name);
+      self->priv->lookup_batch_id = _tp_idle_add_full (
+          TP_LATENCY_CLASS_INTERACTIVE, _tp_dbus_daemon_lookup_batch_cb, self,
+          NULL);
+      return;
+    }
+
+  if (self->priv->pending_lookups == NULL)
+    self->priv->pending_lookups = g_ptr_array_new_with_free_func (g_free);
+
+  g_ptr_array_add (self->priv->pending_lookups, g_strdup (name));
+}
+
 /**
  * tp_dbus_daemon_watch_name_owner:
  * @self: The D-Bus daemon
@@ -505,11 +945,6 @@ tp_dbus_daemon_watch_name_owner (TpDBusDaemon *self,
 
   if (watch == NULL)
     {
-      gchar *match_rule;
-      DBusMessage *message;
-      DBusPendingCall *pc = NULL;
-      GetNameOwnerContext *context = get_name_owner_context_new (self, name);
-
       /* Allocate a new watch */
       watch = g_slice_new0 (_NameOwnerWatch);
       watch->last_owner = NULL;
@@ -519,46 +954,9 @@ tp_dbus_daemon_watch_name_owner (TpDBusDaemon *self,
       g_hash_table_insert (self->priv->name_owner_watches, g_strdup (name),
           watch);
 
-      /* We want to be notified about name owner changes for this one.
-       * Assume the match addition will succeed; there's no good way to cope
-       * with failure here... */
-      match_rule = _tp_dbus_daemon_get_noc_rule (name);
-      DEBUG ("Adding match rule %s", match_rule);
-      dbus_bus_add_match (self->priv->libdbus, match_rule, NULL);
-      g_free (match_rule);
-
-      message = dbus_message_new_method_call (DBUS_SERVICE_DBUS,
-          DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS, "GetNameOwner");
-
-      if (message == NULL)
-        ERROR ("Out of memory");
-
-      /* We already checked that @name was in (a small subset of) UTF-8,
-       * so OOM is the only thing that can go wrong. The use of &name here
-       * is because libdbus is strange. */
-      if (!dbus_message_append_args (message,
-            DBUS_TYPE_STRING, &name,
-            DBUS_TYPE_INVALID))
-        ERROR ("Out of memory");
-
-      if (!dbus_connection_send_with_reply (self->priv->libdbus,
-          message, &pc, -1))
-        ERROR ("Out of memory");
-      /* pc is unreffed by _tp_dbus_daemon_get_name_owner_notify */
-      dbus_message_unref (message);
-
-      if (pc == NULL || dbus_pending_call_get_completed (pc))
-        {
-          /* pc can be NULL when the connection is already disconnected */
-          _tp_dbus_daemon_get_name_owner_notify (pc, context);
-          get_name_owner_context_unref (context);
-        }
-      else if (!dbus_pending_call_set_notify (pc,
-            _tp_dbus_daemon_get_name_owner_notify,
-            context, get_name_owner_context_unref))
-        {
-          ERROR ("Out of memory");
-        }
+      /* all the watches for a name share a match rule and a lookup */
+      _tp_dbus_daemon_add_noc_match (self, name);
+      _tp_dbus_daemon_look_up_name_owner (self, name);
     }
 
   g_array_append_val (watch->callbacks, tmp);
@@ -575,8 +973,6 @@ _tp_dbus_daemon_stop_watching (TpDBusDaemon *self,
                                const gchar *name,
                                _NameOwnerWatch *watch)
 {
-  gchar *match_rule;
-
   /* Clean up any leftöver callbacks. */
   if (watch->callbacks->len > 0)
     {
@@ -596,10 +992,7 @@ _tp_dbus_daemon_stop_watching (TpDBusDaemon *self,
   g_free (watch->last_owner);
   g_slice_free (_NameOwnerWatch, watch);
 
-  match_rule = _tp_dbus_daemon_get_noc_rule (name);
-  DEBUG ("Removing match rule %s", match_rule);
-  dbus_bus_remove_match (self->priv->libdbus, match_rule, NULL);
-  g_free (match_rule);
+  _tp_dbus_daemon_remove_noc_match (self, name);
 }
 
 /**
@@ -763,6 +1156,20 @@ tp_dbus_daemon_request_name (TpDBusDaemon *self,
                              const gchar *well_known_name,
                              gboolean idempotent,
                              GError **error)
+{
+  return _tp_dbus_daemon_request_name_with_flags (self, well_known_name,
+      idempotent, DBUS_NAME_FLAG_DO_NOT_QUEUE, error);
+}
+
+/* As for tp_dbus_daemon_request_name(), but with additional RequestName
+ * flags such as DBUS_NAME_FLAG_ALLOW_REPLACEMENT; @flags must include
+ * DBUS_NAME_FLAG_DO_NOT_QUEUE */
+gboolean
+_tp_dbus_daemon_request_name_with_flags (TpDBusDaemon *self,
+    const gchar *well_known_name,
+    gboolean idempotent,
+    guint flags,
+    GError **error)
 {
   TpProxy *as_proxy = (TpProxy *) self;
   DBusGConnection *gconn;
@@ -775,6 +1182,7 @@ tp_dbus_daemon_request_name (TpDBusDaemon *self,
   g_return_val_if_fail (tp_dbus_check_valid_bus_name (well_known_name,
         TP_DBUS_NAME_TYPE_WELL_KNOWN, error), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail (flags & DBUS_NAME_FLAG_DO_NOT_QUEUE, FALSE);
 
   invalidated = tp_proxy_get_invalidated (self);
 
@@ -790,8 +1198,7 @@ tp_dbus_daemon_request_name (TpDBusDaemon *self,
   dbc = dbus_g_connection_get_connection (gconn);
 
   dbus_error_init (&dbus_error);
-  result = dbus_bus_request_name (dbc, well_known_name,
-      DBUS_NAME_FLAG_DO_NOT_QUEUE, &dbus_error);
+  result = dbus_bus_request_name (dbc, well_known_name, flags, &dbus_error);
 
   switch (result)
     {
@@ -921,15 +1328,28 @@ void
 tp_dbus_daemon_register_object (TpDBusDaemon *self,
     const gchar *object_path,
     gpointer object)
+{
+  g_return_if_fail (TP_IS_DBUS_DAEMON (self));
+  g_return_if_fail (tp_dbus_check_valid_object_path (object_path, NULL));
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  _tp_dbus_daemon_register_trusted_object (self, object_path, object);
+}
+
+void
+_tp_dbus_daemon_register_trusted_object (TpDBusDaemon *self,
+    const gchar *object_path,
+    gpointer object)
 {
   TpProxy *as_proxy = (TpProxy *) self;
 
   g_return_if_fail (TP_IS_DBUS_DAEMON (self));
-  g_return_if_fail (tp_dbus_check_valid_object_path (object_path, NULL));
   g_return_if_fail (G_IS_OBJECT (object));
 
   dbus_g_connection_register_g_object (as_proxy->dbus_connection,
       object_path, object);
+  _tp_svc_export_object (dbus_g_connection_get_connection (
+        as_proxy->dbus_connection), object_path, object);
 }
 
 /**
@@ -952,6 +1372,8 @@ tp_dbus_daemon_unregister_object (TpDBusDaemon *self,
   g_return_if_fail (TP_IS_DBUS_DAEMON (self));
   g_return_if_fail (G_IS_OBJECT (object));
 
+  _tp_svc_unexport_object (dbus_g_connection_get_connection (
+        as_proxy->dbus_connection), object);
   dbus_g_connection_unregister_g_object (as_proxy->dbus_connection, object);
 }
 
@@ -1111,7 +1533,8 @@ _tp_dbus_daemon_list_names_notify (DBusPendingCall *pc,
   /* We have to do the real work in an idle, so we don't break re-entrant
    * calls (the dbus-glib event source isn't re-entrant) */
   context->refs++;
-  g_idle_add_full (G_PRIORITY_HIGH, _tp_dbus_daemon_list_names_idle,
+  _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+      _tp_dbus_daemon_list_names_idle,
       context, list_names_context_unref);
 
   if (pc != NULL)
@@ -1341,6 +1764,14 @@ tp_dbus_daemon_dispose (GObject *object)
       g_hash_table_unref (tmp);
     }
 
+  if (self->priv->lookup_batch_id != 0)
+    {
+      _tp_source_remove (self->priv->lookup_batch_id);
+      self->priv->lookup_batch_id = 0;
+    }
+
+  tp_clear_pointer (&self->priv->pending_lookups, g_ptr_array_unref);
+
   if (self->priv->libdbus != NULL)
     {
       /* remove myself from the list to be notified on NoC */
@@ -1359,10 +1790,29 @@ tp_dbus_daemon_dispose (GObject *object)
             }
         }
 
+      /* libdbus requires private connections to be closed before their
+       * last ref is released */
+      if (self->priv->private_context != NULL)
+        dbus_connection_close (self->priv->libdbus);
+
       dbus_connection_unref (self->priv->libdbus);
       self->priv->libdbus = NULL;
     }
 
+  if (self->priv->private_context != NULL)
+    {
+      G_LOCK (context_bus_daemons);
+
+      if (g_hash_table_lookup (context_bus_daemons,
+            self->priv->private_context) == self)
+        g_hash_table_remove (context_bus_daemons,
+            self->priv->private_context);
+
+      G_UNLOCK (context_bus_daemons);
+
+      tp_clear_pointer (&self->priv->private_context, g_main_context_unref);
+    }
+
   G_OBJECT_CLASS (tp_dbus_daemon_parent_class)->dispose (object);
 }
 
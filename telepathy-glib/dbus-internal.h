@@ -30,13 +30,27 @@ G_BEGIN_DECLS
 gboolean _tp_dbus_daemon_get_name_owner (TpDBusDaemon *self, gint timeout_ms,
     const gchar *well_known_name, gchar **unique_name, GError **error);
 
+gboolean _tp_dbus_daemon_request_name_with_flags (TpDBusDaemon *self,
+    const gchar *well_known_name, gboolean idempotent, guint flags,
+    GError **error);
+
 void _tp_register_dbus_glib_marshallers (void);
+void _tp_register_dbus_glib_marshallers_for_interface (const gchar *iface);
 
 DBusGConnection *_tp_dbus_starter_bus_conn (GError **error)
   G_GNUC_WARN_UNUSED_RESULT;
 
 gboolean _tp_dbus_daemon_is_the_shared_one (TpDBusDaemon *self);
 
+/* Like tp_dbus_daemon_register_object(), but for an object path that
+ * telepathy-glib generated itself and so is known to be valid */
+void _tp_dbus_daemon_register_trusted_object (TpDBusDaemon *self,
+    const gchar *object_path,
+    gpointer object);
+
+TpDBusDaemon *_tp_dbus_daemon_dup_for_context (GMainContext *context,
+    GError **error) G_GNUC_WARN_UNUSED_RESULT;
+
 G_END_DECLS
 
 #endif /* __TP_INTERNAL_DBUS_GLIB_H__ */
@@ -22,12 +22,18 @@
 
 #include <telepathy-glib/dbus-properties-mixin.h>
 
+#include <string.h>
+
 #include <telepathy-glib/errors.h>
+#include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/svc-generic.h>
 #include <telepathy-glib/util.h>
 
 #define DEBUG_FLAG TP_DEBUG_PROPERTIES
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/metrics-internal.h"
+#include "telepathy-glib/util-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
 
 /**
  * SECTION:dbus-properties-mixin
@@ -121,7 +127,9 @@
  * freed, so it always remains valid.
  *
  * In addition to the documented members, there are two private pointers
- * for future expansion, which must always be initialized to %NULL.
+ * for future expansion, which must always be initialized to %NULL. (Code
+ * generated by glib-ginterface-gen.py from telepathy-glib 0.UNRELEASED or
+ * later sets the first, to speed up looking up properties by name.)
  *
  * Since: 0.7.3
  */
@@ -227,6 +235,24 @@ tp_svc_interface_get_dbus_properties_info (GType g_interface)
  * implementations must always be prepared to return *something*.
  */
 
+/**
+ * TpDBusPropertiesMixinVariantGetter:
+ * @object: The exported object with the properties
+ * @iface: A quark representing the D-Bus interface name
+ * @name: A quark representing the D-Bus property name
+ * @getter_data: The getter_data from the #TpDBusPropertiesMixinPropImpl
+ *
+ * Signature of a callback used to get the value of a property as a
+ * #GVariant, without going via a #GValue. See
+ * tp_dbus_properties_mixin_class_set_variant_getter().
+ *
+ * As with #TpDBusPropertiesMixinGetter, getting a property can't fail.
+ *
+ * Returns: (transfer full): the value of the property, whose type must match
+ *  the property's D-Bus signature; it may be a floating reference
+ * Since: 0.UNRELEASED
+ */
+
 /**
  * tp_dbus_properties_mixin_getter_gobject_properties:
  * @object: The exported object with the properties
@@ -370,6 +396,20 @@ _extra_prop_impls_quark (void)
 }
 
 
+/* TpDBusPropertiesMixinIfaceInfo._1 holds a function generated by
+ * glib-ginterface-gen.py, if any, which maps a property name to its index in
+ * TpDBusPropertiesMixinIfaceInfo.props (or -1) via a perfect hash */
+typedef gint (*PropertyLookup) (const gchar *name);
+
+#define PROPERTY_LOOKUP(iface_info) ((PropertyLookup) (iface_info)->_1)
+
+/* TpDBusPropertiesMixinIfaceImpl._2 holds, if the interface has a
+ * PROPERTY_LOOKUP, an array with the implementation of each property in
+ * TpDBusPropertiesMixinIfaceInfo.props, or NULL where it is not
+ * implemented */
+#define PROP_IMPLS_BY_INDEX(iface_impl) \
+  ((TpDBusPropertiesMixinPropImpl **) (iface_impl)->_2)
+
 static gboolean
 link_interface (GType type,
                 const GType *interfaces,
@@ -408,6 +448,19 @@ link_interface (GType type,
 
   iface_impl->mixin_priv = iface_info;
 
+  if (PROPERTY_LOOKUP (iface_info) != NULL && iface_impl->_2 == NULL)
+    {
+      guint n_props = 0;
+
+      while (iface_info->props[n_props].name != 0)
+        n_props++;
+
+      /* the interface implementation lives as long as the class, so this is
+       * never freed */
+      iface_impl->_2 = (GCallback) g_new0 (TpDBusPropertiesMixinPropImpl *,
+          MAX (n_props, 1));
+    }
+
   for (prop_impl = iface_impl->props; prop_impl->name != NULL; prop_impl++)
     {
       TpDBusPropertiesMixinPropInfo *prop_info;
@@ -437,11 +490,48 @@ link_interface (GType type,
               iface_impl->name);
           return FALSE;
         }
+
+      if (PROP_IMPLS_BY_INDEX (iface_impl) != NULL)
+        {
+          TpDBusPropertiesMixinPropInfo *prop_info = prop_impl->mixin_priv;
+
+          PROP_IMPLS_BY_INDEX (iface_impl)[prop_info - iface_info->props] =
+              prop_impl;
+        }
     }
 
   return TRUE;
 }
 
+/* TpDBusPropertiesMixinIfaceImpl._1 holds an IfaceImplExtra, or NULL if
+ * none of its fields have been set */
+typedef struct {
+    TpDBusPropertiesMixinVariantGetter variant_getter;
+    /* set by tp_dbus_properties_mixin_class_set_immutable() */
+    gboolean immutable;
+} IfaceImplExtra;
+
+#define IFACE_IMPL_EXTRA(iface_impl) ((IfaceImplExtra *) (iface_impl)->_1)
+
+#define VARIANT_GETTER(iface_impl) \
+  (IFACE_IMPL_EXTRA (iface_impl) == NULL ? NULL : \
+   IFACE_IMPL_EXTRA (iface_impl)->variant_getter)
+
+#define IS_IMMUTABLE(iface_impl) \
+  (IFACE_IMPL_EXTRA (iface_impl) != NULL && \
+   IFACE_IMPL_EXTRA (iface_impl)->immutable)
+
+static IfaceImplExtra *
+iface_impl_ensure_extra (TpDBusPropertiesMixinIfaceImpl *iface_impl)
+{
+  /* the interface implementation lives as long as the class, so this is
+   * never freed */
+  if (iface_impl->_1 == NULL)
+    iface_impl->_1 = (GCallback) g_new0 (IfaceImplExtra, 1);
+
+  return IFACE_IMPL_EXTRA (iface_impl);
+}
+
 /* if this assertion fails, TpDBusPropertiesMixinIfaceImpl.mixin_next (which
  * used to be a GCallback but is now a gpointer) will be an ABI break on this
  * architecture, so do some evil trick with unions or something */
@@ -663,13 +753,53 @@ out:
   g_free (interfaces);
 }
 
+/* Find the implementation of @iface_quark set up for @type itself, not any
+ * of its parents. @cls is the class of @type or of a subclass. */
+static TpDBusPropertiesMixinIfaceImpl *
+find_iface_impl_for_type (GType type,
+    GObjectClass *cls,
+    GQuark iface_quark)
+{
+  gpointer offset = g_type_get_qdata (type, _prop_mixin_offset_quark ());
+  TpDBusPropertiesMixinClass *mixin = NULL;
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
+  TpDBusPropertiesMixinIfaceInfo *iface_info;
+
+  if (offset != NULL)
+    mixin = &G_STRUCT_MEMBER (TpDBusPropertiesMixinClass, cls,
+        GPOINTER_TO_SIZE (offset));
+
+  if (mixin != NULL && mixin->interfaces != NULL)
+    {
+      for (iface_impl = mixin->interfaces;
+           iface_impl->name != NULL;
+           iface_impl++)
+        {
+          iface_info = iface_impl->mixin_priv;
+
+          if (iface_info->dbus_interface == iface_quark)
+            return iface_impl;
+        }
+    }
+
+  for (iface_impl = g_type_get_qdata (type, _extra_prop_impls_quark ());
+       iface_impl != NULL;
+       iface_impl = iface_impl->mixin_next)
+    {
+      iface_info = iface_impl->mixin_priv;
+
+      if (iface_info->dbus_interface == iface_quark)
+        return iface_impl;
+    }
+
+  return NULL;
+}
+
 static TpDBusPropertiesMixinIfaceImpl *
 _tp_dbus_properties_mixin_find_iface_impl (GObject *self,
                                            const gchar *name)
 {
   GType type;
-  GQuark offset_quark = _prop_mixin_offset_quark ();
-  GQuark extras_quark = _extra_prop_impls_quark ();
   GQuark iface_quark = g_quark_try_string (name);
 
   if (iface_quark == 0)
@@ -679,40 +809,257 @@ _tp_dbus_properties_mixin_find_iface_impl (GObject *self,
        type != 0;
        type = g_type_parent (type))
     {
-      gpointer offset = g_type_get_qdata (type, offset_quark);
-      TpDBusPropertiesMixinClass *mixin = NULL;
-      TpDBusPropertiesMixinIfaceImpl *iface_impl;
-      TpDBusPropertiesMixinIfaceInfo *iface_info;
+      TpDBusPropertiesMixinIfaceImpl *iface_impl = find_iface_impl_for_type (
+          type, G_OBJECT_GET_CLASS (self), iface_quark);
 
-      if (offset != NULL)
-        mixin = &G_STRUCT_MEMBER (TpDBusPropertiesMixinClass,
-            G_OBJECT_GET_CLASS (self), GPOINTER_TO_SIZE (offset));
+      if (iface_impl != NULL)
+        return iface_impl;
+    }
 
-      if (mixin != NULL && mixin->interfaces != NULL)
-        {
-          for (iface_impl = mixin->interfaces;
-               iface_impl->name != NULL;
-               iface_impl++)
-            {
-              iface_info = iface_impl->mixin_priv;
+  return NULL;
+}
 
-              if (iface_info->dbus_interface == iface_quark)
-                return iface_impl;
-            }
-        }
+/**
+ * tp_dbus_properties_mixin_class_set_variant_getter: (skip)
+ * @cls: a subclass of #GObjectClass
+ * @interface_name: the name of an interface whose properties @cls
+ *  implements
+ * @getter: a callback to get properties on this interface as #GVariant
+ *
+ * Declare that the properties of @interface_name, which must have been set
+ * up for @cls itself (not a parent class) by
+ * tp_dbus_properties_mixin_class_init() or
+ * tp_dbus_properties_mixin_implement_interface(), can also be got by
+ * @getter, with the same getter_data from their
+ * #TpDBusPropertiesMixinPropImpl.
+ *
+ * The D-Bus methods Get and GetAll, and
+ * tp_dbus_properties_mixin_dup_all_vardict(), then use @getter,
+ * and put its results straight into the reply without converting them
+ * from #GValue. Functions that return a #GValue, such as
+ * tp_dbus_properties_mixin_get(), keep using the #TpDBusPropertiesMixinGetter
+ * if there is one, and otherwise convert the result of @getter.
+ * The #TpDBusPropertiesMixinGetter may therefore be %NULL if @getter can
+ * get all the properties.
+ *
+ * This function should be called from the class_init callback, after
+ * setting up the interface.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dbus_properties_mixin_class_set_variant_getter (GObjectClass *cls,
+    const gchar *interface_name,
+    TpDBusPropertiesMixinVariantGetter getter)
+{
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
 
-      for (iface_impl = g_type_get_qdata (type, extras_quark);
-           iface_impl != NULL;
-           iface_impl = iface_impl->mixin_next)
-        {
-          iface_info = iface_impl->mixin_priv;
+  g_return_if_fail (G_IS_OBJECT_CLASS (cls));
+  g_return_if_fail (interface_name != NULL);
 
-          if (iface_info->dbus_interface == iface_quark)
-            return iface_impl;
+  iface_impl = find_iface_impl_for_type (G_OBJECT_CLASS_TYPE (cls), cls,
+      g_quark_try_string (interface_name));
+
+  if (iface_impl == NULL)
+    {
+      CRITICAL ("type %s does not implement the properties of %s itself",
+          G_OBJECT_CLASS_NAME (cls), interface_name);
+      return;
+    }
+
+  iface_impl_ensure_extra (iface_impl)->variant_getter = getter;
+}
+
+/**
+ * tp_dbus_properties_mixin_class_set_immutable:
+ * @cls: a subclass of #GObjectClass
+ * @interface_name: the name of an interface whose properties @cls
+ *  implements
+ *
+ * Declare that the readable properties of @interface_name, which must have
+ * been set up for @cls itself as for
+ * tp_dbus_properties_mixin_class_set_variant_getter(), never change
+ * during the lifetime of an object once they have first been read.
+ *
+ * The first call to the D-Bus methods Get or GetAll, or to
+ * tp_dbus_properties_mixin_dup_all_vardict(), for @interface_name on each
+ * object then gets all of those properties and keeps them; later calls
+ * reuse them instead of calling the getter, and each GetAll reply is a
+ * copy of one that was serialized the first time. Functions that return a
+ * #GValue, such as tp_dbus_properties_mixin_get(), still call the getter.
+ *
+ * This function should be called from the class_init callback, after
+ * setting up the interface.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dbus_properties_mixin_class_set_immutable (GObjectClass *cls,
+    const gchar *interface_name)
+{
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
+
+  g_return_if_fail (G_IS_OBJECT_CLASS (cls));
+  g_return_if_fail (interface_name != NULL);
+
+  iface_impl = find_iface_impl_for_type (G_OBJECT_CLASS_TYPE (cls), cls,
+      g_quark_try_string (interface_name));
+
+  if (iface_impl == NULL)
+    {
+      CRITICAL ("type %s does not implement the properties of %s itself",
+          G_OBJECT_CLASS_NAME (cls), interface_name);
+      return;
+    }
+
+  iface_impl_ensure_extra (iface_impl)->immutable = TRUE;
+}
+
+/* The values of an interface marked with
+ * tp_dbus_properties_mixin_class_set_immutable(), on one object */
+typedef struct {
+    /* a{sv} of every readable property */
+    GVariant *all;
+    /* a reply to GetAll containing @all, or NULL if not built yet */
+    DBusMessage *get_all_reply;
+} ImmutableCache;
+
+static void
+immutable_cache_free (gpointer p)
+{
+  ImmutableCache *cache = p;
+
+  g_variant_unref (cache->all);
+
+  if (cache->get_all_reply != NULL)
+    dbus_message_unref (cache->get_all_reply);
+
+  g_slice_free (ImmutableCache, cache);
+}
+
+static GQuark
+_immutable_caches_quark (void)
+{
+  static GQuark q = 0;
+
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string
+        ("tp_dbus_properties_mixin_class_set_immutable@"
+         "TELEPATHY_GLIB_0.UNRELEASED");
+
+  return q;
+}
+
+static GVariant *iface_impl_build_vardict (GObject *self,
+    TpDBusPropertiesMixinIfaceImpl *iface_impl);
+
+/* Returns: (transfer none): the cached values of @iface_impl, which must
+ * be immutable, on @self */
+static ImmutableCache *
+immutable_cache_ensure (GObject *self,
+    TpDBusPropertiesMixinIfaceImpl *iface_impl)
+{
+  GQuark q = _immutable_caches_quark ();
+  /* borrowed TpDBusPropertiesMixinIfaceImpl => owned ImmutableCache */
+  GHashTable *caches = g_object_get_qdata (self, q);
+  ImmutableCache *cache;
+
+  if (caches == NULL)
+    {
+      caches = g_hash_table_new_full (NULL, NULL, NULL,
+          immutable_cache_free);
+      g_object_set_qdata_full (self, q, caches,
+          (GDestroyNotify) g_hash_table_unref);
+    }
+
+  cache = g_hash_table_lookup (caches, iface_impl);
+
+  if (cache == NULL)
+    {
+      cache = g_slice_new0 (ImmutableCache);
+      cache->all = iface_impl_build_vardict (self, iface_impl);
+      g_hash_table_insert (caches, iface_impl, cache);
+    }
+
+  return cache;
+}
+
+/* Returns: (transfer full): the value of @prop_impl, or %NULL if the
+ * variant getter fails or returns the wrong type */
+static GVariant *
+iface_impl_dup_variant (GObject *self,
+    TpDBusPropertiesMixinIfaceImpl *iface_impl,
+    TpDBusPropertiesMixinPropImpl *prop_impl)
+{
+  TpDBusPropertiesMixinIfaceInfo *iface_info = iface_impl->mixin_priv;
+  TpDBusPropertiesMixinPropInfo *prop_info = prop_impl->mixin_priv;
+  GVariant *ret;
+
+  if (VARIANT_GETTER (iface_impl) != NULL)
+    {
+      ret = VARIANT_GETTER (iface_impl) (self, iface_info->dbus_interface,
+          prop_info->name, prop_impl->getter_data);
+
+      /* the getter has presumably already complained */
+      if (G_UNLIKELY (ret == NULL))
+        return NULL;
+
+      g_variant_ref_sink (ret);
+
+      if (G_UNLIKELY (!g_variant_is_of_type (ret,
+              G_VARIANT_TYPE (prop_info->dbus_signature))))
+        {
+          CRITICAL ("%s.%s on %s should have type '%s', not '%s'",
+              iface_impl->name, prop_impl->name, G_OBJECT_TYPE_NAME (self),
+              prop_info->dbus_signature, g_variant_get_type_string (ret));
+          g_variant_unref (ret);
+          return NULL;
         }
     }
+  else
+    {
+      GValue value = G_VALUE_INIT;
 
-  return NULL;
+      g_value_init (&value, prop_info->type);
+      iface_impl->getter (self, iface_info->dbus_interface,
+          prop_info->name, &value, prop_impl->getter_data);
+      ret = g_variant_ref_sink (dbus_g_value_build_g_variant (&value));
+      g_value_unset (&value);
+    }
+
+  return ret;
+}
+
+/* @value is unset (initialized to all zeroes) */
+static void
+iface_impl_get_value (GObject *self,
+    TpDBusPropertiesMixinIfaceImpl *iface_impl,
+    TpDBusPropertiesMixinPropImpl *prop_impl,
+    GValue *value)
+{
+  TpDBusPropertiesMixinIfaceInfo *iface_info = iface_impl->mixin_priv;
+  TpDBusPropertiesMixinPropInfo *prop_info = prop_impl->mixin_priv;
+  GVariant *variant;
+
+  if (iface_impl->getter != NULL)
+    {
+      g_value_init (value, prop_info->type);
+      iface_impl->getter (self, iface_info->dbus_interface,
+          prop_info->name, value, prop_impl->getter_data);
+      return;
+    }
+
+  variant = iface_impl_dup_variant (self, iface_impl, prop_impl);
+
+  if (variant == NULL)
+    {
+      /* the variant getter is broken, but has already complained */
+      g_value_init (value, prop_info->type);
+      return;
+    }
+
+  dbus_g_value_parse_g_variant (variant, value);
+  g_variant_unref (variant);
 }
 
 static TpDBusPropertiesMixinPropImpl *
@@ -720,9 +1067,19 @@ _tp_dbus_properties_mixin_find_prop_impl
     (TpDBusPropertiesMixinIfaceImpl *iface_impl,
      const gchar *name)
 {
-  GQuark prop_quark = g_quark_try_string (name);
+  TpDBusPropertiesMixinIfaceInfo *iface_info = iface_impl->mixin_priv;
+  GQuark prop_quark;
   TpDBusPropertiesMixinPropImpl *prop_impl;
 
+  if (PROP_IMPLS_BY_INDEX (iface_impl) != NULL)
+    {
+      gint i = PROPERTY_LOOKUP (iface_info) (name);
+
+      return (i < 0 ? NULL : PROP_IMPLS_BY_INDEX (iface_impl)[i]);
+    }
+
+  prop_quark = g_quark_try_string (name);
+
   if (prop_quark == 0)
     return NULL;
 
@@ -769,7 +1126,7 @@ _iface_impl_get_property_impl (
       return FALSE;
     }
 
-  if (iface_impl->getter == NULL)
+  if (iface_impl->getter == NULL && VARIANT_GETTER (iface_impl) == NULL)
     {
       g_set_error (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
           "Getting properties on %s is unimplemented", interface_name);
@@ -828,12 +1185,7 @@ tp_dbus_properties_mixin_get (GObject *self,
 
   if (prop_impl != NULL)
     {
-      TpDBusPropertiesMixinIfaceInfo *iface_info = iface_impl->mixin_priv;
-      TpDBusPropertiesMixinPropInfo *prop_info = prop_impl->mixin_priv;
-
-      g_value_init (value, prop_info->type);
-      iface_impl->getter (self, iface_info->dbus_interface,
-          prop_info->name, value, prop_impl->getter_data);
+      iface_impl_get_value (self, iface_impl, prop_impl, value);
       return TRUE;
     }
   else
@@ -858,7 +1210,7 @@ tp_dbus_properties_mixin_fill_properties_hash_va (
        iface != NULL;
        iface = va_arg (ap, gchar *))
     {
-      GValue *value = g_slice_new0 (GValue);
+      GValue *value = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
       GError *error = NULL;
 
       if (first)
@@ -979,6 +1331,35 @@ tp_dbus_properties_mixin_make_properties_hash (
   return table;
 }
 
+/* An estimate of the size of the arguments of a PropertiesChanged signal,
+ * for the metrics */
+static guint64
+properties_changed_size (const gchar *interface_name,
+    GHashTable *changed_properties,
+    const gchar * const *invalidated_properties)
+{
+  guint64 size = strlen (interface_name) + 1;
+  GHashTableIter iter;
+  gpointer k, v;
+  const gchar * const *name;
+
+  g_hash_table_iter_init (&iter, changed_properties);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      GVariant *variant = g_variant_ref_sink (
+          dbus_g_value_build_g_variant (v));
+
+      size += strlen (k) + 1 + g_variant_get_size (variant);
+      g_variant_unref (variant);
+    }
+
+  for (name = invalidated_properties; *name != NULL; name++)
+    size += strlen (*name) + 1;
+
+  return size;
+}
+
 /**
  * tp_dbus_properties_mixin_emit_properties_changed:
  * @object: an object which uses the D-Bus properties mixin
@@ -1016,7 +1397,6 @@ tp_dbus_properties_mixin_emit_properties_changed (
     const gchar * const *properties)
 {
   TpDBusPropertiesMixinIfaceImpl *iface_impl;
-  TpDBusPropertiesMixinIfaceInfo *iface_info;
   GHashTable *changed_properties;
   GPtrArray *invalidated_properties;
   const gchar * const *prop_name;
@@ -1026,8 +1406,6 @@ tp_dbus_properties_mixin_emit_properties_changed (
       interface_name);
   g_return_if_fail (iface_impl != NULL);
 
-  iface_info = iface_impl->mixin_priv;
-
   /* If someone passes no property names, well … that's fine, we have nothing
    * to do.
    */
@@ -1061,9 +1439,7 @@ tp_dbus_properties_mixin_emit_properties_changed (
         {
           GValue v = { 0, };
 
-          g_value_init (&v, prop_info->type);
-          iface_impl->getter (object, iface_info->dbus_interface,
-              prop_info->name, &v, prop_impl->getter_data);
+          iface_impl_get_value (object, iface_impl, prop_impl, &v);
           g_hash_table_insert (changed_properties, (gchar *) *prop_name,
               tp_g_value_slice_dup (&v));
 
@@ -1085,6 +1461,13 @@ tp_dbus_properties_mixin_emit_properties_changed (
 
   tp_svc_dbus_properties_emit_properties_changed (object, interface_name,
       changed_properties, (const gchar **) invalidated_properties->pdata);
+
+  if (_tp_metrics_are_enabled ())
+    _tp_metrics_add_signal_bytes (TP_IFACE_DBUS_PROPERTIES,
+        "PropertiesChanged", properties_changed_size (interface_name,
+          changed_properties,
+          (const gchar * const *) invalidated_properties->pdata));
+
   g_hash_table_unref (changed_properties);
   g_ptr_array_unref (invalidated_properties);
 }
@@ -1124,6 +1507,223 @@ tp_dbus_properties_mixin_emit_properties_changed_varargs (
   g_ptr_array_unref (property_names);
 }
 
+/* PropertiesChanged signals deferred by
+ * tp_dbus_properties_mixin_defer_properties_changed(), attached to the
+ * object as qdata */
+typedef struct {
+    /* owned DeferredIface, in the order in which the interfaces first
+     * changed */
+    GPtrArray *interfaces;
+    guint flush_id;
+} DeferredChanges;
+
+typedef struct {
+    /* interned */
+    const gchar *interface_name;
+    /* interned property names, each at most once */
+    GPtrArray *properties;
+} DeferredIface;
+
+static GQuark
+_deferred_changes_quark (void)
+{
+  static GQuark q = 0;
+
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string
+        ("tp_dbus_properties_mixin_defer_properties_changed@"
+         "TELEPATHY_GLIB_0.UNRELEASED");
+
+  return q;
+}
+
+static void
+deferred_iface_free (gpointer p)
+{
+  DeferredIface *deferred_iface = p;
+
+  g_ptr_array_unref (deferred_iface->properties);
+  g_slice_free (DeferredIface, deferred_iface);
+}
+
+static void
+deferred_changes_free (gpointer p)
+{
+  DeferredChanges *deferred = p;
+
+  /* the source holds a ref to the object, so it can't still be pending
+   * when the object is finalized */
+  g_assert (deferred->flush_id == 0);
+  g_ptr_array_unref (deferred->interfaces);
+  g_slice_free (DeferredChanges, deferred);
+}
+
+/**
+ * tp_dbus_properties_mixin_flush_properties_changed:
+ * @object: an object which uses the D-Bus properties mixin
+ *
+ * Emit the PropertiesChanged signals that have been deferred by
+ * tp_dbus_properties_mixin_defer_properties_changed(), now, rather than
+ * when the main loop next runs. If there are none, do nothing.
+ *
+ * This happens automatically before any other signal from one of
+ * telepathy-glib's TpSvc interfaces is emitted on @object, so it is only
+ * necessary before emitting signals from other interfaces.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dbus_properties_mixin_flush_properties_changed (GObject *object)
+{
+  DeferredChanges *deferred;
+  guint i;
+
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  /* Take it off the object first, so that emitting PropertiesChanged below
+   * doesn't come back here */
+  deferred = g_object_steal_qdata (object, _deferred_changes_quark ());
+
+  if (deferred == NULL)
+    return;
+
+  if (deferred->flush_id != 0)
+    {
+      /* this drops the source's ref to object, but our caller has one */
+      _tp_source_remove (deferred->flush_id);
+      deferred->flush_id = 0;
+    }
+
+  for (i = 0; i < deferred->interfaces->len; i++)
+    {
+      DeferredIface *deferred_iface = g_ptr_array_index (
+          deferred->interfaces, i);
+
+      g_ptr_array_add (deferred_iface->properties, NULL);
+      DEBUG ("emitting %u coalesced changes to %s",
+          deferred_iface->properties->len - 1,
+          deferred_iface->interface_name);
+      tp_dbus_properties_mixin_emit_properties_changed (object,
+          deferred_iface->interface_name,
+          (const gchar * const *) deferred_iface->properties->pdata);
+    }
+
+  deferred_changes_free (deferred);
+}
+
+static gboolean
+flush_properties_changed_cb (gpointer data)
+{
+  GObject *object = data;
+  DeferredChanges *deferred = g_object_get_qdata (object,
+      _deferred_changes_quark ());
+
+  g_assert (deferred != NULL);
+  deferred->flush_id = 0;
+  tp_dbus_properties_mixin_flush_properties_changed (object);
+  return FALSE;
+}
+
+/**
+ * tp_dbus_properties_mixin_defer_properties_changed:
+ * @object: an object which uses the D-Bus properties mixin
+ * @interface_name: the interface on which properties have changed
+ * @properties: (allow-none): a %NULL-terminated array of (unqualified)
+ *  property names whose values have changed.
+ *
+ * Like tp_dbus_properties_mixin_emit_properties_changed(), but rather than
+ * emitting PropertiesChanged immediately, remember that @properties have
+ * changed, and emit one PropertiesChanged signal per interface, for all the
+ * properties that changed, when control returns to the main loop. The
+ * values included in the signal are the values at that time, so a property
+ * that changes several times is only signalled once.
+ *
+ * This is useful for code that changes several properties in quick
+ * succession, and would otherwise emit a PropertiesChanged signal for each.
+ *
+ * The deferred signals are emitted before any other signal from one of
+ * telepathy-glib's TpSvc interfaces on @object, including an immediate
+ * PropertiesChanged, so they keep their place relative to those;
+ * tp_dbus_properties_mixin_flush_properties_changed() can be used to emit
+ * them before other signals.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dbus_properties_mixin_defer_properties_changed (
+    GObject *object,
+    const gchar *interface_name,
+    const gchar * const *properties)
+{
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
+  DeferredChanges *deferred;
+  DeferredIface *deferred_iface = NULL;
+  const gchar * const *prop_name;
+  guint i;
+
+  g_return_if_fail (G_IS_OBJECT (object));
+  g_return_if_fail (interface_name != NULL);
+  iface_impl = _tp_dbus_properties_mixin_find_iface_impl (object,
+      interface_name);
+  g_return_if_fail (iface_impl != NULL);
+
+  if (properties == NULL || properties[0] == NULL)
+    return;
+
+  for (prop_name = properties; *prop_name != NULL; prop_name++)
+    g_return_if_fail (_tp_dbus_properties_mixin_find_prop_impl (iface_impl,
+          *prop_name) != NULL);
+
+  interface_name = g_intern_string (interface_name);
+  deferred = g_object_get_qdata (object, _deferred_changes_quark ());
+
+  if (deferred == NULL)
+    {
+      deferred = g_slice_new0 (DeferredChanges);
+      deferred->interfaces = g_ptr_array_new_with_free_func (
+          deferred_iface_free);
+      g_object_set_qdata_full (object, _deferred_changes_quark (), deferred,
+          deferred_changes_free);
+    }
+
+  for (i = 0; i < deferred->interfaces->len; i++)
+    {
+      DeferredIface *candidate = g_ptr_array_index (deferred->interfaces, i);
+
+      if (candidate->interface_name == interface_name)
+        {
+          deferred_iface = candidate;
+          break;
+        }
+    }
+
+  if (deferred_iface == NULL)
+    {
+      deferred_iface = g_slice_new0 (DeferredIface);
+      deferred_iface->interface_name = interface_name;
+      deferred_iface->properties = g_ptr_array_new ();
+      g_ptr_array_add (deferred->interfaces, deferred_iface);
+    }
+
+  for (prop_name = properties; *prop_name != NULL; prop_name++)
+    {
+      const gchar *name = g_intern_string (*prop_name);
+
+      for (i = 0; i < deferred_iface->properties->len; i++)
+        {
+          if (g_ptr_array_index (deferred_iface->properties, i) == name)
+            break;
+        }
+
+      if (i == deferred_iface->properties->len)
+        g_ptr_array_add (deferred_iface->properties, (gchar *) name);
+    }
+
+  if (deferred->flush_id == 0)
+    deferred->flush_id = _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+        flush_properties_changed_cb, g_object_ref (object), g_object_unref);
+}
+
 static void
 _tp_dbus_properties_mixin_get (TpSvcDBusProperties *iface,
                                const gchar *interface_name,
@@ -1131,9 +1731,52 @@ _tp_dbus_properties_mixin_get (TpSvcDBusProperties *iface,
                                DBusGMethodInvocation *context)
 {
   GObject *self = G_OBJECT (iface);
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
   GValue value = { 0 };
   GError *error = NULL;
 
+  iface_impl = _tp_dbus_properties_mixin_find_iface_impl (self,
+      interface_name);
+
+  if (iface_impl != NULL && IS_IMMUTABLE (iface_impl))
+    {
+      ImmutableCache *cache = immutable_cache_ensure (self, iface_impl);
+      GVariant *variant = g_variant_lookup_value (cache->all, property_name,
+          NULL);
+
+      /* if it's not there, it's unreadable or doesn't exist, and the
+       * code below reports why */
+      if (variant != NULL)
+        {
+          _tp_dbus_g_method_return_variant (context,
+              g_variant_new ("(v)", variant));
+          g_variant_unref (variant);
+          return;
+        }
+    }
+
+  if (iface_impl != NULL && VARIANT_GETTER (iface_impl) != NULL)
+    {
+      TpDBusPropertiesMixinPropImpl *prop_impl;
+      GVariant *variant = NULL;
+
+      /* if this fails, tp_dbus_properties_mixin_get() will fail the same
+       * way and report it */
+      prop_impl = _iface_impl_get_property_impl (self, iface_impl,
+          interface_name, property_name, NULL);
+
+      if (prop_impl != NULL)
+        variant = iface_impl_dup_variant (self, iface_impl, prop_impl);
+
+      if (variant != NULL)
+        {
+          _tp_dbus_g_method_return_variant (context,
+              g_variant_new ("(v)", variant));
+          g_variant_unref (variant);
+          return;
+        }
+    }
+
   if (tp_dbus_properties_mixin_get (self, interface_name, property_name,
         &value, &error))
     {
@@ -1165,7 +1808,6 @@ tp_dbus_properties_mixin_dup_all (GObject *self,
     const gchar *interface_name)
 {
   TpDBusPropertiesMixinIfaceImpl *iface_impl;
-  TpDBusPropertiesMixinIfaceInfo *iface_info;
   TpDBusPropertiesMixinPropImpl *prop_impl;
   /* no key destructor needed - the keys are immortal */
   GHashTable *values = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
@@ -1174,11 +1816,10 @@ tp_dbus_properties_mixin_dup_all (GObject *self,
   iface_impl = _tp_dbus_properties_mixin_find_iface_impl (self,
       interface_name);
 
-  if (iface_impl == NULL || iface_impl->getter == NULL)
+  if (iface_impl == NULL ||
+      (iface_impl->getter == NULL && VARIANT_GETTER (iface_impl) == NULL))
     return values;
 
-  iface_info = iface_impl->mixin_priv;
-
   for (prop_impl = iface_impl->props;
        prop_impl->name != NULL;
        prop_impl++)
@@ -1189,23 +1830,119 @@ tp_dbus_properties_mixin_dup_all (GObject *self,
       if ((prop_info->flags & TP_DBUS_PROPERTIES_MIXIN_FLAG_READ) == 0)
         continue;
 
-      value = tp_g_value_slice_new (prop_info->type);
-      iface_impl->getter (self, iface_info->dbus_interface,
-          prop_info->name, value, prop_impl->getter_data);
+      value = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
+      iface_impl_get_value (self, iface_impl, prop_impl, value);
       g_hash_table_insert (values, (gchar *) prop_impl->name, value);
     }
 
   return values;
 }
 
+/**
+ * tp_dbus_properties_mixin_dup_all_vardict:
+ * @self: an object with this mixin
+ * @interface_name: a D-Bus interface name
+ *
+ * The same as tp_dbus_properties_mixin_dup_all(), but return a
+ * %G_VARIANT_TYPE_VARDICT. If the interface's properties have a
+ * #TpDBusPropertiesMixinVariantGetter, the map is built from its results
+ * without creating any #GValue.
+ *
+ * Returns: (transfer full): a map from property name (without the
+ *  interface name) to value
+ * Since: 0.UNRELEASED
+ */
+GVariant *
+tp_dbus_properties_mixin_dup_all_vardict (GObject *self,
+    const gchar *interface_name)
+{
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
+
+  iface_impl = _tp_dbus_properties_mixin_find_iface_impl (self,
+      interface_name);
+
+  if (iface_impl != NULL && IS_IMMUTABLE (iface_impl))
+    return g_variant_ref (immutable_cache_ensure (self, iface_impl)->all);
+
+  return iface_impl_build_vardict (self, iface_impl);
+}
+
+/* Returns: (transfer full): the readable properties of @iface_impl, which
+ * may be %NULL, on @self */
+static GVariant *
+iface_impl_build_vardict (GObject *self,
+    TpDBusPropertiesMixinIfaceImpl *iface_impl)
+{
+  TpDBusPropertiesMixinPropImpl *prop_impl;
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  if (iface_impl == NULL ||
+      (iface_impl->getter == NULL && VARIANT_GETTER (iface_impl) == NULL))
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  for (prop_impl = iface_impl->props;
+       prop_impl->name != NULL;
+       prop_impl++)
+    {
+      TpDBusPropertiesMixinPropInfo *prop_info = prop_impl->mixin_priv;
+      GVariant *value;
+
+      if ((prop_info->flags & TP_DBUS_PROPERTIES_MIXIN_FLAG_READ) == 0)
+        continue;
+
+      value = iface_impl_dup_variant (self, iface_impl, prop_impl);
+
+      if (value != NULL)
+        {
+          g_variant_builder_add (&builder, "{sv}", prop_impl->name, value);
+          g_variant_unref (value);
+        }
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 static void
 _tp_dbus_properties_mixin_get_all_dbus (TpSvcDBusProperties *iface,
     const gchar *interface_name,
     DBusGMethodInvocation *context)
 {
-  GHashTable *values = tp_dbus_properties_mixin_dup_all (G_OBJECT (iface),
+  TpDBusPropertiesMixinIfaceImpl *iface_impl;
+  GHashTable *values;
+
+  iface_impl = _tp_dbus_properties_mixin_find_iface_impl (G_OBJECT (iface),
       interface_name);
 
+  if (iface_impl != NULL && IS_IMMUTABLE (iface_impl))
+    {
+      ImmutableCache *cache = immutable_cache_ensure (G_OBJECT (iface),
+          iface_impl);
+
+      if (cache->get_all_reply == NULL)
+        cache->get_all_reply = _tp_dbus_method_return_template_new (
+            g_variant_new ("(@a{sv})", cache->all));
+
+      _tp_dbus_g_method_return_template (context, cache->get_all_reply);
+      return;
+    }
+
+  /* if the interface has a variant getter, its values never need to be
+   * turned into GValues and marshalled by dbus-glib */
+  if (iface_impl != NULL && VARIANT_GETTER (iface_impl) != NULL)
+    {
+      GVariant *all = tp_dbus_properties_mixin_dup_all_vardict (
+          G_OBJECT (iface), interface_name);
+
+      _tp_dbus_g_method_return_variant (context,
+          g_variant_new ("(@a{sv})", all));
+      g_variant_unref (all);
+      return;
+    }
+
+  values = tp_dbus_properties_mixin_dup_all (G_OBJECT (iface),
+      interface_name);
   tp_svc_dbus_properties_return_from_get_all (context, values);
   g_hash_table_unref (values);
 }
@@ -73,6 +73,9 @@ typedef void (*TpDBusPropertiesMixinGetter) (GObject *object,
 void tp_dbus_properties_mixin_getter_gobject_properties (GObject *object,
     GQuark iface, GQuark name, GValue *value, gpointer getter_data);
 
+typedef GVariant *(*TpDBusPropertiesMixinVariantGetter) (GObject *object,
+    GQuark iface, GQuark name, gpointer getter_data);
+
 typedef gboolean (*TpDBusPropertiesMixinSetter) (GObject *object,
     GQuark iface, GQuark name, const GValue *value, gpointer setter_data,
     GError **error);
@@ -124,6 +127,15 @@ void tp_dbus_properties_mixin_implement_interface (GObjectClass *cls,
     GQuark iface, TpDBusPropertiesMixinGetter getter,
     TpDBusPropertiesMixinSetter setter, TpDBusPropertiesMixinPropImpl *props);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dbus_properties_mixin_class_set_variant_getter (GObjectClass *cls,
+    const gchar *interface_name,
+    TpDBusPropertiesMixinVariantGetter getter);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dbus_properties_mixin_class_set_immutable (GObjectClass *cls,
+    const gchar *interface_name);
+
 void tp_dbus_properties_mixin_iface_init (gpointer g_iface,
     gpointer iface_data);
 
@@ -142,6 +154,10 @@ _TP_AVAILABLE_IN_0_22
 GHashTable *tp_dbus_properties_mixin_dup_all (GObject *self,
     const gchar *interface_name);
 
+_TP_AVAILABLE_IN_UNRELEASED
+GVariant *tp_dbus_properties_mixin_dup_all_vardict (GObject *self,
+    const gchar *interface_name);
+
 GHashTable *tp_dbus_properties_mixin_make_properties_hash (
     GObject *object, const gchar *first_interface,
     const gchar *first_property, ...)
@@ -167,6 +183,15 @@ void tp_dbus_properties_mixin_emit_properties_changed_varargs (
     ...)
   G_GNUC_NULL_TERMINATED;
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dbus_properties_mixin_defer_properties_changed (
+    GObject *object,
+    const gchar *interface_name,
+    const gchar * const *properties);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dbus_properties_mixin_flush_properties_changed (GObject *object);
+
 G_END_DECLS
 
 #endif /* #ifndef __TP_DBUS_PROPERTIES_MIXIN_H__ */
@@ -95,6 +95,7 @@
 
 #define DEBUG_FLAG TP_DEBUG_CHANNEL
 #include "telepathy-glib/automatic-client-factory-internal.h"
+#include "telepathy-glib/batching-io-stream-internal.h"
 #include "telepathy-glib/channel-internal.h"
 #include "telepathy-glib/debug-internal.h"
 #include "telepathy-glib/variant-util-internal.h"
@@ -111,6 +112,15 @@ struct _TpDBusTubeChannelPrivate
 
   GSimpleAsyncResult *result;
   gchar *address;
+
+  /* if max_delay_ms is not 0, the connection is on a batching stream */
+  guint batch_max_delay_ms;
+  gsize batch_max_bytes;
+  _TpBatchingIOStream *batching_stream;
+  /* when get_traffic_stats() was last called, and what it returned */
+  gint64 stats_time;
+  guint64 stats_messages;
+  guint64 stats_bytes;
 };
 
 enum
@@ -129,6 +139,7 @@ tp_dbus_tube_channel_dispose (GObject *obj)
   /* If priv->result isn't NULL, it owns a ref to self. */
   g_warn_if_fail (self->priv->result == NULL);
   tp_clear_pointer (&self->priv->address, g_free);
+  tp_clear_object (&self->priv->batching_stream);
 
   G_OBJECT_CLASS (tp_dbus_tube_channel_parent_class)->dispose (obj);
 }
@@ -205,6 +216,75 @@ dbus_connection_new_cb (GObject *source,
   complete_operation (self);
 }
 
+static GDBusMessage *
+count_message_filter (GDBusConnection *connection,
+    GDBusMessage *message,
+    gboolean incoming,
+    gpointer user_data)
+{
+  _tp_batching_io_stream_count_message (user_data);
+  return message;
+}
+
+static void
+dbus_connection_new_for_stream_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpDBusTubeChannel *self = user_data;
+  GDBusConnection *conn;
+  GError *error = NULL;
+
+  conn = g_dbus_connection_new_finish (result, &error);
+  if (conn == NULL)
+    {
+      DEBUG ("Failed to create GDBusConnection: %s", error->message);
+      g_simple_async_result_take_error (self->priv->result, error);
+      tp_clear_object (&self->priv->batching_stream);
+    }
+  else
+    {
+      /* filters are called in GDBus' worker thread, and the connection may
+       * well outlive us, so the counter lives in the stream */
+      g_dbus_connection_add_filter (conn, count_message_filter,
+          g_object_ref (self->priv->batching_stream), g_object_unref);
+      self->priv->stats_time = g_get_monotonic_time ();
+
+      g_simple_async_result_set_op_res_gpointer (self->priv->result,
+          conn, g_object_unref);
+    }
+
+  complete_operation (self);
+}
+
+static void
+address_get_stream_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpDBusTubeChannel *self = user_data;
+  GIOStream *stream;
+  GError *error = NULL;
+
+  stream = g_dbus_address_get_stream_finish (result, NULL, &error);
+  if (stream == NULL)
+    {
+      DEBUG ("Failed to connect to %s: %s", self->priv->address,
+          error->message);
+      g_simple_async_result_take_error (self->priv->result, error);
+      complete_operation (self);
+      return;
+    }
+
+  self->priv->batching_stream = _tp_batching_io_stream_new (stream,
+      self->priv->batch_max_delay_ms, self->priv->batch_max_bytes);
+  g_object_unref (stream);
+
+  g_dbus_connection_new (G_IO_STREAM (self->priv->batching_stream), NULL,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL,
+      dbus_connection_new_for_stream_cb, self);
+}
+
 static void
 check_tube_open (TpDBusTubeChannel *self)
 {
@@ -220,6 +300,13 @@ check_tube_open (TpDBusTubeChannel *self)
   DEBUG ("Tube %s opened: %s", tp_proxy_get_object_path (self),
       self->priv->address);
 
+  if (self->priv->batch_max_delay_ms > 0)
+    {
+      g_dbus_address_get_stream (self->priv->address, NULL,
+          address_get_stream_cb, self);
+      return;
+    }
+
   g_dbus_connection_new_for_address (self->priv->address,
       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL,
       NULL, dbus_connection_new_cb, self);
@@ -821,3 +908,121 @@ tp_dbus_tube_channel_accept_finish (TpDBusTubeChannel *self,
   _tp_implement_finish_return_copy_pointer (self,
       tp_dbus_tube_channel_accept_async, g_object_ref)
 }
+
+/**
+ * tp_dbus_tube_channel_set_batching:
+ * @self: a #TpDBusTubeChannel
+ * @max_delay_ms: the longest time, in milliseconds, that an outgoing
+ *  message may be held back to be sent together with the following ones,
+ *  or 0 to send each message as soon as possible
+ * @max_bytes: how many bytes of messages are sent together at most; 0 means
+ *  the default of 64 KiB
+ *
+ * Ask for the #GDBusConnection returned by tp_dbus_tube_channel_offer_finish()
+ * or tp_dbus_tube_channel_accept_finish() to batch its outgoing messages,
+ * which is worth it for applications sending bursts of many small messages.
+ *
+ * In this mode, a message is written to the tube's socket together with the
+ * messages sent after it, once @max_delay_ms have passed or @max_bytes are
+ * waiting, whichever comes first. g_dbus_connection_flush() sends whatever
+ * is waiting immediately. If the other side is slow to read, sending more
+ * messages waits for the previous ones to have been written.
+ *
+ * The connection is not made directly on the tube's socket in this mode, so
+ * it can't be used to pass Unix file descriptors; and only the
+ * authentication mechanisms which don't depend on the D-Bus library seeing
+ * the socket itself, such as DBUS_COOKIE_SHA1, are available.
+ * tp_dbus_tube_channel_get_traffic_stats() can be used to see how well
+ * batching works.
+ *
+ * This must be called before tp_dbus_tube_channel_offer_async() or
+ * tp_dbus_tube_channel_accept_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dbus_tube_channel_set_batching (TpDBusTubeChannel *self,
+    guint max_delay_ms,
+    gsize max_bytes)
+{
+  g_return_if_fail (TP_IS_DBUS_TUBE_CHANNEL (self));
+  g_return_if_fail (self->priv->result == NULL);
+  g_return_if_fail (self->priv->address == NULL);
+
+  self->priv->batch_max_delay_ms = max_delay_ms;
+  self->priv->batch_max_bytes = (max_bytes > 0 ? max_bytes : 64 * 1024);
+}
+
+/**
+ * tp_dbus_tube_channel_get_traffic_stats:
+ * @self: a #TpDBusTubeChannel
+ * @messages: (out) (allow-none): used to return the number of D-Bus
+ *  messages sent and received so far, or %NULL
+ * @bytes: (out) (allow-none): used to return the number of bytes sent and
+ *  received so far, or %NULL
+ * @writes: (out) (allow-none): used to return how many times the tube's
+ *  socket has been written to so far, or %NULL
+ * @messages_per_second: (out) (allow-none): used to return the average
+ *  number of messages sent and received per second since the previous call
+ *  to this function, or since the tube was opened, or %NULL
+ * @bytes_per_second: (out) (allow-none): used to return the average number
+ *  of bytes sent and received per second over the same period, or %NULL
+ *
+ * Return statistics about the traffic on the #GDBusConnection of a tube
+ * which was opened after calling tp_dbus_tube_channel_set_batching(). They
+ * keep being counted after the tube is closed, for as long as the
+ * #GDBusConnection is in use.
+ *
+ * Comparing @messages with @writes shows how many messages were batched
+ * together on average.
+ *
+ * Returns: %TRUE if the statistics were returned; %FALSE if batching was
+ *  not requested or the tube has not been opened yet
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_dbus_tube_channel_get_traffic_stats (TpDBusTubeChannel *self,
+    guint64 *messages,
+    guint64 *bytes,
+    guint64 *writes,
+    gdouble *messages_per_second,
+    gdouble *bytes_per_second)
+{
+  guint64 n_messages, n_bytes, n_writes;
+  gint64 now;
+  gdouble elapsed;
+
+  g_return_val_if_fail (TP_IS_DBUS_TUBE_CHANNEL (self), FALSE);
+
+  if (self->priv->batching_stream == NULL || self->priv->stats_time == 0)
+    return FALSE;
+
+  _tp_batching_io_stream_get_stats (self->priv->batching_stream,
+      &n_messages, &n_bytes, &n_writes);
+
+  now = g_get_monotonic_time ();
+  elapsed = (gdouble) (now - self->priv->stats_time) / G_USEC_PER_SEC;
+
+  if (messages != NULL)
+    *messages = n_messages;
+
+  if (bytes != NULL)
+    *bytes = n_bytes;
+
+  if (writes != NULL)
+    *writes = n_writes;
+
+  if (messages_per_second != NULL)
+    *messages_per_second = (elapsed > 0 ?
+        (n_messages - self->priv->stats_messages) / elapsed : 0);
+
+  if (bytes_per_second != NULL)
+    *bytes_per_second = (elapsed > 0 ?
+        (n_bytes - self->priv->stats_bytes) / elapsed : 0);
+
+  self->priv->stats_time = now;
+  self->priv->stats_messages = n_messages;
+  self->priv->stats_bytes = n_bytes;
+  return TRUE;
+}
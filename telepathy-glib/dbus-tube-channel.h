@@ -97,6 +97,19 @@ GDBusConnection * tp_dbus_tube_channel_accept_finish (TpDBusTubeChannel *self,
     GAsyncResult *result,
     GError **error) G_GNUC_WARN_UNUSED_RESULT;
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dbus_tube_channel_set_batching (TpDBusTubeChannel *self,
+    guint max_delay_ms,
+    gsize max_bytes);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_dbus_tube_channel_get_traffic_stats (TpDBusTubeChannel *self,
+    guint64 *messages,
+    guint64 *bytes,
+    guint64 *writes,
+    gdouble *messages_per_second,
+    gdouble *bytes_per_second);
+
 G_END_DECLS
 
 #endif
@@ -75,6 +75,8 @@ struct _TpDebugClient {
 
 struct _TpDebugClientPrivate {
     gboolean enabled;
+    /* TRUE if the service doesn't have GetPackedMessages */
+    gboolean no_packed_messages;
 };
 
 static const TpProxyFeature *tp_debug_client_list_features (
@@ -142,6 +144,27 @@ new_debug_message_cb (TpDebugClient *self,
   g_object_unref (msg);
 }
 
+static void
+new_debug_messages_cb (TpDebugClient *self,
+    const GPtrArray *messages,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  guint i;
+
+  for (i = 0; i < messages->len; i++)
+    {
+      gdouble timestamp;
+      const gchar *domain, *message;
+      TpDebugLevel level;
+
+      tp_value_array_unpack (g_ptr_array_index (messages, i), 4,
+          &timestamp, &domain, &level, &message);
+      new_debug_message_cb (self, timestamp, domain, level, message, NULL,
+          NULL);
+    }
+}
+
 static void
 tp_debug_client_constructed (GObject *object)
 {
@@ -162,7 +185,15 @@ tp_debug_client_constructed (GObject *object)
         NULL, NULL, NULL, &error))
     {
       WARNING ("Failed to connect to NewDebugMessage: %s", error->message);
-      g_error_free (error);
+      g_clear_error (&error);
+    }
+
+  /* services which batch their messages use this instead */
+  if (!tp_cli_debug_connect_to_new_debug_messages (self,
+        new_debug_messages_cb, NULL, NULL, NULL, &error))
+    {
+      WARNING ("Failed to connect to NewDebugMessages: %s", error->message);
+      g_clear_error (&error);
     }
 }
 
@@ -219,6 +250,9 @@ tp_debug_client_class_init (TpDebugClientClass *klass)
    * Emitted when a #TpDebugMessage is generated if the TpDebugMessage:enabled
    * property is set to %TRUE.
    *
+   * If the service batches its debug messages, this is emitted for each
+   * message in the batch, in the order they were generated.
+   *
    * Since: 0.19.0
    */
   signals[SIG_NEW_DEBUG_MESSAGE] = g_signal_new ("new-debug-message",
@@ -461,6 +495,83 @@ tp_debug_client_is_enabled (TpDebugClient *self)
   return self->priv->enabled;
 }
 
+static void get_messages_cb (TpDebugClient *self,
+    const GPtrArray *messages,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object);
+
+static void
+get_packed_messages_cb (TpDebugClient *self,
+    const GArray *timestamps,
+    const gchar **domains,
+    const GArray *domain_indices,
+    const GArray *levels,
+    const gchar **messages,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GSimpleAsyncResult *result = user_data;
+  GPtrArray *messages_arr;
+  guint n_domains, n, i;
+
+  if (g_error_matches (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD))
+    {
+      /* an older service: fall back to the original method */
+      DEBUG ("GetPackedMessages() not implemented, using GetMessages()");
+      self->priv->no_packed_messages = TRUE;
+      tp_cli_debug_call_get_messages (self, -1, get_messages_cb,
+          g_object_ref (result), g_object_unref, NULL);
+      return;
+    }
+
+  if (error != NULL)
+    {
+      DEBUG ("GetPackedMessages() failed: %s", error->message);
+      g_simple_async_result_set_from_error (result, error);
+      goto out;
+    }
+
+  n_domains = (domains == NULL ? 0 : g_strv_length ((gchar **) domains));
+  n = timestamps->len;
+
+  if (domain_indices->len != n || levels->len != n ||
+      messages == NULL || g_strv_length ((gchar **) messages) != n)
+    {
+      g_simple_async_result_set_error (result, TP_ERROR,
+          TP_ERROR_CONFUSED, "GetPackedMessages() returned arrays of "
+          "different lengths");
+      goto out;
+    }
+
+  messages_arr = g_ptr_array_new_full (n, g_object_unref);
+
+  for (i = 0; i < n; i++)
+    {
+      guint domain = g_array_index (domain_indices, guint, i);
+
+      if (domain >= n_domains)
+        {
+          g_simple_async_result_set_error (result, TP_ERROR,
+              TP_ERROR_CONFUSED, "GetPackedMessages() returned domain "
+              "index %u, but only %u domains", domain, n_domains);
+          g_ptr_array_unref (messages_arr);
+          goto out;
+        }
+
+      g_ptr_array_add (messages_arr, _tp_debug_message_new (
+            g_array_index (timestamps, gdouble, i), domains[domain],
+            g_array_index (levels, guint, i), messages[i]));
+    }
+
+  g_simple_async_result_set_op_res_gpointer (result, messages_arr,
+      (GDestroyNotify) g_ptr_array_unref);
+
+out:
+  g_simple_async_result_complete (result);
+}
+
 static void
 get_messages_cb (TpDebugClient *self,
     const GPtrArray *messages,
@@ -524,8 +635,12 @@ tp_debug_client_get_messages_async (
   GSimpleAsyncResult *result = g_simple_async_result_new (G_OBJECT (self),
       callback, user_data, tp_debug_client_set_enabled_async);
 
-  tp_cli_debug_call_get_messages (self, -1, get_messages_cb,
-      result, g_object_unref, NULL);
+  if (self->priv->no_packed_messages)
+    tp_cli_debug_call_get_messages (self, -1, get_messages_cb,
+        result, g_object_unref, NULL);
+  else
+    tp_cli_debug_call_get_packed_messages (self, -1, get_packed_messages_cb,
+        result, g_object_unref, NULL);
 }
 
 /**
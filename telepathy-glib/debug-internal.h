@@ -39,12 +39,25 @@ typedef enum
   TP_DEBUG_TLS           = 1 << 20
 } TpDebugFlags;
 
+/* Domains whose DEBUG() messages are enabled, and the subset of those whose
+ * TRACE() messages are also enabled. These are only meant to be read by the
+ * macros below, so that a disabled message costs a single test; use
+ * tp_debug_set_flags() or _tp_debug_set_flags() to change them. */
+extern TpDebugFlags _tp_debug_flags;
+extern TpDebugFlags _tp_debug_trace_flags;
+
 gboolean _tp_debug_flag_is_set (TpDebugFlags flag);
 void _tp_debug_set_flags (TpDebugFlags flags);
 void _tp_log (GLogLevelFlags level, TpDebugFlags flag, const gchar *format, ...)
     G_GNUC_PRINTF (3, 4);
 gboolean _tp_debug_is_persistent (void);
 
+/* long enough for "YYYY-MM-DDTHH:MM:SS.uuuuuuZ" and a NUL */
+#define _TP_DEBUG_TIMESTAMP_SIZE 28
+
+void _tp_debug_format_timestamp (gint64 now,
+    gchar *buffer);
+
 #define _TP_DEBUG_IS_PERSISTENT (_tp_debug_is_persistent ())
 
 G_END_DECLS
@@ -100,12 +113,33 @@ G_END_DECLS
 
 #undef DEBUG
 #undef DEBUGGING
+#undef TRACE
+
+/* The arguments to DEBUG() and TRACE() are not evaluated unless the
+ * message is going to be logged. TRACE() is for messages in loops and
+ * other hot paths: it is enabled by the plain "domain" keyword, but not by
+ * "domain=debug", and can be compiled out with --disable-debug-trace. */
 
 #ifdef ENABLE_DEBUG
 #   define DEBUG(format, ...) \
-      _tp_log (G_LOG_LEVEL_DEBUG, DEBUG_FLAG, "%s: " format, \
-          G_STRFUNC, ##__VA_ARGS__)
-#   define DEBUGGING _tp_debug_flag_is_set (DEBUG_FLAG)
+      G_STMT_START \
+        { \
+          if (G_UNLIKELY (_tp_debug_flags & (DEBUG_FLAG))) \
+            _tp_log (G_LOG_LEVEL_DEBUG, DEBUG_FLAG, "%s: " format, \
+                G_STRFUNC, ##__VA_ARGS__); \
+        } \
+      G_STMT_END
+#   define DEBUGGING ((_tp_debug_flags & (DEBUG_FLAG)) != 0)
+#   ifdef ENABLE_DEBUG_TRACE
+#     define TRACE(format, ...) \
+        G_STMT_START \
+          { \
+            if (G_UNLIKELY (_tp_debug_trace_flags & (DEBUG_FLAG))) \
+              _tp_log (G_LOG_LEVEL_DEBUG, DEBUG_FLAG, "%s: " format, \
+                  G_STRFUNC, ##__VA_ARGS__); \
+          } \
+        G_STMT_END
+#   endif
 #else /* !defined (ENABLE_DEBUG) */
 #   ifndef DEBUG_STUB_DEFINED
 static inline void
@@ -120,4 +154,15 @@ DEBUG (
 #   define DEBUGGING 0
 #endif /* !defined (ENABLE_DEBUG) */
 
+#ifndef TRACE
+/* still type-check the arguments, but never log */
+#   define TRACE(format, ...) \
+      G_STMT_START \
+        { \
+          if (0) \
+            _tp_log (G_LOG_LEVEL_DEBUG, DEBUG_FLAG, format, ##__VA_ARGS__); \
+        } \
+      G_STMT_END
+#endif
+
 #endif /* defined (DEBUG_FLAG) */
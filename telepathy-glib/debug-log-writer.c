@@ -0,0 +1,532 @@
+/* A buffered log file writer with rotation, running in its own thread
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/debug.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/util.h>
+
+#include "telepathy-glib/debug-internal.h"
+
+/*
+ * Each message is formatted straight into a buffer by the thread that logs
+ * it, under a mutex which is only held for as long as that takes. The
+ * writer thread swaps the whole buffer for an empty one and writes it out,
+ * rotating (and compressing) files as needed, so no thread that logs ever
+ * waits for the disk. If the writer falls MAX_PENDING bytes behind,
+ * messages are counted and dropped, rather than blocking.
+ */
+
+#define INITIAL_BUFFER_SIZE (64 * 1024)
+#define MAX_PENDING (4 * 1024 * 1024)
+
+typedef struct {
+    GMutex lock;
+    /* signalled when there is something to write, or it is time to stop */
+    GCond wake;
+    /* signalled when the writer thread has written everything it took */
+    GCond flushed;
+    GThread *thread;
+    GLogFunc old_handler;
+    /* G_MESSAGES_DEBUG when we started */
+    gchar *debug_domains;
+
+    /* protected by lock */
+    GString *pending;
+    guint n_dropped;
+    gboolean busy;
+    gboolean stopping;
+
+    /* only used by the writer thread, once it has been started */
+    gchar *path;
+    int fd;
+    guint64 size;
+    gint64 opened_at;
+    gsize max_size;
+    guint max_age;
+    guint n_rotated;
+    gboolean compress;
+    gboolean failed;
+} LogWriter;
+
+static LogWriter *log_writer = NULL;
+
+static void
+log_writer_fail (LogWriter *self,
+    const gchar *what,
+    const gchar *message)
+{
+  /* don't log this, since it would come straight back to us */
+  if (!self->failed)
+    g_printerr ("telepathy-glib: Can't %s log file '%s' (%s), discarding "
+        "further messages\n", what, self->path, message);
+
+  self->failed = TRUE;
+}
+
+static gboolean
+log_writer_open (LogWriter *self,
+    gboolean append,
+    GError **error)
+{
+  struct stat st;
+
+  self->fd = g_open (self->path,
+      O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+
+  if (self->fd == -1)
+    {
+      int e = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (e),
+          "Can't open logfile '%s': %s", self->path, g_strerror (e));
+      return FALSE;
+    }
+
+  self->size = 0;
+
+  if (append && fstat (self->fd, &st) == 0)
+    self->size = st.st_size;
+
+  self->opened_at = g_get_monotonic_time ();
+  return TRUE;
+}
+
+/* Compress @path to @path.gz, and delete @path if that worked */
+static void
+log_writer_compress (const gchar *path)
+{
+  gchar *gz_path = g_strdup_printf ("%s.gz", path);
+  GFile *source_file = g_file_new_for_path (path);
+  GFile *target_file = g_file_new_for_path (gz_path);
+  GFileInputStream *source = NULL;
+  GFileOutputStream *target = NULL;
+  GConverter *compressor = NULL;
+  GOutputStream *converter = NULL;
+  GError *error = NULL;
+
+  source = g_file_read (source_file, NULL, &error);
+
+  if (source == NULL)
+    goto finally;
+
+  target = g_file_replace (target_file, NULL, FALSE, G_FILE_CREATE_NONE,
+      NULL, &error);
+
+  if (target == NULL)
+    goto finally;
+
+  compressor = G_CONVERTER (g_zlib_compressor_new (
+        G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  converter = g_converter_output_stream_new (G_OUTPUT_STREAM (target),
+      compressor);
+
+  if (g_output_stream_splice (converter, G_INPUT_STREAM (source),
+        G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+        G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, NULL, &error) < 0)
+    goto finally;
+
+  g_unlink (path);
+
+finally:
+  if (error != NULL)
+    {
+      /* keep the uncompressed file, and carry on */
+      g_printerr ("telepathy-glib: Can't compress log file '%s': %s\n",
+          path, error->message);
+      g_error_free (error);
+    }
+
+  g_clear_object (&converter);
+  g_clear_object (&compressor);
+  g_clear_object (&target);
+  g_clear_object (&source);
+  g_object_unref (target_file);
+  g_object_unref (source_file);
+  g_free (gz_path);
+}
+
+/* Rename path to path.1, path.1 to path.2 and so on, dropping the oldest,
+ * and start a new file */
+static void
+log_writer_rotate (LogWriter *self)
+{
+  const gchar *suffix = (self->compress ? ".gz" : "");
+  GError *error = NULL;
+  guint i;
+
+  if (close (self->fd) != 0)
+    g_printerr ("telepathy-glib: Error closing log file '%s': %s\n",
+        self->path, g_strerror (errno));
+
+  self->fd = -1;
+
+  if (self->n_rotated > 0)
+    {
+      gchar *rotated;
+
+      for (i = self->n_rotated - 1; i > 0; i--)
+        {
+          gchar *from = g_strdup_printf ("%s.%u%s", self->path, i, suffix);
+          gchar *to = g_strdup_printf ("%s.%u%s", self->path, i + 1, suffix);
+
+          /* it's fine if there weren't that many files yet */
+          g_rename (from, to);
+          g_free (from);
+          g_free (to);
+        }
+
+      rotated = g_strdup_printf ("%s.1", self->path);
+
+      if (g_rename (self->path, rotated) == 0 && self->compress)
+        log_writer_compress (rotated);
+
+      g_free (rotated);
+    }
+
+  if (!log_writer_open (self, FALSE, &error))
+    {
+      log_writer_fail (self, "reopen", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+log_writer_write (LogWriter *self,
+    const gchar *data,
+    gsize len)
+{
+  if (self->failed)
+    return;
+
+  if ((self->max_size > 0 && self->size > 0 &&
+        self->size + len > self->max_size) ||
+      (self->max_age > 0 && g_get_monotonic_time () - self->opened_at >=
+        (gint64) self->max_age * G_USEC_PER_SEC))
+    {
+      log_writer_rotate (self);
+
+      if (self->failed)
+        return;
+    }
+
+  while (len > 0)
+    {
+      gssize n = write (self->fd, data, len);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          log_writer_fail (self, "write to", g_strerror (errno));
+          return;
+        }
+
+      data += n;
+      len -= n;
+      self->size += n;
+    }
+}
+
+static gpointer
+log_writer_thread (gpointer user_data)
+{
+  LogWriter *self = user_data;
+  GString *chunk = g_string_sized_new (INITIAL_BUFFER_SIZE);
+
+  g_mutex_lock (&self->lock);
+
+  while (TRUE)
+    {
+      GString *tmp;
+      guint n_dropped;
+
+      while (self->pending->len == 0 && self->n_dropped == 0 &&
+          !self->stopping)
+        g_cond_wait (&self->wake, &self->lock);
+
+      if (self->pending->len == 0 && self->n_dropped == 0)
+        break;
+
+      /* take everything that is pending, and leave an empty buffer */
+      tmp = self->pending;
+      self->pending = chunk;
+      chunk = tmp;
+      n_dropped = self->n_dropped;
+      self->n_dropped = 0;
+      self->busy = TRUE;
+
+      g_mutex_unlock (&self->lock);
+
+      if (n_dropped > 0)
+        {
+          gchar *note = g_strdup_printf ("telepathy-glib: %u messages were "
+              "dropped because the log file could not keep up\n", n_dropped);
+
+          log_writer_write (self, note, strlen (note));
+          g_free (note);
+        }
+
+      log_writer_write (self, chunk->str, chunk->len);
+      g_string_truncate (chunk, 0);
+
+      g_mutex_lock (&self->lock);
+      self->busy = FALSE;
+      g_cond_broadcast (&self->flushed);
+    }
+
+  g_mutex_unlock (&self->lock);
+  g_string_free (chunk, TRUE);
+  return NULL;
+}
+
+/* the same as g_log_default_handler() would print */
+static gboolean
+log_writer_wants (LogWriter *self,
+    const gchar *log_domain,
+    GLogLevelFlags log_level)
+{
+  if (log_level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL |
+        G_LOG_LEVEL_WARNING | G_LOG_LEVEL_MESSAGE))
+    return TRUE;
+
+  if ((log_level >> G_LOG_LEVEL_USER_SHIFT) != 0)
+    return TRUE;
+
+  if (self->debug_domains == NULL)
+    return FALSE;
+
+  if (!tp_strdiff (self->debug_domains, "all"))
+    return TRUE;
+
+  return (log_domain != NULL &&
+      strstr (self->debug_domains, log_domain) != NULL);
+}
+
+static const gchar *
+log_level_name (GLogLevelFlags log_level)
+{
+  if (log_level & G_LOG_LEVEL_ERROR)
+    return "ERROR";
+  else if (log_level & G_LOG_LEVEL_CRITICAL)
+    return "CRITICAL";
+  else if (log_level & G_LOG_LEVEL_WARNING)
+    return "WARNING";
+  else if (log_level & G_LOG_LEVEL_MESSAGE)
+    return "Message";
+  else if (log_level & G_LOG_LEVEL_INFO)
+    return "INFO";
+  else if (log_level & G_LOG_LEVEL_DEBUG)
+    return "DEBUG";
+  else
+    return "LOG";
+}
+
+static void
+log_writer_handler (const gchar *log_domain,
+    GLogLevelFlags log_level,
+    const gchar *message,
+    gpointer user_data)
+{
+  LogWriter *self = user_data;
+  gboolean fatal = ((log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR))
+      != 0);
+  gchar now[_TP_DEBUG_TIMESTAMP_SIZE];
+
+  if (!log_writer_wants (self, log_domain, log_level))
+    return;
+
+  _tp_debug_format_timestamp (g_get_real_time (), now);
+
+  g_mutex_lock (&self->lock);
+
+  if (self->stopping)
+    {
+      g_mutex_unlock (&self->lock);
+      g_log_default_handler (log_domain, log_level, message, NULL);
+      return;
+    }
+
+  if (self->pending->len >= MAX_PENDING && !fatal)
+    {
+      self->n_dropped++;
+      g_mutex_unlock (&self->lock);
+      return;
+    }
+
+  if (log_domain != NULL)
+    g_string_append_printf (self->pending, "%s: %s-%s: %s\n", now,
+        log_domain, log_level_name (log_level), message);
+  else
+    g_string_append_printf (self->pending, "%s: %s: %s\n", now,
+        log_level_name (log_level), message);
+
+  g_cond_signal (&self->wake);
+
+  /* we're about to abort, so make sure the message gets there */
+  if (fatal)
+    {
+      while (self->pending->len > 0 || self->busy)
+        g_cond_wait (&self->flushed, &self->lock);
+    }
+
+  g_mutex_unlock (&self->lock);
+
+  if (fatal)
+    g_log_default_handler (log_domain, log_level, message, NULL);
+}
+
+/**
+ * tp_debug_start_log_writer:
+ * @filename: a file to which to write log messages, optionally prefixed
+ *  with '+' as for tp_debug_divert_messages()
+ * @max_size: start a new file before the current file would grow beyond
+ *  this many bytes, or 0 to not limit the size
+ * @max_age: start a new file when the current file has been written to
+ *  for this many seconds, or 0 to not limit its age
+ * @n_rotated: how many previous files to keep, or 0 to keep none
+ * @compress: if %TRUE, compress previous files with gzip
+ * @error: used to raise an error if @filename can't be opened
+ *
+ * Set up a log handler, as if with g_log_set_default_handler(), which
+ * writes each message to @filename with a timestamp, in the same format as
+ * tp_debug_timestamped_log_handler(). Messages are printed or discarded
+ * according to their level and
+ * <envar>G_MESSAGES_DEBUG</envar>, as g_log_default_handler() does.
+ *
+ * Unlike tp_debug_divert_messages(), the messages are written out by a
+ * background thread, so a thread that logs a message never waits for
+ * the disk. If that thread falls several megabytes behind, messages are
+ * dropped, and a note saying how many were dropped is written instead.
+ * Fatal messages are written out before they are printed to stderr as
+ * usual.
+ *
+ * When a limit set by @max_size or @max_age is reached, @filename is
+ * renamed to <filename>@filename.1</filename> (and then compressed to
+ * <filename>@filename.1.gz</filename> if @compress is %TRUE), any older
+ * files are renamed to the next number up, any beyond @n_rotated are
+ * deleted, and a new @filename is started.
+ *
+ * Only one log writer may run at a time.
+ *
+ * Returns: %TRUE if the log writer was started
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_debug_start_log_writer (const gchar *filename,
+    gsize max_size,
+    guint max_age,
+    guint n_rotated,
+    gboolean compress,
+    GError **error)
+{
+  LogWriter *self;
+  gboolean append = FALSE;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (log_writer == NULL, FALSE);
+
+  if (filename[0] == '+')
+    {
+      append = TRUE;
+      filename++;
+    }
+
+  self = g_slice_new0 (LogWriter);
+  self->path = g_strdup (filename);
+  self->max_size = max_size;
+  self->max_age = max_age;
+  self->n_rotated = n_rotated;
+  self->compress = compress;
+
+  if (!log_writer_open (self, append, error))
+    {
+      g_free (self->path);
+      g_slice_free (LogWriter, self);
+      return FALSE;
+    }
+
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->wake);
+  g_cond_init (&self->flushed);
+  self->pending = g_string_sized_new (INITIAL_BUFFER_SIZE);
+  self->debug_domains = g_strdup (g_getenv ("G_MESSAGES_DEBUG"));
+  self->thread = g_thread_new ("tp-log-writer", log_writer_thread, self);
+
+  log_writer = self;
+  self->old_handler = g_log_set_default_handler (log_writer_handler, self);
+  return TRUE;
+}
+
+/**
+ * tp_debug_stop_log_writer:
+ *
+ * Write out any messages that are still pending, stop the thread started
+ * by tp_debug_start_log_writer(), and restore the previous default log
+ * handler. This should be called just before exiting, or at least when no
+ * other thread is logging. It does nothing if the log writer is not
+ * running.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_debug_stop_log_writer (void)
+{
+  LogWriter *self = log_writer;
+
+  if (self == NULL)
+    return;
+
+  g_log_set_default_handler (self->old_handler, NULL);
+  log_writer = NULL;
+
+  g_mutex_lock (&self->lock);
+  self->stopping = TRUE;
+  g_cond_signal (&self->wake);
+  g_mutex_unlock (&self->lock);
+
+  g_thread_join (self->thread);
+
+  if (self->fd != -1 && close (self->fd) != 0)
+    g_printerr ("telepathy-glib: Error closing log file '%s': %s\n",
+        self->path, g_strerror (errno));
+
+  g_string_free (self->pending, TRUE);
+  g_cond_clear (&self->flushed);
+  g_cond_clear (&self->wake);
+  g_mutex_clear (&self->lock);
+  g_free (self->debug_domains);
+  g_free (self->path);
+  g_slice_free (LogWriter, self);
+}
@@ -21,10 +21,13 @@
 
 #include "debug-sender.h"
 
+#include <string.h>
+
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/defs.h>
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/util-internal.h>
 #include <telepathy-glib/util.h>
 #include <telepathy-glib/svc-generic.h>
 
@@ -75,21 +78,59 @@ static gpointer debug_sender = NULL;
 
 #define DEBUG_MESSAGE_LIMIT 800
 
+/* Messages up to this long, including the trailing NUL, are stored in
+ * their slot; longer ones need an allocation of their own. */
+#define DEBUG_SLOT_TEXT_SIZE 120
+
 static void debug_iface_init (gpointer g_iface, gpointer iface_data);
 
+/* A cached message */
+typedef struct {
+  gdouble timestamp;
+  GQuark domain;
+  TpDebugLevel level;
+  /* NULL if the message fits in text */
+  gchar *long_text;
+  gchar text[DEBUG_SLOT_TEXT_SIZE];
+} DebugSlot;
+
 struct _TpDebugSenderPrivate
 {
   gboolean enabled;
   gboolean timestamps;
-  GQueue *messages;
+  /* A ring of max_messages slots, of which the n_messages starting at
+   * slots[first] (and wrapping around) are in use, oldest first */
+  DebugSlot *slots;
+  guint max_messages;
+  guint first;
+  guint n_messages;
+
+  /* If non-zero, NewDebugMessages is emitted at most once per this many
+   * milliseconds, instead of NewDebugMessage for every message */
+  guint batch_interval;
+  /* GValueArray of a Debug_Message, waiting to be signalled */
+  GPtrArray *batch;
+  guint batch_timeout;
 };
 
-typedef struct {
+/* A message on its way from tp_debug_sender_log_handler(), which might be
+ * in any thread, to the main context */
+typedef struct _DebugMessage DebugMessage;
+
+struct _DebugMessage {
+  /* the message logged before this one */
+  DebugMessage *next;
   gdouble timestamp;
-  gchar *domain;
+  GQuark domain;
   TpDebugLevel level;
-  gchar *string;
-} DebugMessage;
+  /* allocated together with the rest of the struct */
+  gchar string[1];
+};
+
+/* DebugMessage, newest first, waiting for tp_debug_sender_idle(). Any
+ * thread can push onto this; only the main context takes from it, and it
+ * always takes the whole list, so this can be used without a lock. */
+static gpointer pending_messages = NULL;
 
 G_DEFINE_TYPE_WITH_CODE (TpDebugSender, tp_debug_sender, G_TYPE_OBJECT,
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
@@ -100,6 +141,7 @@ G_DEFINE_TYPE_WITH_CODE (TpDebugSender, tp_debug_sender, G_TYPE_OBJECT,
 enum
 {
   PROP_ENABLED = 1,
+  PROP_BATCH_INTERVAL,
   NUM_PROPERTIES
 };
 
@@ -131,22 +173,127 @@ debug_message_new (GTimeVal *timestamp,
     GLogLevelFlags level,
     const gchar *string)
 {
+  gsize len = strlen (string);
   DebugMessage *msg;
 
-  msg = g_slice_new0 (DebugMessage);
+  msg = g_malloc (G_STRUCT_OFFSET (DebugMessage, string) + len + 1);
+  msg->next = NULL;
   msg->timestamp = timestamp->tv_sec + timestamp->tv_usec / 1e6;
-  msg->domain = g_strdup (domain);
+  msg->domain = g_quark_from_string (domain);
   msg->level = log_level_flags_to_debug_level (level);
-  msg->string = g_strdup (string);
+  memcpy (msg->string, string, len + 1);
   return msg;
 }
 
 static void
 debug_message_free (DebugMessage *msg)
 {
-  g_free (msg->domain);
-  g_free (msg->string);
-  g_slice_free (DebugMessage, msg);
+  g_free (msg);
+}
+
+static const gchar *
+debug_slot_get_text (const DebugSlot *slot)
+{
+  return (slot->long_text != NULL ? slot->long_text : slot->text);
+}
+
+static void
+debug_slot_set_text (DebugSlot *slot,
+    const gchar *string)
+{
+  gsize len = strlen (string);
+
+  if (len < DEBUG_SLOT_TEXT_SIZE)
+    memcpy (slot->text, string, len + 1);
+  else
+    slot->long_text = g_strdup (string);
+}
+
+/* Returns: (transfer none): the slot for a new message, which is the oldest
+ *  message's slot if the cache is full, or %NULL if there is no cache */
+static DebugSlot *
+debug_sender_push_slot (TpDebugSender *self)
+{
+  TpDebugSenderPrivate *priv = self->priv;
+  DebugSlot *slot;
+
+  if (priv->max_messages == 0)
+    return NULL;
+
+  if (priv->n_messages < priv->max_messages)
+    {
+      slot = &priv->slots[(priv->first + priv->n_messages) %
+          priv->max_messages];
+      priv->n_messages++;
+    }
+  else
+    {
+      slot = &priv->slots[priv->first];
+      priv->first = (priv->first + 1) % priv->max_messages;
+      g_free (slot->long_text);
+    }
+
+  slot->long_text = NULL;
+  return slot;
+}
+
+static void
+debug_sender_flush (TpDebugSender *self)
+{
+  TpDebugSenderPrivate *priv = self->priv;
+
+  if (priv->batch_timeout != 0)
+    {
+      _tp_source_remove (priv->batch_timeout);
+      priv->batch_timeout = 0;
+    }
+
+  if (priv->batch->len == 0)
+    return;
+
+  tp_svc_debug_emit_new_debug_messages (self, priv->batch);
+  g_ptr_array_set_size (priv->batch, 0);
+}
+
+static gboolean
+debug_sender_flush_cb (gpointer data)
+{
+  TpDebugSender *self = data;
+
+  self->priv->batch_timeout = 0;
+  debug_sender_flush (self);
+  return FALSE;
+}
+
+static void
+debug_sender_emit (TpDebugSender *self,
+    gdouble timestamp,
+    GQuark domain,
+    TpDebugLevel level,
+    const gchar *string)
+{
+  TpDebugSenderPrivate *priv = self->priv;
+
+  if (!priv->enabled)
+    return;
+
+  if (priv->batch_interval == 0)
+    {
+      tp_svc_debug_emit_new_debug_message (self, timestamp,
+          g_quark_to_string (domain), level, string);
+      return;
+    }
+
+  g_ptr_array_add (priv->batch, tp_value_array_build (4,
+        G_TYPE_DOUBLE, timestamp,
+        G_TYPE_STRING, g_quark_to_string (domain),
+        G_TYPE_UINT, level,
+        G_TYPE_STRING, string,
+        G_TYPE_INVALID));
+
+  if (priv->batch_timeout == 0)
+    priv->batch_timeout = _tp_timeout_add (TP_LATENCY_CLASS_BULK,
+        priv->batch_interval, debug_sender_flush_cb, self);
 }
 
 static void
@@ -163,6 +310,10 @@ tp_debug_sender_get_property (GObject *object,
         g_value_set_boolean (value, self->priv->enabled);
         break;
 
+      case PROP_BATCH_INTERVAL:
+        g_value_set_uint (value, self->priv->batch_interval);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -179,9 +330,16 @@ tp_debug_sender_set_property (GObject *object,
   switch (property_id)
     {
       case PROP_ENABLED:
+        /* messages which were generated while enabled are still sent */
+        debug_sender_flush (self);
         self->priv->enabled = g_value_get_boolean (value);
         break;
 
+      case PROP_BATCH_INTERVAL:
+        debug_sender_flush (self);
+        self->priv->batch_interval = g_value_get_uint (value);
+        break;
+
      default:
        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -191,10 +349,18 @@ static void
 tp_debug_sender_finalize (GObject *object)
 {
   TpDebugSender *self = TP_DEBUG_SENDER (object);
+  guint i;
+
+  for (i = 0; i < self->priv->max_messages; i++)
+    g_free (self->priv->slots[i].long_text);
+
+  g_free (self->priv->slots);
+  self->priv->slots = NULL;
 
-  g_queue_foreach (self->priv->messages, (GFunc) debug_message_free, NULL);
-  g_queue_free (self->priv->messages);
-  self->priv->messages = NULL;
+  if (self->priv->batch_timeout != 0)
+    _tp_source_remove (self->priv->batch_timeout);
+
+  g_ptr_array_unref (self->priv->batch);
 
   G_OBJECT_CLASS (tp_debug_sender_parent_class)->finalize (object);
 }
@@ -221,11 +387,37 @@ tp_debug_sender_constructor (GType type,
   return retval;
 }
 
+static void
+tp_debug_sender_trim (GObject *object,
+    TpTrimLevel level)
+{
+  TpDebugSenderPrivate *priv = TP_DEBUG_SENDER (object)->priv;
+  guint n_forget = priv->n_messages;
+
+  if (level == TP_TRIM_LEVEL_MODERATE)
+    n_forget -= priv->n_messages / 2;
+
+  /* the ring itself stays allocated; only long messages have anything
+   * else to free */
+  while (n_forget > 0)
+    {
+      DebugSlot *slot = &priv->slots[priv->first];
+
+      g_free (slot->long_text);
+      slot->long_text = NULL;
+      priv->first = (priv->first + 1) % priv->max_messages;
+      priv->n_messages--;
+      n_forget--;
+    }
+}
+
 static void
 tp_debug_sender_constructed (GObject *object)
 {
   TpDBusDaemon *dbus_daemon;
 
+  _tp_register_trimmable (object, tp_debug_sender_trim);
+
   dbus_daemon = tp_dbus_daemon_dup (NULL);
 
   if (dbus_daemon != NULL)
@@ -243,6 +435,7 @@ tp_debug_sender_class_init (TpDebugSenderClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   static TpDBusPropertiesMixinPropImpl debug_props[] = {
       { "Enabled", "enabled", "enabled" },
+      { "BatchInterval", "batch-interval", "batch-interval" },
       { NULL }
   };
   static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
@@ -274,6 +467,23 @@ tp_debug_sender_class_init (TpDebugSenderClass *klass)
           FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * TpDebugSender:batch-interval:
+   *
+   * If non-zero, new debug messages are collected for this many
+   * milliseconds and then signalled together with the NewDebugMessages
+   * D-Bus signal, instead of being signalled one at a time with
+   * NewDebugMessage. Clients can also set this over D-Bus, as the
+   * BatchInterval property.
+   *
+   * Since: 0.UNRELEASED
+   */
+  g_object_class_install_property (object_class, PROP_BATCH_INTERVAL,
+      g_param_spec_uint ("batch-interval", "Batch interval",
+          "Milliseconds for which new debug messages are batched, or 0",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   klass->dbus_props_class.interfaces = prop_interfaces;
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (TpDebugSenderClass, dbus_props_class));
@@ -284,25 +494,25 @@ get_messages (TpSvcDebug *self,
     DBusGMethodInvocation *context)
 {
   TpDebugSender *dbg = TP_DEBUG_SENDER (self);
+  TpDebugSenderPrivate *priv = dbg->priv;
   GPtrArray *messages;
-  GList *i;
-  guint j;
+  guint i, j;
 
-  messages = g_ptr_array_sized_new (g_queue_get_length (dbg->priv->messages));
+  messages = g_ptr_array_sized_new (priv->n_messages);
 
-  for (i = dbg->priv->messages->head; i; i = i->next)
+  for (i = 0; i < priv->n_messages; i++)
     {
       GValue gvalue = { 0 };
-      DebugMessage *message = (DebugMessage *) i->data;
+      DebugSlot *slot = &priv->slots[(priv->first + i) % priv->max_messages];
 
       g_value_init (&gvalue, TP_STRUCT_TYPE_DEBUG_MESSAGE);
       g_value_take_boxed (&gvalue,
           dbus_g_type_specialized_construct (TP_STRUCT_TYPE_DEBUG_MESSAGE));
       dbus_g_type_struct_set (&gvalue,
-          0, message->timestamp,
-          1, message->domain,
-          2, message->level,
-          3, message->string,
+          0, slot->timestamp,
+          1, g_quark_to_string (slot->domain),
+          2, slot->level,
+          3, debug_slot_get_text (slot),
           G_MAXUINT);
       g_ptr_array_add (messages, g_value_get_boxed (&gvalue));
     }
@@ -315,6 +525,68 @@ get_messages (TpSvcDebug *self,
   g_ptr_array_unref (messages);
 }
 
+static void
+get_packed_messages (TpSvcDebug *self,
+    DBusGMethodInvocation *context)
+{
+  TpDebugSenderPrivate *priv = TP_DEBUG_SENDER (self)->priv;
+  GArray *timestamps, *domain_indices, *levels;
+  GPtrArray *domains, *messages;
+  /* GQuark => index in domains + 1 */
+  GHashTable *domain_index;
+  guint i;
+
+  timestamps = g_array_sized_new (FALSE, FALSE, sizeof (gdouble),
+      priv->n_messages);
+  domain_indices = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      priv->n_messages);
+  levels = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      priv->n_messages);
+  domains = g_ptr_array_new ();
+  messages = g_ptr_array_sized_new (priv->n_messages + 1);
+  domain_index = g_hash_table_new (NULL, NULL);
+
+  /* the strings are all borrowed from the cache */
+  for (i = 0; i < priv->n_messages; i++)
+    {
+      DebugSlot *slot = &priv->slots[(priv->first + i) % priv->max_messages];
+      guint index_ = GPOINTER_TO_UINT (g_hash_table_lookup (domain_index,
+            GUINT_TO_POINTER (slot->domain)));
+      guint level = slot->level;
+
+      if (index_ == 0)
+        {
+          const gchar *domain = g_quark_to_string (slot->domain);
+
+          /* a NULL would end the list */
+          g_ptr_array_add (domains, (gchar *) (domain != NULL ? domain : ""));
+          index_ = domains->len;
+          g_hash_table_insert (domain_index, GUINT_TO_POINTER (slot->domain),
+              GUINT_TO_POINTER (index_));
+        }
+
+      index_--;
+      g_array_append_val (timestamps, slot->timestamp);
+      g_array_append_val (domain_indices, index_);
+      g_array_append_val (levels, level);
+      g_ptr_array_add (messages, (gchar *) debug_slot_get_text (slot));
+    }
+
+  g_ptr_array_add (domains, NULL);
+  g_ptr_array_add (messages, NULL);
+
+  tp_svc_debug_return_from_get_packed_messages (context, timestamps,
+      (const gchar **) domains->pdata, domain_indices, levels,
+      (const gchar **) messages->pdata);
+
+  g_hash_table_unref (domain_index);
+  g_ptr_array_unref (messages);
+  g_ptr_array_unref (domains);
+  g_array_unref (levels);
+  g_array_unref (domain_indices);
+  g_array_unref (timestamps);
+}
+
 static void
 debug_iface_init (gpointer g_iface,
     gpointer iface_data)
@@ -322,6 +594,7 @@ debug_iface_init (gpointer g_iface,
   TpSvcDebugClass *klass = (TpSvcDebugClass *) g_iface;
 
   tp_svc_debug_implement_get_messages (klass, get_messages);
+  tp_svc_debug_implement_get_packed_messages (klass, get_packed_messages);
 }
 
 static void
@@ -330,7 +603,13 @@ tp_debug_sender_init (TpDebugSender *self)
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_DEBUG_SENDER,
       TpDebugSenderPrivate);
 
-  self->priv->messages = g_queue_new ();
+  self->priv->batch = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+
+#ifdef ENABLE_DEBUG_CACHE
+  self->priv->max_messages = DEBUG_MESSAGE_LIMIT;
+  self->priv->slots = g_new0 (DebugSlot, self->priv->max_messages);
+#endif
 }
 
 /**
@@ -355,32 +634,25 @@ tp_debug_sender_dup (void)
   return g_object_new (TP_TYPE_DEBUG_SENDER, NULL);
 }
 
+/* Cache @string, if there is a cache, and emit it if enabled */
 static void
-_tp_debug_sender_take (TpDebugSender *self,
-    DebugMessage *new_msg)
+_tp_debug_sender_add (TpDebugSender *self,
+    gdouble timestamp,
+    GQuark domain,
+    TpDebugLevel level,
+    const gchar *string)
 {
-#ifdef ENABLE_DEBUG_CACHE
-  if (g_queue_get_length (self->priv->messages) >= DEBUG_MESSAGE_LIMIT)
-    {
-      DebugMessage *old_head =
-        (DebugMessage *) g_queue_pop_head (self->priv->messages);
+  DebugSlot *slot = debug_sender_push_slot (self);
 
-      debug_message_free (old_head);
-    }
-
-  g_queue_push_tail (self->priv->messages, new_msg);
-#endif
-
-  if (self->priv->enabled)
+  if (slot != NULL)
     {
-      tp_svc_debug_emit_new_debug_message (self, new_msg->timestamp,
-          new_msg->domain, new_msg->level, new_msg->string);
+      slot->timestamp = timestamp;
+      slot->domain = domain;
+      slot->level = level;
+      debug_slot_set_text (slot, string);
     }
 
-#ifndef ENABLE_DEBUG_CACHE
-  /* if there's cache, these are freed when they fall of its end instead */
-  debug_message_free (new_msg);
-#endif
+  debug_sender_emit (self, timestamp, domain, level, string);
 }
 
 /**
@@ -412,8 +684,10 @@ tp_debug_sender_add_message (TpDebugSender *self,
       timestamp = &now;
     }
 
-  _tp_debug_sender_take (self,
-      debug_message_new (timestamp, domain, level, string));
+  _tp_debug_sender_add (self,
+      timestamp->tv_sec + timestamp->tv_usec / 1e6,
+      g_quark_from_string (domain), log_level_flags_to_debug_level (level),
+      string);
 }
 
 /**
@@ -442,12 +716,46 @@ tp_debug_sender_add_message_vprintf (TpDebugSender *self,
     va_list args)
 {
   gchar *message = NULL;
+  DebugSlot *slot = debug_sender_push_slot (self);
+
+  /* the common case: format the message straight into the cache */
+  if (slot != NULL)
+    {
+      GTimeVal now = { 0 };
+      va_list copy;
+      const gchar *text;
+
+      if (timestamp == NULL)
+        {
+          g_get_current_time (&now);
+          timestamp = &now;
+        }
+
+      G_VA_COPY (copy, args);
+
+      if (g_vsnprintf (slot->text, DEBUG_SLOT_TEXT_SIZE, format,
+              copy) >= DEBUG_SLOT_TEXT_SIZE)
+        slot->long_text = g_strdup_vprintf (format, args);
 
-  /* disabled cache? we might have no need to format the message at all */
-#ifndef ENABLE_DEBUG_CACHE
+      va_end (copy);
+
+      slot->timestamp = timestamp->tv_sec + timestamp->tv_usec / 1e6;
+      slot->domain = g_quark_from_string (domain);
+      slot->level = log_level_flags_to_debug_level (level);
+      text = debug_slot_get_text (slot);
+
+      debug_sender_emit (self, slot->timestamp, slot->domain, slot->level,
+          text);
+
+      if (formatted != NULL)
+        *formatted = g_strdup (text);
+
+      return;
+    }
+
+  /* no cache? we might have no need to format the message at all */
   if (!self->priv->enabled && formatted == NULL)
     return;
-#endif
 
   message = g_strdup_vprintf (format, args);
 
@@ -494,16 +802,62 @@ tp_debug_sender_add_message_printf (TpDebugSender *self,
 }
 
 static gboolean
-tp_debug_sender_idle (gpointer data)
+tp_debug_sender_idle (gpointer data G_GNUC_UNUSED)
 {
-  if (debug_sender == NULL)
-    debug_message_free (data);
-  else
-    _tp_debug_sender_take (debug_sender, data);
+  DebugMessage *batch, *msg, *oldest_first = NULL;
+
+  /* take everything that has been logged since we were scheduled; the
+   * next message to be logged will schedule us again */
+  do
+    batch = g_atomic_pointer_get (&pending_messages);
+  while (!g_atomic_pointer_compare_and_exchange (&pending_messages, batch,
+        NULL));
+
+  while (batch != NULL)
+    {
+      msg = batch;
+      batch = msg->next;
+      msg->next = oldest_first;
+      oldest_first = msg;
+    }
+
+  while (oldest_first != NULL)
+    {
+      msg = oldest_first;
+      oldest_first = msg->next;
+
+      if (debug_sender != NULL)
+        _tp_debug_sender_add (debug_sender, msg->timestamp, msg->domain,
+            msg->level, msg->string);
+
+      debug_message_free (msg);
+    }
 
   return FALSE;
 }
 
+/* must be thread-safe */
+static void
+debug_message_push (DebugMessage *msg)
+{
+  gpointer head;
+
+  do
+    {
+      head = g_atomic_pointer_get (&pending_messages);
+      msg->next = head;
+    }
+  while (!g_atomic_pointer_compare_and_exchange (&pending_messages, head,
+        msg));
+
+  /* only the first message of a batch needs to wake up the main context;
+   * this is always the global default, even if the message was logged by
+   * a thread with a thread-default main context of its own */
+  if (head == NULL)
+    g_idle_add_full (tp_get_latency_class_priority (TP_LATENCY_CLASS_BULK),
+        tp_debug_sender_idle, NULL, NULL);
+}
+
 /**
  * tp_debug_sender_log_handler:
  * @log_domain: domain of the message
@@ -592,9 +946,8 @@ tp_debug_sender_log_handler (const gchar *log_domain,
       if (now.tv_sec == 0)
         g_get_current_time (&now);
 
-      g_idle_add_full (G_PRIORITY_HIGH, tp_debug_sender_idle,
-          debug_message_new (&now, log_domain, log_level, message),
-          NULL);
+      debug_message_push (debug_message_new (&now, log_domain, log_level,
+            message));
     }
 }
 
@@ -620,3 +973,59 @@ tp_debug_sender_set_timestamps (TpDebugSender *self,
 
   self->priv->timestamps = maybe;
 }
+
+/**
+ * tp_debug_sender_set_max_messages:
+ * @self: a #TpDebugSender
+ * @max_messages: the number of messages to keep, or 0 to keep none
+ *
+ * Set how many of the most recent messages are kept, to be returned by
+ * the GetMessages D-Bus method. If this is less than the number of
+ * messages already kept, the oldest are forgotten.
+ *
+ * Space for @max_messages messages is allocated straight away, so that
+ * adding a message usually needs no memory allocation; only messages
+ * longer than about a hundred bytes need one.
+ *
+ * The default is 800, or 0 if telepathy-glib was configured with
+ * <literal>--disable-debug-cache</literal>.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_debug_sender_set_max_messages (TpDebugSender *self,
+    guint max_messages)
+{
+  TpDebugSenderPrivate *priv;
+  DebugSlot *slots;
+  guint n, skip, i;
+
+  g_return_if_fail (TP_IS_DEBUG_SENDER (self));
+
+  priv = self->priv;
+
+  if (max_messages == priv->max_messages)
+    return;
+
+  slots = g_new0 (DebugSlot, max_messages);
+  n = MIN (priv->n_messages, max_messages);
+  skip = priv->n_messages - n;
+
+  /* forget the oldest messages that don't fit, and move the rest to the
+   * start of the new ring */
+  for (i = 0; i < priv->n_messages; i++)
+    {
+      DebugSlot *slot = &priv->slots[(priv->first + i) % priv->max_messages];
+
+      if (i < skip)
+        g_free (slot->long_text);
+      else
+        slots[i - skip] = *slot;
+    }
+
+  g_free (priv->slots);
+  priv->slots = slots;
+  priv->max_messages = max_messages;
+  priv->first = 0;
+  priv->n_messages = n;
+}
@@ -96,6 +96,10 @@ void tp_debug_sender_log_handler (const gchar *log_domain,
 _TP_AVAILABLE_IN_0_16
 void tp_debug_sender_set_timestamps (TpDebugSender *self, gboolean maybe);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_debug_sender_set_max_messages (TpDebugSender *self,
+    guint max_messages);
+
 G_END_DECLS
 
 #endif /* __TP_DEBUG_SENDER_H__ */
@@ -58,12 +58,23 @@
  *     (client)</listitem>
  * <listitem><literal>all</literal> - all of the above</listitem>
  * </itemizedlist>
+ *
+ * Each keyword may also be given a level, as in
+ * <literal>connection=info,proxy=debug</literal>, to log only messages of
+ * that severity or higher from that part of telepathy-glib. The levels are
+ * <literal>trace</literal>, <literal>debug</literal>,
+ * <literal>info</literal>, <literal>message</literal>,
+ * <literal>warning</literal> and <literal>critical</literal>. A keyword
+ * without a level is equivalent to <literal>trace</literal>, which logs
+ * everything; by default, everything except debug and trace messages is
+ * logged.
  */
 #include "config.h"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #ifdef HAVE_UNISTD_H
@@ -77,8 +88,25 @@
 
 #define DEBUG_FLAG TP_DEBUG_MISC
 #include "debug-internal.h"
-
-static TpDebugFlags flags = 0;
+#include "util-internal.h"
+
+TpDebugFlags _tp_debug_flags = 0;
+TpDebugFlags _tp_debug_trace_flags = 0;
+
+/* Severities that can be set as a threshold, least severe first. These are
+ * relative to the default (LEVEL_INFO), so that a zeroed array of
+ * thresholds is the default. */
+typedef enum {
+    LEVEL_TRACE = -2,
+    LEVEL_DEBUG = -1,
+    LEVEL_INFO = 0,
+    LEVEL_MESSAGE,
+    LEVEL_WARNING,
+    LEVEL_CRITICAL
+} DebugLevel;
+
+/* index of the flag's bit => the least severe DebugLevel to log */
+static gint8 thresholds[32] = { 0 };
 
 static gboolean tp_debug_persistent = FALSE;
 
@@ -94,7 +122,7 @@ static gboolean tp_debug_persistent = FALSE;
 void
 tp_debug_set_all_flags (void)
 {
-  flags = 0xffff;
+  _tp_debug_set_flags (0xffff);
   tp_debug_persistent = TRUE;
 }
 
@@ -158,11 +186,87 @@ static DebugKeyToDomain key_to_domain[] = {
   { 0, NULL }
 };
 
+static const struct {
+    const gchar *name;
+    DebugLevel level;
+} levels[] = {
+  { "trace",         LEVEL_TRACE },
+  { "debug",         LEVEL_DEBUG },
+  { "info",          LEVEL_INFO },
+  { "message",       LEVEL_MESSAGE },
+  { "warning",       LEVEL_WARNING },
+  { "critical",      LEVEL_CRITICAL },
+};
+
 static GDebugKey persist_keys[] = {
   { "persist",       1 },
   { 0, },
 };
 
+static void
+debug_update_masks (void)
+{
+  guint i;
+
+  _tp_debug_flags = 0;
+  _tp_debug_trace_flags = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (thresholds); i++)
+    {
+      if (thresholds[i] <= LEVEL_DEBUG)
+        _tp_debug_flags |= (1u << i);
+
+      if (thresholds[i] <= LEVEL_TRACE)
+        _tp_debug_trace_flags |= (1u << i);
+    }
+}
+
+/* Set the threshold for the key @name ("all" for every key) from the level
+ * name @level, as in "connection=info" */
+static void
+debug_set_threshold (const gchar *name,
+    const gchar *level,
+    guint nkeys)
+{
+  gboolean all = !g_ascii_strcasecmp (name, "all");
+  guint flag = 0;
+  guint i;
+
+  for (i = 0; i < nkeys; i++)
+    {
+      if (all || !g_ascii_strcasecmp (name, keys[i].key))
+        flag |= keys[i].value;
+    }
+
+  if (flag == 0)
+    {
+      MESSAGE ("Unknown debug keyword '%s'", name);
+      return;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (levels); i++)
+    {
+      if (!g_ascii_strcasecmp (level, levels[i].name))
+        break;
+    }
+
+  if (i == G_N_ELEMENTS (levels))
+    {
+      MESSAGE ("Unknown debug level '%s' for '%s'", level, name);
+      return;
+    }
+
+  while (flag != 0)
+    {
+      gint index = g_bit_nth_lsf (flag, -1);
+
+      thresholds[index] = levels[i].level;
+      flag &= ~(1u << index);
+    }
+
+  debug_update_masks ();
+}
+
 /**
  * tp_debug_set_flags:
  * @flags_string: The flags to set, comma-separated. If %NULL or empty,
@@ -171,7 +275,17 @@ static GDebugKey persist_keys[] = {
  * Set the debug flags indicated by @flags_string, in addition to any already
  * set.
  *
- * The parsing matches that of g_parse_debug_string().
+ * The parsing matches that of g_parse_debug_string(), except that
+ * keywords may be followed by <literal>=</literal> and a level, as
+ * described above. Setting a level for a keyword replaces any level set
+ * for it previously; the level may be given for <literal>all</literal>,
+ * too.
+ *
+ * The keyword <literal>alloc</literal> is not a debug flag: it turns on
+ * accounting of the allocations made by a few busy subsystems, and logs the
+ * number of live allocations, their size and the allocation rate for each
+ * of them with %G_LOG_LEVEL_INFO every few seconds. It is not included in
+ * <literal>all</literal>, and cannot be turned off again. Since 0.UNRELEASED.
  *
  * If telepathy-glib was compiled with --disable-debug (not recommended),
  * this function has no practical effect, since the debug messages it would
@@ -183,11 +297,47 @@ void
 tp_debug_set_flags (const gchar *flags_string)
 {
   guint nkeys;
+  gchar **tokens;
+  GString *plain;
+  guint i;
+
+  if (flags_string == NULL)
+    return;
 
   for (nkeys = 0; keys[nkeys].value; nkeys++);
 
-  if (flags_string != NULL)
-    _tp_debug_set_flags (g_parse_debug_string (flags_string, keys, nkeys));
+  /* the same separators as g_parse_debug_string() */
+  tokens = g_strsplit_set (flags_string, ":;, \t", -1);
+  plain = g_string_new ("");
+
+  for (i = 0; tokens[i] != NULL; i++)
+    {
+      gchar *equals = strchr (tokens[i], '=');
+
+      if (equals == NULL)
+        {
+          if (!g_ascii_strcasecmp (tokens[i], "alloc"))
+            _tp_alloc_stats_enable ();
+          else if (tokens[i][0] != '\0')
+            {
+              if (plain->len > 0)
+                g_string_append_c (plain, ',');
+
+              g_string_append (plain, tokens[i]);
+            }
+        }
+      else
+        {
+          *equals = '\0';
+          debug_set_threshold (tokens[i], equals + 1, nkeys);
+        }
+    }
+
+  if (plain->len > 0)
+    _tp_debug_set_flags (g_parse_debug_string (plain->str, keys, nkeys));
+
+  g_string_free (plain, TRUE);
+  g_strfreev (tokens);
 }
 
 /**
@@ -256,24 +406,34 @@ tp_debug_set_persistent (gboolean persistent)
  * _tp_debug_set_flags:
  * @new_flags More flags to set
  *
- * Set extra flags. For internal use only
+ * Set extra flags, logging everything (including TRACE()) for them. For
+ * internal use only
  */
 void
 _tp_debug_set_flags (TpDebugFlags new_flags)
 {
-  flags |= new_flags;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (thresholds); i++)
+    {
+      if (new_flags & (1u << i))
+        thresholds[i] = LEVEL_TRACE;
+    }
+
+  _tp_debug_flags |= new_flags;
+  _tp_debug_trace_flags |= new_flags;
 }
 
 /*
- * _tp_debug_set_flags:
+ * _tp_debug_flag_is_set:
  * @flag: Flag to test
  *
- * Returns: %TRUE if the flag is set. For use via DEBUGGING() only.
+ * Returns: %TRUE if DEBUG() messages are enabled for the flag
  */
 gboolean
 _tp_debug_flag_is_set (TpDebugFlags flag)
 {
-  return (flag & flags) != 0;
+  return (flag & _tp_debug_flags) != 0;
 }
 
 static const gchar *
@@ -299,6 +459,32 @@ debug_flag_to_domain (TpDebugFlags flag)
     return key_to_domain[index].domain;
 }
 
+static DebugLevel
+level_from_log_level (GLogLevelFlags level)
+{
+  if (level & G_LOG_LEVEL_CRITICAL)
+    return LEVEL_CRITICAL;
+  else if (level & G_LOG_LEVEL_WARNING)
+    return LEVEL_WARNING;
+  else if (level & G_LOG_LEVEL_MESSAGE)
+    return LEVEL_MESSAGE;
+  else if (level & G_LOG_LEVEL_INFO)
+    return LEVEL_INFO;
+  else
+    return LEVEL_DEBUG;
+}
+
+static DebugLevel
+debug_flag_threshold (TpDebugFlags flag)
+{
+  gint index = g_bit_nth_lsf (flag, -1);
+
+  if (index < 0)
+    return LEVEL_INFO;
+
+  return thresholds[index];
+}
+
 /*
  * _tp_log:
  * @level: Log level
@@ -306,15 +492,24 @@ debug_flag_to_domain (TpDebugFlags flag)
  * @format: Format string for g_logv
  *
  * Emit a debug message with the given format and arguments, but only
- * if the given debug flag is set. For use via
- * ERROR()/CRITICAL()/.../DEBUG() only.
+ * if @level is at least the threshold set for the given debug flag. For
+ * use via ERROR()/CRITICAL()/.../DEBUG()/TRACE() only.
  */
 void _tp_log (GLogLevelFlags level,
               TpDebugFlags flag,
               const gchar *format,
               ...)
 {
-  if ((flag & flags) || level > G_LOG_LEVEL_DEBUG)
+  gboolean wanted;
+
+  if (level & G_LOG_LEVEL_ERROR)
+    wanted = TRUE;
+  else if (level & G_LOG_LEVEL_DEBUG)
+    wanted = ((flag & _tp_debug_flags) != 0);
+  else
+    wanted = (level_from_log_level (level) >= debug_flag_threshold (flag));
+
+  if (wanted)
     {
       va_list args;
       va_start (args, format);
@@ -358,6 +553,10 @@ _tp_debug_is_persistent (void)
  * This function still works if telepathy-glib was compiled without debug
  * support.
  *
+ * Writing to the file happens in whichever thread logs the message, and
+ * can block it if the disk is slow; tp_debug_start_log_writer() avoids
+ * that.
+ *
  * Since: 0.7.1
  */
 void
@@ -406,6 +605,50 @@ tp_debug_divert_messages (const gchar *filename)
     }
 }
 
+G_LOCK_DEFINE_STATIC (timestamp);
+/* the part of the timestamp that only changes once per second */
+static gint64 timestamp_second = -1;
+static gchar timestamp_prefix[_TP_DEBUG_TIMESTAMP_SIZE];
+
+/*
+ * _tp_debug_format_timestamp:
+ * @now: the time, as returned by g_get_real_time()
+ * @buffer: (out caller-allocates): at least %_TP_DEBUG_TIMESTAMP_SIZE bytes
+ *
+ * Write @now to @buffer in the same format as g_time_val_to_iso8601(),
+ * but without allocating: the date and time are only formatted when the
+ * second changes.
+ */
+void
+_tp_debug_format_timestamp (gint64 now,
+    gchar *buffer)
+{
+  gint64 second = now / G_USEC_PER_SEC;
+  guint usec = now % G_USEC_PER_SEC;
+
+  G_LOCK (timestamp);
+
+  if (second != timestamp_second)
+    {
+      GDateTime *date_time = g_date_time_new_from_unix_utc (second);
+      gchar *formatted = g_date_time_format (date_time, "%Y-%m-%dT%H:%M:%S");
+
+      g_strlcpy (timestamp_prefix, formatted, sizeof (timestamp_prefix));
+      timestamp_second = second;
+      g_free (formatted);
+      g_date_time_unref (date_time);
+    }
+
+  /* like g_time_val_to_iso8601(), omit the fraction if it is zero */
+  if (usec != 0)
+    g_snprintf (buffer, _TP_DEBUG_TIMESTAMP_SIZE, "%s.%06uZ",
+        timestamp_prefix, usec);
+  else
+    g_snprintf (buffer, _TP_DEBUG_TIMESTAMP_SIZE, "%sZ", timestamp_prefix);
+
+  G_UNLOCK (timestamp);
+}
+
 /**
  * tp_debug_timestamped_log_handler:
  * @log_domain: the message's log domain
@@ -439,13 +682,11 @@ tp_debug_timestamped_log_handler (const gchar *log_domain,
                                   gpointer ignored)
 {
 #ifdef ENABLE_DEBUG
-  GTimeVal now;
-  gchar *tmp, *now_str;
+  gchar now_str[_TP_DEBUG_TIMESTAMP_SIZE];
+  gchar *tmp;
 
-  g_get_current_time (&now);
-  now_str = g_time_val_to_iso8601 (&now);
+  _tp_debug_format_timestamp (g_get_real_time (), now_str);
   tmp = g_strdup_printf ("%s: %s", now_str, message);
-  g_free (now_str);
   message = tmp;
 #endif
 
@@ -19,6 +19,26 @@ void tp_debug_divert_messages (const gchar *filename);
 void tp_debug_timestamped_log_handler (const gchar *log_domain,
     GLogLevelFlags log_level, const gchar *message, gpointer ignored);
 
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_debug_start_log_writer (const gchar *filename,
+    gsize max_size,
+    guint max_age,
+    guint n_rotated,
+    gboolean compress,
+    GError **error);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_debug_stop_log_writer (void);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_debug_set_tracing (gboolean enabled);
+_TP_AVAILABLE_IN_UNRELEASED
+gchar *tp_debug_dup_trace_events (void);
+_TP_AVAILABLE_IN_UNRELEASED
+gchar *tp_debug_dup_trace_critical_path (void);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_debug_set_metrics (gboolean enabled);
+
 #ifndef TP_DISABLE_DEPRECATED
 _TP_DEPRECATED
 void tp_debug_set_flags_from_string (const gchar *flags_string);
@@ -193,12 +193,17 @@ struct _TpDTMFPlayerPrivate
   guint pause_ms;
   gboolean playing_tone;
   gboolean paused;
+  /* if the current tones were played with tp_dtmf_player_play_scheduled(),
+   * the tones after a 'w', or NULL if there were none */
+  gboolean scheduled;
+  const gchar *deferred;
 };
 
 static guint sig_id_started_tone;
 static guint sig_id_stopped_tone;
 static guint sig_id_finished;
 static guint sig_id_tones_deferred;
+static guint sig_id_tones_scheduled;
 
 static void
 tp_dtmf_player_emit_started_tone (TpDTMFPlayer *self,
@@ -260,6 +265,8 @@ tp_dtmf_player_cancel (TpDTMFPlayer *self)
     }
 
   tp_clear_pointer (&self->priv->dialstring, g_free);
+  self->priv->scheduled = FALSE;
+  self->priv->deferred = NULL;
 }
 
 static gboolean
@@ -417,6 +424,143 @@ tp_dtmf_player_play (TpDTMFPlayer *self,
   return TRUE;
 }
 
+static gboolean
+tp_dtmf_player_schedule_cb (gpointer data)
+{
+  TpDTMFPlayer *self = data;
+
+  self->priv->timer_id = 0;
+
+  if (self->priv->deferred != NULL)
+    tp_dtmf_player_emit_tones_deferred (self, self->priv->deferred);
+
+  tp_dtmf_player_emit_finished (self, FALSE);
+  tp_dtmf_player_cancel (self);
+  return FALSE;
+}
+
+/**
+ * tp_dtmf_player_play_scheduled:
+ * @self: a DTMF interpreter
+ * @tones: a sequence of tones, as for tp_dtmf_player_play()
+ * @tone_ms: length of each tone in milliseconds
+ * @gap_ms: length of each gap between tones in milliseconds
+ * @pause_ms: length of each pause in milliseconds
+ * @error: used to raise an error
+ *
+ * Interpret @tones in the same way as tp_dtmf_player_play(), but work out
+ * when each tone should start and stop straight away, and emit them all at
+ * once in #TpDTMFPlayer::tones-scheduled before returning, rather than
+ * emitting #TpDTMFPlayer::started-tone and #TpDTMFPlayer::stopped-tone for
+ * each tone as it is reached.
+ *
+ * This is for connection managers whose media backend can start and stop
+ * tones at given times by itself: the timing of the tones then doesn't depend
+ * on how busy the main loop is, and the whole of @tones is handled with a
+ * single timer, which fires when the last tone has stopped.
+ * That is when #TpDTMFPlayer::tones-deferred (if @tones contains a 'W' or
+ * 'w') and #TpDTMFPlayer::finished are emitted. If playback is cancelled
+ * with tp_dtmf_player_cancel() before then, the backend should stop
+ * playing the tones it was given when #TpDTMFPlayer::finished is emitted.
+ *
+ * Returns: %TRUE on success, %FALSE (setting @error) on failure
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_dtmf_player_play_scheduled (TpDTMFPlayer *self,
+    const gchar *tones,
+    guint tone_ms,
+    guint gap_ms,
+    guint pause_ms,
+    GError **error)
+{
+  GVariantBuilder builder;
+  gboolean after_tone = FALSE;
+  gint64 start, t;
+  const gchar *c;
+
+  g_return_val_if_fail (TP_IS_DTMF_PLAYER (self), FALSE);
+  g_return_val_if_fail (tones != NULL, FALSE);
+  g_return_val_if_fail (tone_ms > 0, FALSE);
+  g_return_val_if_fail (gap_ms > 0, FALSE);
+  g_return_val_if_fail (pause_ms > 0, FALSE);
+
+  if (self->priv->dialstring != NULL)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_SERVICE_BUSY,
+          "DTMF tones are already being played");
+      return FALSE;
+    }
+
+  g_assert (self->priv->timer_id == 0);
+
+  for (c = tones; *c != '\0'; c++)
+    {
+      if (_tp_dtmf_char_classify (*c) == DTMF_CHAR_CLASS_MEANINGLESS)
+        {
+          g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+              "Invalid character in DTMF string starting at %s", c);
+          return FALSE;
+        }
+    }
+
+  self->priv->dialstring = g_strdup (tones);
+  self->priv->scheduled = TRUE;
+  self->priv->deferred = NULL;
+
+  /* the same rules as tp_dtmf_player_timer_cb(): a gap only separates two
+   * consecutive tones, and we stop at the first 'w' */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uxx)"));
+  start = t = g_get_monotonic_time ();
+
+  for (c = self->priv->dialstring; *c != '\0'; c++)
+    {
+      DTMFCharClass klass = _tp_dtmf_char_classify (*c);
+
+      if (klass == DTMF_CHAR_CLASS_EVENT)
+        {
+          if (after_tone)
+            t += gap_ms * (gint64) 1000;
+
+          g_variant_builder_add (&builder, "(uxx)",
+              (guint32) _tp_dtmf_char_to_event (*c), t,
+              t + tone_ms * (gint64) 1000);
+          t += tone_ms * (gint64) 1000;
+          after_tone = TRUE;
+        }
+      else if (klass == DTMF_CHAR_CLASS_PAUSE)
+        {
+          t += pause_ms * (gint64) 1000;
+          after_tone = FALSE;
+        }
+      else
+        {
+          g_assert (klass == DTMF_CHAR_CLASS_WAIT_FOR_USER);
+
+          if (c[1] != '\0')
+            self->priv->deferred = c + 1;
+
+          break;
+        }
+    }
+
+  g_signal_emit (self, sig_id_tones_scheduled, 0,
+      g_variant_builder_end (&builder));
+
+  if (t == start)
+    {
+      /* nothing to wait for */
+      tp_dtmf_player_schedule_cb (self);
+      return TRUE;
+    }
+
+  /* round up, so we never finish before the last tone has stopped */
+  self->priv->timer_id = g_timeout_add ((t - start + 999) / 1000,
+      tp_dtmf_player_schedule_cb, self);
+  return TRUE;
+}
+
 /**
  * tp_dtmf_player_is_active:
  * @self: a DTMF interpreter
@@ -524,6 +668,22 @@ tp_dtmf_player_class_init (TpDTMFPlayerClass *cls)
   sig_id_tones_deferred =  g_signal_new ("tones-deferred",
       G_OBJECT_CLASS_TYPE (cls), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
       NULL, G_TYPE_NONE, 1, G_TYPE_STRING);
+
+  /**
+   * TpDTMFPlayer::tones-scheduled:
+   * @self: the #TpDTMFPlayer
+   * @schedule: a #GVariant of type a(uxx): for each tone to be played, a
+   *  #TpDTMFEvent, and the times at which it should start and stop, in
+   *  the same microseconds as g_get_monotonic_time()
+   *
+   * Emitted by tp_dtmf_player_play_scheduled() with every tone it will
+   * play, up to the first 'W' or 'w' if any, in order.
+   *
+   * Since: 0.UNRELEASED
+   */
+  sig_id_tones_scheduled =  g_signal_new ("tones-scheduled",
+      G_OBJECT_CLASS_TYPE (cls), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      NULL, G_TYPE_NONE, 1, G_TYPE_VARIANT);
 }
 
 /**
@@ -25,6 +25,7 @@
 #define __TP_DTMF_H__
 
 #include <glib-object.h>
+#include <telepathy-glib/defs.h>
 #include <telepathy-glib/enums.h>
 
 gchar tp_dtmf_event_to_char (TpDTMFEvent event);
@@ -69,6 +70,11 @@ gboolean tp_dtmf_player_play (TpDTMFPlayer *self,
     const gchar *tones, guint tone_ms, guint gap_ms, guint pause_ms,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_dtmf_player_play_scheduled (TpDTMFPlayer *self,
+    const gchar *tones, guint tone_ms, guint gap_ms, guint pause_ms,
+    GError **error);
+
 gboolean tp_dtmf_player_is_active (TpDTMFPlayer *self);
 
 void tp_dtmf_player_cancel (TpDTMFPlayer *self);
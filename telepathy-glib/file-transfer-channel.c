@@ -94,6 +94,9 @@
  * Since: 0.15.5
  */
 
+/* for splice(2) */
+#define _GNU_SOURCE
+
 #include "config.h"
 
 #include "telepathy-glib/file-transfer-channel.h"
@@ -110,6 +113,7 @@
 #define DEBUG_FLAG TP_DEBUG_CHANNEL
 #include "telepathy-glib/automatic-client-factory-internal.h"
 #include "telepathy-glib/channel-internal.h"
+#include "telepathy-glib/checksum-input-stream-internal.h"
 #include "telepathy-glib/debug-internal.h"
 
 #include <stdio.h>
@@ -119,8 +123,18 @@
 #ifdef HAVE_GIO_UNIX
 #include <gio/gunixsocketaddress.h>
 #include <gio/gunixconnection.h>
+#include <gio/gfiledescriptorbased.h>
 #endif /* HAVE_GIO_UNIX */
 
+#if defined (HAVE_GIO_UNIX) && defined (HAVE_SPLICE) && \
+    defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+#define USE_NATIVE_TRANSFER
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
+
 G_DEFINE_TYPE (TpFileTransferChannel, tp_file_transfer_channel, TP_TYPE_CHANNEL)
 
 struct _TpFileTransferChannelPrivate
@@ -154,7 +168,13 @@ struct _TpFileTransferChannelPrivate
     GSocketAddress *remote_address;
     /* The value passed to Accept; this shouldn't be stored in
      * initial_offset as they can easily be different. */
-    guint requested_offset;
+    guint64 requested_offset;
+    /* When resuming (tp_file_transfer_channel_resume_file_async()): the
+     * destination, opened for reading and writing so it can be seek'd to the
+     * InitialOffset, and the sidecar file saying which transfer it's
+     * part of; otherwise NULL */
+    GFileIOStream *io_stream;
+    GFile *checkpoint;
 
     TpSocketAddressType socket_type;
     TpSocketAccessControl access_control;
@@ -162,8 +182,48 @@ struct _TpFileTransferChannelPrivate
 
     GSimpleAsyncResult *result;
     GCancellable *cancellable;
+
+    /* set by tp_file_transfer_channel_set_buffer_size(), or 0 */
+    gsize buffer_size;
+    /* set by tp_file_transfer_channel_set_socket_options() and
+     * tp_file_transfer_channel_set_use_abstract_unix() */
+    TpSocketOptions socket_options;
+
+    /* TransferredBytesChanged is notified at most once per
+     * NOTIFY_INTERVAL_MS: if non-zero, a notification was made less than
+     * that ago, and transferred_bytes_dirty is whether another one is due
+     * when this source fires */
+    guint notify_transferred_id;
+    gboolean transferred_bytes_dirty;
+    /* transferred_bytes and g_get_monotonic_time() when transfer_rate was
+     * last updated, or 0 */
+    guint64 rate_bytes;
+    gint64 rate_time;
+    /* bytes per second */
+    guint64 transfer_rate;
+
+    /* set by tp_file_transfer_channel_set_compute_content_hash() */
+    gboolean compute_hash;
+    /* the stream being spliced, if we are hashing it */
+    _TpChecksumInputStream *checksum_stream;
+    /* lower-case hex, once the whole file has been hashed */
+    gchar *computed_hash;
+
+    /* set by tp_file_transfer_channel_set_scheduler(), or NULL */
+    TpTransferScheduler *scheduler;
+    guint scheduler_weight;
+    /* set by tp_file_transfer_channel_set_paused() */
+    gboolean paused;
+    /* the source of our transfer on @scheduler, while it is running */
+    GInputStream *scheduled_source;
 };
 
+#define NOTIFY_INTERVAL_MS 250
+
+/* Used when the application didn't choose a buffer size; this is the
+ * default capacity of a pipe on Linux */
+#define DEFAULT_BUFFER_SIZE (64 * 1024)
+
 enum /* properties */
 {
   PROP_MIME_TYPE = 1,
@@ -177,6 +237,9 @@ enum /* properties */
   PROP_INITIAL_OFFSET,
   PROP_SERVICE_NAME,
   PROP_METADATA,
+  PROP_TRANSFER_RATE,
+  PROP_ESTIMATED_TIME_REMAINING,
+  PROP_COMPUTED_CONTENT_HASH,
   N_PROPS
 };
 
@@ -210,6 +273,34 @@ stream_close_cb (GObject *source,
   g_object_unref (self);
 }
 
+/* Takes ownership of @error, if not NULL */
+static void
+splice_finished (TpFileTransferChannel *self,
+    GError *error)
+{
+  if (error != NULL && !g_cancellable_is_cancelled (self->priv->cancellable))
+    DEBUG ("splice operation failed: %s", error->message);
+
+  /* only a complete file has a meaningful hash */
+  if (error == NULL && self->priv->checksum_stream != NULL)
+    {
+      g_free (self->priv->computed_hash);
+      self->priv->computed_hash = g_strdup (
+          _tp_checksum_input_stream_get_string (
+            self->priv->checksum_stream));
+      DEBUG ("hashed %" G_GUINT64_FORMAT " bytes: %s",
+          _tp_checksum_input_stream_get_bytes (self->priv->checksum_stream),
+          self->priv->computed_hash);
+      g_object_notify ((GObject *) self, "computed-content-hash");
+    }
+
+  g_clear_object (&self->priv->checksum_stream);
+  g_clear_error (&error);
+
+  g_io_stream_close_async (self->priv->stream, G_PRIORITY_DEFAULT,
+      NULL, stream_close_cb, g_object_ref (self));
+}
+
 static void
 splice_stream_ready_cb (GObject *output,
     GAsyncResult *result,
@@ -220,16 +311,401 @@ splice_stream_ready_cb (GObject *output,
 
   g_output_stream_splice_finish (G_OUTPUT_STREAM (output), result,
       &error);
+  splice_finished (self, error);
+  g_object_unref (self);
+}
 
-  if (error != NULL && !g_cancellable_is_cancelled (self->priv->cancellable))
-    DEBUG ("splice operation failed: %s", error->message);
-  g_clear_error (&error);
+static void
+scheduled_splice_ready_cb (GObject *scheduler,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpFileTransferChannel *self = user_data;
+  GError *error = NULL;
+
+  tp_transfer_scheduler_splice_finish (TP_TRANSFER_SCHEDULER (scheduler),
+      result, &error);
+  g_clear_object (&self->priv->scheduled_source);
+  splice_finished (self, error);
+  g_object_unref (self);
+}
+
+/* Returns the GChecksumType for the channel's ContentHashType, if we should
+ * hash the file while transferring it */
+static gboolean
+get_checksum_type (TpFileTransferChannel *self,
+    GChecksumType *checksum_type)
+{
+  if (!self->priv->compute_hash)
+    return FALSE;
+
+  /* when receiving the rest of a partial file, we don't see the start */
+  if (!tp_channel_get_requested (TP_CHANNEL (self)) &&
+      self->priv->requested_offset != 0)
+    return FALSE;
+
+  switch (self->priv->content_hash_type)
+    {
+      case TP_FILE_HASH_TYPE_MD5:
+        *checksum_type = G_CHECKSUM_MD5;
+        return TRUE;
+
+      case TP_FILE_HASH_TYPE_SHA1:
+        *checksum_type = G_CHECKSUM_SHA1;
+        return TRUE;
+
+      case TP_FILE_HASH_TYPE_SHA256:
+        *checksum_type = G_CHECKSUM_SHA256;
+        return TRUE;
+
+      default:
+        return FALSE;
+    }
+}
+
+/* Returns @source, or a stream hashing what is read from it */
+static GInputStream *
+maybe_checksum_stream (TpFileTransferChannel *self,
+    GInputStream *source)
+{
+  GChecksumType checksum_type;
+
+  if (!get_checksum_type (self, &checksum_type))
+    return g_object_ref (source);
+
+  g_clear_object (&self->priv->checksum_stream);
+  self->priv->checksum_stream = _tp_checksum_input_stream_new (source,
+      checksum_type);
+  return g_object_ref (self->priv->checksum_stream);
+}
+
+static void
+splice_streams (TpFileTransferChannel *self)
+{
+  GInputStream *source;
+  GOutputStream *target;
+
+  if (tp_channel_get_requested (TP_CHANNEL (self)))
+    {
+      target = g_io_stream_get_output_stream (self->priv->stream);
+      source = maybe_checksum_stream (self, self->priv->in_stream);
+    }
+  else
+    {
+      target = self->priv->out_stream;
+      source = maybe_checksum_stream (self,
+          g_io_stream_get_input_stream (self->priv->stream));
+    }
+
+  if (self->priv->scheduler != NULL)
+    {
+      tp_transfer_scheduler_splice_async (self->priv->scheduler, target,
+          source,
+          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+          self->priv->scheduler_weight, self->priv->cancellable,
+          scheduled_splice_ready_cb, g_object_ref (self));
+
+      self->priv->scheduled_source = g_object_ref (source);
+
+      if (self->priv->paused)
+        tp_transfer_scheduler_set_paused (self->priv->scheduler, source,
+            TRUE);
+    }
+  else
+    {
+      g_output_stream_splice_async (target, source,
+          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+          G_PRIORITY_DEFAULT, self->priv->cancellable,
+          splice_stream_ready_cb, g_object_ref (self));
+    }
+
+  g_object_unref (source);
+}
+
+#ifdef USE_NATIVE_TRANSFER
+/* Moving the data between the file and the CM's socket inside the kernel,
+ * with sendfile(2) when providing and splice(2) through a pipe when
+ * accepting, rather than copying it through GIO's buffers. This runs in a
+ * thread, because the file descriptors of local files always block. */
+
+typedef struct
+{
+  gboolean sending;
+  gint file_fd;
+  gint socket_fd;
+  gsize buffer_size;
+  /* only touched by the thread */
+  guint64 transferred;
+} NativeTransfer;
+
+static void
+native_transfer_free (NativeTransfer *nt)
+{
+  g_slice_free (NativeTransfer, nt);
+}
+
+static gboolean
+wait_for_socket (gint fd,
+    GIOCondition condition,
+    GCancellable *cancellable,
+    GError **error)
+{
+  GPollFD fds[2] = { { fd, condition, 0 }, };
+  guint n_fds = 1;
+  gint ret;
+  gint errsv;
+
+  if (g_cancellable_make_pollfd (cancellable, &fds[1]))
+    n_fds++;
+
+  do
+    {
+      ret = g_poll (fds, n_fds, -1);
+      errsv = errno;
+    }
+  while (ret < 0 && errsv == EINTR);
+
+  if (n_fds > 1)
+    g_cancellable_release_fd (cancellable);
+
+  if (ret < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+          "poll: %s", g_strerror (errsv));
+      return FALSE;
+    }
+
+  return !g_cancellable_set_error_if_cancelled (cancellable, error);
+}
+
+/* Errors which mean this pair of file descriptors can't be used with
+ * sendfile() or splice(), in which case we fall back to GIO if nothing has
+ * been transferred yet */
+static void
+native_transfer_set_error (NativeTransfer *nt,
+    gint errsv,
+    const gchar *syscall,
+    GError **error)
+{
+  if (nt->transferred == 0 && (errsv == EINVAL || errsv == ENOSYS))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+          "%s: %s", syscall, g_strerror (errsv));
+      return;
+    }
+
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+      "%s: %s", syscall, g_strerror (errsv));
+}
+
+static gboolean
+native_transfer_send (NativeTransfer *nt,
+    GCancellable *cancellable,
+    GError **error)
+{
+  while (!g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gssize n = sendfile (nt->socket_fd, nt->file_fd, NULL,
+          nt->buffer_size);
+
+      if (n > 0)
+        {
+          nt->transferred += n;
+        }
+      else if (n == 0)
+        {
+          return TRUE;
+        }
+      else if (errno == EAGAIN)
+        {
+          if (!wait_for_socket (nt->socket_fd, G_IO_OUT, cancellable, error))
+            return FALSE;
+        }
+      else if (errno != EINTR)
+        {
+          native_transfer_set_error (nt, errno, "sendfile", error);
+          return FALSE;
+        }
+    }
+
+  return FALSE;
+}
+
+static gboolean
+native_transfer_receive (NativeTransfer *nt,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gint pipe_fds[2];
+  gboolean ret = FALSE;
+
+  if (pipe (pipe_fds) != 0)
+    {
+      /* nothing has happened yet, so let GIO do it instead */
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+          "pipe: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+#ifdef F_SETPIPE_SZ
+  /* Best effort: without it, each splice() moves at most the pipe's default
+   * capacity */
+  fcntl (pipe_fds[1], F_SETPIPE_SZ, (gint) nt->buffer_size);
+#endif
+
+  while (!g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gssize n = splice (nt->socket_fd, NULL, pipe_fds[1], NULL,
+          nt->buffer_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+      if (n == 0)
+        {
+          ret = TRUE;
+          break;
+        }
+      else if (n < 0)
+        {
+          if (errno == EAGAIN)
+            {
+              if (!wait_for_socket (nt->socket_fd, G_IO_IN, cancellable,
+                    error))
+                break;
+            }
+          else if (errno != EINTR)
+            {
+              native_transfer_set_error (nt, errno, "splice", error);
+              break;
+            }
+
+          continue;
+        }
+
+      /* The pipe is drained completely before reading from the socket
+       * again, so writing to the file never has to wait for the peer */
+      while (n > 0)
+        {
+          gssize m = splice (pipe_fds[0], NULL, nt->file_fd, NULL, n,
+              SPLICE_F_MOVE);
+
+          if (m < 0 && errno == EINTR)
+            continue;
+
+          if (m <= 0)
+            {
+              /* the data is already out of the socket, so there's no
+               * falling back from here */
+              g_set_error (error, G_IO_ERROR,
+                  g_io_error_from_errno (m < 0 ? errno : EIO),
+                  "splice: %s", g_strerror (m < 0 ? errno : EIO));
+              goto out;
+            }
+
+          n -= m;
+          nt->transferred += m;
+        }
+    }
+
+out:
+  close (pipe_fds[0]);
+  close (pipe_fds[1]);
+  return ret;
+}
+
+static void
+native_transfer_thread (GSimpleAsyncResult *result,
+    GObject *object,
+    GCancellable *cancellable)
+{
+  NativeTransfer *nt = g_simple_async_result_get_op_res_gpointer (result);
+  GError *error = NULL;
+  gboolean ok;
+
+  if (nt->sending)
+    ok = native_transfer_send (nt, cancellable, &error);
+  else
+    ok = native_transfer_receive (nt, cancellable, &error);
+
+  if (!ok)
+    g_simple_async_result_take_error (result, error);
+}
+
+static void
+native_transfer_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpFileTransferChannel *self = (TpFileTransferChannel *) source;
+  GError *error = NULL;
+
+  if (g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result),
+        &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+          DEBUG ("falling back to GIO: %s", error->message);
+          g_error_free (error);
+          splice_streams (self);
+          return;
+        }
+
+      if (!g_cancellable_is_cancelled (self->priv->cancellable))
+        DEBUG ("transfer failed: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  if (self->priv->in_stream != NULL)
+    g_input_stream_close (self->priv->in_stream, NULL, NULL);
+
+  if (self->priv->out_stream != NULL)
+    g_output_stream_close (self->priv->out_stream, NULL, NULL);
 
   g_io_stream_close_async (self->priv->stream, G_PRIORITY_DEFAULT,
       NULL, stream_close_cb, g_object_ref (self));
+}
 
-  g_object_unref (self);
+/* Returns TRUE if the transfer has been started, or FALSE if the file or the
+ * socket isn't backed by a file descriptor */
+static gboolean
+start_native_transfer (TpFileTransferChannel *self)
+{
+  NativeTransfer *nt;
+  GSimpleAsyncResult *result;
+  GObject *file_stream;
+
+  if (tp_channel_get_requested (TP_CHANNEL (self)))
+    file_stream = (GObject *) self->priv->in_stream;
+  else
+    file_stream = (GObject *) self->priv->out_stream;
+
+  if (!G_IS_FILE_DESCRIPTOR_BASED (file_stream))
+    return FALSE;
+
+  nt = g_slice_new0 (NativeTransfer);
+  nt->sending = tp_channel_get_requested (TP_CHANNEL (self));
+  nt->file_fd = g_file_descriptor_based_get_fd (
+      G_FILE_DESCRIPTOR_BASED (file_stream));
+  nt->socket_fd = g_socket_get_fd (self->priv->client_socket);
+  nt->buffer_size = self->priv->buffer_size;
+
+  if (nt->buffer_size == 0)
+    nt->buffer_size = DEFAULT_BUFFER_SIZE;
+
+  DEBUG ("%s in the kernel, %" G_GSIZE_FORMAT " bytes at a time",
+      nt->sending ? "sending" : "receiving", nt->buffer_size);
+
+  result = g_simple_async_result_new ((GObject *) self, native_transfer_cb,
+      NULL, start_native_transfer);
+  g_simple_async_result_set_op_res_gpointer (result, nt,
+      (GDestroyNotify) native_transfer_free);
+  g_simple_async_result_run_in_thread (result, native_transfer_thread,
+      G_PRIORITY_DEFAULT, self->priv->cancellable);
+  g_object_unref (result);
+
+  return TRUE;
 }
+#endif /* USE_NATIVE_TRANSFER */
 
 static void
 client_socket_connected (TpFileTransferChannel *self)
@@ -268,30 +744,20 @@ client_socket_connected (TpFileTransferChannel *self)
 
   self->priv->stream = G_IO_STREAM (conn);
 
-  if (tp_channel_get_requested (TP_CHANNEL (self)))
-    {
-      GOutputStream *stream;
-
-      stream = g_io_stream_get_output_stream (G_IO_STREAM (conn));
-
-      g_output_stream_splice_async (stream, self->priv->in_stream,
-          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-          G_PRIORITY_DEFAULT, self->priv->cancellable,
-          splice_stream_ready_cb, g_object_ref (self));
-    }
-  else
-    {
-      GInputStream *stream;
+#ifdef USE_NATIVE_TRANSFER
+  {
+    GChecksumType checksum_type;
 
-      stream = g_io_stream_get_input_stream (G_IO_STREAM (conn));
+    /* the data never comes through this process, so it can't be hashed
+     * or scheduled */
+    if (!get_checksum_type (self, &checksum_type) &&
+        self->priv->scheduler == NULL &&
+        start_native_transfer (self))
+      return;
+  }
+#endif
 
-      g_output_stream_splice_async (self->priv->out_stream, stream,
-          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-          G_PRIORITY_DEFAULT, self->priv->cancellable,
-          splice_stream_ready_cb, g_object_ref (self));
-    }
+  splice_streams (self);
 }
 
 static gboolean
@@ -338,9 +804,27 @@ tp_file_transfer_channel_state_changed_cb (TpChannel *proxy,
       self->priv->in_stream ? "present" : "not present",
       self->priv->out_stream ? "present" : "not present");
 
+  flush_transferred_bytes (self);
+
   self->priv->state = state;
   self->priv->state_reason = reason;
 
+  /* Partial files are kept for resuming if the transfer fails, but once it
+   * is complete there's nothing to resume */
+  if (state == TP_FILE_TRANSFER_STATE_COMPLETED &&
+      self->priv->checkpoint != NULL)
+    {
+      GError *error = NULL;
+
+      if (!g_file_delete (self->priv->checkpoint, NULL, &error))
+        {
+          DEBUG ("Failed to delete checkpoint: %s", error->message);
+          g_clear_error (&error);
+        }
+
+      g_clear_object (&self->priv->checkpoint);
+    }
+
   /* If the channel is open AND we have the socket path, we can start the
    * transfer. The socket path could be NULL if we are not doing the actual
    * data transfer but are just an observer for the channel. */
@@ -365,6 +849,74 @@ tp_file_transfer_channel_initial_offset_defined_cb (TpChannel *proxy,
   g_object_notify (G_OBJECT (self), "initial-offset");
 }
 
+static void
+update_transfer_rate (TpFileTransferChannel *self)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (self->priv->rate_time != 0 && now > self->priv->rate_time &&
+      self->priv->transferred_bytes >= self->priv->rate_bytes)
+    {
+      guint64 rate = (self->priv->transferred_bytes - self->priv->rate_bytes) *
+          G_USEC_PER_SEC / (now - self->priv->rate_time);
+
+      /* smooth it a little, so that one slow interval doesn't make the
+       * estimated time jump */
+      if (self->priv->transfer_rate == 0)
+        self->priv->transfer_rate = rate;
+      else
+        self->priv->transfer_rate = (self->priv->transfer_rate + rate) / 2;
+    }
+
+  self->priv->rate_bytes = self->priv->transferred_bytes;
+  self->priv->rate_time = now;
+}
+
+static void
+notify_transferred_bytes (TpFileTransferChannel *self)
+{
+  GObject *obj = (GObject *) self;
+
+  update_transfer_rate (self);
+  self->priv->transferred_bytes_dirty = FALSE;
+
+  g_object_freeze_notify (obj);
+  g_object_notify (obj, "transferred-bytes");
+  g_object_notify (obj, "transfer-rate");
+  g_object_notify (obj, "estimated-time-remaining");
+  g_object_thaw_notify (obj);
+}
+
+static gboolean
+notify_transferred_bytes_cb (gpointer user_data)
+{
+  TpFileTransferChannel *self = user_data;
+
+  if (self->priv->transferred_bytes_dirty)
+    {
+      notify_transferred_bytes (self);
+      return TRUE;
+    }
+
+  self->priv->notify_transferred_id = 0;
+  return FALSE;
+}
+
+/* Make sure whoever is watching has seen the latest value, for instance
+ * before the transfer is reported to be complete */
+static void
+flush_transferred_bytes (TpFileTransferChannel *self)
+{
+  if (self->priv->notify_transferred_id == 0)
+    return;
+
+  g_source_remove (self->priv->notify_transferred_id);
+  self->priv->notify_transferred_id = 0;
+
+  if (self->priv->transferred_bytes_dirty)
+    notify_transferred_bytes (self);
+}
+
 static void
 tp_file_transfer_channel_transferred_bytes_changed_cb (TpChannel *proxy,
     guint64 count,
@@ -374,7 +926,17 @@ tp_file_transfer_channel_transferred_bytes_changed_cb (TpChannel *proxy,
   TpFileTransferChannel *self = (TpFileTransferChannel *) proxy;
 
   self->priv->transferred_bytes = count;
-  g_object_notify (G_OBJECT (self), "transferred-bytes");
+
+  /* Some CMs emit this for every chunk; coalesce them */
+  if (self->priv->notify_transferred_id != 0)
+    {
+      self->priv->transferred_bytes_dirty = TRUE;
+      return;
+    }
+
+  notify_transferred_bytes (self);
+  self->priv->notify_transferred_id = g_timeout_add (NOTIFY_INTERVAL_MS,
+      notify_transferred_bytes_cb, self);
 }
 
 static void
@@ -674,6 +1236,19 @@ tp_file_transfer_channel_get_property (GObject *object,
         g_value_set_boxed (value, self->priv->metadata);
         break;
 
+      case PROP_TRANSFER_RATE:
+        g_value_set_uint64 (value, self->priv->transfer_rate);
+        break;
+
+      case PROP_ESTIMATED_TIME_REMAINING:
+        g_value_set_int64 (value,
+            tp_file_transfer_channel_get_estimated_time_remaining (self));
+        break;
+
+      case PROP_COMPUTED_CONTENT_HASH:
+        g_value_set_string (value, self->priv->computed_hash);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -710,10 +1285,22 @@ tp_file_transfer_channel_dispose (GObject *obj)
 {
   TpFileTransferChannel *self = (TpFileTransferChannel *) obj;
 
+  if (self->priv->notify_transferred_id != 0)
+    {
+      g_source_remove (self->priv->notify_transferred_id);
+      self->priv->notify_transferred_id = 0;
+    }
+
   tp_clear_pointer (&self->priv->date, g_date_time_unref);
   g_clear_object (&self->priv->file);
+  g_clear_object (&self->priv->io_stream);
+  g_clear_object (&self->priv->checkpoint);
   tp_clear_pointer (&self->priv->metadata, g_hash_table_unref);
   g_clear_object (&self->priv->stream);
+  g_clear_object (&self->priv->checksum_stream);
+  tp_clear_pointer (&self->priv->computed_hash, g_free);
+  g_clear_object (&self->priv->scheduled_source);
+  g_clear_object (&self->priv->scheduler);
 
   if (self->priv->cancellable != NULL)
     g_cancellable_cancel (self->priv->cancellable);
@@ -1003,6 +1590,64 @@ tp_file_transfer_channel_class_init (TpFileTransferChannelClass *klass)
   g_object_class_install_property (object_class, PROP_METADATA,
       param_spec);
 
+  /**
+   * TpFileTransferChannel:transfer-rate:
+   *
+   * An estimate of the current speed of the transfer, in bytes per second,
+   * from the #TpFileTransferChannel:transferred-bytes updates received so
+   * far, or 0 if unknown.
+   *
+   * Like #TpFileTransferChannel:transferred-bytes, this is notified at
+   * most a few times per second however often the connection manager
+   * reports progress.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_uint64 ("transfer-rate",
+      "Transfer rate",
+      "Estimated transfer speed in bytes per second",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TRANSFER_RATE,
+      param_spec);
+
+  /**
+   * TpFileTransferChannel:estimated-time-remaining:
+   *
+   * An estimate of the number of seconds until the transfer is complete,
+   * based on #TpFileTransferChannel:transfer-rate, or -1 if unknown
+   * (for instance because the #TpFileTransferChannel:size is not known).
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_int64 ("estimated-time-remaining",
+      "Estimated time remaining",
+      "Estimated number of seconds until the transfer is complete, or -1",
+      -1, G_MAXINT64, -1,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+      PROP_ESTIMATED_TIME_REMAINING, param_spec);
+
+  /**
+   * TpFileTransferChannel:computed-content-hash:
+   *
+   * The hash of the file, of the type given by the channel's
+   * ContentHashType, computed while it was transferred, as a string of
+   * lower-case hexadecimal digits; or %NULL if it has not been computed.
+   * See tp_file_transfer_channel_set_compute_content_hash().
+   *
+   * This is notified once the whole file has been transferred.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_string ("computed-content-hash",
+      "Computed content hash",
+      "The hash of the file, computed while it was transferred",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+      PROP_COMPUTED_CONTENT_HASH, param_spec);
+
   g_type_class_add_private (object_class, sizeof
       (TpFileTransferChannelPrivate));
 }
@@ -1099,6 +1744,30 @@ start_transfer (TpFileTransferChannel *self)
 {
   GError *error = NULL;
 
+  /* The CM may not be able to start where we asked when resuming, in
+   * which case it will send the data from InitialOffset */
+  if (self->priv->io_stream != NULL &&
+      (guint64) self->priv->initial_offset != self->priv->requested_offset)
+    {
+      GSeekable *seekable = G_SEEKABLE (self->priv->io_stream);
+
+      DEBUG ("resuming from %" G_GUINT64_FORMAT " instead of %"
+          G_GUINT64_FORMAT, (guint64) self->priv->initial_offset,
+          self->priv->requested_offset);
+
+      if (!g_seekable_seek (seekable, self->priv->initial_offset, G_SEEK_SET,
+            NULL, &error) ||
+          !g_seekable_truncate (seekable, self->priv->initial_offset, NULL,
+            &error))
+        {
+          DEBUG ("Failed to rewind partial file: %s", error->message);
+          g_clear_error (&error);
+          return;
+        }
+
+      self->priv->requested_offset = self->priv->initial_offset;
+    }
+
   g_socket_set_blocking (self->priv->client_socket, FALSE);
 
   /* g_socket_connect returns true on successful connection */
@@ -1175,6 +1844,7 @@ set_address_and_access_control (TpFileTransferChannel *self)
 
   if (!_tp_set_socket_address_type_and_access_control_type (
           self->priv->available_socket_types,
+          self->priv->socket_options.abstract_unix,
           &self->priv->socket_type, &self->priv->access_control, &error))
     {
       operation_failed (self, error);
@@ -1193,6 +1863,9 @@ set_address_and_access_control (TpFileTransferChannel *self)
       return FALSE;
     }
 
+  _tp_socket_apply_options (self->priv->client_socket,
+      &self->priv->socket_options);
+
   switch (self->priv->access_control)
     {
       case TP_SOCKET_ACCESS_CONTROL_LOCALHOST:
@@ -1259,41 +1932,310 @@ file_transfer_set_uri_cb (TpProxy *proxy,
       G_OBJECT (self));
 }
 
+static void write_checkpoint (TpFileTransferChannel *self);
+
+static void
+accept_opened_file (TpFileTransferChannel *self,
+    GFile *file)
+{
+  gchar *uri;
+  GValue *value;
+
+  g_clear_object (&self->priv->file);
+  self->priv->file = g_object_ref (file);
+
+  if (self->priv->checkpoint != NULL)
+    write_checkpoint (self);
+
+  /* Try setting FileTransfer.URI before accepting the file */
+  uri = g_file_get_uri (file);
+  value = tp_g_value_slice_new_take_string (uri);
+
+  tp_cli_dbus_properties_call_set (self, -1,
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "URI", value,
+      file_transfer_set_uri_cb, NULL, NULL, G_OBJECT (self));
+
+  tp_g_value_slice_free (value);
+}
+
+static void
+file_replace_async_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpFileTransferChannel *self = user_data;
+  GFile *file = G_FILE (source);
+  GFileOutputStream *out_stream;
+  GError *error = NULL;
+
+  out_stream = g_file_replace_finish (file, result, &error);
+
+  if (error != NULL)
+    {
+      DEBUG ("Failed to replace file: %s", error->message);
+      operation_failed (self, error);
+      return;
+    }
+
+  self->priv->out_stream = G_OUTPUT_STREAM (out_stream);
+
+  accept_opened_file (self, file);
+}
+
+/* Resuming transfers.
+ *
+ * The partial file is kept between attempts, with a small key file next to
+ * it (the "checkpoint") recording which transfer it belongs to. A partial
+ * file is only resumed if its checkpoint matches the new channel's file
+ * name, size, date and content hash; otherwise it's replaced. */
+
+#define CHECKPOINT_GROUP "Transfer"
+
+static GFile *
+dup_checkpoint_file (GFile *file)
+{
+  GFile *parent = g_file_get_parent (file);
+  gchar *basename;
+  gchar *name;
+  GFile *ret;
+
+  if (parent == NULL)
+    return NULL;
+
+  basename = g_file_get_basename (file);
+  name = g_strdup_printf ("%s.tp-checkpoint", basename);
+  ret = g_file_get_child (parent, name);
+
+  g_free (name);
+  g_free (basename);
+  g_object_unref (parent);
+  return ret;
+}
+
+static GKeyFile *
+build_checkpoint (TpFileTransferChannel *self)
+{
+  GKeyFile *key_file = g_key_file_new ();
+
+  g_key_file_set_string (key_file, CHECKPOINT_GROUP, "Filename",
+      self->priv->filename != NULL ? self->priv->filename : "");
+  g_key_file_set_uint64 (key_file, CHECKPOINT_GROUP, "Size",
+      self->priv->size);
+  g_key_file_set_int64 (key_file, CHECKPOINT_GROUP, "Date",
+      self->priv->date != NULL ? g_date_time_to_unix (self->priv->date) : 0);
+  g_key_file_set_integer (key_file, CHECKPOINT_GROUP, "ContentHashType",
+      self->priv->content_hash_type);
+  g_key_file_set_string (key_file, CHECKPOINT_GROUP, "ContentHash",
+      self->priv->content_hash != NULL ? self->priv->content_hash : "");
+
+  return key_file;
+}
+
+static void
+write_checkpoint (TpFileTransferChannel *self)
+{
+  GKeyFile *key_file = build_checkpoint (self);
+  gchar *data;
+  gsize len;
+  GError *error = NULL;
+
+  data = g_key_file_to_data (key_file, &len, NULL);
+
+  /* it's tiny, and we're about to write lots of data anyway */
+  if (!g_file_replace_contents (self->priv->checkpoint, data, len, NULL,
+        FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error))
+    {
+      DEBUG ("Failed to write checkpoint, this transfer won't be "
+          "resumable: %s", error->message);
+      g_clear_error (&error);
+      g_clear_object (&self->priv->checkpoint);
+    }
+
+  g_free (data);
+  g_key_file_free (key_file);
+}
+
+static gboolean
+checkpoint_matches (TpFileTransferChannel *self,
+    const gchar *contents,
+    gsize len)
+{
+  GKeyFile *expected = build_checkpoint (self);
+  GKeyFile *found = g_key_file_new ();
+  gchar **keys;
+  gboolean ret = TRUE;
+  guint i;
+
+  if (!g_key_file_load_from_data (found, contents, len, G_KEY_FILE_NONE,
+        NULL))
+    {
+      ret = FALSE;
+      goto out;
+    }
+
+  keys = g_key_file_get_keys (expected, CHECKPOINT_GROUP, NULL, NULL);
+
+  for (i = 0; ret && keys[i] != NULL; i++)
+    {
+      gchar *want = g_key_file_get_value (expected, CHECKPOINT_GROUP, keys[i],
+          NULL);
+      gchar *have = g_key_file_get_value (found, CHECKPOINT_GROUP, keys[i],
+          NULL);
+
+      if (tp_strdiff (want, have))
+        {
+          DEBUG ("%s was '%s', now '%s'", keys[i], have, want);
+          ret = FALSE;
+        }
+
+      g_free (want);
+      g_free (have);
+    }
+
+  g_strfreev (keys);
+
+out:
+  g_key_file_free (expected);
+  g_key_file_free (found);
+  return ret;
+}
+
+static void
+resume_from_scratch (TpFileTransferChannel *self)
+{
+  self->priv->requested_offset = 0;
+
+  g_file_replace_async (self->priv->file, NULL, FALSE, G_FILE_CREATE_NONE,
+      G_PRIORITY_DEFAULT, NULL, file_replace_async_cb, self);
+}
+
+static void
+file_open_readwrite_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpFileTransferChannel *self = user_data;
+  GFile *file = G_FILE (source);
+  GFileIOStream *io_stream;
+  GFileInfo *info;
+  guint64 size;
+  GError *error = NULL;
+
+  io_stream = g_file_open_readwrite_finish (file, result, &error);
+
+  if (io_stream == NULL)
+    {
+      DEBUG ("Can't open partial file, starting again: %s", error->message);
+      g_clear_error (&error);
+      resume_from_scratch (self);
+      return;
+    }
+
+  info = g_file_io_stream_query_info (io_stream,
+      G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, &error);
+
+  if (info == NULL)
+    {
+      DEBUG ("Can't get size of partial file, starting again: %s",
+          error->message);
+      g_clear_error (&error);
+      g_object_unref (io_stream);
+      resume_from_scratch (self);
+      return;
+    }
+
+  size = g_file_info_get_size (info);
+  g_object_unref (info);
+
+  if (size > self->priv->size ||
+      !g_seekable_seek (G_SEEKABLE (io_stream), size, G_SEEK_SET, NULL,
+        &error))
+    {
+      DEBUG ("Can't resume partial file of size %" G_GUINT64_FORMAT
+          ", starting again: %s", size,
+          error != NULL ? error->message : "larger than the transfer");
+      g_clear_error (&error);
+      g_object_unref (io_stream);
+      resume_from_scratch (self);
+      return;
+    }
+
+  DEBUG ("resuming at offset %" G_GUINT64_FORMAT, size);
+
+  self->priv->io_stream = io_stream;
+  self->priv->out_stream = g_object_ref (
+      g_io_stream_get_output_stream (G_IO_STREAM (io_stream)));
+  self->priv->requested_offset = size;
+
+  accept_opened_file (self, file);
+}
+
 static void
-file_replace_async_cb (GObject *source,
+checkpoint_loaded_cb (GObject *source,
     GAsyncResult *result,
     gpointer user_data)
 {
   TpFileTransferChannel *self = user_data;
-  GFile *file = G_FILE (source);
-  GFileOutputStream *out_stream;
-  gchar *uri;
+  gchar *contents;
+  gsize len;
   GError *error = NULL;
-  GValue *value;
-
-  out_stream = g_file_replace_finish (file, result, &error);
 
-  if (error != NULL)
+  if (!g_file_load_contents_finish (G_FILE (source), result, &contents, &len,
+        NULL, &error))
     {
-      DEBUG ("Failed to replace file: %s", error->message);
-      operation_failed (self, error);
+      DEBUG ("No checkpoint to resume from: %s", error->message);
+      g_clear_error (&error);
+      resume_from_scratch (self);
       return;
     }
 
-  self->priv->out_stream = G_OUTPUT_STREAM (out_stream);
+  if (checkpoint_matches (self, contents, len))
+    {
+      g_file_open_readwrite_async (self->priv->file, G_PRIORITY_DEFAULT, NULL,
+          file_open_readwrite_cb, self);
+    }
+  else
+    {
+      DEBUG ("Partial file is from a different transfer, starting again");
+      resume_from_scratch (self);
+    }
 
-  g_clear_object (&self->priv->file);
-  self->priv->file = g_object_ref (file);
+  g_free (contents);
+}
 
-  /* Try setting FileTransfer.URI before accepting the file */
-  uri = g_file_get_uri (file);
-  value = tp_g_value_slice_new_take_string (uri);
+static gboolean
+check_can_accept (TpFileTransferChannel *self,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  if (self->priv->access_control_param != NULL)
+    {
+      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
+          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "Can't accept already accepted transfer");
 
-  tp_cli_dbus_properties_call_set (self, -1,
-      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "URI", value,
-      file_transfer_set_uri_cb, NULL, NULL, G_OBJECT (self));
+      return FALSE;
+    }
 
-  tp_g_value_slice_free (value);
+  if (self->priv->state != TP_FILE_TRANSFER_STATE_PENDING)
+    {
+      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
+          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "Can't accept a transfer that isn't pending");
+
+      return FALSE;
+    }
+
+  if (tp_channel_get_requested (TP_CHANNEL (self)))
+    {
+      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
+          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "Can't accept outgoing transfer");
+
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 /**
@@ -1322,32 +2264,8 @@ tp_file_transfer_channel_accept_file_async (TpFileTransferChannel *self,
   g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
   g_return_if_fail (G_IS_FILE (file));
 
-  if (self->priv->access_control_param != NULL)
-    {
-      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
-          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "Can't accept already accepted transfer");
-
-      return;
-    }
-
-  if (self->priv->state != TP_FILE_TRANSFER_STATE_PENDING)
-    {
-      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
-          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "Can't accept a transfer that isn't pending");
-
-      return;
-    }
-
-  if (tp_channel_get_requested (TP_CHANNEL (self)))
-    {
-      g_simple_async_report_error_in_idle (G_OBJECT (self), callback,
-          user_data, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "Can't accept outgoing transfer");
-
-      return;
-    }
+  if (!check_can_accept (self, callback, user_data))
+    return;
 
   self->priv->result = g_simple_async_result_new (G_OBJECT (self), callback,
       user_data, tp_file_transfer_channel_accept_file_async);
@@ -1378,6 +2296,82 @@ tp_file_transfer_channel_accept_file_finish (TpFileTransferChannel *self,
   _tp_implement_finish_void (self, tp_file_transfer_channel_accept_file_async)
 }
 
+/**
+ * tp_file_transfer_channel_resume_file_async:
+ * @self: a #TpFileTransferChannel
+ * @file: a #GFile where the file should be saved
+ * @callback: a callback to call when the transfer has been accepted
+ * @user_data: data to pass to @callback
+ *
+ * Accept an incoming file transfer in the
+ * %TP_FILE_TRANSFER_STATE_PENDING state, like
+ * tp_file_transfer_channel_accept_file_async(), but continuing from where a
+ * previous attempt to receive the same file into @file stopped.
+ *
+ * To make this possible, a small checkpoint file is kept next to @file
+ * (with ".tp-checkpoint" appended to its name) until the transfer is
+ * complete. If it shows that @file is a partial copy of this channel's
+ * file (same #TpFileTransferChannel:filename,
+ * #TpFileTransferChannel:size, #TpFileTransferChannel:date and content
+ * hash), the connection manager is asked to start sending from the end of
+ * @file; otherwise, @file is replaced as if
+ * tp_file_transfer_channel_accept_file_async() had been called with offset
+ * 0. If the connection manager can only start from an earlier point (see
+ * #TpFileTransferChannel:initial-offset), @file is truncated to it.
+ *
+ * Once the accept has been processed, @callback will be called. You can
+ * then call tp_file_transfer_channel_resume_file_finish() to get the result
+ * of the operation.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_resume_file_async (TpFileTransferChannel *self,
+    GFile *file,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (G_IS_FILE (file));
+
+  if (!check_can_accept (self, callback, user_data))
+    return;
+
+  self->priv->result = g_simple_async_result_new (G_OBJECT (self), callback,
+      user_data, tp_file_transfer_channel_resume_file_async);
+
+  g_clear_object (&self->priv->file);
+  self->priv->file = g_object_ref (file);
+  g_clear_object (&self->priv->checkpoint);
+  self->priv->checkpoint = dup_checkpoint_file (file);
+
+  if (self->priv->checkpoint == NULL)
+    resume_from_scratch (self);
+  else
+    g_file_load_contents_async (self->priv->checkpoint, NULL,
+        checkpoint_loaded_cb, self);
+}
+
+/**
+ * tp_file_transfer_channel_resume_file_finish:
+ * @self: a #TpFileTransferChannel
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes a call to tp_file_transfer_channel_resume_file_async().
+ *
+ * Returns: %TRUE if the accept operation was a success, or %FALSE
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_file_transfer_channel_resume_file_finish (TpFileTransferChannel *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (self, tp_file_transfer_channel_resume_file_async)
+}
+
 static void
 file_read_async_cb (GObject *source,
     GAsyncResult *res,
@@ -1504,6 +2498,263 @@ tp_file_transfer_channel_provide_file_finish (TpFileTransferChannel *self,
   _tp_implement_finish_void (self, tp_file_transfer_channel_provide_file_async)
 }
 
+/**
+ * tp_file_transfer_channel_set_buffer_size:
+ * @self: a #TpFileTransferChannel
+ * @buffer_size: the maximum number of bytes to move at a time, or 0 to use
+ *  a default
+ *
+ * Choose how much data is moved between the file and the connection
+ * manager at a time. Larger buffers mean fewer system calls for very big
+ * files. This must be called before
+ * tp_file_transfer_channel_accept_file_async() or
+ * tp_file_transfer_channel_provide_file_async().
+ *
+ * On Linux, local files are transferred without copying them through this
+ * process, and @buffer_size is the size of each sendfile() or splice();
+ * elsewhere, or for files which are not backed by a file descriptor, GIO
+ * chooses its own buffer size and this has no effect.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_buffer_size (TpFileTransferChannel *self,
+    gsize buffer_size)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (self->priv->stream == NULL);
+
+  self->priv->buffer_size = buffer_size;
+}
+
+/**
+ * tp_file_transfer_channel_set_socket_options:
+ * @self: a #TpFileTransferChannel
+ * @send_buffer_size: the socket's send buffer size (SO_SNDBUF), or 0 to use
+ *  the system's default
+ * @receive_buffer_size: the socket's receive buffer size (SO_RCVBUF), or 0
+ *  to use the system's default
+ * @no_delay: if %TRUE, disable Nagle's algorithm (TCP_NODELAY)
+ * @keepalive: if %TRUE, enable TCP keepalives (SO_KEEPALIVE)
+ *
+ * Tune the socket between this process and the connection manager. Socket
+ * buffers at least as large as the one set with
+ * tp_file_transfer_channel_set_buffer_size() let each write complete in one
+ * go. @no_delay and @keepalive only apply to IPv4 and IPv6 sockets.
+ *
+ * Options which the system refuses are ignored. This must be called before
+ * tp_file_transfer_channel_accept_file_async() or
+ * tp_file_transfer_channel_provide_file_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_socket_options (TpFileTransferChannel *self,
+    gint send_buffer_size,
+    gint receive_buffer_size,
+    gboolean no_delay,
+    gboolean keepalive)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (send_buffer_size >= 0);
+  g_return_if_fail (receive_buffer_size >= 0);
+  g_return_if_fail (self->priv->client_socket == NULL);
+
+  self->priv->socket_options.send_buffer_size = send_buffer_size;
+  self->priv->socket_options.receive_buffer_size = receive_buffer_size;
+  self->priv->socket_options.no_delay = no_delay;
+  self->priv->socket_options.keepalive = keepalive;
+}
+
+/**
+ * tp_file_transfer_channel_set_use_abstract_unix:
+ * @self: a #TpFileTransferChannel
+ * @use_abstract_unix: if %TRUE, prefer %TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX
+ *
+ * If @use_abstract_unix is %TRUE and both this platform and the connection
+ * manager support it, connect to the connection manager through a Unix
+ * socket in the abstract namespace, rather than one on the filesystem.
+ * Otherwise, the usual socket type is used.
+ *
+ * This must be called before tp_file_transfer_channel_accept_file_async()
+ * or tp_file_transfer_channel_provide_file_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_use_abstract_unix (TpFileTransferChannel *self,
+    gboolean use_abstract_unix)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (self->priv->client_socket == NULL);
+
+  self->priv->socket_options.abstract_unix = use_abstract_unix;
+}
+
+/**
+ * tp_file_transfer_channel_set_compute_content_hash:
+ * @self: a #TpFileTransferChannel
+ * @compute: %TRUE to hash the file while transferring it
+ *
+ * If @compute is %TRUE, and the channel has a ContentHashType other than
+ * %TP_FILE_HASH_TYPE_NONE, hash the file as it is sent or received, so that
+ * it does not have to be read again afterwards to check it. Once the whole
+ * file has been transferred, the result is available from
+ * tp_file_transfer_channel_get_computed_content_hash(), and can be compared
+ * with the hash announced by the sender using
+ * tp_file_transfer_channel_check_content_hash().
+ *
+ * The hash is not computed when receiving the rest of a partial file with
+ * tp_file_transfer_channel_resume_file_async(), since the start of the
+ * file is not transferred. Hashing means the data is copied through this
+ * process, rather than moved by the kernel as described for
+ * tp_file_transfer_channel_set_buffer_size(), so it is off by default.
+ *
+ * This must be called before
+ * tp_file_transfer_channel_accept_file_async() or
+ * tp_file_transfer_channel_provide_file_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_compute_content_hash (
+    TpFileTransferChannel *self,
+    gboolean compute)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (self->priv->stream == NULL);
+
+  self->priv->compute_hash = compute;
+}
+
+/**
+ * tp_file_transfer_channel_get_computed_content_hash:
+ * @self: a #TpFileTransferChannel
+ *
+ * Return the #TpFileTransferChannel:computed-content-hash property
+ *
+ * Returns: (transfer none): the value of the
+ *   #TpFileTransferChannel:computed-content-hash property
+ *
+ * Since: 0.UNRELEASED
+ */
+const gchar *
+tp_file_transfer_channel_get_computed_content_hash (
+    TpFileTransferChannel *self)
+{
+  g_return_val_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self), NULL);
+
+  return self->priv->computed_hash;
+}
+
+/**
+ * tp_file_transfer_channel_check_content_hash:
+ * @self: a #TpFileTransferChannel
+ * @error: used to raise an error if %FALSE is returned
+ *
+ * Compare #TpFileTransferChannel:computed-content-hash with the channel's
+ * ContentHash, as given by the sender.
+ *
+ * Returns: %TRUE if they are the same; %FALSE, with @error set to
+ *  %G_IO_ERROR_INVALID_DATA, if they differ, meaning the file was corrupted
+ *  in transit; or %FALSE, with @error set to %TP_ERROR_NOT_AVAILABLE, if
+ *  either of them is unknown
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_file_transfer_channel_check_content_hash (TpFileTransferChannel *self,
+    GError **error)
+{
+  g_return_val_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self), FALSE);
+
+  if (self->priv->computed_hash == NULL ||
+      tp_str_empty (self->priv->content_hash))
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "The file's hash has not been computed, or was not given by the "
+          "sender");
+      return FALSE;
+    }
+
+  if (g_ascii_strcasecmp (self->priv->computed_hash,
+        self->priv->content_hash) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+          "The file's hash is %s, but the sender said it was %s",
+          self->priv->computed_hash, self->priv->content_hash);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * tp_file_transfer_channel_set_scheduler:
+ * @self: a #TpFileTransferChannel
+ * @scheduler: (allow-none): a #TpTransferScheduler, such as the one
+ *  returned by tp_transfer_scheduler_dup_default(), or %NULL
+ * @weight: this transfer's share of @scheduler's bandwidth, relative to
+ *  its other transfers; must be at least 1
+ *
+ * Copy the file with @scheduler, so that it shares a rate limit with the
+ * other transfers using it, and so that it can be paused with
+ * tp_file_transfer_channel_set_paused(). If @scheduler is %NULL, which is
+ * the default, the file is copied as fast as the connection allows.
+ *
+ * Like tp_file_transfer_channel_set_compute_content_hash(), a scheduler
+ * means the data is copied through this process, and this must be called
+ * before tp_file_transfer_channel_accept_file_async() or
+ * tp_file_transfer_channel_provide_file_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_scheduler (TpFileTransferChannel *self,
+    TpTransferScheduler *scheduler,
+    guint weight)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (scheduler == NULL || TP_IS_TRANSFER_SCHEDULER (scheduler));
+  g_return_if_fail (scheduler == NULL || weight > 0);
+  g_return_if_fail (self->priv->stream == NULL);
+
+  if (scheduler != NULL)
+    g_object_ref (scheduler);
+
+  g_clear_object (&self->priv->scheduler);
+  self->priv->scheduler = scheduler;
+  self->priv->scheduler_weight = weight;
+}
+
+/**
+ * tp_file_transfer_channel_set_paused:
+ * @self: a #TpFileTransferChannel
+ * @paused: %TRUE to stop copying the file, %FALSE to carry on
+ *
+ * Pause or resume a transfer that uses a #TpTransferScheduler, as described
+ * for tp_transfer_scheduler_set_paused(). The connection to the CM stays
+ * open while the transfer is paused. If the transfer has not started yet,
+ * it will start paused.
+ *
+ * This can only be used after tp_file_transfer_channel_set_scheduler().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_file_transfer_channel_set_paused (TpFileTransferChannel *self,
+    gboolean paused)
+{
+  g_return_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self));
+  g_return_if_fail (self->priv->scheduler != NULL);
+
+  self->priv->paused = paused;
+
+  if (self->priv->scheduled_source != NULL)
+    tp_transfer_scheduler_set_paused (self->priv->scheduler,
+        self->priv->scheduled_source, paused);
+}
+
 
 /* Property accessors */
 
@@ -1646,6 +2897,59 @@ tp_file_transfer_channel_get_transferred_bytes (TpFileTransferChannel *self)
   return self->priv->transferred_bytes;
 }
 
+/**
+ * tp_file_transfer_channel_get_transfer_rate:
+ * @self: a #TpFileTransferChannel
+ *
+ * Return the #TpFileTransferChannel:transfer-rate property
+ *
+ * Returns: the value of the #TpFileTransferChannel:transfer-rate property
+ *
+ * Since: 0.UNRELEASED
+ */
+guint64
+tp_file_transfer_channel_get_transfer_rate (TpFileTransferChannel *self)
+{
+  g_return_val_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self), 0);
+
+  return self->priv->transfer_rate;
+}
+
+/**
+ * tp_file_transfer_channel_get_estimated_time_remaining:
+ * @self: a #TpFileTransferChannel
+ *
+ * Return the #TpFileTransferChannel:estimated-time-remaining property
+ *
+ * Returns: the value of the
+ *   #TpFileTransferChannel:estimated-time-remaining property
+ *
+ * Since: 0.UNRELEASED
+ */
+gint64
+tp_file_transfer_channel_get_estimated_time_remaining (
+    TpFileTransferChannel *self)
+{
+  guint64 remaining;
+
+  g_return_val_if_fail (TP_IS_FILE_TRANSFER_CHANNEL (self), -1);
+
+  /* G_MAXUINT64 means the CM doesn't know the size */
+  if (self->priv->size == G_MAXUINT64)
+    return -1;
+
+  if (self->priv->transferred_bytes >= self->priv->size)
+    return 0;
+
+  if (self->priv->transfer_rate == 0)
+    return -1;
+
+  remaining = self->priv->size - self->priv->transferred_bytes;
+
+  return (remaining + self->priv->transfer_rate - 1) /
+      self->priv->transfer_rate;
+}
+
 /**
  * tp_file_transfer_channel_get_service_name:
  * @self: a #TpFileTransferChannel
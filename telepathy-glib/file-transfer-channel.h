@@ -28,6 +28,7 @@
 
 #include <telepathy-glib/channel.h>
 #include <telepathy-glib/defs.h>
+#include <telepathy-glib/transfer-scheduler.h>
 
 G_BEGIN_DECLS
 
@@ -87,6 +88,18 @@ gboolean tp_file_transfer_channel_accept_file_finish (
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_resume_file_async (TpFileTransferChannel *self,
+    GFile *file,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_file_transfer_channel_resume_file_finish (
+    TpFileTransferChannel *self,
+    GAsyncResult *result,
+    GError **error);
+
 _TP_AVAILABLE_IN_0_18
 void tp_file_transfer_channel_provide_file_async (TpFileTransferChannel *self,
     GFile *file,
@@ -99,6 +112,43 @@ gboolean tp_file_transfer_channel_provide_file_finish (
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_buffer_size (TpFileTransferChannel *self,
+    gsize buffer_size);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_compute_content_hash (
+    TpFileTransferChannel *self,
+    gboolean compute);
+
+_TP_AVAILABLE_IN_UNRELEASED
+const gchar *tp_file_transfer_channel_get_computed_content_hash (
+    TpFileTransferChannel *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_file_transfer_channel_check_content_hash (
+    TpFileTransferChannel *self,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_scheduler (TpFileTransferChannel *self,
+    TpTransferScheduler *scheduler,
+    guint weight);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_paused (TpFileTransferChannel *self,
+    gboolean paused);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_socket_options (TpFileTransferChannel *self,
+    gint send_buffer_size,
+    gint receive_buffer_size,
+    gboolean no_delay,
+    gboolean keepalive);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_file_transfer_channel_set_use_abstract_unix (
+    TpFileTransferChannel *self,
+    gboolean use_abstract_unix);
+
 /* Property accessors */
 
 _TP_AVAILABLE_IN_0_16
@@ -128,6 +178,14 @@ _TP_AVAILABLE_IN_0_16
 guint64 tp_file_transfer_channel_get_transferred_bytes (
     TpFileTransferChannel *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+guint64 tp_file_transfer_channel_get_transfer_rate (
+    TpFileTransferChannel *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gint64 tp_file_transfer_channel_get_estimated_time_remaining (
+    TpFileTransferChannel *self);
+
 /* Metadata */
 
 _TP_AVAILABLE_IN_0_18
@@ -432,22 +432,96 @@ tp_unix_connection_send_credentials_with_byte (GSocketConnection *connection,
 #endif
 }
 
-static void
-send_credentials_with_byte_async_thread (GSimpleAsyncResult *res,
-    GObject *object,
-    GCancellable *cancellable)
+#ifdef HAVE_GIO_UNIX
+/* The asynchronous versions make the same calls as the synchronous ones on
+ * a non-blocking socket, and if the other side isn't ready yet, wait for it
+ * in the main context rather than tying up a thread for each connection. */
+typedef struct
 {
+  GSimpleAsyncResult *res;
+  GSocketConnection *connection;
+  GCancellable *cancellable;
   guchar byte;
+  gboolean turn_off_so_passcreds;
+} CredentialsAsyncData;
+
+static CredentialsAsyncData *
+credentials_async_data_new (GSocketConnection *connection,
+    GSimpleAsyncResult *res,
+    GCancellable *cancellable)
+{
+  CredentialsAsyncData *data = g_slice_new0 (CredentialsAsyncData);
+
+  data->res = g_object_ref (res);
+  data->connection = g_object_ref (connection);
+
+  if (cancellable != NULL)
+    data->cancellable = g_object_ref (cancellable);
+
+  return data;
+}
+
+static void
+credentials_async_data_complete (CredentialsAsyncData *data)
+{
+  /* the first attempt is made before the _async() call returns */
+  g_simple_async_result_complete_in_idle (data->res);
+
+  g_object_unref (data->res);
+  g_object_unref (data->connection);
+  tp_clear_object (&data->cancellable);
+  g_slice_free (CredentialsAsyncData, data);
+}
+
+static void
+credentials_async_data_wait (CredentialsAsyncData *data,
+    GIOCondition condition,
+    GSocketSourceFunc callback)
+{
+  GSource *source;
+
+  /* the source is also dispatched if the operation is cancelled, in which
+   * case the next attempt fails with G_IO_ERROR_CANCELLED */
+  source = g_socket_create_source (
+      g_socket_connection_get_socket (data->connection), condition,
+      data->cancellable);
+  g_source_set_callback (source, (GSourceFunc) callback, data, NULL);
+  g_source_attach (source, g_main_context_get_thread_default ());
+  g_source_unref (source);
+}
+
+static gboolean
+send_credentials_with_byte_async_try (GSocket *_socket G_GNUC_UNUSED,
+    GIOCondition condition G_GNUC_UNUSED,
+    gpointer user_data)
+{
+  CredentialsAsyncData *data = user_data;
+  GSocket *socket = g_socket_connection_get_socket (data->connection);
+  gboolean blocking = g_socket_get_blocking (socket);
   GError *error = NULL;
+  gboolean ok;
 
-  byte = GPOINTER_TO_UINT (g_simple_async_result_get_op_res_gpointer (res));
+  g_socket_set_blocking (socket, FALSE);
+  ok = _tp_unix_connection_send_credentials_with_byte (
+      G_UNIX_CONNECTION (data->connection), data->byte, data->cancellable,
+      &error);
+  g_socket_set_blocking (socket, blocking);
 
-  if (!tp_unix_connection_send_credentials_with_byte (
-          (GSocketConnection *) object, byte, cancellable, &error))
+  if (!ok && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
     {
-      g_simple_async_result_take_error (res, error);
+      g_error_free (error);
+      credentials_async_data_wait (data, G_IO_OUT,
+          send_credentials_with_byte_async_try);
+      return FALSE;
     }
+
+  if (!ok)
+    g_simple_async_result_take_error (data->res, error);
+
+  credentials_async_data_complete (data);
+  return FALSE;
 }
+#endif
 
 /**
  * tp_unix_connection_send_credentials_with_byte_async:
@@ -477,16 +551,22 @@ tp_unix_connection_send_credentials_with_byte_async (
     gpointer user_data)
 {
   GSimpleAsyncResult *res;
+#ifdef HAVE_GIO_UNIX
+  CredentialsAsyncData *data;
+#endif
 
   res = g_simple_async_result_new (G_OBJECT (connection), callback, user_data,
       tp_unix_connection_send_credentials_with_byte_async);
 
-  /* Extra casting to guint to work around GNOME#661546 for GLib < 2.32 */
-  g_simple_async_result_set_op_res_gpointer (res,
-      GUINT_TO_POINTER ((guint) byte), NULL);
-
-  g_simple_async_result_run_in_thread (res,
-      send_credentials_with_byte_async_thread, G_PRIORITY_DEFAULT, cancellable);
+#ifdef HAVE_GIO_UNIX
+  data = credentials_async_data_new (connection, res, cancellable);
+  data->byte = byte;
+  send_credentials_with_byte_async_try (NULL, G_IO_OUT, data);
+#else
+  g_simple_async_result_set_error (res, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+      "Unix sockets not supported");
+  g_simple_async_result_complete_in_idle (res);
+#endif
 
   g_object_unref (res);
 }
@@ -515,49 +595,22 @@ tp_unix_connection_send_credentials_with_byte_finish (
 }
 
 #ifdef HAVE_GIO_UNIX
-static GCredentials *
-_tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
-    guchar *byte,
-    GCancellable *cancellable,
+/* On Linux, we need to turn on SO_PASSCRED if it isn't enabled
+ * already. We also need to turn it off when we're done.  See
+ * #617483 for more discussion.
+ */
+static gboolean
+enable_so_passcred (GSocket *_socket,
+    gboolean *turn_off_so_passcreds,
     GError **error)
 {
-  /* There is not variant of g_unix_connection_receive_credentials allowing us
-   * to choose the byte sent :( See bgo #629267
-   *
-   * This code has been copied from glib/gunixconnection.c
-   *
-   * Copyright © 2009 Codethink Limited
-   */
-  GCredentials *ret;
-  GSocketControlMessage **scms;
-  gint nscm;
-  GSocket *_socket;
-  gint n;
-  gssize num_bytes_read;
-#ifdef __linux__
-  gboolean turn_off_so_passcreds;
-#endif
-  GInputVector vector;
-  guchar buffer[1];
-
-  g_return_val_if_fail (G_IS_UNIX_CONNECTION (connection), NULL);
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
-  ret = NULL;
-  scms = NULL;
-
-  g_object_get (connection, "socket", &_socket, NULL);
+  *turn_off_so_passcreds = FALSE;
 
-  /* On Linux, we need to turn on SO_PASSCRED if it isn't enabled
-   * already. We also need to turn it off when we're done.  See
-   * #617483 for more discussion.
-   */
 #ifdef __linux__
   {
     gint opt_val;
     socklen_t opt_len;
 
-    turn_off_so_passcreds = FALSE;
     opt_val = 0;
     opt_len = sizeof (gint);
     if (getsockopt (g_socket_get_fd (_socket),
@@ -571,7 +624,7 @@ _tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
                      g_io_error_from_errno (errno),
                      "Error checking if SO_PASSCRED is enabled for socket: %s",
                      strerror (errno));
-        goto out;
+        return FALSE;
       }
     if (opt_len != sizeof (gint))
       {
@@ -581,7 +634,7 @@ _tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
                      "Unexpected option length while checking if SO_PASSCRED is enabled for socket. "
                        "Expected %d bytes, got %d",
                      (gint) sizeof (gint), (gint) opt_len);
-        goto out;
+        return FALSE;
       }
     if (opt_val == 0)
       {
@@ -597,13 +650,65 @@ _tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
                          g_io_error_from_errno (errno),
                          "Error enabling SO_PASSCRED: %s",
                          strerror (errno));
-            goto out;
+            return FALSE;
           }
-        turn_off_so_passcreds = TRUE;
+        *turn_off_so_passcreds = TRUE;
       }
   }
 #endif
 
+  return TRUE;
+}
+
+static gboolean
+restore_so_passcred (GSocket *_socket,
+    gboolean turn_off_so_passcreds,
+    GError **error)
+{
+#ifdef __linux__
+  if (turn_off_so_passcreds)
+    {
+      gint opt_val;
+      opt_val = 0;
+      if (setsockopt (g_socket_get_fd (_socket),
+                      SOL_SOCKET,
+                      SO_PASSCRED,
+                      &opt_val,
+                      sizeof opt_val) != 0)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       "Error while disabling SO_PASSCRED: %s",
+                       strerror (errno));
+          return FALSE;
+        }
+    }
+#endif
+
+  return TRUE;
+}
+
+/* Receive the byte and the credentials message, with SO_PASSCRED already
+ * enabled. If @_socket is non-blocking, this fails with
+ * G_IO_ERROR_WOULD_BLOCK when they haven't arrived yet. */
+static GCredentials *
+receive_credentials_message (GSocket *_socket,
+    guchar *byte,
+    GCancellable *cancellable,
+    GError **error)
+{
+  GCredentials *ret;
+  GSocketControlMessage **scms;
+  gint nscm;
+  gint n;
+  gssize num_bytes_read;
+  GInputVector vector;
+  guchar buffer[1];
+
+  ret = NULL;
+  scms = NULL;
+
   vector.buffer = buffer;
   vector.size = 1;
 
@@ -661,34 +766,47 @@ _tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
   g_object_ref (ret);
 
  out:
-
-#ifdef __linux__
-  if (turn_off_so_passcreds)
-    {
-      gint opt_val;
-      opt_val = 0;
-      if (setsockopt (g_socket_get_fd (_socket),
-                      SOL_SOCKET,
-                      SO_PASSCRED,
-                      &opt_val,
-                      sizeof opt_val) != 0)
-        {
-          g_set_error (error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       "Error while disabling SO_PASSCRED: %s",
-                       strerror (errno));
-          goto out;
-        }
-    }
-#endif
-
   if (scms != NULL)
     {
       for (n = 0; n < nscm; n++)
         g_object_unref (scms[n]);
       g_free (scms);
     }
+  return ret;
+}
+
+static GCredentials *
+_tp_unix_connection_receive_credentials_with_byte (GUnixConnection *connection,
+    guchar *byte,
+    GCancellable *cancellable,
+    GError **error)
+{
+  /* There is not variant of g_unix_connection_receive_credentials allowing us
+   * to choose the byte sent :( See bgo #629267
+   *
+   * This code has been copied from glib/gunixconnection.c
+   *
+   * Copyright © 2009 Codethink Limited
+   */
+  GCredentials *ret = NULL;
+  GSocket *_socket;
+  gboolean turn_off_so_passcreds;
+
+  g_return_val_if_fail (G_IS_UNIX_CONNECTION (connection), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  g_object_get (connection, "socket", &_socket, NULL);
+
+  if (!enable_so_passcred (_socket, &turn_off_so_passcreds, error))
+    goto out;
+
+  ret = receive_credentials_message (_socket, byte, cancellable, error);
+
+  if (!restore_so_passcred (_socket, turn_off_so_passcreds,
+        ret == NULL ? NULL : error))
+    tp_clear_object (&ret);
+
+ out:
   g_object_unref (_socket);
   return ret;
 }
@@ -731,6 +849,7 @@ typedef struct
   guchar byte;
 } ReceiveCredentialsWithByteData;
 
+#ifdef HAVE_GIO_UNIX
 static ReceiveCredentialsWithByteData *
 receive_credentials_with_byte_data_new (GCredentials *creds,
     guchar byte)
@@ -751,29 +870,52 @@ receive_credentials_with_byte_data_free (ReceiveCredentialsWithByteData *data)
   g_slice_free (ReceiveCredentialsWithByteData, data);
 }
 
-static void
-receive_credentials_with_byte_async_thread (GSimpleAsyncResult *res,
-    GObject *object,
-    GCancellable *cancellable)
+static gboolean
+receive_credentials_with_byte_async_try (GSocket *_socket G_GNUC_UNUSED,
+    GIOCondition condition G_GNUC_UNUSED,
+    gpointer user_data)
 {
-  guchar byte;
+  CredentialsAsyncData *data = user_data;
+  GSocket *socket = g_socket_connection_get_socket (data->connection);
+  gboolean blocking = g_socket_get_blocking (socket);
   GCredentials *creds;
   GError *error = NULL;
 
-  creds = tp_unix_connection_receive_credentials_with_byte (
-      (GSocketConnection *) object, &byte, cancellable, &error);
-  if (creds == NULL)
+  g_socket_set_blocking (socket, FALSE);
+  creds = receive_credentials_message (socket, &data->byte,
+      data->cancellable, &error);
+  g_socket_set_blocking (socket, blocking);
+
+  if (creds == NULL &&
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
     {
-      g_simple_async_result_take_error (res, error);
-      return;
+      /* SO_PASSCRED stays enabled while we wait */
+      g_error_free (error);
+      credentials_async_data_wait (data, G_IO_IN,
+          receive_credentials_with_byte_async_try);
+      return FALSE;
     }
 
-  g_simple_async_result_set_op_res_gpointer (res,
-      receive_credentials_with_byte_data_new (creds, byte),
-      (GDestroyNotify) receive_credentials_with_byte_data_free);
+  if (!restore_so_passcred (socket, data->turn_off_so_passcreds,
+        creds == NULL ? NULL : &error))
+    tp_clear_object (&creds);
+
+  if (creds == NULL)
+    {
+      g_simple_async_result_take_error (data->res, error);
+    }
+  else
+    {
+      g_simple_async_result_set_op_res_gpointer (data->res,
+          receive_credentials_with_byte_data_new (creds, data->byte),
+          (GDestroyNotify) receive_credentials_with_byte_data_free);
+      g_object_unref (creds);
+    }
 
-  g_object_unref (creds);
+  credentials_async_data_complete (data);
+  return FALSE;
 }
+#endif
 
 /**
  * tp_unix_connection_receive_credentials_with_byte_async:
@@ -801,13 +943,32 @@ tp_unix_connection_receive_credentials_with_byte_async (
     gpointer user_data)
 {
   GSimpleAsyncResult *res;
+#ifdef HAVE_GIO_UNIX
+  CredentialsAsyncData *data;
+  GError *error = NULL;
+#endif
 
   res = g_simple_async_result_new (G_OBJECT (connection), callback, user_data,
       tp_unix_connection_receive_credentials_with_byte_async);
 
-  g_simple_async_result_run_in_thread (res,
-      receive_credentials_with_byte_async_thread, G_PRIORITY_DEFAULT,
-      cancellable);
+#ifdef HAVE_GIO_UNIX
+  data = credentials_async_data_new (connection, res, cancellable);
+
+  if (enable_so_passcred (g_socket_connection_get_socket (connection),
+        &data->turn_off_so_passcreds, &error))
+    {
+      receive_credentials_with_byte_async_try (NULL, G_IO_IN, data);
+    }
+  else
+    {
+      g_simple_async_result_take_error (res, error);
+      credentials_async_data_complete (data);
+    }
+#else
+  g_simple_async_result_set_error (res, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+      "Unix sockets not supported");
+  g_simple_async_result_complete_in_idle (res);
+#endif
 
   g_object_unref (res);
 }
@@ -64,6 +64,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <telepathy-glib/base-channel.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug-ansi.h>
 #include <telepathy-glib/errors.h>
@@ -73,6 +74,7 @@
 #define DEBUG_FLAG TP_DEBUG_GROUPS
 
 #include "debug-internal.h"
+#include "telepathy-glib/presence-mixin-internal.h"
 
 static const char *
 group_change_reason_str (guint reason)
@@ -146,11 +148,83 @@ struct _TpGroupMixinClassPrivate {
 
 struct _TpGroupMixinPrivate {
     TpHandleSet *actors;
-    GHashTable *handle_owners;
+    /* local handles which have an owner entry, and TpHandle owner of each of
+     * them (0 if unknown): indexed by the local handle for handles below
+     * MAX_DENSE_OWNERS, which most handle repositories allocate densely, so
+     * that this is smaller and faster than a hash table when every member
+     * has an owner, as in anonymous MUCs; and in a hash table (NULL until
+     * needed) for larger handles, which custom or reclaiming repositories
+     * can return */
+    TpIntset *owned_handles;
+    GArray *handle_owners;
+    GHashTable *sparse_handle_owners;
     GHashTable *local_pending_info;
     GPtrArray *externals;
+    /* arrays of the handles in members, local_pending and remote_pending,
+     * built when first needed and discarded when membership changes, so
+     * that large groups which are queried often don't have to convert their
+     * sets every time; or NULL */
+    GArray *members_snapshot;
+    GArray *local_pending_snapshot;
+    GArray *remote_pending_snapshot;
+
+    /* number of tp_group_mixin_begin_changes() calls not yet matched by
+     * tp_group_mixin_end_changes() */
+    guint batch_depth;
+    /* set by tp_group_mixin_set_changes_timeout() */
+    guint changes_timeout;
+    guint changes_timeout_id;
+    /* While batching: handle => GUINT_TO_POINTER (MemberState) before the
+     * first change to it in this batch. All the changes in a batch have the
+     * same message, actor and reason. */
+    GHashTable *batch_initial;
+    gchar *batch_message;
+    TpHandle batch_actor;
+    TpChannelGroupChangeReason batch_reason;
 };
 
+typedef enum {
+    MEMBER_STATE_NONE = 1,
+    MEMBER_STATE_MEMBER,
+    MEMBER_STATE_LOCAL_PENDING,
+    MEMBER_STATE_REMOTE_PENDING
+} MemberState;
+
+/* Return a borrowed array of the handles in @set, using and filling in
+ * the cached copy in @snapshot */
+static GArray *
+get_snapshot (TpHandleSet *set,
+    GArray **snapshot)
+{
+  if (*snapshot == NULL)
+    *snapshot = tp_handle_set_to_array (set);
+
+  return *snapshot;
+}
+
+/* Return a new array with the same contents as get_snapshot(); callers of
+ * our public API may g_array_free() what we return, so we can't just
+ * return another reference */
+static GArray *
+dup_snapshot (TpHandleSet *set,
+    GArray **snapshot)
+{
+  GArray *borrowed = get_snapshot (set, snapshot);
+  GArray *ret = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      borrowed->len);
+
+  g_array_append_vals (ret, borrowed->data, borrowed->len);
+  return ret;
+}
+
+static void
+discard_snapshots (TpGroupMixin *mixin)
+{
+  tp_clear_pointer (&mixin->priv->members_snapshot, g_array_unref);
+  tp_clear_pointer (&mixin->priv->local_pending_snapshot, g_array_unref);
+  tp_clear_pointer (&mixin->priv->remote_pending_snapshot, g_array_unref);
+}
+
 /**
  * TP_HAS_GROUP_MIXIN:
  * @o: a #GObject instance
@@ -337,11 +411,13 @@ tp_group_mixin_init (GObject *obj,
   mixin->remote_pending = tp_handle_set_new (handle_repo);
 
   mixin->priv = g_slice_new0 (TpGroupMixinPrivate);
-  mixin->priv->handle_owners = g_hash_table_new (NULL, NULL);
+  mixin->priv->owned_handles = tp_intset_new ();
+  mixin->priv->handle_owners = g_array_new (FALSE, TRUE, sizeof (TpHandle));
   mixin->priv->local_pending_info = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify)local_pending_info_free);
   mixin->priv->actors = tp_handle_set_new (handle_repo);
   mixin->priv->externals = NULL;
+  mixin->priv->batch_initial = g_hash_table_new (NULL, NULL);
 }
 
 static void
@@ -377,12 +453,23 @@ tp_group_mixin_finalize (GObject *obj)
 
   tp_handle_set_destroy (mixin->priv->actors);
 
-  g_hash_table_unref (mixin->priv->handle_owners);
+  tp_intset_destroy (mixin->priv->owned_handles);
+  g_array_unref (mixin->priv->handle_owners);
+  tp_clear_pointer (&mixin->priv->sparse_handle_owners, g_hash_table_unref);
   g_hash_table_unref (mixin->priv->local_pending_info);
 
   if (mixin->priv->externals)
     g_ptr_array_unref (mixin->priv->externals);
 
+  discard_snapshots (mixin);
+
+  /* it's too late to emit anything that was batched up */
+  if (mixin->priv->changes_timeout_id != 0)
+    g_source_remove (mixin->priv->changes_timeout_id);
+
+  g_hash_table_unref (mixin->priv->batch_initial);
+  g_free (mixin->priv->batch_message);
+
   g_slice_free (TpGroupMixinPrivate, mixin->priv);
 
   tp_handle_set_destroy (mixin->members);
@@ -811,7 +898,7 @@ tp_group_mixin_get_members (GObject *obj,
 {
   TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  *ret = tp_handle_set_to_array (mixin->members);
+  *ret = dup_snapshot (mixin->members, &mixin->priv->members_snapshot);
 
   return TRUE;
 }
@@ -820,20 +907,10 @@ static void
 tp_group_mixin_get_members_async (TpSvcChannelInterfaceGroup *obj,
                                   DBusGMethodInvocation *context)
 {
-  GArray *ret;
-  GError *error = NULL;
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  if (tp_group_mixin_get_members ((GObject *) obj, &ret, &error))
-    {
-      tp_svc_channel_interface_group_return_from_get_members (
-          context, ret);
-      g_array_unref (ret);
-    }
-  else
-    {
-      dbus_g_method_return_error (context, error);
-      g_error_free (error);
-    }
+  tp_svc_channel_interface_group_return_from_get_members (context,
+      get_snapshot (mixin->members, &mixin->priv->members_snapshot));
 }
 
 /**
@@ -853,7 +930,8 @@ tp_group_mixin_get_local_pending_members (GObject *obj,
 {
   TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  *ret = tp_handle_set_to_array (mixin->local_pending);
+  *ret = dup_snapshot (mixin->local_pending,
+      &mixin->priv->local_pending_snapshot);
 
   return TRUE;
 }
@@ -862,20 +940,11 @@ static void
 tp_group_mixin_get_local_pending_members_async (TpSvcChannelInterfaceGroup *obj,
                                                 DBusGMethodInvocation *context)
 {
-  GArray *ret;
-  GError *error = NULL;
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  if (tp_group_mixin_get_local_pending_members ((GObject *) obj, &ret, &error))
-    {
-      tp_svc_channel_interface_group_return_from_get_local_pending_members (
-          context, ret);
-      g_array_unref (ret);
-    }
-  else
-    {
-      dbus_g_method_return_error (context, error);
-      g_error_free (error);
-    }
+  tp_svc_channel_interface_group_return_from_get_local_pending_members (
+      context, get_snapshot (mixin->local_pending,
+        &mixin->priv->local_pending_snapshot));
 }
 
 typedef struct {
@@ -985,7 +1054,8 @@ tp_group_mixin_get_remote_pending_members (GObject *obj,
 {
   TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  *ret = tp_handle_set_to_array (mixin->remote_pending);
+  *ret = dup_snapshot (mixin->remote_pending,
+      &mixin->priv->remote_pending_snapshot);
 
   return TRUE;
 }
@@ -994,21 +1064,11 @@ static void
 tp_group_mixin_get_remote_pending_members_async (TpSvcChannelInterfaceGroup *obj,
                                                  DBusGMethodInvocation *context)
 {
-  GArray *ret;
-  GError *error = NULL;
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  if (tp_group_mixin_get_remote_pending_members ((GObject *) obj,
-        &ret, &error))
-    {
-      tp_svc_channel_interface_group_return_from_get_remote_pending_members (
-          context, ret);
-      g_array_unref (ret);
-    }
-  else
-    {
-      dbus_g_method_return_error (context, error);
-      g_error_free (error);
-    }
+  tp_svc_channel_interface_group_return_from_get_remote_pending_members (
+      context, get_snapshot (mixin->remote_pending,
+        &mixin->priv->remote_pending_snapshot));
 }
 
 /**
@@ -1035,9 +1095,11 @@ tp_group_mixin_get_all_members (GObject *obj,
 {
   TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
 
-  *members = tp_handle_set_to_array (mixin->members);
-  *local_pending = tp_handle_set_to_array (mixin->local_pending);
-  *remote_pending = tp_handle_set_to_array (mixin->remote_pending);
+  *members = dup_snapshot (mixin->members, &mixin->priv->members_snapshot);
+  *local_pending = dup_snapshot (mixin->local_pending,
+      &mixin->priv->local_pending_snapshot);
+  *remote_pending = dup_snapshot (mixin->remote_pending,
+      &mixin->priv->remote_pending_snapshot);
 
   return TRUE;
 }
@@ -1065,6 +1127,85 @@ tp_group_mixin_get_all_members_async (TpSvcChannelInterfaceGroup *obj,
     }
 }
 
+/* the highest local handle + 1 kept in the array, bounding it to 256 KiB */
+#define MAX_DENSE_OWNERS (1 << 16)
+
+static TpHandle
+get_handle_owner (TpGroupMixinPrivate *priv,
+    TpHandle local_handle)
+{
+  if (local_handle >= MAX_DENSE_OWNERS)
+    {
+      if (priv->sparse_handle_owners == NULL)
+        return 0;
+
+      return GPOINTER_TO_UINT (g_hash_table_lookup (
+            priv->sparse_handle_owners, GUINT_TO_POINTER (local_handle)));
+    }
+
+  if (local_handle >= priv->handle_owners->len)
+    return 0;
+
+  return g_array_index (priv->handle_owners, TpHandle, local_handle);
+}
+
+static void
+set_handle_owner (TpGroupMixinPrivate *priv,
+    TpHandle local_handle,
+    TpHandle owner_handle)
+{
+  tp_intset_add (priv->owned_handles, local_handle);
+
+  if (local_handle >= MAX_DENSE_OWNERS)
+    {
+      if (priv->sparse_handle_owners == NULL)
+        priv->sparse_handle_owners = g_hash_table_new (NULL, NULL);
+
+      g_hash_table_insert (priv->sparse_handle_owners,
+          GUINT_TO_POINTER (local_handle), GUINT_TO_POINTER (owner_handle));
+      return;
+    }
+
+  if (local_handle >= priv->handle_owners->len)
+    g_array_set_size (priv->handle_owners, local_handle + 1);
+
+  g_array_index (priv->handle_owners, TpHandle, local_handle) = owner_handle;
+}
+
+static void
+unset_handle_owner (TpGroupMixinPrivate *priv,
+    TpHandle local_handle)
+{
+  tp_intset_remove (priv->owned_handles, local_handle);
+
+  if (local_handle >= MAX_DENSE_OWNERS)
+    {
+      if (priv->sparse_handle_owners != NULL)
+        g_hash_table_remove (priv->sparse_handle_owners,
+            GUINT_TO_POINTER (local_handle));
+    }
+  else if (local_handle < priv->handle_owners->len)
+    {
+      g_array_index (priv->handle_owners, TpHandle, local_handle) = 0;
+    }
+}
+
+/* The HandleOwners property, as a new Handle_Owner_Map */
+static GHashTable *
+dup_handle_owners_table (TpGroupMixinPrivate *priv)
+{
+  GHashTable *ret = g_hash_table_new (NULL, NULL);
+  TpIntsetFastIter iter;
+  TpHandle handle;
+
+  tp_intset_fast_iter_init (&iter, priv->owned_handles);
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    g_hash_table_insert (ret, GUINT_TO_POINTER (handle),
+        GUINT_TO_POINTER (get_handle_owner (priv, handle)));
+
+  return ret;
+}
+
 /**
  * tp_group_mixin_get_handle_owners: (skip)
  * @obj: An object implementing the group interface with this mixin
@@ -1122,9 +1263,7 @@ tp_group_mixin_get_handle_owners (GObject *obj,
           return FALSE;
         }
 
-      owner_handle = GPOINTER_TO_UINT (
-          g_hash_table_lookup (priv->handle_owners,
-                               GUINT_TO_POINTER (local_handle)));
+      owner_handle = get_handle_owner (priv, local_handle);
 
       g_array_append_val (*ret, owner_handle);
     }
@@ -1469,6 +1608,13 @@ emit_members_changed_signals (GObject *channel,
       g_free (remote_str);
     }
 
+  /* Presence changes that the connection has not emitted yet happened
+   * before this */
+  if (TP_IS_BASE_CHANNEL (channel))
+    _tp_presence_mixin_flush_pending (
+        (GObject *) tp_base_channel_get_connection (
+            (TpBaseChannel *) channel));
+
   added_contact_ids = maybe_add_contact_ids (mixin, add, local_pending,
       remote_pending, actor, details_);
 
@@ -1497,6 +1643,242 @@ emit_members_changed_signals (GObject *channel,
 }
 
 
+/* Emit MembersChanged, MembersChangedDetailed and, if necessary,
+ * HandleOwnersChanged for a change that has already been made */
+static void
+emit_change (GObject *obj,
+    const gchar *message,
+    const TpIntset *new_add,
+    const TpIntset *new_remove,
+    const TpIntset *new_local_pending,
+    const TpIntset *new_remote_pending,
+    TpHandle actor,
+    TpChannelGroupChangeReason reason,
+    const GHashTable *details)
+{
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
+  GArray *arr_add, *arr_remove, *arr_local, *arr_remote;
+  GArray *arr_owners_removed;
+
+  /* translate intsets to arrays */
+  arr_add = tp_intset_to_array (new_add);
+  arr_remove = tp_intset_to_array (new_remove);
+  arr_local = tp_intset_to_array (new_local_pending);
+  arr_remote = tp_intset_to_array (new_remote_pending);
+
+  /* remove any handle owner mappings */
+  arr_owners_removed = remove_handle_owners_if_exist (obj, arr_remove);
+
+  /* emit signals */
+  emit_members_changed_signals (obj, message, arr_add, arr_remove,
+      arr_local, arr_remote, actor, reason, details);
+
+  if (arr_owners_removed->len > 0)
+    {
+      GHashTable *empty_hash_table = g_hash_table_new (NULL, NULL);
+
+      tp_svc_channel_interface_group_emit_handle_owners_changed (obj,
+          empty_hash_table, arr_owners_removed);
+      tp_svc_channel_interface_group_emit_handle_owners_changed_detailed (
+          obj, empty_hash_table, arr_owners_removed, empty_hash_table);
+
+      if (mixin->priv->externals != NULL)
+        {
+          guint i;
+
+          for (i = 0; i < mixin->priv->externals->len; i++)
+            {
+              tp_svc_channel_interface_group_emit_handle_owners_changed (
+                  g_ptr_array_index (mixin->priv->externals, i),
+                  empty_hash_table, arr_owners_removed);
+              tp_svc_channel_interface_group_emit_handle_owners_changed_detailed (
+                  g_ptr_array_index (mixin->priv->externals, i),
+                  empty_hash_table, arr_owners_removed, empty_hash_table);
+            }
+        }
+
+      g_hash_table_unref (empty_hash_table);
+    }
+
+  /* free arrays */
+  g_array_unref (arr_add);
+  g_array_unref (arr_remove);
+  g_array_unref (arr_local);
+  g_array_unref (arr_remote);
+  g_array_unref (arr_owners_removed);
+}
+
+static MemberState
+get_member_state (TpGroupMixin *mixin,
+    TpHandle handle)
+{
+  if (tp_handle_set_is_member (mixin->members, handle))
+    return MEMBER_STATE_MEMBER;
+
+  if (tp_handle_set_is_member (mixin->local_pending, handle))
+    return MEMBER_STATE_LOCAL_PENDING;
+
+  if (tp_handle_set_is_member (mixin->remote_pending, handle))
+    return MEMBER_STATE_REMOTE_PENDING;
+
+  return MEMBER_STATE_NONE;
+}
+
+/* Remember what state the handles in @set were in before this batch, if
+ * we don't already know */
+static void
+remember_initial_states (TpGroupMixin *mixin,
+    const TpIntset *set)
+{
+  TpIntsetFastIter iter;
+  TpHandle handle;
+
+  tp_intset_fast_iter_init (&iter, set);
+
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    {
+      if (!g_hash_table_lookup_extended (mixin->priv->batch_initial,
+            GUINT_TO_POINTER (handle), NULL, NULL))
+        g_hash_table_insert (mixin->priv->batch_initial,
+            GUINT_TO_POINTER (handle),
+            GUINT_TO_POINTER (get_member_state (mixin, handle)));
+    }
+}
+
+/* Return TRUE if a change with these details can be folded into the
+ * current batch: it must not have any details that MembersChanged can't
+ * express, and must have the same message, actor and reason as the rest of
+ * the batch */
+static gboolean
+batch_accepts (TpGroupMixin *mixin,
+    const gchar *message,
+    TpHandle actor,
+    TpChannelGroupChangeReason reason,
+    const GHashTable *details)
+{
+  GHashTableIter iter;
+  gpointer k;
+
+  g_hash_table_iter_init (&iter, (GHashTable *) details);
+
+  while (g_hash_table_iter_next (&iter, &k, NULL))
+    {
+      if (tp_strdiff (k, "actor") && tp_strdiff (k, "change-reason") &&
+          tp_strdiff (k, "message"))
+        return FALSE;
+    }
+
+  if (g_hash_table_size (mixin->priv->batch_initial) == 0)
+    return TRUE;
+
+  return (actor == mixin->priv->batch_actor &&
+      reason == mixin->priv->batch_reason &&
+      !tp_strdiff (message, mixin->priv->batch_message));
+}
+
+/* Emit one signal for the net effect of the changes batched up so far */
+static void
+flush_changes (GObject *obj)
+{
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
+  TpIntset *add, *del, *local_pending, *remote_pending;
+  GHashTableIter iter;
+  gpointer k, v;
+  gchar *message;
+
+  if (mixin->priv->changes_timeout_id != 0)
+    {
+      g_source_remove (mixin->priv->changes_timeout_id);
+      mixin->priv->changes_timeout_id = 0;
+    }
+
+  if (g_hash_table_size (mixin->priv->batch_initial) == 0)
+    return;
+
+  add = tp_intset_new ();
+  del = tp_intset_new ();
+  local_pending = tp_intset_new ();
+  remote_pending = tp_intset_new ();
+
+  g_hash_table_iter_init (&iter, mixin->priv->batch_initial);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      TpHandle handle = GPOINTER_TO_UINT (k);
+      MemberState now = get_member_state (mixin, handle);
+
+      if (now == GPOINTER_TO_UINT (v))
+        continue;
+
+      switch (now)
+        {
+        case MEMBER_STATE_MEMBER:
+          tp_intset_add (add, handle);
+          break;
+        case MEMBER_STATE_LOCAL_PENDING:
+          tp_intset_add (local_pending, handle);
+          break;
+        case MEMBER_STATE_REMOTE_PENDING:
+          tp_intset_add (remote_pending, handle);
+          break;
+        case MEMBER_STATE_NONE:
+          tp_intset_add (del, handle);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  g_hash_table_remove_all (mixin->priv->batch_initial);
+  message = mixin->priv->batch_message;
+  mixin->priv->batch_message = NULL;
+
+  if (tp_intset_size (add) > 0 ||
+      tp_intset_size (del) > 0 ||
+      tp_intset_size (local_pending) > 0 ||
+      tp_intset_size (remote_pending) > 0)
+    {
+      GHashTable *details = g_hash_table_new_full (g_str_hash, g_str_equal,
+          NULL, (GDestroyNotify) tp_g_value_slice_free);
+
+      if (mixin->priv->batch_actor != 0)
+        g_hash_table_insert (details, "actor",
+            tp_g_value_slice_new_uint (mixin->priv->batch_actor));
+
+      if (mixin->priv->batch_reason != TP_CHANNEL_GROUP_CHANGE_REASON_NONE)
+        g_hash_table_insert (details, "change-reason",
+            tp_g_value_slice_new_uint (mixin->priv->batch_reason));
+
+      if (message != NULL && message[0] != '\0')
+        g_hash_table_insert (details, "message",
+            tp_g_value_slice_new_string (message));
+
+      emit_change (obj, message, add, del, local_pending, remote_pending,
+          mixin->priv->batch_actor, mixin->priv->batch_reason, details);
+      g_hash_table_unref (details);
+    }
+  else
+    {
+      DEBUG ("not emitting signal, batched changes cancelled out");
+    }
+
+  tp_intset_destroy (add);
+  tp_intset_destroy (del);
+  tp_intset_destroy (local_pending);
+  tp_intset_destroy (remote_pending);
+  g_free (message);
+}
+
+static gboolean
+changes_timeout_cb (gpointer data)
+{
+  GObject *obj = data;
+
+  TP_GROUP_MIXIN (obj)->priv->changes_timeout_id = 0;
+  flush_changes (obj);
+  return FALSE;
+}
+
 static gboolean
 change_members (GObject *obj,
                 const gchar *message,
@@ -1511,6 +1893,7 @@ change_members (GObject *obj,
   TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
   TpIntset *new_add, *new_remove, *new_local_pending,
            *new_remote_pending, *tmp, *tmp2, *empty;
+  gboolean batching;
   gboolean ret;
 
   empty = tp_intset_new ();
@@ -1530,6 +1913,33 @@ change_members (GObject *obj,
   if (add_remote_pending == NULL)
     add_remote_pending = empty;
 
+  batching = (mixin->priv->batch_depth > 0 ||
+      mixin->priv->changes_timeout > 0);
+
+  if (batching &&
+      !batch_accepts (mixin, message, actor, reason, details))
+    {
+      /* emit what we have so far, so the order of changes is preserved */
+      flush_changes (obj);
+      batching = batch_accepts (mixin, message, actor, reason, details);
+    }
+
+  if (batching)
+    {
+      if (g_hash_table_size (mixin->priv->batch_initial) == 0)
+        {
+          g_free (mixin->priv->batch_message);
+          mixin->priv->batch_message = g_strdup (message);
+          mixin->priv->batch_actor = actor;
+          mixin->priv->batch_reason = reason;
+        }
+
+      remember_initial_states (mixin, add);
+      remember_initial_states (mixin, del);
+      remember_initial_states (mixin, add_local_pending);
+      remember_initial_states (mixin, add_remote_pending);
+    }
+
   /* remember the actor handle before any handle unreffing happens */
   if (actor)
     {
@@ -1602,55 +2012,22 @@ change_members (GObject *obj,
       tp_intset_size (new_local_pending) > 0 ||
       tp_intset_size (new_remote_pending) > 0)
     {
-      GArray *arr_add, *arr_remove, *arr_local, *arr_remote;
-      GArray *arr_owners_removed;
-
-      /* translate intsets to arrays */
-      arr_add = tp_intset_to_array (new_add);
-      arr_remove = tp_intset_to_array (new_remove);
-      arr_local = tp_intset_to_array (new_local_pending);
-      arr_remote = tp_intset_to_array (new_remote_pending);
+      /* nothing changed unless one of these is non-empty, so this is the
+       * only place we need to do this */
+      discard_snapshots (mixin);
 
-      /* remove any handle owner mappings */
-      arr_owners_removed = remove_handle_owners_if_exist (obj, arr_remove);
-
-      /* emit signals */
-      emit_members_changed_signals (obj, message, arr_add, arr_remove,
-          arr_local, arr_remote, actor, reason, details);
-
-      if (arr_owners_removed->len > 0)
+      if (batching)
         {
-          GHashTable *empty_hash_table = g_hash_table_new (NULL, NULL);
-
-          tp_svc_channel_interface_group_emit_handle_owners_changed (obj,
-              empty_hash_table, arr_owners_removed);
-          tp_svc_channel_interface_group_emit_handle_owners_changed_detailed (
-              obj, empty_hash_table, arr_owners_removed, empty_hash_table);
-
-          if (mixin->priv->externals != NULL)
-            {
-              guint i;
-
-              for (i = 0; i < mixin->priv->externals->len; i++)
-                {
-                  tp_svc_channel_interface_group_emit_handle_owners_changed (
-                      g_ptr_array_index (mixin->priv->externals, i),
-                      empty_hash_table, arr_owners_removed);
-                  tp_svc_channel_interface_group_emit_handle_owners_changed_detailed (
-                      g_ptr_array_index (mixin->priv->externals, i),
-                      empty_hash_table, arr_owners_removed, empty_hash_table);
-                }
-            }
-
-          g_hash_table_unref (empty_hash_table);
+          if (mixin->priv->batch_depth == 0 &&
+              mixin->priv->changes_timeout_id == 0)
+            mixin->priv->changes_timeout_id = g_timeout_add (
+                mixin->priv->changes_timeout, changes_timeout_cb, obj);
+        }
+      else
+        {
+          emit_change (obj, message, new_add, new_remove, new_local_pending,
+              new_remote_pending, actor, reason, details);
         }
-
-      /* free arrays */
-      g_array_unref (arr_add);
-      g_array_unref (arr_remove);
-      g_array_unref (arr_local);
-      g_array_unref (arr_remote);
-      g_array_unref (arr_owners_removed);
 
       ret = TRUE;
     }
@@ -1830,6 +2207,92 @@ tp_group_mixin_change_members_detailed (GObject *obj,
       add_remote_pending, actor, reason, details);
 }
 
+/**
+ * tp_group_mixin_begin_changes: (skip)
+ * @obj: An object implementing the group interface using this mixin
+ *
+ * Start a batch of changes. Until the matching call to
+ * tp_group_mixin_end_changes(), calls to tp_group_mixin_change_members() and
+ * tp_group_mixin_change_members_detailed() change the group immediately, but
+ * the MembersChanged and MembersChangedDetailed signals are held back.
+ * Successive changes to the same contact are folded together, and
+ * tp_group_mixin_end_changes() signals the net change in one go. For
+ * instance, this is useful while joining a large chatroom, where the
+ * protocol reports each member separately.
+ *
+ * Only changes with the same message, actor and reason, and no details
+ * other than those, can be folded together. A change that differs causes
+ * the changes so far to be signalled first, so the order of changes is
+ * preserved.
+ *
+ * Batches may be nested; the signals are emitted when the outermost batch
+ * ends.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_group_mixin_begin_changes (GObject *obj)
+{
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
+
+  g_return_if_fail (mixin != NULL);
+
+  mixin->priv->batch_depth++;
+}
+
+/**
+ * tp_group_mixin_end_changes: (skip)
+ * @obj: An object implementing the group interface using this mixin
+ *
+ * End a batch of changes started by tp_group_mixin_begin_changes(). If this
+ * is the outermost batch, emit MembersChanged and MembersChangedDetailed
+ * for the net effect of the changes made during it, if any.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_group_mixin_end_changes (GObject *obj)
+{
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
+
+  g_return_if_fail (mixin != NULL);
+  g_return_if_fail (mixin->priv->batch_depth > 0);
+
+  if (--mixin->priv->batch_depth == 0)
+    flush_changes (obj);
+}
+
+/**
+ * tp_group_mixin_set_changes_timeout: (skip)
+ * @obj: An object implementing the group interface using this mixin
+ * @timeout_ms: a time in milliseconds, or 0
+ *
+ * If @timeout_ms is non-zero, changes made outside a batch started by
+ * tp_group_mixin_begin_changes() start a batch of their own, which ends
+ * @timeout_ms milliseconds after its first change. This lets membership
+ * changes that trickle in from the network be signalled together, at the
+ * cost of signalling them a little later.
+ *
+ * If @timeout_ms is 0, which is the default, changes made outside a batch
+ * are signalled immediately, and any changes still waiting for the timeout
+ * are signalled now.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_group_mixin_set_changes_timeout (GObject *obj,
+    guint timeout_ms)
+{
+  TpGroupMixin *mixin = TP_GROUP_MIXIN (obj);
+
+  g_return_if_fail (mixin != NULL);
+
+  mixin->priv->changes_timeout = timeout_ms;
+
+  if (timeout_ms == 0 && mixin->priv->batch_depth == 0)
+    flush_changes (obj);
+}
+
 /**
  * tp_group_mixin_add_handle_owner: (skip)
  * @obj: A GObject implementing the group interface with this mixin
@@ -1904,6 +2367,28 @@ add_us_mapping_for_owners_map (GHashTable *map,
     }
 }
 
+static void
+add_us_mapping_for_owners (GHashTable *map,
+    TpHandleRepoIface *repo,
+    TpGroupMixinPrivate *priv)
+{
+  TpIntsetFastIter iter;
+  TpHandle local_handle;
+
+  tp_intset_fast_iter_init (&iter, priv->owned_handles);
+  while (tp_intset_fast_iter_next (&iter, &local_handle))
+    {
+      TpHandle owner_handle = get_handle_owner (priv, local_handle);
+
+      g_hash_table_insert (map, GUINT_TO_POINTER (local_handle),
+          (gchar *) tp_handle_inspect (repo, local_handle));
+
+      if (owner_handle != 0)
+        g_hash_table_insert (map, GUINT_TO_POINTER (owner_handle),
+            (gchar *) tp_handle_inspect (repo, owner_handle));
+    }
+}
+
 static void
 add_handle_owners_helper (gpointer key,
                           gpointer value,
@@ -1914,7 +2399,7 @@ add_handle_owners_helper (gpointer key,
 
   g_return_if_fail (local_handle != 0);
 
-  g_hash_table_insert (mixin->priv->handle_owners, key, value);
+  set_handle_owner (mixin->priv, local_handle, GPOINTER_TO_UINT (value));
 }
 
 /**
@@ -1976,18 +2461,13 @@ remove_handle_owners_if_exist (GObject *obj,
   for (i = 0; i < array->len; i++)
     {
       TpHandle handle = g_array_index (array, guint, i);
-      gpointer local_handle, owner_handle;
 
       g_assert (handle != 0);
 
-      if (g_hash_table_lookup_extended (priv->handle_owners,
-                                        GUINT_TO_POINTER (handle),
-                                        &local_handle,
-                                        &owner_handle))
+      if (tp_intset_is_member (priv->owned_handles, handle))
         {
-          g_assert (GPOINTER_TO_UINT (local_handle) == handle);
           g_array_append_val (ret, handle);
-          g_hash_table_remove (priv->handle_owners, GUINT_TO_POINTER (handle));
+          unset_handle_owner (priv, handle);
         }
     }
 
@@ -2008,8 +2488,7 @@ dup_member_identifiers (GObject *obj)
   add_us_mapping_for_handleset (ret, mixin->handle_repo, mixin->local_pending);
   add_us_mapping_for_handleset (ret, mixin->handle_repo, mixin->remote_pending);
 
-  add_us_mapping_for_owners_map (ret, mixin->handle_repo,
-      mixin->priv->handle_owners);
+  add_us_mapping_for_owners (ret, mixin->handle_repo, mixin->priv);
 
   return ret;
 }
@@ -2111,7 +2590,7 @@ tp_group_mixin_get_dbus_property (GObject *object,
   else if (name == q[MIXIN_DP_HANDLE_OWNERS])
     {
       g_return_if_fail (G_VALUE_HOLDS (value, TP_HASH_TYPE_HANDLE_OWNER_MAP));
-      g_value_set_boxed (value, mixin->priv->handle_owners);
+      g_value_take_boxed (value, dup_handle_owners_table (mixin->priv));
     }
   else if (name == q[MIXIN_DP_LOCAL_PENDING_MEMBERS])
     {
@@ -2126,24 +2605,15 @@ tp_group_mixin_get_dbus_property (GObject *object,
     }
   else if (name == q[MIXIN_DP_MEMBERS])
     {
-      GArray *ret = NULL;
-      gboolean success;
-
       g_return_if_fail (G_VALUE_HOLDS_BOXED (value));
-      success = tp_group_mixin_get_members (object, &ret, NULL);
-      g_assert (success);     /* as of 0.7.8, cannot fail */
-      g_value_take_boxed (value, ret);
+      g_value_set_boxed (value, get_snapshot (mixin->members,
+            &mixin->priv->members_snapshot));
     }
   else if (name == q[MIXIN_DP_REMOTE_PENDING_MEMBERS])
     {
-      GArray *ret = NULL;
-      gboolean success;
-
       g_return_if_fail (G_VALUE_HOLDS_BOXED (value));
-      success = tp_group_mixin_get_remote_pending_members (object,
-          &ret, NULL);
-      g_assert (success);     /* as of 0.7.8, cannot fail */
-      g_value_take_boxed (value, ret);
+      g_value_set_boxed (value, get_snapshot (mixin->remote_pending,
+            &mixin->priv->remote_pending_snapshot));
     }
   else if (name == q[MIXIN_DP_SELF_HANDLE])
     {
@@ -28,6 +28,7 @@
 #define __TP_GROUP_MIXIN_H__
 
 #include <telepathy-glib/dbus-properties-mixin.h>
+#include <telepathy-glib/defs.h>
 #include <telepathy-glib/handle-repo.h>
 #include <telepathy-glib/svc-channel.h>
 #include <telepathy-glib/util.h>
@@ -215,6 +216,12 @@ gboolean tp_group_mixin_change_members_detailed (GObject *obj,
     const TpIntset *add, const TpIntset *del,
     const TpIntset *add_local_pending, const TpIntset *add_remote_pending,
     const GHashTable *details);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_group_mixin_begin_changes (GObject *obj);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_group_mixin_end_changes (GObject *obj);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_group_mixin_set_changes_timeout (GObject *obj, guint timeout_ms);
 void tp_group_mixin_change_self_handle (GObject *obj,
     TpHandle new_self_handle);
 
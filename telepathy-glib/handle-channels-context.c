@@ -56,6 +56,7 @@
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/proxy-internal.h>
 #include <telepathy-glib/util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_CLIENT
@@ -90,12 +91,8 @@ static guint signals[N_SIGNALS] = { 0 };
 struct _TpHandleChannelsContextPrivate
 {
   TpHandleChannelsContextState state;
-  GSimpleAsyncResult *result;
   DBusGMethodInvocation *dbus_context;
-
-  /* Number of calls we are waiting they return. Once they have all returned
-   * the context is considered as prepared */
-  guint num_pending;
+  gboolean preparing;
 };
 
 static void
@@ -161,12 +158,6 @@ tp_handle_channels_context_dispose (GObject *object)
       self->handler_info = NULL;
     }
 
-  if (self->priv->result != NULL)
-    {
-      g_object_unref (self->priv->result);
-      self->priv->result = NULL;
-    }
-
   if (dispose != NULL)
     dispose (object);
 }
@@ -538,144 +529,40 @@ _tp_handle_channels_context_get_state (
   return self->priv->state;
 }
 
-static gboolean
-context_is_prepared (TpHandleChannelsContext *self)
-{
-  return self->priv->num_pending == 0;
-}
-
-static void
-context_check_prepare (TpHandleChannelsContext *self)
-{
-  if (!context_is_prepared (self))
-    return;
-
-  /*  is prepared */
-  g_simple_async_result_complete (self->priv->result);
-
-  g_object_unref (self->priv->result);
-  self->priv->result = NULL;
-}
-
-static void
-account_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpHandleChannelsContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare account: %s", error->message);
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-conn_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpHandleChannelsContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare connection: %s", error->message);
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-hcc_channel_prepare_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
-{
-  TpHandleChannelsContext *self = user_data;
-  GError *error = NULL;
-
-  if (self->priv->result == NULL)
-    goto out;
-
-  if (!tp_proxy_prepare_finish (source, result, &error))
-    {
-      DEBUG ("Failed to prepare channel: %s", error->message);
-
-      g_error_free (error);
-    }
-
-  self->priv->num_pending--;
-  context_check_prepare (self);
-
-out:
-  g_object_unref (self);
-}
-
-static void
-context_prepare (TpHandleChannelsContext *self,
-    const GQuark *account_features,
-    const GQuark *connection_features,
-    const GQuark *channel_features)
-{
-  guint i;
-
-  self->priv->num_pending = 2;
-
-  tp_proxy_prepare_async (self->account, account_features,
-      account_prepare_cb, g_object_ref (self));
-
-  tp_proxy_prepare_async (self->connection, connection_features,
-      conn_prepare_cb, g_object_ref (self));
-
-  for (i = 0; i < self->channels->len; i++)
-    {
-      TpChannel *channel = g_ptr_array_index (self->channels, i);
-
-      self->priv->num_pending++;
-
-      tp_proxy_prepare_async (channel, channel_features,
-          hcc_channel_prepare_cb, g_object_ref (self));
-    }
-}
-
 void
 _tp_handle_channels_context_prepare_async (
     TpHandleChannelsContext *self,
     const GQuark *account_features,
     const GQuark *connection_features,
     const GQuark *channel_features,
+    guint timeout_ms,
     GAsyncReadyCallback callback,
     gpointer user_data)
 {
+  GSimpleAsyncResult *result;
+  TpProxyPrepareMany *prepare;
+  guint i;
+
   g_return_if_fail (TP_IS_HANDLE_CHANNELS_CONTEXT (self));
   /* This is only used once, by TpBaseClient, so for simplicity, we only
    * allow one asynchronous preparation */
-  g_return_if_fail (self->priv->result == NULL);
+  g_return_if_fail (!self->priv->preparing);
 
-  self->priv->result = g_simple_async_result_new (G_OBJECT (self),
+  self->priv->preparing = TRUE;
+  result = g_simple_async_result_new (G_OBJECT (self),
       callback, user_data, _tp_handle_channels_context_prepare_async);
+  prepare = _tp_proxy_prepare_many_new (result);
+  g_object_unref (result);
+
+  _tp_proxy_prepare_many_add (prepare, self->account, account_features);
+  _tp_proxy_prepare_many_add (prepare, self->connection,
+      connection_features);
+
+  for (i = 0; i < self->channels->len; i++)
+    _tp_proxy_prepare_many_add (prepare,
+        g_ptr_array_index (self->channels, i), channel_features);
 
-  context_prepare (self, account_features, connection_features,
-      channel_features);
+  _tp_proxy_prepare_many_start (prepare, timeout_ms);
 }
 
 gboolean
@@ -38,20 +38,33 @@
  * Most connection managers will use this for all supported handle types
  * except %TP_HANDLE_TYPE_LIST.
  *
+ * If the #TpDynamicHandleRepo:normalize-function is expensive and
+ * thread-safe, tp_dynamic_handle_repo_set_normalize_threaded() can be used
+ * to make tp_handle_ensure_async() run it in worker threads.
+ *
+ * Repositories expected to hold a very large number of handles, such as
+ * the members of many large chatrooms, can set the
+ * #TpDynamicHandleRepo:compact-storage property to reduce the memory used
+ * per handle.
+ *
  * Changed in 0.13.8: handles are no longer reference-counted, and
  * the reference-count-related functions are stubs. Instead, handles remain
- * valid until the handle repository is destroyed.
+ * valid until the handle repository is destroyed, unless
+ * tp_dynamic_handle_repo_set_reclaim_after() is used.
  */
 
 #include "config.h"
 
 #include <telepathy-glib/handle-repo-dynamic.h>
 
+#include <string.h>
+
 #include <dbus/dbus-glib.h>
 
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/heap.h>
 #include <telepathy-glib/handle-repo-internal.h>
+#include <telepathy-glib/util-internal.h>
 #include <telepathy-glib/util.h>
 
 #define DEBUG_FLAG TP_DEBUG_HANDLES
@@ -143,11 +156,77 @@ handle_priv_free_contents (TpHandlePriv *priv)
   g_datalist_clear (&(priv->datalist));
 }
 
+/* Handle reclamation: a handle is an index into handle_to_priv in the low
+ * bits, and the number of times that index has been reclaimed in the high
+ * bits, so that nobody can confuse a reclaimed handle with its
+ * replacement (at least until the generation wraps around) */
+
+#define RECLAIM_INDEX_BITS 24
+#define RECLAIM_INDEX_MASK ((1 << RECLAIM_INDEX_BITS) - 1)
+
+typedef struct {
+    /* number of tp_handle_pin() calls not yet matched by tp_handle_unpin() */
+    guint pins;
+    /* the sweep_epoch when this handle was last used or known to be
+     * pinned */
+    guint epoch;
+    /* the high bits of the handle currently or next using this index */
+    guint8 generation;
+} ReclaimSlot;
+
+/* Compact storage: identifiers are packed end to end into blocks of this
+ * size, and found via an open-addressing table of IdSlot */
+
+#define ARENA_BLOCK_SIZE 65536
+#define MIN_ID_SLOTS 64
+
+typedef struct {
+    guint hash;
+    /* 0 if the slot is empty; handles are never removed, so there are no
+     * tombstones */
+    TpHandle handle;
+} IdSlot;
+
+/* A tp_handle_ensure_async() call whose normalization is being done in a
+ * worker thread */
+typedef struct {
+    /* owned */
+    TpDynamicHandleRepo *self;
+    /* owned */
+    gchar *id;
+    gpointer context;
+    /* owned */
+    GSimpleAsyncResult *result;
+    /* set by the worker thread: exactly one is non-NULL afterwards */
+    gchar *normal_id;
+    GError *error;
+} NormalizeJob;
+
+/* An entry in the normalization cache, which is its own hash key */
+typedef struct {
+    /* owned, not normalized */
+    gchar *id;
+    gpointer context;
+    TpHandle handle;
+    /* in normalize_cache_lru; data points to the entry */
+    GList link;
+} NormalizeCacheEntry;
+
+static void
+datalist_holder_free (gpointer p)
+{
+  GData **holder = p;
+
+  g_datalist_clear (holder);
+  g_slice_free (GData *, holder);
+}
+
 enum
 {
   PROP_HANDLE_TYPE = 1,
   PROP_NORMALIZE_FUNCTION,
   PROP_DEFAULT_NORMALIZE_CONTEXT,
+  PROP_COMPACT_STORAGE,
 };
 
 /**
@@ -172,10 +251,45 @@ struct _TpDynamicHandleRepo {
 
   TpHandleType handle_type;
 
+  /* If FALSE, the default storage: */
   /* Array of TpHandlePriv keyed by handle; 0th element is unused */
   GArray *handle_to_priv;
   /* Map contact unique ID -> GUINT_TO_POINTER(handle) */
   GHashTable *string_to_handle;
+
+  /* If TRUE, compact storage: */
+  gboolean compact_storage;
+  /* Array of const gchar * pointing into arenas, keyed by handle; 0th
+   * element is unused */
+  GArray *handle_to_id;
+  /* Open-addressing table of IdSlot, with id_slots_mask + 1 entries */
+  IdSlot *id_slots;
+  guint id_slots_mask;
+  /* Blocks of packed, NUL-terminated unique IDs; the last block in
+   * ARENA_BLOCK_SIZE bytes is filled from arena_cursor onwards */
+  GPtrArray *arenas;
+  gchar *arena_cursor;
+  gsize arena_remaining;
+  /* Map GUINT_TO_POINTER(handle) -> owned GData **, only for handles
+   * that have ever had qdata */
+  GHashTable *handle_to_datalist;
+
+  /* If reclaiming handles (never with compact storage): */
+  /* Array of ReclaimSlot, keyed by the index part of the handle in
+   * parallel with handle_to_priv; or NULL if not reclaiming */
+  GArray *reclaim_slots;
+  /* Array of guint: indices in handle_to_priv that are free for reuse */
+  GArray *free_indices;
+  /* Set of borrowed TpHandleSet for this repo, whose members are pinned */
+  GHashTable *pinning_sets;
+  /* Map owned client unique name => owned TpHandleSet, for handles held
+   * with HoldHandles */
+  GHashTable *client_holds;
+  /* Incremented by each sweep */
+  guint sweep_epoch;
+  /* Timeout that sweeps, or 0 */
+  guint sweep_id;
+
   /* Normalization function */
   TpDynamicHandleRepoNormalizeFunc normalize_function;
   /* Context for normalization function if NULL is passed to _ensure or
@@ -191,6 +305,26 @@ struct _TpDynamicHandleRepo {
   /* Async normalization function */
   TpDynamicHandleRepoNormalizeAsync normalize_async;
   TpDynamicHandleRepoNormalizeFinish normalize_finish;
+
+  /* Threaded normalization, or NULL if not enabled */
+  GThreadPool *normalize_pool;
+  /* The main context in which to complete threaded normalizations */
+  GMainContext *normalize_context;
+  /* Protects normalized_jobs and normalized_idle_pending */
+  GMutex normalized_lock;
+  /* NormalizeJob whose worker has finished, oldest first */
+  GQueue normalized_jobs;
+  /* TRUE if an idle is attached to normalize_context to drain
+   * normalized_jobs */
+  gboolean normalized_idle_pending;
+
+  /* Set of NormalizeCacheEntry, or NULL if not caching */
+  GHashTable *normalize_cache;
+  /* The same entries, most recently used first */
+  GQueue normalize_cache_lru;
+  guint normalize_cache_max;
+  guint64 normalize_cache_hits;
+  guint64 normalize_cache_misses;
 };
 
 static void dynamic_repo_iface_init (gpointer g_iface,
@@ -204,25 +338,318 @@ static inline TpHandlePriv *
 handle_priv_lookup (TpDynamicHandleRepo *repo,
     TpHandle handle)
 {
-  if (handle == 0 || handle >= repo->handle_to_priv->len)
+  guint i = handle;
+
+  if (G_UNLIKELY (repo->reclaim_slots != NULL))
+    {
+      i = handle & RECLAIM_INDEX_MASK;
+
+      if (i >= repo->reclaim_slots->len ||
+          g_array_index (repo->reclaim_slots, ReclaimSlot, i).generation !=
+            handle >> RECLAIM_INDEX_BITS)
+        return NULL;
+    }
+
+  if (i == 0 || i >= repo->handle_to_priv->len)
+    return NULL;
+
+  return &g_array_index (repo->handle_to_priv, TpHandlePriv, i);
+}
+
+/* Return the ReclaimSlot for @handle, or NULL if @handle is not valid or
+ * handles are not reclaimed */
+static inline ReclaimSlot *
+reclaim_slot_lookup (TpDynamicHandleRepo *repo,
+    TpHandle handle)
+{
+  TpHandlePriv *priv;
+
+  if (G_LIKELY (repo->reclaim_slots == NULL))
+    return NULL;
+
+  priv = handle_priv_lookup (repo, handle);
+
+  if (priv == NULL || priv->string == NULL)
+    return NULL;
+
+  return &g_array_index (repo->reclaim_slots, ReclaimSlot,
+      handle & RECLAIM_INDEX_MASK);
+}
+
+/* Return the handle currently or next using index @i */
+static inline TpHandle
+reclaim_make_handle (TpDynamicHandleRepo *repo,
+    guint i)
+{
+  guint generation = g_array_index (repo->reclaim_slots, ReclaimSlot,
+      i).generation;
+
+  return i | (generation << RECLAIM_INDEX_BITS);
+}
+
+/* Note that @handle, which must be valid or 0, is still in use */
+static inline void
+reclaim_touch (TpDynamicHandleRepo *repo,
+    TpHandle handle)
+{
+  if (G_UNLIKELY (repo->reclaim_slots != NULL) && handle != 0)
+    g_array_index (repo->reclaim_slots, ReclaimSlot,
+        handle & RECLAIM_INDEX_MASK).epoch = repo->sweep_epoch;
+}
+
+static inline const gchar *
+compact_id_lookup (TpDynamicHandleRepo *repo,
+    TpHandle handle)
+{
+  if (handle == 0 || handle >= repo->handle_to_id->len)
     return NULL;
 
-  return &g_array_index (repo->handle_to_priv, TpHandlePriv, handle);
+  return g_array_index (repo->handle_to_id, const gchar *, handle);
+}
+
+/* Return the slot holding @id, or the empty slot where it would go */
+static IdSlot *
+compact_find_slot (TpDynamicHandleRepo *self,
+    const gchar *id,
+    guint hash)
+{
+  guint i = hash & self->id_slots_mask;
+
+  while (TRUE)
+    {
+      IdSlot *slot = self->id_slots + i;
+
+      if (slot->handle == 0)
+        return slot;
+
+      if (slot->hash == hash &&
+          !strcmp (g_array_index (self->handle_to_id, const gchar *,
+              slot->handle), id))
+        return slot;
+
+      i = (i + 1) & self->id_slots_mask;
+    }
+}
+
+static void
+compact_grow_slots (TpDynamicHandleRepo *self)
+{
+  IdSlot *old_slots = self->id_slots;
+  guint old_size = self->id_slots_mask + 1;
+  guint i;
+
+  self->id_slots_mask = old_size * 2 - 1;
+  self->id_slots = g_new0 (IdSlot, old_size * 2);
+
+  for (i = 0; i < old_size; i++)
+    {
+      guint j;
+
+      if (old_slots[i].handle == 0)
+        continue;
+
+      /* all IDs are distinct, so we only need to find a free slot */
+      for (j = old_slots[i].hash & self->id_slots_mask;
+          self->id_slots[j].handle != 0;
+          j = (j + 1) & self->id_slots_mask)
+        ;
+
+      self->id_slots[j] = old_slots[i];
+    }
+
+  g_free (old_slots);
+}
+
+/* Copy @id into the arenas, returning the copy */
+static const gchar *
+compact_intern (TpDynamicHandleRepo *self,
+    const gchar *id)
+{
+  gsize size = strlen (id) + 1;
+  gchar *ret;
+
+  if (size > self->arena_remaining)
+    {
+      /* don't waste the rest of the current block on an unusually long
+       * ID */
+      if (size > ARENA_BLOCK_SIZE / 4)
+        {
+          ret = g_memdup (id, size);
+          g_ptr_array_add (self->arenas, ret);
+          return ret;
+        }
+
+      self->arena_cursor = g_malloc (ARENA_BLOCK_SIZE);
+      self->arena_remaining = ARENA_BLOCK_SIZE;
+      g_ptr_array_add (self->arenas, self->arena_cursor);
+    }
+
+  ret = self->arena_cursor;
+  memcpy (ret, id, size);
+  self->arena_cursor += size;
+  self->arena_remaining -= size;
+  return ret;
+}
+
+/* Return the handle for @id, creating it if necessary. This does not
+ * allocate memory if the handle already exists. */
+static TpHandle
+compact_ensure (TpDynamicHandleRepo *self,
+    const gchar *id)
+{
+  guint hash = g_str_hash (id);
+  IdSlot *slot = compact_find_slot (self, id, hash);
+  const gchar *stored;
+
+  if (slot->handle != 0)
+    return slot->handle;
+
+  /* keep the load factor at most 3/4; handle_to_id->len is one more than
+   * the number of handles, because of the dummy 0'th entry */
+  if (self->handle_to_id->len * 4 > (self->id_slots_mask + 1) * 3)
+    {
+      compact_grow_slots (self);
+      slot = compact_find_slot (self, id, hash);
+    }
+
+  stored = compact_intern (self, id);
+  slot->hash = hash;
+  slot->handle = self->handle_to_id->len;
+  g_array_append_val (self->handle_to_id, stored);
+
+  return slot->handle;
+}
+
+static TpHandle
+find_handle (TpDynamicHandleRepo *self,
+    const gchar *id)
+{
+  if (self->compact_storage)
+    return compact_find_slot (self, id, g_str_hash (id))->handle;
+  else
+    return GPOINTER_TO_UINT (g_hash_table_lookup (self->string_to_handle,
+          id));
+}
+
+static const gchar *
+handle_get_id (TpDynamicHandleRepo *self,
+    TpHandle handle)
+{
+  if (self->compact_storage)
+    {
+      return compact_id_lookup (self, handle);
+    }
+  else
+    {
+      TpHandlePriv *priv = handle_priv_lookup (self, handle);
+
+      return (priv == NULL ? NULL : priv->string);
+    }
+}
+
+/* Return the datalist for @handle, which must be valid, or %NULL if it has
+ * none and @create is FALSE */
+static GData **
+handle_get_datalist (TpDynamicHandleRepo *self,
+    TpHandle handle,
+    gboolean create)
+{
+  GData **holder;
+
+  if (!self->compact_storage)
+    return &(handle_priv_lookup (self, handle)->datalist);
+
+  holder = g_hash_table_lookup (self->handle_to_datalist,
+      GUINT_TO_POINTER (handle));
+
+  if (holder == NULL && create)
+    {
+      holder = g_slice_new (GData *);
+      g_datalist_init (holder);
+      g_hash_table_insert (self->handle_to_datalist,
+          GUINT_TO_POINTER (handle), holder);
+    }
+
+  return holder;
 }
 
 static void
 tp_dynamic_handle_repo_init (TpDynamicHandleRepo *self)
 {
-  self->handle_to_priv = g_array_new (FALSE, FALSE, sizeof (TpHandlePriv));
-  /* dummy 0'th entry */
-  g_array_append_val (self->handle_to_priv, empty_priv);
+  g_mutex_init (&self->normalized_lock);
+  g_queue_init (&self->normalized_jobs);
+  g_queue_init (&self->normalize_cache_lru);
+}
+
+static void
+dynamic_trim (GObject *obj,
+    TpTrimLevel level)
+{
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (obj);
+  guint keep = 0;
+
+  if (self->normalize_cache == NULL)
+    return;
+
+  if (level == TP_TRIM_LEVEL_MODERATE)
+    keep = self->normalize_cache_lru.length / 2;
+
+  DEBUG ("%s repo: keeping %u of %u cached normalizations",
+      tp_handle_type_to_string (self->handle_type), keep,
+      self->normalize_cache_lru.length);
+
+  while (self->normalize_cache_lru.length > keep)
+    normalize_cache_evict_oldest (self);
+}
+
+static void
+dynamic_constructed (GObject *obj)
+{
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (obj);
+  void (*chain_up) (GObject *) =
+    G_OBJECT_CLASS (tp_dynamic_handle_repo_parent_class)->constructed;
+
+  if (chain_up != NULL)
+    chain_up (obj);
+
+  if (self->compact_storage)
+    {
+      const gchar *dummy = NULL;
+
+      self->handle_to_id = g_array_new (FALSE, FALSE, sizeof (const gchar *));
+      /* dummy 0'th entry */
+      g_array_append_val (self->handle_to_id, dummy);
+
+      self->id_slots_mask = MIN_ID_SLOTS - 1;
+      self->id_slots = g_new0 (IdSlot, MIN_ID_SLOTS);
+      self->arenas = g_ptr_array_new_with_free_func (g_free);
+      self->handle_to_datalist = g_hash_table_new_full (NULL, NULL, NULL,
+          datalist_holder_free);
+    }
+  else
+    {
+      self->handle_to_priv = g_array_new (FALSE, FALSE,
+          sizeof (TpHandlePriv));
+      /* dummy 0'th entry */
+      g_array_append_val (self->handle_to_priv, empty_priv);
+
+      self->string_to_handle = g_hash_table_new (g_str_hash, g_str_equal);
+    }
 
-  self->string_to_handle = g_hash_table_new (g_str_hash, g_str_equal);
+  _tp_register_trimmable (self, dynamic_trim);
 }
 
 static void
 dynamic_dispose (GObject *obj)
 {
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (obj);
+
+  if (self->sweep_id != 0)
+    {
+      g_source_remove (self->sweep_id);
+      self->sweep_id = 0;
+    }
+
   _tp_dynamic_handle_repo_set_normalization_data ((TpHandleRepoIface *) obj,
       NULL, NULL);
 
@@ -236,17 +663,62 @@ dynamic_finalize (GObject *obj)
   GObjectClass *parent = G_OBJECT_CLASS (tp_dynamic_handle_repo_parent_class);
   guint i;
 
-  g_assert (self->handle_to_priv != NULL);
-  g_assert (self->string_to_handle != NULL);
+  /* every pending job holds a ref, so there can't be any left */
+  g_assert (g_queue_is_empty (&self->normalized_jobs));
+
+  if (self->normalize_pool != NULL)
+    g_thread_pool_free (self->normalize_pool, FALSE, TRUE);
+
+  if (self->normalize_context != NULL)
+    g_main_context_unref (self->normalize_context);
+
+  g_mutex_clear (&self->normalized_lock);
+
+  if (self->normalize_cache != NULL)
+    g_hash_table_unref (self->normalize_cache);
+
+  if (self->reclaim_slots != NULL)
+    {
+      GHashTableIter iter;
+      gpointer set;
+
+      /* destroying our own sets removes them from pinning_sets */
+      g_hash_table_unref (self->client_holds);
+
+      /* any other sets outlive us, so must not tell us when they go */
+      g_hash_table_iter_init (&iter, self->pinning_sets);
+
+      while (g_hash_table_iter_next (&iter, &set, NULL))
+        _tp_handle_set_forget_repo (set);
+
+      g_hash_table_unref (self->pinning_sets);
+      g_array_unref (self->free_indices);
+      g_array_unref (self->reclaim_slots);
+    }
 
-  for (i = 0; i < self->handle_to_priv->len; i++)
+  if (self->compact_storage)
     {
-      handle_priv_free_contents (&g_array_index (self->handle_to_priv,
-            TpHandlePriv, i));
+      g_assert (self->handle_to_id != NULL);
+
+      g_hash_table_unref (self->handle_to_datalist);
+      g_array_unref (self->handle_to_id);
+      g_free (self->id_slots);
+      g_ptr_array_unref (self->arenas);
     }
+  else
+    {
+      g_assert (self->handle_to_priv != NULL);
+      g_assert (self->string_to_handle != NULL);
 
-  g_array_unref (self->handle_to_priv);
-  g_hash_table_unref (self->string_to_handle);
+      for (i = 0; i < self->handle_to_priv->len; i++)
+        {
+          handle_priv_free_contents (&g_array_index (self->handle_to_priv,
+                TpHandlePriv, i));
+        }
+
+      g_array_unref (self->handle_to_priv);
+      g_hash_table_unref (self->string_to_handle);
+    }
 
   if (parent->finalize)
     parent->finalize (obj);
@@ -271,6 +743,9 @@ dynamic_get_property (GObject *object,
     case PROP_DEFAULT_NORMALIZE_CONTEXT:
       g_value_set_pointer (value, self->default_normalize_context);
       break;
+    case PROP_COMPACT_STORAGE:
+      g_value_set_boolean (value, self->compact_storage);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -296,6 +771,9 @@ dynamic_set_property (GObject *object,
     case PROP_DEFAULT_NORMALIZE_CONTEXT:
       self->default_normalize_context = g_value_get_pointer (value);
       break;
+    case PROP_COMPACT_STORAGE:
+      self->compact_storage = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -308,6 +786,7 @@ tp_dynamic_handle_repo_class_init (TpDynamicHandleRepoClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GParamSpec *param_spec;
 
+  object_class->constructed = dynamic_constructed;
   object_class->dispose = dynamic_dispose;
   object_class->finalize = dynamic_finalize;
 
@@ -348,6 +827,29 @@ tp_dynamic_handle_repo_class_init (TpDynamicHandleRepoClass *klass)
       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   g_object_class_install_property (object_class,
       PROP_DEFAULT_NORMALIZE_CONTEXT, param_spec);
+
+  /**
+   * TpDynamicHandleRepo:compact-storage:
+   *
+   * If %TRUE, store the normalized identifiers packed together in large
+   * blocks, and index them with an open-addressing hash table, instead
+   * of allocating each one separately. This roughly halves the memory used
+   * per handle, and tp_handle_ensure() does not allocate memory for a
+   * handle that already exists unless the
+   * #TpDynamicHandleRepo:normalize-function does.
+   *
+   * This is intended for repositories that will hold hundreds of thousands
+   * of handles. The default is %FALSE.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_boolean ("compact-storage",
+      "Compact storage",
+      "If TRUE, pack handle IDs into large blocks to save memory",
+      FALSE,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class,
+      PROP_COMPACT_STORAGE, param_spec);
 }
 
 static gboolean
@@ -357,7 +859,7 @@ dynamic_handle_is_valid (TpHandleRepoIface *irepo,
 {
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
 
-  if (handle_priv_lookup (self, handle) == NULL)
+  if (handle_get_id (self, handle) == NULL)
     {
       g_set_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE,
           "handle %u is not currently a valid %s handle (type %u)",
@@ -396,33 +898,84 @@ dynamic_handles_are_valid (TpHandleRepoIface *irepo,
 }
 
 static void
-dynamic_unref_handle (TpHandleRepoIface *repo G_GNUC_UNUSED,
-    TpHandle handle G_GNUC_UNUSED)
+dynamic_unref_handle (TpHandleRepoIface *repo,
+    TpHandle handle)
 {
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
+  ReclaimSlot *slot = reclaim_slot_lookup (self, handle);
+
+  if (slot == NULL)
+    return;
+
+  g_return_if_fail (slot->pins > 0);
+
+  /* it gets a full grace period from now */
+  if (--slot->pins == 0)
+    slot->epoch = self->sweep_epoch;
 }
 
 static TpHandle
-dynamic_ref_handle (TpHandleRepoIface *repo G_GNUC_UNUSED,
+dynamic_ref_handle (TpHandleRepoIface *repo,
     TpHandle handle)
 {
+  ReclaimSlot *slot = reclaim_slot_lookup (TP_DYNAMIC_HANDLE_REPO (repo),
+      handle);
+
+  if (slot != NULL)
+    slot->pins++;
+
   return handle;
 }
 
 static gboolean
-dynamic_client_hold_handle (TpHandleRepoIface *repo G_GNUC_UNUSED,
-    const gchar *client_name G_GNUC_UNUSED,
-    TpHandle handle G_GNUC_UNUSED,
-    GError **error G_GNUC_UNUSED)
+dynamic_client_hold_handle (TpHandleRepoIface *repo,
+    const gchar *client_name,
+    TpHandle handle,
+    GError **error)
 {
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
+  TpHandleSet *held;
+
+  if (self->client_holds == NULL)
+    return TRUE;
+
+  if (!dynamic_handle_is_valid (repo, handle, error))
+    return FALSE;
+
+  held = g_hash_table_lookup (self->client_holds, client_name);
+
+  if (held == NULL)
+    {
+      held = tp_handle_set_new (repo);
+      g_hash_table_insert (self->client_holds, g_strdup (client_name), held);
+    }
+
+  tp_handle_set_add (held, handle);
   return TRUE;
 }
 
 static gboolean
-dynamic_client_release_handle (TpHandleRepoIface *repo G_GNUC_UNUSED,
-    const gchar *client_name G_GNUC_UNUSED,
-    TpHandle handle G_GNUC_UNUSED,
+dynamic_client_release_handle (TpHandleRepoIface *repo,
+    const gchar *client_name,
+    TpHandle handle,
     GError **error G_GNUC_UNUSED)
 {
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
+  TpHandleSet *held;
+
+  if (self->client_holds == NULL)
+    return TRUE;
+
+  held = g_hash_table_lookup (self->client_holds, client_name);
+
+  if (held != NULL && tp_handle_set_remove (held, handle))
+    {
+      reclaim_touch (self, handle);
+
+      if (tp_handle_set_is_empty (held))
+        g_hash_table_remove (self->client_holds, client_name);
+    }
+
   return TRUE;
 }
 
@@ -431,12 +984,8 @@ dynamic_inspect_handle (TpHandleRepoIface *irepo,
     TpHandle handle)
 {
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
-  TpHandlePriv *priv = handle_priv_lookup (self, handle);
 
-  if (priv == NULL)
-    return NULL;
-  else
-    return priv->string;
+  return handle_get_id (self, handle);
 }
 
 /**
@@ -460,42 +1009,9 @@ tp_dynamic_handle_repo_lookup_exact (TpHandleRepoIface *irepo,
     const char *id)
 {
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
+  TpHandle handle = find_handle (self, id);
 
-  return GPOINTER_TO_UINT (g_hash_table_lookup (self->string_to_handle, id));
-}
-
-static TpHandle
-dynamic_lookup_handle (TpHandleRepoIface *irepo,
-    const char *id,
-    gpointer context,
-    GError **error)
-{
-  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
-  TpHandle handle;
-  gchar *normal_id = NULL;
-
-  if (context == NULL)
-    context = self->default_normalize_context;
-
-  if (self->normalize_function)
-    {
-      normal_id = (self->normalize_function) (irepo, id, context, error);
-      if (normal_id == NULL)
-        return 0;
-      id = normal_id;
-    }
-
-  handle = GPOINTER_TO_UINT (g_hash_table_lookup (self->string_to_handle, id));
-
-  if (handle == 0)
-    {
-      g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
-          "no %s handle (type %u) currently exists for ID \"%s\"",
-          tp_handle_type_to_string (self->handle_type),
-          self->handle_type, id);
-    }
-
-  g_free (normal_id);
+  reclaim_touch (self, handle);
   return handle;
 }
 
@@ -506,67 +1022,345 @@ ensure_handle_take_normalized_id (TpDynamicHandleRepo *self,
   TpHandle handle;
   TpHandlePriv *priv;
 
+  if (self->compact_storage)
+    {
+      handle = compact_ensure (self, normal_id);
+      g_free (normal_id);
+      return handle;
+    }
+
   handle = GPOINTER_TO_UINT (g_hash_table_lookup (self->string_to_handle,
       normal_id));
 
   if (handle != 0)
     {
       g_free (normal_id);
+      reclaim_touch (self, handle);
       return handle;
     }
 
-  handle = self->handle_to_priv->len;
-  g_array_append_val (self->handle_to_priv, empty_priv);
-  priv = &g_array_index (self->handle_to_priv, TpHandlePriv, handle);
+  if (self->free_indices != NULL && self->free_indices->len > 0)
+    {
+      guint i = g_array_index (self->free_indices, guint,
+          self->free_indices->len - 1);
+
+      g_array_set_size (self->free_indices, self->free_indices->len - 1);
+      priv = &g_array_index (self->handle_to_priv, TpHandlePriv, i);
+      handle = reclaim_make_handle (self, i);
+    }
+  else
+    {
+      handle = self->handle_to_priv->len;
+      g_array_append_val (self->handle_to_priv, empty_priv);
+      priv = &g_array_index (self->handle_to_priv, TpHandlePriv, handle);
+
+      if (self->reclaim_slots != NULL)
+        {
+          ReclaimSlot slot = { 0, 0, 0 };
+
+          if (handle > RECLAIM_INDEX_MASK)
+            ERROR ("more than %u %s handles exist", RECLAIM_INDEX_MASK,
+                tp_handle_type_to_string (self->handle_type));
+
+          g_array_append_val (self->reclaim_slots, slot);
+        }
+    }
 
   handle_priv_init_take_string (priv, normal_id);
   g_hash_table_insert (self->string_to_handle, priv->string,
       GUINT_TO_POINTER (handle));
+  reclaim_touch (self, handle);
 
   return handle;
 }
 
+/* Return the handle for @id, which is already normalized, creating it if
+ * necessary. @id is only copied if a new handle is created. */
 static TpHandle
-dynamic_ensure_handle (TpHandleRepoIface *irepo,
-    const char *id,
-    gpointer context,
-    GError **error)
+ensure_handle_for_normalized_id (TpDynamicHandleRepo *self,
+    const gchar *id)
 {
-  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
-  gchar *normal_id;
+  TpHandle handle;
 
-  if (context == NULL)
-    context = self->default_normalize_context;
+  if (self->compact_storage)
+    return compact_ensure (self, id);
 
-  if (self->normalize_function)
-    {
-      normal_id = (self->normalize_function) (irepo, id, context, error);
-      if (normal_id == NULL)
-        return 0;
-    }
-  else
+  handle = find_handle (self, id);
+
+  if (handle != 0)
     {
-      normal_id = g_strdup (id);
+      reclaim_touch (self, handle);
+      return handle;
     }
 
-  return ensure_handle_take_normalized_id (self, normal_id);
+  return ensure_handle_take_normalized_id (self, g_strdup (id));
 }
 
-static void
-normalize_cb (GObject *source,
-    GAsyncResult *result,
-    gpointer user_data)
+static guint
+normalize_cache_entry_hash (gconstpointer p)
 {
-  TpDynamicHandleRepo *self = (TpDynamicHandleRepo *) source;
-  TpHandleRepoIface *repo = (TpHandleRepoIface *) self;
-  GSimpleAsyncResult *my_result = user_data;
-  gchar *normal_id;
-  GError *error = NULL;
+  const NormalizeCacheEntry *entry = p;
 
-  normal_id = self->normalize_finish (repo, result, &error);
-  if (normal_id == NULL)
-    {
-      g_simple_async_result_take_error (my_result, error);
+  return g_str_hash (entry->id) ^ g_direct_hash (entry->context);
+}
+
+static gboolean
+normalize_cache_entry_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const NormalizeCacheEntry *x = a, *y = b;
+
+  return x->context == y->context && !tp_strdiff (x->id, y->id);
+}
+
+static void
+normalize_cache_entry_free (gpointer p)
+{
+  NormalizeCacheEntry *entry = p;
+
+  g_free (entry->id);
+  g_slice_free (NormalizeCacheEntry, entry);
+}
+
+static void
+normalize_cache_evict_oldest (TpDynamicHandleRepo *self)
+{
+  GList *link = g_queue_peek_tail_link (&self->normalize_cache_lru);
+
+  g_queue_unlink (&self->normalize_cache_lru, link);
+  /* frees the entry, of which link is a member */
+  g_hash_table_remove (self->normalize_cache, link->data);
+}
+
+/* Return the cached handle for un-normalized @id in @context, or 0 */
+static TpHandle
+normalize_cache_lookup (TpDynamicHandleRepo *self,
+    const gchar *id,
+    gpointer context)
+{
+  NormalizeCacheEntry key = { (gchar *) id, context };
+  NormalizeCacheEntry *entry;
+
+  if (self->normalize_cache == NULL)
+    return 0;
+
+  entry = g_hash_table_lookup (self->normalize_cache, &key);
+
+  if (entry == NULL)
+    {
+      self->normalize_cache_misses++;
+      return 0;
+    }
+
+  self->normalize_cache_hits++;
+
+  /* move it to the most recently used end */
+  g_queue_unlink (&self->normalize_cache_lru, &entry->link);
+  g_queue_push_head_link (&self->normalize_cache_lru, &entry->link);
+
+  return entry->handle;
+}
+
+static void
+normalize_cache_insert (TpDynamicHandleRepo *self,
+    const gchar *id,
+    gpointer context,
+    TpHandle handle)
+{
+  NormalizeCacheEntry *entry;
+
+  if (self->normalize_cache == NULL)
+    return;
+
+  entry = g_slice_new0 (NormalizeCacheEntry);
+  entry->id = g_strdup (id);
+  entry->context = context;
+  entry->handle = handle;
+  entry->link.data = entry;
+
+  /* the same ID might have been inserted while we were normalizing it
+   * asynchronously */
+  if (g_hash_table_contains (self->normalize_cache, entry))
+    {
+      normalize_cache_entry_free (entry);
+      return;
+    }
+
+  g_hash_table_add (self->normalize_cache, entry);
+  g_queue_push_head_link (&self->normalize_cache_lru, &entry->link);
+
+  if (self->normalize_cache_lru.length > self->normalize_cache_max)
+    normalize_cache_evict_oldest (self);
+}
+
+static void
+set_not_available_error (TpDynamicHandleRepo *self,
+    const gchar *normal_id,
+    GError **error)
+{
+  g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+      "no %s handle (type %u) currently exists for ID \"%s\"",
+      tp_handle_type_to_string (self->handle_type),
+      self->handle_type, normal_id);
+}
+
+/* Normalize @id and return its handle, creating it if @create is TRUE.
+ * @context has already been replaced by the default if necessary. */
+static TpHandle
+normalize_to_handle (TpDynamicHandleRepo *self,
+    const gchar *id,
+    gpointer context,
+    gboolean create,
+    GError **error)
+{
+  gchar *normal_id;
+  TpHandle handle;
+
+  if (self->normalize_function == NULL)
+    {
+      if (create)
+        return ensure_handle_for_normalized_id (self, id);
+
+      handle = find_handle (self, id);
+
+      if (handle == 0)
+        set_not_available_error (self, id, error);
+
+      reclaim_touch (self, handle);
+      return handle;
+    }
+
+  handle = normalize_cache_lookup (self, id, context);
+
+  if (handle != 0)
+    {
+      reclaim_touch (self, handle);
+      return handle;
+    }
+
+  normal_id = (self->normalize_function) ((TpHandleRepoIface *) self, id,
+      context, error);
+
+  if (normal_id == NULL)
+    return 0;
+
+  if (create)
+    {
+      handle = ensure_handle_take_normalized_id (self, normal_id);
+    }
+  else
+    {
+      handle = find_handle (self, normal_id);
+
+      if (handle == 0)
+        set_not_available_error (self, normal_id, error);
+
+      reclaim_touch (self, handle);
+      g_free (normal_id);
+    }
+
+  if (handle != 0)
+    normalize_cache_insert (self, id, context, handle);
+
+  return handle;
+}
+
+static TpHandle
+dynamic_lookup_handle (TpHandleRepoIface *irepo,
+    const char *id,
+    gpointer context,
+    GError **error)
+{
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
+
+  if (context == NULL)
+    context = self->default_normalize_context;
+
+  return normalize_to_handle (self, id, context, FALSE, error);
+}
+
+static TpHandle
+dynamic_ensure_handle (TpHandleRepoIface *irepo,
+    const char *id,
+    gpointer context,
+    GError **error)
+{
+  TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (irepo);
+
+  if (context == NULL)
+    context = self->default_normalize_context;
+
+  return normalize_to_handle (self, id, context, TRUE, error);
+}
+
+static gboolean
+normalize_to_handles (TpDynamicHandleRepo *self,
+    const gchar * const *ids,
+    gpointer context,
+    gboolean create,
+    GArray *handles,
+    GError **error)
+{
+  guint base = handles->len;
+  guint i, n = g_strv_length ((GStrv) ids);
+
+  if (context == NULL)
+    context = self->default_normalize_context;
+
+  /* grow @handles once, rather than once per ID */
+  g_array_set_size (handles, base + n);
+
+  for (i = 0; i < n; i++)
+    {
+      TpHandle handle = normalize_to_handle (self, ids[i], context, create,
+          error);
+
+      if (handle == 0)
+        return FALSE;
+
+      g_array_index (handles, TpHandle, base + i) = handle;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+dynamic_ensure_handles (TpHandleRepoIface *irepo,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  return normalize_to_handles (TP_DYNAMIC_HANDLE_REPO (irepo), ids, context,
+      TRUE, handles, error);
+}
+
+static gboolean
+dynamic_lookup_handles (TpHandleRepoIface *irepo,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  return normalize_to_handles (TP_DYNAMIC_HANDLE_REPO (irepo), ids, context,
+      FALSE, handles, error);
+}
+
+static void
+normalize_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpDynamicHandleRepo *self = (TpDynamicHandleRepo *) source;
+  TpHandleRepoIface *repo = (TpHandleRepoIface *) self;
+  GSimpleAsyncResult *my_result = user_data;
+  gchar *normal_id;
+  GError *error = NULL;
+
+  normal_id = self->normalize_finish (repo, result, &error);
+  if (normal_id == NULL)
+    {
+      g_simple_async_result_take_error (my_result, error);
     }
   else
     {
@@ -581,6 +1375,97 @@ normalize_cb (GObject *source,
   g_object_unref (my_result);
 }
 
+/* Called in the normalize_context; completes every job the workers have
+ * finished since the last time */
+static gboolean
+normalized_idle_cb (gpointer user_data)
+{
+  TpDynamicHandleRepo *self = g_object_ref (user_data);
+  GQueue jobs;
+  NormalizeJob *job;
+
+  g_mutex_lock (&self->normalized_lock);
+  jobs = self->normalized_jobs;
+  g_queue_init (&self->normalized_jobs);
+  self->normalized_idle_pending = FALSE;
+  g_mutex_unlock (&self->normalized_lock);
+
+  while ((job = g_queue_pop_head (&jobs)) != NULL)
+    {
+      if (job->normal_id == NULL)
+        {
+          g_simple_async_result_take_error (job->result, job->error);
+        }
+      else
+        {
+          TpHandle handle;
+
+          handle = ensure_handle_take_normalized_id (self, job->normal_id);
+          normalize_cache_insert (self, job->id, job->context, handle);
+          g_simple_async_result_set_op_res_gpointer (job->result,
+              GUINT_TO_POINTER (handle), NULL);
+        }
+
+      g_simple_async_result_complete (job->result);
+      g_object_unref (job->result);
+      g_free (job->id);
+      g_object_unref (job->self);
+      g_slice_free (NormalizeJob, job);
+    }
+
+  g_object_unref (self);
+  return FALSE;
+}
+
+/* Called in a worker thread */
+static void
+normalize_thread_func (gpointer data,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  NormalizeJob *job = data;
+  TpDynamicHandleRepo *self = job->self;
+
+  job->normal_id = (self->normalize_function) ((TpHandleRepoIface *) self,
+      job->id, job->context, &job->error);
+
+  if (job->normal_id == NULL && job->error == NULL)
+    g_set_error (&job->error, TP_ERROR, TP_ERROR_INVALID_HANDLE,
+        "\"%s\" could not be normalized", job->id);
+
+  g_mutex_lock (&self->normalized_lock);
+
+  g_queue_push_tail (&self->normalized_jobs, job);
+
+  /* results that arrive while the idle is pending are coalesced into it */
+  if (!self->normalized_idle_pending)
+    {
+      GSource *source = _tp_idle_source_new (TP_LATENCY_CLASS_NORMAL);
+
+      g_source_set_callback (source, normalized_idle_cb, self, NULL);
+      g_source_attach (source, self->normalize_context);
+      g_source_unref (source);
+      self->normalized_idle_pending = TRUE;
+    }
+
+  g_mutex_unlock (&self->normalized_lock);
+}
+
+static gboolean
+can_normalize_threaded (TpDynamicHandleRepo *self)
+{
+  GMainContext *context;
+  gboolean ret;
+
+  if (self->normalize_pool == NULL || self->normalize_function == NULL)
+    return FALSE;
+
+  /* The GSimpleAsyncResult must be completed in the caller's context */
+  context = g_main_context_ref_thread_default ();
+  ret = (context == self->normalize_context);
+  g_main_context_unref (context);
+  return ret;
+}
+
 static void
 dynamic_ensure_handle_async (TpHandleRepoIface *repo,
     TpBaseConnection *connection,
@@ -592,6 +1477,38 @@ dynamic_ensure_handle_async (TpHandleRepoIface *repo,
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
   GSimpleAsyncResult *result;
 
+  if (self->normalize_async == NULL && can_normalize_threaded (self))
+    {
+      NormalizeJob *job;
+      TpHandle handle;
+
+      if (context == NULL)
+        context = self->default_normalize_context;
+
+      result = g_simple_async_result_new (G_OBJECT (repo), callback,
+          user_data, dynamic_ensure_handle_async);
+      handle = normalize_cache_lookup (self, id, context);
+
+      if (handle != 0)
+        {
+          reclaim_touch (self, handle);
+          g_simple_async_result_set_op_res_gpointer (result,
+              GUINT_TO_POINTER (handle), NULL);
+          g_simple_async_result_complete_in_idle (result);
+          g_object_unref (result);
+          return;
+        }
+
+      job = g_slice_new0 (NormalizeJob);
+      job->self = g_object_ref (self);
+      job->id = g_strdup (id);
+      job->context = context;
+      job->result = result;
+
+      g_thread_pool_push (self->normalize_pool, job, NULL);
+      return;
+    }
+
   if (self->normalize_async == NULL)
     {
       TpHandleRepoIfaceClass *klass;
@@ -617,11 +1534,16 @@ dynamic_set_qdata (TpHandleRepoIface *repo, TpHandle handle,
     GQuark key_id, gpointer data, GDestroyNotify destroy)
 {
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
-  TpHandlePriv *priv = handle_priv_lookup (self, handle);
+  GData **datalist;
 
-  g_return_if_fail (((void)"invalid handle", priv != NULL));
+  g_return_if_fail (((void)"invalid handle",
+        handle_get_id (self, handle) != NULL));
 
-  g_datalist_id_set_data_full (&priv->datalist, key_id, data, destroy);
+  datalist = handle_get_datalist (self, handle, data != NULL);
+
+  /* removing data from a handle that never had any is a no-op */
+  if (datalist != NULL)
+    g_datalist_id_set_data_full (datalist, key_id, data, destroy);
 }
 
 static gpointer
@@ -629,11 +1551,17 @@ dynamic_get_qdata (TpHandleRepoIface *repo, TpHandle handle,
     GQuark key_id)
 {
   TpDynamicHandleRepo *self = TP_DYNAMIC_HANDLE_REPO (repo);
-  TpHandlePriv *priv = handle_priv_lookup (self, handle);
+  GData **datalist;
+
+  g_return_val_if_fail (((void)"invalid handle",
+        handle_get_id (self, handle) != NULL), NULL);
 
-  g_return_val_if_fail (((void)"invalid handle", priv != NULL), NULL);
+  datalist = handle_get_datalist (self, handle, FALSE);
 
-  return g_datalist_id_get_data (&priv->datalist, key_id);
+  if (datalist == NULL)
+    return NULL;
+
+  return g_datalist_id_get_data (datalist, key_id);
 }
 
 static void
@@ -652,6 +1580,8 @@ dynamic_repo_iface_init (gpointer g_iface,
   klass->lookup_handle = dynamic_lookup_handle;
   klass->ensure_handle = dynamic_ensure_handle;
   klass->ensure_handle_async = dynamic_ensure_handle_async;
+  klass->ensure_handles = dynamic_ensure_handles;
+  klass->lookup_handles = dynamic_lookup_handles;
   klass->set_qdata = dynamic_set_qdata;
   klass->get_qdata = dynamic_get_qdata;
 }
@@ -705,6 +1635,27 @@ _tp_dynamic_handle_repo_set_normalization_data (TpHandleRepoIface *irepo,
   self->free_normalization_data = destroy;
 }
 
+/*
+ * _tp_handle_repo_has_async_normalization:
+ * @repo: a handle repository
+ *
+ * Returns: %TRUE if tp_handle_ensure_async() on @repo may give a different
+ *  result from tp_handle_ensure(), because it calls a
+ *  #TpDynamicHandleRepoNormalizeAsync, or is better than it because it
+ *  normalizes in a worker thread
+ */
+gboolean
+_tp_handle_repo_has_async_normalization (TpHandleRepoIface *repo)
+{
+  TpDynamicHandleRepo *self;
+
+  if (!TP_IS_DYNAMIC_HANDLE_REPO (repo))
+    return FALSE;
+
+  self = TP_DYNAMIC_HANDLE_REPO (repo);
+  return (self->normalize_async != NULL || can_normalize_threaded (self));
+}
+
 /**
  * tp_dynamic_handle_repo_set_normalize_async:
  * @self: A #TpDynamicHandleRepo
@@ -728,3 +1679,406 @@ tp_dynamic_handle_repo_set_normalize_async (TpDynamicHandleRepo *self,
   self->normalize_async = normalize_async;
   self->normalize_finish = normalize_finish;
 }
+
+/**
+ * tp_dynamic_handle_repo_set_normalize_threaded:
+ * @self: A #TpDynamicHandleRepo
+ * @max_threads: the maximum number of worker threads, or 0 to stop using
+ *  worker threads
+ *
+ * Make tp_handle_ensure_async() run the
+ * #TpDynamicHandleRepo:normalize-function in a pool of up to @max_threads
+ * worker threads, instead of in the main loop. Results are handed back to
+ * the thread-default main context of the caller of this function, where
+ * handles are created and the callbacks are called; results that finish
+ * close together are delivered in a single main loop iteration.
+ * tp_handle_ensure_async() calls made from any other main context are
+ * normalized synchronously, as before.
+ *
+ * This is useful if normalization is expensive, for instance stringprep
+ * for XMPP JIDs, and many handles are requested at once. The
+ * normalize-function must be thread-safe, and must not use @self or its
+ * normalization data while threaded normalization is enabled. This has no
+ * effect on repositories with a #TpDynamicHandleRepoNormalizeAsync, which
+ * takes precedence.
+ *
+ * If threaded normalization is disabled, normalizations that have
+ * already been queued still complete in the worker threads.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dynamic_handle_repo_set_normalize_threaded (TpDynamicHandleRepo *self,
+    guint max_threads)
+{
+  g_return_if_fail (TP_IS_DYNAMIC_HANDLE_REPO (self));
+
+  if (max_threads == 0)
+    {
+      if (self->normalize_pool != NULL)
+        {
+          g_thread_pool_free (self->normalize_pool, FALSE, TRUE);
+          self->normalize_pool = NULL;
+        }
+
+      g_clear_pointer (&self->normalize_context, g_main_context_unref);
+      return;
+    }
+
+  if (self->normalize_pool != NULL)
+    {
+      g_thread_pool_set_max_threads (self->normalize_pool, max_threads,
+          NULL);
+      return;
+    }
+
+  self->normalize_context = g_main_context_ref_thread_default ();
+  self->normalize_pool = g_thread_pool_new (normalize_thread_func, NULL,
+      max_threads, FALSE, NULL);
+}
+
+/**
+ * tp_dynamic_handle_repo_set_normalize_cache_size:
+ * @self: A #TpDynamicHandleRepo
+ * @max_entries: the maximum number of identifiers to remember, or 0 to
+ *  stop caching
+ *
+ * Remember the handles that the most recently used @max_entries
+ * un-normalized identifiers were normalized to, so that looking up the
+ * same identifier again in the same context does not call the
+ * #TpDynamicHandleRepo:normalize-function. This is useful when clients
+ * repeatedly use the same variants of identifiers, such as mixed-case JIDs
+ * or phone numbers without a country code.
+ *
+ * This is only correct if the normalize-function gives the same result for
+ * the same identifier and context every time. Only identifiers that were
+ * normalized successfully, and (for tp_handle_lookup()) had a handle, are
+ * remembered. Entries for handles that are reclaimed (see
+ * tp_dynamic_handle_repo_set_reclaim_after()) are discarded.
+ *
+ * Reducing @max_entries discards the least recently used entries. The
+ * counters returned by tp_dynamic_handle_repo_get_normalize_cache_stats()
+ * are not reset.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dynamic_handle_repo_set_normalize_cache_size (TpDynamicHandleRepo *self,
+    guint max_entries)
+{
+  g_return_if_fail (TP_IS_DYNAMIC_HANDLE_REPO (self));
+
+  self->normalize_cache_max = max_entries;
+
+  if (max_entries == 0)
+    {
+      /* entries don't own their links, so just forget them */
+      g_queue_init (&self->normalize_cache_lru);
+      g_clear_pointer (&self->normalize_cache, g_hash_table_unref);
+      return;
+    }
+
+  if (self->normalize_cache == NULL)
+    self->normalize_cache = g_hash_table_new_full (
+        normalize_cache_entry_hash, normalize_cache_entry_equal,
+        normalize_cache_entry_free, NULL);
+
+  while (self->normalize_cache_lru.length > max_entries)
+    normalize_cache_evict_oldest (self);
+}
+
+/**
+ * tp_dynamic_handle_repo_get_normalize_cache_stats:
+ * @self: A #TpDynamicHandleRepo
+ * @hits: (out) (allow-none): used to return the number of times a handle
+ *  was found in the normalization cache
+ * @misses: (out) (allow-none): used to return the number of times the
+ *  normalize-function had to be called although the cache was enabled
+ *
+ * Return statistics for the cache enabled by
+ * tp_dynamic_handle_repo_set_normalize_cache_size(), to help choose its
+ * size.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dynamic_handle_repo_get_normalize_cache_stats (TpDynamicHandleRepo *self,
+    guint64 *hits,
+    guint64 *misses)
+{
+  g_return_if_fail (TP_IS_DYNAMIC_HANDLE_REPO (self));
+
+  if (hits != NULL)
+    *hits = self->normalize_cache_hits;
+
+  if (misses != NULL)
+    *misses = self->normalize_cache_misses;
+}
+
+static void
+reclaim_index (TpDynamicHandleRepo *self,
+    guint i)
+{
+  TpHandlePriv *priv = &g_array_index (self->handle_to_priv, TpHandlePriv,
+      i);
+  ReclaimSlot *slot = &g_array_index (self->reclaim_slots, ReclaimSlot, i);
+
+  g_hash_table_remove (self->string_to_handle, priv->string);
+  handle_priv_free_contents (priv);
+  *priv = empty_priv;
+  slot->generation++;
+  g_array_append_val (self->free_indices, i);
+}
+
+/*
+ * _tp_dynamic_handle_repo_sweep:
+ * @repo: (type TelepathyGLib.DynamicHandleRepo): a #TpDynamicHandleRepo
+ *  which reclaims handles
+ *
+ * Reclaim every handle that has not been pinned, held or used since the
+ * previous call. This is called every grace period, and by tests.
+ */
+void
+_tp_dynamic_handle_repo_sweep (TpHandleRepoIface *repo)
+{
+  TpDynamicHandleRepo *self = (TpDynamicHandleRepo *) repo;
+  TpIntset *in_sets;
+  GHashTableIter iter;
+  gpointer set;
+  guint i, n_reclaimed = 0;
+
+  g_return_if_fail (TP_IS_DYNAMIC_HANDLE_REPO (self));
+  g_return_if_fail (self->reclaim_slots != NULL);
+
+  in_sets = tp_intset_new ();
+  g_hash_table_iter_init (&iter, self->pinning_sets);
+
+  while (g_hash_table_iter_next (&iter, &set, NULL))
+    tp_intset_union_update (in_sets, tp_handle_set_peek (set));
+
+  for (i = 1; i < self->handle_to_priv->len; i++)
+    {
+      ReclaimSlot *slot = &g_array_index (self->reclaim_slots, ReclaimSlot,
+          i);
+
+      if (g_array_index (self->handle_to_priv, TpHandlePriv, i).string ==
+          NULL)
+        continue;
+
+      /* if it stops being in use before the next sweep, it will still
+       * get a full grace period */
+      if (slot->pins > 0 ||
+          tp_intset_is_member (in_sets, reclaim_make_handle (self, i)))
+        {
+          slot->epoch = self->sweep_epoch + 1;
+          continue;
+        }
+
+      /* used since the last sweep */
+      if (slot->epoch == self->sweep_epoch)
+        continue;
+
+      reclaim_index (self, i);
+      n_reclaimed++;
+    }
+
+  tp_intset_destroy (in_sets);
+  self->sweep_epoch++;
+
+  if (n_reclaimed > 0 && self->normalize_cache != NULL)
+    {
+      GList *link, *next;
+
+      for (link = self->normalize_cache_lru.head; link != NULL; link = next)
+        {
+          NormalizeCacheEntry *entry = link->data;
+
+          next = link->next;
+
+          if (handle_get_id (self, entry->handle) == NULL)
+            {
+              g_queue_unlink (&self->normalize_cache_lru, link);
+              /* frees the entry, of which link is a member */
+              g_hash_table_remove (self->normalize_cache, entry);
+            }
+        }
+    }
+
+  DEBUG ("reclaimed %u %s handles, %u remain", n_reclaimed,
+      tp_handle_type_to_string (self->handle_type),
+      self->handle_to_priv->len - 1 - self->free_indices->len);
+}
+
+static gboolean
+sweep_cb (gpointer user_data)
+{
+  _tp_dynamic_handle_repo_sweep (user_data);
+  return TRUE;
+}
+
+/**
+ * tp_dynamic_handle_repo_set_reclaim_after:
+ * @self: A #TpDynamicHandleRepo
+ * @grace_period: the minimum number of seconds for which a handle must be
+ *  unused before it is reclaimed; must be positive
+ *
+ * Reclaim handles that are no longer in use, instead of keeping every
+ * handle until @self is destroyed. This is useful for connections that see
+ * a very large number of transient contacts over their lifetime, such as
+ * gateways to busy chatrooms.
+ *
+ * A handle is in use while any of these are true:
+ *
+ * <itemizedlist>
+ * <listitem>it is in a #TpHandleSet, such as the members of a
+ *  #TpGroupMixin or a #TpBaseContactList</listitem>
+ * <listitem>it has been pinned with tp_handle_pin(), as is done for the
+ *  self-handle of a #TpBaseConnection, the target and initiator of a
+ *  #TpBaseChannel and the sender of a #TpCMMessage</listitem>
+ * <listitem>a D-Bus client holds it with HoldHandles, and has neither
+ *  released it nor exited</listitem>
+ * </itemizedlist>
+ *
+ * Any other handle is reclaimed once it has not been in use, nor returned by
+ * tp_handle_ensure(), tp_handle_lookup() and similar functions, for between
+ * @grace_period and twice @grace_period seconds. Its qdata is freed, and if
+ * the same identifier is used again, a new handle is made for it.
+ *
+ * A reclaimed handle's number is eventually reused, but its upper 8 bits
+ * change each time, so a client that keeps a stale handle gets an
+ * InvalidHandle error instead of the wrong contact for at least the next
+ * 255 reuses. At most 2<superscript>24</superscript>-1 handles can exist at
+ * any time.
+ *
+ * This must be called before any handles or #TpHandleSet<!-- -->s are
+ * created in @self, and cannot be used with
+ * #TpDynamicHandleRepo:compact-storage. Calling it again changes the grace
+ * period; reclaiming cannot be turned off.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_dynamic_handle_repo_set_reclaim_after (TpDynamicHandleRepo *self,
+    guint grace_period)
+{
+  g_return_if_fail (TP_IS_DYNAMIC_HANDLE_REPO (self));
+  g_return_if_fail (grace_period > 0);
+  g_return_if_fail (!self->compact_storage);
+  g_return_if_fail (self->reclaim_slots != NULL ||
+      self->handle_to_priv->len == 1);
+
+  if (self->reclaim_slots == NULL)
+    {
+      ReclaimSlot dummy = { 0, 0, 0 };
+
+      self->reclaim_slots = g_array_new (FALSE, FALSE, sizeof (ReclaimSlot));
+      /* dummy 0'th entry */
+      g_array_append_val (self->reclaim_slots, dummy);
+      self->free_indices = g_array_new (FALSE, FALSE, sizeof (guint));
+      self->pinning_sets = g_hash_table_new (NULL, NULL);
+      self->client_holds = g_hash_table_new_full (g_str_hash, g_str_equal,
+          g_free, (GDestroyNotify) tp_handle_set_destroy);
+    }
+
+  if (self->sweep_id != 0)
+    g_source_remove (self->sweep_id);
+
+  self->sweep_id = g_timeout_add_seconds (grace_period, sweep_cb, self);
+}
+
+/*
+ * _tp_dynamic_handle_repo_is_reclaiming:
+ * @repo: a handle repository
+ *
+ * Returns: %TRUE if @repo is a #TpDynamicHandleRepo on which
+ *  tp_dynamic_handle_repo_set_reclaim_after() has been called
+ */
+gboolean
+_tp_dynamic_handle_repo_is_reclaiming (TpHandleRepoIface *repo)
+{
+  return (TP_IS_DYNAMIC_HANDLE_REPO (repo) &&
+      ((TpDynamicHandleRepo *) repo)->reclaim_slots != NULL);
+}
+
+/*
+ * _tp_dynamic_handle_repo_forget_client:
+ * @repo: a handle repository
+ * @client: the unique name of a D-Bus client which has exited
+ *
+ * Release every handle that @client held, if @repo reclaims handles.
+ */
+void
+_tp_dynamic_handle_repo_forget_client (TpHandleRepoIface *repo,
+    const gchar *client)
+{
+  TpDynamicHandleRepo *self;
+  TpHandleSet *held;
+  TpIntsetFastIter iter;
+  TpHandle handle;
+
+  if (!_tp_dynamic_handle_repo_is_reclaiming (repo))
+    return;
+
+  self = (TpDynamicHandleRepo *) repo;
+  held = g_hash_table_lookup (self->client_holds, client);
+
+  if (held == NULL)
+    return;
+
+  tp_intset_fast_iter_init (&iter, tp_handle_set_peek (held));
+
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    reclaim_touch (self, handle);
+
+  g_hash_table_remove (self->client_holds, client);
+}
+
+/*
+ * _tp_dynamic_handle_repo_track_set:
+ * @repo: the repository of @set
+ * @set: a new handle set
+ *
+ * Returns: %TRUE if @repo will not reclaim any handles while they are in
+ *  @set, in which case _tp_dynamic_handle_repo_untrack_set() must be called
+ *  when @set is destroyed
+ */
+gboolean
+_tp_dynamic_handle_repo_track_set (TpHandleRepoIface *repo,
+    TpHandleSet *set)
+{
+  if (!_tp_dynamic_handle_repo_is_reclaiming (repo))
+    return FALSE;
+
+  g_hash_table_add (((TpDynamicHandleRepo *) repo)->pinning_sets, set);
+  return TRUE;
+}
+
+/*
+ * _tp_dynamic_handle_repo_untrack_set:
+ * @repo: the repository of @set
+ * @set: a handle set for which _tp_dynamic_handle_repo_track_set()
+ *  returned %TRUE
+ *
+ * Stop pinning the members of @set, which is being destroyed.
+ */
+void
+_tp_dynamic_handle_repo_untrack_set (TpHandleRepoIface *repo,
+    TpHandleSet *set)
+{
+  TpDynamicHandleRepo *self = (TpDynamicHandleRepo *) repo;
+  TpIntsetFastIter iter;
+  TpHandle handle;
+
+  /* its members get a full grace period from now */
+  tp_intset_fast_iter_init (&iter, tp_handle_set_peek (set));
+
+  while (tp_intset_fast_iter_next (&iter, &handle))
+    {
+      ReclaimSlot *slot = reclaim_slot_lookup (self, handle);
+
+      if (slot != NULL)
+        slot->epoch = self->sweep_epoch;
+    }
+
+  g_hash_table_remove (self->pinning_sets, set);
+}
@@ -91,6 +91,24 @@ void tp_dynamic_handle_repo_set_normalize_async (TpDynamicHandleRepo *self,
     TpDynamicHandleRepoNormalizeAsync normalize_async,
     TpDynamicHandleRepoNormalizeFinish normalize_finish);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dynamic_handle_repo_set_normalize_threaded (TpDynamicHandleRepo *self,
+    guint max_threads);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dynamic_handle_repo_set_normalize_cache_size (
+    TpDynamicHandleRepo *self,
+    guint max_entries);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dynamic_handle_repo_get_normalize_cache_stats (
+    TpDynamicHandleRepo *self,
+    guint64 *hits,
+    guint64 *misses);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_dynamic_handle_repo_set_reclaim_after (TpDynamicHandleRepo *self,
+    guint grace_period);
+
 G_END_DECLS
 
 #endif
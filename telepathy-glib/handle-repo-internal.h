@@ -37,21 +37,25 @@ typedef struct _TpHandleRepoIfaceClass TpHandleRepoIfaceInterface;
  * @parent_class: Fields shared with GTypeInterface
  * @handle_is_valid: Implementation for tp_handle_is_valid() for this repo
  * @handles_are_valid: Implementation for tp_handles_are_valid() for this repo
- * @ref_handle: Implementation for tp_handle_ref() for this repo
- * @unref_handle: Implementation for tp_handle_unref() for this repo
- * @client_hold_handle: Implementation for tp_handle_client_hold() for this
- *  repo
- * @client_release_handle: Implementation for tp_handle_client_release() for
- *  this repo
+ * @ref_handle: Implementation for tp_handle_pin() for this repo
+ * @unref_handle: Implementation for tp_handle_unpin() for this repo
+ * @client_hold_handle: Implementation for HoldHandles for this repo
+ * @client_release_handle: Implementation for ReleaseHandles for this repo
  * @inspect_handle: Implementation for tp_handle_inspect() for this repo
  * @ensure_handle: Implementation for tp_handle_ensure() for this repo
  * @lookup_handle: Implementation for tp_handle_lookup() for this repo
+ * @ensure_handles: Implementation for tp_handle_ensure_many() for this repo,
+ *  which may append some handles to the array before failing
+ * @lookup_handles: Implementation for tp_handle_lookup_many() for this repo,
+ *  likewise
  * @get_qdata: Implementation for tp_handle_get_qdata() for this repo
  * @set_qdata: Implementation for tp_handle_set_qdata() for this repo
  *
  * The class of a #TpHandleRepoIface. All implementation callbacks must be
  * filled in by all implementations, and have the same semantics as the
- * global function that calls them.
+ * global function that calls them, except that @ensure_handle_async,
+ * @ensure_handle_finish, @ensure_handles and @lookup_handles have default
+ * implementations in terms of the single-handle callbacks.
  */
 struct _TpHandleRepoIfaceClass {
     GTypeInterface parent_class;
@@ -88,6 +92,13 @@ struct _TpHandleRepoIfaceClass {
         GQuark key_id, gpointer data, GDestroyNotify destroy);
     gpointer (*get_qdata) (TpHandleRepoIface *repo, TpHandle handle,
         GQuark key_id);
+
+    gboolean (*ensure_handles) (TpHandleRepoIface *self,
+        const gchar * const *ids, gpointer context, GArray *handles,
+        GError **error);
+    gboolean (*lookup_handles) (TpHandleRepoIface *self,
+        const gchar * const *ids, gpointer context, GArray *handles,
+        GError **error);
 };
 
 gpointer _tp_dynamic_handle_repo_get_normalization_data (
@@ -96,6 +107,30 @@ void _tp_dynamic_handle_repo_set_normalization_data (TpHandleRepoIface *irepo,
     gpointer data,
     GDestroyNotify destroy);
 
+gboolean _tp_handle_repo_has_async_normalization (TpHandleRepoIface *repo);
+
+void _tp_handle_repo_client_hold (TpHandleRepoIface *repo,
+    const gchar *client,
+    const GArray *handles);
+void _tp_handle_repo_client_release (TpHandleRepoIface *repo,
+    const gchar *client,
+    const GArray *handles);
+
+gboolean _tp_dynamic_handle_repo_is_reclaiming (TpHandleRepoIface *repo);
+void _tp_dynamic_handle_repo_forget_client (TpHandleRepoIface *repo,
+    const gchar *client);
+gboolean _tp_dynamic_handle_repo_track_set (TpHandleRepoIface *repo,
+    TpHandleSet *set);
+void _tp_dynamic_handle_repo_untrack_set (TpHandleRepoIface *repo,
+    TpHandleSet *set);
+void _tp_dynamic_handle_repo_sweep (TpHandleRepoIface *repo);
+
+void _tp_handle_set_forget_repo (TpHandleSet *set);
+
+void _tp_handle_repo_add_identifiers (TpHandleRepoIface *repo,
+    const TpIntset *handles,
+    GHashTable *map);
+
 G_END_DECLS
 
 #endif /*__TP_INTERNAL_HANDLE_REPO_H__ */
@@ -63,6 +63,8 @@ struct _TpStaticHandleRepo {
   TpHandleType handle_type;
   TpHandle last_handle;
   gchar **handle_names;
+  /* borrowed name from @handle_names => GUINT_TO_POINTER (handle) */
+  GHashTable *index;
   GData **datalists;
 };
 
@@ -79,6 +81,7 @@ tp_static_handle_repo_init (TpStaticHandleRepo *self)
   self->handle_type = 0;
   self->last_handle = 0;
   self->handle_names = NULL;
+  self->index = NULL;
   self->datalists = NULL;
 }
 
@@ -96,6 +99,9 @@ static_finalize (GObject *object)
         }
     }
 
+  if (self->index != NULL)
+    g_hash_table_unref (self->index);
+
   g_strfreev (self->handle_names);
 
   G_OBJECT_CLASS (tp_static_handle_repo_parent_class)->finalize (object);
@@ -148,11 +154,21 @@ static_set_property (GObject *object,
             }
         }
 
+      if (self->index != NULL)
+        g_hash_table_unref (self->index);
+
       g_strfreev (self->handle_names);
       self->handle_names = g_strdupv (g_value_get_boxed (value));
+      self->index = g_hash_table_new (g_str_hash, g_str_equal);
       i = 0;
       while (self->handle_names[i] != NULL)
         {
+          /* if a name is repeated, the first handle wins, as it did when
+           * this was a linear search */
+          if (!g_hash_table_contains (self->index, self->handle_names[i]))
+            g_hash_table_insert (self->index, self->handle_names[i],
+                GUINT_TO_POINTER (i + 1));
+
           i++;
         }
       self->last_handle = i;
@@ -273,12 +289,14 @@ static_lookup_handle (TpHandleRepoIface *irepo,
                       GError **error)
 {
   TpStaticHandleRepo *self = TP_STATIC_HANDLE_REPO (irepo);
-  guint i;
 
-  for (i = 0; i < self->last_handle; i++)
+  if (id != NULL && self->index != NULL)
     {
-      if (!tp_strdiff (self->handle_names[i], id))
-        return (TpHandle) i + 1;
+      TpHandle handle = GPOINTER_TO_UINT (g_hash_table_lookup (self->index,
+            id));
+
+      if (handle != 0)
+        return handle;
     }
 
   g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
@@ -286,6 +304,28 @@ static_lookup_handle (TpHandleRepoIface *irepo,
   return 0;
 }
 
+static gboolean
+static_lookup_handles (TpHandleRepoIface *irepo,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  guint i;
+
+  for (i = 0; ids[i] != NULL; i++)
+    {
+      TpHandle handle = static_lookup_handle (irepo, ids[i], context, error);
+
+      if (handle == 0)
+        return FALSE;
+
+      g_array_append_val (handles, handle);
+    }
+
+  return TRUE;
+}
+
 
 static void
 static_set_qdata (TpHandleRepoIface *repo, TpHandle handle,
@@ -343,6 +383,8 @@ static_repo_iface_init (gpointer g_iface,
   /* this repo is static, so lookup and ensure are identical */
   klass->lookup_handle = static_lookup_handle;
   klass->ensure_handle = static_lookup_handle;
+  klass->lookup_handles = static_lookup_handles;
+  klass->ensure_handles = static_lookup_handles;
   klass->set_qdata = static_set_qdata;
   klass->get_qdata = static_get_qdata;
 }
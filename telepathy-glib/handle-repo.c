@@ -279,6 +279,87 @@ tp_handle_inspect (TpHandleRepoIface *self,
 }
 
 
+/**
+ * tp_handle_pin:
+ * @self: A handle repository implementation
+ * @handle: A handle of the type stored in the repository
+ *
+ * Keep @handle valid until a matching call to tp_handle_unpin(), even if
+ * @self reclaims handles that are no longer in use, as described for
+ * tp_dynamic_handle_repo_set_reclaim_after(). Handles that are members of
+ * a #TpHandleSet do not need to be pinned.
+ *
+ * This does nothing if @self does not reclaim handles, which is the
+ * default.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_handle_pin (TpHandleRepoIface *self,
+    TpHandle handle)
+{
+  TP_HANDLE_REPO_IFACE_GET_CLASS (self)->ref_handle (self, handle);
+}
+
+/**
+ * tp_handle_unpin:
+ * @self: A handle repository implementation
+ * @handle: A handle of the type stored in the repository
+ *
+ * Release a pin taken with tp_handle_pin().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_handle_unpin (TpHandleRepoIface *self,
+    TpHandle handle)
+{
+  TP_HANDLE_REPO_IFACE_GET_CLASS (self)->unref_handle (self, handle);
+}
+
+/*
+ * _tp_handle_repo_client_hold:
+ * @repo: A handle repository implementation
+ * @client: the unique name of a D-Bus client
+ * @handles: valid handles of the type stored in the repository
+ *
+ * Record that @client called HoldHandles on @handles.
+ */
+void
+_tp_handle_repo_client_hold (TpHandleRepoIface *repo,
+    const gchar *client,
+    const GArray *handles)
+{
+  TpHandleRepoIfaceClass *klass = TP_HANDLE_REPO_IFACE_GET_CLASS (repo);
+  guint i;
+
+  for (i = 0; i < handles->len; i++)
+    klass->client_hold_handle (repo, client,
+        g_array_index (handles, TpHandle, i), NULL);
+}
+
+/*
+ * _tp_handle_repo_client_release:
+ * @repo: A handle repository implementation
+ * @client: the unique name of a D-Bus client
+ * @handles: valid handles of the type stored in the repository
+ *
+ * Record that @client called ReleaseHandles on @handles.
+ */
+void
+_tp_handle_repo_client_release (TpHandleRepoIface *repo,
+    const gchar *client,
+    const GArray *handles)
+{
+  TpHandleRepoIfaceClass *klass = TP_HANDLE_REPO_IFACE_GET_CLASS (repo);
+  guint i;
+
+  for (i = 0; i < handles->len; i++)
+    klass->client_release_handle (repo, client,
+        g_array_index (handles, TpHandle, i), NULL);
+}
+
+
 /**
  * tp_handle_ensure:
  * @self: A handle repository implementation
@@ -377,6 +458,98 @@ tp_handle_lookup (TpHandleRepoIface *self,
       id, context, error);
 }
 
+/**
+ * tp_handle_ensure_many: (skip)
+ * @self: A handle repository implementation
+ * @ids: (array zero-terminated=1): strings whose handles are required
+ * @context: User data to be passed to the normalization callback
+ * @handles: (element-type TpHandle): an array to which the handles will be
+ *  appended
+ * @error: Used to return an error if %FALSE is returned
+ *
+ * Append a handle for each of @ids to @handles, in the same order,
+ * creating them if necessary. This is equivalent to calling
+ * tp_handle_ensure() on each string, but implementations can do it more
+ * efficiently.
+ *
+ * If any of @ids is invalid, @handles is left as it was (although handles
+ * may have been created for some of the other strings) and %FALSE is
+ * returned.
+ *
+ * Returns: %TRUE if a handle was appended for every string in @ids
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_handle_ensure_many (TpHandleRepoIface *self,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  guint old_len;
+
+  g_return_val_if_fail (TP_IS_HANDLE_REPO_IFACE (self), FALSE);
+  g_return_val_if_fail (ids != NULL, FALSE);
+  g_return_val_if_fail (handles != NULL, FALSE);
+
+  old_len = handles->len;
+
+  if (!TP_HANDLE_REPO_IFACE_GET_CLASS (self)->ensure_handles (self,
+        ids, context, handles, error))
+    {
+      g_array_set_size (handles, old_len);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * tp_handle_lookup_many: (skip)
+ * @self: A handle repository implementation
+ * @ids: (array zero-terminated=1): strings whose handles are required
+ * @context: User data to be passed to the normalization callback
+ * @handles: (element-type TpHandle): an array to which the handles will be
+ *  appended
+ * @error: Used to raise an error if %FALSE is returned
+ *
+ * Append the handle for each of @ids to @handles, in the same order,
+ * without creating any. This is equivalent to calling tp_handle_lookup()
+ * on each string, but implementations can do it more efficiently.
+ *
+ * If any of @ids is invalid or has no handle, @handles is left as it was
+ * and %FALSE is returned.
+ *
+ * Returns: %TRUE if a handle was appended for every string in @ids
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_handle_lookup_many (TpHandleRepoIface *self,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  guint old_len;
+
+  g_return_val_if_fail (TP_IS_HANDLE_REPO_IFACE (self), FALSE);
+  g_return_val_if_fail (ids != NULL, FALSE);
+  g_return_val_if_fail (handles != NULL, FALSE);
+
+  old_len = handles->len;
+
+  if (!TP_HANDLE_REPO_IFACE_GET_CLASS (self)->lookup_handles (self,
+        ids, context, handles, error))
+    {
+      g_array_set_size (handles, old_len);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 
 /**
  * tp_handle_set_qdata: (skip)
@@ -478,6 +651,50 @@ default_ensure_handle_finish (TpHandleRepoIface *self,
   return GPOINTER_TO_UINT (g_simple_async_result_get_op_res_gpointer (simple));
 }
 
+static gboolean
+default_ensure_handles (TpHandleRepoIface *self,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  guint i;
+
+  for (i = 0; ids[i] != NULL; i++)
+    {
+      TpHandle handle = tp_handle_ensure (self, ids[i], context, error);
+
+      if (handle == 0)
+        return FALSE;
+
+      g_array_append_val (handles, handle);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+default_lookup_handles (TpHandleRepoIface *self,
+    const gchar * const *ids,
+    gpointer context,
+    GArray *handles,
+    GError **error)
+{
+  guint i;
+
+  for (i = 0; ids[i] != NULL; i++)
+    {
+      TpHandle handle = tp_handle_lookup (self, ids[i], context, error);
+
+      if (handle == 0)
+        return FALSE;
+
+      g_array_append_val (handles, handle);
+    }
+
+  return TRUE;
+}
+
 static void
 tp_handle_repo_iface_default_init (TpHandleRepoIfaceInterface *iface)
 {
@@ -485,6 +702,8 @@ tp_handle_repo_iface_default_init (TpHandleRepoIfaceInterface *iface)
 
   iface->ensure_handle_async = default_ensure_handle_async;
   iface->ensure_handle_finish = default_ensure_handle_finish;
+  iface->ensure_handles = default_ensure_handles;
+  iface->lookup_handles = default_lookup_handles;
 
   param_spec = g_param_spec_uint ("handle-type", "Handle type",
       "The TpHandleType held in this handle repository.",
@@ -120,6 +120,20 @@ TpHandle tp_handle_ensure (TpHandleRepoIface *self,
     const gchar *id, gpointer context, GError **error)
     G_GNUC_WARN_UNUSED_RESULT;
 
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_handle_lookup_many (TpHandleRepoIface *self,
+    const gchar * const *ids, gpointer context, GArray *handles,
+    GError **error);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_handle_ensure_many (TpHandleRepoIface *self,
+    const gchar * const *ids, gpointer context, GArray *handles,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_handle_pin (TpHandleRepoIface *self, TpHandle handle);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_handle_unpin (TpHandleRepoIface *self, TpHandle handle);
+
 _TP_AVAILABLE_IN_0_20
 void tp_handle_ensure_async (TpHandleRepoIface *self,
     TpBaseConnection *connection,
@@ -175,6 +189,12 @@ GHashTable *tp_handle_set_to_identifier_map (TpHandleSet *self)
     G_GNUC_WARN_UNUSED_RESULT;
 TpHandleSet *tp_handle_set_new_from_array (TpHandleRepoIface *repo,
     const GArray *array) G_GNUC_WARN_UNUSED_RESULT;
+_TP_AVAILABLE_IN_UNRELEASED
+TpHandleSet *tp_handle_set_new_from_sorted (TpHandleRepoIface *repo,
+    const TpHandle *handles, guint n_handles) G_GNUC_WARN_UNUSED_RESULT;
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_handle_set_to_buffer (const TpHandleSet *set, TpHandle *buffer,
+    guint n_handles);
 
 TpIntset *tp_handle_set_update (TpHandleSet *set, const TpIntset *add)
   G_GNUC_WARN_UNUSED_RESULT;
@@ -29,22 +29,56 @@
 
 #include <glib.h>
 
+#include <telepathy-glib/handle-repo-internal.h>
 #include <telepathy-glib/intset.h>
 #define DEBUG_FLAG TP_DEBUG_HANDLES
 #include "debug-internal.h"
+#include "util-internal.h"
 
 /**
  * TpHandleSet:
  *
  * A set of handles. This is similar to a #TpIntset (and implemented using
- * one), but adding a handle to the set also references it.
+ * one), but if its repository reclaims handles (see
+ * tp_dynamic_handle_repo_set_reclaim_after()), handles in the set are
+ * never reclaimed.
  */
 struct _TpHandleSet
 {
   TpHandleRepoIface *repo;
   TpIntset *intset;
+  /* TRUE if @repo reclaims handles, and so needs to know which sets
+   * exist */
+  gboolean tracked;
 };
 
+/* Return a new set for @repo, taking ownership of @intset */
+static TpHandleSet *
+handle_set_new_take (TpHandleRepoIface *repo,
+    TpIntset *intset)
+{
+  TpHandleSet *set;
+
+  set = _tp_slice_new0_tagged (_TP_ALLOC_HANDLE_SET, TpHandleSet);
+  set->repo = repo;
+  set->intset = intset;
+  set->tracked = _tp_dynamic_handle_repo_track_set (repo, set);
+  return set;
+}
+
+/*
+ * _tp_handle_set_forget_repo:
+ * @set: a handle set
+ *
+ * Called when @set's repository is finalized, so that destroying @set
+ * afterwards does not try to tell it.
+ */
+void
+_tp_handle_set_forget_repo (TpHandleSet *set)
+{
+  set->tracked = FALSE;
+}
+
 /**
  * TP_TYPE_HANDLE_SET: (skip)
  *
@@ -67,14 +101,9 @@ G_DEFINE_BOXED_TYPE (TpHandleSet, tp_handle_set, tp_handle_set_copy,
 TpHandleSet *
 tp_handle_set_new (TpHandleRepoIface *repo)
 {
-  TpHandleSet *set;
   g_assert (repo != NULL);
 
-  set = g_slice_new0 (TpHandleSet);
-  set->intset = tp_intset_new ();
-  set->repo = repo;
-
-  return set;
+  return handle_set_new_take (repo, tp_intset_new ());
 }
 
 /**
@@ -92,12 +121,40 @@ TpHandleSet *
 tp_handle_set_new_from_array (TpHandleRepoIface *repo,
     const GArray *array)
 {
-  TpHandleSet *set = tp_handle_set_new (repo);
-  TpIntset *tmp = tp_intset_from_array (array);
+  g_return_val_if_fail (repo != NULL, NULL);
+  g_return_val_if_fail (array != NULL, NULL);
 
-  tp_intset_destroy (tp_handle_set_update (set, tmp));
-  tp_intset_destroy (tmp);
-  return set;
+  return handle_set_new_take (repo, tp_intset_from_array (array));
+}
+
+/**
+ * tp_handle_set_new_from_sorted: (skip)
+ * @repo: #TpHandleRepoIface that holds the handles to be reffed by this set
+ * @handles: (array length=n_handles): handles in ascending order, possibly
+ *  with duplicates
+ * @n_handles: the number of handles in @handles
+ *
+ * Creates a new #TpHandleSet from handles that have already been sorted,
+ * which is faster than adding them one by one. See
+ * tp_intset_new_from_sorted().
+ *
+ * Returns: (transfer full): A new #TpHandleSet
+ *
+ * Since: 0.UNRELEASED
+ */
+TpHandleSet *
+tp_handle_set_new_from_sorted (TpHandleRepoIface *repo,
+    const TpHandle *handles,
+    guint n_handles)
+{
+  TpIntset *intset;
+
+  g_return_val_if_fail (repo != NULL, NULL);
+
+  intset = tp_intset_new_from_sorted (handles, n_handles);
+  g_return_val_if_fail (intset != NULL, NULL);
+
+  return handle_set_new_take (repo, intset);
 }
 
 static void
@@ -115,9 +172,12 @@ freer (TpHandleSet *set, TpHandle handle, gpointer userdata)
 void
 tp_handle_set_destroy (TpHandleSet *set)
 {
+  if (set->tracked)
+    _tp_dynamic_handle_repo_untrack_set (set->repo, set);
+
   tp_handle_set_foreach (set, freer, NULL);
   tp_intset_destroy (set->intset);
-  g_slice_free (TpHandleSet, set);
+  _tp_slice_free_tagged (_TP_ALLOC_HANDLE_SET, TpHandleSet, set);
 }
 
 /**
@@ -293,6 +353,30 @@ tp_handle_set_to_array (const TpHandleSet *set)
   return tp_intset_to_array (set->intset);
 }
 
+/**
+ * tp_handle_set_to_buffer: (skip)
+ * @set: A handle set
+ * @buffer: (array length=n_handles) (out caller-allocates): a buffer with
+ *  room for @n_handles handles
+ * @n_handles: the size of @buffer
+ *
+ * Copy the handles in @set into @buffer in ascending order, stopping when
+ * it is full. See tp_intset_to_buffer().
+ *
+ * Returns: the number of handles written to @buffer
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_handle_set_to_buffer (const TpHandleSet *set,
+    TpHandle *buffer,
+    guint n_handles)
+{
+  g_return_val_if_fail (set != NULL, 0);
+
+  return tp_intset_to_buffer (set->intset, buffer, n_handles);
+}
+
 /**
  * tp_handle_set_to_identifier_map:
  * @self: a handle set
@@ -309,30 +393,53 @@ GHashTable *
 tp_handle_set_to_identifier_map (
     TpHandleSet *self)
 {
-  /* We don't bother dupping the strings: they remain valid as long as the
-   * connection's alive and hence the repo exists.
-   */
   GHashTable *map = g_hash_table_new (NULL, NULL);
-  TpIntsetFastIter iter;
-  TpHandle handle;
 
   g_return_val_if_fail (self != NULL, map);
 
-  tp_intset_fast_iter_init (&iter, self->intset);
-  while (tp_intset_fast_iter_next (&iter, &handle))
+  _tp_handle_repo_add_identifiers (self->repo, self->intset, map);
+  return map;
+}
+
+/*
+ * _tp_handle_repo_add_identifiers:
+ * @repo: a handle repository
+ * @handles: handles in @repo
+ * @map: a map from handles to borrowed identifiers, of the sort returned
+ *  by tp_handle_set_to_identifier_map()
+ *
+ * Add the identifier of each of @handles to @map. The strings are not
+ * copied: they remain valid as long as the connection's alive and hence
+ * the repo exists. The handles are visited in ascending order, a batch at
+ * a time, which keeps consecutive lookups in the repo close together.
+ */
+void
+_tp_handle_repo_add_identifiers (TpHandleRepoIface *repo,
+    const TpIntset *handles,
+    GHashTable *map)
+{
+  TpIntsetFastIter iter;
+  TpHandle batch[64];
+  guint i, n;
+
+  tp_intset_fast_iter_init (&iter, handles);
+
+  while ((n = tp_intset_fast_iter_next_batch (&iter, batch,
+          G_N_ELEMENTS (batch))) > 0)
     {
-      if (handle == 0 || !tp_handle_is_valid (self->repo, handle, NULL))
-        {
-          WARNING ("handle set %p contains invalid handle #%u", self, handle);
-        }
-      else
+      for (i = 0; i < n; i++)
         {
-          g_hash_table_insert (map, GUINT_TO_POINTER (handle),
-              (gchar *) tp_handle_inspect (self->repo, handle));
+          if (batch[i] == 0 || !tp_handle_is_valid (repo, batch[i], NULL))
+            {
+              WARNING ("handle set contains invalid handle #%u", batch[i]);
+            }
+          else
+            {
+              g_hash_table_insert (map, GUINT_TO_POINTER (batch[i]),
+                  (gchar *) tp_handle_inspect (repo, batch[i]));
+            }
         }
     }
-
-  return map;
 }
 
 /**
@@ -391,15 +498,10 @@ TpHandleSet *
 tp_handle_set_new_from_intset (TpHandleRepoIface *repo,
     const TpIntset *intset)
 {
-  TpHandleSet *set;
-
   g_return_val_if_fail (repo != NULL, NULL);
   g_return_val_if_fail (intset != NULL, NULL);
 
-  set = g_slice_new0 (TpHandleSet);
-  set->repo = repo;
-  set->intset = tp_intset_copy (intset);
-  return set;
+  return handle_set_new_take (repo, tp_intset_copy (intset));
 }
 
 /**
@@ -415,7 +517,7 @@ tp_handle_set_new_from_intset (TpHandleRepoIface *repo,
 TpIntset *
 tp_handle_set_update (TpHandleSet *set, const TpIntset *add)
 {
-  TpIntset *ret, *tmp;
+  TpIntset *ret;
 
   g_return_val_if_fail (set != NULL, NULL);
   g_return_val_if_fail (add != NULL, NULL);
@@ -424,9 +526,7 @@ tp_handle_set_update (TpHandleSet *set, const TpIntset *add)
   ret = tp_intset_difference (add, set->intset);
 
   /* update CURRENT to be the union of CURRENT and ADD */
-  tmp = tp_intset_union (add, set->intset);
-  tp_intset_destroy (set->intset);
-  set->intset = tmp;
+  tp_intset_union_update (set->intset, add);
 
   return ret;
 }
@@ -451,7 +551,7 @@ tp_handle_set_update (TpHandleSet *set, const TpIntset *add)
 TpIntset *
 tp_handle_set_difference_update (TpHandleSet *set, const TpIntset *remove)
 {
-  TpIntset *ret, *tmp;
+  TpIntset *ret;
 
   g_return_val_if_fail (set != NULL, NULL);
   g_return_val_if_fail (remove != NULL, NULL);
@@ -460,9 +560,7 @@ tp_handle_set_difference_update (TpHandleSet *set, const TpIntset *remove)
   ret = tp_intset_intersection (remove, set->intset);
 
   /* update CURRENT to be CURRENT - REMOVE */
-  tmp = tp_intset_difference (set->intset, remove);
-  tp_intset_destroy (set->intset);
-  set->intset = tmp;
+  tp_intset_difference_update (set->intset, remove);
 
   return ret;
 }
@@ -0,0 +1,174 @@
+/*<private_header>*/
+/*
+ * heap-internal.h - heap queues specialized for one type of key
+ *
+ * Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_HEAP_INTERNAL_H__
+#define __TP_HEAP_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * TpHeap calls a GCompareFunc through a pointer at every step, and keeps
+ * each element in a separately-allocated TpHeapHandle, which is what lets
+ * it remove or reorder arbitrary elements. A queue that only ever takes
+ * the first element, like a timer queue ordered by deadline, can do
+ * better by keeping the key next to the value in one array and comparing
+ * keys inline.
+ *
+ * _TP_DEFINE_TYPED_HEAP (Name, prefix, KeyType, before) defines a struct
+ * Name, whose fields are private, and these static inline functions:
+ *
+ *   void prefix_init (Name *heap);
+ *   void prefix_clear (Name *heap);
+ *   guint prefix_size (const Name *heap);
+ *   void prefix_add (Name *heap, KeyType key, gpointer value);
+ *   gpointer prefix_peek_first (const Name *heap, KeyType *key);
+ *   gpointer prefix_extract_first (Name *heap, KeyType *key);
+ *
+ * @before (a, b) must be an expression, usually a macro, which is true
+ * if the key a should come out of the heap before b. peek_first and
+ * extract_first set *key if key is not NULL; they must not be called on
+ * an empty heap. The heap does not own its values, and prefix_clear()
+ * just frees its storage, leaving it empty and ready for reuse.
+ */
+
+#define _TP_TYPED_HEAP_LESS(a, b) ((a) < (b))
+
+#define _TP_DEFINE_TYPED_HEAP(Name, prefix, KeyType, before) \
+\
+typedef struct { \
+    KeyType key; \
+    gpointer value; \
+} Name##Entry; \
+\
+typedef struct { \
+    Name##Entry *entries; \
+    guint len; \
+    guint allocated; \
+} Name; \
+\
+static inline void \
+prefix##_init (Name *heap) \
+{ \
+  heap->entries = NULL; \
+  heap->len = 0; \
+  heap->allocated = 0; \
+} \
+\
+static inline void \
+prefix##_clear (Name *heap) \
+{ \
+  g_free (heap->entries); \
+  prefix##_init (heap); \
+} \
+\
+static inline guint \
+prefix##_size (const Name *heap) \
+{ \
+  return heap->len; \
+} \
+\
+static inline void \
+prefix##_add (Name *heap, \
+    KeyType key, \
+    gpointer value) \
+{ \
+  guint i; \
+\
+  if (heap->len == heap->allocated) \
+    { \
+      heap->allocated = MAX (16, heap->allocated * 2); \
+      heap->entries = g_renew (Name##Entry, heap->entries, \
+          heap->allocated); \
+    } \
+\
+  /* move parents down into the hole until the new key fits there */ \
+  i = heap->len++; \
+\
+  while (i > 0 && (before (key, heap->entries[(i - 1) / 2].key))) \
+    { \
+      heap->entries[i] = heap->entries[(i - 1) / 2]; \
+      i = (i - 1) / 2; \
+    } \
+\
+  heap->entries[i].key = key; \
+  heap->entries[i].value = value; \
+} \
+\
+static inline gpointer \
+prefix##_peek_first (const Name *heap, \
+    KeyType *key) \
+{ \
+  g_return_val_if_fail (heap->len > 0, NULL); \
+\
+  if (key != NULL) \
+    *key = heap->entries[0].key; \
+\
+  return heap->entries[0].value; \
+} \
+\
+static inline gpointer \
+prefix##_extract_first (Name *heap, \
+    KeyType *key) \
+{ \
+  Name##Entry last; \
+  gpointer ret; \
+  guint i = 0; \
+\
+  g_return_val_if_fail (heap->len > 0, NULL); \
+\
+  if (key != NULL) \
+    *key = heap->entries[0].key; \
+\
+  ret = heap->entries[0].value; \
+  last = heap->entries[--heap->len]; \
+\
+  /* move children up into the hole until the last entry fits there */ \
+  while (i * 2 + 1 < heap->len) \
+    { \
+      guint j = i * 2 + 1; \
+\
+      if (j + 1 < heap->len && \
+          (before (heap->entries[j + 1].key, heap->entries[j].key))) \
+        j++; \
+\
+      if (!(before (heap->entries[j].key, last.key))) \
+        break; \
+\
+      heap->entries[i] = heap->entries[j]; \
+      i = j; \
+    } \
+\
+  if (heap->len > 0) \
+    heap->entries[i] = last; \
+\
+  return ret; \
+}
+
+/* a queue of values in order of a gint64 key, smallest first, such as a
+ * deadline from g_get_monotonic_time() */
+_TP_DEFINE_TYPED_HEAP (_TpInt64Heap, _tp_int64_heap, gint64,
+    _TP_TYPED_HEAP_LESS)
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,10 @@
  * @short_description: a heap queue of pointers
  *
  * A heap queue of pointers.
+ *
+ * Each element added to the heap is tracked by a #TpHeapHandle, which can
+ * be used to remove it or to restore the heap order after its priority
+ * has changed, in logarithmic rather than linear time.
  */
 
 #include "config.h"
@@ -42,11 +46,109 @@
  */
 struct _TpHeap
 {
+  /* (element-type TpHeapHandle) */
   GPtrArray *data;
   GCompareFunc comparator;
   GDestroyNotify destructor;
 };
 
+/**
+ * TpHeapHandle:
+ *
+ * An opaque reference to an element in a #TpHeap, returned by
+ * tp_heap_add(). It remains valid until the element is removed from the
+ * heap, by tp_heap_extract_first(), tp_heap_remove(),
+ * tp_heap_remove_handle(), tp_heap_clear() or tp_heap_destroy().
+ *
+ * Since: 0.UNRELEASED
+ */
+struct _TpHeapHandle
+{
+  gpointer element;
+  /* 1-based position in data */
+  guint index;
+};
+
+#define HEAP_INDEX(heap, index) \
+  ((TpHeapHandle *) g_ptr_array_index ((heap)->data, (index)-1))
+
+static inline gint
+heap_compare (TpHeap *heap,
+    guint a,
+    guint b)
+{
+  return heap->comparator (HEAP_INDEX (heap, a)->element,
+      HEAP_INDEX (heap, b)->element);
+}
+
+static inline void
+heap_swap (TpHeap *heap,
+    guint a,
+    guint b)
+{
+  TpHeapHandle *tmp = HEAP_INDEX (heap, a);
+
+  g_ptr_array_index (heap->data, a - 1) = HEAP_INDEX (heap, b);
+  g_ptr_array_index (heap->data, b - 1) = tmp;
+  HEAP_INDEX (heap, a)->index = a;
+  HEAP_INDEX (heap, b)->index = b;
+}
+
+/* Move the node at 1-based index @i towards the root until its parent
+ * comes before it. Returns the new index. */
+static guint
+sift_up (TpHeap *heap,
+    guint i)
+{
+  while (i != 1 && heap_compare (heap, i, i / 2) < 0)
+    {
+      heap_swap (heap, i, i / 2);
+      i /= 2;
+    }
+
+  return i;
+}
+
+/* Move the node at 1-based index @i towards the leaves until neither child
+ * comes before it */
+static void
+sift_down (TpHeap *heap,
+    guint i)
+{
+  guint m = heap->data->len;
+
+  while (i * 2 <= m)
+    {
+      guint j = i * 2;
+
+      /* select the child which is supposed to come FIRST */
+      if (j + 1 <= m && heap_compare (heap, j, j + 1) > 0)
+        j++;
+
+      if (heap_compare (heap, i, j) <= 0)
+        break;
+
+      heap_swap (heap, i, j);
+      i = j;
+    }
+}
+
+static void
+free_nodes (TpHeap *heap)
+{
+  guint i;
+
+  for (i = 0; i < heap->data->len; i++)
+    {
+      TpHeapHandle *node = g_ptr_array_index (heap->data, i);
+
+      if (heap->destructor)
+        (heap->destructor) (node->element);
+
+      g_slice_free (TpHeapHandle, node);
+    }
+}
+
 /**
  * tp_heap_new:
  * @comparator: Comparator by which to order the pointers in the heap
@@ -70,6 +172,61 @@ tp_heap_new (GCompareFunc comparator, GDestroyNotify destructor)
   return ret;
 }
 
+/**
+ * tp_heap_new_from_array:
+ * @comparator: Comparator by which to order the pointers in the heap
+ * @destructor: Function to call on the pointers when the heap is destroyed
+ *  or cleared, or %NULL if this is not needed
+ * @elements: (element-type gpointer): elements to put in the heap, in any
+ *  order
+ *
+ * Create a heap queue containing the pointers in @elements. This takes
+ * time linear in the number of elements, which is faster than adding
+ * them one by one with tp_heap_add().
+ *
+ * The heap does not keep a reference to @elements itself, but the
+ * destructor, if any, will be called on the pointers it contained when
+ * the heap is destroyed or cleared. No handles are returned for these
+ * elements; use tp_heap_add() for elements that will need one.
+ *
+ * Returns: A new heap queue.
+ *
+ * Since: 0.UNRELEASED
+ */
+TpHeap *
+tp_heap_new_from_array (GCompareFunc comparator,
+    GDestroyNotify destructor,
+    const GPtrArray *elements)
+{
+  TpHeap *ret;
+  guint i;
+
+  g_return_val_if_fail (elements != NULL, NULL);
+
+  ret = g_slice_new (TpHeap);
+  g_assert (comparator != NULL);
+
+  ret->data = g_ptr_array_sized_new (MAX (DEFAULT_SIZE, elements->len));
+  ret->comparator = comparator;
+  ret->destructor = destructor;
+
+  for (i = 0; i < elements->len; i++)
+    {
+      TpHeapHandle *node = g_slice_new (TpHeapHandle);
+
+      node->element = g_ptr_array_index (elements, i);
+      node->index = i + 1;
+      g_ptr_array_add (ret->data, node);
+    }
+
+  /* Floyd's construction: every sift_down from the last parent back to
+   * the root costs at most the height of its subtree, O(n) in total */
+  for (i = ret->data->len / 2; i >= 1; i--)
+    sift_down (ret, i);
+
+  return ret;
+}
+
 /**
  * tp_heap_destroy:
  * @heap: The heap queue
@@ -81,16 +238,7 @@ tp_heap_destroy (TpHeap * heap)
 {
   g_return_if_fail (heap != NULL);
 
-  if (heap->destructor)
-    {
-      guint i;
-
-      for (i = 0; i < heap->data->len; i++)
-        {
-          (heap->destructor) (g_ptr_array_index (heap->data, i));
-        }
-    }
-
+  free_nodes (heap);
   g_ptr_array_unref (heap->data);
   g_slice_free (TpHeap, heap);
 }
@@ -107,51 +255,37 @@ tp_heap_clear (TpHeap *heap)
 {
   g_return_if_fail (heap != NULL);
 
-  if (heap->destructor)
-    {
-      guint i;
-
-      for (i = 0; i < heap->data->len; i++)
-        {
-          (heap->destructor) (g_ptr_array_index (heap->data, i));
-        }
-    }
-
-  g_ptr_array_unref (heap->data);
-  heap->data = g_ptr_array_sized_new (DEFAULT_SIZE);
+  free_nodes (heap);
+  g_ptr_array_set_size (heap->data, 0);
 }
 
-#define HEAP_INDEX(heap, index) (g_ptr_array_index ((heap)->data, (index)-1))
-
 /**
  * tp_heap_add:
  * @heap: The heap queue
  * @element: An element
  *
  * Add element to the heap queue, maintaining correct order.
+ *
+ * Since 0.UNRELEASED, this returns a handle for the new element, which
+ * may be ignored.
+ *
+ * Returns: (transfer none): a handle for @element, valid until it is
+ *  removed from @heap
  */
-void
+TpHeapHandle *
 tp_heap_add (TpHeap *heap, gpointer element)
 {
-  guint m;
+  TpHeapHandle *node;
 
-  g_return_if_fail (heap != NULL);
+  g_return_val_if_fail (heap != NULL, NULL);
 
-  g_ptr_array_add (heap->data, element);
-  m = heap->data->len;
-  while (m != 1)
-    {
-      gpointer parent = HEAP_INDEX (heap, m / 2);
-
-      if (heap->comparator (element, parent) < 0)
-        {
-          HEAP_INDEX (heap, m / 2) = element;
-          HEAP_INDEX (heap, m) = parent;
-          m /= 2;
-        }
-      else
-        break;
-    }
+  node = g_slice_new (TpHeapHandle);
+  node->element = element;
+  g_ptr_array_add (heap->data, node);
+  node->index = heap->data->len;
+  sift_up (heap, node->index);
+
+  return node;
 }
 
 /**
@@ -168,7 +302,7 @@ tp_heap_peek_first (TpHeap *heap)
   g_return_val_if_fail (heap != NULL, NULL);
 
   if (heap->data->len > 0)
-    return HEAP_INDEX (heap, 1);
+    return HEAP_INDEX (heap, 1)->element;
   else
     return NULL;
 }
@@ -178,54 +312,39 @@ tp_heap_peek_first (TpHeap *heap)
  * @heap: The heap queue
  * @index: The index into the queue
  *
- * Remove the element at 1-based index @index from the queue and return it.
- * The destructor, if any, is not called.
+ * Remove the element at 1-based index @index from the queue, free its
+ * handle and return it. The destructor, if any, is not called.
  *
  * Returns: The element with 1-based index @index
  */
 static gpointer
-extract_element (TpHeap * heap, int index)
+extract_element (TpHeap * heap, guint index)
 {
+  TpHeapHandle *node;
   gpointer ret;
+  guint m = heap->data->len;
 
-  g_return_val_if_fail (heap != NULL, NULL);
+  g_assert (index >= 1 && index <= m);
 
-  if (heap->data->len > 0)
-    {
-      guint m = heap->data->len;
-      guint i = 1, j;
-      ret = HEAP_INDEX (heap, index);
-
-      HEAP_INDEX (heap, index) = HEAP_INDEX (heap, m);
-
-      while (i * 2 <= m)
-        {
-          /* select the child which is supposed to come FIRST */
-          if ((i * 2 + 1 <= m)
-              && (heap->
-                  comparator (HEAP_INDEX (heap, i * 2),
-                              HEAP_INDEX (heap, i * 2 + 1)) > 0))
-            j = i * 2 + 1;
-          else
-            j = i * 2;
-
-          if (heap->comparator (HEAP_INDEX (heap, i), HEAP_INDEX (heap, j)) >
-              0)
-            {
-              gpointer tmp = HEAP_INDEX (heap, i);
-              HEAP_INDEX (heap, i) = HEAP_INDEX (heap, j);
-              HEAP_INDEX (heap, j) = tmp;
-              i = j;
-            }
-          else
-            break;
-        }
+  node = HEAP_INDEX (heap, index);
+  ret = node->element;
 
+  if (index != m)
+    {
+      /* move the last node into the hole, then restore the heap order
+       * in whichever direction it is violated */
+      heap_swap (heap, index, m);
       g_ptr_array_remove_index (heap->data, m - 1);
+
+      if (sift_up (heap, index) == index)
+        sift_down (heap, index);
     }
   else
-    ret = NULL;
+    {
+      g_ptr_array_remove_index (heap->data, m - 1);
+    }
 
+  g_slice_free (TpHeapHandle, node);
   return ret;
 }
 
@@ -236,6 +355,9 @@ extract_element (TpHeap * heap, int index)
  *
  * Remove @element from @heap, if it's present. The destructor, if any,
  * is not called.
+ *
+ * This takes time linear in the size of the heap; if you kept the handle
+ * returned by tp_heap_add(), tp_heap_remove_handle() is faster.
  */
 void
 tp_heap_remove (TpHeap *heap, gpointer element)
@@ -246,7 +368,7 @@ tp_heap_remove (TpHeap *heap, gpointer element)
 
     for (i = 1; i <= heap->data->len; i++)
       {
-          if (element == HEAP_INDEX (heap, i))
+          if (element == HEAP_INDEX (heap, i)->element)
             {
               extract_element (heap, i);
               break;
@@ -254,6 +376,85 @@ tp_heap_remove (TpHeap *heap, gpointer element)
       }
 }
 
+static gboolean
+heap_owns_handle (TpHeap *heap,
+    TpHeapHandle *handle)
+{
+  return (handle->index >= 1 && handle->index <= heap->data->len &&
+      HEAP_INDEX (heap, handle->index) == handle);
+}
+
+/**
+ * tp_heap_remove_handle:
+ * @heap: The heap queue
+ * @handle: a handle returned by tp_heap_add() for an element that is still
+ *  in @heap
+ *
+ * Remove the element referenced by @handle from @heap in logarithmic time.
+ * @handle is no longer valid afterwards. The destructor, if any, is not
+ * called.
+ *
+ * Returns: the removed element
+ *
+ * Since: 0.UNRELEASED
+ */
+gpointer
+tp_heap_remove_handle (TpHeap *heap,
+    TpHeapHandle *handle)
+{
+  g_return_val_if_fail (heap != NULL, NULL);
+  g_return_val_if_fail (handle != NULL, NULL);
+  g_return_val_if_fail (heap_owns_handle (heap, handle), NULL);
+
+  return extract_element (heap, handle->index);
+}
+
+/**
+ * tp_heap_update_handle:
+ * @heap: The heap queue
+ * @handle: a handle returned by tp_heap_add() for an element that is still
+ *  in @heap
+ *
+ * Restore the order of @heap after the element referenced by @handle has
+ * changed in a way that affects the comparator, for instance because its
+ * deadline was moved earlier or later. This takes logarithmic time.
+ *
+ * Only that one element may have changed since the heap was last in
+ * order.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_heap_update_handle (TpHeap *heap,
+    TpHeapHandle *handle)
+{
+  g_return_if_fail (heap != NULL);
+  g_return_if_fail (handle != NULL);
+  g_return_if_fail (heap_owns_handle (heap, handle));
+
+  if (sift_up (heap, handle->index) == handle->index)
+    sift_down (heap, handle->index);
+}
+
+/**
+ * tp_heap_handle_get_element:
+ * @handle: a handle returned by tp_heap_add() for an element that is still
+ *  in its heap
+ *
+ * <!--Returns: says it all-->
+ *
+ * Returns: (transfer none): the element referenced by @handle
+ *
+ * Since: 0.UNRELEASED
+ */
+gpointer
+tp_heap_handle_get_element (TpHeapHandle *handle)
+{
+  g_return_val_if_fail (handle != NULL, NULL);
+
+  return handle->element;
+}
+
 /**
  * tp_heap_extract_first:
  * @heap: The heap queue
@@ -29,17 +29,30 @@
 
 #include <glib.h>
 
+#include <telepathy-glib/defs.h>
+
 G_BEGIN_DECLS
 
 typedef struct _TpHeap TpHeap;
+typedef struct _TpHeapHandle TpHeapHandle;
 
 TpHeap *tp_heap_new (GCompareFunc comparator, GDestroyNotify destructor)
   G_GNUC_WARN_UNUSED_RESULT;
+_TP_AVAILABLE_IN_UNRELEASED
+TpHeap *tp_heap_new_from_array (GCompareFunc comparator,
+    GDestroyNotify destructor, const GPtrArray *elements)
+  G_GNUC_WARN_UNUSED_RESULT;
 void tp_heap_destroy (TpHeap *heap);
 void tp_heap_clear (TpHeap *heap);
 
-void tp_heap_add (TpHeap *heap, gpointer element);
+TpHeapHandle *tp_heap_add (TpHeap *heap, gpointer element);
 void tp_heap_remove (TpHeap *heap, gpointer element);
+_TP_AVAILABLE_IN_UNRELEASED
+gpointer tp_heap_remove_handle (TpHeap *heap, TpHeapHandle *handle);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_heap_update_handle (TpHeap *heap, TpHeapHandle *handle);
+_TP_AVAILABLE_IN_UNRELEASED
+gpointer tp_heap_handle_get_element (TpHeapHandle *handle);
 gpointer tp_heap_peek_first (TpHeap *heap);
 gpointer tp_heap_extract_first (TpHeap *heap);
 
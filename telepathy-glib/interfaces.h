@@ -11,6 +11,20 @@ G_BEGIN_DECLS
 
 #include <telepathy-glib/_gen/telepathy-interfaces.h>
 
+/**
+ * TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES:
+ *
+ * The client interest token
+ * "org.freedesktop.Telepathy.Connection.Interface.Avatars/avatar-files".
+ * Clients which add an interest in it, as #TpContact does, can receive
+ * avatars with the AvatarFileRetrieved signal instead of AvatarRetrieved;
+ * see tp_base_connection_set_avatar_file_threshold().
+ *
+ * Since: 0.UNRELEASED
+ */
+#define TP_TOKEN_CONNECTION_INTERFACE_AVATARS_AVATAR_FILES \
+  TP_IFACE_CONNECTION_INTERFACE_AVATARS "/avatar-files"
+
 G_END_DECLS
 
 #endif
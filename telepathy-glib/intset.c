@@ -28,35 +28,68 @@
  * @see_also: #TpHandleSet
  *
  * A #TpIntset is a set of unsigned integers, implemented as a
- * dynamically-allocated sparse bitfield.
+ * dynamically-allocated sparse bitfield. Dense ranges of consecutive
+ * integers, such as the handles of a large contact list, are stored as
+ * runs, so they take very little memory.
  */
 
 #include "config.h"
 
 #include <telepathy-glib/intset.h>
 #include <telepathy-glib/util.h>
+#include <telepathy-glib/util-internal.h>
 
+#include <stdlib.h>
 #include <string.h>
 #include <glib.h>
 
-/* On platforms with 64-bit pointers we could pack 64 bits into the values,
- * if count_bits32() is replaced with a 64-bit version. This doesn't work
- * yet. */
-#undef USE_64_BITS
-
-#ifdef USE_64_BITS
-#   define BITFIELD_BITS 64
-#   define BITFIELD_LOG2_BITS 6
-#else
-#   define BITFIELD_BITS 32
-#   define BITFIELD_LOG2_BITS 5
+#if defined (HAVE_X86_SIMD_DISPATCH) && defined (__x86_64__)
+# define HAVE_X86_KERNELS
+# include <immintrin.h>
 #endif
 
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+# define HAVE_NEON_KERNELS
+# include <arm_neon.h>
+#endif
+
+/* Integers are split into a 16-bit key (the high part) and a 16-bit low
+ * part. All the members that share a key live in one container, and the
+ * set keeps its containers in an array sorted by key. Each container uses
+ * whichever of three representations is smallest for its contents, much
+ * like "Roaring" bitmaps:
+ *
+ * - CONTAINER_ARRAY: a sorted array of low parts, for sparse chunks
+ * - CONTAINER_BITMAP: one bit per low part, stored as BITMAP_WORDS
+ *   words of BITFIELD_BITS bits, for dense but irregular chunks
+ * - CONTAINER_RUN: a sorted array of runs of consecutive low parts, for
+ *   ranges like handles allocated in order by a TpDynamicHandleRepo
+ *
+ * Set algebra between bitmaps is done a word at a time. */
+
+#define CHUNK_LOG2_SIZE 16
+#define CHUNK_SIZE (1 << CHUNK_LOG2_SIZE)
+#define CHUNK_KEY(x) ((x) >> CHUNK_LOG2_SIZE)
+#define CHUNK_LOW(x) ((x) & (CHUNK_SIZE - 1))
+#define CHUNK_BASE(key) ((guint) (key) << CHUNK_LOG2_SIZE)
+
+#define BITFIELD_BITS 64
+#define BITFIELD_LOG2_BITS 6
+#define BITMAP_WORDS (CHUNK_SIZE / BITFIELD_BITS)
+#define BITMAP_BYTES (BITMAP_WORDS * sizeof (guint64))
+
 G_STATIC_ASSERT (1 << BITFIELD_LOG2_BITS == BITFIELD_BITS);
-G_STATIC_ASSERT (sizeof (gpointer) >= sizeof (gsize));
 #define LOW_MASK (BITFIELD_BITS - 1)
-#define HIGH_PART(x) (x & ~LOW_MASK)
-#define LOW_PART(x) (x & LOW_MASK)
+#define WORD_INDEX(low) ((low) >> BITFIELD_LOG2_BITS)
+#define WORD_BIT(low) (G_GUINT64_CONSTANT (1) << ((low) & LOW_MASK))
+#define ALL_ONES (~ G_GUINT64_CONSTANT (0))
+
+/* An array container with more members than this would use more memory
+ * than a bitmap */
+#define ARRAY_MAX_CARDINALITY (BITMAP_BYTES / sizeof (guint16))
+
+/* Initial number of items allocated for a new array or run container */
+#define MIN_ALLOCATED 4
 
 /**
  * TP_TYPE_INTSET:
@@ -157,65 +190,1810 @@ tp_intset_iter_init (
     TpIntsetIter *iter,
     const TpIntset *set)
 {
-  g_return_if_fail (iter != NULL);
-  iter->set = set;
-  iter->element = (guint)(-1);
+  g_return_if_fail (iter != NULL);
+  iter->set = set;
+  iter->element = (guint)(-1);
+}
+
+/**
+ * tp_intset_iter_reset:
+ * @iter: An integer set iterator to be reset.
+ *
+ * Reset the iterator @iter to the beginning. It must already be associated
+ * with a set.
+ *
+ * Deprecated: since 0.19.0. Use #TpIntsetFastIter instead
+ */
+void
+tp_intset_iter_reset (TpIntsetIter *iter)
+{
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (iter->set != NULL);
+  iter->element = (guint)(-1);
+}
+
+/**
+ * TpIntset:
+ *
+ * Opaque type representing a set of unsigned integers.
+ *
+ * Before 0.11.16, this type was called <type>TpIntSet</type>, which is
+ * now a backwards compatibility typedef.
+ */
+
+typedef enum {
+    CONTAINER_ARRAY,
+    CONTAINER_BITMAP,
+    CONTAINER_RUN
+} ContainerType;
+
+typedef struct {
+    guint16 start;
+    /* the run contains start, start + 1, ..., start + length */
+    guint16 length;
+} Run;
+
+typedef struct {
+    /* CHUNK_KEY() of every member */
+    guint key;
+    ContainerType type;
+    /* number of members, between 1 and CHUNK_SIZE inclusive */
+    guint cardinality;
+    /* number of guint16 or Run items used and allocated; only meaningful
+     * for CONTAINER_ARRAY and CONTAINER_RUN */
+    guint n_items;
+    guint n_allocated;
+    union {
+        /* sorted, no duplicates; use container_array() */
+        guint16 *array;
+        /* the same, if n_allocated is no more than MIN_ALLOCATED, so that
+         * the handful of members in a typical small set need no separate
+         * allocation */
+        guint16 small[MIN_ALLOCATED];
+        /* BITMAP_WORDS words */
+        guint64 *bitmap;
+        /* sorted, never overlapping or adjacent */
+        Run *runs;
+    } data;
+} Container;
+
+#define container_array(c) \
+  ((c)->n_allocated <= MIN_ALLOCATED ? (c)->data.small : (c)->data.array)
+
+typedef enum {
+    OP_AND,
+    OP_OR,
+    OP_ANDNOT,
+    OP_XOR
+} SetOp;
+
+struct _TpIntset
+{
+  /* Containers sorted by key. A container is never empty: it is removed
+   * from the array when its last member is.
+   *
+   * For instance, the set { 5, 23 } is represented by one array container
+   * with key 0 and items { 5, 23 }, and the set { 1, 2, ..., 100000 } is
+   * represented by a run container with key 0 and runs { (1, 65534) },
+   * followed by a run container with key 1 and runs { (0, 34463) }. */
+  Container *containers;
+  guint n_containers;
+  guint n_allocated;
+  /* Where containers points while there is no more than one of them,
+   * which is the common case for a TpHandleSet: the members of most sets
+   * are few and close together, and then the TpIntset is the only
+   * allocation. */
+  Container first;
+};
+
+/* ---- Word-at-a-time kernels ---- */
+
+static inline guint
+count_bits64 (guint64 n)
+{
+  n = n - ((n >> 1) & G_GUINT64_CONSTANT (0x5555555555555555));
+  n = (n & G_GUINT64_CONSTANT (0x3333333333333333)) +
+      ((n >> 2) & G_GUINT64_CONSTANT (0x3333333333333333));
+  n = (n + (n >> 4)) & G_GUINT64_CONSTANT (0x0f0f0f0f0f0f0f0f);
+  return (guint) ((n * G_GUINT64_CONSTANT (0x0101010101010101)) >> 56);
+}
+
+/* @n must be non-zero */
+static inline guint
+lowest_bit64 (guint64 n)
+{
+  if ((guint32) n != 0)
+    return g_bit_nth_lsf ((guint32) n, -1);
+  else
+    return 32 + g_bit_nth_lsf ((guint32) (n >> 32), -1);
+}
+
+/* The bitmap kernels below all have the same semantics:
+ *
+ * - count (words) returns the number of bits set in @words
+ * - op (dest, left, right, op) sets @dest to (@left OP @right) and returns
+ *   the number of bits set in @dest; @dest may be the same as @left
+ * - count_runs (words) returns the number of runs of consecutive set bits
+ *   in @words
+ *
+ * and are chosen at runtime by bitmap_kernels(), according to what the CPU
+ * supports. */
+
+static guint
+bitmap_count_generic (const guint64 *words)
+{
+  guint i, count = 0;
+
+  for (i = 0; i < BITMAP_WORDS; i++)
+    count += count_bits64 (words[i]);
+
+  return count;
+}
+
+static guint
+bitmap_count_runs_generic (const guint64 *words)
+{
+  guint i, n_runs = 0;
+  guint64 carry = 0;
+
+  for (i = 0; i < BITMAP_WORDS; i++)
+    {
+      /* bits that are set, but whose lower neighbour is not */
+      n_runs += count_bits64 (words[i] & ~((words[i] << 1) | carry));
+      carry = words[i] >> LOW_MASK;
+    }
+
+  return n_runs;
+}
+
+#define GENERIC_LOOP(expr) \
+  for (i = 0; i < BITMAP_WORDS; i++) \
+    { \
+      dest[i] = (expr); \
+      count += count_bits64 (dest[i]); \
+    }
+
+static guint
+bitmap_op_generic (guint64 *dest,
+    const guint64 *left,
+    const guint64 *right,
+    SetOp op)
+{
+  guint i, count = 0;
+
+  switch (op)
+    {
+      case OP_AND:
+        GENERIC_LOOP (left[i] & right[i]);
+        break;
+
+      case OP_OR:
+        GENERIC_LOOP (left[i] | right[i]);
+        break;
+
+      case OP_ANDNOT:
+        GENERIC_LOOP (left[i] & ~right[i]);
+        break;
+
+      case OP_XOR:
+        GENERIC_LOOP (left[i] ^ right[i]);
+        break;
+    }
+
+  return count;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/* SSE4.2-era CPUs: 128-bit logic operations, and the POPCNT instruction */
+
+__attribute__ ((target ("sse4.2,popcnt")))
+static guint
+bitmap_count_sse42 (const guint64 *words)
+{
+  guint i;
+  guint64 count = 0;
+
+  for (i = 0; i < BITMAP_WORDS; i++)
+    count += _mm_popcnt_u64 (words[i]);
+
+  return (guint) count;
+}
+
+/* this one is used by the AVX2 kernels too */
+__attribute__ ((target ("popcnt")))
+static guint
+bitmap_count_runs_popcnt (const guint64 *words)
+{
+  guint i;
+  guint64 n_runs = 0;
+  guint64 carry = 0;
+
+  for (i = 0; i < BITMAP_WORDS; i++)
+    {
+      n_runs += _mm_popcnt_u64 (words[i] & ~((words[i] << 1) | carry));
+      carry = words[i] >> LOW_MASK;
+    }
+
+  return (guint) n_runs;
+}
+
+#define SSE42_LOOP(expr) \
+  for (i = 0; i < BITMAP_WORDS; i += 2) \
+    { \
+      __m128i l = _mm_loadu_si128 ((const __m128i *) (left + i)); \
+      __m128i r = _mm_loadu_si128 ((const __m128i *) (right + i)); \
+      __m128i d = (expr); \
+      \
+      _mm_storeu_si128 ((__m128i *) (dest + i), d); \
+      count += _mm_popcnt_u64 (_mm_cvtsi128_si64 (d)); \
+      count += _mm_popcnt_u64 (_mm_extract_epi64 (d, 1)); \
+    }
+
+__attribute__ ((target ("sse4.2,popcnt")))
+static guint
+bitmap_op_sse42 (guint64 *dest,
+    const guint64 *left,
+    const guint64 *right,
+    SetOp op)
+{
+  guint i;
+  guint64 count = 0;
+
+  switch (op)
+    {
+      case OP_AND:
+        SSE42_LOOP (_mm_and_si128 (l, r));
+        break;
+
+      case OP_OR:
+        SSE42_LOOP (_mm_or_si128 (l, r));
+        break;
+
+      case OP_ANDNOT:
+        /* _mm_andnot_si128 (a, b) is (~a & b) */
+        SSE42_LOOP (_mm_andnot_si128 (r, l));
+        break;
+
+      case OP_XOR:
+        SSE42_LOOP (_mm_xor_si128 (l, r));
+        break;
+    }
+
+  return (guint) count;
+}
+
+static gboolean
+bitmap_kernels_sse42_supported (void)
+{
+  return (__builtin_cpu_supports ("sse4.2") &&
+      __builtin_cpu_supports ("popcnt"));
+}
+
+/* AVX2: 256-bit logic operations, and a vectorized population count which
+ * looks up each nibble in a 16-entry table (Muła's method) */
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+popcount_avx2 (__m256i v)
+{
+  const __m256i table = _mm256_setr_epi8 (
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8 (0x0f);
+  __m256i lo = _mm256_and_si256 (v, low_nibbles);
+  __m256i hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low_nibbles);
+  __m256i bytes = _mm256_add_epi8 (_mm256_shuffle_epi8 (table, lo),
+      _mm256_shuffle_epi8 (table, hi));
+
+  /* sum the bytes of each 64-bit lane */
+  return _mm256_sad_epu8 (bytes, _mm256_setzero_si256 ());
+}
+
+__attribute__ ((target ("avx2")))
+static inline guint
+sum_lanes_avx2 (__m256i acc)
+{
+  return (guint) (_mm256_extract_epi64 (acc, 0) +
+      _mm256_extract_epi64 (acc, 1) +
+      _mm256_extract_epi64 (acc, 2) +
+      _mm256_extract_epi64 (acc, 3));
+}
+
+__attribute__ ((target ("avx2")))
+static guint
+bitmap_count_avx2 (const guint64 *words)
+{
+  __m256i acc = _mm256_setzero_si256 ();
+  guint i;
+
+  for (i = 0; i < BITMAP_WORDS; i += 4)
+    acc = _mm256_add_epi64 (acc, popcount_avx2 (
+          _mm256_loadu_si256 ((const __m256i *) (words + i))));
+
+  return sum_lanes_avx2 (acc);
+}
+
+#define AVX2_LOOP(expr) \
+  for (i = 0; i < BITMAP_WORDS; i += 4) \
+    { \
+      __m256i l = _mm256_loadu_si256 ((const __m256i *) (left + i)); \
+      __m256i r = _mm256_loadu_si256 ((const __m256i *) (right + i)); \
+      __m256i d = (expr); \
+      \
+      _mm256_storeu_si256 ((__m256i *) (dest + i), d); \
+      acc = _mm256_add_epi64 (acc, popcount_avx2 (d)); \
+    }
+
+__attribute__ ((target ("avx2")))
+static guint
+bitmap_op_avx2 (guint64 *dest,
+    const guint64 *left,
+    const guint64 *right,
+    SetOp op)
+{
+  __m256i acc = _mm256_setzero_si256 ();
+  guint i;
+
+  switch (op)
+    {
+      case OP_AND:
+        AVX2_LOOP (_mm256_and_si256 (l, r));
+        break;
+
+      case OP_OR:
+        AVX2_LOOP (_mm256_or_si256 (l, r));
+        break;
+
+      case OP_ANDNOT:
+        /* _mm256_andnot_si256 (a, b) is (~a & b) */
+        AVX2_LOOP (_mm256_andnot_si256 (r, l));
+        break;
+
+      case OP_XOR:
+        AVX2_LOOP (_mm256_xor_si256 (l, r));
+        break;
+    }
+
+  return sum_lanes_avx2 (acc);
+}
+
+static gboolean
+bitmap_kernels_avx2_supported (void)
+{
+  return (__builtin_cpu_supports ("avx2") &&
+      __builtin_cpu_supports ("popcnt"));
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+
+/* NEON is always available where we build these, so they need no runtime
+ * check */
+
+static inline uint64x2_t
+popcount_neon (uint64x2_t v)
+{
+  return vpaddlq_u32 (vpaddlq_u16 (vpaddlq_u8 (
+          vcntq_u8 (vreinterpretq_u8_u64 (v)))));
+}
+
+static guint
+bitmap_count_neon (const guint64 *words)
+{
+  uint64x2_t acc = vdupq_n_u64 (0);
+  guint i;
+
+  for (i = 0; i < BITMAP_WORDS; i += 2)
+    acc = vaddq_u64 (acc,
+        popcount_neon (vld1q_u64 ((const uint64_t *) (words + i))));
+
+  return (guint) (vgetq_lane_u64 (acc, 0) + vgetq_lane_u64 (acc, 1));
+}
+
+#define NEON_LOOP(expr) \
+  for (i = 0; i < BITMAP_WORDS; i += 2) \
+    { \
+      uint64x2_t l = vld1q_u64 ((const uint64_t *) (left + i)); \
+      uint64x2_t r = vld1q_u64 ((const uint64_t *) (right + i)); \
+      uint64x2_t d = (expr); \
+      \
+      vst1q_u64 ((uint64_t *) (dest + i), d); \
+      acc = vaddq_u64 (acc, popcount_neon (d)); \
+    }
+
+static guint
+bitmap_op_neon (guint64 *dest,
+    const guint64 *left,
+    const guint64 *right,
+    SetOp op)
+{
+  uint64x2_t acc = vdupq_n_u64 (0);
+  guint i;
+
+  switch (op)
+    {
+      case OP_AND:
+        NEON_LOOP (vandq_u64 (l, r));
+        break;
+
+      case OP_OR:
+        NEON_LOOP (vorrq_u64 (l, r));
+        break;
+
+      case OP_ANDNOT:
+        /* vbicq_u64 (a, b) is (a & ~b) */
+        NEON_LOOP (vbicq_u64 (l, r));
+        break;
+
+      case OP_XOR:
+        NEON_LOOP (veorq_u64 (l, r));
+        break;
+    }
+
+  return (guint) (vgetq_lane_u64 (acc, 0) + vgetq_lane_u64 (acc, 1));
+}
+
+#endif /* HAVE_NEON_KERNELS */
+
+typedef struct {
+    const gchar *name;
+    /* NULL if always supported */
+    gboolean (*supported) (void);
+    guint (*count) (const guint64 *words);
+    guint (*op) (guint64 *dest, const guint64 *left, const guint64 *right,
+        SetOp op);
+    guint (*count_runs) (const guint64 *words);
+} BitmapKernels;
+
+/* in descending order of preference */
+static const BitmapKernels all_kernels[] = {
+#ifdef HAVE_X86_KERNELS
+    { "avx2", bitmap_kernels_avx2_supported, bitmap_count_avx2,
+      bitmap_op_avx2, bitmap_count_runs_popcnt },
+    { "sse4.2", bitmap_kernels_sse42_supported, bitmap_count_sse42,
+      bitmap_op_sse42, bitmap_count_runs_popcnt },
+#endif
+#ifdef HAVE_NEON_KERNELS
+    { "neon", NULL, bitmap_count_neon, bitmap_op_neon,
+      bitmap_count_runs_generic },
+#endif
+    { "generic", NULL, bitmap_count_generic, bitmap_op_generic,
+      bitmap_count_runs_generic }
+};
+
+/* Return the best kernels that this CPU supports, or the ones named by the
+ * TP_INTSET_KERNELS environment variable if they are supported (this is
+ * useful for testing and benchmarking). */
+static const BitmapKernels *
+bitmap_kernels (void)
+{
+  static gsize chosen = 0;
+
+  if (g_once_init_enter (&chosen))
+    {
+      const gchar *wanted = g_getenv ("TP_INTSET_KERNELS");
+      const BitmapKernels *best = NULL;
+      const BitmapKernels *named = NULL;
+      guint i;
+
+#ifdef HAVE_X86_KERNELS
+      __builtin_cpu_init ();
+#endif
+
+      for (i = 0; i < G_N_ELEMENTS (all_kernels); i++)
+        {
+          const BitmapKernels *k = all_kernels + i;
+
+          if (k->supported != NULL && !k->supported ())
+            continue;
+
+          if (best == NULL)
+            best = k;
+
+          if (named == NULL && !tp_strdiff (wanted, k->name))
+            named = k;
+        }
+
+      /* the generic kernels are always supported */
+      g_assert (best != NULL);
+
+      g_once_init_leave (&chosen, (gsize) (named != NULL ? named : best));
+    }
+
+  return (const BitmapKernels *) chosen;
+}
+
+static inline guint
+bitmap_count (const guint64 *words)
+{
+  return bitmap_kernels ()->count (words);
+}
+
+static inline guint
+bitmap_op (guint64 *dest,
+    const guint64 *left,
+    const guint64 *right,
+    SetOp op)
+{
+  return bitmap_kernels ()->op (dest, left, right, op);
+}
+
+static inline guint
+bitmap_count_runs (const guint64 *words)
+{
+  return bitmap_kernels ()->count_runs (words);
+}
+
+/* Apply @op to the bits from @first to @last inclusive, with a right-hand
+ * side that is all ones in that range: OP_OR sets them, OP_ANDNOT clears
+ * them and OP_XOR flips them. */
+static void
+bitmap_range_op (guint64 *words,
+    guint first,
+    guint last,
+    SetOp op)
+{
+  guint first_word = WORD_INDEX (first);
+  guint last_word = WORD_INDEX (last);
+  guint64 first_mask = ALL_ONES << (first & LOW_MASK);
+  guint64 last_mask = ALL_ONES >> (LOW_MASK - (last & LOW_MASK));
+  guint i;
+
+  g_assert (first <= last);
+  g_assert (op != OP_AND);
+
+  for (i = first_word; i <= last_word; i++)
+    {
+      guint64 mask = ALL_ONES;
+
+      if (i == first_word)
+        mask &= first_mask;
+
+      if (i == last_word)
+        mask &= last_mask;
+
+      switch (op)
+        {
+          case OP_OR:
+            words[i] |= mask;
+            break;
+
+          case OP_ANDNOT:
+            words[i] &= ~mask;
+            break;
+
+          case OP_XOR:
+            words[i] ^= mask;
+            break;
+
+          case OP_AND:
+            g_assert_not_reached ();
+        }
+    }
+}
+
+/* ---- Containers ---- */
+
+/* Return the index of the first item in @array that is >= @low, and set
+ * @found to whether it is equal to @low */
+static guint
+array_lower_bound (const guint16 *array,
+    guint n_items,
+    guint low,
+    gboolean *found)
+{
+  guint lo = 0, hi = n_items;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (array[mid] < low)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (found != NULL)
+    *found = (lo < n_items && array[lo] == low);
+
+  return lo;
+}
+
+/* Return the number of runs in @runs whose start is <= @low; if @low is in
+ * a run at all, it is in the run just before the returned index */
+static guint
+runs_upper_bound (const Run *runs,
+    guint n_items,
+    guint low)
+{
+  guint lo = 0, hi = n_items;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (runs[mid].start <= low)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static inline guint
+run_end (const Run *run)
+{
+  return (guint) run->start + run->length;
+}
+
+static void
+container_free_data (Container *c)
+{
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        if (c->n_allocated > MIN_ALLOCATED)
+          g_free (c->data.array);
+
+        break;
+
+      case CONTAINER_BITMAP:
+        g_free (c->data.bitmap);
+        break;
+
+      case CONTAINER_RUN:
+        g_free (c->data.runs);
+        break;
+    }
+
+  c->data.array = NULL;
+  c->cardinality = 0;
+  c->n_items = 0;
+  c->n_allocated = 0;
+}
+
+static void
+container_init_array (Container *c,
+    guint key,
+    guint n_allocated)
+{
+  c->key = key;
+  c->type = CONTAINER_ARRAY;
+  c->cardinality = 0;
+  c->n_items = 0;
+  c->n_allocated = MAX (n_allocated, MIN_ALLOCATED);
+
+  if (c->n_allocated > MIN_ALLOCATED)
+    c->data.array = g_new (guint16, c->n_allocated);
+}
+
+/* Change the space allocated for the items of @c, an array container,
+ * moving them in or out of the Container itself if necessary */
+static void
+container_resize_array (Container *c,
+    guint n_allocated)
+{
+  guint16 *items;
+
+  n_allocated = MAX (n_allocated, MIN_ALLOCATED);
+  g_assert (n_allocated >= c->n_items);
+
+  if (n_allocated == c->n_allocated)
+    return;
+
+  if (c->n_allocated <= MIN_ALLOCATED)
+    {
+      items = g_new (guint16, n_allocated);
+      memcpy (items, c->data.small, c->n_items * sizeof (guint16));
+      c->data.array = items;
+    }
+  else if (n_allocated <= MIN_ALLOCATED)
+    {
+      items = c->data.array;
+      memcpy (c->data.small, items, c->n_items * sizeof (guint16));
+      g_free (items);
+    }
+  else
+    {
+      c->data.array = g_renew (guint16, c->data.array, n_allocated);
+    }
+
+  c->n_allocated = n_allocated;
+}
+
+static void
+container_init_runs (Container *c,
+    guint key,
+    guint n_allocated)
+{
+  c->key = key;
+  c->type = CONTAINER_RUN;
+  c->cardinality = 0;
+  c->n_items = 0;
+  c->n_allocated = MAX (n_allocated, MIN_ALLOCATED);
+  c->data.runs = g_new (Run, c->n_allocated);
+}
+
+static gboolean
+container_contains (const Container *c,
+    guint low)
+{
+  gboolean found;
+  guint i;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        array_lower_bound (container_array (c), c->n_items, low, &found);
+        return found;
+
+      case CONTAINER_BITMAP:
+        return (c->data.bitmap[WORD_INDEX (low)] & WORD_BIT (low)) != 0;
+
+      case CONTAINER_RUN:
+        i = runs_upper_bound (c->data.runs, c->n_items, low);
+        return (i > 0 && low <= run_end (c->data.runs + i - 1));
+    }
+
+  g_assert_not_reached ();
+  return FALSE;
+}
+
+static guint
+container_count_runs (const Container *c)
+{
+  const guint16 *items;
+  guint i, n_runs;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        items = container_array (c);
+        n_runs = (c->n_items > 0 ? 1 : 0);
+
+        for (i = 1; i < c->n_items; i++)
+          {
+            if (items[i] != items[i - 1] + 1)
+              n_runs++;
+          }
+
+        return n_runs;
+
+      case CONTAINER_BITMAP:
+        return bitmap_count_runs (c->data.bitmap);
+
+      case CONTAINER_RUN:
+        return c->n_items;
+    }
+
+  g_assert_not_reached ();
+  return 0;
+}
+
+/* Return the representation that would use the least memory for a chunk
+ * with @cardinality members in @n_runs runs */
+static ContainerType
+container_best_type (guint cardinality,
+    guint n_runs)
+{
+  gsize run_bytes = n_runs * sizeof (Run);
+  gsize array_bytes = cardinality * sizeof (guint16);
+
+  if (cardinality > ARRAY_MAX_CARDINALITY)
+    array_bytes = G_MAXSIZE;
+
+  if (run_bytes < array_bytes && run_bytes < BITMAP_BYTES)
+    return CONTAINER_RUN;
+
+  if (cardinality <= ARRAY_MAX_CARDINALITY)
+    return CONTAINER_ARRAY;
+
+  return CONTAINER_BITMAP;
+}
+
+/* Return a newly allocated bitmap with the same members as @c */
+static guint64 *
+container_dup_bitmap (const Container *c)
+{
+  guint64 *words;
+  guint i;
+
+  if (c->type == CONTAINER_BITMAP)
+    return g_memdup (c->data.bitmap, BITMAP_BYTES);
+
+  words = g_new0 (guint64, BITMAP_WORDS);
+
+  if (c->type == CONTAINER_ARRAY)
+    {
+      const guint16 *items = container_array (c);
+
+      for (i = 0; i < c->n_items; i++)
+        words[WORD_INDEX (items[i])] |= WORD_BIT (items[i]);
+    }
+  else
+    {
+      for (i = 0; i < c->n_items; i++)
+        bitmap_range_op (words, c->data.runs[i].start,
+            run_end (c->data.runs + i), OP_OR);
+    }
+
+  return words;
+}
+
+/* Replace the contents of @c, which must have no data, with the
+ * @cardinality members of @words, using representation @type. Takes
+ * ownership of @words. */
+static void
+container_take_bitmap_as (Container *c,
+    guint64 *words,
+    guint cardinality,
+    ContainerType type)
+{
+  guint key = c->key;
+  guint i;
+
+  g_assert (cardinality > 0);
+
+  if (type == CONTAINER_BITMAP)
+    {
+      c->type = CONTAINER_BITMAP;
+      c->data.bitmap = words;
+      c->cardinality = cardinality;
+      c->n_items = 0;
+      c->n_allocated = 0;
+      return;
+    }
+
+  if (type == CONTAINER_ARRAY)
+    {
+      guint16 *items;
+
+      container_init_array (c, key, cardinality);
+      items = container_array (c);
+
+      for (i = 0; i < BITMAP_WORDS; i++)
+        {
+          guint64 w = words[i];
+
+          while (w != 0)
+            {
+              items[c->n_items++] = (i << BITFIELD_LOG2_BITS) |
+                lowest_bit64 (w);
+              w &= w - 1;
+            }
+        }
+    }
+  else
+    {
+      guint low = 0;
+
+      container_init_runs (c, key, bitmap_count_runs (words));
+
+      while (low < CHUNK_SIZE)
+        {
+          guint start;
+
+          /* skip clear bits, a word at a time where possible */
+          while (low < CHUNK_SIZE &&
+              (words[WORD_INDEX (low)] & (ALL_ONES << (low & LOW_MASK)))
+                == 0)
+            low = (WORD_INDEX (low) + 1) << BITFIELD_LOG2_BITS;
+
+          if (low >= CHUNK_SIZE)
+            break;
+
+          while ((words[WORD_INDEX (low)] & WORD_BIT (low)) == 0)
+            low++;
+
+          start = low;
+
+          /* skip set bits, a word at a time where possible */
+          while (low < CHUNK_SIZE &&
+              (words[WORD_INDEX (low)] | ~(ALL_ONES << (low & LOW_MASK)))
+                == ALL_ONES)
+            low = (WORD_INDEX (low) + 1) << BITFIELD_LOG2_BITS;
+
+          while (low < CHUNK_SIZE &&
+              (words[WORD_INDEX (low)] & WORD_BIT (low)) != 0)
+            low++;
+
+          g_assert (c->n_items < c->n_allocated);
+          c->data.runs[c->n_items].start = start;
+          c->data.runs[c->n_items].length = low - 1 - start;
+          c->n_items++;
+        }
+    }
+
+  c->cardinality = cardinality;
+  g_free (words);
+}
+
+/* As for container_take_bitmap_as(), but choose the best representation */
+static void
+container_take_bitmap (Container *c,
+    guint64 *words,
+    guint cardinality)
+{
+  container_take_bitmap_as (c, words, cardinality,
+      container_best_type (cardinality, bitmap_count_runs (words)));
+}
+
+/* Convert @c to @type, keeping the same members */
+static void
+container_convert (Container *c,
+    ContainerType type)
+{
+  guint cardinality = c->cardinality;
+  guint i;
+
+  if (c->type == type)
+    return;
+
+  if (c->type == CONTAINER_ARRAY && type == CONTAINER_RUN)
+    {
+      const guint16 *items = container_array (c);
+      Container tmp;
+
+      container_init_runs (&tmp, c->key, container_count_runs (c));
+
+      for (i = 0; i < c->n_items; i++)
+        {
+          if (i > 0 && items[i] == items[i - 1] + 1)
+            {
+              tmp.data.runs[tmp.n_items - 1].length++;
+            }
+          else
+            {
+              tmp.data.runs[tmp.n_items].start = items[i];
+              tmp.data.runs[tmp.n_items].length = 0;
+              tmp.n_items++;
+            }
+        }
+
+      tmp.cardinality = cardinality;
+      container_free_data (c);
+      *c = tmp;
+    }
+  else if (c->type == CONTAINER_RUN && type == CONTAINER_ARRAY)
+    {
+      Container tmp;
+      guint16 *items;
+
+      /* leave some room to grow, so we don't immediately convert back */
+      container_init_array (&tmp, c->key,
+          MIN (cardinality * 2, ARRAY_MAX_CARDINALITY));
+      items = container_array (&tmp);
+
+      for (i = 0; i < c->n_items; i++)
+        {
+          guint low;
+
+          for (low = c->data.runs[i].start;
+              low <= run_end (c->data.runs + i);
+              low++)
+            items[tmp.n_items++] = low;
+        }
+
+      tmp.cardinality = cardinality;
+      container_free_data (c);
+      *c = tmp;
+    }
+  else
+    {
+      guint64 *words;
+
+      if (c->type == CONTAINER_BITMAP)
+        {
+          words = c->data.bitmap;
+          c->data.bitmap = NULL;
+        }
+      else
+        {
+          words = container_dup_bitmap (c);
+          container_free_data (c);
+        }
+
+      container_take_bitmap_as (c, words, cardinality, type);
+    }
+}
+
+/* Switch @c to its most compact representation */
+static void
+container_optimize (Container *c)
+{
+  container_convert (c,
+      container_best_type (c->cardinality, container_count_runs (c)));
+}
+
+/* Called after changing a run container: if it has become larger than the
+ * alternatives, convert it */
+static void
+container_check_runs (Container *c)
+{
+  gsize run_bytes = c->n_items * sizeof (Run);
+
+  if (c->cardinality == 0)
+    return;
+
+  if (run_bytes > BITMAP_BYTES ||
+      (c->cardinality <= ARRAY_MAX_CARDINALITY &&
+       run_bytes > c->cardinality * sizeof (guint16)))
+    container_optimize (c);
+}
+
+static void
+container_ensure_room (Container *c)
+{
+  if (c->n_items < c->n_allocated)
+    return;
+
+  if (c->type == CONTAINER_ARRAY)
+    {
+      container_resize_array (c,
+          MIN (c->n_allocated * 2, ARRAY_MAX_CARDINALITY));
+    }
+  else
+    {
+      c->n_allocated *= 2;
+      c->data.runs = g_renew (Run, c->data.runs, c->n_allocated);
+    }
+}
+
+/* Add @low to @c. Returns %TRUE if it was not already there. */
+static gboolean
+container_add (Container *c,
+    guint low)
+{
+  gboolean found;
+  guint i;
+  guint16 *items;
+  Run *runs;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        items = container_array (c);
+        i = array_lower_bound (items, c->n_items, low, &found);
+
+        if (found)
+          return FALSE;
+
+        if (c->n_items == c->n_allocated ||
+            c->n_items >= ARRAY_MAX_CARDINALITY)
+          {
+            /* Before growing the array, see whether it would be better
+             * as runs; this is amortized over the reallocations */
+            container_optimize (c);
+
+            if (c->type == CONTAINER_ARRAY)
+              {
+                if (c->n_items < ARRAY_MAX_CARDINALITY)
+                  container_ensure_room (c);
+                else
+                  container_convert (c, CONTAINER_BITMAP);
+              }
+
+            return container_add (c, low);
+          }
+
+        memmove (items + i + 1, items + i,
+            (c->n_items - i) * sizeof (guint16));
+        items[i] = low;
+        c->n_items++;
+        c->cardinality++;
+        return TRUE;
+
+      case CONTAINER_BITMAP:
+        if (c->data.bitmap[WORD_INDEX (low)] & WORD_BIT (low))
+          return FALSE;
+
+        c->data.bitmap[WORD_INDEX (low)] |= WORD_BIT (low);
+        c->cardinality++;
+        return TRUE;
+
+      case CONTAINER_RUN:
+        runs = c->data.runs;
+        i = runs_upper_bound (runs, c->n_items, low);
+
+        if (i > 0 && low <= run_end (runs + i - 1))
+          return FALSE;
+
+        if (i > 0 && low == run_end (runs + i - 1) + 1)
+          {
+            /* extend the previous run upwards, possibly joining it to the
+             * next one */
+            runs[i - 1].length++;
+
+            if (i < c->n_items && runs[i].start == low + 1)
+              {
+                runs[i - 1].length += runs[i].length + 1;
+                memmove (runs + i, runs + i + 1,
+                    (c->n_items - i - 1) * sizeof (Run));
+                c->n_items--;
+              }
+          }
+        else if (i < c->n_items && runs[i].start == low + 1)
+          {
+            /* extend the next run downwards */
+            runs[i].start--;
+            runs[i].length++;
+          }
+        else
+          {
+            container_ensure_room (c);
+            runs = c->data.runs;
+            memmove (runs + i + 1, runs + i,
+                (c->n_items - i) * sizeof (Run));
+            runs[i].start = low;
+            runs[i].length = 0;
+            c->n_items++;
+          }
+
+        c->cardinality++;
+        container_check_runs (c);
+        return TRUE;
+    }
+
+  g_assert_not_reached ();
+  return FALSE;
+}
+
+/* Remove @low from @c. Returns %TRUE if it was there. */
+static gboolean
+container_remove (Container *c,
+    guint low)
+{
+  gboolean found;
+  guint i, end;
+  guint16 *items;
+  Run *runs;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        items = container_array (c);
+        i = array_lower_bound (items, c->n_items, low, &found);
+
+        if (!found)
+          return FALSE;
+
+        memmove (items + i, items + i + 1,
+            (c->n_items - i - 1) * sizeof (guint16));
+        c->n_items--;
+        c->cardinality--;
+
+        if (c->n_allocated > MIN_ALLOCATED &&
+            c->n_items < c->n_allocated / 4)
+          container_resize_array (c, c->n_allocated / 2);
+
+        return TRUE;
+
+      case CONTAINER_BITMAP:
+        if ((c->data.bitmap[WORD_INDEX (low)] & WORD_BIT (low)) == 0)
+          return FALSE;
+
+        c->data.bitmap[WORD_INDEX (low)] &= ~WORD_BIT (low);
+        c->cardinality--;
+
+        /* convert back well below the threshold at which we'd convert to a
+         * bitmap, to avoid flip-flopping */
+        if (c->cardinality > 0 &&
+            c->cardinality <= ARRAY_MAX_CARDINALITY / 2)
+          container_optimize (c);
+
+        return TRUE;
+
+      case CONTAINER_RUN:
+        runs = c->data.runs;
+        i = runs_upper_bound (runs, c->n_items, low);
+
+        if (i == 0 || low > run_end (runs + i - 1))
+          return FALSE;
+
+        i--;
+        end = run_end (runs + i);
+
+        if (runs[i].length == 0)
+          {
+            memmove (runs + i, runs + i + 1,
+                (c->n_items - i - 1) * sizeof (Run));
+            c->n_items--;
+          }
+        else if (low == runs[i].start)
+          {
+            runs[i].start++;
+            runs[i].length--;
+          }
+        else if (low == end)
+          {
+            runs[i].length--;
+          }
+        else
+          {
+            /* split the run in two */
+            container_ensure_room (c);
+            runs = c->data.runs;
+            memmove (runs + i + 2, runs + i + 1,
+                (c->n_items - i - 1) * sizeof (Run));
+            runs[i].length = low - 1 - runs[i].start;
+            runs[i + 1].start = low + 1;
+            runs[i + 1].length = end - low - 1;
+            c->n_items++;
+          }
+
+        c->cardinality--;
+        container_check_runs (c);
+        return TRUE;
+    }
+
+  g_assert_not_reached ();
+  return FALSE;
+}
+
+/* Calls @func (base + low, @userdata) for each low part in @c, in order */
+static void
+container_foreach (const Container *c,
+    TpIntFunc func,
+    gpointer userdata)
+{
+  guint base = CHUNK_BASE (c->key);
+  const guint16 *items;
+  guint i;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        items = container_array (c);
+
+        for (i = 0; i < c->n_items; i++)
+          func (base | items[i], userdata);
+
+        break;
+
+      case CONTAINER_BITMAP:
+        for (i = 0; i < BITMAP_WORDS; i++)
+          {
+            guint64 w = c->data.bitmap[i];
+
+            while (w != 0)
+              {
+                func (base | (i << BITFIELD_LOG2_BITS) | lowest_bit64 (w),
+                    userdata);
+                w &= w - 1;
+              }
+          }
+
+        break;
+
+      case CONTAINER_RUN:
+        for (i = 0; i < c->n_items; i++)
+          {
+            guint low;
+
+            for (low = c->data.runs[i].start;
+                low <= run_end (c->data.runs + i);
+                low++)
+              func (base | low, userdata);
+          }
+
+        break;
+    }
+}
+
+/* If @c has a member >= @low, set @next to the smallest such member and
+ * return %TRUE */
+static gboolean
+container_find_next (const Container *c,
+    guint low,
+    guint *next)
+{
+  guint i;
+  guint64 w;
+
+  switch (c->type)
+    {
+      case CONTAINER_ARRAY:
+        i = array_lower_bound (container_array (c), c->n_items, low, NULL);
+
+        if (i >= c->n_items)
+          return FALSE;
+
+        *next = container_array (c)[i];
+        return TRUE;
+
+      case CONTAINER_BITMAP:
+        i = WORD_INDEX (low);
+        w = c->data.bitmap[i] & (ALL_ONES << (low & LOW_MASK));
+
+        while (w == 0)
+          {
+            if (++i >= BITMAP_WORDS)
+              return FALSE;
+
+            w = c->data.bitmap[i];
+          }
+
+        *next = (i << BITFIELD_LOG2_BITS) | lowest_bit64 (w);
+        return TRUE;
+
+      case CONTAINER_RUN:
+        i = runs_upper_bound (c->data.runs, c->n_items, low);
+
+        if (i > 0 && low <= run_end (c->data.runs + i - 1))
+          {
+            *next = low;
+            return TRUE;
+          }
+
+        if (i >= c->n_items)
+          return FALSE;
+
+        *next = c->data.runs[i].start;
+        return TRUE;
+    }
+
+  g_assert_not_reached ();
+  return FALSE;
+}
+
+static void
+container_copy (Container *dest,
+    const Container *src)
+{
+  *dest = *src;
+
+  switch (src->type)
+    {
+      case CONTAINER_ARRAY:
+        container_init_array (dest, src->key, src->n_items);
+        memcpy (container_array (dest), container_array (src),
+            src->n_items * sizeof (guint16));
+        dest->n_items = src->n_items;
+        dest->cardinality = src->cardinality;
+        break;
+
+      case CONTAINER_BITMAP:
+        dest->data.bitmap = g_memdup (src->data.bitmap, BITMAP_BYTES);
+        break;
+
+      case CONTAINER_RUN:
+        dest->n_allocated = MAX (src->n_items, MIN_ALLOCATED);
+        dest->data.runs = g_new (Run, dest->n_allocated);
+        memcpy (dest->data.runs, src->data.runs,
+            src->n_items * sizeof (Run));
+        break;
+    }
+}
+
+/* Set @dest to (@left OP @right), where both arrays are sorted */
+static void
+array_merge (Container *dest,
+    const Container *left,
+    const Container *right,
+    SetOp op)
+{
+  const guint16 *l = container_array (left);
+  const guint16 *r = container_array (right);
+  guint i = 0, j = 0;
+  guint16 *out;
+
+  container_init_array (dest, left->key, left->n_items +
+      (op == OP_OR || op == OP_XOR ? right->n_items : 0));
+  out = container_array (dest);
+
+  while (i < left->n_items && j < right->n_items)
+    {
+      if (l[i] < r[j])
+        {
+          if (op != OP_AND)
+            out[dest->n_items++] = l[i];
+
+          i++;
+        }
+      else if (l[i] > r[j])
+        {
+          if (op == OP_OR || op == OP_XOR)
+            out[dest->n_items++] = r[j];
+
+          j++;
+        }
+      else
+        {
+          if (op == OP_AND || op == OP_OR)
+            out[dest->n_items++] = l[i];
+
+          i++;
+          j++;
+        }
+    }
+
+  if (op != OP_AND)
+    {
+      for (; i < left->n_items; i++)
+        out[dest->n_items++] = l[i];
+    }
+
+  if (op == OP_OR || op == OP_XOR)
+    {
+      for (; j < right->n_items; j++)
+        out[dest->n_items++] = r[j];
+    }
+
+  dest->cardinality = dest->n_items;
+}
+
+/* Apply @op to @words, a bitmap, with @other as the right-hand side */
+static void
+bitmap_apply_container (guint64 *words,
+    const Container *other,
+    SetOp op)
+{
+  const guint16 *items;
+  guint i;
+
+  switch (other->type)
+    {
+      case CONTAINER_BITMAP:
+        bitmap_op (words, words, other->data.bitmap, op);
+        break;
+
+      case CONTAINER_ARRAY:
+        if (op == OP_AND)
+          {
+            guint64 *tmp = container_dup_bitmap (other);
+
+            bitmap_op (words, words, tmp, op);
+            g_free (tmp);
+            break;
+          }
+
+        items = container_array (other);
+
+        for (i = 0; i < other->n_items; i++)
+          bitmap_range_op (words, items[i], items[i], op);
+
+        break;
+
+      case CONTAINER_RUN:
+        if (op == OP_AND)
+          {
+            guint next = 0;
+
+            /* clear everything between the runs */
+            for (i = 0; i < other->n_items; i++)
+              {
+                if (other->data.runs[i].start > next)
+                  bitmap_range_op (words, next,
+                      other->data.runs[i].start - 1, OP_ANDNOT);
+
+                next = run_end (other->data.runs + i) + 1;
+              }
+
+            if (next < CHUNK_SIZE)
+              bitmap_range_op (words, next, CHUNK_SIZE - 1, OP_ANDNOT);
+
+            break;
+          }
+
+        for (i = 0; i < other->n_items; i++)
+          bitmap_range_op (words, other->data.runs[i].start,
+              run_end (other->data.runs + i), op);
+
+        break;
+    }
+}
+
+/* Set @dest to the members of @src for which container_contains (@filter)
+ * is @wanted */
+static void
+container_filter (Container *dest,
+    const Container *src,
+    const Container *filter,
+    gboolean wanted)
+{
+  const guint16 *in = container_array (src);
+  guint16 *out;
+  guint i;
+
+  g_assert (src->type == CONTAINER_ARRAY);
+  container_init_array (dest, src->key, src->n_items);
+  out = container_array (dest);
+
+  for (i = 0; i < src->n_items; i++)
+    {
+      if (!container_contains (filter, in[i]) == !wanted)
+        out[dest->n_items++] = in[i];
+    }
+
+  dest->cardinality = dest->n_items;
+}
+
+/* Set @dest, which must not have any data, to (@left OP @right). Returns
+ * %FALSE and leaves @dest without data if the result is empty. */
+static gboolean
+container_op (Container *dest,
+    const Container *left,
+    const Container *right,
+    SetOp op)
+{
+  guint64 *words;
+  guint cardinality;
+
+  g_assert (left->key == right->key);
+
+  if (left->type == CONTAINER_ARRAY && right->type == CONTAINER_ARRAY)
+    {
+      array_merge (dest, left, right, op);
+
+      if (dest->cardinality == 0)
+        {
+          container_free_data (dest);
+          return FALSE;
+        }
+
+      container_optimize (dest);
+      return TRUE;
+    }
+
+  if (left->type == CONTAINER_ARRAY && (op == OP_AND || op == OP_ANDNOT))
+    {
+      container_filter (dest, left, right, (op == OP_AND));
+    }
+  else if (right->type == CONTAINER_ARRAY && op == OP_AND)
+    {
+      container_filter (dest, right, left, TRUE);
+    }
+  else
+    {
+      words = container_dup_bitmap (left);
+      bitmap_apply_container (words, right, op);
+      cardinality = bitmap_count (words);
+
+      if (cardinality == 0)
+        {
+          g_free (words);
+          return FALSE;
+        }
+
+      dest->key = left->key;
+      container_take_bitmap (dest, words, cardinality);
+      return TRUE;
+    }
+
+  if (dest->cardinality == 0)
+    {
+      container_free_data (dest);
+      return FALSE;
+    }
+
+  container_optimize (dest);
+  return TRUE;
+}
+
+/* Set @self to (@self OP @other). Returns %FALSE, leaving @self without
+ * data, if the result is empty. */
+static gboolean
+container_op_update (Container *self,
+    const Container *other,
+    SetOp op)
+{
+  Container tmp;
+  gboolean ok;
+
+  g_assert (self->key == other->key);
+
+  if (self->type == CONTAINER_BITMAP)
+    {
+      guint cardinality;
+      guint64 *words = self->data.bitmap;
+
+      bitmap_apply_container (words, other, op);
+      cardinality = bitmap_count (words);
+
+      if (cardinality == 0)
+        {
+          container_free_data (self);
+          return FALSE;
+        }
+
+      self->data.bitmap = NULL;
+      container_take_bitmap (self, words, cardinality);
+      return TRUE;
+    }
+
+  /* For a few changes to a large set, which is what TpHandleSet and the
+   * group mixin usually do, editing in place beats rebuilding */
+  if (other->type == CONTAINER_ARRAY && op != OP_AND &&
+      other->n_items * 8 < self->cardinality)
+    {
+      guint i;
+
+      for (i = 0; i < other->n_items; i++)
+        {
+          guint low = container_array (other)[i];
+
+          if (op == OP_OR)
+            container_add (self, low);
+          else if (op == OP_ANDNOT)
+            container_remove (self, low);
+          else if (!container_remove (self, low))
+            container_add (self, low);
+        }
+
+      if (self->cardinality == 0)
+        {
+          container_free_data (self);
+          return FALSE;
+        }
+
+      return TRUE;
+    }
+
+  ok = container_op (&tmp, self, other, op);
+  container_free_data (self);
+
+  if (ok)
+    *self = tmp;
+
+  return ok;
+}
+
+static gboolean
+container_is_equal (const Container *left,
+    const Container *right)
+{
+  Container tmp;
+
+  if (left->key != right->key ||
+      left->cardinality != right->cardinality)
+    return FALSE;
+
+  if (left->type == right->type)
+    {
+      switch (left->type)
+        {
+          case CONTAINER_ARRAY:
+            return (memcmp (container_array (left), container_array (right),
+                  left->n_items * sizeof (guint16)) == 0);
+
+          case CONTAINER_BITMAP:
+            return (memcmp (left->data.bitmap, right->data.bitmap,
+                  BITMAP_BYTES) == 0);
+
+          case CONTAINER_RUN:
+            /* runs are canonical: never adjacent or overlapping */
+            return (left->n_items == right->n_items &&
+                memcmp (left->data.runs, right->data.runs,
+                  left->n_items * sizeof (Run)) == 0);
+        }
+    }
+
+  if (container_op (&tmp, left, right, OP_XOR))
+    {
+      container_free_data (&tmp);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* ---- The set itself ---- */
+
+#define intset_container(set, i) (&(set)->containers[(i)])
+
+/* Set the number of containers in @set to @n, without initializing any new
+ * ones */
+static void
+intset_set_n_containers (TpIntset *set,
+    guint n)
+{
+  if (n > set->n_allocated)
+    {
+      guint n_allocated = MAX (n, set->n_allocated * 2);
+
+      if (set->containers == &set->first)
+        {
+          set->containers = g_new (Container, n_allocated);
+          memcpy (set->containers, &set->first,
+              set->n_containers * sizeof (Container));
+        }
+      else
+        {
+          set->containers = g_renew (Container, set->containers,
+              n_allocated);
+        }
+
+      set->n_allocated = n_allocated;
+    }
+
+  set->n_containers = n;
+}
+
+static void
+intset_insert_container (TpIntset *set,
+    guint i,
+    const Container *c)
+{
+  intset_set_n_containers (set, set->n_containers + 1);
+  memmove (set->containers + i + 1, set->containers + i,
+      (set->n_containers - i - 1) * sizeof (Container));
+  set->containers[i] = *c;
 }
 
-/**
- * tp_intset_iter_reset:
- * @iter: An integer set iterator to be reset.
- *
- * Reset the iterator @iter to the beginning. It must already be associated
- * with a set.
- *
- * Deprecated: since 0.19.0. Use #TpIntsetFastIter instead
- */
-void
-tp_intset_iter_reset (TpIntsetIter *iter)
+static void
+intset_remove_container (TpIntset *set,
+    guint i)
 {
-  g_return_if_fail (iter != NULL);
-  g_return_if_fail (iter->set != NULL);
-  iter->element = (guint)(-1);
+  memmove (set->containers + i, set->containers + i + 1,
+      (set->n_containers - i - 1) * sizeof (Container));
+  set->n_containers--;
 }
 
-/**
- * TpIntset:
- *
- * Opaque type representing a set of unsigned integers.
- *
- * Before 0.11.16, this type was called <type>TpIntSet</type>, which is
- * now a backwards compatibility typedef.
- */
+/* Return the index of the first container in @set whose key is >= @key,
+ * and set @found to whether its key is @key */
+static guint
+intset_lower_bound (const TpIntset *set,
+    guint key,
+    gboolean *found)
+{
+  guint lo = 0, hi = set->n_containers;
 
-struct _TpIntset
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (intset_container (set, mid)->key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (found != NULL)
+    *found = (lo < set->n_containers &&
+        intset_container (set, lo)->key == key);
+
+  return lo;
+}
+
+static Container *
+intset_lookup (const TpIntset *set,
+    guint element)
 {
-  /* HIGH_PART(n) => bitfield where bit LOW_PART(n) is set if n is present.
-   *
-   * For instance, when using 32-bit values, the set { 5, 23 } is represented
-   * by the map { 0 => (1 << 23 | 1 << 5) }, and the set { 1, 32, 42 } is
-   * represented by the map { 0 => (1 << 1), 32 => (1 << 10 | 1 << 0) }. */
-  GHashTable *table;
-  guint largest_ever;
-};
+  gboolean found;
+  guint i = intset_lower_bound (set, CHUNK_KEY (element), &found);
 
-/*
- * Update @set's largest_ever member to be at least as large as everything
- * that could be encoded in the hash table key @key.
- *
- * We could use g_bit_nth_msf (value, BITFIELD_BITS) instead of LOW_MASK if we
- * wanted to get largest_ever exactly right, but we just need something
- * reasonable to make TpIntsetIter terminate early, and carrying on for up to
- * BITFIELD_BITS extra iterations isn't a problem.
- */
-static inline void
-intset_update_largest_ever (TpIntset *set,
-    gpointer key)
+  if (found)
+    return intset_container (set, i);
+
+  return NULL;
+}
+
+/* If @set has a member >= @element, set @next to the smallest such member
+ * and return %TRUE */
+static gboolean
+intset_find_next (const TpIntset *set,
+    guint element,
+    guint *next)
 {
-  guint upper_bound = GPOINTER_TO_UINT (key) | LOW_MASK;
+  guint i = intset_lower_bound (set, CHUNK_KEY (element), NULL);
+
+  for (; i < set->n_containers; i++)
+    {
+      const Container *c = intset_container (set, i);
+      guint low = (c->key == CHUNK_KEY (element) ? CHUNK_LOW (element) : 0);
+
+      if (container_find_next (c, low, &low))
+        {
+          *next = CHUNK_BASE (c->key) | low;
+          return TRUE;
+        }
+    }
 
-  if (set->largest_ever < upper_bound)
-    set->largest_ever = upper_bound;
+  return FALSE;
 }
 
 /**
@@ -243,10 +2021,11 @@ tp_intset_sized_new (guint size G_GNUC_UNUSED)
 TpIntset *
 tp_intset_new ()
 {
-  TpIntset *set = g_slice_new (TpIntset);
+  TpIntset *set = _tp_slice_new_tagged (_TP_ALLOC_INTSET, TpIntset);
 
-  set->table = g_hash_table_new (NULL, NULL);
-  set->largest_ever = 0;
+  set->containers = &set->first;
+  set->n_containers = 0;
+  set->n_allocated = 1;
   return set;
 }
 
@@ -282,8 +2061,8 @@ tp_intset_destroy (TpIntset *set)
 {
   g_return_if_fail (set != NULL);
 
-  g_hash_table_unref (set->table);
-  g_slice_free (TpIntset, set);
+  tp_intset_clear (set);
+  _tp_slice_free_tagged (_TP_ALLOC_INTSET, TpIntset, set);
 }
 
 /**
@@ -295,9 +2074,21 @@ tp_intset_destroy (TpIntset *set)
 void
 tp_intset_clear (TpIntset *set)
 {
+  guint i;
+
   g_return_if_fail (set != NULL);
 
-  g_hash_table_remove_all (set->table);
+  for (i = 0; i < set->n_containers; i++)
+    container_free_data (intset_container (set, i));
+
+  if (set->containers != &set->first)
+    {
+      g_free (set->containers);
+      set->containers = &set->first;
+      set->n_allocated = 1;
+    }
+
+  set->n_containers = 0;
 }
 
 /**
@@ -311,20 +2102,22 @@ void
 tp_intset_add (TpIntset *set,
     guint element)
 {
-  gpointer key = GSIZE_TO_POINTER ((gsize) HIGH_PART (element));
-  gsize bit = LOW_PART (element);
-  gpointer old_value, new_value;
+  gboolean found;
+  guint i;
 
   g_return_if_fail (set != NULL);
 
-  old_value = g_hash_table_lookup (set->table, key);
-  new_value = GSIZE_TO_POINTER (GPOINTER_TO_SIZE (old_value) | (1 << bit));
+  i = intset_lower_bound (set, CHUNK_KEY (element), &found);
+
+  if (!found)
+    {
+      Container c;
 
-  if (old_value != new_value)
-    g_hash_table_insert (set->table, key, new_value);
+      container_init_array (&c, CHUNK_KEY (element), MIN_ALLOCATED);
+      intset_insert_container (set, i, &c);
+    }
 
-  if (element > set->largest_ever)
-    set->largest_ever = element;
+  container_add (intset_container (set, i), CHUNK_LOW (element));
 }
 
 /**
@@ -340,38 +2133,38 @@ gboolean
 tp_intset_remove (TpIntset *set,
     guint element)
 {
-  gpointer key = GSIZE_TO_POINTER ((gsize) HIGH_PART (element));
-  gsize bit = LOW_PART (element);
-  gpointer old_value, new_value;
+  gboolean found;
+  guint i;
+  Container *c;
 
   g_return_val_if_fail (set != NULL, FALSE);
 
-  old_value = g_hash_table_lookup (set->table, key);
-  new_value = GSIZE_TO_POINTER (GPOINTER_TO_SIZE (old_value) & ~ (1 << bit));
+  i = intset_lower_bound (set, CHUNK_KEY (element), &found);
 
-  if (old_value != new_value)
-    {
-      if (new_value == NULL)
-        g_hash_table_remove (set->table, key);
-      else
-        g_hash_table_insert (set->table, key, new_value);
+  if (!found)
+    return FALSE;
 
-      return TRUE;
+  c = intset_container (set, i);
+
+  if (!container_remove (c, CHUNK_LOW (element)))
+    return FALSE;
+
+  if (c->cardinality == 0)
+    {
+      container_free_data (c);
+      intset_remove_container (set, i);
     }
 
-  return FALSE;
+  return TRUE;
 }
 
 static inline gboolean
 _tp_intset_is_member (const TpIntset *set,
     guint element)
 {
-  gpointer key = GSIZE_TO_POINTER ((gsize) HIGH_PART (element));
-  gsize bit = LOW_PART (element);
-  gpointer value;
+  const Container *c = intset_lookup (set, element);
 
-  value = g_hash_table_lookup (set->table, key);
-  return ((GPOINTER_TO_SIZE (value) & (1 << bit)) != 0);
+  return (c != NULL && container_contains (c, CHUNK_LOW (element)));
 }
 
 /**
@@ -405,36 +2198,200 @@ tp_intset_foreach (const TpIntset *set,
     TpIntFunc func,
     gpointer userdata)
 {
-  gsize high_part, low_part;
+  guint i;
 
   g_return_if_fail (set != NULL);
   g_return_if_fail (func != NULL);
 
-  for (high_part = 0;
-      high_part <= set->largest_ever;
-      high_part += BITFIELD_BITS)
-    {
-      gsize entry = GPOINTER_TO_SIZE (g_hash_table_lookup (set->table,
-            GSIZE_TO_POINTER (high_part)));
+  for (i = 0; i < set->n_containers; i++)
+    container_foreach (intset_container (set, i), func, userdata);
+}
+
+/* Initialize @c to contain the @n_elements integers in @elements, which are
+ * sorted in ascending order (possibly with duplicates) and all in the same
+ * chunk; @n_elements must be at least 1 */
+static void
+container_init_from_sorted (Container *c,
+    const guint *elements,
+    guint n_elements)
+{
+  guint key = CHUNK_KEY (elements[0]);
+  guint cardinality = 1, n_runs = 1;
+  guint16 *items;
+  guint i;
 
-      if (entry == 0)
+  /* first pass: count the distinct members, and the runs */
+  for (i = 1; i < n_elements; i++)
+    {
+      if (elements[i] == elements[i - 1])
         continue;
 
-      for (low_part = 0; low_part < BITFIELD_BITS; low_part++)
+      cardinality++;
+
+      if (elements[i] != elements[i - 1] + 1)
+        n_runs++;
+    }
+
+  /* second pass: fill in the best representation */
+  switch (container_best_type (cardinality, n_runs))
+    {
+      case CONTAINER_ARRAY:
+        container_init_array (c, key, cardinality);
+        items = container_array (c);
+
+        for (i = 0; i < n_elements; i++)
+          {
+            if (i == 0 || elements[i] != elements[i - 1])
+              items[c->n_items++] = CHUNK_LOW (elements[i]);
+          }
+
+        break;
+
+      case CONTAINER_RUN:
+        container_init_runs (c, key, n_runs);
+
+        for (i = 0; i < n_elements; i++)
+          {
+            guint low = CHUNK_LOW (elements[i]);
+
+            if (i > 0 && elements[i] == elements[i - 1])
+              continue;
+
+            if (i > 0 && elements[i] == elements[i - 1] + 1)
+              {
+                c->data.runs[c->n_items - 1].length++;
+              }
+            else
+              {
+                c->data.runs[c->n_items].start = low;
+                c->data.runs[c->n_items].length = 0;
+                c->n_items++;
+              }
+          }
+
+        break;
+
+      case CONTAINER_BITMAP:
         {
-          if (entry & (1 << low_part))
+          guint64 *words = g_new0 (guint64, BITMAP_WORDS);
+
+          for (i = 0; i < n_elements; i++)
             {
-              func (high_part + low_part, userdata);
+              guint low = CHUNK_LOW (elements[i]);
+
+              words[WORD_INDEX (low)] |= WORD_BIT (low);
             }
+
+          c->key = key;
+          container_take_bitmap_as (c, words, cardinality, CONTAINER_BITMAP);
         }
+
+        break;
     }
+
+  c->cardinality = cardinality;
 }
 
-static void
-addint (guint i, gpointer data)
+static gint
+compare_uint (gconstpointer a,
+    gconstpointer b)
+{
+  guint left = *(const guint *) a;
+  guint right = *(const guint *) b;
+
+  return (left < right) ? -1 : (left > right) ? 1 : 0;
+}
+
+static gboolean
+elements_are_sorted (const guint *elements,
+    guint n_elements)
+{
+  guint i;
+
+  for (i = 1; i < n_elements; i++)
+    {
+      if (elements[i] < elements[i - 1])
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * tp_intset_new_from_sorted:
+ * @elements: (array length=n_elements): integers in ascending order, possibly
+ *  with duplicates
+ * @n_elements: the number of integers in @elements
+ *
+ * Build a set from integers that have already been sorted. This is much
+ * faster than adding them one at a time, because each part of the set is
+ * built in one pass, in its final representation.
+ *
+ * Returns: (transfer full): a set containing the integers in @elements, to
+ *  be freed with tp_intset_destroy() by the caller
+ *
+ * Since: 0.UNRELEASED
+ */
+TpIntset *
+tp_intset_new_from_sorted (const guint *elements,
+    guint n_elements)
+{
+  TpIntset *set;
+  guint i = 0;
+
+  g_return_val_if_fail (elements != NULL || n_elements == 0, NULL);
+  g_return_val_if_fail (elements_are_sorted (elements, n_elements), NULL);
+
+  set = tp_intset_new ();
+
+  while (i < n_elements)
+    {
+      guint key = CHUNK_KEY (elements[i]);
+      guint end;
+      Container c;
+
+      for (end = i + 1;
+          end < n_elements && CHUNK_KEY (elements[end]) == key;
+          end++)
+        ;
+
+      container_init_from_sorted (&c, elements + i, end - i);
+      intset_insert_container (set, set->n_containers, &c);
+      i = end;
+    }
+
+  return set;
+}
+
+/**
+ * tp_intset_to_buffer:
+ * @set: a set of integers
+ * @buffer: (array length=n_elements) (out caller-allocates): a buffer with
+ *  room for @n_elements integers
+ * @n_elements: the size of @buffer
+ *
+ * Copy the members of @set into @buffer in ascending order, stopping when
+ * @buffer is full. Using tp_intset_size() to size the buffer first, this
+ * exports the whole set without any reallocation.
+ *
+ * Returns: the number of integers written to @buffer
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_intset_to_buffer (const TpIntset *set,
+    guint *buffer,
+    guint n_elements)
 {
-  GArray *array = (GArray *) data;
-  g_array_append_val (array, i);
+  TpIntsetFastIter iter;
+
+  g_return_val_if_fail (set != NULL, 0);
+  g_return_val_if_fail (buffer != NULL || n_elements == 0, 0);
+
+  /* this relies on the fast iterator being in ascending order, which is
+   * not part of its API, but is true */
+  tp_intset_fast_iter_init (&iter, set);
+  return tp_intset_fast_iter_next_batch (&iter, buffer, n_elements);
 }
 
 /**
@@ -450,12 +2407,15 @@ GArray *
 tp_intset_to_array (const TpIntset *set)
 {
   GArray *array;
+  guint size;
 
   g_return_val_if_fail (set != NULL, NULL);
 
-  array = g_array_new (FALSE, TRUE, sizeof (guint));
+  size = tp_intset_size (set);
+  array = g_array_sized_new (FALSE, TRUE, sizeof (guint), size);
+  g_array_set_size (array, size);
 
-  tp_intset_foreach (set, addint, array);
+  tp_intset_to_buffer (set, (guint *) array->data, size);
 
   return array;
 }
@@ -474,30 +2434,24 @@ TpIntset *
 tp_intset_from_array (const GArray *array)
 {
   TpIntset *set;
-  guint i;
+  guint *sorted;
 
   g_return_val_if_fail (array != NULL, NULL);
 
-  set = tp_intset_new ();
+  if (elements_are_sorted ((const guint *) array->data, array->len))
+    return tp_intset_new_from_sorted ((const guint *) array->data,
+        array->len);
 
-  for (i = 0; i < array->len; i++)
-    {
-      tp_intset_add (set, g_array_index (array, guint, i));
-    }
+  /* sorting a copy and building the set in one pass is quicker than
+   * inserting the elements in random order */
+  sorted = g_memdup (array->data, array->len * sizeof (guint));
+  qsort (sorted, array->len, sizeof (guint), compare_uint);
+  set = tp_intset_new_from_sorted (sorted, array->len);
+  g_free (sorted);
 
   return set;
 }
 
-/* these magic numbers would need adjusting for 64-bit storage */
-G_STATIC_ASSERT (BITFIELD_BITS == 32);
-
-static inline guint
-count_bits32 (guint32 n)
-{
-  n = n - ((n >> 1) & 033333333333) - ((n >> 2) & 011111111111);
-  return ((n + (n >> 3)) & 030707070707) % 63;
-}
-
 /**
  * tp_intset_size:
  * @set: A set of integers
@@ -511,17 +2465,12 @@ guint
 tp_intset_size (const TpIntset *set)
 {
   guint count = 0;
-  gpointer entry;
-  GHashTableIter iter;
+  guint i;
 
   g_return_val_if_fail (set != NULL, 0);
 
-  g_hash_table_iter_init (&iter, (GHashTable *) set->table);
-
-  while (g_hash_table_iter_next (&iter, NULL, &entry))
-    {
-      count += count_bits32 (GPOINTER_TO_SIZE (entry));
-    }
+  for (i = 0; i < set->n_containers; i++)
+    count += intset_container (set, i)->cardinality;
 
   return count;
 }
@@ -541,7 +2490,7 @@ gboolean
 tp_intset_is_empty (const TpIntset *set)
 {
   g_return_val_if_fail (set != NULL, TRUE);
-  return (g_hash_table_size (set->table) == 0);
+  return (set->n_containers == 0);
 }
 
 /**
@@ -558,23 +2507,19 @@ gboolean
 tp_intset_is_equal (const TpIntset *left,
     const TpIntset *right)
 {
-  gpointer key, value;
-  GHashTableIter iter;
+  guint i;
 
   g_return_val_if_fail (left != NULL, FALSE);
   g_return_val_if_fail (right != NULL, FALSE);
 
-  if (g_hash_table_size (left->table) != g_hash_table_size (right->table))
+  if (left->n_containers != right->n_containers)
     return FALSE;
 
-  g_hash_table_iter_init (&iter, (GHashTable *) left->table);
-
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (i = 0; i < left->n_containers; i++)
     {
-      if (g_hash_table_lookup (right->table, key) != value)
-        {
-          return FALSE;
-        }
+      if (!container_is_equal (intset_container (left, i),
+            intset_container (right, i)))
+        return FALSE;
     }
 
   return TRUE;
@@ -594,21 +2539,16 @@ tp_intset_is_equal (const TpIntset *left,
 TpIntset *
 tp_intset_copy (const TpIntset *orig)
 {
-  gpointer key, value;
-  GHashTableIter iter;
   TpIntset *ret;
+  guint i;
 
   g_return_val_if_fail (orig != NULL, NULL);
 
   ret = tp_intset_new ();
+  intset_set_n_containers (ret, orig->n_containers);
 
-  g_hash_table_iter_init (&iter, (GHashTable *) orig->table);
-
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    {
-      intset_update_largest_ever (ret, key);
-      g_hash_table_insert (ret->table, key, value);
-    }
+  for (i = 0; i < orig->n_containers; i++)
+    container_copy (intset_container (ret, i), intset_container (orig, i));
 
   return ret;
 }
@@ -629,24 +2569,36 @@ tp_intset_copy (const TpIntset *orig)
 TpIntset *
 tp_intset_intersection (const TpIntset *left, const TpIntset *right)
 {
-  gpointer key, value;
-  GHashTableIter iter;
   TpIntset *ret;
+  guint i = 0, j = 0;
 
-  ret = tp_intset_new ();
+  g_return_val_if_fail (left != NULL, NULL);
+  g_return_val_if_fail (right != NULL, NULL);
 
-  g_hash_table_iter_init (&iter, (GHashTable *) left->table);
+  ret = tp_intset_new ();
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  while (i < left->n_containers && j < right->n_containers)
     {
-      gsize v = GPOINTER_TO_SIZE (value);
+      const Container *l = intset_container (left, i);
+      const Container *r = intset_container (right, j);
 
-      v &= GPOINTER_TO_SIZE (g_hash_table_lookup (right->table, key));
-
-      if (v != 0)
+      if (l->key < r->key)
+        {
+          i++;
+        }
+      else if (l->key > r->key)
+        {
+          j++;
+        }
+      else
         {
-          intset_update_largest_ever (ret, key);
-          g_hash_table_insert (ret->table, key, GSIZE_TO_POINTER (v));
+          Container c;
+
+          if (container_op (&c, l, r, OP_AND))
+            intset_insert_container (ret, ret->n_containers, &c);
+
+          i++;
+          j++;
         }
     }
 
@@ -690,19 +2642,64 @@ void
 tp_intset_union_update (TpIntset *self,
     const TpIntset *other)
 {
-  gpointer key, value;
-  GHashTableIter iter;
+  guint n_self, n_other, n_new = 0;
+  guint i, j, k;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
+
+  n_self = self->n_containers;
+  n_other = other->n_containers;
+
+  /* count the containers in @other that @self doesn't have */
+  for (i = 0, j = 0; j < n_other; j++)
+    {
+      guint key = intset_container (other, j)->key;
+
+      while (i < n_self && intset_container (self, i)->key < key)
+        i++;
+
+      if (i >= n_self || intset_container (self, i)->key != key)
+        n_new++;
+    }
+
+  intset_set_n_containers (self, n_self + n_new);
 
-  g_hash_table_iter_init (&iter, (GHashTable *) other->table);
+  /* merge from the end backwards, so the containers can be moved up in
+   * place to make room */
+  i = n_self;
+  j = n_other;
+  k = n_self + n_new;
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  while (j > 0)
     {
-      gsize v = GPOINTER_TO_SIZE (value);
+      const Container *o = intset_container (other, j - 1);
+      Container *s = (i > 0 ? intset_container (self, i - 1) : NULL);
 
-      intset_update_largest_ever (self, key);
-      v |= GPOINTER_TO_SIZE (g_hash_table_lookup (self->table, key));
-      g_hash_table_insert (self->table, key, GSIZE_TO_POINTER (v));
+      k--;
+
+      if (s != NULL && s->key > o->key)
+        {
+          *intset_container (self, k) = *s;
+          i--;
+        }
+      else if (s != NULL && s->key == o->key)
+        {
+          /* a union with a non-empty container can't be empty */
+          container_op_update (s, o, OP_OR);
+          *intset_container (self, k) = *s;
+          i--;
+          j--;
+        }
+      else
+        {
+          container_copy (intset_container (self, k), o);
+          j--;
+        }
     }
+
+  /* the containers before index i haven't moved */
+  g_assert (k == i);
 }
 
 /**
@@ -745,23 +2742,35 @@ void
 tp_intset_difference_update (TpIntset *self,
     const TpIntset *other)
 {
-  gpointer key, value;
-  GHashTableIter iter;
+  guint i, j = 0, kept = 0;
 
-  g_hash_table_iter_init (&iter, (GHashTable *) other->table);
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (other != NULL);
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for (i = 0; i < self->n_containers; i++)
     {
-      gsize v = GPOINTER_TO_SIZE (value);
-      v = (GPOINTER_TO_SIZE (g_hash_table_lookup (self->table, key))) & ~v;
+      Container *s = intset_container (self, i);
+      gboolean keep = TRUE;
 
-      /* No need to update largest_ever here - we're only deleting members. */
+      while (j < other->n_containers &&
+          intset_container (other, j)->key < s->key)
+        j++;
 
-      if (v == 0)
-        g_hash_table_remove (self->table, key);
-      else
-        g_hash_table_insert (self->table, key, GSIZE_TO_POINTER (v));
+      if (j < other->n_containers &&
+          intset_container (other, j)->key == s->key)
+        keep = container_op_update (s, intset_container (other, j),
+            OP_ANDNOT);
+
+      if (keep)
+        {
+          if (kept != i)
+            *intset_container (self, kept) = *s;
+
+          kept++;
+        }
     }
+
+  intset_set_n_containers (self, kept);
 }
 
 /**
@@ -780,27 +2789,45 @@ TpIntset *
 tp_intset_symmetric_difference (const TpIntset *left, const TpIntset *right)
 {
   TpIntset *ret;
-  gpointer key, value;
-  GHashTableIter iter;
+  guint i = 0, j = 0;
 
   g_return_val_if_fail (left != NULL, NULL);
   g_return_val_if_fail (right != NULL, NULL);
 
-  ret = tp_intset_copy (left);
-
-  g_hash_table_iter_init (&iter, (GHashTable *) right->table);
+  ret = tp_intset_new ();
 
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  while (i < left->n_containers || j < right->n_containers)
     {
-      gsize v = GPOINTER_TO_SIZE (value);
-      v = v ^ GPOINTER_TO_SIZE (g_hash_table_lookup (ret->table, key));
+      const Container *l = NULL;
+      const Container *r = NULL;
+      Container c;
 
-      /* No need to update largest_ever here - we're only deleting members. */
+      if (i < left->n_containers)
+        l = intset_container (left, i);
 
-      if (v == 0)
-        g_hash_table_remove (ret->table, key);
+      if (j < right->n_containers)
+        r = intset_container (right, j);
+
+      if (r == NULL || (l != NULL && l->key < r->key))
+        {
+          container_copy (&c, l);
+          intset_insert_container (ret, ret->n_containers, &c);
+          i++;
+        }
+      else if (l == NULL || l->key > r->key)
+        {
+          container_copy (&c, r);
+          intset_insert_container (ret, ret->n_containers, &c);
+          j++;
+        }
       else
-        g_hash_table_insert (ret->table, key, GSIZE_TO_POINTER (v));
+        {
+          if (container_op (&c, l, r, OP_XOR))
+            intset_insert_container (ret, ret->n_containers, &c);
+
+          i++;
+          j++;
+        }
     }
 
   return ret;
@@ -860,29 +2887,17 @@ tp_intset_dump (const TpIntset *set)
 gboolean
 tp_intset_iter_next (TpIntsetIter *iter)
 {
+  guint next;
+
   g_return_val_if_fail (iter != NULL, FALSE);
   g_return_val_if_fail (iter->set != NULL, FALSE);
 
-  do
-    {
-      if (iter->element == (guint)(-1))
-        {
-          /* only just started */
-          iter->element = 0;
-        }
-      else
-        {
-          ++iter->element;
-        }
+  if (!intset_find_next (iter->set,
+        (iter->element == (guint)(-1) ? 0 : iter->element + 1), &next))
+    return FALSE;
 
-      if (_tp_intset_is_member (iter->set, iter->element))
-        {
-          return TRUE;
-        }
-    }
-  while (iter->element < iter->set->largest_ever &&
-      iter->element != (guint)(-1));
-  return FALSE;
+  iter->element = next;
+  return TRUE;
 }
 
 /**
@@ -921,10 +2936,16 @@ tp_intset_iter_next (TpIntsetIter *iter)
  */
 
 typedef struct {
-    GHashTableIter hash_iter;
-    gboolean ok;
-    gsize high_part;
-    gsize bitfield;
+    const TpIntset *set;
+    /* index of the current container */
+    guint container;
+    /* index of the next item in an array container, the next word in a
+     * bitmap container, or the current run in a run container */
+    guint position;
+    /* the next member of the current run, relative to its start */
+    guint offset;
+    /* bits of the current bitmap word that have not been returned yet */
+    guint64 bitfield;
 } RealFastIter;
 
 G_STATIC_ASSERT (sizeof (TpIntsetFastIter) >= sizeof (RealFastIter));
@@ -945,12 +2966,120 @@ tp_intset_fast_iter_init (TpIntsetFastIter *iter,
 {
   RealFastIter *real = (RealFastIter *) iter;
   g_return_if_fail (set != NULL);
-  g_return_if_fail (set->table != NULL);
+  g_return_if_fail (set->containers != NULL);
 
-  g_hash_table_iter_init (&real->hash_iter, (GHashTable *) set->table);
+  real->set = set;
+  real->container = 0;
+  real->position = 0;
+  real->offset = 0;
   real->bitfield = 0;
-  real->high_part = 0;
-  real->ok = TRUE;
+}
+
+/**
+ * tp_intset_fast_iter_next_batch:
+ * @iter: an iterator
+ * @output: (array length=n_elements) (out caller-allocates): a buffer with
+ *  room for @n_elements integers
+ * @n_elements: the size of @output
+ *
+ * Advance @iter by up to @n_elements members, storing them in @output. This
+ * is equivalent to calling tp_intset_fast_iter_next() up to @n_elements
+ * times, but cheaper. As with tp_intset_fast_iter_next(), iteration is not
+ * necessarily in numerical order.
+ *
+ * Returns: the number of integers written to @output, which is less than
+ *  @n_elements (possibly 0) if the end of the set has been reached
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_intset_fast_iter_next_batch (TpIntsetFastIter *iter,
+    guint *output,
+    guint n_elements)
+{
+  RealFastIter *real = (RealFastIter *) iter;
+  const TpIntset *set;
+  guint written = 0;
+
+  g_return_val_if_fail (iter != NULL, 0);
+  g_return_val_if_fail (output != NULL || n_elements == 0, 0);
+
+  set = real->set;
+
+  while (written < n_elements && real->container < set->n_containers)
+    {
+      const Container *c = intset_container (set, real->container);
+      guint base = CHUNK_BASE (c->key);
+      const guint16 *items;
+      gboolean exhausted = FALSE;
+
+      switch (c->type)
+        {
+          case CONTAINER_ARRAY:
+            items = container_array (c);
+
+            while (written < n_elements && real->position < c->n_items)
+              output[written++] = base | items[real->position++];
+
+            exhausted = (real->position >= c->n_items);
+            break;
+
+          case CONTAINER_BITMAP:
+            while (written < n_elements)
+              {
+                if (real->bitfield == 0)
+                  {
+                    if (real->position >= BITMAP_WORDS)
+                      {
+                        exhausted = TRUE;
+                        break;
+                      }
+
+                    real->bitfield = c->data.bitmap[real->position++];
+                    continue;
+                  }
+
+                output[written++] = base |
+                  ((real->position - 1) << BITFIELD_LOG2_BITS) |
+                  lowest_bit64 (real->bitfield);
+                /* clear the bit so we won't return it again */
+                real->bitfield &= real->bitfield - 1;
+              }
+
+            break;
+
+          case CONTAINER_RUN:
+            while (written < n_elements && real->position < c->n_items)
+              {
+                const Run *run = c->data.runs + real->position;
+
+                output[written++] = base | (run->start + real->offset);
+
+                if (real->offset == run->length)
+                  {
+                    real->position++;
+                    real->offset = 0;
+                  }
+                else
+                  {
+                    real->offset++;
+                  }
+              }
+
+            exhausted = (real->position >= c->n_items);
+            break;
+        }
+
+      if (exhausted)
+        {
+          real->container++;
+          real->position = 0;
+          real->offset = 0;
+          real->bitfield = 0;
+        }
+    }
+
+  return written;
 }
 
 /**
@@ -969,39 +3098,13 @@ gboolean
 tp_intset_fast_iter_next (TpIntsetFastIter *iter,
     guint *output)
 {
-  RealFastIter *real = (RealFastIter *) iter;
-  guint low_part;
+  guint element;
 
-  if (!real->ok)
+  if (tp_intset_fast_iter_next_batch (iter, &element, 1) == 0)
     return FALSE;
 
-  if (real->bitfield == 0)
-    {
-      gpointer k, v;
-
-      real->ok = g_hash_table_iter_next (&real->hash_iter, &k, &v);
-
-      if (!real->ok)
-        return FALSE;
-
-      real->high_part = GPOINTER_TO_SIZE (k);
-      real->bitfield = GPOINTER_TO_SIZE (v);
-      g_assert (real->bitfield != 0);
-    }
-
-  for (low_part = 0; low_part < BITFIELD_BITS; low_part++)
-    {
-      if (real->bitfield & (1 << low_part))
-        {
-          /* clear the bit so we won't return it again */
-          real->bitfield -= (1 << low_part);
-
-          if (output != NULL)
-            *output = real->high_part | low_part;
-
-          return TRUE;
-        }
-    }
+  if (output != NULL)
+    *output = element;
 
-  g_assert_not_reached ();
+  return TRUE;
 }
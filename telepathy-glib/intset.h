@@ -68,6 +68,13 @@ void tp_intset_foreach (const TpIntset *set, TpIntFunc func,
 GArray *tp_intset_to_array (const TpIntset *set) G_GNUC_WARN_UNUSED_RESULT;
 TpIntset *tp_intset_from_array (const GArray *array) G_GNUC_WARN_UNUSED_RESULT;
 
+_TP_AVAILABLE_IN_UNRELEASED
+TpIntset *tp_intset_new_from_sorted (const guint *elements,
+    guint n_elements) G_GNUC_WARN_UNUSED_RESULT;
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_intset_to_buffer (const TpIntset *set, guint *buffer,
+    guint n_elements);
+
 gboolean tp_intset_is_empty (const TpIntset *set) G_GNUC_WARN_UNUSED_RESULT;
 guint tp_intset_size (const TpIntset *set) G_GNUC_WARN_UNUSED_RESULT;
 
@@ -121,6 +128,10 @@ void tp_intset_fast_iter_init (TpIntsetFastIter *iter,
 gboolean tp_intset_fast_iter_next (TpIntsetFastIter *iter,
     guint *output);
 
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_intset_fast_iter_next_batch (TpIntsetFastIter *iter,
+    guint *output, guint n_elements);
+
 void tp_intset_union_update (TpIntset *self, const TpIntset *other);
 void tp_intset_difference_update (TpIntset *self, const TpIntset *other);
 
@@ -0,0 +1,39 @@
+/*<private_header>*/
+/* Detect callbacks that block the main loop (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_MAIN_LOOP_WATCHDOG_INTERNAL_H__
+#define __TP_MAIN_LOOP_WATCHDOG_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _tp_main_loop_watchdog_start (guint threshold_ms);
+void _tp_main_loop_watchdog_stop (void);
+
+void _tp_main_loop_watchdog_note_method_call (const gchar *iface,
+    const gchar *member,
+    const gchar *path);
+
+gchar *_tp_main_loop_watchdog_dup_summary (gboolean reset);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,401 @@
+/* Detect callbacks that block the main loop
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/main-loop-watchdog-internal.h"
+
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_MANAGER
+#include "telepathy-glib/debug-internal.h"
+
+/*
+ * A GSource with the most urgent possible priority notices each main loop
+ * iteration starting to dispatch (in its check function) and going back to
+ * poll (in the next prepare); it never becomes ready itself, so it doesn't
+ * cause any extra wakeups. The time between the two is how long the main
+ * loop was unable to respond to anything.
+ *
+ * A separate thread wakes up a few times per threshold. If the main loop
+ * has been dispatching for longer than the threshold, it logs a message
+ * naming the last D-Bus method call dispatched, and where possible
+ * interrupts the main thread with a signal whose handler prints a
+ * backtrace to stderr. Once a minute, it also logs a summary of how long
+ * the iterations took.
+ *
+ * Nested main loops run by callbacks (such as dbus-glib's blocking calls)
+ * count as the main loop going back to poll.
+ */
+
+#if defined (HAVE_BACKTRACE) && defined (HAVE_BACKTRACE_SYMBOLS_FD) && \
+  defined (HAVE_SIGNAL) && defined (HAVE_PTHREAD_KILL) && defined (SIGRTMIN)
+#   define USE_BACKTRACE_SIGNAL
+#endif
+
+/* how often to log a summary, in seconds */
+#define SUMMARY_INTERVAL 60
+/* bucket 0 counts iterations shorter than 1 ms; bucket i > 0 counts those
+ * of at least 2**(i-1) ms but less than 2**i ms; the last bucket also
+ * counts anything longer */
+#define N_BUCKETS 20
+
+static GMutex lock;
+static GCond cond;
+static GThread *thread = NULL;
+static GSource *source = NULL;
+static guint threshold = 0;
+
+/* All protected by @lock */
+static gboolean stopping = FALSE;
+/* when the current iteration started dispatching, or 0 if it hasn't */
+static gint64 busy_since = 0;
+/* the value of @busy_since for which a message has been logged */
+static gint64 reported = 0;
+/* "iface.member on path", or NULL if no method has been dispatched
+ * during this iteration */
+static gchar *method_call = NULL;
+static guint64 buckets[N_BUCKETS];
+static guint64 n_samples = 0;
+static gint64 longest = 0;
+
+#ifdef USE_BACKTRACE_SIGNAL
+static pthread_t main_thread;
+
+static void
+backtrace_handler (int sig)
+{
+  void *array[20];
+  size_t size;
+
+#define MSG "\n########## Main loop blocked (version " VERSION ") ##########\n"
+  write (STDERR_FILENO, MSG, strlen (MSG));
+#undef MSG
+
+  size = backtrace (array, 20);
+  backtrace_symbols_fd (array, size, STDERR_FILENO);
+}
+#endif /* USE_BACKTRACE_SIGNAL */
+
+static guint
+bucket_for_lag (gint64 usec)
+{
+  guint64 msec = usec / 1000;
+
+  if (msec == 0)
+    return 0;
+
+  return MIN (g_bit_storage (msec), N_BUCKETS - 1);
+}
+
+static gboolean
+watchdog_prepare (GSource *src G_GNUC_UNUSED,
+    gint *timeout)
+{
+  gint64 lag = 0;
+  gboolean was_reported = FALSE;
+
+  *timeout = -1;
+
+  g_mutex_lock (&lock);
+
+  if (busy_since != 0)
+    {
+      lag = g_get_monotonic_time () - busy_since;
+      was_reported = (reported == busy_since);
+
+      buckets[bucket_for_lag (lag)]++;
+      n_samples++;
+
+      if (lag > longest)
+        longest = lag;
+    }
+
+  busy_since = 0;
+  tp_clear_pointer (&method_call, g_free);
+  g_mutex_unlock (&lock);
+
+  if (was_reported)
+    MESSAGE ("main loop was blocked for %" G_GINT64_FORMAT " ms",
+        lag / 1000);
+
+  return FALSE;
+}
+
+static gboolean
+watchdog_check (GSource *src G_GNUC_UNUSED)
+{
+  g_mutex_lock (&lock);
+  busy_since = g_get_monotonic_time ();
+  g_mutex_unlock (&lock);
+
+  return FALSE;
+}
+
+static gboolean
+watchdog_dispatch (GSource *src G_GNUC_UNUSED,
+    GSourceFunc callback G_GNUC_UNUSED,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  /* never ready, so never dispatched */
+  g_return_val_if_reached (G_SOURCE_CONTINUE);
+}
+
+static GSourceFuncs watchdog_funcs = {
+    watchdog_prepare,
+    watchdog_check,
+    watchdog_dispatch,
+    NULL
+};
+
+/* the smallest bound in ms below which at least @percent of the samples
+ * fall */
+static guint
+percentile_bound (const guint64 *counts,
+    guint64 total,
+    guint percent)
+{
+  guint64 wanted = (total * percent + 99) / 100;
+  guint64 so_far = 0;
+  guint i;
+
+  for (i = 0; i < N_BUCKETS - 1; i++)
+    {
+      so_far += counts[i];
+
+      if (so_far >= wanted)
+        break;
+    }
+
+  return 1 << i;
+}
+
+/* called with @lock held */
+static gchar *
+format_summary (void)
+{
+  if (n_samples == 0)
+    return NULL;
+
+  return g_strdup_printf ("%" G_GUINT64_FORMAT " iterations: "
+      "50%% < %u ms, 90%% < %u ms, 99%% < %u ms, longest %" G_GINT64_FORMAT
+      " ms", n_samples,
+      percentile_bound (buckets, n_samples, 50),
+      percentile_bound (buckets, n_samples, 90),
+      percentile_bound (buckets, n_samples, 99),
+      longest / 1000);
+}
+
+/* called with @lock held */
+static void
+reset_summary (void)
+{
+  memset (buckets, 0, sizeof (buckets));
+  n_samples = 0;
+  longest = 0;
+}
+
+gchar *
+_tp_main_loop_watchdog_dup_summary (gboolean reset)
+{
+  gchar *ret;
+
+  g_mutex_lock (&lock);
+  ret = format_summary ();
+
+  if (reset)
+    reset_summary ();
+
+  g_mutex_unlock (&lock);
+  return ret;
+}
+
+static gpointer
+watchdog_thread (gpointer data G_GNUC_UNUSED)
+{
+  gint64 next_summary = g_get_monotonic_time () +
+      SUMMARY_INTERVAL * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&lock);
+
+  while (!stopping)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gint64 wake;
+
+      if (busy_since != 0 && reported != busy_since &&
+          now - busy_since >= threshold * G_TIME_SPAN_MILLISECOND)
+        {
+          gint64 lag = now - busy_since;
+          gchar *call = g_strdup (method_call);
+
+          reported = busy_since;
+          g_mutex_unlock (&lock);
+
+          MESSAGE ("main loop has been blocked for %" G_GINT64_FORMAT
+              " ms%s%s", lag / 1000,
+              call == NULL ? "" : " while serving ",
+              call == NULL ? "" : call);
+          g_free (call);
+
+#ifdef USE_BACKTRACE_SIGNAL
+          pthread_kill (main_thread, SIGRTMIN);
+#endif
+
+          g_mutex_lock (&lock);
+        }
+
+      if (now >= next_summary)
+        {
+          gchar *summary = format_summary ();
+
+          reset_summary ();
+          g_mutex_unlock (&lock);
+
+          if (summary != NULL)
+            DEBUG ("main loop latency over the last %u s: %s",
+                SUMMARY_INTERVAL, summary);
+
+          g_free (summary);
+          next_summary = now + SUMMARY_INTERVAL * G_TIME_SPAN_SECOND;
+          g_mutex_lock (&lock);
+        }
+
+      wake = MIN (next_summary,
+          now + threshold * G_TIME_SPAN_MILLISECOND / 4);
+      g_cond_wait_until (&cond, &lock, wake);
+    }
+
+  g_mutex_unlock (&lock);
+  return NULL;
+}
+
+/*
+ * _tp_main_loop_watchdog_start:
+ * @threshold_ms: log a message if the default main context spends longer
+ *  than this dispatching a single iteration
+ *
+ * Start watching the default main context. Must be called from the thread
+ * that runs it.
+ */
+void
+_tp_main_loop_watchdog_start (guint threshold_ms)
+{
+  g_return_if_fail (threshold_ms > 0);
+  g_return_if_fail (thread == NULL);
+
+  threshold = threshold_ms;
+
+#ifdef USE_BACKTRACE_SIGNAL
+  main_thread = pthread_self ();
+  signal (SIGRTMIN, backtrace_handler);
+
+    {
+      /* the first call to backtrace() might load libgcc, which is not
+       * something to do in a signal handler */
+      void *array[1];
+
+      backtrace (array, 1);
+    }
+#endif /* USE_BACKTRACE_SIGNAL */
+
+  g_mutex_lock (&lock);
+  stopping = FALSE;
+  busy_since = 0;
+  reported = 0;
+  reset_summary ();
+  g_mutex_unlock (&lock);
+
+  source = g_source_new (&watchdog_funcs, sizeof (GSource));
+  g_source_set_priority (source, G_MININT);
+  g_source_set_name (source, "tp-glib main loop watchdog");
+  g_source_attach (source, NULL);
+
+  thread = g_thread_new ("tp-glib main loop watchdog", watchdog_thread,
+      NULL);
+  DEBUG ("reporting main loop iterations that take longer than %u ms",
+      threshold);
+}
+
+void
+_tp_main_loop_watchdog_stop (void)
+{
+  if (thread == NULL)
+    return;
+
+  g_mutex_lock (&lock);
+  stopping = TRUE;
+  g_cond_signal (&cond);
+  g_mutex_unlock (&lock);
+
+  g_thread_join (thread);
+  thread = NULL;
+
+  g_source_destroy (source);
+  g_source_unref (source);
+  source = NULL;
+
+#ifdef USE_BACKTRACE_SIGNAL
+  signal (SIGRTMIN, SIG_DFL);
+#endif
+
+  g_mutex_lock (&lock);
+  tp_clear_pointer (&method_call, g_free);
+  g_mutex_unlock (&lock);
+}
+
+/*
+ * _tp_main_loop_watchdog_note_method_call:
+ *
+ * Record that a D-Bus method call is about to be dispatched, so that it
+ * can be blamed if the main loop blocks during this iteration. Does
+ * nothing if the watchdog is not running.
+ */
+void
+_tp_main_loop_watchdog_note_method_call (const gchar *iface,
+    const gchar *member,
+    const gchar *path)
+{
+  if (thread == NULL)
+    return;
+
+  g_mutex_lock (&lock);
+  g_free (method_call);
+  method_call = g_strdup_printf ("%s.%s on %s",
+      iface == NULL ? "(no interface)" : iface, member, path);
+  g_mutex_unlock (&lock);
+}
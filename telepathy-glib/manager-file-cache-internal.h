@@ -0,0 +1,38 @@
+/*<private_header>*/
+/* On-disk cache of parsed .manager files (internal)
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_MANAGER_FILE_CACHE_INTERNAL_H__
+#define __TP_MANAGER_FILE_CACHE_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean _tp_manager_file_cache_lookup (const gchar *filename,
+    GStrv *interfaces,
+    GVariant **protocols);
+
+void _tp_manager_file_cache_store (const gchar *filename,
+    const gchar * const *interfaces,
+    GHashTable *protocols);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,221 @@
+/* On-disk cache of parsed .manager files
+ *
+ * Copyright © 2011 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/manager-file-cache-internal.h"
+
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_MANAGER
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+/* Each .manager file gets a cache file named after its path, containing a
+ * single GVariant of this type: a format version, the path, modification
+ * time and size of the .manager file it was built from, the
+ * ConnectionManager.Interfaces, and a dictionary mapping protocol names to
+ * their immutable properties, exactly as _tp_protocol_parse_manager_file()
+ * returned them.
+ *
+ * The file is mapped and never validated as a whole: GVariant checks each
+ * part of untrusted data as it is accessed, and replaces anything malformed
+ * with a default value, so a corrupt cache can at worst give us a protocol
+ * with missing properties. */
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_TYPE "(usxtasa{sa{sv}})"
+
+static gchar *
+cache_filename (const gchar *filename)
+{
+  gchar *escaped = tp_escape_as_identifier (filename);
+  gchar *ret = g_build_filename (g_get_user_cache_dir (), "telepathy",
+      "managers", escaped, NULL);
+
+  g_free (escaped);
+  return ret;
+}
+
+static gboolean
+stat_manager_file (const gchar *filename,
+    gint64 *mtime,
+    guint64 *size)
+{
+  GStatBuf buf;
+
+  if (g_stat (filename, &buf) != 0)
+    {
+      DEBUG ("Unable to stat %s: %s", filename, g_strerror (errno));
+      return FALSE;
+    }
+
+  *mtime = buf.st_mtime;
+  *size = buf.st_size;
+  return TRUE;
+}
+
+/*
+ * _tp_manager_file_cache_lookup:
+ * @filename: the path to a .manager file
+ * @interfaces: (out) (transfer full): used to return the connection
+ *  manager's interfaces
+ * @protocols: (out) (transfer full): used to return an a{sa{sv}} mapping
+ *  protocol names to their immutable properties
+ *
+ * Returns: %TRUE if @filename has not changed since it was passed to
+ *  _tp_manager_file_cache_store(), possibly in a previous process
+ */
+gboolean
+_tp_manager_file_cache_lookup (const gchar *filename,
+    GStrv *interfaces,
+    GVariant **protocols)
+{
+  gchar *path = cache_filename (filename);
+  GMappedFile *mapped;
+  GBytes *bytes;
+  GVariant *top;
+  GError *error = NULL;
+  gint64 mtime, cached_mtime;
+  guint64 size, cached_size;
+  guint32 version;
+  const gchar *cached_filename;
+  gboolean ret = FALSE;
+
+  if (!stat_manager_file (filename, &mtime, &size))
+    goto out;
+
+  mapped = g_mapped_file_new (path, FALSE, &error);
+
+  if (mapped == NULL)
+    {
+      DEBUG ("%s not cached in %s: %s", filename, path, error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  top = g_variant_ref_sink (g_variant_new_from_bytes (
+        G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+  /* the bytes keep the file mapped for as long as we need it */
+  g_bytes_unref (bytes);
+  g_mapped_file_unref (mapped);
+
+  g_variant_get_child (top, 0, "u", &version);
+  g_variant_get_child (top, 1, "&s", &cached_filename);
+  g_variant_get_child (top, 2, "x", &cached_mtime);
+  g_variant_get_child (top, 3, "t", &cached_size);
+
+  if (version != CACHE_FORMAT_VERSION)
+    {
+      DEBUG ("ignoring %s with unknown version %u", path, version);
+    }
+  else if (tp_strdiff (cached_filename, filename) ||
+      cached_mtime != mtime || cached_size != size)
+    {
+      DEBUG ("%s has changed since it was cached in %s", filename, path);
+    }
+  else
+    {
+      DEBUG ("using cached copy of %s from %s", filename, path);
+      g_variant_get_child (top, 4, "^as", interfaces);
+      *protocols = g_variant_get_child_value (top, 5);
+      ret = TRUE;
+    }
+
+  g_variant_unref (top);
+
+out:
+  g_free (path);
+  return ret;
+}
+
+/*
+ * _tp_manager_file_cache_store:
+ * @filename: the path to a .manager file
+ * @interfaces: (allow-none): the connection manager's interfaces, as read
+ *  from @filename
+ * @protocols: (element-type utf8 GLib.HashTable): protocol names mapped to
+ *  their immutable properties, as read from @filename
+ *
+ * Remember what was read from @filename, until it changes.
+ */
+void
+_tp_manager_file_cache_store (const gchar *filename,
+    const gchar * const *interfaces,
+    GHashTable *protocols)
+{
+  static const gchar * const no_interfaces[] = { NULL };
+  gchar *path = NULL;
+  gchar *dir = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer k, v;
+  GVariant *top;
+  gint64 mtime;
+  guint64 size;
+  GError *error = NULL;
+
+  if (!stat_manager_file (filename, &mtime, &size))
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  g_hash_table_iter_init (&iter, protocols);
+
+  while (g_hash_table_iter_next (&iter, &k, &v))
+    {
+      GVariant *immutables = _tp_asv_to_vardict (v);
+
+      g_variant_builder_add (&builder, "{s@a{sv}}", k, immutables);
+      g_variant_unref (immutables);
+    }
+
+  if (interfaces == NULL)
+    interfaces = no_interfaces;
+
+  top = g_variant_ref_sink (g_variant_new ("(usxt^as@a{sa{sv}})",
+        CACHE_FORMAT_VERSION, filename, mtime, size, interfaces,
+        g_variant_builder_end (&builder)));
+
+  path = cache_filename (filename);
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0700) == -1)
+    {
+      DEBUG ("Error creating manager file cache dir: %s",
+          g_strerror (errno));
+    }
+  else if (!g_file_set_contents (path, g_variant_get_data (top),
+        g_variant_get_size (top), &error))
+    {
+      DEBUG ("Error writing %s: %s", path, error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      DEBUG ("cached %s in %s", filename, path);
+    }
+
+  g_variant_unref (top);
+  g_free (dir);
+  g_free (path);
+}
@@ -50,6 +50,8 @@ struct _TpMessage {
 };
 
 void _tp_message_set_immutable (TpMessage *self);
+const gchar *_tp_message_peek_text (TpMessage *self,
+    TpChannelTextMessageFlags *out_flags);
 
 G_END_DECLS
 
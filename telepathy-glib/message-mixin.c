@@ -67,8 +67,14 @@
 
 #include <dbus/dbus-glib.h>
 #include <dbus/dbus-glib-lowlevel.h>
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/chat-state-map-internal.h>
 #include <telepathy-glib/cm-message.h>
 #include <telepathy-glib/cm-message-internal.h>
 #include <telepathy-glib/dbus.h>
@@ -78,6 +84,8 @@
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/message-internal.h>
+#include <telepathy-glib/util-internal.h>
+#include <telepathy-glib/variant-util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_IM
 
@@ -100,6 +108,12 @@ struct _TpMessageMixinPrivate
 
   /* Sending */
   TpMessageMixinSendImpl send_message;
+  TpMessageMixinSendBatchImpl send_batch;
+  /* TpMessage, queued to be passed to send_batch */
+  GPtrArray *outgoing_batch;
+  /* the TpMessageSendingFlags for each message in outgoing_batch */
+  GArray *outgoing_batch_flags;
+  guint outgoing_batch_idle;
   GArray *msg_types;
   TpMessagePartSupportFlags message_part_support_flags;
   TpDeliveryReportingSupportFlags delivery_reporting_support_flags;
@@ -108,12 +122,47 @@ struct _TpMessageMixinPrivate
   /* Receiving */
   guint recv_id;
   GQueue *pending;
+  /* incoming_id => borrowed GList * link in pending, whose data is the
+   * TpCMMessage with that ID */
+  GHashTable *pending_links;
+  /* borrowed message-token => borrowed GList * link in pending, the most
+   * recent if several have the same token; spilled messages are not
+   * included */
+  GHashTable *pending_tokens;
+
+  /* If non-zero, at most this many messages are kept in pending; older
+   * messages are written to spill_file, and only the SpilledMessage
+   * describing them is kept in spilled */
+  guint max_pending_in_memory;
+  gchar *spill_path;
+  /* NULL if nothing has been spilled since spilled was last empty */
+  FILE *spill_file;
+  goffset spill_end;
+  /* SpilledMessage, oldest first; all are older than anything in pending */
+  GQueue spilled;
+  /* incoming_id => borrowed GList * link in spilled */
+  GHashTable *spilled_links;
+
+  /* If non-NULL, every received message is appended to journal_file, and
+   * so is the ID of every acknowledged message, so that messages still
+   * pending can be rescued if the connection manager restarts */
+  gchar *journal_path;
+  FILE *journal_file;
+  /* number of messages in journal_file that have not been acknowledged */
+  guint journal_live;
+  /* if non-zero, journal_file has been written to since it was synced */
+  guint journal_sync_idle;
 
   /* ChatState */
 
-  /* TpHandle -> TpChannelChatState */
-  GHashTable *chat_states;
+  /* everyone's state, Gone being stored as Inactive */
+  _TpChatStateMap *chat_states;
   TpMessageMixinSendChatStateImpl send_chat_state;
+  /* If non-zero, each member's chat state changes at most once per this
+   * many milliseconds */
+  guint chat_state_interval;
+  /* TpHandle -> owned ChatStateLimiter */
+  GHashTable *chat_state_limiters;
   /* FALSE unless at least one chat state notification has been sent; <gone/>
    * will only be sent when the channel closes if this is TRUE. This prevents
    * opening a channel and closing it immediately sending a spurious <gone/> to
@@ -199,17 +248,424 @@ tp_message_mixin_get_offset_quark (void)
 }
 
 
-static gint
-pending_item_id_equals_data (gconstpointer item,
-                             gconstpointer data)
+static GList *
+pending_find_link (TpMessageMixin *mixin,
+                   guint id)
 {
-  const TpCMMessage *self = item;
-  guint id = GPOINTER_TO_UINT (data);
+  return g_hash_table_lookup (mixin->priv->pending_links,
+      GUINT_TO_POINTER (id));
+}
 
-  /* The sense of this comparison is correct: the callback passed to
-   * g_queue_find_custom() should return 0 when the desired item is found.
-   */
-  return (self->incoming_id != id);
+typedef struct {
+    guint32 id;
+    TpHandle sender;
+    /* TRUE if tp_message_mixin_set_rescued() was called after this message
+     * was written out */
+    gboolean rescued;
+    /* where its parts, as a serialized aa{sv}, are in spill_file */
+    goffset offset;
+    gsize length;
+    /* the message's content streams, which can't be written out, or NULL */
+    GHashTable *content_streams;
+} SpilledMessage;
+
+/* Remove @link_ from the pending queue and destroy its message */
+static void
+pending_delete_link (TpMessageMixin *mixin,
+                     GList *link_)
+{
+  TpMessage *item = link_->data;
+  TpCMMessage *cm_msg = link_->data;
+  const gchar *token;
+
+  /* if IDs have wrapped around, the index might point to a newer message
+   * with the same ID */
+  if (pending_find_link (mixin, cm_msg->incoming_id) == link_)
+    g_hash_table_remove (mixin->priv->pending_links,
+        GUINT_TO_POINTER (cm_msg->incoming_id));
+
+  token = tp_message_get_token (item);
+
+  if (token != NULL &&
+      g_hash_table_lookup (mixin->priv->pending_tokens, token) == link_)
+    g_hash_table_remove (mixin->priv->pending_tokens, token);
+
+  g_queue_delete_link (mixin->priv->pending, link_);
+  tp_message_destroy (item);
+}
+
+static void
+spill_file_close (TpMessageMixin *mixin)
+{
+  if (mixin->priv->spill_file == NULL)
+    return;
+
+  fclose (mixin->priv->spill_file);
+  mixin->priv->spill_file = NULL;
+  mixin->priv->spill_end = 0;
+
+  if (g_unlink (mixin->priv->spill_path) != 0 && errno != ENOENT)
+    DEBUG ("couldn't remove %s: %s", mixin->priv->spill_path,
+        g_strerror (errno));
+}
+
+static GList *
+spilled_find_link (TpMessageMixin *mixin,
+                   guint id)
+{
+  return g_hash_table_lookup (mixin->priv->spilled_links,
+      GUINT_TO_POINTER (id));
+}
+
+/* Forget about @link_ and its message. The log is append-only, so the
+ * message stays on disk until everything in it has been forgotten. */
+static void
+spilled_delete_link (TpMessageMixin *mixin,
+                     GList *link_)
+{
+  SpilledMessage *spilled = link_->data;
+
+  if (spilled_find_link (mixin, spilled->id) == link_)
+    g_hash_table_remove (mixin->priv->spilled_links,
+        GUINT_TO_POINTER (spilled->id));
+
+  g_queue_delete_link (&mixin->priv->spilled, link_);
+  tp_clear_pointer (&spilled->content_streams, g_hash_table_unref);
+  g_slice_free (SpilledMessage, spilled);
+
+  if (g_queue_is_empty (&mixin->priv->spilled))
+    spill_file_close (mixin);
+}
+
+/* Move the oldest message in pending to the spill file.
+ *
+ * Returns: %FALSE if it couldn't be written, in which case it stays in
+ *  memory */
+static gboolean
+pending_spill_oldest (TpMessageMixin *mixin)
+{
+  GList *link_ = g_queue_peek_head_link (mixin->priv->pending);
+  TpMessage *msg;
+  TpCMMessage *cm_msg;
+  SpilledMessage *spilled;
+  GVariant *variant;
+  gsize len;
+
+  g_return_val_if_fail (link_ != NULL, FALSE);
+  g_return_val_if_fail (mixin->priv->spill_path != NULL, FALSE);
+
+  msg = link_->data;
+  cm_msg = link_->data;
+
+  if (mixin->priv->spill_file == NULL)
+    {
+      mixin->priv->spill_file = g_fopen (mixin->priv->spill_path, "w+b");
+      mixin->priv->spill_end = 0;
+
+      if (mixin->priv->spill_file == NULL)
+        {
+          DEBUG ("couldn't open %s, keeping pending messages in memory: %s",
+              mixin->priv->spill_path, g_strerror (errno));
+          return FALSE;
+        }
+    }
+
+  variant = _tp_boxed_to_variant (TP_ARRAY_TYPE_MESSAGE_PART_LIST, "aa{sv}",
+      msg->parts);
+  g_return_val_if_fail (variant != NULL, FALSE);
+  len = g_variant_get_size (variant);
+
+  if (fseek (mixin->priv->spill_file, mixin->priv->spill_end,
+          SEEK_SET) != 0 ||
+      fwrite (g_variant_get_data (variant), 1, len,
+          mixin->priv->spill_file) != len ||
+      fflush (mixin->priv->spill_file) != 0)
+    {
+      DEBUG ("couldn't write message %u to %s, keeping it in memory: %s",
+          cm_msg->incoming_id, mixin->priv->spill_path, g_strerror (errno));
+      g_variant_unref (variant);
+      return FALSE;
+    }
+
+  spilled = g_slice_new0 (SpilledMessage);
+  spilled->id = cm_msg->incoming_id;
+  spilled->sender = tp_cm_message_get_sender (msg);
+  spilled->offset = mixin->priv->spill_end;
+  spilled->length = len;
+  spilled->content_streams = _tp_cm_message_get_content_streams (msg);
+  mixin->priv->spill_end += len;
+
+  if (spilled->content_streams != NULL)
+    g_hash_table_ref (spilled->content_streams);
+
+  g_queue_push_tail (&mixin->priv->spilled, spilled);
+  g_hash_table_insert (mixin->priv->spilled_links,
+      GUINT_TO_POINTER (spilled->id),
+      g_queue_peek_tail_link (&mixin->priv->spilled));
+
+  pending_delete_link (mixin, link_);
+  g_variant_unref (variant);
+  return TRUE;
+}
+
+static void
+pending_enforce_limit (TpMessageMixin *mixin)
+{
+  if (mixin->priv->max_pending_in_memory == 0)
+    return;
+
+  while (g_queue_get_length (mixin->priv->pending) >
+      mixin->priv->max_pending_in_memory)
+    {
+      if (!pending_spill_oldest (mixin))
+        break;
+    }
+}
+
+/* Returns: (transfer full): a copy of the spilled message, read back from
+ *  disk, or %NULL if it couldn't be read */
+static TpMessage *
+spilled_message_load (TpMessageMixin *mixin,
+                      const SpilledMessage *spilled)
+{
+  gchar *data = g_malloc (spilled->length);
+  GVariant *variant;
+  GValue value = G_VALUE_INIT;
+  TpMessage *msg;
+
+  g_assert (mixin->priv->spill_file != NULL);
+
+  if (fseek (mixin->priv->spill_file, spilled->offset, SEEK_SET) != 0 ||
+      fread (data, 1, spilled->length,
+          mixin->priv->spill_file) != spilled->length)
+    {
+      DEBUG ("couldn't read message %u back from %s: %s", spilled->id,
+          mixin->priv->spill_path, g_strerror (errno));
+      g_free (data);
+      return NULL;
+    }
+
+  variant = g_variant_ref_sink (g_variant_new_from_data (
+        G_VARIANT_TYPE ("aa{sv}"), data, spilled->length, FALSE, g_free,
+        data));
+  dbus_g_value_parse_g_variant (variant, &value);
+  g_variant_unref (variant);
+
+  msg = _tp_cm_message_new_from_parts (mixin->priv->connection,
+      g_value_get_boxed (&value));
+  g_value_unset (&value);
+
+  ((TpCMMessage *) msg)->incoming_id = spilled->id;
+  _tp_cm_message_set_content_streams (msg, spilled->content_streams);
+
+  if (spilled->rescued)
+    tp_message_set_boolean (msg, 0, "rescued", TRUE);
+
+  return msg;
+}
+
+/* Each record in the journal is a little-endian guint32 length followed by
+ * a serialized (ubaa{sv}): the message's ID, whether it has been
+ * acknowledged, and, if not, its parts */
+#define JOURNAL_RECORD_TYPE "(ubaa{sv})"
+
+static void
+journal_close (TpMessageMixin *mixin)
+{
+  if (mixin->priv->journal_sync_idle != 0)
+    {
+      _tp_source_remove (mixin->priv->journal_sync_idle);
+      mixin->priv->journal_sync_idle = 0;
+    }
+
+  if (mixin->priv->journal_file != NULL)
+    {
+      fclose (mixin->priv->journal_file);
+      mixin->priv->journal_file = NULL;
+    }
+}
+
+static gboolean
+journal_sync_cb (gpointer user_data)
+{
+  TpMessageMixin *mixin = user_data;
+  int fd;
+
+  mixin->priv->journal_sync_idle = 0;
+
+  if (mixin->priv->journal_file == NULL)
+    return FALSE;
+
+  fd = fileno (mixin->priv->journal_file);
+
+  /* everything in it has been acknowledged, so start again */
+  if (mixin->priv->journal_live == 0)
+    {
+      if (fflush (mixin->priv->journal_file) == 0 && ftruncate (fd, 0) == 0)
+        rewind (mixin->priv->journal_file);
+      else
+        DEBUG ("couldn't truncate %s: %s", mixin->priv->journal_path,
+            g_strerror (errno));
+    }
+
+  /* one sync for all the messages received or acknowledged since the last
+   * time we got here */
+  if (fflush (mixin->priv->journal_file) != 0 || fsync (fd) != 0)
+    {
+      DEBUG ("couldn't sync %s, no longer keeping a journal: %s",
+          mixin->priv->journal_path, g_strerror (errno));
+      journal_close (mixin);
+    }
+
+  return FALSE;
+}
+
+/* Write a record for message @id to the journal; @parts_variant is empty
+ * if @acked */
+static void
+journal_write (TpMessageMixin *mixin,
+               guint32 id,
+               gboolean acked,
+               GVariant *parts_variant)
+{
+  GVariant *record;
+  guint32 len;
+
+  if (mixin->priv->journal_file == NULL)
+    return;
+
+  record = g_variant_ref_sink (g_variant_new ("(ub@aa{sv})", id,
+        acked, parts_variant));
+  len = GUINT32_TO_LE (g_variant_get_size (record));
+
+  if (fwrite (&len, sizeof (len), 1, mixin->priv->journal_file) != 1 ||
+      fwrite (g_variant_get_data (record), 1, g_variant_get_size (record),
+          mixin->priv->journal_file) != g_variant_get_size (record))
+    {
+      DEBUG ("couldn't write message %u to %s, no longer keeping a "
+          "journal: %s", id, mixin->priv->journal_path, g_strerror (errno));
+      journal_close (mixin);
+    }
+  else
+    {
+      if (!acked)
+        mixin->priv->journal_live++;
+      else if (mixin->priv->journal_live > 0)
+        mixin->priv->journal_live--;
+
+      if (mixin->priv->journal_sync_idle == 0)
+        mixin->priv->journal_sync_idle = _tp_idle_add (
+            TP_LATENCY_CLASS_NORMAL, journal_sync_cb, mixin);
+    }
+
+  g_variant_unref (record);
+}
+
+/* Append a record for message @id to the journal, with its @parts if it
+ * has just been received, or %NULL if it has just been acknowledged */
+static void
+journal_append (TpMessageMixin *mixin,
+                guint32 id,
+                const GPtrArray *parts)
+{
+  GVariant *parts_variant;
+
+  if (mixin->priv->journal_file == NULL)
+    return;
+
+  if (parts != NULL)
+    parts_variant = _tp_boxed_to_variant (TP_ARRAY_TYPE_MESSAGE_PART_LIST,
+        "aa{sv}", (gpointer) parts);
+  else
+    parts_variant = g_variant_ref_sink (g_variant_new_array (
+          G_VARIANT_TYPE_VARDICT, NULL, 0));
+
+  g_return_if_fail (parts_variant != NULL);
+
+  journal_write (mixin, id, parts == NULL, parts_variant);
+  g_variant_unref (parts_variant);
+}
+
+/* Returns: (transfer full) (element-type GLib.Variant): the parts, as
+ *  aa{sv}, of each message in @contents that was never acknowledged, in
+ *  the order they were received */
+static GPtrArray *
+journal_parse (const gchar *path,
+               const gchar *contents,
+               gsize length)
+{
+  /* owned GVariant, or NULL once acknowledged */
+  GPtrArray *received = g_ptr_array_new ();
+  /* ID => index in received */
+  GHashTable *live = g_hash_table_new (NULL, NULL);
+  GPtrArray *ret;
+  gsize offset = 0;
+  guint i;
+
+  while (offset < length)
+    {
+      GVariant *record;
+      GVariant *parts;
+      guint32 len, id;
+      gboolean acked;
+      gpointer index;
+
+      /* a partial record at the end was being written when we stopped */
+      if (length - offset < sizeof (len))
+        break;
+
+      memcpy (&len, contents + offset, sizeof (len));
+      len = GUINT32_FROM_LE (len);
+
+      if (length - offset - sizeof (len) < len)
+        break;
+
+      offset += sizeof (len);
+
+      /* copied, so that it is suitably aligned */
+      record = g_variant_ref_sink (g_variant_new_from_data (
+            G_VARIANT_TYPE (JOURNAL_RECORD_TYPE),
+            g_memdup (contents + offset, len), len, FALSE, g_free, NULL));
+      offset += len;
+
+      /* parts keeps the record's data alive */
+      g_variant_get (record, "(ub@aa{sv})", &id, &acked, &parts);
+      g_variant_unref (record);
+
+      if (acked &&
+          g_hash_table_lookup_extended (live, GUINT_TO_POINTER (id), NULL,
+            &index))
+        {
+          tp_clear_pointer (&g_ptr_array_index (received,
+                GPOINTER_TO_UINT (index)), g_variant_unref);
+          g_hash_table_remove (live, GUINT_TO_POINTER (id));
+        }
+      else if (!acked && g_variant_n_children (parts) > 0)
+        {
+          g_hash_table_insert (live, GUINT_TO_POINTER (id),
+              GUINT_TO_POINTER (received->len));
+          g_ptr_array_add (received, g_variant_ref (parts));
+        }
+
+      g_variant_unref (parts);
+    }
+
+  if (offset < length)
+    DEBUG ("ignoring %" G_GSIZE_FORMAT " bytes at the end of %s",
+        length - offset, path);
+
+  ret = g_ptr_array_new_full (g_hash_table_size (live),
+      (GDestroyNotify) g_variant_unref);
+
+  for (i = 0; i < received->len; i++)
+    {
+      if (g_ptr_array_index (received, i) != NULL)
+        g_ptr_array_add (ret, g_ptr_array_index (received, i));
+    }
+
+  g_ptr_array_unref (received);
+  g_hash_table_unref (live);
+  return ret;
 }
 
 static gchar *
@@ -315,19 +771,272 @@ tp_message_mixin_implement_sending (GObject *object,
       (gchar **) supported_content_types);
 }
 
+/**
+ * TpMessageMixinSendBatchImpl:
+ * @object: An instance of the implementation that uses this mixin
+ * @n_messages: the number of messages in @messages
+ * @messages: (array length=n_messages): outgoing messages, oldest first
+ * @flags: (array length=n_messages): the flags with which to send each
+ *  message in @messages
+ *
+ * Signature of a virtual method which may be implemented to send several
+ * messages at once, for instance by packing them into a single network
+ * write. As for #TpMessageMixinSendImpl, it must arrange for
+ * tp_message_mixin_sent() to be called for each message in @messages.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+static gboolean
+outgoing_batch_flush_cb (gpointer object)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+  GPtrArray *messages = mixin->priv->outgoing_batch;
+  GArray *flags = mixin->priv->outgoing_batch_flags;
+
+  mixin->priv->outgoing_batch_idle = 0;
+
+  /* send_batch might send more messages, which will start a new batch */
+  mixin->priv->outgoing_batch = g_ptr_array_new ();
+  mixin->priv->outgoing_batch_flags = g_array_new (FALSE, FALSE,
+      sizeof (TpMessageSendingFlags));
+
+  DEBUG ("sending a batch of %u messages", messages->len);
+  mixin->priv->send_batch (object, messages->len,
+      (TpMessage * const *) messages->pdata,
+      (const TpMessageSendingFlags *) flags->data);
+
+  g_ptr_array_unref (messages);
+  g_array_unref (flags);
+  return FALSE;
+}
+
+/* Pass @message to the implementation, either now or as part of a batch */
+static void
+dispatch_outgoing (GObject *object,
+                   TpMessage *message,
+                   TpMessageSendingFlags flags)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+
+  if (mixin->priv->send_batch == NULL)
+    {
+      mixin->priv->send_message (object, message, flags);
+      return;
+    }
+
+  g_ptr_array_add (mixin->priv->outgoing_batch, message);
+  g_array_append_val (mixin->priv->outgoing_batch_flags, flags);
+
+  /* Every call to SendMessage or Send already waiting to be dispatched
+   * will be handled before this, so they all end up in the same batch */
+  if (mixin->priv->outgoing_batch_idle == 0)
+    mixin->priv->outgoing_batch_idle = _tp_idle_add (
+        TP_LATENCY_CLASS_NORMAL, outgoing_batch_flush_cb, object);
+}
+
+/**
+ * tp_message_mixin_implement_send_batch:
+ * @object: An instance of the implementation that uses this mixin
+ * @send_batch: An implementation of sending several messages at once
+ *
+ * Arrange for messages to be passed to @send_batch, rather than to the
+ * #TpMessageMixinSendImpl passed to tp_message_mixin_implement_sending().
+ * Messages submitted in quick succession, such as a burst of pipelined
+ * SendMessage calls, are collected until the main loop is idle and passed
+ * to @send_batch together.
+ *
+ * This must be called after tp_message_mixin_implement_sending(), and may
+ * only be called once per object.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_message_mixin_implement_send_batch (GObject *object,
+    TpMessageMixinSendBatchImpl send_batch)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+
+  g_return_if_fail (mixin->priv->send_message != NULL);
+  g_return_if_fail (mixin->priv->send_batch == NULL);
+  g_return_if_fail (send_batch != NULL);
+
+  mixin->priv->send_batch = send_batch;
+}
+
 static TpChannelChatState
 lookup_current_chat_state (TpMessageMixin *mixin,
     TpHandle member)
 {
-  gpointer tmp;
+  return _tp_chat_state_map_get (mixin->priv->chat_states, member);
+}
+
+/* Record and signal @member's new state, without any rate limiting */
+static void
+chat_state_emit (GObject *object,
+    TpHandle member,
+    TpChannelChatState state)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+
+  if (state == lookup_current_chat_state (mixin, member))
+    return;
+
+  /* someone who has left is no different from someone who was never
+   * here, as far as ChatStates is concerned */
+  _tp_chat_state_map_set (mixin->priv->chat_states, member,
+      state == TP_CHANNEL_CHAT_STATE_GONE ?
+          TP_CHANNEL_CHAT_STATE_INACTIVE : state);
+
+  tp_svc_channel_interface_chat_state_emit_chat_state_changed (object,
+      member, state);
+}
+
+/* Send @state to the network if @send, then record and signal it */
+static gboolean
+chat_state_apply (GObject *object,
+    TpHandle member,
+    TpChannelChatState state,
+    gboolean send,
+    GError **error)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+
+  if (send)
+    {
+      if (!mixin->priv->send_chat_state (object, state, error))
+        return FALSE;
+
+      mixin->priv->send_gone = TRUE;
+    }
+
+  chat_state_emit (object, member, state);
+  return TRUE;
+}
+
+typedef struct {
+    GObject *object;
+    TpHandle member;
+    /* monotonic time at which member's state last changed */
+    gint64 last_change;
+    /* the latest state we were asked for, valid if timeout != 0 */
+    TpChannelChatState pending_state;
+    /* TRUE if pending_state must also be sent */
+    gboolean pending_send;
+    guint timeout;
+} ChatStateLimiter;
+
+static void
+chat_state_limiter_free (gpointer p)
+{
+  ChatStateLimiter *limiter = p;
+
+  if (limiter->timeout != 0)
+    g_source_remove (limiter->timeout);
+
+  g_slice_free (ChatStateLimiter, limiter);
+}
+
+static gboolean
+chat_state_limiter_timeout_cb (gpointer user_data)
+{
+  ChatStateLimiter *limiter = user_data;
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (limiter->object);
+  GError *error = NULL;
+
+  limiter->timeout = 0;
+  limiter->last_change = g_get_monotonic_time ();
+
+  if (limiter->pending_state != lookup_current_chat_state (mixin,
+          limiter->member) &&
+      !chat_state_apply (limiter->object, limiter->member,
+          limiter->pending_state, limiter->pending_send, &error))
+    {
+      DEBUG ("failed to send deferred chat state %u: %s",
+          limiter->pending_state, error->message);
+      g_error_free (error);
+    }
+
+  limiter->pending_send = FALSE;
+  return FALSE;
+}
+
+/* Change @member's state to @state, sending it first if @send, at most once
+ * per chat_state_interval; a change made too soon after the previous one is
+ * deferred, and replaced by any later change made in the meantime. */
+static gboolean
+chat_state_change_limited (GObject *object,
+    TpHandle member,
+    TpChannelChatState state,
+    gboolean send,
+    GError **error)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+  ChatStateLimiter *limiter;
+  gint64 now, next;
+
+  if (mixin->priv->chat_state_interval == 0)
+    {
+      if (state == lookup_current_chat_state (mixin, member))
+        return TRUE;
+
+      return chat_state_apply (object, member, state, send, error);
+    }
+
+  limiter = g_hash_table_lookup (mixin->priv->chat_state_limiters,
+      GUINT_TO_POINTER (member));
+
+  if (limiter == NULL)
+    {
+      limiter = g_slice_new0 (ChatStateLimiter);
+      limiter->object = object;
+      limiter->member = member;
+      g_hash_table_insert (mixin->priv->chat_state_limiters,
+          GUINT_TO_POINTER (member), limiter);
+    }
 
-  if (g_hash_table_lookup_extended (mixin->priv->chat_states,
-          GUINT_TO_POINTER (member), NULL, &tmp))
+  if (state == lookup_current_chat_state (mixin, member))
+    {
+      /* back where we started: forget whatever was deferred */
+      if (limiter->timeout != 0)
+        {
+          g_source_remove (limiter->timeout);
+          limiter->timeout = 0;
+          limiter->pending_send = FALSE;
+        }
+
+      return TRUE;
+    }
+
+  now = g_get_monotonic_time ();
+  next = limiter->last_change +
+      (gint64) mixin->priv->chat_state_interval * 1000;
+
+  /* leaving the chat is never delayed */
+  if (now >= next ||
+      state == TP_CHANNEL_CHAT_STATE_INACTIVE ||
+      state == TP_CHANNEL_CHAT_STATE_GONE)
     {
-      return GPOINTER_TO_UINT (tmp);
+      if (limiter->timeout != 0)
+        {
+          g_source_remove (limiter->timeout);
+          limiter->timeout = 0;
+        }
+
+      send = send || limiter->pending_send;
+      limiter->pending_send = FALSE;
+      limiter->last_change = now;
+      return chat_state_apply (object, member, state, send, error);
     }
 
-  return TP_CHANNEL_CHAT_STATE_INACTIVE;
+  limiter->pending_state = state;
+  limiter->pending_send = limiter->pending_send || send;
+
+  if (limiter->timeout == 0)
+    limiter->timeout = g_timeout_add ((next - now + 999) / 1000,
+        chat_state_limiter_timeout_cb, limiter);
+
+  return TRUE;
 }
 
 /**
@@ -339,6 +1048,9 @@ lookup_current_chat_state (TpMessageMixin *mixin,
  * Change the current chat state of @member to be @state. This emits
  * ChatStateChanged signal and update ChatStates property.
  *
+ * If tp_message_mixin_set_chat_state_interval() has been called, the
+ * change might be delayed; see that function for details.
+ *
  * Since: 0.19.0
  */
 void
@@ -346,28 +1058,65 @@ tp_message_mixin_change_chat_state (GObject *object,
     TpHandle member,
     TpChannelChatState state)
 {
-  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
-
   g_return_if_fail (state < TP_NUM_CHANNEL_CHAT_STATES);
 
-  if (state == lookup_current_chat_state (mixin, member))
-    return;
+  chat_state_change_limited (object, member, state, FALSE, NULL);
+}
 
-  if (state == TP_CHANNEL_CHAT_STATE_INACTIVE ||
-      state == TP_CHANNEL_CHAT_STATE_GONE)
-    {
-      g_hash_table_remove (mixin->priv->chat_states,
-          GUINT_TO_POINTER (member));
-    }
-  else
+/**
+ * tp_message_mixin_set_chat_state_interval:
+ * @object: an instance of the implementation that uses this mixin
+ * @interval_ms: the minimum time between changes to each member's chat
+ *  state, in milliseconds, or 0 to apply every change immediately
+ *
+ * Limit how often each member's chat state can change. User interfaces
+ * often switch between %TP_CHANNEL_CHAT_STATE_COMPOSING and
+ * %TP_CHANNEL_CHAT_STATE_PAUSED on every keystroke, and in a large chat
+ * room each switch would cost a ChatStateChanged signal, and for our own
+ * state a call to the #TpMessageMixinSendChatStateImpl.
+ *
+ * When this is non-zero, a change made less than @interval_ms after the
+ * previous change to the same member's state is delayed until the
+ * interval has passed; only the latest of the changes made in the
+ * meantime is then applied, and nothing at all if that is the state the
+ * member already had. Changes to %TP_CHANNEL_CHAT_STATE_INACTIVE and
+ * %TP_CHANNEL_CHAT_STATE_GONE are never delayed. A SetChatState call
+ * whose change is delayed returns straight away; if sending the state
+ * later fails, the error is only logged.
+ *
+ * The default is 0. This may be called at any time.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_message_mixin_set_chat_state_interval (GObject *object,
+    guint interval_ms)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
+
+  mixin->priv->chat_state_interval = interval_ms;
+
+  /* apply anything that was waiting straight away */
+  if (interval_ms == 0)
     {
-      g_hash_table_insert (mixin->priv->chat_states,
-          GUINT_TO_POINTER (member),
-          GUINT_TO_POINTER (state));
-    }
+      GHashTableIter iter;
+      gpointer v;
 
-  tp_svc_channel_interface_chat_state_emit_chat_state_changed (object,
-      member, state);
+      g_hash_table_iter_init (&iter, mixin->priv->chat_state_limiters);
+
+      while (g_hash_table_iter_next (&iter, NULL, &v))
+        {
+          ChatStateLimiter *limiter = v;
+
+          if (limiter->timeout != 0)
+            {
+              g_source_remove (limiter->timeout);
+              chat_state_limiter_timeout_cb (limiter);
+            }
+        }
+
+      g_hash_table_remove_all (mixin->priv->chat_state_limiters);
+    }
 }
 
 /**
@@ -419,6 +1168,9 @@ tp_message_mixin_maybe_send_gone (GObject *object)
 {
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
 
+  /* don't send anything that was deferred after we've gone */
+  g_hash_table_remove_all (mixin->priv->chat_state_limiters);
+
   if (mixin->priv->send_gone && !TP_HAS_GROUP_MIXIN (object) &&
       mixin->priv->send_chat_state != NULL)
     {
@@ -456,108 +1208,406 @@ tp_message_mixin_set_chat_state_async (TpSvcChannelInterfaceChatState *iface,
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
   GError *error = NULL;
 
-  if (mixin->priv->send_chat_state == NULL)
+  if (mixin->priv->send_chat_state == NULL)
+    {
+      tp_dbus_g_method_return_not_implemented (context);
+      return;
+    }
+
+  if (state >= TP_NUM_CHANNEL_CHAT_STATES)
+    {
+      DEBUG ("invalid chat state %u", state);
+
+      g_set_error (&error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "invalid state: %u", state);
+      goto error;
+    }
+
+  if (state == TP_CHANNEL_CHAT_STATE_GONE)
+    {
+      /* We cannot explicitly set the Gone state */
+      DEBUG ("you may not explicitly set the Gone state");
+
+      g_set_error (&error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "you may not explicitly set the Gone state");
+      goto error;
+    }
+
+  if (!chat_state_change_limited (object, get_self_handle (object), state,
+          TRUE, &error))
+    goto error;
+
+  tp_svc_channel_interface_chat_state_return_from_set_chat_state (context);
+  return;
+
+error:
+  dbus_g_method_return_error (context, error);
+  g_clear_error (&error);
+}
+
+/**
+ * tp_message_mixin_init:
+ * @obj: An instance of the implementation that uses this mixin
+ * @offset: The byte offset of the TpMessageMixin within the object structure
+ * @connection: A #TpBaseConnection
+ *
+ * Initialize the mixin. Should be called from the implementation's
+ * instance init function or constructor like so:
+ *
+ * <informalexample><programlisting>
+ * tp_message_mixin_init ((GObject *) self,
+ *     G_STRUCT_OFFSET (SomeObject, message_mixin),
+ *     self->connection);
+ * </programlisting></informalexample>
+ *
+ * Since: 0.7.21
+ */
+void
+tp_message_mixin_init (GObject *obj,
+                       gsize offset,
+                       TpBaseConnection *connection)
+{
+  TpMessageMixin *mixin;
+
+  g_assert (G_IS_OBJECT (obj));
+
+  g_type_set_qdata (G_OBJECT_TYPE (obj),
+                    TP_MESSAGE_MIXIN_OFFSET_QUARK,
+                    GINT_TO_POINTER (offset));
+
+  mixin = TP_MESSAGE_MIXIN (obj);
+
+  mixin->priv = g_slice_new0 (TpMessageMixinPrivate);
+
+  mixin->priv->pending = g_queue_new ();
+  mixin->priv->pending_links = g_hash_table_new (NULL, NULL);
+  mixin->priv->pending_tokens = g_hash_table_new (g_str_hash, g_str_equal);
+  g_queue_init (&mixin->priv->spilled);
+  mixin->priv->spilled_links = g_hash_table_new (NULL, NULL);
+  mixin->priv->recv_id = 0;
+  mixin->priv->msg_types = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      TP_NUM_CHANNEL_TEXT_MESSAGE_TYPES);
+  mixin->priv->connection = g_object_ref (connection);
+
+  mixin->priv->supported_content_types = g_new0 (gchar *, 1);
+
+  mixin->priv->chat_states = _tp_chat_state_map_new ();
+  mixin->priv->chat_state_limiters = g_hash_table_new_full (NULL, NULL,
+      NULL, chat_state_limiter_free);
+
+  mixin->priv->outgoing_batch = g_ptr_array_new ();
+  mixin->priv->outgoing_batch_flags = g_array_new (FALSE, FALSE,
+      sizeof (TpMessageSendingFlags));
+}
+
+
+/**
+ * tp_message_mixin_clear:
+ * @obj: An object with this mixin
+ *
+ * Clear the pending message queue, deleting all messages without emitting
+ * PendingMessagesRemoved.
+ */
+void
+tp_message_mixin_clear (GObject *obj)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
+  TpMessage *item;
+
+  GList *link_;
+
+  while ((link_ = g_queue_peek_head_link (&mixin->priv->spilled)) != NULL)
+    spilled_delete_link (mixin, link_);
+
+  g_hash_table_remove_all (mixin->priv->pending_links);
+  g_hash_table_remove_all (mixin->priv->pending_tokens);
+
+  while ((item = g_queue_pop_head (mixin->priv->pending)) != NULL)
+    {
+      tp_message_destroy (item);
+    }
+}
+
+
+/**
+ * tp_message_mixin_set_max_pending_in_memory:
+ * @obj: An object with this mixin
+ * @max: the largest number of pending messages to keep in memory, or 0
+ *  to keep them all in memory (the default)
+ * @spill_filename: (allow-none): the file in which to store older pending
+ *  messages, which must be non-%NULL if @max is non-zero
+ *
+ * Limit the number of unacknowledged messages held in memory. When more
+ * than @max messages are pending, the oldest are appended to
+ * @spill_filename, and are read back when they are listed or their content
+ * is requested; no messages are lost. The file is deleted when all the
+ * messages in it have been acknowledged, or the channel is finalized.
+ *
+ * If messages have already been written to a file, @spill_filename must
+ * be the same as in the previous call, or %NULL if @max is 0. Setting
+ * @max to 0 does not reload messages that have already been written out.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_message_mixin_set_max_pending_in_memory (GObject *obj,
+    guint max,
+    const gchar *spill_filename)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
+
+  g_return_if_fail (max == 0 || spill_filename != NULL);
+  g_return_if_fail (mixin->priv->spill_file == NULL ||
+      spill_filename == NULL ||
+      !tp_strdiff (spill_filename, mixin->priv->spill_path));
+
+  mixin->priv->max_pending_in_memory = max;
+
+  if (mixin->priv->spill_file == NULL)
+    {
+      g_free (mixin->priv->spill_path);
+      mixin->priv->spill_path = g_strdup (spill_filename);
+    }
+
+  pending_enforce_limit (mixin);
+}
+
+
+/* Take a message that was pending when the journal was written, with
+ * the handles of its previous life replaced by that of its sender's
+ * identifier in this one. Returns: %FALSE if it couldn't be taken */
+static gboolean
+journal_rescue (GObject *obj,
+                GVariant *parts_variant)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
+  GValue value = G_VALUE_INIT;
+  GPtrArray *parts;
+  GHashTable *header;
+  const gchar *sender_id;
+  TpHandle sender = 0;
+  TpMessage *msg;
+
+  dbus_g_value_parse_g_variant (parts_variant, &value);
+
+  if (!G_VALUE_HOLDS (&value, TP_ARRAY_TYPE_MESSAGE_PART_LIST))
+    {
+      DEBUG ("couldn't rescue a message of the wrong type from %s",
+          mixin->priv->journal_path);
+      g_value_unset (&value);
+      return FALSE;
+    }
+
+  parts = g_value_get_boxed (&value);
+  header = g_ptr_array_index (parts, 0);
+
+  g_hash_table_remove (header, "message-sender");
+  g_hash_table_remove (header, "pending-message-id");
+  sender_id = tp_asv_get_string (header, "message-sender-id");
+
+  if (sender_id != NULL)
+    {
+      GError *error = NULL;
+
+      sender = tp_handle_ensure (tp_base_connection_get_handles (
+            mixin->priv->connection, TP_HANDLE_TYPE_CONTACT), sender_id,
+          NULL, &error);
+
+      if (sender == 0)
+        {
+          DEBUG ("couldn't rescue a message from '%s': %s", sender_id,
+              error->message);
+          g_error_free (error);
+          g_value_unset (&value);
+          return FALSE;
+        }
+    }
+
+  msg = _tp_cm_message_new_from_parts (mixin->priv->connection, parts);
+  g_value_unset (&value);
+
+  if (sender != 0)
+    tp_cm_message_set_sender (msg, sender);
+
+  tp_message_set_boolean (msg, 0, "rescued", TRUE);
+  tp_message_mixin_take_received (obj, msg);
+  return TRUE;
+}
+
+/**
+ * tp_message_mixin_set_journal:
+ * @obj: An object with this mixin
+ * @filename: the file in which to keep a journal of unacknowledged
+ *  messages
+ * @error: used to raise an error if %FALSE is returned
+ *
+ * Keep a journal of the messages received by @obj that have not been
+ * acknowledged, so that they survive the connection manager exiting or
+ * crashing. Every received message is appended to @filename, and so is
+ * a record of its acknowledgement; the writes made in one main loop
+ * iteration are flushed to disk together.
+ *
+ * If @filename already exists, the messages still pending in it are
+ * first received again, as if with tp_message_mixin_take_received(),
+ * but marked as rescued, as for tp_message_mixin_set_rescued(); any
+ * that cannot be, for instance because their sender's identifier is no
+ * longer valid, are kept in the journal. The old journal is only
+ * replaced once the new one has been written to disk. A
+ * connection manager should call this function as soon as it has
+ * created the channel, with a filename that identifies the channel
+ * across restarts, such as one derived from its account and target; it
+ * can then avoid fetching the same messages from the server again.
+ *
+ * Content streams, and the handles of contacts other than the sender,
+ * are not kept in the journal. The file is deleted when @obj is finalized
+ * with no messages pending.
+ *
+ * This function may only be called once for each channel.
+ *
+ * Returns: %TRUE if the journal is being kept
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_message_mixin_set_journal (GObject *obj,
+    const gchar *filename,
+    GError **error)
+{
+  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
+  GPtrArray *rescued = NULL;
+  gchar *contents;
+  gsize length;
+  GError *inner_error = NULL;
+  gchar *tmp_path;
+  int fd, saved_errno = 0;
+  GList *cur;
+  guint i;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (mixin->priv->journal_path == NULL, FALSE);
+
+  if (g_file_get_contents (filename, &contents, &length, &inner_error))
     {
-      tp_dbus_g_method_return_not_implemented (context);
-      return;
+      rescued = journal_parse (filename, contents, length);
+      g_free (contents);
     }
-
-  if (state >= TP_NUM_CHANNEL_CHAT_STATES)
+  else if (!g_error_matches (inner_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
     {
-      DEBUG ("invalid chat state %u", state);
-
-      g_set_error (&error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "invalid state: %u", state);
-      goto error;
+      g_propagate_error (error, inner_error);
+      return FALSE;
+    }
+  else
+    {
+      g_clear_error (&inner_error);
     }
 
-  if (state == TP_CHANNEL_CHAT_STATE_GONE)
+  /* rewrite it from scratch, leaving out whatever was acknowledged; the
+   * new journal only replaces the old one once it has everything that
+   * was pending in it, so neither a crash nor an error loses messages */
+  tmp_path = g_strdup_printf ("%s.XXXXXX", filename);
+  fd = g_mkstemp (tmp_path);
+
+  if (fd >= 0)
     {
-      /* We cannot explicitly set the Gone state */
-      DEBUG ("you may not explicitly set the Gone state");
+      mixin->priv->journal_file = fdopen (fd, "wb");
 
-      g_set_error (&error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
-          "you may not explicitly set the Gone state");
-      goto error;
+      if (mixin->priv->journal_file == NULL)
+        {
+          saved_errno = errno;
+          close (fd);
+        }
+    }
+  else
+    {
+      saved_errno = errno;
     }
 
-  if (!mixin->priv->send_chat_state (object, state, &error))
-    goto error;
+  if (mixin->priv->journal_file == NULL)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+          "Unable to create %s: %s", tmp_path, g_strerror (saved_errno));
 
-  mixin->priv->send_gone = TRUE;
-  tp_message_mixin_change_chat_state (object, get_self_handle (object), state);
+      if (fd >= 0)
+        g_unlink (tmp_path);
 
-  tp_svc_channel_interface_chat_state_return_from_set_chat_state (context);
-  return;
+      g_free (tmp_path);
+      tp_clear_pointer (&rescued, g_ptr_array_unref);
+      return FALSE;
+    }
 
-error:
-  dbus_g_method_return_error (context, error);
-  g_clear_error (&error);
-}
+  mixin->priv->journal_path = g_strdup (filename);
+  mixin->priv->journal_live = 0;
 
-/**
- * tp_message_mixin_init:
- * @obj: An instance of the implementation that uses this mixin
- * @offset: The byte offset of the TpMessageMixin within the object structure
- * @connection: A #TpBaseConnection
- *
- * Initialize the mixin. Should be called from the implementation's
- * instance init function or constructor like so:
- *
- * <informalexample><programlisting>
- * tp_message_mixin_init ((GObject *) self,
- *     G_STRUCT_OFFSET (SomeObject, message_mixin),
- *     self->connection);
- * </programlisting></informalexample>
- *
- * Since: 0.7.21
- */
-void
-tp_message_mixin_init (GObject *obj,
-                       gsize offset,
-                       TpBaseConnection *connection)
-{
-  TpMessageMixin *mixin;
+  /* anything received before now is only in memory */
+  for (cur = g_queue_peek_head_link (mixin->priv->pending);
+      cur != NULL;
+      cur = cur->next)
+    {
+      TpMessage *msg = cur->data;
 
-  g_assert (G_IS_OBJECT (obj));
+      journal_append (mixin, ((TpCMMessage *) msg)->incoming_id, msg->parts);
+    }
 
-  g_type_set_qdata (G_OBJECT_TYPE (obj),
-                    TP_MESSAGE_MIXIN_OFFSET_QUARK,
-                    GINT_TO_POINTER (offset));
+  for (cur = g_queue_peek_head_link (&mixin->priv->spilled);
+      cur != NULL;
+      cur = cur->next)
+    {
+      SpilledMessage *spilled = cur->data;
+      TpMessage *msg = spilled_message_load (mixin, spilled);
 
-  mixin = TP_MESSAGE_MIXIN (obj);
+      if (msg != NULL)
+        {
+          journal_append (mixin, spilled->id, msg->parts);
+          tp_message_destroy (msg);
+        }
+    }
 
-  mixin->priv = g_slice_new0 (TpMessageMixinPrivate);
+  if (rescued != NULL)
+    {
+      DEBUG ("rescuing %u messages from %s", rescued->len, filename);
 
-  mixin->priv->pending = g_queue_new ();
-  mixin->priv->recv_id = 0;
-  mixin->priv->msg_types = g_array_sized_new (FALSE, FALSE, sizeof (guint),
-      TP_NUM_CHANNEL_TEXT_MESSAGE_TYPES);
-  mixin->priv->connection = g_object_ref (connection);
+      for (i = 0; i < rescued->len; i++)
+        {
+          GVariant *parts_variant = g_ptr_array_index (rescued, i);
 
-  mixin->priv->supported_content_types = g_new0 (gchar *, 1);
+          /* keep it for a later attempt, under an ID that is never
+           * allocated, so nothing in this life acknowledges it */
+          if (!journal_rescue (obj, parts_variant))
+            journal_write (mixin, G_MAXUINT32, FALSE, parts_variant);
+        }
 
-  mixin->priv->chat_states = g_hash_table_new (NULL, NULL);
-}
+      g_ptr_array_unref (rescued);
+    }
 
+  if (mixin->priv->journal_sync_idle != 0)
+    {
+      _tp_source_remove (mixin->priv->journal_sync_idle);
+      mixin->priv->journal_sync_idle = 0;
+    }
 
-/**
- * tp_message_mixin_clear:
- * @obj: An object with this mixin
- *
- * Clear the pending message queue, deleting all messages without emitting
- * PendingMessagesRemoved.
- */
-void
-tp_message_mixin_clear (GObject *obj)
-{
-  TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
-  TpMessage *item;
+  /* journal_write() has already given up if this is NULL */
+  if (mixin->priv->journal_file == NULL)
+    saved_errno = EIO;
+  else if (fflush (mixin->priv->journal_file) != 0 ||
+      fsync (fileno (mixin->priv->journal_file)) != 0 ||
+      g_rename (tmp_path, filename) != 0)
+    saved_errno = errno;
 
-  while ((item = g_queue_pop_head (mixin->priv->pending)) != NULL)
+  if (saved_errno != 0)
     {
-      tp_message_destroy (item);
+      /* the rescued messages are pending anyway, and the old journal is
+       * still there for the next attempt */
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+          "Unable to replace %s: %s", filename, g_strerror (saved_errno));
+      journal_close (mixin);
+      g_unlink (tmp_path);
+      g_free (tmp_path);
+      tp_clear_pointer (&mixin->priv->journal_path, g_free);
+      return FALSE;
     }
+
+  g_free (tmp_path);
+  return TRUE;
 }
 
 
@@ -576,15 +1626,59 @@ tp_message_mixin_finalize (GObject *obj)
 
   DEBUG ("%p", obj);
 
+  if (mixin->priv->outgoing_batch_idle != 0)
+    _tp_source_remove (mixin->priv->outgoing_batch_idle);
+
+  if (mixin->priv->outgoing_batch->len > 0)
+    {
+      GError error = { TP_ERROR, TP_ERROR_CANCELLED,
+          "Channel was destroyed before the message was sent" };
+      guint i;
+
+      for (i = 0; i < mixin->priv->outgoing_batch->len; i++)
+        tp_message_mixin_sent (obj,
+            g_ptr_array_index (mixin->priv->outgoing_batch, i),
+            g_array_index (mixin->priv->outgoing_batch_flags,
+                TpMessageSendingFlags, i),
+            NULL, &error);
+    }
+
+  g_ptr_array_unref (mixin->priv->outgoing_batch);
+  g_array_unref (mixin->priv->outgoing_batch_flags);
+
+  /* messages that are still pending stay in the journal, to be rescued by
+   * the next channel to use it */
+  if (mixin->priv->journal_sync_idle != 0)
+    {
+      _tp_source_remove (mixin->priv->journal_sync_idle);
+      journal_sync_cb (mixin);
+    }
+
+  journal_close (mixin);
+
+  if (mixin->priv->journal_path != NULL && mixin->priv->journal_live == 0 &&
+      g_unlink (mixin->priv->journal_path) != 0 && errno != ENOENT)
+    DEBUG ("couldn't remove %s: %s", mixin->priv->journal_path,
+        g_strerror (errno));
+
+  g_free (mixin->priv->journal_path);
+
   tp_message_mixin_clear (obj);
   g_assert (g_queue_is_empty (mixin->priv->pending));
   g_queue_free (mixin->priv->pending);
+  g_hash_table_unref (mixin->priv->pending_links);
+  g_hash_table_unref (mixin->priv->pending_tokens);
+  g_assert (g_queue_is_empty (&mixin->priv->spilled));
+  g_assert (mixin->priv->spill_file == NULL);
+  g_hash_table_unref (mixin->priv->spilled_links);
+  g_free (mixin->priv->spill_path);
   g_array_unref (mixin->priv->msg_types);
   g_strfreev (mixin->priv->supported_content_types);
 
   g_object_unref (mixin->priv->connection);
 
-  g_hash_table_unref (mixin->priv->chat_states);
+  g_hash_table_unref (mixin->priv->chat_state_limiters);
+  _tp_chat_state_map_free (mixin->priv->chat_states);
 
   g_slice_free (TpMessageMixinPrivate, mixin->priv);
 }
@@ -597,6 +1691,7 @@ tp_message_mixin_acknowledge_pending_messages_async (
 {
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (iface);
   GPtrArray *links = g_ptr_array_sized_new (ids->len);
+  GPtrArray *spilled_links = g_ptr_array_new ();
   TpIntset *seen = tp_intset_new ();
   guint i;
 
@@ -616,8 +1711,15 @@ tp_message_mixin_acknowledge_pending_messages_async (
         }
 
       tp_intset_add (seen, id);
-      link_ = g_queue_find_custom (mixin->priv->pending,
-          GUINT_TO_POINTER (id), pending_item_id_equals_data);
+      link_ = pending_find_link (mixin, id);
+
+      if (link_ != NULL)
+        {
+          g_ptr_array_add (links, link_);
+          continue;
+        }
+
+      link_ = spilled_find_link (mixin, id);
 
       if (link_ == NULL)
         {
@@ -629,11 +1731,12 @@ tp_message_mixin_acknowledge_pending_messages_async (
           g_error_free (error);
 
           g_ptr_array_unref (links);
+          g_ptr_array_unref (spilled_links);
           tp_intset_destroy (seen);
           return;
         }
 
-      g_ptr_array_add (links, link_);
+      g_ptr_array_add (spilled_links, link_);
     }
 
   tp_svc_channel_interface_messages_emit_pending_messages_removed (iface,
@@ -642,65 +1745,96 @@ tp_message_mixin_acknowledge_pending_messages_async (
   for (i = 0; i < links->len; i++)
     {
       GList *link_ = g_ptr_array_index (links, i);
-      TpMessage *item = link_->data;
       TpCMMessage *cm_msg = link_->data;
 
       DEBUG ("acknowledging message id %u", cm_msg->incoming_id);
 
-      g_queue_delete_link (mixin->priv->pending, link_);
-      tp_message_destroy (item);
+      journal_append (mixin, cm_msg->incoming_id, NULL);
+      pending_delete_link (mixin, link_);
+    }
+
+  for (i = 0; i < spilled_links->len; i++)
+    {
+      GList *link_ = g_ptr_array_index (spilled_links, i);
+      SpilledMessage *spilled = link_->data;
+
+      DEBUG ("acknowledging spilled message id %u", spilled->id);
+
+      journal_append (mixin, spilled->id, NULL);
+      spilled_delete_link (mixin, link_);
     }
 
   g_ptr_array_unref (links);
+  g_ptr_array_unref (spilled_links);
   tp_intset_destroy (seen);
   tp_svc_channel_type_text_return_from_acknowledge_pending_messages (context);
 }
 
+static GValueArray *
+pending_text_message_new (TpMessage *msg)
+{
+  TpCMMessage *cm_msg = (TpCMMessage *) msg;
+  GType pending_type = TP_STRUCT_TYPE_PENDING_TEXT_MESSAGE;
+  GValue val = { 0, };
+  gchar *text;
+  TpChannelTextMessageFlags flags;
+  TpChannelTextMessageType type;
+  TpHandle sender;
+  guint timestamp;
+
+  text = parts_to_text (msg, &flags, &type, &sender, &timestamp);
+
+  g_value_init (&val, pending_type);
+  g_value_take_boxed (&val,
+      dbus_g_type_specialized_construct (pending_type));
+  dbus_g_type_struct_set (&val,
+      0, cm_msg->incoming_id,
+      1, timestamp,
+      2, sender,
+      3, type,
+      4, flags,
+      5, text,
+      G_MAXUINT);
+
+  g_free (text);
+
+  return g_value_get_boxed (&val);
+}
+
 static void
 tp_message_mixin_list_pending_messages_async (TpSvcChannelTypeText *iface,
                                               gboolean clear,
                                               DBusGMethodInvocation *context)
 {
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (iface);
-  GType pending_type = TP_STRUCT_TYPE_PENDING_TEXT_MESSAGE;
   guint count;
   GPtrArray *messages;
   GList *cur;
   guint i;
 
-  count = g_queue_get_length (mixin->priv->pending);
+  count = g_queue_get_length (&mixin->priv->spilled) +
+      g_queue_get_length (mixin->priv->pending);
   messages = g_ptr_array_sized_new (count);
 
-  for (cur = g_queue_peek_head_link (mixin->priv->pending);
+  /* spilled messages are the oldest, so they come first */
+  for (cur = g_queue_peek_head_link (&mixin->priv->spilled);
        cur != NULL;
        cur = cur->next)
     {
-      TpMessage *msg = cur->data;
-      TpCMMessage *cm_msg = cur->data;
-      GValue val = { 0, };
-      gchar *text;
-      TpChannelTextMessageFlags flags;
-      TpChannelTextMessageType type;
-      TpHandle sender;
-      guint timestamp;
-
-      text = parts_to_text (msg, &flags, &type, &sender, &timestamp);
-
-      g_value_init (&val, pending_type);
-      g_value_take_boxed (&val,
-          dbus_g_type_specialized_construct (pending_type));
-      dbus_g_type_struct_set (&val,
-          0, cm_msg->incoming_id,
-          1, timestamp,
-          2, sender,
-          3, type,
-          4, flags,
-          5, text,
-          G_MAXUINT);
+      TpMessage *msg = spilled_message_load (mixin, cur->data);
 
-      g_free (text);
+      if (msg == NULL)
+        continue;
+
+      g_ptr_array_add (messages, pending_text_message_new (msg));
+      tp_message_destroy (msg);
+    }
 
-      g_ptr_array_add (messages, g_value_get_boxed (&val));
+  for (cur = g_queue_peek_head_link (mixin->priv->pending);
+       cur != NULL;
+       cur = cur->next)
+    {
+      g_ptr_array_add (messages, pending_text_message_new (cur->data));
     }
 
   if (clear)
@@ -708,20 +1842,28 @@ tp_message_mixin_list_pending_messages_async (TpSvcChannelTypeText *iface,
       GArray *ids;
 
       DEBUG ("WARNING: ListPendingMessages(clear=TRUE) is deprecated");
-      cur = g_queue_peek_head_link (mixin->priv->pending);
 
       ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), count);
 
+      while ((cur = g_queue_peek_head_link (&mixin->priv->spilled)) != NULL)
+        {
+          SpilledMessage *spilled = cur->data;
+
+          i = spilled->id;
+          g_array_append_val (ids, i);
+          spilled_delete_link (mixin, cur);
+        }
+
+      cur = g_queue_peek_head_link (mixin->priv->pending);
+
       while (cur != NULL)
         {
-          TpMessage *msg = cur->data;
           TpCMMessage *cm_msg = cur->data;
           GList *next = cur->next;
 
           i = cm_msg->incoming_id;
           g_array_append_val (ids, i);
-          g_queue_delete_link (mixin->priv->pending, cur);
-          tp_message_destroy (msg);
+          pending_delete_link (mixin, cur);
 
           cur = next;
         }
@@ -740,6 +1882,137 @@ tp_message_mixin_list_pending_messages_async (TpSvcChannelTypeText *iface,
   g_ptr_array_unref (messages);
 }
 
+typedef struct {
+    DBusGMethodInvocation *context;
+    /* the message whose content is being retrieved */
+    TpMessage *message;
+    /* part number => GValue * borrowed from message or owned_values */
+    GHashTable *ret;
+    /* GValue * which were read from content streams */
+    GPtrArray *owned_values;
+    /* part numbers whose content is still to be read from a stream */
+    GArray *stream_parts;
+    guint next;
+} ContentRetrieval;
+
+static void
+content_retrieval_free (ContentRetrieval *r)
+{
+  g_hash_table_unref (r->ret);
+  g_ptr_array_unref (r->owned_values);
+  g_array_unref (r->stream_parts);
+  tp_message_destroy (r->message);
+  g_slice_free (ContentRetrieval, r);
+}
+
+static void
+content_retrieval_fail (ContentRetrieval *r,
+                        GError *error)
+{
+  GError *tp_error = g_error_new (TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+      "couldn't read part %u of message %u: %s",
+      g_array_index (r->stream_parts, guint, r->next),
+      ((TpCMMessage *) r->message)->incoming_id, error->message);
+
+  DEBUG ("%s", tp_error->message);
+  dbus_g_method_return_error (r->context, tp_error);
+  g_error_free (tp_error);
+  g_error_free (error);
+  content_retrieval_free (r);
+}
+
+static void
+content_retrieval_succeed (ContentRetrieval *r)
+{
+  tp_svc_channel_interface_messages_return_from_get_pending_message_content (
+      r->context, r->ret);
+  content_retrieval_free (r);
+}
+
+static gboolean
+stream_can_rewind (GInputStream *stream)
+{
+  return G_IS_SEEKABLE (stream) && g_seekable_can_seek (G_SEEKABLE (stream));
+}
+
+static void content_retrieval_continue (ContentRetrieval *r);
+
+static void
+content_retrieval_spliced_cb (GObject *source,
+                              GAsyncResult *result,
+                              gpointer user_data)
+{
+  ContentRetrieval *r = user_data;
+  GMemoryOutputStream *sink = G_MEMORY_OUTPUT_STREAM (source);
+  GHashTable *streams = _tp_cm_message_get_content_streams (r->message);
+  guint part = g_array_index (r->stream_parts, guint, r->next);
+  GError *error = NULL;
+  GBytes *bytes;
+  gconstpointer data;
+  gsize len;
+  GValue *value;
+
+  if (g_output_stream_splice_finish (G_OUTPUT_STREAM (sink), result,
+          &error) < 0)
+    {
+      content_retrieval_fail (r, error);
+      g_object_unref (sink);
+      return;
+    }
+
+  bytes = g_memory_output_stream_steal_as_bytes (sink);
+  data = g_bytes_get_data (bytes, &len);
+  value = tp_g_value_slice_new_bytes (len, data);
+  g_ptr_array_add (r->owned_values, value);
+  g_hash_table_insert (r->ret, GUINT_TO_POINTER (part), value);
+
+  /* a stream that can't be rewound can only be read once, so replace it
+   * with what we read from it */
+  if (!stream_can_rewind (g_hash_table_lookup (streams,
+          GUINT_TO_POINTER (part))))
+    g_hash_table_insert (streams, GUINT_TO_POINTER (part),
+        g_memory_input_stream_new_from_bytes (bytes));
+
+  g_bytes_unref (bytes);
+  g_object_unref (sink);
+
+  r->next++;
+  content_retrieval_continue (r);
+}
+
+/* Read the next streamed part, or reply if there are no more */
+static void
+content_retrieval_continue (ContentRetrieval *r)
+{
+  GInputStream *stream;
+  GOutputStream *sink;
+  GError *error = NULL;
+
+  if (r->next >= r->stream_parts->len)
+    {
+      content_retrieval_succeed (r);
+      return;
+    }
+
+  stream = g_hash_table_lookup (_tp_cm_message_get_content_streams (
+        r->message),
+      GUINT_TO_POINTER (g_array_index (r->stream_parts, guint, r->next)));
+  g_assert (stream != NULL);
+
+  if (stream_can_rewind (stream) &&
+      !g_seekable_seek (G_SEEKABLE (stream), 0, G_SEEK_SET, NULL, &error))
+    {
+      content_retrieval_fail (r, error);
+      return;
+    }
+
+  /* the ref on sink is released in the callback */
+  sink = g_memory_output_stream_new_resizable ();
+  g_output_stream_splice_async (sink, stream,
+      G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, G_PRIORITY_DEFAULT, NULL,
+      content_retrieval_spliced_cb, r);
+}
+
 static void
 tp_message_mixin_get_pending_message_content_async (
     TpSvcChannelInterfaceMessages *iface,
@@ -750,13 +2023,33 @@ tp_message_mixin_get_pending_message_content_async (
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (iface);
   GList *node;
   TpMessage *item;
-  GHashTable *ret;
+  GHashTable *streams;
+  ContentRetrieval *r;
   guint i;
 
-  node = g_queue_find_custom (mixin->priv->pending,
-      GUINT_TO_POINTER (message_id), pending_item_id_equals_data);
+  node = pending_find_link (mixin, message_id);
+
+  if (node != NULL)
+    {
+      item = g_object_ref (node->data);
+    }
+  else if ((node = spilled_find_link (mixin, message_id)) != NULL)
+    {
+      /* a copy of a spilled message, which the ContentRetrieval will own */
+      item = spilled_message_load (mixin, node->data);
+
+      if (item == NULL)
+        {
+          GError *error = g_error_new (TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+              "message %u could not be read back from disk", message_id);
 
-  if (node == NULL)
+          DEBUG ("%s", error->message);
+          dbus_g_method_return_error (context, error);
+          g_error_free (error);
+          return;
+        }
+    }
+  else
     {
       GError *error = g_error_new (TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
           "invalid message id %u", message_id);
@@ -767,8 +2060,6 @@ tp_message_mixin_get_pending_message_content_async (
       return;
     }
 
-  item = node->data;
-
   for (i = 0; i < part_numbers->len; i++)
     {
       guint part = g_array_index (part_numbers, guint, i);
@@ -781,14 +2072,22 @@ tp_message_mixin_get_pending_message_content_async (
           DEBUG ("%s", error->message);
           dbus_g_method_return_error (context, error);
           g_error_free (error);
+          tp_message_destroy (item);
           return;
         }
     }
 
-  /* no free callbacks set - we borrow the content from the message */
-  ret = g_hash_table_new (g_direct_hash, g_direct_equal);
+  r = g_slice_new0 (ContentRetrieval);
+  r->context = context;
+  r->message = item;
+  /* no free callbacks set - values are borrowed from the message, or
+   * owned by owned_values */
+  r->ret = g_hash_table_new (g_direct_hash, g_direct_equal);
+  r->owned_values = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_g_value_slice_free);
+  r->stream_parts = g_array_new (FALSE, FALSE, sizeof (guint));
 
-  /* FIXME: later, need a way to support streaming content */
+  streams = _tp_cm_message_get_content_streams (item);
 
   for (i = 0; i < part_numbers->len; i++)
     {
@@ -805,19 +2104,24 @@ tp_message_mixin_get_pending_message_content_async (
           tp_asv_get_string (part_data, "type") == NULL)
         continue;
 
+      /* streamed content is read after everything else has been found */
+      if (streams != NULL &&
+          g_hash_table_lookup (streams, GUINT_TO_POINTER (part)) != NULL)
+        {
+          g_array_append_val (r->stream_parts, part);
+          continue;
+        }
+
       value = g_hash_table_lookup (part_data, "content");
 
       /* skip parts with no content */
       if (value == NULL)
         continue;
 
-      g_hash_table_insert (ret, GUINT_TO_POINTER (part), value);
+      g_hash_table_insert (r->ret, GUINT_TO_POINTER (part), value);
     }
 
-  tp_svc_channel_interface_messages_return_from_get_pending_message_content (
-      context, ret);
-
-  g_hash_table_unref (ret);
+  content_retrieval_continue (r);
 }
 
 static void
@@ -843,8 +2147,16 @@ queue_pending (GObject *object, TpMessage *pending)
   const GHashTable *header;
   TpDeliveryStatus delivery_status;
   TpCMMessage *cm_message = (TpCMMessage *) pending;
+  const gchar *token = tp_message_get_token (pending);
 
   g_queue_push_tail (mixin->priv->pending, pending);
+  g_hash_table_insert (mixin->priv->pending_links,
+      GUINT_TO_POINTER (cm_message->incoming_id),
+      g_queue_peek_tail_link (mixin->priv->pending));
+
+  if (token != NULL)
+    g_hash_table_insert (mixin->priv->pending_tokens, (gchar *) token,
+        g_queue_peek_tail_link (mixin->priv->pending));
 
   text = parts_to_text (pending, &flags, &type, &sender, &timestamp);
   tp_svc_channel_type_text_emit_received (object, cm_message->incoming_id,
@@ -918,6 +2230,10 @@ queue_pending (GObject *object, TpMessage *pending)
  * until acknowledged, and emit the Received and ReceivedMessage signals. Also
  * emit the SendError signal if the message is a failed delivery report.
  *
+ * If @message supersedes a message that is still pending in memory, and
+ * does not say when the original message was received, its
+ * "original-message-received" header is filled in from that message.
+ *
  * Returns: the message ID
  *
  * Since: 0.7.21
@@ -929,6 +2245,7 @@ tp_message_mixin_take_received (GObject *object,
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
   TpCMMessage *cm_msg = (TpCMMessage *) message;
   GHashTable *header;
+  const gchar *supersedes;
 
   g_return_val_if_fail (cm_msg->incoming_id == G_MAXUINT32, 0);
   g_return_val_if_fail (message->parts->len >= 1, 0);
@@ -949,6 +2266,22 @@ tp_message_mixin_take_received (GObject *object,
     tp_message_set_uint64 (message, 0, "message-received",
         time (NULL));
 
+  supersedes = tp_message_get_supersedes (message);
+
+  /* if it corrects a message that is still pending, say when that one was
+   * received, unless the connection manager already knows */
+  if (supersedes != NULL &&
+      tp_asv_lookup (header, "original-message-received") == NULL)
+    {
+      GList *link_ = g_hash_table_lookup (mixin->priv->pending_tokens,
+          supersedes);
+
+      if (link_ != NULL)
+        tp_message_set_int64 (message, 0, "original-message-received",
+            tp_asv_get_int64 (tp_message_peek (link_->data, 0),
+                "message-received", NULL));
+    }
+
   /* Here we add the message to the incoming queue: Although we have not
    * returned the message ID to the caller directly at this point, we
    * have poked it into the TpMessage, which the caller (and anyone connected
@@ -956,6 +2289,8 @@ tp_message_mixin_take_received (GObject *object,
    * between putting the message into the queue and making its ID available.
    */
   queue_pending (object, message);
+  journal_append (mixin, cm_msg->incoming_id, message->parts);
+  pending_enforce_limit (mixin);
 
   return cm_msg->incoming_id;
 }
@@ -978,7 +2313,18 @@ tp_message_mixin_has_pending_messages (GObject *object,
                                        TpHandle *first_sender)
 {
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (object);
-  TpMessage *msg = g_queue_peek_head (mixin->priv->pending);
+  SpilledMessage *spilled = g_queue_peek_head (&mixin->priv->spilled);
+  TpMessage *msg;
+
+  if (spilled != NULL)
+    {
+      if (first_sender != NULL)
+        *first_sender = spilled->sender;
+
+      return TRUE;
+    }
+
+  msg = g_queue_peek_head (mixin->priv->pending);
 
   if (msg != NULL && first_sender != NULL)
     {
@@ -1009,6 +2355,15 @@ tp_message_mixin_set_rescued (GObject *obj)
   TpMessageMixin *mixin = TP_MESSAGE_MIXIN (obj);
   GList *cur;
 
+  for (cur = g_queue_peek_head_link (&mixin->priv->spilled);
+       cur != NULL;
+       cur = cur->next)
+    {
+      SpilledMessage *spilled = cur->data;
+
+      spilled->rescued = TRUE;
+    }
+
   for (cur = g_queue_peek_head_link (mixin->priv->pending);
        cur != NULL;
        cur = cur->next)
@@ -1166,7 +2521,7 @@ tp_message_mixin_send_async (TpSvcChannelTypeText *iface,
   cm_msg->outgoing_context = context;
   cm_msg->outgoing_text_api = TRUE;
 
-  mixin->priv->send_message ((GObject *) iface, message, 0);
+  dispatch_outgoing ((GObject *) iface, message, 0);
 }
 
 
@@ -1274,7 +2629,7 @@ tp_message_mixin_send_message_async (TpSvcChannelInterfaceMessages *iface,
   cm_msg->outgoing_context = context;
   cm_msg->outgoing_text_api = FALSE;
 
-  mixin->priv->send_message ((GObject *) iface, message, flags);
+  dispatch_outgoing ((GObject *) iface, message, flags);
 }
 
 
@@ -1377,12 +2732,26 @@ tp_message_mixin_get_dbus_property (GObject *object,
 
   if (name == q_pending_messages)
     {
-      GPtrArray *arrays = g_ptr_array_sized_new (g_queue_get_length (
-            mixin->priv->pending));
+      GPtrArray *arrays = g_ptr_array_sized_new (
+          g_queue_get_length (&mixin->priv->spilled) +
+          g_queue_get_length (mixin->priv->pending));
       GList *l;
       GType type = dbus_g_type_get_collection ("GPtrArray",
           TP_HASH_TYPE_MESSAGE_PART);
 
+      for (l = g_queue_peek_head_link (&mixin->priv->spilled);
+           l != NULL;
+           l = g_list_next (l))
+        {
+          TpMessage *msg = spilled_message_load (mixin, l->data);
+
+          if (msg == NULL)
+            continue;
+
+          g_ptr_array_add (arrays, g_boxed_copy (type, msg->parts));
+          tp_message_destroy (msg);
+        }
+
       for (l = g_queue_peek_head_link (mixin->priv->pending);
            l != NULL;
            l = g_list_next (l))
@@ -1412,7 +2781,8 @@ tp_message_mixin_get_dbus_property (GObject *object,
     }
   else if (name == q_chat_states)
     {
-      g_value_set_boxed (value, mixin->priv->chat_states);
+      g_value_take_boxed (value,
+          _tp_chat_state_map_dup_hash (mixin->priv->chat_states));
     }
 }
 
@@ -56,6 +56,16 @@ void tp_message_mixin_set_rescued (GObject *obj);
 
 void tp_message_mixin_clear (GObject *obj);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_message_mixin_set_max_pending_in_memory (GObject *obj,
+    guint max,
+    const gchar *spill_filename);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_message_mixin_set_journal (GObject *obj,
+    const gchar *filename,
+    GError **error);
+
 /* Sending */
 
 typedef void (*TpMessageMixinSendImpl) (GObject *object,
@@ -72,6 +82,15 @@ void tp_message_mixin_implement_sending (GObject *object,
     TpDeliveryReportingSupportFlags delivery_reporting_support_flags,
     const gchar * const * supported_content_types);
 
+typedef void (*TpMessageMixinSendBatchImpl) (GObject *object,
+    guint n_messages,
+    TpMessage * const *messages,
+    const TpMessageSendingFlags *flags);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_message_mixin_implement_send_batch (GObject *object,
+    TpMessageMixinSendBatchImpl send_batch);
+
 /* ChatState */
 
 typedef gboolean (*TpMessageMixinSendChatStateImpl) (GObject *object,
@@ -90,6 +109,10 @@ void tp_message_mixin_implement_send_chat_state (GObject *object,
 _TP_AVAILABLE_IN_0_20
 void tp_message_mixin_maybe_send_gone (GObject *object);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_message_mixin_set_chat_state_interval (GObject *object,
+    guint interval_ms);
+
 /* Initialization */
 void tp_message_mixin_text_iface_init (gpointer g_iface, gpointer iface_data);
 void tp_message_mixin_messages_iface_init (gpointer g_iface,
@@ -43,6 +43,7 @@
 
 #define DEBUG_FLAG TP_DEBUG_MISC
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
 
 G_DEFINE_TYPE (TpMessage, tp_message, G_TYPE_OBJECT)
 
@@ -68,8 +69,16 @@ G_DEFINE_TYPE (TpMessage, tp_message, G_TYPE_OBJECT)
 struct _TpMessagePrivate
 {
   gboolean mutable;
+  /* TRUE if this message was counted by the allocation accounting */
+  gboolean counted;
+  /* the text and flags rendered by tp_message_to_text(), cached once the
+   * message is immutable, or NULL if not yet rendered */
+  gchar *text;
+  TpChannelTextMessageFlags text_flags;
 };
 
+#define MESSAGE_ALLOC_SIZE (sizeof (TpMessage) + sizeof (TpMessagePrivate))
+
 static void
 tp_message_dispose (GObject *object)
 {
@@ -93,12 +102,26 @@ tp_message_dispose (GObject *object)
     dispose (object);
 }
 
+static void
+tp_message_finalize (GObject *object)
+{
+  TpMessage *self = TP_MESSAGE (object);
+
+  if (self->priv->counted)
+    _tp_alloc_stats_note_free (_TP_ALLOC_MESSAGE, MESSAGE_ALLOC_SIZE);
+
+  g_free (self->priv->text);
+
+  G_OBJECT_CLASS (tp_message_parent_class)->finalize (object);
+}
+
 static void
 tp_message_class_init (TpMessageClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
   gobject_class->dispose = tp_message_dispose;
+  gobject_class->finalize = tp_message_finalize;
 
   g_type_class_add_private (gobject_class, sizeof (TpMessagePrivate));
 }
@@ -112,6 +135,12 @@ tp_message_init (TpMessage *self)
   /* Message can be modified until _tp_message_set_immutable() is called */
   self->priv->mutable = TRUE;
 
+  if (G_UNLIKELY (_tp_alloc_stats_enabled))
+    {
+      _tp_alloc_stats_record (_TP_ALLOC_MESSAGE, MESSAGE_ALLOC_SIZE);
+      self->priv->counted = TRUE;
+    }
+
   /* Create header part */
   self->parts = g_ptr_array_sized_new (1);
 
@@ -669,7 +698,7 @@ tp_message_set_variant (TpMessage *self,
   g_return_if_fail (self->priv->mutable);
 
   g_variant_ref_sink (value);
-  gvalue = g_slice_new0 (GValue);
+  gvalue = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
   dbus_g_value_parse_g_variant (value, gvalue);
   g_variant_unref (value);
 
@@ -714,6 +743,9 @@ subtract_from_hash (gpointer key,
   g_hash_table_remove (user_data, key);
 }
 
+static gchar *render_text (TpMessage *message,
+    TpChannelTextMessageFlags *out_flags);
+
 /**
  * tp_message_to_text:
  * @message: a #TpMessage
@@ -721,6 +753,10 @@ subtract_from_hash (gpointer key,
  *
  * Concatene all the text parts contained in @message.
  *
+ * The result is cached once @message can no longer be modified, as is the
+ * case for every #TpSignalledMessage, so calling this more than once for
+ * the same message only copies the text.
+ *
  * Returns: (transfer full): a newly allocated string containing the
  * text content of #message
  *
@@ -729,6 +765,43 @@ subtract_from_hash (gpointer key,
 gchar *
 tp_message_to_text (TpMessage *message,
     TpChannelTextMessageFlags *out_flags)
+{
+  g_return_val_if_fail (TP_IS_MESSAGE (message), NULL);
+
+  if (!message->priv->mutable)
+    return g_strdup (_tp_message_peek_text (message, out_flags));
+
+  return render_text (message, out_flags);
+}
+
+/*
+ * _tp_message_peek_text:
+ * @self: an immutable message
+ * @out_flags: (out) (allow-none): the #TpChannelTextMessageFlags of @self
+ *
+ * The same as tp_message_to_text(), but without copying the cached text.
+ *
+ * Returns: (transfer none): the text content of @self, which is valid for
+ *  as long as @self is
+ */
+const gchar *
+_tp_message_peek_text (TpMessage *self,
+    TpChannelTextMessageFlags *out_flags)
+{
+  g_return_val_if_fail (!self->priv->mutable, NULL);
+
+  if (self->priv->text == NULL)
+    self->priv->text = render_text (self, &self->priv->text_flags);
+
+  if (out_flags != NULL)
+    *out_flags = self->priv->text_flags;
+
+  return self->priv->text;
+}
+
+static gchar *
+render_text (TpMessage *message,
+    TpChannelTextMessageFlags *out_flags)
 {
   guint i;
   GHashTable *header = g_ptr_array_index (message->parts, 0);
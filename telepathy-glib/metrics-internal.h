@@ -0,0 +1,51 @@
+/*<private_header>*/
+/* Process-wide D-Bus method and signal statistics (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_METRICS_INTERNAL_H__
+#define __TP_METRICS_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Only meant to be read directly, to avoid doing any work when metrics are
+ * off; use tp_debug_set_metrics() to change it */
+extern gboolean _tp_metrics_enabled;
+
+#define _tp_metrics_are_enabled() G_UNLIKELY (_tp_metrics_enabled)
+
+void _tp_metrics_record_call (const gchar *iface,
+    const gchar *member,
+    gint64 run_usec);
+void _tp_metrics_record_unimplemented (const gchar *iface,
+    const gchar *member);
+void _tp_metrics_record_signal (const gchar *iface,
+    const gchar *member);
+void _tp_metrics_add_signal_bytes (const gchar *iface,
+    const gchar *member,
+    guint64 bytes);
+
+/* implements TpSvcMetrics1 */
+void _tp_metrics_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,364 @@
+/* Process-wide D-Bus method and signal statistics
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/metrics-internal.h"
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/debug.h>
+#include <telepathy-glib/errors.h>
+#include <telepathy-glib/svc-generic.h>
+#include <telepathy-glib/util.h>
+
+/*
+ * Statistics are kept per (interface, member) pair, in two hash tables
+ * protected by one lock: the generated TpSvc code feeds them from
+ * whichever thread dispatches D-Bus calls, which is normally the main
+ * thread, so the lock is uncontended.
+ */
+
+/* the longest latency with a histogram bucket of its own: about a minute */
+#define MAX_BOUND (64 * 1000 * 1000)
+/* buckets per power of two, above the first few microseconds */
+#define SUB_BUCKETS 4
+
+typedef struct {
+    /* owned */
+    gchar *iface;
+    gchar *member;
+} MetricsKey;
+
+typedef struct {
+    MetricsKey key;
+    guint calls;
+    guint unimplemented;
+    /* n_bounds + 1 */
+    guint *histogram;
+} MethodMetrics;
+
+typedef struct {
+    MetricsKey key;
+    guint emissions;
+    guint64 bytes;
+} SignalMetrics;
+
+gboolean _tp_metrics_enabled = FALSE;
+
+static GMutex lock;
+/* MetricsKey => owned MethodMetrics or SignalMetrics */
+static GHashTable *methods = NULL;
+static GHashTable *signals = NULL;
+/* increasing upper bounds of the histogram buckets, in microseconds */
+static GArray *bounds = NULL;
+
+static guint
+metrics_key_hash (gconstpointer p)
+{
+  const MetricsKey *key = p;
+
+  return g_str_hash (key->iface) * 31 + g_str_hash (key->member);
+}
+
+static gboolean
+metrics_key_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const MetricsKey *ka = a;
+  const MetricsKey *kb = b;
+
+  return !tp_strdiff (ka->iface, kb->iface) &&
+      !tp_strdiff (ka->member, kb->member);
+}
+
+static void
+method_metrics_free (gpointer p)
+{
+  MethodMetrics *m = p;
+
+  g_free (m->key.iface);
+  g_free (m->key.member);
+  g_free (m->histogram);
+  g_slice_free (MethodMetrics, m);
+}
+
+static void
+signal_metrics_free (gpointer p)
+{
+  SignalMetrics *s = p;
+
+  g_free (s->key.iface);
+  g_free (s->key.member);
+  g_slice_free (SignalMetrics, s);
+}
+
+/* called with the lock held */
+static void
+ensure_tables (void)
+{
+  guint bound;
+
+  if (methods != NULL)
+    return;
+
+  methods = g_hash_table_new_full (metrics_key_hash, metrics_key_equal,
+      NULL, method_metrics_free);
+  signals = g_hash_table_new_full (metrics_key_hash, metrics_key_equal,
+      NULL, signal_metrics_free);
+
+  /* 1, 2, 3, 4, then SUB_BUCKETS evenly-spaced bounds per power of two:
+   * 5, 6, 7, 8, 10, 12, 14, 16, 20, ... */
+  bounds = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (bound = 1; bound <= SUB_BUCKETS; bound++)
+    g_array_append_val (bounds, bound);
+
+  for (bound = SUB_BUCKETS; bound < MAX_BOUND; )
+    {
+      guint step = bound / SUB_BUCKETS;
+      guint i;
+
+      for (i = 0; i < SUB_BUCKETS; i++)
+        {
+          bound += step;
+          g_array_append_val (bounds, bound);
+        }
+    }
+}
+
+/* called with the lock held */
+static guint
+bucket_for_latency (gint64 usec)
+{
+  guint lo = 0;
+  guint hi = bounds->len;
+
+  /* the first bucket whose bound is at least @usec, or bounds->len */
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+
+      if (g_array_index (bounds, guint, mid) < usec)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/* called with the lock held */
+static MethodMetrics *
+ensure_method (const gchar *iface,
+    const gchar *member)
+{
+  MetricsKey key = { (gchar *) iface, (gchar *) member };
+  MethodMetrics *m;
+
+  ensure_tables ();
+  m = g_hash_table_lookup (methods, &key);
+
+  if (m == NULL)
+    {
+      m = g_slice_new0 (MethodMetrics);
+      m->key.iface = g_strdup (iface);
+      m->key.member = g_strdup (member);
+      m->histogram = g_new0 (guint, bounds->len + 1);
+      g_hash_table_insert (methods, &m->key, m);
+    }
+
+  return m;
+}
+
+/* called with the lock held */
+static SignalMetrics *
+ensure_signal (const gchar *iface,
+    const gchar *member)
+{
+  MetricsKey key = { (gchar *) iface, (gchar *) member };
+  SignalMetrics *s;
+
+  ensure_tables ();
+  s = g_hash_table_lookup (signals, &key);
+
+  if (s == NULL)
+    {
+      s = g_slice_new0 (SignalMetrics);
+      s->key.iface = g_strdup (iface);
+      s->key.member = g_strdup (member);
+      g_hash_table_insert (signals, &s->key, s);
+    }
+
+  return s;
+}
+
+/**
+ * tp_debug_set_metrics:
+ * @enabled: %TRUE to start collecting statistics, %FALSE to stop
+ *
+ * Start or stop counting the D-Bus method calls dispatched to, and the
+ * signals emitted by, this process's service-side objects, and measuring
+ * how long each method's implementation runs.
+ *
+ * While statistics are being collected, #TpBaseConnectionManager and
+ * #TpBaseConnection objects report them to D-Bus clients via the
+ * <literal>org.freedesktop.Telepathy.Metrics1</literal> interface; the
+ * statistics cover the whole process, not just the object they are
+ * requested from. Stopping does not discard the statistics collected so
+ * far, but makes that interface report that they are unavailable.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_debug_set_metrics (gboolean enabled)
+{
+  _tp_metrics_enabled = enabled;
+}
+
+void
+_tp_metrics_record_call (const gchar *iface,
+    const gchar *member,
+    gint64 run_usec)
+{
+  MethodMetrics *m;
+
+  g_mutex_lock (&lock);
+  m = ensure_method (iface, member);
+  m->calls++;
+  m->histogram[bucket_for_latency (run_usec)]++;
+  g_mutex_unlock (&lock);
+}
+
+void
+_tp_metrics_record_unimplemented (const gchar *iface,
+    const gchar *member)
+{
+  MethodMetrics *m;
+
+  g_mutex_lock (&lock);
+  m = ensure_method (iface, member);
+  m->calls++;
+  m->unimplemented++;
+  g_mutex_unlock (&lock);
+}
+
+void
+_tp_metrics_record_signal (const gchar *iface,
+    const gchar *member)
+{
+  g_mutex_lock (&lock);
+  ensure_signal (iface, member)->emissions++;
+  g_mutex_unlock (&lock);
+}
+
+void
+_tp_metrics_add_signal_bytes (const gchar *iface,
+    const gchar *member,
+    guint64 bytes)
+{
+  g_mutex_lock (&lock);
+  ensure_signal (iface, member)->bytes += bytes;
+  g_mutex_unlock (&lock);
+}
+
+static void
+metrics_get_metrics (TpSvcMetrics1 *iface G_GNUC_UNUSED,
+    DBusGMethodInvocation *context)
+{
+  GPtrArray *method_list;
+  GPtrArray *signal_list;
+  GArray *bounds_copy;
+  GHashTableIter iter;
+  gpointer v;
+
+  if (!_tp_metrics_enabled)
+    {
+      GError e = { TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "This service is not collecting statistics" };
+
+      dbus_g_method_return_error (context, &e);
+      return;
+    }
+
+  method_list = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+  signal_list = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+
+  g_mutex_lock (&lock);
+  ensure_tables ();
+
+  g_hash_table_iter_init (&iter, methods);
+
+  while (g_hash_table_iter_next (&iter, NULL, &v))
+    {
+      MethodMetrics *m = v;
+      GArray *histogram = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+          bounds->len + 1);
+
+      g_array_append_vals (histogram, m->histogram, bounds->len + 1);
+      g_ptr_array_add (method_list, tp_value_array_build (5,
+            G_TYPE_STRING, m->key.iface,
+            G_TYPE_STRING, m->key.member,
+            G_TYPE_UINT, m->calls,
+            G_TYPE_UINT, m->unimplemented,
+            DBUS_TYPE_G_UINT_ARRAY, histogram,
+            G_TYPE_INVALID));
+      g_array_unref (histogram);
+    }
+
+  g_hash_table_iter_init (&iter, signals);
+
+  while (g_hash_table_iter_next (&iter, NULL, &v))
+    {
+      SignalMetrics *s = v;
+
+      g_ptr_array_add (signal_list, tp_value_array_build (4,
+            G_TYPE_STRING, s->key.iface,
+            G_TYPE_STRING, s->key.member,
+            G_TYPE_UINT, s->emissions,
+            G_TYPE_UINT64, s->bytes,
+            G_TYPE_INVALID));
+    }
+
+  bounds_copy = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      bounds->len);
+  g_array_append_vals (bounds_copy, bounds->data, bounds->len);
+
+  g_mutex_unlock (&lock);
+
+  tp_svc_metrics1_return_from_get_metrics (context, method_list,
+      signal_list, bounds_copy);
+
+  g_array_unref (bounds_copy);
+  g_ptr_array_unref (signal_list);
+  g_ptr_array_unref (method_list);
+}
+
+void
+_tp_metrics_iface_init (gpointer g_iface,
+    gpointer iface_data G_GNUC_UNUSED)
+{
+  TpSvcMetrics1Class *klass = g_iface;
+
+#define IMPLEMENT(x) tp_svc_metrics1_implement_##x (klass, metrics_##x)
+  IMPLEMENT (get_metrics);
+#undef IMPLEMENT
+}
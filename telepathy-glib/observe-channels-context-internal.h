@@ -70,6 +70,7 @@ void _tp_observe_channels_context_prepare_async (TpObserveChannelsContext *self,
     const GQuark *account_features,
     const GQuark *connection_features,
     const GQuark *channel_features,
+    guint timeout_ms,
     GAsyncReadyCallback callback,
     gpointer user_data);
 
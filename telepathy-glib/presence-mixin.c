@@ -300,11 +300,25 @@
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/contacts-mixin.h>
+#include <telepathy-glib/util-internal.h>
+#include <telepathy-glib/util.h>
 
 #define DEBUG_FLAG TP_DEBUG_PRESENCE
 
 #include "debug-internal.h"
-
+#include "telepathy-glib/base-connection-internal.h"
+#include "telepathy-glib/presence-mixin-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+struct _TpPresenceMixinPrivate {
+    /* see tp_presence_mixin_set_coalescing() */
+    gboolean coalesce;
+    guint latency_ms;
+    /* TpHandle => owned TpPresenceStatus, the latest status of each contact
+     * that has not been emitted yet */
+    GHashTable *pending;
+    guint flush_id;
+};
 
 static GHashTable *construct_simple_presence_hash (
   const TpPresenceStatusSpec *supported_statuses,
@@ -526,9 +540,20 @@ tp_presence_mixin_init (GObject *obj,
 void
 tp_presence_mixin_finalize (GObject *obj)
 {
+  TpPresenceMixin *mixin = TP_PRESENCE_MIXIN (obj);
+
   DEBUG ("%p", obj);
 
   /* free any data held directly by the object here */
+  if (mixin->priv != NULL)
+    {
+      /* the source holds a ref to obj, so it must already be gone */
+      g_assert (mixin->priv->flush_id == 0);
+
+      tp_clear_pointer (&mixin->priv->pending, g_hash_table_unref);
+      g_slice_free (TpPresenceMixinPrivate, mixin->priv);
+      mixin->priv = NULL;
+    }
 }
 
 static void
@@ -583,25 +608,75 @@ construct_presence_hash (const TpPresenceStatusSpec *supported_statuses,
 }
 
 
-/**
- * tp_presence_mixin_emit_presence_update: (skip)
- * @obj: A connection object with this mixin
- * @contact_presences: A mapping of contact handles to #TpPresenceStatus
- *  structures with the presence data to emit
- *
- * Emit the PresenceUpdate signal for multiple contacts. For emitting
- * PresenceUpdate for a single contact, there is a convenience wrapper called
- * #tp_presence_mixin_emit_one_presence_update.
- */
-void
-tp_presence_mixin_emit_presence_update (GObject *obj,
-                                        GHashTable *contact_statuses)
+/* Returns: (transfer full): @contact_statuses without the contacts whose
+ * presence no client is interested in, or %NULL if there are none left */
+static GHashTable *
+filter_interesting_contacts (GObject *obj,
+    GHashTable *contact_statuses)
+{
+  TpBaseConnection *conn;
+  GHashTable *filtered = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (!TP_IS_BASE_CONNECTION (obj))
+    return g_hash_table_ref (contact_statuses);
+
+  conn = (TpBaseConnection *) obj;
+  g_hash_table_iter_init (&iter, contact_statuses);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (!tp_base_connection_is_contact_interesting (conn,
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+            GPOINTER_TO_UINT (key)))
+        {
+          filtered = g_hash_table_new (NULL, NULL);
+          break;
+        }
+    }
+
+  /* the usual case: nothing to leave out */
+  if (filtered == NULL)
+    return g_hash_table_ref (contact_statuses);
+
+  g_hash_table_iter_init (&iter, contact_statuses);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      if (tp_base_connection_is_contact_interesting (conn,
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+            GPOINTER_TO_UINT (key)))
+        g_hash_table_insert (filtered, key, value);
+    }
+
+  if (g_hash_table_size (filtered) == 0)
+    {
+      g_hash_table_unref (filtered);
+      return NULL;
+    }
+
+  return filtered;
+}
+
+static void
+emit_presence_update_now (GObject *obj,
+    GHashTable *all_statuses)
 {
   TpPresenceMixinClass *mixin_cls =
     TP_PRESENCE_MIXIN_CLASS (G_OBJECT_GET_CLASS (obj));
   GHashTable *presence_hash;
+  GHashTable *contact_statuses;
 
-  DEBUG ("called.");
+  /* don't build or emit presences that nobody is looking at */
+  contact_statuses = filter_interesting_contacts (obj, all_statuses);
+
+  if (contact_statuses == NULL)
+    {
+      DEBUG ("no client is interested in any of these %u contacts",
+          g_hash_table_size (all_statuses));
+      return;
+    }
 
   if (g_type_interface_peek (G_OBJECT_GET_CLASS (obj),
       TP_TYPE_SVC_CONNECTION_INTERFACE_PRESENCE) != NULL)
@@ -617,13 +692,227 @@ tp_presence_mixin_emit_presence_update (GObject *obj,
   if (g_type_interface_peek (G_OBJECT_GET_CLASS (obj),
       TP_TYPE_SVC_CONNECTION_INTERFACE_SIMPLE_PRESENCE) != NULL)
     {
+      gboolean sent = FALSE;
+
       presence_hash = construct_simple_presence_hash (mixin_cls->statuses,
         contact_statuses);
-      tp_svc_connection_interface_simple_presence_emit_presences_changed (obj,
-        presence_hash);
+
+      if (TP_IS_BASE_CONNECTION (obj) &&
+          _tp_base_connection_has_unicast_signals (TP_BASE_CONNECTION (obj),
+            TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE))
+        {
+          GVariant *v = _tp_boxed_to_variant (
+              TP_HASH_TYPE_SIMPLE_CONTACT_PRESENCES, "a{u(uss)}",
+              presence_hash);
+
+          /* the connection may deliver these to interested clients only */
+          sent = tp_base_connection_emit_unicast_signal (
+              TP_BASE_CONNECTION (obj),
+              TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+              TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+              "PresencesChanged", g_variant_new_tuple (&v, 1));
+          g_variant_unref (v);
+        }
+
+      if (!sent)
+        tp_svc_connection_interface_simple_presence_emit_presences_changed (
+            obj, presence_hash);
 
       g_hash_table_unref (presence_hash);
     }
+
+  if (TP_IS_BASE_CONNECTION (obj))
+    {
+      GArray *contacts = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+          g_hash_table_size (contact_statuses));
+      GHashTableIter iter;
+      gpointer key;
+
+      g_hash_table_iter_init (&iter, contact_statuses);
+
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          TpHandle handle = GPOINTER_TO_UINT (key);
+
+          g_array_append_val (contacts, handle);
+        }
+
+      /* does nothing unless the connection manager asked for it */
+      tp_contacts_mixin_emit_contact_attributes_changed (obj,
+          TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE, contacts);
+      g_array_unref (contacts);
+    }
+
+  g_hash_table_unref (contact_statuses);
+}
+
+/**
+ * tp_presence_mixin_flush_presence_updates: (skip)
+ * @obj: A connection object with this mixin
+ *
+ * If tp_presence_mixin_set_coalescing() has been used, emit any presence
+ * changes that are still waiting to be emitted, now. Otherwise, do nothing.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_presence_mixin_flush_presence_updates (GObject *obj)
+{
+  TpPresenceMixin *mixin = TP_PRESENCE_MIXIN (obj);
+  GHashTable *pending;
+
+  if (mixin->priv == NULL || mixin->priv->pending == NULL)
+    return;
+
+  if (mixin->priv->flush_id != 0)
+    {
+      /* this drops the source's ref to obj, but our caller has one */
+      _tp_source_remove (mixin->priv->flush_id);
+      mixin->priv->flush_id = 0;
+    }
+
+  pending = mixin->priv->pending;
+  mixin->priv->pending = NULL;
+
+  DEBUG ("emitting %u coalesced presence changes",
+      g_hash_table_size (pending));
+  emit_presence_update_now (obj, pending);
+  g_hash_table_unref (pending);
+}
+
+static gboolean
+flush_presence_updates_cb (gpointer data)
+{
+  GObject *obj = data;
+
+  TP_PRESENCE_MIXIN (obj)->priv->flush_id = 0;
+  tp_presence_mixin_flush_presence_updates (obj);
+  return FALSE;
+}
+
+/*
+ * _tp_presence_mixin_flush_pending:
+ * @obj: (allow-none): any object
+ *
+ * If @obj has the presence mixin, flush its coalesced presence changes, so
+ * that they are emitted before some other signal that must come after them,
+ * such as MembersChanged.
+ */
+void
+_tp_presence_mixin_flush_pending (GObject *obj)
+{
+  if (obj != NULL &&
+      g_type_get_qdata (G_OBJECT_TYPE (obj),
+        TP_PRESENCE_MIXIN_OFFSET_QUARK) != NULL)
+    tp_presence_mixin_flush_presence_updates (obj);
+}
+
+/**
+ * tp_presence_mixin_set_coalescing: (skip)
+ * @obj: A connection object with this mixin
+ * @enabled: %TRUE to coalesce presence changes
+ * @latency_ms: if @enabled is %TRUE, the longest time in milliseconds for
+ *  which a change may be delayed, or 0 to emit at the next main loop
+ *  iteration
+ *
+ * Connection managers that call tp_presence_mixin_emit_presence_update()
+ * or tp_presence_mixin_emit_one_presence_update() many times in quick
+ * succession, for instance while receiving the presences of a whole
+ * roster, can use this to have all those changes emitted together. Until
+ * they are emitted, the changes are kept per contact, so if a contact
+ * changes presence more than once, only their latest presence is emitted.
+ *
+ * Pending changes are always emitted before MembersChanged on a
+ * #TpBaseChannel of the connection, and before the ContactList interface's
+ * ContactsChanged; tp_presence_mixin_flush_presence_updates() can be used
+ * to emit them before other signals. Disabling coalescing also emits them.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_presence_mixin_set_coalescing (GObject *obj,
+    gboolean enabled,
+    guint latency_ms)
+{
+  TpPresenceMixin *mixin = TP_PRESENCE_MIXIN (obj);
+
+  if (mixin->priv == NULL)
+    mixin->priv = g_slice_new0 (TpPresenceMixinPrivate);
+
+  if (!enabled)
+    tp_presence_mixin_flush_presence_updates (obj);
+
+  mixin->priv->coalesce = enabled;
+  mixin->priv->latency_ms = latency_ms;
+}
+
+/**
+ * tp_presence_mixin_emit_presence_update: (skip)
+ * @obj: A connection object with this mixin
+ * @contact_presences: A mapping of contact handles to #TpPresenceStatus
+ *  structures with the presence data to emit
+ *
+ * Emit the PresenceUpdate signal for multiple contacts. For emitting
+ * PresenceUpdate for a single contact, there is a convenience wrapper called
+ * #tp_presence_mixin_emit_one_presence_update.
+ *
+ * If tp_presence_mixin_set_coalescing() has been used, the signal is emitted
+ * later, together with other changes.
+ *
+ * If @obj is a #TpBaseConnection, contacts for which
+ * tp_base_connection_is_contact_interesting() returns %FALSE for
+ * %TP_IFACE_QUARK_CONNECTION_INTERFACE_SIMPLE_PRESENCE are left out, and
+ * nothing is emitted if that leaves none.
+ */
+void
+tp_presence_mixin_emit_presence_update (GObject *obj,
+                                        GHashTable *contact_statuses)
+{
+  TpPresenceMixin *mixin = TP_PRESENCE_MIXIN (obj);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  DEBUG ("called.");
+
+  if (mixin->priv == NULL || !mixin->priv->coalesce)
+    {
+      emit_presence_update_now (obj, contact_statuses);
+      return;
+    }
+
+  if (mixin->priv->pending == NULL)
+    mixin->priv->pending = g_hash_table_new_full (NULL, NULL, NULL,
+        (GDestroyNotify) tp_presence_status_free);
+
+  g_hash_table_iter_init (&iter, contact_statuses);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const TpPresenceStatus *status = value;
+
+      /* replaces any earlier status for the same contact */
+      g_hash_table_insert (mixin->priv->pending, key,
+          tp_presence_status_new (status->index,
+            status->optional_arguments));
+    }
+
+  if (mixin->priv->flush_id == 0)
+    {
+      if (mixin->priv->latency_ms == 0)
+        mixin->priv->flush_id = _tp_idle_add_full (
+            TP_LATENCY_CLASS_NORMAL, flush_presence_updates_cb,
+            g_object_ref (obj), g_object_unref);
+      else
+        {
+          GSource *source = g_timeout_source_new (mixin->priv->latency_ms);
+
+          g_source_set_callback (source, flush_presence_updates_cb,
+              g_object_ref (obj), g_object_unref);
+          mixin->priv->flush_id = g_source_attach (source,
+              g_main_context_get_thread_default ());
+          g_source_unref (source);
+        }
+    }
 }
 
 
@@ -1572,6 +1861,14 @@ tp_presence_mixin_simple_presence_fill_contact_attributes (GObject *obj,
  * Register the SimplePresence interface with the Contacts interface to make it
  * inspectable. The Contacts mixin should be initialized before this function
  * is called
+ *
+ * If every presence change is emitted with
+ * tp_presence_mixin_emit_presence_update() or
+ * tp_presence_mixin_emit_one_presence_update(), rather than by emitting
+ * PresencesChanged directly, connection managers can also call
+ * tp_contacts_mixin_set_contact_attributes_notified() for
+ * %TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE, and the changes will be
+ * signalled by ContactAttributesChanged too.
  */
 void
 tp_presence_mixin_simple_presence_register_with_contacts_mixin (GObject *obj)
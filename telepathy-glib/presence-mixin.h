@@ -177,6 +177,12 @@ void tp_presence_mixin_emit_presence_update (GObject *obj,
 void tp_presence_mixin_emit_one_presence_update (GObject *obj,
     TpHandle handle, const TpPresenceStatus *status);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_presence_mixin_set_coalescing (GObject *obj, gboolean enabled,
+    guint latency_ms);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_presence_mixin_flush_presence_updates (GObject *obj);
+
 void tp_presence_mixin_iface_init (gpointer g_iface, gpointer iface_data);
 void tp_presence_mixin_simple_presence_iface_init (gpointer g_iface, gpointer iface_data);
 void tp_presence_mixin_simple_presence_init_dbus_properties (GObjectClass *cls);
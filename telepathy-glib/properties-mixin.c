@@ -213,10 +213,7 @@ void tp_properties_mixin_finalize (GObject *obj)
       TpProperty *prop = &mixin->properties[i];
 
       if (prop->value)
-        {
-          g_value_unset (prop->value);
-          g_slice_free (GValue, prop->value);
-        }
+        tp_g_value_slice_free (prop->value);
 
       if (ctx->values[i])
         {
@@ -863,6 +860,64 @@ tp_properties_mixin_change_flags (GObject *obj,
     }
 }
 
+/**
+ * tp_properties_mixin_change_values:
+ * @obj: An object with the properties mixin
+ * @n_values: The number of elements in @prop_ids and @values
+ * @prop_ids: (array length=n_values): Property IDs on which to act
+ * @values: (array length=n_values): New property values, in the same order
+ *  as @prop_ids
+ * @add: Property flags to be added via bitwise OR to each of @prop_ids
+ * @del: Property flags to be removed via bitwise AND from each of @prop_ids
+ *
+ * Change the values and flags of several properties at once in response to
+ * a server state change, such as joining a chat room, as if by calling
+ * tp_properties_mixin_change_value() and tp_properties_mixin_change_flags()
+ * for each of them with the same #TpIntset.
+ *
+ * Values which are equal to the stored value, and flags which do not
+ * change, are ignored. At most one PropertiesChanged signal and one
+ * PropertyFlagsChanged signal are emitted, after all the properties have
+ * been updated, so a client never sees a partial change.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_properties_mixin_change_values (GObject *obj,
+    guint n_values,
+    const guint *prop_ids,
+    const GValue *values,
+    TpPropertyFlags add,
+    TpPropertyFlags del)
+{
+  TpPropertiesMixinClass *mixin_cls = TP_PROPERTIES_MIXIN_CLASS (
+      G_OBJECT_GET_CLASS (obj));
+  TpIntset *changed_values, *changed_flags;
+  guint i;
+
+  g_return_if_fail (n_values == 0 || prop_ids != NULL);
+  g_return_if_fail (n_values == 0 || values != NULL);
+
+  changed_values = tp_intset_sized_new (mixin_cls->num_props);
+  changed_flags = tp_intset_sized_new (mixin_cls->num_props);
+
+  for (i = 0; i < n_values; i++)
+    {
+      tp_properties_mixin_change_value (obj, prop_ids[i], values + i,
+          changed_values);
+
+      if (add != 0 || del != 0)
+        tp_properties_mixin_change_flags (obj, prop_ids[i], add, del,
+            changed_flags);
+    }
+
+  tp_properties_mixin_emit_changed (obj, changed_values);
+  tp_properties_mixin_emit_flags (obj, changed_flags);
+
+  tp_intset_destroy (changed_values);
+  tp_intset_destroy (changed_flags);
+}
+
 /**
  * tp_properties_mixin_emit_changed:
  * @obj: an object with the properties mixin
@@ -259,6 +259,10 @@ void tp_properties_mixin_change_value (GObject *obj, guint prop_id,
     const GValue *new_value, TpIntset *props);
 void tp_properties_mixin_change_flags (GObject *obj, guint prop_id,
     TpPropertyFlags add, TpPropertyFlags del, TpIntset *props);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_properties_mixin_change_values (GObject *obj, guint n_values,
+    const guint *prop_ids, const GValue *values, TpPropertyFlags add,
+    TpPropertyFlags del);
 void tp_properties_mixin_emit_changed (GObject *obj, const TpIntset *props);
 void tp_properties_mixin_emit_flags (GObject *obj, const TpIntset *props);
 
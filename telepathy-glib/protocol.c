@@ -150,8 +150,30 @@ struct _TpProtocolPrivate
   GStrv addressable_uri_schemes;
   /* (transfer container) (element-type utf8 Simple_Status_Spec) */
   GHashTable *presence_statuses;
+
+  /* borrowed key => owned NormalizationEntry, where the key says which
+   * method was called with what arguments; see normalization_key() */
+  GHashTable *normalization_cache;
+  /* NormalizationEntry, most recently used first */
+  GQueue normalization_lru;
+  /* TRUE if the CM doesn't have NormalizeContacts */
+  gboolean no_normalize_contacts;
 };
 
+/* how many results of NormalizeContact and similar methods we remember */
+#define NORMALIZATION_CACHE_SIZE 4096
+
+/* the most identifiers we pass to one NormalizeContacts call */
+#define MAX_NORMALIZE_BATCH 1000
+
+typedef struct {
+    /* owned, and also the key in normalization_cache */
+    gchar *key;
+    gchar *normalized;
+    /* the link in normalization_lru whose data is this entry */
+    GList *link;
+} NormalizationEntry;
+
 enum
 {
     PROP_PROTOCOL_NAME = 1,
@@ -434,6 +456,10 @@ tp_protocol_finalize (GObject *object)
   if (self->priv->protocol_properties != NULL)
     g_hash_table_unref (self->priv->protocol_properties);
 
+  /* the entries are freed by the hash table */
+  g_queue_clear (&self->priv->normalization_lru);
+  tp_clear_pointer (&self->priv->normalization_cache, g_hash_table_unref);
+
   if (finalize != NULL)
     finalize (object);
 }
@@ -503,6 +529,28 @@ asv_strdupv_or_empty (const GHashTable *asv,
     return g_strdupv ((GStrv) no_strings);
 }
 
+static void
+tp_protocol_trim (GObject *object,
+    TpTrimLevel level)
+{
+  TpProtocol *self = (TpProtocol *) object;
+  guint keep = 0;
+
+  if (self->priv->normalization_cache == NULL)
+    return;
+
+  if (level == TP_TRIM_LEVEL_MODERATE)
+    keep = g_queue_get_length (&self->priv->normalization_lru) / 2;
+
+  while (g_queue_get_length (&self->priv->normalization_lru) > keep)
+    {
+      NormalizationEntry *oldest = g_queue_pop_tail (
+          &self->priv->normalization_lru);
+
+      g_hash_table_remove (self->priv->normalization_cache, oldest->key);
+    }
+}
+
 static void
 tp_protocol_constructed (GObject *object)
 {
@@ -679,6 +727,8 @@ tp_protocol_constructed (GObject *object)
       had_immutables);
   _tp_proxy_set_feature_prepared (proxy, TP_PROTOCOL_FEATURE_CORE,
       had_immutables && tp_protocol_check_for_core (self));
+
+  _tp_register_trimmable (self, tp_protocol_trim);
 }
 
 enum {
@@ -1667,7 +1717,7 @@ _tp_protocol_parse_channel_class (GKeyFile *file,
       gchar *value = NULL;
       gchar *property = NULL;
       const gchar *dbus_type;
-      GValue *v = g_slice_new0 (GValue);
+      GValue *v = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
 
       value = g_key_file_get_value (file, group, *key, NULL);
 
@@ -1709,7 +1759,7 @@ cleanup:
           if (G_IS_VALUE (v))
             tp_g_value_slice_free (v);
           else
-            g_slice_free (GValue, v);
+            _tp_slice_free_tagged (_TP_ALLOC_GVALUE, GValue, v);
         }
 
       g_free (property);
@@ -2069,9 +2119,94 @@ tp_protocol_get_cm_name (TpProtocol *self)
   return self->priv->cm_name;
 }
 
+static void
+normalization_entry_free (gpointer p)
+{
+  NormalizationEntry *entry = p;
+
+  g_free (entry->key);
+  g_free (entry->normalized);
+  g_slice_free (NormalizationEntry, entry);
+}
+
+/* Returns a key for normalization_cache: @method is a single character
+ * identifying the D-Bus method, and @args are its string arguments */
+static gchar *
+normalization_key (gchar method,
+    const gchar *first_arg,
+    const gchar *second_arg)
+{
+  /* the arguments are UTF-8, so they can't contain \xff */
+  return g_strdup_printf ("%c\xff%s\xff%s", method, first_arg,
+      second_arg == NULL ? "" : second_arg);
+}
+
+/* Remember that the method and arguments in @key returned @normalized.
+ * These methods normalize offline, so the result for a given protocol
+ * cannot change. */
+static void
+tp_protocol_cache_normalization (TpProtocol *self,
+    const gchar *key,
+    const gchar *normalized)
+{
+  NormalizationEntry *entry;
+
+  if (self->priv->normalization_cache == NULL)
+    self->priv->normalization_cache = g_hash_table_new_full (g_str_hash,
+        g_str_equal, NULL, normalization_entry_free);
+
+  entry = g_hash_table_lookup (self->priv->normalization_cache, key);
+
+  if (entry != NULL)
+    {
+      g_free (entry->normalized);
+      entry->normalized = g_strdup (normalized);
+      g_queue_unlink (&self->priv->normalization_lru, entry->link);
+      g_queue_push_head_link (&self->priv->normalization_lru, entry->link);
+      return;
+    }
+
+  entry = g_slice_new0 (NormalizationEntry);
+  entry->key = g_strdup (key);
+  entry->normalized = g_strdup (normalized);
+  g_queue_push_head (&self->priv->normalization_lru, entry);
+  entry->link = self->priv->normalization_lru.head;
+  g_hash_table_insert (self->priv->normalization_cache, entry->key, entry);
+
+  if (g_queue_get_length (&self->priv->normalization_lru) >
+      NORMALIZATION_CACHE_SIZE)
+    {
+      NormalizationEntry *oldest = g_queue_pop_tail (
+          &self->priv->normalization_lru);
+
+      g_hash_table_remove (self->priv->normalization_cache, oldest->key);
+    }
+}
+
+/* Returns: (transfer none): the cached result for @key, or %NULL */
+static const gchar *
+tp_protocol_lookup_normalization (TpProtocol *self,
+    const gchar *key)
+{
+  NormalizationEntry *entry;
+
+  if (self->priv->normalization_cache == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (self->priv->normalization_cache, key);
+
+  if (entry == NULL)
+    return NULL;
+
+  g_queue_unlink (&self->priv->normalization_lru, entry->link);
+  g_queue_push_head_link (&self->priv->normalization_lru, entry->link);
+  return entry->normalized;
+}
+
 /*
  * Handle the result from a tp_cli_protocol_* function that
- * returns one string. user_data is a #GTask.
+ * returns one string. user_data is a #GTask, whose task data is
+ * the normalization_key() under which to cache the result.
  */
 static void
 tp_protocol_async_string_cb (TpProxy *proxy,
@@ -2081,9 +2216,48 @@ tp_protocol_async_string_cb (TpProxy *proxy,
     GObject *weak_object G_GNUC_UNUSED)
 {
   if (error == NULL)
-    g_task_return_pointer (user_data, g_strdup (normalized), g_free);
+    {
+      tp_protocol_cache_normalization ((TpProtocol *) proxy,
+          g_task_get_task_data (user_data), normalized);
+      g_task_return_pointer (user_data, g_strdup (normalized), g_free);
+    }
   else
-    g_task_return_error (user_data, g_error_copy (error));
+    {
+      g_task_return_error (user_data, g_error_copy (error));
+    }
+}
+
+/*
+ * Create a #GTask for a method returning one string, which is cached
+ * under @key. If there is a cached result, return it and return %NULL;
+ * otherwise return the task, which the caller must pass to
+ * tp_protocol_async_string_cb().
+ */
+static GTask *
+tp_protocol_string_task_new (TpProtocol *self,
+    gchar *key,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data,
+    gpointer source_tag)
+{
+  GTask *task;
+  const gchar *cached;
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, source_tag);
+  g_task_set_task_data (task, key, g_free);
+
+  cached = tp_protocol_lookup_normalization (self, key);
+
+  if (cached != NULL)
+    {
+      g_task_return_pointer (task, g_strdup (cached), g_free);
+      g_object_unref (task);
+      return NULL;
+    }
+
+  return task;
 }
 
 /**
@@ -2099,6 +2273,15 @@ tp_protocol_async_string_cb (TpProxy *proxy,
  * normalization (e.g. transforming case-insensitive text to lower-case),
  * but does not query servers or anything similar.
  *
+ * Since the result cannot change, the results of recent calls to this
+ * method and to tp_protocol_identify_account_async(),
+ * tp_protocol_normalize_contact_uri_async() and
+ * tp_protocol_normalize_vcard_address_async() are remembered, and
+ * repeating one of them does not make a D-Bus call.
+ *
+ * To normalize many identifiers, tp_protocol_normalize_contacts_async()
+ * is more efficient.
+ *
  * Since: 0.23.1
  */
 void
@@ -2115,8 +2298,12 @@ tp_protocol_normalize_contact_async (TpProtocol *self,
   /* this makes no sense to call for its side-effects */
   g_return_if_fail (callback != NULL);
 
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, tp_protocol_normalize_contact_async);
+  task = tp_protocol_string_task_new (self,
+      normalization_key ('c', contact, NULL), cancellable, callback,
+      user_data, tp_protocol_normalize_contact_async);
+
+  if (task == NULL)
+    return;
 
   tp_cli_protocol_call_normalize_contact (self, -1, contact,
       tp_protocol_async_string_cb, task, g_object_unref, NULL);
@@ -2146,6 +2333,351 @@ tp_protocol_normalize_contact_finish (TpProtocol *self,
   return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+typedef struct {
+    /* owned ID => owned normalized ID */
+    GHashTable *normalized;
+    /* owned ID => owned GError */
+    GHashTable *failures;
+    /* the number of D-Bus calls we are waiting for */
+    guint pending;
+    /* if not %NULL, the whole operation failed */
+    GError *error;
+} NormalizeContactsData;
+
+static void
+normalize_contacts_data_free (gpointer p)
+{
+  NormalizeContactsData *data = p;
+
+  g_hash_table_unref (data->normalized);
+  g_hash_table_unref (data->failures);
+  g_clear_error (&data->error);
+  g_slice_free (NormalizeContactsData, data);
+}
+
+static void
+normalize_contacts_call_done (GTask *task)
+{
+  NormalizeContactsData *data = g_task_get_task_data (task);
+
+  g_assert (data->pending > 0);
+
+  if (--data->pending > 0)
+    return;
+
+  if (data->error != NULL)
+    g_task_return_error (task, g_error_copy (data->error));
+  else
+    g_task_return_pointer (task, g_hash_table_ref (data->normalized),
+        (GDestroyNotify) g_hash_table_unref);
+}
+
+/* Record that @contact normalizes to @normalized, or failed with @error */
+static void
+normalize_contacts_take_result (TpProtocol *self,
+    NormalizeContactsData *data,
+    const gchar *contact,
+    const gchar *normalized,
+    GError *error)
+{
+  if (normalized != NULL)
+    {
+      gchar *key = normalization_key ('c', contact, NULL);
+
+      tp_protocol_cache_normalization (self, key, normalized);
+      g_free (key);
+      g_hash_table_insert (data->normalized, g_strdup (contact),
+          g_strdup (normalized));
+    }
+  else
+    {
+      g_hash_table_insert (data->failures, g_strdup (contact), error);
+    }
+}
+
+typedef struct {
+    GTask *task;
+    /* owned IDs, NULL-terminated */
+    GPtrArray *contacts;
+} NormalizeContactsBatch;
+
+static void
+normalize_one_contact_cb (TpProxy *proxy,
+    const gchar *normalized,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  NormalizeContactsBatch *batch = user_data;
+  NormalizeContactsData *data = g_task_get_task_data (batch->task);
+
+  normalize_contacts_take_result ((TpProtocol *) proxy, data,
+      g_ptr_array_index (batch->contacts, 0),
+      (error == NULL ? normalized : NULL),
+      (error == NULL ? NULL : g_error_copy (error)));
+  normalize_contacts_call_done (batch->task);
+}
+
+static void
+normalize_contacts_batch_free (gpointer p)
+{
+  NormalizeContactsBatch *batch = p;
+
+  g_object_unref (batch->task);
+  g_ptr_array_unref (batch->contacts);
+  g_slice_free (NormalizeContactsBatch, batch);
+}
+
+static void
+normalize_contacts_one_by_one (TpProtocol *self,
+    GTask *task,
+    GPtrArray *contacts)
+{
+  NormalizeContactsData *data = g_task_get_task_data (task);
+  guint i;
+
+  /* -1 because NULL terminator is explicit */
+  for (i = 0; i < contacts->len - 1; i++)
+    {
+      NormalizeContactsBatch *one = g_slice_new0 (NormalizeContactsBatch);
+
+      one->task = g_object_ref (task);
+      one->contacts = g_ptr_array_new_with_free_func (g_free);
+      g_ptr_array_add (one->contacts,
+          g_strdup (g_ptr_array_index (contacts, i)));
+      g_ptr_array_add (one->contacts, NULL);
+
+      data->pending++;
+      tp_cli_protocol_call_normalize_contact (self, -1,
+          g_ptr_array_index (one->contacts, 0), normalize_one_contact_cb,
+          one, normalize_contacts_batch_free, NULL);
+    }
+}
+
+static void
+normalize_contacts_cb (TpProxy *proxy,
+    GHashTable *normalized,
+    GHashTable *errors,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  TpProtocol *self = (TpProtocol *) proxy;
+  NormalizeContactsBatch *batch = user_data;
+  NormalizeContactsData *data = g_task_get_task_data (batch->task);
+  guint i;
+
+  if (g_error_matches (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD))
+    {
+      /* an older CM: fall back to the original method */
+      DEBUG ("NormalizeContacts() not implemented, using NormalizeContact()");
+      self->priv->no_normalize_contacts = TRUE;
+      normalize_contacts_one_by_one (self, batch->task, batch->contacts);
+      goto out;
+    }
+
+  if (error != NULL)
+    {
+      DEBUG ("NormalizeContacts() failed: %s", error->message);
+
+      if (data->error == NULL)
+        data->error = g_error_copy (error);
+
+      goto out;
+    }
+
+  /* -1 because NULL terminator is explicit */
+  for (i = 0; i < batch->contacts->len - 1; i++)
+    {
+      const gchar *contact = g_ptr_array_index (batch->contacts, i);
+      const gchar *s = g_hash_table_lookup (normalized, contact);
+      GValueArray *va = g_hash_table_lookup (errors, contact);
+      GError *e = NULL;
+
+      if (s == NULL && va != NULL)
+        {
+          const gchar *name, *message;
+
+          tp_value_array_unpack (va, 2, &name, &message);
+          tp_proxy_dbus_error_to_gerror (self, name, message, &e);
+        }
+      else if (s == NULL)
+        {
+          g_set_error (&e, TP_DBUS_ERRORS, TP_DBUS_ERROR_INCONSISTENT,
+              "NormalizeContacts() returned neither a result nor an error "
+              "for '%s'", contact);
+        }
+
+      normalize_contacts_take_result (self, data, contact, s, e);
+    }
+
+out:
+  normalize_contacts_call_done (batch->task);
+}
+
+static void
+normalize_contacts_send (TpProtocol *self,
+    GTask *task,
+    GPtrArray *contacts)
+{
+  NormalizeContactsData *data = g_task_get_task_data (task);
+  NormalizeContactsBatch *batch;
+
+  g_ptr_array_add (contacts, NULL);
+
+  if (self->priv->no_normalize_contacts)
+    {
+      normalize_contacts_one_by_one (self, task, contacts);
+      g_ptr_array_unref (contacts);
+      return;
+    }
+
+  batch = g_slice_new0 (NormalizeContactsBatch);
+  batch->task = g_object_ref (task);
+  batch->contacts = contacts;
+  data->pending++;
+
+  tp_cli_protocol_call_normalize_contacts (self, -1,
+      (const gchar **) contacts->pdata, normalize_contacts_cb,
+      batch, normalize_contacts_batch_free, NULL);
+}
+
+/**
+ * tp_protocol_normalize_contacts_async:
+ * @self: a protocol
+ * @contacts: (array zero-terminated=1): contact identifiers, possibly
+ *  invalid
+ * @cancellable: (allow-none): may be used to cancel the async request
+ * @callback: (scope async): a callback to call when
+ *  the request is satisfied
+ * @user_data: (closure) (allow-none): data to pass to @callback
+ *
+ * Perform best-effort offline contact normalization for each of
+ * @contacts, in the same way as tp_protocol_normalize_contact_async().
+ *
+ * Identifiers that were normalized recently are answered without a D-Bus
+ * call, and the rest are normalized in batches, with one D-Bus call per
+ * batch, if the connection manager supports that. This is much faster
+ * than normalizing them one by one when importing a large address book.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_protocol_normalize_contacts_async (TpProtocol *self,
+    const gchar * const *contacts,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GTask *task;
+  NormalizeContactsData *data;
+  GHashTable *seen;
+  GPtrArray *batch = NULL;
+  guint i;
+
+  g_return_if_fail (TP_IS_PROTOCOL (self));
+  g_return_if_fail (contacts != NULL);
+  /* this makes no sense to call for its side-effects */
+  g_return_if_fail (callback != NULL);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, tp_protocol_normalize_contacts_async);
+
+  data = g_slice_new0 (NormalizeContactsData);
+  data->normalized = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  data->failures = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_error_free);
+  g_task_set_task_data (task, data, normalize_contacts_data_free);
+
+  /* we don't report completion until everything has been sent */
+  data->pending = 1;
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; contacts[i] != NULL; i++)
+    {
+      gchar *key;
+      const gchar *cached;
+
+      if (g_hash_table_contains (seen, contacts[i]))
+        continue;
+
+      g_hash_table_add (seen, (gchar *) contacts[i]);
+
+      key = normalization_key ('c', contacts[i], NULL);
+      cached = tp_protocol_lookup_normalization (self, key);
+      g_free (key);
+
+      if (cached != NULL)
+        {
+          g_hash_table_insert (data->normalized, g_strdup (contacts[i]),
+              g_strdup (cached));
+          continue;
+        }
+
+      if (batch == NULL)
+        batch = g_ptr_array_new_with_free_func (g_free);
+
+      g_ptr_array_add (batch, g_strdup (contacts[i]));
+
+      if (batch->len >= MAX_NORMALIZE_BATCH)
+        {
+          normalize_contacts_send (self, task, batch);
+          batch = NULL;
+        }
+    }
+
+  if (batch != NULL)
+    normalize_contacts_send (self, task, batch);
+
+  DEBUG ("%u identifiers, %u already known", i,
+      g_hash_table_size (data->normalized));
+
+  g_hash_table_unref (seen);
+  normalize_contacts_call_done (task);
+  g_object_unref (task);
+}
+
+/**
+ * tp_protocol_normalize_contacts_finish:
+ * @self: a protocol
+ * @result: a #GAsyncResult
+ * @failures: (out) (allow-none) (transfer full) (element-type utf8 GLib.Error):
+ *  used to return a map from identifiers that could not be normalized to
+ *  the reason why
+ * @error: a #GError to fill
+ *
+ * Interpret the result of tp_protocol_normalize_contacts_async().
+ * Each identifier that was passed to that function appears in either
+ * the returned map or @failures.
+ *
+ * Returns: (transfer full) (element-type utf8 utf8): a map from each
+ *  identifier that could be normalized to its normalized form, or %NULL
+ *  if the whole operation failed
+ * Since: 0.UNRELEASED
+ */
+GHashTable *
+tp_protocol_normalize_contacts_finish (TpProtocol *self,
+    GAsyncResult *result,
+    GHashTable **failures,
+    GError **error)
+{
+  NormalizeContactsData *data;
+  GHashTable *ret;
+
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+  g_return_val_if_fail (g_async_result_is_tagged (result,
+        tp_protocol_normalize_contacts_async), NULL);
+
+  ret = g_task_propagate_pointer (G_TASK (result), error);
+  data = g_task_get_task_data (G_TASK (result));
+
+  if (ret != NULL && failures != NULL)
+    *failures = g_hash_table_ref (data->failures);
+
+  return ret;
+}
+
 /**
  * tp_protocol_identify_account_async:
  * @self: a protocol
@@ -2174,6 +2706,7 @@ tp_protocol_identify_account_async (TpProtocol *self,
 {
   GTask *task;
   GHashTable *asv;
+  gchar *printed;
 
   g_return_if_fail (TP_IS_PROTOCOL (self));
   g_return_if_fail (vardict != NULL);
@@ -2181,9 +2714,19 @@ tp_protocol_identify_account_async (TpProtocol *self,
   /* this makes no sense to call for its side-effects */
   g_return_if_fail (callback != NULL);
 
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, tp_protocol_identify_account_async);
   g_variant_ref_sink (vardict);
+  printed = g_variant_print (vardict, TRUE);
+  task = tp_protocol_string_task_new (self,
+      normalization_key ('a', printed, NULL), cancellable, callback,
+      user_data, tp_protocol_identify_account_async);
+  g_free (printed);
+
+  if (task == NULL)
+    {
+      g_variant_unref (vardict);
+      return;
+    }
+
   asv = _tp_asv_from_vardict (vardict);
   tp_cli_protocol_call_identify_account (self, -1, asv,
       tp_protocol_async_string_cb, task, g_object_unref, NULL);
@@ -2243,8 +2786,12 @@ tp_protocol_normalize_contact_uri_async (TpProtocol *self,
   /* this makes no sense to call for its side-effects */
   g_return_if_fail (callback != NULL);
 
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, tp_protocol_normalize_contact_uri_async);
+  task = tp_protocol_string_task_new (self,
+      normalization_key ('u', uri, NULL), cancellable, callback,
+      user_data, tp_protocol_normalize_contact_uri_async);
+
+  if (task == NULL)
+    return;
 
   tp_cli_protocol_interface_addressing_call_normalize_contact_uri (self, -1,
       uri, tp_protocol_async_string_cb, task, g_object_unref, NULL);
@@ -2305,8 +2852,12 @@ tp_protocol_normalize_vcard_address_async (TpProtocol *self,
   /* this makes no sense to call for its side-effects */
   g_return_if_fail (callback != NULL);
 
-  task = g_task_new (self, cancellable, callback, user_data);
-  g_task_set_source_tag (task, tp_protocol_normalize_vcard_address_async);
+  task = tp_protocol_string_task_new (self,
+      normalization_key ('v', field, value), cancellable, callback,
+      user_data, tp_protocol_normalize_vcard_address_async);
+
+  if (task == NULL)
+    return;
 
   tp_cli_protocol_interface_addressing_call_normalize_vcard_address (self, -1,
       field, value, tp_protocol_async_string_cb, task, g_object_unref, NULL);
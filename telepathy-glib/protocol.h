@@ -161,6 +161,19 @@ gchar *tp_protocol_normalize_contact_finish (TpProtocol *self,
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_protocol_normalize_contacts_async (TpProtocol *self,
+    const gchar * const *contacts,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GHashTable *tp_protocol_normalize_contacts_finish (TpProtocol *self,
+    GAsyncResult *result,
+    GHashTable **failures,
+    GError **error);
+
 _TP_AVAILABLE_IN_0_24
 void tp_protocol_identify_account_async (TpProtocol *self,
     GVariant *vardict,
@@ -30,6 +30,18 @@ typedef void (*TpProxyProc) (TpProxy *);
 
 gboolean _tp_proxy_is_preparing (gpointer self,
     GQuark feature);
+gboolean _tp_proxy_is_prepared_all (gpointer self,
+    const GQuark *features);
+typedef struct _TpProxyPrepareMany TpProxyPrepareMany;
+
+TpProxyPrepareMany *_tp_proxy_prepare_many_new (GSimpleAsyncResult *result)
+  G_GNUC_WARN_UNUSED_RESULT;
+void _tp_proxy_prepare_many_add (TpProxyPrepareMany *self,
+    gpointer proxy,
+    const GQuark *features);
+void _tp_proxy_prepare_many_start (TpProxyPrepareMany *self,
+    guint timeout_ms);
+
 void _tp_proxy_set_feature_prepared (TpProxy *self,
     GQuark feature,
     gboolean succeeded);
@@ -47,4 +59,66 @@ gboolean _tp_proxy_will_announce_connected_finish (TpProxy *self,
 void _tp_proxy_ensure_factory (gpointer self,
     TpSimpleClientFactory *factory);
 
+/* Embedded in each pending call or signal invocation whose callback is
+ * waiting to be run from the main loop, so that queueing it doesn't need
+ * to allocate anything */
+typedef struct {
+    GList link;
+    void (*run) (gpointer owner);
+} TpProxyCompletion;
+
+void _tp_proxy_completion_queue (TpProxyCompletion *completion,
+    GMainContext *context,
+    gpointer owner,
+    void (*run) (gpointer owner));
+
+GMainContext *_tp_proxy_get_main_context (gpointer self);
+void _tp_proxy_set_main_context (gpointer self,
+    GMainContext *context);
+
+void _tp_proxy_invalidate_many (GPtrArray *proxies,
+    const GError *error);
+
+/* Generated in _gen/interfaces-body.h: the names of all the interfaces in
+ * the Telepathy spec, NULL-terminated */
+const gchar * const *_tp_iface_get_known_names (void);
+
+/* Used by the _tp_cli_*_vardict functions generated by glib-client-gen.py,
+ * which take and return arguments as GVariant tuples. @out_args is
+ * borrowed and is NULL on error */
+typedef void (*TpProxyVardictCallback) (TpProxy *proxy,
+    GVariant *out_args,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object);
+
+typedef void (*TpProxyVardictSignalCallback) (TpProxy *proxy,
+    GVariant *args,
+    gpointer user_data,
+    GObject *weak_object);
+
+TpProxyPendingCall *_tp_proxy_call_vardict (TpProxy *self,
+    GQuark iface,
+    const gchar *member,
+    GVariant *args,
+    const GVariantType *reply_type,
+    gint timeout_ms,
+    TpProxyVardictCallback callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object);
+
+TpProxySignalConnection *_tp_proxy_signal_connection_new_vardict (
+    TpProxy *self,
+    GQuark iface,
+    const gchar *member,
+    const GVariantType *signature,
+    const GType *expected_types,
+    GCallback collect_args,
+    TpProxyVardictSignalCallback callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object,
+    GError **error);
+
 #endif
@@ -21,6 +21,11 @@
 
 #include "telepathy-glib/proxy-subclass.h"
 #include "telepathy-glib/proxy-internal.h"
+#include "telepathy-glib/tracing-internal.h"
+#include "telepathy-glib/util-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+#include <dbus/dbus-glib-lowlevel.h>
 
 #define DEBUG_FLAG TP_DEBUG_PROXY
 #include "telepathy-glib/debug-internal.h"
@@ -44,7 +49,7 @@ struct _TpProxyPendingCall {
     /* This structure's "reference count" is implicit:
      * - 1 if D-Bus has us (from creation until _completed)
      * - 1 if results have come in but we haven't run the callback yet
-     *   (idle_source is nonzero)
+     *   (idle_queued is set)
      *
      * In normal use, its life cycle should go like this:
      * - Created by tp_proxy_pending_call_v0_new
@@ -52,7 +57,7 @@ struct _TpProxyPendingCall {
      * - tp_proxy_pending_call_v0_take_pending_call
      * - (Phase 1)
      * - tp_proxy_pending_call_v0_take_results
-     * - Idle handler queued
+     * - Added to the completion queue
      * - (Phase 2)
      * - tp_proxy_pending_call_v0_completed
      * - (Phase 3)
@@ -91,15 +96,27 @@ struct _TpProxyPendingCall {
     gpointer user_data;
     GDestroyNotify destroy;
     GObject *weak_object;
+    /* Links in the list of pending calls sharing weak_object's
+     * WeakObjectCalls, if weak_object is non-NULL */
+    TpProxyPendingCall *weak_prev;
+    TpProxyPendingCall *weak_next;
 
     /* Non-NULL until either _completed or destroy, whichever comes first */
     DBusGProxy *iface_proxy;
     DBusGProxyCall *pending_call;
 
-    /* Nonzero if _idle_invoke has been queued (even if it has already
-     * happened), i.e. if results have been taken or the DBusGProxy
-     * was destroyed */
-    guint idle_source;
+    /* Only for calls made by _tp_proxy_call_vardict(), which bypass
+     * dbus-glib: non-NULL until the reply arrives or the call is
+     * cancelled */
+    DBusPendingCall *libdbus_call;
+    /* owned */
+    GVariantType *reply_type;
+
+    /* TRUE if we have been added to the completion queue (even if
+     * _idle_invoke has already happened), i.e. if results have been taken,
+     * the call was cancelled or the DBusGProxy was destroyed */
+    unsigned idle_queued:1;
+    TpProxyCompletion completion;
 
     /* If TRUE, invoke the callback even on cancellation */
     unsigned cancel_must_raise:1;
@@ -109,33 +126,131 @@ struct _TpProxyPendingCall {
     /* If TRUE, dbus-glib no longer holds a reference to us */
     unsigned dbus_completed:1;
 
+    /* If tracing was enabled when the call was made: what it was, when it
+     * was made, and when its reply (if any) arrived; otherwise 0 */
+    const gchar *trace_iface;
+    const gchar *trace_member;
+    gint64 trace_start;
+    gint64 trace_reply;
+
     /* Marker to indicate that this is, in fact, a valid TpProxyPendingCall */
     gconstpointer priv;
 };
 
 static const gchar * const pending_call_magic = "TpProxyPendingCall";
 
+/*
+ * All the pending calls whose weak object is the same GObject share a
+ * single weak reference to it, rather than each adding its own: GObject
+ * keeps weak references in an array, so adding and removing one per call
+ * is quadratic in the number of calls in flight.
+ */
+typedef struct {
+    GObject *weak_object;
+    TpProxyPendingCall *calls;
+} WeakObjectCalls;
+
+static GQuark
+weak_object_calls_quark (void)
+{
+  static GQuark q = 0;
+
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string ("tp-proxy-pending-call-weak-object");
+
+  return q;
+}
+
 static void
-tp_proxy_pending_call_lost_weak_ref (gpointer data,
-                                     GObject *dead)
+weak_object_calls_lost_weak_ref (gpointer data,
+    GObject *dead)
 {
-  TpProxyPendingCall *pc = data;
+  WeakObjectCalls *woc = data;
+  TpProxyPendingCall *pc;
 
-  DEBUG ("%p lost weak ref to %p", pc, dead);
+  g_assert (dead == woc->weak_object);
 
-  g_assert (pc->priv == pending_call_magic);
-  g_assert (dead == pc->weak_object);
+  g_object_steal_qdata (dead, weak_object_calls_quark ());
 
-  pc->weak_object = NULL;
+  while ((pc = woc->calls) != NULL)
+    {
+      DEBUG ("%p lost weak ref to %p", pc, dead);
+
+      g_assert (pc->priv == pending_call_magic);
+      g_assert (pc->weak_object == dead);
+
+      woc->calls = pc->weak_next;
 
-  if (!pc->idle_completed)
-    tp_proxy_pending_call_cancel (pc);
+      if (woc->calls != NULL)
+        woc->calls->weak_prev = NULL;
+
+      pc->weak_object = NULL;
+      pc->weak_next = NULL;
+
+      if (!pc->idle_completed)
+        tp_proxy_pending_call_cancel (pc);
+    }
+
+  g_slice_free (WeakObjectCalls, woc);
 }
 
-static gboolean
-tp_proxy_pending_call_idle_invoke (gpointer p)
+static void
+tp_proxy_pending_call_add_weak_ref (TpProxyPendingCall *pc)
+{
+  GQuark quark = weak_object_calls_quark ();
+  WeakObjectCalls *woc = g_object_get_qdata (pc->weak_object, quark);
+
+  if (woc == NULL)
+    {
+      woc = g_slice_new0 (WeakObjectCalls);
+      woc->weak_object = pc->weak_object;
+      g_object_set_qdata (pc->weak_object, quark, woc);
+      g_object_weak_ref (pc->weak_object, weak_object_calls_lost_weak_ref,
+          woc);
+    }
+
+  pc->weak_prev = NULL;
+  pc->weak_next = woc->calls;
+
+  if (woc->calls != NULL)
+    woc->calls->weak_prev = pc;
+
+  woc->calls = pc;
+}
+
+static void
+tp_proxy_pending_call_remove_weak_ref (TpProxyPendingCall *pc)
+{
+  GQuark quark = weak_object_calls_quark ();
+  WeakObjectCalls *woc = g_object_get_qdata (pc->weak_object, quark);
+
+  g_assert (woc != NULL);
+
+  if (pc->weak_prev != NULL)
+    pc->weak_prev->weak_next = pc->weak_next;
+  else
+    woc->calls = pc->weak_next;
+
+  if (pc->weak_next != NULL)
+    pc->weak_next->weak_prev = pc->weak_prev;
+
+  pc->weak_prev = NULL;
+  pc->weak_next = NULL;
+
+  if (woc->calls == NULL)
+    {
+      g_object_weak_unref (pc->weak_object, weak_object_calls_lost_weak_ref,
+          woc);
+      g_object_steal_qdata (pc->weak_object, quark);
+      g_slice_free (WeakObjectCalls, woc);
+    }
+
+  pc->weak_object = NULL;
+}
+
+static void
+tp_proxy_pending_call_idle_invoke (TpProxyPendingCall *pc)
 {
-  TpProxyPendingCall *pc = p;
   TpProxyInvokeFunc invoke = pc->invoke_callback;
 
   MORE_DEBUG ("%p", pc);
@@ -143,7 +258,7 @@ tp_proxy_pending_call_idle_invoke (gpointer p)
   if (invoke == NULL)
     {
       /* either already invoked (bug?), or cancelled */
-      return FALSE;
+      return;
     }
 
   MORE_DEBUG ("%p: invoking user callback", pc);
@@ -152,19 +267,188 @@ tp_proxy_pending_call_idle_invoke (gpointer p)
   g_assert (pc->error == NULL || pc->args == NULL);
   g_assert (!pc->idle_completed);
 
+  if (pc->trace_start != 0)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gint64 reply = (pc->trace_reply != 0 ? pc->trace_reply : now);
+
+      /* dbus-glib doesn't tell us the serial of the method call */
+      _tp_trace_record (TP_TRACE_SIDE_CLIENT, pc->trace_iface,
+          pc->trace_member, 0, pc->trace_start, now - reply,
+          reply - pc->trace_start);
+    }
+
   pc->invoke_callback = NULL;
   invoke (pc->proxy, pc->error, pc->args, pc->callback,
       pc->user_data, pc->weak_object);
   pc->error = NULL;
   pc->args = NULL;
 
-  /* don't clear pc->idle_source here! tp_proxy_pending_call_v0_completed
-   * compares it to 0 to determine whether to free the object */
+  /* don't clear pc->idle_queued here! tp_proxy_pending_call_v0_completed
+   * checks it to determine whether to free the object */
+}
+
+static void _tp_proxy_pending_call_idle_completed (gpointer p);
+
+/*
+ * Rather than adding an idle source per call or signal, calls and signals
+ * whose callbacks are ready to run are queued, and one idle source runs all
+ * that were queued when it was dispatched. Sharing one queue keeps method
+ * replies and signals in the order in which they arrived.
+ *
+ * There is one queue per main context: each proxy's callbacks run in the
+ * thread-default main context at the time the proxy was constructed, so
+ * that a process can use independent proxies in several threads, each
+ * running its own main context. The queues are protected by a lock, since
+ * dbus-glib delivers replies in the main context of the bus connection,
+ * which is not necessarily the proxy's.
+ *
+ * The source may recurse, so that a callback which iterates a nested main
+ * loop while waiting for another call still sees that call complete.
+ */
+typedef struct {
+    /* owned */
+    GMainContext *context;
+    GQueue queue;
+    /* the attached source that will dispatch the queue, or NULL */
+    GSource *source;
+    /* one per source which was ever attached and has not been destroyed */
+    guint refcount;
+} CompletionQueue;
+
+G_LOCK_DEFINE_STATIC (completion_queues);
+/* borrowed GMainContext * => borrowed CompletionQueue *, for each queue
+ * that has a source attached */
+static GHashTable *completion_queues = NULL;
+
+static void
+completion_queue_unref (gpointer p)
+{
+  CompletionQueue *cq = p;
+  gboolean last;
+
+  G_LOCK (completion_queues);
+  last = (--cq->refcount == 0);
+  G_UNLOCK (completion_queues);
 
+  if (last)
+    {
+      g_assert (g_queue_is_empty (&cq->queue));
+      g_main_context_unref (cq->context);
+      g_slice_free (CompletionQueue, cq);
+    }
+}
+
+static gboolean
+completion_queue_dispatch (gpointer data)
+{
+  CompletionQueue *cq = data;
+  guint n;
+  GList *link;
+
+  G_LOCK (completion_queues);
+  n = cq->queue.length;
+  G_UNLOCK (completion_queues);
+
+  /* anything queued by these callbacks waits for the next dispatch */
+  while (n-- > 0)
+    {
+      TpProxyCompletion *completion;
+
+      G_LOCK (completion_queues);
+      link = g_queue_pop_head_link (&cq->queue);
+      G_UNLOCK (completion_queues);
+
+      if (link == NULL)
+        break;
+
+      completion = (TpProxyCompletion *) link;
+      /* this may free the completion */
+      completion->run (link->data);
+    }
+
+  G_LOCK (completion_queues);
+
+  if (!g_queue_is_empty (&cq->queue))
+    {
+      G_UNLOCK (completion_queues);
+      return TRUE;
+    }
+
+  /* a nested dispatch may already have emptied the queue, and a new source
+   * may already have been attached */
+  if (cq->source == g_main_current_source ())
+    {
+      cq->source = NULL;
+      g_hash_table_remove (completion_queues, cq->context);
+    }
+
+  G_UNLOCK (completion_queues);
   return FALSE;
 }
 
-static void _tp_proxy_pending_call_idle_completed (gpointer p);
+void
+_tp_proxy_completion_queue (TpProxyCompletion *completion,
+    GMainContext *context,
+    gpointer owner,
+    void (*run) (gpointer owner))
+{
+  CompletionQueue *cq;
+
+  completion->link.data = owner;
+  completion->link.prev = NULL;
+  completion->link.next = NULL;
+  completion->run = run;
+
+  G_LOCK (completion_queues);
+
+  if (G_UNLIKELY (completion_queues == NULL))
+    completion_queues = g_hash_table_new (NULL, NULL);
+
+  cq = g_hash_table_lookup (completion_queues, context);
+
+  if (cq == NULL)
+    {
+      cq = g_slice_new0 (CompletionQueue);
+      cq->context = g_main_context_ref (context);
+      g_queue_init (&cq->queue);
+      g_hash_table_insert (completion_queues, context, cq);
+    }
+
+  g_queue_push_tail_link (&cq->queue, &completion->link);
+
+  if (cq->source == NULL)
+    {
+      cq->source = _tp_idle_source_new (TP_LATENCY_CLASS_INTERACTIVE);
+      cq->refcount++;
+      g_source_set_can_recurse (cq->source, TRUE);
+      g_source_set_callback (cq->source, completion_queue_dispatch,
+          cq, completion_queue_unref);
+      g_source_attach (cq->source, context);
+      g_source_unref (cq->source);
+    }
+
+  G_UNLOCK (completion_queues);
+}
+
+static void
+tp_proxy_pending_call_run (gpointer p)
+{
+  TpProxyPendingCall *pc = p;
+
+  tp_proxy_pending_call_idle_invoke (pc);
+  _tp_proxy_pending_call_idle_completed (pc);
+}
+
+static void
+tp_proxy_pending_call_queue_idle (TpProxyPendingCall *pc)
+{
+  g_assert (!pc->idle_queued);
+
+  pc->idle_queued = TRUE;
+  _tp_proxy_completion_queue (&pc->completion,
+      _tp_proxy_get_main_context (pc->proxy), pc, tp_proxy_pending_call_run);
+}
 
 static void
 _tp_proxy_pending_call_dgproxy_destroy (DBusGProxy *iface_proxy,
@@ -177,7 +461,7 @@ _tp_proxy_pending_call_dgproxy_destroy (DBusGProxy *iface_proxy,
 
   DEBUG ("%p: DBusGProxy %p invalidated", pc, iface_proxy);
 
-  if (pc->idle_source == 0)
+  if (!pc->idle_queued)
     {
       /* we haven't already received and queued a reply, so synthesize
        * one */
@@ -187,9 +471,7 @@ _tp_proxy_pending_call_dgproxy_destroy (DBusGProxy *iface_proxy,
       pc->error = g_error_new_literal (TP_DBUS_ERRORS,
           TP_DBUS_ERROR_NAME_OWNER_LOST, "Name owner lost (service crashed?)");
 
-      pc->idle_source = g_idle_add_full (G_PRIORITY_HIGH,
-          tp_proxy_pending_call_idle_invoke, pc,
-          _tp_proxy_pending_call_idle_completed);
+      tp_proxy_pending_call_queue_idle (pc);
     }
 
   g_signal_handlers_disconnect_by_func (pc->iface_proxy,
@@ -276,8 +558,15 @@ tp_proxy_pending_call_v0_new (TpProxy *self,
   pc->priv = pending_call_magic;
   pc->cancel_must_raise = cancel_must_raise;
 
+  if (_tp_tracing_is_enabled ())
+    {
+      pc->trace_iface = g_quark_to_string (iface);
+      pc->trace_member = g_intern_string (member);
+      pc->trace_start = g_get_monotonic_time ();
+    }
+
   if (weak_object != NULL)
-    g_object_weak_ref (weak_object, tp_proxy_pending_call_lost_weak_ref, pc);
+    tp_proxy_pending_call_add_weak_ref (pc);
 
   g_signal_connect (iface_proxy, "destroy",
       G_CALLBACK (_tp_proxy_pending_call_dgproxy_destroy), pc);
@@ -328,14 +617,19 @@ tp_proxy_pending_call_cancel (TpProxyPendingCall *pc)
    * pending call object afterwards. Otherwise, we must free the pending
    * call object later anyway, in case this function was called due to
    * weak refs (like fd.o #14750). */
-  if (pc->idle_source == 0)
+  if (!pc->idle_queued)
+    tp_proxy_pending_call_queue_idle (pc);
+
+  if (pc->libdbus_call != NULL)
     {
-      pc->idle_source = g_idle_add_full (G_PRIORITY_HIGH,
-          tp_proxy_pending_call_idle_invoke, pc,
-          _tp_proxy_pending_call_idle_completed);
-    }
+      DBusPendingCall *libdbus_call = pc->libdbus_call;
 
-  if (!pc->dbus_completed && pc->pending_call != NULL)
+      /* this may call tp_proxy_pending_call_v0_completed */
+      pc->libdbus_call = NULL;
+      dbus_pending_call_cancel (libdbus_call);
+      dbus_pending_call_unref (libdbus_call);
+    }
+  else if (!pc->dbus_completed && pc->pending_call != NULL)
     {
       /* Implicitly asserts that iface_proxy is non-NULL */
       DBusGProxy *iface_proxy = g_object_ref (pc->iface_proxy);
@@ -369,8 +663,10 @@ tp_proxy_pending_call_free (TpProxyPendingCall *pc)
   pc->args = NULL;
 
   if (pc->weak_object != NULL)
-    g_object_weak_unref (pc->weak_object,
-        tp_proxy_pending_call_lost_weak_ref, pc);
+    tp_proxy_pending_call_remove_weak_ref (pc);
+
+  if (pc->reply_type != NULL)
+    g_variant_type_free (pc->reply_type);
 
   if (pc->iface_proxy != NULL)
     {
@@ -416,7 +712,7 @@ tp_proxy_pending_call_v0_completed (gpointer p)
 
   /* dbus-glib frees its user_data *before* it emits destroy; if we
    * haven't yet queued the callback, assume that's what's going on. */
-  if (pc->idle_source == 0 && pc->iface_proxy != NULL)
+  if (!pc->idle_queued && pc->iface_proxy != NULL)
     {
       MORE_DEBUG ("Looks like this pending call hasn't finished, assuming "
           "the DBusGProxy is about to die");
@@ -499,7 +795,7 @@ tp_proxy_pending_call_v0_take_results (TpProxyPendingCall *pc,
   g_return_if_fail (pc->priv == pending_call_magic);
   g_return_if_fail (pc->args == NULL);
   g_return_if_fail (pc->error == NULL);
-  g_return_if_fail (pc->idle_source == 0);
+  g_return_if_fail (!pc->idle_queued);
   g_return_if_fail (error == NULL || args == NULL);
 
   MORE_DEBUG ("%p (error: %s)", pc,
@@ -508,8 +804,201 @@ tp_proxy_pending_call_v0_take_results (TpProxyPendingCall *pc,
   pc->args = args;
   pc->error = _tp_proxy_take_and_remap_error (pc->proxy, error);
 
+  if (pc->trace_start != 0)
+    pc->trace_reply = g_get_monotonic_time ();
+
   /* queue up the actual callback to run after we go back to the event loop */
-  pc->idle_source = g_idle_add_full (G_PRIORITY_HIGH,
-      tp_proxy_pending_call_idle_invoke, pc,
-      _tp_proxy_pending_call_idle_completed);
+  tp_proxy_pending_call_queue_idle (pc);
+}
+
+static void
+vardict_invoke (TpProxy *self,
+    GError *error,
+    GValueArray *args,
+    GCallback callback,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  TpProxyVardictCallback cb = (TpProxyVardictCallback) callback;
+
+  if (error != NULL)
+    {
+      cb (self, NULL, error, user_data, weak_object);
+      g_error_free (error);
+      return;
+    }
+
+  g_assert (args != NULL && args->n_values == 1);
+  cb (self, g_value_get_variant (args->values + 0), NULL, user_data,
+      weak_object);
+  tp_value_array_free (args);
+}
+
+static void
+vardict_call_notify (DBusPendingCall *pending,
+    void *user_data)
+{
+  TpProxyPendingCall *pc = user_data;
+  DBusMessage *reply = dbus_pending_call_steal_reply (pending);
+  DBusError dbus_error = DBUS_ERROR_INIT;
+  GError *error = NULL;
+  GVariant *out_args;
+
+  g_assert (pc->libdbus_call == pending);
+
+  /* libdbus keeps its own ref until we return, then frees the pending call,
+   * which calls tp_proxy_pending_call_v0_completed */
+  pc->libdbus_call = NULL;
+  dbus_pending_call_unref (pending);
+
+  /* the proxy was invalidated, and an error has already been queued */
+  if (pc->idle_queued)
+    goto finally;
+
+  if (dbus_set_error_from_message (&dbus_error, reply))
+    {
+      /* the same GError dbus-glib would have given us */
+      dbus_set_g_error (&error, &dbus_error);
+      dbus_error_free (&dbus_error);
+      tp_proxy_pending_call_v0_take_results (pc, error, NULL);
+      goto finally;
+    }
+
+  out_args = _tp_dbus_message_dup_body (reply, &error);
+
+  if (out_args != NULL && !g_variant_is_of_type (out_args, pc->reply_type))
+    {
+      g_set_error (&error, DBUS_GERROR, DBUS_GERROR_INVALID_ARGS,
+          "Reply has signature '%s', expected '%s'",
+          dbus_message_get_signature (reply),
+          g_variant_type_peek_string (pc->reply_type));
+      g_variant_unref (out_args);
+      out_args = NULL;
+    }
+
+  if (out_args == NULL)
+    {
+      tp_proxy_pending_call_v0_take_results (pc, error, NULL);
+    }
+  else
+    {
+      tp_proxy_pending_call_v0_take_results (pc, NULL,
+          tp_value_array_build (1, G_TYPE_VARIANT, out_args, G_TYPE_INVALID));
+      g_variant_unref (out_args);
+    }
+
+finally:
+  dbus_message_unref (reply);
+}
+
+/*
+ * _tp_proxy_call_vardict:
+ * @self: a proxy
+ * @iface: a quark whose string value is the D-Bus interface
+ * @member: the name of the method being called
+ * @args: (allow-none): a tuple of "in" arguments, or %NULL if there are
+ *  none; if floating, it is consumed
+ * @reply_type: the type of the tuple of "out" arguments
+ * @timeout_ms: the timeout in milliseconds, or -1 to use the default
+ * @callback: (allow-none): called with the "out" arguments, or an error
+ * @user_data: user-supplied data for the callback
+ * @destroy: user-supplied destructor for the data
+ * @weak_object: as for tp_proxy_pending_call_v0_new()
+ *
+ * Call a method, converting its arguments and reply directly between
+ * #GVariant and libdbus messages, rather than via dbus-glib and #GValue.
+ * The call is still made on the proxy's #DBusGConnection, so it is
+ * ordered with respect to calls made by the tp_cli functions, and it
+ * fails with %TP_DBUS_ERROR_NAME_OWNER_LOST if the proxy is invalidated
+ * first, in the same way.
+ *
+ * This is called by the _tp_cli_*_vardict functions generated by
+ * tools/glib-client-gen.py.
+ *
+ * Returns: a pending call, or %NULL if @callback was %NULL or has already
+ *  been called with an error
+ */
+TpProxyPendingCall *
+_tp_proxy_call_vardict (TpProxy *self,
+    GQuark iface,
+    const gchar *member,
+    GVariant *args,
+    const GVariantType *reply_type,
+    gint timeout_ms,
+    TpProxyVardictCallback callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object)
+{
+  GError *error = NULL;
+  DBusGProxy *iface_proxy;
+  DBusConnection *libdbus;
+  DBusMessage *message;
+  DBusPendingCall *pending = NULL;
+  TpProxyPendingCall *pc;
+
+  g_return_val_if_fail (TP_IS_PROXY (self), NULL);
+  g_return_val_if_fail (args == NULL || g_variant_is_of_type (args,
+        G_VARIANT_TYPE_TUPLE), NULL);
+  g_return_val_if_fail (g_variant_type_is_tuple (reply_type), NULL);
+
+  iface_proxy = tp_proxy_get_interface_by_id (self, iface, &error);
+
+  if (iface_proxy == NULL)
+    {
+      if (args != NULL)
+        g_variant_unref (g_variant_ref_sink (args));
+
+      if (callback != NULL)
+        callback (self, NULL, error, user_data, weak_object);
+
+      if (destroy != NULL)
+        destroy (user_data);
+
+      g_error_free (error);
+      return NULL;
+    }
+
+  libdbus = dbus_g_connection_get_connection (
+      tp_proxy_get_dbus_connection (self));
+  message = _tp_dbus_message_new_method_call (self->bus_name,
+      self->object_path, g_quark_to_string (iface), member, args);
+
+  if (callback == NULL)
+    {
+      dbus_message_set_no_reply (message, TRUE);
+      dbus_connection_send (libdbus, message, NULL);
+      dbus_message_unref (message);
+      return NULL;
+    }
+
+  pc = tp_proxy_pending_call_v0_new (self, iface, member, iface_proxy,
+      vardict_invoke, G_CALLBACK (callback), user_data, destroy,
+      weak_object, FALSE);
+  pc->reply_type = g_variant_type_copy (reply_type);
+
+  if (!dbus_connection_send_with_reply (libdbus, message, &pending,
+        timeout_ms))
+    ERROR ("Out of memory");
+
+  dbus_message_unref (message);
+
+  if (pending == NULL)
+    {
+      /* libdbus doesn't give us a pending call if the connection has
+       * already been closed */
+      tp_proxy_pending_call_v0_take_results (pc,
+          g_error_new_literal (DBUS_GERROR, DBUS_GERROR_DISCONNECTED,
+            "Connection is closed"), NULL);
+      tp_proxy_pending_call_v0_completed (pc);
+      return pc;
+    }
+
+  pc->libdbus_call = pending;
+
+  if (!dbus_pending_call_set_notify (pending, vardict_call_notify, pc,
+        tp_proxy_pending_call_v0_completed))
+    ERROR ("Out of memory");
+
+  return pc;
 }
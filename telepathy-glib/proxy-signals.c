@@ -20,6 +20,16 @@
 #include "config.h"
 
 #include "telepathy-glib/proxy-subclass.h"
+#include "telepathy-glib/proxy-internal.h"
+
+#include <string.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+#include <gio/gio.h>
+
+#include <telepathy-glib/dbus-daemon.h>
+#include <telepathy-glib/util-internal.h>
+#include <telepathy-glib/variant-util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_PROXY
 #include "telepathy-glib/debug-internal.h"
@@ -40,12 +50,14 @@
  */
 
 typedef struct _TpProxySignalInvocation TpProxySignalInvocation;
+typedef struct _SignalRouter SignalRouter;
 
 struct _TpProxySignalInvocation {
+    /* NULL if the signal connection was disconnected before we ran */
     TpProxySignalConnection *sc;
     TpProxy *proxy;
     GValueArray *args;
-    guint idle_source;
+    TpProxyCompletion completion;
 };
 
 struct _TpProxySignalConnection {
@@ -59,7 +71,19 @@ struct _TpProxySignalConnection {
      * + 1 per callback being invoked (possibly nested!) right now */
     TpProxy *proxy;
 
+    /* If we're connected via dbus-glib: non-NULL until disconnected */
     DBusGProxy *iface_proxy;
+    /* If we're connected via a SignalRouter: non-NULL until disconnected */
+    SignalRouter *router;
+    /* Only used with a SignalRouter; owned */
+    gchar *sender;
+    gchar *path;
+    GQuark iface;
+    GType *expected_types;
+    guint n_args;
+    /* If non-NULL, the callback takes the arguments as a tuple of this
+     * type, rather than as a GValueArray; owned */
+    GVariantType *variant_type;
     gchar *member;
     GCallback collect_args;
     TpProxyInvokeFunc invoke_callback;
@@ -75,11 +99,388 @@ struct _TpProxySignalConnection {
 static void _tp_proxy_signal_connection_dgproxy_destroy (DBusGProxy *,
     TpProxySignalConnection *);
 
+/*
+ * Signals from proxies with a unique bus name (connections, channels and
+ * so on) don't go through dbus-glib's per-DBusGProxy signal machinery.
+ * Instead, each TpDBusDaemon has a SignalRouter, which adds one match rule
+ * per (sender, interface) pair however many objects and signals are being
+ * watched, and a libdbus filter that looks up the signal connections for
+ * each signal's object path, and demarshals its arguments once for all of
+ * them.
+ *
+ * Proxies whose bus name is a well-known name still use dbus-glib, which
+ * follows the name's owner for us.
+ */
+struct _SignalRouter {
+    /* reffed */
+    DBusConnection *libdbus;
+    /* owned object path => owned GPtrArray of borrowed
+     * TpProxySignalConnection */
+    GHashTable *by_path;
+    /* owned match rule => number of signal connections needing it */
+    GHashTable *match_rules;
+};
+
+static GQuark
+signal_router_quark (void)
+{
+  static GQuark q = 0;
+
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string ("tp-proxy-signal-router");
+
+  return q;
+}
+
+static gchar *
+signal_router_dup_match_rule (TpProxySignalConnection *sc)
+{
+  return g_strdup_printf ("type='signal',sender='%s',interface='%s'",
+      sc->sender, g_quark_to_string (sc->iface));
+}
+
+static gboolean
+expected_types_equal (const GType *a,
+    const GType *b,
+    guint n_args)
+{
+  return memcmp (a, b, n_args * sizeof (GType)) == 0;
+}
+
+static GValueArray *
+signal_router_demarshal (DBusMessage *message,
+    GVariant *body,
+    const GType *expected_types,
+    guint n_args)
+{
+  GValueArray *args;
+  guint i;
+
+  if (g_variant_n_children (body) != n_args)
+    goto wrong_signature;
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  args = g_value_array_new (n_args);
+
+  for (i = 0; i < n_args; i++)
+    {
+      GVariant *child = g_variant_get_child_value (body, i);
+      GValue value = G_VALUE_INIT;
+
+      dbus_g_value_parse_g_variant (child, &value);
+      g_variant_unref (child);
+
+      if (G_VALUE_TYPE (&value) != expected_types[i])
+        {
+          if (G_IS_VALUE (&value))
+            g_value_unset (&value);
+
+          tp_value_array_free (args);
+          goto wrong_signature;
+        }
+
+      /* move, rather than copy, the value into the array */
+      g_value_array_append (args, NULL);
+      args->values[i] = value;
+    }
+  G_GNUC_END_IGNORE_DEPRECATIONS
+
+  return args;
+
+wrong_signature:
+  DEBUG ("ignoring %s.%s with unexpected signature '%s'",
+      dbus_message_get_interface (message), dbus_message_get_member (message),
+      dbus_message_get_signature (message));
+  return NULL;
+}
+
+/* Returns: (transfer none): the body of @message, parsing it into *@body
+ *  if that hasn't already been done, or %NULL if it can't be parsed */
+static GVariant *
+signal_router_ensure_body (DBusMessage *message,
+    GVariant **body,
+    gboolean *tried)
+{
+  GError *error = NULL;
+
+  if (*tried)
+    return *body;
+
+  *tried = TRUE;
+  *body = _tp_dbus_message_dup_body (message, &error);
+
+  if (*body == NULL)
+    {
+      DEBUG ("unable to parse %s.%s: %s", dbus_message_get_interface (message),
+          dbus_message_get_member (message), error->message);
+      g_error_free (error);
+    }
+
+  return *body;
+}
+
+static DBusHandlerResult
+signal_router_filter (DBusConnection *connection,
+    DBusMessage *message,
+    void *user_data)
+{
+  SignalRouter *router = user_data;
+  const gchar *sender = dbus_message_get_sender (message);
+  const gchar *path = dbus_message_get_path (message);
+  const gchar *member = dbus_message_get_member (message);
+  GPtrArray *subscribers;
+  TpProxySignalConnection *matched[16];
+  GPtrArray *more = NULL;
+  guint n_matched = 0;
+  GQuark iface;
+  GValueArray *args = NULL;
+  const GType *args_types = NULL;
+  GVariant *body = NULL;
+  gboolean tried = FALSE;
+  guint i;
+
+  if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL ||
+      sender == NULL || path == NULL || member == NULL ||
+      dbus_message_get_interface (message) == NULL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  subscribers = g_hash_table_lookup (router->by_path, path);
+
+  if (subscribers == NULL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  /* if nobody has interned the interface name, nobody is watching it */
+  iface = g_quark_try_string (dbus_message_get_interface (message));
+
+  if (iface == 0)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  /* collect the matches first, since delivery consumes the arguments */
+  for (i = 0; i < subscribers->len; i++)
+    {
+      TpProxySignalConnection *sc = g_ptr_array_index (subscribers, i);
+
+      if (sc->iface != iface || tp_strdiff (sc->member, member) ||
+          tp_strdiff (sc->sender, sender))
+        continue;
+
+      if (n_matched < G_N_ELEMENTS (matched))
+        {
+          matched[n_matched++] = sc;
+        }
+      else
+        {
+          if (more == NULL)
+            more = g_ptr_array_new ();
+
+          g_ptr_array_add (more, sc);
+        }
+    }
+
+  for (i = 0; i < n_matched + (more == NULL ? 0 : more->len); i++)
+    {
+      TpProxySignalConnection *sc = (i < n_matched ? matched[i] :
+          g_ptr_array_index (more, i - n_matched));
+      gboolean last = (i + 1 == n_matched + (more == NULL ? 0 : more->len));
+
+      if (sc->variant_type != NULL)
+        {
+          if (signal_router_ensure_body (message, &body, &tried) == NULL)
+            continue;
+
+          if (!g_variant_is_of_type (body, sc->variant_type))
+            {
+              DEBUG ("ignoring %s.%s with unexpected signature '%s'",
+                  g_quark_to_string (iface), member,
+                  dbus_message_get_signature (message));
+              continue;
+            }
+
+          tp_proxy_signal_connection_v0_take_results (sc,
+              tp_value_array_build (1, G_TYPE_VARIANT, body, G_TYPE_INVALID));
+          continue;
+        }
+
+      if (sc->n_args == 0)
+        {
+          tp_proxy_signal_connection_v0_take_results (sc, NULL);
+          continue;
+        }
+
+      if (args != NULL && !expected_types_equal (args_types,
+            sc->expected_types, sc->n_args))
+        {
+          tp_value_array_free (args);
+          args = NULL;
+        }
+
+      if (args == NULL)
+        {
+          if (signal_router_ensure_body (message, &body, &tried) == NULL)
+            continue;
+
+          args = signal_router_demarshal (message, body, sc->expected_types,
+              sc->n_args);
+          args_types = sc->expected_types;
+
+          if (args == NULL)
+            continue;
+        }
+
+      if (last)
+        {
+          tp_proxy_signal_connection_v0_take_results (sc, args);
+          args = NULL;
+        }
+      else
+        {
+          G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+          tp_proxy_signal_connection_v0_take_results (sc,
+              g_value_array_copy (args));
+          G_GNUC_END_IGNORE_DEPRECATIONS
+        }
+    }
+
+  if (args != NULL)
+    tp_value_array_free (args);
+
+  if (body != NULL)
+    g_variant_unref (body);
+
+  if (more != NULL)
+    g_ptr_array_unref (more);
+
+  /* other filters, and dbus-glib, might be interested too */
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void
+signal_router_free (gpointer p)
+{
+  SignalRouter *router = p;
+
+  /* every signal connection holds a ref to a TpProxy, which holds a ref to
+   * the TpDBusDaemon, so there can't be any left */
+  g_assert (g_hash_table_size (router->by_path) == 0);
+  g_assert (g_hash_table_size (router->match_rules) == 0);
+
+  dbus_connection_remove_filter (router->libdbus, signal_router_filter,
+      router);
+  dbus_connection_unref (router->libdbus);
+  g_hash_table_unref (router->by_path);
+  g_hash_table_unref (router->match_rules);
+  g_slice_free (SignalRouter, router);
+}
+
+static SignalRouter *
+signal_router_for_proxy (TpProxy *proxy)
+{
+  TpDBusDaemon *dbus = tp_proxy_get_dbus_daemon (proxy);
+  SignalRouter *router;
+
+  router = g_object_get_qdata ((GObject *) dbus, signal_router_quark ());
+
+  if (router != NULL)
+    return router;
+
+  router = g_slice_new0 (SignalRouter);
+  router->libdbus = dbus_connection_ref (dbus_g_connection_get_connection (
+        tp_proxy_get_dbus_connection (dbus)));
+  router->by_path = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_ptr_array_unref);
+  router->match_rules = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+
+  if (!dbus_connection_add_filter (router->libdbus, signal_router_filter,
+        router, NULL))
+    ERROR ("Out of memory");
+
+  g_object_set_qdata_full ((GObject *) dbus, signal_router_quark (), router,
+      signal_router_free);
+  return router;
+}
+
+static void
+signal_router_add (SignalRouter *router,
+    TpProxySignalConnection *sc)
+{
+  GPtrArray *subscribers = g_hash_table_lookup (router->by_path, sc->path);
+  gchar *rule = signal_router_dup_match_rule (sc);
+  gpointer count;
+
+  if (subscribers == NULL)
+    {
+      subscribers = g_ptr_array_new ();
+      g_hash_table_insert (router->by_path, g_strdup (sc->path), subscribers);
+    }
+
+  g_ptr_array_add (subscribers, sc);
+
+  if (g_hash_table_lookup_extended (router->match_rules, rule, NULL, &count))
+    {
+      g_hash_table_insert (router->match_rules, rule,
+          GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+    }
+  else
+    {
+      /* the NULL error means this doesn't block */
+      dbus_bus_add_match (router->libdbus, rule, NULL);
+      g_hash_table_insert (router->match_rules, rule, GUINT_TO_POINTER (1));
+    }
+
+  sc->router = router;
+}
+
+static void
+signal_router_remove (SignalRouter *router,
+    TpProxySignalConnection *sc)
+{
+  GPtrArray *subscribers = g_hash_table_lookup (router->by_path, sc->path);
+  gchar *rule = signal_router_dup_match_rule (sc);
+  guint count;
+
+  g_assert (subscribers != NULL);
+
+  if (!g_ptr_array_remove_fast (subscribers, sc))
+    g_assert_not_reached ();
+
+  if (subscribers->len == 0)
+    g_hash_table_remove (router->by_path, sc->path);
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (router->match_rules, rule));
+  g_assert (count > 0);
+
+  if (count > 1)
+    {
+      g_hash_table_insert (router->match_rules, rule,
+          GUINT_TO_POINTER (count - 1));
+    }
+  else
+    {
+      dbus_bus_remove_match (router->libdbus, rule, NULL);
+      g_hash_table_remove (router->match_rules, rule);
+      g_free (rule);
+    }
+
+  sc->router = NULL;
+}
+
+static gboolean tp_proxy_signal_connection_unref (TpProxySignalConnection *sc);
+
 static void
 tp_proxy_signal_connection_disconnect_dbus_glib (TpProxySignalConnection *sc)
 {
   DBusGProxy *iface_proxy = sc->iface_proxy;
 
+  if (sc->router != NULL)
+    {
+      signal_router_remove (sc->router, sc);
+      /* this is the router's equivalent of dbus-glib dropping the closure
+       * (tp_proxy_signal_connection_dropped) */
+      tp_proxy_signal_connection_unref (sc);
+      return;
+    }
+
   /* ignore if already done */
   if (iface_proxy == NULL)
     return;
@@ -175,6 +576,12 @@ tp_proxy_signal_connection_unref (TpProxySignalConnection *sc)
   sc->user_data = NULL;
 
   g_free (sc->member);
+  g_free (sc->sender);
+  g_free (sc->path);
+  g_free (sc->expected_types);
+
+  if (sc->variant_type != NULL)
+    g_variant_type_free (sc->variant_type);
 
   /* We can't inline this here, because of fd.o #14750. If our signal
    * connection gets destroyed by side-effects of something else losing a
@@ -183,7 +590,8 @@ tp_proxy_signal_connection_unref (TpProxySignalConnection *sc)
    * invalidation when the weak object goes away) then we need to avoid dying
    * til *our* weak-reference callback has run. So, don't actually free the
    * signal connection until we've re-entered the main loop. */
-  g_idle_add_full (G_PRIORITY_HIGH, _tp_proxy_signal_connection_finish_free,
+  _tp_idle_add_full (TP_LATENCY_CLASS_INTERACTIVE,
+      _tp_proxy_signal_connection_finish_free,
       sc, NULL);
 
   return TRUE;
@@ -220,8 +628,9 @@ tp_proxy_signal_connection_disconnect (TpProxySignalConnection *sc)
       g_assert (invocation->sc == sc);
       g_object_unref (invocation->proxy);
       invocation->proxy = NULL;
+      /* it will be freed when it reaches the head of the completion
+       * queue */
       invocation->sc = NULL;
-      g_source_remove (invocation->idle_source);
 
       if (tp_proxy_signal_connection_unref (sc))
         return;
@@ -231,22 +640,9 @@ tp_proxy_signal_connection_disconnect (TpProxySignalConnection *sc)
 }
 
 static void
-tp_proxy_signal_invocation_free (gpointer p)
+tp_proxy_signal_invocation_free (TpProxySignalInvocation *invocation)
 {
-  TpProxySignalInvocation *invocation = p;
-
-  if (invocation->sc != NULL)
-    {
-      /* this shouldn't really happen - it'll get run if the idle source
-       * is removed by something other than t_p_s_c_disconnect or
-       * t_p_s_i_run */
-      WARNING ("idle source removed by someone else");
-
-      g_queue_remove (&invocation->sc->invocations, invocation);
-      g_object_unref (invocation->proxy);
-      tp_proxy_signal_connection_unref (invocation->sc);
-    }
-
+  g_assert (invocation->sc == NULL);
   g_assert (invocation->proxy == NULL);
 
   if (invocation->args != NULL)
@@ -255,14 +651,23 @@ tp_proxy_signal_invocation_free (gpointer p)
   g_slice_free (TpProxySignalInvocation, invocation);
 }
 
-static gboolean
+static void
 tp_proxy_signal_invocation_run (gpointer p)
 {
   TpProxySignalInvocation *invocation = p;
-  TpProxySignalInvocation *popped = g_queue_pop_head
-      (&invocation->sc->invocations);
+  TpProxySignalInvocation *popped;
+
+  /* disconnected while we were queued */
+  if (invocation->sc == NULL)
+    {
+      tp_proxy_signal_invocation_free (invocation);
+      return;
+    }
+
+  popped = g_queue_pop_head (&invocation->sc->invocations);
 
-  /* if GLib is running idle handlers in the wrong order, then we've lost */
+  /* if the completion queue is running in the wrong order, then we've
+   * lost */
   MORE_DEBUG ("%p: popped %p", invocation->sc, popped);
   g_assert (popped == invocation);
 
@@ -282,7 +687,7 @@ tp_proxy_signal_invocation_run (gpointer p)
   tp_proxy_signal_connection_unref (invocation->sc);
   invocation->sc = NULL;
 
-  return FALSE;
+  tp_proxy_signal_invocation_free (invocation);
 }
 
 static void
@@ -400,7 +805,6 @@ tp_proxy_signal_connection_v0_new (TpProxy *self,
 
   sc->refcount = 1;
   sc->proxy = self;
-  sc->iface_proxy = g_object_ref (iface_proxy);
   sc->member = g_strdup (member);
   sc->collect_args = collect_args;
   sc->invoke_callback = invoke_callback;
@@ -416,11 +820,32 @@ tp_proxy_signal_connection_v0_new (TpProxy *self,
   g_signal_connect (self, "invalidated",
       G_CALLBACK (tp_proxy_signal_connection_proxy_invalidated), sc);
 
-  g_signal_connect (iface_proxy, "destroy",
-      G_CALLBACK (_tp_proxy_signal_connection_dgproxy_destroy), sc);
+  if (self->bus_name[0] == ':' && !TP_IS_DBUS_DAEMON (self))
+    {
+      guint n_args = 0;
+
+      while (expected_types[n_args] != G_TYPE_INVALID)
+        n_args++;
+
+      sc->sender = g_strdup (self->bus_name);
+      sc->path = g_strdup (self->object_path);
+      sc->iface = iface;
+      sc->n_args = n_args;
+      sc->expected_types = g_memdup (expected_types,
+          (n_args + 1) * sizeof (GType));
 
-  dbus_g_proxy_connect_signal (iface_proxy, member, collect_args, sc,
-      tp_proxy_signal_connection_dropped);
+      signal_router_add (signal_router_for_proxy (self), sc);
+    }
+  else
+    {
+      sc->iface_proxy = g_object_ref (iface_proxy);
+
+      g_signal_connect (iface_proxy, "destroy",
+          G_CALLBACK (_tp_proxy_signal_connection_dgproxy_destroy), sc);
+
+      dbus_g_proxy_connect_signal (iface_proxy, member, collect_args, sc,
+          tp_proxy_signal_connection_dropped);
+    }
 
   return sc;
 }
@@ -461,7 +886,101 @@ tp_proxy_signal_connection_v0_take_results (TpProxySignalConnection *sc,
       sc->invocations.head, sc->invocations.tail,
       sc->invocations.length);
 
-  invocation->idle_source = g_idle_add_full (G_PRIORITY_HIGH,
-      tp_proxy_signal_invocation_run, invocation,
-      tp_proxy_signal_invocation_free);
+  _tp_proxy_completion_queue (&invocation->completion,
+      _tp_proxy_get_main_context (invocation->proxy), invocation,
+      tp_proxy_signal_invocation_run);
+}
+
+static void
+vardict_signal_invoke (TpProxy *self,
+    GError *error,
+    GValueArray *args,
+    GCallback callback,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  TpProxyVardictSignalCallback cb = (TpProxyVardictSignalCallback) callback;
+  GVariant *tuple;
+
+  g_assert (error == NULL);
+
+  if (args != NULL && args->n_values == 1 &&
+      G_VALUE_HOLDS (args->values + 0, G_TYPE_VARIANT))
+    {
+      /* from the SignalRouter, which already has the tuple */
+      tuple = g_value_dup_variant (args->values + 0);
+    }
+  else
+    {
+      /* from dbus-glib, for a proxy with a well-known name */
+      GVariant **children = g_new (GVariant *, args == NULL ? 0 :
+          args->n_values);
+      guint i;
+
+      for (i = 0; args != NULL && i < args->n_values; i++)
+        children[i] = dbus_g_value_build_g_variant (args->values + i);
+
+      tuple = g_variant_ref_sink (g_variant_new_tuple (children, i));
+      g_free (children);
+    }
+
+  cb (self, tuple, user_data, weak_object);
+  g_variant_unref (tuple);
+
+  if (args != NULL)
+    tp_value_array_free (args);
+}
+
+/*
+ * _tp_proxy_signal_connection_new_vardict:
+ * @self: a proxy
+ * @iface: a quark whose string value is the D-Bus interface
+ * @member: the name of the signal to which we're connecting
+ * @signature: the type of the tuple of the signal's arguments
+ * @expected_types: as for tp_proxy_signal_connection_v0_new()
+ * @collect_args: as for tp_proxy_signal_connection_v0_new()
+ * @callback: called with the arguments as a tuple of type @signature
+ * @user_data: user-supplied data for the callback
+ * @destroy: user-supplied destructor for the data
+ * @weak_object: as for tp_proxy_signal_connection_v0_new()
+ * @error: used to raise an error if %NULL is returned
+ *
+ * The same as tp_proxy_signal_connection_v0_new(), except that when the
+ * signal is routed through a SignalRouter, its arguments are never
+ * converted to #GValue. @expected_types and @collect_args are only used
+ * for proxies whose signals still come from dbus-glib.
+ *
+ * This is called by the _tp_cli_*_vardict functions generated by
+ * tools/glib-client-gen.py.
+ *
+ * Returns: a signal connection structure, or %NULL if the proxy does not
+ *  have the desired interface or has become invalid
+ */
+TpProxySignalConnection *
+_tp_proxy_signal_connection_new_vardict (TpProxy *self,
+    GQuark iface,
+    const gchar *member,
+    const GVariantType *signature,
+    const GType *expected_types,
+    GCallback collect_args,
+    TpProxyVardictSignalCallback callback,
+    gpointer user_data,
+    GDestroyNotify destroy,
+    GObject *weak_object,
+    GError **error)
+{
+  TpProxySignalConnection *sc;
+
+  g_return_val_if_fail (g_variant_type_is_tuple (signature), NULL);
+
+  sc = tp_proxy_signal_connection_v0_new (self, iface, member,
+      expected_types, collect_args, vardict_signal_invoke,
+      G_CALLBACK (callback), user_data, destroy, weak_object, error);
+
+  /* no signals can have been delivered yet, since that only happens in the
+   * main loop */
+  if (sc != NULL)
+    sc->variant_type = g_variant_type_copy (signature);
+
+  return sc;
 }
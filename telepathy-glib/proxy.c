@@ -34,6 +34,7 @@
 #define DEBUG_FLAG TP_DEBUG_PROXY
 #include "debug-internal.h"
 #include "simple-client-factory-internal.h"
+#include "tracing-internal.h"
 #include "util-internal.h"
 
 #include "_gen/tp-cli-generic-body.h"
@@ -138,6 +139,17 @@ tp_dbus_errors_quark (void)
  * #TpProxy is a base class for Telepathy client-side proxies, which represent
  * an object accessed via D-Bus and provide access to its methods and signals.
  *
+ * Method-call callbacks, signal callbacks and #TpProxy::invalidated for a
+ * proxy are run in the thread-default main context (see
+ * g_main_context_push_thread_default()) that was in use when the proxy was
+ * constructed. A process can shard its work across threads by giving each
+ * thread its own main context and creating independent proxies, and
+ * their #TpSimpleClientFactory and #TpDBusDaemon, from that thread; since
+ * 0.UNRELEASED, tp_dbus_daemon_dup() returns a separate bus connection for
+ * each thread-default main context, so that replies and signals are
+ * delivered to it directly. Each proxy must only be used from the thread
+ * that runs its main context.
+ *
  * Since: 0.7.1
  */
 
@@ -382,14 +394,23 @@ tp_proxy_prepare_request_finish (TpProxyPrepareRequest *req,
   g_slice_free (TpProxyPrepareRequest, req);
 }
 
+/* Interfaces from the Telepathy spec get a small dense index each, so
+ * that checking whether a proxy has one is a single bit test */
+#define MAX_KNOWN_INTERFACES 256
+
 struct _TpProxyPrivate {
     /* GQuark for interface => either a ref'd DBusGProxy *,
      * or the TpProxy itself used as a dummy value to indicate that
      * the DBusGProxy has not been needed yet */
     GData *interfaces;
+    /* bit i is set if the interface with known index i is in interfaces */
+    guint64 known_interfaces[MAX_KNOWN_INTERFACES / 64];
 
     /* feature => FeatureState */
     GData *features;
+    /* feature => g_new'd gint64, the g_get_monotonic_time() at which it
+     * entered FEATURE_STATE_TRYING, while it's in that state */
+    GData *feature_start_times;
 
     /* Queue of TpProxyPrepareRequest. The first requests are the core one,
      * sorted from the most upper super class to the subclass core features.
@@ -405,6 +426,10 @@ struct _TpProxyPrivate {
     gboolean dispose_has_run;
 
     TpSimpleClientFactory *factory;
+
+    /* the thread-default main context when we were constructed, in which
+     * callbacks are run; owned */
+    GMainContext *main_context;
 };
 
 G_DEFINE_TYPE (TpProxy, tp_proxy, G_TYPE_OBJECT)
@@ -428,7 +453,57 @@ enum {
 
 static guint signals[N_SIGNALS] = {0};
 
+/* GQuark => 1 + the interface's known index, or 0 if it has none; set up
+ * once by tp_proxy_init_known_interfaces() and read-only afterwards */
+static guint16 *known_interface_indices = NULL;
+static GQuark max_known_interface_quark = 0;
+
 static void tp_proxy_iface_destroyed_cb (DBusGProxy *dgproxy, TpProxy *self);
+static void tp_proxy_interface_added (TpProxy *self, GQuark iface,
+    DBusGProxy *dgproxy);
+
+static void
+tp_proxy_index_known_interfaces (void)
+{
+  const gchar * const *names = _tp_iface_get_known_names ();
+  GArray *quarks = g_array_new (FALSE, FALSE, sizeof (GQuark));
+  guint i;
+
+  for (i = 0; names[i] != NULL && i < MAX_KNOWN_INTERFACES; i++)
+    {
+      GQuark q = g_quark_from_static_string (names[i]);
+
+      g_array_append_val (quarks, q);
+      max_known_interface_quark = MAX (max_known_interface_quark, q);
+    }
+
+  if (names[i] != NULL)
+    DEBUG ("more than %u known interfaces: the others will be looked up "
+        "more slowly", MAX_KNOWN_INTERFACES);
+
+  known_interface_indices = g_new0 (guint16, max_known_interface_quark + 1);
+
+  for (i = 0; i < quarks->len; i++)
+    known_interface_indices[g_array_index (quarks, GQuark, i)] = i + 1;
+
+  g_array_unref (quarks);
+}
+
+/* Returns: 1 + the known index of @iface, or 0 if it only has an entry in
+ *  the interfaces datalist */
+static inline guint
+tp_proxy_known_interface_index (GQuark iface)
+{
+  if (iface == 0 || iface > max_known_interface_quark)
+    return 0;
+
+  return known_interface_indices[iface];
+}
+
+#define KNOWN_INTERFACE_WORD(self, index) \
+  ((self)->priv->known_interfaces[((index) - 1) / 64])
+#define KNOWN_INTERFACE_BIT(index) \
+  (G_GUINT64_CONSTANT (1) << (((index) - 1) % 64))
 
 /**
  * tp_proxy_borrow_interface_by_id: (skip)
@@ -492,7 +567,10 @@ tp_proxy_get_interface_by_id (TpProxy *self,
         error))
       return NULL;
 
-  dgproxy = g_datalist_id_get_data (&self->priv->interfaces, iface);
+  if (tp_proxy_has_interface_by_id (self, iface))
+    dgproxy = g_datalist_id_get_data (&self->priv->interfaces, iface);
+  else
+    dgproxy = NULL;
 
   if (dgproxy == self)
     {
@@ -510,8 +588,7 @@ tp_proxy_get_interface_by_id (TpProxy *self,
       g_datalist_id_set_data_full (&self->priv->interfaces, iface,
           dgproxy, g_object_unref);
 
-      g_signal_emit (self, signals[SIGNAL_INTERFACE_ADDED], 0,
-          (guint) iface, dgproxy);
+      tp_proxy_interface_added (self, iface, dgproxy);
     }
 
   if (dgproxy != NULL)
@@ -544,9 +621,16 @@ tp_proxy_has_interface_by_id (gpointer self,
                               GQuark iface)
 {
   TpProxy *proxy = self;
+  guint index;
 
   g_return_val_if_fail (TP_IS_PROXY (self), FALSE);
 
+  index = tp_proxy_known_interface_index (iface);
+
+  if (index != 0)
+    return (KNOWN_INTERFACE_WORD (proxy, index) &
+        KNOWN_INTERFACE_BIT (index)) != 0;
+
   return (g_datalist_id_get_data (&proxy->priv->interfaces, iface)
       != NULL);
 }
@@ -574,13 +658,11 @@ gboolean
 tp_proxy_has_interface (gpointer self,
     const gchar *iface)
 {
-  TpProxy *proxy = self;
   GQuark q = g_quark_try_string (iface);
 
   g_return_val_if_fail (TP_IS_PROXY (self), FALSE);
 
-  return (q != 0 &&
-    g_datalist_id_get_data (&proxy->priv->interfaces, q) != NULL);
+  return (q != 0 && tp_proxy_has_interface_by_id (self, q));
 }
 
 static void
@@ -600,6 +682,8 @@ tp_proxy_lose_interfaces (TpProxy *self)
       tp_proxy_lose_interface, self);
 
   g_datalist_clear (&self->priv->interfaces);
+  memset (self->priv->known_interfaces, 0,
+      sizeof (self->priv->known_interfaces));
 }
 
 static void tp_proxy_poll_features (TpProxy *self, const GError *error);
@@ -658,6 +742,49 @@ tp_proxy_invalidate (TpProxy *self, const GError *error)
     }
 }
 
+/*
+ * _tp_proxy_invalidate_many:
+ * @proxies: (element-type TpProxy): proxies, which must be kept alive by
+ *  the caller
+ * @error: an error causing the invalidation
+ *
+ * Equivalent to calling tp_proxy_invalidate() on each of @proxies, except
+ * that all of them are marked as invalid before any #TpProxy::invalidated
+ * signal is emitted, so that a handler for one of them does not see the
+ * others in a half-torn-down state.
+ */
+void
+_tp_proxy_invalidate_many (GPtrArray *proxies,
+    const GError *error)
+{
+  GPtrArray *newly_invalid;
+  guint i;
+
+  g_return_if_fail (proxies != NULL);
+  g_return_if_fail (error != NULL);
+
+  newly_invalid = g_ptr_array_sized_new (proxies->len);
+
+  for (i = 0; i < proxies->len; i++)
+    {
+      TpProxy *self = g_ptr_array_index (proxies, i);
+
+      if (self->invalidated == NULL)
+        {
+          self->invalidated = g_error_copy (error);
+          g_ptr_array_add (newly_invalid, self);
+        }
+    }
+
+  DEBUG ("%u of %u proxies invalidated: %s", newly_invalid->len,
+      proxies->len, error->message);
+
+  for (i = 0; i < newly_invalid->len; i++)
+    tp_proxy_emit_invalidated (g_ptr_array_index (newly_invalid, i));
+
+  g_ptr_array_unref (newly_invalid);
+}
+
 static void
 tp_proxy_iface_destroyed_cb (DBusGProxy *dgproxy,
                              TpProxy *self)
@@ -673,12 +800,18 @@ tp_proxy_iface_destroyed_cb (DBusGProxy *dgproxy,
    */
   if (self->invalidated == NULL)
     {
+      GSource *source = _tp_idle_source_new (TP_LATENCY_CLASS_INTERACTIVE);
+
       DEBUG ("%p", self);
       self->invalidated = g_error_new_literal (TP_DBUS_ERRORS,
           TP_DBUS_ERROR_NAME_OWNER_LOST, "Name owner lost (service crashed?)");
 
-      g_idle_add_full (G_PRIORITY_HIGH, tp_proxy_emit_invalidated,
+      /* this might be called from the bus connection's main context,
+       * which is not necessarily ours */
+      g_source_set_callback (source, tp_proxy_emit_invalidated,
           g_object_ref (self), g_object_unref);
+      g_source_attach (source, self->priv->main_context);
+      g_source_unref (source);
     }
 }
 
@@ -723,8 +856,13 @@ tp_proxy_add_interface_by_id (TpProxy *self,
        * helpfully wake us up on every signal, if we do. So we set a
        * dummy value (self), and replace it with the real value in
        * tp_proxy_get_interface_by_id */
+      guint index = tp_proxy_known_interface_index (iface);
+
       g_datalist_id_set_data_full (&self->priv->interfaces, iface,
           self, NULL);
+
+      if (index != 0)
+        KNOWN_INTERFACE_WORD (self, index) |= KNOWN_INTERFACE_BIT (index);
     }
 
   return iface_proxy;
@@ -1008,6 +1146,7 @@ tp_proxy_init (TpProxy *self)
       TpProxyPrivate);
 
   self->priv->prepare_requests = g_queue_new ();
+  self->priv->main_context = g_main_context_ref_thread_default ();
 }
 
 static GQuark
@@ -1036,6 +1175,34 @@ tp_proxy_set_feature_state (TpProxy *self,
     GQuark feature,
     FeatureState state)
 {
+  gint64 *start = g_datalist_id_get_data (&self->priv->feature_start_times,
+      feature);
+
+  if (start != NULL && state != FEATURE_STATE_TRYING)
+    {
+      gint64 elapsed = g_get_monotonic_time () - *start;
+
+      /* Features are started as soon as their dependencies and interfaces
+       * allow, so these show how long each one really took */
+      DEBUG ("%p: %s %s after %" G_GINT64_FORMAT " us", self,
+          g_quark_to_string (feature),
+          state == FEATURE_STATE_READY ? "prepared" : "not prepared",
+          elapsed);
+
+      if (_tp_tracing_is_enabled ())
+        _tp_trace_record (TP_TRACE_SIDE_PREPARE, G_OBJECT_TYPE_NAME (self),
+            g_quark_to_string (feature), 0, *start, 0, elapsed);
+
+      g_datalist_id_remove_data (&self->priv->feature_start_times, feature);
+    }
+  else if (start == NULL && state == FEATURE_STATE_TRYING)
+    {
+      start = g_new (gint64, 1);
+      *start = g_get_monotonic_time ();
+      g_datalist_id_set_data_full (&self->priv->feature_start_times, feature,
+          start, g_free);
+    }
+
   g_datalist_id_set_data (&self->priv->features, feature,
       GINT_TO_POINTER (state));
 }
@@ -1065,12 +1232,9 @@ tp_proxy_constructor (GType type,
   TpProxy *self = TP_PROXY (object_class->constructor (type,
         n_params, params));
   TpProxyClass *klass = TP_PROXY_GET_CLASS (self);
-  TpProxyInterfaceAddLink *iter;
   GType proxy_parent_type = G_TYPE_FROM_CLASS (tp_proxy_parent_class);
   GType ancestor_type;
 
-  _tp_register_dbus_glib_marshallers ();
-
   for (ancestor_type = type;
        ancestor_type != proxy_parent_type && ancestor_type != 0;
        ancestor_type = g_type_parent (ancestor_type))
@@ -1080,13 +1244,6 @@ tp_proxy_constructor (GType type,
       guint i;
       GArray *core_features;
 
-      for (iter = g_type_get_qdata (ancestor_type,
-              interface_added_cb_quark ());
-           iter != NULL;
-           iter = iter->next)
-        g_signal_connect (self, "interface-added", G_CALLBACK (iter->callback),
-            NULL);
-
       if (ancestor == NULL || ancestor->list_features == NULL)
         continue;
 
@@ -1188,6 +1345,9 @@ tp_proxy_finalize (GObject *object)
   if (self->priv->features != NULL)
     g_datalist_clear (&self->priv->features);
 
+  if (self->priv->feature_start_times != NULL)
+    g_datalist_clear (&self->priv->feature_start_times);
+
   g_assert (self->invalidated != NULL);
   g_error_free (self->invalidated);
 
@@ -1197,20 +1357,136 @@ tp_proxy_finalize (GObject *object)
 
   g_free (self->bus_name);
   g_free (self->object_path);
+  g_main_context_unref (self->priv->main_context);
 
   G_OBJECT_CLASS (tp_proxy_parent_class)->finalize (object);
 }
 
+/*
+ * _tp_proxy_get_main_context:
+ * @self: a proxy
+ *
+ * Returns: (transfer none): the thread-default main context when @self was
+ *  constructed, in which its callbacks are run
+ */
+GMainContext *
+_tp_proxy_get_main_context (gpointer self)
+{
+  g_return_val_if_fail (TP_IS_PROXY (self), NULL);
+
+  return TP_PROXY (self)->priv->main_context;
+}
+
+/*
+ * _tp_proxy_set_main_context:
+ * @self: a proxy which has not made any method calls or connected to any
+ *  signals yet
+ * @context: the main context in which to run its callbacks
+ *
+ * Override the main context recorded when @self was constructed.
+ */
+void
+_tp_proxy_set_main_context (gpointer self,
+    GMainContext *context)
+{
+  TpProxy *proxy = self;
+
+  g_return_if_fail (TP_IS_PROXY (self));
+  g_return_if_fail (context != NULL);
+
+  g_main_context_ref (context);
+  g_main_context_unref (proxy->priv->main_context);
+  proxy->priv->main_context = context;
+}
+
+/* bit i is set once the marshallers for the signals of the interface with
+ * known index i have been registered */
+static guint registered_marshallers[MAX_KNOWN_INTERFACES / 32];
+
+static gpointer
+tp_proxy_register_all_marshallers (gpointer unused G_GNUC_UNUSED)
+{
+  _tp_register_dbus_glib_marshallers ();
+  return NULL;
+}
+
+/* Register the marshallers for @iface's signals, the first time any proxy
+ * uses it: a short-lived process only pays for the interfaces it uses,
+ * rather than for the whole spec on every proxy construction */
+static void
+tp_proxy_ensure_marshallers (GQuark iface)
+{
+  guint index = tp_proxy_known_interface_index (iface);
+  guint word, bit;
+
+  if (index == 0)
+    {
+      static GOnce once = G_ONCE_INIT;
+
+      /* an extension should register its own marshallers, but it might
+       * have relied on ours for signatures that it shares with the spec */
+      g_once (&once, tp_proxy_register_all_marshallers, NULL);
+      return;
+    }
+
+  word = (index - 1) / 32;
+  bit = 1U << ((index - 1) % 32);
+
+  if ((g_atomic_int_get (&registered_marshallers[word]) & bit) != 0)
+    return;
+
+  /* registering twice, if two threads race, is harmless */
+  _tp_register_dbus_glib_marshallers_for_interface (
+      g_quark_to_string (iface));
+  g_atomic_int_or (&registered_marshallers[word], bit);
+}
+
+/* Called when the DBusGProxy for @iface is first needed. The hooks are
+ * called directly, rather than being connected to each proxy's
+ * interface-added signal during construction, so that constructing a proxy
+ * costs nothing for interfaces it never uses. */
+static void
+tp_proxy_interface_added (TpProxy *self,
+    GQuark iface,
+    DBusGProxy *dgproxy)
+{
+  GType proxy_parent_type = G_TYPE_FROM_CLASS (tp_proxy_parent_class);
+  GType type;
+
+  tp_proxy_ensure_marshallers (iface);
+
+  for (type = G_OBJECT_TYPE (self);
+       type != proxy_parent_type && type != 0;
+       type = g_type_parent (type))
+    {
+      TpProxyInterfaceAddLink *iter;
+
+      for (iter = g_type_get_qdata (type, interface_added_cb_quark ());
+           iter != NULL;
+           iter = iter->next)
+        iter->callback (self, iface, dgproxy, NULL);
+    }
+
+  g_signal_emit (self, signals[SIGNAL_INTERFACE_ADDED], 0,
+      (guint) iface, dgproxy);
+}
+
 /**
  * tp_proxy_or_subclass_hook_on_interface_add:
  * @proxy_or_subclass: The #GType of #TpProxy or a subclass
  * @callback: A signal handler for #TpProxy::interface-added
  *
- * Arrange for @callback to be connected to #TpProxy::interface-added
- * during the #TpProxy constructor. This is done sufficiently early that
- * it will see the signal for the default interface (@interface member of
- * #TpProxyClass), if any, being added. The intended use is for the callback
- * to call dbus_g_proxy_add_signal() on the new #DBusGProxy.
+ * Arrange for @callback to be called whenever #TpProxy::interface-added
+ * is about to be emitted on an instance of @proxy_or_subclass, before any
+ * handlers connected to that signal. It will see the signal for the
+ * default interface (@interface member of #TpProxyClass), if any, being
+ * added. The intended use is for the callback to call
+ * dbus_g_proxy_add_signal() on the new #DBusGProxy.
+ *
+ * Since 0.UNRELEASED, @callback is called directly rather than being
+ * connected to each proxy during construction, so it is only called for
+ * interfaces that are actually used, and also applies to proxies that
+ * were constructed before this function was called.
  *
  * Since 0.7.6, to ensure correct overriding of interfaces that might be
  * added to telepathy-glib, before calling this function you should
@@ -1623,6 +1899,7 @@ tp_proxy_once (gpointer data G_GNUC_UNUSED)
 {
   GType type = TP_TYPE_PROXY;
 
+  tp_proxy_index_known_interfaces ();
   tp_proxy_or_subclass_hook_on_interface_add (type,
       tp_cli_generic_add_signals);
 
@@ -1841,7 +2118,7 @@ check_depends_ready (TpProxy *self,
                 return FALSE;
               }
 
-            DEBUG ("retry preparing dep: %s", g_quark_to_string (dep));
+            TRACE ("retry preparing dep: %s", g_quark_to_string (dep));
             tp_proxy_set_feature_state (self, dep, FEATURE_STATE_WANTED);
             ready = FALSE;
             break;
@@ -2099,6 +2376,185 @@ core_prepared (TpProxy *self)
   return !req->core;
 }
 
+/*
+ * _tp_proxy_is_prepared_all:
+ * @self: an instance of a #TpProxy subclass
+ * @features: (allow-none): a 0-terminated list of features
+ *
+ * Returns: %TRUE if @self has not been invalidated, its core features are
+ *  ready, and so is each of @features that @self's class supports; in other
+ *  words, whether tp_proxy_prepare_async() would have nothing to do
+ */
+gboolean
+_tp_proxy_is_prepared_all (gpointer self,
+    const GQuark *features)
+{
+  TpProxy *proxy = self;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_PROXY (self), FALSE);
+
+  if (proxy->invalidated != NULL || !core_prepared (proxy))
+    return FALSE;
+
+  for (i = 0; features != NULL && features[i] != 0; i++)
+    {
+      FeatureState state = tp_proxy_get_feature_state (proxy, features[i]);
+
+      if (state != FEATURE_STATE_READY && state != FEATURE_STATE_INVALID)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Prepares features on several proxies at once, and completes a single
+ * result when they have all finished or a deadline has passed. This is
+ * what TpBaseClient's contexts do before calling the client. */
+struct _TpProxyPrepareMany {
+    /* NULL once completed, after which late callbacks are ignored */
+    GSimpleAsyncResult *result;
+    /* proxies not yet prepared, plus one until
+     * _tp_proxy_prepare_many_start() */
+    guint num_pending;
+    /* if non-zero, we'll stop waiting when this fires */
+    guint timeout_id;
+};
+
+/*
+ * _tp_proxy_prepare_many_new:
+ * @result: the result to complete when preparation has finished
+ *
+ * Returns: (transfer full): a new preparation, to which proxies should be
+ *  added with _tp_proxy_prepare_many_add() before
+ *  _tp_proxy_prepare_many_start() is called
+ */
+TpProxyPrepareMany *
+_tp_proxy_prepare_many_new (GSimpleAsyncResult *result)
+{
+  TpProxyPrepareMany *self = g_slice_new0 (TpProxyPrepareMany);
+
+  self->result = g_object_ref (result);
+  self->num_pending = 1;
+  return self;
+}
+
+static void
+prepare_many_complete (TpProxyPrepareMany *self)
+{
+  GSimpleAsyncResult *result = self->result;
+
+  if (self->timeout_id != 0)
+    {
+      g_source_remove (self->timeout_id);
+      self->timeout_id = 0;
+    }
+
+  self->result = NULL;
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+static void
+prepare_many_proxy_done (TpProxyPrepareMany *self)
+{
+  if (--self->num_pending > 0)
+    return;
+
+  if (self->result != NULL)
+    prepare_many_complete (self);
+
+  g_slice_free (TpProxyPrepareMany, self);
+}
+
+static void
+prepare_many_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish (source, result, &error))
+    {
+      DEBUG ("Failed to prepare %s %s: %s", G_OBJECT_TYPE_NAME (source),
+          tp_proxy_get_object_path (source), error->message);
+      g_error_free (error);
+    }
+
+  prepare_many_proxy_done (user_data);
+}
+
+static gboolean
+prepare_many_timeout_cb (gpointer user_data)
+{
+  TpProxyPrepareMany *self = user_data;
+
+  /* features are only ever "prepared if possible", so carry on with
+   * whatever we have got rather than keeping the caller waiting */
+  DEBUG ("Gave up waiting for %u proxies to be prepared",
+      self->num_pending);
+
+  self->timeout_id = 0;
+  prepare_many_complete (self);
+  return FALSE;
+}
+
+/*
+ * _tp_proxy_prepare_many_add:
+ * @self: a preparation that has not been started
+ * @proxy: an instance of a #TpProxy subclass
+ * @features: (allow-none): a 0-terminated list of features
+ *
+ * Prepare @features on @proxy, unless it already has them: the same account
+ * and connection are typically shared by every context, and are prepared by
+ * the first one.
+ */
+void
+_tp_proxy_prepare_many_add (TpProxyPrepareMany *self,
+    gpointer proxy,
+    const GQuark *features)
+{
+  g_return_if_fail (self->result != NULL);
+
+  if (_tp_proxy_is_prepared_all (proxy, features))
+    return;
+
+  self->num_pending++;
+  tp_proxy_prepare_async (proxy, features, prepare_many_cb, self);
+}
+
+/*
+ * _tp_proxy_prepare_many_start:
+ * @self: (transfer full): a preparation that has not been started
+ * @timeout_ms: if non-zero, stop waiting after this many milliseconds and
+ *  complete the result anyway
+ *
+ * Complete the result when every proxy added to @self has been prepared,
+ * or in an idle callback if they all already were.
+ */
+void
+_tp_proxy_prepare_many_start (TpProxyPrepareMany *self,
+    guint timeout_ms)
+{
+  g_return_if_fail (self->result != NULL);
+
+  if (self->num_pending == 1)
+    {
+      /* everything was already prepared */
+      g_simple_async_result_complete_in_idle (self->result);
+      g_object_unref (self->result);
+      g_slice_free (TpProxyPrepareMany, self);
+      return;
+    }
+
+  if (timeout_ms > 0)
+    self->timeout_id = g_timeout_add (timeout_ms, prepare_many_timeout_cb,
+        self);
+
+  /* release the count held since _tp_proxy_prepare_many_new() */
+  prepare_many_proxy_done (self);
+}
+
 /* Returns %TRUE if all the features requested in @req have complete their
  * preparation */
 static gboolean
@@ -2155,7 +2611,7 @@ request_is_complete (TpProxy *self,
                 if (check_depends_ready (self, feature, FALSE, &failed))
                   {
                     /* We can prepare it now */
-                    DEBUG ("%p: calling callback for %s", self,
+                    TRACE ("%p: calling callback for %s", self,
                         g_quark_to_string (feature));
 
                     tp_proxy_set_feature_state (self, feature,
@@ -2268,7 +2724,7 @@ tp_proxy_poll_features (TpProxy *self,
       if (!core_prepared (self) &&
           req != head)
         {
-          DEBUG ("%p: core features not ready yet, nothing prepared", self);
+          TRACE ("%p: core features not ready yet, nothing prepared", self);
           continue;
         }
 
@@ -27,6 +27,8 @@
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/util.h>
 
+#include <string.h>
+
 /**
  * SECTION: room-info
  * @title: TpRoomInfo
@@ -56,10 +58,43 @@
 
 G_DEFINE_TYPE (TpRoomInfo, tp_room_info, G_TYPE_OBJECT)
 
+/* Indices into TpRoomInfoPriv.strings */
+enum {
+    ROOM_STRING_HANDLE_NAME,
+    ROOM_STRING_NAME,
+    ROOM_STRING_DESCRIPTION,
+    ROOM_STRING_SUBJECT,
+    ROOM_STRING_ROOM_ID,
+    ROOM_STRING_SERVER,
+    N_ROOM_STRINGS
+};
+
+/* The Room_Info keys corresponding to TpRoomInfoPriv.strings */
+static const gchar * const room_string_keys[N_ROOM_STRINGS] = {
+    "handle-name",
+    "name",
+    "description",
+    "subject",
+    "room-id",
+    "server"
+};
+
+/* A room list can have a great many of these, so rather than keeping a
+ * copy of the a{sv}, we only keep the fields we have accessors for. */
 struct _TpRoomInfoPriv {
   TpHandle handle;
-  gchar *channel_type;
-  GHashTable *info;
+  /* interned, since there are only a few channel types */
+  const gchar *channel_type;
+  /* each either NULL or pointing into string_block */
+  const gchar *strings[N_ROOM_STRINGS];
+  /* all the non-NULL strings, end to end */
+  gchar *string_block;
+  guint members;
+  guint members_known:1;
+  guint password:1;
+  guint password_known:1;
+  guint invite_only:1;
+  guint invite_only_known:1;
 };
 
 static void
@@ -69,8 +104,7 @@ tp_room_info_finalize (GObject *object)
   void (*chain_up) (GObject *) =
       ((GObjectClass *) tp_room_info_parent_class)->finalize;
 
-  g_free (self->priv->channel_type);
-  g_hash_table_unref (self->priv->info);
+  g_free (self->priv->string_block);
 
   if (chain_up != NULL)
     chain_up (object);
@@ -98,8 +132,15 @@ TpRoomInfo *
 _tp_room_info_new (GValueArray *dbus_struct)
 {
   TpRoomInfo *room;
+  TpRoomInfoPriv *priv;
   const gchar *channel_type;
   GHashTable *info;
+  const gchar *strings[N_ROOM_STRINGS];
+  gsize lengths[N_ROOM_STRINGS];
+  gsize total = 0;
+  gchar *cursor;
+  gboolean known;
+  guint i;
 
   g_return_val_if_fail (dbus_struct != NULL, NULL);
   g_return_val_if_fail (dbus_struct->n_values == 3, NULL);
@@ -109,16 +150,46 @@ _tp_room_info_new (GValueArray *dbus_struct)
   room = g_object_new (TP_TYPE_ROOM_INFO,
       NULL);
 
+  priv = room->priv;
+
   tp_value_array_unpack (dbus_struct, 3,
-      &room->priv->handle,
+      &priv->handle,
       &channel_type,
       &info);
-  room->priv->channel_type = g_strdup (channel_type);
-  room->priv->info = g_hash_table_new_full (g_str_hash, g_str_equal,
-      g_free, (GDestroyNotify) tp_g_value_slice_free);
-  tp_g_hash_table_update (room->priv->info, info,
-      (GBoxedCopyFunc) g_strdup,
-      (GBoxedCopyFunc) tp_g_value_slice_dup);
+  priv->channel_type = g_intern_string (channel_type);
+
+  for (i = 0; i < N_ROOM_STRINGS; i++)
+    {
+      strings[i] = tp_asv_get_string (info, room_string_keys[i]);
+
+      if (strings[i] != NULL)
+        {
+          lengths[i] = strlen (strings[i]) + 1;
+          total += lengths[i];
+        }
+    }
+
+  if (total > 0)
+    priv->string_block = g_malloc (total);
+
+  cursor = priv->string_block;
+
+  for (i = 0; i < N_ROOM_STRINGS; i++)
+    {
+      if (strings[i] != NULL)
+        {
+          memcpy (cursor, strings[i], lengths[i]);
+          priv->strings[i] = cursor;
+          cursor += lengths[i];
+        }
+    }
+
+  priv->members = tp_asv_get_uint32 (info, "members", &known);
+  priv->members_known = known;
+  priv->password = tp_asv_get_boolean (info, "password", &known);
+  priv->password_known = known;
+  priv->invite_only = tp_asv_get_boolean (info, "invite-only", &known);
+  priv->invite_only_known = known;
 
   return room;
 }
@@ -170,7 +241,7 @@ tp_room_info_get_channel_type (TpRoomInfo *self)
 const gchar *
 tp_room_info_get_handle_name (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "handle-name");
+  return self->priv->strings[ROOM_STRING_HANDLE_NAME];
 }
 
 /**
@@ -187,7 +258,7 @@ tp_room_info_get_handle_name (TpRoomInfo *self)
 const gchar *
 tp_room_info_get_name (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "name");
+  return self->priv->strings[ROOM_STRING_NAME];
 }
 
 /**
@@ -203,7 +274,7 @@ tp_room_info_get_name (TpRoomInfo *self)
 const gchar *
 tp_room_info_get_description (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "description");
+  return self->priv->strings[ROOM_STRING_DESCRIPTION];
 }
 
 /**
@@ -219,7 +290,7 @@ tp_room_info_get_description (TpRoomInfo *self)
 const gchar *
 tp_room_info_get_subject (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "subject");
+  return self->priv->strings[ROOM_STRING_SUBJECT];
 }
 
 /**
@@ -238,7 +309,10 @@ guint
 tp_room_info_get_members_count (TpRoomInfo *self,
     gboolean *known)
 {
-  return tp_asv_get_uint32 (self->priv->info, "members", known);
+  if (known != NULL)
+    *known = self->priv->members_known;
+
+  return self->priv->members;
 }
 
 /**
@@ -257,7 +331,10 @@ gboolean
 tp_room_info_get_requires_password (TpRoomInfo *self,
     gboolean *known)
 {
-  return tp_asv_get_boolean (self->priv->info, "password", known);
+  if (known != NULL)
+    *known = self->priv->password_known;
+
+  return self->priv->password;
 }
 
 /**
@@ -276,7 +353,10 @@ gboolean
 tp_room_info_get_invite_only (TpRoomInfo *self,
     gboolean *known)
 {
-  return tp_asv_get_boolean (self->priv->info, "invite-only", known);
+  if (known != NULL)
+    *known = self->priv->invite_only_known;
+
+  return self->priv->invite_only;
 }
 
 /**
@@ -292,7 +372,7 @@ tp_room_info_get_invite_only (TpRoomInfo *self,
 const gchar *
 tp_room_info_get_room_id (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "room-id");
+  return self->priv->strings[ROOM_STRING_ROOM_ID];
 }
 
 /**
@@ -308,5 +388,5 @@ tp_room_info_get_room_id (TpRoomInfo *self)
 const gchar *
 tp_room_info_get_server (TpRoomInfo *self)
 {
-  return tp_asv_get_string (self->priv->info, "server");
+  return self->priv->strings[ROOM_STRING_SERVER];
 }
@@ -55,6 +55,7 @@
 #include "telepathy-glib/debug-internal.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <glib/gstdio.h>
 
 static void async_initable_iface_init (GAsyncInitableIface *iface);
@@ -72,6 +73,20 @@ struct _TpRoomListPrivate
 
   GSimpleAsyncResult *async_res;
   gulong invalidated_id;
+
+  /* TRUE once tp_room_list_want_more() has been called: from then on,
+   * we only emit got-room when we have credit */
+  gboolean flow_controlled;
+  /* number of rooms we may still emit, if flow_controlled */
+  guint credit;
+  /* reffed TpRoomInfo which are waiting for credit, oldest first */
+  GQueue queued_rooms;
+  /* TRUE while we are emitting got-room for queued_rooms */
+  gboolean emitting;
+
+  /* set by tp_room_list_set_filter(): casefolded, or NULL */
+  gchar *filter_name;
+  guint filter_min_members;
 };
 
 enum
@@ -143,6 +158,66 @@ tp_room_list_set_property (GObject *object,
     }
 }
 
+static gboolean
+room_matches_filter (TpRoomList *self,
+    TpRoomInfo *room)
+{
+  gboolean known;
+
+  if (self->priv->filter_min_members > 0 &&
+      tp_room_info_get_members_count (room, &known) <
+        self->priv->filter_min_members &&
+      known)
+    return FALSE;
+
+  if (self->priv->filter_name != NULL)
+    {
+      const gchar *name = tp_room_info_get_name (room);
+      gchar *folded;
+      gboolean ret;
+
+      if (name == NULL)
+        name = tp_room_info_get_handle_name (room);
+
+      if (name == NULL)
+        return FALSE;
+
+      folded = g_utf8_casefold (name, -1);
+      ret = (strstr (folded, self->priv->filter_name) != NULL);
+      g_free (folded);
+      return ret;
+    }
+
+  return TRUE;
+}
+
+static void
+emit_queued_rooms (TpRoomList *self)
+{
+  /* a got-room handler might call tp_room_list_want_more(); the loop below
+   * will use the new credit */
+  if (self->priv->emitting)
+    return;
+
+  self->priv->emitting = TRUE;
+  g_object_ref (self);
+
+  while (!g_queue_is_empty (&self->priv->queued_rooms) &&
+      (!self->priv->flow_controlled || self->priv->credit > 0))
+    {
+      TpRoomInfo *room = g_queue_pop_head (&self->priv->queued_rooms);
+
+      if (self->priv->flow_controlled)
+        self->priv->credit--;
+
+      g_signal_emit (self, signals[SIG_GOT_ROOM], 0, room);
+      g_object_unref (room);
+    }
+
+  self->priv->emitting = FALSE;
+  g_object_unref (self);
+}
+
 static void
 got_rooms_cb (TpChannel *channel,
     const GPtrArray *rooms,
@@ -157,9 +232,14 @@ got_rooms_cb (TpChannel *channel,
       TpRoomInfo *room;
 
       room = _tp_room_info_new (g_ptr_array_index (rooms, i));
-      g_signal_emit (self, signals[SIG_GOT_ROOM], 0, room);
-      g_object_unref (room);
+
+      if (room_matches_filter (self, room))
+        g_queue_push_tail (&self->priv->queued_rooms, room);
+      else
+        g_object_unref (room);
     }
+
+  emit_queued_rooms (self);
 }
 
 static void
@@ -203,6 +283,9 @@ tp_room_list_dispose (GObject *object)
   destroy_channel (self);
   g_clear_object (&self->priv->account);
 
+  g_queue_foreach (&self->priv->queued_rooms, (GFunc) g_object_unref, NULL);
+  g_queue_clear (&self->priv->queued_rooms);
+
   if (chain_up != NULL)
     chain_up (object);
 }
@@ -215,6 +298,7 @@ tp_room_list_finalize (GObject *object)
       ((GObjectClass *) tp_room_list_parent_class)->finalize;
 
   g_free (self->priv->server);
+  g_free (self->priv->filter_name);
 
   if (chain_up != NULL)
     chain_up (object);
@@ -318,6 +402,7 @@ tp_room_list_init (TpRoomList *self)
 {
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE ((self), TP_TYPE_ROOM_LIST,
       TpRoomListPrivate);
+  g_queue_init (&self->priv->queued_rooms);
 }
 
 /**
@@ -401,6 +486,113 @@ tp_room_list_start (TpRoomList *self)
       list_rooms_cb, NULL, NULL, G_OBJECT (self));
 }
 
+/**
+ * tp_room_list_want_more:
+ * @self: a #TpRoomList
+ * @n_rooms: the number of additional rooms the application is ready for
+ *
+ * Allow #TpRoomList::got-room to be emitted up to @n_rooms more times.
+ *
+ * By default, #TpRoomList::got-room is emitted for each room as soon as
+ * the connection manager reports it, which can be more than a user
+ * interface can keep up with on a large server. After this function has
+ * been called, even with @n_rooms = 0, @self only emits
+ * #TpRoomList::got-room while it has credit. Rooms found meanwhile are
+ * queued, oldest first, and emitted as more credit is given. This lets the
+ * application fetch rooms a page at a time, for instance as the user
+ * scrolls. Call this before tp_room_list_start() if no rooms should be
+ * emitted until they are wanted.
+ *
+ * If rooms are already queued, up to @n_rooms of them are emitted before
+ * this function returns.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_room_list_want_more (TpRoomList *self,
+    guint n_rooms)
+{
+  g_return_if_fail (TP_IS_ROOM_LIST (self));
+
+  self->priv->flow_controlled = TRUE;
+
+  if (n_rooms > G_MAXUINT - self->priv->credit)
+    self->priv->credit = G_MAXUINT;
+  else
+    self->priv->credit += n_rooms;
+
+  emit_queued_rooms (self);
+}
+
+/**
+ * tp_room_list_get_n_queued_rooms:
+ * @self: a #TpRoomList
+ *
+ * <!-- -->
+ *
+ * Returns: the number of rooms which have been found, but not yet emitted
+ *  because the application has not asked for them with
+ *  tp_room_list_want_more()
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_room_list_get_n_queued_rooms (TpRoomList *self)
+{
+  g_return_val_if_fail (TP_IS_ROOM_LIST (self), 0);
+
+  return g_queue_get_length (&self->priv->queued_rooms);
+}
+
+/**
+ * tp_room_list_set_filter:
+ * @self: a #TpRoomList
+ * @name_contains: (allow-none): if not %NULL, only rooms whose
+ *  name (or identifier, if they have no name) contains this string,
+ *  ignoring case, will be reported
+ * @min_members: if nonzero, rooms known to have fewer members than
+ *  this will not be reported
+ *
+ * Only report rooms matching the given criteria via
+ * #TpRoomList::got-room. Rooms which do not match are discarded as soon as
+ * they are received, and so are any queued rooms that no longer match.
+ * Rooms whose number of members is unknown are not affected by
+ * @min_members.
+ *
+ * The Telepathy D-Bus API does not let the connection manager filter room
+ * lists, so @self filters them as they arrive.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_room_list_set_filter (TpRoomList *self,
+    const gchar *name_contains,
+    guint min_members)
+{
+  GList *l, *next;
+
+  g_return_if_fail (TP_IS_ROOM_LIST (self));
+
+  g_free (self->priv->filter_name);
+  self->priv->filter_name = NULL;
+
+  if (!tp_str_empty (name_contains))
+    self->priv->filter_name = g_utf8_casefold (name_contains, -1);
+
+  self->priv->filter_min_members = min_members;
+
+  for (l = self->priv->queued_rooms.head; l != NULL; l = next)
+    {
+      next = l->next;
+
+      if (!room_matches_filter (self, l->data))
+        {
+          g_object_unref (l->data);
+          g_queue_delete_link (&self->priv->queued_rooms, l);
+        }
+    }
+}
+
 static void
 chan_invalidated_cb (TpChannel *channel,
     guint domain,
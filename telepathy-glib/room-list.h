@@ -73,6 +73,18 @@ gboolean tp_room_list_is_listing (TpRoomList *self);
 
 void tp_room_list_start (TpRoomList *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_room_list_want_more (TpRoomList *self,
+    guint n_rooms);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_room_list_get_n_queued_rooms (TpRoomList *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_room_list_set_filter (TpRoomList *self,
+    const gchar *name_contains,
+    guint min_members);
+
 G_END_DECLS
 
 #endif
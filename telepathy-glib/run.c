@@ -30,6 +30,33 @@
  *
  * This function also manages the connection manager's lifetime - if there
  * are no new connections for a while, it times out and exits.
+ *
+ * Since 0.UNRELEASED, if the environment variable
+ * <envar>TP_MAIN_LOOP_WATCHDOG</envar> is set to a number of milliseconds,
+ * a watchdog thread reports any main loop iteration that takes longer than
+ * that to dispatch. The message names the D-Bus method call being served,
+ * if any; where the platform supports it, a backtrace of the main thread
+ * is also printed on stderr. Once a minute, the watchdog logs a summary of
+ * the main loop's latency at debug level in the "tp-glib/manager" domain,
+ * so that it can be seen via the
+ * <literal>org.freedesktop.Telepathy.Debug</literal> interface.
+ *
+ * Since 0.UNRELEASED, if the environment variable
+ * <envar>TP_CM_IDLE_TIMEOUT</envar> is set to a number of milliseconds, the
+ * connection manager waits that long without connections before exiting,
+ * rather than 5 seconds.
+ *
+ * Since 0.UNRELEASED, if the environment variable
+ * <envar>TP_CM_HANDOFF</envar> is set, the connection manager can be
+ * upgraded without dropping its connections. It takes its well-known bus
+ * name from a running instance which was also started with
+ * <envar>TP_CM_HANDOFF</envar>, and lets a later one take the name in
+ * turn. An instance which loses its name in this way stops receiving new
+ * connection requests, but keeps serving the connections it already has;
+ * it exits as soon as the last of them is disconnected, without waiting
+ * for the idle timeout, even if the PERSIST debug flag is set. Connections
+ * made after the hand-off are served by the new instance. The connections'
+ * state stays in the process that made them: it is not migrated.
  */
 
 #include "config.h"
@@ -47,6 +74,8 @@
 
 #define DEBUG_FLAG TP_DEBUG_MANAGER
 #include "debug-internal.h"
+#include "base-connection-manager-internal.h"
+#include "main-loop-watchdog-internal.h"
 #include <telepathy-glib/base-connection-manager.h>
 #include <telepathy-glib/debug.h>
 #include <telepathy-glib/errors.h>
@@ -65,6 +94,14 @@ static GMainLoop *mainloop = NULL;
 static TpBaseConnectionManager *manager = NULL;
 static gboolean connections_exist = FALSE;
 static guint timeout_id = 0;
+/* our well-known name, if we might be asked to hand it over */
+static gchar *handoff_bus_name = NULL;
+/* TRUE if a newer instance has taken our well-known name */
+static gboolean handed_off = FALSE;
+
+#define DIE_TIME 5000
+
+static guint die_time = DIE_TIME;
 
 static void
 quit_loop (void)
@@ -77,7 +114,7 @@ quit_loop (void)
 static gboolean
 kill_connection_manager (gpointer data)
 {
-  if (!_TP_DEBUG_IS_PERSISTENT && !connections_exist)
+  if (!connections_exist && (handed_off || !_TP_DEBUG_IS_PERSISTENT))
     {
       g_debug ("no connections, and timed out");
       quit_loop ();
@@ -102,8 +139,6 @@ new_connection (TpBaseConnectionManager *conn,
     }
 }
 
-#define DIE_TIME 5000
-
 static void
 no_more_connections (TpBaseConnectionManager *conn)
 {
@@ -114,7 +149,23 @@ no_more_connections (TpBaseConnectionManager *conn)
       g_source_remove (timeout_id);
     }
 
-  timeout_id = g_timeout_add (DIE_TIME, kill_connection_manager, NULL);
+  /* once we've been replaced, nobody can ask us for a new connection */
+  if (handed_off)
+    timeout_id = g_idle_add (kill_connection_manager, NULL);
+  else
+    timeout_id = g_timeout_add (die_time, kill_connection_manager, NULL);
+}
+
+static void
+name_lost (void)
+{
+  g_message ("A newer instance has taken over %s; exiting once the last "
+      "connection has gone", handoff_bus_name);
+
+  handed_off = TRUE;
+
+  if (!connections_exist)
+    no_more_connections (manager);
 }
 
 #ifdef ENABLE_BACKTRACE
@@ -178,6 +229,24 @@ dbus_filter_function (DBusConnection *connection,
       g_message ("Got disconnected from the session bus");
       quit_loop ();
     }
+  else if (handoff_bus_name != NULL && !handed_off &&
+      dbus_message_is_signal (message, DBUS_INTERFACE_DBUS, "NameLost") &&
+      !tp_strdiff (dbus_message_get_sender (message), DBUS_SERVICE_DBUS))
+    {
+      const gchar *name = NULL;
+
+      if (dbus_message_get_args (message, NULL, DBUS_TYPE_STRING, &name,
+            DBUS_TYPE_INVALID) &&
+          !tp_strdiff (name, handoff_bus_name))
+        name_lost ();
+    }
+  else if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    {
+      _tp_main_loop_watchdog_note_method_call (
+          dbus_message_get_interface (message),
+          dbus_message_get_member (message),
+          dbus_message_get_path (message));
+    }
 
   return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
@@ -196,12 +265,16 @@ dbus_filter_function (DBusConnection *connection,
  * loop. When this function returns, the program should exit.
  *
  * If the connection manager does not create a connection within a
- * short arbitrary time (currently 5 seconds), either on startup or after
+ * short arbitrary time (by default 5 seconds), either on startup or after
  * the last open connection is disconnected, and the PERSIST debug
  * flag is not set, return 0.
  *
  * If registering the connection manager on D-Bus fails, return 1.
  *
+ * See the section description for the
+ * <envar>TP_MAIN_LOOP_WATCHDOG</envar>, <envar>TP_CM_IDLE_TIMEOUT</envar>
+ * and <envar>TP_CM_HANDOFF</envar> environment variables.
+ *
  * Returns: the status code with which the process should exit
  */
 
@@ -215,6 +288,8 @@ tp_run_connection_manager (const char *prog_name,
   DBusConnection *connection = NULL;
   TpDBusDaemon *bus_daemon = NULL;
   GError *error = NULL;
+  const gchar *watchdog;
+  const gchar *idle_timeout;
   int ret = 1;
 
   add_signal_handlers ();
@@ -254,6 +329,25 @@ tp_run_connection_manager (const char *prog_name,
 
   manager = construct_cm ();
 
+  if (g_getenv ("TP_CM_HANDOFF") != NULL)
+    {
+      _tp_base_connection_manager_set_handoff (manager, TRUE);
+      handoff_bus_name = _tp_base_connection_manager_dup_bus_name (manager);
+    }
+
+  idle_timeout = g_getenv ("TP_CM_IDLE_TIMEOUT");
+
+  if (idle_timeout != NULL)
+    {
+      guint64 ms = g_ascii_strtoull (idle_timeout, NULL, 10);
+
+      if (ms > 0)
+        die_time = MIN (ms, G_MAXUINT);
+      else
+        WARNING ("ignoring TP_CM_IDLE_TIMEOUT=%s: expected a number of "
+            "milliseconds", idle_timeout);
+    }
+
   g_signal_connect (manager, "new-connection",
       (GCallback) new_connection, NULL);
 
@@ -279,10 +373,25 @@ tp_run_connection_manager (const char *prog_name,
   g_debug ("started version %s (telepathy-glib version %s)", version,
       VERSION);
 
-  timeout_id = g_timeout_add (DIE_TIME, kill_connection_manager, NULL);
+  timeout_id = g_timeout_add (die_time, kill_connection_manager, NULL);
+
+  watchdog = g_getenv ("TP_MAIN_LOOP_WATCHDOG");
+
+  if (watchdog != NULL)
+    {
+      guint64 threshold = g_ascii_strtoull (watchdog, NULL, 10);
+
+      if (threshold > 0)
+        _tp_main_loop_watchdog_start (MIN (threshold, G_MAXUINT));
+      else
+        WARNING ("ignoring TP_MAIN_LOOP_WATCHDOG=%s: expected a number of "
+            "milliseconds", watchdog);
+    }
 
   g_main_loop_run (mainloop);
 
+  _tp_main_loop_watchdog_stop ();
+
   g_message ("Exiting");
 
   ret = 0;
@@ -304,6 +413,10 @@ out:
 
   mainloop = NULL;
 
+  g_free (handoff_bus_name);
+  handoff_bus_name = NULL;
+  handed_off = FALSE;
+
   g_assert (manager == NULL);
 
   return ret;
@@ -45,7 +45,12 @@ struct _TpSignalledMessage {
     TpSignalledMessagePrivate *priv;
 };
 
-TpMessage * _tp_signalled_message_new (const GPtrArray *parts,
+TpMessage * _tp_signalled_message_new_without_sender (
+    const GPtrArray *parts);
+void _tp_signalled_message_set_sender (TpMessage *message,
+    TpContact *sender);
+void _tp_signalled_message_set_sender_unknown (TpMessage *message);
+void _tp_signalled_message_resolve_sender (TpMessage *message,
     TpContact *sender);
 
 
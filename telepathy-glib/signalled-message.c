@@ -133,6 +133,10 @@ tp_signalled_message_class_init (TpSignalledMessageClass *klass)
    * A #TpContact representing the sender of the message, if known, or %NULL
    * otherwise.
    *
+   * If tp_text_channel_set_lazy_senders() has been used, this may change
+   * from %NULL to the sender once it has been prepared; the message's
+   * "message-sender-id" header can be used until then.
+   *
    * Since: 0.13.9
    */
   param_spec = g_param_spec_object ("sender", "TpContact",
@@ -155,33 +159,22 @@ tp_signalled_message_init (TpSignalledMessage *self)
 }
 
 /*
- * Create a new TpSignalledMessage.
- *
- * Any message-sender and message-sender-id in parts[0] will be ignored
- * completely: the caller is responsible for interpreting those fields
- * and providing a suitable @sender.
- *
- * The message-sender will be removed from the header, and the
- * message-sender-id will be set to match the #TpContact:identifier of @sender.
- *
- * @sender may be %NULL, which means the message wasn't sent by a contact
- * (this could be used for administrative messages from a chatroom or the
- * server) or we have no idea who sent it.
+ * Create a new TpSignalledMessage whose sender is not yet known, copying
+ * @parts. The message remains mutable until
+ * _tp_signalled_message_set_sender() is called, and must not be given to
+ * the library user before then; until that point, message-sender and
+ * message-sender-id in parts[0] are exactly as they were in @parts.
  */
 TpMessage *
-_tp_signalled_message_new (const GPtrArray *parts,
-    TpContact *sender)
+_tp_signalled_message_new_without_sender (const GPtrArray *parts)
 {
   TpMessage *self;
   guint i;
 
   g_return_val_if_fail (parts != NULL, NULL);
   g_return_val_if_fail (parts->len > 0, NULL);
-  g_return_val_if_fail (sender == NULL || TP_IS_CONTACT (sender), NULL);
 
-  self = g_object_new (TP_TYPE_SIGNALLED_MESSAGE,
-      "sender", sender,
-      NULL);
+  self = g_object_new (TP_TYPE_SIGNALLED_MESSAGE, NULL);
 
   for (i = 0; i < parts->len; i++)
     {
@@ -195,24 +188,93 @@ _tp_signalled_message_new (const GPtrArray *parts,
           (GBoxedCopyFunc) tp_g_value_slice_dup);
     }
 
+  return self;
+}
+
+/*
+ * Set the sender of a message created with
+ * _tp_signalled_message_new_without_sender(), and make it immutable.
+ *
+ * Any message-sender and message-sender-id in parts[0] will be ignored
+ * completely: the caller is responsible for interpreting those fields
+ * and providing a suitable @sender.
+ *
+ * The message-sender will be removed from the header, and the
+ * message-sender-id will be set to match the #TpContact:identifier of @sender.
+ *
+ * @sender may be %NULL, which means the message wasn't sent by a contact
+ * (this could be used for administrative messages from a chatroom or the
+ * server) or we have no idea who sent it.
+ */
+void
+_tp_signalled_message_set_sender (TpMessage *message,
+    TpContact *sender)
+{
+  TpSignalledMessage *self = (TpSignalledMessage *) message;
+
+  g_return_if_fail (TP_IS_SIGNALLED_MESSAGE (message));
+  g_return_if_fail (tp_message_is_mutable (message));
+  g_return_if_fail (sender == NULL || TP_IS_CONTACT (sender));
+  g_return_if_fail (self->priv->sender == NULL);
+
+  if (sender != NULL)
+    self->priv->sender = g_object_ref (sender);
+
   /* This handle may not be persistent, user should use the TpContact
    * directly */
-  tp_message_delete_key (self, 0, "message-sender");
+  tp_message_delete_key (message, 0, "message-sender");
 
   /* override any message-sender-id that the message might have had */
   if (sender == NULL)
     {
-      tp_message_delete_key (self, 0, "message-sender-id");
+      tp_message_delete_key (message, 0, "message-sender-id");
     }
   else
     {
-      tp_message_set_string (self, 0, "message-sender-id",
+      tp_message_set_string (message, 0, "message-sender-id",
           tp_contact_get_identifier (sender));
     }
 
-  _tp_message_set_immutable (self);
+  _tp_message_set_immutable (message);
+}
 
-  return self;
+/*
+ * Make a message created with _tp_signalled_message_new_without_sender()
+ * immutable while its sender is still being prepared. The message-sender
+ * is removed from the header, but the message-sender-id from the connection
+ * manager is kept, so the library user can tell who sent the message until
+ * _tp_signalled_message_resolve_sender() is called.
+ */
+void
+_tp_signalled_message_set_sender_unknown (TpMessage *message)
+{
+  g_return_if_fail (TP_IS_SIGNALLED_MESSAGE (message));
+  g_return_if_fail (tp_message_is_mutable (message));
+
+  /* This handle may not be persistent, user should use the TpContact
+   * directly */
+  tp_message_delete_key (message, 0, "message-sender");
+
+  _tp_message_set_immutable (message);
+}
+
+/*
+ * Set the sender of a message previously passed to
+ * _tp_signalled_message_set_sender_unknown(), once it has been prepared.
+ */
+void
+_tp_signalled_message_resolve_sender (TpMessage *message,
+    TpContact *sender)
+{
+  TpSignalledMessage *self = (TpSignalledMessage *) message;
+
+  g_return_if_fail (TP_IS_SIGNALLED_MESSAGE (message));
+  g_return_if_fail (!tp_message_is_mutable (message));
+  g_return_if_fail (TP_IS_CONTACT (sender));
+  g_return_if_fail (self->priv->sender == NULL);
+
+  self->priv->sender = g_object_ref (sender);
+  g_object_notify ((GObject *) self, "sender");
 }
 
 /**
@@ -238,6 +300,30 @@ tp_signalled_message_get_sender (TpMessage *message)
   return self->priv->sender;
 }
 
+/**
+ * tp_signalled_message_peek_text:
+ * @message: a #TpSignalledMessage
+ * @out_flags: (out) (allow-none): if not %NULL, the
+ *  #TpChannelTextMessageFlags of @message
+ *
+ * The same as tp_message_to_text(), but without copying the text. It is
+ * only worked out the first time it is needed, however many times it is
+ * used.
+ *
+ * Returns: (transfer none): the text content of @message, which is valid
+ *  for as long as @message is
+ *
+ * Since: 0.UNRELEASED
+ */
+const gchar *
+tp_signalled_message_peek_text (TpMessage *message,
+    TpChannelTextMessageFlags *out_flags)
+{
+  g_return_val_if_fail (TP_IS_SIGNALLED_MESSAGE (message), NULL);
+
+  return _tp_message_peek_text (message, out_flags);
+}
+
 guint
 _tp_signalled_message_get_pending_message_id (TpMessage *message,
     gboolean *valid)
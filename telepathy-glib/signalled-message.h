@@ -46,6 +46,10 @@ GType tp_signalled_message_get_type (void);
 
 TpContact * tp_signalled_message_get_sender (TpMessage *message);
 
+_TP_AVAILABLE_IN_UNRELEASED
+const gchar * tp_signalled_message_peek_text (TpMessage *message,
+    TpChannelTextMessageFlags *out_flags);
+
 G_END_DECLS
 
 #endif /* __TP_SIGNALLED_MESSAGE_H__ */
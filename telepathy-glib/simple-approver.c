@@ -58,6 +58,14 @@
  * ]|
  *
  * See examples/client/text-approver.c for a complete example.
+ *
+ * An approver that accepts channels without asking the user can keep the
+ * dispatch operations it is given, accept their contexts, and pass them
+ * all to tp_channel_dispatch_operation_handle_many_with_async() or
+ * tp_channel_dispatch_operation_claim_many_with_async() together, rather
+ * than waiting for each one to be handled in turn. The features of the
+ * account and connection are only prepared for the first dispatch
+ * operation on each of them, and shared by the rest.
  */
 
 /**
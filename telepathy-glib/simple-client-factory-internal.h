@@ -29,6 +29,9 @@ G_BEGIN_DECLS
 void _tp_simple_client_factory_insert_proxy (TpSimpleClientFactory *self,
     gpointer proxy);
 
+gboolean _tp_simple_client_factory_get_introspection_cache_enabled (
+    TpSimpleClientFactory *self);
+
 TpChannelRequest *_tp_simple_client_factory_ensure_channel_request (
     TpSimpleClientFactory *self,
     const gchar *object_path,
@@ -45,6 +48,7 @@ _tp_simple_client_factory_ensure_channel_dispatch_operation (
 TpAccount *_tp_account_new_with_factory (TpSimpleClientFactory *factory,
     TpDBusDaemon *bus_daemon,
     const gchar *object_path,
+    const GHashTable *immutable_properties,
     GError **error);
 
 TpConnection *_tp_connection_new_with_factory (TpSimpleClientFactory *factory,
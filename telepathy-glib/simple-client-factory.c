@@ -126,15 +126,33 @@
 #include "telepathy-glib/simple-client-factory-internal.h"
 #include "telepathy-glib/util-internal.h"
 
+/* Each kind of proxy has its own cache, so that lookups in a client with
+ * thousands of channels don't have to wade through them to find an
+ * account, and so that asking for a channel can never return a proxy of
+ * some other type which happens to have the same object path. Contacts are
+ * not here: they're cached per-connection, by handle. */
+typedef enum
+{
+  CACHE_ACCOUNTS,
+  CACHE_CONNECTIONS,
+  CACHE_CHANNELS,
+  CACHE_CHANNEL_REQUESTS,
+  CACHE_CHANNEL_DISPATCH_OPERATIONS,
+  /* anything else that was created with us as its factory */
+  CACHE_OTHER,
+  N_CACHES
+} ProxyCache;
+
 struct _TpSimpleClientFactoryPrivate
 {
   TpDBusDaemon *dbus;
-  /* Owned object-path -> weakref to TpProxy */
-  GHashTable *proxy_cache;
+  /* Borrowed object-path (owned by the proxy) -> weakref to TpProxy */
+  GHashTable *proxy_caches[N_CACHES];
   GArray *desired_account_features;
   GArray *desired_connection_features;
   GArray *desired_channel_features;
   GArray *desired_contact_features;
+  gboolean introspection_cache_enabled;
 };
 
 enum
@@ -145,6 +163,23 @@ enum
 
 G_DEFINE_TYPE (TpSimpleClientFactory, tp_simple_client_factory, G_TYPE_OBJECT)
 
+static ProxyCache
+cache_for_proxy (gpointer proxy)
+{
+  if (TP_IS_CHANNEL (proxy))
+    return CACHE_CHANNELS;
+  else if (TP_IS_CONNECTION (proxy))
+    return CACHE_CONNECTIONS;
+  else if (TP_IS_ACCOUNT (proxy))
+    return CACHE_ACCOUNTS;
+  else if (TP_IS_CHANNEL_REQUEST (proxy))
+    return CACHE_CHANNEL_REQUESTS;
+  else if (TP_IS_CHANNEL_DISPATCH_OPERATION (proxy))
+    return CACHE_CHANNEL_DISPATCH_OPERATIONS;
+  else
+    return CACHE_OTHER;
+}
+
 static void
 proxy_invalidated_cb (TpProxy *proxy,
     guint domain,
@@ -152,8 +187,12 @@ proxy_invalidated_cb (TpProxy *proxy,
     gchar *message,
     TpSimpleClientFactory *self)
 {
-  g_hash_table_remove (self->priv->proxy_cache,
-      tp_proxy_get_object_path (proxy));
+  GHashTable *cache = self->priv->proxy_caches[cache_for_proxy (proxy)];
+  const gchar *object_path = tp_proxy_get_object_path (proxy);
+
+  /* don't remove a newer proxy that has replaced this one */
+  if (g_hash_table_lookup (cache, object_path) == proxy)
+    g_hash_table_remove (cache, object_path);
 }
 
 static void
@@ -163,7 +202,7 @@ insert_proxy (TpSimpleClientFactory *self,
   if (proxy == NULL)
     return;
 
-  g_hash_table_insert (self->priv->proxy_cache,
+  g_hash_table_insert (self->priv->proxy_caches[cache_for_proxy (proxy)],
       (gpointer) tp_proxy_get_object_path (proxy), proxy);
 
   /* This assume that invalidated signal is emitted from TpProxy dispose. May
@@ -174,16 +213,17 @@ insert_proxy (TpSimpleClientFactory *self,
 
 static gpointer
 lookup_proxy (TpSimpleClientFactory *self,
+    ProxyCache which,
     const gchar *object_path)
 {
-  return g_hash_table_lookup (self->priv->proxy_cache, object_path);
+  return g_hash_table_lookup (self->priv->proxy_caches[which], object_path);
 }
 
 void
 _tp_simple_client_factory_insert_proxy (TpSimpleClientFactory *self,
     gpointer proxy)
 {
-  g_return_if_fail (lookup_proxy (self,
+  g_return_if_fail (lookup_proxy (self, cache_for_proxy (proxy),
       tp_proxy_get_object_path (proxy)) == NULL);
 
   insert_proxy (self, proxy);
@@ -192,11 +232,11 @@ _tp_simple_client_factory_insert_proxy (TpSimpleClientFactory *self,
 static TpAccount *
 create_account_impl (TpSimpleClientFactory *self,
     const gchar *object_path,
-    const GHashTable *immutable_properties G_GNUC_UNUSED,
+    const GHashTable *immutable_properties,
     GError **error)
 {
   return _tp_account_new_with_factory (self, self->priv->dbus, object_path,
-      error);
+      immutable_properties, error);
 }
 
 static GArray *
@@ -321,9 +361,13 @@ static void
 tp_simple_client_factory_finalize (GObject *object)
 {
   TpSimpleClientFactory *self = (TpSimpleClientFactory *) object;
+  guint i;
 
   g_clear_object (&self->priv->dbus);
-  tp_clear_pointer (&self->priv->proxy_cache, g_hash_table_unref);
+
+  for (i = 0; i < N_CACHES; i++)
+    tp_clear_pointer (&self->priv->proxy_caches[i], g_hash_table_unref);
+
   tp_clear_pointer (&self->priv->desired_account_features, g_array_unref);
   tp_clear_pointer (&self->priv->desired_connection_features, g_array_unref);
   tp_clear_pointer (&self->priv->desired_channel_features, g_array_unref);
@@ -336,11 +380,13 @@ static void
 tp_simple_client_factory_init (TpSimpleClientFactory *self)
 {
   GQuark feature;
+  guint i;
 
   self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_SIMPLE_CLIENT_FACTORY,
       TpSimpleClientFactoryPrivate);
 
-  self->priv->proxy_cache = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < N_CACHES; i++)
+    self->priv->proxy_caches[i] = g_hash_table_new (g_str_hash, g_str_equal);
 
   self->priv->desired_account_features = g_array_new (TRUE, FALSE,
       sizeof (GQuark));
@@ -450,6 +496,12 @@ tp_simple_client_factory_get_dbus_daemon (TpSimpleClientFactory *self)
  * is responsible for calling tp_proxy_prepare_async() with the desired
  * features (as given by tp_simple_client_factory_dup_account_features()).
  *
+ * If @immutable_properties contains %TP_PROP_ACCOUNT_INTERFACES, it is assumed
+ * to contain all the properties that the account manager's
+ * GetAccountProperties method would return for this account, and a newly
+ * created #TpAccount uses them instead of asking the account for its
+ * properties. #TpAccountManager does this when possible.
+ *
  * This function is rather low-level. tp_account_manager_dup_valid_accounts()
  * and #TpAccountManager::validity-changed are more appropriate for most
  * applications.
@@ -470,7 +522,7 @@ tp_simple_client_factory_ensure_account (TpSimpleClientFactory *self,
   g_return_val_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self), NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  account = lookup_proxy (self, object_path);
+  account = lookup_proxy (self, CACHE_ACCOUNTS, object_path);
   if (account != NULL)
     return g_object_ref (account);
 
@@ -598,7 +650,7 @@ tp_simple_client_factory_ensure_connection (TpSimpleClientFactory *self,
   g_return_val_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self), NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  connection = lookup_proxy (self, object_path);
+  connection = lookup_proxy (self, CACHE_CONNECTIONS, object_path);
   if (connection != NULL)
     return g_object_ref (connection);
 
@@ -690,6 +742,43 @@ tp_simple_client_factory_add_connection_features_varargs (
   va_end (var_args);
 }
 
+/**
+ * tp_simple_client_factory_set_introspection_cache_enabled:
+ * @self: a #TpSimpleClientFactory
+ * @enabled: %TRUE if #TpConnection objects created by @self should share
+ *  what they find out about their connections with other processes
+ *
+ * Once a connection is %TP_CONNECTION_STATUS_CONNECTED, its interfaces,
+ * the interfaces in its #TpConnection:contact-attribute-interfaces and
+ * its #TpConnection:capabilities do not change. If @enabled is %TRUE,
+ * #TpConnection objects created by @self afterwards remember them in a file
+ * in the user's runtime directory, and use what another process wrote there
+ * instead of asking the connection manager again, as long as the
+ * connection still has the same interfaces.
+ *
+ * This is mostly useful for clients that are started while connections
+ * are already online, such as notifiers, loggers and user interfaces.
+ * It is disabled by default.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_simple_client_factory_set_introspection_cache_enabled (
+    TpSimpleClientFactory *self,
+    gboolean enabled)
+{
+  g_return_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self));
+
+  self->priv->introspection_cache_enabled = enabled;
+}
+
+gboolean
+_tp_simple_client_factory_get_introspection_cache_enabled (
+    TpSimpleClientFactory *self)
+{
+  return self->priv->introspection_cache_enabled;
+}
+
 /**
  * tp_simple_client_factory_ensure_channel:
  * @self: a #TpSimpleClientFactory object
@@ -731,7 +820,7 @@ tp_simple_client_factory_ensure_channel (TpSimpleClientFactory *self,
   g_return_val_if_fail (tp_proxy_get_factory (connection) == self, NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  channel = lookup_proxy (self, object_path);
+  channel = lookup_proxy (self, CACHE_CHANNELS, object_path);
   if (channel != NULL)
     return g_object_ref (channel);
 
@@ -873,6 +962,72 @@ tp_simple_client_factory_ensure_contact (TpSimpleClientFactory *self,
   return contact;
 }
 
+/**
+ * tp_simple_client_factory_ensure_contacts:
+ * @self: a #TpSimpleClientFactory object
+ * @connection: a #TpConnection whose #TpProxy:factory is this object
+ * @n_contacts: the number of contacts in @handles and @identifiers
+ * @handles: (array length=n_contacts): the contacts' handles
+ * @identifiers: (array length=n_contacts): the contacts' identifiers, in
+ *  the same order as @handles
+ *
+ * The same as calling tp_simple_client_factory_ensure_contact() for each
+ * element of @handles and @identifiers, but more efficient when there are
+ * many contacts, for instance when a large contact list arrives.
+ *
+ * Returns: (transfer full) (element-type TelepathyGLib.Contact): a new
+ *  #GPtrArray containing a reference to a #TpContact for each handle, in
+ *  the same order as @handles
+ *
+ * Since: 0.UNRELEASED
+ */
+GPtrArray *
+tp_simple_client_factory_ensure_contacts (TpSimpleClientFactory *self,
+    TpConnection *connection,
+    guint n_contacts,
+    const TpHandle *handles,
+    const gchar * const *identifiers)
+{
+  TpSimpleClientFactoryClass *klass;
+  GPtrArray *contacts;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self), NULL);
+  g_return_val_if_fail (TP_IS_CONNECTION (connection), NULL);
+  g_return_val_if_fail (tp_proxy_get_factory (connection) == self, NULL);
+  g_return_val_if_fail (tp_connection_has_immortal_handles (connection), NULL);
+  g_return_val_if_fail (n_contacts == 0 || handles != NULL, NULL);
+  g_return_val_if_fail (n_contacts == 0 || identifiers != NULL, NULL);
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      g_return_val_if_fail (handles[i] != 0, NULL);
+      g_return_val_if_fail (identifiers[i] != NULL, NULL);
+    }
+
+  klass = TP_SIMPLE_CLIENT_FACTORY_GET_CLASS (self);
+  contacts = g_ptr_array_new_full (n_contacts, g_object_unref);
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      TpContact *contact;
+
+      contact = tp_connection_dup_contact_if_possible (connection,
+          handles[i], identifiers[i]);
+
+      if (contact == NULL)
+        {
+          contact = klass->create_contact (self, connection, handles[i],
+              identifiers[i]);
+          _tp_connection_add_contact (connection, handles[i], contact);
+        }
+
+      g_ptr_array_add (contacts, contact);
+    }
+
+  return contacts;
+}
+
 static void
 upgrade_contacts_cb (GObject *source,
     GAsyncResult *result,
@@ -1188,7 +1343,7 @@ _tp_simple_client_factory_ensure_channel_request (TpSimpleClientFactory *self,
   g_return_val_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self), NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  request = lookup_proxy (self, object_path);
+  request = lookup_proxy (self, CACHE_CHANNEL_REQUESTS, object_path);
   if (request != NULL)
     {
       /* A common usage is request_and_handle, in that case EnsureChannel
@@ -1241,7 +1396,8 @@ _tp_simple_client_factory_ensure_channel_dispatch_operation (
   g_return_val_if_fail (TP_IS_SIMPLE_CLIENT_FACTORY (self), NULL);
   g_return_val_if_fail (g_variant_is_object_path (object_path), NULL);
 
-  dispatch = lookup_proxy (self, object_path);
+  dispatch = lookup_proxy (self, CACHE_CHANNEL_DISPATCH_OPERATIONS,
+      object_path);
   if (dispatch != NULL)
     return g_object_ref (dispatch);
 
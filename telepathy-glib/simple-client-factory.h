@@ -152,6 +152,10 @@ void tp_simple_client_factory_add_connection_features_varargs (
     TpSimpleClientFactory *self,
     GQuark feature,
     ...);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_simple_client_factory_set_introspection_cache_enabled (
+    TpSimpleClientFactory *self,
+    gboolean enabled);
 
 /* TpChannel */
 _TP_AVAILABLE_IN_0_16
@@ -179,6 +183,13 @@ TpContact *tp_simple_client_factory_ensure_contact (TpSimpleClientFactory *self,
     TpConnection *connection,
     TpHandle handle,
     const gchar *identifier);
+_TP_AVAILABLE_IN_UNRELEASED
+GPtrArray *tp_simple_client_factory_ensure_contacts (
+    TpSimpleClientFactory *self,
+    TpConnection *connection,
+    guint n_contacts,
+    const TpHandle *handles,
+    const gchar * const *identifiers);
 _TP_AVAILABLE_IN_0_20
 void tp_simple_client_factory_upgrade_contacts_async (
     TpSimpleClientFactory *self,
@@ -138,6 +138,54 @@ conn_waiting_sig_free (ConnWaitingSig *c)
   g_slice_free (ConnWaitingSig, c);
 }
 
+static void
+conn_waiting_sig_queue_free (GQueue *queue)
+{
+  g_queue_free_full (queue, (GDestroyNotify) conn_waiting_sig_free);
+}
+
+static void
+sig_waiting_conn_queue_free (GQueue *queue)
+{
+  g_queue_free_full (queue, (GDestroyNotify) sig_waiting_conn_free);
+}
+
+/* Append @item to the queue for @key in @table */
+static void
+waiting_push (GHashTable *table,
+    guint key,
+    gpointer item)
+{
+  GQueue *queue = g_hash_table_lookup (table, GUINT_TO_POINTER (key));
+
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (table, GUINT_TO_POINTER (key), queue);
+    }
+
+  g_queue_push_tail (queue, item);
+}
+
+/* Remove and return the oldest item for @key in @table, or NULL */
+static gpointer
+waiting_pop (GHashTable *table,
+    guint key)
+{
+  GQueue *queue = g_hash_table_lookup (table, GUINT_TO_POINTER (key));
+  gpointer item;
+
+  if (queue == NULL)
+    return NULL;
+
+  item = g_queue_pop_head (queue);
+
+  if (g_queue_is_empty (queue))
+    g_hash_table_remove (table, GUINT_TO_POINTER (key));
+
+  return item;
+}
+
 struct _TpStreamTubeChannelPrivate
 {
   GHashTable *parameters;
@@ -147,11 +195,18 @@ struct _TpStreamTubeChannelPrivate
   GSocketAddress *address;
   gchar *unix_tmpdir;
   /* GSocketConnection we have accepted but are still waiting a
-   * NewRemoteConnection to identify them. Owned ConnWaitingSig. */
-  GSList *conn_waiting_sig;
+   * NewRemoteConnection to identify them: match key (see sig_match_key())
+   * => owned GQueue of owned ConnWaitingSig, oldest first. */
+  GHashTable *conn_waiting_sig;
   /* NewRemoteConnection signals we have received but didn't accept their TCP
-   * connection yet. Owned SigWaitingConn. */
-  GSList *sig_waiting_conn;
+   * connection yet: match key => owned GQueue of owned SigWaitingConn,
+   * oldest first. */
+  GHashTable *sig_waiting_conn;
+  /* 0, or the backlog set by tp_stream_tube_channel_set_listen_backlog() */
+  guint listen_backlog;
+
+  /* Both sides: applied to every socket we connect or accept */
+  TpSocketOptions socket_options;
 
   /* Accepting side */
   GSocket *client_socket;
@@ -226,13 +281,8 @@ tp_stream_tube_channel_dispose (GObject *obj)
   tp_clear_object (&self->priv->result);
   tp_clear_pointer (&self->priv->parameters, g_hash_table_unref);
 
-  g_slist_foreach (self->priv->conn_waiting_sig, (GFunc) conn_waiting_sig_free,
-      NULL);
-  tp_clear_pointer (&self->priv->conn_waiting_sig, g_slist_free);
-
-  g_slist_foreach (self->priv->sig_waiting_conn, (GFunc) sig_waiting_conn_free,
-      NULL);
-  tp_clear_pointer (&self->priv->sig_waiting_conn, g_slist_free);
+  tp_clear_pointer (&self->priv->conn_waiting_sig, g_hash_table_unref);
+  tp_clear_pointer (&self->priv->sig_waiting_conn, g_hash_table_unref);
 
   if (self->priv->tube_connections != NULL)
     {
@@ -885,6 +935,7 @@ tp_stream_tube_channel_accept_async (TpStreamTubeChannel *self,
       TP_HASH_TYPE_SUPPORTED_SOCKET_MAP);
 
   if (!_tp_set_socket_address_type_and_access_control_type (supported_sockets,
+      self->priv->socket_options.abstract_unix,
       &self->priv->socket_type, &self->priv->access_control, &error))
     {
       operation_failed (self, error);
@@ -908,6 +959,9 @@ tp_stream_tube_channel_accept_async (TpStreamTubeChannel *self,
       return;
     }
 
+  _tp_socket_apply_options (self->priv->client_socket,
+      &self->priv->socket_options);
+
   switch (self->priv->access_control)
     {
       case TP_SOCKET_ACCESS_CONTROL_LOCALHOST:
@@ -1015,15 +1069,38 @@ _new_remote_connection_with_contact (TpConnection *conn,
   /* anyone receiving the signal is required to hold their own reference */
 }
 
-static gboolean
-sig_match_conn (TpStreamTubeChannel *self,
-    SigWaitingConn *sig,
-    ConnWaitingSig *c)
+/* Connections and NewRemoteConnection signals are matched by a key: the
+ * port the connection comes from with TP_SOCKET_ACCESS_CONTROL_PORT, or the
+ * byte sent with the credentials with TP_SOCKET_ACCESS_CONTROL_CREDENTIALS.
+ * Otherwise we can't tell connections apart, so they all have the same key
+ * and are matched in the order they arrived. */
+static guint
+sig_match_key (TpStreamTubeChannel *self,
+    SigWaitingConn *sig)
 {
   if (self->priv->access_control == TP_SOCKET_ACCESS_CONTROL_PORT)
     {
-      /* Use the port to identify the connection */
       guint port;
+
+      dbus_g_type_struct_get (sig->param, 1, &port, G_MAXINT);
+      return port;
+    }
+  else if (self->priv->access_control == TP_SOCKET_ACCESS_CONTROL_CREDENTIALS)
+    {
+      return g_value_get_uchar (sig->param);
+    }
+
+  return 0;
+}
+
+/* Returns FALSE if we can't tell which signal @c would match */
+static gboolean
+conn_match_key (TpStreamTubeChannel *self,
+    ConnWaitingSig *c,
+    guint *key)
+{
+  if (self->priv->access_control == TP_SOCKET_ACCESS_CONTROL_PORT)
+    {
       GSocketAddress *address;
       GError *error = NULL;
 
@@ -1036,38 +1113,24 @@ sig_match_conn (TpStreamTubeChannel *self,
           return FALSE;
         }
 
-      dbus_g_type_struct_get (sig->param, 1, &port, G_MAXINT);
-
-      if (port == g_inet_socket_address_get_port (
-            G_INET_SOCKET_ADDRESS (address)))
-        {
-          DEBUG ("Identified connection %u using port %u",
-              port, sig->connection_id);
-
-          g_object_unref (address);
-          return TRUE;
-        }
+      *key = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address));
 
       g_object_unref (address);
     }
   else if (self->priv->access_control == TP_SOCKET_ACCESS_CONTROL_CREDENTIALS)
     {
-      guchar byte;
-
-      byte = g_value_get_uchar (sig->param);
-
-      return byte == c->byte;
+      *key = c->byte;
     }
   else
     {
       DEBUG ("Can't properly identify connection as we are using "
-          "access control %u. Assume it's the head of the list",
+          "access control %u. Assume it's the oldest one",
           self->priv->access_control);
 
-      return TRUE;
+      *key = 0;
     }
 
-  return FALSE;
+  return TRUE;
 }
 
 static gboolean
@@ -1173,9 +1236,9 @@ _new_remote_connection (TpChannel *channel,
     GObject *obj)
 {
   TpStreamTubeChannel *self = (TpStreamTubeChannel *) obj;
-  GSList *l;
-  ConnWaitingSig *found_conn = NULL;
+  ConnWaitingSig *found_conn;
   SigWaitingConn *sig;
+  guint key;
   TpHandle chan_handle;
   TpHandleType handle_type;
   gboolean rejected = FALSE;
@@ -1192,31 +1255,22 @@ _new_remote_connection (TpChannel *channel,
     }
 
   sig = sig_waiting_conn_new (handle, param, connection_id, rejected);
+  key = sig_match_key (self, sig);
 
-  for (l = self->priv->conn_waiting_sig; l != NULL && found_conn == NULL;
-      l = g_slist_next (l))
-    {
-      ConnWaitingSig *conn = l->data;
-
-      if (sig_match_conn (self, sig, conn))
-        found_conn = conn;
-
-    }
+  found_conn = waiting_pop (self->priv->conn_waiting_sig, key);
 
   if (found_conn == NULL)
     {
       DEBUG ("Didn't find any connection for %u. Waiting for more",
           connection_id);
 
-      /* Pass ownership of sig to the list */
-      self->priv->sig_waiting_conn = g_slist_append (
-          self->priv->sig_waiting_conn, sig);
+      /* Pass ownership of sig to the table */
+      waiting_push (self->priv->sig_waiting_conn, key, sig);
       return;
     }
 
   /* We found a connection */
-  self->priv->conn_waiting_sig = g_slist_remove (
-      self->priv->conn_waiting_sig, found_conn);
+  DEBUG ("Identified connection %u using key %u", connection_id, key);
 
   if (rejected)
     connection_rejected (self, found_conn->conn, handle, connection_id);
@@ -1298,23 +1352,6 @@ finally:
     tp_g_value_slice_free (addressv);
 }
 
-static SigWaitingConn *
-find_sig_for_conn (TpStreamTubeChannel *self,
-    ConnWaitingSig *c)
-{
-  GSList *l;
-
-  for (l = self->priv->sig_waiting_conn; l != NULL; l = g_slist_next (l))
-    {
-      SigWaitingConn *sig = l->data;
-
-      if (sig_match_conn (self, sig, c))
-        return sig;
-    }
-
-  return NULL;
-}
-
 static void
 credentials_received (TpStreamTubeChannel *self,
     GSocketConnection *conn,
@@ -1322,24 +1359,30 @@ credentials_received (TpStreamTubeChannel *self,
 {
   SigWaitingConn *sig;
   ConnWaitingSig *c;
+  guint key;
 
   c = conn_waiting_sig_new (conn, byte);
 
-  sig = find_sig_for_conn (self, c);
+  if (!conn_match_key (self, c, &key))
+    {
+      /* It will never match anything */
+      conn_waiting_sig_free (c);
+      return;
+    }
+
+  sig = waiting_pop (self->priv->sig_waiting_conn, key);
   if (sig == NULL)
     {
       DEBUG ("Can't identify the connection, wait for NewRemoteConnection sig");
 
-      /* Pass ownership to the list */
-      self->priv->conn_waiting_sig = g_slist_append (
-          self->priv->conn_waiting_sig, c);
+      /* Pass ownership to the table */
+      waiting_push (self->priv->conn_waiting_sig, key, c);
 
       return;
     }
 
   /* Connection has been identified */
-  self->priv->sig_waiting_conn = g_slist_remove (self->priv->sig_waiting_conn,
-      sig);
+  DEBUG ("Identified connection %u using key %u", sig->connection_id, key);
 
   if (sig->rejected)
     connection_rejected (self, conn, sig->handle, sig->connection_id);
@@ -1396,6 +1439,9 @@ service_incoming_cb (GSocketService *service,
 
   DEBUG ("New incoming connection");
 
+  _tp_socket_apply_options (g_socket_connection_get_socket (conn),
+      &self->priv->socket_options);
+
 #ifdef HAVE_GIO_UNIX
   /* Check the credentials if needed */
   if (self->priv->access_control == TP_SOCKET_ACCESS_CONTROL_CREDENTIALS)
@@ -1455,6 +1501,7 @@ tp_stream_tube_channel_offer_async (TpStreamTubeChannel *self,
       TP_HASH_TYPE_SUPPORTED_SOCKET_MAP);
 
   if (!_tp_set_socket_address_type_and_access_control_type (supported_sockets,
+      self->priv->socket_options.abstract_unix,
       &self->priv->socket_type, &self->priv->access_control, &error))
     {
       operation_failed (self, error);
@@ -1467,6 +1514,15 @@ tp_stream_tube_channel_offer_async (TpStreamTubeChannel *self,
       self->priv->access_control);
 
   self->priv->service = g_socket_service_new ();
+  self->priv->conn_waiting_sig = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) conn_waiting_sig_queue_free);
+  self->priv->sig_waiting_conn = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) sig_waiting_conn_queue_free);
+
+  /* This only affects sockets added after it's set */
+  if (self->priv->listen_backlog != 0)
+    g_socket_listener_set_backlog (G_SOCKET_LISTENER (self->priv->service),
+        self->priv->listen_backlog);
 
   switch (self->priv->socket_type)
     {
@@ -1486,6 +1542,22 @@ tp_stream_tube_channel_offer_async (TpStreamTubeChannel *self,
             }
         }
 
+        break;
+
+      case TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX:
+        {
+          self->priv->address = _tp_create_abstract_unix_socket (
+              self->priv->service, &error);
+
+          if (self->priv->address == NULL)
+            {
+              operation_failed (self, error);
+
+              g_clear_error (&error);
+              return;
+            }
+        }
+
         break;
 #endif /* HAVE_GIO_UNIX */
 
@@ -1533,6 +1605,99 @@ tp_stream_tube_channel_offer_async (TpStreamTubeChannel *self,
   _offer_with_address (self, params);
 }
 
+/**
+ * tp_stream_tube_channel_set_listen_backlog:
+ * @self: an outgoing #TpStreamTubeChannel
+ * @backlog: the maximum number of connections to the tube waiting to be
+ *  accepted, or 0 to use GIO's default
+ *
+ * Set how many connections from the connection manager can be waiting to
+ * be accepted by the local socket before new ones are refused, as with
+ * g_socket_listener_set_backlog(). Tubes which many contacts connect to at
+ * the same time may need more than the default.
+ *
+ * This must be called before tp_stream_tube_channel_offer_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_channel_set_listen_backlog (TpStreamTubeChannel *self,
+    guint backlog)
+{
+  g_return_if_fail (TP_IS_STREAM_TUBE_CHANNEL (self));
+  g_return_if_fail (self->priv->service == NULL);
+
+  self->priv->listen_backlog = backlog;
+}
+
+/**
+ * tp_stream_tube_channel_set_socket_options:
+ * @self: a #TpStreamTubeChannel
+ * @send_buffer_size: the send buffer size for each socket (SO_SNDBUF), or 0
+ *  to use the system's default
+ * @receive_buffer_size: the receive buffer size for each socket
+ *  (SO_RCVBUF), or 0 to use the system's default
+ * @no_delay: if %TRUE, disable Nagle's algorithm (TCP_NODELAY)
+ * @keepalive: if %TRUE, enable TCP keepalives (SO_KEEPALIVE)
+ *
+ * Tune the sockets between this process and the connection manager: the
+ * one connected by tp_stream_tube_channel_accept_async(), or each one
+ * accepted after tp_stream_tube_channel_offer_async(). Larger buffers help
+ * tubes carrying bulk data; @no_delay helps interactive protocols. @no_delay
+ * and @keepalive only apply to IPv4 and IPv6 sockets.
+ *
+ * Options which the system refuses are ignored. This must be called before
+ * tp_stream_tube_channel_accept_async() or
+ * tp_stream_tube_channel_offer_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_channel_set_socket_options (TpStreamTubeChannel *self,
+    gint send_buffer_size,
+    gint receive_buffer_size,
+    gboolean no_delay,
+    gboolean keepalive)
+{
+  g_return_if_fail (TP_IS_STREAM_TUBE_CHANNEL (self));
+  g_return_if_fail (send_buffer_size >= 0);
+  g_return_if_fail (receive_buffer_size >= 0);
+  g_return_if_fail (self->priv->service == NULL);
+  g_return_if_fail (self->priv->client_socket == NULL);
+
+  self->priv->socket_options.send_buffer_size = send_buffer_size;
+  self->priv->socket_options.receive_buffer_size = receive_buffer_size;
+  self->priv->socket_options.no_delay = no_delay;
+  self->priv->socket_options.keepalive = keepalive;
+}
+
+/**
+ * tp_stream_tube_channel_set_use_abstract_unix:
+ * @self: a #TpStreamTubeChannel
+ * @use_abstract_unix: if %TRUE, prefer %TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX
+ *
+ * If @use_abstract_unix is %TRUE and both this platform and the connection
+ * manager support it, use a Unix socket in the abstract namespace instead
+ * of one in a temporary directory, so that nothing needs to be created on
+ * (or removed from) the filesystem. Otherwise, the usual socket type is
+ * used.
+ *
+ * This must be called before tp_stream_tube_channel_accept_async() or
+ * tp_stream_tube_channel_offer_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_channel_set_use_abstract_unix (TpStreamTubeChannel *self,
+    gboolean use_abstract_unix)
+{
+  g_return_if_fail (TP_IS_STREAM_TUBE_CHANNEL (self));
+  g_return_if_fail (self->priv->service == NULL);
+  g_return_if_fail (self->priv->client_socket == NULL);
+
+  self->priv->socket_options.abstract_unix = use_abstract_unix;
+}
+
 /**
  * tp_stream_tube_channel_offer_finish:
  * @self: a #TpStreamTubeChannel
@@ -26,6 +26,7 @@
 #define __TP_STREAM_TUBE_CHANNEL_H__
 
 #include <telepathy-glib/channel.h>
+#include <telepathy-glib/defs.h>
 
 G_BEGIN_DECLS
 
@@ -95,6 +96,21 @@ gboolean tp_stream_tube_channel_offer_finish (TpStreamTubeChannel *self,
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_channel_set_listen_backlog (TpStreamTubeChannel *self,
+    guint backlog);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_channel_set_socket_options (TpStreamTubeChannel *self,
+    gint send_buffer_size,
+    gint receive_buffer_size,
+    gboolean no_delay,
+    gboolean keepalive);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_channel_set_use_abstract_unix (TpStreamTubeChannel *self,
+    gboolean use_abstract_unix);
+
 G_END_DECLS
 
 #endif
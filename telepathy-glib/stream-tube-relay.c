@@ -0,0 +1,1110 @@
+/*
+ * Relaying a Stream Tube connection to another stream
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:stream-tube-relay
+ * @title: TpStreamTubeRelay
+ * @short_description: copy data between a Stream Tube connection and
+ *  another stream
+ *
+ * A #TpStreamTubeRelay copies everything received on a
+ * #TpStreamTubeConnection to another #GIOStream, such as a connection to a
+ * local service or one end of a pipe to a child process, and everything
+ * received on that stream back to the tube, until both sides have been
+ * closed.
+ *
+ * At most #TpStreamTubeRelay:buffer-size bytes are held for each direction
+ * at any time: nothing more is read from one side until what was read has
+ * been written to the other, so a slow reader slows down the writer rather
+ * than making the relay buffer without limit.
+ *
+ * On Linux, when both sides are sockets, data is moved between them inside
+ * the kernel with splice(2), without being copied through user space.
+ *
+ * Alternatively, the relay can share a rate limit with other transfers by
+ * copying through a #TpTransferScheduler: see
+ * tp_stream_tube_relay_set_scheduler().
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpStreamTubeRelay:
+ *
+ * Data structure representing a relay between a #TpStreamTubeConnection
+ * and another stream.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpStreamTubeRelayClass:
+ *
+ * The class of a #TpStreamTubeRelay.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/* for splice(2) */
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include "telepathy-glib/stream-tube-relay.h"
+
+#include <telepathy-glib/util.h>
+#include <telepathy-glib/util-internal.h>
+
+#define DEBUG_FLAG TP_DEBUG_CHANNEL
+#include "telepathy-glib/debug-internal.h"
+
+#if defined (HAVE_GIO_UNIX) && defined (HAVE_SPLICE)
+#define USE_SPLICE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#endif
+
+#define DEFAULT_BUFFER_SIZE (64 * 1024)
+
+/* the most splice() calls made for one direction before going back to the
+ * main loop, so that a fast peer can't starve everything else */
+#define MAX_SPLICE_ROUNDS 16
+
+struct _TpStreamTubeRelayClass {
+    /*<private>*/
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (TpStreamTubeRelay, tp_stream_tube_relay, G_TYPE_OBJECT)
+
+enum {
+    PROP_TUBE_CONNECTION = 1,
+    PROP_STREAM,
+    PROP_BUFFER_SIZE,
+    PROP_BYTES_FROM_TUBE,
+    PROP_BYTES_TO_TUBE,
+    N_PROPS
+};
+
+/* One half of the relay, copying from @in to @out */
+typedef struct
+{
+  TpStreamTubeRelay *self;
+  GInputStream *in;
+  GOutputStream *out;
+  /* the sockets underlying @in and @out, if they are GSocketConnections */
+  GSocket *in_socket;
+  GSocket *out_socket;
+  guint64 *counter;
+  /* TRUE while @in is being copied by a TpTransferScheduler */
+  gboolean scheduled;
+
+  /* copying through GIO: @len bytes were read into @buffer, of which
+   * @written have been written so far */
+  guint8 *buffer;
+  gsize len;
+  gsize written;
+
+#ifdef USE_SPLICE
+  gint pipe_fds[2];
+  /* bytes which have been spliced into the pipe but not out of it yet */
+  gsize in_pipe;
+  gboolean eof;
+  GSource *source;
+#endif
+} Direction;
+
+struct _TpStreamTubeRelayPrivate
+{
+  TpStreamTubeConnection *tube_connection;
+  GIOStream *stream;
+  gsize buffer_size;
+
+  /* set by tp_stream_tube_relay_set_scheduler(), or NULL */
+  TpTransferScheduler *scheduler;
+  guint scheduler_weight;
+  /* set by tp_stream_tube_relay_set_paused() */
+  gboolean paused;
+
+  guint64 bytes_from_tube;
+  guint64 bytes_to_tube;
+
+  /* non-NULL while running */
+  GSimpleAsyncResult *result;
+  GCancellable *cancellable;
+  GCancellable *user_cancellable;
+  gulong cancelled_id;
+  GError *error;
+  /* directions still copying, or streams still being closed */
+  guint n_pending;
+
+  Direction from_tube;
+  Direction to_tube;
+};
+
+static void
+tp_stream_tube_relay_init (TpStreamTubeRelay *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      TP_TYPE_STREAM_TUBE_RELAY, TpStreamTubeRelayPrivate);
+
+  self->priv->buffer_size = DEFAULT_BUFFER_SIZE;
+}
+
+static void
+tp_stream_tube_relay_dispose (GObject *object)
+{
+  TpStreamTubeRelay *self = TP_STREAM_TUBE_RELAY (object);
+  void (*dispose) (GObject *) =
+    G_OBJECT_CLASS (tp_stream_tube_relay_parent_class)->dispose;
+
+  /* a running relay holds a reference to itself */
+  g_assert (self->priv->result == NULL);
+
+  tp_clear_object (&self->priv->tube_connection);
+  tp_clear_object (&self->priv->stream);
+  tp_clear_object (&self->priv->scheduler);
+
+  if (dispose != NULL)
+    dispose (object);
+}
+
+static void
+tp_stream_tube_relay_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpStreamTubeRelay *self = TP_STREAM_TUBE_RELAY (object);
+
+  switch (property_id)
+    {
+      case PROP_TUBE_CONNECTION:
+        g_value_set_object (value, self->priv->tube_connection);
+        break;
+      case PROP_STREAM:
+        g_value_set_object (value, self->priv->stream);
+        break;
+      case PROP_BUFFER_SIZE:
+        g_value_set_uint (value, self->priv->buffer_size);
+        break;
+      case PROP_BYTES_FROM_TUBE:
+        g_value_set_uint64 (value, self->priv->bytes_from_tube);
+        break;
+      case PROP_BYTES_TO_TUBE:
+        g_value_set_uint64 (value, self->priv->bytes_to_tube);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_stream_tube_relay_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpStreamTubeRelay *self = TP_STREAM_TUBE_RELAY (object);
+
+  switch (property_id)
+    {
+      case PROP_TUBE_CONNECTION:
+        g_assert (self->priv->tube_connection == NULL); /* construct only */
+        self->priv->tube_connection = g_value_dup_object (value);
+        break;
+      case PROP_STREAM:
+        g_assert (self->priv->stream == NULL); /* construct only */
+        self->priv->stream = g_value_dup_object (value);
+        break;
+      case PROP_BUFFER_SIZE:
+        self->priv->buffer_size = g_value_get_uint (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+  }
+}
+
+static void
+tp_stream_tube_relay_constructed (GObject *object)
+{
+  TpStreamTubeRelay *self = TP_STREAM_TUBE_RELAY (object);
+  void (*chain_up) (GObject *) =
+    ((GObjectClass *) tp_stream_tube_relay_parent_class)->constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  g_assert (TP_IS_STREAM_TUBE_CONNECTION (self->priv->tube_connection));
+  g_assert (G_IS_IO_STREAM (self->priv->stream));
+}
+
+static void
+tp_stream_tube_relay_class_init (TpStreamTubeRelayClass *cls)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (cls);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (cls, sizeof (TpStreamTubeRelayPrivate));
+
+  object_class->get_property = tp_stream_tube_relay_get_property;
+  object_class->set_property = tp_stream_tube_relay_set_property;
+  object_class->constructed = tp_stream_tube_relay_constructed;
+  object_class->dispose = tp_stream_tube_relay_dispose;
+
+  /**
+   * TpStreamTubeRelay:tube-connection:
+   *
+   * The #TpStreamTubeConnection whose data is relayed.
+   * Read-only except during construction.
+   *
+   * This property can't be %NULL.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_object ("tube-connection",
+      "TpStreamTubeConnection",
+      "TpStreamTubeConnection whose data is relayed",
+      TP_TYPE_STREAM_TUBE_CONNECTION,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TUBE_CONNECTION,
+      param_spec);
+
+  /**
+   * TpStreamTubeRelay:stream:
+   *
+   * The #GIOStream to which the data received on
+   * #TpStreamTubeRelay:tube-connection is written, and from which the data
+   * sent on it is read. Read-only except during construction.
+   *
+   * This property can't be %NULL.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_object ("stream", "GIOStream",
+      "GIOStream to which the tube connection is relayed",
+      G_TYPE_IO_STREAM,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_STREAM, param_spec);
+
+  /**
+   * TpStreamTubeRelay:buffer-size:
+   *
+   * The most bytes held by the relay for each direction. Changing it only
+   * has an effect before tp_stream_tube_relay_run_async() is called.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_uint ("buffer-size", "Buffer size",
+      "Most bytes held by the relay for each direction",
+      1, G_MAXINT, DEFAULT_BUFFER_SIZE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_BUFFER_SIZE,
+      param_spec);
+
+  /**
+   * TpStreamTubeRelay:bytes-from-tube:
+   *
+   * The number of bytes received on #TpStreamTubeRelay:tube-connection and
+   * written to #TpStreamTubeRelay:stream so far. Change notification is not
+   * emitted for this property. When using a #TpTransferScheduler, this is
+   * only updated once this direction has finished.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_uint64 ("bytes-from-tube", "Bytes from tube",
+      "Bytes relayed from the tube connection to the stream",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_BYTES_FROM_TUBE,
+      param_spec);
+
+  /**
+   * TpStreamTubeRelay:bytes-to-tube:
+   *
+   * The number of bytes read from #TpStreamTubeRelay:stream and sent on
+   * #TpStreamTubeRelay:tube-connection so far. Change notification is not
+   * emitted for this property. When using a #TpTransferScheduler, this is
+   * only updated once this direction has finished.
+   *
+   * Since: 0.UNRELEASED
+   */
+  param_spec = g_param_spec_uint64 ("bytes-to-tube", "Bytes to tube",
+      "Bytes relayed from the stream to the tube connection",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_BYTES_TO_TUBE,
+      param_spec);
+}
+
+/**
+ * tp_stream_tube_relay_new:
+ * @tube_connection: a #TpStreamTubeConnection
+ * @stream: the #GIOStream to relay @tube_connection to
+ *
+ * Create a relay between @tube_connection and @stream. Nothing is copied
+ * until tp_stream_tube_relay_run_async() is called.
+ *
+ * Returns: (transfer full): a new #TpStreamTubeRelay
+ *
+ * Since: 0.UNRELEASED
+ */
+TpStreamTubeRelay *
+tp_stream_tube_relay_new (TpStreamTubeConnection *tube_connection,
+    GIOStream *stream)
+{
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_CONNECTION (tube_connection),
+      NULL);
+  g_return_val_if_fail (G_IS_IO_STREAM (stream), NULL);
+
+  return g_object_new (TP_TYPE_STREAM_TUBE_RELAY,
+      "tube-connection", tube_connection,
+      "stream", stream,
+      NULL);
+}
+
+/**
+ * tp_stream_tube_relay_new_for_fd:
+ * @tube_connection: a #TpStreamTubeConnection
+ * @fd: a connected socket
+ * @error: used to raise an error if @fd is not a socket
+ *
+ * Create a relay between @tube_connection and the socket @fd, which the
+ * relay takes ownership of: it will be closed when the relay has finished,
+ * or when the relay is freed without having been run.
+ *
+ * Returns: (transfer full): a new #TpStreamTubeRelay, or %NULL if @error
+ *  is set
+ *
+ * Since: 0.UNRELEASED
+ */
+TpStreamTubeRelay *
+tp_stream_tube_relay_new_for_fd (TpStreamTubeConnection *tube_connection,
+    gint fd,
+    GError **error)
+{
+  GSocket *socket;
+  GSocketConnection *connection;
+  TpStreamTubeRelay *self;
+
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_CONNECTION (tube_connection),
+      NULL);
+  g_return_val_if_fail (fd >= 0, NULL);
+
+  socket = g_socket_new_from_fd (fd, error);
+
+  if (socket == NULL)
+    return NULL;
+
+  connection = g_socket_connection_factory_create_connection (socket);
+  self = tp_stream_tube_relay_new (tube_connection, G_IO_STREAM (connection));
+
+  g_object_unref (connection);
+  g_object_unref (socket);
+  return self;
+}
+
+static GSocket *
+get_socket (GIOStream *stream)
+{
+  if (G_IS_SOCKET_CONNECTION (stream))
+    return g_socket_connection_get_socket (G_SOCKET_CONNECTION (stream));
+
+  return NULL;
+}
+
+static void
+relay_set_error (TpStreamTubeRelay *self,
+    GError *error)
+{
+  /* the first error is the interesting one: the others are usually caused
+   * by our cancelling the other direction because of it */
+  if (self->priv->error == NULL)
+    {
+      DEBUG ("stopping relay: %s", error->message);
+      self->priv->error = error;
+      g_cancellable_cancel (self->priv->cancellable);
+    }
+  else
+    {
+      g_error_free (error);
+    }
+}
+
+static void
+relay_complete (TpStreamTubeRelay *self)
+{
+  GSimpleAsyncResult *result = self->priv->result;
+
+  DEBUG ("relay finished: %" G_GUINT64_FORMAT " bytes from tube, %"
+      G_GUINT64_FORMAT " bytes to tube", self->priv->bytes_from_tube,
+      self->priv->bytes_to_tube);
+
+  if (self->priv->error != NULL)
+    {
+      g_simple_async_result_take_error (result, self->priv->error);
+      self->priv->error = NULL;
+    }
+
+  if (self->priv->user_cancellable != NULL)
+    {
+      g_cancellable_disconnect (self->priv->user_cancellable,
+          self->priv->cancelled_id);
+      self->priv->cancelled_id = 0;
+    }
+
+  tp_clear_object (&self->priv->user_cancellable);
+  tp_clear_object (&self->priv->cancellable);
+  self->priv->result = NULL;
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+  /* the reference taken in run_async() */
+  g_object_unref (self);
+}
+
+static void
+stream_closed_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpStreamTubeRelay *self = user_data;
+  GError *error = NULL;
+
+  if (!g_io_stream_close_finish (G_IO_STREAM (source), result, &error))
+    {
+      DEBUG ("Failed to close stream: %s", error->message);
+      g_error_free (error);
+    }
+
+  if (--self->priv->n_pending == 0)
+    relay_complete (self);
+}
+
+static void
+direction_done (Direction *d)
+{
+  TpStreamTubeRelay *self = d->self;
+  GIOStream *tube_stream;
+
+  tp_clear_pointer (&d->buffer, g_free);
+
+#ifdef USE_SPLICE
+  if (d->pipe_fds[0] != -1)
+    {
+      close (d->pipe_fds[0]);
+      close (d->pipe_fds[1]);
+      d->pipe_fds[0] = d->pipe_fds[1] = -1;
+    }
+#endif
+
+  if (--self->priv->n_pending > 0)
+    return;
+
+  /* both directions have finished: we don't need either stream any more */
+  tube_stream = G_IO_STREAM (tp_stream_tube_connection_get_socket_connection (
+        self->priv->tube_connection));
+
+  self->priv->n_pending = 2;
+  g_io_stream_close_async (tube_stream, G_PRIORITY_DEFAULT, NULL,
+      stream_closed_cb, self);
+  g_io_stream_close_async (self->priv->stream, G_PRIORITY_DEFAULT, NULL,
+      stream_closed_cb, self);
+}
+
+static void
+direction_failed (Direction *d,
+    GError *error)
+{
+  relay_set_error (d->self, error);
+  direction_done (d);
+}
+
+static void
+output_closed_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Direction *d = user_data;
+  GError *error = NULL;
+
+  if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), result,
+        &error))
+    {
+      DEBUG ("Failed to close output stream: %s", error->message);
+      g_error_free (error);
+    }
+
+  direction_done (d);
+}
+
+static void
+direction_eof (Direction *d)
+{
+  GError *error = NULL;
+
+  /* Let the other side know there's nothing more to come, while still
+   * relaying whatever it sends in the other direction. Closing a
+   * GSocketConnection's output stream doesn't do anything, so sockets are
+   * shut down instead. */
+  if (d->out_socket == NULL)
+    {
+      g_output_stream_close_async (d->out, G_PRIORITY_DEFAULT, NULL,
+          output_closed_cb, d);
+      return;
+    }
+
+  if (!g_socket_shutdown (d->out_socket, FALSE, TRUE, &error))
+    {
+      DEBUG ("Failed to shut down socket: %s", error->message);
+      g_error_free (error);
+    }
+
+  direction_done (d);
+}
+
+static void direction_copy (Direction *d);
+
+static void
+copy_write_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Direction *d = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+
+  if (n < 0)
+    {
+      direction_failed (d, error);
+      return;
+    }
+
+  d->written += n;
+  *d->counter += n;
+
+  if (d->written < d->len)
+    {
+      g_output_stream_write_async (d->out, d->buffer + d->written,
+          d->len - d->written, G_PRIORITY_DEFAULT, d->self->priv->cancellable,
+          copy_write_cb, d);
+      return;
+    }
+
+  /* only read more once everything has been written */
+  direction_copy (d);
+}
+
+static void
+copy_read_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Direction *d = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (G_INPUT_STREAM (source), result, &error);
+
+  if (n < 0)
+    {
+      direction_failed (d, error);
+      return;
+    }
+
+  if (n == 0)
+    {
+      direction_eof (d);
+      return;
+    }
+
+  d->len = n;
+  d->written = 0;
+  g_output_stream_write_async (d->out, d->buffer, d->len,
+      G_PRIORITY_DEFAULT, d->self->priv->cancellable, copy_write_cb, d);
+}
+
+static void
+direction_copy (Direction *d)
+{
+  if (d->buffer == NULL)
+    d->buffer = g_malloc (d->self->priv->buffer_size);
+
+  g_input_stream_read_async (d->in, d->buffer, d->self->priv->buffer_size,
+      G_PRIORITY_DEFAULT, d->self->priv->cancellable, copy_read_cb, d);
+}
+
+static void
+scheduled_splice_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Direction *d = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = tp_transfer_scheduler_splice_finish (TP_TRANSFER_SCHEDULER (source),
+      result, &error);
+  d->scheduled = FALSE;
+
+  if (n < 0)
+    {
+      direction_failed (d, error);
+      return;
+    }
+
+  *d->counter += n;
+  direction_eof (d);
+}
+
+static void
+direction_schedule (Direction *d)
+{
+  TpStreamTubeRelayPrivate *priv = d->self->priv;
+
+  d->scheduled = TRUE;
+  tp_transfer_scheduler_splice_async (priv->scheduler, d->out, d->in,
+      G_OUTPUT_STREAM_SPLICE_NONE, priv->scheduler_weight,
+      priv->cancellable, scheduled_splice_cb, d);
+
+  if (priv->paused)
+    tp_transfer_scheduler_set_paused (priv->scheduler, d->in, TRUE);
+}
+
+#ifdef USE_SPLICE
+static void direction_splice (Direction *d);
+
+static gboolean
+splice_source_cb (GSocket *socket,
+    GIOCondition condition,
+    gpointer user_data)
+{
+  Direction *d = user_data;
+
+  tp_clear_pointer (&d->source, g_source_unref);
+  direction_splice (d);
+  return FALSE;
+}
+
+static void
+splice_wait (Direction *d,
+    GSocket *socket,
+    GIOCondition condition)
+{
+  /* this also wakes us up if the relay is cancelled */
+  d->source = g_socket_create_source (socket, condition,
+      d->self->priv->cancellable);
+  g_source_set_callback (d->source, (GSourceFunc) splice_source_cb, d, NULL);
+  g_source_attach (d->source, g_main_context_get_thread_default ());
+}
+
+static void
+splice_failed (Direction *d,
+    gint saved_errno)
+{
+  direction_failed (d, g_error_new_literal (G_IO_ERROR,
+        g_io_error_from_errno (saved_errno), g_strerror (saved_errno)));
+}
+
+static void
+direction_splice (Direction *d)
+{
+  gsize buffer_size = d->self->priv->buffer_size;
+  gint in_fd = g_socket_get_fd (d->in_socket);
+  gint out_fd = g_socket_get_fd (d->out_socket);
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < MAX_SPLICE_ROUNDS; i++)
+    {
+      gboolean progress = FALSE;
+      gssize n;
+
+      if (g_cancellable_set_error_if_cancelled (d->self->priv->cancellable,
+            &error))
+        {
+          direction_failed (d, error);
+          return;
+        }
+
+      /* the pipe is our buffer: only read while it has room, so we don't
+       * read faster than the other side accepts */
+      if (!d->eof && d->in_pipe < buffer_size)
+        {
+          n = splice (in_fd, NULL, d->pipe_fds[1], NULL,
+              buffer_size - d->in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+          if (n > 0)
+            {
+              d->in_pipe += n;
+              progress = TRUE;
+            }
+          else if (n == 0)
+            {
+              d->eof = TRUE;
+            }
+          else if (errno == EINVAL && *d->counter == 0 && d->in_pipe == 0)
+            {
+              /* the kernel can't splice from this kind of socket: copy the
+               * data through our own buffer instead */
+              DEBUG ("splice() not supported, falling back to copying");
+              close (d->pipe_fds[0]);
+              close (d->pipe_fds[1]);
+              d->pipe_fds[0] = d->pipe_fds[1] = -1;
+              direction_copy (d);
+              return;
+            }
+          else if (errno != EAGAIN && errno != EINTR)
+            {
+              splice_failed (d, errno);
+              return;
+            }
+        }
+
+      if (d->in_pipe > 0)
+        {
+          n = splice (d->pipe_fds[0], NULL, out_fd, NULL, d->in_pipe,
+              SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+          if (n > 0)
+            {
+              d->in_pipe -= n;
+              *d->counter += n;
+              progress = TRUE;
+            }
+          else if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+              splice_failed (d, errno);
+              return;
+            }
+        }
+
+      if (d->eof && d->in_pipe == 0)
+        {
+          direction_eof (d);
+          return;
+        }
+
+      if (!progress)
+        break;
+    }
+
+  /* Either we're blocked, or we've done enough for one main loop iteration
+   * and the source will fire again straight away. Data in the pipe has to
+   * be written before anything else matters. */
+  if (d->in_pipe > 0)
+    splice_wait (d, d->out_socket, G_IO_OUT);
+  else
+    splice_wait (d, d->in_socket, G_IO_IN);
+}
+
+static gboolean
+direction_start_splice (Direction *d)
+{
+  GError *error = NULL;
+
+  if (d->in_socket == NULL || d->out_socket == NULL)
+    return FALSE;
+
+  if (!g_unix_open_pipe (d->pipe_fds, FD_CLOEXEC, &error))
+    {
+      DEBUG ("Failed to create pipe, falling back to copying: %s",
+          error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+#ifdef F_SETPIPE_SZ
+  /* Best effort: if it fails, the pipe's real capacity bounds how much we
+   * hold instead */
+  fcntl (d->pipe_fds[1], F_SETPIPE_SZ, (gint) d->self->priv->buffer_size);
+#endif
+
+  d->in_pipe = 0;
+  d->eof = FALSE;
+  direction_splice (d);
+  return TRUE;
+}
+#endif /* USE_SPLICE */
+
+static void
+direction_start (Direction *d,
+    TpStreamTubeRelay *self,
+    GIOStream *from,
+    GIOStream *to,
+    guint64 *counter)
+{
+  d->self = self;
+  d->in = g_io_stream_get_input_stream (from);
+  d->out = g_io_stream_get_output_stream (to);
+  d->in_socket = get_socket (from);
+  d->out_socket = get_socket (to);
+  d->counter = counter;
+
+#ifdef USE_SPLICE
+  d->pipe_fds[0] = d->pipe_fds[1] = -1;
+#endif
+
+  if (self->priv->scheduler != NULL)
+    {
+      direction_schedule (d);
+      return;
+    }
+
+#ifdef USE_SPLICE
+  if (direction_start_splice (d))
+    return;
+#endif
+
+  direction_copy (d);
+}
+
+static void
+relay_cancelled_cb (GCancellable *cancellable,
+    gpointer user_data)
+{
+  TpStreamTubeRelay *self = user_data;
+
+  g_cancellable_cancel (self->priv->cancellable);
+}
+
+/**
+ * tp_stream_tube_relay_run_async:
+ * @self: a #TpStreamTubeRelay
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ *  ignore
+ * @callback: a callback to call when the relay has finished
+ * @user_data: data to pass to @callback
+ *
+ * Start copying data in both directions between
+ * #TpStreamTubeRelay:tube-connection and #TpStreamTubeRelay:stream.
+ *
+ * When one side reaches the end of its stream, the other side's output is
+ * shut down, and data keeps flowing in the other direction. Once both
+ * directions have finished, or as soon as either fails or @cancellable is
+ * cancelled, both streams are closed and @callback is called.
+ *
+ * The relay keeps a reference to itself until then, and can only be run
+ * once.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_relay_run_async (TpStreamTubeRelay *self,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  GIOStream *tube_stream;
+
+  g_return_if_fail (TP_IS_STREAM_TUBE_RELAY (self));
+  g_return_if_fail (self->priv->result == NULL);
+  g_return_if_fail (self->priv->from_tube.self == NULL);
+
+  self->priv->result = g_simple_async_result_new (G_OBJECT (self), callback,
+      user_data, tp_stream_tube_relay_run_async);
+  self->priv->cancellable = g_cancellable_new ();
+
+  /* released in relay_complete() */
+  g_object_ref (self);
+
+  if (cancellable != NULL)
+    {
+      self->priv->user_cancellable = g_object_ref (cancellable);
+      self->priv->cancelled_id = g_cancellable_connect (cancellable,
+          G_CALLBACK (relay_cancelled_cb), self, NULL);
+    }
+
+  tube_stream = G_IO_STREAM (tp_stream_tube_connection_get_socket_connection (
+        self->priv->tube_connection));
+
+  self->priv->n_pending = 2;
+  direction_start (&self->priv->from_tube, self, tube_stream,
+      self->priv->stream, &self->priv->bytes_from_tube);
+  direction_start (&self->priv->to_tube, self, self->priv->stream,
+      tube_stream, &self->priv->bytes_to_tube);
+}
+
+/**
+ * tp_stream_tube_relay_set_scheduler:
+ * @self: a #TpStreamTubeRelay
+ * @scheduler: (allow-none): a #TpTransferScheduler, such as the one
+ *  returned by tp_transfer_scheduler_dup_default(), or %NULL
+ * @weight: the share of @scheduler's bandwidth given to each direction of
+ *  this relay, relative to its other transfers; must be at least 1
+ *
+ * Copy the data in both directions with @scheduler, so that the relay
+ * shares a rate limit with the other transfers using it, and so that it
+ * can be paused with tp_stream_tube_relay_set_paused(). The data is then
+ * always copied through this process, rather than with splice(2), and
+ * #TpStreamTubeRelay:buffer-size is not used.
+ *
+ * This must be called before tp_stream_tube_relay_run_async().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_relay_set_scheduler (TpStreamTubeRelay *self,
+    TpTransferScheduler *scheduler,
+    guint weight)
+{
+  g_return_if_fail (TP_IS_STREAM_TUBE_RELAY (self));
+  g_return_if_fail (scheduler == NULL || TP_IS_TRANSFER_SCHEDULER (scheduler));
+  g_return_if_fail (scheduler == NULL || weight > 0);
+  g_return_if_fail (self->priv->from_tube.self == NULL);
+
+  if (scheduler != NULL)
+    g_object_ref (scheduler);
+
+  tp_clear_object (&self->priv->scheduler);
+  self->priv->scheduler = scheduler;
+  self->priv->scheduler_weight = weight;
+}
+
+/**
+ * tp_stream_tube_relay_set_paused:
+ * @self: a #TpStreamTubeRelay
+ * @paused: %TRUE to stop relaying data, %FALSE to carry on
+ *
+ * Pause or resume both directions of a relay that uses a
+ * #TpTransferScheduler, as described for tp_transfer_scheduler_set_paused().
+ * Both streams stay open while the relay is paused. If the relay is not
+ * running yet, it will start paused.
+ *
+ * This can only be used after tp_stream_tube_relay_set_scheduler().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_stream_tube_relay_set_paused (TpStreamTubeRelay *self,
+    gboolean paused)
+{
+  g_return_if_fail (TP_IS_STREAM_TUBE_RELAY (self));
+  g_return_if_fail (self->priv->scheduler != NULL);
+
+  self->priv->paused = paused;
+
+  if (self->priv->from_tube.scheduled)
+    tp_transfer_scheduler_set_paused (self->priv->scheduler,
+        self->priv->from_tube.in, paused);
+
+  if (self->priv->to_tube.scheduled)
+    tp_transfer_scheduler_set_paused (self->priv->scheduler,
+        self->priv->to_tube.in, paused);
+}
+
+/**
+ * tp_stream_tube_relay_run_finish:
+ * @self: a #TpStreamTubeRelay
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes relaying data.
+ *
+ * Returns: %TRUE if both sides were closed cleanly, otherwise %FALSE
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_stream_tube_relay_run_finish (TpStreamTubeRelay *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_void (self, tp_stream_tube_relay_run_async)
+}
+
+/**
+ * tp_stream_tube_relay_get_tube_connection:
+ * @self: a #TpStreamTubeRelay
+ *
+ * Return the #TpStreamTubeRelay:tube-connection property
+ *
+ * Returns: (transfer none): the value of #TpStreamTubeRelay:tube-connection
+ *
+ * Since: 0.UNRELEASED
+ */
+TpStreamTubeConnection *
+tp_stream_tube_relay_get_tube_connection (TpStreamTubeRelay *self)
+{
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_RELAY (self), NULL);
+
+  return self->priv->tube_connection;
+}
+
+/**
+ * tp_stream_tube_relay_get_stream:
+ * @self: a #TpStreamTubeRelay
+ *
+ * Return the #TpStreamTubeRelay:stream property
+ *
+ * Returns: (transfer none): the value of #TpStreamTubeRelay:stream
+ *
+ * Since: 0.UNRELEASED
+ */
+GIOStream *
+tp_stream_tube_relay_get_stream (TpStreamTubeRelay *self)
+{
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_RELAY (self), NULL);
+
+  return self->priv->stream;
+}
+
+/**
+ * tp_stream_tube_relay_get_bytes_from_tube:
+ * @self: a #TpStreamTubeRelay
+ *
+ * Return the #TpStreamTubeRelay:bytes-from-tube property
+ *
+ * Returns: the value of #TpStreamTubeRelay:bytes-from-tube
+ *
+ * Since: 0.UNRELEASED
+ */
+guint64
+tp_stream_tube_relay_get_bytes_from_tube (TpStreamTubeRelay *self)
+{
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_RELAY (self), 0);
+
+  return self->priv->bytes_from_tube;
+}
+
+/**
+ * tp_stream_tube_relay_get_bytes_to_tube:
+ * @self: a #TpStreamTubeRelay
+ *
+ * Return the #TpStreamTubeRelay:bytes-to-tube property
+ *
+ * Returns: the value of #TpStreamTubeRelay:bytes-to-tube
+ *
+ * Since: 0.UNRELEASED
+ */
+guint64
+tp_stream_tube_relay_get_bytes_to_tube (TpStreamTubeRelay *self)
+{
+  g_return_val_if_fail (TP_IS_STREAM_TUBE_RELAY (self), 0);
+
+  return self->priv->bytes_to_tube;
+}
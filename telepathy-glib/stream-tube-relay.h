@@ -0,0 +1,111 @@
+/*
+ * Relaying a Stream Tube connection to another stream
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if defined (TP_DISABLE_SINGLE_INCLUDE) && !defined (_TP_IN_META_HEADER) && !defined (_TP_COMPILATION)
+#error "Only <telepathy-glib/telepathy-glib.h> and <telepathy-glib/telepathy-glib-dbus.h> can be included directly."
+#endif
+
+#ifndef __TP_STREAM_TUBE_RELAY_H__
+#define __TP_STREAM_TUBE_RELAY_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include <telepathy-glib/defs.h>
+#include <telepathy-glib/stream-tube-connection.h>
+#include <telepathy-glib/transfer-scheduler.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpStreamTubeRelay TpStreamTubeRelay;
+typedef struct _TpStreamTubeRelayClass TpStreamTubeRelayClass;
+typedef struct _TpStreamTubeRelayPrivate TpStreamTubeRelayPrivate;
+
+struct _TpStreamTubeRelay {
+  /*<private>*/
+  GObject parent;
+  TpStreamTubeRelayPrivate *priv;
+};
+
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_stream_tube_relay_get_type (void);
+
+#define TP_TYPE_STREAM_TUBE_RELAY \
+  (tp_stream_tube_relay_get_type ())
+#define TP_STREAM_TUBE_RELAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TYPE_STREAM_TUBE_RELAY, \
+                               TpStreamTubeRelay))
+#define TP_STREAM_TUBE_RELAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TYPE_STREAM_TUBE_RELAY, \
+                            TpStreamTubeRelayClass))
+#define TP_IS_STREAM_TUBE_RELAY(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TYPE_STREAM_TUBE_RELAY))
+#define TP_IS_STREAM_TUBE_RELAY_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TYPE_STREAM_TUBE_RELAY))
+#define TP_STREAM_TUBE_RELAY_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TYPE_STREAM_TUBE_RELAY, \
+                              TpStreamTubeRelayClass))
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpStreamTubeRelay *tp_stream_tube_relay_new (
+    TpStreamTubeConnection *tube_connection,
+    GIOStream *stream);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpStreamTubeRelay *tp_stream_tube_relay_new_for_fd (
+    TpStreamTubeConnection *tube_connection,
+    gint fd,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_relay_run_async (TpStreamTubeRelay *self,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_relay_set_scheduler (TpStreamTubeRelay *self,
+    TpTransferScheduler *scheduler,
+    guint weight);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_stream_tube_relay_set_paused (TpStreamTubeRelay *self,
+    gboolean paused);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_stream_tube_relay_run_finish (TpStreamTubeRelay *self,
+    GAsyncResult *result,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpStreamTubeConnection *tp_stream_tube_relay_get_tube_connection (
+    TpStreamTubeRelay *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GIOStream *tp_stream_tube_relay_get_stream (TpStreamTubeRelay *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint64 tp_stream_tube_relay_get_bytes_from_tube (TpStreamTubeRelay *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint64 tp_stream_tube_relay_get_bytes_to_tube (TpStreamTubeRelay *self);
+
+G_END_DECLS
+
+#endif
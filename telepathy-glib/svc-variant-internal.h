@@ -0,0 +1,72 @@
+/*<private_header>*/
+/* Dispatching D-Bus method calls to GVariant-based implementations (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_SVC_VARIANT_INTERNAL_H__
+#define __TP_SVC_VARIANT_INTERNAL_H__
+
+#include <glib-object.h>
+#include <dbus/dbus.h>
+
+G_BEGIN_DECLS
+
+/* A method call being handled by a TpSvcVariantMethodImpl, which must
+ * eventually be passed to exactly one of the _tp_svc_invocation_return
+ * functions */
+typedef struct _TpSvcInvocation TpSvcInvocation;
+
+/* @in_args is a tuple of the method's "in" arguments, which is only valid
+ * until the implementation returns */
+typedef void (*TpSvcVariantMethodImpl) (GObject *self,
+    GVariant *in_args,
+    TpSvcInvocation *invocation);
+
+/* Returns the implementation of @member in @vtable, or %NULL if it only has
+ * a dbus-glib implementation, and sets @in_signature to the signature its
+ * arguments must have; generated by glib-ginterface-gen.py --variant-prefix
+ * for each interface */
+typedef TpSvcVariantMethodImpl (*TpSvcVariantLookupFunc) (gpointer vtable,
+    const gchar *member,
+    const gchar **in_signature);
+
+/* Called by the generated code when @iface is first used */
+void _tp_svc_interface_set_variant_methods (GType iface,
+    const gchar *name,
+    TpSvcVariantLookupFunc lookup);
+
+/* Called by tp_dbus_daemon_register_object() and
+ * tp_dbus_daemon_unregister_object() */
+void _tp_svc_export_object (DBusConnection *connection,
+    const gchar *object_path,
+    GObject *object);
+void _tp_svc_unexport_object (DBusConnection *connection,
+    GObject *object);
+
+const gchar *_tp_svc_invocation_get_sender (TpSvcInvocation *invocation);
+
+void _tp_svc_invocation_return_variant (TpSvcInvocation *invocation,
+    GVariant *out_args);
+void _tp_svc_invocation_return_error (TpSvcInvocation *invocation,
+    const GError *error);
+
+gchar *_tp_svc_dup_error_name (const GError *error);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,554 @@
+/* Dispatching D-Bus method calls to GVariant-based implementations
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/svc-variant-internal.h"
+
+#include <dbus/dbus-glib.h>
+#include <gio/gio.h>
+
+#include <telepathy-glib/errors.h>
+
+#define DEBUG_FLAG TP_DEBUG_MISC
+
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/tracing-internal.h"
+#include "telepathy-glib/variant-util-internal.h"
+
+/*
+ * dbus-glib demarshals every incoming call into #GValue<!-- -->s, which for
+ * methods taking or returning large nested containers costs far more than
+ * the method itself. If the generated TpSvc code was built with
+ * --variant-prefix, each method also has a vtable slot for an
+ * implementation that receives its arguments as a #GVariant instead, which
+ * is no more than a copy of the message body.
+ *
+ * Objects exported with tp_dbus_daemon_register_object() are also
+ * recorded here, and a libdbus filter, which runs before dbus-glib's
+ * object path handlers, routes calls to them directly to such
+ * implementations. Everything else, including calls whose arguments have
+ * the wrong signature and calls with no interface, falls through to
+ * dbus-glib as before, so that the dbus-glib implementation (if any) is
+ * used and errors are reported the same way.
+ */
+
+typedef struct {
+    GType iface;
+    TpSvcVariantLookupFunc lookup;
+} Registration;
+
+/* static string D-Bus interface name -> owned Registration */
+static GHashTable *registrations = NULL;
+G_LOCK_DEFINE_STATIC (registrations);
+
+typedef struct _Exports Exports;
+
+typedef struct _Export Export;
+
+struct _Export {
+    Exports *owner;
+    gchar *object_path;
+    /* weak; NULL once it has been finalized */
+    GObject *object;
+    /* the key for this in owner->by_object, even once it has been
+     * finalized */
+    gpointer object_key;
+    /* the next Export for the same object, which is rare */
+    Export *next;
+};
+
+struct _Exports {
+    /* owned object path -> owned Export */
+    GHashTable *by_path;
+    /* borrowed object -> borrowed Export, the head of a list of the
+     * Exports for that object, so that unexporting one of thousands of
+     * objects doesn't mean looking at all of them */
+    GHashTable *by_object;
+};
+
+static dbus_int32_t exports_slot = -1;
+
+struct _TpSvcInvocation {
+    DBusConnection *connection;
+    DBusMessage *call;
+};
+
+void
+_tp_svc_interface_set_variant_methods (GType iface,
+    const gchar *name,
+    TpSvcVariantLookupFunc lookup)
+{
+  Registration *reg = g_slice_new (Registration);
+
+  reg->iface = iface;
+  reg->lookup = lookup;
+
+  G_LOCK (registrations);
+
+  if (registrations == NULL)
+    registrations = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_insert (registrations, (gchar *) name, reg);
+
+  G_UNLOCK (registrations);
+}
+
+static Registration *
+lookup_registration (const gchar *name)
+{
+  Registration *reg = NULL;
+
+  G_LOCK (registrations);
+
+  if (registrations != NULL)
+    reg = g_hash_table_lookup (registrations, name);
+
+  G_UNLOCK (registrations);
+
+  return reg;
+}
+
+static gboolean
+type_has_variant_methods (GType type)
+{
+  GHashTableIter iter;
+  gpointer v;
+  gboolean ret = FALSE;
+
+  G_LOCK (registrations);
+
+  if (registrations != NULL)
+    {
+      g_hash_table_iter_init (&iter, registrations);
+
+      while (!ret && g_hash_table_iter_next (&iter, NULL, &v))
+        ret = g_type_is_a (type, ((Registration *) v)->iface);
+    }
+
+  G_UNLOCK (registrations);
+
+  return ret;
+}
+
+static void
+export_object_finalized_cb (gpointer data,
+    GObject *where_the_object_was G_GNUC_UNUSED)
+{
+  Export *export = data;
+
+  export->object = NULL;
+  g_hash_table_remove (export->owner->by_path, export->object_path);
+}
+
+static void
+export_free (gpointer p)
+{
+  Export *export = p;
+  GHashTable *by_object = export->owner->by_object;
+  Export *head = g_hash_table_lookup (by_object, export->object_key);
+
+  if (head == export && export->next == NULL)
+    {
+      g_hash_table_remove (by_object, export->object_key);
+    }
+  else if (head == export)
+    {
+      g_hash_table_insert (by_object, export->object_key, export->next);
+    }
+  else
+    {
+      while (head->next != export)
+        head = head->next;
+
+      head->next = export->next;
+    }
+
+  if (export->object != NULL)
+    g_object_weak_unref (export->object, export_object_finalized_cb, export);
+
+  g_free (export->object_path);
+  g_slice_free (Export, export);
+}
+
+static void
+exports_free (gpointer p)
+{
+  Exports *exports = p;
+
+  g_hash_table_unref (exports->by_path);
+  g_hash_table_unref (exports->by_object);
+  g_slice_free (Exports, exports);
+}
+
+static DBusHandlerResult
+svc_variant_filter (DBusConnection *connection,
+    DBusMessage *message,
+    void *user_data)
+{
+  Exports *exports = user_data;
+  const gchar *object_path;
+  const gchar *iface;
+  const gchar *member;
+  const gchar *in_signature = NULL;
+  Export *export;
+  Registration *reg;
+  TpSvcVariantMethodImpl impl;
+  TpSvcInvocation *invocation;
+  GObject *object;
+  GVariant *in_args;
+  gpointer span;
+  GError *error = NULL;
+
+  if (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  object_path = dbus_message_get_path (message);
+  iface = dbus_message_get_interface (message);
+
+  /* without an interface, dbus-glib has to work out which one is meant */
+  if (object_path == NULL || iface == NULL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  export = g_hash_table_lookup (exports->by_path, object_path);
+
+  if (export == NULL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  reg = lookup_registration (iface);
+
+  if (reg == NULL ||
+      !G_TYPE_CHECK_INSTANCE_TYPE (export->object, reg->iface))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  member = dbus_message_get_member (message);
+  impl = reg->lookup (g_type_interface_peek (
+        G_OBJECT_GET_CLASS (export->object), reg->iface),
+      member, &in_signature);
+
+  /* let dbus-glib call the other implementation, or reply with an error */
+  if (impl == NULL || !dbus_message_has_signature (message, in_signature))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  in_args = _tp_dbus_message_dup_body (message, &error);
+
+  if (in_args == NULL)
+    {
+      DEBUG ("unable to parse %s.%s call: %s", iface, member, error->message);
+      g_error_free (error);
+      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+  invocation = g_slice_new (TpSvcInvocation);
+  invocation->connection = dbus_connection_ref (connection);
+  invocation->call = dbus_message_ref (message);
+
+  /* the implementation might unregister it */
+  object = g_object_ref (export->object);
+
+  span = _tp_svc_trace_begin_message (message, iface, member);
+  impl (object, in_args, invocation);
+  _tp_svc_trace_end (span);
+
+  g_object_unref (object);
+  g_variant_unref (in_args);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+void
+_tp_svc_export_object (DBusConnection *connection,
+    const gchar *object_path,
+    GObject *object)
+{
+  Exports *exports;
+  Export *export;
+
+  /* nothing to route for objects that only have dbus-glib
+   * implementations, so don't bother remembering them */
+  if (!type_has_variant_methods (G_OBJECT_TYPE (object)))
+    return;
+
+  if (!dbus_connection_allocate_data_slot (&exports_slot))
+    ERROR ("Out of memory");
+
+  exports = dbus_connection_get_data (connection, exports_slot);
+
+  if (exports == NULL)
+    {
+      exports = g_slice_new (Exports);
+      exports->by_path = g_hash_table_new_full (g_str_hash, g_str_equal,
+          NULL, export_free);
+      exports->by_object = g_hash_table_new (NULL, NULL);
+
+      if (!dbus_connection_set_data (connection, exports_slot, exports,
+            exports_free))
+        ERROR ("Out of memory");
+
+      /* we add this filter at most once per DBusConnection */
+      if (!dbus_connection_add_filter (connection, svc_variant_filter,
+            exports, NULL))
+        ERROR ("Out of memory");
+    }
+
+  /* the path is owned by the Export, and replacing an existing Export
+   * would free its key while the table still refers to it */
+  g_hash_table_remove (exports->by_path, object_path);
+
+  export = g_slice_new (Export);
+  export->owner = exports;
+  export->object_path = g_strdup (object_path);
+  export->object = object;
+  export->object_key = object;
+  export->next = g_hash_table_lookup (exports->by_object, object);
+  g_object_weak_ref (object, export_object_finalized_cb, export);
+
+  g_hash_table_insert (exports->by_path, export->object_path, export);
+  g_hash_table_insert (exports->by_object, object, export);
+}
+
+void
+_tp_svc_unexport_object (DBusConnection *connection,
+    GObject *object)
+{
+  Exports *exports;
+  Export *export;
+
+  if (exports_slot == -1)
+    return;
+
+  exports = dbus_connection_get_data (connection, exports_slot);
+
+  if (exports == NULL)
+    return;
+
+  /* each removal takes the head off the list */
+  while ((export = g_hash_table_lookup (exports->by_object, object)) != NULL)
+    g_hash_table_remove (exports->by_path, export->object_path);
+}
+
+const gchar *
+_tp_svc_invocation_get_sender (TpSvcInvocation *invocation)
+{
+  return dbus_message_get_sender (invocation->call);
+}
+
+static void
+invocation_send (TpSvcInvocation *invocation,
+    DBusMessage *reply)
+{
+  if (reply == NULL)
+    ERROR ("Out of memory");
+
+  if (!dbus_connection_send (invocation->connection, reply, NULL))
+    ERROR ("Out of memory");
+
+  dbus_message_unref (reply);
+}
+
+static void
+invocation_free (TpSvcInvocation *invocation)
+{
+  dbus_message_unref (invocation->call);
+  dbus_connection_unref (invocation->connection);
+  g_slice_free (TpSvcInvocation, invocation);
+}
+
+/*
+ * _tp_svc_invocation_return_variant:
+ * @invocation: a method call
+ * @out_args: a tuple of "out" arguments; if floating, it is consumed
+ *
+ * Reply to @invocation with @out_args, and free it.
+ */
+void
+_tp_svc_invocation_return_variant (TpSvcInvocation *invocation,
+    GVariant *out_args)
+{
+  if (dbus_message_get_no_reply (invocation->call))
+    {
+      /* drops the floating reference, if there is one */
+      g_variant_unref (g_variant_ref_sink (out_args));
+    }
+  else
+    {
+      invocation_send (invocation,
+          _tp_dbus_message_new_method_return (invocation->call, out_args));
+    }
+
+  invocation_free (invocation);
+}
+
+static const gchar *
+dbus_gerror_get_name (const GError *error)
+{
+  switch (error->code)
+    {
+      case DBUS_GERROR_NO_MEMORY:
+        return DBUS_ERROR_NO_MEMORY;
+      case DBUS_GERROR_SERVICE_UNKNOWN:
+        return DBUS_ERROR_SERVICE_UNKNOWN;
+      case DBUS_GERROR_NAME_HAS_NO_OWNER:
+        return DBUS_ERROR_NAME_HAS_NO_OWNER;
+      case DBUS_GERROR_NO_REPLY:
+        return DBUS_ERROR_NO_REPLY;
+      case DBUS_GERROR_IO_ERROR:
+        return DBUS_ERROR_IO_ERROR;
+      case DBUS_GERROR_BAD_ADDRESS:
+        return DBUS_ERROR_BAD_ADDRESS;
+      case DBUS_GERROR_NOT_SUPPORTED:
+        return DBUS_ERROR_NOT_SUPPORTED;
+      case DBUS_GERROR_LIMITS_EXCEEDED:
+        return DBUS_ERROR_LIMITS_EXCEEDED;
+      case DBUS_GERROR_ACCESS_DENIED:
+        return DBUS_ERROR_ACCESS_DENIED;
+      case DBUS_GERROR_AUTH_FAILED:
+        return DBUS_ERROR_AUTH_FAILED;
+      case DBUS_GERROR_NO_SERVER:
+        return DBUS_ERROR_NO_SERVER;
+      case DBUS_GERROR_TIMEOUT:
+        return DBUS_ERROR_TIMEOUT;
+      case DBUS_GERROR_NO_NETWORK:
+        return DBUS_ERROR_NO_NETWORK;
+      case DBUS_GERROR_ADDRESS_IN_USE:
+        return DBUS_ERROR_ADDRESS_IN_USE;
+      case DBUS_GERROR_DISCONNECTED:
+        return DBUS_ERROR_DISCONNECTED;
+      case DBUS_GERROR_INVALID_ARGS:
+        return DBUS_ERROR_INVALID_ARGS;
+      case DBUS_GERROR_FILE_NOT_FOUND:
+        return DBUS_ERROR_FILE_NOT_FOUND;
+      case DBUS_GERROR_FILE_EXISTS:
+        return DBUS_ERROR_FILE_EXISTS;
+      case DBUS_GERROR_UNKNOWN_METHOD:
+        return DBUS_ERROR_UNKNOWN_METHOD;
+      case DBUS_GERROR_TIMED_OUT:
+        return DBUS_ERROR_TIMED_OUT;
+      case DBUS_GERROR_MATCH_RULE_NOT_FOUND:
+        return DBUS_ERROR_MATCH_RULE_NOT_FOUND;
+      case DBUS_GERROR_MATCH_RULE_INVALID:
+        return DBUS_ERROR_MATCH_RULE_INVALID;
+      case DBUS_GERROR_SPAWN_EXEC_FAILED:
+        return DBUS_ERROR_SPAWN_EXEC_FAILED;
+      case DBUS_GERROR_SPAWN_FORK_FAILED:
+        return DBUS_ERROR_SPAWN_FORK_FAILED;
+      case DBUS_GERROR_SPAWN_CHILD_EXITED:
+        return DBUS_ERROR_SPAWN_CHILD_EXITED;
+      case DBUS_GERROR_SPAWN_CHILD_SIGNALED:
+        return DBUS_ERROR_SPAWN_CHILD_SIGNALED;
+      case DBUS_GERROR_SPAWN_FAILED:
+        return DBUS_ERROR_SPAWN_FAILED;
+      case DBUS_GERROR_UNIX_PROCESS_ID_UNKNOWN:
+        return DBUS_ERROR_UNIX_PROCESS_ID_UNKNOWN;
+      case DBUS_GERROR_INVALID_SIGNATURE:
+        return DBUS_ERROR_INVALID_SIGNATURE;
+      case DBUS_GERROR_INVALID_FILE_CONTENT:
+        return DBUS_ERROR_INVALID_FILE_CONTENT;
+      case DBUS_GERROR_SELINUX_SECURITY_CONTEXT_UNKNOWN:
+        return DBUS_ERROR_SELINUX_SECURITY_CONTEXT_UNKNOWN;
+      case DBUS_GERROR_REMOTE_EXCEPTION:
+        return dbus_g_error_get_name ((GError *) error);
+      default:
+        return DBUS_ERROR_FAILED;
+    }
+}
+
+/*
+ * _tp_svc_dup_error_name:
+ * @error: an error to be sent over D-Bus
+ *
+ * Returns the D-Bus error name that dbus-glib would use if @error was
+ * returned with dbus_g_method_return_error(): the standard names for
+ * #DBUS_GERROR, the registered names for #TP_ERROR, and a made-up
+ * org.freedesktop.DBus.GLib.UnmappedError name for anything else, such as
+ * "org.freedesktop.DBus.GLib.UnmappedError.GIoErrorQuark.Code1".
+ *
+ * Error domains registered by other code with
+ * dbus_g_error_domain_register() are treated as unmapped, since dbus-glib
+ * has no API to look them up.
+ *
+ * Returns: (transfer full): a D-Bus error name
+ */
+gchar *
+_tp_svc_dup_error_name (const GError *error)
+{
+  GString *name;
+  const gchar *p;
+  gboolean capitalize = TRUE;
+
+  if (error->domain == DBUS_GERROR)
+    return g_strdup (dbus_gerror_get_name (error));
+
+  if (error->domain == TP_ERROR)
+    {
+      GEnumClass *klass = g_type_class_ref (TP_TYPE_ERROR);
+      gboolean known = (g_enum_get_value (klass, error->code) != NULL);
+
+      g_type_class_unref (klass);
+
+      if (known)
+        return g_strdup (tp_error_get_dbus_name (error->code));
+    }
+
+  /* "g-io-error-quark" becomes "GIoErrorQuark", as in dbus-glib */
+  name = g_string_new ("org.freedesktop.DBus.GLib.UnmappedError.");
+
+  for (p = g_quark_to_string (error->domain); p != NULL && *p != '\0'; p++)
+    {
+      if (*p == '-' || *p == '_')
+        {
+          capitalize = TRUE;
+        }
+      else if (capitalize)
+        {
+          g_string_append_c (name, g_ascii_toupper (*p));
+          capitalize = FALSE;
+        }
+      else
+        {
+          g_string_append_c (name, *p);
+        }
+    }
+
+  g_string_append_printf (name, ".Code%d", error->code);
+  return g_string_free (name, FALSE);
+}
+
+/*
+ * _tp_svc_invocation_return_error:
+ * @invocation: a method call
+ * @error: the error to reply with
+ *
+ * Reply to @invocation with @error, mapped to a D-Bus error name by
+ * _tp_svc_dup_error_name(), and free it.
+ */
+void
+_tp_svc_invocation_return_error (TpSvcInvocation *invocation,
+    const GError *error)
+{
+  if (!dbus_message_get_no_reply (invocation->call))
+    {
+      gchar *name = _tp_svc_dup_error_name (error);
+
+      invocation_send (invocation,
+          dbus_message_new_error (invocation->call, name, error->message));
+      g_free (name);
+    }
+
+  invocation_free (invocation);
+}
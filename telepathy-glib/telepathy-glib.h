@@ -37,6 +37,7 @@
 #include <telepathy-glib/account.h>
 #include <telepathy-glib/add-dispatch-operation-context.h>
 #include <telepathy-glib/automatic-client-factory.h>
+#include <telepathy-glib/base-avatars.h>
 #include <telepathy-glib/base-call-channel.h>
 #include <telepathy-glib/base-call-content.h>
 #include <telepathy-glib/base-call-stream.h>
@@ -70,6 +71,8 @@
 #include <telepathy-glib/connection-contact-list.h>
 #include <telepathy-glib/connection-manager.h>
 #include <telepathy-glib/connection.h>
+#include <telepathy-glib/contact-index.h>
+#include <telepathy-glib/contact-view.h>
 #include <telepathy-glib/contact-operations.h>
 #include <telepathy-glib/contact-search-result.h>
 #include <telepathy-glib/contact-search.h>
@@ -109,9 +112,11 @@
 #include <telepathy-glib/simple-observer.h>
 #include <telepathy-glib/stream-tube-channel.h>
 #include <telepathy-glib/stream-tube-connection.h>
+#include <telepathy-glib/stream-tube-relay.h>
 #include <telepathy-glib/text-channel.h>
 #include <telepathy-glib/text-mixin.h>
 #include <telepathy-glib/tls-certificate.h>
+#include <telepathy-glib/transfer-scheduler.h>
 #include <telepathy-glib/variant-util.h>
 
 /* deprecated, gone in 1.0 */
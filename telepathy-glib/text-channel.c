@@ -53,6 +53,7 @@
 #include <telepathy-glib/gnio-util.h>
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/intset.h>
 #include <telepathy-glib/message-internal.h>
 #include <telepathy-glib/proxy-internal.h>
 #include <telepathy-glib/proxy-subclass.h>
@@ -66,6 +67,7 @@
 #include "telepathy-glib/channel-internal.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <glib/gstdio.h>
 
 G_DEFINE_TYPE (TpTextChannel, tp_text_channel, TP_TYPE_CHANNEL)
@@ -78,14 +80,24 @@ struct _TpTextChannelPrivate
   GArray *message_types;
 
   GSimpleAsyncResult *pending_messages_result;
-  guint n_preparing_pending_messages;
 
   /* queue of owned TpSignalledMessage */
   GQueue *pending_messages;
+  /* borrowed message token => borrowed TpSignalledMessage in
+   * pending_messages, the most recent one if several have the same token */
+  GHashTable *pending_tokens;
   gboolean got_initial_messages;
 
   gboolean is_sms_channel;
   gboolean sms_flash;
+
+  /* If TRUE, received messages are delivered before their senders have
+   * been prepared */
+  gboolean lazy_senders;
+  /* MessageSender, for messages delivered since lazy_senders_idle was
+   * added */
+  GPtrArray *lazy_senders_queue;
+  guint lazy_senders_idle;
 };
 
 enum
@@ -104,6 +116,8 @@ enum /* signals */
   SIG_PENDING_MESSAGE_REMOVED,
   SIG_MESSAGE_SENT,
   SIG_CONTACT_CHAT_STATE_CHANGED,
+  SIG_MESSAGE_SENDER_PREPARED,
+  SIG_MESSAGE_SUPERSEDED,
   LAST_SIGNAL
 };
 
@@ -117,9 +131,18 @@ tp_text_channel_dispose (GObject *obj)
   tp_clear_pointer (&self->priv->supported_content_types, g_strfreev);
   tp_clear_pointer (&self->priv->message_types, g_array_unref);
 
+  tp_clear_pointer (&self->priv->pending_tokens, g_hash_table_unref);
   g_queue_foreach (self->priv->pending_messages, (GFunc) g_object_unref, NULL);
   tp_clear_pointer (&self->priv->pending_messages, g_queue_free);
 
+  if (self->priv->lazy_senders_idle != 0)
+    {
+      _tp_source_remove (self->priv->lazy_senders_idle);
+      self->priv->lazy_senders_idle = 0;
+    }
+
+  tp_clear_pointer (&self->priv->lazy_senders_queue, g_ptr_array_unref);
+
   G_OBJECT_CLASS (tp_text_channel_parent_class)->dispose (obj);
 }
 
@@ -296,21 +319,9 @@ prepare_sender_finish (TpTextChannel *self,
   return sender;
 }
 
-static GPtrArray *
-copy_parts (const GPtrArray *parts)
-{
-  return g_boxed_copy (TP_ARRAY_TYPE_MESSAGE_PART_LIST, parts);
-}
-
-static void
-free_parts (GPtrArray *parts)
-{
-  g_boxed_free (TP_ARRAY_TYPE_MESSAGE_PART_LIST, parts);
-}
-
 typedef struct
 {
-  GPtrArray *parts;
+  TpMessage *msg;
   guint flags;
   gchar *token;
 } MessageSentData;
@@ -323,16 +334,15 @@ message_sent_sender_ready_cb (GObject *object,
   TpTextChannel *self = (TpTextChannel *) object;
   MessageSentData *data = user_data;
   TpContact *sender;
-  TpMessage *msg;
 
   sender = prepare_sender_finish (self, result, NULL);
-  msg = _tp_signalled_message_new (data->parts, sender);
+  _tp_signalled_message_set_sender (data->msg, sender);
 
-  g_signal_emit (self, signals[SIG_MESSAGE_SENT], 0, msg, data->flags,
+  g_signal_emit (self, signals[SIG_MESSAGE_SENT], 0, data->msg, data->flags,
       data->token);
 
-  g_object_unref (msg);
-  free_parts (data->parts);
+  tp_clear_object (&sender);
+  g_object_unref (data->msg);
   g_free (data->token);
   g_slice_free (MessageSentData, data);
 }
@@ -350,12 +360,14 @@ message_sent_cb (TpChannel *channel,
 
   DEBUG ("New message sent");
 
+  /* While its sender is being prepared, we hold the message that will be
+   * given to the user; this way @parts is only copied once. */
   data = g_slice_new (MessageSentData);
-  data->parts = copy_parts (parts);
+  data->msg = _tp_signalled_message_new_without_sender (parts);
   data->flags = flags;
   data->token = tp_str_empty (token) ? NULL : g_strdup (token);
 
-  prepare_sender_async (self, parts, TRUE,
+  prepare_sender_async (self, data->msg->parts, TRUE,
       message_sent_sender_ready_cb, data);
 }
 
@@ -507,20 +519,51 @@ tp_text_channel_constructed (GObject *obj)
       TP_PROP_CHANNEL_INTERFACE_SMS_FLASH, NULL);
 }
 
+/* Append @msg to the pending messages, and announce it if @fire_received.
+ * Takes ownership of @msg. */
 static void
-add_message_received (TpTextChannel *self,
-    const GPtrArray *parts,
-    TpContact *sender,
+pending_messages_push (TpTextChannel *self,
+    TpMessage *msg,
     gboolean fire_received)
 {
-  TpMessage *msg;
+  const gchar *token = tp_message_get_token (msg);
+  const gchar *supersedes = tp_message_get_supersedes (msg);
+  TpMessage *original = NULL;
 
-  msg = _tp_signalled_message_new (parts, sender);
+  if (supersedes != NULL)
+    original = g_hash_table_lookup (self->priv->pending_tokens, supersedes);
 
   g_queue_push_tail (self->priv->pending_messages, msg);
 
-  if (fire_received)
-    g_signal_emit (self, signals[SIG_MESSAGE_RECEIVED], 0, msg);
+  if (token != NULL)
+    g_hash_table_insert (self->priv->pending_tokens, (gchar *) token, msg);
+
+  if (!fire_received)
+    return;
+
+  /* in case a ::message-received handler makes it go away */
+  if (original != NULL)
+    g_object_ref (original);
+
+  g_signal_emit (self, signals[SIG_MESSAGE_RECEIVED], 0, msg);
+
+  if (original != NULL)
+    {
+      g_signal_emit (self, signals[SIG_MESSAGE_SUPERSEDED], 0, msg,
+          original);
+      g_object_unref (original);
+    }
+}
+
+/* Takes ownership of @msg */
+static void
+add_message_received (TpTextChannel *self,
+    TpMessage *msg,
+    TpContact *sender,
+    gboolean fire_received)
+{
+  _tp_signalled_message_set_sender (msg, sender);
+  pending_messages_push (self, msg, fire_received);
 }
 
 static void
@@ -529,13 +572,259 @@ message_received_sender_ready_cb (GObject *object,
     gpointer user_data)
 {
   TpTextChannel *self = (TpTextChannel *) object;
-  GPtrArray *parts = user_data;
+  TpMessage *msg = user_data;
   TpContact *sender;
 
   sender = prepare_sender_finish (self, result, NULL);
-  add_message_received (self, parts, sender, TRUE);
+  add_message_received (self, msg, sender, TRUE);
+
+  tp_clear_object (&sender);
+}
+
+typedef struct
+{
+  /* owned TpSignalledMessage */
+  TpMessage *msg;
+  /* 0 if the message has no sender */
+  TpHandle handle;
+  gchar *id;
+  /* owned; before preparation, the existing TpContact for handle if any;
+   * afterwards, the prepared sender, or NULL if it couldn't be prepared */
+  TpContact *contact;
+} MessageSender;
+
+/* Called with the MessageSender for each message passed to
+ * prepare_senders(), once all of their senders have been prepared */
+typedef void (*SendersPreparedFunc) (TpTextChannel *self,
+    GPtrArray *senders);
 
-  free_parts (parts);
+typedef struct
+{
+  TpTextChannel *self;
+  /* owned MessageSender */
+  GPtrArray *senders;
+  /* handle => borrowed TpContact, from the contacts queue's results */
+  GHashTable *prepared;
+  /* number of contacts queue items not yet prepared */
+  guint n_pending;
+  SendersPreparedFunc done;
+} SenderBatch;
+
+/* Takes ownership of @msg, and of the ref on @contact if any */
+static MessageSender *
+message_sender_new (TpMessage *msg,
+    TpHandle handle,
+    const gchar *id,
+    TpContact *contact)
+{
+  MessageSender *sender = g_slice_new0 (MessageSender);
+
+  sender->msg = msg;
+  sender->handle = handle;
+  sender->id = g_strdup (id);
+  sender->contact = contact;
+
+  return sender;
+}
+
+static void
+message_sender_free (gpointer p)
+{
+  MessageSender *sender = p;
+
+  g_object_unref (sender->msg);
+  g_free (sender->id);
+  tp_clear_object (&sender->contact);
+  g_slice_free (MessageSender, sender);
+}
+
+static void
+senders_prepared_cb (GObject *object,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpTextChannel *self = (TpTextChannel *) object;
+  SenderBatch *batch = user_data;
+  GPtrArray *contacts = NULL;
+  guint i;
+
+  _tp_channel_contacts_queue_prepare_finish ((TpChannel *) self, result,
+      &contacts, NULL);
+
+  for (i = 0; contacts != NULL && i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+
+      g_hash_table_insert (batch->prepared,
+          GUINT_TO_POINTER (tp_contact_get_handle (contact)),
+          g_object_ref (contact));
+    }
+
+  tp_clear_pointer (&contacts, g_ptr_array_unref);
+
+  if (--batch->n_pending > 0)
+    return;
+
+  for (i = 0; i < batch->senders->len; i++)
+    {
+      MessageSender *sender = g_ptr_array_index (batch->senders, i);
+      TpContact *contact = g_hash_table_lookup (batch->prepared,
+          GUINT_TO_POINTER (sender->handle));
+
+      tp_clear_object (&sender->contact);
+
+      if (contact != NULL)
+        sender->contact = g_object_ref (contact);
+    }
+
+  batch->done (self, batch->senders);
+
+  g_hash_table_unref (batch->prepared);
+  g_ptr_array_unref (batch->senders);
+  g_object_unref (batch->self);
+  g_slice_free (SenderBatch, batch);
+}
+
+/* Prepare the senders of all of @senders, asking for each contact only
+ * once, then call @done. Like prepare_sender_async(), this goes through
+ * the channel's contacts queue, so @done is called in order with respect
+ * to other messages. Takes ownership of @senders. */
+static void
+prepare_senders (TpTextChannel *self,
+    GPtrArray *senders,
+    SendersPreparedFunc done)
+{
+  TpChannel *channel = (TpChannel *) self;
+  SenderBatch *batch;
+  GPtrArray *contacts = g_ptr_array_new_with_free_func (g_object_unref);
+  GPtrArray *ids = g_ptr_array_new_with_free_func (g_free);
+  GArray *handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  TpIntset *seen = tp_intset_new ();
+  guint i;
+
+  batch = g_slice_new0 (SenderBatch);
+  batch->self = g_object_ref (self);
+  batch->senders = senders;
+  batch->prepared = g_hash_table_new_full (NULL, NULL, NULL,
+      g_object_unref);
+  batch->done = done;
+
+  for (i = 0; i < senders->len; i++)
+    {
+      MessageSender *sender = g_ptr_array_index (senders, i);
+
+      if (sender->handle == 0 || tp_intset_is_member (seen, sender->handle))
+        continue;
+
+      tp_intset_add (seen, sender->handle);
+
+      if (sender->contact != NULL)
+        g_ptr_array_add (contacts, g_object_ref (sender->contact));
+      else if (sender->id != NULL)
+        g_ptr_array_add (ids, g_strdup (sender->id));
+      else
+        g_array_append_val (handles, sender->handle);
+    }
+
+  DEBUG ("preparing %u senders of %u messages", tp_intset_size (seen),
+      senders->len);
+
+  /* count them all first, in case a callback is called straight away */
+  batch->n_pending = (contacts->len > 0) + (ids->len > 0) +
+      (handles->len > 0);
+
+  if (batch->n_pending == 0)
+    {
+      /* No senders. Still need to go through the queue to prevent
+       * reordering */
+      batch->n_pending = 1;
+      _tp_channel_contacts_queue_prepare_async (channel, NULL,
+          senders_prepared_cb, batch);
+    }
+
+  if (contacts->len > 0)
+    _tp_channel_contacts_queue_prepare_async (channel, contacts,
+        senders_prepared_cb, batch);
+
+  if (ids->len > 0)
+    _tp_channel_contacts_queue_prepare_by_id_async (channel, ids,
+        senders_prepared_cb, batch);
+
+  if (handles->len > 0)
+    _tp_channel_contacts_queue_prepare_by_handle_async (channel, handles,
+        senders_prepared_cb, batch);
+
+  g_ptr_array_unref (contacts);
+  g_ptr_array_unref (ids);
+  g_array_unref (handles);
+  tp_intset_destroy (seen);
+}
+
+static void
+lazy_senders_prepared (TpTextChannel *self,
+    GPtrArray *senders)
+{
+  guint i;
+
+  for (i = 0; i < senders->len; i++)
+    {
+      MessageSender *sender = g_ptr_array_index (senders, i);
+
+      if (sender->contact == NULL)
+        continue;
+
+      _tp_signalled_message_resolve_sender (sender->msg, sender->contact);
+      g_signal_emit (self, signals[SIG_MESSAGE_SENDER_PREPARED], 0,
+          sender->msg);
+    }
+}
+
+/* Prepare the senders of every message delivered lazily since the last
+ * idle, in one go */
+static gboolean
+lazy_senders_idle_cb (gpointer user_data)
+{
+  TpTextChannel *self = user_data;
+  GPtrArray *senders = self->priv->lazy_senders_queue;
+
+  self->priv->lazy_senders_idle = 0;
+  self->priv->lazy_senders_queue = NULL;
+
+  prepare_senders (self, senders, lazy_senders_prepared);
+  return FALSE;
+}
+
+/* Deliver @msg straight away, and arrange for its sender to be prepared
+ * along with any others received at about the same time. Takes ownership
+ * of @msg. */
+static void
+add_message_received_lazily (TpTextChannel *self,
+    TpMessage *msg,
+    gboolean fire_received)
+{
+  TpContact *contact;
+  TpHandle handle;
+  const gchar *id;
+
+  handle = get_sender (self, msg->parts, &contact, &id);
+
+  if (handle != 0)
+    {
+      if (self->priv->lazy_senders_queue == NULL)
+        self->priv->lazy_senders_queue = g_ptr_array_new_with_free_func (
+            message_sender_free);
+
+      /* get_sender() gave us a ref to contact */
+      g_ptr_array_add (self->priv->lazy_senders_queue,
+          message_sender_new (g_object_ref (msg), handle, id, contact));
+
+      if (self->priv->lazy_senders_idle == 0)
+        self->priv->lazy_senders_idle = _tp_idle_add (
+            TP_LATENCY_CLASS_NORMAL, lazy_senders_idle_cb, self);
+    }
+
+  _tp_signalled_message_set_sender_unknown (msg);
+  pending_messages_push (self, msg, fire_received);
 }
 
 static void
@@ -545,6 +834,7 @@ message_received_cb (TpChannel *proxy,
     GObject *weak_object)
 {
   TpTextChannel *self = user_data;
+  TpMessage *msg;
 
   /* If we are still retrieving pending messages, no need to add the message,
    * it will be in the initial set of messages retrieved. */
@@ -553,9 +843,16 @@ message_received_cb (TpChannel *proxy,
 
   DEBUG ("New message received");
 
-  prepare_sender_async (self, message, FALSE,
-      message_received_sender_ready_cb,
-      copy_parts (message));
+  msg = _tp_signalled_message_new_without_sender (message);
+
+  if (self->priv->lazy_senders)
+    {
+      add_message_received_lazily (self, msg, TRUE);
+      return;
+    }
+
+  prepare_sender_async (self, msg->parts, FALSE,
+      message_received_sender_ready_cb, msg);
 }
 
 static gint
@@ -591,6 +888,7 @@ pending_messages_removed_ready_cb (GObject *object,
       guint id = g_array_index (ids, guint, i);
       GList *link_;
       TpMessage *msg;
+      const gchar *token;
 
       link_ = g_queue_find_custom (self->priv->pending_messages,
           GUINT_TO_POINTER (id), find_msg_by_id);
@@ -602,9 +900,15 @@ pending_messages_removed_ready_cb (GObject *object,
         }
 
       msg = link_->data;
+      token = tp_message_get_token (msg);
 
       g_queue_delete_link (self->priv->pending_messages, link_);
 
+      /* a newer message might have the same token */
+      if (token != NULL &&
+          g_hash_table_lookup (self->priv->pending_tokens, token) == msg)
+        g_hash_table_remove (self->priv->pending_tokens, token);
+
       g_signal_emit (self, signals[SIG_PENDING_MESSAGE_REMOVED], 0, msg);
 
       g_object_unref (msg);
@@ -635,25 +939,21 @@ pending_messages_removed_cb (TpChannel *channel,
 }
 
 static void
-pending_message_sender_ready_cb (GObject *object,
-    GAsyncResult *result,
-    gpointer user_data)
+pending_senders_prepared (TpTextChannel *self,
+    GPtrArray *senders)
 {
-  TpTextChannel *self = (TpTextChannel *) object;
-  GPtrArray *parts = user_data;
-  TpContact *sender;
-
-  sender = prepare_sender_finish (self, result, NULL);
-  add_message_received (self, parts, sender, FALSE);
+  guint i;
 
-  self->priv->n_preparing_pending_messages--;
-  if (self->priv->n_preparing_pending_messages == 0)
+  for (i = 0; i < senders->len; i++)
     {
-      g_simple_async_result_complete (self->priv->pending_messages_result);
-      g_clear_object (&self->priv->pending_messages_result);
+      MessageSender *sender = g_ptr_array_index (senders, i);
+
+      add_message_received (self, g_object_ref (sender->msg),
+          sender->contact, FALSE);
     }
 
-  free_parts (parts);
+  g_simple_async_result_complete (self->priv->pending_messages_result);
+  g_clear_object (&self->priv->pending_messages_result);
 }
 
 /* There is no TP_ARRAY_TYPE_PENDING_TEXT_MESSAGE_LIST_LIST (fdo #32433) */
@@ -669,6 +969,7 @@ get_pending_messages_cb (TpProxy *proxy,
 {
   TpTextChannel *self = (TpTextChannel *) proxy;
   GPtrArray *messages;
+  GPtrArray *senders;
   guint i;
 
   self->priv->got_initial_messages = TRUE;
@@ -708,15 +1009,37 @@ get_pending_messages_cb (TpProxy *proxy,
       return;
     }
 
-  self->priv->n_preparing_pending_messages = messages->len;
-  for (i = 0; i < messages->len; i++)
+  if (self->priv->lazy_senders)
     {
-      GPtrArray *parts = g_ptr_array_index (messages, i);
+      for (i = 0; i < messages->len; i++)
+        add_message_received_lazily (self,
+            _tp_signalled_message_new_without_sender (
+                g_ptr_array_index (messages, i)),
+            FALSE);
+
+      g_simple_async_result_complete_in_idle (
+          self->priv->pending_messages_result);
+      g_clear_object (&self->priv->pending_messages_result);
+      return;
+    }
 
-      prepare_sender_async (self, parts, FALSE,
-          pending_message_sender_ready_cb,
-          copy_parts (parts));
+  /* Prepare all the senders at once, rather than one message at a time */
+  senders = g_ptr_array_new_full (messages->len, message_sender_free);
+
+  for (i = 0; i < messages->len; i++)
+    {
+      TpMessage *msg = _tp_signalled_message_new_without_sender (
+          g_ptr_array_index (messages, i));
+      TpContact *contact;
+      TpHandle handle;
+      const gchar *id;
+
+      handle = get_sender (self, msg->parts, &contact, &id);
+      g_ptr_array_add (senders, message_sender_new (msg, handle, id,
+            contact));
     }
+
+  prepare_senders (self, senders, pending_senders_prepared);
 }
 
 static void
@@ -1015,7 +1338,8 @@ tp_text_channel_class_init (TpTextChannelClass *klass)
    *
    * It is guaranteed that @message's #TpSignalledMessage:sender has all of the
    * features previously passed to
-   * tp_simple_client_factory_add_contact_features() prepared.
+   * tp_simple_client_factory_add_contact_features() prepared, unless
+   * tp_text_channel_set_lazy_senders() has been used.
    *
    * Since: 0.13.10
    */
@@ -1089,6 +1413,9 @@ tp_text_channel_class_init (TpTextChannelClass *klass)
    * has finished preparing features %TP_TEXT_CHANNEL_FEATURE_CHAT_STATES,
    * %TP_CHANNEL_FEATURE_GROUP and %TP_CHANNEL_FEATURE_CONTACTS.
    *
+   * Changed in 0.UNRELEASED: as with #TpChannel::chat-state-changed,
+   * changes that arrive together are coalesced per contact.
+   *
    * Since: 0.19.0
    */
   signals[SIG_CONTACT_CHAT_STATE_CHANGED] = g_signal_new (
@@ -1098,6 +1425,59 @@ tp_text_channel_class_init (TpTextChannelClass *klass)
       0,
       NULL, NULL, NULL,
       G_TYPE_NONE, 2, TP_TYPE_CONTACT, G_TYPE_UINT);
+
+  /**
+   * TpTextChannel::message-sender-prepared:
+   * @self: the #TpTextChannel
+   * @message: a #TpSignalledMessage
+   *
+   * If tp_text_channel_set_lazy_senders() has been used, this signal is
+   * emitted when the #TpSignalledMessage:sender of a message that has
+   * already been announced by #TpTextChannel::message-received, or was
+   * already pending when #TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES was
+   * prepared, has become available.
+   *
+   * It is guaranteed that @message's #TpSignalledMessage:sender has all of the
+   * features previously passed to
+   * tp_simple_client_factory_add_contact_features() prepared.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIG_MESSAGE_SENDER_PREPARED] = g_signal_new (
+      "message-sender-prepared",
+      G_OBJECT_CLASS_TYPE (klass),
+      G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, NULL,
+      G_TYPE_NONE,
+      1, TP_TYPE_SIGNALLED_MESSAGE);
+
+  /**
+   * TpTextChannel::message-superseded:
+   * @self: the #TpTextChannel
+   * @message: a #TpSignalledMessage that has just been received
+   * @original: the pending #TpSignalledMessage whose token is
+   *  tp_message_get_supersedes() for @message
+   *
+   * Emitted just after #TpTextChannel::message-received if @message is
+   * an edit or correction of a message that is still pending, so that
+   * clients can apply it without looking through the pending messages.
+   * @original is not removed from the pending messages: it still has to
+   * be acknowledged.
+   *
+   * If the message it supersedes is not pending, for instance because it
+   * was sent by the local user, or has already been acknowledged, this
+   * signal is not emitted, and clients should look for it in their own
+   * history instead.
+   *
+   * Since: 0.UNRELEASED
+   */
+  signals[SIG_MESSAGE_SUPERSEDED] = g_signal_new (
+      "message-superseded",
+      G_OBJECT_CLASS_TYPE (klass),
+      G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, NULL,
+      G_TYPE_NONE,
+      2, TP_TYPE_SIGNALLED_MESSAGE, TP_TYPE_SIGNALLED_MESSAGE);
 }
 
 static void
@@ -1107,6 +1487,7 @@ tp_text_channel_init (TpTextChannel *self)
       TpTextChannelPrivate);
 
   self->priv->pending_messages = g_queue_new ();
+  self->priv->pending_tokens = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 
@@ -1270,6 +1651,39 @@ tp_text_channel_get_pending_messages (TpTextChannel *self)
   return g_list_copy (g_queue_peek_head_link (self->priv->pending_messages));
 }
 
+/**
+ * tp_text_channel_set_lazy_senders:
+ * @self: a #TpTextChannel
+ * @enabled: %TRUE to deliver received messages before their senders have
+ *  been prepared
+ *
+ * By default, #TpTextChannel::message-received is not emitted, and
+ * #TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES is not prepared, until the
+ * sender of each message has been prepared, and messages wait for the
+ * senders of earlier messages. In a busy chatroom, this can delay the
+ * first message considerably.
+ *
+ * If @enabled is %TRUE, messages are delivered as soon as they are
+ * received, with #TpSignalledMessage:sender set to %NULL; the sender's
+ * identifier is available as the "message-sender-id" header. The senders
+ * of messages received at about the same time are then prepared together,
+ * asking for each contact only once, and
+ * #TpTextChannel::message-sender-prepared is emitted for each message.
+ *
+ * This should be called before #TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES
+ * is prepared, to apply to the initial pending messages too.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_text_channel_set_lazy_senders (TpTextChannel *self,
+    gboolean enabled)
+{
+  g_return_if_fail (TP_IS_TEXT_CHANNEL (self));
+
+  self->priv->lazy_senders = enabled;
+}
+
 /**
  * tp_text_channel_dup_pending_messages:
  * @self: a #TpTextChannel
@@ -1294,6 +1708,58 @@ tp_text_channel_dup_pending_messages (TpTextChannel *self)
       (GCopyFunc) g_object_ref, NULL);
 }
 
+/**
+ * tp_text_channel_peek_pending_messages:
+ * @self: a #TpTextChannel
+ *
+ * The same as tp_text_channel_dup_pending_messages(), but without copying
+ * the list or taking references to the messages. The list may not be
+ * modified.
+ *
+ * The returned list is not necessarily valid after the main loop is next
+ * re-entered, since messages may be acknowledged or received; use
+ * tp_text_channel_dup_pending_messages() to keep a copy.
+ *
+ * Returns: (transfer none) (element-type TelepathyGLib.SignalledMessage):
+ * a #GList of #TpSignalledMessage, oldest first
+ *
+ * Since: 0.UNRELEASED
+ */
+const GList *
+tp_text_channel_peek_pending_messages (TpTextChannel *self)
+{
+  g_return_val_if_fail (TP_IS_TEXT_CHANNEL (self), NULL);
+
+  return g_queue_peek_head_link (self->priv->pending_messages);
+}
+
+/**
+ * tp_text_channel_peek_pending_message_by_token:
+ * @self: a #TpTextChannel
+ * @token: a message token, as returned by tp_message_get_token()
+ *
+ * Find the pending message whose tp_message_get_token() is @token.
+ * Unlike looking through tp_text_channel_peek_pending_messages(), this
+ * does not depend on how many messages are pending.
+ *
+ * If several pending messages have @token, the most recently received is
+ * returned.
+ *
+ * Returns: (transfer none): a #TpSignalledMessage, or %NULL if none of the
+ *  pending messages has @token
+ *
+ * Since: 0.UNRELEASED
+ */
+TpMessage *
+tp_text_channel_peek_pending_message_by_token (TpTextChannel *self,
+    const gchar *token)
+{
+  g_return_val_if_fail (TP_IS_TEXT_CHANNEL (self), NULL);
+  g_return_val_if_fail (token != NULL, NULL);
+
+  return g_hash_table_lookup (self->priv->pending_tokens, token);
+}
+
 static void
 send_message_cb (TpChannel *proxy,
     const gchar *token,
@@ -1381,6 +1847,249 @@ tp_text_channel_send_message_finish (TpTextChannel *self,
       g_strdup, token);
 }
 
+/* the default for tp_text_channel_send_messages_async()'s @max_in_flight */
+#define DEFAULT_MAX_MESSAGES_IN_FLIGHT 16
+
+typedef struct
+{
+  TpTextChannel *self;
+  /* owned TpMessage */
+  GPtrArray *messages;
+  TpMessageSendingFlags flags;
+  guint max_in_flight;
+  /* index in messages of the next message to send */
+  guint next;
+  guint in_flight;
+  /* owned gchar * or NULL, for each message */
+  GPtrArray *tokens;
+  /* owned GError * or NULL, for each message */
+  GPtrArray *errors;
+  /* borrowed; each call in flight holds a ref */
+  GSimpleAsyncResult *result;
+} SendMessagesData;
+
+typedef struct
+{
+  SendMessagesData *data;
+  GSimpleAsyncResult *result;
+  guint index;
+} SendMessagesCall;
+
+static void
+error_free_if_set (gpointer error)
+{
+  if (error != NULL)
+    g_error_free (error);
+}
+
+static void
+send_messages_data_free (gpointer p)
+{
+  SendMessagesData *data = p;
+
+  g_ptr_array_unref (data->messages);
+  g_ptr_array_unref (data->tokens);
+  g_ptr_array_unref (data->errors);
+  g_slice_free (SendMessagesData, data);
+}
+
+static void
+send_messages_call_free (gpointer p)
+{
+  SendMessagesCall *call = p;
+
+  g_object_unref (call->result);
+  g_slice_free (SendMessagesCall, call);
+}
+
+static void send_messages_cb (TpChannel *proxy,
+    const gchar *token,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object);
+
+static void
+send_messages_next (SendMessagesData *data)
+{
+  while (data->in_flight < data->max_in_flight &&
+      data->next < data->messages->len)
+    {
+      SendMessagesCall *call = g_slice_new (SendMessagesCall);
+      TpMessage *message = g_ptr_array_index (data->messages, data->next);
+
+      call->data = data;
+      call->result = g_object_ref (data->result);
+      call->index = data->next++;
+      data->in_flight++;
+
+      tp_cli_channel_interface_messages_call_send_message (
+          TP_CHANNEL (data->self), -1, message->parts, data->flags,
+          send_messages_cb, call, send_messages_call_free, NULL);
+    }
+}
+
+static void
+send_messages_cb (TpChannel *proxy,
+    const gchar *token,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  SendMessagesCall *call = user_data;
+  SendMessagesData *data = call->data;
+
+  if (error != NULL)
+    {
+      DEBUG ("Failed to send message %u: %s", call->index, error->message);
+
+      g_ptr_array_index (data->errors, call->index) = g_error_copy (error);
+    }
+  else if (!tp_str_empty (token))
+    {
+      g_ptr_array_index (data->tokens, call->index) = g_strdup (token);
+    }
+
+  data->in_flight--;
+  send_messages_next (data);
+
+  if (data->in_flight == 0 && data->next == data->messages->len)
+    g_simple_async_result_complete_in_idle (data->result);
+}
+
+/**
+ * tp_text_channel_send_messages_async:
+ * @self: a #TpTextChannel
+ * @n_messages: the number of messages in @messages
+ * @messages: (array length=n_messages): #TpClientMessage objects
+ * @flags: flags affecting how the messages are sent
+ * @max_in_flight: the largest number of messages which may be waiting to
+ *  be submitted to the server at any one time, or 0 for a reasonable
+ *  default
+ * @callback: a callback to call when all of the messages have been
+ *  submitted to the server, or have failed
+ * @user_data: data to pass to @callback
+ *
+ * Submit several messages to the server for sending, in order. This is
+ * equivalent to calling tp_text_channel_send_message_async() for each
+ * message, but up to @max_in_flight messages are given to the connection
+ * manager without waiting for earlier messages to be submitted. Connection
+ * managers may be able to send messages that arrive together in a single
+ * batch.
+ *
+ * Once every message has been submitted or has failed, @callback will
+ * be called. You can then call tp_text_channel_send_messages_finish() to
+ * get the result for each message.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_text_channel_send_messages_async (TpTextChannel *self,
+    guint n_messages,
+    TpMessage * const *messages,
+    TpMessageSendingFlags flags,
+    guint max_in_flight,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  SendMessagesData *data;
+  guint i;
+
+  g_return_if_fail (TP_IS_TEXT_CHANNEL (self));
+  g_return_if_fail (n_messages == 0 || messages != NULL);
+
+  for (i = 0; i < n_messages; i++)
+    g_return_if_fail (TP_IS_CLIENT_MESSAGE (messages[i]));
+
+  data = g_slice_new0 (SendMessagesData);
+  data->self = self;
+  data->messages = g_ptr_array_new_full (n_messages, g_object_unref);
+  data->flags = flags;
+  data->max_in_flight = (max_in_flight == 0 ? DEFAULT_MAX_MESSAGES_IN_FLIGHT
+      : max_in_flight);
+  data->tokens = g_ptr_array_new_full (n_messages, g_free);
+  data->errors = g_ptr_array_new_full (n_messages, error_free_if_set);
+
+  for (i = 0; i < n_messages; i++)
+    {
+      g_ptr_array_add (data->messages, g_object_ref (messages[i]));
+      g_ptr_array_add (data->tokens, NULL);
+      g_ptr_array_add (data->errors, NULL);
+    }
+
+  data->result = g_simple_async_result_new (G_OBJECT (self), callback,
+      user_data, tp_text_channel_send_messages_async);
+  g_simple_async_result_set_op_res_gpointer (data->result, data,
+      send_messages_data_free);
+
+  if (n_messages == 0)
+    g_simple_async_result_complete_in_idle (data->result);
+  else
+    send_messages_next (data);
+
+  /* from now on, the calls in flight keep it alive */
+  g_object_unref (data->result);
+}
+
+/**
+ * tp_text_channel_send_messages_finish:
+ * @self: a #TpTextChannel
+ * @result: a #GAsyncResult passed to the callback for
+ *  tp_text_channel_send_messages_async()
+ * @tokens: (out) (transfer full) (element-type utf8) (allow-none): if not
+ *  %NULL, used to return an array with the token of each sent message, as
+ *  for tp_text_channel_send_message_finish(), or %NULL for messages which
+ *  have no token or could not be sent
+ * @errors: (out) (transfer full) (element-type GLib.Error) (allow-none):
+ *  if not %NULL, used to return an array with the error for each message
+ *  which could not be sent, or %NULL for messages which were sent
+ * @error: a #GError to fill
+ *
+ * Completes a call to tp_text_channel_send_messages_async(). @tokens and
+ * @errors have one element for each message passed to
+ * tp_text_channel_send_messages_async(), in the same order, and are set
+ * even if this function returns %FALSE.
+ *
+ * Returns: %TRUE if every message has been submitted to the server;
+ *  otherwise %FALSE, with @error set to a copy of the first message's error
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_text_channel_send_messages_finish (TpTextChannel *self,
+    GAsyncResult *result,
+    GPtrArray **tokens,
+    GPtrArray **errors,
+    GError **error)
+{
+  SendMessagesData *data;
+  guint i;
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+          G_OBJECT (self), tp_text_channel_send_messages_async), FALSE);
+
+  data = g_simple_async_result_get_op_res_gpointer (
+      G_SIMPLE_ASYNC_RESULT (result));
+
+  if (tokens != NULL)
+    *tokens = g_ptr_array_ref (data->tokens);
+
+  if (errors != NULL)
+    *errors = g_ptr_array_ref (data->errors);
+
+  for (i = 0; i < data->errors->len; i++)
+    {
+      const GError *e = g_ptr_array_index (data->errors, i);
+
+      if (e != NULL)
+        {
+          g_set_error_literal (error, e->domain, e->code, e->message);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
 static void
 acknowledge_pending_messages_ready_cb (GObject *object,
     GAsyncResult *res,
@@ -1594,6 +2303,144 @@ tp_text_channel_ack_message_finish (TpTextChannel *self,
   _tp_implement_finish_void (self, tp_text_channel_ack_message_async)
 }
 
+static void
+get_pending_message_content_cb (TpChannel *channel,
+    GHashTable *contents,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GSimpleAsyncResult *result = user_data;
+  guint part = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (result),
+        "tp-text-channel-part"));
+  const GValue *value;
+  GBytes *bytes = NULL;
+
+  if (error != NULL)
+    {
+      DEBUG ("Failed to get message content: %s", error->message);
+
+      g_simple_async_result_set_from_error (result, error);
+      goto out;
+    }
+
+  value = g_hash_table_lookup (contents, GUINT_TO_POINTER (part));
+
+  if (value == NULL)
+    {
+      g_simple_async_result_set_error (result, TP_ERROR,
+          TP_ERROR_NOT_AVAILABLE, "Part %u has no content", part);
+    }
+  else if (G_VALUE_HOLDS (value, DBUS_TYPE_G_UCHAR_ARRAY))
+    {
+      GArray *array = g_value_get_boxed (value);
+
+      bytes = g_bytes_new (array->data, array->len);
+    }
+  else if (G_VALUE_HOLDS_STRING (value))
+    {
+      const gchar *text = g_value_get_string (value);
+
+      bytes = g_bytes_new (text, strlen (text));
+    }
+  else
+    {
+      g_simple_async_result_set_error (result, TP_ERROR,
+          TP_ERROR_NOT_AVAILABLE, "Content of part %u has unexpected type %s",
+          part, G_VALUE_TYPE_NAME (value));
+    }
+
+  if (bytes != NULL)
+    g_simple_async_result_set_op_res_gpointer (result, bytes,
+        (GDestroyNotify) g_bytes_unref);
+
+out:
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+/**
+ * tp_text_channel_get_pending_message_content_async:
+ * @self: a #TpTextChannel
+ * @message: a #TpSignalledMessage which is still pending
+ * @part: a part number, which must be strictly greater than 0 and less than
+ *  the number returned by tp_message_count_parts()
+ * @callback: a callback to call when the content has been retrieved
+ * @user_data: data to pass to @callback
+ *
+ * Retrieve the content of part @part of @message from the connection
+ * manager. This is needed for parts that have "needs-retrieval" set to
+ * %TRUE, such as large attachments, whose content is not included in the
+ * message when it is received; the part's "size" key, if present, says how
+ * big the content is.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_text_channel_get_pending_message_content_async (TpTextChannel *self,
+    TpMessage *message,
+    guint part,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  TpChannel *chan = (TpChannel *) self;
+  GSimpleAsyncResult *result;
+  GArray *parts;
+  guint id;
+  gboolean valid;
+
+  g_return_if_fail (TP_IS_TEXT_CHANNEL (self));
+  g_return_if_fail (TP_IS_SIGNALLED_MESSAGE (message));
+  g_return_if_fail (part > 0);
+  g_return_if_fail (part < tp_message_count_parts (message));
+
+  id = _tp_signalled_message_get_pending_message_id (message, &valid);
+  if (!valid)
+    {
+      g_simple_async_report_error_in_idle (G_OBJECT (self), callback, user_data,
+          TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+          "Message doesn't have a pending-message-id");
+
+      return;
+    }
+
+  result = g_simple_async_result_new (G_OBJECT (self), callback,
+      user_data, tp_text_channel_get_pending_message_content_async);
+  g_object_set_data (G_OBJECT (result), "tp-text-channel-part",
+      GUINT_TO_POINTER (part));
+
+  parts = g_array_sized_new (FALSE, FALSE, sizeof (guint), 1);
+  g_array_append_val (parts, part);
+
+  tp_cli_channel_interface_messages_call_get_pending_message_content (chan,
+      -1, id, parts, get_pending_message_content_cb, result, NULL,
+      G_OBJECT (self));
+
+  g_array_unref (parts);
+}
+
+/**
+ * tp_text_channel_get_pending_message_content_finish:
+ * @self: a #TpTextChannel
+ * @result: a #GAsyncResult passed to the callback for
+ *  tp_text_channel_get_pending_message_content_async()
+ * @error: a #GError to fill
+ *
+ * Finishes retrieving the content of a message part.
+ *
+ * Returns: (transfer full): the content of the part, or %NULL on error
+ *
+ * Since: 0.UNRELEASED
+ */
+GBytes *
+tp_text_channel_get_pending_message_content_finish (TpTextChannel *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  _tp_implement_finish_return_copy_pointer (self,
+      tp_text_channel_get_pending_message_content_async, g_bytes_ref)
+}
+
 /**
  * TP_TEXT_CHANNEL_FEATURE_CHAT_STATES:
  *
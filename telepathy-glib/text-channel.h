@@ -92,6 +92,16 @@ GList * tp_text_channel_get_pending_messages (TpTextChannel *self);
 
 _TP_AVAILABLE_IN_0_20
 GList * tp_text_channel_dup_pending_messages (TpTextChannel *self);
+_TP_AVAILABLE_IN_UNRELEASED
+const GList * tp_text_channel_peek_pending_messages (TpTextChannel *self);
+_TP_AVAILABLE_IN_UNRELEASED
+TpMessage * tp_text_channel_peek_pending_message_by_token (
+    TpTextChannel *self,
+    const gchar *token);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_text_channel_set_lazy_senders (TpTextChannel *self,
+    gboolean enabled);
 
 void tp_text_channel_send_message_async (TpTextChannel *self,
     TpMessage *message,
@@ -104,6 +114,22 @@ gboolean tp_text_channel_send_message_finish (TpTextChannel *self,
     gchar **token,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_text_channel_send_messages_async (TpTextChannel *self,
+    guint n_messages,
+    TpMessage * const *messages,
+    TpMessageSendingFlags flags,
+    guint max_in_flight,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_text_channel_send_messages_finish (TpTextChannel *self,
+    GAsyncResult *result,
+    GPtrArray **tokens,
+    GPtrArray **errors,
+    GError **error);
+
 void tp_text_channel_ack_messages_async (TpTextChannel *self,
     const GList *messages,
     GAsyncReadyCallback callback,
@@ -122,6 +148,19 @@ gboolean tp_text_channel_ack_message_finish (TpTextChannel *self,
     GAsyncResult *result,
     GError **error);
 
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_text_channel_get_pending_message_content_async (TpTextChannel *self,
+    TpMessage *message,
+    guint part,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+
+_TP_AVAILABLE_IN_UNRELEASED
+GBytes *tp_text_channel_get_pending_message_content_finish (
+    TpTextChannel *self,
+    GAsyncResult *result,
+    GError **error);
+
 _TP_AVAILABLE_IN_0_16
 void tp_text_channel_ack_all_pending_messages_async (TpTextChannel *self,
     GAsyncReadyCallback callback,
@@ -0,0 +1,47 @@
+/*<private_header>*/
+/* A hierarchical timer wheel shared by everything in a main context
+ * (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_TIMER_WHEEL_INTERNAL_H__
+#define __TP_TIMER_WHEEL_INTERNAL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the resolution of the timer wheel: timers fire up to this late, in
+ * batches, and never early */
+#define _TP_TIMER_WHEEL_TICK_MS 50
+
+/* Like g_timeout_add_full() at G_PRIORITY_DEFAULT, but sharing one
+ * GSource with every other such timer in @context (or the global default
+ * main context if %NULL); only call these from the thread that runs
+ * @context */
+guint _tp_timer_wheel_add (GMainContext *context,
+    guint interval_ms,
+    GSourceFunc function,
+    gpointer data,
+    GDestroyNotify notify);
+void _tp_timer_wheel_remove (GMainContext *context,
+    guint id);
+
+G_END_DECLS
+
+#endif
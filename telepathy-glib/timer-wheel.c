@@ -0,0 +1,508 @@
+/* A hierarchical timer wheel shared by everything in a main context
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/timer-wheel-internal.h"
+
+#define DEBUG_FLAG TP_DEBUG_MISC
+#include "telepathy-glib/debug-internal.h"
+
+/*
+ * A connection manager with thousands of connections has thousands of
+ * keepalive, reconnection and similar timeouts, nearly all of which are
+ * seconds or minutes away. As separate GSources, every iteration of the
+ * main loop looks at each of them; here they share one GSource per main
+ * context, whose ready time is the next tick at which anything is due.
+ *
+ * Time is divided into ticks of _TP_TIMER_WHEEL_TICK_MS. Each of N_LEVELS
+ * levels has N_SLOTS slots, the slots of level L each covering
+ * N_SLOTS ** L ticks, so the wheel as a whole covers WHEEL_SPAN ticks
+ * (about nine days); a timer further in the future than that is put in
+ * the furthest slot, and put back when it gets there. A timer due in
+ * fewer than N_SLOTS ** (L + 1) ticks goes in level L, in the slot for
+ * its due tick; as the wheel turns, each slot of level L > 0 is emptied
+ * into the levels below when its time comes, and each slot of level 0 is
+ * run. Adding or removing a timer is just a list operation, and every
+ * timer due in the same tick runs in the same dispatch.
+ */
+
+#define LEVEL_BITS 6
+#define N_SLOTS (1 << LEVEL_BITS)
+#define SLOT_MASK (N_SLOTS - 1)
+#define N_LEVELS 4
+#define WHEEL_SPAN (G_GUINT64_CONSTANT (1) << (LEVEL_BITS * N_LEVELS))
+#define TICK_USEC (_TP_TIMER_WHEEL_TICK_MS * G_GINT64_CONSTANT (1000))
+
+typedef struct _Link Link;
+
+/* a node in a circular doubly-linked list with a sentinel, so that a timer
+ * can be unlinked without knowing which list it is in */
+struct _Link {
+    Link *prev;
+    Link *next;
+};
+
+typedef struct {
+    /* first, so a Link * is a Timer *, except for the sentinels */
+    Link link;
+    guint id;
+    guint interval_ms;
+    /* the tick at which it is due */
+    guint64 expires;
+    guint8 level;
+    guint8 slot;
+    /* TRUE while its function is being called */
+    gboolean running;
+    /* TRUE if _tp_timer_wheel_remove() has been called while it was
+     * running */
+    gboolean removed;
+    GSourceFunc function;
+    gpointer data;
+    GDestroyNotify notify;
+} Timer;
+
+typedef struct {
+    GSource source;
+    GMainContext *context;
+    /* g_get_monotonic_time() at tick 0 */
+    gint64 origin;
+    /* every timer due at or before this tick has been run */
+    guint64 now;
+    /* owned guint id -> owned Timer */
+    GHashTable *timers;
+    /* bit i of occupied[L] is set if slots[L][i] is non-empty */
+    guint64 occupied[N_LEVELS];
+    Link slots[N_LEVELS][N_SLOTS];
+} Wheel;
+
+/* borrowed GMainContext -> borrowed Wheel, which is owned by the main
+ * context to which it is attached */
+static GHashTable *wheels = NULL;
+G_LOCK_DEFINE_STATIC (wheels);
+
+static gint last_id = 0;
+
+static inline void
+link_init (Link *link)
+{
+  link->prev = link;
+  link->next = link;
+}
+
+static inline gboolean
+link_is_empty (const Link *link)
+{
+  return (link->next == link);
+}
+
+static inline void
+link_append (Link *list,
+    Link *link)
+{
+  link->prev = list->prev;
+  link->next = list;
+  list->prev->next = link;
+  list->prev = link;
+}
+
+static inline void
+link_unlink (Link *link)
+{
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link_init (link);
+}
+
+/* Move every node in @from to the end of @to */
+static inline void
+link_splice (Link *to,
+    Link *from)
+{
+  if (link_is_empty (from))
+    return;
+
+  from->next->prev = to->prev;
+  from->prev->next = to;
+  to->prev->next = from->next;
+  to->prev = from->prev;
+  link_init (from);
+}
+
+/* @n must be non-zero */
+static inline guint
+lowest_bit64 (guint64 n)
+{
+  if ((guint32) n != 0)
+    return g_bit_nth_lsf ((guint32) n, -1);
+  else
+    return 32 + g_bit_nth_lsf ((guint32) (n >> 32), -1);
+}
+
+static void
+wheel_insert (Wheel *wheel,
+    Timer *timer)
+{
+  guint64 expires = MAX (timer->expires, wheel->now);
+  guint level;
+
+  if (expires - wheel->now >= WHEEL_SPAN)
+    expires = wheel->now + WHEEL_SPAN - 1;
+
+  for (level = 0; level < N_LEVELS - 1; level++)
+    {
+      if (expires - wheel->now <
+          (G_GUINT64_CONSTANT (1) << (LEVEL_BITS * (level + 1))))
+        break;
+    }
+
+  timer->level = level;
+  timer->slot = (expires >> (LEVEL_BITS * level)) & SLOT_MASK;
+  link_append (&wheel->slots[level][timer->slot], &timer->link);
+  wheel->occupied[level] |= G_GUINT64_CONSTANT (1) << timer->slot;
+}
+
+static void
+wheel_unlink (Wheel *wheel,
+    Timer *timer)
+{
+  link_unlink (&timer->link);
+
+  if (link_is_empty (&wheel->slots[timer->level][timer->slot]))
+    wheel->occupied[timer->level] &=
+      ~(G_GUINT64_CONSTANT (1) << timer->slot);
+}
+
+/* Move everything in @slot of @level > 0 into lower levels */
+static void
+wheel_cascade (Wheel *wheel,
+    guint level,
+    guint slot)
+{
+  Link pending;
+
+  link_init (&pending);
+  link_splice (&pending, &wheel->slots[level][slot]);
+  wheel->occupied[level] &= ~(G_GUINT64_CONSTANT (1) << slot);
+
+  while (!link_is_empty (&pending))
+    {
+      Timer *timer = (Timer *) pending.next;
+
+      link_unlink (&timer->link);
+      wheel_insert (wheel, timer);
+    }
+}
+
+static guint64
+ticks_from_now (Wheel *wheel,
+    gint64 now_usec,
+    guint interval_ms)
+{
+  gint64 due = now_usec + interval_ms * G_GINT64_CONSTANT (1000) -
+      wheel->origin;
+
+  /* round up, so a timer never fires early */
+  return MAX ((guint64) ((due + TICK_USEC - 1) / TICK_USEC), wheel->now + 1);
+}
+
+static void
+timer_free (Timer *timer)
+{
+  if (timer->notify != NULL)
+    timer->notify (timer->data);
+
+  g_slice_free (Timer, timer);
+}
+
+static void
+wheel_run (Wheel *wheel,
+    Timer *timer)
+{
+  gboolean again;
+
+  timer->running = TRUE;
+  again = timer->function (timer->data);
+  timer->running = FALSE;
+
+  if (timer->removed)
+    {
+      timer_free (timer);
+    }
+  else if (again)
+    {
+      timer->expires = ticks_from_now (wheel,
+          g_source_get_time (&wheel->source), timer->interval_ms);
+      wheel_insert (wheel, timer);
+    }
+  else
+    {
+      /* doesn't free it */
+      g_hash_table_steal (wheel->timers, GUINT_TO_POINTER (timer->id));
+      timer_free (timer);
+    }
+}
+
+/* Turn the wheel by one tick, running whatever is then due */
+static void
+wheel_advance (Wheel *wheel)
+{
+  Link pending;
+  guint level, slot;
+
+  wheel->now++;
+
+  /* find the levels whose current slot has just come round, and empty
+   * them from the top down, so that what comes down from one level to
+   * the next is included */
+  for (level = 1; level < N_LEVELS; level++)
+    {
+      if ((wheel->now &
+            ((G_GUINT64_CONSTANT (1) << (LEVEL_BITS * level)) - 1)) != 0)
+        break;
+    }
+
+  while (--level > 0)
+    wheel_cascade (wheel, level,
+        (wheel->now >> (LEVEL_BITS * level)) & SLOT_MASK);
+
+  slot = wheel->now & SLOT_MASK;
+  link_init (&pending);
+  link_splice (&pending, &wheel->slots[0][slot]);
+  wheel->occupied[0] &= ~(G_GUINT64_CONSTANT (1) << slot);
+
+  /* a function can remove timers that are still pending, since unlinking
+   * doesn't need to know which list they're in */
+  while (!link_is_empty (&pending))
+    {
+      Timer *timer = (Timer *) pending.next;
+
+      link_unlink (&timer->link);
+      wheel_run (wheel, timer);
+    }
+}
+
+/* Return the next tick at which something must be run or cascaded, or
+ * G_MAXUINT64 if the wheel is empty */
+static guint64
+wheel_next_tick (Wheel *wheel)
+{
+  guint64 best = G_MAXUINT64;
+  guint level;
+
+  for (level = 0; level < N_LEVELS; level++)
+    {
+      guint shift = LEVEL_BITS * level;
+      guint64 bits = wheel->occupied[level];
+      guint64 base;
+      guint r;
+
+      if (bits == 0)
+        continue;
+
+      /* slot i of this level next comes round in the first period
+       * >= base whose index is i */
+      base = (wheel->now >> shift) + 1;
+      r = base & SLOT_MASK;
+      bits = (bits >> r) | (bits << ((N_SLOTS - r) & SLOT_MASK));
+      best = MIN (best, (base + lowest_bit64 (bits)) << shift);
+    }
+
+  return best;
+}
+
+static void
+wheel_update_ready_time (Wheel *wheel)
+{
+  guint64 next = wheel_next_tick (wheel);
+
+  if (next == G_MAXUINT64)
+    g_source_set_ready_time (&wheel->source, -1);
+  else
+    g_source_set_ready_time (&wheel->source,
+        wheel->origin + (gint64) next * TICK_USEC);
+}
+
+static gboolean
+wheel_dispatch (GSource *source,
+    GSourceFunc callback G_GNUC_UNUSED,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  Wheel *wheel = (Wheel *) source;
+  guint64 target = (g_source_get_time (source) - wheel->origin) / TICK_USEC;
+
+  while (wheel->now < target)
+    {
+      /* after a long sleep with nothing to do, don't turn the wheel
+       * round and round */
+      if (g_hash_table_size (wheel->timers) == 0)
+        wheel->now = target;
+      else
+        wheel_advance (wheel);
+    }
+
+  wheel_update_ready_time (wheel);
+  return TRUE;
+}
+
+static void
+wheel_finalize (GSource *source)
+{
+  Wheel *wheel = (Wheel *) source;
+  GHashTableIter iter;
+  gpointer v;
+
+  G_LOCK (wheels);
+  g_hash_table_remove (wheels, wheel->context);
+  G_UNLOCK (wheels);
+
+  /* the main context is going away, so these will never run */
+  g_hash_table_iter_init (&iter, wheel->timers);
+
+  while (g_hash_table_iter_next (&iter, NULL, &v))
+    {
+      g_hash_table_iter_steal (&iter);
+      timer_free (v);
+    }
+
+  g_hash_table_unref (wheel->timers);
+}
+
+static GSourceFuncs wheel_funcs = {
+    NULL,
+    NULL,
+    wheel_dispatch,
+    wheel_finalize
+};
+
+static Wheel *
+wheel_dup_for_context (GMainContext *context)
+{
+  Wheel *wheel;
+  guint level, slot;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  G_LOCK (wheels);
+
+  if (wheels == NULL)
+    wheels = g_hash_table_new (NULL, NULL);
+
+  wheel = g_hash_table_lookup (wheels, context);
+
+  if (wheel == NULL)
+    {
+      wheel = (Wheel *) g_source_new (&wheel_funcs, sizeof (Wheel));
+      wheel->context = context;
+      wheel->origin = g_get_monotonic_time ();
+      wheel->now = 0;
+      wheel->timers = g_hash_table_new (NULL, NULL);
+
+      for (level = 0; level < N_LEVELS; level++)
+        {
+          wheel->occupied[level] = 0;
+
+          for (slot = 0; slot < N_SLOTS; slot++)
+            link_init (&wheel->slots[level][slot]);
+        }
+
+      g_source_set_priority (&wheel->source, G_PRIORITY_DEFAULT);
+      g_source_set_ready_time (&wheel->source, -1);
+      g_source_attach (&wheel->source, context);
+      g_hash_table_insert (wheels, context, wheel);
+      DEBUG ("new timer wheel for main context %p", context);
+    }
+  else
+    {
+      g_source_ref (&wheel->source);
+    }
+
+  G_UNLOCK (wheels);
+  return wheel;
+}
+
+guint
+_tp_timer_wheel_add (GMainContext *context,
+    guint interval_ms,
+    GSourceFunc function,
+    gpointer data,
+    GDestroyNotify notify)
+{
+  Wheel *wheel;
+  Timer *timer;
+
+  g_return_val_if_fail (function != NULL, 0);
+
+  wheel = wheel_dup_for_context (context);
+
+  timer = g_slice_new0 (Timer);
+  link_init (&timer->link);
+
+  do
+    timer->id = (guint) g_atomic_int_add (&last_id, 1) + 1;
+  while (timer->id == 0);
+
+  timer->interval_ms = interval_ms;
+  timer->expires = ticks_from_now (wheel, g_get_monotonic_time (),
+      interval_ms);
+  timer->function = function;
+  timer->data = data;
+  timer->notify = notify;
+
+  g_hash_table_insert (wheel->timers, GUINT_TO_POINTER (timer->id), timer);
+  wheel_insert (wheel, timer);
+  wheel_update_ready_time (wheel);
+
+  g_source_unref (&wheel->source);
+  return timer->id;
+}
+
+void
+_tp_timer_wheel_remove (GMainContext *context,
+    guint id)
+{
+  Wheel *wheel = wheel_dup_for_context (context);
+  Timer *timer = g_hash_table_lookup (wheel->timers, GUINT_TO_POINTER (id));
+
+  if (timer == NULL)
+    {
+      CRITICAL ("no timer %u in main context %p", id, context);
+      goto finally;
+    }
+
+  g_hash_table_steal (wheel->timers, GUINT_TO_POINTER (id));
+
+  if (timer->running)
+    {
+      /* wheel_run() will free it */
+      timer->removed = TRUE;
+    }
+  else
+    {
+      wheel_unlink (wheel, timer);
+      timer_free (timer);
+    }
+
+  /* the ready time is left alone, since waking up once with nothing to
+   * do is cheaper than working out when to wake up instead */
+
+finally:
+  g_source_unref (&wheel->source);
+}
@@ -23,6 +23,8 @@
 #include <config.h>
 #include "telepathy-glib/tls-certificate.h"
 
+#include <string.h>
+
 #include <glib/gstdio.h>
 
 #include <telepathy-glib/_gen/tp-cli-tls-cert.h>
@@ -90,11 +92,33 @@ struct _TpTLSCertificatePrivate {
   GPtrArray *rejections;
   /* GPtrArray of TP_STRUCT_TYPE_TLS_CERTIFICATE_REJECTION to send to CM */
   GPtrArray *pending_rejections;
+  /* computed on demand from cert_type and cert_data */
+  gchar *fingerprint;
 };
 
+/* A previous verifier's decision about a certificate chain */
+typedef struct {
+    gboolean accepted;
+    /* g_get_monotonic_time() after which this is forgotten */
+    gint64 expires;
+} Verdict;
+
+G_LOCK_DEFINE_STATIC (verdicts);
+/* owned "fingerprint\nidentity\nidentity..." => owned Verdict */
+static GHashTable *verdicts = NULL;
+
+/* don't bother looking for expired verdicts until there are this many */
+#define VERDICTS_PRUNE_THRESHOLD 64
+
 G_DEFINE_TYPE (TpTLSCertificate, tp_tls_certificate,
     TP_TYPE_PROXY)
 
+static void
+verdict_free (gpointer p)
+{
+  g_slice_free (Verdict, p);
+}
+
 /**
  * TP_TLS_CERTIFICATE_FEATURE_CORE:
  *
@@ -347,6 +371,7 @@ tp_tls_certificate_finalize (GObject *object)
 
   tp_clear_pointer (&self->priv->rejections, g_ptr_array_unref);
   g_free (priv->cert_type);
+  g_free (priv->fingerprint);
   if (priv->cert_data != NULL)
     g_ptr_array_unref (priv->cert_data);
   tp_clear_boxed (TP_ARRAY_TYPE_TLS_CERTIFICATE_REJECTION_LIST,
@@ -919,6 +944,265 @@ tp_tls_certificate_get_cert_data (TpTLSCertificate *self)
   return self->priv->cert_data;
 }
 
+/**
+ * tp_tls_certificate_get_chain_fingerprint:
+ * @self: a #TpTLSCertificate
+ *
+ * Return a stable identifier for the certificate chain in
+ * #TpTLSCertificate:cert-data, of type #TpTLSCertificate:cert-type.
+ * Two #TpTLSCertificate objects have the same fingerprint if and only if
+ * (barring hash collisions) they have identical chains of the same type,
+ * even if they belong to different connections or processes. This is
+ * suitable for remembering that a chain has already been checked; see
+ * tp_tls_certificate_remember_verdict().
+ *
+ * The fingerprint is a lower-case hexadecimal SHA-256 digest, but callers
+ * should treat it as opaque.
+ *
+ * Returns: the fingerprint, or %NULL if %TP_TLS_CERTIFICATE_FEATURE_CORE
+ *  has not been prepared
+ *
+ * Since: 0.UNRELEASED
+ */
+const gchar *
+tp_tls_certificate_get_chain_fingerprint (TpTLSCertificate *self)
+{
+  GChecksum *checksum;
+  guint i;
+
+  g_return_val_if_fail (TP_IS_TLS_CERTIFICATE (self), NULL);
+
+  if (self->priv->fingerprint != NULL)
+    return self->priv->fingerprint;
+
+  if (self->priv->cert_data == NULL)
+    return NULL;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+  /* the type, and each certificate, are prefixed with their lengths so
+   * that different chains can't produce the same input */
+  for (i = 0; i <= self->priv->cert_data->len; i++)
+    {
+      gconstpointer data;
+      gsize len;
+      guint32 len_be;
+
+      if (i == 0)
+        {
+          data = self->priv->cert_type;
+          len = (data == NULL ? 0 : strlen (data));
+        }
+      else
+        {
+          data = g_bytes_get_data (
+              g_ptr_array_index (self->priv->cert_data, i - 1), &len);
+        }
+
+      len_be = GUINT32_TO_BE ((guint32) len);
+      g_checksum_update (checksum, (const guchar *) &len_be,
+          sizeof (len_be));
+
+      if (len > 0)
+        g_checksum_update (checksum, data, len);
+    }
+
+  self->priv->fingerprint = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  return self->priv->fingerprint;
+}
+
+static gint
+str_ptr_cmp (gconstpointer a,
+    gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/* Returns: a key for verdicts, or %NULL if @self is not prepared */
+static gchar *
+verdict_key (TpTLSCertificate *self,
+    const gchar * const *reference_identities)
+{
+  const gchar *fingerprint = tp_tls_certificate_get_chain_fingerprint (self);
+  GPtrArray *sorted;
+  GString *key;
+  guint i;
+
+  if (fingerprint == NULL)
+    return NULL;
+
+  /* the order of the identities doesn't change the result of
+   * verification */
+  sorted = g_ptr_array_new ();
+
+  for (i = 0; reference_identities != NULL &&
+      reference_identities[i] != NULL; i++)
+    g_ptr_array_add (sorted, (gpointer) reference_identities[i]);
+
+  g_ptr_array_sort (sorted, str_ptr_cmp);
+
+  key = g_string_new (fingerprint);
+
+  for (i = 0; i < sorted->len; i++)
+    {
+      g_string_append_c (key, '\n');
+      g_string_append (key, g_ptr_array_index (sorted, i));
+    }
+
+  g_ptr_array_unref (sorted);
+  return g_string_free (key, FALSE);
+}
+
+/**
+ * tp_tls_certificate_remember_verdict:
+ * @self: a #TpTLSCertificate with %TP_TLS_CERTIFICATE_FEATURE_CORE
+ *  prepared
+ * @reference_identities: (array zero-terminated=1) (allow-none): the
+ *  identities against which @self was verified, in any order
+ * @accepted: %TRUE if the chain was found to be valid for
+ *  @reference_identities, %FALSE if it was rejected
+ * @lifetime_seconds: how long to remember this verdict
+ *
+ * Remember, for the rest of this process's lifetime or until
+ * @lifetime_seconds have passed, that a verifier has checked @self's
+ * certificate chain against @reference_identities. A verifier which is
+ * presented with an identical chain for the same identities, for instance
+ * when an account reconnects, can find this with
+ * tp_tls_certificate_lookup_verdict() and skip the expensive verification.
+ *
+ * A later verdict for the same chain and identities replaces an earlier one.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_tls_certificate_remember_verdict (TpTLSCertificate *self,
+    const gchar * const *reference_identities,
+    gboolean accepted,
+    guint lifetime_seconds)
+{
+  gchar *key;
+  Verdict *verdict;
+  gint64 now = g_get_monotonic_time ();
+
+  g_return_if_fail (TP_IS_TLS_CERTIFICATE (self));
+
+  key = verdict_key (self, reference_identities);
+  g_return_if_fail (key != NULL);
+
+  verdict = g_slice_new (Verdict);
+  verdict->accepted = accepted;
+  verdict->expires = now + (gint64) lifetime_seconds * G_USEC_PER_SEC;
+
+  G_LOCK (verdicts);
+
+  if (verdicts == NULL)
+    {
+      verdicts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+          verdict_free);
+    }
+  else if (g_hash_table_size (verdicts) >= VERDICTS_PRUNE_THRESHOLD)
+    {
+      GHashTableIter iter;
+      gpointer v;
+
+      g_hash_table_iter_init (&iter, verdicts);
+
+      while (g_hash_table_iter_next (&iter, NULL, &v))
+        {
+          if (((Verdict *) v)->expires <= now)
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+  DEBUG ("remembering that %s was %s for %u seconds", key,
+      accepted ? "accepted" : "rejected", lifetime_seconds);
+  g_hash_table_insert (verdicts, key, verdict);
+
+  G_UNLOCK (verdicts);
+}
+
+/**
+ * tp_tls_certificate_lookup_verdict:
+ * @self: a #TpTLSCertificate with %TP_TLS_CERTIFICATE_FEATURE_CORE
+ *  prepared
+ * @reference_identities: (array zero-terminated=1) (allow-none): the
+ *  identities against which @self is to be verified, in any order
+ * @accepted: (out) (allow-none): used to return %TRUE if an identical
+ *  chain was previously accepted for @reference_identities, or %FALSE if
+ *  it was rejected
+ *
+ * Look for a verdict passed to tp_tls_certificate_remember_verdict() for
+ * any certificate with the same chain as @self, and the same
+ * @reference_identities, which has not yet expired.
+ *
+ * Returns: %TRUE if such a verdict was found, in which case @accepted is
+ *  set; %FALSE if @self must be verified in full
+ *
+ * Since: 0.UNRELEASED
+ */
+gboolean
+tp_tls_certificate_lookup_verdict (TpTLSCertificate *self,
+    const gchar * const *reference_identities,
+    gboolean *accepted)
+{
+  gchar *key;
+  Verdict *verdict = NULL;
+  gboolean found = FALSE;
+
+  g_return_val_if_fail (TP_IS_TLS_CERTIFICATE (self), FALSE);
+
+  key = verdict_key (self, reference_identities);
+
+  if (key == NULL)
+    return FALSE;
+
+  G_LOCK (verdicts);
+
+  if (verdicts != NULL)
+    verdict = g_hash_table_lookup (verdicts, key);
+
+  if (verdict != NULL && verdict->expires <= g_get_monotonic_time ())
+    {
+      g_hash_table_remove (verdicts, key);
+      verdict = NULL;
+    }
+
+  if (verdict != NULL)
+    {
+      found = TRUE;
+
+      if (accepted != NULL)
+        *accepted = verdict->accepted;
+    }
+
+  G_UNLOCK (verdicts);
+
+  g_free (key);
+  return found;
+}
+
+/**
+ * tp_tls_certificate_forget_verdicts:
+ *
+ * Forget all verdicts passed to tp_tls_certificate_remember_verdict(),
+ * for instance because the set of trusted certificate authorities has
+ * changed.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_tls_certificate_forget_verdicts (void)
+{
+  G_LOCK (verdicts);
+
+  if (verdicts != NULL)
+    g_hash_table_remove_all (verdicts);
+
+  G_UNLOCK (verdicts);
+}
+
 /**
  * tp_tls_certificate_get_state:
  * @self: a #TpTLSCertificate
@@ -126,6 +126,22 @@ GPtrArray * tp_tls_certificate_get_cert_data (TpTLSCertificate *self);
 _TP_AVAILABLE_IN_0_20
 TpTLSCertificateState tp_tls_certificate_get_state (TpTLSCertificate *self);
 
+_TP_AVAILABLE_IN_UNRELEASED
+const gchar *tp_tls_certificate_get_chain_fingerprint (
+    TpTLSCertificate *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_tls_certificate_remember_verdict (TpTLSCertificate *self,
+    const gchar * const *reference_identities,
+    gboolean accepted,
+    guint lifetime_seconds);
+_TP_AVAILABLE_IN_UNRELEASED
+gboolean tp_tls_certificate_lookup_verdict (TpTLSCertificate *self,
+    const gchar * const *reference_identities,
+    gboolean *accepted);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_tls_certificate_forget_verdicts (void);
+
 G_END_DECLS
 
 #endif /* multiple-inclusion guard */
@@ -0,0 +1,74 @@
+/*<private_header>*/
+/* Spans recording the latency of D-Bus method calls (internal)
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TP_TRACING_INTERNAL_H__
+#define __TP_TRACING_INTERNAL_H__
+
+#include <glib.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    TP_TRACE_SIDE_CLIENT,
+    TP_TRACE_SIDE_SERVICE,
+    /* preparing a TpProxy feature: the "iface" is the proxy's type name and
+     * the "member" is the feature */
+    TP_TRACE_SIDE_PREPARE
+} TpTraceSide;
+
+/* Only meant to be read directly, to avoid doing any work when tracing is
+ * off; use tp_debug_set_tracing() to change it */
+extern gboolean _tp_tracing_enabled;
+
+#define _tp_tracing_is_enabled() G_UNLIKELY (_tp_tracing_enabled)
+
+void _tp_trace_record (TpTraceSide side,
+    const gchar *iface,
+    const gchar *member,
+    guint32 serial,
+    gint64 start,
+    gint64 queue_usec,
+    gint64 run_usec);
+
+/* Called by the generated TpSvc code around each method implementation,
+ * instead of each unimplemented method, and before emitting each signal;
+ * these feed the metrics as well as the tracing spans. The last one also
+ * emits any PropertiesChanged signals that @instance has deferred, so that
+ * they keep their place relative to its other signals */
+gpointer _tp_svc_trace_begin (DBusGMethodInvocation *context,
+    const gchar *iface,
+    const gchar *member);
+/* The same, for calls dispatched to a GVariant-based implementation,
+ * where the call itself is available */
+gpointer _tp_svc_trace_begin_message (DBusMessage *call,
+    const gchar *iface,
+    const gchar *member);
+void _tp_svc_trace_end (gpointer span);
+void _tp_svc_trace_unimplemented (const gchar *iface,
+    const gchar *member);
+void _tp_svc_trace_signal (gpointer instance,
+    const gchar *iface,
+    const gchar *member);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,515 @@
+/* Spans recording the latency of D-Bus method calls
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/tracing-internal.h"
+#include "telepathy-glib/metrics-internal.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include <telepathy-glib/dbus-properties-mixin.h>
+#include <telepathy-glib/debug.h>
+
+/*
+ * Each span is written into the next slot of a fixed-size ring, which is
+ * claimed with an atomic increment, so recording never takes a lock.
+ * Each slot has a sequence number which is odd while it's being written,
+ * so that tp_debug_dup_trace_events() can skip slots that are being
+ * overwritten under its feet.
+ */
+
+/* must be a power of two, so that the index wraps around cleanly */
+#define RING_SIZE 4096
+
+typedef struct {
+    volatile gint seq;
+    TpTraceSide side;
+    /* static or interned */
+    const gchar *iface;
+    const gchar *member;
+    guint32 serial;
+    guint thread;
+    /* g_get_monotonic_time() */
+    gint64 start;
+    gint64 queue_usec;
+    gint64 run_usec;
+} TraceSpan;
+
+typedef struct {
+    const gchar *iface;
+    const gchar *member;
+    guint32 serial;
+    gint64 start;
+} SvcSpan;
+
+gboolean _tp_tracing_enabled = FALSE;
+
+/* allocated the first time tracing is enabled, and never freed, so that a
+ * thread that is still recording a span can't write into freed memory */
+static TraceSpan *ring = NULL;
+static volatile gint next_slot = 0;
+
+/**
+ * tp_debug_set_tracing:
+ * @enabled: %TRUE to start recording spans, %FALSE to stop
+ *
+ * Start or stop recording a span for each D-Bus method call made by a
+ * #TpProxy, and for each D-Bus method call dispatched to a service-side
+ * object's TpSvc interface implementation.
+ *
+ * Client-side spans last from the call being made until the reply
+ * arrives; the time for which the reply then waited in the main loop
+ * before its callback ran is recorded as the queue time. Service-side
+ * spans last for as long as the method's implementation runs, but do
+ * not include any time for which an asynchronous implementation waits
+ * before replying. Service-side spans also record the serial number of the
+ * method call message; client-side spans do not, because dbus-glib does
+ * not make it available.
+ *
+ * A span is also recorded for the preparation of each #TpProxy feature,
+ * from the time at which its dependencies and interfaces allowed it to
+ * start until it was prepared or failed. Its name is the proxy's type
+ * name and the feature's name, for instance
+ * <literal>TpConnection.tp-connection-feature-balance</literal>.
+ *
+ * The most recent few thousand spans are kept, and can be retrieved with
+ * tp_debug_dup_trace_events(). Stopping does not discard them.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_debug_set_tracing (gboolean enabled)
+{
+  if (enabled && g_atomic_pointer_get (&ring) == NULL)
+    {
+      TraceSpan *new_ring = g_new0 (TraceSpan, RING_SIZE);
+
+      if (!g_atomic_pointer_compare_and_exchange (&ring, NULL, new_ring))
+        g_free (new_ring);
+    }
+
+  _tp_tracing_enabled = enabled;
+}
+
+void
+_tp_trace_record (TpTraceSide side,
+    const gchar *iface,
+    const gchar *member,
+    guint32 serial,
+    gint64 start,
+    gint64 queue_usec,
+    gint64 run_usec)
+{
+  TraceSpan *ringp = g_atomic_pointer_get (&ring);
+  TraceSpan *span;
+
+  if (ringp == NULL)
+    return;
+
+  span = ringp + ((guint) g_atomic_int_add (&next_slot, 1) % RING_SIZE);
+
+  g_atomic_int_inc (&span->seq);
+  span->side = side;
+  span->iface = iface;
+  span->member = member;
+  span->serial = serial;
+  span->thread = GPOINTER_TO_UINT (g_thread_self ());
+  span->start = start;
+  span->queue_usec = queue_usec;
+  span->run_usec = run_usec;
+  g_atomic_int_inc (&span->seq);
+}
+
+static gpointer
+svc_span_new (const gchar *iface,
+    const gchar *member,
+    guint32 serial)
+{
+  SvcSpan *span = g_slice_new (SvcSpan);
+
+  span->iface = iface;
+  span->member = member;
+  span->serial = serial;
+  span->start = g_get_monotonic_time ();
+  return span;
+}
+
+gpointer
+_tp_svc_trace_begin (DBusGMethodInvocation *context,
+    const gchar *iface,
+    const gchar *member)
+{
+  guint32 serial = 0;
+
+  if (!_tp_tracing_is_enabled () && !_tp_metrics_are_enabled ())
+    return NULL;
+
+  if (_tp_tracing_is_enabled ())
+    {
+      /* dbus-glib doesn't give us the method call itself, but the reply it
+       * would send refers to it by serial */
+      DBusMessage *reply = dbus_g_method_get_reply (context);
+
+      serial = dbus_message_get_reply_serial (reply);
+      dbus_message_unref (reply);
+    }
+
+  return svc_span_new (iface, member, serial);
+}
+
+gpointer
+_tp_svc_trace_begin_message (DBusMessage *call,
+    const gchar *iface,
+    const gchar *member)
+{
+  if (!_tp_tracing_is_enabled () && !_tp_metrics_are_enabled ())
+    return NULL;
+
+  /* the names come from the message, so they have to be interned to
+   * outlive it */
+  return svc_span_new (g_intern_string (iface), g_intern_string (member),
+      dbus_message_get_serial (call));
+}
+
+void
+_tp_svc_trace_end (gpointer p)
+{
+  SvcSpan *span = p;
+  gint64 run_usec;
+
+  if (span == NULL)
+    return;
+
+  run_usec = g_get_monotonic_time () - span->start;
+
+  if (_tp_tracing_is_enabled ())
+    _tp_trace_record (TP_TRACE_SIDE_SERVICE, span->iface, span->member,
+        span->serial, span->start, 0, run_usec);
+
+  if (_tp_metrics_are_enabled ())
+    _tp_metrics_record_call (span->iface, span->member, run_usec);
+
+  g_slice_free (SvcSpan, span);
+}
+
+void
+_tp_svc_trace_unimplemented (const gchar *iface,
+    const gchar *member)
+{
+  if (_tp_metrics_are_enabled ())
+    _tp_metrics_record_unimplemented (iface, member);
+}
+
+void
+_tp_svc_trace_signal (gpointer instance,
+    const gchar *iface,
+    const gchar *member)
+{
+  tp_dbus_properties_mixin_flush_properties_changed (instance);
+
+  if (_tp_metrics_are_enabled ())
+    _tp_metrics_record_signal (iface, member);
+}
+
+static const gchar *
+trace_side_to_category (TpTraceSide side)
+{
+  switch (side)
+    {
+      case TP_TRACE_SIDE_CLIENT:
+        return "client";
+      case TP_TRACE_SIDE_SERVICE:
+        return "service";
+      case TP_TRACE_SIDE_PREPARE:
+        return "prepare";
+    }
+
+  g_return_val_if_reached ("");
+}
+
+/* copies of the completely-written spans in the ring, in no particular
+ * order */
+static GArray *
+dup_spans (void)
+{
+  TraceSpan *ringp = g_atomic_pointer_get (&ring);
+  GArray *spans = g_array_new (FALSE, FALSE, sizeof (TraceSpan));
+  guint i;
+
+  for (i = 0; ringp != NULL && i < RING_SIZE; i++)
+    {
+      TraceSpan copy;
+      gint seq = g_atomic_int_get (&ringp[i].seq);
+
+      /* never written, or being written right now */
+      if (seq == 0 || (seq & 1) != 0)
+        continue;
+
+      copy = ringp[i];
+
+      if (g_atomic_int_get (&ringp[i].seq) != seq)
+        continue;
+
+      g_array_append_val (spans, copy);
+    }
+
+  return spans;
+}
+
+/**
+ * tp_debug_dup_trace_events:
+ *
+ * Return the spans recorded since tp_debug_set_tracing() was first
+ * called, as a JSON document in the Trace Event Format used by Chrome's
+ * about:tracing and by Perfetto.
+ *
+ * Timestamps are taken from the monotonic clock, as returned by
+ * g_get_monotonic_time(), which is shared by all processes on the same
+ * machine; so the traces from a user interface and from the connection
+ * managers it talks to can be merged by concatenating their
+ * <literal>traceEvents</literal> arrays.
+ *
+ * Returns: (transfer full): the recorded spans, as JSON
+ *
+ * Since: 0.UNRELEASED
+ */
+gchar *
+tp_debug_dup_trace_events (void)
+{
+  GArray *spans = dup_spans ();
+  GString *json = g_string_new ("{\"traceEvents\":[");
+  guint pid = 0;
+  guint i;
+
+#ifdef HAVE_UNISTD_H
+  pid = getpid ();
+#endif
+
+  for (i = 0; i < spans->len; i++)
+    {
+      const TraceSpan *span = &g_array_index (spans, TraceSpan, i);
+
+      /* D-Bus names, type names and feature names never need escaping in
+       * JSON */
+      g_string_append_printf (json,
+          "%s\n{\"name\":\"%s.%s\",\"cat\":\"%s\",\"ph\":\"X\","
+          "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ","
+          "\"pid\":%u,\"tid\":%u,"
+          "\"args\":{\"serial\":%u,\"queue_us\":%" G_GINT64_FORMAT "}}",
+          i == 0 ? "" : ",", span->iface, span->member,
+          trace_side_to_category (span->side),
+          span->start, span->run_usec, pid, span->thread, span->serial,
+          span->queue_usec);
+    }
+
+  g_array_unref (spans);
+  g_string_append (json, "\n]}\n");
+  return g_string_free (json, FALSE);
+}
+
+/* when the caller was able to carry on: a method call's callback runs
+ * after its reply has waited in the main loop */
+static gint64
+span_end (const TraceSpan *span)
+{
+  return span->start + span->run_usec + span->queue_usec;
+}
+
+/*
+ * Append to @path the spans that serialized the interval [@lo, @hi],
+ * latest first: the span that finished last within it, then the span
+ * that finished last before that one started, and so on. Spans which
+ * overlap the chosen span ran in parallel with it, so they are not on
+ * the path. @outer is the span whose interval this is, if any, which is
+ * not a candidate itself.
+ */
+static void
+find_path (GArray *spans,
+    const TraceSpan *outer,
+    gint64 lo,
+    gint64 hi,
+    GPtrArray *path)
+{
+  while (TRUE)
+    {
+      const TraceSpan *best = NULL;
+      guint i;
+
+      for (i = 0; i < spans->len; i++)
+        {
+          const TraceSpan *span = &g_array_index (spans, TraceSpan, i);
+
+          if (span == outer || span->start < lo || span_end (span) > hi)
+            continue;
+
+          /* of two spans which end together, the outer one is the one
+           * that was waited for */
+          if (best == NULL || span_end (span) > span_end (best) ||
+              (span_end (span) == span_end (best) &&
+               span->start < best->start))
+            best = span;
+        }
+
+      if (best == NULL)
+        return;
+
+      g_ptr_array_add (path, (gpointer) best);
+      hi = best->start;
+    }
+}
+
+static void
+append_path (GString *report,
+    GArray *spans,
+    const TraceSpan *outer,
+    gint64 lo,
+    gint64 hi,
+    gint64 origin,
+    guint depth,
+    gint64 *in_calls,
+    gint64 *queued)
+{
+  GPtrArray *path = g_ptr_array_new ();
+  gint64 previous_end = lo;
+  guint i;
+
+  find_path (spans, outer, lo, hi, path);
+
+  for (i = path->len; i > 0; i--)
+    {
+      const TraceSpan *span = g_ptr_array_index (path, i - 1);
+
+      if (span->start > previous_end)
+        g_string_append_printf (report, "%*s%+10" G_GINT64_FORMAT
+            " %10" G_GINT64_FORMAT "  (untraced)\n", depth * 2, "",
+            previous_end - origin, span->start - previous_end);
+
+      g_string_append_printf (report, "%*s%+10" G_GINT64_FORMAT
+          " %10" G_GINT64_FORMAT "  %s %s.%s", depth * 2, "",
+          span->start - origin, span_end (span) - span->start,
+          trace_side_to_category (span->side), span->iface, span->member);
+
+      if (span->queue_usec > 0)
+        g_string_append_printf (report, " (queued %" G_GINT64_FORMAT ")",
+            span->queue_usec);
+
+      g_string_append_c (report, '\n');
+
+      /* a feature's preparation is made up of the method calls it made
+       * and the other features it waited for; a method call is only
+       * made up of its service side, if it was in this process, which
+       * is not what we're interested in */
+      if (span->side == TP_TRACE_SIDE_PREPARE)
+        {
+          append_path (report, spans, span, span->start, span_end (span),
+              origin, depth + 1, in_calls, queued);
+        }
+      else if (span->side == TP_TRACE_SIDE_CLIENT)
+        {
+          *in_calls += span->run_usec;
+          *queued += span->queue_usec;
+        }
+
+      previous_end = span_end (span);
+    }
+
+  g_ptr_array_unref (path);
+}
+
+/**
+ * tp_debug_dup_trace_critical_path:
+ *
+ * Return a report of the critical path through the spans recorded since
+ * tp_debug_set_tracing() was first called: the chain of method calls
+ * and feature preparations, each of which only started once the one
+ * before it had finished, that ends with the last span to finish. This
+ * is what serializes a sequence like a client's startup; shortening
+ * anything that is not on the critical path will not make it any faster.
+ *
+ * The path is inferred from timing alone, so a span which happened to
+ * finish just before another started is assumed to be what it was
+ * waiting for. Each feature preparation on the path is broken down in
+ * the same way, indented below it. Each line gives the offset of the
+ * start of a span from the start of the path and its duration, in
+ * microseconds, including the time for which a method call's reply
+ * waited in the main loop before its callback ran; gaps in the path,
+ * during which nothing that is traced was running, are shown as
+ * <literal>(untraced)</literal>.
+ *
+ * Only the spans recorded in this process are considered, and only the
+ * most recent few thousand of them are kept.
+ *
+ * Returns: (transfer full): a human-readable report
+ *
+ * Since: 0.UNRELEASED
+ */
+gchar *
+tp_debug_dup_trace_critical_path (void)
+{
+  GArray *spans = dup_spans ();
+  GString *report = g_string_new ("");
+  gint64 lo = G_MAXINT64;
+  gint64 hi = G_MININT64;
+  gint64 in_calls = 0;
+  gint64 queued = 0;
+  guint i;
+
+  /* the service side of calls to other processes isn't in our spans, so
+   * for consistency ignore the service side of calls to this one */
+  for (i = spans->len; i > 0; i--)
+    {
+      const TraceSpan *span = &g_array_index (spans, TraceSpan, i - 1);
+
+      if (span->side == TP_TRACE_SIDE_SERVICE)
+        g_array_remove_index_fast (spans, i - 1);
+    }
+
+  for (i = 0; i < spans->len; i++)
+    {
+      const TraceSpan *span = &g_array_index (spans, TraceSpan, i);
+
+      lo = MIN (lo, span->start);
+      hi = MAX (hi, span_end (span));
+    }
+
+  if (spans->len == 0)
+    {
+      g_string_append (report, "no spans have been recorded\n");
+    }
+  else
+    {
+      g_string_append_printf (report,
+          "critical path: %" G_GINT64_FORMAT " us\n"
+          "%10s %10s  span\n", hi - lo, "start_us", "duration_us");
+      append_path (report, spans, NULL, lo, hi, lo, 0, &in_calls,
+          &queued);
+      g_string_append_printf (report,
+          "%" G_GINT64_FORMAT " us waiting for D-Bus replies, %"
+          G_GINT64_FORMAT " us with replies queued in the main loop\n",
+          in_calls, queued);
+    }
+
+  g_array_unref (spans);
+  return g_string_free (report, FALSE);
+}
@@ -0,0 +1,857 @@
+/*
+ * transfer-scheduler.c - sharing bandwidth between concurrent transfers
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * SECTION:transfer-scheduler
+ * @title: TpTransferScheduler
+ * @short_description: share a bandwidth limit between concurrent transfers
+ * @see_also: #TpFileTransferChannel, #TpStreamTubeConnection
+ *
+ * A #TpTransferScheduler copies data from input streams to output streams,
+ * like g_output_stream_splice_async(), but makes all the transfers it is
+ * running share a single rate limit, so that a few large file transfers do
+ * not starve interactive traffic on the same link.
+ *
+ * When the limit is reached, each waiting transfer gets a share of the
+ * bandwidth proportional to the weight it was given when it was started,
+ * which can be changed later with tp_transfer_scheduler_set_weight().
+ * A transfer can also be paused with tp_transfer_scheduler_set_paused():
+ * it simply stops reading from its source, so any socket involved stays
+ * open, and carries on where it left off when it is resumed.
+ *
+ * The scheduler returned by tp_transfer_scheduler_dup_default() is shared
+ * by the whole process, and is a good place to set a global limit; for
+ * a limit per account, create a scheduler for each account with
+ * tp_transfer_scheduler_new(). File transfers opt in with
+ * tp_file_transfer_channel_set_scheduler(); stream tube users who relay
+ * the data of a #TpStreamTubeConnection can pass its
+ * tp_stream_tube_connection_get_socket_connection() to
+ * tp_transfer_scheduler_splice_async().
+ *
+ * The data is always copied through this process, and I/O is done with the
+ * priority of %TP_LATENCY_CLASS_BULK.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpTransferScheduler:
+ *
+ * Data structure representing a group of transfers sharing a rate limit.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+/**
+ * TpTransferSchedulerClass:
+ *
+ * The class of a #TpTransferScheduler.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+#include "config.h"
+
+#include "telepathy-glib/transfer-scheduler.h"
+
+#include <telepathy-glib/util.h>
+
+#define DEBUG_FLAG TP_DEBUG_CHANNEL
+#include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
+
+struct _TpTransferSchedulerClass {
+    /*<private>*/
+    GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (TpTransferScheduler, tp_transfer_scheduler, G_TYPE_OBJECT)
+
+enum {
+    PROP_RATE_LIMIT = 1,
+    N_PROPS
+};
+
+/* The most we read from a source at once */
+#define MAX_CHUNK_SIZE (64 * 1024)
+/* The least we read at once, however low the rate limit */
+#define MIN_CHUNK_SIZE 512
+/* When limited, chunks are at most this fraction of a second's worth of
+ * data, so that transfers take turns fairly often */
+#define CHUNKS_PER_SECOND 20
+/* Unused bandwidth is saved up for at most this fraction of a second */
+#define BURSTS_PER_SECOND 10
+/* Virtual time advances by (bytes << WEIGHT_SHIFT) / weight */
+#define WEIGHT_SHIFT 16
+
+typedef struct {
+    /* borrowed: the result holds a ref to the scheduler */
+    TpTransferScheduler *scheduler;
+    /* owned */
+    GSimpleAsyncResult *result;
+    GInputStream *source;
+    GOutputStream *target;
+    GCancellable *cancellable;
+    /* owned, or NULL */
+    GSource *cancelled_source;
+    GOutputStreamSpliceFlags flags;
+
+    guint weight;
+    gboolean paused;
+    /* TRUE if we have read a chunk and not started writing it yet, either
+     * because we're paused, or because we're waiting for our turn */
+    gboolean waiting;
+
+    /* start-time fair queueing tags of the chunk in @buffer */
+    guint64 start_tag;
+    guint64 finish_tag;
+
+    gchar buffer[MAX_CHUNK_SIZE];
+    gsize len;
+    gsize written;
+    gssize transferred;
+
+    /* owned, the first error to happen while closing the streams */
+    GError *error;
+} Transfer;
+
+struct _TpTransferSchedulerPrivate
+{
+  /* bytes per second, or 0 */
+  guint64 rate_limit;
+  /* token bucket, in bytes * G_USEC_PER_SEC; may go negative, since a
+   * chunk is allowed to go as soon as there is any credit */
+  gint64 credit;
+  /* g_get_monotonic_time() when @credit was last updated */
+  gint64 refilled;
+  /* the start tag of the chunk most recently allowed to go */
+  guint64 virtual_time;
+  /* while some transfers are waiting for credit */
+  guint refill_id;
+
+  /* borrowed GInputStream => Transfer, freed once it has completed */
+  GHashTable *transfers;
+};
+
+static TpTransferScheduler *default_scheduler = NULL;
+
+static void transfer_read (Transfer *t);
+static void transfer_write (Transfer *t);
+static void transfer_finish (Transfer *t,
+    GError *error);
+static void schedule (TpTransferScheduler *self);
+
+static void
+transfer_free (Transfer *t)
+{
+  if (t->cancelled_source != NULL)
+    {
+      g_source_destroy (t->cancelled_source);
+      g_source_unref (t->cancelled_source);
+    }
+
+  g_clear_object (&t->source);
+  g_clear_object (&t->target);
+  g_clear_object (&t->cancellable);
+  g_clear_object (&t->result);
+  g_clear_error (&t->error);
+  g_slice_free (Transfer, t);
+}
+
+static gint
+io_priority (void)
+{
+  return tp_get_latency_class_priority (TP_LATENCY_CLASS_BULK);
+}
+
+static gsize
+chunk_size (TpTransferScheduler *self)
+{
+  if (self->priv->rate_limit == 0)
+    return MAX_CHUNK_SIZE;
+
+  return CLAMP (self->priv->rate_limit / CHUNKS_PER_SECOND,
+      MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+}
+
+static gint64
+max_credit (TpTransferScheduler *self)
+{
+  guint64 burst = MAX (self->priv->rate_limit / BURSTS_PER_SECOND,
+      chunk_size (self));
+
+  return burst * G_USEC_PER_SEC;
+}
+
+static void
+refill (TpTransferScheduler *self)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed = MIN (now - self->priv->refilled, G_USEC_PER_SEC);
+
+  self->priv->refilled = now;
+  self->priv->credit = MIN (
+      self->priv->credit + elapsed * (gint64) self->priv->rate_limit,
+      max_credit (self));
+}
+
+static gboolean
+refill_cb (gpointer user_data)
+{
+  TpTransferScheduler *self = user_data;
+
+  self->priv->refill_id = 0;
+  schedule (self);
+  return FALSE;
+}
+
+/* Returns the waiting transfer that should go next, or NULL */
+static Transfer *
+next_transfer (TpTransferScheduler *self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  Transfer *best = NULL;
+
+  g_hash_table_iter_init (&iter, self->priv->transfers);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Transfer *t = value;
+
+      if (!t->waiting || t->paused)
+        continue;
+
+      if (best == NULL || t->finish_tag < best->finish_tag)
+        best = t;
+    }
+
+  return best;
+}
+
+/* Let waiting transfers write their chunks, smallest finish tag first, for
+ * as long as there is credit */
+static void
+schedule (TpTransferScheduler *self)
+{
+  Transfer *t;
+
+  if (self->priv->rate_limit != 0)
+    refill (self);
+
+  while ((t = next_transfer (self)) != NULL)
+    {
+      if (self->priv->rate_limit != 0 && self->priv->credit <= 0)
+        {
+          if (self->priv->refill_id == 0)
+            {
+              /* wait until the debt has been paid off */
+              guint64 wait_us = (-self->priv->credit) /
+                  self->priv->rate_limit;
+
+              self->priv->refill_id = _tp_timeout_add (
+                  TP_LATENCY_CLASS_BULK, MAX (wait_us / 1000, 1),
+                  refill_cb, self);
+            }
+
+          return;
+        }
+
+      t->waiting = FALSE;
+      self->priv->virtual_time = t->start_tag;
+
+      if (self->priv->rate_limit != 0)
+        self->priv->credit -= (gint64) t->len * G_USEC_PER_SEC;
+
+      transfer_write (t);
+    }
+}
+
+static void
+transfer_complete (Transfer *t)
+{
+  if (t->error != NULL)
+    {
+      g_simple_async_result_take_error (t->result, t->error);
+      t->error = NULL;
+    }
+  else
+    {
+      g_simple_async_result_set_op_res_gssize (t->result, t->transferred);
+    }
+
+  g_simple_async_result_complete (t->result);
+  transfer_free (t);
+}
+
+static void
+close_target_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+  GError *error = NULL;
+
+  if (!g_output_stream_close_finish (G_OUTPUT_STREAM (source), result,
+        &error) && t->error == NULL)
+    t->error = error;
+  else
+    g_clear_error (&error);
+
+  transfer_complete (t);
+}
+
+static void
+close_source_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+  GError *error = NULL;
+
+  if (!g_input_stream_close_finish (G_INPUT_STREAM (source), result,
+        &error) && t->error == NULL)
+    t->error = error;
+  else
+    g_clear_error (&error);
+
+  if (t->flags & G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET)
+    {
+      g_output_stream_close_async (t->target, io_priority (), NULL,
+          close_target_cb, t);
+      return;
+    }
+
+  transfer_complete (t);
+}
+
+/* Takes ownership of @error, if not NULL */
+static void
+transfer_finish (Transfer *t,
+    GError *error)
+{
+  /* completing the result may release the last ref to us otherwise */
+  TpTransferScheduler *self = g_object_ref (t->scheduler);
+
+  DEBUG ("%p: finished after %" G_GSSIZE_FORMAT " bytes: %s", t->source,
+      t->transferred, error == NULL ? "success" : error->message);
+
+  g_hash_table_remove (self->priv->transfers, t->source);
+  t->error = error;
+
+  if (t->flags & G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE)
+    {
+      g_input_stream_close_async (t->source, io_priority (), NULL,
+          close_source_cb, t);
+    }
+  else if (t->flags & G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET)
+    {
+      g_output_stream_close_async (t->target, io_priority (), NULL,
+          close_target_cb, t);
+    }
+  else
+    {
+      transfer_complete (t);
+    }
+
+  /* others may have been waiting for this one */
+  schedule (self);
+  g_object_unref (self);
+}
+
+static void
+write_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+
+  if (n < 0)
+    {
+      transfer_finish (t, error);
+      return;
+    }
+
+  t->written += n;
+
+  if (t->written < t->len)
+    {
+      transfer_write (t);
+      return;
+    }
+
+  t->transferred += t->len;
+  transfer_read (t);
+}
+
+static void
+transfer_write (Transfer *t)
+{
+  g_output_stream_write_async (t->target, t->buffer + t->written,
+      t->len - t->written, io_priority (), t->cancellable, write_cb, t);
+}
+
+static void
+read_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+  TpTransferScheduler *self = t->scheduler;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (G_INPUT_STREAM (source), result, &error);
+
+  if (n < 0)
+    {
+      transfer_finish (t, error);
+      return;
+    }
+
+  if (n == 0)
+    {
+      transfer_finish (t, NULL);
+      return;
+    }
+
+  /* we might be about to wait, and would not notice being cancelled now */
+  if (g_cancellable_set_error_if_cancelled (t->cancellable, &error))
+    {
+      transfer_finish (t, error);
+      return;
+    }
+
+  t->len = n;
+  t->written = 0;
+
+  /* A transfer that has been idle doesn't get to catch up on the turns
+   * it missed */
+  t->start_tag = MAX (self->priv->virtual_time, t->finish_tag);
+  t->finish_tag = t->start_tag + (((guint64) n << WEIGHT_SHIFT) / t->weight);
+  t->waiting = TRUE;
+
+  schedule (self);
+}
+
+static void
+transfer_read (Transfer *t)
+{
+  g_input_stream_read_async (t->source, t->buffer,
+      chunk_size (t->scheduler), io_priority (), t->cancellable, read_cb, t);
+}
+
+static gboolean
+cancelled_cb (GCancellable *cancellable,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+  GError *error = NULL;
+
+  /* if we're reading or writing, that will fail by itself */
+  if (t->waiting)
+    {
+      t->waiting = FALSE;
+      g_cancellable_set_error_if_cancelled (cancellable, &error);
+      transfer_finish (t, error);
+    }
+
+  return FALSE;
+}
+
+static void
+tp_transfer_scheduler_init (TpTransferScheduler *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, TP_TYPE_TRANSFER_SCHEDULER,
+      TpTransferSchedulerPrivate);
+
+  self->priv->transfers = g_hash_table_new (NULL, NULL);
+  self->priv->refilled = g_get_monotonic_time ();
+}
+
+static void
+tp_transfer_scheduler_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpTransferScheduler *self = TP_TRANSFER_SCHEDULER (object);
+
+  switch (property_id)
+    {
+      case PROP_RATE_LIMIT:
+        g_value_set_uint64 (value, self->priv->rate_limit);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_transfer_scheduler_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpTransferScheduler *self = TP_TRANSFER_SCHEDULER (object);
+
+  switch (property_id)
+    {
+      case PROP_RATE_LIMIT:
+        tp_transfer_scheduler_set_rate_limit (self,
+            g_value_get_uint64 (value));
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_transfer_scheduler_finalize (GObject *object)
+{
+  TpTransferScheduler *self = TP_TRANSFER_SCHEDULER (object);
+
+  /* every transfer holds a ref to us through its result */
+  g_assert (g_hash_table_size (self->priv->transfers) == 0);
+  g_hash_table_unref (self->priv->transfers);
+
+  if (self->priv->refill_id != 0)
+    _tp_source_remove (self->priv->refill_id);
+
+  G_OBJECT_CLASS (tp_transfer_scheduler_parent_class)->finalize (object);
+}
+
+static void
+tp_transfer_scheduler_class_init (TpTransferSchedulerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (TpTransferSchedulerPrivate));
+
+  object_class->get_property = tp_transfer_scheduler_get_property;
+  object_class->set_property = tp_transfer_scheduler_set_property;
+  object_class->finalize = tp_transfer_scheduler_finalize;
+
+  /**
+   * TpTransferScheduler:rate-limit:
+   *
+   * The total number of bytes per second that all the transfers using this
+   * scheduler may copy, or 0 for no limit, which is the default.
+   *
+   * Since: 0.UNRELEASED
+   */
+  g_object_class_install_property (object_class, PROP_RATE_LIMIT,
+      g_param_spec_uint64 ("rate-limit", "Rate limit",
+        "Bytes per second shared between all transfers, or 0",
+        0, G_MAXUINT32, 0,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * tp_transfer_scheduler_new:
+ *
+ * Return a new scheduler with no rate limit, for a group of transfers that
+ * should share a limit separate from that of
+ * tp_transfer_scheduler_dup_default(), such as those of one account.
+ *
+ * Returns: (transfer full): a new #TpTransferScheduler
+ *
+ * Since: 0.UNRELEASED
+ */
+TpTransferScheduler *
+tp_transfer_scheduler_new (void)
+{
+  return g_object_new (TP_TYPE_TRANSFER_SCHEDULER, NULL);
+}
+
+/**
+ * tp_transfer_scheduler_dup_default:
+ *
+ * Return the scheduler shared by the whole process, creating it if
+ * necessary. It only lasts as long as someone holds a reference to it, so
+ * an application setting a rate limit on it should keep the result.
+ *
+ * Returns: (transfer full): a reference to the default
+ *  #TpTransferScheduler
+ *
+ * Since: 0.UNRELEASED
+ */
+TpTransferScheduler *
+tp_transfer_scheduler_dup_default (void)
+{
+  if (default_scheduler != NULL)
+    return g_object_ref (default_scheduler);
+
+  default_scheduler = tp_transfer_scheduler_new ();
+  g_object_add_weak_pointer ((GObject *) default_scheduler,
+      (gpointer) &default_scheduler);
+  return default_scheduler;
+}
+
+/**
+ * tp_transfer_scheduler_set_rate_limit:
+ * @self: a #TpTransferScheduler
+ * @bytes_per_second: the new value of #TpTransferScheduler:rate-limit,
+ *  which is at most %G_MAXUINT32
+ *
+ * Change the total rate at which this scheduler's transfers may copy data.
+ * This takes effect immediately, for transfers that are already running
+ * as well as those that start later.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_transfer_scheduler_set_rate_limit (TpTransferScheduler *self,
+    guint64 bytes_per_second)
+{
+  g_return_if_fail (TP_IS_TRANSFER_SCHEDULER (self));
+  g_return_if_fail (bytes_per_second <= G_MAXUINT32);
+
+  if (self->priv->rate_limit == bytes_per_second)
+    return;
+
+  DEBUG ("%" G_GUINT64_FORMAT " bytes per second", bytes_per_second);
+
+  /* start afresh, rather than with however much was saved up under the
+   * old limit */
+  self->priv->rate_limit = bytes_per_second;
+  self->priv->credit = 0;
+  self->priv->refilled = g_get_monotonic_time ();
+
+  if (self->priv->refill_id != 0)
+    {
+      _tp_source_remove (self->priv->refill_id);
+      self->priv->refill_id = 0;
+    }
+
+  g_object_notify ((GObject *) self, "rate-limit");
+  schedule (self);
+}
+
+/**
+ * tp_transfer_scheduler_get_rate_limit:
+ * @self: a #TpTransferScheduler
+ *
+ * Return the #TpTransferScheduler:rate-limit property
+ *
+ * Returns: the value of the #TpTransferScheduler:rate-limit property
+ *
+ * Since: 0.UNRELEASED
+ */
+guint64
+tp_transfer_scheduler_get_rate_limit (TpTransferScheduler *self)
+{
+  g_return_val_if_fail (TP_IS_TRANSFER_SCHEDULER (self), 0);
+
+  return self->priv->rate_limit;
+}
+
+/**
+ * tp_transfer_scheduler_get_n_transfers:
+ * @self: a #TpTransferScheduler
+ *
+ * Return the number of transfers started with
+ * tp_transfer_scheduler_splice_async() that have not finished yet,
+ * including those that are paused.
+ *
+ * Returns: the number of running transfers
+ *
+ * Since: 0.UNRELEASED
+ */
+guint
+tp_transfer_scheduler_get_n_transfers (TpTransferScheduler *self)
+{
+  g_return_val_if_fail (TP_IS_TRANSFER_SCHEDULER (self), 0);
+
+  return g_hash_table_size (self->priv->transfers);
+}
+
+/**
+ * tp_transfer_scheduler_splice_async:
+ * @self: a #TpTransferScheduler
+ * @target: the stream to write to
+ * @source: the stream to read from, which must not already be used by a
+ *  transfer on @self
+ * @flags: whether to close @source and @target at the end
+ * @weight: this transfer's share of the bandwidth, relative to the others;
+ *  must be at least 1
+ * @cancellable: (allow-none): optional #GCancellable object, %NULL to
+ *  ignore
+ * @callback: a callback to call when @source has reached the end, or
+ *  something has failed
+ * @user_data: data to pass to @callback
+ *
+ * Copy everything from @source to @target, like
+ * g_output_stream_splice_async(), subject to #TpTransferScheduler:rate-limit.
+ * Call tp_transfer_scheduler_splice_finish() from @callback to get the
+ * result.
+ *
+ * @source identifies the transfer in calls to
+ * tp_transfer_scheduler_set_weight() and tp_transfer_scheduler_set_paused().
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_transfer_scheduler_splice_async (TpTransferScheduler *self,
+    GOutputStream *target,
+    GInputStream *source,
+    GOutputStreamSpliceFlags flags,
+    guint weight,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  Transfer *t;
+
+  g_return_if_fail (TP_IS_TRANSFER_SCHEDULER (self));
+  g_return_if_fail (G_IS_OUTPUT_STREAM (target));
+  g_return_if_fail (G_IS_INPUT_STREAM (source));
+  g_return_if_fail (weight > 0);
+  g_return_if_fail (g_hash_table_lookup (self->priv->transfers, source) ==
+      NULL);
+
+  t = g_slice_new0 (Transfer);
+  t->scheduler = self;
+  t->result = g_simple_async_result_new ((GObject *) self, callback,
+      user_data, tp_transfer_scheduler_splice_async);
+  t->source = g_object_ref (source);
+  t->target = g_object_ref (target);
+  t->flags = flags;
+  t->weight = weight;
+  /* newcomers queue behind whatever is going now */
+  t->finish_tag = self->priv->virtual_time;
+
+  if (cancellable != NULL)
+    {
+      t->cancellable = g_object_ref (cancellable);
+      t->cancelled_source = g_cancellable_source_new (cancellable);
+      g_source_set_callback (t->cancelled_source,
+          (GSourceFunc) cancelled_cb, t, NULL);
+      g_source_attach (t->cancelled_source,
+          g_main_context_get_thread_default ());
+    }
+
+  DEBUG ("%p: weight %u", source, weight);
+  g_hash_table_insert (self->priv->transfers, source, t);
+  transfer_read (t);
+}
+
+/**
+ * tp_transfer_scheduler_splice_finish:
+ * @self: a #TpTransferScheduler
+ * @result: a #GAsyncResult
+ * @error: a #GError to fill
+ *
+ * Finishes tp_transfer_scheduler_splice_async().
+ *
+ * Returns: the number of bytes copied, or -1 on error
+ *
+ * Since: 0.UNRELEASED
+ */
+gssize
+tp_transfer_scheduler_splice_finish (TpTransferScheduler *self,
+    GAsyncResult *result,
+    GError **error)
+{
+  GSimpleAsyncResult *simple = (GSimpleAsyncResult *) result;
+
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+        G_OBJECT (self), tp_transfer_scheduler_splice_async), -1);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return -1;
+
+  return g_simple_async_result_get_op_res_gssize (simple);
+}
+
+/**
+ * tp_transfer_scheduler_set_weight:
+ * @self: a #TpTransferScheduler
+ * @source: the source of a running transfer
+ * @weight: the transfer's new share of the bandwidth; must be at least 1
+ *
+ * Change the share of the bandwidth given to the transfer reading from
+ * @source, from the next chunk of data onwards. A transfer with twice the
+ * weight of another gets twice as much bandwidth, when the rate limit is
+ * reached.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_transfer_scheduler_set_weight (TpTransferScheduler *self,
+    GInputStream *source,
+    guint weight)
+{
+  Transfer *t;
+
+  g_return_if_fail (TP_IS_TRANSFER_SCHEDULER (self));
+  g_return_if_fail (weight > 0);
+
+  t = g_hash_table_lookup (self->priv->transfers, source);
+  g_return_if_fail (t != NULL);
+
+  t->weight = weight;
+}
+
+/**
+ * tp_transfer_scheduler_set_paused:
+ * @self: a #TpTransferScheduler
+ * @source: the source of a running transfer
+ * @paused: %TRUE to stop the transfer, %FALSE to carry on
+ *
+ * Pause or resume the transfer reading from @source. A paused transfer
+ * finishes any read or write it has already started, but writes nothing
+ * more until it is resumed. The streams are left open, so the other end
+ * of a socket will just see the data stop coming for a while.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_transfer_scheduler_set_paused (TpTransferScheduler *self,
+    GInputStream *source,
+    gboolean paused)
+{
+  Transfer *t;
+
+  g_return_if_fail (TP_IS_TRANSFER_SCHEDULER (self));
+
+  t = g_hash_table_lookup (self->priv->transfers, source);
+  g_return_if_fail (t != NULL);
+
+  paused = !!paused;
+
+  if (t->paused == paused)
+    return;
+
+  DEBUG ("%p: %s", source, paused ? "paused" : "resumed");
+  t->paused = paused;
+
+  if (!paused)
+    schedule (self);
+}
@@ -0,0 +1,102 @@
+/*
+ * transfer-scheduler.h - sharing bandwidth between concurrent transfers
+ *
+ * Copyright © 2013 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#if defined (TP_DISABLE_SINGLE_INCLUDE) && !defined (_TP_IN_META_HEADER) && !defined (_TP_COMPILATION)
+#error "Only <telepathy-glib/telepathy-glib.h> and <telepathy-glib/telepathy-glib-dbus.h> can be included directly."
+#endif
+
+#ifndef __TP_TRANSFER_SCHEDULER_H__
+#define __TP_TRANSFER_SCHEDULER_H__
+
+#include <gio/gio.h>
+
+#include <telepathy-glib/defs.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TpTransferScheduler TpTransferScheduler;
+typedef struct _TpTransferSchedulerClass TpTransferSchedulerClass;
+typedef struct _TpTransferSchedulerPrivate TpTransferSchedulerPrivate;
+
+struct _TpTransferScheduler {
+  /*<private>*/
+  GObject parent;
+  TpTransferSchedulerPrivate *priv;
+};
+
+_TP_AVAILABLE_IN_UNRELEASED
+GType tp_transfer_scheduler_get_type (void);
+
+#define TP_TYPE_TRANSFER_SCHEDULER \
+  (tp_transfer_scheduler_get_type ())
+#define TP_TRANSFER_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), TP_TYPE_TRANSFER_SCHEDULER, \
+                               TpTransferScheduler))
+#define TP_TRANSFER_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), TP_TYPE_TRANSFER_SCHEDULER, \
+                            TpTransferSchedulerClass))
+#define TP_IS_TRANSFER_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TP_TYPE_TRANSFER_SCHEDULER))
+#define TP_IS_TRANSFER_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), TP_TYPE_TRANSFER_SCHEDULER))
+#define TP_TRANSFER_SCHEDULER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TYPE_TRANSFER_SCHEDULER, \
+                              TpTransferSchedulerClass))
+
+_TP_AVAILABLE_IN_UNRELEASED
+TpTransferScheduler *tp_transfer_scheduler_new (void);
+_TP_AVAILABLE_IN_UNRELEASED
+TpTransferScheduler *tp_transfer_scheduler_dup_default (void);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_transfer_scheduler_set_rate_limit (TpTransferScheduler *self,
+    guint64 bytes_per_second);
+_TP_AVAILABLE_IN_UNRELEASED
+guint64 tp_transfer_scheduler_get_rate_limit (TpTransferScheduler *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+guint tp_transfer_scheduler_get_n_transfers (TpTransferScheduler *self);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_transfer_scheduler_splice_async (TpTransferScheduler *self,
+    GOutputStream *target,
+    GInputStream *source,
+    GOutputStreamSpliceFlags flags,
+    guint weight,
+    GCancellable *cancellable,
+    GAsyncReadyCallback callback,
+    gpointer user_data);
+_TP_AVAILABLE_IN_UNRELEASED
+gssize tp_transfer_scheduler_splice_finish (TpTransferScheduler *self,
+    GAsyncResult *result,
+    GError **error);
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_transfer_scheduler_set_weight (TpTransferScheduler *self,
+    GInputStream *source,
+    guint weight);
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_transfer_scheduler_set_paused (TpTransferScheduler *self,
+    GInputStream *source,
+    gboolean paused);
+
+G_END_DECLS
+
+#endif
@@ -30,6 +30,7 @@
 #include <telepathy-glib/channel-request.h>
 #include <telepathy-glib/connection.h>
 #include <telepathy-glib/contact.h>
+#include <telepathy-glib/util.h>
 
 GArray *_tp_quark_array_copy (const GQuark *quarks) G_GNUC_WARN_UNUSED_RESULT;
 void _tp_quark_array_merge (GArray *array, const GQuark *quarks, gssize n);
@@ -37,12 +38,41 @@ void _tp_quark_array_merge_valist (GArray *array,
     GQuark feature,
     va_list var_args);
 
+const GQuark *_tp_quark_array_intern (const GQuark *quarks, gssize n);
+const GQuark *_tp_quark_array_intern_union (const GQuark *a,
+    const GQuark *b);
+
+const gchar * const *_tp_strv_intern_concat (const gchar * const *a,
+    const gchar * const *b);
+
+gboolean _tp_g_value_equal (const GValue *a, const GValue *b);
+gboolean _tp_asv_equal (GHashTable *a, GHashTable *b);
+
 #ifdef HAVE_GIO_UNIX
 GSocketAddress * _tp_create_temp_unix_socket (GSocketService *service,
     gchar **tmpdir,
     GError **error);
+GSocketAddress * _tp_create_abstract_unix_socket (GSocketService *service,
+    GError **error);
 #endif /* HAVE_GIO_UNIX */
 
+/* Set by tp_stream_tube_channel_set_socket_options() and
+ * tp_file_transfer_channel_set_socket_options(); all zero means "leave the
+ * socket as it is" */
+typedef struct {
+    /* SO_SNDBUF and SO_RCVBUF, or 0 for the system default */
+    gint send_buffer_size;
+    gint receive_buffer_size;
+    /* TCP_NODELAY and SO_KEEPALIVE, for IPv4 and IPv6 sockets only */
+    gboolean no_delay;
+    gboolean keepalive;
+    /* use TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX if the CM supports it */
+    gboolean abstract_unix;
+} TpSocketOptions;
+
+void _tp_socket_apply_options (GSocket *socket,
+    const TpSocketOptions *options);
+
 GList * _tp_create_channel_request_list (TpSimpleClientFactory *factory,
     GHashTable *request_props);
 
@@ -90,6 +120,7 @@ gboolean _tp_bind_connection_status_to_boolean (GBinding *binding,
 
 gboolean _tp_set_socket_address_type_and_access_control_type (
     GHashTable *supported_sockets,
+    gboolean prefer_abstract_unix,
     TpSocketAddressType *address_type,
     TpSocketAccessControl *access_control,
     GError **error);
@@ -112,4 +143,101 @@ GList *_tp_g_list_copy_deep (GList *list,
     GCopyFunc func,
     gpointer user_data);
 
+/* Allocation accounting, enabled by the "alloc" keyword in
+ * tp_debug_set_flags(). Allocations made through these macros are counted
+ * per tag, and the totals are logged periodically; see util.c. */
+typedef enum {
+    _TP_ALLOC_GVALUE,
+    _TP_ALLOC_INTSET,
+    _TP_ALLOC_HANDLE_SET,
+    _TP_ALLOC_MESSAGE,
+    _TP_N_ALLOC_TAGS
+} _TpAllocTag;
+
+extern gboolean _tp_alloc_stats_enabled;
+
+void _tp_alloc_stats_enable (void);
+void _tp_alloc_stats_record (_TpAllocTag tag,
+    gssize bytes);
+
+#define _tp_alloc_stats_note_alloc(tag, bytes) \
+  G_STMT_START \
+    { \
+      if (G_UNLIKELY (_tp_alloc_stats_enabled)) \
+        _tp_alloc_stats_record ((tag), (gssize) (bytes)); \
+    } \
+  G_STMT_END
+
+#define _tp_alloc_stats_note_free(tag, bytes) \
+  G_STMT_START \
+    { \
+      if (G_UNLIKELY (_tp_alloc_stats_enabled)) \
+        _tp_alloc_stats_record ((tag), -(gssize) (bytes)); \
+    } \
+  G_STMT_END
+
+static inline gpointer
+_tp_slice_alloc_tagged (_TpAllocTag tag,
+    gsize size)
+{
+  _tp_alloc_stats_note_alloc (tag, size);
+  return g_slice_alloc (size);
+}
+
+static inline gpointer
+_tp_slice_alloc0_tagged (_TpAllocTag tag,
+    gsize size)
+{
+  _tp_alloc_stats_note_alloc (tag, size);
+  return g_slice_alloc0 (size);
+}
+
+static inline void
+_tp_slice_free1_tagged (_TpAllocTag tag,
+    gsize size,
+    gpointer mem)
+{
+  _tp_alloc_stats_note_free (tag, size);
+  g_slice_free1 (size, mem);
+}
+
+/* like g_slice_new(), g_slice_new0() and g_slice_free(), but counted under
+ * @tag */
+#define _tp_slice_new_tagged(tag, type) \
+  ((type *) _tp_slice_alloc_tagged ((tag), sizeof (type)))
+
+#define _tp_slice_new0_tagged(tag, type) \
+  ((type *) _tp_slice_alloc0_tagged ((tag), sizeof (type)))
+
+#define _tp_slice_free_tagged(tag, type, mem) \
+  G_STMT_START \
+    { \
+      if (1) \
+        _tp_slice_free1_tagged ((tag), sizeof (type), (mem)); \
+      else \
+        (void) ((type *) 0 == (mem)); \
+    } \
+  G_STMT_END
+
+GSource *_tp_idle_source_new (TpLatencyClass latency_class)
+  G_GNUC_WARN_UNUSED_RESULT;
+guint _tp_idle_add (TpLatencyClass latency_class,
+    GSourceFunc function,
+    gpointer data);
+guint _tp_idle_add_full (TpLatencyClass latency_class,
+    GSourceFunc function,
+    gpointer data,
+    GDestroyNotify notify);
+guint _tp_timeout_add (TpLatencyClass latency_class,
+    guint interval,
+    GSourceFunc function,
+    gpointer data);
+void _tp_source_remove (guint id);
+
+typedef void (*TpTrimFunc) (GObject *object,
+    TpTrimLevel level);
+
+void _tp_register_trimmable (gpointer object,
+    TpTrimFunc trim);
+
 #endif /* __TP_UTIL_INTERNAL_H__ */
@@ -34,6 +34,8 @@
 #include <glib/gstdio.h>
 #include <gobject/gvaluecollector.h>
 
+#include <gio/gnetworking.h>
+
 #ifdef HAVE_GIO_UNIX
 #include <gio/gunixsocketaddress.h>
 #include <gio/gunixconnection.h>
@@ -46,6 +48,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define DEBUG_FLAG TP_DEBUG_MISC
@@ -185,7 +188,7 @@ tp_g_ptr_array_extend (GPtrArray *target,
 GValue *
 tp_g_value_slice_new (GType type)
 {
-  GValue *ret = g_slice_new0 (GValue);
+  GValue *ret = _tp_slice_new0_tagged (_TP_ALLOC_GVALUE, GValue);
 
   g_value_init (ret, type);
   return ret;
@@ -495,7 +498,7 @@ void
 tp_g_value_slice_free (GValue *value)
 {
   g_value_unset (value);
-  g_slice_free (GValue, value);
+  _tp_slice_free_tagged (_TP_ALLOC_GVALUE, GValue, value);
 }
 
 
@@ -732,10 +735,10 @@ _esc_ident_bad (gchar c, gboolean is_first)
 gchar *
 tp_escape_as_identifier (const gchar *name)
 {
-  gboolean bad = FALSE;
-  size_t len = 0;
-  GString *op;
-  const gchar *ptr, *first_ok;
+  static const gchar hex_digits[] = "0123456789abcdef";
+  gsize n_bad = 0;
+  const gchar *ptr;
+  gchar *escaped, *out;
 
   g_return_val_if_fail (name != NULL, NULL);
 
@@ -746,43 +749,36 @@ tp_escape_as_identifier (const gchar *name)
   for (ptr = name; *ptr; ptr++)
     {
       if (_esc_ident_bad (*ptr, ptr == name))
-        {
-          bad = TRUE;
-          len += 3;
-        }
-      else
-        len++;
+        n_bad++;
     }
 
   /* fast path if it's clean */
-  if (!bad)
-    return g_strdup (name);
+  if (n_bad == 0)
+    return g_memdup (name, ptr - name + 1);
+
+  /* each unsafe character becomes three, so we know the length exactly
+   * and can write the result in place, rather than growing a GString */
+  escaped = g_malloc ((ptr - name) + 2 * n_bad + 1);
+  out = escaped;
 
-  /* If strictly less than ptr, first_ok is the first uncopied safe character.
-   */
-  first_ok = name;
-  op = g_string_sized_new (len);
   for (ptr = name; *ptr; ptr++)
     {
-      if (_esc_ident_bad (*ptr, ptr == name))
+      guchar c = *ptr;
+
+      if (_esc_ident_bad (c, ptr == name))
         {
-          /* copy preceding safe characters if any */
-          if (first_ok < ptr)
-            {
-              g_string_append_len (op, first_ok, ptr - first_ok);
-            }
-          /* escape the unsafe character */
-          g_string_append_printf (op, "_%02x", (unsigned char)(*ptr));
-          /* restart after it */
-          first_ok = ptr + 1;
+          *out++ = '_';
+          *out++ = hex_digits[c >> 4];
+          *out++ = hex_digits[c & 0xf];
+        }
+      else
+        {
+          *out++ = c;
         }
     }
-  /* copy trailing safe characters if any */
-  if (first_ok < ptr)
-    {
-      g_string_append_len (op, first_ok, ptr - first_ok);
-    }
-  return g_string_free (op, FALSE);
+
+  *out = '\0';
+  return escaped;
 }
 
 
@@ -914,75 +910,207 @@ tp_g_key_file_get_uint64 (GKeyFile *key_file,
   return v;
 }
 
-typedef struct {
-    GObject *instance;
-    GObject *observer;
+/*
+ * Everything connected with tp_g_signal_connect_object() between the same
+ * instance and observer shares one WeakPair, so that however many signals
+ * an object binds to another, there are only two weak references between
+ * them. Each observer keeps its pairs in a list in its qdata, which is
+ * short: an object rarely observes more than a handful of others.
+ */
+
+typedef struct _WeakPair WeakPair;
+typedef struct _WeakHandler WeakHandler;
+
+struct _WeakHandler {
+    WeakPair *pair;
     GClosure *closure;
     gulong handler_id;
-} WeakHandlerCtx;
+    WeakHandler *prev;
+    WeakHandler *next;
+};
 
-static WeakHandlerCtx *
-whc_new (GObject *instance,
-         GObject *observer)
+struct _WeakPair {
+    GObject *instance;
+    GObject *observer;
+    WeakHandler *handlers;
+    /* the next pair with the same observer */
+    WeakPair *next;
+};
+
+/* protects the pairs and handlers, not the signal connections */
+G_LOCK_DEFINE_STATIC (weak_pairs);
+
+static GQuark
+weak_pairs_quark (void)
 {
-  WeakHandlerCtx *ctx = g_slice_new0 (WeakHandlerCtx);
+  static GQuark q = 0;
 
-  ctx->instance = instance;
-  ctx->observer = observer;
+  if (G_UNLIKELY (q == 0))
+    q = g_quark_from_static_string ("tp_g_signal_connect_object pairs");
 
-  return ctx;
+  return q;
 }
 
+static void instance_destroyed_cb (gpointer, GObject *);
+static void observer_destroyed_cb (gpointer, GObject *);
+static void closure_invalidated_cb (gpointer, GClosure *);
+
+/* Called with the lock held */
+static WeakPair *
+weak_pair_ensure (GObject *instance,
+    GObject *observer)
+{
+  GQuark q = weak_pairs_quark ();
+  WeakPair *head = g_object_get_qdata (observer, q);
+  WeakPair *pair;
+
+  for (pair = head; pair != NULL; pair = pair->next)
+    {
+      if (pair->instance == instance)
+        return pair;
+    }
+
+  pair = g_slice_new0 (WeakPair);
+  pair->instance = instance;
+  pair->observer = observer;
+  pair->next = head;
+  g_object_set_qdata (observer, q, pair);
+
+  /* if an object observes itself, one weak reference is enough: the
+   * handlers go away with it anyway */
+  g_object_weak_ref (instance, instance_destroyed_cb, pair);
+
+  if (observer != instance)
+    g_object_weak_ref (observer, observer_destroyed_cb, pair);
+
+  return pair;
+}
+
+/* Called with the lock held. Removes @pair from its observer's list; the
+ * caller is responsible for the weak references and for freeing it. */
 static void
-whc_free (WeakHandlerCtx *ctx)
+weak_pair_unlink (WeakPair *pair)
 {
-  g_slice_free (WeakHandlerCtx, ctx);
+  GQuark q = weak_pairs_quark ();
+  WeakPair *head = g_object_get_qdata (pair->observer, q);
+  WeakPair **link;
+
+  for (link = &head; *link != NULL; link = &(*link)->next)
+    {
+      if (*link == pair)
+        {
+          *link = pair->next;
+          break;
+        }
+    }
+
+  g_object_set_qdata (pair->observer, q, head);
 }
 
-static void observer_destroyed_cb (gpointer, GObject *);
-static void closure_invalidated_cb (gpointer, GClosure *);
+/* Frees @handlers, which have already been removed from their pair, and
+ * disconnects them from @instance if it is not %NULL */
+static void
+weak_handlers_free (WeakHandler *handlers,
+    GObject *instance)
+{
+  while (handlers != NULL)
+    {
+      WeakHandler *next = handlers->next;
+
+      g_closure_remove_invalidate_notifier (handlers->closure, handlers,
+          closure_invalidated_cb);
+
+      if (instance != NULL)
+        g_signal_handler_disconnect (instance, handlers->handler_id);
+
+      g_slice_free (WeakHandler, handlers);
+      handlers = next;
+    }
+}
 
 /*
  * If signal handlers are removed before the object is destroyed, this
- * callback will never get triggered.
+ * callback will never get triggered. In fact GObject destroys an object's
+ * signal handlers before notifying its weak references, so this is only
+ * a safety net.
  */
 static void
-instance_destroyed_cb (gpointer ctx_,
+instance_destroyed_cb (gpointer pair_,
     GObject *where_the_instance_was)
 {
-  WeakHandlerCtx *ctx = ctx_;
+  WeakPair *pair = pair_;
+  WeakHandler *handlers;
 
-  /* No need to disconnect the signal here, the instance has gone away. */
-  g_object_weak_unref (ctx->observer, observer_destroyed_cb, ctx);
-  g_closure_remove_invalidate_notifier (ctx->closure, ctx,
-      closure_invalidated_cb);
-  whc_free (ctx);
+  G_LOCK (weak_pairs);
+  handlers = pair->handlers;
+  pair->handlers = NULL;
+  weak_pair_unlink (pair);
+
+  if (pair->observer != pair->instance)
+    g_object_weak_unref (pair->observer, observer_destroyed_cb, pair);
+
+  G_UNLOCK (weak_pairs);
+
+  /* No need to disconnect the signals here, the instance has gone away. */
+  weak_handlers_free (handlers, NULL);
+  g_slice_free (WeakPair, pair);
 }
 
 /* Triggered when the observer is destroyed. */
 static void
-observer_destroyed_cb (gpointer ctx_,
+observer_destroyed_cb (gpointer pair_,
     GObject *where_the_observer_was)
 {
-  WeakHandlerCtx *ctx = ctx_;
+  WeakPair *pair = pair_;
+  WeakHandler *handlers;
 
-  g_closure_remove_invalidate_notifier (ctx->closure, ctx,
-      closure_invalidated_cb);
-  g_signal_handler_disconnect (ctx->instance, ctx->handler_id);
-  g_object_weak_unref (ctx->instance, instance_destroyed_cb, ctx);
-  whc_free (ctx);
+  G_LOCK (weak_pairs);
+  handlers = pair->handlers;
+  pair->handlers = NULL;
+  weak_pair_unlink (pair);
+  g_object_weak_unref (pair->instance, instance_destroyed_cb, pair);
+  G_UNLOCK (weak_pairs);
+
+  weak_handlers_free (handlers, pair->instance);
+  g_slice_free (WeakPair, pair);
 }
 
 /* Triggered when either object is destroyed or the handler is disconnected. */
 static void
-closure_invalidated_cb (gpointer ctx_,
+closure_invalidated_cb (gpointer handler_,
     GClosure *where_the_closure_was)
 {
-  WeakHandlerCtx *ctx = ctx_;
+  WeakHandler *handler = handler_;
+  WeakPair *pair = handler->pair;
+  gboolean last;
+
+  G_LOCK (weak_pairs);
+
+  if (handler->prev != NULL)
+    handler->prev->next = handler->next;
+  else
+    pair->handlers = handler->next;
+
+  if (handler->next != NULL)
+    handler->next->prev = handler->prev;
+
+  last = (pair->handlers == NULL);
+
+  if (last)
+    {
+      weak_pair_unlink (pair);
+      g_object_weak_unref (pair->instance, instance_destroyed_cb, pair);
+
+      if (pair->observer != pair->instance)
+        g_object_weak_unref (pair->observer, observer_destroyed_cb, pair);
+    }
+
+  G_UNLOCK (weak_pairs);
+
+  g_slice_free (WeakHandler, handler);
 
-  g_object_weak_unref (ctx->instance, instance_destroyed_cb, ctx);
-  g_object_weak_unref (ctx->observer, observer_destroyed_cb, ctx);
-  whc_free (ctx);
+  if (last)
+    g_slice_free (WeakPair, pair);
 }
 
 /**
@@ -1024,7 +1152,7 @@ tp_g_signal_connect_object (gpointer instance,
     GConnectFlags connect_flags)
 {
   GObject *instance_obj = G_OBJECT (instance);
-  WeakHandlerCtx *ctx = whc_new (instance_obj, gobject);
+  WeakHandler *handler;
 
   g_return_val_if_fail (G_TYPE_CHECK_INSTANCE (instance), 0);
   g_return_val_if_fail (detailed_signal != NULL, 0);
@@ -1033,20 +1161,39 @@ tp_g_signal_connect_object (gpointer instance,
   g_return_val_if_fail (
       (connect_flags & ~(G_CONNECT_AFTER|G_CONNECT_SWAPPED)) == 0, 0);
 
+  handler = g_slice_new0 (WeakHandler);
+
   if (connect_flags & G_CONNECT_SWAPPED)
-    ctx->closure = g_cclosure_new_object_swap (c_handler, gobject);
+    handler->closure = g_cclosure_new_object_swap (c_handler, gobject);
   else
-    ctx->closure = g_cclosure_new_object (c_handler, gobject);
+    handler->closure = g_cclosure_new_object (c_handler, gobject);
+
+  handler->handler_id = g_signal_connect_closure (instance, detailed_signal,
+      handler->closure, (connect_flags & G_CONNECT_AFTER) ? TRUE : FALSE);
+
+  if (handler->handler_id == 0)
+    {
+      /* g_signal_connect_closure() has already complained, and left the
+       * closure floating */
+      g_closure_sink (handler->closure);
+      g_slice_free (WeakHandler, handler);
+      return 0;
+    }
+
+  G_LOCK (weak_pairs);
+  handler->pair = weak_pair_ensure (instance_obj, gobject);
+  handler->next = handler->pair->handlers;
+
+  if (handler->next != NULL)
+    handler->next->prev = handler;
 
-  ctx->handler_id = g_signal_connect_closure (instance, detailed_signal,
-      ctx->closure, (connect_flags & G_CONNECT_AFTER) ? TRUE : FALSE);
+  handler->pair->handlers = handler;
+  G_UNLOCK (weak_pairs);
 
-  g_object_weak_ref (instance_obj, instance_destroyed_cb, ctx);
-  g_object_weak_ref (gobject, observer_destroyed_cb, ctx);
-  g_closure_add_invalidate_notifier (ctx->closure, ctx,
+  g_closure_add_invalidate_notifier (handler->closure, handler,
       closure_invalidated_cb);
 
-  return ctx->handler_id;
+  return handler->handler_id;
 }
 
 /*
@@ -1568,6 +1715,306 @@ _tp_quark_array_merge_valist (GArray *array,
   g_array_unref (features);
 }
 
+/* Interned feature sets. Like the quarks they contain, these are never
+ * freed: there are only as many distinct combinations as the code asks for,
+ * and in exchange two interned sets are equal if and only if they are the
+ * same pointer, which makes caching their unions cheap. Each is sorted,
+ * without duplicates, and 0-terminated. */
+
+typedef struct {
+    const GQuark *a;
+    const GQuark *b;
+} QuarkArrayPair;
+
+G_LOCK_DEFINE_STATIC (interned_quark_arrays);
+/* const GQuark * => itself */
+static GHashTable *interned_quark_arrays = NULL;
+/* QuarkArrayPair * => const GQuark * */
+static GHashTable *quark_array_unions = NULL;
+
+static guint
+quark_array_hash (gconstpointer p)
+{
+  const GQuark *q;
+  guint hash = 0;
+
+  for (q = p; *q != 0; q++)
+    hash = (hash * 31) + *q;
+
+  return hash;
+}
+
+static gboolean
+quark_array_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const GQuark *qa = a;
+  const GQuark *qb = b;
+
+  while (*qa != 0 && *qa == *qb)
+    {
+      qa++;
+      qb++;
+    }
+
+  return (*qa == *qb);
+}
+
+static guint
+quark_array_pair_hash (gconstpointer p)
+{
+  const QuarkArrayPair *pair = p;
+
+  return g_direct_hash (pair->a) * 31 + g_direct_hash (pair->b);
+}
+
+static gboolean
+quark_array_pair_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const QuarkArrayPair *pa = a;
+  const QuarkArrayPair *pb = b;
+
+  return (pa->a == pb->a && pa->b == pb->b);
+}
+
+static gint
+quark_cmp (gconstpointer a,
+    gconstpointer b)
+{
+  GQuark qa = *(const GQuark *) a;
+  GQuark qb = *(const GQuark *) b;
+
+  return (qa < qb) ? -1 : (qa > qb);
+}
+
+/* Must be called with the lock held. @buf has @n quarks followed by a 0,
+ * and may be modified. */
+static const GQuark *
+quark_array_intern_locked (GQuark *buf,
+    gsize n)
+{
+  const GQuark *ret;
+  gsize i, j;
+
+  if (interned_quark_arrays == NULL)
+    {
+      interned_quark_arrays = g_hash_table_new (quark_array_hash,
+          quark_array_equal);
+      quark_array_unions = g_hash_table_new_full (quark_array_pair_hash,
+          quark_array_pair_equal, g_free, NULL);
+    }
+
+  qsort (buf, n, sizeof (GQuark), quark_cmp);
+
+  for (i = 0, j = 0; i < n; i++)
+    {
+      if (j == 0 || buf[j - 1] != buf[i])
+        buf[j++] = buf[i];
+    }
+
+  buf[j] = 0;
+
+  ret = g_hash_table_lookup (interned_quark_arrays, buf);
+
+  if (ret == NULL)
+    {
+      ret = g_memdup (buf, (j + 1) * sizeof (GQuark));
+      g_hash_table_add (interned_quark_arrays, (gpointer) ret);
+    }
+
+  return ret;
+}
+
+/*
+ * _tp_quark_array_intern:
+ * @quarks: (allow-none): quarks to intern
+ * @n: the number of @quarks, or -1 if @quarks is 0-terminated
+ *
+ * Returns: (transfer none): a canonical, immutable, 0-terminated copy of
+ *  @quarks, sorted and without duplicates, which lives as long as the
+ *  process. Interning equal sets in any order gives the same pointer.
+ */
+const GQuark *
+_tp_quark_array_intern (const GQuark *quarks,
+    gssize n)
+{
+  GQuark stack_buf[16];
+  GQuark *buf = stack_buf;
+  const GQuark *ret;
+
+  g_return_val_if_fail (n >= -1, NULL);
+  g_return_val_if_fail (n <= 0 || quarks != NULL, NULL);
+
+  if (quarks == NULL)
+    n = 0;
+  else if (n < 0)
+    for (n = 0; quarks[n] != 0; n++);
+
+  /* the common case, a handful of features, can be looked up without
+   * allocating anything */
+  if ((gsize) n >= G_N_ELEMENTS (stack_buf))
+    buf = g_new (GQuark, n + 1);
+
+  if (n > 0)
+    memcpy (buf, quarks, n * sizeof (GQuark));
+
+  G_LOCK (interned_quark_arrays);
+  ret = quark_array_intern_locked (buf, n);
+  G_UNLOCK (interned_quark_arrays);
+
+  if (buf != stack_buf)
+    g_free (buf);
+
+  return ret;
+}
+
+/*
+ * _tp_quark_array_intern_union:
+ * @a: a set returned by _tp_quark_array_intern()
+ * @b: another such set
+ *
+ * Returns: (transfer none): the interned union of @a and @b. The result is
+ *  remembered, so asking again for the same pair is a single lookup.
+ */
+const GQuark *
+_tp_quark_array_intern_union (const GQuark *a,
+    const GQuark *b)
+{
+  QuarkArrayPair key;
+  const GQuark *ret;
+  GQuark *buf;
+  gsize len_a, len_b;
+
+  g_return_val_if_fail (a != NULL, NULL);
+  g_return_val_if_fail (b != NULL, NULL);
+
+  if (a == b || *b == 0)
+    return a;
+
+  if (*a == 0)
+    return b;
+
+  /* union is commutative, so only remember one ordering of each pair */
+  key.a = MIN (a, b);
+  key.b = MAX (a, b);
+
+  G_LOCK (interned_quark_arrays);
+
+  ret = g_hash_table_lookup (quark_array_unions, &key);
+
+  if (ret == NULL)
+    {
+      for (len_a = 0; a[len_a] != 0; len_a++);
+      for (len_b = 0; b[len_b] != 0; len_b++);
+
+      buf = g_new (GQuark, len_a + len_b + 1);
+      memcpy (buf, a, len_a * sizeof (GQuark));
+      memcpy (buf + len_a, b, len_b * sizeof (GQuark));
+      ret = quark_array_intern_locked (buf, len_a + len_b);
+      g_free (buf);
+
+      g_hash_table_insert (quark_array_unions,
+          g_memdup (&key, sizeof (key)), (gpointer) ret);
+    }
+
+  G_UNLOCK (interned_quark_arrays);
+
+  return ret;
+}
+
+G_LOCK_DEFINE_STATIC (interned_strvs);
+
+/* set of NULL-terminated arrays of g_intern_string() results */
+static GHashTable *interned_strvs = NULL;
+
+static guint
+interned_strv_hash (gconstpointer p)
+{
+  const gchar * const *strv = p;
+  guint hash = 0;
+
+  for (; *strv != NULL; strv++)
+    hash = hash * 31 + g_direct_hash (*strv);
+
+  return hash;
+}
+
+static gboolean
+interned_strv_equal (gconstpointer a,
+    gconstpointer b)
+{
+  const gchar * const *sa = a;
+  const gchar * const *sb = b;
+
+  for (; *sa != NULL && *sa == *sb; sa++, sb++);
+
+  return (*sa == *sb);
+}
+
+static void
+interned_strv_append (GPtrArray *arr,
+    const gchar * const *strv)
+{
+  guint i;
+
+  for (; strv != NULL && *strv != NULL; strv++)
+    {
+      const gchar *s = g_intern_string (*strv);
+
+      for (i = 0; i < arr->len; i++)
+        {
+          if (g_ptr_array_index (arr, i) == s)
+            break;
+        }
+
+      if (i == arr->len)
+        g_ptr_array_add (arr, (gpointer) s);
+    }
+}
+
+/*
+ * _tp_strv_intern_concat:
+ * @a: (allow-none): a %NULL-terminated array of strings
+ * @b: (allow-none): another such array
+ *
+ * Returns: (transfer none): a canonical, immutable, %NULL-terminated array
+ *  containing the strings in @a followed by those in @b, in order and
+ *  without duplicates, which lives as long as the process. The strings are
+ *  interned with g_intern_string(), so neither @a, @b nor their contents
+ *  need to outlive this call.
+ */
+const gchar * const *
+_tp_strv_intern_concat (const gchar * const *a,
+    const gchar * const *b)
+{
+  GPtrArray *arr = g_ptr_array_new ();
+  const gchar * const *ret;
+
+  interned_strv_append (arr, a);
+  interned_strv_append (arr, b);
+  g_ptr_array_add (arr, NULL);
+
+  G_LOCK (interned_strvs);
+
+  if (interned_strvs == NULL)
+    interned_strvs = g_hash_table_new (interned_strv_hash,
+        interned_strv_equal);
+
+  ret = g_hash_table_lookup (interned_strvs, arr->pdata);
+
+  if (ret == NULL)
+    {
+      ret = g_memdup (arr->pdata, arr->len * sizeof (gpointer));
+      g_hash_table_add (interned_strvs, (gpointer) ret);
+    }
+
+  G_UNLOCK (interned_strvs);
+
+  g_ptr_array_unref (arr);
+  return ret;
+}
+
 #ifdef HAVE_GIO_UNIX
 GSocketAddress *
 _tp_create_temp_unix_socket (GSocketService *service,
@@ -1613,8 +2060,113 @@ _tp_create_temp_unix_socket (GSocketService *service,
 
   return address;
 }
+
+/* Listen on a randomly-named socket in the abstract namespace, which,
+ * unlike _tp_create_temp_unix_socket(), needs nothing on the filesystem
+ * to be created or cleaned up. Returns NULL with G_IO_ERROR_NOT_SUPPORTED
+ * if this platform has no abstract namespace. */
+GSocketAddress *
+_tp_create_abstract_unix_socket (GSocketService *service,
+    GError **error)
+{
+  guint attempt;
+
+  if (!g_unix_socket_address_abstract_names_supported ())
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+          "Abstract Unix sockets are not supported on this platform");
+      return NULL;
+    }
+
+  for (attempt = 0; attempt < 10; attempt++)
+    {
+      GSocketAddress *address;
+      GError *e = NULL;
+      gchar *name;
+
+      name = g_strdup_printf ("tp-glib-socket-%08x%08x", g_random_int (),
+          g_random_int ());
+      address = g_unix_socket_address_new_with_type (name, -1,
+          G_UNIX_SOCKET_ADDRESS_ABSTRACT);
+      g_free (name);
+
+      if (g_socket_listener_add_address (G_SOCKET_LISTENER (service),
+            address, G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_DEFAULT,
+            NULL, NULL, &e))
+        return address;
+
+      g_object_unref (address);
+
+      /* try another name if someone else got this one */
+      if (!g_error_matches (e, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE) ||
+          attempt == 9)
+        {
+          g_propagate_error (error, e);
+          return NULL;
+        }
+
+      g_clear_error (&e);
+    }
+
+  g_assert_not_reached ();
+  return NULL;
+}
 #endif /* HAVE_GIO_UNIX */
 
+/*
+ * _tp_socket_apply_options:
+ * @socket: a socket to or from the connection manager
+ * @options: the options to apply
+ *
+ * Applies @options to @socket. Failing to set an option is not fatal: the
+ * socket keeps working with the system's defaults.
+ */
+void
+_tp_socket_apply_options (GSocket *socket,
+    const TpSocketOptions *options)
+{
+  GError *error = NULL;
+  GSocketFamily family;
+
+  g_return_if_fail (G_IS_SOCKET (socket));
+  g_return_if_fail (options != NULL);
+
+  family = g_socket_get_family (socket);
+
+  if (options->send_buffer_size > 0 &&
+      !g_socket_set_option (socket, SOL_SOCKET, SO_SNDBUF,
+          options->send_buffer_size, &error))
+    {
+      DEBUG ("couldn't set SO_SNDBUF to %d: %s", options->send_buffer_size,
+          error->message);
+      g_clear_error (&error);
+    }
+
+  if (options->receive_buffer_size > 0 &&
+      !g_socket_set_option (socket, SOL_SOCKET, SO_RCVBUF,
+          options->receive_buffer_size, &error))
+    {
+      DEBUG ("couldn't set SO_RCVBUF to %d: %s",
+          options->receive_buffer_size, error->message);
+      g_clear_error (&error);
+    }
+
+  /* Nagle's algorithm and keepalives only mean anything for TCP */
+  if (family != G_SOCKET_FAMILY_IPV4 && family != G_SOCKET_FAMILY_IPV6)
+    return;
+
+  if (options->no_delay &&
+      !g_socket_set_option (socket, IPPROTO_TCP, TCP_NODELAY, 1, &error))
+    {
+      DEBUG ("couldn't set TCP_NODELAY: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  if (options->keepalive)
+    g_socket_set_keepalive (socket, TRUE);
+}
+
 GList *
 _tp_create_channel_request_list (TpSimpleClientFactory *factory,
     GHashTable *request_props)
@@ -1796,6 +2348,98 @@ _tp_enum_to_nick_nonnull (
     return enum_value->value_nick;
 }
 
+/*
+ * _tp_g_value_equal:
+ * @a: a #GValue
+ * @b: a #GValue
+ *
+ * Compare two #GValues of the basic types found in a{sv} maps.
+ *
+ * Returns: %TRUE if @a and @b have the same type and value. Values of
+ *  other types are never considered equal.
+ */
+gboolean
+_tp_g_value_equal (const GValue *a,
+    const GValue *b)
+{
+  if (G_VALUE_TYPE (a) != G_VALUE_TYPE (b))
+    return FALSE;
+
+  if (G_VALUE_HOLDS (a, G_TYPE_STRV))
+    {
+      const gchar * const *sa = g_value_get_boxed (a);
+      const gchar * const *sb = g_value_get_boxed (b);
+      guint i;
+
+      if (sa == NULL || sb == NULL)
+        return (sa == sb);
+
+      for (i = 0; sa[i] != NULL && sb[i] != NULL; i++)
+        {
+          if (tp_strdiff (sa[i], sb[i]))
+            return FALSE;
+        }
+
+      return (sa[i] == sb[i]);
+    }
+
+  switch (G_VALUE_TYPE (a))
+    {
+      case G_TYPE_STRING:
+        return !tp_strdiff (g_value_get_string (a), g_value_get_string (b));
+      case G_TYPE_DOUBLE:
+        return g_value_get_double (a) == g_value_get_double (b);
+      case G_TYPE_INT64:
+        return g_value_get_int64 (a) == g_value_get_int64 (b);
+      case G_TYPE_UINT64:
+        return g_value_get_uint64 (a) == g_value_get_uint64 (b);
+      case G_TYPE_INT:
+        return g_value_get_int (a) == g_value_get_int (b);
+      case G_TYPE_UINT:
+        return g_value_get_uint (a) == g_value_get_uint (b);
+      case G_TYPE_UCHAR:
+        return g_value_get_uchar (a) == g_value_get_uchar (b);
+      case G_TYPE_BOOLEAN:
+        return !g_value_get_boolean (a) == !g_value_get_boolean (b);
+      default:
+        return FALSE;
+    }
+}
+
+/*
+ * _tp_asv_equal:
+ * @a: a map from strings to #GValue
+ * @b: a map from strings to #GValue
+ *
+ * Returns: %TRUE if @a and @b have the same keys, and the values of each key
+ *  are equal according to _tp_g_value_equal()
+ */
+gboolean
+_tp_asv_equal (GHashTable *a,
+    GHashTable *b)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (a == b)
+    return TRUE;
+
+  if (g_hash_table_size (a) != g_hash_table_size (b))
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, a);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const GValue *other = g_hash_table_lookup (b, key);
+
+      if (other == NULL || !_tp_g_value_equal (value, other))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 gboolean
 _tp_bind_connection_status_to_boolean (GBinding *binding,
     const GValue *src_value,
@@ -1826,6 +2470,7 @@ _tp_bind_connection_status_to_boolean (GBinding *binding,
  */
 static gboolean
 _tp_determine_socket_address_type (GHashTable *supported_sockets,
+    gboolean prefer_abstract_unix,
     TpSocketAddressType *address_type,
     GError **error)
 {
@@ -1838,6 +2483,17 @@ _tp_determine_socket_address_type (GHashTable *supported_sockets,
       TP_SOCKET_ADDRESS_TYPE_IPV6
   };
 
+#ifdef HAVE_GIO_UNIX
+  if (prefer_abstract_unix &&
+      g_unix_socket_address_abstract_names_supported () &&
+      g_hash_table_lookup (supported_sockets,
+        GUINT_TO_POINTER (TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX)) != NULL)
+    {
+      *address_type = TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX;
+      return TRUE;
+    }
+#endif /* HAVE_GIO_UNIX */
+
   for (i = 0; i < G_N_ELEMENTS (types); i++)
     {
       GArray *arr = g_hash_table_lookup (supported_sockets,
@@ -1944,6 +2600,7 @@ _tp_determine_access_control_type (GHashTable *supported_sockets,
 gboolean
 _tp_set_socket_address_type_and_access_control_type (
     GHashTable *supported_sockets,
+    gboolean prefer_abstract_unix,
     TpSocketAddressType *address_type,
     TpSocketAccessControl *access_control,
     GError **error)
@@ -1951,8 +2608,8 @@ _tp_set_socket_address_type_and_access_control_type (
   g_return_val_if_fail (address_type != NULL, FALSE);
   g_return_val_if_fail (access_control != NULL, FALSE);
 
-  if (!_tp_determine_socket_address_type (supported_sockets, address_type,
-        error))
+  if (!_tp_determine_socket_address_type (supported_sockets,
+        prefer_abstract_unix, address_type, error))
     return FALSE;
 
   return _tp_determine_access_control_type (supported_sockets,
@@ -1970,6 +2627,7 @@ _tp_create_client_socket (TpSocketAddressType socket_type,
     {
 #ifdef HAVE_GIO_UNIX
       case TP_SOCKET_ADDRESS_TYPE_UNIX:
+      case TP_SOCKET_ADDRESS_TYPE_ABSTRACT_UNIX:
         family = G_SOCKET_FAMILY_UNIX;
         break;
 #endif
@@ -2140,3 +2798,494 @@ void
 {
   _tp_value_array_free_inline (va);
 }
+
+/* Allocation accounting (see util-internal.h). The counters are only
+ * touched once _tp_alloc_stats_enable() has been called, so the macros cost
+ * a single test otherwise. Frees are only seen if they go through the
+ * tagged macros too, and only allocations made after the accounting was
+ * enabled are seen: for instance a GValue from tp_g_value_slice_new()
+ * released with plain g_slice_free() stays "live". So the live figures are
+ * approximate, but the allocation counts and rates are exact. */
+
+#define ALLOC_STATS_INTERVAL_SECONDS 10
+
+gboolean _tp_alloc_stats_enabled = FALSE;
+
+typedef struct {
+    gint64 live_bytes;
+    gint64 live_count;
+    guint64 n_allocations;
+    /* n_allocations when the stats were last logged */
+    guint64 n_allocations_logged;
+} AllocStats;
+
+static const gchar * const alloc_tag_names[_TP_N_ALLOC_TAGS] = {
+    "gvalue",
+    "intset",
+    "handle-set",
+    "message"
+};
+
+G_LOCK_DEFINE_STATIC (alloc_stats);
+static AllocStats alloc_stats[_TP_N_ALLOC_TAGS];
+static gint64 alloc_stats_logged_at = 0;
+
+void
+_tp_alloc_stats_record (_TpAllocTag tag,
+    gssize bytes)
+{
+  g_return_if_fail (tag < _TP_N_ALLOC_TAGS);
+
+  G_LOCK (alloc_stats);
+
+  alloc_stats[tag].live_bytes += bytes;
+
+  if (bytes >= 0)
+    {
+      alloc_stats[tag].live_count++;
+      alloc_stats[tag].n_allocations++;
+    }
+  else
+    {
+      alloc_stats[tag].live_count--;
+    }
+
+  G_UNLOCK (alloc_stats);
+}
+
+static gboolean
+alloc_stats_log_cb (gpointer user_data)
+{
+  AllocStats snapshot[_TP_N_ALLOC_TAGS];
+  gint64 now = g_get_monotonic_time ();
+  gdouble seconds;
+  guint i;
+
+  G_LOCK (alloc_stats);
+
+  memcpy (snapshot, alloc_stats, sizeof (snapshot));
+
+  for (i = 0; i < _TP_N_ALLOC_TAGS; i++)
+    alloc_stats[i].n_allocations_logged = alloc_stats[i].n_allocations;
+
+  seconds = (now - alloc_stats_logged_at) / (gdouble) G_USEC_PER_SEC;
+  alloc_stats_logged_at = now;
+
+  G_UNLOCK (alloc_stats);
+
+  for (i = 0; i < _TP_N_ALLOC_TAGS; i++)
+    {
+      INFO ("alloc %s: %" G_GINT64_FORMAT " live, %" G_GINT64_FORMAT
+          " bytes; %" G_GUINT64_FORMAT " allocations, %.1f/s",
+          alloc_tag_names[i], snapshot[i].live_count,
+          snapshot[i].live_bytes, snapshot[i].n_allocations,
+          (snapshot[i].n_allocations - snapshot[i].n_allocations_logged) /
+            MAX (seconds, 1e-6));
+    }
+
+  return TRUE;
+}
+
+/*
+ * _tp_alloc_stats_enable:
+ *
+ * Start counting allocations made with _tp_slice_new0_tagged() and
+ * friends, and log the totals for each tag, with the allocation rate since
+ * they were last logged, every ALLOC_STATS_INTERVAL_SECONDS in the default
+ * main context. They are logged as INFO messages in the "misc" domain, so
+ * a #TpDebugSender makes them available over D-Bus.
+ *
+ * This cannot be undone, because frees of objects allocated while it was
+ * enabled would then be missed. It should be enabled early, too, since
+ * frees of objects allocated before it was enabled are still counted.
+ */
+void
+_tp_alloc_stats_enable (void)
+{
+  if (_tp_alloc_stats_enabled)
+    return;
+
+  G_LOCK (alloc_stats);
+  alloc_stats_logged_at = g_get_monotonic_time ();
+  G_UNLOCK (alloc_stats);
+
+  _tp_alloc_stats_enabled = TRUE;
+  g_timeout_add_seconds (ALLOC_STATS_INTERVAL_SECONDS, alloc_stats_log_cb,
+      NULL);
+}
+
+/**
+ * TpLatencyClass:
+ * @TP_LATENCY_CLASS_INTERACTIVE: work that a user or a D-Bus caller is
+ *  waiting for, such as completing a method call or emitting a signal
+ *  that a method call caused
+ * @TP_LATENCY_CLASS_NORMAL: routine work that is deferred to the main loop,
+ *  such as coalescing change notification or continuing an operation in
+ *  several steps
+ * @TP_LATENCY_CLASS_BULK: high-volume work whose latency does not matter
+ *  much, such as fetching avatars, forwarding debug messages or
+ *  processing a large contact list
+ *
+ * The classes into which telepathy-glib sorts the callbacks that it defers
+ * to an idle or timeout source. Each class is mapped onto a #GSource
+ * priority, which can be changed with tp_set_latency_class_priority(),
+ * so that the library's own deferred work does not delay, or get delayed
+ * by, the application's.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+static gint latency_class_priorities[] = {
+    G_PRIORITY_HIGH,
+    G_PRIORITY_DEFAULT_IDLE,
+    G_PRIORITY_LOW
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (latency_class_priorities) ==
+    TP_LATENCY_CLASS_BULK + 1);
+
+/**
+ * tp_set_latency_class_priority:
+ * @latency_class: a latency class
+ * @priority: a #GSource priority such as %G_PRIORITY_DEFAULT_IDLE
+ *
+ * Set the priority of the idle and timeout sources that telepathy-glib
+ * creates for callbacks in @latency_class from now on. Sources that
+ * have already been created keep their old priority.
+ *
+ * By default, %TP_LATENCY_CLASS_INTERACTIVE uses %G_PRIORITY_HIGH,
+ * %TP_LATENCY_CLASS_NORMAL uses %G_PRIORITY_DEFAULT_IDLE and
+ * %TP_LATENCY_CLASS_BULK uses %G_PRIORITY_LOW.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_set_latency_class_priority (TpLatencyClass latency_class,
+    gint priority)
+{
+  g_return_if_fail (latency_class <= TP_LATENCY_CLASS_BULK);
+
+  g_atomic_int_set (&latency_class_priorities[latency_class], priority);
+}
+
+/**
+ * tp_get_latency_class_priority:
+ * @latency_class: a latency class
+ *
+ * Return the priority set by tp_set_latency_class_priority(), or the
+ * default priority for @latency_class if it has not been set.
+ *
+ * Returns: a #GSource priority
+ *
+ * Since: 0.UNRELEASED
+ */
+gint
+tp_get_latency_class_priority (TpLatencyClass latency_class)
+{
+  g_return_val_if_fail (latency_class <= TP_LATENCY_CLASS_BULK,
+      G_PRIORITY_DEFAULT_IDLE);
+
+  return g_atomic_int_get (&latency_class_priorities[latency_class]);
+}
+
+/*
+ * _tp_idle_source_new:
+ * @latency_class: the latency class of the callback
+ *
+ * Returns: (transfer full): a new idle source with the priority of
+ *  @latency_class, which the caller must attach to a main context
+ */
+GSource *
+_tp_idle_source_new (TpLatencyClass latency_class)
+{
+  GSource *source = g_idle_source_new ();
+
+  g_source_set_priority (source,
+      tp_get_latency_class_priority (latency_class));
+  return source;
+}
+
+/*
+ * _tp_idle_add_full:
+ * @latency_class: the latency class of @function
+ * @function: called when the thread-default main context is idle
+ * @data: data for @function
+ * @notify: (allow-none): called on @data when the source is removed
+ *
+ * Like g_idle_add_full(), but with the priority of @latency_class, and
+ * attached to the thread-default main context rather than the global
+ * default, so that work deferred by an object bound to a worker thread's
+ * main context (see #TpBaseConnection:main-context) stays in that thread.
+ * Remove it with _tp_source_remove(), from the same thread.
+ *
+ * Returns: the ID of the source
+ */
+guint
+_tp_idle_add_full (TpLatencyClass latency_class,
+    GSourceFunc function,
+    gpointer data,
+    GDestroyNotify notify)
+{
+  GSource *source = _tp_idle_source_new (latency_class);
+  guint id;
+
+  g_source_set_callback (source, function, data, notify);
+  id = g_source_attach (source, g_main_context_get_thread_default ());
+  g_source_unref (source);
+  return id;
+}
+
+/*
+ * _tp_idle_add:
+ * @latency_class: the latency class of @function
+ * @function: called when the thread-default main context is idle
+ * @data: data for @function
+ *
+ * Like _tp_idle_add_full(), with no destroy notification.
+ *
+ * Returns: the ID of the source
+ */
+guint
+_tp_idle_add (TpLatencyClass latency_class,
+    GSourceFunc function,
+    gpointer data)
+{
+  return _tp_idle_add_full (latency_class, function, data, NULL);
+}
+
+/*
+ * _tp_timeout_add:
+ * @latency_class: the latency class of @function
+ * @interval: the time between calls to @function, in milliseconds
+ * @function: called from the thread-default main context every @interval ms
+ * @data: data for @function
+ *
+ * Like g_timeout_add(), but with the priority of @latency_class, and
+ * attached to the thread-default main context like _tp_idle_add_full().
+ *
+ * Returns: the ID of the source
+ */
+guint
+_tp_timeout_add (TpLatencyClass latency_class,
+    guint interval,
+    GSourceFunc function,
+    gpointer data)
+{
+  GSource *source = g_timeout_source_new (interval);
+  guint id;
+
+  g_source_set_priority (source,
+      tp_get_latency_class_priority (latency_class));
+  g_source_set_callback (source, function, data, NULL);
+  id = g_source_attach (source, g_main_context_get_thread_default ());
+  g_source_unref (source);
+  return id;
+}
+
+/*
+ * _tp_source_remove:
+ * @id: the ID of a source added by _tp_idle_add_full() or _tp_timeout_add()
+ *  in this thread
+ *
+ * Like g_source_remove(), but for a source in the thread-default main
+ * context.
+ */
+void
+_tp_source_remove (guint id)
+{
+  GSource *source = g_main_context_find_source_by_id (
+      g_main_context_get_thread_default (), id);
+
+  g_return_if_fail (source != NULL);
+  g_source_destroy (source);
+}
+
+/**
+ * TpTrimLevel:
+ * @TP_TRIM_LEVEL_MODERATE: memory is getting short: forget the older half
+ *  of each cache
+ * @TP_TRIM_LEVEL_COMPLETE: memory is critically short: forget everything
+ *  that can be recovered later
+ *
+ * How much cached data tp_trim_caches() should discard.
+ *
+ * Since: 0.UNRELEASED
+ */
+
+typedef struct {
+    GWeakRef object;
+    TpTrimFunc trim;
+    GMainContext *context;
+} Trimmable;
+
+typedef struct {
+    GObject *object;
+    TpTrimFunc trim;
+    TpTrimLevel level;
+} TrimCall;
+
+/* Trimmable, for objects which may or may not still exist */
+static GSList *trimmables = NULL;
+G_LOCK_DEFINE_STATIC (trimmables);
+
+static void
+trimmable_free (Trimmable *t)
+{
+  g_weak_ref_clear (&t->object);
+  g_main_context_unref (t->context);
+  g_slice_free (Trimmable, t);
+}
+
+/* Must be called with the lock held. Returns a list of the objects still
+ * alive, with a strong ref each, which the caller must release after
+ * dropping the lock, in case that is the last ref. */
+static GSList *
+trimmables_sweep (void)
+{
+  GSList *alive = NULL;
+  GSList *l = trimmables;
+
+  trimmables = NULL;
+
+  while (l != NULL)
+    {
+      Trimmable *t = l->data;
+      GObject *object = g_weak_ref_get (&t->object);
+      GSList *next = l->next;
+
+      if (object == NULL)
+        {
+          trimmable_free (t);
+          g_slist_free_1 (l);
+        }
+      else
+        {
+          l->next = trimmables;
+          trimmables = l;
+          alive = g_slist_prepend (alive, object);
+        }
+
+      l = next;
+    }
+
+  return alive;
+}
+
+/*
+ * _tp_register_trimmable:
+ * @object: a #GObject with optional cached data
+ * @trim: called on @object by tp_trim_caches()
+ *
+ * Arrange for @trim to be called for @object by tp_trim_caches(), in the
+ * thread-default main context at the time of this call, until @object is
+ * finalized.
+ */
+void
+_tp_register_trimmable (gpointer object,
+    TpTrimFunc trim)
+{
+  Trimmable *t;
+  GSList *alive;
+
+  g_return_if_fail (G_IS_OBJECT (object));
+  g_return_if_fail (trim != NULL);
+
+  t = g_slice_new0 (Trimmable);
+  g_weak_ref_init (&t->object, object);
+  t->trim = trim;
+  t->context = g_main_context_ref_thread_default ();
+
+  G_LOCK (trimmables);
+  /* forget objects which have gone, so the list doesn't only grow */
+  alive = trimmables_sweep ();
+  trimmables = g_slist_prepend (trimmables, t);
+  G_UNLOCK (trimmables);
+
+  g_slist_free_full (alive, g_object_unref);
+}
+
+static gboolean
+trim_call_cb (gpointer data)
+{
+  TrimCall *call = data;
+
+  call->trim (call->object, call->level);
+  return FALSE;
+}
+
+static void
+trim_call_free (gpointer data)
+{
+  TrimCall *call = data;
+
+  g_object_unref (call->object);
+  g_slice_free (TrimCall, call);
+}
+
+/**
+ * tp_trim_caches:
+ * @level: how much to discard
+ *
+ * Discard data that telepathy-glib keeps only to save time or D-Bus round
+ * trips, and can fetch or recompute if it is needed again: the results of
+ * identifier normalization cached by #TpProtocol and #TpDynamicHandleRepo,
+ * the backlog of debug messages kept by #TpDebugSender, and, for
+ * %TP_TRIM_LEVEL_COMPLETE, the contact attributes that each #TpConnection
+ * has loaded from its on-disk cache (see
+ * tp_connection_set_contact_attributes_cache_enabled()).
+ *
+ * This is intended to be called when the system reports that memory is
+ * short, for instance from a #GMemoryMonitor's low-memory-warning signal
+ * on GLib versions which have it. It may be called from any thread: each
+ * object is trimmed in the main context it was created in, straight away
+ * if that is the caller's, and otherwise the next time that main context
+ * is iterated.
+ *
+ * Since: 0.UNRELEASED
+ */
+void
+tp_trim_caches (TpTrimLevel level)
+{
+  GSList *alive, *l;
+  /* TrimCall, and the main context in which to make each one */
+  GSList *calls = NULL;
+  GSList *contexts = NULL;
+
+  g_return_if_fail (level <= TP_TRIM_LEVEL_COMPLETE);
+
+  DEBUG ("trimming caches (level %u)", level);
+
+  G_LOCK (trimmables);
+  alive = trimmables_sweep ();
+
+  /* the sweep built both lists in the same order */
+  for (l = trimmables; l != NULL; l = l->next)
+    {
+      Trimmable *t = l->data;
+      TrimCall *call = g_slice_new0 (TrimCall);
+
+      g_assert (alive != NULL);
+      call->object = alive->data;
+      alive = g_slist_delete_link (alive, alive);
+
+      call->trim = t->trim;
+      call->level = level;
+      calls = g_slist_prepend (calls, call);
+      contexts = g_slist_prepend (contexts, g_main_context_ref (t->context));
+    }
+
+  g_assert (alive == NULL);
+  G_UNLOCK (trimmables);
+
+  while (calls != NULL)
+    {
+      GMainContext *context = contexts->data;
+
+      g_main_context_invoke_full (context, G_PRIORITY_DEFAULT, trim_call_cb,
+          calls->data, trim_call_free);
+      g_main_context_unref (context);
+
+      calls = g_slist_delete_link (calls, calls);
+      contexts = g_slist_delete_link (contexts, contexts);
+    }
+}
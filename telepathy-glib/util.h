@@ -30,6 +30,7 @@
 #include <gio/gio.h>
 
 #include <telepathy-glib/defs.h>
+#include <telepathy-glib/_gen/genums.h>
 
 #define tp_verify_statement(R)  ((void) G_STATIC_ASSERT_EXPR (R))
 #define tp_verify_true(R)       (((void) G_STATIC_ASSERT_EXPR (R)), 1)
@@ -181,6 +182,26 @@ gboolean tp_user_action_time_should_present (gint64 user_action_time,
 /* See https://bugzilla.gnome.org/show_bug.cgi?id=610969 for glib inclusion */
 gchar *tp_utf8_make_valid (const gchar *name);
 
+typedef enum {
+    TP_LATENCY_CLASS_INTERACTIVE,
+    TP_LATENCY_CLASS_NORMAL,
+    TP_LATENCY_CLASS_BULK
+} TpLatencyClass;
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_set_latency_class_priority (TpLatencyClass latency_class,
+    gint priority);
+_TP_AVAILABLE_IN_UNRELEASED
+gint tp_get_latency_class_priority (TpLatencyClass latency_class);
+
+typedef enum {
+    TP_TRIM_LEVEL_MODERATE,
+    TP_TRIM_LEVEL_COMPLETE
+} TpTrimLevel;
+
+_TP_AVAILABLE_IN_UNRELEASED
+void tp_trim_caches (TpTrimLevel level);
+
 G_END_DECLS
 
 #undef  __TP_IN_UTIL_H__
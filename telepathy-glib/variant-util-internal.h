@@ -24,6 +24,8 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <dbus/dbus.h>
+#include <dbus/dbus-glib.h>
 
 GVariant *_tp_asv_to_vardict (const GHashTable *asv);
 
@@ -33,4 +35,67 @@ GVariant * _tp_boxed_to_variant (GType gtype,
 
 GHashTable * _tp_asv_from_vardict (GVariant *variant);
 
+/* A builder for small a{sv} maps whose keys are static strings, such as
+ * the TP_PROP_ constants. The values live in the builder, which is
+ * normally on the stack, until it is turned into a #GHashTable or a
+ * vardict, so no slice or hash insertion is needed per key while building
+ * and the vardict needs no GValue at all. See variant-util.c. */
+#define _TP_ASV_BUILDER_MAX_ENTRIES 8
+
+typedef struct {
+    const gchar *key;
+    GValue value;
+} _TpAsvBuilderEntry;
+
+typedef struct {
+    guint n_entries;
+    _TpAsvBuilderEntry entries[_TP_ASV_BUILDER_MAX_ENTRIES];
+} _TpAsvBuilder;
+
+void _tp_asv_builder_init (_TpAsvBuilder *self);
+void _tp_asv_builder_clear (_TpAsvBuilder *self);
+
+GValue *_tp_asv_builder_add (_TpAsvBuilder *self,
+    const gchar *key,
+    GType type);
+void _tp_asv_builder_add_string (_TpAsvBuilder *self,
+    const gchar *key,
+    const gchar *value);
+void _tp_asv_builder_add_uint32 (_TpAsvBuilder *self,
+    const gchar *key,
+    guint32 value);
+void _tp_asv_builder_add_boolean (_TpAsvBuilder *self,
+    const gchar *key,
+    gboolean value);
+
+GHashTable *_tp_asv_builder_end (_TpAsvBuilder *self);
+void _tp_asv_builder_end_into (_TpAsvBuilder *self,
+    GHashTable *asv);
+GVariant *_tp_asv_builder_end_vardict (_TpAsvBuilder *self);
+
+GVariant *_tp_dbus_message_dup_body (DBusMessage *message,
+    GError **error);
+
+DBusMessage *_tp_dbus_message_new_method_call (const gchar *destination,
+    const gchar *path,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args);
+
+DBusMessage *_tp_dbus_message_new_signal (const gchar *path,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args);
+
+DBusMessage *_tp_dbus_message_new_method_return (DBusMessage *call,
+    GVariant *args);
+
+void _tp_dbus_g_method_return_variant (DBusGMethodInvocation *context,
+    GVariant *args);
+
+DBusMessage *_tp_dbus_method_return_template_new (GVariant *args);
+
+void _tp_dbus_g_method_return_template (DBusGMethodInvocation *context,
+    DBusMessage *reply_template);
+
 #endif /* __TP_VARIANT_UTIL_INTERNAL_H__ */
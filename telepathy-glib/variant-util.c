@@ -43,8 +43,13 @@
 #include <telepathy-glib/variant-util.h>
 #include <telepathy-glib/variant-util-internal.h>
 
+#include <string.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+
 #include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/util.h>
+#include <telepathy-glib/util-internal.h>
 
 #define DEBUG_FLAG TP_DEBUG_MISC
 #include "debug-internal.h"
@@ -107,6 +112,481 @@ _tp_asv_from_vardict (GVariant *variant)
   return result;
 }
 
+/*
+ * _tp_asv_builder_init:
+ * @self: an uninitialized builder, typically on the stack
+ *
+ * Prepare @self to collect up to %_TP_ASV_BUILDER_MAX_ENTRIES values.
+ */
+void
+_tp_asv_builder_init (_TpAsvBuilder *self)
+{
+  self->n_entries = 0;
+}
+
+/*
+ * _tp_asv_builder_clear:
+ * @self: a builder
+ *
+ * Free any values in @self, which may then be reused or discarded. It is
+ * harmless to call this after the builder has been ended.
+ */
+void
+_tp_asv_builder_clear (_TpAsvBuilder *self)
+{
+  guint i;
+
+  for (i = 0; i < self->n_entries; i++)
+    g_value_unset (&self->entries[i].value);
+
+  self->n_entries = 0;
+}
+
+/*
+ * _tp_asv_builder_add:
+ * @self: a builder
+ * @key: (transfer none): a string which must remain valid for as long as
+ *  the resulting map, typically a TP_PROP_ constant
+ * @type: the type of the value
+ *
+ * Add an entry for @key, replacing any previous entry for it as
+ * tp_asv_set_uint32() and friends would.
+ *
+ * Returns: (transfer none): a #GValue initialized to @type, which the
+ *  caller should set
+ */
+GValue *
+_tp_asv_builder_add (_TpAsvBuilder *self,
+    const gchar *key,
+    GType type)
+{
+  _TpAsvBuilderEntry *entry;
+  guint i;
+
+  g_return_val_if_fail (key != NULL, NULL);
+
+  for (i = 0; i < self->n_entries; i++)
+    {
+      if (!tp_strdiff (self->entries[i].key, key))
+        break;
+    }
+
+  if (i < self->n_entries)
+    {
+      g_value_unset (&self->entries[i].value);
+    }
+  else
+    {
+      g_return_val_if_fail (self->n_entries < _TP_ASV_BUILDER_MAX_ENTRIES,
+          NULL);
+      self->n_entries++;
+    }
+
+  entry = &self->entries[i];
+  entry->key = key;
+  memset (&entry->value, 0, sizeof (GValue));
+  return g_value_init (&entry->value, type);
+}
+
+void
+_tp_asv_builder_add_string (_TpAsvBuilder *self,
+    const gchar *key,
+    const gchar *value)
+{
+  GValue *v = _tp_asv_builder_add (self, key, G_TYPE_STRING);
+
+  g_return_if_fail (v != NULL);
+  g_value_set_string (v, value);
+}
+
+void
+_tp_asv_builder_add_uint32 (_TpAsvBuilder *self,
+    const gchar *key,
+    guint32 value)
+{
+  GValue *v = _tp_asv_builder_add (self, key, G_TYPE_UINT);
+
+  g_return_if_fail (v != NULL);
+  g_value_set_uint (v, value);
+}
+
+void
+_tp_asv_builder_add_boolean (_TpAsvBuilder *self,
+    const gchar *key,
+    gboolean value)
+{
+  GValue *v = _tp_asv_builder_add (self, key, G_TYPE_BOOLEAN);
+
+  g_return_if_fail (v != NULL);
+  g_value_set_boolean (v, value);
+}
+
+/* move the values out of @self into @asv, copying the keys with @key_dup
+ * if it is not %NULL */
+static void
+asv_builder_move_into (_TpAsvBuilder *self,
+    GHashTable *asv,
+    gchar *(*key_dup) (const gchar *))
+{
+  guint i;
+
+  for (i = 0; i < self->n_entries; i++)
+    {
+      _TpAsvBuilderEntry *entry = &self->entries[i];
+      GValue *value = _tp_slice_new_tagged (_TP_ALLOC_GVALUE, GValue);
+
+      /* steal the contents, rather than copying them */
+      *value = entry->value;
+      g_hash_table_insert (asv,
+          key_dup != NULL ? key_dup (entry->key) : (gchar *) entry->key,
+          value);
+    }
+
+  self->n_entries = 0;
+}
+
+/*
+ * _tp_asv_builder_end:
+ * @self: a builder
+ *
+ * Returns: (transfer full): a new map of type
+ *  %TP_HASH_TYPE_STRING_VARIANT_MAP, like one from tp_asv_new(), containing
+ *  the values from @self, which is left empty
+ */
+GHashTable *
+_tp_asv_builder_end (_TpAsvBuilder *self)
+{
+  GHashTable *asv = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) tp_g_value_slice_free);
+
+  asv_builder_move_into (self, asv, NULL);
+  return asv;
+}
+
+/*
+ * _tp_asv_builder_end_into:
+ * @self: a builder
+ * @asv: a map which frees its keys with g_free() and its values with
+ *  tp_g_value_slice_free(), such as one from
+ *  tp_dbus_properties_mixin_make_properties_hash()
+ *
+ * Move the values from @self into @asv, copying their keys, and leave
+ * @self empty.
+ */
+void
+_tp_asv_builder_end_into (_TpAsvBuilder *self,
+    GHashTable *asv)
+{
+  asv_builder_move_into (self, asv, g_strdup);
+}
+
+/*
+ * _tp_asv_builder_end_vardict:
+ * @self: a builder
+ *
+ * Returns: (transfer full): a vardict containing the values from @self,
+ *  which is left empty
+ */
+GVariant *
+_tp_asv_builder_end_vardict (_TpAsvBuilder *self)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  for (i = 0; i < self->n_entries; i++)
+    {
+      const GValue *value = &self->entries[i].value;
+      GType type = G_VALUE_TYPE (value);
+      GVariant *variant;
+
+      /* the common types are converted directly; dbus-glib copes with the
+       * rest */
+      if (type == G_TYPE_STRING)
+        variant = g_variant_new_string (g_value_get_string (value));
+      else if (type == G_TYPE_UINT)
+        variant = g_variant_new_uint32 (g_value_get_uint (value));
+      else if (type == G_TYPE_BOOLEAN)
+        variant = g_variant_new_boolean (g_value_get_boolean (value));
+      else
+        variant = dbus_g_value_build_g_variant (value);
+
+      g_variant_builder_add (&builder, "{sv}", self->entries[i].key,
+          variant);
+    }
+
+  _tp_asv_builder_clear (self);
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/*
+ * _tp_dbus_message_dup_body:
+ * @message: a libdbus message
+ * @error: used to raise an error if %NULL is returned
+ *
+ * Convert the arguments of @message into a tuple, without going via
+ * #GValue. This is done by handing the serialized message to GDBus,
+ * so the result has exactly the message's signature.
+ *
+ * Returns: (transfer full): a tuple of the arguments, which is the empty
+ *  tuple if @message has none, or %NULL if @message cannot be parsed
+ */
+GVariant *
+_tp_dbus_message_dup_body (DBusMessage *message,
+    GError **error)
+{
+  GDBusMessage *gmessage;
+  GVariant *body;
+  char *blob;
+  int len;
+
+  if (!dbus_message_marshal (message, &blob, &len))
+    ERROR ("Out of memory");
+
+  gmessage = g_dbus_message_new_from_blob ((guchar *) blob, len,
+      G_DBUS_CAPABILITY_FLAGS_NONE, error);
+  dbus_free (blob);
+
+  if (gmessage == NULL)
+    return NULL;
+
+  body = g_dbus_message_get_body (gmessage);
+
+  if (body == NULL)
+    body = g_variant_ref_sink (g_variant_new ("()"));
+  else
+    g_variant_ref (body);
+
+  g_object_unref (gmessage);
+  return body;
+}
+
+/* Returns: (transfer full): a copy of @gmessage as a libdbus message, with
+ * no serial number */
+static DBusMessage *
+dbus_message_from_gdbus (GDBusMessage *gmessage)
+{
+  DBusMessage *parsed;
+  DBusMessage *message;
+  DBusError error = DBUS_ERROR_INIT;
+  guchar *blob;
+  gsize len;
+  GError *gerror = NULL;
+
+  /* libdbus considers a message with serial 0 to be invalid, and copying
+   * it resets the serial anyway, so libdbus can assign its own */
+  g_dbus_message_set_serial (gmessage, 1);
+  blob = g_dbus_message_to_blob (gmessage, &len,
+      G_DBUS_CAPABILITY_FLAGS_NONE, &gerror);
+
+  if (blob == NULL)
+    ERROR ("unable to serialize message: %s", gerror->message);
+
+  parsed = dbus_message_demarshal ((const char *) blob, len, &error);
+
+  if (parsed == NULL)
+    ERROR ("unable to parse message: %s", error.message);
+
+  message = dbus_message_copy (parsed);
+
+  if (message == NULL)
+    ERROR ("Out of memory");
+
+  dbus_message_unref (parsed);
+  g_free (blob);
+  return message;
+}
+
+/*
+ * _tp_dbus_message_new_method_call:
+ * @destination: the bus name to call
+ * @path: the object path to call
+ * @iface: the interface of the method
+ * @member: the name of the method
+ * @args: (allow-none): a tuple of "in" arguments; if floating, it is
+ *  consumed
+ *
+ * The reverse of _tp_dbus_message_dup_body(): build a libdbus method call
+ * whose arguments are @args.
+ *
+ * Returns: (transfer full): a new method call with no serial number
+ */
+DBusMessage *
+_tp_dbus_message_new_method_call (const gchar *destination,
+    const gchar *path,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args)
+{
+  GDBusMessage *gmessage;
+  DBusMessage *message;
+
+  gmessage = g_dbus_message_new_method_call (destination, path, iface,
+      member);
+
+  if (args != NULL)
+    g_dbus_message_set_body (gmessage, args);
+
+  message = dbus_message_from_gdbus (gmessage);
+  g_object_unref (gmessage);
+  return message;
+}
+
+/*
+ * _tp_dbus_message_new_signal:
+ * @path: the object path emitting the signal
+ * @iface: the interface of the signal
+ * @member: the name of the signal
+ * @args: (allow-none): a tuple of arguments; if floating, it is consumed
+ *
+ * Build a libdbus signal whose arguments are @args. It is a broadcast
+ * unless a destination is set with dbus_message_set_destination().
+ *
+ * Returns: (transfer full): a new signal with no serial number
+ */
+DBusMessage *
+_tp_dbus_message_new_signal (const gchar *path,
+    const gchar *iface,
+    const gchar *member,
+    GVariant *args)
+{
+  GDBusMessage *gmessage;
+  DBusMessage *message;
+
+  gmessage = g_dbus_message_new_signal (path, iface, member);
+
+  if (args != NULL)
+    g_dbus_message_set_body (gmessage, args);
+
+  message = dbus_message_from_gdbus (gmessage);
+  g_object_unref (gmessage);
+  return message;
+}
+
+static DBusMessage *
+method_return_new (guint32 reply_serial,
+    const gchar *destination,
+    GVariant *args)
+{
+  GDBusMessage *gmessage = g_dbus_message_new ();
+  DBusMessage *message;
+
+  g_dbus_message_set_message_type (gmessage,
+      G_DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  g_dbus_message_set_flags (gmessage,
+      G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+  g_dbus_message_set_reply_serial (gmessage, reply_serial);
+
+  /* peer-to-peer connections have no sender */
+  if (destination != NULL)
+    g_dbus_message_set_destination (gmessage, destination);
+
+  g_dbus_message_set_body (gmessage, args);
+
+  message = dbus_message_from_gdbus (gmessage);
+  g_object_unref (gmessage);
+  return message;
+}
+
+/*
+ * _tp_dbus_message_new_method_return:
+ * @call: a method call
+ * @args: a tuple of "out" arguments; if floating, it is consumed
+ *
+ * Build a libdbus reply to @call whose arguments are @args.
+ *
+ * Returns: (transfer full): a new method return with no serial number
+ */
+DBusMessage *
+_tp_dbus_message_new_method_return (DBusMessage *call,
+    GVariant *args)
+{
+  return method_return_new (dbus_message_get_serial (call),
+      dbus_message_get_sender (call), args);
+}
+
+/*
+ * _tp_dbus_g_method_return_variant:
+ * @context: a method invocation
+ * @args: a tuple of "out" arguments; if floating, it is consumed
+ *
+ * Reply to @context with @args, like dbus_g_method_return() but without
+ * converting them to #GValue first. This frees @context.
+ */
+void
+_tp_dbus_g_method_return_variant (DBusGMethodInvocation *context,
+    GVariant *args)
+{
+  DBusMessage *skeleton = dbus_g_method_get_reply (context);
+
+  /* this takes ownership of the message */
+  dbus_g_method_send_reply (context,
+      method_return_new (dbus_message_get_reply_serial (skeleton),
+        dbus_message_get_destination (skeleton), args));
+
+  dbus_message_unref (skeleton);
+}
+
+/*
+ * _tp_dbus_method_return_template_new:
+ * @args: a tuple of "out" arguments; if floating, it is consumed
+ *
+ * Serialize a method reply containing @args once, so that it can be sent
+ * in reply to any number of calls by _tp_dbus_g_method_return_template().
+ *
+ * Returns: (transfer full): a method return message, which must not itself
+ *  be sent
+ */
+DBusMessage *
+_tp_dbus_method_return_template_new (GVariant *args)
+{
+  GDBusMessage *gmessage = g_dbus_message_new ();
+  DBusMessage *message;
+
+  g_dbus_message_set_message_type (gmessage,
+      G_DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  g_dbus_message_set_flags (gmessage,
+      G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+  /* a placeholder, so that libdbus accepts the message: each copy gets
+   * the serial of the call it answers */
+  g_dbus_message_set_reply_serial (gmessage, 1);
+  g_dbus_message_set_body (gmessage, args);
+
+  message = dbus_message_from_gdbus (gmessage);
+  g_object_unref (gmessage);
+  return message;
+}
+
+/*
+ * _tp_dbus_g_method_return_template:
+ * @context: a method invocation
+ * @reply_template: a message from _tp_dbus_method_return_template_new()
+ *
+ * Reply to @context with a copy of @reply_template, which costs little more
+ * than copying its bytes. This frees @context.
+ */
+void
+_tp_dbus_g_method_return_template (DBusGMethodInvocation *context,
+    DBusMessage *reply_template)
+{
+  DBusMessage *skeleton = dbus_g_method_get_reply (context);
+  DBusMessage *reply = dbus_message_copy (reply_template);
+  const gchar *destination = dbus_message_get_destination (skeleton);
+
+  if (reply == NULL ||
+      !dbus_message_set_reply_serial (reply,
+        dbus_message_get_reply_serial (skeleton)) ||
+      (destination != NULL &&
+       !dbus_message_set_destination (reply, destination)))
+    ERROR ("Out of memory");
+
+  /* this takes ownership of the message */
+  dbus_g_method_send_reply (context, reply);
+
+  dbus_message_unref (skeleton);
+}
+
 /**
  * tp_variant_type_classify:
  * @type: a #GVariantType
@@ -28,6 +28,58 @@
     g_assert_cmpstr (tp_asv_get_object_path (hash, key), ==, expected_value); \
     g_assert_cmpstr (tp_vardict_get_object_path (vardict, key), ==, expected_value); \
 
+static void
+test_builder (void)
+{
+  static const char * const strv[] = { "Foo", "Bar", NULL };
+  _TpAsvBuilder builder;
+  GHashTable *hash;
+  GVariant *vardict;
+  guint i;
+
+  /* build the same map twice, once as each representation */
+  for (i = 0; i < 2; i++)
+    {
+      _tp_asv_builder_init (&builder);
+      _tp_asv_builder_add_string (&builder, "s", "replaced");
+      _tp_asv_builder_add_uint32 (&builder, "u32", 42);
+      _tp_asv_builder_add_boolean (&builder, "b", TRUE);
+      g_value_set_boxed (_tp_asv_builder_add (&builder, "as", G_TYPE_STRV),
+          strv);
+      g_value_set_double (_tp_asv_builder_add (&builder, "d", G_TYPE_DOUBLE),
+          0.5);
+      /* adding a key again replaces it */
+      _tp_asv_builder_add_string (&builder, "s", "test");
+
+      if (i == 0)
+        {
+          hash = _tp_asv_builder_end (&builder);
+          vardict = _tp_asv_to_vardict (hash);
+        }
+      else
+        {
+          vardict = _tp_asv_builder_end_vardict (&builder);
+          hash = _tp_asv_from_vardict (vardict);
+        }
+
+      /* the builder is left empty */
+      g_assert_cmpuint (builder.n_entries, ==, 0);
+      _tp_asv_builder_clear (&builder);
+
+      g_assert_cmpuint (tp_asv_size (hash), ==, 5);
+      asv_assert_string ("s", "test");
+      g_assert_cmpuint (tp_vardict_get_uint32 (vardict, "u32", NULL), ==, 42);
+      g_assert_cmpuint (tp_asv_get_uint32 (hash, "u32", NULL), ==, 42);
+      g_assert (tp_vardict_get_boolean (vardict, "b", NULL));
+      g_assert (tp_asv_get_boolean (hash, "b", NULL));
+      g_assert_cmpstr (tp_asv_get_strv (hash, "as")[1], ==, "Bar");
+      g_assert (tp_vardict_get_double (vardict, "d", NULL) == 0.5);
+
+      g_hash_table_unref (hash);
+      g_variant_unref (vardict);
+    }
+}
+
 int main (int argc, char **argv)
 {
   GHashTable *hash;
@@ -274,6 +326,8 @@ int main (int argc, char **argv)
   MYASSERT (G_VALUE_HOLDS_INT (tp_asv_lookup (hash, "i32:0")), "");
   MYASSERT (tp_asv_lookup (hash, "not-there") == NULL, "");
 
+  test_builder ();
+
   /* Teardown */
 
   g_hash_table_unref (hash);
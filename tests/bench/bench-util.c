@@ -0,0 +1,244 @@
+/* Shared code for the benchmarks
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Every benchmark prints one tab-separated line per result on stdout:
+ *
+ *   benchmark  size  ops  microseconds  ops_per_second  allocations  bytes
+ *     peak_rss_kb
+ *
+ * where allocations and bytes count calls to g_malloc(), g_realloc() and
+ * friends during the measurement, and peak_rss_kb is the process's peak
+ * resident set size so far, or 0 if it cannot be determined. Run with
+ * G_SLICE=always-malloc (as "make bench" does) so that GSlice allocations
+ * are counted too. */
+
+#include "config.h"
+
+#include "tests/bench/bench-util.h"
+
+#include <stdlib.h>
+
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_GETRUSAGE) && defined(HAVE_SYS_RESOURCE_H)
+#include <sys/resource.h>
+#endif
+
+#include <telepathy-glib/util.h>
+
+static volatile gsize n_allocations = 0;
+static volatile gsize n_allocated_bytes = 0;
+
+static gpointer
+counting_malloc (gsize n_bytes)
+{
+  g_atomic_pointer_add (&n_allocations, 1);
+  g_atomic_pointer_add (&n_allocated_bytes, n_bytes);
+  return malloc (n_bytes);
+}
+
+static gpointer
+counting_realloc (gpointer mem,
+    gsize n_bytes)
+{
+  g_atomic_pointer_add (&n_allocations, 1);
+  g_atomic_pointer_add (&n_allocated_bytes, n_bytes);
+  return realloc (mem, n_bytes);
+}
+
+static void
+counting_free (gpointer mem)
+{
+  free (mem);
+}
+
+static GMemVTable counting_vtable = {
+    counting_malloc,
+    counting_realloc,
+    counting_free,
+    NULL,
+    NULL,
+    NULL
+};
+
+static glong
+peak_rss_kb (void)
+{
+#if defined(HAVE_GETRUSAGE) && defined(HAVE_SYS_RESOURCE_H)
+  struct rusage usage;
+
+  /* ru_maxrss is in kilobytes on Linux and the BSDs */
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    return usage.ru_maxrss;
+#endif
+
+  return 0;
+}
+
+/*
+ * tp_tests_bench_get_cpu_time:
+ *
+ * Returns: the user and system CPU time used by this process so far, in
+ *  microseconds, or 0 if it cannot be determined
+ */
+gint64
+tp_tests_bench_get_cpu_time (void)
+{
+#if defined(HAVE_GETRUSAGE) && defined(HAVE_SYS_RESOURCE_H)
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+        (gint64) G_USEC_PER_SEC +
+        usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+
+  return 0;
+}
+
+/*
+ * tp_tests_bench_get_rss:
+ *
+ * Returns: the current (not peak) resident set size of this process, in
+ *  bytes, or 0 if it cannot be determined; this only works on Linux
+ */
+gsize
+tp_tests_bench_get_rss (void)
+{
+  gsize rss = 0;
+#ifdef G_OS_UNIX
+  gchar *contents;
+  gchar **fields;
+  glong page_size = sysconf (_SC_PAGESIZE);
+
+  /* the second field is the number of resident pages */
+  if (page_size > 0 &&
+      g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    {
+      fields = g_strsplit (contents, " ", 3);
+
+      if (fields[0] != NULL && fields[1] != NULL)
+        rss = g_ascii_strtoull (fields[1], NULL, 10) * page_size;
+
+      g_strfreev (fields);
+      g_free (contents);
+    }
+#endif
+
+  return rss;
+}
+
+/*
+ * tp_tests_bench_init:
+ * @argc: from main()
+ * @argv: from main()
+ * @default_sizes: sizes to run the benchmarks at if none are given on the
+ *  command line
+ * @n_default_sizes: the number of elements of @default_sizes
+ * @sizes: (out) (transfer full): used to return the sizes to run the
+ *  benchmarks at, as a #GArray of #guint
+ *
+ * Install the counting allocator, parse the command line and print the
+ * header line. This must be the first thing main() does, before anything
+ * has allocated memory with GLib; it exits with status 2 on invalid
+ * arguments.
+ */
+void
+tp_tests_bench_init (int argc,
+    char **argv,
+    const guint *default_sizes,
+    guint n_default_sizes,
+    GArray **sizes)
+{
+  gint i;
+
+  g_mem_set_vtable (&counting_vtable);
+
+  *sizes = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (i = 1; i < argc; i++)
+    {
+      guint64 n = g_ascii_strtoull (argv[i], NULL, 10);
+      guint size = n;
+
+      if (n == 0 || n > G_MAXUINT)
+        {
+          g_printerr ("Usage: %s [SIZE...]\n", argv[0]);
+          exit (2);
+        }
+
+      g_array_append_val (*sizes, size);
+    }
+
+  if ((*sizes)->len == 0)
+    g_array_append_vals (*sizes, default_sizes, n_default_sizes);
+
+  if (tp_strdiff (g_getenv ("G_SLICE"), "always-malloc"))
+    g_printerr ("G_SLICE is not always-malloc: allocations from GSlice "
+        "will not be counted\n");
+
+  g_print ("# benchmark\tsize\tops\tmicroseconds\tops_per_second"
+      "\tallocations\tbytes\tpeak_rss_kb\n");
+}
+
+void
+tp_tests_bench_start (TpTestsBenchMeasurement *m,
+    const gchar *benchmark,
+    guint size)
+{
+  m->benchmark = benchmark;
+  m->size = size;
+  m->start_allocations = g_atomic_pointer_get (&n_allocations);
+  m->start_bytes = g_atomic_pointer_get (&n_allocated_bytes);
+  m->start_time = g_get_monotonic_time ();
+}
+
+/*
+ * tp_tests_bench_report:
+ * @m: a measurement started with tp_tests_bench_start()
+ * @n_ops: how many operations were carried out since then
+ *
+ * Print the result of @m.
+ */
+void
+tp_tests_bench_report (TpTestsBenchMeasurement *m,
+    guint64 n_ops)
+{
+  gint64 elapsed = g_get_monotonic_time () - m->start_time;
+  gsize allocations = g_atomic_pointer_get (&n_allocations) -
+      m->start_allocations;
+  gsize bytes = g_atomic_pointer_get (&n_allocated_bytes) - m->start_bytes;
+  gdouble ops_per_second = n_ops * (gdouble) G_USEC_PER_SEC /
+      MAX (elapsed, 1);
+
+  g_print ("%s\t%u\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%.0f"
+      "\t%" G_GSIZE_FORMAT "\t%" G_GSIZE_FORMAT "\t%ld\n",
+      m->benchmark, m->size, n_ops, elapsed, ops_per_second,
+      allocations, bytes, peak_rss_kb ());
+}
+
+/*
+ * tp_tests_bench_get_allocations:
+ * @m: a measurement started with tp_tests_bench_start()
+ * @bytes: (out) (allow-none): used to return how many bytes were allocated
+ *  since then
+ *
+ * Returns: how many allocations were made since @m was started
+ */
+gsize
+tp_tests_bench_get_allocations (TpTestsBenchMeasurement *m,
+    gsize *bytes)
+{
+  if (bytes != NULL)
+    *bytes = g_atomic_pointer_get (&n_allocated_bytes) - m->start_bytes;
+
+  return g_atomic_pointer_get (&n_allocations) - m->start_allocations;
+}
@@ -0,0 +1,44 @@
+/* Shared code for the benchmarks
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#ifndef __TP_TESTS_BENCH_UTIL_H__
+#define __TP_TESTS_BENCH_UTIL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct {
+    const gchar *benchmark;
+    guint size;
+    gint64 start_time;
+    gsize start_allocations;
+    gsize start_bytes;
+} TpTestsBenchMeasurement;
+
+void tp_tests_bench_init (int argc,
+    char **argv,
+    const guint *default_sizes,
+    guint n_default_sizes,
+    GArray **sizes);
+
+void tp_tests_bench_start (TpTestsBenchMeasurement *m,
+    const gchar *benchmark,
+    guint size);
+void tp_tests_bench_report (TpTestsBenchMeasurement *m,
+    guint64 n_ops);
+gsize tp_tests_bench_get_allocations (TpTestsBenchMeasurement *m,
+    gsize *bytes);
+
+gint64 tp_tests_bench_get_cpu_time (void);
+gsize tp_tests_bench_get_rss (void);
+
+G_END_DECLS
+
+#endif /* #ifndef __TP_TESTS_BENCH_UTIL_H__ */
@@ -0,0 +1,278 @@
+/* Benchmarks for client-side contact list and contact handling
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-contacts [N_CONTACTS...]
+ *
+ * For each roster size (1000, 10000 and 100000 by default), this connects
+ * a TpTestsContactsConnection with that many contacts, spread over a few
+ * groups, and measures:
+ *
+ *   contact-list    connecting and preparing
+ *                   TP_CONNECTION_FEATURE_CONTACT_LIST, until the roster
+ *                   has been retrieved
+ *   presence-storm  one PresencesChanged signal per contact, until each
+ *                   TpContact has emitted TpContact::presence-changed
+ *   upgrade         tp_connection_upgrade_contacts_async() on every
+ *                   contact, from a second TpConnection with no contact
+ *                   features
+ *
+ * The service and the client run in this process, so the figures include
+ * the service side. See bench-util.c for the output format. */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/contacts-conn.h"
+#include "tests/lib/contact-list-manager.h"
+#include "tests/lib/util.h"
+
+#define N_GROUPS 10
+
+typedef struct {
+    guint n_contacts;
+
+    /* Service side objects */
+    TpBaseConnection *base_connection;
+    TpTestsContactsConnection *service_conn;
+    TpTestsContactListManager *manager;
+    TpHandleRepoIface *contact_repo;
+    GArray *handles;
+
+    /* Client side objects */
+    TpDBusDaemon *dbus;
+    TpConnection *client_conn;
+    guint n_presences_changed;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    TpDBusDaemon *dbus,
+    guint n_contacts)
+{
+  TpSimpleClientFactory *factory;
+  guint i;
+
+  f->n_contacts = n_contacts;
+  f->dbus = g_object_ref (dbus);
+  f->n_presences_changed = 0;
+
+  tp_tests_create_conn (TP_TESTS_TYPE_CONTACTS_CONNECTION, "me@test.com",
+      FALSE, &f->base_connection, &f->client_conn);
+  f->service_conn = TP_TESTS_CONTACTS_CONNECTION (f->base_connection);
+  f->manager = tp_tests_contacts_connection_get_contact_list_manager (
+      f->service_conn);
+  f->contact_repo = tp_base_connection_get_handles (f->base_connection,
+      TP_HANDLE_TYPE_CONTACT);
+
+  factory = tp_proxy_get_factory (f->client_conn);
+  tp_simple_client_factory_add_contact_features_varargs (factory,
+      TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_PRESENCE,
+      TP_CONTACT_FEATURE_SUBSCRIPTION_STATES,
+      TP_CONTACT_FEATURE_CONTACT_GROUPS,
+      TP_CONTACT_FEATURE_INVALID);
+
+  f->handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      n_contacts);
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u", i);
+      gchar *group = g_strdup_printf ("group%u", i % N_GROUPS);
+      TpHandle handle = tp_handle_ensure (f->contact_repo, id, NULL, NULL);
+
+      g_assert (handle != 0);
+      g_array_append_val (f->handles, handle);
+      tp_tests_contact_list_manager_add_to_group (f->manager, group, handle);
+
+      g_free (group);
+      g_free (id);
+    }
+
+  tp_tests_contact_list_manager_add_initial_contacts (f->manager,
+      f->handles->len, (TpHandle *) f->handles->data);
+}
+
+static void
+teardown (Fixture *f)
+{
+  tp_tests_connection_assert_disconnect_succeeds (f->client_conn);
+  g_object_unref (f->client_conn);
+  g_object_unref (f->base_connection);
+  g_array_unref (f->handles);
+  g_object_unref (f->dbus);
+}
+
+static void
+bench_contact_list (Fixture *f)
+{
+  const GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED,
+      TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  TpTestsBenchMeasurement m;
+  GPtrArray *contacts;
+
+  tp_tests_bench_start (&m, "contact-list", f->n_contacts);
+
+  tp_cli_connection_call_connect (f->client_conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (f->client_conn, features);
+
+  /* The feature is prepared as soon as the connection is, but the
+   * TpContact objects only exist once the roster has been retrieved */
+  while (tp_connection_get_contact_list_state (f->client_conn) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
+    g_main_context_iteration (NULL, TRUE);
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  contacts = tp_connection_dup_contact_list (f->client_conn);
+  g_assert_cmpuint (contacts->len, ==, f->n_contacts);
+  g_ptr_array_unref (contacts);
+}
+
+static void
+presence_changed_cb (TpContact *contact,
+    guint type,
+    const gchar *status,
+    const gchar *message,
+    Fixture *f)
+{
+  f->n_presences_changed++;
+}
+
+static void
+bench_presence_storm (Fixture *f)
+{
+  const TpTestsContactsConnectionPresenceStatusIndex busy =
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY;
+  const gchar *message = "benchmarking";
+  TpTestsBenchMeasurement m;
+  GPtrArray *contacts;
+  guint i;
+
+  contacts = tp_connection_dup_contact_list (f->client_conn);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+
+      g_assert (tp_contact_has_feature (contact,
+            TP_CONTACT_FEATURE_PRESENCE));
+      g_signal_connect (contact, "presence-changed",
+          G_CALLBACK (presence_changed_cb), f);
+    }
+
+  tp_tests_bench_start (&m, "presence-storm", f->n_contacts);
+
+  for (i = 0; i < f->handles->len; i++)
+    tp_tests_contacts_connection_change_presences (f->service_conn, 1,
+        &g_array_index (f->handles, TpHandle, i), &busy, &message);
+
+  while (f->n_presences_changed < f->n_contacts)
+    g_main_context_iteration (NULL, TRUE);
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  for (i = 0; i < contacts->len; i++)
+    g_signal_handlers_disconnect_by_func (g_ptr_array_index (contacts, i),
+        presence_changed_cb, f);
+
+  g_ptr_array_unref (contacts);
+}
+
+static void
+bench_upgrade (Fixture *f)
+{
+  const GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED, 0 };
+  const TpContactFeature contact_features[] = { TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_PRESENCE, TP_CONTACT_FEATURE_SUBSCRIPTION_STATES,
+      TP_CONTACT_FEATURE_CONTACT_GROUPS };
+  TpSimpleClientFactory *factory;
+  TpConnection *conn;
+  GPtrArray *contacts;
+  GPtrArray *upgraded = NULL;
+  GAsyncResult *result = NULL;
+  GError *error = NULL;
+  TpTestsBenchMeasurement m;
+  guint i;
+
+  /* A second proxy for the same connection, with its own factory, so that
+   * its TpContact objects start with no features */
+  factory = (TpSimpleClientFactory *) tp_automatic_client_factory_new (
+      f->dbus);
+  conn = tp_simple_client_factory_ensure_connection (factory,
+      tp_proxy_get_object_path (f->client_conn), NULL, &error);
+  g_assert_no_error (error);
+  tp_tests_proxy_run_until_prepared (conn, features);
+
+  contacts = g_ptr_array_new_full (f->n_contacts, g_object_unref);
+
+  for (i = 0; i < f->handles->len; i++)
+    {
+      TpHandle handle = g_array_index (f->handles, TpHandle, i);
+
+      g_ptr_array_add (contacts, tp_simple_client_factory_ensure_contact (
+            factory, conn, handle,
+            tp_handle_inspect (f->contact_repo, handle)));
+    }
+
+  tp_tests_bench_start (&m, "upgrade", f->n_contacts);
+
+  tp_connection_upgrade_contacts_async (conn, contacts->len,
+      (TpContact * const *) contacts->pdata,
+      G_N_ELEMENTS (contact_features), contact_features,
+      tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  tp_connection_upgrade_contacts_finish (conn, result, &upgraded, &error);
+  g_assert_no_error (error);
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  g_assert_cmpuint (upgraded->len, ==, f->n_contacts);
+  g_assert (tp_contact_has_feature (g_ptr_array_index (upgraded, 0),
+        TP_CONTACT_FEATURE_CONTACT_GROUPS));
+
+  g_ptr_array_unref (upgraded);
+  g_object_unref (result);
+  g_ptr_array_unref (contacts);
+  g_object_unref (conn);
+  g_object_unref (factory);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  static const guint default_sizes[] = { 1000, 10000, 100000 };
+  TpDBusDaemon *dbus;
+  GArray *sizes;
+  guint i;
+
+  tp_tests_bench_init (argc, argv, default_sizes,
+      G_N_ELEMENTS (default_sizes), &sizes);
+
+  /* keep the temporary session bus alive for all the runs */
+  dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  for (i = 0; i < sizes->len; i++)
+    {
+      Fixture f;
+
+      setup (&f, dbus, g_array_index (sizes, guint, i));
+      bench_contact_list (&f);
+      bench_presence_storm (&f);
+      bench_upgrade (&f);
+      teardown (&f);
+    }
+
+  g_object_unref (dbus);
+  g_array_unref (sizes);
+  return 0;
+}
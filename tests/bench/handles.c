@@ -0,0 +1,173 @@
+/* Benchmarks for handle repositories, TpIntset and TpHandleSet
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-handles [N_HANDLES...]
+ *
+ * For each size (1000, 10000 and 100000 by default), this measures:
+ *
+ *   repo-ensure, repo-lookup, repo-inspect
+ *       tp_handle_ensure(), tp_handle_lookup() and tp_handle_inspect() on
+ *       a TpDynamicHandleRepo, once per handle
+ *   intset-union, intset-intersection, intset-difference,
+ *   intset-symmetric-difference
+ *       the corresponding operation on two sets of 3/4 of the handles
+ *       each, overlapping by half, repeated REPEATS times
+ *   handle-set-update, handle-set-difference-update
+ *       adding one of those sets to an empty TpHandleSet, and removing one
+ *       from a copy of the other, repeated REPEATS times
+ *
+ * See bench-util.c for the output format. */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/util.h"
+
+#define REPEATS 100
+
+typedef TpIntset *(*IntsetBinaryOp) (const TpIntset *, const TpIntset *);
+
+static void
+bench_intset_op (const gchar *benchmark,
+    guint n_handles,
+    IntsetBinaryOp op,
+    const TpIntset *left,
+    const TpIntset *right)
+{
+  TpTestsBenchMeasurement m;
+  guint i;
+
+  tp_tests_bench_start (&m, benchmark, n_handles);
+
+  for (i = 0; i < REPEATS; i++)
+    tp_intset_destroy (op (left, right));
+
+  tp_tests_bench_report (&m, REPEATS);
+}
+
+static void
+bench_size (guint n_handles)
+{
+  TpTestsBenchMeasurement m;
+  TpHandleRepoIface *repo;
+  gchar **ids;
+  TpHandle *handles;
+  TpIntset *left, *right;
+  guint i;
+
+  repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      NULL);
+
+  ids = g_new0 (gchar *, n_handles + 1);
+  handles = g_new0 (TpHandle, n_handles);
+
+  for (i = 0; i < n_handles; i++)
+    ids[i] = g_strdup_printf ("contact%u@example.com", i);
+
+  tp_tests_bench_start (&m, "repo-ensure", n_handles);
+
+  for (i = 0; i < n_handles; i++)
+    handles[i] = tp_handle_ensure (repo, ids[i], NULL, NULL);
+
+  tp_tests_bench_report (&m, n_handles);
+
+  tp_tests_bench_start (&m, "repo-lookup", n_handles);
+
+  for (i = 0; i < n_handles; i++)
+    {
+      if (tp_handle_lookup (repo, ids[i], NULL, NULL) != handles[i])
+        g_error ("%s has the wrong handle", ids[i]);
+    }
+
+  tp_tests_bench_report (&m, n_handles);
+
+  tp_tests_bench_start (&m, "repo-inspect", n_handles);
+
+  for (i = 0; i < n_handles; i++)
+    {
+      if (tp_handle_inspect (repo, handles[i]) == NULL)
+        g_error ("handle %u is not valid", handles[i]);
+    }
+
+  tp_tests_bench_report (&m, n_handles);
+
+  /* left is the first 3/4 of the handles and right is the last 3/4, so
+   * they overlap in the middle half */
+  left = tp_intset_sized_new (n_handles);
+  right = tp_intset_sized_new (n_handles);
+
+  for (i = 0; i < n_handles; i++)
+    {
+      if (i < n_handles - n_handles / 4)
+        tp_intset_add (left, handles[i]);
+
+      if (i >= n_handles / 4)
+        tp_intset_add (right, handles[i]);
+    }
+
+  bench_intset_op ("intset-union", n_handles, tp_intset_union, left,
+      right);
+  bench_intset_op ("intset-intersection", n_handles,
+      tp_intset_intersection, left, right);
+  bench_intset_op ("intset-difference", n_handles,
+      tp_intset_difference, left, right);
+  bench_intset_op ("intset-symmetric-difference", n_handles,
+      tp_intset_symmetric_difference, left, right);
+
+  tp_tests_bench_start (&m, "handle-set-update", n_handles);
+
+  for (i = 0; i < REPEATS; i++)
+    {
+      TpHandleSet *set = tp_handle_set_new (repo);
+
+      tp_intset_destroy (tp_handle_set_update (set, left));
+      tp_handle_set_destroy (set);
+    }
+
+  tp_tests_bench_report (&m, REPEATS);
+
+  tp_tests_bench_start (&m, "handle-set-difference-update", n_handles);
+
+  for (i = 0; i < REPEATS; i++)
+    {
+      TpHandleSet *set = tp_handle_set_new_from_intset (repo, right);
+
+      tp_intset_destroy (tp_handle_set_difference_update (set, left));
+      tp_handle_set_destroy (set);
+    }
+
+  tp_tests_bench_report (&m, REPEATS);
+
+  tp_intset_destroy (left);
+  tp_intset_destroy (right);
+  g_free (handles);
+  g_strfreev (ids);
+  g_object_unref (repo);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  static const guint default_sizes[] = { 1000, 10000, 100000 };
+  GArray *sizes;
+  guint i;
+
+  tp_tests_bench_init (argc, argv, default_sizes,
+      G_N_ELEMENTS (default_sizes), &sizes);
+
+  for (i = 0; i < sizes->len; i++)
+    bench_size (g_array_index (sizes, guint, i));
+
+  g_array_unref (sizes);
+  return 0;
+}
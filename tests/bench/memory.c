@@ -0,0 +1,291 @@
+/* Memory footprint of many connections, contacts and channels
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-memory [N_CONNECTIONS...]
+ *
+ * For each number of connections (10 and 100 by default), this connects
+ * that many TpTestsContactsConnections, each with $BENCH_MEMORY_CONTACTS
+ * contacts on its roster (100 by default) and $BENCH_MEMORY_CHANNELS text
+ * channels (10 by default), prepares a TpConnection with the contact list
+ * and a TpChannel for each of them, and measures:
+ *
+ *   memory          the whole process, one operation per connection,
+ *                   contact or channel
+ *
+ * and prints the figures per object, on a comment line of the form
+ *
+ *   # memory  size  objects  rss_bytes_per_object
+ *     allocations_per_object  bytes_per_object
+ *
+ * where rss_bytes_per_object is how much the resident set size grew,
+ * divided by the number of objects, and 0 if it cannot be determined.
+ * Allocations and bytes are cumulative, as for the other benchmarks, so
+ * they include short-lived allocations; the resident set size is the
+ * closest we have to a live footprint. The service and the client run in
+ * this process, so all these figures include both sides.
+ *
+ * If $BENCH_MAX_RSS_PER_OBJECT or $BENCH_MAX_ALLOCATIONS_PER_OBJECT are
+ * set, this exits with status 1 if any size exceeds them, which is what
+ * "make check-bench" uses. See bench-util.c for the output format. */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/contacts-conn.h"
+#include "tests/lib/contact-list-manager.h"
+#include "tests/lib/echo-chan.h"
+#include "tests/lib/util.h"
+
+typedef struct {
+    /* Service side objects */
+    TpBaseConnection *base_connection;
+    GPtrArray *service_channels;
+
+    /* Client side objects */
+    TpConnection *client_conn;
+    GPtrArray *client_channels;
+} Connection;
+
+static guint n_contacts = 100;
+static guint n_channels = 10;
+
+static guint
+get_count (const gchar *variable,
+    guint default_value)
+{
+  const gchar *value = g_getenv (variable);
+  guint64 n;
+
+  if (value == NULL)
+    return default_value;
+
+  n = g_ascii_strtoull (value, NULL, 10);
+
+  if (n > G_MAXUINT / 2)
+    {
+      g_printerr ("$%s is out of range\n", variable);
+      exit (2);
+    }
+
+  return n;
+}
+
+static gdouble
+get_threshold (const gchar *variable)
+{
+  const gchar *value = g_getenv (variable);
+
+  if (value == NULL || value[0] == '\0')
+    return 0;
+
+  return g_ascii_strtod (value, NULL);
+}
+
+static Connection *
+connection_new (guint n)
+{
+  const GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED,
+      TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  Connection *c = g_slice_new0 (Connection);
+  TpTestsContactListManager *manager;
+  TpHandleRepoIface *contact_repo;
+  TpSimpleClientFactory *factory;
+  GArray *handles;
+  gchar *account = g_strdup_printf ("me%u@test.com", n);
+  guint i;
+
+  tp_tests_create_conn (TP_TESTS_TYPE_CONTACTS_CONNECTION, account,
+      FALSE, &c->base_connection, &c->client_conn);
+  manager = tp_tests_contacts_connection_get_contact_list_manager (
+      TP_TESTS_CONTACTS_CONNECTION (c->base_connection));
+  contact_repo = tp_base_connection_get_handles (c->base_connection,
+      TP_HANDLE_TYPE_CONTACT);
+
+  factory = tp_proxy_get_factory (c->client_conn);
+  tp_simple_client_factory_add_contact_features_varargs (factory,
+      TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_PRESENCE,
+      TP_CONTACT_FEATURE_SUBSCRIPTION_STATES,
+      TP_CONTACT_FEATURE_CONTACT_GROUPS,
+      TP_CONTACT_FEATURE_INVALID);
+
+  handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle), n_contacts);
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u", i);
+      TpHandle handle = tp_handle_ensure (contact_repo, id, NULL, NULL);
+
+      g_assert (handle != 0);
+      g_array_append_val (handles, handle);
+      g_free (id);
+    }
+
+  tp_tests_contact_list_manager_add_initial_contacts (manager,
+      handles->len, (TpHandle *) handles->data);
+
+  tp_cli_connection_call_connect (c->client_conn, -1, NULL, NULL, NULL,
+      NULL);
+  tp_tests_proxy_run_until_prepared (c->client_conn, features);
+
+  while (tp_connection_get_contact_list_state (c->client_conn) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
+    g_main_context_iteration (NULL, TRUE);
+
+  c->service_channels = g_ptr_array_new_with_free_func (g_object_unref);
+  c->client_channels = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (i = 0; i < n_channels; i++)
+    {
+      gchar *id = g_strdup_printf ("peer%u", i);
+      gchar *path = g_strdup_printf ("%s/Channel%u",
+          tp_proxy_get_object_path (c->client_conn), i);
+      TpHandle handle = tp_handle_ensure (contact_repo, id, NULL, NULL);
+      TpChannel *chan;
+      GError *error = NULL;
+
+      g_assert (handle != 0);
+
+      g_ptr_array_add (c->service_channels, tp_tests_object_new_static_class (
+            TP_TESTS_TYPE_ECHO_CHANNEL,
+            "connection", c->base_connection,
+            "object-path", path,
+            "handle", handle,
+            NULL));
+
+      chan = tp_channel_new (c->client_conn, path,
+          TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_CONTACT, handle, &error);
+      g_assert_no_error (error);
+      tp_tests_proxy_run_until_prepared (chan, NULL);
+      g_ptr_array_add (c->client_channels, chan);
+
+      g_free (path);
+      g_free (id);
+    }
+
+  g_array_unref (handles);
+  g_free (account);
+  return c;
+}
+
+static void
+connection_free (Connection *c)
+{
+  tp_tests_connection_assert_disconnect_succeeds (c->client_conn);
+  g_ptr_array_unref (c->client_channels);
+  g_ptr_array_unref (c->service_channels);
+  g_object_unref (c->client_conn);
+  g_object_unref (c->base_connection);
+  g_slice_free (Connection, c);
+}
+
+static gboolean
+bench_size (guint n_connections,
+    gdouble max_rss,
+    gdouble max_allocations)
+{
+  TpTestsBenchMeasurement m;
+  GPtrArray *connections = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) connection_free);
+  guint64 n_objects = n_connections * (guint64) (1 + n_contacts + n_channels);
+  gsize start_rss = tp_tests_bench_get_rss ();
+  gsize end_rss;
+  gsize allocations;
+  gsize bytes;
+  gdouble rss_per_object = 0;
+  gboolean ok = TRUE;
+  guint i;
+
+  tp_tests_bench_start (&m, "memory", n_connections);
+
+  /* connections are numbered from 1, because the first one is the
+   * warm-up connection */
+  for (i = 0; i < n_connections; i++)
+    g_ptr_array_add (connections, connection_new (i + 1));
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  end_rss = tp_tests_bench_get_rss ();
+  allocations = tp_tests_bench_get_allocations (&m, &bytes);
+  tp_tests_bench_report (&m, n_objects);
+
+  if (start_rss != 0 && end_rss > start_rss)
+    rss_per_object = (end_rss - start_rss) / (gdouble) n_objects;
+
+  g_print ("# memory\t%u\t%" G_GUINT64_FORMAT "\t%.0f\t%.1f\t%.0f\n",
+      n_connections, n_objects, rss_per_object,
+      allocations / (gdouble) n_objects, bytes / (gdouble) n_objects);
+
+  if (max_rss > 0 && rss_per_object > max_rss)
+    {
+      g_printerr ("bench-memory: %u connections: %.0f bytes of RSS per "
+          "object, more than the limit of %.0f\n", n_connections,
+          rss_per_object, max_rss);
+      ok = FALSE;
+    }
+
+  if (max_allocations > 0 &&
+      allocations / (gdouble) n_objects > max_allocations)
+    {
+      g_printerr ("bench-memory: %u connections: %.1f allocations per "
+          "object, more than the limit of %.1f\n", n_connections,
+          allocations / (gdouble) n_objects, max_allocations);
+      ok = FALSE;
+    }
+
+  g_ptr_array_unref (connections);
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  return ok;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  static const guint default_sizes[] = { 10, 100 };
+  TpDBusDaemon *dbus;
+  Connection *warm_up;
+  GArray *sizes;
+  gdouble max_rss, max_allocations;
+  gboolean ok = TRUE;
+  guint i;
+
+  tp_tests_bench_init (argc, argv, default_sizes,
+      G_N_ELEMENTS (default_sizes), &sizes);
+
+  n_contacts = get_count ("BENCH_MEMORY_CONTACTS", n_contacts);
+  n_channels = get_count ("BENCH_MEMORY_CHANNELS", n_channels);
+  max_rss = get_threshold ("BENCH_MAX_RSS_PER_OBJECT");
+  max_allocations = get_threshold ("BENCH_MAX_ALLOCATIONS_PER_OBJECT");
+
+  /* keep the temporary session bus alive for all the runs */
+  dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  /* one connection, with its contacts and channels, outside the
+   * measurements, so that class initialization and the bus's first-use
+   * costs are not attributed to the objects being counted */
+  warm_up = connection_new (0);
+
+  for (i = 0; i < sizes->len; i++)
+    ok = bench_size (g_array_index (sizes, guint, i), max_rss,
+        max_allocations) && ok;
+
+  connection_free (warm_up);
+  g_object_unref (dbus);
+  g_array_unref (sizes);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,389 @@
+/* End-to-end messaging benchmark, with one process per client
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-messages [--clients=N] [--rate=R] [--messages=M]
+ *
+ * This starts a temporary session bus and a TpTestsContactsConnection
+ * with one ExampleEcho2Channel per client, then runs N (default 4) client
+ * processes. Each client sends M (default 1000) messages with
+ * tp_text_channel_send_message_async() at R (default 100) messages per
+ * second, or one at a time as soon as the previous one has come back if R
+ * is 0. The channel echoes every message, and the client measures the
+ * time from sending it to receiving the echo through
+ * TpTextChannel::message-received, then acknowledges it.
+ *
+ * Each client prints one tab-separated line on stdout, and the service
+ * prints one once all the clients have finished:
+ *
+ *   side  client  messages  p50_us  p99_us  max_us  cpu_us_per_message
+ *
+ * where the latencies are "-" for the service. CPU time is the user and
+ * system time of that process; the dbus-daemon's is not counted. */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "examples/cm/echo-message-parts/chan.h"
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/contacts-conn.h"
+#include "tests/lib/util.h"
+
+/* abort a client if nothing has been echoed for this long */
+#define STALL_TIMEOUT_SECONDS 30
+
+static gint n_clients = 4;
+static gint rate = 100;
+static gint n_messages = 1000;
+static gint client_number = -1;
+static gchar *conn_path = NULL;
+static gchar *chan_path = NULL;
+
+static GOptionEntry entries[] = {
+    { "clients", 'c', 0, G_OPTION_ARG_INT, &n_clients,
+      "Number of client processes", "N" },
+    { "rate", 'r', 0, G_OPTION_ARG_INT, &rate,
+      "Messages per second sent by each client, or 0 to send the next "
+      "message as soon as the previous one has been echoed", "R" },
+    { "messages", 'm', 0, G_OPTION_ARG_INT, &n_messages,
+      "Messages sent by each client", "M" },
+    /* used to run the clients */
+    { "client", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &client_number,
+      NULL, NULL },
+    { "connection", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &conn_path,
+      NULL, NULL },
+    { "channel", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &chan_path,
+      NULL, NULL },
+    { NULL }
+};
+
+typedef struct {
+    GMainLoop *loop;
+    TpTextChannel *channel;
+
+    /* monotonic time at which each message was sent, indexed by the
+     * sequence number in its text */
+    gint64 *sent_at;
+    /* latency of each echoed message, in the order they came back */
+    GArray *latencies;
+    guint n_sent;
+
+    gint64 start_time;
+    gint64 last_activity;
+    guint send_source;
+} Client;
+
+static void
+client_send_one (Client *c)
+{
+  gchar *text = g_strdup_printf ("%u", c->n_sent);
+  TpMessage *message = tp_client_message_new_text (
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, text);
+
+  c->sent_at[c->n_sent++] = g_get_monotonic_time ();
+  tp_text_channel_send_message_async (c->channel, message, 0, NULL, NULL);
+
+  g_object_unref (message);
+  g_free (text);
+}
+
+static gboolean
+client_send_cb (gpointer user_data)
+{
+  Client *c = user_data;
+  gint64 elapsed = g_get_monotonic_time () - c->start_time;
+  guint64 due = elapsed * (guint64) rate / G_USEC_PER_SEC + 1;
+
+  /* catch up with however many messages should have been sent by now, so
+   * that rates above one per timer tick work */
+  while (c->n_sent < due && c->n_sent < (guint) n_messages)
+    client_send_one (c);
+
+  if (c->n_sent < (guint) n_messages)
+    return TRUE;
+
+  c->send_source = 0;
+  return FALSE;
+}
+
+static gboolean
+client_check_stalled_cb (gpointer user_data)
+{
+  Client *c = user_data;
+
+  if (g_get_monotonic_time () - c->last_activity >
+      STALL_TIMEOUT_SECONDS * G_USEC_PER_SEC)
+    g_error ("client %d: only %u of %d messages were echoed",
+        client_number, c->latencies->len, n_messages);
+
+  return TRUE;
+}
+
+static void
+message_received_cb (TpTextChannel *channel,
+    TpSignalledMessage *message,
+    Client *c)
+{
+  gint64 now = g_get_monotonic_time ();
+  gchar *text = tp_message_to_text ((TpMessage *) message, NULL);
+  guint64 seq = g_ascii_strtoull (text, NULL, 10);
+  gint64 latency;
+
+  g_assert_cmpuint (seq, <, c->n_sent);
+  latency = now - c->sent_at[seq];
+  g_array_append_val (c->latencies, latency);
+  c->last_activity = now;
+
+  tp_text_channel_ack_message_async (channel, (TpMessage *) message, NULL,
+      NULL);
+  g_free (text);
+
+  if (c->latencies->len == (guint) n_messages)
+    g_main_loop_quit (c->loop);
+  else if (rate == 0)
+    client_send_one (c);
+}
+
+static gint
+compare_gint64 (gconstpointer a,
+    gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return (x > y) - (x < y);
+}
+
+static gint64
+percentile (GArray *sorted,
+    guint pct)
+{
+  return g_array_index (sorted, gint64, (sorted->len - 1) * pct / 100);
+}
+
+static int
+run_client (void)
+{
+  const GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONNECTED, 0 };
+  const GQuark chan_features[] = {
+      TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  TpDBusDaemon *dbus;
+  TpConnection *conn;
+  GHashTable *props;
+  GError *error = NULL;
+  Client c = { NULL };
+  gint64 cpu_time;
+  guint stall_source;
+
+  dbus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+
+  conn = tp_connection_new (dbus, NULL, conn_path, &error);
+  g_assert_no_error (error);
+  tp_tests_proxy_run_until_prepared (conn, conn_features);
+
+  /* the rest of the immutable properties are fetched while preparing */
+  props = tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+          TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
+          TP_HANDLE_TYPE_CONTACT,
+      NULL);
+  c.channel = tp_text_channel_new (conn, chan_path, props, &error);
+  g_assert_no_error (error);
+  tp_tests_proxy_run_until_prepared (c.channel, chan_features);
+
+  c.loop = g_main_loop_new (NULL, FALSE);
+  c.sent_at = g_new0 (gint64, n_messages);
+  c.latencies = g_array_sized_new (FALSE, FALSE, sizeof (gint64),
+      n_messages);
+
+  g_signal_connect (c.channel, "message-received",
+      G_CALLBACK (message_received_cb), &c);
+
+  cpu_time = tp_tests_bench_get_cpu_time ();
+  c.start_time = c.last_activity = g_get_monotonic_time ();
+
+  if (rate == 0)
+    client_send_one (&c);
+  else
+    c.send_source = g_timeout_add (MAX (1, 1000 / rate), client_send_cb,
+        &c);
+
+  stall_source = g_timeout_add_seconds (1, client_check_stalled_cb, &c);
+  g_main_loop_run (c.loop);
+  cpu_time = tp_tests_bench_get_cpu_time () - cpu_time;
+
+  g_array_sort (c.latencies, compare_gint64);
+  g_print ("client\t%d\t%d\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+      "\t%" G_GINT64_FORMAT "\t%.1f\n", client_number, n_messages,
+      percentile (c.latencies, 50), percentile (c.latencies, 99),
+      percentile (c.latencies, 100), (gdouble) cpu_time / n_messages);
+
+  g_source_remove (stall_source);
+
+  if (c.send_source != 0)
+    g_source_remove (c.send_source);
+
+  g_array_unref (c.latencies);
+  g_free (c.sent_at);
+  g_main_loop_unref (c.loop);
+  g_hash_table_unref (props);
+  g_object_unref (c.channel);
+  g_object_unref (conn);
+  g_object_unref (dbus);
+  return 0;
+}
+
+typedef struct {
+    GMainLoop *loop;
+    gint n_running;
+    gboolean failed;
+} Service;
+
+static void
+client_exited_cb (GPid pid,
+    gint status,
+    gpointer user_data)
+{
+  Service *s = user_data;
+  GError *error = NULL;
+
+  if (!g_spawn_check_exit_status (status, &error))
+    {
+      g_printerr ("client process %d failed: %s\n", (gint) pid,
+          error->message);
+      g_clear_error (&error);
+      s->failed = TRUE;
+    }
+
+  g_spawn_close_pid (pid);
+
+  if (--s->n_running == 0)
+    g_main_loop_quit (s->loop);
+}
+
+static int
+run_service (const gchar *program)
+{
+  TpDBusDaemon *dbus;
+  TpBaseConnection *base_connection;
+  TpConnection *client_conn;
+  TpHandleRepoIface *contact_repo;
+  GPtrArray *channels;
+  Service s = { NULL };
+  gint64 cpu_time = 0;
+  gint i;
+
+  /* keep the temporary session bus alive until the clients are done; its
+   * address is in the environment that they inherit */
+  dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  tp_tests_create_and_connect_conn (TP_TESTS_TYPE_CONTACTS_CONNECTION,
+      "me@test.com", &base_connection, &client_conn);
+  contact_repo = tp_base_connection_get_handles (base_connection,
+      TP_HANDLE_TYPE_CONTACT);
+
+  channels = g_ptr_array_new_with_free_func (g_object_unref);
+  s.loop = g_main_loop_new (NULL, FALSE);
+
+  g_print ("# side\tclient\tmessages\tp50_us\tp99_us\tmax_us"
+      "\tcpu_us_per_message\n");
+
+  for (i = 0; i < n_clients; i++)
+    {
+      gchar *id = g_strdup_printf ("client%d", i);
+      gchar *path = g_strdup_printf ("%s/Channel%d",
+          tp_proxy_get_object_path (client_conn), i);
+      gchar *client_arg = g_strdup_printf ("--client=%d", i);
+      gchar *conn_arg = g_strdup_printf ("--connection=%s",
+          tp_proxy_get_object_path (client_conn));
+      gchar *chan_arg = g_strdup_printf ("--channel=%s", path);
+      gchar *rate_arg = g_strdup_printf ("--rate=%d", rate);
+      gchar *messages_arg = g_strdup_printf ("--messages=%d", n_messages);
+      gchar *argv[] = { (gchar *) program, client_arg, conn_arg, chan_arg,
+          rate_arg, messages_arg, NULL };
+      GError *error = NULL;
+      GPid pid;
+
+      g_ptr_array_add (channels, g_object_new (EXAMPLE_TYPE_ECHO_2_CHANNEL,
+            "connection", base_connection,
+            "handle", tp_handle_ensure (contact_repo, id, NULL, NULL),
+            "object-path", path,
+            NULL));
+
+      if (i == 0)
+        cpu_time = tp_tests_bench_get_cpu_time ();
+
+      if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL,
+            NULL, &pid, &error))
+        g_error ("unable to run %s: %s", program, error->message);
+
+      g_child_watch_add (pid, client_exited_cb, &s);
+      s.n_running++;
+
+      g_free (messages_arg);
+      g_free (rate_arg);
+      g_free (chan_arg);
+      g_free (conn_arg);
+      g_free (client_arg);
+      g_free (path);
+      g_free (id);
+    }
+
+  if (s.n_running > 0)
+    g_main_loop_run (s.loop);
+
+  cpu_time = tp_tests_bench_get_cpu_time () - cpu_time;
+  g_print ("service\t-\t%d\t-\t-\t-\t%.1f\n", n_clients * n_messages,
+      (gdouble) cpu_time / MAX (1, n_clients * n_messages));
+
+  g_ptr_array_foreach (channels, (GFunc) tp_base_channel_destroyed, NULL);
+  g_ptr_array_unref (channels);
+  tp_tests_connection_assert_disconnect_succeeds (client_conn);
+  g_object_unref (client_conn);
+  g_object_unref (base_connection);
+  g_main_loop_unref (s.loop);
+  g_object_unref (dbus);
+
+  return s.failed ? 1 : 0;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  int ret;
+
+  context = g_option_context_new ("- benchmark messages sent through the "
+      "echo channel");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error) ||
+      n_clients < 0 || rate < 0 || n_messages <= 0)
+    {
+      g_printerr ("%s: %s\n", argv[0],
+          error != NULL ? error->message : "invalid arguments");
+      return 2;
+    }
+
+  g_option_context_free (context);
+
+  if (client_number >= 0)
+    ret = run_client ();
+  else
+    ret = run_service (argv[0]);
+
+  g_free (conn_path);
+  g_free (chan_path);
+  return ret;
+}
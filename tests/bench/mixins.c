@@ -0,0 +1,353 @@
+/* Benchmarks for the service-side mixins
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-mixins [N_CONTACTS...]
+ *
+ * For each size (1000, 10000 and 100000 by default), this measures, on a
+ * connected TpTestsContactsConnection with that many contacts:
+ *
+ *   contact-attributes-N
+ *       tp_contacts_mixin_get_contact_attributes() for every contact, with
+ *       N interfaces and hence N fill functions
+ *   group-add-members, group-remove-members
+ *       one tp_group_mixin_change_members() adding or removing every
+ *       contact on a TpTestsTextChannelGroup
+ *   group-join-one-by-one
+ *       one tp_group_mixin_change_members() per contact, as when a large
+ *       MUC is joined and the members are announced one at a time
+ *   message-queue
+ *       tp_message_mixin_take_received() once per contact
+ *   message-ack
+ *       acknowledging all those messages in one AcknowledgePendingMessages
+ *       call, including the D-Bus round trip
+ *   presence-emit-batch
+ *       one tp_presence_mixin_emit_presence_update() for every contact
+ *   presence-emit-one-by-one, presence-emit-coalesced
+ *       one presence update per contact, without and with
+ *       tp_presence_mixin_set_coalescing()
+ *
+ * See bench-util.c for the output format. */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/message-mixin.h>
+
+#include "examples/cm/echo-message-parts/chan.h"
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/contacts-conn.h"
+#include "tests/lib/textchan-group.h"
+#include "tests/lib/util.h"
+
+typedef struct {
+    guint n_contacts;
+
+    /* Service side objects */
+    TpBaseConnection *base_connection;
+    TpTestsContactsConnection *service_conn;
+    TpHandleRepoIface *contact_repo;
+    GArray *handles;
+    TpIntset *handle_set;
+
+    /* Client side objects */
+    TpConnection *client_conn;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    guint n_contacts)
+{
+  guint i;
+
+  f->n_contacts = n_contacts;
+
+  tp_tests_create_and_connect_conn (TP_TESTS_TYPE_CONTACTS_CONNECTION,
+      "me@test.com", &f->base_connection, &f->client_conn);
+  f->service_conn = TP_TESTS_CONTACTS_CONNECTION (f->base_connection);
+  f->contact_repo = tp_base_connection_get_handles (f->base_connection,
+      TP_HANDLE_TYPE_CONTACT);
+
+  f->handles = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      n_contacts);
+  f->handle_set = tp_intset_sized_new (n_contacts);
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u", i);
+      TpHandle handle = tp_handle_ensure (f->contact_repo, id, NULL, NULL);
+
+      g_assert (handle != 0);
+      g_array_append_val (f->handles, handle);
+      tp_intset_add (f->handle_set, handle);
+      g_free (id);
+    }
+}
+
+static void
+teardown (Fixture *f)
+{
+  tp_tests_connection_assert_disconnect_succeeds (f->client_conn);
+  g_object_unref (f->client_conn);
+  g_object_unref (f->base_connection);
+  tp_intset_destroy (f->handle_set);
+  g_array_unref (f->handles);
+}
+
+static void
+bench_contact_attributes (Fixture *f)
+{
+  static const gchar * const all_interfaces[] = {
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+      TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_LIST,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS,
+      TP_IFACE_CONNECTION_INTERFACE_LOCATION,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO,
+      TP_IFACE_CONNECTION_INTERFACE_CLIENT_TYPES,
+      NULL
+  };
+  static const gchar * const assumed_interfaces[] = {
+      TP_IFACE_CONNECTION,
+      NULL
+  };
+  static const guint n_interfaces[] = { 1, 3,
+      G_N_ELEMENTS (all_interfaces) - 1 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (n_interfaces); i++)
+    {
+      const gchar **interfaces = g_new0 (const gchar *,
+          n_interfaces[i] + 1);
+      gchar *benchmark = g_strdup_printf ("contact-attributes-%u",
+          n_interfaces[i]);
+      TpTestsBenchMeasurement m;
+      GHashTable *attributes;
+
+      memcpy (interfaces, all_interfaces,
+          n_interfaces[i] * sizeof (const gchar *));
+
+      tp_tests_bench_start (&m, benchmark, f->n_contacts);
+      attributes = tp_contacts_mixin_get_contact_attributes (
+          (GObject *) f->base_connection, f->handles, interfaces,
+          (const gchar **) assumed_interfaces, NULL);
+      tp_tests_bench_report (&m, f->n_contacts);
+
+      g_assert_cmpuint (g_hash_table_size (attributes), ==, f->n_contacts);
+
+      g_hash_table_unref (attributes);
+      g_free (benchmark);
+      g_free (interfaces);
+    }
+}
+
+static void
+bench_group (Fixture *f)
+{
+  GObject *chan;
+  gchar *chan_path;
+  TpTestsBenchMeasurement m;
+  guint i;
+
+  chan_path = g_strdup_printf ("%s/MucChannel",
+      tp_proxy_get_object_path (f->client_conn));
+  chan = tp_tests_object_new_static_class (TP_TESTS_TYPE_TEXT_CHANNEL_GROUP,
+      "connection", f->base_connection,
+      "object-path", chan_path,
+      "detailed", TRUE,
+      NULL);
+
+  tp_tests_bench_start (&m, "group-add-members", f->n_contacts);
+  tp_group_mixin_change_members (chan, "", f->handle_set, NULL, NULL, NULL,
+      0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_tests_bench_start (&m, "group-remove-members", f->n_contacts);
+  tp_group_mixin_change_members (chan, "", NULL, f->handle_set, NULL, NULL,
+      0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_tests_bench_start (&m, "group-join-one-by-one", f->n_contacts);
+
+  for (i = 0; i < f->handles->len; i++)
+    {
+      TpIntset *add = tp_intset_new_containing (
+          g_array_index (f->handles, TpHandle, i));
+
+      tp_group_mixin_change_members (chan, "", add, NULL, NULL, NULL,
+          0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+      tp_intset_destroy (add);
+    }
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_base_channel_destroyed ((TpBaseChannel *) chan);
+  g_object_unref (chan);
+  g_free (chan_path);
+}
+
+static void
+acknowledge_cb (TpChannel *proxy,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  gboolean *done = user_data;
+
+  g_assert_no_error (error);
+  *done = TRUE;
+}
+
+static void
+bench_messages (Fixture *f)
+{
+  GObject *chan_service;
+  TpTextChannel *chan;
+  gchar *chan_path;
+  GHashTable *props;
+  GArray *ids;
+  TpTestsBenchMeasurement m;
+  GError *error = NULL;
+  gboolean done = FALSE;
+  guint i;
+
+  chan_path = g_strdup_printf ("%s/TextChannel",
+      tp_proxy_get_object_path (f->client_conn));
+  chan_service = g_object_new (EXAMPLE_TYPE_ECHO_2_CHANNEL,
+      "connection", f->base_connection,
+      "handle", g_array_index (f->handles, TpHandle, 0),
+      "object-path", chan_path,
+      NULL);
+
+  g_object_get (chan_service,
+      "channel-properties", &props,
+      NULL);
+  chan = tp_text_channel_new (f->client_conn, chan_path, props, &error);
+  g_assert_no_error (error);
+  tp_tests_proxy_run_until_prepared (chan, NULL);
+
+  ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), f->n_contacts);
+
+  tp_tests_bench_start (&m, "message-queue", f->n_contacts);
+
+  for (i = 0; i < f->handles->len; i++)
+    {
+      TpMessage *message = tp_cm_message_new_text (f->base_connection,
+          g_array_index (f->handles, TpHandle, i),
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "benchmarking");
+      guint id = tp_message_mixin_take_received (chan_service, message);
+
+      g_array_append_val (ids, id);
+    }
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_tests_bench_start (&m, "message-ack", f->n_contacts);
+
+  tp_cli_channel_type_text_call_acknowledge_pending_messages (
+      (TpChannel *) chan, -1, ids, acknowledge_cb, &done, NULL, NULL);
+
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  g_assert (!tp_message_mixin_has_pending_messages (chan_service, NULL));
+
+  tp_base_channel_destroyed ((TpBaseChannel *) chan_service);
+  g_object_unref (chan);
+  g_object_unref (chan_service);
+  g_array_unref (ids);
+  g_hash_table_unref (props);
+  g_free (chan_path);
+}
+
+static void
+bench_presence (Fixture *f)
+{
+  TpTestsContactsConnectionPresenceStatusIndex *statuses;
+  const gchar **messages;
+  TpTestsBenchMeasurement m;
+  guint i;
+
+  statuses = g_new0 (TpTestsContactsConnectionPresenceStatusIndex,
+      f->n_contacts);
+  messages = g_new0 (const gchar *, f->n_contacts);
+
+  for (i = 0; i < f->n_contacts; i++)
+    {
+      statuses[i] = TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY;
+      messages[i] = "benchmarking";
+    }
+
+  tp_tests_bench_start (&m, "presence-emit-batch", f->n_contacts);
+  tp_tests_contacts_connection_change_presences (f->service_conn,
+      f->n_contacts, (TpHandle *) f->handles->data, statuses, messages);
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_tests_bench_start (&m, "presence-emit-one-by-one", f->n_contacts);
+
+  for (i = 0; i < f->n_contacts; i++)
+    tp_tests_contacts_connection_change_presences (f->service_conn, 1,
+        &g_array_index (f->handles, TpHandle, i), statuses + i,
+        messages + i);
+
+  tp_tests_bench_report (&m, f->n_contacts);
+
+  tp_presence_mixin_set_coalescing ((GObject *) f->service_conn, TRUE, 0);
+  tp_tests_bench_start (&m, "presence-emit-coalesced", f->n_contacts);
+
+  for (i = 0; i < f->n_contacts; i++)
+    tp_tests_contacts_connection_change_presences (f->service_conn, 1,
+        &g_array_index (f->handles, TpHandle, i), statuses + i,
+        messages + i);
+
+  tp_presence_mixin_flush_presence_updates ((GObject *) f->service_conn);
+  tp_tests_bench_report (&m, f->n_contacts);
+  tp_presence_mixin_set_coalescing ((GObject *) f->service_conn, FALSE, 0);
+
+  g_free (statuses);
+  g_free (messages);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  static const guint default_sizes[] = { 1000, 10000, 100000 };
+  TpDBusDaemon *dbus;
+  GArray *sizes;
+  guint i;
+
+  tp_tests_bench_init (argc, argv, default_sizes,
+      G_N_ELEMENTS (default_sizes), &sizes);
+
+  /* keep the temporary session bus alive for all the runs */
+  dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  for (i = 0; i < sizes->len; i++)
+    {
+      Fixture f;
+
+      setup (&f, g_array_index (sizes, guint, i));
+      bench_contact_attributes (&f);
+      bench_group (&f);
+      bench_messages (&f);
+      bench_presence (&f);
+      teardown (&f);
+    }
+
+  g_object_unref (dbus);
+  g_array_unref (sizes);
+  return 0;
+}
@@ -0,0 +1,121 @@
+/* Benchmarks for client-side proxy construction, as in short-lived tools
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+/* Usage: bench-startup [N_PROXIES...]
+ *
+ * This measures, once per process:
+ *
+ *   first-proxies   constructing the first TpConnection, TpChannel and
+ *                   TpAccount, which is what a short-lived tool run from a
+ *                   script pays for on every invocation
+ *
+ * and for each size (100, 1000 and 10000 by default):
+ *
+ *   proxy-new       constructing that many more TpConnection, TpChannel
+ *                   and TpAccount proxies, one per operation
+ *
+ * None of the proxies have a service behind them, so this only measures
+ * their construction, including the D-Bus interfaces that their
+ * constructors use. See bench-util.c for the output format. */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/bench/bench-util.h"
+#include "tests/lib/util.h"
+
+static void
+new_proxies (TpDBusDaemon *dbus,
+    guint i,
+    GPtrArray *proxies)
+{
+  GError *error = NULL;
+  gchar *path = g_strdup_printf ("%sbench/proto/conn%u",
+      TP_CONN_OBJECT_PATH_BASE, i);
+  gchar *chan_path = g_strdup_printf ("%s/Channel", path);
+  gchar *account_path = g_strdup_printf ("%sbench/proto/account%u",
+      TP_ACCOUNT_OBJECT_PATH_BASE, i);
+  TpConnection *conn;
+  TpChannel *chan;
+  TpAccount *account;
+
+  /* the bus name is derived from the object path */
+  conn = tp_connection_new (dbus, NULL, path, &error);
+  g_assert_no_error (error);
+
+  chan = tp_channel_new (conn, chan_path, TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_NONE, 0, &error);
+  g_assert_no_error (error);
+
+  account = tp_account_new (dbus, account_path, &error);
+  g_assert_no_error (error);
+
+  g_ptr_array_add (proxies, conn);
+  g_ptr_array_add (proxies, chan);
+  g_ptr_array_add (proxies, account);
+
+  g_free (path);
+  g_free (chan_path);
+  g_free (account_path);
+}
+
+static void
+bench_size (TpDBusDaemon *dbus,
+    guint n_proxies)
+{
+  TpTestsBenchMeasurement m;
+  GPtrArray *proxies = g_ptr_array_new_with_free_func (g_object_unref);
+  guint i;
+
+  tp_tests_bench_start (&m, "proxy-new", n_proxies);
+
+  for (i = 0; i < n_proxies; i++)
+    new_proxies (dbus, i + 1, proxies);
+
+  tp_tests_bench_report (&m, n_proxies);
+
+  g_ptr_array_unref (proxies);
+
+  /* let the proxies' cancelled calls go away before the next size */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  static const guint default_sizes[] = { 100, 1000, 10000 };
+  TpTestsBenchMeasurement m;
+  TpDBusDaemon *dbus;
+  GPtrArray *proxies;
+  GArray *sizes;
+  guint i;
+
+  tp_tests_bench_init (argc, argv, default_sizes,
+      G_N_ELEMENTS (default_sizes), &sizes);
+
+  /* keep the temporary session bus alive for all the runs; this also
+   * constructs the first proxy, so it is not measured */
+  dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  proxies = g_ptr_array_new_with_free_func (g_object_unref);
+  tp_tests_bench_start (&m, "first-proxies", 1);
+  new_proxies (dbus, 0, proxies);
+  tp_tests_bench_report (&m, 1);
+  g_ptr_array_unref (proxies);
+
+  for (i = 0; i < sizes->len; i++)
+    bench_size (dbus, g_array_index (sizes, guint, i));
+
+  g_object_unref (dbus);
+  g_array_unref (sizes);
+  return 0;
+}
@@ -1187,6 +1187,104 @@ test_classes_variant (Test *test,
   g_object_unref (caps);
 }
 
+static void
+test_shared (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpCapabilities *caps, *caps2, *other;
+  GPtrArray *classes, *classes2;
+
+  classes = g_ptr_array_sized_new (2);
+  add_text_chat_class (classes, TP_HANDLE_TYPE_CONTACT);
+  add_ft_class (classes, NULL);
+
+  /* an equal but separately-built set of classes */
+  classes2 = g_ptr_array_sized_new (2);
+  add_text_chat_class (classes2, TP_HANDLE_TYPE_CONTACT);
+  add_ft_class (classes2, NULL);
+
+  caps = _tp_capabilities_new (classes, TRUE);
+  caps2 = _tp_capabilities_new (classes2, TRUE);
+  g_assert (caps == caps2);
+  g_object_unref (caps2);
+
+  /* whether it's specific to a contact matters */
+  other = _tp_capabilities_new (classes, FALSE);
+  g_assert (other != caps);
+  g_assert (!tp_capabilities_is_specific_to_contact (other));
+  g_assert (tp_capabilities_supports_text_chats (other));
+  g_assert (tp_capabilities_supports_file_transfer (other));
+  g_object_unref (other);
+
+  /* so do the classes */
+  other = _tp_capabilities_new (NULL, TRUE);
+  g_assert (other != caps);
+  g_assert (!tp_capabilities_supports_text_chats (other));
+  g_object_unref (other);
+
+  /* once the last reference is gone, a new object is made */
+  g_object_add_weak_pointer ((GObject *) caps, (gpointer *) &caps);
+  g_object_unref (caps);
+  g_assert (caps == NULL);
+
+  caps = _tp_capabilities_new (classes2, TRUE);
+  g_assert (tp_capabilities_is_specific_to_contact (caps));
+  g_assert (tp_capabilities_supports_text_chats (caps));
+  g_assert (tp_capabilities_supports_file_transfer (caps));
+  g_assert (!tp_capabilities_supports_text_chatrooms (caps));
+  g_object_unref (caps);
+
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, classes);
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, classes2);
+}
+
+static void
+test_classes_hash (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  static const gchar * const other_allowed[] = {
+      TP_PROP_CHANNEL_TYPE_FILE_TRANSFER_FILENAME, NULL };
+  TpCapabilities *caps;
+  GPtrArray *classes, *classes2, *other, *empty;
+
+  classes = g_ptr_array_sized_new (2);
+  add_text_chat_class (classes, TP_HANDLE_TYPE_CONTACT);
+  add_ft_class (classes, NULL);
+
+  classes2 = g_ptr_array_sized_new (2);
+  add_text_chat_class (classes2, TP_HANDLE_TYPE_CONTACT);
+  add_ft_class (classes2, NULL);
+
+  other = g_ptr_array_sized_new (2);
+  add_text_chat_class (other, TP_HANDLE_TYPE_CONTACT);
+  add_ft_class (other, other_allowed);
+
+  g_assert_cmpuint (_tp_capabilities_classes_hash (classes), ==,
+      _tp_capabilities_classes_hash (classes2));
+
+  caps = _tp_capabilities_new (classes, TRUE);
+  g_assert (_tp_capabilities_has_classes (caps, classes, TRUE));
+  g_assert (_tp_capabilities_has_classes (caps, classes2, TRUE));
+  g_assert (!_tp_capabilities_has_classes (caps, classes, FALSE));
+  g_assert (!_tp_capabilities_has_classes (caps, other, TRUE));
+  g_assert (!_tp_capabilities_has_classes (caps, NULL, TRUE));
+  g_object_unref (caps);
+
+  /* NULL is the same as no classes at all */
+  empty = g_ptr_array_new ();
+  caps = _tp_capabilities_new (NULL, TRUE);
+  g_assert_cmpuint (_tp_capabilities_classes_hash (NULL), ==,
+      _tp_capabilities_classes_hash (empty));
+  g_assert (_tp_capabilities_has_classes (caps, NULL, TRUE));
+  g_assert (_tp_capabilities_has_classes (caps, empty, TRUE));
+  g_object_unref (caps);
+  g_ptr_array_unref (empty);
+
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, classes);
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, classes2);
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, other);
+}
+
 int
 main (int argc,
     char **argv)
@@ -1212,6 +1310,10 @@ main (int argc,
       test_supports_call, NULL);
   g_test_add (TEST_PREFIX "classes-variant", Test, NULL, setup,
       test_classes_variant, NULL);
+  g_test_add (TEST_PREFIX "shared", Test, NULL, setup,
+      test_shared, NULL);
+  g_test_add (TEST_PREFIX "classes-hash", Test, NULL, setup,
+      test_classes_hash, NULL);
 
   return g_test_run ();
 }
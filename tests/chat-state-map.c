@@ -0,0 +1,114 @@
+/* Tests of the compact chat state table shared by TpChannel and
+ * TpMessageMixin
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "telepathy-glib/chat-state-map-internal.h"
+
+static void
+test_defaults (void)
+{
+  _TpChatStateMap *map = _tp_chat_state_map_new ();
+
+  g_assert_cmpuint (_tp_chat_state_map_get (map, 0), ==,
+      TP_CHANNEL_CHAT_STATE_INACTIVE);
+  g_assert_cmpuint (_tp_chat_state_map_get (map, 12345), ==,
+      TP_CHANNEL_CHAT_STATE_INACTIVE);
+  g_assert (tp_intset_is_empty (_tp_chat_state_map_peek_active (map)));
+
+  /* setting the default is not a change */
+  g_assert (!_tp_chat_state_map_set (map, 1,
+        TP_CHANNEL_CHAT_STATE_INACTIVE));
+  g_assert (tp_intset_is_empty (_tp_chat_state_map_peek_active (map)));
+
+  _tp_chat_state_map_free (map);
+}
+
+static void
+test_set (void)
+{
+  /* small and large handles, and a state that doesn't fit in a byte */
+  static const struct {
+      TpHandle handle;
+      guint state;
+  } changes[] = {
+      { 1, TP_CHANNEL_CHAT_STATE_COMPOSING },
+      { 70000, TP_CHANNEL_CHAT_STATE_PAUSED },
+      { 2, TP_CHANNEL_CHAT_STATE_GONE },
+      { 3, 1000 },
+      { G_MAXUINT32, TP_CHANNEL_CHAT_STATE_ACTIVE },
+  };
+  _TpChatStateMap *map = _tp_chat_state_map_new ();
+  GHashTable *hash;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    {
+      g_assert (_tp_chat_state_map_set (map, changes[i].handle,
+            changes[i].state));
+      g_assert (!_tp_chat_state_map_set (map, changes[i].handle,
+            changes[i].state));
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    g_assert_cmpuint (_tp_chat_state_map_get (map, changes[i].handle), ==,
+        changes[i].state);
+
+  g_assert_cmpuint (tp_intset_size (_tp_chat_state_map_peek_active (map)),
+      ==, G_N_ELEMENTS (changes));
+
+  hash = _tp_chat_state_map_dup_hash (map);
+  g_assert_cmpuint (g_hash_table_size (hash), ==, G_N_ELEMENTS (changes));
+
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    g_assert_cmpuint (GPOINTER_TO_UINT (g_hash_table_lookup (hash,
+            GUINT_TO_POINTER (changes[i].handle))), ==, changes[i].state);
+
+  g_hash_table_unref (hash);
+
+  /* moving between the byte array and the hash table in either direction
+   * leaves nothing behind */
+  g_assert (_tp_chat_state_map_set (map, 3, TP_CHANNEL_CHAT_STATE_ACTIVE));
+  g_assert_cmpuint (_tp_chat_state_map_get (map, 3), ==,
+      TP_CHANNEL_CHAT_STATE_ACTIVE);
+  g_assert (_tp_chat_state_map_set (map, 1, 1001));
+  g_assert_cmpuint (_tp_chat_state_map_get (map, 1), ==, 1001);
+
+  /* going back to Inactive leaves the active set */
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    {
+      g_assert (_tp_chat_state_map_set (map, changes[i].handle,
+            TP_CHANNEL_CHAT_STATE_INACTIVE));
+      g_assert_cmpuint (_tp_chat_state_map_get (map, changes[i].handle), ==,
+          TP_CHANNEL_CHAT_STATE_INACTIVE);
+    }
+
+  g_assert (tp_intset_is_empty (_tp_chat_state_map_peek_active (map)));
+
+  hash = _tp_chat_state_map_dup_hash (map);
+  g_assert_cmpuint (g_hash_table_size (hash), ==, 0);
+  g_hash_table_unref (hash);
+
+  _tp_chat_state_map_free (map);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/chat-state-map/defaults", test_defaults);
+  g_test_add_func ("/chat-state-map/set", test_set);
+
+  return g_test_run ();
+}
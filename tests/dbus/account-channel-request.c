@@ -688,6 +688,55 @@ test_handle_re_handle (Test *test,
   g_object_unref (req2);
 }
 
+static void
+create_and_handle_count_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  TpChannel *channel;
+
+  channel = tp_account_channel_request_create_and_handle_channel_finish (
+      TP_ACCOUNT_CHANNEL_REQUEST (source), result, NULL, &test->error);
+  g_assert_no_error (test->error);
+  g_assert (TP_IS_CHANNEL (channel));
+  g_object_unref (channel);
+
+  test->count--;
+  if (test->count <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_handle_shared_handler (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpAccountChannelRequest *alice_req, *bob_req;
+
+  alice_req = tp_account_channel_request_new_text (test->account, 0);
+  tp_account_channel_request_set_target_id (alice_req,
+      TP_HANDLE_TYPE_CONTACT, "alice");
+  bob_req = tp_account_channel_request_new_text (test->account, 0);
+  tp_account_channel_request_set_target_id (bob_req,
+      TP_HANDLE_TYPE_CONTACT, "bob");
+
+  tp_account_channel_request_create_and_handle_channel_async (alice_req,
+      NULL, create_and_handle_count_cb, test);
+  tp_account_channel_request_create_and_handle_channel_async (bob_req,
+      NULL, create_and_handle_count_cb, test);
+
+  /* both requests are outstanding at once, through the same Handler */
+  g_assert (_tp_account_channel_request_get_client (alice_req) ==
+      _tp_account_channel_request_get_client (bob_req));
+
+  test->count = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_object_unref (alice_req);
+  g_object_unref (bob_req);
+}
+
 static void
 create_and_handle_hints_cb (GObject *source,
     GAsyncResult *result,
@@ -1452,6 +1501,8 @@ main (int argc,
       setup, test_handle_cancel_after_create, teardown);
   g_test_add ("/account-channels/request-handle/re-handle", Test, NULL,
       setup, test_handle_re_handle, teardown);
+  g_test_add ("/account-channels/request-handle/shared-handler", Test, NULL,
+      setup, test_handle_shared_handler, teardown);
   g_test_add ("/account-channels/request-handle/create-success-hints", Test,
       NULL, setup, test_handle_create_success_hints, teardown);
   g_test_add ("/account-channels/request-handle/delegated", Test, NULL,
@@ -20,6 +20,8 @@
 
 #define ACCOUNT1_PATH TP_ACCOUNT_OBJECT_PATH_BASE "badger/musher/account1"
 #define ACCOUNT2_PATH TP_ACCOUNT_OBJECT_PATH_BASE "badger/musher/account2"
+#define OFFLINE_ACCOUNT_PATH \
+  TP_ACCOUNT_OBJECT_PATH_BASE "badger/musher/offline"
 
 typedef struct {
     GFunc action;
@@ -778,6 +780,148 @@ test_most_available_two_unset (Test *test,
       presence_new (TP_CONNECTION_PRESENCE_TYPE_BUSY, "busy", ""));
 }
 
+static guint
+count_valid_accounts (TpAccountManager *am)
+{
+  GList *accounts = tp_account_manager_dup_valid_accounts (am);
+  guint n = g_list_length (accounts);
+
+  g_list_free_full (accounts, g_object_unref);
+  return n;
+}
+
+static void
+test_lazy (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GAsyncResult *result = NULL;
+  GStrv paths;
+
+  tp_tests_simple_account_manager_add_account (test->service, ACCOUNT1_PATH,
+      TRUE);
+  tp_tests_simple_account_manager_add_account (test->service, ACCOUNT2_PATH,
+      TRUE);
+
+  test->am = tp_account_manager_new (test->dbus);
+  tp_account_manager_set_lazy_accounts (test->am, 0);
+  tp_tests_proxy_run_until_prepared (test->am, NULL);
+
+  /* the manager is ready, but none of its accounts have been prepared */
+  paths = tp_account_manager_dup_valid_account_paths (test->am);
+  g_assert_cmpuint (g_strv_length (paths), ==, 2);
+  g_assert (tp_strv_contains ((const gchar * const *) paths, ACCOUNT1_PATH));
+  g_assert (tp_strv_contains ((const gchar * const *) paths, ACCOUNT2_PATH));
+  g_strfreev (paths);
+  g_assert_cmpuint (count_valid_accounts (test->am), ==, 0);
+
+  /* one of them is wanted now */
+  tp_account_manager_prepare_account_async (test->am, ACCOUNT1_PATH,
+      tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  test->account1 = tp_account_manager_prepare_account_finish (test->am,
+      result, &test->error);
+  g_assert_no_error (test->error);
+  g_assert (TP_IS_ACCOUNT (test->account1));
+  g_assert (tp_proxy_is_prepared (test->account1, TP_ACCOUNT_FEATURE_CORE));
+  g_clear_object (&result);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (test->am);
+  g_assert_cmpuint (count_valid_accounts (test->am), ==, 1);
+
+  /* the other is prepared in the background once that's allowed */
+  tp_account_manager_set_lazy_accounts (test->am, 1);
+
+  while (count_valid_accounts (test->am) < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  paths = tp_account_manager_dup_valid_account_paths (test->am);
+  g_assert_cmpuint (g_strv_length (paths), ==, 2);
+  g_strfreev (paths);
+}
+
+static void
+test_set_all_presences (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GAsyncResult *result = NULL;
+  GHashTable *failures;
+  gboolean ok;
+
+  tp_tests_simple_account_manager_add_account (test->service, ACCOUNT1_PATH,
+      TRUE);
+  tp_tests_simple_account_manager_add_account (test->service, ACCOUNT2_PATH,
+      TRUE);
+
+  test->am = tp_account_manager_new (test->dbus);
+  tp_tests_proxy_run_until_prepared (test->am, NULL);
+  g_assert_cmpuint (count_valid_accounts (test->am), ==, 2);
+
+  /* the simple account doesn't let RequestedPresence be set, so each
+   * request fails, and each failure is reported */
+  tp_account_manager_set_all_requested_presences_async (test->am,
+      TP_CONNECTION_PRESENCE_TYPE_AWAY, "away", "gone fishing", 1, 10,
+      tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  ok = tp_account_manager_set_all_requested_presences_finish (test->am,
+      result, &failures, &test->error);
+  g_assert (!ok);
+  g_assert (test->error != NULL);
+  g_clear_error (&test->error);
+  g_assert_cmpuint (g_hash_table_size (failures), ==, 2);
+  g_hash_table_unref (failures);
+  g_clear_object (&result);
+}
+
+static void
+test_bulk_properties (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GObject *offline_service;
+  TpSimpleClientFactory *factory;
+  TpAccount *account;
+  GList *accounts;
+
+  /* This account is not on the bus, so its properties can only come from
+   * the account manager */
+  offline_service = tp_tests_object_new_static_class (
+      TP_TESTS_TYPE_SIMPLE_ACCOUNT, NULL);
+
+  tp_tests_simple_account_manager_add_account_object (test->service,
+      ACCOUNT1_PATH, G_OBJECT (test->account1_service));
+  tp_tests_simple_account_manager_add_account_object (test->service,
+      OFFLINE_ACCOUNT_PATH, offline_service);
+  tp_tests_simple_account_manager_add_account (test->service, ACCOUNT1_PATH,
+      TRUE);
+  tp_tests_simple_account_manager_add_account (test->service,
+      OFFLINE_ACCOUNT_PATH, TRUE);
+
+  test->am = tp_account_manager_new (test->dbus);
+  factory = tp_proxy_get_factory (test->am);
+  tp_simple_client_factory_add_account_features_varargs (factory,
+      TP_ACCOUNT_FEATURE_STORAGE, TP_ACCOUNT_FEATURE_ADDRESSING, 0);
+  tp_tests_proxy_run_until_prepared (test->am, NULL);
+
+  g_assert_cmpuint (test->service->get_account_properties_calls, ==, 1);
+
+  accounts = tp_account_manager_dup_valid_accounts (test->am);
+  g_assert_cmpuint (g_list_length (accounts), ==, 2);
+  g_list_free_full (accounts, g_object_unref);
+
+  account = tp_simple_client_factory_ensure_account (factory,
+      OFFLINE_ACCOUNT_PATH, NULL, NULL);
+  g_assert (tp_proxy_is_prepared (account, TP_ACCOUNT_FEATURE_CORE));
+  g_assert (tp_proxy_is_prepared (account, TP_ACCOUNT_FEATURE_STORAGE));
+  g_assert (tp_proxy_is_prepared (account, TP_ACCOUNT_FEATURE_ADDRESSING));
+  g_assert_cmpstr (tp_account_get_display_name (account), ==,
+      "Fake Account");
+  g_assert_cmpstr (tp_account_get_storage_provider (account), ==,
+      "org.freedesktop.Telepathy.glib.test");
+  g_assert (tp_account_get_uri_schemes (account) != NULL);
+
+  g_object_unref (account);
+  g_object_unref (offline_service);
+}
+
 int
 main (int argc,
     char **argv)
@@ -801,6 +945,10 @@ main (int argc,
 
   g_test_add ("/am/ensure", Test, NULL, setup_service,
               test_ensure, teardown_service);
+  g_test_add ("/am/lazy", Test, NULL, setup_service, test_lazy,
+      teardown_service);
+  g_test_add ("/am/bulk-properties", Test, NULL, setup_service,
+      test_bulk_properties, teardown_service);
 
   g_test_add ("/am/most-available/no-account", Test, NULL, setup_service,
               test_most_available_no_account, teardown_service);
@@ -812,5 +960,7 @@ main (int argc,
               test_most_available_one_unset, teardown_service);
   g_test_add ("/am/most-available/two-unset", Test, NULL, setup_service,
               test_most_available_two_unset, teardown_service);
+  g_test_add ("/am/set-all-presences", Test, NULL, setup_service,
+              test_set_all_presences, teardown_service);
   return tp_tests_run_with_bus ();
 }
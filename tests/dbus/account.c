@@ -926,6 +926,83 @@ test_connection (Test *test,
   g_hash_table_unref (change);
 }
 
+static void
+test_unchanged (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark account_features[] = { TP_ACCOUNT_FEATURE_CORE, 0 };
+  GHashTable *change = tp_asv_new (NULL, NULL);
+  GVariant *parameters, *dup;
+
+  test->account = tp_account_new (test->dbus, ACCOUNT_PATH, NULL);
+  g_assert (test->account != NULL);
+
+  tp_proxy_prepare_async (test->account, account_features,
+      account_prepare_cb, test);
+  g_main_loop_run (test->mainloop);
+
+  g_assert (tp_proxy_is_prepared (test->account, TP_ACCOUNT_FEATURE_CORE));
+  parameters = tp_account_get_parameters_vardict (test->account);
+  dup = tp_account_dup_parameters_vardict (test->account);
+  g_assert (g_variant_equal (parameters, dup));
+  g_variant_unref (dup);
+
+  /* the same values again: nothing is notified or copied */
+
+  test_set_up_account_notify (test);
+  tp_asv_set_static_string (change, "DisplayName", "Fake Account");
+  tp_asv_set_static_string (change, "Nickname", "badger");
+  tp_asv_take_boxed (change, "Parameters", TP_HASH_TYPE_STRING_VARIANT_MAP,
+      tp_asv_new (NULL, NULL));
+  tp_asv_take_boxed (change, "CurrentPresence",
+      TP_STRUCT_TYPE_SIMPLE_PRESENCE,
+      tp_value_array_build (3,
+        G_TYPE_UINT, TP_CONNECTION_PRESENCE_TYPE_AWAY,
+        G_TYPE_STRING, "currently-away",
+        G_TYPE_STRING, "this is my CurrentPresence",
+        G_TYPE_INVALID));
+  tp_svc_account_emit_account_property_changed (test->account_service, change);
+  g_hash_table_remove_all (change);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (test->account);
+  g_assert_cmpuint (g_hash_table_size (test->times_notified), ==, 0);
+  g_assert (tp_account_get_parameters_vardict (test->account) == parameters);
+
+  /* only the properties that really change are notified */
+
+  tp_tests_simple_account_set_presence (test->account_service,
+      TP_CONNECTION_PRESENCE_TYPE_AWAY, "currently-away", "out to lunch");
+
+  tp_tests_proxy_run_until_dbus_queue_processed (test->account);
+  g_assert_cmpuint (g_hash_table_size (test->times_notified), ==, 1);
+  g_assert_cmpuint (test_get_times_notified (test, "current-status-message"),
+      ==, 1);
+
+  /* new parameters replace the cached variant */
+
+  tp_asv_take_boxed (change, "Parameters", TP_HASH_TYPE_STRING_VARIANT_MAP,
+      tp_asv_new (
+        "account", G_TYPE_STRING, "badger@example.com",
+        NULL));
+  tp_svc_account_emit_account_property_changed (test->account_service, change);
+  g_hash_table_remove_all (change);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (test->account);
+  parameters = tp_account_get_parameters_vardict (test->account);
+  g_assert_cmpuint (g_variant_n_children (parameters), ==, 1);
+  g_assert_cmpstr (tp_vardict_get_string (parameters, "account"), ==,
+      "badger@example.com");
+  g_assert_cmpstr (tp_asv_get_string (
+        tp_account_get_parameters (test->account), "account"), ==,
+      "badger@example.com");
+
+  dup = tp_account_dup_parameters_vardict (test->account);
+  g_assert (g_variant_equal (parameters, dup));
+  g_variant_unref (dup);
+
+  g_hash_table_unref (change);
+}
+
 int
 main (int argc,
       char **argv)
@@ -988,6 +1065,8 @@ main (int argc,
 
   g_test_add ("/account/connection", Test, NULL, setup_service,
               test_connection, teardown_service);
+  g_test_add ("/account/unchanged", Test, NULL, setup_service,
+              test_unchanged, teardown_service);
 
   g_test_add ("/account/storage", Test, "first", setup_service, test_storage,
       teardown_service);
@@ -603,6 +603,99 @@ test_observer (Test *test,
   g_hash_table_unref (info);
 }
 
+static void
+observer_recovery_progress_cb (TpBaseClient *client,
+    guint n_observed,
+    guint n_remaining,
+    GArray *progress)
+{
+  g_array_append_val (progress, n_observed);
+  g_array_append_val (progress, n_remaining);
+}
+
+static void
+test_observer_recovery_pacing (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GPtrArray *channels, *channels_2, *requests_satisified;
+  GHashTable *info;
+  GArray *progress = g_array_new (FALSE, FALSE, sizeof (guint));
+  guint i;
+
+  tp_base_client_take_observer_filter (test->base_client, tp_asv_new (
+        TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+          TP_IFACE_CHANNEL_TYPE_TEXT,
+        NULL));
+  tp_base_client_set_observer_recover (test->base_client, TRUE);
+  tp_base_client_set_observer_recovery_pacing (test->base_client, 1);
+
+  g_signal_connect (test->base_client, "observer-recovery-progress",
+      G_CALLBACK (observer_recovery_progress_cb), progress);
+
+  tp_base_client_register (test->base_client, &test->error);
+  g_assert_no_error (test->error);
+
+  tp_proxy_add_interface_by_id (TP_PROXY (test->client),
+      TP_IFACE_QUARK_CLIENT_OBSERVER);
+
+  channels = g_ptr_array_sized_new (1);
+  add_channel_to_ptr_array (channels, test->text_chan);
+  channels_2 = g_ptr_array_sized_new (1);
+  add_channel_to_ptr_array (channels_2, test->text_chan_2);
+  requests_satisified = g_ptr_array_sized_new (0);
+  info = tp_asv_new (
+      "recovering", G_TYPE_BOOLEAN, TRUE,
+      NULL);
+
+  /* three recovered bundles arrive at once; they are prepared one by one,
+   * and all of them are eventually observed */
+  for (i = 0; i < 3; i++)
+    {
+      tp_cli_client_observer_call_observe_channels (test->client, -1,
+          tp_proxy_get_object_path (test->account),
+          tp_proxy_get_object_path (test->connection),
+          (i == 1 ? channels_2 : channels), "/", requests_satisified, info,
+          no_return_cb, test, NULL, NULL);
+      test->wait++;
+    }
+
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+  g_assert (test->simple_client->observe_ctx != NULL);
+
+  g_assert_cmpuint (progress->len, ==, 6);
+
+  /* how many are still waiting depends on how soon the calls arrive */
+  for (i = 0; i < 3; i++)
+    {
+      g_assert_cmpuint (g_array_index (progress, guint, 2 * i), ==, i + 1);
+      g_assert_cmpuint (g_array_index (progress, guint, 2 * i + 1), <=,
+          2 - i);
+    }
+
+  g_assert_cmpuint (g_array_index (progress, guint, 5), ==, 0);
+
+  /* channels which are not being recovered are not paced */
+  tp_asv_set_boolean (info, "recovering", FALSE);
+  tp_cli_client_observer_call_observe_channels (test->client, -1,
+      tp_proxy_get_object_path (test->account),
+      tp_proxy_get_object_path (test->connection),
+      channels, "/", requests_satisified, info,
+      no_return_cb, test, NULL, NULL);
+  test->wait++;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (progress->len, ==, 6);
+
+  g_ptr_array_foreach (channels, free_channel_details, NULL);
+  g_ptr_array_foreach (channels_2, free_channel_details, NULL);
+  g_ptr_array_unref (channels);
+  g_ptr_array_unref (channels_2);
+  g_ptr_array_unref (requests_satisified);
+  g_hash_table_unref (info);
+  g_array_unref (progress);
+}
+
 /* Test Approver */
 static void
 get_approver_prop_cb (TpProxy *proxy,
@@ -1588,6 +1681,8 @@ main (int argc,
       teardown);
   g_test_add ("/base-client/observer", Test, NULL, setup, test_observer,
       teardown);
+  g_test_add ("/base-client/observer/recovery-pacing", Test, NULL, setup,
+      test_observer_recovery_pacing, teardown);
   g_test_add ("/base-client/approver", Test, NULL, setup, test_approver,
       teardown);
   g_test_add ("/base-client/handler", Test, NULL, setup, test_handler,
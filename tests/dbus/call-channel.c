@@ -55,6 +55,14 @@ typedef struct
   GArray *contacts;
 
   TpCallContent *added_content;
+
+  guint n_members_changed;
+  GHashTable *members_updated;
+
+  /* the number of candidates in each LocalCandidatesAdded signal, and the
+   * component of each candidate signalled */
+  GArray *candidate_batches;
+  GArray *candidate_components;
 } Test;
 
 static void
@@ -436,6 +444,8 @@ run_until_active (Test *test)
       TpCallContent *content = g_ptr_array_index (contents, i);
       GPtrArray *streams;
 
+      /* contents don't fetch their streams until they're prepared */
+      tp_tests_proxy_run_until_prepared (content, NULL);
       streams = tp_call_content_get_streams (content);
       for (j = 0; j < streams->len; j++)
         {
@@ -1043,6 +1053,294 @@ test_dtmf (Test *test,
   g_assert_no_error (test->error);
 }
 
+static gboolean
+timeline_has_event (GVariant *timeline,
+    const gchar *event,
+    const gchar *detail,
+    gint64 *offset)
+{
+  GVariantIter iter;
+  const gchar *e, *d;
+  gint64 o;
+
+  g_variant_iter_init (&iter, timeline);
+
+  while (g_variant_iter_next (&iter, "(&s&sx)", &e, &d, &o))
+    {
+      if (!tp_strdiff (e, event) && (detail == NULL || !tp_strdiff (d, detail)))
+        {
+          *offset = o;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static void
+test_timeline (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpBaseCallChannel *service_chan;
+  GVariant *timeline;
+  const gchar *event, *detail;
+  gint64 created, accepted, active, last = 0, offset;
+  GVariantIter iter;
+
+  outgoing_call (test, "timeline-badger", TRUE, FALSE);
+  run_until_accepted (test);
+  run_until_active (test);
+
+  service_chan = TP_BASE_CALL_CHANNEL (dbus_g_connection_lookup_g_object (
+        tp_proxy_get_dbus_connection (test->chan),
+        tp_proxy_get_object_path (test->chan)));
+  g_assert (service_chan != NULL);
+
+  timeline = tp_base_call_channel_dup_timeline (service_chan);
+  g_assert_cmpstr (g_variant_get_type_string (timeline), ==, "a(ssx)");
+
+  /* events are in order */
+  g_variant_iter_init (&iter, timeline);
+
+  while (g_variant_iter_next (&iter, "(&s&sx)", &event, &detail, &offset))
+    {
+      g_assert_cmpint (offset, >=, last);
+      last = offset;
+    }
+
+  g_assert (timeline_has_event (timeline, "created", "outgoing", &created));
+  g_assert_cmpint (created, >=, 0);
+  g_assert (timeline_has_event (timeline, "call-state", "ACCEPTED",
+        &accepted));
+  g_assert (timeline_has_event (timeline, "call-state", "ACTIVE", &active));
+  g_assert_cmpint (created, <=, accepted);
+  g_assert_cmpint (accepted, <=, active);
+
+  g_variant_unref (timeline);
+
+  /* the property is the same thing */
+  g_object_get (service_chan,
+      "timeline", &timeline,
+      NULL);
+  g_assert (timeline_has_event (timeline, "call-state", "ACTIVE", &offset));
+  g_assert_cmpint (offset, ==, active);
+  g_variant_unref (timeline);
+}
+
+static void
+members_changed_cb (TpCallChannel *channel,
+    GHashTable *updates,
+    GPtrArray *removed,
+    TpCallStateReason *reason,
+    Test *test)
+{
+  test->n_members_changed++;
+  tp_clear_pointer (&test->members_updated, g_hash_table_unref);
+  test->members_updated = g_hash_table_ref (updates);
+  g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_member_batch (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpBaseCallChannel *service_chan;
+  GHashTable *members;
+  TpContact *peer;
+  gpointer v;
+
+  outgoing_call (test, "batch-badger", TRUE, FALSE);
+
+  service_chan = TP_BASE_CALL_CHANNEL (dbus_g_connection_lookup_g_object (
+        tp_proxy_get_dbus_connection (test->chan),
+        tp_proxy_get_object_path (test->chan)));
+  g_assert (service_chan != NULL);
+
+  g_signal_connect (test->call_chan, "members-changed",
+      G_CALLBACK (members_changed_cb), test);
+
+  /* the peer is put on hold and taken off it again, and we join the call;
+   * the net result is one signal, with the final flags */
+  tp_base_call_channel_begin_batch (service_chan);
+  tp_base_call_channel_update_member_flags (service_chan, test->peer_handle,
+      TP_CALL_MEMBER_FLAG_HELD, 0, TP_CALL_STATE_CHANGE_REASON_PROGRESS_MADE,
+      "", "on hold");
+  tp_base_call_channel_begin_batch (service_chan);
+  tp_base_call_channel_update_member_flags (service_chan, test->self_handle,
+      0, 0, TP_CALL_STATE_CHANGE_REASON_PROGRESS_MADE, "", "joined");
+  tp_base_call_channel_end_batch (service_chan);
+  tp_base_call_channel_update_member_flags (service_chan, test->peer_handle,
+      0, 0, TP_CALL_STATE_CHANGE_REASON_PROGRESS_MADE, "", "off hold");
+
+  /* the members are up to date on the service side, but the inner batch
+   * didn't signal anything */
+  members = tp_base_call_channel_get_call_members (service_chan);
+  g_assert_cmpuint (g_hash_table_size (members), ==, 2);
+  tp_tests_proxy_run_until_dbus_queue_processed (test->conn);
+  g_assert_cmpuint (test->n_members_changed, ==, 0);
+
+  tp_base_call_channel_end_batch (service_chan);
+  g_main_loop_run (test->mainloop);
+
+  g_assert_cmpuint (test->n_members_changed, ==, 1);
+  g_assert_cmpuint (g_hash_table_size (test->members_updated), ==, 2);
+
+  members = tp_call_channel_get_members (test->call_chan);
+  g_assert_cmpuint (g_hash_table_size (members), ==, 2);
+  peer = tp_channel_get_target_contact (test->chan);
+  g_assert (g_hash_table_lookup_extended (members, peer, NULL, &v));
+  g_assert_cmpuint (GPOINTER_TO_UINT (v), ==, 0);
+
+  /* nothing more was pending */
+  tp_tests_proxy_run_until_dbus_queue_processed (test->conn);
+  g_assert_cmpuint (test->n_members_changed, ==, 1);
+}
+
+static void
+local_candidates_added_cb (TpCallStream *stream,
+    const GPtrArray *candidates,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+  guint i;
+
+  g_array_append_val (test->candidate_batches, candidates->len);
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      guint component;
+
+      tp_value_array_unpack (g_ptr_array_index (candidates, i), 1,
+          &component);
+      g_array_append_val (test->candidate_components, component);
+    }
+}
+
+static void
+add_candidates_cb (TpCallStream *stream,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  g_assert_no_error ((GError *) error);
+  test->wait_count--;
+}
+
+/* Start adding one candidate for @component to @stream */
+static void
+add_candidate (Test *test,
+    TpCallStream *stream,
+    guint component,
+    guint port)
+{
+  GPtrArray *candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+  GHashTable *info = tp_asv_new (NULL, NULL);
+
+  g_ptr_array_add (candidates, tp_value_array_build (4,
+        G_TYPE_UINT, component,
+        G_TYPE_STRING, "127.0.0.1",
+        G_TYPE_UINT, port,
+        TP_HASH_TYPE_STRING_VARIANT_MAP, info,
+        G_TYPE_INVALID));
+
+  test->wait_count++;
+  tp_cli_call_stream_interface_media_call_add_candidates (stream, -1,
+      candidates, add_candidates_cb, test, NULL, NULL);
+
+  g_hash_table_unref (info);
+  g_ptr_array_unref (candidates);
+}
+
+static void
+test_candidate_batch (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GPtrArray *contents, *streams;
+  TpCallContent *content;
+  TpCallStream *stream;
+  TpBaseMediaCallStream *service_stream;
+
+  outgoing_call (test, "candidate-badger", TRUE, FALSE);
+
+  contents = tp_call_channel_get_contents (test->call_chan);
+  g_assert_cmpuint (contents->len, ==, 1);
+  content = g_ptr_array_index (contents, 0);
+  tp_tests_proxy_run_until_prepared (content, NULL);
+
+  streams = tp_call_content_get_streams (content);
+  g_assert_cmpuint (streams->len, ==, 1);
+  stream = g_ptr_array_index (streams, 0);
+  tp_tests_proxy_run_until_prepared (stream, NULL);
+
+  service_stream = TP_BASE_MEDIA_CALL_STREAM (
+      dbus_g_connection_lookup_g_object (
+        tp_proxy_get_dbus_connection (stream),
+        tp_proxy_get_object_path (stream)));
+  g_assert (service_stream != NULL);
+
+  test->candidate_batches = g_array_new (FALSE, FALSE, sizeof (guint));
+  test->candidate_components = g_array_new (FALSE, FALSE, sizeof (guint));
+  tp_cli_call_stream_interface_media_connect_to_local_candidates_added (
+      stream, local_candidates_added_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  /* with no window, each call is signalled before it returns */
+  add_candidate (test, stream, 1, 1111);
+
+  while (test->wait_count > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (test->candidate_batches->len, ==, 1);
+  g_assert_cmpuint (g_array_index (test->candidate_batches, guint, 0), ==, 1);
+
+  /* candidates added within the window come out together, sorted by
+   * component, although the stream knows about each one as soon as it
+   * arrives */
+  g_object_set (service_stream,
+      "candidate-batch-window", 500,
+      NULL);
+  add_candidate (test, stream, 2, 2222);
+  add_candidate (test, stream, 1, 3333);
+  add_candidate (test, stream, 2, 4444);
+
+  while (test->wait_count > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (
+      tp_base_media_call_stream_get_local_candidates (service_stream)->len,
+      ==, 4);
+  tp_tests_proxy_run_until_dbus_queue_processed (stream);
+  g_assert_cmpuint (test->candidate_batches->len, ==, 1);
+
+  while (test->candidate_batches->len < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (g_array_index (test->candidate_batches, guint, 1), ==, 3);
+  g_assert_cmpuint (test->candidate_components->len, ==, 4);
+  g_assert_cmpuint (g_array_index (test->candidate_components, guint, 1),
+      ==, 1);
+  g_assert_cmpuint (g_array_index (test->candidate_components, guint, 2),
+      ==, 2);
+  g_assert_cmpuint (g_array_index (test->candidate_components, guint, 3),
+      ==, 2);
+
+  /* setting the window back to 0 restores the immediate behaviour */
+  g_object_set (service_stream,
+      "candidate-batch-window", 0,
+      NULL);
+  add_candidate (test, stream, 1, 5555);
+
+  while (test->wait_count > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (test->candidate_batches->len, ==, 3);
+  g_assert_cmpuint (g_array_index (test->candidate_batches, guint, 2), ==, 1);
+}
+
 static void
 teardown (Test *test,
           gconstpointer data G_GNUC_UNUSED)
@@ -1056,6 +1354,9 @@ teardown (Test *test,
   g_array_unref (test->stream_ids);
 
   tp_clear_object (&test->added_content);
+  tp_clear_pointer (&test->members_updated, g_hash_table_unref);
+  tp_clear_pointer (&test->candidate_batches, g_array_unref);
+  tp_clear_pointer (&test->candidate_components, g_array_unref);
   tp_clear_object (&test->chan);
   tp_clear_object (&test->conn);
   tp_clear_object (&test->cm);
@@ -1090,6 +1391,12 @@ main (int argc,
       teardown);
   g_test_add ("/call/dtmf", Test, NULL, setup, test_dtmf,
       teardown);
+  g_test_add ("/call/timeline", Test, NULL, setup, test_timeline,
+      teardown);
+  g_test_add ("/call/candidate-batch", Test, NULL, setup,
+      test_candidate_batch, teardown);
+  g_test_add ("/call/member-batch", Test, NULL, setup, test_member_batch,
+      teardown);
 
   return tp_tests_run_with_bus ();
 }
@@ -630,6 +630,101 @@ test_handle_with (Test *test,
   g_clear_error (&test->error);
 }
 
+typedef struct {
+    gboolean done;
+    gboolean ok;
+    GList *failed;
+} ManyResult;
+
+static void
+handle_many_with_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  ManyResult *many = user_data;
+  GError *error = NULL;
+
+  g_assert (source == NULL);
+
+  many->ok = tp_channel_dispatch_operation_handle_many_with_finish (result,
+      &many->failed, &error);
+
+  if (many->ok)
+    g_assert_no_error (error);
+  else
+    g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+
+  g_clear_error (&error);
+  many->done = TRUE;
+}
+
+static void
+test_handle_many_with (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpTestsSimpleChannelDispatchOperation *service_2;
+  TpChannelDispatchOperation *cdo_2;
+  GList *operations;
+  ManyResult many = { FALSE, FALSE, NULL };
+
+  service_2 = tp_tests_object_new_static_class (
+      TP_TESTS_TYPE_SIMPLE_CHANNEL_DISPATCH_OPERATION,
+      NULL);
+  tp_dbus_daemon_register_object (test->private_dbus, "/whatever2",
+      service_2);
+
+  test->cdo = tp_channel_dispatch_operation_new (test->dbus,
+      "/whatever", NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  cdo_2 = tp_channel_dispatch_operation_new (test->dbus,
+      "/whatever2", NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  operations = g_list_prepend (NULL, cdo_2);
+  operations = g_list_prepend (operations, test->cdo);
+
+  tp_channel_dispatch_operation_handle_many_with_async (operations, NULL,
+      handle_many_with_cb, &many);
+
+  while (!many.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (many.ok);
+  g_assert (many.failed == NULL);
+
+  many.done = FALSE;
+  tp_channel_dispatch_operation_handle_many_with_async (operations, "FAIL",
+      handle_many_with_cb, &many);
+
+  while (!many.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* both of them failed, and they come back in the order we gave */
+  g_assert (!many.ok);
+  g_assert_cmpuint (g_list_length (many.failed), ==, 2);
+  g_assert (many.failed->data == test->cdo);
+  g_assert (many.failed->next->data == cdo_2);
+  g_list_free_full (many.failed, g_object_unref);
+  many.failed = NULL;
+
+  /* an empty batch is trivially successful */
+  many.done = FALSE;
+  tp_channel_dispatch_operation_handle_many_with_async (NULL, NULL,
+      handle_many_with_cb, &many);
+
+  while (!many.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert (many.ok);
+  g_assert (many.failed == NULL);
+
+  g_list_free (operations);
+  g_object_unref (cdo_2);
+  tp_dbus_daemon_unregister_object (test->private_dbus, service_2);
+  g_object_unref (service_2);
+}
+
 static void
 claim_cb (GObject *source,
     GAsyncResult *result,
@@ -929,6 +1024,8 @@ main (int argc,
       test_channel_lost, teardown_services);
   g_test_add ("/cdo/handle-with", Test, NULL, setup_services,
       test_handle_with, teardown_services);
+  g_test_add ("/cdo/handle-many-with", Test, NULL, setup_services,
+      test_handle_many_with, teardown_services);
   g_test_add ("/cdo/claim", Test, NULL, setup_services,
       test_claim, teardown_services);
   g_test_add ("/cdo/channel-lost-preparing", Test, NULL, setup_services,
@@ -74,6 +74,7 @@ assert_chan_sane (TpChannel *chan,
     const gchar *initiator_id)
 {
   GHashTable *asv;
+  GVariant *vardict;
   TpHandleType type;
 
   g_assert (tp_channel_is_ready (chan));
@@ -106,6 +107,17 @@ assert_chan_sane (TpChannel *chan,
   g_assert_cmpstr (
       tp_asv_get_string (asv, TP_PROP_CHANNEL_TARGET_ID), ==,
       IDENTIFIER);
+
+  /* the borrowed variant is the same as the one we can keep */
+  vardict = tp_channel_dup_immutable_properties (chan);
+  g_assert (g_variant_equal (vardict,
+        tp_channel_get_immutable_properties_vardict (chan)));
+  g_assert_cmpuint (g_variant_n_children (vardict), ==,
+      g_hash_table_size (asv));
+  g_assert_cmpstr (
+      tp_vardict_get_string (vardict, TP_PROP_CHANNEL_TARGET_ID), ==,
+      IDENTIFIER);
+  g_variant_unref (vardict);
 }
 
 int
@@ -133,6 +145,7 @@ main (int argc,
   GError invalidated_for_test = { TP_ERROR, TP_ERROR_PERMISSION_DENIED,
       "No channel for you!" };
   GHashTable *asv;
+  GVariant *vardict;
   GAsyncResult *prepare_result;
   GQuark some_features[] = { TP_CHANNEL_FEATURE_CORE,
       TP_CHANNEL_FEATURE_CHAT_STATES, 0 };
@@ -338,6 +351,11 @@ main (int argc,
       TP_UNKNOWN_HANDLE_TYPE, 0, &error);
   g_assert_no_error (error);
 
+  /* we don't know the channel type yet */
+  vardict = tp_channel_dup_immutable_properties (chan);
+  g_assert (tp_vardict_get_string (vardict,
+        TP_PROP_CHANNEL_CHANNEL_TYPE) == NULL);
+
   prepare_result = NULL;
   tp_proxy_prepare_async (chan, some_features, channel_prepared_cb,
       &prepare_result);
@@ -373,6 +391,17 @@ main (int argc,
   g_object_unref (prepare_result);
   prepare_result = NULL;
 
+  /* the properties retrieved during introspection replaced the cached
+   * variant, while the copy we kept is unchanged */
+  g_assert (tp_vardict_get_string (vardict,
+        TP_PROP_CHANNEL_CHANNEL_TYPE) == NULL);
+  g_assert (!g_variant_equal (vardict,
+        tp_channel_get_immutable_properties_vardict (chan)));
+  g_assert_cmpstr (tp_vardict_get_string (
+        tp_channel_get_immutable_properties_vardict (chan),
+        TP_PROP_CHANNEL_CHANNEL_TYPE), ==, TP_IFACE_CHANNEL_TYPE_TEXT);
+  g_variant_unref (vardict);
+
   assert_chan_sane (chan, handle, TRUE,
       tp_base_connection_get_self_handle (service_conn_as_base),
       tp_handle_inspect (contact_repo,
@@ -436,12 +465,11 @@ main (int argc,
   g_assert_cmpuint (
       TP_TESTS_TEXT_CHANNEL_NULL (service_props_chan)->get_channel_type_called,
       ==, 0);
-  /* FIXME: with an improved fast-path we could avoid this one too maybe? */
-  /*
+  /* we were given every immutable property, so we trust that the channel
+   * exists and don't need GetInterfaces to check */
   g_assert_cmpuint (
       TP_TESTS_TEXT_CHANNEL_NULL (service_props_chan)->get_interfaces_called,
       ==, 0);
-   */
 
   assert_chan_sane (chan, handle, FALSE, handle, IDENTIFIER);
 
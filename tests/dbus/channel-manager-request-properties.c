@@ -209,6 +209,56 @@ test_target_id (Test *test,
   g_hash_table_unref (request);
 }
 
+static void
+count_requests_cb (TpTestsSimpleChannelManager *channel_manager,
+    GHashTable *request_properties,
+    guint *n_requests)
+{
+  (*n_requests)++;
+}
+
+static void
+test_ensure_twice (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GHashTable *request, *properties;
+  gboolean yours;
+  gchar *first_path, *path;
+  guint n_requests = 0;
+
+  request = tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING, TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT, TP_HANDLE_TYPE_CONTACT,
+      TP_PROP_CHANNEL_TARGET_ID, G_TYPE_STRING, "lolbags#dingdong",
+      NULL);
+
+  g_signal_connect (test->channel_manager, "request",
+      G_CALLBACK (count_requests_cb), &n_requests);
+
+  tp_cli_connection_interface_requests_run_ensure_channel (test->conn, -1,
+      request, &yours, &first_path, &properties, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (yours);
+  g_assert_cmpuint (n_requests, ==, 1);
+  g_hash_table_unref (properties);
+
+  /* the same target again is answered with the same channel, without
+   * asking the channel manager or normalizing the TargetID again */
+  tp_cli_connection_interface_requests_run_ensure_channel (test->conn, -1,
+      request, &yours, &path, &properties, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (!yours);
+  g_assert_cmpstr (path, ==, first_path);
+  g_assert_cmpstr (tp_asv_get_string (properties, TP_PROP_CHANNEL_TARGET_ID),
+      ==, "lolbags");
+  g_assert_cmpuint (n_requests, ==, 1);
+  g_hash_table_unref (properties);
+  g_free (path);
+
+  g_free (first_path);
+  g_hash_table_unref (request);
+}
+
 int
 main (int argc,
     char **argv)
@@ -219,6 +269,8 @@ main (int argc,
 
   g_test_add ("/channel-manager-request-properties/target-id", Test, NULL, setup,
       test_target_id, teardown);
+  g_test_add ("/channel-manager-request-properties/ensure-twice", Test, NULL,
+      setup, test_ensure_twice, teardown);
 
   return tp_tests_run_with_bus ();
 }
@@ -149,7 +149,9 @@ teardown (Test *test,
   tp_clear_object (&test->chan_contact_service);
   tp_clear_object (&test->chan_room_service);
 
-  tp_tests_connection_assert_disconnect_succeeds (test->connection);
+  if (tp_proxy_get_invalidated (test->connection) == NULL)
+    tp_tests_connection_assert_disconnect_succeeds (test->connection);
+
   g_object_unref (test->connection);
   g_object_unref (test->base_connection);
 
@@ -663,6 +665,54 @@ test_contacts (Test *test,
   g_assert_cmpstr (tp_contact_get_alias (contact), ==, alias2);
 }
 
+static void
+contact_channel_invalidated_cb (TpProxy *proxy,
+    guint domain,
+    gint code,
+    gchar *message,
+    Test *test)
+{
+  /* the connection's channels are all marked invalid before any of them
+   * signals it */
+  g_assert (tp_proxy_get_invalidated (test->channel_room) != NULL);
+  test->wait--;
+}
+
+static void
+test_connection_invalidated (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  const GError *error;
+
+  g_assert_cmpuint (tp_channel_get_handle (test->channel_contact, NULL), !=,
+      0);
+
+  test->wait = 1;
+  g_signal_connect (test->channel_contact, "invalidated",
+      G_CALLBACK (contact_channel_invalidated_cb), test);
+
+  tp_base_connection_change_status (test->base_connection,
+      TP_CONNECTION_STATUS_DISCONNECTED,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+
+  while (tp_proxy_get_invalidated (test->connection) == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpint (test->wait, ==, 0);
+
+  error = tp_proxy_get_invalidated (test->channel_contact);
+  g_assert (error != NULL);
+  g_assert (error->domain == tp_proxy_get_invalidated (
+        test->connection)->domain);
+  g_assert_cmpint (error->code, ==,
+      tp_proxy_get_invalidated (test->connection)->code);
+  g_assert (tp_proxy_get_invalidated (test->channel_room) != NULL);
+
+  /* their handles became meaningless */
+  g_assert_cmpuint (tp_channel_get_handle (test->channel_contact, NULL), ==,
+      0);
+}
+
 int
 main (int argc,
       char **argv)
@@ -707,5 +757,8 @@ main (int argc,
   g_test_add ("/channel/contacts", Test, NULL, setup,
       test_contacts, teardown);
 
+  g_test_add ("/channel/connection-invalidated", Test, NULL, setup,
+      test_connection_invalidated, teardown);
+
   return tp_tests_run_with_bus ();
 }
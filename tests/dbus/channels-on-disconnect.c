@@ -0,0 +1,172 @@
+/* Test that channels go away quietly when their connection disconnects
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/channel.h>
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/debug.h>
+#include <telepathy-glib/gtypes.h>
+#include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/proxy-subclass.h>
+
+#include "tests/lib/echo-conn.h"
+#include "tests/lib/util.h"
+
+#define N_CHANNELS 3
+
+typedef struct {
+    TpDBusDaemon *dbus;
+    TpTestsEchoConnection *service_conn;
+    TpConnection *conn;
+    TpChannel *channels[N_CHANNELS];
+
+    guint n_channel_closed;
+    guint n_closed;
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gchar *name, *conn_path;
+
+  tp_debug_set_flags ("all");
+  test->dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  test->service_conn = TP_TESTS_ECHO_CONNECTION (
+      tp_tests_object_new_static_class (TP_TESTS_TYPE_ECHO_CONNECTION,
+        "account", "me@example.com",
+        "protocol", "example",
+        NULL));
+
+  tp_base_connection_register (TP_BASE_CONNECTION (test->service_conn),
+      "example", &name, &conn_path, &test->error);
+  g_assert_no_error (test->error);
+
+  test->conn = tp_connection_new (test->dbus, name, conn_path,
+      &test->error);
+  g_assert_no_error (test->error);
+
+  g_assert (tp_connection_run_until_ready (test->conn, TRUE, &test->error,
+        NULL));
+  g_assert_no_error (test->error);
+
+  g_free (name);
+  g_free (conn_path);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint i;
+
+  for (i = 0; i < N_CHANNELS; i++)
+    g_clear_object (&test->channels[i]);
+
+  g_clear_object (&test->conn);
+  g_clear_object (&test->service_conn);
+  g_clear_object (&test->dbus);
+}
+
+static void
+channel_closed_cb (TpConnection *conn,
+    const gchar *object_path,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  test->n_channel_closed++;
+}
+
+static void
+closed_cb (TpChannel *channel,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  test->n_closed++;
+}
+
+static void
+test_disconnect (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  static const gchar * const ids[N_CHANNELS] = { "alice@example.com",
+      "bob@example.com", "chris@example.com" };
+  const GError *invalidated;
+  guint i;
+
+  tp_cli_connection_interface_requests_connect_to_channel_closed (test->conn,
+      channel_closed_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  for (i = 0; i < N_CHANNELS; i++)
+    {
+      GHashTable *request, *properties;
+      gchar *path;
+
+      request = tp_asv_new (
+          TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+            TP_IFACE_CHANNEL_TYPE_TEXT,
+          TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
+            TP_HANDLE_TYPE_CONTACT,
+          TP_PROP_CHANNEL_TARGET_ID, G_TYPE_STRING, ids[i],
+          NULL);
+
+      tp_cli_connection_interface_requests_run_create_channel (test->conn,
+          -1, request, &path, &properties, &test->error, NULL);
+      g_assert_no_error (test->error);
+
+      test->channels[i] = tp_channel_new_from_properties (test->conn, path,
+          properties, &test->error);
+      g_assert_no_error (test->error);
+
+      tp_cli_channel_connect_to_closed (test->channels[i], closed_cb, test,
+          NULL, NULL, &test->error);
+      g_assert_no_error (test->error);
+
+      g_hash_table_unref (properties);
+      g_hash_table_unref (request);
+      g_free (path);
+    }
+
+  tp_tests_connection_assert_disconnect_succeeds (test->conn);
+
+  /* StatusChanged is enough to tell us that the channels have gone */
+  g_assert_cmpuint (test->n_channel_closed, ==, 0);
+  g_assert_cmpuint (test->n_closed, ==, 0);
+
+  for (i = 0; i < N_CHANNELS; i++)
+    {
+      invalidated = tp_proxy_get_invalidated (test->channels[i]);
+
+      g_assert (invalidated != NULL);
+      g_assert (invalidated->domain != TP_DBUS_ERRORS);
+    }
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  tp_tests_abort_after (10);
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add ("/channels-on-disconnect", Test, NULL, setup,
+      test_disconnect, teardown);
+
+  return tp_tests_run_with_bus ();
+}
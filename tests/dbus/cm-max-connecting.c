@@ -0,0 +1,319 @@
+/* Tests of tp_base_connection_manager_set_max_connecting()
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/lib/echo-cm.h"
+#include "tests/lib/echo-conn.h"
+#include "tests/lib/util.h"
+
+#define N_CONNECTIONS 3
+
+typedef struct {
+    GMainLoop *mainloop;
+    TpDBusDaemon *dbus;
+
+    TpBaseConnectionManager *service_cm;
+    TpConnectionManager *cm;
+
+    /* borrowed from the service CM */
+    TpTestsEchoConnection *service_conns[N_CONNECTIONS];
+    TpConnection *conns[N_CONNECTIONS];
+
+    /* indexes into service_conns, in the order they started connecting */
+    GArray *started;
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+status_changed_cb (TpTestsEchoConnection *service_conn,
+    guint status,
+    guint reason,
+    Test *test)
+{
+  guint i;
+
+  if (status != TP_CONNECTION_STATUS_CONNECTING)
+    return;
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    {
+      if (test->service_conns[i] == service_conn)
+        g_array_append_val (test->started, i);
+    }
+}
+
+static void
+request_connection_cb (TpConnectionManager *cm,
+    const gchar *bus_name,
+    const gchar *object_path,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  gchar **path = user_data;
+
+  g_assert_no_error ((GError *) error);
+  *path = g_strdup (object_path);
+}
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  DBusGConnection *bus;
+  guint i;
+
+  test->mainloop = g_main_loop_new (NULL, FALSE);
+  test->dbus = tp_tests_dbus_daemon_dup_or_die ();
+  test->started = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  test->service_cm = tp_tests_object_new_static_class (
+      TP_TESTS_TYPE_ECHO_CONNECTION_MANAGER,
+      NULL);
+  g_assert (tp_base_connection_manager_register (test->service_cm));
+
+  test->cm = tp_connection_manager_new (test->dbus, "example_echo", NULL,
+      &test->error);
+  g_assert_no_error (test->error);
+
+  bus = tp_proxy_get_dbus_connection (test->cm);
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    {
+      gchar *account = g_strdup_printf ("me%u@example.com", i);
+      GHashTable *parameters = tp_asv_new (
+          "account", G_TYPE_STRING, account,
+          NULL);
+      gchar *path = NULL;
+
+      tp_cli_connection_manager_call_request_connection (test->cm, -1,
+          "example", parameters, request_connection_cb, &path, NULL, NULL);
+
+      while (path == NULL)
+        g_main_context_iteration (NULL, TRUE);
+
+      test->service_conns[i] = TP_TESTS_ECHO_CONNECTION (
+          dbus_g_connection_lookup_g_object (bus, path));
+      g_assert (test->service_conns[i] != NULL);
+      tp_tests_echo_connection_set_manual_connect (test->service_conns[i],
+          TRUE);
+      g_signal_connect (test->service_conns[i], "status-changed",
+          G_CALLBACK (status_changed_cb), test);
+
+      test->conns[i] = tp_connection_new (test->dbus, NULL, path,
+          &test->error);
+      g_assert_no_error (test->error);
+
+      g_free (path);
+      g_hash_table_unref (parameters);
+      g_free (account);
+    }
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint i;
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    {
+      if (test->service_conns[i] != NULL)
+        g_signal_handlers_disconnect_by_func (test->service_conns[i],
+            status_changed_cb, test);
+
+      tp_cli_connection_call_disconnect (test->conns[i], -1, NULL, NULL,
+          NULL, NULL);
+      tp_tests_proxy_run_until_dbus_queue_processed (test->conns[i]);
+      g_object_unref (test->conns[i]);
+    }
+
+  g_clear_error (&test->error);
+  g_array_unref (test->started);
+  tp_clear_object (&test->cm);
+  tp_clear_object (&test->service_cm);
+  tp_clear_object (&test->dbus);
+  g_main_loop_unref (test->mainloop);
+}
+
+static void
+connect_all (Test *test)
+{
+  guint i;
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    tp_cli_connection_call_connect (test->conns[i], -1, NULL, NULL, NULL,
+        NULL);
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    tp_tests_proxy_run_until_dbus_queue_processed (test->conns[i]);
+}
+
+static void
+assert_status (Test *test,
+    guint i,
+    TpConnectionStatus status)
+{
+  g_assert_cmpint (tp_base_connection_get_status (
+        (TpBaseConnection *) test->service_conns[i]), ==, status);
+}
+
+static void
+assert_started (Test *test,
+    guint n,
+    ...)
+{
+  va_list ap;
+  guint i;
+
+  g_assert_cmpuint (test->started->len, ==, n);
+  va_start (ap, n);
+
+  for (i = 0; i < n; i++)
+    g_assert_cmpuint (g_array_index (test->started, guint, i), ==,
+        va_arg (ap, guint));
+
+  va_end (ap);
+}
+
+static void
+test_queue (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 1);
+  g_assert_cmpuint (tp_base_connection_manager_get_max_connecting (
+        test->service_cm), ==, 1);
+
+  connect_all (test);
+
+  /* only the first one was allowed to start */
+  assert_started (test, 1, 0);
+  assert_status (test, 0, TP_CONNECTION_STATUS_CONNECTING);
+  assert_status (test, 1, TP_INTERNAL_CONNECTION_STATUS_NEW);
+  assert_status (test, 2, TP_INTERNAL_CONNECTION_STATUS_NEW);
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 2);
+
+  /* the others start in the order Connect() was called, each once the one
+   * before it has finished */
+  tp_tests_echo_connection_finish_connecting (test->service_conns[0]);
+  assert_started (test, 2, 0, 1);
+  assert_status (test, 2, TP_INTERNAL_CONNECTION_STATUS_NEW);
+
+  tp_tests_echo_connection_finish_connecting (test->service_conns[1]);
+  assert_started (test, 3, 0, 1, 2);
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 0);
+
+  tp_tests_echo_connection_finish_connecting (test->service_conns[2]);
+  assert_status (test, 2, TP_CONNECTION_STATUS_CONNECTED);
+}
+
+static void
+test_synchronous (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint i;
+
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 1);
+
+  /* the waiting connections finish as soon as they start, so each one
+   * makes room for the next while they are being admitted */
+  tp_tests_echo_connection_set_manual_connect (test->service_conns[1], FALSE);
+  tp_tests_echo_connection_set_manual_connect (test->service_conns[2], FALSE);
+  connect_all (test);
+  assert_started (test, 1, 0);
+
+  tp_tests_echo_connection_finish_connecting (test->service_conns[0]);
+  assert_started (test, 3, 0, 1, 2);
+
+  for (i = 0; i < N_CONNECTIONS; i++)
+    assert_status (test, i, TP_CONNECTION_STATUS_CONNECTED);
+
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 0);
+}
+
+static void
+test_raise_limit (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 1);
+  connect_all (test);
+  assert_started (test, 1, 0);
+
+  /* raising the limit lets the waiting connections start, in order */
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 2);
+  assert_started (test, 2, 0, 1);
+  assert_status (test, 2, TP_INTERNAL_CONNECTION_STATUS_NEW);
+
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 0);
+  assert_started (test, 3, 0, 1, 2);
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 0);
+}
+
+static void
+test_disconnect_waiting (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gpointer weak = test->service_conns[1];
+
+  tp_base_connection_manager_set_max_connecting (test->service_cm, 1);
+  connect_all (test);
+  assert_started (test, 1, 0);
+
+  /* a waiting connection which is disconnected leaves the queue... */
+  g_object_add_weak_pointer (weak, &weak);
+  g_signal_handlers_disconnect_by_func (test->service_conns[1],
+      status_changed_cb, test);
+  test->service_conns[1] = NULL;
+
+  tp_cli_connection_call_disconnect (test->conns[1], -1, NULL, NULL, NULL,
+      NULL);
+  tp_tests_proxy_run_until_dbus_queue_processed (test->conns[1]);
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 1);
+
+  /* ... and nothing else keeps it alive once the CM has forgotten it */
+  while (weak != NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* so the next one to start is the one after it */
+  tp_tests_echo_connection_finish_connecting (test->service_conns[0]);
+  assert_started (test, 2, 0, 2);
+  g_assert_cmpuint (tp_base_connection_manager_get_n_waiting_connections (
+        test->service_cm), ==, 0);
+
+  tp_tests_echo_connection_finish_connecting (test->service_conns[2]);
+  assert_status (test, 2, TP_CONNECTION_STATUS_CONNECTED);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  tp_tests_init (&argc, &argv);
+
+  g_test_add ("/cm-max-connecting/queue", Test, NULL, setup, test_queue,
+      teardown);
+  g_test_add ("/cm-max-connecting/synchronous", Test, NULL, setup,
+      test_synchronous, teardown);
+  g_test_add ("/cm-max-connecting/raise-limit", Test, NULL, setup,
+      test_raise_limit, teardown);
+  g_test_add ("/cm-max-connecting/disconnect-waiting", Test, NULL, setup,
+      test_disconnect_waiting, teardown);
+
+  return tp_tests_run_with_bus ();
+}
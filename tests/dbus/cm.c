@@ -931,6 +931,67 @@ idle_activate (gpointer cm)
   return FALSE;
 }
 
+static GVariant *
+dup_protocol_properties (TpConnectionManager *cm,
+    const gchar *protocol_name)
+{
+  TpProtocol *protocol = tp_connection_manager_get_protocol_object (cm,
+      protocol_name);
+
+  g_assert (TP_IS_PROTOCOL (protocol));
+  return tp_protocol_dup_immutable_properties (protocol);
+}
+
+static void
+test_file_cached (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpConnectionManager *again;
+  gchar *manager_file;
+  gchar *escaped;
+  gchar *cache_file;
+  const gchar * const protocols[] = { "foo", "bar", "somewhat-pathological",
+      NULL };
+  const gchar * const *iter;
+
+  test->cm = tp_connection_manager_new (test->dbus, "test_manager_file",
+      NULL, &test->error);
+  g_assert_no_error (test->error);
+  tp_tests_proxy_run_until_prepared (test->cm, NULL);
+
+  /* reading the .manager file left a cached copy of what it contained */
+  g_object_get (test->cm,
+      "manager-file", &manager_file,
+      NULL);
+  escaped = tp_escape_as_identifier (manager_file);
+  cache_file = g_build_filename (g_get_user_cache_dir (), "telepathy",
+      "managers", escaped, NULL);
+  g_assert (g_file_test (cache_file, G_FILE_TEST_IS_REGULAR));
+
+  /* a second CM object uses that, and gets exactly the same protocols */
+  again = tp_connection_manager_new (test->dbus, "test_manager_file",
+      NULL, &test->error);
+  g_assert_no_error (test->error);
+  tp_tests_proxy_run_until_prepared (again, NULL);
+  g_assert_cmpuint (tp_connection_manager_get_info_source (again), ==,
+      TP_CM_INFO_SOURCE_FILE);
+
+  for (iter = protocols; *iter != NULL; iter++)
+    {
+      GVariant *expected = dup_protocol_properties (test->cm, *iter);
+      GVariant *actual = dup_protocol_properties (again, *iter);
+
+      g_assert (g_variant_equal (expected, actual));
+      g_variant_unref (expected);
+      g_variant_unref (actual);
+    }
+
+  g_object_unref (again);
+  g_free (cache_file);
+  g_free (escaped);
+  g_free (manager_file);
+}
+
 static void
 test_dbus_ready (Test *test,
                  gconstpointer data)
@@ -1120,6 +1181,70 @@ test_list (Test *test,
   g_assert (tp_connection_manager_has_protocol (test->spurious, "normal"));
 }
 
+static void
+found_cb (TpConnectionManager *cm,
+    gpointer user_data)
+{
+  GPtrArray *found = user_data;
+
+  g_assert (TP_IS_CONNECTION_MANAGER (cm));
+  g_ptr_array_add (found, g_object_ref (cm));
+}
+
+static void
+test_list_full (Test *test,
+    gconstpointer data)
+{
+  gint timeout_ms = GPOINTER_TO_INT (data);
+  GPtrArray *found = g_ptr_array_new_with_free_func (g_object_unref);
+  GAsyncResult *res = NULL;
+  GList *cms, *l;
+
+  tp_list_connection_managers_full_async (test->dbus, timeout_ms, found_cb,
+      found, tp_tests_result_ready_cb, &res);
+  tp_tests_run_until_result (&res);
+  cms = tp_list_connection_managers_finish (res, &test->error);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (g_list_length (cms), ==, 2);
+
+  /* every CM in the result was passed to the streaming callback first */
+  g_assert_cmpuint (found->len, ==, 2);
+
+  for (l = cms; l != NULL; l = l->next)
+    {
+      g_assert (l->data == g_ptr_array_index (found, 0) ||
+          l->data == g_ptr_array_index (found, 1));
+
+      if (tp_connection_manager_is_running (l->data))
+        test->echo = g_object_ref (l->data);
+      else
+        test->spurious = g_object_ref (l->data);
+    }
+
+  g_assert (test->echo != NULL);
+  g_assert (test->spurious != NULL);
+
+  if (timeout_ms < 0)
+    {
+      g_assert (tp_proxy_is_prepared (test->echo,
+            TP_CONNECTION_MANAGER_FEATURE_CORE));
+      g_assert (tp_proxy_is_prepared (test->spurious,
+            TP_CONNECTION_MANAGER_FEATURE_CORE));
+    }
+
+  /* whether or not the deadline cut them off, they get there in the end */
+  tp_tests_proxy_run_until_prepared (test->echo, NULL);
+  tp_tests_proxy_run_until_prepared (test->spurious, NULL);
+  g_assert_cmpuint (tp_connection_manager_get_info_source (test->echo),
+      ==, TP_CM_INFO_SOURCE_LIVE);
+  g_assert_cmpuint (tp_connection_manager_get_info_source (test->spurious),
+      ==, TP_CM_INFO_SOURCE_FILE);
+
+  g_list_free_full (cms, g_object_unref);
+  g_ptr_array_unref (found);
+  g_object_unref (res);
+}
+
 int
 main (int argc,
       char **argv)
@@ -1150,6 +1275,8 @@ main (int argc,
       test_complex_file_ready, teardown);
   g_test_add ("/cm/file/complex/cwr", Test, GINT_TO_POINTER (USE_CWR), setup,
       test_complex_file_ready, teardown);
+  g_test_add ("/cm/file/cached", Test, NULL, setup, test_file_cached,
+      teardown);
   g_test_add ("/cm/dbus", Test, GINT_TO_POINTER (0), setup,
       test_dbus_ready, teardown);
   g_test_add ("/cm/dbus/cwr", Test, GINT_TO_POINTER (USE_CWR), setup,
@@ -1189,6 +1316,10 @@ main (int argc,
       setup, test_list, teardown);
   g_test_add ("/cm/list", Test, GINT_TO_POINTER (USE_OLD_LIST),
       setup, test_list, teardown);
+  g_test_add ("/cm/list/full", Test, GINT_TO_POINTER (-1),
+      setup, test_list_full, teardown);
+  g_test_add ("/cm/list/full/deadline", Test, GINT_TO_POINTER (0),
+      setup, test_list_full, teardown);
 
   return tp_tests_run_with_bus ();
 }
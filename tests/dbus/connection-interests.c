@@ -45,6 +45,8 @@ G_DEFINE_TYPE_WITH_CODE (InterestedConnection,
  */
 #define UNSUPPORTED_TOKEN "org.example.Warrington/Wolves"
 
+#define SUPPORTED_IFACE "com.example.rannoch"
+
 static void
 interested_connection_init (InterestedConnection *self G_GNUC_UNUSED)
 {
@@ -64,6 +66,10 @@ interested_connection_constructed (GObject *object)
       TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION);
   tp_base_connection_add_possible_client_interest (base,
       g_quark_from_static_string (SUPPORTED_TOKEN));
+  tp_base_connection_add_possible_contact_interest (base,
+      g_quark_from_static_string (SUPPORTED_TOKEN));
+  tp_base_connection_set_unicast_signals (base,
+      g_quark_from_static_string (SUPPORTED_TOKEN));
 }
 
 static void
@@ -91,6 +97,7 @@ typedef struct {
     GAsyncResult *prepare_result;
 
     GPtrArray *log;
+    guint n_declared;
 } Test;
 
 static void
@@ -386,6 +393,163 @@ test_interest (Test *test,
   g_assert_cmpuint (test->log->len, ==, i);
 }
 
+static void
+test_contact_interest (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  static const gchar * hansard[] = {
+      SUPPORTED_TOKEN,
+      NULL
+  };
+  GQuark token = g_quark_from_static_string (SUPPORTED_TOKEN);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      test->service_conn_as_base, TP_HANDLE_TYPE_CONTACT);
+  const gchar *client = tp_dbus_daemon_get_unique_name (test->client_bus);
+  GArray *contacts = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  TpHandle alice, bob;
+  GError *error = NULL;
+
+  alice = tp_handle_ensure (contact_repo, "alice", NULL, NULL);
+  bob = tp_handle_ensure (contact_repo, "bob", NULL, NULL);
+  g_array_append_val (contacts, alice);
+
+  /* nobody has asked about anyone yet */
+  g_assert (!tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, alice));
+  g_assert (!tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, bob));
+  /* tokens that weren't added as contact interests are unaffected */
+  g_assert (tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION, bob));
+
+  tp_base_connection_add_contact_interest (test->service_conn_as_base,
+      client, SUPPORTED_TOKEN, contacts);
+  g_assert (tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, alice));
+  g_assert (!tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, bob));
+
+  /* a plain interest means every contact */
+  tp_cli_connection_run_add_client_interest (test->conn, -1, hansard, &error,
+      NULL);
+  g_assert_no_error (error);
+  g_assert (tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, bob));
+
+  /* removing the interest removes both kinds */
+  tp_cli_connection_run_remove_client_interest (test->conn, -1, hansard,
+      &error, NULL);
+  g_assert_no_error (error);
+  g_assert (!tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, alice));
+  g_assert (!tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, bob));
+
+  /* so does leaving the bus */
+  tp_base_connection_add_contact_interest (test->service_conn_as_base,
+      client, SUPPORTED_TOKEN, contacts);
+  g_assert (tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, alice));
+
+  dbus_connection_flush (test->client_libdbus);
+  dbus_connection_close (test->client_libdbus);
+
+  while (tp_base_connection_is_contact_interesting (
+        test->service_conn_as_base, token, alice))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_array_unref (contacts);
+}
+
+static DBusHandlerResult
+declared_filter (DBusConnection *connection G_GNUC_UNUSED,
+    DBusMessage *message,
+    void *user_data)
+{
+  Test *test = user_data;
+
+  if (dbus_message_is_signal (message, SUPPORTED_IFACE, "Declared"))
+    {
+      g_assert_cmpstr (dbus_message_get_path (message), ==, test->conn_path);
+      g_assert_cmpstr (dbus_message_get_destination (message), ==,
+          tp_dbus_daemon_get_unique_name (test->client_bus));
+      test->n_declared++;
+    }
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void
+emit_declared (Test *test)
+{
+  g_assert (tp_base_connection_emit_unicast_signal (
+        test->service_conn_as_base,
+        g_quark_from_static_string (SUPPORTED_TOKEN), SUPPORTED_IFACE,
+        "Declared", g_variant_new ("(s)", "herbal medicine")));
+
+  /* run until the signal, if any, has reached the client */
+  tp_tests_proxy_run_until_dbus_queue_processed (test->dbus);
+  tp_tests_proxy_run_until_dbus_queue_processed (test->client_bus);
+}
+
+static void
+test_unicast (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  static const gchar * hansard[] = {
+      SUPPORTED_TOKEN,
+      NULL
+  };
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      test->service_conn_as_base, TP_HANDLE_TYPE_CONTACT);
+  GArray *contacts = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  TpHandle alice;
+  GError *error = NULL;
+
+  alice = tp_handle_ensure (contact_repo, "alice", NULL, NULL);
+  g_array_append_val (contacts, alice);
+
+  dbus_connection_add_filter (test->client_libdbus, declared_filter, test,
+      NULL);
+
+  /* tokens that are broadcast are left to the caller */
+  g_assert (!tp_base_connection_emit_unicast_signal (
+        test->service_conn_as_base,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_LOCATION,
+        TP_IFACE_CONNECTION_INTERFACE_LOCATION, "LocationUpdated",
+        g_variant_new ("(s)", "ignored")));
+
+  /* nobody is interested, so nothing is sent */
+  emit_declared (test);
+  g_assert_cmpuint (test->n_declared, ==, 0);
+
+  /* the client has no match rule for this signal, so it only gets it
+   * because it is addressed to it */
+  tp_cli_connection_run_add_client_interest (test->conn, -1, hansard, &error,
+      NULL);
+  g_assert_no_error (error);
+  emit_declared (test);
+  g_assert_cmpuint (test->n_declared, ==, 1);
+
+  /* an interest in particular contacts is enough, and doesn't make the
+   * client get it twice */
+  tp_base_connection_add_contact_interest (test->service_conn_as_base,
+      tp_dbus_daemon_get_unique_name (test->client_bus), SUPPORTED_TOKEN,
+      contacts);
+  emit_declared (test);
+  g_assert_cmpuint (test->n_declared, ==, 2);
+
+  tp_cli_connection_run_remove_client_interest (test->conn, -1, hansard,
+      &error, NULL);
+  g_assert_no_error (error);
+  emit_declared (test);
+  g_assert_cmpuint (test->n_declared, ==, 2);
+
+  dbus_connection_remove_filter (test->client_libdbus, declared_filter, test);
+  g_array_unref (contacts);
+}
+
 int
 main (int argc,
       char **argv)
@@ -395,6 +559,9 @@ main (int argc,
   g_test_add ("/conn/interest", Test, NULL, setup, test_interest, teardown);
   g_test_add ("/conn/interested-client", Test, NULL, setup,
       test_interested_client, teardown);
+  g_test_add ("/conn/contact-interest", Test, NULL, setup,
+      test_contact_interest, teardown);
+  g_test_add ("/conn/unicast", Test, NULL, setup, test_unicast, teardown);
 
   return tp_tests_run_with_bus ();
 }
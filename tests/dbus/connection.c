@@ -10,11 +10,16 @@
 
 #include "config.h"
 
+#include <string.h>
+
+#include <telepathy-glib/capabilities.h>
 #include <telepathy-glib/connection.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/proxy-subclass.h>
+#include <telepathy-glib/simple-client-factory.h>
+#include <telepathy-glib/util.h>
 
 #include "tests/lib/myassert.h"
 #include "tests/lib/simple-conn.h"
@@ -32,6 +37,12 @@ typedef struct {
     GError *cwr_error /* initialized in setup */;
 
     GAsyncResult *prepare_result;
+
+    /* only for tests where the service connection is bound to a worker
+     * thread's main context */
+    GMainContext *worker_context;
+    GMainLoop *worker_loop;
+    GThread *worker;
 } Test;
 
 static GError invalidated_for_test = { 0, TP_ERROR_PERMISSION_DENIED,
@@ -49,6 +60,17 @@ connection_prepared_cb (GObject *object,
   test->prepare_result = g_object_ref (res);
 }
 
+static gpointer
+worker_thread (gpointer data)
+{
+  Test *test = data;
+
+  g_main_context_push_thread_default (test->worker_context);
+  g_main_loop_run (test->worker_loop);
+  g_main_context_pop_thread_default (test->worker_context);
+  return NULL;
+}
+
 static void
 setup (Test *test,
     gconstpointer data)
@@ -60,11 +82,18 @@ setup (Test *test,
   tp_debug_set_flags ("all");
   test->dbus = tp_tests_dbus_daemon_dup_or_die ();
 
+  if (!tp_strdiff (data, "main-context"))
+    {
+      test->worker_context = g_main_context_new ();
+      test->worker_loop = g_main_loop_new (test->worker_context, FALSE);
+    }
+
   test->service_conn = TP_TESTS_SIMPLE_CONNECTION (
     tp_tests_object_new_static_class (
         TP_TESTS_TYPE_SIMPLE_CONNECTION,
         "account", "me@example.com",
         "protocol", "simple-protocol",
+        "main-context", test->worker_context,
         NULL));
   test->service_conn_as_base = TP_BASE_CONNECTION (test->service_conn);
   g_assert (test->service_conn != NULL);
@@ -74,6 +103,10 @@ setup (Test *test,
         &test->conn_name, &test->conn_path, &error));
   g_assert_no_error (error);
 
+  /* from now on, only the worker thread may use the service connection */
+  if (test->worker_loop != NULL)
+    test->worker = g_thread_new ("worker", worker_thread, test);
+
   test->cwr_ready = FALSE;
   test->cwr_error = NULL;
 }
@@ -103,8 +136,17 @@ teardown (Test *test,
   g_assert_error (error, TP_ERROR, TP_ERROR_CANCELLED);
   g_clear_error (&error);
 
+  if (test->worker != NULL)
+    {
+      g_main_loop_quit (test->worker_loop);
+      g_thread_join (test->worker);
+      test->worker = NULL;
+    }
+
   test->service_conn_as_base = NULL;
   g_object_unref (test->service_conn);
+  tp_clear_pointer (&test->worker_loop, g_main_loop_unref);
+  tp_clear_pointer (&test->worker_context, g_main_context_unref);
   g_free (test->conn_name);
   g_free (test->conn_path);
 
@@ -359,6 +401,282 @@ test_call_when_ready (Test *test,
   g_assert_no_error (test->cwr_error);
 }
 
+static void
+test_tracing (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  gchar *events;
+  gchar *report;
+
+  tp_debug_set_tracing (TRUE);
+
+  test->conn = tp_connection_new (test->dbus, test->conn_name, test->conn_path,
+      &error);
+  g_assert (test->conn != NULL);
+  g_assert_no_error (error);
+
+  tp_cli_connection_call_connect (test->conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (test->conn, NULL);
+
+  tp_debug_set_tracing (FALSE);
+
+  events = tp_debug_dup_trace_events ();
+  g_assert (g_str_has_prefix (events, "{\"traceEvents\":["));
+
+  /* we're both the client and the service; Connect() was called without a
+   * callback, so there's no client-side span for it */
+  g_assert (strstr (events, "{\"name\":\"" TP_IFACE_CONNECTION ".Connect\","
+        "\"cat\":\"service\",\"ph\":\"X\"") != NULL);
+  g_assert (strstr (events, "{\"name\":\"org.freedesktop.DBus.Properties"
+        ".GetAll\",\"cat\":\"client\",\"ph\":\"X\"") != NULL);
+  g_assert (strstr (events, "{\"name\":\"org.freedesktop.DBus.Properties"
+        ".GetAll\",\"cat\":\"service\",\"ph\":\"X\"") != NULL);
+  /* each proxy feature gets a span too */
+  g_assert (strstr (events, "{\"name\":\"TpConnection.tp-connection-feature-"
+        "core\",\"cat\":\"prepare\",\"ph\":\"X\"") != NULL);
+
+  g_free (events);
+
+  /* preparing the connection is what the test waited for, so it is on the
+   * critical path; the service side of the calls is not */
+  report = tp_debug_dup_trace_critical_path ();
+  g_assert (g_str_has_prefix (report, "critical path: "));
+  g_assert (strstr (report,
+        "  prepare TpConnection.tp-connection-feature-core") != NULL);
+  g_assert (strstr (report, "  service ") == NULL);
+  g_free (report);
+}
+
+static TpConnection *
+prepare_with_introspection_cache (Test *test)
+{
+  GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED,
+      TP_CONNECTION_FEATURE_CAPABILITIES, 0 };
+  TpSimpleClientFactory *factory = tp_simple_client_factory_new (test->dbus);
+  TpConnection *conn;
+  GError *error = NULL;
+
+  tp_simple_client_factory_set_introspection_cache_enabled (factory, TRUE);
+  conn = tp_simple_client_factory_ensure_connection (factory,
+      test->conn_path, NULL, &error);
+  g_assert_no_error (error);
+  g_object_unref (factory);
+
+  tp_cli_connection_call_connect (conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (conn, features);
+  g_assert (tp_connection_get_capabilities (conn) != NULL);
+  return conn;
+}
+
+static void
+test_introspection_cache (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  gchar *escaped = tp_escape_as_identifier (test->conn_path);
+  gchar *filename = g_build_filename (g_get_user_runtime_dir (),
+      "telepathy", "connections", escaped, NULL);
+  TpConnection *first;
+  TpConnection *second;
+  gchar *events;
+  const gchar *get_all;
+
+  first = prepare_with_introspection_cache (test);
+
+  /* the results are written out once introspection has settled down */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  g_assert (g_file_test (filename, G_FILE_TEST_IS_REGULAR));
+
+  /* a separate factory has its own TpConnection, like another process
+   * would; it only needs GetAll(Connection) to check that what the first
+   * one found out still applies */
+  tp_debug_set_tracing (TRUE);
+  second = prepare_with_introspection_cache (test);
+  tp_debug_set_tracing (FALSE);
+
+  g_assert (second != first);
+  g_assert (tp_capabilities_supports_text_chats (
+        tp_connection_get_capabilities (second)) ==
+      tp_capabilities_supports_text_chats (
+        tp_connection_get_capabilities (first)));
+
+  events = tp_debug_dup_trace_events ();
+  get_all = strstr (events, "{\"name\":\"org.freedesktop.DBus.Properties"
+        ".GetAll\",\"cat\":\"client\",\"ph\":\"X\"");
+  g_assert (get_all != NULL);
+  /* in particular, not GetAll(Contacts) */
+  g_assert (strstr (get_all + 1, "{\"name\":\"org.freedesktop.DBus."
+        "Properties.GetAll\",\"cat\":\"client\",\"ph\":\"X\"") == NULL);
+  g_assert (strstr (events, "{\"name\":\"org.freedesktop.DBus.Properties"
+        ".Get\",\"cat\":\"client\",\"ph\":\"X\"") == NULL);
+  g_free (events);
+
+  g_object_unref (second);
+  g_object_unref (first);
+  g_free (escaped);
+  g_free (filename);
+}
+
+typedef struct {
+    TpProxySignalConnection *sc;
+    guint calls;
+} FanOut;
+
+static void
+fan_out_status_changed_cb (TpConnection *conn G_GNUC_UNUSED,
+    guint status G_GNUC_UNUSED,
+    guint reason G_GNUC_UNUSED,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  FanOut *f = user_data;
+
+  f->calls++;
+
+  if (f->sc != NULL)
+    {
+      tp_proxy_signal_connection_disconnect (f->sc);
+      f->sc = NULL;
+    }
+}
+
+static void
+test_signal_fan_out (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  TpConnection *other;
+  FanOut first = { NULL, 0 };
+  FanOut second = { NULL, 0 };
+  FanOut third = { NULL, 0 };
+
+  test->conn = tp_connection_new (test->dbus, test->conn_name, test->conn_path,
+      &error);
+  g_assert (test->conn != NULL);
+  g_assert_no_error (error);
+
+  other = tp_connection_new (test->dbus, test->conn_name, test->conn_path,
+      &error);
+  g_assert (other != NULL);
+  g_assert_no_error (error);
+
+  /* two connections for the same signal on one proxy, and one on another
+   * proxy for the same object, all fed from the same D-Bus message; the
+   * first disconnects itself when it's called */
+  first.sc = tp_cli_connection_connect_to_status_changed (test->conn,
+      fan_out_status_changed_cb, &first, NULL, NULL, &error);
+  g_assert_no_error (error);
+  tp_cli_connection_connect_to_status_changed (test->conn,
+      fan_out_status_changed_cb, &second, NULL, NULL, &error);
+  g_assert_no_error (error);
+  tp_cli_connection_connect_to_status_changed (other,
+      fan_out_status_changed_cb, &third, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  /* Connecting, then Connected */
+  tp_cli_connection_call_connect (test->conn, -1, NULL, NULL, NULL, NULL);
+
+  while (second.calls < 2 || third.calls < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (first.calls, ==, 1);
+  g_assert_cmpuint (second.calls, ==, 2);
+  g_assert_cmpuint (third.calls, ==, 2);
+
+  g_object_unref (other);
+}
+
+typedef struct {
+    gboolean done;
+    gboolean saw_connect;
+    gboolean saw_status_changed;
+    guint n_bounds;
+} MetricsResult;
+
+static void
+got_metrics_cb (TpProxy *proxy G_GNUC_UNUSED,
+    const GPtrArray *methods,
+    const GPtrArray *signals,
+    const GArray *bounds,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  MetricsResult *result = user_data;
+  guint i;
+
+  g_assert_no_error (error);
+
+  for (i = 0; i < methods->len; i++)
+    {
+      GValueArray *va = g_ptr_array_index (methods, i);
+      GArray *histogram;
+
+      if (tp_strdiff (g_value_get_string (va->values + 0),
+            TP_IFACE_CONNECTION) ||
+          tp_strdiff (g_value_get_string (va->values + 1), "Connect"))
+        continue;
+
+      result->saw_connect = TRUE;
+      g_assert_cmpuint (g_value_get_uint (va->values + 2), ==, 1);
+      g_assert_cmpuint (g_value_get_uint (va->values + 3), ==, 0);
+      histogram = g_value_get_boxed (va->values + 4);
+      g_assert_cmpuint (histogram->len, ==, bounds->len + 1);
+    }
+
+  for (i = 0; i < signals->len; i++)
+    {
+      GValueArray *va = g_ptr_array_index (signals, i);
+
+      if (!tp_strdiff (g_value_get_string (va->values + 0),
+            TP_IFACE_CONNECTION) &&
+          !tp_strdiff (g_value_get_string (va->values + 1), "StatusChanged"))
+        {
+          result->saw_status_changed = TRUE;
+          g_assert_cmpuint (g_value_get_uint (va->values + 2), >, 0);
+        }
+    }
+
+  result->n_bounds = bounds->len;
+  result->done = TRUE;
+}
+
+static void
+test_metrics (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  GError *error = NULL;
+  MetricsResult result = { FALSE, FALSE, FALSE, 0 };
+
+  tp_debug_set_metrics (TRUE);
+
+  test->conn = tp_connection_new (test->dbus, test->conn_name, test->conn_path,
+      &error);
+  g_assert (test->conn != NULL);
+  g_assert_no_error (error);
+
+  tp_cli_connection_call_connect (test->conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (test->conn, NULL);
+
+  /* the statistics are for the whole process, but every connection is
+   * able to report them */
+  tp_proxy_add_interface_by_id ((TpProxy *) test->conn,
+      TP_IFACE_QUARK_METRICS1);
+  tp_cli_metrics1_call_get_metrics (test->conn, -1, got_metrics_cb,
+      &result, NULL, NULL);
+
+  while (!result.done)
+    g_main_context_iteration (NULL, TRUE);
+
+  tp_debug_set_metrics (FALSE);
+
+  g_assert (result.saw_connect);
+  g_assert (result.saw_status_changed);
+  g_assert_cmpuint (result.n_bounds, >, 0);
+}
+
 static void
 test_call_when_invalid (Test *test,
     gconstpointer nil G_GNUC_UNUSED)
@@ -425,12 +743,123 @@ test_object_path (Test *test,
   g_clear_error (&error);
 }
 
+static void
+test_main_context (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  TpDBusDaemon *service_dbus;
+  GError *error = NULL;
+
+  g_assert (tp_base_connection_get_main_context (
+        test->service_conn_as_base) == test->worker_context);
+
+  /* the service connection has a bus connection of its own, which the
+   * worker thread dispatches */
+  service_dbus = tp_base_connection_get_dbus_daemon (
+      test->service_conn_as_base);
+  g_assert (service_dbus != test->dbus);
+  g_assert_cmpstr (tp_dbus_daemon_get_unique_name (service_dbus), !=,
+      tp_dbus_daemon_get_unique_name (test->dbus));
+
+  /* preparing the client side needs the worker thread to reply to method
+   * calls, since this thread never dispatches the worker's context */
+  test->conn = tp_connection_new (test->dbus, test->conn_name, test->conn_path,
+      &error);
+  g_assert (test->conn != NULL);
+  g_assert_no_error (error);
+
+  tp_tests_proxy_run_until_prepared (test->conn, NULL);
+  g_assert_cmpstr (tp_connection_get_protocol_name (test->conn), ==,
+      "simple-protocol");
+  g_assert_cmpuint (tp_connection_get_status (test->conn, NULL), ==,
+      TP_CONNECTION_STATUS_DISCONNECTED);
+}
+
+typedef struct {
+    guint n_calls;
+    guint repeat;
+    gboolean notified;
+} TimeoutData;
+
+static gboolean
+timeout_cb (gpointer p)
+{
+  TimeoutData *data = p;
+
+  data->n_calls++;
+  return (data->n_calls < data->repeat);
+}
+
+static void
+timeout_notify_cb (gpointer p)
+{
+  TimeoutData *data = p;
+
+  g_assert (!data->notified);
+  data->notified = TRUE;
+}
+
+static void
+test_timeouts (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  TimeoutData once = { 0, 1, FALSE };
+  TimeoutData thrice = { 0, 3, FALSE };
+  TimeoutData removed = { 0, 1, FALSE };
+  TimeoutData pending = { 0, 1, FALSE };
+  gint64 start = g_get_monotonic_time ();
+  TpBaseConnection *other;
+  guint id;
+
+  tp_base_connection_add_timeout (test->service_conn_as_base, 20,
+      timeout_cb, &once, timeout_notify_cb);
+  tp_base_connection_add_timeout (test->service_conn_as_base, 10,
+      timeout_cb, &thrice, timeout_notify_cb);
+  id = tp_base_connection_add_timeout (test->service_conn_as_base, 10,
+      timeout_cb, &removed, timeout_notify_cb);
+  g_assert_cmpuint (id, !=, 0);
+
+  tp_base_connection_remove_timeout (test->service_conn_as_base, id);
+  g_assert (removed.notified);
+
+  while (!once.notified || !thrice.notified)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* never early */
+  g_assert_cmpint (g_get_monotonic_time () - start, >=, 30 * 1000);
+  g_assert_cmpuint (once.n_calls, ==, 1);
+  g_assert_cmpuint (thrice.n_calls, ==, 3);
+  g_assert_cmpuint (removed.n_calls, ==, 0);
+
+  /* disposing a connection removes the rest */
+  other = tp_tests_object_new_static_class (TP_TESTS_TYPE_SIMPLE_CONNECTION,
+      "account", "you@example.com",
+      "protocol", "simple-protocol",
+      NULL);
+  tp_base_connection_add_timeout (other, 60 * 1000, timeout_cb, &pending,
+      timeout_notify_cb);
+  g_object_unref (other);
+  g_assert (pending.notified);
+  g_assert_cmpuint (pending.n_calls, ==, 0);
+}
+
 int
 main (int argc,
       char **argv)
 {
+  gchar *dir;
+  GError *error = NULL;
+
   tp_tests_init (&argc, &argv);
 
+  /* Make sure g_get_user_runtime_dir() returns a tmp directory, so the
+   * introspection cache doesn't end up in the user's. */
+  dir = g_dir_make_tmp ("tp-glib-tests-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_setenv ("XDG_RUNTIME_DIR", dir, TRUE);
+  g_assert_cmpstr (g_get_user_runtime_dir (), ==, dir);
+  g_free (dir);
+
   g_test_add ("/conn/prepare", Test, NULL, setup, test_prepare, teardown);
   g_test_add ("/conn/fail_to_prepare", Test, NULL, setup, test_fail_to_prepare,
       teardown);
@@ -444,6 +873,18 @@ main (int argc,
       test_call_when_invalid, teardown);
   g_test_add ("/conn/object_path", Test, NULL, setup,
       test_object_path, teardown);
+  g_test_add ("/conn/tracing", Test, NULL, setup,
+      test_tracing, teardown);
+  g_test_add ("/conn/introspection-cache", Test, NULL, setup,
+      test_introspection_cache, teardown);
+  g_test_add ("/conn/metrics", Test, NULL, setup,
+      test_metrics, teardown);
+  g_test_add ("/conn/signal_fan_out", Test, NULL, setup,
+      test_signal_fan_out, teardown);
+  g_test_add ("/conn/timeouts", Test, NULL, setup,
+      test_timeouts, teardown);
+  g_test_add ("/conn/main-context", Test, "main-context", setup,
+      test_main_context, teardown);
 
   return tp_tests_run_with_bus ();
 }
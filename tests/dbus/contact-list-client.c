@@ -387,9 +387,15 @@ test_blocked_contacts (Test *test,
   alice = g_ptr_array_index (test->blocked_removed, 0);
   g_assert (TP_IS_CONTACT (alice));
   g_assert_cmpstr (tp_contact_get_identifier (alice), ==, "alice");
+  g_assert (!tp_contact_is_blocked (alice));
 
+  /* the contacts that were blocked to start with are still there */
   blocked = tp_connection_get_blocked_contacts (test->connection);
   g_assert_cmpuint (blocked->len, == , 2);
+  g_assert (g_ptr_array_index (blocked, 0) != alice);
+  g_assert (g_ptr_array_index (blocked, 1) != alice);
+  g_assert (tp_contact_is_blocked (g_ptr_array_index (blocked, 0)));
+  g_assert (tp_contact_is_blocked (g_ptr_array_index (blocked, 1)));
 }
 
 static void
@@ -557,6 +563,423 @@ test_contact_list_properties (Test *test,
   g_ptr_array_unref (contacts);
 }
 
+static void
+alias_notify_cb (GObject *object,
+    GParamSpec *pspec,
+    Test *test)
+{
+  g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_contact_index (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  TpContactFeature alias = TP_CONTACT_FEATURE_ALIAS;
+  TpContactIndex *index;
+  GPtrArray *contacts;
+  GPtrArray *found;
+  GHashTable *aliases;
+  TpContact *geraldine;
+
+  tp_simple_client_factory_add_contact_features (
+      tp_proxy_get_factory (test->connection), 1, &alias);
+
+  tp_proxy_prepare_async (test->connection, conn_features,
+      proxy_prepare_cb, test);
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  index = tp_contact_index_new (test->connection);
+  g_assert (tp_contact_index_get_connection (index) == test->connection);
+
+  contacts = tp_connection_dup_contact_list (test->connection);
+  g_assert_cmpuint (contacts->len, >, 0);
+  g_assert_cmpuint (tp_contact_index_get_n_contacts (index), ==,
+      contacts->len);
+  g_ptr_array_unref (contacts);
+
+  /* case and accents are ignored, and results are sorted by alias */
+  found = tp_contact_index_search (index, "G", 0);
+  g_assert_cmpuint (found->len, ==, 2);
+  g_assert_cmpstr (tp_contact_get_identifier (
+        g_ptr_array_index (found, 0)), ==, "geraldine@example.com");
+  g_assert_cmpstr (tp_contact_get_identifier (
+        g_ptr_array_index (found, 1)), ==, "guillaume@example.com");
+  geraldine = g_object_ref (g_ptr_array_index (found, 0));
+  g_ptr_array_unref (found);
+
+  found = tp_contact_index_search (index, "GÉR", 0);
+  g_assert_cmpuint (found->len, ==, 1);
+  g_assert (g_ptr_array_index (found, 0) == geraldine);
+  g_ptr_array_unref (found);
+
+  /* a word in the middle of the identifier matches, after any aliases */
+  found = tp_contact_index_search (index, "example.c", 3);
+  g_assert_cmpuint (found->len, ==, 3);
+  g_ptr_array_unref (found);
+
+  found = tp_contact_index_search (index, "nobody", 0);
+  g_assert_cmpuint (found->len, ==, 0);
+  g_ptr_array_unref (found);
+
+  /* the index follows alias changes */
+  aliases = g_hash_table_new (NULL, NULL);
+  g_hash_table_insert (aliases,
+      GUINT_TO_POINTER (tp_contact_get_handle (geraldine)), "Zelda Zoe");
+  g_signal_connect (geraldine, "notify::alias",
+      G_CALLBACK (alias_notify_cb), test);
+  tp_cli_connection_interface_aliasing_call_set_aliases (test->connection,
+      -1, aliases, NULL, NULL, NULL, NULL);
+  g_main_loop_run (test->mainloop);
+  g_signal_handlers_disconnect_by_func (geraldine, alias_notify_cb, test);
+  g_hash_table_unref (aliases);
+
+  found = tp_contact_index_search (index, "zelda z", 0);
+  g_assert_cmpuint (found->len, ==, 1);
+  g_assert (g_ptr_array_index (found, 0) == geraldine);
+  g_ptr_array_unref (found);
+
+  found = tp_contact_index_search (index, "zoe", 0);
+  g_assert_cmpuint (found->len, ==, 1);
+  g_ptr_array_unref (found);
+
+  found = tp_contact_index_search (index, "ger", 0);
+  g_assert_cmpuint (found->len, ==, 1);
+  /* still found by identifier */
+  g_assert (g_ptr_array_index (found, 0) == geraldine);
+  g_ptr_array_unref (found);
+
+  g_object_unref (geraldine);
+  g_object_unref (index);
+}
+
+static void
+groups_notify_cb (GObject *object,
+    GParamSpec *pspec,
+    Test *test)
+{
+  g_main_loop_quit (test->mainloop);
+}
+
+static gboolean
+contacts_include (GPtrArray *contacts,
+    const gchar *id)
+{
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      if (!tp_strdiff (tp_contact_get_identifier (
+              g_ptr_array_index (contacts, i)), id))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+test_contact_list_queries (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONTACT_LIST,
+      TP_CONNECTION_FEATURE_CONTACT_GROUPS, 0 };
+  TpContactFeature features[] = { TP_CONTACT_FEATURE_SUBSCRIPTION_STATES,
+      TP_CONTACT_FEATURE_CONTACT_GROUPS };
+  TpContactListIter iter;
+  TpContact *contact;
+  TpContact *sjoerd = NULL;
+  GPtrArray *contacts;
+  const gchar *groups[] = { NULL };
+  guint n = 0;
+
+  tp_simple_client_factory_add_contact_features (
+      tp_proxy_get_factory (test->connection), G_N_ELEMENTS (features),
+      features);
+
+  tp_proxy_prepare_async (test->connection, conn_features,
+      proxy_prepare_cb, test);
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  /* iterating borrows the same contacts that would be copied */
+  contacts = tp_connection_dup_contact_list (test->connection);
+  tp_connection_contact_list_iter_init (&iter, test->connection);
+
+  while (tp_contact_list_iter_next (&iter, &contact))
+    {
+      g_assert (contacts_include (contacts,
+            tp_contact_get_identifier (contact)));
+
+      if (!tp_strdiff (tp_contact_get_identifier (contact),
+            "sjoerd@example.com"))
+        sjoerd = g_object_ref (contact);
+
+      n++;
+    }
+
+  g_assert_cmpuint (n, ==, contacts->len);
+  g_assert (sjoerd != NULL);
+  g_ptr_array_unref (contacts);
+
+  contacts = tp_connection_dup_contacts_by_subscribe_state (test->connection,
+      TP_SUBSCRIPTION_STATE_YES);
+  g_assert_cmpuint (contacts->len, ==, 4);
+  g_assert (contacts_include (contacts, "sjoerd@example.com"));
+  g_assert (contacts_include (contacts, "travis@example.com"));
+  g_ptr_array_unref (contacts);
+
+  contacts = tp_connection_dup_contacts_by_subscribe_state (test->connection,
+      TP_SUBSCRIPTION_STATE_ASK);
+  g_assert_cmpuint (contacts->len, ==, 2);
+  g_assert (contacts_include (contacts, "geraldine@example.com"));
+  g_assert (contacts_include (contacts, "helen@example.com"));
+  g_ptr_array_unref (contacts);
+
+  contacts = tp_connection_dup_contacts_by_publish_state (test->connection,
+      TP_SUBSCRIPTION_STATE_ASK);
+  g_assert_cmpuint (contacts->len, ==, 2);
+  g_assert (contacts_include (contacts, "wim@example.com"));
+  g_assert (contacts_include (contacts, "christian@example.com"));
+  g_ptr_array_unref (contacts);
+
+  contacts = tp_connection_dup_contacts_in_group (test->connection,
+      "Cambridge");
+  g_assert_cmpuint (contacts->len, ==, 4);
+  g_assert (contacts_include (contacts, "sjoerd@example.com"));
+  g_assert (contacts_include (contacts, "guillaume@example.com"));
+  g_assert (contacts_include (contacts, "geraldine@example.com"));
+  g_assert (contacts_include (contacts, "helen@example.com"));
+  g_ptr_array_unref (contacts);
+
+  contacts = tp_connection_dup_contacts_in_group (test->connection,
+      "No such group");
+  g_assert_cmpuint (contacts->len, ==, 0);
+  g_ptr_array_unref (contacts);
+
+  /* the indexes follow changes to the contacts */
+  g_signal_connect (sjoerd, "notify::contact-groups",
+      G_CALLBACK (groups_notify_cb), test);
+  tp_cli_connection_interface_contact_groups_call_set_contact_groups (
+      test->connection, -1, tp_contact_get_handle (sjoerd), groups,
+      NULL, NULL, NULL, NULL);
+  g_main_loop_run (test->mainloop);
+  g_signal_handlers_disconnect_by_func (sjoerd, groups_notify_cb, test);
+
+  contacts = tp_connection_dup_contacts_in_group (test->connection,
+      "Cambridge");
+  g_assert_cmpuint (contacts->len, ==, 3);
+  g_assert (!contacts_include (contacts, "sjoerd@example.com"));
+  g_ptr_array_unref (contacts);
+
+  g_object_unref (sjoerd);
+}
+
+static gint
+alias_cmp (gconstpointer a,
+    gconstpointer b,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  return g_strcmp0 (tp_contact_get_alias ((TpContact *) a),
+      tp_contact_get_alias ((TpContact *) b));
+}
+
+static gboolean
+not_zed_filter (TpContact *contact,
+    gpointer user_data G_GNUC_UNUSED)
+{
+  return !g_str_has_prefix (tp_contact_get_alias (contact), "Z");
+}
+
+static void
+view_inserted_cb (TpContactView *view,
+    TpContact *contact,
+    guint position,
+    GPtrArray *rows)
+{
+  g_assert_cmpuint (position, <=, rows->len);
+
+  /* g_ptr_array_insert() is too new */
+  g_ptr_array_add (rows, NULL);
+  memmove (rows->pdata + position + 1, rows->pdata + position,
+      (rows->len - 1 - position) * sizeof (gpointer));
+  g_ptr_array_index (rows, position) = contact;
+}
+
+static void
+view_removed_cb (TpContactView *view,
+    TpContact *contact,
+    guint position,
+    GPtrArray *rows)
+{
+  g_assert_cmpuint (position, <, rows->len);
+  g_assert (g_ptr_array_index (rows, position) == contact);
+  g_ptr_array_remove_index (rows, position);
+}
+
+static void
+view_moved_cb (TpContactView *view,
+    TpContact *contact,
+    guint old_position,
+    guint new_position,
+    GPtrArray *rows)
+{
+  view_removed_cb (view, contact, old_position, rows);
+  view_inserted_cb (view, contact, new_position, rows);
+}
+
+static void
+contacts_changed_cb (TpConnection *connection,
+    GPtrArray *contacts,
+    TpContactFeature feature,
+    Test *test)
+{
+  if (feature == TP_CONTACT_FEATURE_ALIAS)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+assert_view_matches (TpContactView *view,
+    GPtrArray *rows)
+{
+  GPtrArray *contacts = tp_contact_view_dup_contacts (view);
+  guint i;
+
+  g_assert_cmpuint (contacts->len, ==, rows->len);
+  g_assert_cmpuint (tp_contact_view_get_n_contacts (view), ==, rows->len);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+
+      g_assert (g_ptr_array_index (rows, i) == contact);
+      g_assert (tp_contact_view_get_contact (view, i) == contact);
+      g_assert_cmpint (tp_contact_view_get_position (view, contact), ==, i);
+      g_assert (!g_str_has_prefix (tp_contact_get_alias (contact), "Z"));
+
+      if (i > 0)
+        g_assert_cmpint (alias_cmp (g_ptr_array_index (contacts, i - 1),
+              contact, NULL), <=, 0);
+    }
+
+  g_ptr_array_unref (contacts);
+}
+
+static void
+set_aliases_and_wait (Test *test,
+    TpContact *first,
+    const gchar *first_alias,
+    TpContact *second,
+    const gchar *second_alias)
+{
+  GHashTable *aliases = g_hash_table_new (NULL, NULL);
+
+  g_hash_table_insert (aliases,
+      GUINT_TO_POINTER (tp_contact_get_handle (first)),
+      (gchar *) first_alias);
+  g_hash_table_insert (aliases,
+      GUINT_TO_POINTER (tp_contact_get_handle (second)),
+      (gchar *) second_alias);
+  tp_cli_connection_interface_aliasing_call_set_aliases (test->connection,
+      -1, aliases, NULL, NULL, NULL, NULL);
+  g_main_loop_run (test->mainloop);
+  g_hash_table_unref (aliases);
+}
+
+static void
+test_contact_view (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  TpContactFeature alias = TP_CONTACT_FEATURE_ALIAS;
+  TpContactView *view;
+  GPtrArray *contacts;
+  GPtrArray *rows;
+  TpContact *geraldine = NULL;
+  TpContact *guillaume = NULL;
+  guint i;
+
+  tp_simple_client_factory_add_contact_features (
+      tp_proxy_get_factory (test->connection), 1, &alias);
+
+  tp_proxy_prepare_async (test->connection, conn_features,
+      proxy_prepare_cb, test);
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  view = tp_contact_view_new (test->connection, alias_cmp, not_zed_filter,
+      NULL, NULL);
+  g_assert (tp_contact_view_get_connection (view) == test->connection);
+
+  /* nobody is filtered out yet */
+  contacts = tp_connection_dup_contact_list (test->connection);
+  g_assert_cmpuint (tp_contact_view_get_n_contacts (view), ==,
+      contacts->len);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+
+      if (!tp_strdiff (tp_contact_get_identifier (contact),
+            "geraldine@example.com"))
+        geraldine = g_object_ref (contact);
+      else if (!tp_strdiff (tp_contact_get_identifier (contact),
+            "guillaume@example.com"))
+        guillaume = g_object_ref (contact);
+    }
+
+  g_assert (geraldine != NULL);
+  g_assert (guillaume != NULL);
+
+  /* a mirror of the view, maintained from its signals only */
+  rows = g_ptr_array_new ();
+  g_ptr_array_unref (contacts);
+  contacts = tp_contact_view_dup_contacts (view);
+
+  for (i = 0; i < contacts->len; i++)
+    g_ptr_array_add (rows, g_ptr_array_index (contacts, i));
+
+  assert_view_matches (view, rows);
+  g_signal_connect (view, "contact-inserted",
+      G_CALLBACK (view_inserted_cb), rows);
+  g_signal_connect (view, "contact-removed",
+      G_CALLBACK (view_removed_cb), rows);
+  g_signal_connect (view, "contact-moved",
+      G_CALLBACK (view_moved_cb), rows);
+
+  /* both changes arrive in one batch: one contact moves to the top, the
+   * other one is filtered out */
+  tp_connection_set_contact_notification_batching (test->connection, TRUE);
+  g_signal_connect (test->connection, "contacts-changed",
+      G_CALLBACK (contacts_changed_cb), test);
+  set_aliases_and_wait (test, geraldine, "Aaron", guillaume, "Zebedee");
+
+  assert_view_matches (view, rows);
+  g_assert_cmpint (tp_contact_view_get_position (view, geraldine), ==, 0);
+  g_assert_cmpint (tp_contact_view_get_position (view, guillaume), ==, -1);
+  g_assert_cmpuint (rows->len, ==, contacts->len - 1);
+
+  set_aliases_and_wait (test, geraldine, "Yvonne", guillaume, "Guillaume");
+
+  assert_view_matches (view, rows);
+  g_assert_cmpint (tp_contact_view_get_position (view, geraldine), ==,
+      rows->len - 1);
+  g_assert_cmpint (tp_contact_view_get_position (view, guillaume), >=, 0);
+  g_assert_cmpuint (rows->len, ==, contacts->len);
+
+  g_signal_handlers_disconnect_by_func (test->connection,
+      contacts_changed_cb, test);
+  g_ptr_array_unref (contacts);
+  g_ptr_array_unref (rows);
+  g_object_unref (geraldine);
+  g_object_unref (guillaume);
+  g_object_unref (view);
+}
+
 int
 main (int argc,
       char **argv)
@@ -580,5 +1003,12 @@ main (int argc,
   g_test_add ("/contact-list-client/contact-list/properties", Test,
       GUINT_TO_POINTER (TRUE), setup, test_contact_list_properties, teardown);
 
+  g_test_add ("/contact-list-client/contact-list/queries", Test, NULL,
+      setup, test_contact_list_queries, teardown);
+  g_test_add ("/contact-list-client/contact-list/index", Test, NULL,
+      setup, test_contact_index, teardown);
+  g_test_add ("/contact-list-client/contact-list/view", Test, NULL,
+      setup, test_contact_view, teardown);
+
   return tp_tests_run_with_bus ();
 }
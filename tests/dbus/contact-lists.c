@@ -10,6 +10,7 @@
 
 #include "config.h"
 
+#include <telepathy-glib/base-contact-list.h>
 #include <telepathy-glib/connection.h>
 
 #include "examples/cm/contactlist/conn.h"
@@ -343,11 +344,29 @@ setup_pre_connect (
         "account", account,
         "simulation-delay", 0,
         "protocol", "example-contact-list",
+        "lazy-group-channels", !tp_strdiff (data, "lazy"),
         NULL);
   test->service_conn_as_base = TP_BASE_CONNECTION (test->service_conn);
   g_assert (test->service_conn != NULL);
   g_assert (test->service_conn_as_base != NULL);
 
+  if (!tp_strdiff (data, "time-slice"))
+    {
+      TpChannelManagerIter iter;
+      TpChannelManager *manager;
+
+      tp_base_connection_channel_manager_iter_init (&iter,
+          test->service_conn_as_base);
+
+      while (tp_base_connection_channel_manager_iter_next (&iter, &manager))
+        {
+          if (TP_IS_BASE_CONTACT_LIST (manager))
+            g_object_set (manager,
+                "time-slice", 1,
+                NULL);
+        }
+    }
+
   g_assert (tp_base_connection_register (test->service_conn_as_base, "example",
         &test->conn_name, &test->conn_path, &error));
   g_assert_no_error (error);
@@ -690,37 +709,41 @@ expect_cambridge_once_cb (TpConnection *conn,
     GObject *weak_object G_GNUC_UNUSED)
 {
   Test *test = user_data;
-  GValueArray *va;
-  const gchar *object_path;
-  GHashTable *properties;
-
-  g_assert_cmpuint (channels->len, ==, 1);
-  va = g_ptr_array_index (channels, 0);
-  object_path = g_value_get_boxed (va->values + 0);
-  properties = g_value_get_boxed (va->values + 1);
-
-  if (tp_asv_get_uint32 (properties, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, NULL)
-      != TP_HANDLE_TYPE_GROUP ||
-      tp_strdiff (tp_asv_get_string (properties, TP_PROP_CHANNEL_CHANNEL_TYPE),
-        TP_IFACE_CHANNEL_TYPE_CONTACT_LIST) ||
-      tp_strdiff (tp_asv_get_string (properties, TP_PROP_CHANNEL_TARGET_ID),
-        "Cambridge"))
+  guint i;
+
+  /* channels announced together are signalled together, so the groups
+   * created when the contact list arrives may all be in one signal */
+  for (i = 0; i < channels->len; i++)
     {
-      /* either this is not a ContactList, or it's a LIST ContactList,
-       * or it's one of the other groups - Montreal or Francophones.
-       * Either way, it's not interesting right now. */
-      DEBUG ("NewChannels not for Cambridge group, ignoring");
-      return;
+      GValueArray *va = g_ptr_array_index (channels, i);
+      const gchar *object_path = g_value_get_boxed (va->values + 0);
+      GHashTable *properties = g_value_get_boxed (va->values + 1);
+
+      if (tp_asv_get_uint32 (properties, TP_PROP_CHANNEL_TARGET_HANDLE_TYPE,
+            NULL) != TP_HANDLE_TYPE_GROUP ||
+          tp_strdiff (tp_asv_get_string (properties,
+              TP_PROP_CHANNEL_CHANNEL_TYPE),
+            TP_IFACE_CHANNEL_TYPE_CONTACT_LIST) ||
+          tp_strdiff (tp_asv_get_string (properties,
+              TP_PROP_CHANNEL_TARGET_ID),
+            "Cambridge"))
+        {
+          /* either this is not a ContactList, or it's a LIST ContactList,
+           * or it's one of the other groups - Montreal or Francophones.
+           * Either way, it's not interesting right now. */
+          DEBUG ("NewChannels not for Cambridge group, ignoring");
+          continue;
+        }
+
+      DEBUG ("NewChannels for Cambridge group");
+      /* the Cambridge group should only be created once (fd.o #52011) */
+      g_assert (test->group == NULL);
+
+      test->group = tp_simple_client_factory_ensure_channel (
+          tp_proxy_get_factory (conn),
+          conn, object_path, properties, &test->error);
+      g_assert_no_error (test->error);
     }
-
-  DEBUG ("NewChannels for Cambridge group");
-  /* the Cambridge group should only be created once (fd.o #52011) */
-  g_assert (test->group == NULL);
-
-  test->group = tp_simple_client_factory_ensure_channel (
-      tp_proxy_get_factory (conn),
-      conn, object_path, properties, &test->error);
-  g_assert_no_error (test->error);
 }
 
 static void
@@ -1032,6 +1055,58 @@ test_contact_list_attrs (Test *test,
         GUINT_TO_POINTER (test->ninja)) == NULL);
 }
 
+static void
+test_contact_list_attrs_after_change (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  const gchar * const interfaces[] = { NULL };
+  GHashTable *first;
+  GError *error = NULL;
+
+  test->publish = test_ensure_channel (test, TP_HANDLE_TYPE_LIST, "publish");
+
+  tp_connection_get_contact_list_attributes (test->conn, -1,
+      interfaces, FALSE, contact_attrs_cb, test, test_quit_loop, NULL);
+  g_main_loop_run (test->main_loop);
+  first = g_hash_table_ref (test->contact_attributes);
+
+  /* asking again without any change in between gives the same answer */
+  tp_connection_get_contact_list_attributes (test->conn, -1,
+      interfaces, FALSE, contact_attrs_cb, test, test_quit_loop, NULL);
+  g_main_loop_run (test->main_loop);
+  g_assert_cmpuint (g_hash_table_size (test->contact_attributes), ==,
+      g_hash_table_size (first));
+  test_assert_contact_list_attrs (test, test->wim,
+      TP_SUBSCRIPTION_STATE_NO, TP_SUBSCRIPTION_STATE_ASK,
+      "I'm more metal than you!");
+  test_assert_contact_list_attrs (test, test->sjoerd,
+      TP_SUBSCRIPTION_STATE_YES, TP_SUBSCRIPTION_STATE_YES, NULL);
+  g_hash_table_unref (first);
+
+  /* a change and a removal are both reflected in the next answer */
+  g_array_append_val (test->arr, test->wim);
+  tp_cli_connection_interface_contact_list_run_authorize_publication (
+      test->conn, -1, test->arr, &error, NULL);
+  g_assert_no_error (error);
+
+  g_array_set_size (test->arr, 0);
+  g_array_append_val (test->arr, test->sjoerd);
+  tp_cli_connection_interface_contact_list_run_remove_contacts (test->conn,
+      -1, test->arr, &error, NULL);
+  g_assert_no_error (error);
+
+  tp_connection_get_contact_list_attributes (test->conn, -1,
+      interfaces, FALSE, contact_attrs_cb, test, test_quit_loop, NULL);
+  g_main_loop_run (test->main_loop);
+
+  test_assert_contact_list_attrs (test, test->wim,
+      TP_SUBSCRIPTION_STATE_NO, TP_SUBSCRIPTION_STATE_YES, NULL);
+  test_assert_contact_list_attrs (test, test->helen,
+      TP_SUBSCRIPTION_STATE_ASK, TP_SUBSCRIPTION_STATE_NO, NULL);
+  g_assert (g_hash_table_lookup (test->contact_attributes,
+        GUINT_TO_POINTER (test->sjoerd)) == NULL);
+}
+
 static void
 test_assert_contact_blocking_attrs (Test *test,
     TpHandle handle,
@@ -2198,6 +2273,144 @@ test_remove_group_empty (Test *test,
   test_assert_one_group_removed (test, 1, "people who understand const in C");
 }
 
+static void
+count_group_channel_cb (TpExportableChannel *channel,
+    gpointer user_data)
+{
+  guint *n = user_data;
+  TpHandleType handle_type;
+
+  g_object_get (channel,
+      "handle-type", &handle_type,
+      NULL);
+
+  if (handle_type == TP_HANDLE_TYPE_GROUP)
+    (*n)++;
+}
+
+/* Returns the number of group channels that the service has created */
+static guint
+test_count_group_channels (Test *test)
+{
+  TpChannelManagerIter iter;
+  TpChannelManager *manager;
+  guint n = 0;
+
+  tp_base_connection_channel_manager_iter_init (&iter,
+      test->service_conn_as_base);
+
+  while (tp_base_connection_channel_manager_iter_next (&iter, &manager))
+    {
+      if (TP_IS_BASE_CONTACT_LIST (manager))
+        tp_channel_manager_foreach_channel (manager, count_group_channel_cb,
+            &n);
+    }
+
+  return n;
+}
+
+static void
+test_lazy_groups (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  GValue *value = NULL;
+  const gchar * const *groups;
+  TpChannel *again;
+
+  /* the groups exist, but there are no channels for them yet */
+  tp_cli_dbus_properties_run_get (test->conn, -1,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS, "Groups", &value,
+      &test->error, NULL);
+  g_assert_no_error (test->error);
+  groups = g_value_get_boxed (value);
+  g_assert (tp_strv_contains (groups, "Cambridge"));
+  tp_g_value_slice_free (value);
+
+  g_assert_cmpuint (test_count_group_channels (test), ==, 0);
+
+  /* asking for one creates it, with the group's members */
+  test->group = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP,
+      "Cambridge");
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+  g_assert_cmpuint (
+      tp_intset_size (tp_channel_group_get_members (test->group)), ==, 4);
+  g_assert (tp_intset_is_member (tp_channel_group_get_members (test->group),
+        test->sjoerd));
+  g_assert (tp_intset_is_member (tp_channel_group_get_members (test->group),
+        test->helen));
+
+  /* and after that, the same channel is returned */
+  again = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP, "Cambridge");
+  g_assert_cmpstr (tp_proxy_get_object_path (again), ==,
+      tp_proxy_get_object_path (test->group));
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+  g_object_unref (again);
+
+  /* it's kept up to date like any other group channel */
+  g_array_append_val (test->arr, test->ninja);
+  tp_cli_connection_interface_contact_groups_run_add_to_group (test->conn,
+      -1, "Cambridge", test->arr, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (tp_intset_is_member (tp_channel_group_get_members (test->group),
+        test->ninja));
+}
+
+static void
+test_lazy_groups_close (Test *test,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  const gchar *name = "people who understand const in C";
+
+  /* an empty group can be created by asking for its channel, and deleted by
+   * closing it */
+  test->group = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP, name);
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+  test_assert_one_group_created (test, 0, name);
+
+  tp_cli_channel_run_close (test->group, -1, &test->error, NULL);
+  g_assert_no_error (test->error);
+  tp_tests_proxy_run_until_dbus_queue_processed (test->conn);
+  g_assert (tp_proxy_get_invalidated (test->group) != NULL);
+  g_assert_cmpuint (test_count_group_channels (test), ==, 0);
+  test_assert_one_group_removed (test, 1, name);
+  g_clear_object (&test->group);
+
+  /* asking again makes a new group and channel */
+  test->group = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP, name);
+  g_assert (tp_proxy_get_invalidated (test->group) == NULL);
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+  test_assert_one_group_created (test, 2, name);
+  g_clear_object (&test->group);
+  test_clear_log (test);
+
+  /* removing a group with a channel closes the channel */
+  test->group = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP,
+      "Cambridge");
+  tp_cli_connection_interface_contact_groups_run_remove_group (test->conn,
+      -1, "Cambridge", &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (tp_proxy_get_invalidated (test->group) != NULL);
+  g_clear_object (&test->group);
+  /* only the empty group's channel is left */
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+
+  /* when the group comes back, it has no channel until one is requested */
+  g_array_append_val (test->arr, test->sjoerd);
+  tp_cli_connection_interface_contact_groups_run_add_to_group (test->conn,
+      -1, "Cambridge", test->arr, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (test_count_group_channels (test), ==, 1);
+
+  test->group = test_ensure_channel (test, TP_HANDLE_TYPE_GROUP,
+      "Cambridge");
+  g_assert (tp_proxy_get_invalidated (test->group) == NULL);
+  g_assert_cmpuint (test_count_group_channels (test), ==, 2);
+  g_assert_cmpuint (
+      tp_intset_size (tp_channel_group_get_members (test->group)), ==, 1);
+  g_assert (tp_intset_is_member (tp_channel_group_get_members (test->group),
+        test->sjoerd));
+}
+
 static void
 test_set_contact_groups (Test *test,
     gconstpointer nil G_GNUC_UNUSED)
@@ -2605,6 +2818,20 @@ test_request_blocked_contacts (Test *test,
   g_assert_cmpstr (tp_handle_inspect (test->contact_repo, test->bill), ==,
       g_hash_table_lookup (blocked_contacts, GUINT_TO_POINTER (test->bill)));
   g_hash_table_unref (blocked_contacts);
+
+  /* the reply is remembered, but not once blocking changes */
+  g_array_append_val (test->arr, test->bill);
+  tp_cli_connection_interface_contact_blocking_run_unblock_contacts (
+      test->conn, -1, test->arr, &error, NULL);
+  g_assert_no_error (error);
+
+  tp_cli_connection_interface_contact_blocking_run_request_blocked_contacts (
+      test->conn, -1, &blocked_contacts, &error, NULL);
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_hash_table_size (blocked_contacts), ==, 1);
+  g_assert (g_hash_table_lookup (blocked_contacts,
+        GUINT_TO_POINTER (test->bill)) == NULL);
+  g_hash_table_unref (blocked_contacts);
 }
 
 static void
@@ -2753,8 +2980,14 @@ main (int argc,
       Test, NULL, setup, test_properties, teardown);
   g_test_add ("/contact-lists/contacts",
       Test, NULL, setup, test_contacts, teardown);
+  g_test_add ("/contact-lists/contacts/time-slice",
+      Test, "time-slice", setup, test_contacts, teardown);
   g_test_add ("/contact-lists/contact-list-attrs",
       Test, NULL, setup, test_contact_list_attrs, teardown);
+  g_test_add ("/contact-lists/contact-list-attrs/time-slice",
+      Test, "time-slice", setup, test_contact_list_attrs, teardown);
+  g_test_add ("/contact-lists/contact-list-attrs/after-change",
+      Test, NULL, setup, test_contact_list_attrs_after_change, teardown);
   g_test_add ("/contact-lists/contact-blocking-attrs",
       Test, NULL, setup, test_contact_blocking_attrs, teardown);
 
@@ -2860,6 +3093,11 @@ main (int argc,
   g_test_add ("/contact-lists/remove-group/empty/old",
       Test, "old", setup, test_remove_group_empty, teardown);
 
+  g_test_add ("/contact-lists/lazy-groups",
+      Test, "lazy", setup, test_lazy_groups, teardown);
+  g_test_add ("/contact-lists/lazy-groups/close",
+      Test, "lazy", setup, test_lazy_groups_close, teardown);
+
   g_test_add ("/contact-lists/set_contact_groups",
       Test, NULL, setup, test_set_contact_groups, teardown);
   g_test_add ("/contact-lists/set_contact_groups/no-op",
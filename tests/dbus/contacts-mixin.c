@@ -13,7 +13,9 @@
 #include <telepathy-glib/connection.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
+#include <telepathy-glib/gtypes.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/util.h>
 
 #include "tests/lib/contacts-conn.h"
 #include "tests/lib/debug.h"
@@ -130,6 +132,232 @@ test_features (TpTestsContactsConnection *service_conn,
   g_hash_table_unref (contacts);
 }
 
+static void
+test_duplicates (TpTestsContactsConnection *service_conn,
+                 TpConnection *client_conn,
+                 GArray *handles)
+{
+  const gchar *interfaces[] = {
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+      NULL };
+  GArray *some = g_array_new (FALSE, FALSE, sizeof (guint));
+  guint invalid = 31337;
+  GError *error = NULL;
+  GHashTable *contacts;
+  GHashTable *attrs;
+
+  g_message (G_STRFUNC);
+
+  /* the same contact twice, and one that doesn't exist */
+  g_array_append_val (some, g_array_index (handles, guint, 1));
+  g_array_append_val (some, invalid);
+  g_array_append_val (some, g_array_index (handles, guint, 1));
+
+  MYASSERT (tp_cli_connection_interface_contacts_run_get_contact_attributes (
+        client_conn, -1, some, interfaces, FALSE, &contacts, &error, NULL),
+      "");
+  g_assert_no_error (error);
+  g_assert_cmpuint (g_hash_table_size (contacts), ==, 1);
+
+  attrs = g_hash_table_lookup (contacts,
+      GUINT_TO_POINTER (g_array_index (handles, guint, 1)));
+  MYASSERT (attrs != NULL, "");
+  g_assert_cmpstr (
+      tp_asv_get_string (attrs, TP_IFACE_CONNECTION "/contact-id"), ==,
+      "bob");
+  g_assert_cmpstr (
+      tp_asv_get_string (attrs,
+          TP_IFACE_CONNECTION_INTERFACE_ALIASING "/alias"), ==,
+      "Bob the Builder");
+  /* only the interfaces that were asked for */
+  g_assert (tp_asv_lookup (attrs,
+        TP_IFACE_CONNECTION_INTERFACE_AVATARS "/token") == NULL);
+
+  g_hash_table_unref (contacts);
+  g_array_unref (some);
+}
+
+static void
+capabilities_changed_cb (TpConnection *conn,
+    GHashTable *caps,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  GHashTable **changed = user_data;
+
+  g_assert (*changed == NULL);
+  *changed = g_boxed_copy (TP_HASH_TYPE_CONTACT_CAPABILITIES_MAP, caps);
+}
+
+static void
+test_capability_sets (TpTestsContactsConnection *service_conn,
+    TpConnection *client_conn,
+    GArray *handles)
+{
+  TpBaseConnection *base = TP_BASE_CONNECTION (service_conn);
+  GPtrArray *classes = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+  GHashTable *fixed = tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+        TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
+        TP_HANDLE_TYPE_CONTACT,
+      NULL);
+  const gchar * const allowed[] = { NULL };
+  GHashTable *changed = NULL;
+  GHashTable *caps;
+  GPtrArray *alice, *bob;
+  GError *error = NULL;
+
+  g_message (G_STRFUNC);
+
+  g_ptr_array_add (classes, tp_value_array_build (2,
+        TP_HASH_TYPE_CHANNEL_CLASS, fixed,
+        G_TYPE_STRV, allowed,
+        G_TYPE_INVALID));
+
+  g_assert (!tp_base_connection_has_capability_set (base, "text"));
+  tp_base_connection_add_capability_set (base, "text", classes);
+  g_assert (tp_base_connection_has_capability_set (base, "text"));
+
+  tp_cli_connection_interface_contact_capabilities_connect_to_contact_capabilities_changed (
+      client_conn, capabilities_changed_cb, &changed, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  tp_base_connection_set_contacts_capability_set (base, handles, "text");
+
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* one signal for all of them */
+  g_assert_cmpuint (g_hash_table_size (changed), ==, 3);
+  g_hash_table_unref (changed);
+
+  /* they all share the same set */
+  caps = tp_base_connection_dup_contact_capabilities (base, handles);
+  g_assert_cmpuint (g_hash_table_size (caps), ==, 3);
+  alice = g_hash_table_lookup (caps,
+      GUINT_TO_POINTER (g_array_index (handles, guint, 0)));
+  bob = g_hash_table_lookup (caps,
+      GUINT_TO_POINTER (g_array_index (handles, guint, 1)));
+  g_assert (alice != NULL);
+  g_assert (alice == bob);
+  g_assert (alice != classes);
+  g_assert_cmpuint (alice->len, ==, 1);
+  g_hash_table_unref (caps);
+
+  /* and they keep it, however often they're told */
+  changed = NULL;
+  tp_base_connection_set_contacts_capability_set (base, handles, "text");
+  tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+  g_assert (changed == NULL);
+
+  tp_base_connection_set_contacts_capability_set (base, handles, NULL);
+
+  while (changed == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_hash_table_unref (changed);
+
+  caps = tp_base_connection_dup_contact_capabilities (base, handles);
+  g_assert_cmpuint (g_hash_table_size (caps), ==, 0);
+  g_hash_table_unref (caps);
+
+  g_hash_table_unref (fixed);
+  g_ptr_array_unref (classes);
+}
+
+/* Fill the aliases of @handles and @n_total - @handles->len synthetic
+ * contacts with @max_threads threads, and check that it matches the serial
+ * fill */
+static void
+assert_threaded_fill (TpTestsContactsConnection *service_conn,
+    GArray *handles,
+    guint n_total,
+    guint max_threads)
+{
+  const gchar *interfaces[] = { TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+      NULL };
+  const gchar *assumed[] = { TP_IFACE_CONNECTION, NULL };
+  GObject *object = (GObject *) service_conn;
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
+  GArray *many = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  GHashTable *serial, *threaded;
+  guint i;
+
+  g_assert_cmpuint (n_total, >=, handles->len);
+
+  for (i = 0; i < n_total - handles->len; i++)
+    {
+      gchar *id = g_strdup_printf ("contact%u", i);
+      TpHandle handle = tp_handle_ensure (service_repo, id, NULL, NULL);
+
+      g_array_append_val (many, handle);
+      g_free (id);
+    }
+
+  g_array_append_vals (many, handles->data, handles->len);
+
+  serial = tp_contacts_mixin_get_contact_attributes (object, many,
+      interfaces, assumed, NULL);
+
+  tp_contacts_mixin_set_contact_attributes_thread_safe (object,
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING);
+  tp_contacts_mixin_set_fill_threaded (object, max_threads);
+  threaded = tp_contacts_mixin_get_contact_attributes (object, many,
+      interfaces, assumed, NULL);
+  tp_contacts_mixin_set_fill_threaded (object, 0);
+
+  g_assert_cmpuint (g_hash_table_size (threaded), ==, many->len);
+  g_assert_cmpuint (g_hash_table_size (serial), ==, many->len);
+
+  for (i = 0; i < many->len; i++)
+    {
+      gpointer key = GUINT_TO_POINTER (g_array_index (many, TpHandle, i));
+      GHashTable *expected = g_hash_table_lookup (serial, key);
+      GHashTable *attrs = g_hash_table_lookup (threaded, key);
+
+      g_assert (attrs != NULL);
+      g_assert_cmpuint (g_hash_table_size (attrs), ==, 2);
+      g_assert_cmpstr (
+          tp_asv_get_string (attrs, TP_IFACE_CONNECTION "/contact-id"), ==,
+          tp_asv_get_string (expected, TP_IFACE_CONNECTION "/contact-id"));
+      g_assert_cmpstr (
+          tp_asv_get_string (attrs,
+              TP_IFACE_CONNECTION_INTERFACE_ALIASING "/alias"), ==,
+          tp_asv_get_string (expected,
+              TP_IFACE_CONNECTION_INTERFACE_ALIASING "/alias"));
+    }
+
+  /* the real aliases are still there, after the synthetic contacts */
+  g_assert_cmpstr (tp_asv_get_string (
+        g_hash_table_lookup (threaded,
+          GUINT_TO_POINTER (g_array_index (handles, TpHandle, 0))),
+        TP_IFACE_CONNECTION_INTERFACE_ALIASING "/alias"), ==,
+      "Alice in Wonderland");
+
+  g_hash_table_unref (threaded);
+  g_hash_table_unref (serial);
+  g_array_unref (many);
+}
+
+static void
+test_threaded_fill (TpTestsContactsConnection *service_conn,
+    TpConnection *client_conn,
+    GArray *handles)
+{
+  g_message (G_STRFUNC);
+
+  /* enough to be split between several threads */
+  assert_threaded_fill (service_conn, handles, 2000, 3);
+
+  /* with more threads than that, the number of chunks is limited by the
+   * number of contacts instead, and rounding each chunk's size up would
+   * put the last one past the end */
+  assert_threaded_fill (service_conn, handles, 66305, 300);
+}
+
 int
 main (int argc,
       char **argv)
@@ -204,6 +432,9 @@ main (int argc,
 
   test_no_features (service_conn, client_conn, handles);
   test_features (service_conn, client_conn, handles);
+  test_duplicates (service_conn, client_conn, handles);
+  test_capability_sets (service_conn, client_conn, handles);
+  test_threaded_fill (service_conn, client_conn, handles);
 
   /* Teardown */
 
@@ -29,6 +29,7 @@
 #include <telepathy-glib/contact.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
+#include <telepathy-glib/util.h>
 
 #include "tests/lib/contacts-conn.h"
 #include "tests/lib/broken-client-types-conn.h"
@@ -172,6 +173,32 @@ reset_result (Result *result)
   g_clear_error (&result->error);
 }
 
+/* Check that the borrowed list has the same fields as a copy */
+static void
+assert_peek_contact_info (TpContact *contact)
+{
+  GList *copy = tp_contact_dup_contact_info (contact);
+  const GList *l;
+  GList *m;
+
+  for (l = tp_contact_peek_contact_info (contact), m = copy;
+      l != NULL && m != NULL;
+      l = l->next, m = m->next)
+    {
+      TpContactInfoField *peeked = l->data;
+      TpContactInfoField *copied = m->data;
+
+      g_assert (peeked != copied);
+      g_assert_cmpstr (peeked->field_name, ==, copied->field_name);
+      tp_tests_assert_strv_equals (peeked->parameters, copied->parameters);
+      tp_tests_assert_strv_equals (peeked->field_value, copied->field_value);
+    }
+
+  g_assert (l == NULL);
+  g_assert (m == NULL);
+  tp_contact_info_list_free (copy);
+}
+
 static void
 contact_info_verify (TpContact *contact)
 {
@@ -179,6 +206,7 @@ contact_info_verify (TpContact *contact)
   TpContactInfoField *field;
 
   g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_CONTACT_INFO));
+  assert_peek_contact_info (contact);
 
   info = tp_contact_get_contact_info (contact);
   g_assert (info != NULL);
@@ -307,6 +335,50 @@ contact_info_request_cancel (gpointer cancellable)
   return FALSE;
 }
 
+typedef struct {
+    GMainLoop *loop;
+    guint pending;
+} BatchInfoResult;
+
+static void
+contact_info_request_many_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  BatchInfoResult *result = user_data;
+  GHashTable *failures = NULL;
+  GError *error = NULL;
+
+  tp_connection_request_contact_info_finish (TP_CONNECTION (object), res,
+      &failures, &error);
+  g_assert_no_error (error);
+  g_assert (failures != NULL);
+  g_assert_cmpuint (g_hash_table_size (failures), ==, 0);
+  g_hash_table_unref (failures);
+
+  if (--result->pending == 0)
+    g_main_loop_quit (result->loop);
+}
+
+static void
+contact_info_request_many_cancelled_cb (GObject *object,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  BatchInfoResult *result = user_data;
+  GHashTable *failures = NULL;
+  GError *error = NULL;
+
+  tp_connection_request_contact_info_finish (TP_CONNECTION (object), res,
+      &failures, &error);
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert (failures == NULL);
+  g_clear_error (&error);
+
+  if (--result->pending == 0)
+    g_main_loop_quit (result->loop);
+}
+
 static void
 test_contact_info (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
@@ -320,10 +392,16 @@ test_contact_info (Fixture *f,
   TpContact *contact;
   TpHandle handle;
   const gchar *field_value[] = { "Foo", NULL };
-  GPtrArray *info;
+  const gchar *other_field_value[] = { "Bar", NULL };
+  GPtrArray *info, *other_info;
+  const TpContactInfoField *field;
   GList *info_list = NULL;
   GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONTACT_INFO, 0 };
   GCancellable *cancellable;
+  BatchInfoResult many = { NULL, 0 };
+  TpHandle handles[20];
+  TpContact *contacts[21];
+  guint i;
 
   /* Create fake info fields */
   info = g_ptr_array_new_with_free_func ((GDestroyNotify) tp_value_array_free);
@@ -400,6 +478,26 @@ test_contact_info (Fixture *f,
   g_main_loop_run (result.loop);
   g_assert_no_error (result.error);
 
+  /* changing it again replaces the list that we can borrow */
+  g_signal_handlers_disconnect_by_func (contact, contact_info_notify_cb,
+      &result);
+  other_info = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) tp_value_array_free);
+  g_ptr_array_add (other_info, tp_value_array_build (3,
+      G_TYPE_STRING, "n",
+      G_TYPE_STRV, NULL,
+      G_TYPE_STRV, other_field_value,
+      G_TYPE_INVALID));
+  tp_tests_contacts_connection_change_contact_info (service_conn, handle,
+      other_info);
+  tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+
+  g_assert (tp_contact_peek_contact_info (contact) != NULL);
+  field = tp_contact_peek_contact_info (contact)->data;
+  g_assert_cmpstr (field->field_value[0], ==, "Bar");
+  assert_peek_contact_info (contact);
+  g_ptr_array_unref (other_info);
+
   reset_result (&result);
   tp_handle_unref (service_repo, handle);
 
@@ -478,6 +576,64 @@ test_contact_info (Fixture *f,
   reset_result (&result);
   tp_handle_unref (service_repo, handle);
 
+  /* TEST7: Request the info of many contacts at once, twice, with the same
+   * contact appearing more than once. The requests are shared, and each
+   * contact has its info when the operations finish. */
+  many.loop = result.loop;
+
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    {
+      gchar *id = g_strdup_printf ("info-test-7-%u", i);
+
+      handles[i] = tp_handle_ensure (service_repo, id, NULL, NULL);
+      g_free (id);
+    }
+
+  tp_connection_get_contacts_by_handle (client_conn,
+      G_N_ELEMENTS (handles), handles,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+  g_assert_cmpuint (result.contacts->len, ==, G_N_ELEMENTS (handles));
+
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    {
+      contacts[i] = g_ptr_array_index (result.contacts, i);
+      g_assert (tp_contact_get_contact_info (contacts[i]) == NULL);
+    }
+
+  contacts[G_N_ELEMENTS (handles)] = contacts[0];
+
+  tp_connection_request_contact_info_async (client_conn,
+      G_N_ELEMENTS (contacts), contacts, NULL,
+      contact_info_request_many_cb, &many);
+  tp_connection_request_contact_info_async (client_conn, 5, contacts, NULL,
+      contact_info_request_many_cb, &many);
+  many.pending = 2;
+  g_main_loop_run (result.loop);
+
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    contact_info_verify (contacts[i]);
+
+  /* cancelling one operation does not affect the other one */
+  cancellable = g_cancellable_new ();
+  tp_connection_request_contact_info_async (client_conn,
+      G_N_ELEMENTS (contacts), contacts, cancellable,
+      contact_info_request_many_cancelled_cb, &many);
+  tp_connection_request_contact_info_async (client_conn, 5, contacts, NULL,
+      contact_info_request_many_cb, &many);
+  many.pending = 2;
+  g_idle_add_full (G_PRIORITY_HIGH, contact_info_request_cancel,
+      cancellable, g_object_unref);
+  g_main_loop_run (result.loop);
+
+  reset_result (&result);
+
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    tp_handle_unref (service_repo, handles[i]);
+
   /* Cleanup */
   g_main_loop_unref (result.loop);
   g_ptr_array_unref (info);
@@ -739,355 +895,1202 @@ test_avatar_data_after_token (Fixture *f,
 }
 
 static void
-test_by_handle (Fixture *f,
+request_avatar_data_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  Result *result = user_data;
+
+  tp_contact_request_avatar_data_finish (TP_CONTACT (source), res,
+      &result->error);
+  finish (result);
+}
+
+static void
+test_avatar_data_lazy (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
-  TpTestsContactsConnection *service_conn = f->service_conn;
-  TpConnection *client_conn = f->client_conn;
   Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  TpHandle handles[5] = { 0, 0, 0, 0, 0 };
-  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
-      (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
-  TpContact *contacts[4];
-  gpointer weak_pointers[4];
-  guint i;
+  const gchar avatar_data[] = "lazy-avatar-data";
+  TpContactFeature feature = TP_CONTACT_FEATURE_AVATAR_DATA;
+  gboolean avatar_retrieved_called = FALSE;
+  TpProxySignalConnection *signal_id;
+  TpContact *contact;
+  TpHandle handle;
+  GArray *array;
+  gchar *content = NULL;
 
   g_message (G_STRFUNC);
 
-  /* arrange for some handles to exist */
-  handles[0] = tp_handle_ensure (service_repo, "alice", NULL, NULL);
-  MYASSERT (handles[0] != 0, "");
-  handles[1] = tp_handle_ensure (service_repo, "bob", NULL, NULL);
-  MYASSERT (handles[1] != 0, "");
-  /* randomly guess at a handle that shouldn't exist */
-  handles[2] = 31337;
-  MYASSERT (!tp_handle_is_valid (service_repo, 31337, NULL), "");
-  /* another valid handle */
-  handles[3] = tp_handle_ensure (service_repo, "chris", NULL, NULL);
-  MYASSERT (handles[3] != 0, "");
-  /* another invalid handle */
-  handles[4] = 12345;
-  MYASSERT (!tp_handle_is_valid (service_repo, 12345, NULL), "");
+  tp_connection_set_lazy_avatar_data (f->client_conn, TRUE);
 
-  /* Make a request for the following 5 contacts:
-   * - alice
-   * - bob
-   * - invalid handle 31337
-   * - chris
-   * - invalid handle 12345
-   */
-  tp_connection_get_contacts_by_handle (client_conn,
-      5, handles,
-      0, NULL,
+  signal_id = tp_cli_connection_interface_avatars_connect_to_avatar_retrieved (
+      f->client_conn, avatar_retrieved_cb, &avatar_retrieved_called, NULL,
+      NULL, &result.error);
+  g_assert_no_error (result.error);
+
+  array = g_array_new (FALSE, FALSE, sizeof (gchar));
+  g_array_append_vals (array, avatar_data, strlen (avatar_data) + 1);
+  handle = tp_handle_ensure (f->service_repo, "lazy-avatar", NULL, NULL);
+  tp_tests_contacts_connection_change_avatar_data (f->service_conn, handle,
+      array, "image/png", "lazy-avatar-token");
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      1, &feature,
       by_handle_cb,
       &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
+  g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_AVATAR_DATA));
+  g_assert_cmpstr (tp_contact_get_avatar_token (contact), ==,
+      "lazy-avatar-token");
+
+  /* nobody asked for it, so it isn't downloaded */
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert (!avatar_retrieved_called);
+  g_assert (tp_contact_get_avatar_file (contact) == NULL);
 
+  /* now somebody does */
+  reset_result (&result);
+  tp_contact_request_avatar_data_async (contact, request_avatar_data_cb,
+      &result);
   g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
 
-  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
-  MYASSERT (result.invalid->len == 2, ": %u", result.invalid->len);
+  g_assert (avatar_retrieved_called);
+  g_assert_cmpstr (tp_contact_get_avatar_mime_type (contact), ==,
+      "image/png");
+  g_assert (tp_contact_get_avatar_file (contact) != NULL);
+  g_file_load_contents (tp_contact_get_avatar_file (contact), NULL,
+      &content, NULL, NULL, &result.error);
   g_assert_no_error (result.error);
+  g_assert_cmpstr (content, ==, avatar_data);
 
-  MYASSERT (g_ptr_array_index (result.contacts, 0) != NULL, "");
-  MYASSERT (g_ptr_array_index (result.contacts, 1) != NULL, "");
-  MYASSERT (g_ptr_array_index (result.contacts, 2) != NULL, "");
-  contacts[0] = g_object_ref (g_ptr_array_index (result.contacts, 0));
-  g_assert_cmpuint (tp_contact_get_handle (contacts[0]), ==, handles[0]);
-  g_assert_cmpstr (tp_contact_get_identifier (contacts[0]), ==, "alice");
-  contacts[1] = g_object_ref (g_ptr_array_index (result.contacts, 1));
-  g_assert_cmpuint (tp_contact_get_handle (contacts[1]), ==, handles[1]);
-  g_assert_cmpstr (tp_contact_get_identifier (contacts[1]), ==, "bob");
-  contacts[3] = g_object_ref (g_ptr_array_index (result.contacts, 2));
-  g_assert_cmpuint (tp_contact_get_handle (contacts[3]), ==, handles[3]);
-  g_assert_cmpstr (tp_contact_get_identifier (contacts[3]), ==, "chris");
+  /* asking again is answered from the cache */
+  avatar_retrieved_called = FALSE;
+  tp_contact_request_avatar_data_async (contact, request_avatar_data_cb,
+      &result);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+  g_assert (!avatar_retrieved_called);
 
-  /* clean up before doing the second request */
+  tp_proxy_signal_connection_disconnect (signal_id);
+  g_free (content);
+  g_object_unref (contact);
+  tp_handle_unref (f->service_repo, handle);
+  g_array_unref (array);
   reset_result (&result);
-  g_assert (result.error == NULL);
+  g_main_loop_unref (result.loop);
+}
 
-  /* Replace one of the invalid handles with a valid one */
-  handles[2] = tp_handle_ensure (service_repo, "dora", NULL, NULL);
-  MYASSERT (handles[2] != 0, "");
+static void
+avatar_file_retrieved_cb (TpConnection *connection,
+    guint handle,
+    const gchar *token,
+    const gchar *path,
+    const gchar *mime_type,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  gchar **path_out = user_data;
 
-  /* Make a request for the following 4 contacts:
-   * - alice (TpContact exists)
-   * - bob (TpContact exists)
-   * - dora (TpContact needs to be created)
-   * - chris (TpContact exists)
-   */
-  tp_connection_get_contacts_by_handle (client_conn,
-      4, handles,
-      0, NULL,
-      by_handle_cb,
-      &result, finish, NULL);
+  g_free (*path_out);
+  *path_out = g_strdup (path);
+}
 
-  g_main_loop_run (result.loop);
+static void
+test_avatar_data_files (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  const gchar avatar_data[] = "avatar-data-in-a-file";
+  TpContactFeature feature = TP_CONTACT_FEATURE_AVATAR_DATA;
+  gboolean avatar_retrieved_called = FALSE;
+  gchar *avatar_path = NULL;
+  TpProxySignalConnection *signal_id, *file_signal_id;
+  TpContact *contact;
+  TpHandle handle;
+  GArray *array;
+  gchar *content = NULL;
 
-  /* assert that we got the same contacts back */
+  g_message (G_STRFUNC);
 
-  MYASSERT (result.contacts->len == 4, ": %u", result.contacts->len);
-  MYASSERT (result.invalid->len == 0, ": %u", result.invalid->len);
-  g_assert_no_error (result.error);
+  tp_base_connection_set_avatar_file_threshold (f->base_connection, 1);
 
-  /* 0, 1 and 3 we already have a reference to */
-  MYASSERT (g_ptr_array_index (result.contacts, 0) == contacts[0], "");
-  g_object_unref (g_ptr_array_index (result.contacts, 0));
-  MYASSERT (g_ptr_array_index (result.contacts, 1) == contacts[1], "");
-  g_object_unref (g_ptr_array_index (result.contacts, 1));
-  MYASSERT (g_ptr_array_index (result.contacts, 3) == contacts[3], "");
-  g_object_unref (g_ptr_array_index (result.contacts, 3));
+  signal_id = tp_cli_connection_interface_avatars_connect_to_avatar_retrieved (
+      f->client_conn, avatar_retrieved_cb, &avatar_retrieved_called, NULL,
+      NULL, &result.error);
+  g_assert_no_error (result.error);
+  file_signal_id =
+      tp_cli_connection_interface_avatars_connect_to_avatar_file_retrieved (
+          f->client_conn, avatar_file_retrieved_cb, &avatar_path, NULL,
+          NULL, &result.error);
+  g_assert_no_error (result.error);
 
-  /* 2 we don't */
-  contacts[2] = g_ptr_array_index (result.contacts, 2);
-  g_assert_cmpuint (tp_contact_get_handle (contacts[2]), ==, handles[2]);
-  g_assert_cmpstr (tp_contact_get_identifier (contacts[2]), ==, "dora");
+  array = g_array_new (FALSE, FALSE, sizeof (gchar));
+  g_array_append_vals (array, avatar_data, strlen (avatar_data) + 1);
+  handle = tp_handle_ensure (f->service_repo, "avatar-in-a-file", NULL, NULL);
+  tp_tests_contacts_connection_change_avatar_data (f->service_conn, handle,
+      array, "image/png", "avatar-in-a-file-token");
 
-  g_ptr_array_unref (result.contacts);
-  result.contacts = NULL;
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      1, &feature,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
 
-  /* clean up refs to contacts and assert that they aren't leaked */
+  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
 
-  for (i = 0; i < 4; i++)
-    {
-      weak_pointers[i] = contacts[i];
-      g_object_add_weak_pointer ((GObject *) contacts[i],weak_pointers +i);
-    }
+  while (tp_contact_get_avatar_file (contact) == NULL)
+    g_main_context_iteration (NULL, TRUE);
 
-  for (i = 0; i < 4; i++)
-    {
-      g_object_unref (contacts[i]);
-      MYASSERT (weak_pointers[i] == NULL, ": %u", i);
-    }
+  /* TpContact asked for avatars in files, so it was not sent inline */
+  g_assert (!avatar_retrieved_called);
+  g_assert (avatar_path != NULL);
+  g_assert (g_file_test (avatar_path, G_FILE_TEST_IS_REGULAR));
 
-  /* wait for ReleaseHandles to run */
-  tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+  g_assert_cmpstr (tp_contact_get_avatar_mime_type (contact), ==,
+      "image/png");
+  g_file_load_contents (tp_contact_get_avatar_file (contact), NULL,
+      &content, NULL, NULL, &result.error);
+  g_assert_no_error (result.error);
+  g_assert_cmpstr (content, ==, avatar_data);
 
-  /* remaining cleanup */
-  g_assert (result.error == NULL);
+  tp_proxy_signal_connection_disconnect (signal_id);
+  tp_proxy_signal_connection_disconnect (file_signal_id);
+  g_free (avatar_path);
+  g_free (content);
+  g_object_unref (contact);
+  tp_handle_unref (f->service_repo, handle);
+  g_array_unref (array);
   reset_result (&result);
   g_main_loop_unref (result.loop);
 }
 
-/* Silently removes the TpBaseConnection object from D-Bus, so that if the test
- * makes any D-Bus calls on it, it will fail (but the TpConnection proxy isn't
- * invalidated otherwise)
- */
+/* A TpBaseAvatars which "downloads" the avatars that the test set with
+ * tp_tests_contacts_connection_change_avatar_data(), in an idle */
+typedef struct {
+    TpBaseAvatars parent;
+    TpTestsContactsConnection *service_conn;
+    /* GArray of TpHandle, the batches passed to fetch_avatars */
+    GPtrArray *batches;
+    GArray *pending;
+    guint idle_id;
+} TestAvatars;
+
+typedef struct {
+    TpBaseAvatarsClass parent_class;
+} TestAvatarsClass;
+
+static GType test_avatars_get_type (void);
+
+G_DEFINE_TYPE (TestAvatars, test_avatars, TP_TYPE_BASE_AVATARS)
+
 static void
-make_the_connection_disappear (Fixture *f)
+test_avatars_init (TestAvatars *self)
 {
-  GError *error = NULL;
-  gboolean ok;
+  self->batches = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) g_array_unref);
+  self->pending = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+}
 
-  tp_dbus_daemon_unregister_object (
-      tp_base_connection_get_dbus_daemon (f->base_connection),
-      f->base_connection);
-  /* check that that worked */
-  ok = tp_cli_connection_run_get_self_handle (f->client_conn, -1, NULL,
-      &error, NULL);
-  g_assert_error (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD);
-  g_assert (!ok);
-  g_clear_error (&error);
+static void
+test_avatars_finalize (GObject *object)
+{
+  TestAvatars *self = (TestAvatars *) object;
+
+  g_assert_cmpuint (self->idle_id, ==, 0);
+  g_ptr_array_unref (self->batches);
+  g_array_unref (self->pending);
+
+  G_OBJECT_CLASS (test_avatars_parent_class)->finalize (object);
+}
+
+static gboolean
+test_avatars_download_cb (gpointer user_data)
+{
+  TestAvatars *self = user_data;
+  guint i;
+
+  self->idle_id = 0;
+
+  for (i = 0; i < self->pending->len; i++)
+    {
+      TpHandle handle = g_array_index (self->pending, TpHandle, i);
+      const gchar *mime_type, *token;
+      GArray *data = tp_tests_contacts_connection_get_avatar_data (
+          self->service_conn, handle, &mime_type, &token);
+
+      if (data != NULL)
+        tp_base_avatars_avatar_fetched (user_data, handle, token, data,
+            mime_type);
+      else
+        tp_base_avatars_fetch_failed (user_data, handle);
+    }
+
+  g_array_set_size (self->pending, 0);
+  return FALSE;
 }
 
-/* Returns the TpBaseConnection to D-Bus (after a previous call to
- * make_the_connection_disappear())
- */
 static void
-put_the_connection_back (Fixture *f)
+test_avatars_fetch_avatars (TpBaseAvatars *avatars,
+    const GArray *contacts)
 {
-  GError *error = NULL;
-  gboolean ok;
+  TestAvatars *self = (TestAvatars *) avatars;
+  GArray *batch = g_array_new (FALSE, FALSE, sizeof (TpHandle));
 
-  tp_dbus_daemon_register_object (
-      tp_base_connection_get_dbus_daemon (f->base_connection),
-      tp_base_connection_get_object_path (f->base_connection),
-      f->base_connection);
-  /* check that *that* worked */
-  ok = tp_cli_connection_run_get_self_handle (f->client_conn, -1, NULL,
-      &error, NULL);
-  g_assert_no_error (error);
-  g_assert (ok);
+  g_array_append_vals (batch, contacts->data, contacts->len);
+  g_ptr_array_add (self->batches, batch);
+  g_array_append_vals (self->pending, contacts->data, contacts->len);
+
+  if (self->idle_id == 0)
+    self->idle_id = g_idle_add (test_avatars_download_cb, self);
 }
 
-static TpHandle
-get_handle_with_no_caps (Fixture *f,
-    const gchar *id)
+static void
+test_avatars_class_init (TestAvatarsClass *klass)
 {
-  TpHandle handle;
-  GHashTable *capabilities;
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  TpBaseAvatarsClass *avatars_class = TP_BASE_AVATARS_CLASS (klass);
 
-  handle = tp_handle_ensure (f->service_repo, id, NULL, NULL);
-  g_assert_cmpuint (handle, !=, 0);
+  object_class->finalize = test_avatars_finalize;
+  avatars_class->fetch_avatars = test_avatars_fetch_avatars;
+}
 
-  /* Unlike almost every other feature, with capabilities “not sure” and “none”
-   * are different: you really might care about the difference between “I don't
-   * know if blah can do video” versus “I know blah cannot do video”.
-   *
-   * It happens that we get the repeated-reintrospection behaviour for the
-   * former case of contact caps. I can't really be bothered to fix this.
-   */
-  capabilities = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) g_ptr_array_unref);
-  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handle),
-      g_ptr_array_new ());
-  tp_tests_contacts_connection_change_capabilities (f->service_conn,
-      capabilities);
-  g_hash_table_unref (capabilities);
+static void
+avatar_retrieved_record_cb (TpConnection *connection,
+    guint handle,
+    const gchar *token,
+    const GArray *avatar,
+    const gchar *mime_type,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GArray *retrieved = user_data;
 
-  return handle;
+  g_array_append_val (retrieved, handle);
 }
 
 static void
-test_by_handle_again (Fixture *f,
+request_base_avatars (Fixture *f,
+    GArray *retrieved,
+    guint n,
+    const TpHandle *handles,
+    guint n_expected)
+{
+  GArray *array = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+
+  g_array_append_vals (array, handles, n);
+  g_array_set_size (retrieved, 0);
+
+  tp_cli_connection_interface_avatars_call_request_avatars (f->client_conn,
+      -1, array, NULL, NULL, NULL, NULL);
+
+  while (retrieved->len < n_expected)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* nothing else is on its way */
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (retrieved->len, ==, n_expected);
+
+  g_array_unref (array);
+}
+
+static gboolean
+handles_contain (GArray *handles,
+    TpHandle handle)
+{
+  guint i;
+
+  for (i = 0; i < handles->len; i++)
+    {
+      if (g_array_index (handles, TpHandle, i) == handle)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+test_base_avatars (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
-  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  TpHandle handle;
-  TpContact *contact;
-  gpointer weak_pointer;
-  const gchar *alias = "Alice in Wonderland";
+  const gchar *ids[] = { "base-avatars-1", "base-avatars-2",
+      "base-avatars-3", "base-avatars-4", "base-avatars-5" };
+  const gchar *tokens[] = { "base-avatars-shared", "base-avatars-shared",
+      "base-avatars-3", "base-avatars-4", "base-avatars-5" };
+  GArray *retrieved = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  TpProxySignalConnection *signal_id;
+  TestAvatars *avatars;
+  TpHandle handles[G_N_ELEMENTS (ids)];
+  TpHandle request[4];
+  GArray *batch;
+  GError *error = NULL;
+  guint i;
 
-  g_test_bug ("25181");
+  g_message (G_STRFUNC);
 
-  handle = get_handle_with_no_caps (f, "alice");
-  tp_tests_contacts_connection_change_aliases (f->service_conn, 1, &handle,
-      &alias);
+  avatars = g_object_new (test_avatars_get_type (),
+      "connection", f->base_connection,
+      NULL);
+  avatars->service_conn = f->service_conn;
+  tp_tests_contacts_connection_set_base_avatars (f->service_conn,
+      TP_BASE_AVATARS (avatars));
+  g_assert (tp_base_avatars_get_connection (TP_BASE_AVATARS (avatars)) ==
+      f->base_connection);
 
-  tp_connection_get_contacts_by_handle (f->client_conn,
-      1, &handle,
-      G_N_ELEMENTS (all_contact_features), all_contact_features,
-      by_handle_cb,
-      &result, finish, NULL);
-  g_main_loop_run (result.loop);
-  g_assert_cmpuint (result.contacts->len, ==, 1);
-  g_assert_cmpuint (result.invalid->len, ==, 0);
-  g_assert_no_error (result.error);
+  for (i = 0; i < G_N_ELEMENTS (ids); i++)
+    {
+      GArray *data = g_array_new (FALSE, FALSE, sizeof (gchar));
 
-  g_assert (g_ptr_array_index (result.contacts, 0) != NULL);
-  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
-  g_assert_cmpuint (tp_contact_get_handle (contact), ==, handle);
-  g_assert_cmpstr (tp_contact_get_identifier (contact), ==, "alice");
-  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+      g_array_append_vals (data, tokens[i], strlen (tokens[i]));
+      handles[i] = tp_handle_ensure (f->service_repo, ids[i], NULL, NULL);
+      tp_tests_contacts_connection_change_avatar_data (f->service_conn,
+          handles[i], data, "image/png", tokens[i]);
+      g_array_unref (data);
+    }
 
-  /* clean up before doing the second request */
-  reset_result (&result);
-  g_assert (result.error == NULL);
+  g_assert_cmpstr (tp_base_avatars_get_token (TP_BASE_AVATARS (avatars),
+        handles[1]), ==, "base-avatars-shared");
 
-  make_the_connection_disappear (f);
+  signal_id = tp_cli_connection_interface_avatars_connect_to_avatar_retrieved (
+      f->client_conn, avatar_retrieved_record_cb, retrieved, NULL, NULL,
+      &error);
+  g_assert_no_error (error);
 
-  tp_connection_get_contacts_by_handle (f->client_conn,
-      1, &handle,
-      G_N_ELEMENTS (all_contact_features), all_contact_features,
-      by_handle_cb,
-      &result, finish, NULL);
-  g_main_loop_run (result.loop);
-  g_assert_no_error (result.error);
-  g_assert_cmpuint (result.contacts->len, ==, 1);
-  g_assert_cmpuint (result.invalid->len, ==, 0);
+  /* the first two contacts share an avatar, so it is only downloaded once,
+   * and asking for the first contact twice makes no difference */
+  request[0] = handles[0];
+  request[1] = handles[1];
+  request[2] = handles[2];
+  request[3] = handles[0];
+  request_base_avatars (f, retrieved, 4, request, 3);
+
+  g_assert_cmpuint (avatars->batches->len, ==, 1);
+  batch = g_ptr_array_index (avatars->batches, 0);
+  g_assert_cmpuint (batch->len, ==, 2);
+  g_assert (handles_contain (batch, handles[0]));
+  g_assert (!handles_contain (batch, handles[1]));
+  g_assert (handles_contain (batch, handles[2]));
 
-  g_assert (g_ptr_array_index (result.contacts, 0) == contact);
-  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+  for (i = 0; i < 3; i++)
+    g_assert (handles_contain (retrieved, handles[i]));
 
-  put_the_connection_back (f);
+  /* once they have been downloaded, they are not downloaded again */
+  request_base_avatars (f, retrieved, 3, handles, 3);
+  g_assert_cmpuint (avatars->batches->len, ==, 1);
 
-  g_assert (result.error == NULL);
-  reset_result (&result);
+  /* with a batch size of 1, each one is downloaded separately */
+  tp_base_avatars_set_max_batch_size (TP_BASE_AVATARS (avatars), 1);
+  request_base_avatars (f, retrieved, 2, handles + 3, 2);
+  g_assert_cmpuint (avatars->batches->len, ==, 3);
+  g_assert_cmpuint (
+      ((GArray *) g_ptr_array_index (avatars->batches, 1))->len, ==, 1);
+  g_assert_cmpuint (
+      ((GArray *) g_ptr_array_index (avatars->batches, 2))->len, ==, 1);
 
-  weak_pointer = contact;
-  g_object_add_weak_pointer ((GObject *) contact, &weak_pointer);
-  g_object_unref (contact);
-  g_assert (weak_pointer == NULL);
+  tp_proxy_signal_connection_disconnect (signal_id);
+  g_object_unref (avatars);
+  g_array_unref (retrieved);
+}
 
-  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
-  g_main_loop_unref (result.loop);
+static guint64
+get_inode (GFile *file)
+{
+  GError *error = NULL;
+  GFileInfo *info = g_file_query_info (file, G_FILE_ATTRIBUTE_UNIX_INODE,
+      G_FILE_QUERY_INFO_NONE, NULL, &error);
+  guint64 inode;
+
+  g_assert_no_error (error);
+  inode = g_file_info_get_attribute_uint64 (info,
+      G_FILE_ATTRIBUTE_UNIX_INODE);
+  g_object_unref (info);
+  return inode;
 }
 
 static void
-test_by_handle_upgrade (Fixture *f,
+test_avatar_data_shared (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
   Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  TpHandle handle;
-  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
-      f->base_connection, TP_HANDLE_TYPE_CONTACT);
-  TpContact *contact;
-  gpointer weak_pointer;
-  const gchar *alias = "Alice in Wonderland";
-  TpContactFeature feature = TP_CONTACT_FEATURE_ALIAS;
-
-  g_test_bug ("32191");
+  const gchar avatar_data[] = "shared-avatar-data";
+  const gchar *tokens[] = { "shared-avatar-token-1",
+      "shared-avatar-token-2" };
+  TpContactFeature feature = TP_CONTACT_FEATURE_AVATAR_DATA;
+  TpHandle handles[2];
+  TpContact *contacts[2];
+  GArray *array;
+  guint i;
 
-  handle = tp_handle_ensure (service_repo, "alice", NULL, NULL);
-  g_assert_cmpuint (handle, !=, 0);
-  tp_tests_contacts_connection_change_aliases (f->service_conn, 1, &handle,
-      &alias);
+  g_message (G_STRFUNC);
 
-  tp_connection_get_contacts_by_handle (f->client_conn,
-      1, &handle,
-      0, NULL,
-      by_handle_cb,
-      &result, finish, NULL);
-  g_main_loop_run (result.loop);
-  g_assert_cmpuint (result.contacts->len, ==, 1);
-  g_assert_cmpuint (result.invalid->len, ==, 0);
-  g_assert_no_error (result.error);
+  array = g_array_new (FALSE, FALSE, sizeof (gchar));
+  g_array_append_vals (array, avatar_data, strlen (avatar_data) + 1);
 
-  g_assert (g_ptr_array_index (result.contacts, 0) != NULL);
-  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
-  g_assert_cmpuint (tp_contact_get_handle (contact), ==, handle);
-  g_assert_cmpstr (tp_contact_get_identifier (contact), ==, "alice");
-  /* fallback alias is still in effect */
-  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "alice");
+  handles[0] = tp_handle_ensure (f->service_repo, "shared-avatar-1", NULL,
+      NULL);
+  handles[1] = tp_handle_ensure (f->service_repo, "shared-avatar-2", NULL,
+      NULL);
 
-  /* clean up before doing the second request */
-  reset_result (&result);
-  g_assert (result.error == NULL);
+  /* two contacts with different tokens for the same image */
+  for (i = 0; i < 2; i++)
+    tp_tests_contacts_connection_change_avatar_data (f->service_conn,
+        handles[i], array, "image/png", tokens[i]);
 
-  /* the second request enables the Alias feature, so it must make more D-Bus
-   * round trips */
   tp_connection_get_contacts_by_handle (f->client_conn,
-      1, &handle,
+      2, handles,
       1, &feature,
       by_handle_cb,
       &result, finish, NULL);
   g_main_loop_run (result.loop);
-  g_assert_cmpuint (result.contacts->len, ==, 1);
-  g_assert_cmpuint (result.invalid->len, ==, 0);
   g_assert_no_error (result.error);
+  g_assert_cmpuint (result.contacts->len, ==, 2);
 
-  g_assert (g_ptr_array_index (result.contacts, 0) == contact);
-  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+  for (i = 0; i < 2; i++)
+    {
+      contacts[i] = g_object_ref (g_ptr_array_index (result.contacts, i));
 
-  g_assert (result.error == NULL);
-  reset_result (&result);
+      while (tp_contact_get_avatar_file (contacts[i]) == NULL)
+        {
+          g_signal_connect_swapped (contacts[i], "notify::avatar-file",
+              G_CALLBACK (finish), &result);
+          g_main_loop_run (result.loop);
+          g_signal_handlers_disconnect_by_func (contacts[i], finish,
+              &result);
+        }
 
-  weak_pointer = contact;
-  g_object_add_weak_pointer ((GObject *) contact, &weak_pointer);
-  g_object_unref (contact);
-  g_assert (weak_pointer == NULL);
+      g_assert_cmpstr (tp_contact_get_avatar_mime_type (contacts[i]), ==,
+          "image/png");
+    }
 
-  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  /* each token still has its own file, but they are the same file */
+  g_assert (!g_file_equal (tp_contact_get_avatar_file (contacts[0]),
+        tp_contact_get_avatar_file (contacts[1])));
+  g_assert_cmpuint (get_inode (tp_contact_get_avatar_file (contacts[0])),
+      ==, get_inode (tp_contact_get_avatar_file (contacts[1])));
+
+  for (i = 0; i < 2; i++)
+    {
+      g_object_unref (contacts[i]);
+      tp_handle_unref (f->service_repo, handles[i]);
+    }
+
+  reset_result (&result);
   g_main_loop_unref (result.loop);
+  g_array_unref (array);
 }
 
 static void
-test_no_features (Fixture *f,
+test_by_handle (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
   TpTestsContactsConnection *service_conn = f->service_conn;
   TpConnection *client_conn = f->client_conn;
   Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  const gchar * const ids[] = { "alice", "bob", "chris" };
-  TpHandle handles[3] = { 0, 0, 0 };
+  TpHandle handles[5] = { 0, 0, 0, 0, 0 };
   TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
       (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
-  TpContact *contacts[3];
+  TpContact *contacts[4];
+  gpointer weak_pointers[4];
   guint i;
 
   g_message (G_STRFUNC);
 
-  for (i = 0; i < 3; i++)
-    handles[i] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
+  /* arrange for some handles to exist */
+  handles[0] = tp_handle_ensure (service_repo, "alice", NULL, NULL);
+  MYASSERT (handles[0] != 0, "");
+  handles[1] = tp_handle_ensure (service_repo, "bob", NULL, NULL);
+  MYASSERT (handles[1] != 0, "");
+  /* randomly guess at a handle that shouldn't exist */
+  handles[2] = 31337;
+  MYASSERT (!tp_handle_is_valid (service_repo, 31337, NULL), "");
+  /* another valid handle */
+  handles[3] = tp_handle_ensure (service_repo, "chris", NULL, NULL);
+  MYASSERT (handles[3] != 0, "");
+  /* another invalid handle */
+  handles[4] = 12345;
+  MYASSERT (!tp_handle_is_valid (service_repo, 12345, NULL), "");
+
+  /* Make a request for the following 5 contacts:
+   * - alice
+   * - bob
+   * - invalid handle 31337
+   * - chris
+   * - invalid handle 12345
+   */
+  tp_connection_get_contacts_by_handle (client_conn,
+      5, handles,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+
+  g_main_loop_run (result.loop);
+
+  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
+  MYASSERT (result.invalid->len == 2, ": %u", result.invalid->len);
+  g_assert_no_error (result.error);
+
+  MYASSERT (g_ptr_array_index (result.contacts, 0) != NULL, "");
+  MYASSERT (g_ptr_array_index (result.contacts, 1) != NULL, "");
+  MYASSERT (g_ptr_array_index (result.contacts, 2) != NULL, "");
+  contacts[0] = g_object_ref (g_ptr_array_index (result.contacts, 0));
+  g_assert_cmpuint (tp_contact_get_handle (contacts[0]), ==, handles[0]);
+  g_assert_cmpstr (tp_contact_get_identifier (contacts[0]), ==, "alice");
+  contacts[1] = g_object_ref (g_ptr_array_index (result.contacts, 1));
+  g_assert_cmpuint (tp_contact_get_handle (contacts[1]), ==, handles[1]);
+  g_assert_cmpstr (tp_contact_get_identifier (contacts[1]), ==, "bob");
+  contacts[3] = g_object_ref (g_ptr_array_index (result.contacts, 2));
+  g_assert_cmpuint (tp_contact_get_handle (contacts[3]), ==, handles[3]);
+  g_assert_cmpstr (tp_contact_get_identifier (contacts[3]), ==, "chris");
+
+  /* clean up before doing the second request */
+  reset_result (&result);
+  g_assert (result.error == NULL);
+
+  /* Replace one of the invalid handles with a valid one */
+  handles[2] = tp_handle_ensure (service_repo, "dora", NULL, NULL);
+  MYASSERT (handles[2] != 0, "");
+
+  /* Make a request for the following 4 contacts:
+   * - alice (TpContact exists)
+   * - bob (TpContact exists)
+   * - dora (TpContact needs to be created)
+   * - chris (TpContact exists)
+   */
+  tp_connection_get_contacts_by_handle (client_conn,
+      4, handles,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+
+  g_main_loop_run (result.loop);
+
+  /* assert that we got the same contacts back */
+
+  MYASSERT (result.contacts->len == 4, ": %u", result.contacts->len);
+  MYASSERT (result.invalid->len == 0, ": %u", result.invalid->len);
+  g_assert_no_error (result.error);
+
+  /* 0, 1 and 3 we already have a reference to */
+  MYASSERT (g_ptr_array_index (result.contacts, 0) == contacts[0], "");
+  g_object_unref (g_ptr_array_index (result.contacts, 0));
+  MYASSERT (g_ptr_array_index (result.contacts, 1) == contacts[1], "");
+  g_object_unref (g_ptr_array_index (result.contacts, 1));
+  MYASSERT (g_ptr_array_index (result.contacts, 3) == contacts[3], "");
+  g_object_unref (g_ptr_array_index (result.contacts, 3));
+
+  /* 2 we don't */
+  contacts[2] = g_ptr_array_index (result.contacts, 2);
+  g_assert_cmpuint (tp_contact_get_handle (contacts[2]), ==, handles[2]);
+  g_assert_cmpstr (tp_contact_get_identifier (contacts[2]), ==, "dora");
+
+  g_ptr_array_unref (result.contacts);
+  result.contacts = NULL;
+
+  /* clean up refs to contacts and assert that they aren't leaked */
+
+  for (i = 0; i < 4; i++)
+    {
+      weak_pointers[i] = contacts[i];
+      g_object_add_weak_pointer ((GObject *) contacts[i],weak_pointers +i);
+    }
+
+  for (i = 0; i < 4; i++)
+    {
+      g_object_unref (contacts[i]);
+      MYASSERT (weak_pointers[i] == NULL, ": %u", i);
+    }
+
+  /* wait for ReleaseHandles to run */
+  tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+
+  /* remaining cleanup */
+  g_assert (result.error == NULL);
+  reset_result (&result);
+  g_main_loop_unref (result.loop);
+}
+
+/* Silently removes the TpBaseConnection object from D-Bus, so that if the test
+ * makes any D-Bus calls on it, it will fail (but the TpConnection proxy isn't
+ * invalidated otherwise)
+ */
+static void
+make_the_connection_disappear (Fixture *f)
+{
+  GError *error = NULL;
+  gboolean ok;
+
+  tp_dbus_daemon_unregister_object (
+      tp_base_connection_get_dbus_daemon (f->base_connection),
+      f->base_connection);
+  /* check that that worked */
+  ok = tp_cli_connection_run_get_self_handle (f->client_conn, -1, NULL,
+      &error, NULL);
+  g_assert_error (error, DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD);
+  g_assert (!ok);
+  g_clear_error (&error);
+}
+
+/* Returns the TpBaseConnection to D-Bus (after a previous call to
+ * make_the_connection_disappear())
+ */
+static void
+put_the_connection_back (Fixture *f)
+{
+  GError *error = NULL;
+  gboolean ok;
+
+  tp_dbus_daemon_register_object (
+      tp_base_connection_get_dbus_daemon (f->base_connection),
+      tp_base_connection_get_object_path (f->base_connection),
+      f->base_connection);
+  /* check that *that* worked */
+  ok = tp_cli_connection_run_get_self_handle (f->client_conn, -1, NULL,
+      &error, NULL);
+  g_assert_no_error (error);
+  g_assert (ok);
+}
+
+static TpHandle
+get_handle_with_no_caps (Fixture *f,
+    const gchar *id)
+{
+  TpHandle handle;
+  GHashTable *capabilities;
+
+  handle = tp_handle_ensure (f->service_repo, id, NULL, NULL);
+  g_assert_cmpuint (handle, !=, 0);
+
+  /* Unlike almost every other feature, with capabilities “not sure” and “none”
+   * are different: you really might care about the difference between “I don't
+   * know if blah can do video” versus “I know blah cannot do video”.
+   *
+   * It happens that we get the repeated-reintrospection behaviour for the
+   * former case of contact caps. I can't really be bothered to fix this.
+   */
+  capabilities = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
+  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handle),
+      g_ptr_array_new ());
+  tp_tests_contacts_connection_change_capabilities (f->service_conn,
+      capabilities);
+  g_hash_table_unref (capabilities);
+
+  return handle;
+}
+
+static void
+test_by_handle_again (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  TpHandle handle;
+  TpContact *contact;
+  gpointer weak_pointer;
+  const gchar *alias = "Alice in Wonderland";
+
+  g_test_bug ("25181");
+
+  handle = get_handle_with_no_caps (f, "alice");
+  tp_tests_contacts_connection_change_aliases (f->service_conn, 1, &handle,
+      &alias);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      G_N_ELEMENTS (all_contact_features), all_contact_features,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_cmpuint (result.contacts->len, ==, 1);
+  g_assert_cmpuint (result.invalid->len, ==, 0);
+  g_assert_no_error (result.error);
+
+  g_assert (g_ptr_array_index (result.contacts, 0) != NULL);
+  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
+  g_assert_cmpuint (tp_contact_get_handle (contact), ==, handle);
+  g_assert_cmpstr (tp_contact_get_identifier (contact), ==, "alice");
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+
+  /* clean up before doing the second request */
+  reset_result (&result);
+  g_assert (result.error == NULL);
+
+  make_the_connection_disappear (f);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      G_N_ELEMENTS (all_contact_features), all_contact_features,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+  g_assert_cmpuint (result.contacts->len, ==, 1);
+  g_assert_cmpuint (result.invalid->len, ==, 0);
+
+  g_assert (g_ptr_array_index (result.contacts, 0) == contact);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+
+  put_the_connection_back (f);
+
+  g_assert (result.error == NULL);
+  reset_result (&result);
+
+  weak_pointer = contact;
+  g_object_add_weak_pointer ((GObject *) contact, &weak_pointer);
+  g_object_unref (contact);
+  g_assert (weak_pointer == NULL);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_main_loop_unref (result.loop);
+}
+
+static void
+test_by_handle_upgrade (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  TpHandle handle;
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      f->base_connection, TP_HANDLE_TYPE_CONTACT);
+  TpContact *contact;
+  gpointer weak_pointer;
+  const gchar *alias = "Alice in Wonderland";
+  TpContactFeature feature = TP_CONTACT_FEATURE_ALIAS;
+
+  g_test_bug ("32191");
+
+  handle = tp_handle_ensure (service_repo, "alice", NULL, NULL);
+  g_assert_cmpuint (handle, !=, 0);
+  tp_tests_contacts_connection_change_aliases (f->service_conn, 1, &handle,
+      &alias);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_cmpuint (result.contacts->len, ==, 1);
+  g_assert_cmpuint (result.invalid->len, ==, 0);
+  g_assert_no_error (result.error);
+
+  g_assert (g_ptr_array_index (result.contacts, 0) != NULL);
+  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
+  g_assert_cmpuint (tp_contact_get_handle (contact), ==, handle);
+  g_assert_cmpstr (tp_contact_get_identifier (contact), ==, "alice");
+  /* fallback alias is still in effect */
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "alice");
+
+  /* clean up before doing the second request */
+  reset_result (&result);
+  g_assert (result.error == NULL);
+
+  /* the second request enables the Alias feature, so it must make more D-Bus
+   * round trips */
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      1, &feature,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_cmpuint (result.contacts->len, ==, 1);
+  g_assert_cmpuint (result.invalid->len, ==, 0);
+  g_assert_no_error (result.error);
+
+  g_assert (g_ptr_array_index (result.contacts, 0) == contact);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, "Alice in Wonderland");
+
+  g_assert (result.error == NULL);
+  reset_result (&result);
+
+  weak_pointer = contact;
+  g_object_add_weak_pointer ((GObject *) contact, &weak_pointer);
+  g_object_unref (contact);
+  g_assert (weak_pointer == NULL);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_main_loop_unref (result.loop);
+}
+
+typedef struct {
+    guint n_signals;
+    guint n_contacts;
+    guint last_done;
+} BatchProgress;
+
+static void
+contact_attributes_received_cb (TpConnection *connection,
+    GPtrArray *contacts,
+    guint n_done,
+    guint n_total,
+    BatchProgress *progress)
+{
+  guint i;
+
+  for (i = 0; i < contacts->len; i++)
+    g_assert (TP_IS_CONTACT (g_ptr_array_index (contacts, i)));
+
+  g_assert_cmpuint (n_done, >, progress->last_done);
+  g_assert_cmpuint (n_done, <=, n_total);
+  progress->n_signals++;
+  progress->n_contacts += contacts->len;
+  progress->last_done = n_done;
+}
+
+static void
+test_by_handle_batched (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  static const gchar * const ids[] = { "alice", "bob", "chris", "dora",
+      "eve", "fred", "gina" };
+  TpHandle handles[8];
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      f->base_connection, TP_HANDLE_TYPE_CONTACT);
+  TpContactFeature feature = TP_CONTACT_FEATURE_ALIAS;
+  BatchProgress progress = { 0 };
+  GPtrArray *contacts;
+  guint i;
+
+  /* seven valid handles, with an invalid one in the middle */
+  for (i = 0; i < 3; i++)
+    handles[i] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
+
+  handles[3] = 31337;
+  MYASSERT (!tp_handle_is_valid (service_repo, 31337, NULL), "");
+
+  for (i = 3; i < 7; i++)
+    handles[i + 1] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
+
+  tp_connection_set_contact_attributes_batching (f->client_conn, 2, 2);
+  g_signal_connect (f->client_conn, "contact-attributes-received",
+      G_CALLBACK (contact_attributes_received_cb), &progress);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      8, handles,
+      1, &feature,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  /* four batches of two, with the valid contacts in the original order */
+  g_assert_cmpuint (progress.n_signals, ==, 4);
+  g_assert_cmpuint (progress.n_contacts, ==, 7);
+  g_assert_cmpuint (progress.last_done, ==, 8);
+
+  g_assert_cmpuint (result.contacts->len, ==, 7);
+  g_assert_cmpuint (result.invalid->len, ==, 1);
+  g_assert_cmpuint (g_array_index (result.invalid, TpHandle, 0), ==, 31337);
+
+  for (i = 0; i < 7; i++)
+    {
+      TpContact *contact = g_ptr_array_index (result.contacts, i);
+
+      g_assert_cmpstr (tp_contact_get_identifier (contact), ==, ids[i]);
+      g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_ALIAS));
+    }
+
+  /* upgrading the contacts we already have is batched too */
+  contacts = result.contacts;
+  result.contacts = NULL;
+  reset_result (&result);
+  memset (&progress, 0, sizeof (progress));
+  feature = TP_CONTACT_FEATURE_PRESENCE;
+  handles[3] = handles[7];
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      7, handles,
+      1, &feature,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  g_assert_cmpuint (progress.n_signals, ==, 4);
+  g_assert_cmpuint (progress.n_contacts, ==, 7);
+  g_assert_cmpuint (progress.last_done, ==, 7);
+  g_assert_cmpuint (result.contacts->len, ==, 7);
+  g_assert_cmpuint (result.invalid->len, ==, 0);
+
+  for (i = 0; i < 7; i++)
+    {
+      g_assert (g_ptr_array_index (result.contacts, i) ==
+          g_ptr_array_index (contacts, i));
+      g_assert (tp_contact_has_feature (g_ptr_array_index (contacts, i),
+            TP_CONTACT_FEATURE_PRESENCE));
+    }
+
+  g_ptr_array_foreach (contacts, (GFunc) g_object_unref, NULL);
+  g_ptr_array_unref (contacts);
+
+  g_signal_handlers_disconnect_by_func (f->client_conn,
+      contact_attributes_received_cb, &progress);
+  tp_connection_set_contact_attributes_batching (f->client_conn, 0, 1);
+  reset_result (&result);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_main_loop_unref (result.loop);
+}
+
+static void
+test_no_features (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpTestsContactsConnection *service_conn = f->service_conn;
+  TpConnection *client_conn = f->client_conn;
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  const gchar * const ids[] = { "alice", "bob", "chris" };
+  TpHandle handles[3] = { 0, 0, 0 };
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
+  TpContact *contacts[3];
+  guint i;
+
+  g_message (G_STRFUNC);
+
+  for (i = 0; i < 3; i++)
+    handles[i] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
+
+  tp_connection_get_contacts_by_handle (client_conn,
+      3, handles,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+
+  g_main_loop_run (result.loop);
+
+  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
+  MYASSERT (result.invalid->len == 0, ": %u", result.invalid->len);
+  g_assert_no_error (result.error);
+
+  MYASSERT (g_ptr_array_index (result.contacts, 0) != NULL, "");
+  MYASSERT (g_ptr_array_index (result.contacts, 1) != NULL, "");
+  MYASSERT (g_ptr_array_index (result.contacts, 2) != NULL, "");
+
+  for (i = 0; i < 3; i++)
+    contacts[i] = g_object_ref (g_ptr_array_index (result.contacts, i));
+
+  g_assert (result.error == NULL);
+  reset_result (&result);
+
+  for (i = 0; i < 3; i++)
+    {
+      MYASSERT (tp_contact_get_connection (contacts[i]) == client_conn, "");
+      g_assert_cmpuint (tp_contact_get_handle (contacts[i]), ==, handles[i]);
+      g_assert_cmpstr (tp_contact_get_identifier (contacts[i]), ==,
+          ids[i]);
+      g_assert_cmpstr (tp_contact_get_alias (contacts[i]), ==,
+          tp_contact_get_identifier (contacts[i]));
+      MYASSERT (tp_contact_get_avatar_token (contacts[i]) == NULL,
+          ": %s", tp_contact_get_avatar_token (contacts[i]));
+      g_assert_cmpuint (tp_contact_get_presence_type (contacts[i]), ==,
+          TP_CONNECTION_PRESENCE_TYPE_UNSET);
+      g_assert_cmpstr (tp_contact_get_presence_status (contacts[i]), ==,
+          "");
+      g_assert_cmpstr (tp_contact_get_presence_message (contacts[i]), ==,
+          "");
+      MYASSERT (!tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_ALIAS), "");
+      MYASSERT (!tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_AVATAR_TOKEN), "");
+      MYASSERT (!tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_PRESENCE), "");
+      MYASSERT (!tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_LOCATION), "");
+      MYASSERT (!tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_CAPABILITIES), "");
+    }
+
+  for (i = 0; i < 3; i++)
+    {
+      g_object_unref (contacts[i]);
+      tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+      tp_handle_unref (service_repo, handles[i]);
+    }
+
+  /* remaining cleanup */
+  g_main_loop_unref (result.loop);
+}
+
+static void
+upgrade_cb (TpConnection *connection,
+            guint n_contacts,
+            TpContact * const *contacts,
+            const GError *error,
+            gpointer user_data,
+            GObject *weak_object)
+{
+  Result *result = user_data;
+
+  g_assert (result->invalid == NULL);
+  g_assert (result->contacts == NULL);
+  g_assert (result->error == NULL);
+  g_assert (result->good_ids == NULL);
+  g_assert (result->bad_ids == NULL);
+
+  if (error == NULL)
+    {
+      guint i;
+
+      DEBUG ("got %u contacts", n_contacts);
+
+      result->contacts = g_ptr_array_sized_new (n_contacts);
+
+      for (i = 0; i < n_contacts; i++)
+        {
+          TpContact *contact = contacts[i];
+
+          DEBUG ("contact #%u: %p", i, contact);
+          DEBUG ("contact #%u alias: %s", i, tp_contact_get_alias (contact));
+          DEBUG ("contact #%u avatar token: %s", i,
+              tp_contact_get_avatar_token (contact));
+          DEBUG ("contact #%u presence type: %u", i,
+              tp_contact_get_presence_type (contact));
+          DEBUG ("contact #%u presence status: %s", i,
+              tp_contact_get_presence_status (contact));
+          DEBUG ("contact #%u presence message: %s", i,
+              tp_contact_get_presence_message (contact));
+          g_ptr_array_add (result->contacts, g_object_ref (contact));
+        }
+    }
+  else
+    {
+      DEBUG ("got an error: %s %u: %s", g_quark_to_string (error->domain),
+          error->code, error->message);
+      result->error = g_error_copy (error);
+    }
+}
+
+/* Just put a country in locations for easier comparaisons.
+ * FIXME: Ideally we should have a MYASSERT_SAME_ASV */
+#define ASSERT_SAME_LOCATION(left, left_vardict, right)\
+  G_STMT_START {\
+    g_assert_cmpuint (g_hash_table_size (left), ==, \
+        g_hash_table_size (right));\
+    g_assert_cmpstr (tp_asv_get_string (left, "country"), ==,\
+        tp_asv_get_string (right, "country"));\
+    \
+    g_assert_cmpstr (g_variant_get_type_string (left_vardict), ==, "a{sv}"); \
+    g_assert_cmpuint (g_variant_n_children (left_vardict), ==, \
+        g_hash_table_size (right));\
+    g_assert_cmpstr (tp_vardict_get_string (left_vardict, "country"), ==,\
+        tp_asv_get_string (right, "country"));\
+  } G_STMT_END
+
+static void
+free_rcc_list (GPtrArray *rccs)
+{
+  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, rccs);
+}
+
+static void
+add_text_chat_class (GPtrArray *classes,
+    TpHandleType handle_type)
+{
+  GHashTable *fixed;
+  const gchar * const allowed[] = { NULL };
+  GValueArray *arr;
+
+  fixed = tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
+          TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
+          handle_type,
+      NULL);
+
+  arr = tp_value_array_build (2,
+      TP_HASH_TYPE_STRING_VARIANT_MAP, fixed,
+      G_TYPE_STRV, allowed,
+      G_TYPE_INVALID);
+
+  g_hash_table_unref (fixed);
+
+  g_ptr_array_add (classes, arr);
+}
+
+static GHashTable *
+create_contact_caps (TpHandle *handles)
+{
+  GHashTable *capabilities;
+  GPtrArray *caps1, *caps2, *caps3;
+
+  capabilities = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) free_rcc_list);
+
+  /* Support private text chats */
+  caps1 = g_ptr_array_sized_new (2);
+  add_text_chat_class (caps1, TP_HANDLE_TYPE_CONTACT);
+  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[0]), caps1);
+
+  /* Support text chatrooms */
+  caps2 = g_ptr_array_sized_new (1);
+  add_text_chat_class (caps2, TP_HANDLE_TYPE_ROOM);
+  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[1]), caps2);
+
+  /* Don't support anything */
+  caps3 = g_ptr_array_sized_new (0);
+  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[2]), caps3);
+
+  return capabilities;
+}
+
+static void
+test_upgrade (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpTestsContactsConnection *service_conn = f->service_conn;
+  TpConnection *client_conn = f->client_conn;
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  TpHandle handles[] = { 0, 0, 0 };
+  static const gchar * const ids[] = { "alice", "bob", "chris" };
+  static const gchar * const aliases[] = { "Alice in Wonderland",
+      "Bob the Builder", "Christopher Robin" };
+  static const gchar * const tokens[] = { "aaaaa", "bbbbb", "ccccc" };
+  static TpTestsContactsConnectionPresenceStatusIndex statuses[] = {
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_AVAILABLE,
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY,
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_AWAY };
+  static const gchar * const messages[] = { "", "Fixing it",
+      "GON OUT BACKSON" };
+  GHashTable *location_1 = tp_asv_new (
+      "country",  G_TYPE_STRING, "United Kingdom of Great Britain and Northern Ireland", NULL);
+  GHashTable *location_2 = tp_asv_new (
+      "country",  G_TYPE_STRING, "Atlantis", NULL);
+  GHashTable *location_3 = tp_asv_new (
+      "country",  G_TYPE_STRING, "Belgium", NULL);
+  GHashTable *locations[] = { location_1, location_2, location_3 };
+  GHashTable *capabilities;
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
+  TpContact *contacts[3];
+  TpContactFeature features[] = { TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_AVATAR_TOKEN, TP_CONTACT_FEATURE_PRESENCE,
+      TP_CONTACT_FEATURE_LOCATION, TP_CONTACT_FEATURE_CAPABILITIES };
+  guint i;
+
+  g_message (G_STRFUNC);
+
+  for (i = 0; i < 3; i++)
+    handles[i] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
+
+  tp_tests_contacts_connection_change_aliases (service_conn, 3, handles,
+      aliases);
+  tp_tests_contacts_connection_change_presences (service_conn, 3, handles,
+      statuses, messages);
+  tp_tests_contacts_connection_change_avatar_tokens (service_conn, 3, handles,
+      tokens);
+  tp_tests_contacts_connection_change_locations (service_conn, 3, handles,
+      locations);
+
+  capabilities = create_contact_caps (handles);
+  tp_tests_contacts_connection_change_capabilities (service_conn, capabilities);
+  g_hash_table_unref (capabilities);
 
   tp_connection_get_contacts_by_handle (client_conn,
       3, handles,
@@ -1108,9 +2111,6 @@ test_no_features (Fixture *f,
   for (i = 0; i < 3; i++)
     contacts[i] = g_object_ref (g_ptr_array_index (result.contacts, i));
 
-  g_assert (result.error == NULL);
-  reset_result (&result);
-
   for (i = 0; i < 3; i++)
     {
       MYASSERT (tp_contact_get_connection (contacts[i]) == client_conn, "");
@@ -1139,371 +2139,562 @@ test_no_features (Fixture *f,
             TP_CONTACT_FEATURE_CAPABILITIES), "");
     }
 
+  /* clean up before doing the second request */
+  g_assert (result.error == NULL);
+  reset_result (&result);
+
+  tp_connection_upgrade_contacts (client_conn,
+      3, contacts,
+      G_N_ELEMENTS (features), features,
+      upgrade_cb,
+      &result, finish, NULL);
+
+  g_main_loop_run (result.loop);
+
+  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
+  MYASSERT (result.invalid == NULL, "");
+  g_assert_no_error (result.error);
+
+  for (i = 0; i < 3; i++)
+    {
+      MYASSERT (g_ptr_array_index (result.contacts, 0) == contacts[0], "");
+    }
+
+  g_assert (result.invalid == NULL);
+  g_assert (result.error == NULL);
+  reset_result (&result);
+
+  for (i = 0; i < 3; i++)
+    {
+      GVariant *vardict;
+
+      g_assert_cmpuint (tp_contact_get_handle (contacts[i]), ==, handles[i]);
+      g_assert_cmpstr (tp_contact_get_identifier (contacts[i]), ==,
+          ids[i]);
+
+      MYASSERT (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_ALIAS), "");
+      g_assert_cmpstr (tp_contact_get_alias (contacts[i]), ==,
+          aliases[i]);
+
+      MYASSERT (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_AVATAR_TOKEN), "");
+      g_assert_cmpstr (tp_contact_get_avatar_token (contacts[i]), ==,
+          tokens[i]);
+
+      MYASSERT (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_PRESENCE), "");
+      g_assert_cmpstr (tp_contact_get_presence_message (contacts[i]), ==,
+          messages[i]);
+
+      MYASSERT (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_LOCATION), "");
+
+      vardict = tp_contact_dup_location (contacts[i]);
+      ASSERT_SAME_LOCATION (tp_contact_get_location (contacts[i]),
+          vardict, locations[i]);
+      g_variant_unref (vardict);
+
+      g_object_get (contacts[i],
+          "location-vardict", &vardict,
+          NULL);
+      ASSERT_SAME_LOCATION (tp_contact_get_location (contacts[i]),
+          vardict, locations[i]);
+      g_variant_unref (vardict);
+
+      MYASSERT (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_CAPABILITIES), "");
+      MYASSERT (tp_contact_get_capabilities (contacts[i]) != NULL, "");
+    }
+
+  g_assert_cmpuint (tp_contact_get_presence_type (contacts[0]), ==,
+      TP_CONNECTION_PRESENCE_TYPE_AVAILABLE);
+  g_assert_cmpstr (tp_contact_get_presence_status (contacts[0]), ==,
+      "available");
+  g_assert_cmpuint (tp_contact_get_presence_type (contacts[1]), ==,
+      TP_CONNECTION_PRESENCE_TYPE_BUSY);
+  g_assert_cmpstr (tp_contact_get_presence_status (contacts[1]), ==,
+      "busy");
+  g_assert_cmpuint (tp_contact_get_presence_type (contacts[2]), ==,
+      TP_CONNECTION_PRESENCE_TYPE_AWAY);
+  g_assert_cmpstr (tp_contact_get_presence_status (contacts[2]), ==,
+      "away");
+
+  for (i = 0; i < 3; i++)
+    {
+      g_object_unref (contacts[i]);
+      tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
+      tp_handle_unref (service_repo, handles[i]);
+    }
+
+  /* remaining cleanup */
+  g_hash_table_unref (location_1);
+  g_hash_table_unref (location_2);
+  g_hash_table_unref (location_3);
+  g_main_loop_unref (result.loop);
+}
+
+/* Regression test case for fd.o#41414 */
+static void
+test_upgrade_noop (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  TpHandle handle;
+  TpContact *contact;
+
+  g_test_bug ("41414");
+
+  /* Get a contact by handle */
+  handle = get_handle_with_no_caps (f, "test-upgrade-noop");
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      G_N_ELEMENTS (all_contact_features), all_contact_features,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
+  reset_result (&result);
+
+  /* Upgrade it, but it should already have all features */
+  make_the_connection_disappear (f);
+  tp_connection_upgrade_contacts (f->client_conn,
+      1, &contact,
+      G_N_ELEMENTS (all_contact_features), all_contact_features,
+      upgrade_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+  reset_result (&result);
+
+  put_the_connection_back (f);
+
+  g_object_unref (contact);
+}
+
+typedef struct {
+    GMainLoop *loop;
+    guint n_pending;
+    GPtrArray *contacts[2];
+} CoalescedResult;
+
+static void
+upgrade_async_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  CoalescedResult *result = user_data;
+  GPtrArray *contacts;
+  GError *error = NULL;
+
+  tp_connection_upgrade_contacts_finish (TP_CONNECTION (source), res,
+      &contacts, &error);
+  g_assert_no_error (error);
+
+  result->contacts[2 - result->n_pending] = contacts;
+
+  if (--result->n_pending == 0)
+    g_main_loop_quit (result->loop);
+}
+
+static void
+test_upgrade_coalesced (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  CoalescedResult coalesced = { result.loop, 2, { NULL, NULL } };
+  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
+      f->base_connection, TP_HANDLE_TYPE_CONTACT);
+  TpHandle handles[3];
+  TpContact *contacts[3];
+  TpContactFeature alias = TP_CONTACT_FEATURE_ALIAS;
+  TpContactFeature presence = TP_CONTACT_FEATURE_PRESENCE;
+  BatchProgress progress = { 0 };
+  guint i;
+
+  handles[0] = tp_handle_ensure (service_repo, "alice", NULL, NULL);
+  handles[1] = tp_handle_ensure (service_repo, "bob", NULL, NULL);
+  handles[2] = tp_handle_ensure (service_repo, "chris", NULL, NULL);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      3, handles,
+      0, NULL,
+      by_handle_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  for (i = 0; i < 3; i++)
+    contacts[i] = g_object_ref (g_ptr_array_index (result.contacts, i));
+
+  reset_result (&result);
+
+  g_signal_connect (f->client_conn, "contact-attributes-received",
+      G_CALLBACK (contact_attributes_received_cb), &progress);
+
+  /* two overlapping requests for different features in the same main loop
+   * iteration are answered by one GetContactAttributes call */
+  tp_connection_upgrade_contacts_async (f->client_conn,
+      2, contacts, 1, &alias, upgrade_async_cb, &coalesced);
+  tp_connection_upgrade_contacts_async (f->client_conn,
+      2, contacts + 1, 1, &presence, upgrade_async_cb, &coalesced);
+  g_main_loop_run (result.loop);
+
+  g_assert_cmpuint (progress.n_signals, ==, 1);
+  g_assert_cmpuint (progress.n_contacts, ==, 3);
+
+  /* each request gets back exactly the contacts it asked for */
+  g_assert_cmpuint (coalesced.contacts[0]->len, ==, 2);
+  g_assert (g_ptr_array_index (coalesced.contacts[0], 0) == contacts[0]);
+  g_assert (g_ptr_array_index (coalesced.contacts[0], 1) == contacts[1]);
+  g_assert_cmpuint (coalesced.contacts[1]->len, ==, 2);
+  g_assert (g_ptr_array_index (coalesced.contacts[1], 0) == contacts[1]);
+  g_assert (g_ptr_array_index (coalesced.contacts[1], 1) == contacts[2]);
+
   for (i = 0; i < 3; i++)
     {
+      g_assert (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_ALIAS));
+      g_assert (tp_contact_has_feature (contacts[i],
+            TP_CONTACT_FEATURE_PRESENCE));
       g_object_unref (contacts[i]);
-      tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
-      tp_handle_unref (service_repo, handles[i]);
     }
 
-  /* remaining cleanup */
+  g_signal_handlers_disconnect_by_func (f->client_conn,
+      contact_attributes_received_cb, &progress);
+  g_ptr_array_unref (coalesced.contacts[0]);
+  g_ptr_array_unref (coalesced.contacts[1]);
   g_main_loop_unref (result.loop);
 }
 
 static void
-upgrade_cb (TpConnection *connection,
-            guint n_contacts,
-            TpContact * const *contacts,
-            const GError *error,
-            gpointer user_data,
-            GObject *weak_object)
+count_notify_cb (GObject *object,
+    GParamSpec *pspec,
+    guint *count)
+{
+  (*count)++;
+}
+
+static void
+upgrade_one_async_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
 {
   Result *result = user_data;
 
-  g_assert (result->invalid == NULL);
-  g_assert (result->contacts == NULL);
-  g_assert (result->error == NULL);
-  g_assert (result->good_ids == NULL);
-  g_assert (result->bad_ids == NULL);
+  tp_connection_upgrade_contacts_finish (TP_CONNECTION (source), res,
+      NULL, &result->error);
+  finish (result);
+}
 
-  if (error == NULL)
-    {
-      guint i;
+/* Returns a new TpContact for @handle, which must not exist already,
+ * upgraded to have an alias, and sets *n_notifies to the number of
+ * times its alias changed in the process */
+static TpContact *
+upgrade_new_contact_with_alias (Fixture *f,
+    Result *result,
+    TpHandle handle,
+    const gchar *id,
+    guint *n_notifies)
+{
+  TpContactFeature feature = TP_CONTACT_FEATURE_ALIAS;
+  TpContact *contact;
 
-      DEBUG ("got %u contacts", n_contacts);
+  contact = tp_simple_client_factory_ensure_contact (
+      tp_proxy_get_factory (f->client_conn), f->client_conn, handle, id);
+  g_assert (!tp_contact_has_feature (contact, TP_CONTACT_FEATURE_ALIAS));
 
-      result->contacts = g_ptr_array_sized_new (n_contacts);
+  *n_notifies = 0;
+  g_signal_connect (contact, "notify::alias",
+      G_CALLBACK (count_notify_cb), n_notifies);
 
-      for (i = 0; i < n_contacts; i++)
-        {
-          TpContact *contact = contacts[i];
+  tp_connection_upgrade_contacts_async (f->client_conn, 1, &contact,
+      1, &feature, upgrade_one_async_cb, result);
+  g_main_loop_run (result->loop);
 
-          DEBUG ("contact #%u: %p", i, contact);
-          DEBUG ("contact #%u alias: %s", i, tp_contact_get_alias (contact));
-          DEBUG ("contact #%u avatar token: %s", i,
-              tp_contact_get_avatar_token (contact));
-          DEBUG ("contact #%u presence type: %u", i,
-              tp_contact_get_presence_type (contact));
-          DEBUG ("contact #%u presence status: %s", i,
-              tp_contact_get_presence_status (contact));
-          DEBUG ("contact #%u presence message: %s", i,
-              tp_contact_get_presence_message (contact));
-          g_ptr_array_add (result->contacts, g_object_ref (contact));
-        }
-    }
-  else
-    {
-      DEBUG ("got an error: %s %u: %s", g_quark_to_string (error->domain),
-          error->code, error->message);
-      result->error = g_error_copy (error);
-    }
+  g_signal_handlers_disconnect_by_func (contact, count_notify_cb,
+      n_notifies);
+  return contact;
 }
 
-/* Just put a country in locations for easier comparaisons.
- * FIXME: Ideally we should have a MYASSERT_SAME_ASV */
-#define ASSERT_SAME_LOCATION(left, left_vardict, right)\
-  G_STMT_START {\
-    g_assert_cmpuint (g_hash_table_size (left), ==, \
-        g_hash_table_size (right));\
-    g_assert_cmpstr (tp_asv_get_string (left, "country"), ==,\
-        tp_asv_get_string (right, "country"));\
-    \
-    g_assert_cmpstr (g_variant_get_type_string (left_vardict), ==, "a{sv}"); \
-    g_assert_cmpuint (g_variant_n_children (left_vardict), ==, \
-        g_hash_table_size (right));\
-    g_assert_cmpstr (tp_vardict_get_string (left_vardict, "country"), ==,\
-        tp_asv_get_string (right, "country"));\
-  } G_STMT_END
-
 static void
-free_rcc_list (GPtrArray *rccs)
+drop_contact (TpContact *contact)
 {
-  g_boxed_free (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, rccs);
+  gpointer weak_pointer = contact;
+
+  g_object_add_weak_pointer ((GObject *) contact, &weak_pointer);
+  g_object_unref (contact);
+  g_assert (weak_pointer == NULL);
 }
 
 static void
-add_text_chat_class (GPtrArray *classes,
-    TpHandleType handle_type)
+test_attributes_cache (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
 {
-  GHashTable *fixed;
-  const gchar * const allowed[] = { NULL };
-  GValueArray *arr;
-
-  fixed = tp_asv_new (
-      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING,
-          TP_IFACE_CHANNEL_TYPE_TEXT,
-      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT,
-          handle_type,
-      NULL);
+  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
+  const gchar *alias = "Alice in Wonderland";
+  TpHandle handle;
+  TpContact *contact;
+  guint n_notifies;
+  gchar *escaped, *filename;
 
-  arr = tp_value_array_build (2,
-      TP_HASH_TYPE_STRING_VARIANT_MAP, fixed,
-      G_TYPE_STRV, allowed,
-      G_TYPE_INVALID);
+  handle = tp_handle_ensure (f->service_repo, "alice", NULL, NULL);
+  tp_tests_contacts_connection_change_aliases (f->service_conn, 1, &handle,
+      &alias);
 
-  g_hash_table_unref (fixed);
+  escaped = tp_escape_as_identifier (
+      tp_proxy_get_object_path (f->client_conn));
+  filename = g_build_filename (g_get_user_cache_dir (), "telepathy",
+      "contact-attributes", escaped, NULL);
+  g_free (escaped);
+  g_remove (filename);
 
-  g_ptr_array_add (classes, arr);
-}
+  tp_connection_set_contact_attributes_cache_enabled (f->client_conn, TRUE);
 
-static GHashTable *
-create_contact_caps (TpHandle *handles)
-{
-  GHashTable *capabilities;
-  GPtrArray *caps1, *caps2, *caps3;
+  /* the first time, nothing is cached */
+  contact = upgrade_new_contact_with_alias (f, &result, handle, "alice",
+      &n_notifies);
+  g_assert_no_error (result.error);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, alias);
+  g_assert_cmpuint (n_notifies, ==, 1);
+  drop_contact (contact);
+
+  /* disabling the cache writes it to disk, and re-enabling it reads it
+   * back, as if for a new process */
+  tp_connection_set_contact_attributes_cache_enabled (f->client_conn, FALSE);
+  g_assert (g_file_test (filename, G_FILE_TEST_EXISTS));
+  tp_connection_set_contact_attributes_cache_enabled (f->client_conn, TRUE);
+
+  /* The alias is filled in from the cache; the CM's reply is the same, so
+   * the contact isn't touched again */
+  contact = upgrade_new_contact_with_alias (f, &result, handle, "alice",
+      &n_notifies);
+  g_assert_no_error (result.error);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, alias);
+  g_assert_cmpuint (n_notifies, ==, 1);
+  drop_contact (contact);
 
-  capabilities = g_hash_table_new_full (NULL, NULL, NULL,
-      (GDestroyNotify) free_rcc_list);
+  /* the cached alias is there even before the CM replies (or here, if the
+   * CM never replies at all) */
+  make_the_connection_disappear (f);
+  contact = upgrade_new_contact_with_alias (f, &result, handle, "alice",
+      &n_notifies);
+  g_assert (result.error != NULL);
+  g_clear_error (&result.error);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, alias);
+  drop_contact (contact);
+  put_the_connection_back (f);
 
-  /* Support private text chats */
-  caps1 = g_ptr_array_sized_new (2);
-  add_text_chat_class (caps1, TP_HANDLE_TYPE_CONTACT);
-  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[0]), caps1);
+  tp_connection_set_contact_attributes_cache_enabled (f->client_conn, FALSE);
+  g_remove (filename);
+  g_free (filename);
+  reset_result (&result);
+  g_main_loop_unref (result.loop);
+}
 
-  /* Support text chatrooms */
-  caps2 = g_ptr_array_sized_new (1);
-  add_text_chat_class (caps2, TP_HANDLE_TYPE_ROOM);
-  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[1]), caps2);
+typedef struct {
+    guint n_emissions;
+    TpContactFeature feature;
+    guint n_contacts;
+} ContactsChanged;
 
-  /* Don't support anything */
-  caps3 = g_ptr_array_sized_new (0);
-  g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[2]), caps3);
+static void
+contacts_changed_cb (TpConnection *connection,
+    GPtrArray *contacts,
+    guint feature,
+    ContactsChanged *changed)
+{
+  changed->n_emissions++;
+  changed->feature = feature;
+  changed->n_contacts = contacts->len;
+}
 
-  return capabilities;
+static void
+count_presence_changed_cb (TpContact *contact,
+    guint type,
+    const gchar *status,
+    const gchar *message,
+    guint *count)
+{
+  (*count)++;
 }
 
 static void
-test_upgrade (Fixture *f,
+test_notification_batching (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
-  TpTestsContactsConnection *service_conn = f->service_conn;
-  TpConnection *client_conn = f->client_conn;
   Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  TpHandle handles[] = { 0, 0, 0 };
   static const gchar * const ids[] = { "alice", "bob", "chris" };
-  static const gchar * const aliases[] = { "Alice in Wonderland",
-      "Bob the Builder", "Christopher Robin" };
-  static const gchar * const tokens[] = { "aaaaa", "bbbbb", "ccccc" };
   static TpTestsContactsConnectionPresenceStatusIndex statuses[] = {
-      TP_TESTS_CONTACTS_CONNECTION_STATUS_AVAILABLE,
       TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY,
-      TP_TESTS_CONTACTS_CONNECTION_STATUS_AWAY };
-  static const gchar * const messages[] = { "", "Fixing it",
-      "GON OUT BACKSON" };
-  GHashTable *location_1 = tp_asv_new (
-      "country",  G_TYPE_STRING, "United Kingdom of Great Britain and Northern Ireland", NULL);
-  GHashTable *location_2 = tp_asv_new (
-      "country",  G_TYPE_STRING, "Atlantis", NULL);
-  GHashTable *location_3 = tp_asv_new (
-      "country",  G_TYPE_STRING, "Belgium", NULL);
-  GHashTable *locations[] = { location_1, location_2, location_3 };
-  GHashTable *capabilities;
-  TpHandleRepoIface *service_repo = tp_base_connection_get_handles (
-      (TpBaseConnection *) service_conn, TP_HANDLE_TYPE_CONTACT);
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY,
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY };
+  static const gchar * const messages[] = { "Fixing it", "Fixing it",
+      "Fixing it" };
+  TpContactFeature feature = TP_CONTACT_FEATURE_PRESENCE;
+  ContactsChanged changed = { 0, TP_CONTACT_FEATURE_INVALID, 0 };
+  guint n_notifies[3] = { 0, 0, 0 };
+  guint n_presence_changed[3] = { 0, 0, 0 };
+  TpHandle handles[3];
   TpContact *contacts[3];
-  TpContactFeature features[] = { TP_CONTACT_FEATURE_ALIAS,
-      TP_CONTACT_FEATURE_AVATAR_TOKEN, TP_CONTACT_FEATURE_PRESENCE,
-      TP_CONTACT_FEATURE_LOCATION, TP_CONTACT_FEATURE_CAPABILITIES };
   guint i;
 
   g_message (G_STRFUNC);
 
   for (i = 0; i < 3; i++)
-    handles[i] = tp_handle_ensure (service_repo, ids[i], NULL, NULL);
-
-  tp_tests_contacts_connection_change_aliases (service_conn, 3, handles,
-      aliases);
-  tp_tests_contacts_connection_change_presences (service_conn, 3, handles,
-      statuses, messages);
-  tp_tests_contacts_connection_change_avatar_tokens (service_conn, 3, handles,
-      tokens);
-  tp_tests_contacts_connection_change_locations (service_conn, 3, handles,
-      locations);
-
-  capabilities = create_contact_caps (handles);
-  tp_tests_contacts_connection_change_capabilities (service_conn, capabilities);
-  g_hash_table_unref (capabilities);
+    handles[i] = tp_handle_ensure (f->service_repo, ids[i], NULL, NULL);
 
-  tp_connection_get_contacts_by_handle (client_conn,
+  tp_connection_get_contacts_by_handle (f->client_conn,
       3, handles,
-      0, NULL,
+      1, &feature,
       by_handle_cb,
       &result, finish, NULL);
-
-  g_main_loop_run (result.loop);
-
-  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
-  MYASSERT (result.invalid->len == 0, ": %u", result.invalid->len);
-  g_assert_no_error (result.error);
-
-  MYASSERT (g_ptr_array_index (result.contacts, 0) != NULL, "");
-  MYASSERT (g_ptr_array_index (result.contacts, 1) != NULL, "");
-  MYASSERT (g_ptr_array_index (result.contacts, 2) != NULL, "");
-
-  for (i = 0; i < 3; i++)
-    contacts[i] = g_object_ref (g_ptr_array_index (result.contacts, i));
-
-  for (i = 0; i < 3; i++)
-    {
-      MYASSERT (tp_contact_get_connection (contacts[i]) == client_conn, "");
-      g_assert_cmpuint (tp_contact_get_handle (contacts[i]), ==, handles[i]);
-      g_assert_cmpstr (tp_contact_get_identifier (contacts[i]), ==,
-          ids[i]);
-      g_assert_cmpstr (tp_contact_get_alias (contacts[i]), ==,
-          tp_contact_get_identifier (contacts[i]));
-      MYASSERT (tp_contact_get_avatar_token (contacts[i]) == NULL,
-          ": %s", tp_contact_get_avatar_token (contacts[i]));
-      g_assert_cmpuint (tp_contact_get_presence_type (contacts[i]), ==,
-          TP_CONNECTION_PRESENCE_TYPE_UNSET);
-      g_assert_cmpstr (tp_contact_get_presence_status (contacts[i]), ==,
-          "");
-      g_assert_cmpstr (tp_contact_get_presence_message (contacts[i]), ==,
-          "");
-      MYASSERT (!tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_ALIAS), "");
-      MYASSERT (!tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_AVATAR_TOKEN), "");
-      MYASSERT (!tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_PRESENCE), "");
-      MYASSERT (!tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_LOCATION), "");
-      MYASSERT (!tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_CAPABILITIES), "");
-    }
-
-  /* clean up before doing the second request */
-  g_assert (result.error == NULL);
-  reset_result (&result);
-
-  tp_connection_upgrade_contacts (client_conn,
-      3, contacts,
-      G_N_ELEMENTS (features), features,
-      upgrade_cb,
-      &result, finish, NULL);
-
   g_main_loop_run (result.loop);
-
-  MYASSERT (result.contacts->len == 3, ": %u", result.contacts->len);
-  MYASSERT (result.invalid == NULL, "");
   g_assert_no_error (result.error);
 
+  tp_connection_set_contact_notification_batching (f->client_conn, TRUE);
+  g_signal_connect (f->client_conn, "contacts-changed",
+      G_CALLBACK (contacts_changed_cb), &changed);
+
   for (i = 0; i < 3; i++)
     {
-      MYASSERT (g_ptr_array_index (result.contacts, 0) == contacts[0], "");
+      contacts[i] = g_ptr_array_index (result.contacts, i);
+      g_signal_connect (contacts[i], "notify",
+          G_CALLBACK (count_notify_cb), &n_notifies[i]);
+      g_signal_connect (contacts[i], "presence-changed",
+          G_CALLBACK (count_presence_changed_cb), &n_presence_changed[i]);
     }
 
-  g_assert (result.invalid == NULL);
-  g_assert (result.error == NULL);
-  reset_result (&result);
+  /* Bob is being shown in detail */
+  tp_contact_set_notify_individually (contacts[1], TRUE);
 
-  for (i = 0; i < 3; i++)
-    {
-      GVariant *vardict;
+  tp_tests_contacts_connection_change_presences (f->service_conn, 3, handles,
+      statuses, messages);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
 
-      g_assert_cmpuint (tp_contact_get_handle (contacts[i]), ==, handles[i]);
-      g_assert_cmpstr (tp_contact_get_identifier (contacts[i]), ==,
-          ids[i]);
+  while (changed.n_emissions == 0)
+    g_main_context_iteration (NULL, TRUE);
 
-      MYASSERT (tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_ALIAS), "");
-      g_assert_cmpstr (tp_contact_get_alias (contacts[i]), ==,
-          aliases[i]);
+  /* one summary for everyone */
+  g_assert_cmpuint (changed.n_emissions, ==, 1);
+  g_assert_cmpuint (changed.feature, ==, TP_CONTACT_FEATURE_PRESENCE);
+  g_assert_cmpuint (changed.n_contacts, ==, 3);
 
-      MYASSERT (tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_AVATAR_TOKEN), "");
-      g_assert_cmpstr (tp_contact_get_avatar_token (contacts[i]), ==,
-          tokens[i]);
+  /* and individual notifications only for Bob */
+  g_assert_cmpuint (n_notifies[0], ==, 0);
+  g_assert_cmpuint (n_presence_changed[0], ==, 0);
+  g_assert_cmpuint (n_notifies[1], ==, 3);
+  g_assert_cmpuint (n_presence_changed[1], ==, 1);
+  g_assert_cmpuint (n_notifies[2], ==, 0);
+  g_assert_cmpuint (n_presence_changed[2], ==, 0);
 
-      MYASSERT (tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_PRESENCE), "");
+  for (i = 0; i < 3; i++)
+    {
       g_assert_cmpstr (tp_contact_get_presence_message (contacts[i]), ==,
-          messages[i]);
-
-      MYASSERT (tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_LOCATION), "");
+          "Fixing it");
+      g_signal_handlers_disconnect_by_func (contacts[i], count_notify_cb,
+          &n_notifies[i]);
+      g_signal_handlers_disconnect_by_func (contacts[i],
+          count_presence_changed_cb, &n_presence_changed[i]);
+      tp_handle_unref (f->service_repo, handles[i]);
+    }
 
-      vardict = tp_contact_dup_location (contacts[i]);
-      ASSERT_SAME_LOCATION (tp_contact_get_location (contacts[i]),
-          vardict, locations[i]);
-      g_variant_unref (vardict);
+  g_signal_handlers_disconnect_by_func (f->client_conn, contacts_changed_cb,
+      &changed);
+  tp_connection_set_contact_notification_batching (f->client_conn, FALSE);
+  reset_result (&result);
+  g_main_loop_unref (result.loop);
+}
 
-      g_object_get (contacts[i],
-          "location-vardict", &vardict,
-          NULL);
-      ASSERT_SAME_LOCATION (tp_contact_get_location (contacts[i]),
-          vardict, locations[i]);
-      g_variant_unref (vardict);
+typedef struct {
+    guint n_signals;
+    guint n_contacts;
+    gchar *alice_status;
+    TpHandle alice;
+} PresencesChanged;
 
-      MYASSERT (tp_contact_has_feature (contacts[i],
-            TP_CONTACT_FEATURE_CAPABILITIES), "");
-      MYASSERT (tp_contact_get_capabilities (contacts[i]) != NULL, "");
-    }
+static void
+presences_changed_cb (TpConnection *connection,
+    GHashTable *presences,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  PresencesChanged *changed = user_data;
+  GValueArray *presence = g_hash_table_lookup (presences,
+      GUINT_TO_POINTER (changed->alice));
 
-  g_assert_cmpuint (tp_contact_get_presence_type (contacts[0]), ==,
-      TP_CONNECTION_PRESENCE_TYPE_AVAILABLE);
-  g_assert_cmpstr (tp_contact_get_presence_status (contacts[0]), ==,
-      "available");
-  g_assert_cmpuint (tp_contact_get_presence_type (contacts[1]), ==,
-      TP_CONNECTION_PRESENCE_TYPE_BUSY);
-  g_assert_cmpstr (tp_contact_get_presence_status (contacts[1]), ==,
-      "busy");
-  g_assert_cmpuint (tp_contact_get_presence_type (contacts[2]), ==,
-      TP_CONNECTION_PRESENCE_TYPE_AWAY);
-  g_assert_cmpstr (tp_contact_get_presence_status (contacts[2]), ==,
-      "away");
+  changed->n_signals++;
+  changed->n_contacts = g_hash_table_size (presences);
 
-  for (i = 0; i < 3; i++)
+  if (presence != NULL)
     {
-      g_object_unref (contacts[i]);
-      tp_tests_proxy_run_until_dbus_queue_processed (client_conn);
-      tp_handle_unref (service_repo, handles[i]);
+      g_free (changed->alice_status);
+      changed->alice_status = g_value_dup_string (presence->values + 1);
     }
-
-  /* remaining cleanup */
-  g_hash_table_unref (location_1);
-  g_hash_table_unref (location_2);
-  g_hash_table_unref (location_3);
-  g_main_loop_unref (result.loop);
 }
 
-/* Regression test case for fd.o#41414 */
 static void
-test_upgrade_noop (Fixture *f,
+test_presence_coalescing (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
 {
-  Result result = { g_main_loop_new (NULL, FALSE), NULL, NULL, NULL };
-  TpHandle handle;
-  TpContact *contact;
+  static const gchar * const ids[] = { "alice", "bob" };
+  static TpTestsContactsConnectionPresenceStatusIndex first[] = {
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_BUSY,
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_AVAILABLE };
+  static TpTestsContactsConnectionPresenceStatusIndex second[] = {
+      TP_TESTS_CONTACTS_CONNECTION_STATUS_AWAY };
+  static const gchar * const messages[] = { "", "" };
+  PresencesChanged changed = { 0, 0, NULL, 0 };
+  TpProxySignalConnection *signal_id;
+  GError *error = NULL;
+  TpHandle handles[2];
+  guint i;
 
-  g_test_bug ("41414");
+  g_message (G_STRFUNC);
 
-  /* Get a contact by handle */
-  handle = get_handle_with_no_caps (f, "test-upgrade-noop");
-  tp_connection_get_contacts_by_handle (f->client_conn,
-      1, &handle,
-      G_N_ELEMENTS (all_contact_features), all_contact_features,
-      by_handle_cb,
-      &result, finish, NULL);
-  g_main_loop_run (result.loop);
-  g_assert_no_error (result.error);
+  for (i = 0; i < 2; i++)
+    handles[i] = tp_handle_ensure (f->service_repo, ids[i], NULL, NULL);
 
-  contact = g_object_ref (g_ptr_array_index (result.contacts, 0));
-  reset_result (&result);
+  changed.alice = handles[0];
+  signal_id =
+    tp_cli_connection_interface_simple_presence_connect_to_presences_changed (
+        f->client_conn, presences_changed_cb, &changed, NULL, NULL, &error);
+  g_assert_no_error (error);
 
-  /* Upgrade it, but it should already have all features */
-  make_the_connection_disappear (f);
-  tp_connection_upgrade_contacts (f->client_conn,
-      1, &contact,
-      G_N_ELEMENTS (all_contact_features), all_contact_features,
-      upgrade_cb,
-      &result, finish, NULL);
-  g_main_loop_run (result.loop);
-  g_assert_no_error (result.error);
-  reset_result (&result);
+  tp_presence_mixin_set_coalescing ((GObject *) f->service_conn, TRUE, 0);
 
-  put_the_connection_back (f);
+  /* Alice changes twice, Bob once: only Alice's latest presence is
+   * emitted, together with Bob's */
+  tp_tests_contacts_connection_change_presences (f->service_conn, 2, handles,
+      first, messages);
+  tp_tests_contacts_connection_change_presences (f->service_conn, 1, handles,
+      second, messages);
 
-  g_object_unref (contact);
+  while (changed.n_signals == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+
+  g_assert_cmpuint (changed.n_signals, ==, 1);
+  g_assert_cmpuint (changed.n_contacts, ==, 2);
+  g_assert_cmpstr (changed.alice_status, ==, "away");
+
+  /* without coalescing, each change is emitted straight away */
+  tp_presence_mixin_set_coalescing ((GObject *) f->service_conn, FALSE, 0);
+  tp_tests_contacts_connection_change_presences (f->service_conn, 1, handles,
+      first, messages);
+  tp_tests_contacts_connection_change_presences (f->service_conn, 1, handles,
+      second, messages);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (changed.n_signals, ==, 3);
+
+  tp_proxy_signal_connection_disconnect (signal_id);
+  g_free (changed.alice_status);
+
+  for (i = 0; i < 2; i++)
+    tp_handle_unref (f->service_repo, handles[i]);
 }
 
 typedef struct
@@ -2067,6 +3258,103 @@ test_by_id (Fixture *f,
 }
 
 
+typedef struct {
+    GMainLoop *loop;
+    guint n_pending;
+    TpContact *contacts[2];
+} ByIdAsyncResult;
+
+static void
+dup_by_id_async_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  ByIdAsyncResult *result = user_data;
+  GError *error = NULL;
+  guint i = 2 - result->n_pending;
+
+  result->contacts[i] = tp_connection_dup_contact_by_id_finish (
+      TP_CONNECTION (source), res, &error);
+  g_assert_no_error (error);
+  g_assert (result->contacts[i] != NULL);
+
+  if (--result->n_pending == 0)
+    g_main_loop_quit (result->loop);
+}
+
+static void
+count_attributes_received_cb (TpConnection *connection,
+    GPtrArray *contacts,
+    guint n_done,
+    guint n_total,
+    guint *count)
+{
+  (*count)++;
+}
+
+static void
+test_by_id_cached (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  Result result = { g_main_loop_new (NULL, FALSE) };
+  ByIdAsyncResult async_result = { result.loop, 2, { NULL, NULL } };
+  TpContactFeature alias = TP_CONTACT_FEATURE_ALIAS;
+  static const gchar * const ids[] = { "Alice", NULL };
+  guint n_received = 0;
+
+  g_signal_connect (f->client_conn, "contact-attributes-received",
+      G_CALLBACK (count_attributes_received_cb), &n_received);
+
+  /* two requests for the same contact in the same main loop iteration are
+   * answered by one set of D-Bus calls */
+  tp_connection_dup_contact_by_id_async (f->client_conn, "Alice",
+      1, &alias, dup_by_id_async_cb, &async_result);
+  tp_connection_dup_contact_by_id_async (f->client_conn, "alice",
+      0, NULL, dup_by_id_async_cb, &async_result);
+  g_main_loop_run (result.loop);
+
+  g_assert_cmpuint (n_received, ==, 1);
+  g_assert (async_result.contacts[0] == async_result.contacts[1]);
+  g_assert_cmpstr (tp_contact_get_identifier (async_result.contacts[0]), ==,
+      "alice");
+  g_assert (tp_contact_has_feature (async_result.contacts[0],
+        TP_CONTACT_FEATURE_ALIAS));
+  g_object_unref (async_result.contacts[1]);
+
+  /* now that the ID is known and the contact has the feature, asking again
+   * doesn't need to go to the connection manager at all */
+  async_result.n_pending = 1;
+  async_result.contacts[1] = NULL;
+  tp_connection_dup_contact_by_id_async (f->client_conn, "Alice",
+      1, &alias, dup_by_id_async_cb, &async_result);
+  g_main_loop_run (result.loop);
+
+  g_assert_cmpuint (n_received, ==, 1);
+  g_assert (async_result.contacts[1] == async_result.contacts[0]);
+  g_object_unref (async_result.contacts[1]);
+
+  tp_connection_get_contacts_by_id (f->client_conn,
+      1, ids,
+      1, &alias,
+      by_id_cb,
+      &result, finish, NULL);
+  g_main_loop_run (result.loop);
+  g_assert_no_error (result.error);
+
+  g_assert_cmpuint (n_received, ==, 1);
+  g_assert_cmpuint (result.contacts->len, ==, 1);
+  g_assert (g_ptr_array_index (result.contacts, 0) ==
+      async_result.contacts[0]);
+  g_assert_cmpstr (result.good_ids[0], ==, "Alice");
+
+  g_signal_handlers_disconnect_by_func (f->client_conn,
+      count_attributes_received_cb, &n_received);
+  g_object_unref (async_result.contacts[0]);
+  reset_result (&result);
+  g_main_loop_unref (result.loop);
+}
+
+
 static void
 test_capabilities_without_contact_caps (Fixture *f,
     gconstpointer unused G_GNUC_UNUSED)
@@ -2247,6 +3535,48 @@ test_dup_if_possible (Fixture *f,
   g_object_unref (alice);
 }
 
+static void
+test_ensure_contacts (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpSimpleClientFactory *factory = tp_proxy_get_factory (f->client_conn);
+  const gchar * const ids[] = { "alice", "bob", "alice", NULL };
+  TpHandle handles[3];
+  GPtrArray *contacts;
+  TpContact *contact;
+  guint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      handles[i] = tp_handle_ensure (f->service_repo, ids[i], NULL, NULL);
+      g_assert_cmpuint (handles[i], !=, 0);
+    }
+
+  contacts = tp_simple_client_factory_ensure_contacts (factory,
+      f->client_conn, 3, handles, ids);
+  g_assert (contacts != NULL);
+  g_assert_cmpuint (contacts->len, ==, 3);
+
+  for (i = 0; i < 3; i++)
+    {
+      contact = g_ptr_array_index (contacts, i);
+      g_assert_cmpuint (tp_contact_get_handle (contact), ==, handles[i]);
+      g_assert_cmpstr (tp_contact_get_identifier (contact), ==, ids[i]);
+    }
+
+  /* the same identifier twice gives the same object */
+  g_assert (g_ptr_array_index (contacts, 0) ==
+      g_ptr_array_index (contacts, 2));
+
+  /* and the single-contact variant finds the one we just created */
+  contact = tp_simple_client_factory_ensure_contact (factory,
+      f->client_conn, handles[1], ids[1]);
+  g_assert (contact == g_ptr_array_index (contacts, 1));
+  g_object_unref (contact);
+
+  g_ptr_array_unref (contacts);
+}
+
 typedef struct
 {
   TpSubscriptionState subscribe;
@@ -2428,8 +3758,210 @@ test_contact_groups (Fixture *f,
       (const gchar * const *) data.groups->pdata, NULL, NULL);
   g_main_loop_run (data.loop);
 
-  g_ptr_array_unref (data.groups);
-  g_object_unref (alice);
+  g_ptr_array_unref (data.groups);
+  g_object_unref (alice);
+}
+
+typedef struct
+{
+  guint n_signals;
+  guint n_changes;
+  guint n_removals;
+  TpHandle last_changed;
+  TpHandle last_removed;
+} ContactListChanges;
+
+static void
+contacts_changed_with_id_cb (TpConnection *connection,
+    GHashTable *changes,
+    GHashTable *identifiers,
+    GHashTable *removals,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  ContactListChanges *data = user_data;
+  GHashTableIter iter;
+  gpointer key;
+
+  data->n_signals++;
+  data->n_changes += g_hash_table_size (changes);
+  data->n_removals += g_hash_table_size (removals);
+
+  g_hash_table_iter_init (&iter, changes);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    data->last_changed = GPOINTER_TO_UINT (key);
+
+  g_hash_table_iter_init (&iter, removals);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    data->last_removed = GPOINTER_TO_UINT (key);
+}
+
+static void
+test_contact_list_batching (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpHandle alice_handle, bob_handle;
+  TpBaseContactList *manager;
+  ContactListChanges data = { 0 };
+  TpProxySignalConnection *sc;
+  GError *error = NULL;
+
+  manager = TP_BASE_CONTACT_LIST (
+      tp_tests_contacts_connection_get_contact_list_manager (
+          f->service_conn));
+
+  alice_handle = tp_handle_ensure (f->service_repo, "alice", NULL, NULL);
+  bob_handle = tp_handle_ensure (f->service_repo, "bob", NULL, NULL);
+
+  sc = tp_cli_connection_interface_contact_list_connect_to_contacts_changed_with_id (
+      f->client_conn, contacts_changed_with_id_cb, &data, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  tp_base_contact_list_begin_batch (manager);
+  /* nested batches are only flushed by the outermost end_batch() */
+  tp_base_contact_list_begin_batch (manager);
+
+  tp_tests_contact_list_manager_request_subscription (
+      (TpTestsContactListManager *) manager, 1, &alice_handle, "");
+  tp_tests_contact_list_manager_request_subscription (
+      (TpTestsContactListManager *) manager, 1, &bob_handle, "");
+  tp_tests_contact_list_manager_remove (
+      (TpTestsContactListManager *) manager, 1, &bob_handle);
+
+  tp_base_contact_list_end_batch (manager);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (data.n_signals, ==, 0);
+
+  tp_base_contact_list_end_batch (manager);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+
+  /* bob was added and then removed, so only his removal is signalled */
+  g_assert_cmpuint (data.n_signals, ==, 1);
+  g_assert_cmpuint (data.n_changes, ==, 1);
+  g_assert_cmpuint (data.n_removals, ==, 1);
+  g_assert_cmpuint (data.last_changed, ==, alice_handle);
+  g_assert_cmpuint (data.last_removed, ==, bob_handle);
+
+  /* outside a batch, each change is signalled as it happens */
+  tp_tests_contact_list_manager_remove (
+      (TpTestsContactListManager *) manager, 1, &alice_handle);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (data.n_signals, ==, 2);
+  g_assert_cmpuint (data.last_removed, ==, alice_handle);
+
+  tp_proxy_signal_connection_disconnect (sc);
+}
+
+typedef struct
+{
+  GMainLoop *loop;
+  GHashTable *changed;
+  GHashTable *unchanged;
+  gchar *version;
+  GError *error;
+} ContactListChangesSince;
+
+static void
+contact_list_changes_since_cb (TpConnection *connection,
+    GHashTable *changed,
+    GHashTable *unchanged,
+    const gchar *new_version,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  ContactListChangesSince *data = user_data;
+
+  tp_clear_pointer (&data->changed, g_hash_table_unref);
+  tp_clear_pointer (&data->unchanged, g_hash_table_unref);
+  g_clear_error (&data->error);
+
+  if (error == NULL)
+    {
+      data->changed = g_hash_table_ref (changed);
+      data->unchanged = g_hash_table_ref (unchanged);
+      g_free (data->version);
+      data->version = g_strdup (new_version);
+    }
+  else
+    {
+      data->error = g_error_copy (error);
+    }
+
+  g_main_loop_quit (data->loop);
+}
+
+static void
+get_contact_list_changes_since (Fixture *f,
+    ContactListChangesSince *data,
+    const gchar *version)
+{
+  const gchar *interfaces[] = { NULL };
+
+  tp_cli_connection_interface_contact_list_call_get_contact_list_changes_since (
+      f->client_conn, -1, version, interfaces, contact_list_changes_since_cb,
+      data, NULL, NULL);
+  g_main_loop_run (data->loop);
+}
+
+static void
+test_contact_list_versions (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpHandle alice_handle, bob_handle;
+  TpTestsContactListManager *manager;
+  ContactListChangesSince data = { f->result.loop, NULL, NULL, NULL, NULL };
+  gchar *first_version;
+
+  manager = tp_tests_contacts_connection_get_contact_list_manager (
+      f->service_conn);
+
+  alice_handle = tp_handle_ensure (f->service_repo, "alice", NULL, NULL);
+  bob_handle = tp_handle_ensure (f->service_repo, "bob", NULL, NULL);
+
+  tp_tests_contact_list_manager_request_subscription (manager, 1,
+      &alice_handle, "");
+
+  /* with no version, everything has changed */
+  get_contact_list_changes_since (f, &data, "");
+  g_assert_no_error (data.error);
+  g_assert_cmpuint (g_hash_table_size (data.changed), ==, 1);
+  g_assert (g_hash_table_lookup (data.changed,
+        GUINT_TO_POINTER (alice_handle)) != NULL);
+  g_assert_cmpuint (g_hash_table_size (data.unchanged), ==, 0);
+  first_version = g_strdup (data.version);
+
+  tp_tests_contact_list_manager_request_subscription (manager, 1,
+      &bob_handle, "");
+
+  /* only bob has changed since then; alice is only listed by name */
+  get_contact_list_changes_since (f, &data, first_version);
+  g_assert_no_error (data.error);
+  g_assert_cmpuint (g_hash_table_size (data.changed), ==, 1);
+  g_assert (g_hash_table_lookup (data.changed,
+        GUINT_TO_POINTER (bob_handle)) != NULL);
+  g_assert_cmpuint (g_hash_table_size (data.unchanged), ==, 1);
+  g_assert_cmpstr (g_hash_table_lookup (data.unchanged,
+        GUINT_TO_POINTER (alice_handle)), ==, "alice");
+  g_assert_cmpstr (data.version, !=, first_version);
+
+  /* nothing has changed since the latest version */
+  get_contact_list_changes_since (f, &data, data.version);
+  g_assert_no_error (data.error);
+  g_assert_cmpuint (g_hash_table_size (data.changed), ==, 0);
+  g_assert_cmpuint (g_hash_table_size (data.unchanged), ==, 2);
+
+  /* a version the CM has never heard of means the client must start again */
+  get_contact_list_changes_since (f, &data, "not a version");
+  g_assert_error (data.error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT);
+
+  tp_clear_pointer (&data.changed, g_hash_table_unref);
+  tp_clear_pointer (&data.unchanged, g_hash_table_unref);
+  g_clear_error (&data.error);
+  g_free (data.version);
+  g_free (first_version);
 }
 
 static void
@@ -2459,6 +3991,7 @@ test_no_location (Fixture *f,
   gpointer weak_pointer;
   TpContactFeature feature = TP_CONTACT_FEATURE_LOCATION;
   GHashTable *norway = tp_asv_new ("country",  G_TYPE_STRING, "Norway", NULL);
+  GHashTable *sweden = tp_asv_new ("country",  G_TYPE_STRING, "Sweden", NULL);
   notify_ctx notify_ctx_alice;
   GVariant *vardict;
 
@@ -2518,6 +4051,21 @@ test_no_location (Fixture *f,
   g_assert (notify_ctx_alice.location_vardict_changed);
   vardict = tp_contact_dup_location (contact);
   ASSERT_SAME_LOCATION (tp_contact_get_location (contact), vardict, norway);
+  g_assert (g_variant_equal (vardict,
+        tp_contact_get_location_vardict (contact)));
+
+  /* a new location replaces the borrowed variant, but not our copy */
+  tp_tests_contacts_connection_change_locations (f->service_conn,
+      1, &handle, &sweden);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  ASSERT_SAME_LOCATION (tp_contact_get_location (contact),
+      tp_contact_get_location_vardict (contact), sweden);
+  g_assert_cmpstr (tp_vardict_get_string (vardict, "country"), ==, "Norway");
+  g_variant_unref (vardict);
+
+  vardict = tp_contact_dup_location (contact);
+  g_assert (g_variant_equal (vardict,
+        tp_contact_get_location_vardict (contact)));
   g_variant_unref (vardict);
 
   weak_pointer = contact;
@@ -2573,6 +4121,181 @@ test_no_location (Fixture *f,
   g_assert (weak_pointer == NULL);
 
   tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_hash_table_unref (norway);
+  g_hash_table_unref (sweden);
+}
+
+static GHashTable *
+new_position (gdouble lat,
+    gdouble lon)
+{
+  return tp_asv_new (
+      "lat", G_TYPE_DOUBLE, lat,
+      "lon", G_TYPE_DOUBLE, lon,
+      "country", G_TYPE_STRING, "United Kingdom",
+      NULL);
+}
+
+static void
+change_position (Fixture *f,
+    TpHandle handle,
+    gdouble lat,
+    gdouble lon)
+{
+  GHashTable *location = new_position (lat, lon);
+
+  tp_tests_contacts_connection_change_locations (f->service_conn,
+      1, &handle, &location);
+  g_hash_table_unref (location);
+}
+
+static void
+test_location_update_filter (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  TpContactFeature feature = TP_CONTACT_FEATURE_LOCATION;
+  TpContact *contact;
+  TpHandle handle;
+  GHashTable *location;
+  guint n_notifies = 0;
+
+  contact = tp_tests_connection_run_until_contact_by_id (f->client_conn,
+      "alice", 1, &feature);
+  handle = tp_contact_get_handle (contact);
+  g_signal_connect (contact, "notify::location",
+      G_CALLBACK (count_notify_cb), &n_notifies);
+
+  tp_connection_set_location_update_filter (f->client_conn, 0, 100);
+
+  change_position (f, handle, 51.5, -0.12);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 1);
+
+  /* about 11m north: ignored */
+  change_position (f, handle, 51.5001, -0.12);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 1);
+  location = tp_contact_get_location (contact);
+  g_assert_cmpfloat (tp_asv_get_double (location, "lat", NULL), ==, 51.5);
+  g_assert_cmpstr (tp_asv_get_string (location, "country"), ==,
+      "United Kingdom");
+  g_assert_cmpuint (g_hash_table_size (location), ==, 3);
+
+  /* about 1km north: applied */
+  change_position (f, handle, 51.51, -0.12);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 2);
+  location = tp_contact_get_location (contact);
+  g_assert_cmpfloat (tp_asv_get_double (location, "lat", NULL), ==, 51.51);
+
+  /* exactly the same location is never notified, even without a filter */
+  tp_connection_set_location_update_filter (f->client_conn, 0, 0);
+  change_position (f, handle, 51.51, -0.12);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 2);
+
+  /* with a minimum interval, updates arriving soon after a change are held
+   * back, and only the most recent of them is applied once the interval has
+   * passed */
+  change_position (f, handle, 52.2, 0.12);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 3);
+
+  tp_connection_set_location_update_filter (f->client_conn, 500, 0);
+  change_position (f, handle, 52.21, 0.13);
+  change_position (f, handle, 52.22, 0.14);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+  g_assert_cmpuint (n_notifies, ==, 3);
+  location = tp_contact_get_location (contact);
+  g_assert_cmpfloat (tp_asv_get_double (location, "lat", NULL), ==, 52.2);
+
+  while (n_notifies < 4)
+    g_main_context_iteration (NULL, TRUE);
+
+  location = tp_contact_get_location (contact);
+  g_assert_cmpfloat (tp_asv_get_double (location, "lat", NULL), ==, 52.22);
+  g_assert_cmpfloat (tp_asv_get_double (location, "lon", NULL), ==, 0.14);
+
+  g_signal_handlers_disconnect_by_func (contact, count_notify_cb,
+      &n_notifies);
+  g_object_unref (contact);
+}
+
+static GHashTable *
+create_same_contact_caps (const TpHandle *handles,
+    guint n)
+{
+  GHashTable *capabilities;
+  guint i;
+
+  capabilities = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) free_rcc_list);
+
+  for (i = 0; i < n; i++)
+    {
+      GPtrArray *caps = g_ptr_array_sized_new (1);
+
+      add_text_chat_class (caps, TP_HANDLE_TYPE_CONTACT);
+      g_hash_table_insert (capabilities, GUINT_TO_POINTER (handles[i]),
+          caps);
+    }
+
+  return capabilities;
+}
+
+static void
+test_capabilities_shared (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  static const gchar * const ids[] = { "alice", "bob" };
+  TpContactFeature feature = TP_CONTACT_FEATURE_CAPABILITIES;
+  TpContact *contacts[2];
+  TpHandle handles[2];
+  GHashTable *capabilities;
+  TpCapabilities *caps;
+  guint n_notifies = 0;
+  guint i;
+
+  for (i = 0; i < 2; i++)
+    handles[i] = tp_handle_ensure (f->service_repo, ids[i], NULL, NULL);
+
+  capabilities = create_same_contact_caps (handles, 2);
+  tp_tests_contacts_connection_change_capabilities (f->service_conn,
+      capabilities);
+  g_hash_table_unref (capabilities);
+
+  for (i = 0; i < 2; i++)
+    contacts[i] = tp_tests_connection_run_until_contact_by_id (
+        f->client_conn, ids[i], 1, &feature);
+
+  /* contacts with the same capabilities share a TpCapabilities */
+  caps = tp_contact_get_capabilities (contacts[0]);
+  g_assert (caps != NULL);
+  g_assert (tp_capabilities_is_specific_to_contact (caps));
+  g_assert (tp_capabilities_supports_text_chats (caps));
+  g_assert (tp_contact_get_capabilities (contacts[1]) == caps);
+
+  /* receiving the same capabilities again is not a change */
+  g_signal_connect (contacts[0], "notify::capabilities",
+      G_CALLBACK (count_notify_cb), &n_notifies);
+
+  capabilities = create_same_contact_caps (handles, 1);
+  tp_tests_contacts_connection_change_capabilities (f->service_conn,
+      capabilities);
+  g_hash_table_unref (capabilities);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+
+  g_assert_cmpuint (n_notifies, ==, 0);
+  g_assert (tp_contact_get_capabilities (contacts[0]) == caps);
+
+  g_signal_handlers_disconnect_by_func (contacts[0], count_notify_cb,
+      &n_notifies);
+
+  for (i = 0; i < 2; i++)
+    {
+      g_object_unref (contacts[i]);
+      tp_handle_unref (f->service_repo, handles[i]);
+    }
 }
 
 static void
@@ -2761,6 +4484,73 @@ test_contact_list (Fixture *f,
   g_ptr_array_unref (contacts);
 }
 
+static void
+count_contact_list_changed_cb (TpConnection *connection,
+    GPtrArray *added,
+    GPtrArray *removed,
+    gpointer user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
+static void
+test_contact_list_merged_changes (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  const GQuark feature_connected[] = { TP_CONNECTION_FEATURE_CONNECTED, 0 };
+  TpTestsContactListManager *manager;
+  TpHandle alice, bob, carol;
+  GPtrArray *contacts;
+  guint n_changed = 0;
+  guint queued;
+  guint64 merged_signals, merged_contacts;
+
+  manager = tp_tests_contacts_connection_get_contact_list_manager (
+      f->service_conn);
+  alice = tp_handle_ensure (f->service_repo, "alice", NULL, NULL);
+  bob = tp_handle_ensure (f->service_repo, "bob", NULL, NULL);
+  carol = tp_handle_ensure (f->service_repo, "carol", NULL, NULL);
+
+  tp_tests_proxy_run_until_prepared (f->client_conn, conn_features);
+  tp_cli_connection_call_connect (f->client_conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (f->client_conn, feature_connected);
+
+  while (tp_connection_get_contact_list_state (f->client_conn) !=
+      TP_CONTACT_LIST_STATE_SUCCESS)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_signal_connect (f->client_conn, "contact-list-changed",
+      G_CALLBACK (count_contact_list_changed_cb), &n_changed);
+
+  /* The first change is applied straight away, the second waits for it,
+   * and the others are merged into the second */
+  tp_tests_contact_list_manager_request_subscription (manager, 1, &alice, "");
+  tp_tests_contact_list_manager_request_subscription (manager, 1, &bob, "");
+  tp_tests_contact_list_manager_request_subscription (manager, 1, &carol, "");
+  tp_tests_contact_list_manager_request_subscription (manager, 1, &bob, "");
+
+  contacts = tp_connection_dup_contact_list (f->client_conn);
+
+  while (contacts->len < 3)
+    {
+      g_main_context_iteration (NULL, TRUE);
+      g_ptr_array_unref (contacts);
+      contacts = tp_connection_dup_contact_list (f->client_conn);
+    }
+
+  g_ptr_array_unref (contacts);
+  g_assert_cmpuint (n_changed, ==, 2);
+
+  tp_connection_get_contact_list_queue_stats (f->client_conn, &queued,
+      &merged_signals, &merged_contacts);
+  g_assert_cmpuint (queued, ==, 0);
+  g_assert_cmpuint (merged_signals, ==, 2);
+  g_assert_cmpuint (merged_contacts, ==, 1);
+}
+
 typedef struct
 {
   Fixture *f;
@@ -2935,6 +4725,228 @@ test_self_contact (Fixture *f,
   g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_ALIAS));
 }
 
+static void
+contact_attributes_changed_cb (TpConnection *connection,
+    GHashTable *attributes,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  guint *n_changed = user_data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, attributes);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      g_assert (tp_asv_get_strv (value,
+            TP_TOKEN_CONNECTION_INTERFACE_CONTACTS_CHANGED_INTERFACES)
+          != NULL);
+      g_assert (tp_asv_get_string (value,
+            TP_TOKEN_CONNECTION_CONTACT_ID) != NULL);
+    }
+
+  (*n_changed)++;
+}
+
+static void
+test_contact_attributes_changed (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  const GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONNECTED, 0 };
+  TpContactFeature features[] = { TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_LOCATION };
+  GHashTable *norway = tp_asv_new ("country", G_TYPE_STRING, "Norway", NULL);
+  const gchar *new_alias = "Alice in Norway";
+  notify_ctx notify_ctx_alice;
+  TpHandle handle;
+  TpContact *contact;
+  GVariant *vardict;
+  guint n_changed = 0;
+
+  /* the service has to advertise the interfaces before the client has
+   * introspected it */
+  tp_tests_contacts_connection_set_notify_contact_attributes (
+      f->service_conn);
+
+  tp_cli_connection_call_connect (f->client_conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (f->client_conn, conn_features);
+
+  tp_cli_connection_interface_contacts_connect_to_contact_attributes_changed (
+      f->client_conn, contact_attributes_changed_cb, &n_changed, NULL, NULL,
+      NULL);
+
+  handle = tp_handle_ensure (f->service_repo, "alice", NULL, NULL);
+  g_assert_cmpuint (handle, !=, 0);
+
+  tp_connection_get_contacts_by_handle (f->client_conn,
+      1, &handle,
+      G_N_ELEMENTS (features), features,
+      by_handle_cb,
+      &f->result, finish, NULL);
+  g_main_loop_run (f->result.loop);
+  g_assert_no_error (f->result.error);
+  g_assert_cmpuint (f->result.contacts->len, ==, 1);
+
+  contact = g_object_ref (g_ptr_array_index (f->result.contacts, 0));
+  assert_no_location (contact);
+  reset_result (&f->result);
+
+  notify_ctx_init (&notify_ctx_alice);
+  g_signal_connect (contact, "notify",
+      G_CALLBACK (contact_notify_cb), &notify_ctx_alice);
+
+  tp_tests_contacts_connection_change_aliases (f->service_conn,
+      1, &handle, &new_alias);
+  tp_tests_contacts_connection_change_locations (f->service_conn,
+      1, &handle, &norway);
+  tp_tests_proxy_run_until_dbus_queue_processed (f->client_conn);
+
+  /* one delta per interface, and the contact picked both of them up */
+  g_assert_cmpuint (n_changed, ==, 2);
+  g_assert (notify_ctx_alice.alias_changed);
+  g_assert (notify_ctx_alice.location_changed);
+  g_assert_cmpstr (tp_contact_get_alias (contact), ==, new_alias);
+  vardict = tp_contact_dup_location (contact);
+  ASSERT_SAME_LOCATION (tp_contact_get_location (contact), vardict, norway);
+  g_variant_unref (vardict);
+
+  g_signal_handlers_disconnect_by_func (contact, contact_notify_cb,
+      &notify_ctx_alice);
+  g_object_unref (contact);
+  g_hash_table_unref (norway);
+}
+
+static void
+setup_addressing_conn (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  tp_tests_create_and_connect_conn (TP_TESTS_TYPE_ADDRESSING_CONNECTION,
+      "me@test.com", &f->base_connection, &f->client_conn);
+
+  f->service_conn = TP_TESTS_CONTACTS_CONNECTION (f->base_connection);
+  g_object_ref (f->service_conn);
+
+  f->service_repo = tp_base_connection_get_handles (f->base_connection,
+      TP_HANDLE_TYPE_CONTACT);
+  f->result.loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+by_address_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GHashTable **contacts = user_data;
+  GError *error = NULL;
+
+  g_assert (*contacts == NULL);
+  *contacts = tp_connection_dup_contacts_by_uris_finish (
+      TP_CONNECTION (source), res, &error);
+  g_assert_no_error (error);
+  g_assert (*contacts != NULL);
+}
+
+static void
+by_vcard_field_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  GHashTable **contacts = user_data;
+  GError *error = NULL;
+
+  g_assert (*contacts == NULL);
+  *contacts = tp_connection_dup_contacts_by_vcard_field_finish (
+      TP_CONNECTION (source), res, &error);
+  g_assert_no_error (error);
+  g_assert (*contacts != NULL);
+}
+
+static void
+test_by_address (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  static const gchar * const uris[] = { "xmpp:Alice@example.com",
+      "tel:+15551234", "mailto:nobody@example.com", "xmpp:Not valid",
+      NULL };
+  static const gchar * const jids[] = { "bob@example.com",
+      "alice@example.com", NULL };
+  TpContactFeature features[] = { TP_CONTACT_FEATURE_ALIAS,
+      TP_CONTACT_FEATURE_PRESENCE };
+  GHashTable *contacts = NULL;
+  TpContact *alice, *contact;
+
+  tp_connection_dup_contacts_by_uris_async (f->client_conn, uris,
+      G_N_ELEMENTS (features), features, by_address_cb, &contacts);
+
+  while (contacts == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the unsupported and invalid addresses are just left out */
+  g_assert_cmpuint (g_hash_table_size (contacts), ==, 2);
+
+  alice = g_hash_table_lookup (contacts, "xmpp:Alice@example.com");
+  g_assert (TP_IS_CONTACT (alice));
+  g_assert_cmpstr (tp_contact_get_identifier (alice), ==,
+      "alice@example.com");
+  g_assert (tp_contact_has_feature (alice, TP_CONTACT_FEATURE_ALIAS));
+  g_assert (tp_contact_has_feature (alice, TP_CONTACT_FEATURE_PRESENCE));
+  g_object_ref (alice);
+
+  contact = g_hash_table_lookup (contacts, "tel:+15551234");
+  g_assert (TP_IS_CONTACT (contact));
+  g_assert_cmpstr (tp_contact_get_identifier (contact), ==, "+15551234");
+  g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_ALIAS));
+
+  tp_clear_pointer (&contacts, g_hash_table_unref);
+
+  /* the same contact comes back, whichever way it was looked up */
+  tp_connection_dup_contacts_by_vcard_field_async (f->client_conn,
+      "x-jabber", jids, G_N_ELEMENTS (features), features,
+      by_vcard_field_cb, &contacts);
+
+  while (contacts == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (g_hash_table_size (contacts), ==, 2);
+  g_assert (g_hash_table_lookup (contacts, "alice@example.com") == alice);
+
+  contact = g_hash_table_lookup (contacts, "bob@example.com");
+  g_assert (TP_IS_CONTACT (contact));
+  g_assert_cmpstr (tp_contact_get_identifier (contact), ==,
+      "bob@example.com");
+  g_assert (tp_contact_has_feature (contact, TP_CONTACT_FEATURE_PRESENCE));
+
+  tp_clear_pointer (&contacts, g_hash_table_unref);
+  g_object_unref (alice);
+}
+
+static void
+by_address_unsupported_cb (GObject *source,
+    GAsyncResult *res,
+    gpointer user_data)
+{
+  Result *result = user_data;
+
+  g_assert (tp_connection_dup_contacts_by_uris_finish (
+        TP_CONNECTION (source), res, &result->error) == NULL);
+  g_main_loop_quit (result->loop);
+}
+
+static void
+test_by_address_unsupported (Fixture *f,
+    gconstpointer unused G_GNUC_UNUSED)
+{
+  static const gchar * const uris[] = { "xmpp:alice@example.com", NULL };
+
+  tp_connection_dup_contacts_by_uris_async (f->client_conn, uris,
+      0, NULL, by_address_unsupported_cb, &f->result);
+  g_main_loop_run (f->result.loop);
+
+  g_assert_error (f->result.error, TP_DBUS_ERRORS,
+      TP_DBUS_ERROR_NO_INTERFACE);
+}
+
 static void
 setup_internal (Fixture *f,
     gboolean connect,
@@ -3033,18 +5045,31 @@ main (int argc,
   ADD (by_handle);
   ADD (by_handle_again);
   ADD (by_handle_upgrade);
+  ADD (by_handle_batched);
   ADD (no_features);
   ADD (features);
   ADD (upgrade);
   ADD (upgrade_noop);
+  ADD (upgrade_coalesced);
+  ADD (attributes_cache);
+  ADD (notification_batching);
+  ADD (presence_coalescing);
   ADD (by_id);
+  ADD (by_id_cached);
   ADD (avatar_requirements);
   ADD (avatar_data);
   ADD (avatar_data_after_token);
+  ADD (avatar_data_shared);
+  ADD (avatar_data_lazy);
+  ADD (avatar_data_files);
+  ADD (base_avatars);
   ADD (contact_info);
   ADD (dup_if_possible);
+  ADD (ensure_contacts);
   ADD (subscription_states);
   ADD (contact_groups);
+  ADD (contact_list_batching);
+  ADD (contact_list_versions);
 
   /* test if TpContact fallbacks to connection's capabilities if
    * ContactCapabilities is not implemented. */
@@ -3056,6 +5081,8 @@ main (int argc,
   ADD (prepare_contact_caps_without_request);
 
   ADD (no_location);
+  ADD (location_update_filter);
+  ADD (capabilities_shared);
 
   g_test_add ("/contacts/superfluous-attributes", Fixture, NULL,
       setup_broken_client_types_conn, test_superfluous_attributes,
@@ -3064,12 +5091,24 @@ main (int argc,
   g_test_add ("/contacts/contact-list", Fixture, NULL,
       setup_no_connect, test_contact_list, teardown);
 
+  g_test_add ("/contacts/contact-list-merged-changes", Fixture, NULL,
+      setup_no_connect, test_contact_list_merged_changes, teardown);
+
   g_test_add ("/contacts/initial-contact-list", Fixture, NULL,
       setup_no_connect, test_initial_contact_list, teardown);
 
   g_test_add ("/contacts/self-contact", Fixture, NULL,
       setup_no_connect, test_self_contact, teardown);
 
+  g_test_add ("/contacts/contact-attributes-changed", Fixture, NULL,
+      setup_no_connect, test_contact_attributes_changed, teardown);
+
+  g_test_add ("/contacts/by-address", Fixture, NULL,
+      setup_addressing_conn, test_by_address, teardown);
+
+  g_test_add ("/contacts/by-address-unsupported", Fixture, NULL,
+      setup, test_by_address_unsupported, teardown);
+
   ret = tp_tests_run_with_bus ();
 
   g_assert (haze_remove_directory (dir));
@@ -399,6 +399,43 @@ test_offer (Test *test,
   use_tube (test, test->tube_conn, test->cm_conn);
 }
 
+static void
+test_offer_batching (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint64 messages, bytes, writes;
+
+  /* Outgoing tube */
+  create_tube_service (test, TRUE, TRUE);
+  tp_tests_dbus_tube_channel_set_open_mode (test->tube_chan_service,
+      TP_TESTS_DBUS_TUBE_CHANNEL_OPEN_FIRST);
+
+  tp_dbus_tube_channel_set_batching (test->tube, 10, 0);
+  g_assert (!tp_dbus_tube_channel_get_traffic_stats (test->tube, NULL, NULL,
+        NULL, NULL, NULL));
+
+  g_signal_connect (test->tube_chan_service, "new-connection",
+      G_CALLBACK (new_connection_cb), test);
+
+  tp_dbus_tube_channel_offer_async (test->tube, NULL, tube_offer_cb, test);
+
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_assert (G_IS_DBUS_CONNECTION (test->tube_conn));
+  g_assert (G_IS_DBUS_CONNECTION (test->cm_conn));
+
+  /* the call goes out, and its reply comes back, through the batches */
+  use_tube (test, test->cm_conn, test->tube_conn);
+
+  g_assert (tp_dbus_tube_channel_get_traffic_stats (test->tube, &messages,
+        &bytes, &writes, NULL, NULL));
+  g_assert_cmpuint (messages, >=, 2);
+  g_assert_cmpuint (bytes, >, 0);
+  g_assert_cmpuint (writes, >, 0);
+}
+
 static void
 test_offer_invalidated_before_open (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -503,6 +540,8 @@ main (int argc,
   g_test_add ("/dbus-tube/offer-open-second", Test,
       GUINT_TO_POINTER (TP_TESTS_DBUS_TUBE_CHANNEL_OPEN_SECOND),
       setup, test_offer, teardown);
+  g_test_add ("/dbus-tube/offer-batching", Test, NULL,
+      setup, test_offer_batching, teardown);
   g_test_add ("/dbus-tube/offer-invalidated-before-open", Test, NULL,
       setup, test_offer_invalidated_before_open, teardown);
   g_test_add ("/dbus-tube/accept-open-first", Test,
@@ -4,6 +4,7 @@
 #include <glib.h>
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
+#include <telepathy-glib/defs.h>
 #include <telepathy-glib/util.h>
 
 #include "tests/lib/util.h"
@@ -330,6 +331,156 @@ cancel_watch_during_dispatch (void)
   g_assert_cmpstr (user_data_flags, ==, "..........");
 }
 
+typedef struct {
+    GMainLoop *loop;
+    GHashTable *owners;
+} BatchContext;
+
+static void
+batch_noc (TpDBusDaemon *bus_daemon,
+    const gchar *name,
+    const gchar *new_owner,
+    gpointer user_data)
+{
+  BatchContext *bc = user_data;
+
+  g_message ("%s -> <%s>", name, new_owner);
+  g_hash_table_insert (bc->owners, g_strdup (name), g_strdup (new_owner));
+  g_main_loop_quit (bc->loop);
+}
+
+static void
+test_watch_name_owner_batch (void)
+{
+  TpDBusDaemon *bus = tp_dbus_daemon_dup (NULL);
+  const gchar *unique_name = tp_dbus_daemon_get_unique_name (bus);
+  const gchar * const names[] = { "com.example.First",
+      TP_CLIENT_BUS_NAME_BASE "Batch", TP_CLIENT_BUS_NAME_BASE "Absent",
+      "com.example.Absent", unique_name, NULL };
+  BatchContext bc = { g_main_loop_new (NULL, FALSE),
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free) };
+  GError *error = NULL;
+  guint i;
+
+  g_assert (tp_dbus_daemon_request_name (bus, TP_CLIENT_BUS_NAME_BASE "Batch",
+        FALSE, &error));
+  g_assert_no_error (error);
+
+  /* the first is looked up on its own, and the rest together */
+  for (i = 0; names[i] != NULL; i++)
+    tp_dbus_daemon_watch_name_owner (bus, names[i], batch_noc, &bc, NULL);
+
+  while (g_hash_table_size (bc.owners) < G_N_ELEMENTS (names) - 1)
+    g_main_loop_run (bc.loop);
+
+  g_assert_cmpstr (g_hash_table_lookup (bc.owners, "com.example.First"), ==,
+      "");
+  g_assert_cmpstr (g_hash_table_lookup (bc.owners,
+        TP_CLIENT_BUS_NAME_BASE "Batch"), ==, unique_name);
+  g_assert_cmpstr (g_hash_table_lookup (bc.owners,
+        TP_CLIENT_BUS_NAME_BASE "Absent"), ==, "");
+  g_assert_cmpstr (g_hash_table_lookup (bc.owners, "com.example.Absent"), ==,
+      "");
+  g_assert_cmpstr (g_hash_table_lookup (bc.owners, unique_name), ==,
+      unique_name);
+
+  /* changes to names in a namespace are still noticed */
+  g_assert (tp_dbus_daemon_release_name (bus, TP_CLIENT_BUS_NAME_BASE "Batch",
+        &error));
+  g_assert_no_error (error);
+
+  while (tp_strdiff (g_hash_table_lookup (bc.owners,
+          TP_CLIENT_BUS_NAME_BASE "Batch"), ""))
+    g_main_loop_run (bc.loop);
+
+  for (i = 0; names[i] != NULL; i++)
+    g_assert (tp_dbus_daemon_cancel_name_owner_watch (bus, names[i],
+          batch_noc, &bc));
+
+  g_hash_table_unref (bc.owners);
+  g_main_loop_unref (bc.loop);
+  g_object_unref (bus);
+}
+
+typedef struct {
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *called_in;
+    gchar *owner;
+} ThreadTest;
+
+static void
+thread_get_name_owner_cb (TpDBusDaemon *bus,
+    const gchar *owner,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  ThreadTest *tt = user_data;
+
+  g_assert_no_error (error);
+  tt->called_in = g_thread_self ();
+  tt->owner = g_strdup (owner);
+  g_main_loop_quit (tt->loop);
+}
+
+static gpointer
+thread_default_context_thread (gpointer data)
+{
+  ThreadTest *tt = data;
+  TpDBusDaemon *main_bus = tp_dbus_daemon_dup (NULL);
+  TpDBusDaemon *bus;
+  TpDBusDaemon *again;
+  GError *error = NULL;
+
+  g_main_context_push_thread_default (tt->context);
+
+  /* each thread-default main context has its own bus connection */
+  bus = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+  g_assert (bus != NULL);
+  g_assert (bus != main_bus);
+  g_assert_cmpstr (tp_dbus_daemon_get_unique_name (bus), !=,
+      tp_dbus_daemon_get_unique_name (main_bus));
+
+  again = tp_dbus_daemon_dup (&error);
+  g_assert_no_error (error);
+  g_assert (again == bus);
+  g_object_unref (again);
+
+  /* calls made in this thread complete in this thread, without the global
+   * default main context being iterated */
+  tp_cli_dbus_daemon_call_get_name_owner (bus, -1, "org.freedesktop.DBus",
+      thread_get_name_owner_cb, tt, NULL, NULL);
+  g_main_loop_run (tt->loop);
+
+  g_assert (tt->called_in == g_thread_self ());
+  g_assert_cmpstr (tt->owner, ==, "org.freedesktop.DBus");
+
+  g_object_unref (bus);
+  g_main_context_pop_thread_default (tt->context);
+  g_object_unref (main_bus);
+  return NULL;
+}
+
+static void
+test_thread_default_context (void)
+{
+  ThreadTest tt = { NULL };
+  GThread *thread;
+
+  tt.context = g_main_context_new ();
+  tt.loop = g_main_loop_new (tt.context, FALSE);
+
+  thread = g_thread_new ("thread-default-context",
+      thread_default_context_thread, &tt);
+  g_thread_join (thread);
+
+  g_free (tt.owner);
+  g_main_loop_unref (tt.loop);
+  g_main_context_unref (tt.context);
+}
+
 int
 main (int argc,
       char **argv)
@@ -339,8 +490,12 @@ main (int argc,
   g_test_add_func ("/dbus/validation", test_validation);
   g_test_add_func ("/dbus-daemon/properties", test_properties);
   g_test_add_func ("/dbus-daemon/watch-name-owner", test_watch_name_owner);
+  g_test_add_func ("/dbus-daemon/watch-name-owner-batch",
+      test_watch_name_owner_batch);
   g_test_add_func ("/dbus-daemon/cancel-watch-during-dispatch",
       cancel_watch_during_dispatch);
+  g_test_add_func ("/dbus-daemon/thread-default-context",
+      test_thread_default_context);
 
   return tp_tests_run_with_bus ();
 }
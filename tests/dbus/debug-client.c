@@ -9,6 +9,7 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #include <telepathy-glib/telepathy-glib.h>
@@ -254,6 +255,106 @@ test_get_messages (Test *test,
   g_assert_cmpstr (tp_debug_message_get_message (msg), ==, "message2");
 }
 
+static void
+test_max_messages (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gchar *long_message;
+  TpDebugMessage *msg;
+  guint i;
+
+  for (i = 0; i < 10; i++)
+    tp_debug_sender_add_message_printf (test->sender, NULL, NULL, "domain",
+        G_LOG_LEVEL_DEBUG, "message %u", i);
+
+  /* only the newest messages are kept */
+  tp_debug_sender_set_max_messages (test->sender, 3);
+
+  long_message = g_strnfill (1000, 'x');
+  tp_debug_sender_add_message_printf (test->sender, NULL, NULL, "domain",
+      G_LOG_LEVEL_DEBUG, "%s", long_message);
+
+  tp_debug_client_get_messages_async (test->client, get_messages_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_assert (test->messages != NULL);
+  g_assert_cmpuint (test->messages->len, ==, 3);
+
+  msg = g_ptr_array_index (test->messages, 0);
+  g_assert_cmpstr (tp_debug_message_get_message (msg), ==, "message 8");
+  msg = g_ptr_array_index (test->messages, 1);
+  g_assert_cmpstr (tp_debug_message_get_message (msg), ==, "message 9");
+
+  /* long messages are kept in full */
+  msg = g_ptr_array_index (test->messages, 2);
+  g_assert_cmpstr (tp_debug_message_get_message (msg), ==, long_message);
+
+  g_free (long_message);
+}
+
+#define N_LOGGING_THREADS 4
+#define N_MESSAGES_PER_THREAD 50
+
+static gpointer
+logging_thread (gpointer data)
+{
+  guint n = GPOINTER_TO_UINT (data);
+  guint i;
+
+  for (i = 0; i < N_MESSAGES_PER_THREAD; i++)
+    {
+      gchar *message = g_strdup_printf ("%u %u", n, i);
+
+      tp_debug_sender_log_handler ("domain", G_LOG_LEVEL_DEBUG, message,
+          NULL);
+      g_free (message);
+    }
+
+  return NULL;
+}
+
+static void
+test_log_from_threads (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GThread *threads[N_LOGGING_THREADS];
+  guint next[N_LOGGING_THREADS] = { 0 };
+  guint i;
+
+  for (i = 0; i < N_LOGGING_THREADS; i++)
+    threads[i] = g_thread_new ("logger", logging_thread,
+        GUINT_TO_POINTER (i));
+
+  for (i = 0; i < N_LOGGING_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  tp_debug_client_get_messages_async (test->client, get_messages_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  /* everything arrived, and each thread's messages are in order */
+  g_assert (test->messages != NULL);
+  g_assert_cmpuint (test->messages->len, ==,
+      N_LOGGING_THREADS * N_MESSAGES_PER_THREAD);
+
+  for (i = 0; i < test->messages->len; i++)
+    {
+      TpDebugMessage *msg = g_ptr_array_index (test->messages, i);
+      guint n, j;
+
+      g_assert_cmpint (sscanf (tp_debug_message_get_message (msg), "%u %u",
+            &n, &j), ==, 2);
+      g_assert_cmpuint (n, <, N_LOGGING_THREADS);
+      g_assert_cmpuint (j, ==, next[n]);
+      next[n]++;
+    }
+}
+
 static void
 new_debug_message_cb (TpDebugClient *client,
     TpDebugMessage *message,
@@ -294,6 +395,45 @@ test_new_debug_message (Test *test,
       "new message");
 }
 
+static void
+count_debug_message_cb (TpDebugClient *client,
+    TpDebugMessage *message,
+    Test *test)
+{
+  gchar *expected = g_strdup_printf ("batched %d", test->wait);
+
+  g_assert_cmpstr (tp_debug_message_get_message (message), ==, expected);
+  g_free (expected);
+
+  test->wait++;
+  if (test->wait >= 3)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_batched_messages (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gint i;
+
+  g_signal_connect (test->client, "new-debug-message",
+      G_CALLBACK (count_debug_message_cb), test);
+
+  g_object_set (test->sender,
+      "enabled", TRUE,
+      "batch-interval", 50,
+      NULL);
+
+  for (i = 0; i < 3; i++)
+    tp_debug_sender_add_message_printf (test->sender, NULL, NULL, "domain",
+        G_LOG_LEVEL_DEBUG, "batched %d", i);
+
+  /* they all turn up, in order, as normal messages */
+  test->wait = 0;
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 3);
+}
+
 static void
 test_get_messages_failed (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -327,8 +467,14 @@ main (int argc,
       test_set_enabled, teardown);
   g_test_add ("/debug-client/get-messages", Test, NULL, setup,
       test_get_messages, teardown);
+  g_test_add ("/debug-client/max-messages", Test, NULL, setup,
+      test_max_messages, teardown);
+  g_test_add ("/debug-client/log-from-threads", Test, NULL, setup,
+      test_log_from_threads, teardown);
   g_test_add ("/debug-client/new-debug-message", Test, NULL, setup,
       test_new_debug_message, teardown);
+  g_test_add ("/debug-client/batched-messages", Test, NULL, setup,
+      test_batched_messages, teardown);
   g_test_add ("/debug-client/get-messages-failed", Test, NULL, setup,
       test_get_messages_failed, teardown);
 
@@ -0,0 +1,318 @@
+/* Tests of the synthetic load-generating example CM
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
+#include "examples/cm/synthetic/conn.h"
+#include "examples/cm/synthetic/room.h"
+#include "examples/cm/synthetic/scenario.h"
+
+#include "tests/lib/util.h"
+
+typedef struct {
+    TpDBusDaemon *dbus;
+    ExampleSyntheticScenario *scenario;
+
+    TpBaseConnection *service_conn;
+    TpConnection *conn;
+    TpChannel *room;
+
+    guint n_presence_signals;
+    guint n_presences_changed;
+    guint n_members_changed;
+    guint n_messages;
+
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_debug_set_flags ("all");
+  test->dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  /* a fixed sequence of events, and nothing at all unless a test asks
+   * for it */
+  test->scenario = example_synthetic_scenario_new ();
+  test->scenario->seed = 1;
+  test->scenario->roster_size = 20;
+  test->scenario->presence_rate = 0;
+  test->scenario->room_size = 10;
+  test->scenario->room_churn_rate = 0;
+  test->scenario->room_message_rate = 0;
+}
+
+static void
+connect_conn (Test *test)
+{
+  GQuark features[] = { TP_CONNECTION_FEATURE_CONNECTED,
+      TP_CONNECTION_FEATURE_CONTACT_LIST, 0 };
+  gchar *name, *conn_path;
+
+  test->service_conn = tp_tests_object_new_static_class (
+      EXAMPLE_TYPE_SYNTHETIC_CONNECTION,
+      "account", "me@synthetic",
+      "protocol", "example",
+      "scenario", test->scenario,
+      NULL);
+
+  tp_base_connection_register (test->service_conn, "example", &name,
+      &conn_path, &test->error);
+  g_assert_no_error (test->error);
+
+  test->conn = tp_connection_new (test->dbus, name, conn_path,
+      &test->error);
+  g_assert_no_error (test->error);
+
+  tp_cli_connection_call_connect (test->conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (test->conn, features);
+
+  g_free (name);
+  g_free (conn_path);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  g_clear_error (&test->error);
+  g_clear_object (&test->room);
+
+  if (test->conn != NULL)
+    tp_tests_connection_assert_disconnect_succeeds (test->conn);
+
+  g_clear_object (&test->conn);
+  g_clear_object (&test->service_conn);
+  tp_clear_pointer (&test->scenario, example_synthetic_scenario_free);
+  g_clear_object (&test->dbus);
+}
+
+static void
+test_roster (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GPtrArray *contacts;
+  guint i;
+
+  connect_conn (test);
+
+  g_assert_cmpuint (tp_connection_get_contact_list_state (test->conn), ==,
+      TP_CONTACT_LIST_STATE_SUCCESS);
+
+  contacts = tp_connection_dup_contact_list (test->conn);
+  g_assert_cmpuint (contacts->len, ==, 20);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpContact *contact = g_ptr_array_index (contacts, i);
+
+      g_assert_cmpint (tp_contact_get_subscribe_state (contact), ==,
+          TP_SUBSCRIPTION_STATE_YES);
+      g_assert_cmpint (tp_contact_get_publish_state (contact), ==,
+          TP_SUBSCRIPTION_STATE_YES);
+    }
+
+  g_ptr_array_unref (contacts);
+}
+
+static void
+presences_changed_cb (TpConnection *conn,
+    GHashTable *presences,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  test->n_presence_signals++;
+  test->n_presences_changed += g_hash_table_size (presences);
+}
+
+static void
+test_presence (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  /* enough that every tick has several changes */
+  test->scenario->presence_rate = 200;
+  connect_conn (test);
+
+  tp_cli_connection_interface_simple_presence_connect_to_presences_changed (
+      test->conn, presences_changed_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  while (test->n_presence_signals < 3)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* each tick's changes are batched into one signal */
+  g_assert_cmpuint (test->n_presences_changed, >, test->n_presence_signals);
+}
+
+static void
+members_changed_cb (TpChannel *channel,
+    const gchar *message,
+    const GArray *added,
+    const GArray *removed,
+    const GArray *local_pending,
+    const GArray *remote_pending,
+    guint actor,
+    guint reason,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  /* everyone who leaves is replaced */
+  g_assert_cmpuint (added->len, ==, removed->len);
+  g_assert_cmpuint (added->len, >, 0);
+  test->n_members_changed++;
+}
+
+static void
+message_received_cb (TpChannel *channel,
+    const GPtrArray *parts,
+    gpointer user_data,
+    GObject *weak_object G_GNUC_UNUSED)
+{
+  Test *test = user_data;
+
+  g_assert_cmpuint (parts->len, ==, 2);
+  test->n_messages++;
+}
+
+static void
+test_rooms (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GHashTable *request, *properties;
+  ExampleSyntheticRoomChannel *service_room;
+  gboolean yours;
+  gchar *path;
+
+  test->scenario->rooms_autojoin = 2;
+  test->scenario->room_churn_rate = 50;
+  test->scenario->room_message_rate = 50;
+  connect_conn (test);
+
+  /* we're already in the room, so this just finds it */
+  request = tp_asv_new (
+      TP_PROP_CHANNEL_CHANNEL_TYPE, G_TYPE_STRING, TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_PROP_CHANNEL_TARGET_HANDLE_TYPE, G_TYPE_UINT, TP_HANDLE_TYPE_ROOM,
+      TP_PROP_CHANNEL_TARGET_ID, G_TYPE_STRING, "room1@synthetic",
+      NULL);
+
+  tp_cli_connection_interface_requests_run_ensure_channel (test->conn, -1,
+      request, &yours, &path, &properties, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (!yours);
+
+  service_room = EXAMPLE_SYNTHETIC_ROOM_CHANNEL (
+      dbus_g_connection_lookup_g_object (
+        tp_proxy_get_dbus_connection (test->conn), path));
+  g_assert (service_room != NULL);
+  /* the other members and us */
+  g_assert_cmpuint (tp_handle_set_size (service_room->group.members), ==,
+      11);
+
+  test->room = tp_channel_new_from_properties (test->conn, path, properties,
+      &test->error);
+  g_assert_no_error (test->error);
+
+  tp_cli_channel_interface_group_connect_to_members_changed (test->room,
+      members_changed_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+  tp_cli_channel_interface_messages_connect_to_message_received (test->room,
+      message_received_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  while (test->n_members_changed < 3 || test->n_messages < 3)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (tp_handle_set_size (service_room->group.members), ==,
+      11);
+
+  g_hash_table_unref (properties);
+  g_hash_table_unref (request);
+  g_free (path);
+}
+
+static gchar *
+write_scenario (const gchar *contents)
+{
+  gchar *filename;
+  gint fd;
+  GError *error = NULL;
+
+  fd = g_file_open_tmp ("example-synthetic-XXXXXX.scenario", &filename,
+      &error);
+  g_assert_no_error (error);
+  g_close (fd, &error);
+  g_assert_no_error (error);
+
+  g_file_set_contents (filename, contents, -1, &error);
+  g_assert_no_error (error);
+  return filename;
+}
+
+static void
+test_scenario_file (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  ExampleSyntheticScenario *scenario;
+  gchar *filename;
+
+  filename = write_scenario (
+      "[Roster]\nSize=7\n"
+      "[Rooms]\nAutoJoin=3\nMessagesPerSecond=0.5\n");
+  scenario = example_synthetic_scenario_new_from_file (filename,
+      &test->error);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (scenario->roster_size, ==, 7);
+  g_assert_cmpuint (scenario->rooms_autojoin, ==, 3);
+  g_assert_cmpfloat (scenario->room_message_rate, ==, 0.5);
+  /* things not in the file keep their defaults */
+  g_assert_cmpuint (scenario->room_size, ==, 50);
+  example_synthetic_scenario_free (scenario);
+  g_unlink (filename);
+  g_free (filename);
+
+  filename = write_scenario ("[Presence]\nChangesPerSecond=-1\n");
+  scenario = example_synthetic_scenario_new_from_file (filename,
+      &test->error);
+  g_assert_error (test->error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT);
+  g_assert (scenario == NULL);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  tp_tests_abort_after (10);
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add ("/example-synthetic/roster", Test, NULL, setup,
+      test_roster, teardown);
+  g_test_add ("/example-synthetic/presence", Test, NULL, setup,
+      test_presence, teardown);
+  g_test_add ("/example-synthetic/rooms", Test, NULL, setup,
+      test_rooms, teardown);
+  g_test_add ("/example-synthetic/scenario-file", Test, NULL, setup,
+      test_scenario_file, teardown);
+
+  return tp_tests_run_with_bus ();
+}
@@ -11,6 +11,7 @@
 #include "config.h"
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <string.h>
 
 #include <telepathy-glib/file-transfer-channel.h>
@@ -55,6 +56,10 @@ typedef struct {
     TpFileTransferChannel *channel;
     GIOStream *cm_stream;
 
+    /* ContentHashType and ContentHash for create_file_transfer_channel() */
+    TpFileHashType content_hash_type;
+    const gchar *content_hash;
+
     GError *error /* initialized where needed */;
     gint wait;
 } Test;
@@ -196,6 +201,8 @@ create_file_transfer_channel (Test *test,
       /* TpFileTransferChannel properties */
       "available-socket-types", sockets,
       "content-type", "text/plain",
+      "content-hash-type", test->content_hash_type,
+      "content-hash", test->content_hash,
       "date", (guint64) 271828,
       "description", "badger",
       "filename", "snake.txt",
@@ -425,6 +432,75 @@ test_properties (Test *test,
   g_assert_no_error (error);
 }
 
+static void
+transferred_bytes_notify_cb (GObject *source,
+    GParamSpec *pspec,
+    Test *test)
+{
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+  Test *test = user_data;
+
+  g_main_loop_quit (test->mainloop);
+  return FALSE;
+}
+
+/* Test that a flood of progress reports is coalesced */
+static void
+test_progress (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint64 count;
+  gint64 eta;
+
+  create_file_transfer_channel (test, FALSE, TP_SOCKET_ADDRESS_TYPE_UNIX,
+      TP_SOCKET_ACCESS_CONTROL_LOCALHOST);
+
+  g_signal_connect (test->channel, "notify::transferred-bytes",
+      G_CALLBACK (transferred_bytes_notify_cb), test);
+
+  g_assert_cmpuint (tp_file_transfer_channel_get_transfer_rate (
+        test->channel), ==, 0);
+  g_assert_cmpint (tp_file_transfer_channel_get_estimated_time_remaining (
+        test->channel), ==, -1);
+
+  for (count = 100; count <= 5000; count += 100)
+    tp_tests_file_transfer_channel_set_transferred_bytes (test->chan_service,
+        count);
+
+  /* The first one is notified straight away, and the rest together a bit
+   * later */
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpuint (tp_file_transfer_channel_get_transferred_bytes (
+        test->channel), ==, 5000);
+
+  /* ... and nothing else happens */
+  test->wait = 1;
+  g_timeout_add (600, quit_cb, test);
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 1);
+
+  g_assert_cmpuint (tp_file_transfer_channel_get_transfer_rate (
+        test->channel), >, 0);
+  eta = tp_file_transfer_channel_get_estimated_time_remaining (test->channel);
+  g_assert_cmpint (eta, >, 0);
+
+  /* Once it's all there, nothing remains */
+  tp_tests_file_transfer_channel_set_transferred_bytes (test->chan_service,
+      9001);
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (tp_file_transfer_channel_get_estimated_time_remaining (
+        test->channel), ==, 0);
+}
+
 /* Test sending files */
 static void
 test_provide_success (Test *test,
@@ -537,6 +613,166 @@ test_accept_success (Test *test, gconstpointer data G_GNUC_UNUSED)
   g_object_unref (file);
 }
 
+/* Test hashing a received file as it is written out */
+static void
+test_accept_content_hash (Test *test,
+    gconstpointer data)
+{
+  gboolean matches = GPOINTER_TO_UINT (data);
+  gchar *path = g_build_filename (g_get_tmp_dir (),
+      "file-transfer-hash", NULL);
+  GFile *file = g_file_new_for_path (path);
+  gchar *expected;
+  gchar *contents;
+  GError *error = NULL;
+
+  expected = g_compute_checksum_for_string (G_CHECKSUM_MD5, "test", -1);
+
+  /* The comparison ignores case */
+  test->content_hash_type = TP_FILE_HASH_TYPE_MD5;
+  test->content_hash = matches ? "098F6BCD4621D373CADE4E832627B4F6"
+      : "d41d8cd98f00b204e9800998ecf8427e";
+
+  create_file_transfer_channel (test, FALSE, TP_SOCKET_ADDRESS_TYPE_UNIX,
+      TP_SOCKET_ACCESS_CONTROL_LOCALHOST);
+  tp_tests_file_transfer_channel_set_contents (test->chan_service, "test");
+  tp_file_transfer_channel_set_compute_content_hash (test->channel, TRUE);
+
+  /* Nothing has been hashed yet */
+  g_assert (!tp_file_transfer_channel_check_content_hash (test->channel,
+        &error));
+  g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+  g_clear_error (&error);
+
+  tp_file_transfer_channel_accept_file_async (test->channel,
+      file, 0, file_accept_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  while (tp_file_transfer_channel_get_computed_content_hash (
+        test->channel) == NULL)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (tp_file_transfer_channel_get_computed_content_hash (
+        test->channel), ==, expected);
+
+  /* The whole file was written as well as hashed */
+  g_file_get_contents (path, &contents, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (contents, ==, "test");
+
+  if (matches)
+    {
+      g_assert (tp_file_transfer_channel_check_content_hash (test->channel,
+            &error));
+      g_assert_no_error (error);
+    }
+  else
+    {
+      g_assert (!tp_file_transfer_channel_check_content_hash (test->channel,
+            &error));
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+      g_clear_error (&error);
+    }
+
+  g_unlink (path);
+  g_free (contents);
+  g_free (expected);
+  g_object_unref (file);
+  g_free (path);
+}
+
+static void
+file_resume_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  tp_file_transfer_channel_resume_file_finish (
+      TP_FILE_TRANSFER_CHANNEL (source), result, &test->error);
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+/* Pretend a previous attempt to receive the test channel's file stopped
+ * after @partial_size bytes; the checkpoint claims the file is @size bytes
+ * long */
+static void
+write_partial_file (const gchar *path,
+    gsize partial_size,
+    guint64 size)
+{
+  gchar *checkpoint_path = g_strdup_printf ("%s.tp-checkpoint", path);
+  gchar *contents = g_malloc0 (partial_size);
+  GKeyFile *key_file = g_key_file_new ();
+  gchar *data;
+  GError *error = NULL;
+
+  g_file_set_contents (path, contents, partial_size, &error);
+  g_assert_no_error (error);
+
+  g_key_file_set_string (key_file, "Transfer", "Filename", "snake.txt");
+  g_key_file_set_uint64 (key_file, "Transfer", "Size", size);
+  g_key_file_set_int64 (key_file, "Transfer", "Date", 271828);
+  g_key_file_set_integer (key_file, "Transfer", "ContentHashType", 0);
+  g_key_file_set_string (key_file, "Transfer", "ContentHash", "");
+  data = g_key_file_to_data (key_file, NULL, NULL);
+  g_file_set_contents (checkpoint_path, data, -1, &error);
+  g_assert_no_error (error);
+
+  g_free (data);
+  g_key_file_free (key_file);
+  g_free (contents);
+  g_free (checkpoint_path);
+}
+
+static void
+test_accept_resume (Test *test, gconstpointer data)
+{
+  /* the checkpoint matches if it has the right size */
+  guint64 size = GPOINTER_TO_UINT (data);
+  gchar *path = g_build_filename (g_get_tmp_dir (),
+      "file-transfer-resume", NULL);
+  gchar *checkpoint_path = g_strdup_printf ("%s.tp-checkpoint", path);
+  GFile *file = g_file_new_for_path (path);
+  guint64 service_offset, offset;
+
+  create_file_transfer_channel (test, FALSE, TP_SOCKET_ADDRESS_TYPE_UNIX,
+      TP_SOCKET_ACCESS_CONTROL_LOCALHOST);
+
+  write_partial_file (path, 3000, size);
+
+  tp_file_transfer_channel_resume_file_async (test->channel,
+      file, file_resume_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_object_get (test->chan_service, "initial-offset", &service_offset, NULL);
+  g_object_get (test->channel, "initial-offset", &offset, NULL);
+  g_assert_cmpuint (offset, ==, service_offset);
+
+  if (size == 9001)
+    g_assert_cmpuint (offset, ==, 3000);
+  else
+    g_assert_cmpuint (offset, ==, 0);
+
+  /* The checkpoint is there for next time either way */
+  g_assert (g_file_test (checkpoint_path, G_FILE_TEST_EXISTS));
+
+  g_unlink (checkpoint_path);
+  g_unlink (path);
+  g_object_unref (file);
+  g_free (checkpoint_path);
+  g_free (path);
+}
+
 static void
 test_accept_twice (Test *test, gconstpointer data G_GNUC_UNUSED)
 {
@@ -597,6 +833,8 @@ main (int argc,
       test_create_unrequested, teardown);
   g_test_add ("/file-transfer-channel/properties", Test, NULL, setup,
       test_properties, teardown);
+  g_test_add ("/file-transfer-channel/progress", Test, NULL, setup,
+      test_progress, teardown);
 
   /* Run provide and accept in different contexts */
   run_file_transfer_test ("/file-transfer-channel/accept/success",
@@ -610,6 +848,14 @@ main (int argc,
       test_accept_twice, teardown);
   g_test_add ("/file-transfer-channel/accept/outgoing", Test, NULL, setup,
       test_accept_outgoing, teardown);
+  g_test_add ("/file-transfer-channel/accept/resume", Test,
+      GUINT_TO_POINTER (9001), setup, test_accept_resume, teardown);
+  g_test_add ("/file-transfer-channel/accept/resume-mismatch", Test,
+      GUINT_TO_POINTER (1234), setup, test_accept_resume, teardown);
+  g_test_add ("/file-transfer-channel/accept/content-hash", Test,
+      GUINT_TO_POINTER (TRUE), setup, test_accept_content_hash, teardown);
+  g_test_add ("/file-transfer-channel/accept/content-hash-mismatch", Test,
+      GUINT_TO_POINTER (FALSE), setup, test_accept_content_hash, teardown);
   g_test_add ("/file-transfer-channel/provide/cancel", Test, NULL, setup,
       test_cancel_transfer, teardown);
 
@@ -29,7 +29,7 @@ static GMainLoop *mainloop;
 TpTestsTextChannelGroup *service_chan;
 TpChannel *chan = NULL;
 TpHandleRepoIface *contact_repo;
-TpHandle self_handle, camel, camel2;
+TpHandle self_handle, camel, camel2, camel3, camel4;
 
 typedef void (*diff_checker) (const GArray *added, const GArray *removed,
     const GArray *local_pending, const GArray *remote_pending,
@@ -489,6 +489,59 @@ in_the_desert (void)
   tp_handle_unref (contact_repo, camel2);
 }
 
+static void
+camel3_added (const GArray *added,
+              const GArray *removed,
+              const GArray *local_pending,
+              const GArray *remote_pending,
+              const GHashTable *details)
+{
+  TpHandle hs[] = { camel3, 0 };
+
+  /* camel4 came and went within the batch, so isn't mentioned */
+  MYASSERT (added->len == 1, ": one added");
+  g_assert_cmpuint (g_array_index (added, TpHandle, 0), ==, camel3);
+
+  MYASSERT (removed->len == 0, ": no-one removed");
+  MYASSERT (local_pending->len == 0, ": no new local pending");
+  MYASSERT (remote_pending->len == 0, ": no new remote pending");
+
+  details_contains_ids_for (details, hs);
+}
+
+static void
+camel_caravan (void)
+{
+  TpIntset *set;
+
+  camel3 = tp_handle_ensure (contact_repo, "camel3", NULL, NULL);
+  camel4 = tp_handle_ensure (contact_repo, "camel4", NULL, NULL);
+
+  tp_group_mixin_begin_changes ((GObject *) service_chan);
+
+  set = tp_intset_new_containing (camel3);
+  tp_group_mixin_change_members ((GObject *) service_chan, NULL, set, NULL,
+      NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_intset_destroy (set);
+
+  set = tp_intset_new_containing (camel4);
+  tp_group_mixin_change_members ((GObject *) service_chan, NULL, set, NULL,
+      NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_group_mixin_change_members ((GObject *) service_chan, NULL, NULL, set,
+      NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+  tp_intset_destroy (set);
+
+  /* nothing has been signalled yet: if it had, on_members_changed would
+   * complain */
+  tp_tests_proxy_run_until_dbus_queue_processed (chan);
+
+  expect_signals ("", 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE, camel3_added);
+  tp_group_mixin_end_changes ((GObject *) service_chan);
+  wait_for_outstanding_signals ();
+  MYASSERT (!outstanding_signals (),
+      ": MembersChanged and MembersChangedDetailed should have fired once");
+}
+
 static void
 test_group_mixin (void)
 {
@@ -510,6 +563,8 @@ test_group_mixin (void)
   check_incoming_invitation ();
 
   in_the_desert ();
+
+  camel_caravan ();
 }
 
 int
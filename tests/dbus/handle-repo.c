@@ -7,6 +7,8 @@
 #include <telepathy-glib/enums.h>
 #include <telepathy-glib/handle-repo.h>
 #include <telepathy-glib/handle-repo-dynamic.h>
+#include <telepathy-glib/handle-repo-internal.h>
+#include <telepathy-glib/handle-repo-static.h>
 #include <telepathy-glib/interfaces.h>
 #include <telepathy-glib/errors.h>
 
@@ -98,11 +100,475 @@ test_handles (void)
   g_object_unref (bus_daemon);
 }
 
+static void
+test_compact_storage (void)
+{
+  TpHandleRepoIface *tp_repo;
+  TpHandle handles[1000];
+  TpHandle long_handle;
+  GQuark quark = g_quark_from_static_string ("test-compact-storage");
+  gchar *long_id = g_strnfill (30000, 'x');
+  gboolean compact;
+  guint i;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      "compact-storage", TRUE,
+      NULL);
+  g_object_get (tp_repo, "compact-storage", &compact, NULL);
+  g_assert (compact);
+
+  g_assert (!tp_handle_is_valid (tp_repo, 0, NULL));
+  g_assert (!tp_handle_is_valid (tp_repo, 1, NULL));
+  g_assert (tp_handle_inspect (tp_repo, 1) == NULL);
+
+  /* enough handles to resize the table several times */
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    {
+      gchar *id = g_strdup_printf ("member%u@chat.example.com", i);
+
+      g_assert_cmpuint (tp_handle_lookup (tp_repo, id, NULL, NULL), ==, 0);
+      handles[i] = tp_handle_ensure (tp_repo, id, NULL, NULL);
+      g_assert_cmpuint (handles[i], !=, 0);
+      g_assert_cmpuint (tp_handle_ensure (tp_repo, id, NULL, NULL), ==,
+          handles[i]);
+      g_free (id);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (handles); i++)
+    {
+      gchar *id = g_strdup_printf ("member%u@chat.example.com", i);
+
+      g_assert (tp_handle_is_valid (tp_repo, handles[i], NULL));
+      g_assert_cmpstr (tp_handle_inspect (tp_repo, handles[i]), ==, id);
+      g_assert_cmpuint (tp_handle_lookup (tp_repo, id, NULL, NULL), ==,
+          handles[i]);
+      g_assert_cmpuint (tp_dynamic_handle_repo_lookup_exact (tp_repo, id),
+          ==, handles[i]);
+      g_free (id);
+    }
+
+  /* an ID too long to share a block with others */
+  long_handle = tp_handle_ensure (tp_repo, long_id, NULL, NULL);
+  g_assert_cmpstr (tp_handle_inspect (tp_repo, long_handle), ==, long_id);
+
+  /* qdata is only allocated for handles that use it */
+  g_assert (tp_handle_get_qdata (tp_repo, handles[1], quark) == NULL);
+  tp_handle_set_qdata (tp_repo, handles[1], quark, NULL, NULL);
+  tp_handle_set_qdata (tp_repo, handles[1], quark, g_strdup ("hello"),
+      g_free);
+  g_assert_cmpstr (tp_handle_get_qdata (tp_repo, handles[1], quark), ==,
+      "hello");
+  g_assert (tp_handle_get_qdata (tp_repo, handles[2], quark) == NULL);
+  /* this one is freed when the repo is */
+  tp_handle_set_qdata (tp_repo, handles[3], quark, g_strdup ("world"),
+      g_free);
+  tp_handle_set_qdata (tp_repo, handles[1], quark, NULL, NULL);
+  g_assert (tp_handle_get_qdata (tp_repo, handles[1], quark) == NULL);
+
+  g_object_unref (tp_repo);
+  g_free (long_id);
+}
+
+static gchar *
+normalize_lowercase (TpHandleRepoIface *repo,
+    const gchar *id,
+    gpointer context,
+    GError **error)
+{
+  if (strchr (id, '@') == NULL)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE,
+          "'%s' has no domain", id);
+      return NULL;
+    }
+
+  return g_ascii_strdown (id, -1);
+}
+
+static void
+test_many (gconstpointer compact)
+{
+  TpHandleRepoIface *tp_repo;
+  const gchar * const ids[] = { "Alice@example.com", "bob@example.com",
+      "alice@example.com", NULL };
+  const gchar * const bad_ids[] = { "carol@example.com", "dave", NULL };
+  const gchar * const none[] = { NULL };
+  GArray *handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  GError *error = NULL;
+  TpHandle dummy = 42;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      "normalize-function", normalize_lowercase,
+      "compact-storage", GPOINTER_TO_INT (compact),
+      NULL);
+
+  g_array_append_val (handles, dummy);
+  g_assert (!tp_handle_lookup_many (tp_repo, ids, NULL, handles, &error));
+  g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+  g_clear_error (&error);
+  g_assert_cmpuint (handles->len, ==, 1);
+
+  g_assert (tp_handle_ensure_many (tp_repo, ids, NULL, handles, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (handles->len, ==, 4);
+  g_assert_cmpuint (g_array_index (handles, TpHandle, 0), ==, 42);
+  g_assert_cmpuint (g_array_index (handles, TpHandle, 1), ==,
+      g_array_index (handles, TpHandle, 3));
+  g_assert_cmpuint (g_array_index (handles, TpHandle, 1), !=,
+      g_array_index (handles, TpHandle, 2));
+  g_assert_cmpstr (tp_handle_inspect (tp_repo,
+        g_array_index (handles, TpHandle, 2)), ==, "bob@example.com");
+
+  /* a single invalid ID fails the whole batch */
+  g_assert (!tp_handle_ensure_many (tp_repo, bad_ids, NULL, handles,
+        &error));
+  g_assert_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE);
+  g_clear_error (&error);
+  g_assert_cmpuint (handles->len, ==, 4);
+
+  g_array_set_size (handles, 0);
+  g_assert (tp_handle_lookup_many (tp_repo, ids, NULL, handles, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (handles->len, ==, 3);
+  g_assert_cmpuint (g_array_index (handles, TpHandle, 0), ==,
+      tp_handle_lookup (tp_repo, "ALICE@example.com", NULL, NULL));
+
+  g_assert (tp_handle_ensure_many (tp_repo, none, NULL, handles, NULL));
+  g_assert_cmpuint (handles->len, ==, 3);
+
+  g_array_unref (handles);
+  g_object_unref (tp_repo);
+}
+
+typedef struct {
+    TpHandle *handles;
+    guint n_pending;
+    guint n_failed;
+} ThreadedTest;
+
+typedef struct {
+    ThreadedTest *test;
+    guint pos;
+} ThreadedResult;
+
+static void
+threaded_ensure_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  ThreadedResult *r = user_data;
+  GError *error = NULL;
+
+  r->test->handles[r->pos] = tp_handle_ensure_finish (
+      (TpHandleRepoIface *) source, result, &error);
+
+  if (r->test->handles[r->pos] == 0)
+    {
+      g_assert_error (error, TP_ERROR, TP_ERROR_INVALID_HANDLE);
+      g_clear_error (&error);
+      r->test->n_failed++;
+    }
+
+  r->test->n_pending--;
+  g_slice_free (ThreadedResult, r);
+}
+
+static void
+test_threaded (void)
+{
+  TpHandleRepoIface *tp_repo;
+  ThreadedTest test = { NULL, 0, 0 };
+  guint i, n = 2000;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      "normalize-function", normalize_lowercase,
+      NULL);
+  tp_dynamic_handle_repo_set_normalize_threaded (
+      (TpDynamicHandleRepo *) tp_repo, 4);
+
+  test.handles = g_new0 (TpHandle, n);
+
+  /* every ID appears twice, in different cases, and every tenth is
+   * invalid */
+  for (i = 0; i < n; i++)
+    {
+      ThreadedResult *r = g_slice_new (ThreadedResult);
+      gchar *id;
+
+      if (i % 10 == 9)
+        id = g_strdup_printf ("nobody%u", i / 2);
+      else
+        id = g_strdup_printf ((i % 2) ? "USER%u@EXAMPLE.COM" :
+            "user%u@example.com", i / 2);
+
+      r->test = &test;
+      r->pos = i;
+      test.n_pending++;
+      tp_handle_ensure_async (tp_repo, NULL, id, NULL, threaded_ensure_cb, r);
+      g_free (id);
+    }
+
+  while (test.n_pending > 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (test.n_failed, ==, n / 10);
+
+  for (i = 0; i < n; i += 2)
+    {
+      gchar *id = g_strdup_printf ("user%u@example.com", i / 2);
+
+      if (i % 10 == 8)
+        {
+          g_assert_cmpuint (test.handles[i + 1], ==, 0);
+        }
+      else
+        {
+          g_assert_cmpuint (test.handles[i], !=, 0);
+          g_assert_cmpuint (test.handles[i], ==, test.handles[i + 1]);
+          g_assert_cmpstr (tp_handle_inspect (tp_repo, test.handles[i]), ==,
+              id);
+        }
+
+      g_free (id);
+    }
+
+  tp_dynamic_handle_repo_set_normalize_threaded (
+      (TpDynamicHandleRepo *) tp_repo, 0);
+  g_object_unref (tp_repo);
+  g_free (test.handles);
+}
+
+static guint n_normalized = 0;
+
+static gchar *
+normalize_counting (TpHandleRepoIface *repo,
+    const gchar *id,
+    gpointer context,
+    GError **error)
+{
+  n_normalized++;
+  return normalize_lowercase (repo, id, context, error);
+}
+
+static void
+test_cache (void)
+{
+  TpHandleRepoIface *tp_repo;
+  TpDynamicHandleRepo *dynamic;
+  TpHandle alice, bob;
+  guint64 hits, misses;
+  gint context;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      "normalize-function", normalize_counting,
+      NULL);
+  dynamic = (TpDynamicHandleRepo *) tp_repo;
+  tp_dynamic_handle_repo_set_normalize_cache_size (dynamic, 2);
+  n_normalized = 0;
+
+  alice = tp_handle_ensure (tp_repo, "Alice@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 1);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com", NULL,
+        NULL), ==, alice);
+  g_assert_cmpuint (tp_handle_ensure (tp_repo, "Alice@example.com", NULL,
+        NULL), ==, alice);
+  g_assert_cmpuint (n_normalized, ==, 1);
+
+  /* a different context is a different entry */
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com",
+        &context, NULL), ==, alice);
+  g_assert_cmpuint (n_normalized, ==, 2);
+
+  /* failures are not cached */
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "bob@example.com", NULL,
+        NULL), ==, 0);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "bob", NULL, NULL), ==, 0);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "bob", NULL, NULL), ==, 0);
+  g_assert_cmpuint (n_normalized, ==, 5);
+
+  /* adding a third entry evicts the least recently used, which is the
+   * one with the non-NULL context */
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com", NULL,
+        NULL), ==, alice);
+  bob = tp_handle_ensure (tp_repo, "BOB@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 6);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com", NULL,
+        NULL), ==, alice);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "BOB@example.com", NULL,
+        NULL), ==, bob);
+  g_assert_cmpuint (n_normalized, ==, 6);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com",
+        &context, NULL), ==, alice);
+  g_assert_cmpuint (n_normalized, ==, 7);
+
+  tp_dynamic_handle_repo_get_normalize_cache_stats (dynamic, &hits, &misses);
+  g_assert_cmpuint (hits, ==, 5);
+  g_assert_cmpuint (misses, ==, 7);
+
+  /* disabling the cache stops counting */
+  tp_dynamic_handle_repo_set_normalize_cache_size (dynamic, 0);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "Alice@example.com", NULL,
+        NULL), ==, alice);
+  g_assert_cmpuint (n_normalized, ==, 8);
+  tp_dynamic_handle_repo_get_normalize_cache_stats (dynamic, &hits, NULL);
+  g_assert_cmpuint (hits, ==, 5);
+
+  g_object_unref (tp_repo);
+}
+
+static void
+test_trim (void)
+{
+  TpHandleRepoIface *tp_repo;
+  static const gchar *ids[] = { "a@example.com", "b@example.com",
+      "c@example.com", "d@example.com" };
+  guint i;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      "normalize-function", normalize_counting,
+      NULL);
+  tp_dynamic_handle_repo_set_normalize_cache_size (
+      (TpDynamicHandleRepo *) tp_repo, 10);
+  n_normalized = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (ids); i++)
+    tp_handle_ensure (tp_repo, ids[i], NULL, NULL);
+
+  g_assert_cmpuint (n_normalized, ==, 4);
+
+  /* the two most recently used are kept */
+  tp_trim_caches (TP_TRIM_LEVEL_MODERATE);
+  tp_handle_lookup (tp_repo, "c@example.com", NULL, NULL);
+  tp_handle_lookup (tp_repo, "d@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 4);
+  tp_handle_lookup (tp_repo, "a@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 5);
+
+  /* nothing is kept, but the cache is still enabled */
+  tp_trim_caches (TP_TRIM_LEVEL_COMPLETE);
+  tp_handle_lookup (tp_repo, "d@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 6);
+  tp_handle_lookup (tp_repo, "d@example.com", NULL, NULL);
+  g_assert_cmpuint (n_normalized, ==, 6);
+
+  g_object_unref (tp_repo);
+}
+
+static void
+test_static (void)
+{
+  static const gchar *names[] = { "subscribe", "publish", "stored",
+      "publish", NULL };
+  TpHandleRepoIface *tp_repo;
+  GError *error = NULL;
+  guint i;
+
+  tp_repo = tp_static_handle_repo_new (TP_HANDLE_TYPE_LIST, names);
+
+  for (i = 0; i < 3; i++)
+    {
+      g_assert_cmpuint (tp_handle_lookup (tp_repo, names[i], NULL, NULL),
+          ==, i + 1);
+      g_assert_cmpuint (tp_handle_ensure (tp_repo, names[i], NULL, NULL),
+          ==, i + 1);
+      g_assert_cmpstr (tp_handle_inspect (tp_repo, i + 1), ==, names[i]);
+    }
+
+  /* a repeated name gets the first handle, but the later handle is still
+   * valid */
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "publish", NULL, NULL), ==,
+      2);
+  g_assert_cmpstr (tp_handle_inspect (tp_repo, 4), ==, "publish");
+
+  g_assert_cmpuint (tp_handle_ensure (tp_repo, "deny", NULL, &error), ==, 0);
+  g_assert_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE);
+  g_clear_error (&error);
+
+  g_object_unref (tp_repo);
+}
+
+static void
+test_reclaim (void)
+{
+  TpHandleRepoIface *tp_repo;
+  TpHandleSet *set;
+  TpHandle alice, bob, carol, dave, alice2;
+
+  tp_repo = tp_tests_object_new_static_class (TP_TYPE_DYNAMIC_HANDLE_REPO,
+      "handle-type", TP_HANDLE_TYPE_CONTACT,
+      NULL);
+  tp_dynamic_handle_repo_set_reclaim_after ((TpDynamicHandleRepo *) tp_repo,
+      3600);
+
+  alice = tp_handle_ensure (tp_repo, "alice", NULL, NULL);
+  bob = tp_handle_ensure (tp_repo, "bob", NULL, NULL);
+  carol = tp_handle_ensure (tp_repo, "carol", NULL, NULL);
+  dave = tp_handle_ensure (tp_repo, "dave", NULL, NULL);
+  g_assert_cmpuint (alice, ==, 1);
+  g_assert_cmpuint (dave, ==, 4);
+
+  /* bob is in a set and carol is pinned, so they are never reclaimed */
+  set = tp_handle_set_new_containing (tp_repo, bob);
+  tp_handle_pin (tp_repo, carol);
+
+  /* the handles were used since the last sweep, so they are kept */
+  _tp_dynamic_handle_repo_sweep (tp_repo);
+  g_assert (tp_handle_is_valid (tp_repo, alice, NULL));
+  g_assert (tp_handle_is_valid (tp_repo, dave, NULL));
+
+  /* dave is used again, but alice isn't, so she is reclaimed */
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "dave", NULL, NULL), ==,
+      dave);
+  _tp_dynamic_handle_repo_sweep (tp_repo);
+  g_assert (!tp_handle_is_valid (tp_repo, alice, NULL));
+  g_assert (tp_handle_inspect (tp_repo, alice) == NULL);
+  g_assert_cmpuint (tp_handle_lookup (tp_repo, "alice", NULL, NULL), ==, 0);
+  g_assert (tp_handle_is_valid (tp_repo, bob, NULL));
+  g_assert (tp_handle_is_valid (tp_repo, carol, NULL));
+  g_assert (tp_handle_is_valid (tp_repo, dave, NULL));
+
+  /* alice's index is reused, but the handle is different, so the old one
+   * stays invalid */
+  alice2 = tp_handle_ensure (tp_repo, "alice", NULL, NULL);
+  g_assert_cmpuint (alice2, ==, (1 << 24) | alice);
+  g_assert_cmpstr (tp_handle_inspect (tp_repo, alice2), ==, "alice");
+  g_assert (!tp_handle_is_valid (tp_repo, alice, NULL));
+
+  /* bob and carol get a full grace period after they stop being used */
+  tp_handle_set_destroy (set);
+  tp_handle_unpin (tp_repo, carol);
+  _tp_dynamic_handle_repo_sweep (tp_repo);
+  g_assert (tp_handle_is_valid (tp_repo, alice2, NULL));
+  g_assert (tp_handle_is_valid (tp_repo, bob, NULL));
+  g_assert (tp_handle_is_valid (tp_repo, carol, NULL));
+  g_assert (!tp_handle_is_valid (tp_repo, dave, NULL));
+
+  _tp_dynamic_handle_repo_sweep (tp_repo);
+  g_assert (!tp_handle_is_valid (tp_repo, alice2, NULL));
+  g_assert (!tp_handle_is_valid (tp_repo, bob, NULL));
+  g_assert (!tp_handle_is_valid (tp_repo, carol, NULL));
+
+  g_object_unref (tp_repo);
+}
+
 int main (int argc, char **argv)
 {
   tp_tests_abort_after (10);
 
   test_handles ();
+  test_compact_storage ();
+  test_many (GINT_TO_POINTER (FALSE));
+  test_many (GINT_TO_POINTER (TRUE));
+  test_threaded ();
+  test_cache ();
+  test_trim ();
+  test_static ();
+  test_reclaim ();
 
   return 0;
 }
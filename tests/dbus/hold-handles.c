@@ -0,0 +1,135 @@
+/* Tests of handles held on behalf of D-Bus clients, when the connection
+ * reclaims handles
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "telepathy-glib/handle-repo-internal.h"
+
+#include "tests/lib/contacts-conn.h"
+#include "tests/lib/util.h"
+
+typedef struct {
+    TpBaseConnection *service_conn;
+    TpHandleRepoIface *contact_repo;
+    TpTestsContactListManager *manager;
+    TpConnection *conn;
+
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark conn_features[] = { TP_CONNECTION_FEATURE_CONNECTED, 0 };
+
+  tp_tests_create_conn (TP_TESTS_TYPE_CONTACTS_CONNECTION, "me@test.com",
+      FALSE, &test->service_conn, &test->conn);
+
+  /* this has to happen before the first handle is made, on connection */
+  test->contact_repo = tp_base_connection_get_handles (test->service_conn,
+      TP_HANDLE_TYPE_CONTACT);
+  tp_dynamic_handle_repo_set_reclaim_after (
+      (TpDynamicHandleRepo *) test->contact_repo, 3600);
+
+  tp_cli_connection_call_connect (test->conn, -1, NULL, NULL, NULL, NULL);
+  tp_tests_proxy_run_until_prepared (test->conn, conn_features);
+
+  test->manager = tp_tests_contacts_connection_get_contact_list_manager (
+      TP_TESTS_CONTACTS_CONNECTION (test->service_conn));
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  g_clear_error (&test->error);
+
+  tp_tests_connection_assert_disconnect_succeeds (test->conn);
+  g_clear_object (&test->conn);
+  g_clear_object (&test->service_conn);
+}
+
+static void
+test_contact_list_attributes (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  const gchar * const interfaces[] = { NULL };
+  TpHandle alice, bob;
+  GHashTable *attributes = NULL;
+
+  alice = tp_handle_ensure (test->contact_repo, "alice", NULL, NULL);
+  bob = tp_handle_ensure (test->contact_repo, "bob", NULL, NULL);
+  tp_tests_contact_list_manager_request_subscription (test->manager, 1,
+      &alice, "");
+
+  tp_cli_connection_interface_contact_list_run_get_contact_list_attributes (
+      test->conn, -1, (const gchar **) interfaces, TRUE, &attributes,
+      &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert (g_hash_table_lookup (attributes, GUINT_TO_POINTER (alice))
+      != NULL);
+  g_hash_table_unref (attributes);
+
+  /* nothing uses either contact after that, but this client holds alice, so
+   * only bob is reclaimed */
+  _tp_dynamic_handle_repo_sweep (test->contact_repo);
+  _tp_dynamic_handle_repo_sweep (test->contact_repo);
+  g_assert (tp_handle_is_valid (test->contact_repo, alice, NULL));
+  g_assert (!tp_handle_is_valid (test->contact_repo, bob, NULL));
+}
+
+static void
+test_inspect_cache (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpHandle carol;
+  GArray *handles = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  gchar **ids = NULL;
+
+  carol = tp_handle_ensure (test->contact_repo, "carol", NULL, NULL);
+  g_array_append_val (handles, carol);
+
+  tp_cli_connection_run_inspect_handles (test->conn, -1,
+      TP_HANDLE_TYPE_CONTACT, handles, &ids, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert_cmpstr (ids[0], ==, "carol");
+  g_strfreev (ids);
+
+  /* the cached reply names carol, so her handle must not be reclaimed and
+   * reused while it is cached */
+  _tp_dynamic_handle_repo_sweep (test->contact_repo);
+  _tp_dynamic_handle_repo_sweep (test->contact_repo);
+  g_assert (tp_handle_is_valid (test->contact_repo, carol, NULL));
+
+  tp_cli_connection_run_inspect_handles (test->conn, -1,
+      TP_HANDLE_TYPE_CONTACT, handles, &ids, &test->error, NULL);
+  g_assert_no_error (test->error);
+  g_assert_cmpstr (ids[0], ==, "carol");
+  g_strfreev (ids);
+
+  g_array_unref (handles);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  tp_tests_init (&argc, &argv);
+
+  g_test_add ("/hold-handles/contact-list-attributes", Test, NULL, setup,
+      test_contact_list_attributes, teardown);
+  g_test_add ("/hold-handles/inspect-cache", Test, NULL, setup,
+      test_inspect_cache, teardown);
+
+  return tp_tests_run_with_bus ();
+}
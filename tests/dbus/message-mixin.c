@@ -200,6 +200,36 @@ on_messages_removed (TpChannel *chan,
     }
 }
 
+static guint
+count_requests_channels (TpConnection *conn,
+    const gchar *expected_path)
+{
+  GValue *value = NULL;
+  GPtrArray *channels;
+  GError *error = NULL;
+  guint i, n = 0;
+
+  MYASSERT (tp_cli_dbus_properties_run_get (conn, -1,
+        TP_IFACE_CONNECTION_INTERFACE_REQUESTS, "Channels", &value, &error,
+        NULL), "");
+  g_assert_no_error (error);
+
+  channels = g_value_get_boxed (value);
+
+  for (i = 0; i < channels->len; i++)
+    {
+      GValueArray *details = g_ptr_array_index (channels, i);
+
+      if (!tp_strdiff (g_value_get_boxed (details->values + 0),
+            expected_path))
+        n++;
+    }
+
+  g_assert_cmpuint (channels->len, ==, n);
+  g_boxed_free (G_TYPE_VALUE, value);
+  return n;
+}
+
 int
 main (int argc,
       char **argv)
@@ -268,6 +298,10 @@ main (int argc,
           TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST);
       g_assert_cmpuint (arr->len, ==, 1);
 
+      arr = tp_asv_get_boxed (properties, "Channels",
+          TP_ARRAY_TYPE_CHANNEL_DETAILS_LIST);
+      g_assert_cmpuint (arr->len, ==, 0);
+
       g_hash_table_unref (properties);
     }
 
@@ -287,6 +321,9 @@ main (int argc,
       g_hash_table_unref (request);
     }
 
+  /* the channel has been added to the list we already fetched */
+  g_assert_cmpuint (count_requests_channels (conn, chan_path), ==, 1);
+
   chan = tp_channel_new_from_properties (conn, chan_path, parameters, &error);
   g_assert_no_error (error);
   g_hash_table_unref (parameters);
@@ -1089,6 +1126,8 @@ main (int argc,
       g_assert_no_error (error);
       MYASSERT (channels->len == 0, "%u != 0", channels->len);
       g_boxed_free (TP_ARRAY_TYPE_CHANNEL_INFO_LIST, channels);
+
+      g_assert_cmpuint (count_requests_channels (conn, NULL), ==, 0);
     }
 
   g_print ("\n\n==== End of tests ====\n");
@@ -0,0 +1,281 @@
+/* Tests of TpPropertiesMixin's batched change notification
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/properties-mixin.h>
+#include <telepathy-glib/proxy-subclass.h>
+#include <telepathy-glib/svc-generic.h>
+
+#include "tests/lib/util.h"
+
+/* An object with a few Telepathy.Properties */
+
+enum {
+    PROP_NAME,
+    PROP_LIMIT,
+    PROP_PRIVATE,
+    N_PROPS
+};
+
+static const TpPropertySignature signatures[N_PROPS] = {
+    { "name", G_TYPE_STRING },
+    { "limit", G_TYPE_UINT },
+    { "private", G_TYPE_BOOLEAN },
+};
+
+typedef struct {
+    GObject parent;
+    TpPropertiesMixin properties;
+} PropsObject;
+
+typedef struct {
+    GObjectClass parent_class;
+    TpPropertiesMixinClass properties_class;
+} PropsObjectClass;
+
+static GType props_object_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (PropsObject,
+    props_object,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_PROPERTIES_INTERFACE,
+      tp_properties_mixin_iface_init))
+
+static void
+props_object_init (PropsObject *self)
+{
+  tp_properties_mixin_init ((GObject *) self,
+      G_STRUCT_OFFSET (PropsObject, properties));
+}
+
+static void
+props_object_finalize (GObject *object)
+{
+  tp_properties_mixin_finalize (object);
+
+  ((GObjectClass *) props_object_parent_class)->finalize (object);
+}
+
+static void
+props_object_class_init (PropsObjectClass *cls)
+{
+  GObjectClass *object_class = (GObjectClass *) cls;
+
+  object_class->finalize = props_object_finalize;
+
+  tp_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (PropsObjectClass, properties_class),
+      signatures, N_PROPS, NULL);
+}
+
+typedef struct {
+    TpDBusDaemon *dbus;
+    GObject *obj;
+    TpProxy *proxy;
+    TpProxySignalConnection *values_conn;
+    TpProxySignalConnection *flags_conn;
+
+    /* the property IDs in each signal, as space-separated strings */
+    GPtrArray *values_changed;
+    GPtrArray *flags_changed;
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+record_ids (GPtrArray *signals,
+    const GPtrArray *properties)
+{
+  GString *s = g_string_new ("");
+  guint i;
+
+  for (i = 0; i < properties->len; i++)
+    {
+      guint id;
+
+      tp_value_array_unpack (g_ptr_array_index (properties, i), 1, &id);
+
+      if (i > 0)
+        g_string_append_c (s, ' ');
+
+      g_string_append_printf (s, "%u", id);
+    }
+
+  g_ptr_array_add (signals, g_string_free (s, FALSE));
+}
+
+static void
+properties_changed_cb (TpProxy *proxy,
+    const GPtrArray *properties,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  Test *test = user_data;
+
+  record_ids (test->values_changed, properties);
+}
+
+static void
+property_flags_changed_cb (TpProxy *proxy,
+    const GPtrArray *properties,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  Test *test = user_data;
+
+  record_ids (test->flags_changed, properties);
+}
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  test->dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  test->obj = tp_tests_object_new_static_class (props_object_get_type (),
+      NULL);
+  tp_dbus_daemon_register_object (test->dbus, "/Props", test->obj);
+
+  test->proxy = TP_PROXY (tp_tests_object_new_static_class (TP_TYPE_PROXY,
+      "dbus-daemon", test->dbus,
+      "bus-name", tp_dbus_daemon_get_unique_name (test->dbus),
+      "object-path", "/Props",
+      NULL));
+  tp_proxy_add_interface_by_id (test->proxy,
+      TP_IFACE_QUARK_PROPERTIES_INTERFACE);
+
+  test->values_changed = g_ptr_array_new_with_free_func (g_free);
+  test->flags_changed = g_ptr_array_new_with_free_func (g_free);
+
+  test->values_conn =
+    tp_cli_properties_interface_connect_to_properties_changed (test->proxy,
+        properties_changed_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  test->flags_conn =
+    tp_cli_properties_interface_connect_to_property_flags_changed (
+        test->proxy, property_flags_changed_cb, test, NULL, NULL,
+        &test->error);
+  g_assert_no_error (test->error);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_proxy_signal_connection_disconnect (test->values_conn);
+  tp_proxy_signal_connection_disconnect (test->flags_conn);
+  g_ptr_array_unref (test->values_changed);
+  g_ptr_array_unref (test->flags_changed);
+  g_clear_error (&test->error);
+
+  tp_clear_object (&test->proxy);
+  tp_dbus_daemon_unregister_object (test->dbus, test->obj);
+  tp_clear_object (&test->obj);
+  tp_clear_object (&test->dbus);
+}
+
+/* Wait for whatever the object has emitted, and check that it was one
+ * signal listing the given IDs, or none if @expected is NULL */
+static void
+assert_signalled (Test *test,
+    GPtrArray *signals,
+    const gchar *expected)
+{
+  tp_tests_proxy_run_until_dbus_queue_processed (test->proxy);
+
+  if (expected == NULL)
+    {
+      g_assert_cmpuint (signals->len, ==, 0);
+      return;
+    }
+
+  g_assert_cmpuint (signals->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (signals, 0), ==, expected);
+  g_ptr_array_set_size (signals, 0);
+}
+
+static void
+change_values (Test *test,
+    const gchar *name,
+    guint limit,
+    gboolean private,
+    TpPropertyFlags add,
+    TpPropertyFlags del)
+{
+  guint ids[N_PROPS] = { PROP_NAME, PROP_LIMIT, PROP_PRIVATE };
+  GValue values[N_PROPS] = { G_VALUE_INIT, G_VALUE_INIT, G_VALUE_INIT };
+  guint i;
+
+  g_value_init (&values[0], G_TYPE_STRING);
+  g_value_set_string (&values[0], name);
+  g_value_init (&values[1], G_TYPE_UINT);
+  g_value_set_uint (&values[1], limit);
+  g_value_init (&values[2], G_TYPE_BOOLEAN);
+  g_value_set_boolean (&values[2], private);
+
+  tp_properties_mixin_change_values (test->obj, N_PROPS, ids, values, add,
+      del);
+
+  for (i = 0; i < N_PROPS; i++)
+    g_value_unset (&values[i]);
+}
+
+static void
+test_change_values (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gchar *name;
+
+  /* everything is new, so everything is signalled, once */
+  change_values (test, "Badgers", 10, FALSE, TP_PROPERTY_FLAG_READ, 0);
+  assert_signalled (test, test->values_changed, "0 1 2");
+  assert_signalled (test, test->flags_changed, "0 1 2");
+
+  g_assert (tp_properties_mixin_has_property (test->obj, "name", NULL));
+  g_assert (tp_properties_mixin_is_readable (test->obj, PROP_NAME));
+
+  /* only the values which really changed are signalled, and no flags */
+  change_values (test, "Badgers", 20, TRUE, TP_PROPERTY_FLAG_READ, 0);
+  assert_signalled (test, test->values_changed, "1 2");
+  assert_signalled (test, test->flags_changed, NULL);
+
+  /* flags alone can change */
+  change_values (test, "Badgers", 20, TRUE, TP_PROPERTY_FLAG_WRITE, 0);
+  assert_signalled (test, test->values_changed, NULL);
+  assert_signalled (test, test->flags_changed, "0 1 2");
+
+  /* and nothing at all changing means no signals */
+  change_values (test, "Badgers", 20, TRUE, 0, 0);
+  assert_signalled (test, test->values_changed, NULL);
+  assert_signalled (test, test->flags_changed, NULL);
+
+  change_values (test, "Mushrooms", 20, TRUE, 0, TP_PROPERTY_FLAG_WRITE);
+  assert_signalled (test, test->values_changed, "0");
+  assert_signalled (test, test->flags_changed, "0 1 2");
+
+  g_assert (!tp_properties_mixin_is_writable (test->obj, PROP_NAME));
+  name = g_value_dup_string (
+      TP_PROPERTIES_MIXIN (test->obj)->properties[PROP_NAME].value);
+  g_assert_cmpstr (name, ==, "Mushrooms");
+  g_free (name);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  tp_tests_init (&argc, &argv);
+
+  g_test_add ("/properties-mixin/change-values", Test, NULL, setup,
+      test_change_values, teardown);
+
+  return tp_tests_run_with_bus ();
+}
@@ -8,6 +8,7 @@
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/dbus-properties-mixin.h>
 #include <telepathy-glib/debug.h>
+#include <telepathy-glib/errors.h>
 #include <telepathy-glib/proxy.h>
 #include <telepathy-glib/svc-generic.h>
 #include <telepathy-glib/util.h>
@@ -106,6 +107,129 @@ test_properties_class_init (TestPropertiesClass *cls)
       G_STRUCT_OFFSET (TestPropertiesClass, props));
 }
 
+/* The same interface, but implemented with only a variant getter */
+typedef struct _TestVariantProperties {
+    GObject parent;
+} TestVariantProperties;
+typedef struct _TestVariantPropertiesClass {
+    GObjectClass parent;
+    TpDBusPropertiesMixinClass props;
+} TestVariantPropertiesClass;
+
+GType test_variant_properties_get_type (void);
+
+#define TEST_TYPE_VARIANT_PROPERTIES \
+  (test_variant_properties_get_type ())
+
+G_DEFINE_TYPE_WITH_CODE (TestVariantProperties,
+    test_variant_properties,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TEST_TYPE_SVC_WITH_PROPERTIES, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init));
+
+static void
+test_variant_properties_init (TestVariantProperties *self)
+{
+}
+
+static GVariant *
+prop_variant_getter (GObject *object,
+    GQuark interface,
+    GQuark name,
+    gpointer user_data)
+{
+  if (tp_strdiff (user_data, "read"))
+    g_assert_cmpstr (user_data, ==, "full-access");
+
+  return g_variant_new_uint32 (43);
+}
+
+static void
+test_variant_properties_class_init (TestVariantPropertiesClass *cls)
+{
+  static TpDBusPropertiesMixinPropImpl with_properties_props[] = {
+        { "ReadOnly", "read", NULL },
+        { "ReadWrite", "full-access", NULL },
+        { "WriteOnly", "black-hole", NULL },
+        { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl interfaces[] = {
+      { WITH_PROPERTIES_IFACE, NULL, NULL, with_properties_props },
+      { NULL }
+  };
+
+  cls->props.interfaces = interfaces;
+
+  tp_dbus_properties_mixin_class_init (G_OBJECT_CLASS (cls),
+      G_STRUCT_OFFSET (TestVariantPropertiesClass, props));
+  tp_dbus_properties_mixin_class_set_variant_getter (G_OBJECT_CLASS (cls),
+      WITH_PROPERTIES_IFACE, prop_variant_getter);
+}
+
+/* The same again, but declared to be immutable */
+typedef struct _TestImmutableProperties {
+    GObject parent;
+    guint n_gets;
+} TestImmutableProperties;
+typedef struct _TestImmutablePropertiesClass {
+    GObjectClass parent;
+    TpDBusPropertiesMixinClass props;
+} TestImmutablePropertiesClass;
+
+GType test_immutable_properties_get_type (void);
+
+#define TEST_TYPE_IMMUTABLE_PROPERTIES \
+  (test_immutable_properties_get_type ())
+
+G_DEFINE_TYPE_WITH_CODE (TestImmutableProperties,
+    test_immutable_properties,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TEST_TYPE_SVC_WITH_PROPERTIES, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init));
+
+static void
+test_immutable_properties_init (TestImmutableProperties *self)
+{
+}
+
+static GVariant *
+prop_immutable_getter (GObject *object,
+    GQuark interface,
+    GQuark name,
+    gpointer user_data)
+{
+  TestImmutableProperties *self = (TestImmutableProperties *) object;
+
+  self->n_gets++;
+  return g_variant_new_uint32 (44);
+}
+
+static void
+test_immutable_properties_class_init (TestImmutablePropertiesClass *cls)
+{
+  static TpDBusPropertiesMixinPropImpl with_properties_props[] = {
+        { "ReadOnly", NULL, NULL },
+        { "ReadWrite", NULL, NULL },
+        { "WriteOnly", NULL, NULL },
+        { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl interfaces[] = {
+      { WITH_PROPERTIES_IFACE, NULL, NULL, with_properties_props },
+      { NULL }
+  };
+
+  cls->props.interfaces = interfaces;
+
+  tp_dbus_properties_mixin_class_init (G_OBJECT_CLASS (cls),
+      G_STRUCT_OFFSET (TestImmutablePropertiesClass, props));
+  tp_dbus_properties_mixin_class_set_variant_getter (G_OBJECT_CLASS (cls),
+      WITH_PROPERTIES_IFACE, prop_immutable_getter);
+  tp_dbus_properties_mixin_class_set_immutable (G_OBJECT_CLASS (cls),
+      WITH_PROPERTIES_IFACE);
+}
+
 static void
 test_get (TpProxy *proxy)
 {
@@ -119,6 +243,31 @@ test_get (TpProxy *proxy)
   g_boxed_free (G_TYPE_VALUE, value);
 }
 
+static void
+test_get_unknown (TpProxy *proxy)
+{
+  /* some of these have the same length as a real property, or differ from
+   * one in a single character */
+  static const gchar * const names[] = { "", "R", "ReadOnlx", "readOnly",
+      "ReadWritf", "WriteOnlyAndMore", NULL };
+  GValue *value;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; names[i] != NULL; i++)
+    {
+      g_assert (!tp_cli_dbus_properties_run_get (proxy, -1,
+            WITH_PROPERTIES_IFACE, names[i], &value, &error, NULL));
+      g_assert_error (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED);
+      g_clear_error (&error);
+    }
+
+  g_assert (!tp_cli_dbus_properties_run_get (proxy, -1,
+        WITH_PROPERTIES_IFACE, "WriteOnly", &value, &error, NULL));
+  g_assert_error (error, TP_ERROR, TP_ERROR_PERMISSION_DENIED);
+  g_clear_error (&error);
+}
+
 static void
 test_set (TpProxy *proxy)
 {
@@ -190,8 +339,109 @@ properties_changed_cb (
 typedef struct {
     TestProperties *obj;
     TpProxy *proxy;
+    TestVariantProperties *variant_obj;
+    TpProxy *variant_proxy;
+    GObject *immutable_obj;
+    TpProxy *immutable_proxy;
 } Context;
 
+static void
+test_variant_getter (Context *ctx)
+{
+  GValue *value;
+  GValue local = G_VALUE_INIT;
+  GHashTable *hash;
+  GVariant *vardict;
+  GError *error = NULL;
+  guint32 u;
+
+  /* over D-Bus, replied to without GValues */
+  g_assert (tp_cli_dbus_properties_run_get (ctx->variant_proxy, -1,
+        WITH_PROPERTIES_IFACE, "ReadOnly", &value, NULL, NULL));
+  g_assert (G_VALUE_HOLDS_UINT (value));
+  g_assert_cmpuint (g_value_get_uint (value), ==, 43);
+  g_boxed_free (G_TYPE_VALUE, value);
+
+  g_assert (!tp_cli_dbus_properties_run_get (ctx->variant_proxy, -1,
+        WITH_PROPERTIES_IFACE, "WriteOnly", &value, &error, NULL));
+  g_assert_error (error, TP_ERROR, TP_ERROR_PERMISSION_DENIED);
+  g_clear_error (&error);
+
+  g_assert (tp_cli_dbus_properties_run_get_all (ctx->variant_proxy, -1,
+        WITH_PROPERTIES_IFACE, &hash, NULL, NULL));
+  g_assert_cmpuint (g_hash_table_size (hash), ==, 2);
+  g_assert_cmpuint (tp_asv_get_uint32 (hash, "ReadOnly", NULL), ==, 43);
+  g_assert_cmpuint (tp_asv_get_uint32 (hash, "ReadWrite", NULL), ==, 43);
+  g_hash_table_unref (hash);
+
+  /* locally, converted to a GValue where necessary */
+  g_assert (tp_dbus_properties_mixin_get (G_OBJECT (ctx->variant_obj),
+        WITH_PROPERTIES_IFACE, "ReadWrite", &local, NULL));
+  g_assert (G_VALUE_HOLDS_UINT (&local));
+  g_assert_cmpuint (g_value_get_uint (&local), ==, 43);
+  g_value_unset (&local);
+
+  vardict = tp_dbus_properties_mixin_dup_all_vardict (
+      G_OBJECT (ctx->variant_obj), WITH_PROPERTIES_IFACE);
+  g_assert_cmpuint (g_variant_n_children (vardict), ==, 2);
+  g_assert (g_variant_lookup (vardict, "ReadOnly", "u", &u));
+  g_assert_cmpuint (u, ==, 43);
+  g_variant_unref (vardict);
+
+  /* and with an ordinary GValue getter */
+  vardict = tp_dbus_properties_mixin_dup_all_vardict (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE);
+  g_assert_cmpuint (g_variant_n_children (vardict), ==, 2);
+  g_assert (g_variant_lookup (vardict, "ReadWrite", "u", &u));
+  g_assert_cmpuint (u, ==, 42);
+  g_assert (!g_variant_lookup (vardict, "WriteOnly", "u", &u));
+  g_variant_unref (vardict);
+}
+
+static void
+test_immutable (Context *ctx)
+{
+  TestImmutableProperties *obj =
+    (TestImmutableProperties *) ctx->immutable_obj;
+  GValue *value;
+  GHashTable *hash;
+  GVariant *vardict;
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < 3; i++)
+    {
+      g_assert (tp_cli_dbus_properties_run_get_all (ctx->immutable_proxy, -1,
+            WITH_PROPERTIES_IFACE, &hash, NULL, NULL));
+      g_assert_cmpuint (g_hash_table_size (hash), ==, 2);
+      g_assert_cmpuint (tp_asv_get_uint32 (hash, "ReadOnly", NULL), ==, 44);
+      g_assert_cmpuint (tp_asv_get_uint32 (hash, "ReadWrite", NULL), ==, 44);
+      g_hash_table_unref (hash);
+    }
+
+  /* the two readable properties were only got once each */
+  g_assert_cmpuint (obj->n_gets, ==, 2);
+
+  g_assert (tp_cli_dbus_properties_run_get (ctx->immutable_proxy, -1,
+        WITH_PROPERTIES_IFACE, "ReadWrite", &value, NULL, NULL));
+  g_assert (G_VALUE_HOLDS_UINT (value));
+  g_assert_cmpuint (g_value_get_uint (value), ==, 44);
+  g_boxed_free (G_TYPE_VALUE, value);
+
+  /* errors are still reported as usual */
+  g_assert (!tp_cli_dbus_properties_run_get (ctx->immutable_proxy, -1,
+        WITH_PROPERTIES_IFACE, "WriteOnly", &value, &error, NULL));
+  g_assert_error (error, TP_ERROR, TP_ERROR_PERMISSION_DENIED);
+  g_clear_error (&error);
+
+  vardict = tp_dbus_properties_mixin_dup_all_vardict (ctx->immutable_obj,
+      WITH_PROPERTIES_IFACE);
+  g_assert_cmpuint (g_variant_n_children (vardict), ==, 2);
+  g_variant_unref (vardict);
+
+  g_assert_cmpuint (obj->n_gets, ==, 2);
+}
+
 static void
 test_emit_changed (Context *ctx)
 {
@@ -216,6 +466,85 @@ test_emit_changed (Context *ctx)
   tp_proxy_signal_connection_disconnect (signal_conn);
 }
 
+typedef struct {
+    GMainLoop *loop;
+    guint n_signals;
+} DeferContext;
+
+static void
+deferred_changed_cb (
+    TpProxy *proxy,
+    const gchar *interface_name,
+    GHashTable *changed_properties,
+    const gchar **invalidated_properties,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  DeferContext *dc = user_data;
+
+  dc->n_signals++;
+
+  g_assert_cmpstr (interface_name, ==, WITH_PROPERTIES_IFACE);
+  g_assert_cmpuint (g_hash_table_size (changed_properties), ==, 1);
+  g_assert_cmpuint (tp_asv_get_uint32 (changed_properties, "ReadOnly", NULL),
+      ==, 42);
+
+  /* the first and last signals are the deferred ones */
+  if (dc->n_signals == 2)
+    {
+      g_assert_cmpuint (g_strv_length ((gchar **) invalidated_properties), ==,
+          0);
+    }
+  else
+    {
+      g_assert_cmpuint (g_strv_length ((gchar **) invalidated_properties), ==,
+          1);
+      g_assert_cmpstr (invalidated_properties[0], ==, "ReadWrite");
+    }
+
+  g_main_loop_quit (dc->loop);
+}
+
+static void
+test_defer_changed (Context *ctx)
+{
+  DeferContext dc = { g_main_loop_new (NULL, FALSE), 0 };
+  TpProxySignalConnection *signal_conn;
+  const gchar *read_only[] = { "ReadOnly", NULL };
+  const gchar *both[] = { "ReadWrite", "ReadOnly", NULL };
+  GError *error = NULL;
+
+  signal_conn = tp_cli_dbus_properties_connect_to_properties_changed (
+      ctx->proxy, deferred_changed_cb, &dc, NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  /* An immediate emission comes after the deferred changes, which are
+   * merged into one signal */
+  tp_dbus_properties_mixin_defer_properties_changed (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE, read_only);
+  tp_dbus_properties_mixin_defer_properties_changed (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE, both);
+  tp_dbus_properties_mixin_emit_properties_changed (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE, read_only);
+
+  while (dc.n_signals < 2)
+    g_main_loop_run (dc.loop);
+
+  /* Without one, they are emitted from the main loop */
+  tp_dbus_properties_mixin_defer_properties_changed (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE, both);
+  tp_dbus_properties_mixin_defer_properties_changed (G_OBJECT (ctx->obj),
+      WITH_PROPERTIES_IFACE, read_only);
+  g_main_loop_run (dc.loop);
+  g_assert_cmpuint (dc.n_signals, ==, 3);
+
+  tp_tests_proxy_run_until_dbus_queue_processed (ctx->proxy);
+  g_assert_cmpuint (dc.n_signals, ==, 3);
+
+  tp_proxy_signal_connection_disconnect (signal_conn);
+  g_main_loop_unref (dc.loop);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -237,16 +566,51 @@ main (int argc, char **argv)
 
   g_assert (tp_proxy_has_interface (ctx.proxy, "org.freedesktop.DBus.Properties"));
 
+  ctx.variant_obj = tp_tests_object_new_static_class (
+      TEST_TYPE_VARIANT_PROPERTIES, NULL);
+  tp_dbus_daemon_register_object (dbus_daemon, "/Variant", ctx.variant_obj);
+
+  ctx.variant_proxy = TP_PROXY (tp_tests_object_new_static_class (
+      TP_TYPE_PROXY,
+      "dbus-daemon", dbus_daemon,
+      "bus-name", tp_dbus_daemon_get_unique_name (dbus_daemon),
+      "object-path", "/Variant",
+      NULL));
+
+  ctx.immutable_obj = tp_tests_object_new_static_class (
+      TEST_TYPE_IMMUTABLE_PROPERTIES, NULL);
+  tp_dbus_daemon_register_object (dbus_daemon, "/Immutable",
+      ctx.immutable_obj);
+
+  ctx.immutable_proxy = TP_PROXY (tp_tests_object_new_static_class (
+      TP_TYPE_PROXY,
+      "dbus-daemon", dbus_daemon,
+      "bus-name", tp_dbus_daemon_get_unique_name (dbus_daemon),
+      "object-path", "/Immutable",
+      NULL));
+
   g_test_add_data_func ("/properties/get", ctx.proxy, (GTestDataFunc) test_get);
+  g_test_add_data_func ("/properties/get-unknown", ctx.proxy,
+      (GTestDataFunc) test_get_unknown);
   g_test_add_data_func ("/properties/set", ctx.proxy, (GTestDataFunc) test_set);
   g_test_add_data_func ("/properties/get-all", ctx.proxy, (GTestDataFunc) test_get_all);
 
   g_test_add_data_func ("/properties/changed", &ctx, (GTestDataFunc) test_emit_changed);
+  g_test_add_data_func ("/properties/defer-changed", &ctx,
+      (GTestDataFunc) test_defer_changed);
+  g_test_add_data_func ("/properties/variant-getter", &ctx,
+      (GTestDataFunc) test_variant_getter);
+  g_test_add_data_func ("/properties/immutable", &ctx,
+      (GTestDataFunc) test_immutable);
 
   tp_tests_run_with_bus ();
 
   g_object_unref (ctx.obj);
   g_object_unref (ctx.proxy);
+  g_object_unref (ctx.variant_obj);
+  g_object_unref (ctx.variant_proxy);
+  g_object_unref (ctx.immutable_obj);
+  g_object_unref (ctx.immutable_proxy);
   g_object_unref (dbus_daemon);
 
   return 0;
@@ -669,6 +669,65 @@ test_normalize (Test *test,
   g_clear_error (&test->error);
 }
 
+static void
+test_normalize_many (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  static const gchar * const contacts[] = { "MiXeDcAsE", "", "Other",
+      "MiXeDcAsE", NULL };
+  GAsyncResult *result = NULL;
+  GHashTable *normalized;
+  GHashTable *failures = NULL;
+  GError *e;
+  gchar *s;
+
+  tp_tests_proxy_run_until_prepared (test->cm, NULL);
+  test->protocol = g_object_ref (
+      tp_connection_manager_get_protocol_object (test->cm, "example"));
+
+  tp_protocol_normalize_contacts_async (test->protocol, contacts,
+      NULL, tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  normalized = tp_protocol_normalize_contacts_finish (test->protocol,
+      result, &failures, &test->error);
+  g_assert_no_error (test->error);
+  g_clear_object (&result);
+
+  g_assert_cmpuint (g_hash_table_size (normalized), ==, 2);
+  g_assert_cmpstr (g_hash_table_lookup (normalized, "MiXeDcAsE"), ==,
+      "mixedcase");
+  g_assert_cmpstr (g_hash_table_lookup (normalized, "Other"), ==, "other");
+
+  g_assert_cmpuint (g_hash_table_size (failures), ==, 1);
+  e = g_hash_table_lookup (failures, "");
+  g_assert_error (e, TP_ERROR, TP_ERROR_INVALID_HANDLE);
+
+  g_hash_table_unref (normalized);
+  g_hash_table_unref (failures);
+
+  /* the results are remembered for the single-contact method too */
+  tp_protocol_normalize_contact_async (test->protocol,
+      "Other", NULL, tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  s = tp_protocol_normalize_contact_finish (test->protocol, result,
+      &test->error);
+  g_assert_no_error (test->error);
+  g_assert_cmpstr (s, ==, "other");
+  g_clear_object (&result);
+  g_free (s);
+
+  /* an empty list is fine */
+  tp_protocol_normalize_contacts_async (test->protocol, contacts + 4,
+      NULL, tp_tests_result_ready_cb, &result);
+  tp_tests_run_until_result (&result);
+  normalized = tp_protocol_normalize_contacts_finish (test->protocol,
+      result, NULL, &test->error);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (g_hash_table_size (normalized), ==, 0);
+  g_hash_table_unref (normalized);
+  g_clear_object (&result);
+}
+
 static void
 test_id (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -750,6 +809,8 @@ main (int argc,
       test_protocol_object_from_file, teardown);
   g_test_add ("/protocol-objects/normalize", Test, NULL, setup,
       test_normalize, teardown);
+  g_test_add ("/protocol-objects/normalize-many", Test, NULL, setup,
+      test_normalize_many, teardown);
   g_test_add ("/protocol-objects/id", Test, NULL, setup,
       test_id, teardown);
 
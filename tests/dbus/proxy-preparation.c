@@ -11,6 +11,8 @@
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "telepathy-glib/proxy-internal.h"
+
 #include "tests/lib/util.h"
 #include "tests/lib/simple-account.h"
 #include "tests/lib/simple-conn.h"
@@ -405,6 +407,53 @@ test_interface_later (Test *test,
         TP_TESTS_MY_CONN_PROXY_FEATURE_INTERFACE_LATER));
 }
 
+static void
+prepare_many_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_prepare_many_deadline (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark core[] = { TP_CONNECTION_FEATURE_CORE, 0 };
+  GQuark stalled[] = { TP_TESTS_MY_CONN_PROXY_FEATURE_STALLED, 0 };
+  GSimpleAsyncResult *result;
+  TpProxyPrepareMany *prepare;
+
+  result = g_simple_async_result_new (NULL, prepare_many_cb, test,
+      test_prepare_many_deadline);
+  prepare = _tp_proxy_prepare_many_new (result);
+  g_object_unref (result);
+
+  /* one of these is prepared already, and the other never finishes */
+  _tp_proxy_prepare_many_add (prepare, test->connection, core);
+  _tp_proxy_prepare_many_add (prepare, test->my_conn, stalled);
+  _tp_proxy_prepare_many_start (prepare, 100);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+
+  /* we stopped waiting when the deadline passed */
+  g_assert (test->my_conn->stalled_result != NULL);
+  g_assert (!tp_proxy_is_prepared (test->my_conn,
+        TP_TESTS_MY_CONN_PROXY_FEATURE_STALLED));
+
+  /* finishing late doesn't complete the result a second time */
+  g_simple_async_result_complete_in_idle (test->my_conn->stalled_result);
+  tp_clear_object (&test->my_conn->stalled_result);
+  tp_tests_proxy_run_until_prepared (test->my_conn, stalled);
+  tp_tests_proxy_run_until_dbus_queue_processed (test->my_conn);
+  g_assert_cmpint (test->wait, ==, 0);
+}
+
 int
 main (int argc,
       char **argv)
@@ -434,6 +483,8 @@ main (int argc,
       test_before_connected, teardown);
   g_test_add ("/proxy-preparation/interface-later", Test, NULL, setup,
       test_interface_later, teardown);
+  g_test_add ("/proxy-preparation/prepare-many-deadline", Test, NULL, setup,
+      test_prepare_many_deadline, teardown);
 
   return tp_tests_run_with_bus ();
 }
@@ -0,0 +1,318 @@
+/* Tests of TpBaseRoomConfig's change notification
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/lib/simple-conn.h"
+#include "tests/lib/util.h"
+
+/* A chat room channel whose configuration is a plain TpBaseRoomConfig */
+
+typedef struct {
+    TpBaseChannel parent;
+    TpBaseRoomConfig *config;
+} MucChannel;
+
+typedef struct {
+    TpBaseChannelClass parent_class;
+} MucChannelClass;
+
+static GType muc_channel_get_type (void);
+
+G_DEFINE_TYPE_WITH_CODE (MucChannel,
+    muc_channel,
+    TP_TYPE_BASE_CHANNEL,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_INTERFACE_ROOM_CONFIG,
+      tp_base_room_config_iface_init))
+
+static void
+muc_channel_init (MucChannel *self G_GNUC_UNUSED)
+{
+}
+
+static void
+muc_channel_constructed (GObject *object)
+{
+  MucChannel *self = (MucChannel *) object;
+  void (*chain_up) (GObject *) =
+    ((GObjectClass *) muc_channel_parent_class)->constructed;
+
+  if (chain_up != NULL)
+    chain_up (object);
+
+  self->config = g_object_new (TP_TYPE_BASE_ROOM_CONFIG,
+      "channel", self,
+      NULL);
+  tp_base_channel_register ((TpBaseChannel *) self);
+}
+
+static void
+muc_channel_dispose (GObject *object)
+{
+  MucChannel *self = (MucChannel *) object;
+
+  tp_clear_object (&self->config);
+
+  ((GObjectClass *) muc_channel_parent_class)->dispose (object);
+}
+
+static GPtrArray *
+muc_channel_get_interfaces (TpBaseChannel *chan)
+{
+  GPtrArray *interfaces = TP_BASE_CHANNEL_CLASS (
+      muc_channel_parent_class)->get_interfaces (chan);
+
+  g_ptr_array_add (interfaces, TP_IFACE_CHANNEL_INTERFACE_ROOM_CONFIG);
+  return interfaces;
+}
+
+static void
+muc_channel_class_init (MucChannelClass *cls)
+{
+  GObjectClass *object_class = (GObjectClass *) cls;
+  TpBaseChannelClass *base_class = (TpBaseChannelClass *) cls;
+
+  object_class->constructed = muc_channel_constructed;
+  object_class->dispose = muc_channel_dispose;
+
+  base_class->channel_type = TP_IFACE_CHANNEL_TYPE_TEXT;
+  base_class->target_handle_type = TP_HANDLE_TYPE_NONE;
+  base_class->get_interfaces = muc_channel_get_interfaces;
+  base_class->close = tp_base_channel_destroyed;
+
+  tp_base_room_config_register_class (base_class);
+}
+
+typedef struct {
+    TpBaseConnection *service_conn;
+    TpConnection *client_conn;
+    MucChannel *chan;
+    TpBaseRoomConfig *config;
+    TpProxy *proxy;
+    TpProxySignalConnection *signal_conn;
+
+    /* the sorted names of the properties in each PropertiesChanged */
+    GPtrArray *signals;
+    GError *error /* initialized where needed */;
+} Test;
+
+static void
+properties_changed_cb (TpProxy *proxy,
+    const gchar *interface_name,
+    GHashTable *changed_properties,
+    const gchar **invalidated_properties,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  Test *test = user_data;
+  GList *names, *l;
+  GString *s = g_string_new ("");
+
+  g_assert_cmpstr (interface_name, ==,
+      TP_IFACE_CHANNEL_INTERFACE_ROOM_CONFIG);
+  g_assert_cmpuint (g_strv_length ((gchar **) invalidated_properties), ==,
+      0);
+
+  names = g_list_sort (g_hash_table_get_keys (changed_properties),
+      (GCompareFunc) g_strcmp0);
+
+  for (l = names; l != NULL; l = l->next)
+    {
+      if (l != names)
+        g_string_append_c (s, ' ');
+
+      g_string_append (s, l->data);
+    }
+
+  g_list_free (names);
+  g_ptr_array_add (test->signals, g_string_free (s, FALSE));
+}
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gchar *path;
+
+  tp_tests_create_and_connect_conn (TP_TESTS_TYPE_SIMPLE_CONNECTION,
+      "me@test.com", &test->service_conn, &test->client_conn);
+
+  path = g_strdup_printf ("%s/MucChannel",
+      tp_proxy_get_object_path (test->client_conn));
+
+  test->chan = tp_tests_object_new_static_class (muc_channel_get_type (),
+      "connection", test->service_conn,
+      "object-path", path,
+      NULL);
+  test->config = test->chan->config;
+
+  test->proxy = TP_PROXY (tp_tests_object_new_static_class (TP_TYPE_PROXY,
+      "dbus-daemon", tp_proxy_get_dbus_daemon (test->client_conn),
+      "bus-name", tp_proxy_get_bus_name (test->client_conn),
+      "object-path", path,
+      NULL));
+  g_free (path);
+
+  test->signals = g_ptr_array_new_with_free_func (g_free);
+  test->signal_conn = tp_cli_dbus_properties_connect_to_properties_changed (
+      test->proxy, properties_changed_cb, test, NULL, NULL, &test->error);
+  g_assert_no_error (test->error);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_proxy_signal_connection_disconnect (test->signal_conn);
+  g_ptr_array_unref (test->signals);
+  tp_clear_object (&test->proxy);
+  tp_clear_object (&test->chan);
+
+  tp_tests_connection_assert_disconnect_succeeds (test->client_conn);
+  tp_clear_object (&test->client_conn);
+  tp_clear_object (&test->service_conn);
+}
+
+/* Wait for whatever the service has emitted, and check that it was one
+ * PropertiesChanged signal for @expected, or none if @expected is NULL */
+static void
+assert_signalled (Test *test,
+    const gchar *expected)
+{
+  tp_tests_proxy_run_until_dbus_queue_processed (test->proxy);
+
+  if (expected == NULL)
+    {
+      g_assert_cmpuint (test->signals->len, ==, 0);
+      return;
+    }
+
+  g_assert_cmpuint (test->signals->len, ==, 1);
+  g_assert_cmpstr (g_ptr_array_index (test->signals, 0), ==, expected);
+  g_ptr_array_set_size (test->signals, 0);
+}
+
+static void
+test_revert (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  g_object_set (test->config, "title", "Badgers", NULL);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "Title");
+
+  /* changed and set back, so clients already have the right value */
+  g_object_set (test->config, "title", "Mushrooms", NULL);
+  g_object_set (test->config, "title", "Badgers", NULL);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, NULL);
+
+  /* only the properties which really changed are included */
+  g_object_set (test->config,
+      "title", "Snakes",
+      "limit", 10,
+      "moderated", TRUE,
+      NULL);
+  g_object_set (test->config,
+      "title", "Badgers",
+      "moderated", FALSE,
+      NULL);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "Limit");
+}
+
+static void
+test_revert_mutable (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_base_room_config_set_property_mutable (test->config,
+      TP_BASE_ROOM_CONFIG_TITLE, TRUE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "MutableProperties");
+
+  tp_base_room_config_set_property_mutable (test->config,
+      TP_BASE_ROOM_CONFIG_TITLE, FALSE);
+  tp_base_room_config_set_property_mutable (test->config,
+      TP_BASE_ROOM_CONFIG_TITLE, TRUE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, NULL);
+
+  tp_base_room_config_set_property_mutable (test->config,
+      TP_BASE_ROOM_CONFIG_TITLE, FALSE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "MutableProperties");
+}
+
+static void
+test_revert_can_update (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_base_room_config_set_can_update_configuration (test->config, TRUE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "CanUpdateConfiguration");
+
+  tp_base_room_config_set_can_update_configuration (test->config, FALSE);
+  tp_base_room_config_set_can_update_configuration (test->config, TRUE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, NULL);
+
+  tp_base_room_config_set_can_update_configuration (test->config, FALSE);
+  tp_base_room_config_emit_properties_changed (test->config);
+  assert_signalled (test, "CanUpdateConfiguration");
+}
+
+static void
+test_set_retrieved (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gboolean retrieved;
+
+  g_object_set (test->config,
+      "title", "Badgers",
+      "persistent", TRUE,
+      NULL);
+  tp_base_room_config_set_can_update_configuration (test->config, TRUE);
+
+  /* one signal for the queued changes and ConfigurationRetrieved */
+  tp_base_room_config_set_retrieved (test->config);
+  assert_signalled (test,
+      "CanUpdateConfiguration ConfigurationRetrieved Persistent Title");
+
+  g_object_get (test->config, "configuration-retrieved", &retrieved, NULL);
+  g_assert (retrieved);
+
+  /* with nothing queued, there is nothing to signal... */
+  tp_base_room_config_set_retrieved (test->config);
+  assert_signalled (test, NULL);
+
+  /* ... and afterwards, it is just tp_base_room_config_emit_properties_changed
+   * again */
+  g_object_set (test->config, "description", "Mushrooms", NULL);
+  tp_base_room_config_set_retrieved (test->config);
+  assert_signalled (test, "Description");
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  tp_tests_init (&argc, &argv);
+
+  g_test_add ("/room-config/revert", Test, NULL, setup, test_revert,
+      teardown);
+  g_test_add ("/room-config/revert-mutable", Test, NULL, setup,
+      test_revert_mutable, teardown);
+  g_test_add ("/room-config/revert-can-update", Test, NULL, setup,
+      test_revert_can_update, teardown);
+  g_test_add ("/room-config/set-retrieved", Test, NULL, setup,
+      test_set_retrieved, teardown);
+
+  return tp_tests_run_with_bus ();
+}
@@ -230,6 +230,37 @@ test_listing (Test *test,
   g_assert_cmpstr (tp_room_info_get_server (room), ==, "the server");
 }
 
+static void
+test_want_more (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  g_signal_connect (test->room_list, "got-room",
+      G_CALLBACK (got_room_cb), test);
+
+  /* nothing is emitted until we ask for it */
+  tp_room_list_want_more (test->room_list, 0);
+  tp_room_list_set_filter (test->room_list, "NAME", 0);
+  tp_room_list_start (test->room_list);
+
+  while (tp_room_list_get_n_queued_rooms (test->room_list) < 3)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (test->rooms->len, ==, 0);
+
+  tp_room_list_want_more (test->room_list, 2);
+  g_assert_cmpuint (test->rooms->len, ==, 2);
+  g_assert_cmpuint (tp_room_list_get_n_queued_rooms (test->room_list), ==, 1);
+  g_assert_cmpstr (tp_room_info_get_name (g_ptr_array_index (test->rooms, 0)),
+      ==, "the name");
+
+  /* the remaining room has 10 members, so it is discarded */
+  tp_room_list_set_filter (test->room_list, NULL, 11);
+  g_assert_cmpuint (tp_room_list_get_n_queued_rooms (test->room_list), ==, 0);
+
+  tp_room_list_want_more (test->room_list, 5);
+  g_assert_cmpuint (test->rooms->len, ==, 2);
+}
+
 static void
 room_list_failed_cb (TpRoomList *room_list,
     GError *error,
@@ -311,6 +342,8 @@ main (int argc,
       test_properties, teardown);
   g_test_add ("/room-list-channel/listing", Test, NULL, setup,
       test_listing, teardown);
+  g_test_add ("/room-list-channel/want-more", Test, NULL, setup,
+      test_want_more, teardown);
   g_test_add ("/room-list-channel/list-rooms-fail", Test, NULL, setup,
       test_list_room_fails, teardown);
   g_test_add ("/room-list-channel/invalidated", Test, NULL, setup,
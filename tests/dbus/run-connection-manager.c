@@ -0,0 +1,165 @@
+/* Tests of tp_run_connection_manager()'s idle timeout and hand-off
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <dbus/dbus.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/lib/simple-manager.h"
+#include "tests/lib/util.h"
+
+#define CM_BUS_NAME TP_CM_BUS_NAME_BASE "simple"
+
+typedef struct {
+    TpDBusDaemon *dbus;
+    /* a connection of our own, standing in for another instance of the
+     * connection manager */
+    DBusConnection *other;
+} Test;
+
+static TpBaseConnectionManager *
+construct_cm (void)
+{
+  return tp_tests_object_new_static_class (
+      TP_TESTS_TYPE_SIMPLE_CONNECTION_MANAGER,
+      NULL);
+}
+
+static int
+run_cm (void)
+{
+  char *argv[] = { "test-run-connection-manager", NULL };
+
+  return tp_run_connection_manager ("test-run-connection-manager", VERSION,
+      construct_cm, 1, argv);
+}
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  DBusError error = DBUS_ERROR_INIT;
+
+  test->dbus = tp_tests_dbus_daemon_dup_or_die ();
+
+  test->other = dbus_bus_get_private (DBUS_BUS_STARTER, &error);
+  g_assert (test->other != NULL);
+  g_assert (!dbus_error_is_set (&error));
+  dbus_connection_set_exit_on_disconnect (test->other, FALSE);
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  g_unsetenv ("TP_CM_HANDOFF");
+  g_unsetenv ("TP_CM_IDLE_TIMEOUT");
+
+  /* a connection manager doesn't give its name back when it exits */
+  tp_dbus_daemon_release_name (test->dbus, CM_BUS_NAME, NULL);
+
+  dbus_connection_close (test->other);
+  dbus_connection_unref (test->other);
+  tp_clear_object (&test->dbus);
+}
+
+static void
+test_idle_timeout (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gint64 before, elapsed;
+
+  g_setenv ("TP_CM_IDLE_TIMEOUT", "100", TRUE);
+
+  before = g_get_monotonic_time ();
+  g_assert_cmpint (run_cm (), ==, 0);
+  elapsed = g_get_monotonic_time () - before;
+
+  /* it waited for the timeout we asked for, not the default 5 seconds */
+  g_assert_cmpint (elapsed, >=, 100 * G_TIME_SPAN_MILLISECOND);
+  g_assert_cmpint (elapsed, <, 5 * G_TIME_SPAN_SECOND);
+}
+
+static void
+test_handoff_refused (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  DBusError error = DBUS_ERROR_INIT;
+
+  /* the running instance didn't allow its name to be taken */
+  g_assert_cmpint (dbus_bus_request_name (test->other, CM_BUS_NAME,
+        DBUS_NAME_FLAG_DO_NOT_QUEUE, &error), ==,
+      DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+  g_assert (!dbus_error_is_set (&error));
+
+  g_setenv ("TP_CM_HANDOFF", "1", TRUE);
+  g_setenv ("TP_CM_IDLE_TIMEOUT", "100", TRUE);
+
+  g_test_expect_message ("tp-glib/params", G_LOG_LEVEL_WARNING,
+      "*Couldn't claim bus name*");
+  g_assert_cmpint (run_cm (), ==, 1);
+  g_test_assert_expected_messages ();
+
+  /* the running instance still has the name */
+  g_assert_cmpint (dbus_bus_release_name (test->other, CM_BUS_NAME, NULL),
+      ==, DBUS_RELEASE_NAME_REPLY_RELEASED);
+}
+
+static gboolean
+take_over_cb (gpointer user_data)
+{
+  Test *test = user_data;
+  DBusError error = DBUS_ERROR_INIT;
+
+  g_assert_cmpint (dbus_bus_request_name (test->other, CM_BUS_NAME,
+        DBUS_NAME_FLAG_DO_NOT_QUEUE | DBUS_NAME_FLAG_REPLACE_EXISTING,
+        &error), ==, DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER);
+  g_assert (!dbus_error_is_set (&error));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_handoff (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gint64 before, elapsed;
+
+  /* a newer instance takes the name, so this one exits as soon as it has no
+   * connections, without waiting a minute to be idle */
+  g_setenv ("TP_CM_HANDOFF", "1", TRUE);
+  g_setenv ("TP_CM_IDLE_TIMEOUT", "60000", TRUE);
+  g_timeout_add (10, take_over_cb, test);
+
+  before = g_get_monotonic_time ();
+  g_assert_cmpint (run_cm (), ==, 0);
+  elapsed = g_get_monotonic_time () - before;
+  g_assert_cmpint (elapsed, <, 5 * G_TIME_SPAN_SECOND);
+
+  g_assert_cmpint (dbus_bus_release_name (test->other, CM_BUS_NAME, NULL),
+      ==, DBUS_RELEASE_NAME_REPLY_RELEASED);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  tp_tests_init (&argc, &argv);
+
+  g_test_add ("/run-connection-manager/idle-timeout", Test, NULL, setup,
+      test_idle_timeout, teardown);
+  g_test_add ("/run-connection-manager/handoff-refused", Test, NULL, setup,
+      test_handoff_refused, teardown);
+  g_test_add ("/run-connection-manager/handoff", Test, NULL, setup,
+      test_handoff, teardown);
+
+  return tp_tests_run_with_bus ();
+}
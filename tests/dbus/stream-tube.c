@@ -11,7 +11,10 @@
 
 #include <string.h>
 
+#include <gio/gnetworking.h>
+
 #include <telepathy-glib/stream-tube-channel.h>
+#include <telepathy-glib/stream-tube-relay.h>
 #include <telepathy-glib/debug.h>
 #include <telepathy-glib/defs.h>
 #include <telepathy-glib/dbus.h>
@@ -23,6 +26,7 @@
 #ifdef HAVE_GIO_UNIX
 #include <gio/gio.h>
 #include <gio/gunixcredentialsmessage.h>
+#include <sys/socket.h>
 #endif
 
 #define BUFFER_SIZE 128
@@ -683,6 +687,51 @@ test_accept_twice (Test *test,
   g_assert_error (test->error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT);
 }
 
+static void
+test_accept_socket_options (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GSocket *socket;
+  GError *error = NULL;
+  gint value;
+
+  create_tube_service (test, FALSE, TP_SOCKET_ADDRESS_TYPE_IPV4,
+      TP_SOCKET_ACCESS_CONTROL_LOCALHOST, FALSE);
+
+  g_signal_connect (test->tube_chan_service, "incoming-connection",
+      G_CALLBACK (chan_incoming_connection_cb), test);
+
+  tp_stream_tube_channel_set_socket_options (test->tube, 64 * 1024,
+      64 * 1024, TRUE, TRUE);
+  /* the CM doesn't support abstract sockets, so this has no effect */
+  tp_stream_tube_channel_set_use_abstract_unix (test->tube, TRUE);
+
+  tp_stream_tube_channel_accept_async (test->tube, tube_accept_cb, test);
+
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+  g_assert (test->tube_conn != NULL);
+
+  socket = g_socket_connection_get_socket (
+      tp_stream_tube_connection_get_socket_connection (test->tube_conn));
+  g_assert_cmpuint (g_socket_get_family (socket), ==, G_SOCKET_FAMILY_IPV4);
+  g_assert (g_socket_get_keepalive (socket));
+
+  g_assert (g_socket_get_option (socket, IPPROTO_TCP, TCP_NODELAY, &value,
+        &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (value, !=, 0);
+
+  /* the kernel is free to round this up */
+  g_assert (g_socket_get_option (socket, SOL_SOCKET, SO_SNDBUF, &value,
+        &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (value, >=, 64 * 1024);
+
+  use_tube (test);
+}
+
 static void
 test_accept_outgoing (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -834,6 +883,9 @@ test_offer_race (Test *test,
   create_tube_service (test, TRUE, contexts[i].address_type,
       contexts[i].access_control, contexts[i].contact);
 
+  /* Both connections have to be able to wait to be accepted */
+  tp_stream_tube_channel_set_listen_backlog (test->tube, 2);
+
   tp_stream_tube_channel_offer_async (test->tube, NULL, tube_offer_cb, test);
 
   test->wait = 1;
@@ -1096,6 +1148,82 @@ finally:
   return ret;
 }
 
+#ifdef HAVE_GIO_UNIX
+static void
+relay_run_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  tp_stream_tube_relay_run_finish (TP_STREAM_TUBE_RELAY (source), result,
+      &test->error);
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_relay (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpStreamTubeRelay *relay;
+  GSocket *socket;
+  GSocketConnection *local;
+  gint fds[2];
+
+  create_tube_service (test, FALSE, TP_SOCKET_ADDRESS_TYPE_UNIX,
+      TP_SOCKET_ACCESS_CONTROL_LOCALHOST, FALSE);
+
+  g_signal_connect (test->tube_chan_service, "incoming-connection",
+      G_CALLBACK (chan_incoming_connection_cb), test);
+
+  tp_stream_tube_channel_accept_async (test->tube, tube_accept_cb, test);
+
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  /* relay the tube to one end of a socket pair, and use it through the
+   * other end */
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+
+  relay = tp_stream_tube_relay_new_for_fd (test->tube_conn, fds[0],
+      &test->error);
+  g_assert_no_error (test->error);
+  g_assert (tp_stream_tube_relay_get_tube_connection (relay) ==
+      test->tube_conn);
+
+  socket = g_socket_new_from_fd (fds[1], &test->error);
+  g_assert_no_error (test->error);
+  local = g_socket_connection_factory_create_connection (socket);
+  g_object_unref (socket);
+
+  tp_stream_tube_relay_run_async (relay, NULL, relay_run_cb, test);
+
+  use_tube_with_streams (test, G_IO_STREAM (local), test->cm_stream);
+
+  g_assert_cmpuint (tp_stream_tube_relay_get_bytes_to_tube (relay), ==,
+      BUFFER_SIZE);
+  g_assert_cmpuint (tp_stream_tube_relay_get_bytes_from_tube (relay), ==,
+      BUFFER_SIZE);
+
+  /* the relay finishes once both sides have been closed */
+  g_io_stream_close (G_IO_STREAM (local), NULL, &test->error);
+  g_assert_no_error (test->error);
+  g_io_stream_close (test->cm_stream, NULL, &test->error);
+  g_assert_no_error (test->error);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_object_unref (local);
+  g_object_unref (relay);
+}
+#endif
+
 int
 main (int argc,
       char **argv)
@@ -1117,6 +1245,8 @@ main (int argc,
       teardown);
   g_test_add ("/stream-tube/accept/twice", Test, NULL, setup,
       test_accept_twice, teardown);
+  g_test_add ("/stream-tube/accept/socket-options", Test, NULL, setup,
+      test_accept_socket_options, teardown);
   g_test_add ("/stream-tube/accept/outgoing", Test, NULL, setup,
       test_accept_outgoing, teardown);
 
@@ -1129,5 +1259,9 @@ main (int argc,
   g_test_add ("/stream-tube/offer/bad-connection/sig-first", Test, NULL, setup,
       test_offer_bad_connection_sig_first, teardown);
 
+#ifdef HAVE_GIO_UNIX
+  g_test_add ("/stream-tube/relay", Test, NULL, setup, test_relay, teardown);
+#endif
+
   return tp_tests_run_with_bus ();
 }
@@ -11,6 +11,8 @@
 
 #include <string.h>
 
+#include <glib/gstdio.h>
+
 #include <telepathy-glib/telepathy-glib.h>
 #include <telepathy-glib/message-mixin.h>
 
@@ -41,6 +43,7 @@ typedef struct {
     gchar *token;
     gchar *sent_token;
     TpMessageSendingFlags sending_flags;
+    GBytes *content;
 
     GError *error /* initialized where needed */;
     gint wait;
@@ -147,6 +150,7 @@ teardown (Test *test,
   tp_clear_object (&test->sent_msg);
   tp_clear_pointer (&test->token, g_free);
   tp_clear_pointer (&test->sent_token, g_free);
+  tp_clear_pointer (&test->content, g_bytes_unref);
 
   tp_clear_object (&test->channel);
   tp_clear_object (&test->sms_channel);
@@ -391,6 +395,8 @@ test_message_received (Test *test,
   GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
   TpMessage *msg;
   gchar *text;
+  const gchar *peeked;
+  TpChannelTextMessageFlags flags;
   TpContact *sender;
 
   /* We have to prepare the pending messages feature to be notified about
@@ -418,6 +424,13 @@ test_message_received (Test *test,
   g_assert_cmpstr (text, ==, "Snake");
   g_free (text);
 
+  /* it's only rendered once */
+  peeked = tp_signalled_message_peek_text (test->received_msg, &flags);
+  g_assert_cmpstr (peeked, ==, "Snake");
+  g_assert_cmpuint (flags, ==, 0);
+  g_assert (tp_signalled_message_peek_text (test->received_msg, NULL) ==
+      peeked);
+
   sender = tp_signalled_message_get_sender (test->received_msg);
   g_assert (sender != NULL);
   g_assert_cmpstr (tp_contact_get_identifier (sender), ==, "bob");
@@ -440,6 +453,27 @@ messages_acked_cb (GObject *source,
     g_main_loop_quit (test->mainloop);
 }
 
+/* Check that the borrowed pending messages are the ones in a copy */
+static void
+assert_peek_pending_messages (Test *test,
+    guint n)
+{
+  GList *copy = tp_text_channel_dup_pending_messages (test->channel);
+  const GList *l;
+  GList *m;
+
+  g_assert_cmpuint (g_list_length (copy), ==, n);
+
+  for (l = tp_text_channel_peek_pending_messages (test->channel), m = copy;
+      l != NULL && m != NULL;
+      l = l->next, m = m->next)
+    g_assert (l->data == m->data);
+
+  g_assert (l == NULL);
+  g_assert (m == NULL);
+  g_list_free_full (copy, g_object_unref);
+}
+
 static void
 test_ack_messages (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -478,6 +512,7 @@ test_ack_messages (Test *test,
 
   messages = tp_text_channel_get_pending_messages (test->channel);
   g_assert_cmpuint (g_list_length (messages), ==, 2);
+  assert_peek_pending_messages (test, 2);
 
   tp_text_channel_ack_messages_async (test->channel, messages,
       messages_acked_cb, test);
@@ -490,6 +525,467 @@ test_ack_messages (Test *test,
   /* Messages have been acked so there is no pending messages */
   messages = tp_text_channel_get_pending_messages (test->channel);
   g_assert_cmpuint (g_list_length (messages), ==, 0);
+  assert_peek_pending_messages (test, 0);
+
+  /* A new message shows up in the borrowed list too */
+  g_signal_connect (test->channel, "message-received",
+      G_CALLBACK (message_received_cb), test);
+
+  msg = tp_client_message_new_text (TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      "Mushroom");
+
+  tp_text_channel_send_message_async (test->channel, msg, 0,
+      send_message_cb, test);
+
+  g_object_unref (msg);
+
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  assert_peek_pending_messages (test, 1);
+  g_assert (tp_text_channel_peek_pending_messages (test->channel)->data ==
+      test->received_msg);
+}
+
+static void
+messages_sent_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+  GPtrArray *tokens, *errors;
+  guint i;
+
+  tp_text_channel_send_messages_finish (TP_TEXT_CHANNEL (source), result,
+      &tokens, &errors, &test->error);
+
+  g_assert_cmpuint (tokens->len, ==, errors->len);
+
+  for (i = 0; i < errors->len; i++)
+    g_assert (g_ptr_array_index (errors, i) == NULL);
+
+  g_ptr_array_unref (tokens);
+  g_ptr_array_unref (errors);
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_send_messages (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  const gchar * const texts[] = { "Badger", "Mushroom", "Snake", "Argh" };
+  TpMessage *messages[G_N_ELEMENTS (texts)];
+  GList *pending, *l;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    messages[i] = tp_client_message_new_text (
+        TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, texts[i]);
+
+  /* At most two SendMessage calls at once */
+  tp_text_channel_send_messages_async (test->channel,
+      G_N_ELEMENTS (messages), messages, 0, 2, messages_sent_cb, test);
+
+  for (i = 0; i < G_N_ELEMENTS (messages); i++)
+    g_object_unref (messages[i]);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  /* They were all echoed, in order */
+  tp_proxy_prepare_async (test->channel, features,
+      proxy_prepare_cb, test);
+
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  pending = tp_text_channel_dup_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (pending), ==, G_N_ELEMENTS (texts));
+
+  for (l = pending, i = 0; l != NULL; l = l->next, i++)
+    {
+      gchar *text = tp_message_to_text (l->data, NULL);
+
+      g_assert_cmpstr (text, ==, texts[i]);
+      g_free (text);
+    }
+
+  g_list_free_full (pending, g_object_unref);
+
+  /* An empty batch completes straight away */
+  tp_text_channel_send_messages_async (test->channel, 0, NULL, 0, 0,
+      messages_sent_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+}
+
+static void
+test_ack_messages_out_of_order (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  const gchar * const texts[] = { "Badger", "Mushroom", "Snake" };
+  GList *messages, *middle;
+  gchar *text;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    {
+      TpMessage *msg = tp_client_message_new_text (
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, texts[i]);
+
+      tp_text_channel_send_message_async (test->channel, msg, 0,
+          send_message_cb, test);
+      g_object_unref (msg);
+    }
+
+  test->wait = G_N_ELEMENTS (texts);
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  tp_proxy_prepare_async (test->channel, features,
+      proxy_prepare_cb, test);
+
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  messages = tp_text_channel_get_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 3);
+
+  /* Ack the message in the middle of the queue first */
+  middle = g_list_nth (messages, 1);
+  messages = g_list_remove_link (messages, middle);
+
+  tp_text_channel_ack_messages_async (test->channel, middle,
+      messages_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_list_free (middle);
+  g_list_free (messages);
+
+  /* The others are still pending, in the order they were received */
+  messages = tp_text_channel_get_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 2);
+
+  text = tp_message_to_text (messages->data, NULL);
+  g_assert_cmpstr (text, ==, "Badger");
+  g_free (text);
+
+  text = tp_message_to_text (messages->next->data, NULL);
+  g_assert_cmpstr (text, ==, "Snake");
+  g_free (text);
+
+  /* and can still be found by ID on the service side */
+  tp_text_channel_ack_messages_async (test->channel, messages,
+      messages_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_list_free (messages);
+
+  messages = tp_text_channel_get_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 0);
+}
+
+static void
+test_spilled_pending_messages (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  const gchar * const texts[] = { "Badger", "Mushroom", "Snake" };
+  GList *messages, *l;
+  gchar *dir, *path;
+  guint i;
+
+  dir = g_dir_make_tmp ("tp-glib-tests.XXXXXX", &test->error);
+  g_assert_no_error (test->error);
+  path = g_build_filename (dir, "pending", NULL);
+
+  /* Only keep the newest message in memory */
+  tp_message_mixin_set_max_pending_in_memory (G_OBJECT (test->chan_service),
+      1, path);
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    {
+      TpMessage *msg = tp_client_message_new_text (
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, texts[i]);
+
+      tp_text_channel_send_message_async (test->channel, msg, 0,
+          send_message_cb, test);
+      g_object_unref (msg);
+    }
+
+  test->wait = G_N_ELEMENTS (texts);
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  /* The messages written to disk are still pending, in order */
+  tp_proxy_prepare_async (test->channel, features,
+      proxy_prepare_cb, test);
+
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  messages = tp_text_channel_get_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 3);
+
+  for (l = messages, i = 0; l != NULL; l = l->next, i++)
+    {
+      gchar *text = tp_message_to_text (l->data, NULL);
+
+      g_assert_cmpstr (text, ==, texts[i]);
+      g_free (text);
+    }
+
+  /* they can be acknowledged, and the file goes away when they have been */
+  tp_text_channel_ack_messages_async (test->channel, messages,
+      messages_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_list_free (messages);
+
+  messages = tp_text_channel_get_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 0);
+
+  g_assert (!g_file_test (path, G_FILE_TEST_EXISTS));
+  g_rmdir (dir);
+
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+test_message_journal (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  const gchar * const texts[] = { "Badger", "Mushroom", "Snake" };
+  GList *messages, *middle, *l;
+  GHashTable *props;
+  gchar *dir, *path, *chan_path, *contents;
+  gsize length;
+  TpHandle sender;
+  guint i;
+
+  dir = g_dir_make_tmp ("tp-glib-tests.XXXXXX", &test->error);
+  g_assert_no_error (test->error);
+  path = g_build_filename (dir, "journal", NULL);
+
+  g_assert (tp_message_mixin_set_journal (G_OBJECT (test->chan_service),
+        path, &test->error));
+  g_assert_no_error (test->error);
+
+  for (i = 0; i < G_N_ELEMENTS (texts); i++)
+    {
+      TpMessage *msg = tp_client_message_new_text (
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, texts[i]);
+
+      tp_text_channel_send_message_async (test->channel, msg, 0,
+          send_message_cb, test);
+      g_object_unref (msg);
+    }
+
+  test->wait = G_N_ELEMENTS (texts);
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+
+  messages = tp_text_channel_dup_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 3);
+
+  middle = g_list_nth (messages, 1);
+  messages = g_list_remove_link (messages, middle);
+
+  tp_text_channel_ack_messages_async (test->channel, middle,
+      messages_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_list_free_full (middle, g_object_unref);
+  g_list_free_full (messages, g_object_unref);
+
+  /* the connection manager goes away with two messages pending... */
+  g_object_get (test->chan_service,
+      "channel-properties", &props,
+      "object-path", &chan_path,
+      NULL);
+  g_free (chan_path);
+  tp_clear_object (&test->chan_service);
+  tp_clear_object (&test->channel);
+
+  g_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  /* ... and its successor finds them in the journal */
+  chan_path = g_strdup_printf ("%s/Rescued",
+      tp_proxy_get_object_path (test->connection));
+
+  test->chan_service = g_object_new (
+      EXAMPLE_TYPE_ECHO_2_CHANNEL,
+      "connection", test->base_connection,
+      "handle", test->bob,
+      "object-path", chan_path,
+      NULL);
+
+  g_assert (tp_message_mixin_set_journal (G_OBJECT (test->chan_service),
+        path, &test->error));
+  g_assert_no_error (test->error);
+
+  g_assert (tp_message_mixin_has_pending_messages (
+        G_OBJECT (test->chan_service), &sender));
+  g_assert_cmpuint (sender, ==, test->bob);
+
+  test->channel = tp_text_channel_new (test->connection, chan_path,
+      props, &test->error);
+  g_assert_no_error (test->error);
+  g_hash_table_unref (props);
+  g_free (chan_path);
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+
+  messages = tp_text_channel_dup_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 2);
+
+  for (l = messages, i = 0; l != NULL; l = l->next, i += 2)
+    {
+      gchar *text = tp_message_to_text (l->data, NULL);
+
+      g_assert_cmpstr (text, ==, texts[i]);
+      g_assert (tp_message_is_rescued (l->data));
+      g_assert_cmpstr (tp_contact_get_identifier (
+            tp_signalled_message_get_sender (l->data)), ==, "bob");
+      g_free (text);
+    }
+
+  tp_text_channel_ack_messages_async (test->channel, messages,
+      messages_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_list_free_full (messages, g_object_unref);
+
+  /* with nothing left to rescue, the journal is emptied */
+  tp_tests_proxy_run_until_dbus_queue_processed (test->connection);
+  g_assert (g_file_get_contents (path, &contents, &length, &test->error));
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (length, ==, 0);
+  g_free (contents);
+
+  /* it is deleted when the channel is finalized, but something else might
+   * still have a ref */
+  tp_clear_object (&test->chan_service);
+  g_unlink (path);
+  g_rmdir (dir);
+
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+append_journal_record (GString *journal,
+    guint32 id,
+    const gchar *sender_id,
+    const gchar *text)
+{
+  GVariantBuilder parts;
+  GVariant *record;
+  guint32 len;
+
+  /* as in the mixin's journal: (ID, acknowledged?, parts) */
+  g_variant_builder_init (&parts, G_VARIANT_TYPE ("aa{sv}"));
+  g_variant_builder_add_parsed (&parts, "{'message-sender-id': <%s>}",
+      sender_id);
+  g_variant_builder_add_parsed (&parts,
+      "{'content-type': <'text/plain'>, 'content': <%s>}", text);
+
+  record = g_variant_ref_sink (g_variant_new ("(ubaa{sv})", id, FALSE,
+        &parts));
+  len = GUINT32_TO_LE (g_variant_get_size (record));
+  g_string_append_len (journal, (const gchar *) &len, sizeof (len));
+  g_string_append_len (journal, g_variant_get_data (record),
+      g_variant_get_size (record));
+  g_variant_unref (record);
+}
+
+static void
+test_message_journal_unrescued (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GString *journal = g_string_new ("");
+  gchar *dir, *path, *contents;
+  const gchar *name;
+  gsize length;
+  TpHandle sender;
+  GDir *d;
+
+  dir = g_dir_make_tmp ("tp-glib-tests.XXXXXX", &test->error);
+  g_assert_no_error (test->error);
+  path = g_build_filename (dir, "journal", NULL);
+
+  /* the test connection doesn't allow spaces in identifiers */
+  append_journal_record (journal, 0, "bob", "Badger");
+  append_journal_record (journal, 1, "not bob", "Mushroom");
+  g_assert (g_file_set_contents (path, journal->str, journal->len,
+        &test->error));
+  g_assert_no_error (test->error);
+  g_string_free (journal, TRUE);
+
+  g_assert (tp_message_mixin_set_journal (G_OBJECT (test->chan_service),
+        path, &test->error));
+  g_assert_no_error (test->error);
+
+  g_assert (tp_message_mixin_has_pending_messages (
+        G_OBJECT (test->chan_service), &sender));
+  g_assert_cmpuint (sender, ==, test->bob);
+
+  /* the new journal replaced the old one... */
+  d = g_dir_open (dir, 0, &test->error);
+  g_assert_no_error (test->error);
+  name = g_dir_read_name (d);
+  g_assert_cmpstr (name, ==, "journal");
+  g_assert (g_dir_read_name (d) == NULL);
+  g_dir_close (d);
+
+  /* ... with the message that could be rescued, and the one that couldn't
+   * still in it */
+  g_assert (g_file_get_contents (path, &contents, &length, &test->error));
+  g_assert_no_error (test->error);
+  g_assert (g_strstr_len (contents, length, "Badger") != NULL);
+  g_assert (g_strstr_len (contents, length, "Mushroom") != NULL);
+  g_assert (g_strstr_len (contents, length, "not bob") != NULL);
+  g_free (contents);
+
+  /* so it outlives the channel */
+  tp_clear_object (&test->chan_service);
+  g_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  g_unlink (path);
+  g_rmdir (dir);
+
+  g_free (path);
+  g_free (dir);
 }
 
 static void
@@ -886,6 +1382,316 @@ test_sender_prepared (Test *test,
   g_assert (tp_contact_has_feature (sender, TP_CONTACT_FEATURE_ALIAS));
 }
 
+static void
+message_superseded_cb (TpTextChannel *chan,
+    TpSignalledMessage *msg,
+    TpSignalledMessage *original,
+    Test *test)
+{
+  /* it's announced after the correction itself */
+  g_assert (test->received_msg == (TpMessage *) msg);
+
+  tp_clear_object (&test->removed_msg);
+  test->removed_msg = g_object_ref (original);
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_message_superseded (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  TpMessage *msg, *original;
+  gint64 received;
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+
+  g_signal_connect (test->channel, "message-received",
+      G_CALLBACK (message_received_cb), test);
+  g_signal_connect (test->channel, "message-superseded",
+      G_CALLBACK (message_superseded_cb), test);
+
+  msg = tp_cm_message_new_text (test->base_connection, test->bob,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "I like snkaes");
+  tp_message_set_string (msg, 0, "message-token", "first");
+  tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+
+  g_assert (test->received_msg != NULL);
+  original = g_object_ref (test->received_msg);
+  g_assert (tp_text_channel_peek_pending_message_by_token (test->channel,
+        "first") == original);
+  g_assert (tp_text_channel_peek_pending_message_by_token (test->channel,
+        "second") == NULL);
+  g_assert (test->removed_msg == NULL);
+
+  msg = tp_cm_message_new_text (test->base_connection, test->bob,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "I like snakes");
+  tp_message_set_string (msg, 0, "message-token", "second");
+  tp_message_set_string (msg, 0, "supersedes", "first");
+  tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+  /* message-received, then message-superseded */
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+
+  g_assert (test->removed_msg == original);
+  g_assert_cmpstr (tp_message_get_supersedes (test->received_msg), ==,
+      "first");
+  g_assert (tp_text_channel_peek_pending_message_by_token (test->channel,
+        "second") == test->received_msg);
+
+  /* the message mixin said when the original was received */
+  received = tp_asv_get_int64 (tp_message_peek (original, 0),
+      "message-received", NULL);
+  g_assert_cmpint (received, !=, 0);
+  g_assert_cmpint (tp_asv_get_int64 (tp_message_peek (test->received_msg, 0),
+        "original-message-received", NULL), ==, received);
+
+  /* the original is still pending until it's acknowledged */
+  g_assert (tp_text_channel_peek_pending_message_by_token (test->channel,
+        "first") == original);
+
+  tp_text_channel_ack_message_async (test->channel, original,
+      message_acked_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_assert (tp_text_channel_peek_pending_message_by_token (test->channel,
+        "first") == NULL);
+
+  g_object_unref (original);
+}
+
+static void
+lazy_message_received_cb (TpTextChannel *chan,
+    TpSignalledMessage *msg,
+    Test *test)
+{
+  /* delivered before the sender is known */
+  g_assert (tp_signalled_message_get_sender ((TpMessage *) msg) == NULL);
+  g_assert_cmpstr (tp_asv_get_string (tp_message_peek ((TpMessage *) msg, 0),
+        "message-sender-id"), ==, "admin");
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+message_sender_prepared_cb (TpTextChannel *chan,
+    TpSignalledMessage *msg,
+    Test *test)
+{
+  TpContact *sender = tp_signalled_message_get_sender ((TpMessage *) msg);
+
+  g_assert (sender != NULL);
+  g_assert_cmpstr (tp_contact_get_identifier (sender), ==, "admin");
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+static void
+test_lazy_senders (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  TpHandle admin;
+  TpMessage *msg;
+
+  tp_text_channel_set_lazy_senders (test->channel, TRUE);
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+
+  g_signal_connect (test->channel, "message-received",
+      G_CALLBACK (lazy_message_received_cb), test);
+
+  /* Two messages from a contact we haven't seen before */
+  admin = tp_handle_ensure (test->contact_repo, "admin", NULL, NULL);
+  msg = tp_cm_message_new_text (test->base_connection, admin,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      "Service interuption in 1h");
+  tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+  msg = tp_cm_message_new_text (test->base_connection, admin,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      "Service interuption in 30min");
+  tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+
+  g_signal_handlers_disconnect_by_func (test->channel,
+      lazy_message_received_cb, test);
+  g_signal_connect (test->channel, "message-sender-prepared",
+      G_CALLBACK (message_sender_prepared_cb), test);
+
+  /* then both senders are prepared */
+  test->wait = 2;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+}
+
+static void
+get_pending_message_content_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Test *test = user_data;
+
+  tp_clear_pointer (&test->content, g_bytes_unref);
+  test->content = tp_text_channel_get_pending_message_content_finish (
+      TP_TEXT_CHANNEL (source), result, &test->error);
+
+  test->wait--;
+  if (test->wait <= 0)
+    g_main_loop_quit (test->mainloop);
+}
+
+#define ATTACHMENT_SIZE (1024 * 1024)
+
+static void
+test_content_stream (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  GByteArray *attachment;
+  GInputStream *stream;
+  TpMessage *msg;
+  GList *messages;
+  const GHashTable *part;
+  guint i;
+
+  attachment = g_byte_array_sized_new (ATTACHMENT_SIZE);
+  for (i = 0; i < ATTACHMENT_SIZE; i++)
+    {
+      guint8 byte = i % 251;
+
+      g_byte_array_append (attachment, &byte, 1);
+    }
+
+  stream = g_memory_input_stream_new_from_data (attachment->data,
+      attachment->len, NULL);
+
+  msg = tp_cm_message_new_text (test->base_connection, test->bob,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, "Here's the picture");
+  tp_message_append_part (msg);
+  tp_message_set_string (msg, 2, "content-type", "image/png");
+  tp_cm_message_set_content_stream (msg, 2, stream, ATTACHMENT_SIZE);
+  g_object_unref (stream);
+
+  tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+
+  messages = tp_text_channel_dup_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, 1);
+
+  /* The attachment isn't sent with the message */
+  part = tp_message_peek (messages->data, 2);
+  g_assert (tp_asv_get_boolean (part, "needs-retrieval", NULL));
+  g_assert_cmpuint (tp_asv_get_uint64 (part, "size", NULL), ==,
+      ATTACHMENT_SIZE);
+  g_assert (tp_asv_lookup (part, "content") == NULL);
+
+  /* but can be fetched, more than once */
+  for (i = 0; i < 2; i++)
+    {
+      tp_text_channel_get_pending_message_content_async (test->channel,
+          messages->data, 2, get_pending_message_content_cb, test);
+
+      test->wait = 1;
+      g_main_loop_run (test->mainloop);
+      g_assert_no_error (test->error);
+
+      g_assert (test->content != NULL);
+      g_assert_cmpuint (g_bytes_get_size (test->content), ==,
+          ATTACHMENT_SIZE);
+      g_assert (memcmp (g_bytes_get_data (test->content, NULL),
+            attachment->data, ATTACHMENT_SIZE) == 0);
+    }
+
+  /* the text part is still there too */
+  tp_text_channel_get_pending_message_content_async (test->channel,
+      messages->data, 1, get_pending_message_content_cb, test);
+
+  test->wait = 1;
+  g_main_loop_run (test->mainloop);
+  g_assert_no_error (test->error);
+  g_assert_cmpuint (g_bytes_get_size (test->content), ==,
+      strlen ("Here's the picture"));
+
+  g_list_free_full (messages, g_object_unref);
+  g_byte_array_unref (attachment);
+}
+
+#define N_BACKLOG_MESSAGES 500
+#define N_BACKLOG_SENDERS 10
+
+static void
+test_pending_messages_backlog (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = { TP_TEXT_CHANNEL_FEATURE_INCOMING_MESSAGES, 0 };
+  GList *messages, *l;
+  gdouble elapsed;
+  guint i;
+
+  /* A busy room: lots of pending messages from a few new contacts */
+  for (i = 0; i < N_BACKLOG_MESSAGES; i++)
+    {
+      gchar *id = g_strdup_printf ("sender%u", i % N_BACKLOG_SENDERS);
+      gchar *text = g_strdup_printf ("message %u", i);
+      TpHandle handle = tp_handle_ensure (test->contact_repo, id, NULL, NULL);
+      TpMessage *msg = tp_cm_message_new_text (test->base_connection, handle,
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, text);
+
+      tp_message_mixin_take_received ((GObject *) test->chan_service, msg);
+
+      g_free (id);
+      g_free (text);
+    }
+
+  g_test_timer_start ();
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_message ("prepared %u pending messages from %u senders in %.3fs",
+      N_BACKLOG_MESSAGES, N_BACKLOG_SENDERS, elapsed);
+
+  messages = tp_text_channel_dup_pending_messages (test->channel);
+  g_assert_cmpuint (g_list_length (messages), ==, N_BACKLOG_MESSAGES);
+
+  /* Still in order, and every sender is there */
+  for (l = messages, i = 0; l != NULL; l = l->next, i++)
+    {
+      TpContact *sender = tp_signalled_message_get_sender (l->data);
+      gchar *expected_id = g_strdup_printf ("sender%u",
+          i % N_BACKLOG_SENDERS);
+      gchar *expected_text = g_strdup_printf ("message %u", i);
+      gchar *text = tp_message_to_text (l->data, NULL);
+
+      g_assert (sender != NULL);
+      g_assert_cmpstr (tp_contact_get_identifier (sender), ==, expected_id);
+      g_assert_cmpstr (text, ==, expected_text);
+
+      g_free (expected_id);
+      g_free (expected_text);
+      g_free (text);
+    }
+
+  g_list_free_full (messages, g_object_unref);
+}
+
 static void
 test_sent_with_no_sender (Test *test,
     gconstpointer data G_GNUC_UNUSED)
@@ -1044,6 +1850,152 @@ test_chat_state (Test *test,
   g_assert_cmpuint (state, ==, TP_CHANNEL_CHAT_STATE_COMPOSING);
 }
 
+static void
+count_chat_state_changed_cb (TpTextChannel *channel,
+    TpContact *contact,
+    TpChannelChatState state,
+    Test *test)
+{
+  test->wait++;
+}
+
+static gboolean
+quit_loop_cb (gpointer user_data)
+{
+  Test *test = user_data;
+
+  g_main_loop_quit (test->mainloop);
+  return FALSE;
+}
+
+static void
+test_chat_state_interval (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = {
+      TP_CHANNEL_FEATURE_CONTACTS,
+      TP_TEXT_CHANNEL_FEATURE_CHAT_STATES,
+      0 };
+  TpContact *contact;
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+  contact = tp_channel_get_target_contact ((TpChannel *) test->channel);
+
+  tp_message_mixin_set_chat_state_interval (G_OBJECT (test->chan_service),
+      100);
+
+  g_signal_connect (test->channel, "contact-chat-state-changed",
+      G_CALLBACK (count_chat_state_changed_cb), test);
+  test->wait = 0;
+
+  /* Bob types a few letters, pausing between each */
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_COMPOSING);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_PAUSED);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_COMPOSING);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_PAUSED);
+
+  /* Only the first change happens straight away... */
+  g_timeout_add (50, quit_loop_cb, test);
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 1);
+  g_assert_cmpuint (tp_text_channel_get_chat_state (test->channel, contact),
+      ==, TP_CHANNEL_CHAT_STATE_COMPOSING);
+
+  /* ...and the last one follows once the interval is over */
+  g_timeout_add (200, quit_loop_cb, test);
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 2);
+  g_assert_cmpuint (tp_text_channel_get_chat_state (test->channel, contact),
+      ==, TP_CHANNEL_CHAT_STATE_PAUSED);
+
+  /* Leaving is never delayed */
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_COMPOSING);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_GONE);
+
+  g_timeout_add (50, quit_loop_cb, test);
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 4);
+  g_assert_cmpuint (tp_text_channel_get_chat_state (test->channel, contact),
+      ==, TP_CHANNEL_CHAT_STATE_GONE);
+
+  /* and nothing else turns up afterwards */
+  g_timeout_add (150, quit_loop_cb, test);
+  g_main_loop_run (test->mainloop);
+  g_assert_cmpint (test->wait, ==, 4);
+}
+
+static void
+record_chat_state_changed_cb (TpTextChannel *channel,
+    TpContact *contact,
+    TpChannelChatState state,
+    GArray *states)
+{
+  g_array_append_val (states, state);
+}
+
+static void
+test_chat_state_coalescing (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GQuark features[] = {
+      TP_CHANNEL_FEATURE_CONTACTS,
+      TP_TEXT_CHANNEL_FEATURE_CHAT_STATES,
+      0 };
+  GArray *states = g_array_new (FALSE, FALSE, sizeof (TpChannelChatState));
+  TpContact *contact;
+  guint i;
+
+  tp_tests_proxy_run_until_prepared (test->channel, features);
+  contact = tp_channel_get_target_contact ((TpChannel *) test->channel);
+
+  g_signal_connect (test->channel, "contact-chat-state-changed",
+      G_CALLBACK (record_chat_state_changed_cb), states);
+
+  /* Bob types, pauses and types again, then leaves, all at once */
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_COMPOSING);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_PAUSED);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_COMPOSING);
+  tp_message_mixin_change_chat_state (G_OBJECT (test->chan_service),
+      test->bob, TP_CHANNEL_CHAT_STATE_GONE);
+
+  while (states->len == 0 ||
+      g_array_index (states, TpChannelChatState, states->len - 1) !=
+        TP_CHANNEL_CHAT_STATE_GONE)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpuint (tp_text_channel_get_chat_state (test->channel, contact),
+      ==, TP_CHANNEL_CHAT_STATE_GONE);
+
+  /* Depending on how the signals were dispatched, the intermediate states
+   * may or may not have been coalesced; but whatever was signalled was a
+   * change, and Bob was seen typing before he left */
+  g_assert_cmpuint (states->len, >=, 2);
+  g_assert_cmpuint (g_array_index (states, TpChannelChatState,
+        states->len - 2), ==, TP_CHANNEL_CHAT_STATE_COMPOSING);
+
+  for (i = 1; i < states->len; i++)
+    g_assert_cmpuint (g_array_index (states, TpChannelChatState, i - 1), !=,
+        g_array_index (states, TpChannelChatState, i));
+
+  /* nothing else turns up afterwards */
+  i = states->len;
+  tp_tests_proxy_run_until_dbus_queue_processed (test->connection);
+  g_assert_cmpuint (states->len, ==, i);
+
+  g_signal_handlers_disconnect_by_func (test->channel,
+      record_chat_state_changed_cb, states);
+  g_array_unref (states);
+}
+
 int
 main (int argc,
       char **argv)
@@ -1063,8 +2015,18 @@ main (int argc,
       test_ack_messages, teardown);
   g_test_add ("/text-channel/ack-message", Test, NULL, setup,
       test_ack_message, teardown);
+  g_test_add ("/text-channel/ack-messages-out-of-order", Test, NULL, setup,
+      test_ack_messages_out_of_order, teardown);
+  g_test_add ("/text-channel/spilled-pending-messages", Test, NULL, setup,
+      test_spilled_pending_messages, teardown);
+  g_test_add ("/text-channel/message-journal", Test, NULL, setup,
+      test_message_journal, teardown);
+  g_test_add ("/text-channel/message-journal-unrescued", Test, NULL, setup,
+      test_message_journal_unrescued, teardown);
   g_test_add ("/text-channel/message-sent", Test, NULL, setup,
       test_message_sent, teardown);
+  g_test_add ("/text-channel/send-messages", Test, NULL, setup,
+      test_send_messages, teardown);
   g_test_add ("/text-channel/sms-feature", Test, NULL, setup,
       test_sms_feature, teardown);
   g_test_add ("/text-channel/get-sms-length", Test, NULL, setup,
@@ -1075,12 +2037,24 @@ main (int argc,
       setup, test_pending_messages_with_no_sender_id, teardown);
   g_test_add ("/text-channel/sender-prepared", Test, NULL, setup,
       test_sender_prepared, teardown);
+  g_test_add ("/text-channel/lazy-senders", Test, NULL, setup,
+      test_lazy_senders, teardown);
+  g_test_add ("/text-channel/message-superseded", Test, NULL, setup,
+      test_message_superseded, teardown);
+  g_test_add ("/text-channel/pending-messages-backlog", Test, NULL, setup,
+      test_pending_messages_backlog, teardown);
+  g_test_add ("/text-channel/content-stream", Test, NULL, setup,
+      test_content_stream, teardown);
   g_test_add ("/text-channel/sent-with-no-sender", Test, NULL, setup,
       test_sent_with_no_sender, teardown);
   g_test_add ("/text-channel/receive-muc-delivery", Test, NULL, setup,
       test_receive_muc_delivery, teardown);
   g_test_add ("/text-channel/chat-state", Test, NULL, setup,
       test_chat_state, teardown);
+  g_test_add ("/text-channel/chat-state-interval", Test, NULL, setup,
+      test_chat_state_interval, teardown);
+  g_test_add ("/text-channel/chat-state-coalescing", Test, NULL, setup,
+      test_chat_state_coalescing, teardown);
 
   return tp_tests_run_with_bus ();
 }
@@ -163,6 +163,53 @@ test_core (Test *test,
   tp_tests_assert_bytes_equals (d, "BADGER", 6);
 }
 
+static void
+test_verdict (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  const gchar * const ids[] = { "example.com", "www.example.com", NULL };
+  const gchar * const reversed[] = { "www.example.com", "example.com",
+      NULL };
+  const gchar * const other[] = { "example.net", NULL };
+  TpTLSCertificate *same;
+  const gchar *fingerprint;
+  gboolean accepted = FALSE;
+
+  g_assert (tp_tls_certificate_get_chain_fingerprint (test->cert) == NULL);
+  g_assert (!tp_tls_certificate_lookup_verdict (test->cert, ids, NULL));
+
+  prepare_cert (test, test->cert);
+
+  fingerprint = tp_tls_certificate_get_chain_fingerprint (test->cert);
+  g_assert (fingerprint != NULL);
+  g_assert_cmpuint (strlen (fingerprint), ==, 64);
+
+  g_assert (!tp_tls_certificate_lookup_verdict (test->cert, ids, NULL));
+  tp_tls_certificate_remember_verdict (test->cert, ids, TRUE, 60);
+
+  /* a different proxy for an identical chain finds the same verdict,
+   * whatever order the identities are in */
+  same = tp_tls_certificate_new (TP_PROXY (test->connection),
+      tp_proxy_get_object_path (test->cert), &test->error);
+  g_assert_no_error (test->error);
+  prepare_cert (test, same);
+
+  g_assert_cmpstr (tp_tls_certificate_get_chain_fingerprint (same), ==,
+      fingerprint);
+  g_assert (tp_tls_certificate_lookup_verdict (same, reversed, &accepted));
+  g_assert (accepted);
+  g_assert (!tp_tls_certificate_lookup_verdict (same, other, NULL));
+
+  /* a verdict with no lifetime expires immediately */
+  tp_tls_certificate_remember_verdict (same, other, FALSE, 0);
+  g_assert (!tp_tls_certificate_lookup_verdict (same, other, NULL));
+
+  tp_tls_certificate_forget_verdicts ();
+  g_assert (!tp_tls_certificate_lookup_verdict (same, ids, NULL));
+
+  g_object_unref (same);
+}
+
 static void
 notify_cb (GObject *object,
     GParamSpec *spec,
@@ -344,6 +391,8 @@ main (int argc,
       test_creation, teardown);
   g_test_add ("/tls-certificate/core", Test, NULL, setup,
       test_core, teardown);
+  g_test_add ("/tls-certificate/verdict", Test, NULL, setup,
+      test_verdict, teardown);
   g_test_add ("/tls-certificate/accept", Test, NULL, setup,
       test_accept, teardown);
   g_test_add ("/tls-certificate/reject", Test, NULL, setup,
@@ -14,6 +14,7 @@
 #include <telepathy-glib/dbus.h>
 #include <telepathy-glib/debug.h>
 #include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/proxy-subclass.h>
 #include <telepathy-glib/util.h>
 
 #include "tests/lib/contacts-conn.h"
@@ -246,6 +247,44 @@ teardown (Fixture *f,
   g_clear_object (&f->dbus);
 }
 
+static void
+test_known_and_extension (Fixture *f,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  const gchar * const extension[] = { "com.example.Extension", NULL };
+  const gchar * const avatars[] = {
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS, NULL };
+  GError e = { TP_ERROR, TP_ERROR_CANCELLED, "bye" };
+
+  /* the main interface is always there; interfaces from the spec and
+   * extension interfaces are only there once added */
+  g_assert (tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION));
+  g_assert (!tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS));
+  g_assert (!tp_proxy_has_interface (f->conn, extension[0]));
+
+  tp_proxy_add_interfaces ((TpProxy *) f->conn, extension);
+  g_assert (tp_proxy_has_interface (f->conn, extension[0]));
+  g_assert (!tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS));
+
+  tp_proxy_add_interfaces ((TpProxy *) f->conn, avatars);
+  g_assert (tp_proxy_has_interface (f->conn, avatars[0]));
+  g_assert (tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS));
+  g_assert (!tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_ALIASING));
+
+  /* an invalidated proxy has no interfaces at all */
+  tp_proxy_invalidate ((TpProxy *) f->conn, &e);
+  g_assert (!tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION));
+  g_assert (!tp_proxy_has_interface_by_id (f->conn,
+        TP_IFACE_QUARK_CONNECTION_INTERFACE_AVATARS));
+  g_assert (!tp_proxy_has_interface (f->conn, extension[0]));
+}
+
 int
 main (int argc,
       char **argv)
@@ -264,6 +303,8 @@ main (int argc,
       setup, test_unsupported_async, teardown);
   g_test_add ("/unsupported/signal", Fixture, NULL,
       setup, test_unsupported_signal, teardown);
+  g_test_add ("/interfaces/known-and-extension", Fixture, NULL,
+      setup, test_known_and_extension, teardown);
 
   return tp_tests_run_with_bus ();
 }
@@ -0,0 +1,222 @@
+/* Tests of tp_debug_start_log_writer()
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/debug.h>
+
+/* comfortably more than half of MAX_SIZE, so that each line goes into a
+ * new file */
+#define MAX_SIZE 1000
+#define PADDING 600
+
+typedef struct {
+    gchar *dir;
+    gchar *path;
+} Fixture;
+
+static void
+setup (Fixture *f,
+    gconstpointer data)
+{
+  GError *error = NULL;
+
+  f->dir = g_dir_make_tmp ("tp-glib-log-writer.XXXXXX", &error);
+  g_assert_no_error (error);
+  f->path = g_build_filename (f->dir, "log", NULL);
+}
+
+static void
+teardown (Fixture *f,
+    gconstpointer data)
+{
+  const gchar *name;
+  GDir *dir = g_dir_open (f->dir, 0, NULL);
+
+  g_assert (dir != NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *path = g_build_filename (f->dir, name, NULL);
+
+      g_unlink (path);
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+  g_rmdir (f->dir);
+  g_free (f->path);
+  g_free (f->dir);
+}
+
+static gboolean
+file_contains (const gchar *path,
+    const gchar *needle)
+{
+  gchar *contents;
+  gboolean ret;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return FALSE;
+
+  ret = (strstr (contents, needle) != NULL);
+  g_free (contents);
+  return ret;
+}
+
+static gchar *
+rotated_path (Fixture *f,
+    guint i,
+    const gchar *suffix)
+{
+  return g_strdup_printf ("%s.%u%s", f->path, i, suffix);
+}
+
+/* Log "line @i" with some padding, and wait for the writer thread to
+ * write it to the current file */
+static void
+log_line (Fixture *f,
+    guint i)
+{
+  gchar *padding = g_strnfill (PADDING, 'x');
+  gchar *line = g_strdup_printf ("line %u:", i);
+  guint waited = 0;
+
+  g_message ("%s %s", line, padding);
+
+  while (!file_contains (f->path, line))
+    {
+      g_assert_cmpuint (waited++, <, 5000);
+      g_usleep (1000);
+    }
+
+  g_free (line);
+  g_free (padding);
+}
+
+static void
+test_rotation (Fixture *f,
+    gconstpointer data)
+{
+  gboolean compress = GPOINTER_TO_INT (data);
+  const gchar *suffix = (compress ? ".gz" : "");
+  GError *error = NULL;
+  gchar *path;
+  gchar *contents;
+  gsize len;
+  guint i;
+
+  g_assert (tp_debug_start_log_writer (f->path, MAX_SIZE, 0, 2, compress,
+        &error));
+  g_assert_no_error (error);
+
+  for (i = 0; i < 4; i++)
+    log_line (f, i);
+
+  tp_debug_stop_log_writer ();
+
+  /* the current file has the last line, with a timestamp */
+  g_assert (g_file_get_contents (f->path, &contents, &len, NULL));
+  g_assert (g_str_has_suffix (contents, "xxx\n"));
+  g_assert (strstr (contents, "Z: Message: line 3:") != NULL);
+  g_assert (strstr (contents, "line 2:") == NULL);
+  g_assert_cmpuint (len, <=, MAX_SIZE);
+  g_free (contents);
+
+  /* the previous two files were kept, and the first line was dropped */
+  for (i = 1; i <= 3; i++)
+    {
+      path = rotated_path (f, i, suffix);
+      g_assert (g_file_test (path, G_FILE_TEST_EXISTS) == (i <= 2));
+
+      if (i <= 2 && compress)
+        {
+          g_assert (g_file_get_contents (path, &contents, &len, NULL));
+          g_assert_cmpuint (len, >, 2);
+          /* the gzip magic number */
+          g_assert_cmpuint ((guchar) contents[0], ==, 0x1f);
+          g_assert_cmpuint ((guchar) contents[1], ==, 0x8b);
+          g_free (contents);
+        }
+      else if (i <= 2)
+        {
+          gchar *line = g_strdup_printf ("line %u:", 3 - i);
+
+          g_assert (file_contains (path, line));
+          g_free (line);
+        }
+
+      g_free (path);
+
+      /* compressed files don't leave the uncompressed one behind */
+      path = rotated_path (f, i, "");
+      g_assert (!compress || !g_file_test (path, G_FILE_TEST_EXISTS));
+      g_free (path);
+    }
+}
+
+static void
+test_append (Fixture *f,
+    gconstpointer data)
+{
+  GError *error = NULL;
+  gchar *filename;
+
+  g_assert (g_file_set_contents (f->path, "before\n", -1, NULL));
+
+  filename = g_strdup_printf ("+%s", f->path);
+  g_assert (tp_debug_start_log_writer (filename, 0, 0, 0, FALSE, &error));
+  g_assert_no_error (error);
+  g_free (filename);
+
+  log_line (f, 0);
+  tp_debug_stop_log_writer ();
+
+  g_assert (file_contains (f->path, "before\n"));
+  g_assert (file_contains (f->path, "line 0:"));
+}
+
+static void
+test_error (Fixture *f,
+    gconstpointer data)
+{
+  GError *error = NULL;
+  gchar *path = g_build_filename (f->dir, "nonexistent", "log", NULL);
+
+  g_assert (!tp_debug_start_log_writer (path, 0, 0, 0, FALSE, &error));
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_clear_error (&error);
+  g_free (path);
+
+  /* stopping a writer that isn't running does nothing */
+  tp_debug_stop_log_writer ();
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/debug-log-writer/rotation", Fixture, GINT_TO_POINTER (FALSE),
+      setup, test_rotation, teardown);
+  g_test_add ("/debug-log-writer/rotation-compressed", Fixture,
+      GINT_TO_POINTER (TRUE), setup, test_rotation, teardown);
+  g_test_add ("/debug-log-writer/append", Fixture, NULL,
+      setup, test_append, teardown);
+  g_test_add ("/debug-log-writer/error", Fixture, NULL,
+      setup, test_error, teardown);
+
+  return g_test_run ();
+}
@@ -293,6 +293,89 @@ test_wait (Fixture *f,
       "finished\n");
 }
 
+static void
+scheduled_cb (TpDTMFPlayer *dtmf_player G_GNUC_UNUSED,
+    GVariant *schedule,
+    Fixture *f)
+{
+  GVariantIter iter;
+  guint32 event;
+  gint64 start, stop, first = -1;
+
+  g_variant_iter_init (&iter, schedule);
+
+  /* log times relative to the first tone's start, in ms */
+  while (g_variant_iter_next (&iter, "(uxx)", &event, &start, &stop))
+    {
+      if (first < 0)
+        first = start;
+
+      fixture_log (f, "scheduled '%c' %d-%d", tp_dtmf_event_to_char (event),
+          (gint) ((start - first) / 1000), (gint) ((stop - first) / 1000));
+    }
+}
+
+static void
+test_scheduled (Fixture *f,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  gboolean ok;
+
+  g_signal_connect (f->dtmf_player, "tones-scheduled",
+      G_CALLBACK (scheduled_cb), f);
+
+  ok = tp_dtmf_player_play_scheduled (f->dtmf_player, "*1p2#w3", 10, 5, 20,
+      &f->error);
+  g_assert_no_error (f->error);
+  g_assert (ok);
+  g_assert (tp_dtmf_player_is_active (f->dtmf_player));
+
+  /* the whole schedule is known up front: gaps only separate consecutive
+   * tones, and nothing after the 'w' is played */
+  fixture_assert_log (f,
+      "scheduled '*' 0-10\n"
+      "scheduled '1' 15-25\n"
+      "scheduled '2' 45-55\n"
+      "scheduled '#' 60-70\n");
+
+  while (tp_dtmf_player_is_active (f->dtmf_player))
+    g_main_context_iteration (NULL, TRUE);
+
+  fixture_assert_log (f,
+      "scheduled '*' 0-10\n"
+      "scheduled '1' 15-25\n"
+      "scheduled '2' 45-55\n"
+      "scheduled '#' 60-70\n"
+      "deferred '3'\n"
+      "finished\n");
+
+  /* an empty string finishes straight away */
+  ok = tp_dtmf_player_play_scheduled (f->dtmf_player, "", 1, 1, 1,
+      &f->error);
+  g_assert_no_error (f->error);
+  g_assert (ok);
+  g_assert (!tp_dtmf_player_is_active (f->dtmf_player));
+}
+
+static void
+test_scheduled_cancel (Fixture *f,
+    gconstpointer nil G_GNUC_UNUSED)
+{
+  gboolean ok;
+
+  ok = tp_dtmf_player_play_scheduled (f->dtmf_player, "#", 10000, 1, 1,
+      &f->error);
+  g_assert_no_error (f->error);
+  g_assert (ok);
+  g_assert (tp_dtmf_player_is_active (f->dtmf_player));
+
+  tp_dtmf_player_cancel (f->dtmf_player);
+  g_assert (!tp_dtmf_player_is_active (f->dtmf_player));
+
+  /* no stopped-tone: the backend was told when to stop */
+  fixture_assert_log (f, "cancelled\n");
+}
+
 int
 main (int argc,
     char **argv)
@@ -313,6 +396,8 @@ main (int argc,
   FIXTURE_TEST (cancel_in_pause);
   FIXTURE_TEST (sequence);
   FIXTURE_TEST (wait);
+  FIXTURE_TEST (scheduled);
+  FIXTURE_TEST (scheduled_cancel);
 
   return g_test_run ();
 }
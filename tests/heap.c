@@ -2,6 +2,7 @@
 
 #include <telepathy-glib/intset.h>
 #include <telepathy-glib/heap.h>
+#include "telepathy-glib/heap-internal.h"
 
 #include <stdlib.h>
 #include <time.h>
@@ -12,6 +13,168 @@ static gint comparator_fn (gconstpointer a, gconstpointer b)
     return (a < b) ? -1 : (a == b) ? 0 : 1;
 }
 
+typedef struct {
+    guint priority;
+    TpHeapHandle *handle;
+} Item;
+
+static gint item_comparator_fn (gconstpointer a, gconstpointer b)
+{
+    const Item *x = a, *y = b;
+
+    return (x->priority < y->priority) ? -1 :
+        (x->priority == y->priority) ? 0 : 1;
+}
+
+static void
+drain_in_order (TpHeap *heap, guint expected_size)
+{
+  guint prev = 0;
+  guint n = 0;
+
+  while (tp_heap_size (heap))
+    {
+      Item *item = tp_heap_peek_first (heap);
+
+      g_assert (item == tp_heap_extract_first (heap));
+      g_assert (prev <= item->priority);
+      prev = item->priority;
+      n++;
+    }
+
+  g_assert (n == expected_size);
+}
+
+static void
+test_handles (void)
+{
+  TpHeap *heap = tp_heap_new (item_comparator_fn, NULL);
+  Item *items = g_new0 (Item, 10000);
+  guint i, remaining = 10000;
+
+  for (i = 0; i < 10000; i++)
+    {
+      items[i].priority = rand ();
+      items[i].handle = tp_heap_add (heap, &items[i]);
+      g_assert (tp_heap_handle_get_element (items[i].handle) == &items[i]);
+    }
+
+  /* cancel some, and move others both up and down */
+  for (i = 0; i < 10000; i += 3)
+    {
+      g_assert (tp_heap_remove_handle (heap, items[i].handle) == &items[i]);
+      items[i].handle = NULL;
+      remaining--;
+    }
+
+  for (i = 1; i < 10000; i += 3)
+    {
+      items[i].priority = (i % 2) ? items[i].priority / 2 :
+          items[i].priority + (G_MAXUINT - items[i].priority) / 2;
+      tp_heap_update_handle (heap, items[i].handle);
+    }
+
+  /* the plain remove still works */
+  tp_heap_remove (heap, &items[2]);
+  remaining--;
+
+  g_assert (tp_heap_size (heap) == remaining);
+  drain_in_order (heap, remaining);
+
+  tp_heap_destroy (heap);
+  g_free (items);
+}
+
+static void
+test_from_array (void)
+{
+  GPtrArray *arr = g_ptr_array_new ();
+  Item *items = g_new0 (Item, 10000);
+  TpHeap *heap;
+  guint i;
+
+  for (i = 0; i < 10000; i++)
+    {
+      items[i].priority = rand () % 1000;
+      g_ptr_array_add (arr, &items[i]);
+    }
+
+  heap = tp_heap_new_from_array (item_comparator_fn, NULL, arr);
+  g_ptr_array_unref (arr);
+  g_assert (tp_heap_size (heap) == 10000);
+
+  /* handles for elements added later work alongside the bulk ones */
+  items[0].handle = tp_heap_add (heap, &items[0]);
+  tp_heap_remove_handle (heap, items[0].handle);
+
+  drain_in_order (heap, 10000);
+  tp_heap_destroy (heap);
+  g_free (items);
+}
+
+static void
+test_typed (void)
+{
+  _TpInt64Heap heap;
+  Item *items = g_new0 (Item, 10000);
+  gint64 prev = G_MININT64;
+  guint i, n = 0;
+
+  _tp_int64_heap_init (&heap);
+
+  for (i = 0; i < 10000; i++)
+    {
+      /* plenty of duplicates, and negative keys */
+      items[i].priority = rand () % 1000;
+      _tp_int64_heap_add (&heap, (gint64) items[i].priority - 500,
+          &items[i]);
+    }
+
+  g_assert_cmpuint (_tp_int64_heap_size (&heap), ==, 10000);
+
+  /* take half of them out, then interleave adding and removing */
+  for (i = 0; i < 5000; i++)
+    {
+      gint64 key, peeked;
+      Item *item = _tp_int64_heap_peek_first (&heap, &peeked);
+
+      g_assert (item == _tp_int64_heap_extract_first (&heap, &key));
+      g_assert_cmpint (key, ==, peeked);
+      g_assert_cmpint (key, ==, (gint64) item->priority - 500);
+      g_assert_cmpint (prev, <=, key);
+      prev = key;
+    }
+
+  for (i = 0; i < 5000; i++)
+    _tp_int64_heap_add (&heap, (gint64) items[i].priority - 500,
+        &items[i]);
+
+  prev = G_MININT64;
+
+  while (_tp_int64_heap_size (&heap) > 0)
+    {
+      gint64 key;
+      Item *item = _tp_int64_heap_extract_first (&heap, &key);
+
+      g_assert_cmpint (key, ==, (gint64) item->priority - 500);
+      g_assert_cmpint (prev, <=, key);
+      prev = key;
+      n++;
+    }
+
+  g_assert_cmpuint (n, ==, 10000);
+
+  /* it can be reused after being cleared */
+  _tp_int64_heap_add (&heap, 42, items);
+  _tp_int64_heap_clear (&heap);
+  g_assert_cmpuint (_tp_int64_heap_size (&heap), ==, 0);
+  _tp_int64_heap_add (&heap, 42, items);
+  g_assert (_tp_int64_heap_extract_first (&heap, NULL) == items);
+  _tp_int64_heap_clear (&heap);
+
+  g_free (items);
+}
+
 int
 main (int argc,
       char **argv)
@@ -37,5 +200,9 @@ main (int argc,
 
   tp_heap_destroy (heap);
 
+  test_handles ();
+  test_from_array ();
+  test_typed ();
+
   return 0;
 }
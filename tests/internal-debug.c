@@ -6,10 +6,12 @@
 #include <glib.h>
 
 #include <telepathy-glib/debug.h>
+#include <telepathy-glib/util.h>
 
 #undef DEBUG_FLAG
 #define DEBUG_FLAG TP_DEBUG_IM
 #include "telepathy-glib/debug-internal.h"
+#include "telepathy-glib/util-internal.h"
 
 static void
 test_debugging (void)
@@ -66,6 +68,96 @@ test_debugging_again (void)
 #endif
 }
 
+#undef DEBUG_FLAG
+#define DEBUG_FLAG TP_DEBUG_PRESENCE
+#include "telepathy-glib/debug-internal.h"
+
+#ifdef ENABLE_DEBUG
+static guint n_logged = 0;
+
+static void
+count_messages (const gchar *log_domain,
+    GLogLevelFlags log_level,
+    const gchar *message,
+    gpointer user_data)
+{
+  n_logged++;
+}
+
+static guint
+count_evaluated (guint *n_evaluated)
+{
+  return ++*n_evaluated;
+}
+#endif
+
+static void
+test_levels (void)
+{
+#ifdef ENABLE_DEBUG
+  guint n_evaluated = 0;
+
+  g_log_set_default_handler (count_messages, NULL);
+
+  /* debug, but not trace */
+  tp_debug_set_flags ("presence=debug");
+  g_assert (DEBUGGING);
+  g_assert (!(_tp_debug_trace_flags & DEBUG_FLAG));
+
+  n_logged = 0;
+  DEBUG ("%u", count_evaluated (&n_evaluated));
+  TRACE ("%u", count_evaluated (&n_evaluated));
+  g_assert_cmpuint (n_logged, ==, 1);
+  g_assert_cmpuint (n_evaluated, ==, 1);
+
+  /* a plain keyword enables everything, including trace */
+  tp_debug_set_flags ("presence");
+  g_assert (_tp_debug_trace_flags & DEBUG_FLAG);
+
+  /* raising the threshold suppresses less severe messages, without
+   * evaluating their arguments */
+  tp_debug_set_flags ("groups;presence=message");
+  g_assert (!DEBUGGING);
+  g_assert (_tp_debug_flags & TP_DEBUG_GROUPS);
+
+  n_logged = 0;
+  n_evaluated = 0;
+  DEBUG ("%u", count_evaluated (&n_evaluated));
+  INFO ("not logged");
+  MESSAGE ("logged");
+  g_assert_cmpuint (n_logged, ==, 1);
+  g_assert_cmpuint (n_evaluated, ==, 0);
+
+  /* other domains are unaffected */
+  n_logged = 0;
+  _tp_log (G_LOG_LEVEL_INFO, TP_DEBUG_CONNECTION, "logged");
+  g_assert_cmpuint (n_logged, ==, 1);
+
+  tp_debug_set_flags ("all=critical");
+  g_assert (!(_tp_debug_flags & TP_DEBUG_IM));
+  n_logged = 0;
+  _tp_log (G_LOG_LEVEL_WARNING, TP_DEBUG_CONNECTION, "not logged");
+  g_assert_cmpuint (n_logged, ==, 0);
+#endif
+}
+
+static void
+test_alloc_stats (void)
+{
+  TpDebugFlags flags = _tp_debug_flags;
+  GValue *value;
+
+  g_assert (!_tp_alloc_stats_enabled);
+
+  /* "alloc" is not a debug flag, so it doesn't change the flags */
+  tp_debug_set_flags ("ALLOC");
+  g_assert (_tp_alloc_stats_enabled);
+  g_assert_cmpuint (_tp_debug_flags, ==, flags);
+
+  value = tp_g_value_slice_new_uint (42);
+  tp_g_value_slice_free (value);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -74,5 +166,7 @@ main (int argc, char **argv)
   test_debugging ();
   test_not_debugging ();
   test_debugging_again ();
+  test_alloc_stats ();
+  test_levels ();
   return 0;
 }
@@ -1,5 +1,7 @@
 #include "config.h"
 
+#include <string.h>
+
 #include <glib.h>
 #include <telepathy-glib/intset.h>
 #include <telepathy-glib/util.h>
@@ -52,7 +54,360 @@ test_iteration (TpIntset *set)
   iterate_in_order (set);
 }
 
-int main (int argc, char **argv)
+static void
+test_dense_ranges (void)
+{
+  TpIntset *dense = tp_intset_new ();
+  TpIntset *sparse = tp_intset_new ();
+  TpIntset *tmp, *inter, *uni;
+  guint i;
+
+  /* consecutive members, as allocated by a dynamic handle repo, spanning
+   * several 16-bit chunks */
+  for (i = 1; i <= 200000; i++)
+    tp_intset_add (dense, i);
+
+  g_assert_cmpuint (tp_intset_size (dense), ==, 200000);
+  g_assert (!tp_intset_is_member (dense, 0));
+  g_assert (tp_intset_is_member (dense, 1));
+  g_assert (tp_intset_is_member (dense, 65535));
+  g_assert (tp_intset_is_member (dense, 65536));
+  g_assert (tp_intset_is_member (dense, 200000));
+  g_assert (!tp_intset_is_member (dense, 200001));
+
+  /* punch holes in the runs */
+  for (i = 1000; i < 150000; i += 7)
+    g_assert (tp_intset_remove (dense, i));
+
+  g_assert (!tp_intset_remove (dense, 1000));
+  g_assert (!tp_intset_is_member (dense, 1007));
+  g_assert (tp_intset_is_member (dense, 1008));
+  test_iteration (dense);
+
+  /* scattered members, some of them among the dense ones */
+  for (i = 3; i < 1000000; i += 4099)
+    tp_intset_add (sparse, i);
+
+  test_iteration (sparse);
+
+  inter = tp_intset_intersection (dense, sparse);
+  g_assert (!tp_intset_is_empty (inter));
+  uni = tp_intset_union (dense, sparse);
+  g_assert_cmpuint (tp_intset_size (uni), ==,
+      tp_intset_size (dense) + tp_intset_size (sparse) -
+      tp_intset_size (inter));
+  test_iteration (uni);
+
+  tmp = tp_intset_copy (uni);
+  tp_intset_difference_update (tmp, sparse);
+  g_assert_cmpuint (tp_intset_size (tmp), ==,
+      tp_intset_size (dense) - tp_intset_size (inter));
+  tp_intset_union_update (tmp, sparse);
+  g_assert (tp_intset_is_equal (tmp, uni));
+  tp_intset_destroy (tmp);
+
+  tmp = tp_intset_symmetric_difference (dense, sparse);
+  g_assert_cmpuint (tp_intset_size (tmp), ==,
+      tp_intset_size (uni) - tp_intset_size (inter));
+  tp_intset_union_update (tmp, inter);
+  g_assert (tp_intset_is_equal (tmp, uni));
+  tp_intset_destroy (tmp);
+
+  tp_intset_destroy (inter);
+  tp_intset_destroy (uni);
+
+  /* removing everything leaves nothing behind */
+  tmp = tp_intset_copy (dense);
+  tp_intset_difference_update (tmp, dense);
+  g_assert (tp_intset_is_empty (tmp));
+  tp_intset_destroy (tmp);
+
+  tp_intset_destroy (dense);
+  tp_intset_destroy (sparse);
+}
+
+/* Sets with a few members near each other are stored without any
+ * allocation beyond the TpIntset; check that growing past that and
+ * shrinking back doesn't lose anything */
+static void
+test_small (void)
+{
+  TpIntset *set = tp_intset_new ();
+  TpIntset *copy, *other, *tmp;
+  guint i;
+
+  for (i = 1; i <= 20; i++)
+    {
+      tp_intset_add (set, i * 3);
+      g_assert_cmpuint (tp_intset_size (set), ==, i);
+      g_assert (tp_intset_is_member (set, i * 3));
+      g_assert (!tp_intset_is_member (set, i * 3 + 1));
+      test_iteration (set);
+
+      copy = tp_intset_copy (set);
+      g_assert (tp_intset_is_equal (set, copy));
+      tp_intset_destroy (copy);
+    }
+
+  for (i = 20; i > 1; i--)
+    {
+      g_assert (tp_intset_remove (set, i * 3));
+      g_assert_cmpuint (tp_intset_size (set), ==, i - 1);
+      g_assert (tp_intset_is_member (set, 3));
+      test_iteration (set);
+    }
+
+  /* a second chunk, and then a third, needs more than one container */
+  tp_intset_add (set, 100000);
+  tp_intset_add (set, 200000);
+  g_assert_cmpuint (tp_intset_size (set), ==, 3);
+  g_assert (tp_intset_is_member (set, 3));
+  g_assert (tp_intset_is_member (set, 100000));
+  g_assert (tp_intset_is_member (set, 200000));
+  test_iteration (set);
+
+  other = tp_intset_new_containing (100000);
+  tp_intset_add (other, 5);
+
+  tmp = tp_intset_intersection (set, other);
+  g_assert_cmpuint (tp_intset_size (tmp), ==, 1);
+  g_assert (tp_intset_is_member (tmp, 100000));
+  tp_intset_destroy (tmp);
+
+  tmp = tp_intset_symmetric_difference (set, other);
+  g_assert_cmpuint (tp_intset_size (tmp), ==, 3);
+  g_assert (tp_intset_is_member (tmp, 3));
+  g_assert (tp_intset_is_member (tmp, 5));
+  g_assert (tp_intset_is_member (tmp, 200000));
+  tp_intset_destroy (tmp);
+
+  tp_intset_union_update (other, set);
+  g_assert_cmpuint (tp_intset_size (other), ==, 4);
+  test_iteration (other);
+
+  tp_intset_difference_update (other, set);
+  g_assert_cmpuint (tp_intset_size (other), ==, 1);
+  g_assert (tp_intset_is_member (other, 5));
+  test_iteration (other);
+
+  g_assert (tp_intset_remove (set, 100000));
+  g_assert (tp_intset_remove (set, 3));
+  g_assert_cmpuint (tp_intset_size (set), ==, 1);
+  g_assert (tp_intset_is_member (set, 200000));
+  test_iteration (set);
+
+  /* a cleared set can grow again */
+  tp_intset_clear (set);
+  g_assert (tp_intset_is_empty (set));
+
+  for (i = 0; i < 5; i++)
+    tp_intset_add (set, i * 70000);
+
+  g_assert_cmpuint (tp_intset_size (set), ==, 5);
+  test_iteration (set);
+
+  tp_intset_destroy (other);
+  tp_intset_destroy (set);
+}
+
+static void
+test_bulk (void)
+{
+  TpIntset *set, *ref;
+  TpIntsetFastIter iter;
+  GArray *arr;
+  guint *elements = g_new (guint, 100000);
+  guint *buffer = g_new (guint, 100000);
+  guint batch[17];
+  guint i, n, total;
+
+  /* sorted, with duplicates, spanning dense and sparse chunks */
+  for (i = 0, n = 0; i < 70000; i++)
+    {
+      elements[n++] = i;
+
+      if (i % 5 == 0)
+        elements[n++] = i;
+    }
+
+  for (i = 0; n < 100000; i++)
+    elements[n++] = 100000 + i * 4099;
+
+  set = tp_intset_new_from_sorted (elements, n);
+  ref = tp_intset_new ();
+
+  for (i = 0; i < n; i++)
+    tp_intset_add (ref, elements[i]);
+
+  g_assert (tp_intset_is_equal (set, ref));
+  g_assert_cmpuint (tp_intset_size (set), ==, tp_intset_size (ref));
+
+  /* export in one go, and into a buffer that is too small */
+  n = tp_intset_to_buffer (set, buffer, 100000);
+  g_assert_cmpuint (n, ==, tp_intset_size (set));
+
+  for (i = 1; i < n; i++)
+    g_assert_cmpuint (buffer[i - 1], <, buffer[i]);
+
+  g_assert_cmpuint (tp_intset_to_buffer (set, elements, 10), ==, 10);
+
+  for (i = 0; i < 10; i++)
+    g_assert_cmpuint (elements[i], ==, buffer[i]);
+
+  /* batched iteration sees the same elements */
+  tp_intset_fast_iter_init (&iter, set);
+  total = 0;
+
+  while ((i = tp_intset_fast_iter_next_batch (&iter, batch,
+          G_N_ELEMENTS (batch))) > 0)
+    {
+      guint j;
+
+      for (j = 0; j < i; j++)
+        g_assert_cmpuint (batch[j], ==, buffer[total + j]);
+
+      total += i;
+    }
+
+  g_assert_cmpuint (total, ==, n);
+
+  /* round-trip through an unsorted GArray */
+  arr = g_array_sized_new (FALSE, FALSE, sizeof (guint), n);
+
+  for (i = n; i > 0; i--)
+    g_array_append_val (arr, buffer[i - 1]);
+
+  tp_intset_destroy (set);
+  set = tp_intset_from_array (arr);
+  g_assert (tp_intset_is_equal (set, ref));
+  g_array_unref (arr);
+
+  arr = tp_intset_to_array (set);
+  g_assert_cmpuint (arr->len, ==, n);
+  g_assert (memcmp (arr->data, buffer, n * sizeof (guint)) == 0);
+  g_array_unref (arr);
+
+  tp_intset_destroy (set);
+  set = tp_intset_new_from_sorted (NULL, 0);
+  g_assert (tp_intset_is_empty (set));
+  g_assert_cmpuint (tp_intset_to_buffer (set, buffer, 100000), ==, 0);
+
+  tp_intset_destroy (set);
+  tp_intset_destroy (ref);
+  g_free (elements);
+  g_free (buffer);
+}
+
+#define BENCHMARK_RANGE (1 << 20)
+#define BENCHMARK_ITERATIONS 50
+
+typedef enum {
+    BENCHMARK_UNION,
+    BENCHMARK_INTERSECTION,
+    BENCHMARK_DIFFERENCE,
+    BENCHMARK_SYMMETRIC_DIFFERENCE,
+    BENCHMARK_SIZE,
+    BENCHMARK_IS_EQUAL
+} BenchmarkOp;
+
+static const gchar * const benchmark_names[] = {
+    "union",
+    "intersection",
+    "difference",
+    "symmetric difference",
+    "size",
+    "is_equal"
+};
+
+static void
+benchmark_one (const TpIntset *left,
+    const TpIntset *right,
+    BenchmarkOp op)
+{
+  gint64 before, after;
+  guint i, total = 0;
+
+  before = g_get_monotonic_time ();
+
+  for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+      TpIntset *result = NULL;
+
+      switch (op)
+        {
+          case BENCHMARK_UNION:
+            result = tp_intset_union (left, right);
+            break;
+
+          case BENCHMARK_INTERSECTION:
+            result = tp_intset_intersection (left, right);
+            break;
+
+          case BENCHMARK_DIFFERENCE:
+            result = tp_intset_difference (left, right);
+            break;
+
+          case BENCHMARK_SYMMETRIC_DIFFERENCE:
+            result = tp_intset_symmetric_difference (left, right);
+            break;
+
+          case BENCHMARK_SIZE:
+            total += tp_intset_size (left);
+            break;
+
+          case BENCHMARK_IS_EQUAL:
+            total += tp_intset_is_equal (left, right);
+            break;
+        }
+
+      if (result != NULL)
+        {
+          total += tp_intset_size (result);
+          tp_intset_destroy (result);
+        }
+    }
+
+  after = g_get_monotonic_time ();
+
+  g_test_message ("%s: %.3f ns per element (checksum %u)",
+      benchmark_names[op],
+      (after - before) * 1000.0 / BENCHMARK_ITERATIONS / BENCHMARK_RANGE,
+      total);
+}
+
+static void
+test_benchmark (void)
+{
+  TpIntset *left = tp_intset_new ();
+  TpIntset *right = tp_intset_new ();
+  TpIntset *copy;
+  BenchmarkOp op;
+  guint i;
+
+  /* about half of the integers in the range, so every chunk is a bitmap */
+  for (i = 0; i < BENCHMARK_RANGE; i++)
+    {
+      if (g_random_boolean ())
+        tp_intset_add (left, i);
+
+      if (g_random_boolean ())
+        tp_intset_add (right, i);
+    }
+
+  for (op = BENCHMARK_UNION; op <= BENCHMARK_IS_EQUAL; op++)
+    benchmark_one (left, right, op);
+
+  /* the worst case for is_equal is a pair of equal sets */
+  copy = tp_intset_copy (left);
+  benchmark_one (left, copy, BENCHMARK_IS_EQUAL);
+
+  tp_intset_destroy (copy);
+  tp_intset_destroy (left);
+  tp_intset_destroy (right);
+}
+
+static void
+test_basics (void)
 {
   TpIntset *set1 = tp_intset_new ();
   TpIntset *a, *b, *copy;
@@ -224,6 +579,23 @@ int main (int argc, char **argv)
   a = NULL;
   value = NULL;
   b = NULL;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/intset/basics", test_basics);
+  g_test_add_func ("/intset/dense-ranges", test_dense_ranges);
+  g_test_add_func ("/intset/bulk", test_bulk);
+  g_test_add_func ("/intset/small", test_small);
+
+  /* run with -m perf, optionally with TP_INTSET_KERNELS set to one of
+   * generic, sse4.2, avx2 or neon to compare implementations */
+  if (g_test_perf ())
+    g_test_add_func ("/intset/benchmark", test_benchmark);
 
-  return 0;
+  return g_test_run ();
 }
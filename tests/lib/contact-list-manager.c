@@ -28,6 +28,9 @@ struct _TpTestsContactListManagerPrivate
   TpHandleRepoIface *contact_repo;
   TpHandleRepoIface *group_repo;
   TpHandleSet *groups;
+
+  /* incremented whenever any contact changes */
+  guint version;
 };
 
 static void contact_groups_iface_init (TpContactGroupListInterface *iface);
@@ -35,6 +38,8 @@ static void mutable_contact_groups_iface_init (
     TpMutableContactGroupListInterface *iface);
 static void mutable_iface_init (
     TpMutableContactListInterface *iface);
+static void versioned_iface_init (
+    TpVersionedContactListInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (TpTestsContactListManager, tp_tests_contact_list_manager,
     TP_TYPE_BASE_CONTACT_LIST,
@@ -43,7 +48,9 @@ G_DEFINE_TYPE_WITH_CODE (TpTestsContactListManager, tp_tests_contact_list_manage
     G_IMPLEMENT_INTERFACE (TP_TYPE_MUTABLE_CONTACT_GROUP_LIST,
       mutable_contact_groups_iface_init)
     G_IMPLEMENT_INTERFACE (TP_TYPE_MUTABLE_CONTACT_LIST,
-      mutable_iface_init))
+      mutable_iface_init)
+    G_IMPLEMENT_INTERFACE (TP_TYPE_VERSIONED_CONTACT_LIST,
+      versioned_iface_init))
 
 typedef struct {
   TpSubscriptionState subscribe;
@@ -53,6 +60,9 @@ typedef struct {
 
   TpHandle handle;
   TpHandleRepoIface *contact_repo;
+
+  /* the version of the contact list in which this contact last changed */
+  guint version;
 } ContactDetails;
 
 static void
@@ -97,6 +107,33 @@ ensure_contact (TpTestsContactListManager *self,
   return d;
 }
 
+static void
+contacts_changed (TpTestsContactListManager *self,
+    TpHandleSet *changed,
+    TpHandleSet *removed)
+{
+  self->priv->version++;
+
+  if (changed != NULL)
+    {
+      TpIntsetFastIter iter;
+      TpHandle handle;
+
+      tp_intset_fast_iter_init (&iter, tp_handle_set_peek (changed));
+
+      while (tp_intset_fast_iter_next (&iter, &handle))
+        {
+          ContactDetails *d = lookup_contact (self, handle);
+
+          if (d != NULL)
+            d->version = self->priv->version;
+        }
+    }
+
+  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self),
+      changed, removed);
+}
+
 static void
 tp_tests_contact_list_manager_init (TpTestsContactListManager *self)
 {
@@ -556,6 +593,49 @@ constructed (GObject *object)
   self->priv->groups = tp_handle_set_new (self->priv->group_repo);
 }
 
+static gchar *
+contact_list_dup_version (TpBaseContactList *base)
+{
+  TpTestsContactListManager *self = TP_TESTS_CONTACT_LIST_MANAGER (base);
+
+  return g_strdup_printf ("%u", self->priv->version);
+}
+
+static TpHandleSet *
+contact_list_dup_changes_since (TpBaseContactList *base,
+    const gchar *version)
+{
+  TpTestsContactListManager *self = TP_TESTS_CONTACT_LIST_MANAGER (base);
+  TpHandleSet *set;
+  GHashTableIter iter;
+  gpointer value;
+  gchar *end;
+  guint64 since = g_ascii_strtoull (version, &end, 10);
+
+  if (*end != '\0' || since > self->priv->version)
+    return NULL;
+
+  set = tp_handle_set_new (self->priv->contact_repo);
+  g_hash_table_iter_init (&iter, self->priv->contact_details);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      ContactDetails *d = value;
+
+      if (d->version > since)
+        tp_handle_set_add (set, d->handle);
+    }
+
+  return set;
+}
+
+static void
+versioned_iface_init (TpVersionedContactListInterface *iface)
+{
+  iface->dup_version = contact_list_dup_version;
+  iface->dup_changes_since = contact_list_dup_changes_since;
+}
+
 static void
 contact_groups_iface_init (TpContactGroupListInterface *iface)
 {
@@ -696,8 +776,7 @@ receive_authorized (gpointer p)
     }
   g_array_unref (handles_array);
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (s->self),
-      s->handles, NULL);
+  contacts_changed (s->self, s->handles, NULL);
 
   return FALSE;
 }
@@ -722,8 +801,7 @@ receive_unauthorized (gpointer p)
     }
   g_array_unref (handles_array);
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (s->self),
-      s->handles, NULL);
+  contacts_changed (s->self, s->handles, NULL);
 
   return FALSE;
 }
@@ -748,8 +826,7 @@ tp_tests_contact_list_manager_request_subscription (TpTestsContactListManager *s
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), handles,
-      NULL);
+  contacts_changed (self, handles, NULL);
 
   message_lc = g_ascii_strdown (message, -1);
   if (strstr (message_lc, "please") != NULL)
@@ -790,8 +867,7 @@ tp_tests_contact_list_manager_unsubscribe (TpTestsContactListManager *self,
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), handles,
-      NULL);
+  contacts_changed (self, handles, NULL);
 
   tp_handle_set_destroy (handles);
 }
@@ -816,8 +892,7 @@ tp_tests_contact_list_manager_authorize_publication (TpTestsContactListManager *
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), handles,
-      NULL);
+  contacts_changed (self, handles, NULL);
 
   tp_handle_set_destroy (handles);
 }
@@ -842,8 +917,7 @@ tp_tests_contact_list_manager_unpublish (TpTestsContactListManager *self,
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), handles,
-      NULL);
+  contacts_changed (self, handles, NULL);
 
   tp_handle_set_destroy (handles);
 }
@@ -868,8 +942,7 @@ tp_tests_contact_list_manager_remove (TpTestsContactListManager *self,
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), NULL,
-      handles);
+  contacts_changed (self, NULL, handles);
 
   tp_handle_set_destroy (handles);
 }
@@ -899,8 +972,7 @@ tp_tests_contact_list_manager_add_initial_contacts (TpTestsContactListManager *s
       tp_handle_set_add (handles, members[i]);
     }
 
-  tp_base_contact_list_contacts_changed (TP_BASE_CONTACT_LIST (self), handles,
-      NULL);
+  contacts_changed (self, handles, NULL);
 
   tp_handle_set_destroy (handles);
 }
@@ -13,6 +13,8 @@
 
 #include "contacts-conn.h"
 
+#include <string.h>
+
 #include <dbus/dbus-glib.h>
 
 #include <telepathy-glib/telepathy-glib.h>
@@ -96,6 +98,8 @@ struct _TpTestsContactsConnectionPrivate
   GPtrArray *default_contact_info;
 
   TpTestsContactListManager *list_manager;
+  /* if not NULL, RequestAvatars is implemented with this */
+  TpBaseAvatars *base_avatars;
 };
 
 typedef struct
@@ -175,6 +179,7 @@ finalize (GObject *object)
   g_hash_table_unref (self->priv->locations);
   g_hash_table_unref (self->priv->capabilities);
   g_hash_table_unref (self->priv->contact_info);
+  tp_clear_object (&self->priv->base_avatars);
 
   if (self->priv->default_contact_info != NULL)
     g_ptr_array_unref (self->priv->default_contact_info);
@@ -612,6 +617,45 @@ tp_tests_contacts_connection_class_init (TpTestsContactsConnectionClass *klass)
   tp_base_contact_list_mixin_class_init (base_class);
 }
 
+/* Signal changes to the contact attributes that this connection stores
+ * with ContactAttributesChanged, in addition to each interface's own
+ * signals. This must be called before the client introspects the
+ * connection. */
+void
+tp_tests_contacts_connection_set_notify_contact_attributes (
+    TpTestsContactsConnection *self)
+{
+  static const gchar *interfaces[] = {
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS,
+      TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      TP_IFACE_CONNECTION_INTERFACE_LOCATION,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO,
+      NULL };
+  guint i;
+
+  for (i = 0; interfaces[i] != NULL; i++)
+    tp_contacts_mixin_set_contact_attributes_notified ((GObject *) self,
+        interfaces[i]);
+}
+
+/* Does nothing unless
+ * tp_tests_contacts_connection_set_notify_contact_attributes() was called */
+static void
+emit_contact_attributes_changed (TpTestsContactsConnection *self,
+    const gchar *interface,
+    guint n,
+    const TpHandle *handles)
+{
+  GArray *contacts = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle), n);
+
+  g_array_append_vals (contacts, handles, n);
+  tp_contacts_mixin_emit_contact_attributes_changed ((GObject *) self,
+      interface, contacts);
+  g_array_unref (contacts);
+}
+
 TpTestsContactListManager *
 tp_tests_contacts_connection_get_contact_list_manager (
     TpTestsContactsConnection *self)
@@ -652,6 +696,8 @@ tp_tests_contacts_connection_change_aliases (TpTestsContactsConnection *self,
 
   tp_svc_connection_interface_aliasing_emit_aliases_changed (self,
       structs);
+  emit_contact_attributes_changed (self,
+      TP_IFACE_CONNECTION_INTERFACE_ALIASING, n, handles);
 
   g_ptr_array_foreach (structs, (GFunc) tp_value_array_free, NULL);
   g_ptr_array_unref (structs);
@@ -712,9 +758,17 @@ tp_tests_contacts_connection_change_avatar_tokens (TpTestsContactsConnection *se
       DEBUG ("contact#%u -> %s", handles[i], tokens[i]);
       g_hash_table_insert (self->priv->avatars,
           GUINT_TO_POINTER (handles[i]), avatar_data_new (NULL, NULL, tokens[i]));
-      tp_svc_connection_interface_avatars_emit_avatar_updated (self,
-          handles[i], tokens[i]);
+
+      if (self->priv->base_avatars != NULL)
+        tp_base_avatars_set_token (self->priv->base_avatars, handles[i],
+            tokens[i]);
+      else
+        tp_svc_connection_interface_avatars_emit_avatar_updated (self,
+            handles[i], tokens[i]);
     }
+
+  emit_contact_attributes_changed (self,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS, n, handles);
 }
 
 void
@@ -728,8 +782,51 @@ tp_tests_contacts_connection_change_avatar_data (
   g_hash_table_insert (self->priv->avatars,
       GUINT_TO_POINTER (handle), avatar_data_new (data, mime_type, token));
 
-  tp_svc_connection_interface_avatars_emit_avatar_updated (self,
-      handle, token);
+  if (self->priv->base_avatars != NULL)
+    tp_base_avatars_set_token (self->priv->base_avatars, handle, token);
+  else
+    tp_svc_connection_interface_avatars_emit_avatar_updated (self,
+        handle, token);
+
+  emit_contact_attributes_changed (self,
+      TP_IFACE_CONNECTION_INTERFACE_AVATARS, 1, &handle);
+}
+
+/* Use @avatars to answer RequestAvatars, instead of emitting AvatarRetrieved
+ * for each contact straight away. Its fetch_avatars implementation can use
+ * tp_tests_contacts_connection_get_avatar_data() to find the avatars. */
+void
+tp_tests_contacts_connection_set_base_avatars (
+    TpTestsContactsConnection *self,
+    TpBaseAvatars *avatars)
+{
+  g_return_if_fail (self->priv->base_avatars == NULL);
+
+  self->priv->base_avatars = g_object_ref (avatars);
+}
+
+/* Returns the avatar set with
+ * tp_tests_contacts_connection_change_avatar_data(), or NULL */
+GArray *
+tp_tests_contacts_connection_get_avatar_data (
+    TpTestsContactsConnection *self,
+    TpHandle handle,
+    const gchar **mime_type,
+    const gchar **token)
+{
+  AvatarData *a = g_hash_table_lookup (self->priv->avatars,
+      GUINT_TO_POINTER (handle));
+
+  if (a == NULL || a->data == NULL)
+    return NULL;
+
+  if (mime_type != NULL)
+    *mime_type = a->mime_type;
+
+  if (token != NULL)
+    *token = a->token;
+
+  return a->data;
 }
 
 void
@@ -750,6 +847,9 @@ tp_tests_contacts_connection_change_locations (TpTestsContactsConnection *self,
       tp_svc_connection_interface_location_emit_location_updated (self,
           handles[i], locations[i]);
     }
+
+  emit_contact_attributes_changed (self,
+      TP_IFACE_CONNECTION_INTERFACE_LOCATION, n, handles);
 }
 
 void
@@ -759,18 +859,26 @@ tp_tests_contacts_connection_change_capabilities (
 {
   GHashTableIter iter;
   gpointer handle, caps;
+  GArray *contacts = g_array_sized_new (FALSE, FALSE, sizeof (TpHandle),
+      g_hash_table_size (capabilities));
 
   g_hash_table_iter_init (&iter, capabilities);
   while (g_hash_table_iter_next (&iter, &handle, &caps))
     {
+      TpHandle h = GPOINTER_TO_UINT (handle);
+
       g_hash_table_insert (self->priv->capabilities,
           handle,
           g_boxed_copy (TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST,
             caps));
+      g_array_append_val (contacts, h);
     }
 
   tp_svc_connection_interface_contact_capabilities_emit_contact_capabilities_changed (
       self, capabilities);
+  tp_contacts_mixin_emit_contact_attributes_changed ((GObject *) self,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES, contacts);
+  g_array_unref (contacts);
 }
 
 void
@@ -784,6 +892,8 @@ tp_tests_contacts_connection_change_contact_info (
 
   tp_svc_connection_interface_contact_info_emit_contact_info_changed (self,
       handle, info);
+  emit_contact_attributes_changed (self,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO, 1, &handle);
 }
 
 void
@@ -1001,6 +1111,8 @@ my_get_avatar_tokens (TpSvcConnectionInterfaceAvatars *avatars,
               GUINT_TO_POINTER (handle), a);
           tp_svc_connection_interface_avatars_emit_avatar_updated (self,
               handle, a->token);
+          emit_contact_attributes_changed (self,
+              TP_IFACE_CONNECTION_INTERFACE_AVATARS, 1, &handle);
         }
 
       g_hash_table_insert (result, GUINT_TO_POINTER (handle),
@@ -1073,6 +1185,14 @@ my_request_avatars (TpSvcConnectionInterfaceAvatars *avatars,
       return;
     }
 
+  if (self->priv->base_avatars != NULL)
+    {
+      tp_base_avatars_request_avatars (self->priv->base_avatars, contacts);
+      tp_svc_connection_interface_avatars_return_from_request_avatars (
+          context);
+      return;
+    }
+
   for (i = 0; i < contacts->len; i++)
     {
       TpHandle handle = g_array_index (contacts, TpHandle, i);
@@ -1080,8 +1200,8 @@ my_request_avatars (TpSvcConnectionInterfaceAvatars *avatars,
           GUINT_TO_POINTER (handle));
 
       if (a != NULL)
-        tp_svc_connection_interface_avatars_emit_avatar_retrieved (self, handle,
-            a->token, a->data, a->mime_type);
+        tp_base_connection_emit_avatar_retrieved (base, handle, a->token,
+            a->data, a->mime_type);
     }
 
   tp_svc_connection_interface_avatars_return_from_request_avatars (context);
@@ -1283,6 +1403,9 @@ my_refresh_contact_info (TpSvcConnectionInterfaceContactInfo *obj,
       g_ptr_array_unref (arr);
     }
 
+  tp_contacts_mixin_emit_contact_attributes_changed ((GObject *) self,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACT_INFO, contacts);
+
   tp_svc_connection_interface_contact_info_return_from_refresh_contact_info (
       context);
 }
@@ -1458,3 +1581,136 @@ tp_tests_no_requests_connection_class_init (
   base_class->get_interfaces_always_present = tp_tests_no_requests_get_interfaces_always_present;
   base_class->create_channel_managers = NULL;
 }
+
+/* =============== Addressing ================= */
+
+static void init_addressing (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (TpTestsAddressingConnection,
+    tp_tests_addressing_connection,
+    TP_TESTS_TYPE_CONTACTS_CONNECTION,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_ADDRESSING,
+      init_addressing));
+
+static gchar *
+addressing_address_to_id (TpBaseConnection *base,
+    const gchar *vcard_field,
+    const gchar *address,
+    gpointer user_data,
+    GError **error)
+{
+  if (vcard_field == NULL && g_str_has_prefix (address, "xmpp:"))
+    return g_strdup (address + strlen ("xmpp:"));
+
+  if (vcard_field == NULL && g_str_has_prefix (address, "tel:"))
+    return g_strdup (address + strlen ("tel:"));
+
+  if (!tp_strdiff (vcard_field, "x-jabber") ||
+      !tp_strdiff (vcard_field, "tel"))
+    return g_strdup (address);
+
+  g_set_error (error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+      "Unsupported address '%s'", address);
+  return NULL;
+}
+
+static void
+addressing_get_contacts_by_vcard_field (
+    TpSvcConnectionInterfaceAddressing *iface,
+    const gchar *field,
+    const gchar **addresses,
+    const gchar **interfaces,
+    DBusGMethodInvocation *context)
+{
+  GHashTable *requested, *attributes;
+  gchar *sender = dbus_g_method_get_sender (context);
+  GError *error = NULL;
+
+  if (tp_base_connection_dup_contacts_by_addresses (
+        (TpBaseConnection *) iface, field, addresses,
+        addressing_address_to_id, NULL, interfaces, sender, &requested,
+        &attributes, &error))
+    {
+      tp_svc_connection_interface_addressing_return_from_get_contacts_by_vcard_field (
+          context, requested, attributes);
+      g_hash_table_unref (requested);
+      g_hash_table_unref (attributes);
+    }
+  else
+    {
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+    }
+
+  g_free (sender);
+}
+
+static void
+addressing_get_contacts_by_uri (TpSvcConnectionInterfaceAddressing *iface,
+    const gchar **uris,
+    const gchar **interfaces,
+    DBusGMethodInvocation *context)
+{
+  GHashTable *requested, *attributes;
+  gchar *sender = dbus_g_method_get_sender (context);
+  GError *error = NULL;
+
+  if (tp_base_connection_dup_contacts_by_addresses (
+        (TpBaseConnection *) iface, NULL, uris,
+        addressing_address_to_id, NULL, interfaces, sender, &requested,
+        &attributes, &error))
+    {
+      tp_svc_connection_interface_addressing_return_from_get_contacts_by_uri (
+          context, requested, attributes);
+      g_hash_table_unref (requested);
+      g_hash_table_unref (attributes);
+    }
+  else
+    {
+      dbus_g_method_return_error (context, error);
+      g_error_free (error);
+    }
+
+  g_free (sender);
+}
+
+static void
+init_addressing (gpointer g_iface,
+    gpointer iface_data)
+{
+  TpSvcConnectionInterfaceAddressingClass *klass = g_iface;
+
+#define IMPLEMENT(x) tp_svc_connection_interface_addressing_implement_##x (\
+    klass, addressing_##x)
+  IMPLEMENT(get_contacts_by_vcard_field);
+  IMPLEMENT(get_contacts_by_uri);
+#undef IMPLEMENT
+}
+
+static void
+tp_tests_addressing_connection_init (TpTestsAddressingConnection *self)
+{
+}
+
+static GPtrArray *
+tp_tests_addressing_get_interfaces_always_present (TpBaseConnection *base)
+{
+  GPtrArray *interfaces;
+
+  interfaces = TP_BASE_CONNECTION_CLASS (
+      tp_tests_addressing_connection_parent_class)->get_interfaces_always_present (base);
+
+  g_ptr_array_add (interfaces, TP_IFACE_CONNECTION_INTERFACE_ADDRESSING);
+
+  return interfaces;
+}
+
+static void
+tp_tests_addressing_connection_class_init (
+    TpTestsAddressingConnectionClass *klass)
+{
+  TpBaseConnectionClass *base_class =
+      (TpBaseConnectionClass *) klass;
+
+  base_class->get_interfaces_always_present = tp_tests_addressing_get_interfaces_always_present;
+}
@@ -72,6 +72,9 @@ typedef enum {
   (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TESTS_TYPE_CONTACTS_CONNECTION, \
                               TpTestsContactsConnectionClass))
 
+void tp_tests_contacts_connection_set_notify_contact_attributes (
+    TpTestsContactsConnection *self);
+
 TpTestsContactListManager *tp_tests_contacts_connection_get_contact_list_manager (
     TpTestsContactsConnection *self);
 
@@ -95,6 +98,16 @@ void tp_tests_contacts_connection_change_avatar_data (
     const gchar *mime_type,
     const gchar *token);
 
+void tp_tests_contacts_connection_set_base_avatars (
+    TpTestsContactsConnection *self,
+    TpBaseAvatars *avatars);
+
+GArray *tp_tests_contacts_connection_get_avatar_data (
+    TpTestsContactsConnection *self,
+    TpHandle handle,
+    const gchar **mime_type,
+    const gchar **token);
+
 void tp_tests_contacts_connection_change_locations (
     TpTestsContactsConnection *self,
     guint n,
@@ -183,6 +196,30 @@ GType tp_tests_no_requests_connection_get_type (void);
   (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TESTS_TYPE_NO_REQUESTS_CONNECTION, \
                               TpTestsNoRequestsConnectionClass))
 
+/* Addressing version: contacts are also identified by x-jabber and tel
+ * vCard addresses, and xmpp: and tel: URIs */
+
+typedef struct _TpTestsAddressingConnection TpTestsAddressingConnection;
+typedef struct _TpTestsAddressingConnectionClass
+  TpTestsAddressingConnectionClass;
+
+struct _TpTestsAddressingConnectionClass {
+    TpTestsContactsConnectionClass parent_class;
+};
+
+struct _TpTestsAddressingConnection {
+    TpTestsContactsConnection parent;
+};
+
+GType tp_tests_addressing_connection_get_type (void);
+
+/* TYPE MACROS */
+#define TP_TESTS_TYPE_ADDRESSING_CONNECTION \
+  (tp_tests_addressing_connection_get_type ())
+#define TP_TESTS_ADDRESSING_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), TP_TESTS_TYPE_ADDRESSING_CONNECTION, \
+                              TpTestsAddressingConnection))
+
 G_END_DECLS
 
 #endif /* ifndef __TP_TESTS_CONTACTS_CONN_H__ */
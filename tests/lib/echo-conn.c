@@ -34,6 +34,9 @@ enum
 struct _TpTestsEchoConnectionPrivate
 {
   gchar *account;
+  /* if TRUE, stay CONNECTING until tp_tests_echo_connection_finish_connecting
+   * is called */
+  gboolean manual_connect;
 };
 
 static void
@@ -147,13 +150,36 @@ start_connecting (TpBaseConnection *conn,
                   GError **error)
 {
   TpTestsEchoConnection *self = TP_TESTS_ECHO_CONNECTION (conn);
-  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
-      TP_HANDLE_TYPE_CONTACT);
-  TpHandle self_handle;
+
+  if (self->priv->manual_connect)
+    {
+      tp_base_connection_change_status (conn,
+          TP_CONNECTION_STATUS_CONNECTING,
+          TP_CONNECTION_STATUS_REASON_REQUESTED);
+      return TRUE;
+    }
 
   /* In a real connection manager we'd ask the underlying implementation to
    * start connecting, then go to state CONNECTED when finished, but here
    * we can do it immediately. */
+  tp_tests_echo_connection_finish_connecting (self);
+  return TRUE;
+}
+
+void
+tp_tests_echo_connection_set_manual_connect (TpTestsEchoConnection *self,
+    gboolean manual)
+{
+  self->priv->manual_connect = manual;
+}
+
+void
+tp_tests_echo_connection_finish_connecting (TpTestsEchoConnection *self)
+{
+  TpBaseConnection *conn = (TpBaseConnection *) self;
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (conn,
+      TP_HANDLE_TYPE_CONTACT);
+  TpHandle self_handle;
 
   self_handle = tp_handle_ensure (contact_repo, self->priv->account,
       NULL, NULL);
@@ -161,8 +187,6 @@ start_connecting (TpBaseConnection *conn,
   tp_base_connection_set_self_handle (conn, self_handle);
   tp_base_connection_change_status (conn, TP_CONNECTION_STATUS_CONNECTED,
       TP_CONNECTION_STATUS_REASON_REQUESTED);
-
-  return TRUE;
 }
 
 static void
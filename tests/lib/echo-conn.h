@@ -50,6 +50,10 @@ GType tp_tests_echo_connection_get_type (void);
   (G_TYPE_INSTANCE_GET_CLASS ((obj), TP_TESTS_TYPE_ECHO_CONNECTION, \
                               TpTestsEchoConnectionClass))
 
+void tp_tests_echo_connection_set_manual_connect (TpTestsEchoConnection *self,
+    gboolean manual);
+void tp_tests_echo_connection_finish_connecting (TpTestsEchoConnection *self);
+
 G_END_DECLS
 
 #endif
@@ -18,6 +18,7 @@
 #include <telepathy-glib/telepathy-glib.h>
 
 #include <glib/gstdio.h>
+#include <string.h>
 
 static void file_transfer_iface_init (gpointer iface, gpointer data);
 
@@ -68,6 +69,9 @@ struct _TpTestsFileTransferChannelPrivate {
     GHashTable *available_socket_types;
     gint64 initial_offset;
 
+    /* What to send to the client when accepting, if anything */
+    gchar *contents;
+
     /* Accepting side */
     GSocketService *service;
     GValue *access_control_param;
@@ -147,6 +151,7 @@ dispose (GObject *object)
   g_free (self->priv->filename);
   g_free (self->priv->uri);
   g_free (self->priv->service_name);
+  g_free (self->priv->contents);
 
   tp_clear_pointer (&self->priv->address, tp_g_value_slice_free);
   tp_clear_pointer (&self->priv->available_socket_types, g_hash_table_unref);
@@ -182,7 +187,9 @@ get_property (GObject *object,
         break;
 
       case PROP_CONTENT_HASH:
-        g_value_set_string (value, self->priv->content_hash);
+        g_value_set_string (value, self->priv->content_hash != NULL ?
+            self->priv->content_hash : "");
+        break;
 
       case PROP_CONTENT_HASH_TYPE:
         g_value_set_uint (value, self->priv->content_hash_type);
@@ -257,6 +264,7 @@ set_property (GObject *object,
         break;
 
       case PROP_CONTENT_HASH_TYPE:
+        self->priv->content_hash_type = g_value_get_uint (value);
         break;
 
       case PROP_CONTENT_TYPE:
@@ -329,6 +337,8 @@ fill_immutable_properties (TpBaseChannel *self,
       G_OBJECT (self), properties,
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "AvailableSocketTypes",
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHashType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHash",
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Filename",
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Size",
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Description",
@@ -440,6 +450,19 @@ service_incoming_cb (GSocketService *service,
 
       g_object_unref (addr);
     }
+
+  if (self->priv->contents != NULL)
+    {
+      /* TODO: Async version */
+      g_output_stream_write_all (
+          g_io_stream_get_output_stream (G_IO_STREAM (connection)),
+          self->priv->contents, strlen (self->priv->contents), NULL, NULL,
+          &error);
+      g_assert_no_error (error);
+
+      g_io_stream_close (G_IO_STREAM (connection), NULL, &error);
+      g_assert_no_error (error);
+    }
 }
 
 static void
@@ -561,6 +584,11 @@ file_transfer_accept_file (TpSvcChannelTypeFileTransfer *iface,
   self->priv->access_control_param = tp_g_value_slice_dup (
       access_control_param);
 
+  /* We can start wherever the client likes */
+  self->priv->initial_offset = offset;
+  tp_svc_channel_type_file_transfer_emit_initial_offset_defined (self,
+      offset);
+
   DEBUG ("Setting TP_FILE_TRANSFER_STATE_ACCEPTED");
   change_state (self, TP_FILE_TRANSFER_STATE_ACCEPTED,
       TP_FILE_TRANSFER_STATE_CHANGE_REASON_REQUESTED);
@@ -591,6 +619,8 @@ tp_tests_file_transfer_channel_class_init (
   static TpDBusPropertiesMixinPropImpl file_transfer_props[] = {
       { "AvailableSocketTypes", "available-socket-types", NULL },
       { "ContentType", "content-type", NULL },
+      { "ContentHashType", "content-hash-type", NULL },
+      { "ContentHash", "content-hash", NULL },
       { "Date", "date", NULL },
       { "Description", "description", NULL },
       { "Filename", "filename", NULL },
@@ -626,6 +656,22 @@ tp_tests_file_transfer_channel_class_init (
   g_object_class_install_property (object_class, PROP_AVAILABLE_SOCKET_TYPES,
       param_spec);
 
+  param_spec = g_param_spec_uint ("content-hash-type",
+      "ContentHashType",
+      "The ContentHashType property of this channel",
+      0, TP_NUM_FILE_HASH_TYPES - 1, TP_FILE_HASH_TYPE_NONE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("content-hash",
+      "ContentHash",
+      "The ContentHash property of this channel",
+      NULL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH,
+      param_spec);
+
   param_spec = g_param_spec_string ("content-type",
       "ContentType",
       "The ContentType property of this channel",
@@ -760,3 +806,25 @@ tp_tests_file_transfer_channel_get_server_address (
 
   return address;
 }
+
+/* Report progress, as the CM would while transferring */
+void
+tp_tests_file_transfer_channel_set_transferred_bytes (
+    TpTestsFileTransferChannel *self,
+    guint64 count)
+{
+  self->priv->transferred_bytes = count;
+
+  tp_svc_channel_type_file_transfer_emit_transferred_bytes_changed (self,
+      count);
+}
+
+/* Send @contents to the client once it connects to an accepted transfer */
+void
+tp_tests_file_transfer_channel_set_contents (
+    TpTestsFileTransferChannel *self,
+    const gchar *contents)
+{
+  g_free (self->priv->contents);
+  self->priv->contents = g_strdup (contents);
+}
@@ -58,6 +58,14 @@ GHashTable * tp_tests_file_transfer_channel_get_props (
 GSocketAddress * tp_tests_file_transfer_channel_get_server_address (
         TpTestsFileTransferChannel *self);
 
+void tp_tests_file_transfer_channel_set_transferred_bytes (
+        TpTestsFileTransferChannel *self,
+        guint64 count);
+
+void tp_tests_file_transfer_channel_set_contents (
+        TpTestsFileTransferChannel *self,
+        const gchar *contents);
+
 G_END_DECLS
 
 #endif
@@ -34,6 +34,7 @@ enum {
     FEAT_RETRY_DEP,
     FEAT_BEFORE_CONNECTED,
     FEAT_INTERFACE_LATER,
+    FEAT_STALLED,
     N_FEAT
 };
 
@@ -219,6 +220,19 @@ prepare_interface_later_async (TpProxy *proxy,
   g_object_unref (result);
 }
 
+static void
+prepare_stalled_async (TpProxy *proxy,
+    const TpProxyFeature *feature,
+    GAsyncReadyCallback callback,
+    gpointer user_data)
+{
+  TpTestsMyConnProxy *self = (TpTestsMyConnProxy *) proxy;
+
+  g_assert (self->stalled_result == NULL);
+  self->stalled_result = g_simple_async_result_new ((GObject *) proxy,
+      callback, user_data, prepare_stalled_async);
+}
+
 static const TpProxyFeature *
 list_features (TpProxyClass *cls G_GNUC_UNUSED)
 {
@@ -286,6 +300,9 @@ list_features (TpProxyClass *cls G_GNUC_UNUSED)
       TP_TESTS_MY_CONN_PROXY_IFACE_LATER);
   features[FEAT_INTERFACE_LATER].interfaces_needed = need_iface_later;
 
+  features[FEAT_STALLED].name = TP_TESTS_MY_CONN_PROXY_FEATURE_STALLED;
+  features[FEAT_STALLED].prepare_async = prepare_stalled_async;
+
   return features;
 }
 
@@ -362,3 +379,9 @@ tp_tests_my_conn_proxy_get_feature_quark_interface_later (void)
 {
   return g_quark_from_static_string ("tp-my-conn-proxy-feature-interface-later");
 }
+
+GQuark
+tp_tests_my_conn_proxy_get_feature_quark_stalled (void)
+{
+  return g_quark_from_static_string ("tp-my-conn-proxy-feature-stalled");
+}
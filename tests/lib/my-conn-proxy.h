@@ -38,6 +38,8 @@ struct _TpTestsMyConnProxy {
 
     gboolean retry_feature_success;
     TpTestsMyConnProxyBeforeConnectedState before_connected_state;
+    /* the preparation of FEATURE_STALLED, which the test has to complete */
+    GSimpleAsyncResult *stalled_result;
 };
 
 GType tp_tests_my_conn_proxy_get_type (void);
@@ -119,6 +121,11 @@ GQuark tp_tests_my_conn_proxy_get_feature_quark_before_connected (void) G_GNUC_C
   (tp_tests_my_conn_proxy_get_feature_quark_interface_later ())
 GQuark tp_tests_my_conn_proxy_get_feature_quark_interface_later (void) G_GNUC_CONST;
 
+/* Isn't prepared until the test completes stalled_result */
+#define TP_TESTS_MY_CONN_PROXY_FEATURE_STALLED \
+  (tp_tests_my_conn_proxy_get_feature_quark_stalled ())
+GQuark tp_tests_my_conn_proxy_get_feature_quark_stalled (void) G_GNUC_CONST;
+
 G_END_DECLS
 
 #endif /* #ifndef __TP_TESTS_MY_CONN_PROXY_H__ */
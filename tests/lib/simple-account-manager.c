@@ -43,6 +43,8 @@ struct _TpTestsSimpleAccountManagerPrivate
 {
   GPtrArray *valid_accounts;
   GPtrArray *invalid_accounts;
+  /* object path => borrowed account service, for GetAccountProperties */
+  GHashTable *account_objects;
 };
 
 static void
@@ -74,6 +76,70 @@ tp_tests_simple_account_manager_create_account (TpSvcAccountManager *svc,
   tp_svc_account_manager_return_from_create_account (context, out);
 }
 
+static void
+tp_tests_simple_account_manager_get_account_properties (
+    TpSvcAccountManager *svc,
+    const GPtrArray *in_Accounts,
+    DBusGMethodInvocation *context)
+{
+  TpTestsSimpleAccountManager *self = (TpTestsSimpleAccountManager *) svc;
+  static const gchar * const interfaces[] = { TP_IFACE_ACCOUNT,
+      TP_IFACE_ACCOUNT_INTERFACE_ADDRESSING,
+      TP_IFACE_ACCOUNT_INTERFACE_STORAGE, NULL };
+  GHashTable *ret;
+  guint i;
+
+  /* behave like an older account manager unless the test wants this */
+  if (g_hash_table_size (self->priv->account_objects) == 0)
+    {
+      GError e = { TP_ERROR, TP_ERROR_NOT_IMPLEMENTED, "no thanks" };
+      dbus_g_method_return_error (context, &e);
+      return;
+    }
+
+  self->get_account_properties_calls++;
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) g_hash_table_unref);
+
+  for (i = 0; i < in_Accounts->len; i++)
+    {
+      const gchar *path = g_ptr_array_index (in_Accounts, i);
+      GObject *account = g_hash_table_lookup (self->priv->account_objects,
+          path);
+      GHashTable *properties;
+      const gchar * const *iface;
+
+      if (account == NULL)
+        continue;
+
+      properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+          (GDestroyNotify) tp_g_value_slice_free);
+
+      for (iface = interfaces; *iface != NULL; iface++)
+        {
+          GHashTable *values = tp_dbus_properties_mixin_dup_all (account,
+              *iface);
+          GHashTableIter iter;
+          gpointer k, v;
+
+          g_hash_table_iter_init (&iter, values);
+
+          while (g_hash_table_iter_next (&iter, &k, &v))
+            g_hash_table_insert (properties,
+                g_strdup_printf ("%s.%s", *iface, (const gchar *) k),
+                tp_g_value_slice_dup (v));
+
+          g_hash_table_unref (values);
+        }
+
+      g_hash_table_insert (ret, (gchar *) path, properties);
+    }
+
+  tp_svc_account_manager_return_from_get_account_properties (context, ret);
+  g_hash_table_unref (ret);
+}
+
 static void
 account_manager_iface_init (gpointer klass,
     gpointer unused G_GNUC_UNUSED)
@@ -81,6 +147,7 @@ account_manager_iface_init (gpointer klass,
 #define IMPLEMENT(x) tp_svc_account_manager_implement_##x (\
   klass, tp_tests_simple_account_manager_##x)
   IMPLEMENT (create_account);
+  IMPLEMENT (get_account_properties);
 #undef IMPLEMENT
 }
 
@@ -93,6 +160,8 @@ tp_tests_simple_account_manager_init (TpTestsSimpleAccountManager *self)
 
   self->priv->valid_accounts = g_ptr_array_new_with_free_func (g_free);
   self->priv->invalid_accounts = g_ptr_array_new_with_free_func (g_free);
+  self->priv->account_objects = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, NULL);
 }
 
 static void
@@ -129,6 +198,7 @@ tp_tests_simple_account_manager_finalize (GObject *object)
 
   g_ptr_array_unref (self->priv->valid_accounts);
   g_ptr_array_unref (self->priv->invalid_accounts);
+  g_hash_table_unref (self->priv->account_objects);
 
   tp_clear_pointer (&self->create_cm, g_free);
   tp_clear_pointer (&self->create_protocol, g_free);
@@ -238,3 +308,16 @@ tp_tests_simple_account_manager_remove_account (
 
   tp_svc_account_manager_emit_account_removed (self, object_path);
 }
+
+/* Answer GetAccountProperties for @object_path with the properties of
+ * @account, which must stay alive as long as @self does. Until this is
+ * called, GetAccountProperties is not implemented. */
+void
+tp_tests_simple_account_manager_add_account_object (
+    TpTestsSimpleAccountManager *self,
+    const gchar *object_path,
+    GObject *account)
+{
+  g_hash_table_insert (self->priv->account_objects, g_strdup (object_path),
+      account);
+}
@@ -36,6 +36,8 @@ struct _TpTestsSimpleAccountManager {
     GHashTable *create_parameters;
     GHashTable *create_properties;
 
+    guint get_account_properties_calls;
+
     TpTestsSimpleAccountManagerPrivate *priv;
 };
 
@@ -67,6 +69,11 @@ void tp_tests_simple_account_manager_remove_account (
     TpTestsSimpleAccountManager *self,
     const gchar *object_path);
 
+void tp_tests_simple_account_manager_add_account_object (
+    TpTestsSimpleAccountManager *self,
+    const gchar *object_path,
+    GObject *account);
+
 G_END_DECLS
 
 #endif /* #ifndef __TP_TESTS_SIMPLE_ACCOUNT_MANAGER_H__ */
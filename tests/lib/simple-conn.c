@@ -139,6 +139,30 @@ dispose (GObject *object)
   G_OBJECT_CLASS (tp_tests_simple_connection_parent_class)->dispose (object);
 }
 
+/* Like g_timeout_add (0, ...), but in the main context that the connection
+ * is bound to, which might be run by another thread */
+static guint
+add_timeout (TpTestsSimpleConnection *self,
+    GSourceFunc function)
+{
+  GSource *source = g_timeout_source_new (0);
+  guint id;
+
+  g_source_set_callback (source, function, self, NULL);
+  id = g_source_attach (source,
+      tp_base_connection_get_main_context ((TpBaseConnection *) self));
+  g_source_unref (source);
+  return id;
+}
+
+static void
+remove_timeout (TpTestsSimpleConnection *self,
+    guint id)
+{
+  g_source_destroy (g_main_context_find_source_by_id (
+        tp_base_connection_get_main_context ((TpBaseConnection *) self), id));
+}
+
 static void
 finalize (GObject *object)
 {
@@ -146,12 +170,12 @@ finalize (GObject *object)
 
   if (self->priv->connect_source != 0)
     {
-      g_source_remove (self->priv->connect_source);
+      remove_timeout (self, self->priv->connect_source);
     }
 
   if (self->priv->disconnect_source != 0)
     {
-      g_source_remove (self->priv->disconnect_source);
+      remove_timeout (self, self->priv->disconnect_source);
     }
 
   g_clear_error (&self->priv->get_self_handle_error);
@@ -251,7 +275,7 @@ start_connecting (TpBaseConnection *conn,
    * start connecting, then go to state CONNECTED when finished. Here there
    * isn't actually a connection, so we'll fake a connection process that
    * takes time. */
-  self->priv->connect_source = g_timeout_add (0, pretend_connected, self);
+  self->priv->connect_source = add_timeout (self, pretend_connected);
 
   return TRUE;
 }
@@ -279,8 +303,7 @@ shut_down (TpBaseConnection *conn)
    * start shutting down, then call this function when finished. Here there
    * isn't actually a connection, so we'll fake a disconnection process that
    * takes time. */
-  self->priv->disconnect_source = g_timeout_add (0, pretend_disconnected,
-      conn);
+  self->priv->disconnect_source = add_timeout (self, pretend_disconnected);
 }
 
 static GPtrArray *
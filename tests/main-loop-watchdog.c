@@ -0,0 +1,136 @@
+/* Tests of the main loop watchdog used by tp_run_connection_manager()
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <telepathy-glib/debug.h>
+
+#include "telepathy-glib/main-loop-watchdog-internal.h"
+
+/* the watchdog logs from its own thread */
+static GMutex log_lock;
+static GString *captured = NULL;
+
+static void
+log_handler (const gchar *log_domain,
+    GLogLevelFlags log_level,
+    const gchar *message,
+    gpointer user_data)
+{
+  g_mutex_lock (&log_lock);
+  g_string_append (captured, message);
+  g_string_append_c (captured, '\n');
+  g_mutex_unlock (&log_lock);
+
+  g_log_default_handler (log_domain, log_level, message, user_data);
+}
+
+static gboolean
+log_contains (const gchar *needle)
+{
+  gboolean ret;
+
+  g_mutex_lock (&log_lock);
+  ret = (strstr (captured->str, needle) != NULL);
+  g_mutex_unlock (&log_lock);
+  return ret;
+}
+
+static gboolean
+quit_cb (gpointer data)
+{
+  g_main_loop_quit (data);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+block_cb (gpointer data)
+{
+  _tp_main_loop_watchdog_note_method_call ("com.example.Slow", "Block",
+      "/com/example");
+  g_usleep (150 * G_TIME_SPAN_MILLISECOND);
+
+  /* quit in the next iteration, after the watchdog has seen this one
+   * end */
+  g_idle_add (quit_cb, data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_blocked (void)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  gchar *summary;
+
+  _tp_main_loop_watchdog_start (50);
+
+  g_idle_add (block_cb, loop);
+  g_main_loop_run (loop);
+
+  g_assert (log_contains ("main loop has been blocked for "));
+  g_assert (log_contains (
+        " ms while serving com.example.Slow.Block on /com/example\n"));
+  g_assert (log_contains ("main loop was blocked for 1"));
+
+  summary = _tp_main_loop_watchdog_dup_summary (TRUE);
+  g_assert (summary != NULL);
+  g_assert (strstr (summary, "99% < 256 ms, ") != NULL);
+  g_free (summary);
+
+  /* the summary was reset */
+  g_assert (_tp_main_loop_watchdog_dup_summary (FALSE) == NULL);
+
+  _tp_main_loop_watchdog_stop ();
+  g_main_loop_unref (loop);
+}
+
+static void
+test_not_blocked (void)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  gchar *summary;
+
+  g_string_truncate (captured, 0);
+  _tp_main_loop_watchdog_start (1000);
+
+  g_timeout_add (10, quit_cb, loop);
+  g_main_loop_run (loop);
+
+  g_assert (!log_contains ("blocked"));
+
+  summary = _tp_main_loop_watchdog_dup_summary (FALSE);
+  g_assert (summary != NULL);
+  g_assert (strstr (summary, "99% < 1 ms, ") != NULL);
+  g_free (summary);
+
+  _tp_main_loop_watchdog_stop ();
+  g_main_loop_unref (loop);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+  tp_debug_set_flags ("manager");
+
+  captured = g_string_new ("");
+  g_log_set_handler ("tp-glib/manager",
+      G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG,
+      log_handler, NULL);
+
+  g_test_add_func ("/main-loop-watchdog/blocked", test_blocked);
+  g_test_add_func ("/main-loop-watchdog/not-blocked", test_not_blocked);
+
+  return g_test_run ();
+}
@@ -155,6 +155,82 @@ test_dead_observer_and_disconnected (Test *test,
   g_assert_cmpuint (test->caught, ==, 2);
 }
 
+static void
+test_several_handlers (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  GObject *other_observer = tp_tests_object_new_static_class (
+      tp_tests_stub_object_get_type (), NULL);
+  Test other = { 0, test->emitter, other_observer };
+  gulong id;
+
+  g_object_set_data (other_observer, DATA_KEY, &other);
+
+  /* all of these share their bookkeeping, so check that removing any one
+   * of them leaves the others alone */
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (increment_caught), test->observer, 0);
+  id = tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (increment_caught), test->observer, 0);
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (increment_caught_swapped), test->observer,
+      G_CONNECT_SWAPPED);
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (increment_caught), other_observer, 0);
+
+  g_object_notify (test->emitter, "name");
+  g_assert_cmpuint (test->caught, ==, 3);
+  g_assert_cmpuint (other.caught, ==, 1);
+
+  g_signal_handler_disconnect (test->emitter, id);
+  g_object_notify (test->emitter, "name");
+  g_assert_cmpuint (test->caught, ==, 5);
+  g_assert_cmpuint (other.caught, ==, 2);
+
+  tp_clear_object (&test->observer);
+  g_object_notify (test->emitter, "name");
+  g_assert_cmpuint (test->caught, ==, 5);
+  g_assert_cmpuint (other.caught, ==, 3);
+
+  /* connecting again after the pair's record has gone works too */
+  test->observer = tp_tests_object_new_static_class (
+      tp_tests_stub_object_get_type (), NULL);
+  g_object_set_data (test->observer, DATA_KEY, test);
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (increment_caught), test->observer, 0);
+  g_object_notify (test->emitter, "name");
+  g_assert_cmpuint (test->caught, ==, 6);
+  g_assert_cmpuint (other.caught, ==, 4);
+
+  tp_clear_object (&test->emitter);
+  g_object_unref (other_observer);
+}
+
+static void
+count_notify (GObject *emitter,
+    GParamSpec *param_spec,
+    gpointer user_data)
+{
+  g_assert (emitter == user_data);
+  g_object_set_data (emitter, "count",
+      GUINT_TO_POINTER (GPOINTER_TO_UINT (
+          g_object_get_data (emitter, "count")) + 1));
+}
+
+static void
+test_self (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (count_notify), test->emitter, 0);
+  tp_g_signal_connect_object (test->emitter, "notify::name",
+      G_CALLBACK (count_notify), test->emitter, 0);
+  g_object_notify (test->emitter, "name");
+  g_assert_cmpuint (GPOINTER_TO_UINT (
+        g_object_get_data (test->emitter, "count")), ==, 2);
+  tp_clear_object (&test->emitter);
+}
+
 int
 main (int argc,
     char **argv)
@@ -176,6 +252,9 @@ main (int argc,
       test_disconnected, teardown);
   g_test_add (TEST_PREFIX "dead_observer_and_disconnected", Test, NULL, setup,
       test_dead_observer_and_disconnected, teardown);
+  g_test_add (TEST_PREFIX "several_handlers", Test, NULL, setup,
+      test_several_handlers, teardown);
+  g_test_add (TEST_PREFIX "self", Test, NULL, setup, test_self, teardown);
 
   return g_test_run ();
 }
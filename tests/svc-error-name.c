@@ -0,0 +1,80 @@
+/* Tests of the D-Bus error names used by GVariant-based method
+ * implementations, which are meant to be the same as dbus-glib's
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <dbus/dbus-glib.h>
+
+#include <telepathy-glib/errors.h>
+
+#include "telepathy-glib/svc-variant-internal.h"
+
+static void
+assert_error_name (GQuark domain,
+    gint code,
+    const gchar *expected)
+{
+  GError *error = g_error_new_literal (domain, code, "Badger");
+  gchar *name = _tp_svc_dup_error_name (error);
+
+  g_assert_cmpstr (name, ==, expected);
+
+  g_free (name);
+  g_error_free (error);
+}
+
+static void
+test_dbus_gerror (void)
+{
+  assert_error_name (DBUS_GERROR, DBUS_GERROR_FAILED, DBUS_ERROR_FAILED);
+  assert_error_name (DBUS_GERROR, DBUS_GERROR_INVALID_ARGS,
+      DBUS_ERROR_INVALID_ARGS);
+  assert_error_name (DBUS_GERROR, DBUS_GERROR_UNKNOWN_METHOD,
+      DBUS_ERROR_UNKNOWN_METHOD);
+  assert_error_name (DBUS_GERROR, DBUS_GERROR_NOT_SUPPORTED,
+      DBUS_ERROR_NOT_SUPPORTED);
+}
+
+static void
+test_tp_error (void)
+{
+  assert_error_name (TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+      TP_ERROR_STR_NOT_AVAILABLE);
+  assert_error_name (TP_ERROR, TP_ERROR_INVALID_HANDLE,
+      TP_ERROR_STR_INVALID_HANDLE);
+
+  /* a code with no name is unmapped, like any other domain */
+  assert_error_name (TP_ERROR, 12345,
+      "org.freedesktop.DBus.GLib.UnmappedError.TpErrors.Code12345");
+}
+
+static void
+test_unmapped (void)
+{
+  assert_error_name (G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+      "org.freedesktop.DBus.GLib.UnmappedError.GIoErrorQuark.Code1");
+  assert_error_name (g_quark_from_static_string ("badger_mushroom-snake"), 7,
+      "org.freedesktop.DBus.GLib.UnmappedError.BadgerMushroomSnake.Code7");
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/svc-error-name/dbus-gerror", test_dbus_gerror);
+  g_test_add_func ("/svc-error-name/tp-error", test_tp_error);
+  g_test_add_func ("/svc-error-name/unmapped", test_unmapped);
+
+  return g_test_run ();
+}
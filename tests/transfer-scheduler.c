@@ -0,0 +1,314 @@
+/* Tests of TpTransferScheduler
+ *
+ * Copyright © 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "tests/lib/util.h"
+
+typedef struct {
+    /* borrowed from the Test */
+    GArray *finished;
+    guint index;
+
+    GInputStream *source;
+    GMemoryOutputStream *target;
+    gchar *data;
+    gsize size;
+    gssize result;
+    GError *error;
+    gboolean done;
+} Transfer;
+
+typedef struct {
+    TpTransferScheduler *scheduler;
+    Transfer transfers[2];
+    /* indices of the transfers in the order they finished */
+    GArray *finished;
+} Test;
+
+static void
+transfer_init (Test *test,
+    guint index,
+    gsize size)
+{
+  Transfer *t = &test->transfers[index];
+  gsize i;
+
+  t->finished = test->finished;
+  t->index = index;
+  t->size = size;
+  t->data = g_malloc (size);
+
+  for (i = 0; i < size; i++)
+    t->data[i] = i % 251;
+
+  t->source = g_memory_input_stream_new_from_data (
+      g_memdup (t->data, size), size, g_free);
+  t->target = G_MEMORY_OUTPUT_STREAM (g_memory_output_stream_new (NULL, 0,
+        g_realloc, g_free));
+}
+
+static void
+setup (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  tp_debug_set_flags ("all");
+
+  test->scheduler = tp_transfer_scheduler_new ();
+  test->finished = g_array_new (FALSE, FALSE, sizeof (guint));
+}
+
+static void
+teardown (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (test->transfers); i++)
+    {
+      Transfer *t = &test->transfers[i];
+
+      g_clear_object (&t->source);
+      g_clear_object (&t->target);
+      g_free (t->data);
+      g_clear_error (&t->error);
+    }
+
+  g_array_unref (test->finished);
+  g_object_unref (test->scheduler);
+}
+
+static void
+splice_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  Transfer *t = user_data;
+
+  t->result = tp_transfer_scheduler_splice_finish (
+      TP_TRANSFER_SCHEDULER (source), result, &t->error);
+  t->done = TRUE;
+  g_array_append_val (t->finished, t->index);
+}
+
+static void
+start (Test *test,
+    guint i,
+    guint weight,
+    GCancellable *cancellable)
+{
+  Transfer *t = &test->transfers[i];
+
+  tp_transfer_scheduler_splice_async (test->scheduler,
+      G_OUTPUT_STREAM (t->target), t->source,
+      G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+      G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+      weight, cancellable, splice_cb, t);
+}
+
+static void
+assert_copied (Transfer *t)
+{
+  g_assert_no_error (t->error);
+  g_assert_cmpint (t->result, ==, t->size);
+  g_assert_cmpuint (g_memory_output_stream_get_data_size (t->target), ==,
+      t->size);
+  g_assert (memcmp (g_memory_output_stream_get_data (t->target), t->data,
+        t->size) == 0);
+}
+
+static void
+test_unlimited (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  transfer_init (test, 0, 200 * 1024);
+
+  start (test, 0, 1, NULL);
+  g_assert_cmpuint (tp_transfer_scheduler_get_n_transfers (test->scheduler),
+      ==, 1);
+
+  while (!test->transfers[0].done)
+    g_main_context_iteration (NULL, TRUE);
+
+  assert_copied (&test->transfers[0]);
+  g_assert_cmpuint (tp_transfer_scheduler_get_n_transfers (test->scheduler),
+      ==, 0);
+}
+
+static void
+test_rate_limit (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  gint64 before;
+
+  tp_transfer_scheduler_set_rate_limit (test->scheduler, 100000);
+  g_assert_cmpuint (tp_transfer_scheduler_get_rate_limit (test->scheduler),
+      ==, 100000);
+
+  transfer_init (test, 0, 30000);
+  before = g_get_monotonic_time ();
+
+  start (test, 0, 1, NULL);
+
+  while (!test->transfers[0].done)
+    g_main_context_iteration (NULL, TRUE);
+
+  assert_copied (&test->transfers[0]);
+
+  /* Only one chunk of 5000 bytes can go before there is credit for it,
+   * so the rest takes a quarter of a second, give or take a little */
+  g_assert_cmpint (g_get_monotonic_time () - before, >=,
+      G_USEC_PER_SEC / 5);
+}
+
+static void
+test_weights (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  guint first;
+
+  tp_transfer_scheduler_set_rate_limit (test->scheduler, 200000);
+
+  transfer_init (test, 0, 40000);
+  transfer_init (test, 1, 40000);
+
+  start (test, 0, 1, NULL);
+  start (test, 1, 3, NULL);
+  g_assert_cmpuint (tp_transfer_scheduler_get_n_transfers (test->scheduler),
+      ==, 2);
+
+  while (test->finished->len < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  assert_copied (&test->transfers[0]);
+  assert_copied (&test->transfers[1]);
+
+  /* the same amount of data, but three times the share */
+  first = g_array_index (test->finished, guint, 0);
+  g_assert_cmpuint (first, ==, 1);
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+  return FALSE;
+}
+
+static void
+run_for_a_while (void)
+{
+  gboolean timed_out = FALSE;
+
+  g_timeout_add (100, timeout_cb, &timed_out);
+
+  while (!timed_out)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_pause (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  Transfer *t = &test->transfers[0];
+
+  transfer_init (test, 0, 200 * 1024);
+
+  start (test, 0, 1, NULL);
+  tp_transfer_scheduler_set_paused (test->scheduler, t->source, TRUE);
+
+  /* nothing is written, and the streams stay open */
+  run_for_a_while ();
+  g_assert (!t->done);
+  g_assert_cmpuint (g_memory_output_stream_get_data_size (t->target), ==,
+      0);
+  g_assert (!g_output_stream_is_closed (G_OUTPUT_STREAM (t->target)));
+  g_assert_cmpuint (tp_transfer_scheduler_get_n_transfers (test->scheduler),
+      ==, 1);
+
+  tp_transfer_scheduler_set_paused (test->scheduler, t->source, FALSE);
+
+  while (!t->done)
+    g_main_context_iteration (NULL, TRUE);
+
+  assert_copied (t);
+}
+
+static void
+test_cancel_paused (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  Transfer *t = &test->transfers[0];
+  GCancellable *cancellable = g_cancellable_new ();
+
+  transfer_init (test, 0, 200 * 1024);
+
+  start (test, 0, 1, cancellable);
+  tp_transfer_scheduler_set_paused (test->scheduler, t->source, TRUE);
+  run_for_a_while ();
+  g_assert (!t->done);
+
+  g_cancellable_cancel (cancellable);
+
+  while (!t->done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_error (t->error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint (t->result, ==, -1);
+  g_assert_cmpuint (tp_transfer_scheduler_get_n_transfers (test->scheduler),
+      ==, 0);
+
+  g_object_unref (cancellable);
+}
+
+static void
+test_default (Test *test,
+    gconstpointer data G_GNUC_UNUSED)
+{
+  TpTransferScheduler *a = tp_transfer_scheduler_dup_default ();
+  TpTransferScheduler *b = tp_transfer_scheduler_dup_default ();
+
+  g_assert (a == b);
+  g_assert (a != test->scheduler);
+
+  g_object_unref (a);
+  g_object_unref (b);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+#define TEST_PREFIX "/transfer-scheduler/"
+
+  tp_tests_abort_after (10);
+  g_test_init (&argc, &argv, NULL);
+  g_test_bug_base ("http://bugs.freedesktop.org/show_bug.cgi?id=");
+
+  g_test_add (TEST_PREFIX "unlimited", Test, NULL, setup, test_unlimited,
+      teardown);
+  g_test_add (TEST_PREFIX "rate-limit", Test, NULL, setup, test_rate_limit,
+      teardown);
+  g_test_add (TEST_PREFIX "weights", Test, NULL, setup, test_weights,
+      teardown);
+  g_test_add (TEST_PREFIX "pause", Test, NULL, setup, test_pause,
+      teardown);
+  g_test_add (TEST_PREFIX "cancel-paused", Test, NULL, setup,
+      test_cancel_paused, teardown);
+  g_test_add (TEST_PREFIX "default", Test, NULL, setup, test_default,
+      teardown);
+
+  return g_test_run ();
+}
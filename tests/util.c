@@ -5,6 +5,7 @@
 #include <glib.h>
 
 #include <telepathy-glib/util.h>
+#include <telepathy-glib/util-internal.h>
 
 void test_strv_contains (void);
 
@@ -292,6 +293,144 @@ test_utf8_make_valid (void)
     }
 }
 
+static void
+test_quark_array_intern (void)
+{
+  GQuark a = g_quark_from_static_string ("a");
+  GQuark b = g_quark_from_static_string ("b");
+  GQuark c = g_quark_from_static_string ("c");
+  GQuark ab[] = { a, b, 0 };
+  GQuark bab[] = { b, a, b, 0 };
+  GQuark bc[] = { b, c };
+  const GQuark *empty, *set_ab, *set_bc, *set_abc;
+  const GQuark *q;
+
+  empty = _tp_quark_array_intern (NULL, 0);
+  g_assert (empty != NULL);
+  g_assert_cmpuint (empty[0], ==, 0);
+  g_assert (_tp_quark_array_intern (ab, 0) == empty);
+
+  /* order and duplicates don't matter */
+  set_ab = _tp_quark_array_intern (ab, -1);
+  g_assert (_tp_quark_array_intern (bab, -1) == set_ab);
+  g_assert (set_ab != ab);
+
+  for (q = set_ab; *q != 0; q++)
+    g_assert (q == set_ab || q[-1] < q[0]);
+
+  g_assert_cmpuint (q - set_ab, ==, 2);
+
+  set_bc = _tp_quark_array_intern (bc, 2);
+  g_assert (set_bc != set_ab);
+
+  set_abc = _tp_quark_array_intern_union (set_ab, set_bc);
+  g_assert (_tp_quark_array_intern_union (set_bc, set_ab) == set_abc);
+  g_assert (_tp_quark_array_intern_union (set_abc, set_ab) == set_abc);
+  g_assert (_tp_quark_array_intern_union (set_ab, empty) == set_ab);
+  g_assert (_tp_quark_array_intern_union (empty, set_bc) == set_bc);
+
+  for (q = set_abc; *q != 0; q++);
+
+  g_assert_cmpuint (q - set_abc, ==, 3);
+}
+
+static void
+test_strv_intern_concat (void)
+{
+  const gchar * const ab[] = { "a", "b", NULL };
+  const gchar * const bc[] = { "b", "c", NULL };
+  gchar *dynamic[] = { g_strdup ("a"), g_strdup ("b"), NULL };
+  const gchar * const *set_ab, *set_abc, *empty;
+
+  empty = _tp_strv_intern_concat (NULL, NULL);
+  g_assert (empty != NULL);
+  g_assert (empty[0] == NULL);
+
+  /* the contents don't need to live as long as the result */
+  set_ab = _tp_strv_intern_concat (ab, NULL);
+  g_assert (_tp_strv_intern_concat ((const gchar * const *) dynamic,
+        NULL) == set_ab);
+  g_assert (_tp_strv_intern_concat (NULL, ab) == set_ab);
+  g_free (dynamic[0]);
+  g_free (dynamic[1]);
+
+  g_assert_cmpuint (g_strv_length ((gchar **) set_ab), ==, 2);
+  g_assert_cmpstr (set_ab[0], ==, "a");
+  g_assert_cmpstr (set_ab[1], ==, "b");
+
+  /* order is kept, and duplicates are dropped */
+  set_abc = _tp_strv_intern_concat (set_ab, bc);
+  g_assert (set_abc != set_ab);
+  g_assert_cmpuint (g_strv_length ((gchar **) set_abc), ==, 3);
+  g_assert_cmpstr (set_abc[2], ==, "c");
+  g_assert (_tp_strv_intern_concat (ab, bc) == set_abc);
+  g_assert (_tp_strv_intern_concat (bc, ab) != set_abc);
+}
+
+static gboolean
+record_idle_cb (gpointer data)
+{
+  GString *order = data;
+
+  g_string_append_c (order, 'x');
+  return FALSE;
+}
+
+static gboolean
+record_interactive_idle_cb (gpointer data)
+{
+  GString *order = data;
+
+  g_string_append_c (order, 'i');
+  return FALSE;
+}
+
+static void
+test_latency_classes (void)
+{
+  GString *order = g_string_new ("");
+  GSource *source;
+
+  g_assert_cmpint (tp_get_latency_class_priority (
+        TP_LATENCY_CLASS_INTERACTIVE), ==, G_PRIORITY_HIGH);
+  g_assert_cmpint (tp_get_latency_class_priority (TP_LATENCY_CLASS_NORMAL),
+      ==, G_PRIORITY_DEFAULT_IDLE);
+  g_assert_cmpint (tp_get_latency_class_priority (TP_LATENCY_CLASS_BULK),
+      ==, G_PRIORITY_LOW);
+
+  source = _tp_idle_source_new (TP_LATENCY_CLASS_BULK);
+  g_assert_cmpint (g_source_get_priority (source), ==, G_PRIORITY_LOW);
+  g_source_unref (source);
+
+  /* interactive callbacks overtake bulk ones that were queued first */
+  _tp_idle_add (TP_LATENCY_CLASS_BULK, record_idle_cb, order);
+  _tp_idle_add (TP_LATENCY_CLASS_INTERACTIVE, record_interactive_idle_cb,
+      order);
+
+  while (order->len < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (order->str, ==, "ix");
+  g_string_truncate (order, 0);
+
+  /* ... unless the application says otherwise */
+  tp_set_latency_class_priority (TP_LATENCY_CLASS_BULK, G_PRIORITY_HIGH - 1);
+  g_assert_cmpint (tp_get_latency_class_priority (TP_LATENCY_CLASS_BULK),
+      ==, G_PRIORITY_HIGH - 1);
+
+  _tp_idle_add (TP_LATENCY_CLASS_INTERACTIVE, record_interactive_idle_cb,
+      order);
+  _tp_timeout_add (TP_LATENCY_CLASS_BULK, 0, record_idle_cb, order);
+
+  while (order->len < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (order->str, ==, "xi");
+
+  tp_set_latency_class_priority (TP_LATENCY_CLASS_BULK, G_PRIORITY_LOW);
+  g_string_free (order, TRUE);
+}
+
 int main (int argc, char **argv)
 {
   GPtrArray *ptrarray;
@@ -327,11 +466,26 @@ int main (int argc, char **argv)
   g_assert (!tp_strdiff (string,  "_c2_a9"));
   g_free (string);
 
+  string = tp_escape_as_identifier ("/org/freedesktop/Telepathy");
+  g_assert (!tp_strdiff (string,
+        "_2forg_2ffreedesktop_2fTelepathy"));
+  g_free (string);
+
+  string = tp_escape_as_identifier ("9");
+  g_assert (!tp_strdiff (string, "_39"));
+  g_free (string);
+
   test_strv_contains ();
 
   test_value_array_build ();
 
   test_utf8_make_valid ();
 
+  test_quark_array_intern ();
+
+  test_strv_intern_concat ();
+
+  test_latency_classes ();
+
   return 0;
 }
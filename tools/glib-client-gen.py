@@ -41,6 +41,7 @@ class Generator(object):
         self.__header = []
         self.__body = []
         self.__docs = []
+        self.__vardict = []
 
         self.prefix_lc = prefix.lower()
         self.prefix_uc = prefix.upper()
@@ -73,9 +74,19 @@ class Generator(object):
 
         self.guard = opts.get('--guard', None)
 
+        # If set, also generate GVariant-based variants of each method and
+        # signal, named with this prefix and a _vardict suffix and declared in
+        # basename-vardict.h. They're implemented in terms of private
+        # telepathy-glib functions, so this is only useful inside
+        # telepathy-glib itself.
+        self.vardict_prefix = opts.get('--vardict-prefix', None)
+
     def h(self, s):
         self.__header.append(s)
 
+    def v(self, s):
+        self.__vardict.append(s)
+
     def b(self, s):
         self.__body.append(s)
 
@@ -357,6 +368,76 @@ class Generator(object):
         self.b('}')
         self.b('')
 
+        if self.vardict_prefix is not None:
+            self.do_signal_vardict(signal, iface_lc, member, member_lc, args,
+                                   collect_name)
+
+    def do_signal_vardict(self, signal, iface_lc, member, member_lc, args,
+            collect_name):
+        # Example:
+        #
+        # TpProxySignalConnection *
+        #   _tp_cli_connection_connect_to_status_changed_vardict
+        #   (TpConnection *proxy,
+        #   TpProxyVardictSignalCallback callback,
+        #   gpointer user_data,
+        #   GDestroyNotify destroy,
+        #   GObject *weak_object,
+        #   GError **error);
+        #
+        # The callback receives the signal's arguments as a tuple.
+
+        name = ('%s_%s_connect_to_%s_vardict'
+                % (self.vardict_prefix, iface_lc, member_lc))
+        signature = ''.join([elt.getAttribute('type')
+                             for name_, info, tp_type, elt in args])
+
+        self.v('TpProxySignalConnection *%s (%sproxy,'
+               % (name, self.proxy_arg))
+        self.v('    TpProxyVardictSignalCallback callback,')
+        self.v('    gpointer user_data,')
+        self.v('    GDestroyNotify destroy,')
+        self.v('    GObject *weak_object,')
+        self.v('    GError **error);')
+        self.v('')
+
+        self.b('TpProxySignalConnection *')
+        self.b('%s (%sproxy,' % (name, self.proxy_arg))
+        self.b('    TpProxyVardictSignalCallback callback,')
+        self.b('    gpointer user_data,')
+        self.b('    GDestroyNotify destroy,')
+        self.b('    GObject *weak_object,')
+        self.b('    GError **error)')
+        self.b('{')
+        self.b('  GType expected_types[%d] = {' % (len(args) + 1))
+
+        for arg in args:
+            name_, info, tp_type, elt = arg
+            ctype, gtype, marshaller, pointer = info
+
+            self.b('      %s,' % gtype)
+
+        self.b('      G_TYPE_INVALID };')
+        self.b('')
+        self.b('  g_return_val_if_fail (%s (proxy), NULL);'
+               % self.proxy_assert)
+        self.b('  g_return_val_if_fail (callback != NULL, NULL);')
+        self.b('')
+        self.b('  return _tp_proxy_signal_connection_new_vardict (')
+        self.b('      (TpProxy *) proxy,')
+        self.b('      %s, \"%s\",' % (self.get_iface_quark(), member))
+        self.b('      G_VARIANT_TYPE (\"(%s)\"), expected_types,' % signature)
+
+        if args:
+            self.b('      G_CALLBACK (%s),' % collect_name)
+        else:
+            self.b('      NULL, /* no args => no collector function */')
+
+        self.b('      callback, user_data, destroy,')
+        self.b('      weak_object, error);')
+        self.b('}')
+        self.b('')
+
     def do_method(self, iface, method):
         iface_lc = iface.lower()
 
@@ -808,11 +889,91 @@ class Generator(object):
         self.do_method_reentrant(method, iface_lc, member, member_lc,
                                  in_args, out_args, collect_callback)
 
+        if self.vardict_prefix is not None:
+            self.do_method_vardict(method, iface_lc, member, member_lc,
+                                   in_args, out_args)
+
         # leave a gap for the end of the method
         self.d('')
         self.b('')
         self.h('')
 
+    def do_method_vardict(self, method, iface_lc, member, member_lc, in_args,
+            out_args):
+        # Example:
+        #
+        # TpProxyPendingCall *
+        #   _tp_cli_connection_call_request_handles_vardict
+        #   (TpConnection *proxy,
+        #   gint timeout_ms,
+        #   GVariant *in_args,
+        #   TpProxyVardictCallback callback,
+        #   gpointer user_data,
+        #   GDestroyNotify destroy,
+        #   GObject *weak_object);
+        #
+        # @in_args is a tuple of the 'in' arguments, and may be floating;
+        # methods without 'in' arguments don't have it. The callback
+        # receives a tuple of the 'out' arguments.
+
+        name = ('%s_%s_call_%s_vardict'
+                % (self.vardict_prefix, iface_lc, member_lc))
+        in_sig = ''.join([elt.getAttribute('type')
+                          for name_, info, tp_type, elt in in_args])
+        out_sig = ''.join([elt.getAttribute('type')
+                           for name_, info, tp_type, elt in out_args])
+
+        self.v('TpProxyPendingCall *%s (%sproxy,' % (name, self.proxy_arg))
+        self.v('    gint timeout_ms,')
+
+        if in_args:
+            self.v('    GVariant *in_args,')
+
+        self.v('    TpProxyVardictCallback callback,')
+        self.v('    gpointer user_data,')
+        self.v('    GDestroyNotify destroy,')
+        self.v('    GObject *weak_object);')
+        self.v('')
+
+        self.b('TpProxyPendingCall *')
+        self.b('%s (%sproxy,' % (name, self.proxy_arg))
+        self.b('    gint timeout_ms,')
+
+        if in_args:
+            self.b('    GVariant *in_args,')
+
+        self.b('    TpProxyVardictCallback callback,')
+        self.b('    gpointer user_data,')
+        self.b('    GDestroyNotify destroy,')
+        self.b('    GObject *weak_object)')
+        self.b('{')
+        self.b('  g_return_val_if_fail (%s (proxy), NULL);'
+               % self.proxy_assert)
+
+        if in_args:
+            self.b('  g_return_val_if_fail (g_variant_is_of_type (in_args,')
+            self.b('        G_VARIANT_TYPE ("(%s)")), NULL);' % in_sig)
+
+        self.b('  g_return_val_if_fail (callback != NULL || '
+               'user_data == NULL, NULL);')
+        self.b('  g_return_val_if_fail (callback != NULL || '
+               'destroy == NULL, NULL);')
+        self.b('  g_return_val_if_fail (callback != NULL || '
+               'weak_object == NULL, NULL);')
+        self.b('')
+        self.b('  return _tp_proxy_call_vardict ((TpProxy *) proxy,')
+        self.b('      %s, "%s",' % (self.get_iface_quark(), member))
+
+        if in_args:
+            self.b('      in_args,')
+        else:
+            self.b('      NULL,')
+
+        self.b('      G_VARIANT_TYPE ("(%s)"), timeout_ms,' % out_sig)
+        self.b('      callback, user_data, destroy, weak_object);')
+        self.b('}')
+        self.b('')
+
     def do_method_reentrant(self, method, iface_lc, member, member_lc, in_args,
             out_args, collect_callback):
         # Reentrant blocking calls
@@ -1138,6 +1299,23 @@ class Generator(object):
         self.b('/*<private_header>*/')
         self.b('')
 
+        if self.vardict_prefix is not None:
+            self.b('#include "%s-vardict.h"'
+                   % os.path.basename(self.basename))
+            self.b('')
+
+            self.v('/*<private_header>*/')
+
+            if self.guard is not None:
+                self.v('#ifndef %s_VARDICT' % self.guard)
+                self.v('#define %s_VARDICT' % self.guard)
+                self.v('')
+
+            self.v('#include "telepathy-glib/proxy-internal.h"')
+            self.v('')
+            self.v('G_BEGIN_DECLS')
+            self.v('')
+
         nodes = self.dom.getElementsByTagName('node')
         nodes.sort(key=key_by_name)
 
@@ -1196,6 +1374,17 @@ class Generator(object):
         file_set_contents(self.basename + '-body.h', u('\n').join(self.__body).encode('utf-8'))
         file_set_contents(self.basename + '-gtk-doc.h', u('\n').join(self.__docs).encode('utf-8'))
 
+        if self.vardict_prefix is not None:
+            self.v('G_END_DECLS')
+            self.v('')
+
+            if self.guard is not None:
+                self.v('#endif /* defined (%s_VARDICT) */' % self.guard)
+                self.v('')
+
+            file_set_contents(self.basename + '-vardict.h',
+                    u('\n').join(self.__vardict).encode('utf-8'))
+
 def types_to_gtypes(types):
     return [type_to_gtype(t)[1] for t in types]
 
@@ -1205,7 +1394,8 @@ if __name__ == '__main__':
                                ['group=', 'subclass=', 'subclass-assert=',
                                 'iface-quark-prefix=', 'tp-proxy-api=',
                                 'generate-reentrant=', 'deprecate-reentrant=',
-                                'deprecation-attribute=', 'guard='])
+                                'deprecation-attribute=', 'guard=',
+                                'vardict-prefix='])
 
     opts = {}
 
@@ -15,6 +15,8 @@ class Generator(object):
     def __init__(self, dom, prefix):
         self.dom = dom
         self.marshallers = {}
+        # (interface name, set of marshaller names) in spec order
+        self.iface_marshallers = []
         self.prefix = prefix
 
     def do_signal(self, signal):
@@ -25,6 +27,23 @@ class Generator(object):
 
         self.marshallers[marshaller] = rhs
 
+        iface = signal.parentNode.getAttribute('name')
+
+        if not self.iface_marshallers or self.iface_marshallers[-1][0] != iface:
+            self.iface_marshallers.append((iface, set()))
+
+        self.iface_marshallers[-1][1].add(marshaller)
+
+    def print_registration(self, marshaller, indent):
+        rhs = self.marshallers[marshaller]
+
+        print('%sdbus_g_object_register_marshaller (' % indent)
+        print('%s    g_cclosure_marshal_generic,' % indent)
+        print('%s    G_TYPE_NONE,       /* return */' % indent)
+        for type in rhs:
+            print('%s    G_TYPE_%s,' % (indent, type.replace('VOID', 'NONE')))
+        print('%s    G_TYPE_INVALID);' % indent)
+
     def __call__(self):
         signals = self.dom.getElementsByTagName('signal')
 
@@ -38,15 +57,35 @@ class Generator(object):
         all = list(self.marshallers.keys())
         all.sort()
         for marshaller in all:
-            rhs = self.marshallers[marshaller]
+            self.print_registration(marshaller, '  ')
 
-            print('  dbus_g_object_register_marshaller (')
-            print('      g_cclosure_marshal_generic,')
-            print('      G_TYPE_NONE,       /* return */')
-            for type in rhs:
-                print('      G_TYPE_%s,' % type.replace('VOID', 'NONE'))
-            print('      G_TYPE_INVALID);')
+        print('}')
+
+        # Register only the marshallers needed by one interface's signals,
+        # so that they can be registered when it is first used
+        print('')
+        print('void %s_register_dbus_glib_marshallers_for_interface ('
+                % self.prefix)
+        print('    const gchar *iface);')
+        print('')
+        print('void')
+        print('%s_register_dbus_glib_marshallers_for_interface ('
+                % self.prefix)
+        print('    const gchar *iface)')
+        print('{')
 
+        for iface, marshallers in self.iface_marshallers:
+            print('  if (g_str_equal (iface, "%s"))' % iface)
+            print('    {')
+            marshallers = list(marshallers)
+            marshallers.sort()
+            for marshaller in marshallers:
+                self.print_registration(marshaller, '      ')
+            print('      return;')
+            print('    }')
+            print('')
+
+        print('  /* otherwise, @iface has no signals or is not in the spec */')
         print('}')
 
 
@@ -43,15 +43,44 @@ def get_emits_changed(node):
     except IndexError:
         return None
 
+def find_perfect_hash(names):
+    """Find a hash function of the form
+
+        (len * mult + name[i] + name[len - 1 - j]) % size
+
+    which maps each of names (a list of distinct strings) to a different
+    slot, with i and j small enough to be valid for every name of an
+    acceptable length. Return (mult, i, j, size) for the smallest size
+    found, or None."""
+
+    min_len = min([len(name) for name in names])
+    positions = range(min(min_len, 8))
+
+    for size in range(len(names), 4 * len(names) + 1):
+        for mult in (1, 3, 5, 7, 11, 13, 31):
+            for i in positions:
+                for j in positions:
+                    slots = set()
+
+                    for name in names:
+                        slots.add((len(name) * mult + ord(name[i]) +
+                                   ord(name[len(name) - 1 - j])) % size)
+
+                    if len(slots) == len(names):
+                        return (mult, i, j, size)
+
+    return None
+
 class Generator(object):
 
     def __init__(self, dom, prefix, basename, signal_marshal_prefix,
                  headers, end_headers, not_implemented_func,
-                 allow_havoc):
+                 allow_havoc, trace_func_prefix, variant_prefix):
         self.dom = dom
         self.__header = []
         self.__body = []
         self.__docs = []
+        self.__variant = []
 
         assert prefix.endswith('_')
         assert not signal_marshal_prefix.endswith('_')
@@ -83,10 +112,22 @@ class Generator(object):
         self.end_headers = end_headers
         self.not_implemented_func = not_implemented_func
         self.allow_havoc = allow_havoc
+        self.trace_func_prefix = trace_func_prefix
+
+        # If set, also give each method a second vtable slot for an
+        # implementation that receives its arguments as a GVariant, set with
+        # a function named with this prefix and a _variant suffix and
+        # declared in basename-variant.h. Calls are routed to those slots by
+        # private telepathy-glib functions, so this is only useful inside
+        # telepathy-glib itself.
+        self.variant_prefix = variant_prefix
 
     def h(self, s):
         self.__header.append(s)
 
+    def v(self, s):
+        self.__variant.append(s)
+
     def b(self, s):
         self.__body.append(s)
 
@@ -128,6 +169,10 @@ class Generator(object):
         self.b('    GTypeInterface parent_class;')
         for method in methods:
             self.b('    %s %s;' % self.get_method_impl_names(method))
+        if self.variant_prefix is not None:
+            for method in methods:
+                self.b('    TpSvcVariantMethodImpl %s_variant_cb;'
+                       % method.getAttribute('tp:name-for-bindings').lower())
         self.b('};')
         self.b('')
 
@@ -255,6 +300,16 @@ class Generator(object):
         for signal in signals:
             base_init_code.extend(self.do_signal(signal))
 
+        lookup_func = None
+
+        if properties:
+            lookup_func = self.do_property_lookup(properties)
+
+        variant_lookup_func = None
+
+        if self.variant_prefix is not None and methods:
+            variant_lookup_func = self.do_variant_method_lookup(methods)
+
         self.b('static inline void')
         self.b('%s%s_base_init_once (gpointer klass G_GNUC_UNUSED)'
                % (self.prefix_, node_name_lc))
@@ -292,7 +347,12 @@ class Generator(object):
             self.b('      { 0, 0, NULL, 0, NULL, NULL }')
             self.b('  };')
             self.b('  static TpDBusPropertiesMixinIfaceInfo interface =')
-            self.b('      { 0, properties, NULL, NULL };')
+
+            if lookup_func is None:
+                self.b('      { 0, properties, NULL, NULL };')
+            else:
+                self.b('      { 0, properties, (GCallback) %s, NULL };'
+                       % lookup_func)
             self.b('')
 
 
@@ -317,6 +377,12 @@ class Generator(object):
 
             self.b('')
 
+        if variant_lookup_func is not None:
+            self.b('  _tp_svc_interface_set_variant_methods (%s,'
+                   % self.current_gtype)
+            self.b('      "%s", %s);' % (self.iface_name, variant_lookup_func))
+            self.b('')
+
         for s in base_init_code:
             self.b(s)
         self.b('}')
@@ -370,6 +436,98 @@ class Generator(object):
         self.node_name_lc = None
         self.node_name_uc = None
 
+    def do_property_lookup(self, properties):
+        # The properties mixin uses this function, in place of comparing
+        # quarks for each property in turn, to find the index of a property
+        # in properties[] from its name
+        names = [m.getAttribute('name') for m in properties]
+        found = find_perfect_hash(names)
+
+        if found is None:
+            return None
+
+        mult, i, j, size = found
+        slots = [-1] * size
+
+        for index, name in enumerate(names):
+            slots[(len(name) * mult + ord(name[i]) +
+                   ord(name[len(name) - 1 - j])) % size] = index
+
+        func = '%s%s_lookup_property' % (self.prefix_, self.node_name_lc)
+
+        self.b('static gint')
+        self.b('%s (const gchar *name)' % func)
+        self.b('{')
+        self.b('  static const gchar * const names[] = {')
+
+        for name in names:
+            self.b('      "%s",' % name)
+
+        self.b('  };')
+        self.b('  static const gint16 slots[%d] = { %s };'
+               % (size, ', '.join([str(x) for x in slots])))
+        self.b('  gsize len = strlen (name);')
+        self.b('  gint i;')
+        self.b('')
+        self.b('  if (len < %d || len > %d)'
+               % (min([len(n) for n in names]), max([len(n) for n in names])))
+        self.b('    return -1;')
+        self.b('')
+        self.b('  i = slots[(len * %d + (guchar) name[%d] +' % (mult, i))
+        self.b('      (guchar) name[len - %d]) %% %d];' % (1 + j, size))
+        self.b('')
+        self.b('  if (i < 0 || strcmp (name, names[i]) != 0)')
+        self.b('    return -1;')
+        self.b('')
+        self.b('  return i;')
+        self.b('}')
+        self.b('')
+
+        return func
+
+    def do_variant_method_lookup(self, methods):
+        # Example:
+        #
+        # static TpSvcVariantMethodImpl
+        # tp_svc_thing_lookup_variant_method (gpointer klass,
+        #     const gchar *member,
+        #     const gchar **in_signature)
+        #
+        # returns the GVariant-based implementation of member, if any, and
+        # the signature its arguments must have
+
+        name = '%s%s_lookup_variant_method' % (self.prefix_,
+                                               self.node_name_lc)
+
+        self.b('static TpSvcVariantMethodImpl')
+        self.b('%s (gpointer klass,' % name)
+        self.b('    const gchar *member,')
+        self.b('    const gchar **in_signature)')
+        self.b('{')
+        self.b('  %s%sClass *vtable = klass;'
+               % (self.Prefix, self.node_name_mixed))
+        self.b('')
+
+        for method in methods:
+            in_sig = ''.join([arg.getAttribute('type')
+                for arg in method.getElementsByTagName('arg')
+                if arg.getAttribute('direction') != 'out'])
+
+            self.b('  if (strcmp (member, "%s") == 0)'
+                   % method.getAttribute('name'))
+            self.b('    {')
+            self.b('      *in_signature = "%s";' % in_sig)
+            self.b('      return vtable->%s_variant_cb;'
+                   % method.getAttribute('tp:name-for-bindings').lower())
+            self.b('    }')
+            self.b('')
+
+        self.b('  return NULL;')
+        self.b('}')
+        self.b('')
+
+        return name
+
     def get_method_glue(self, methods):
         info = []
         offsets = []
@@ -538,10 +696,22 @@ class Generator(object):
         self.b('  if (impl != NULL)')
         tmp = ['self'] + [name for (ctype, name) in in_args] + ['context']
         self.b('    {')
+        if self.trace_func_prefix:
+            self.b('      gpointer span = %s_begin (context,'
+                    % self.trace_func_prefix)
+            self.b('          "%s", "%s");'
+                    % (self.iface_name, dbus_method_name))
+            self.b('')
         self.b('      (impl) (%s);' % ',\n        '.join(tmp))
+        if self.trace_func_prefix:
+            self.b('      %s_end (span);' % self.trace_func_prefix)
         self.b('    }')
         self.b('  else')
         self.b('    {')
+        if self.trace_func_prefix:
+            self.b('      %s_unimplemented ("%s",'
+                    % (self.trace_func_prefix, self.iface_name))
+            self.b('          "%s");' % dbus_method_name)
         if self.not_implemented_func:
             self.b('      %s (context);' % self.not_implemented_func)
         else:
@@ -578,9 +748,16 @@ class Generator(object):
                   self.Prefix, self.node_name_mixed, impl_name))
         self.b('{')
         self.b('  klass->%s_cb = impl;' % class_member_name)
+        if self.variant_prefix is not None:
+            self.b('  /* a subclass overriding the method replaces any')
+            self.b('   * GVariant-based implementation it inherited */')
+            self.b('  klass->%s_variant_cb = NULL;' % class_member_name)
         self.b('}')
         self.b('')
 
+        if self.variant_prefix is not None:
+            self.do_method_variant(class_member_name)
+
         # Return convenience function (static inline, in header)
         self.d('/**')
         self.d(' * %s:' % ret_name)
@@ -609,6 +786,35 @@ class Generator(object):
 
         return in_class
 
+    def do_method_variant(self, class_member_name):
+        # Example:
+        #
+        # void _tp_svc_thing_implement_do_stuff_variant (TpSvcThingClass *klass,
+        #     TpSvcVariantMethodImpl impl);
+        #
+        # impl receives the 'in' arguments as a tuple, and must reply with
+        # _tp_svc_invocation_return_variant() or similar. The dbus-glib
+        # implementation set by tp_svc_thing_implement_do_stuff() is still
+        # used if the call cannot be routed to impl.
+
+        name = '%s_%s_implement_%s_variant' % (self.variant_prefix,
+                                               self.node_name_lc,
+                                               class_member_name)
+
+        self.v('void %s (%s%sClass *klass,'
+               % (name, self.Prefix, self.node_name_mixed))
+        self.v('    TpSvcVariantMethodImpl impl);')
+        self.v('')
+
+        self.b('void')
+        self.b('%s (%s%sClass *klass,'
+               % (name, self.Prefix, self.node_name_mixed))
+        self.b('    TpSvcVariantMethodImpl impl)')
+        self.b('{')
+        self.b('  klass->%s_variant_cb = impl;' % class_member_name)
+        self.b('}')
+        self.b('')
+
     def get_signal_const_entry(self, signal):
         assert self.node_name_uc is not None
         return ('SIGNAL_%s_%s'
@@ -681,6 +887,10 @@ class Generator(object):
         self.b('  g_assert (instance != NULL);')
         self.b('  g_assert (G_TYPE_CHECK_INSTANCE_TYPE (instance, %s));'
                % (self.current_gtype))
+        if self.trace_func_prefix:
+            self.b('  %s_signal (instance, "%s",'
+                    % (self.trace_func_prefix, self.iface_name))
+            self.b('      "%s");' % dbus_name)
         tmp = (['instance', '%s_signals[%s]' % (self.node_name_lc, const_name),
                 '0'] + [name for (ctype, name, gtype) in args])
         self.b('  g_signal_emit (' + ',\n      '.join(tmp) + ');')
@@ -743,6 +953,35 @@ class Generator(object):
         self.b('#include "%s.h"' % self.basename)
         self.b('')
 
+        if self.variant_prefix is not None:
+            self.b('#include "%s-variant.h"' % self.basename)
+            self.b('')
+
+            self.v('/*<private_header>*/')
+            self.v('')
+            self.v('#include "%s.h"' % os.path.basename(self.basename))
+            self.v('#include "telepathy-glib/svc-variant-internal.h"')
+            self.v('')
+            self.v('G_BEGIN_DECLS')
+            self.v('')
+
+        if self.have_properties(nodes) or self.variant_prefix is not None:
+            self.b('#include <string.h>')
+            self.b('')
+
+        if self.trace_func_prefix:
+            self.b('gpointer %s_begin (DBusGMethodInvocation *context,'
+                    % self.trace_func_prefix)
+            self.b('    const gchar *iface, const gchar *member);')
+            self.b('void %s_end (gpointer span);' % self.trace_func_prefix)
+            self.b('void %s_unimplemented (const gchar *iface,'
+                    % self.trace_func_prefix)
+            self.b('    const gchar *member);')
+            self.b('void %s_signal (gpointer instance, const gchar *iface,'
+                    % self.trace_func_prefix)
+            self.b('    const gchar *member);')
+            self.b('')
+
         for node in nodes:
             self.do_node(node)
 
@@ -759,6 +998,12 @@ class Generator(object):
         file_set_contents(self.basename + '.c', u('\n').join(self.__body).encode('utf-8'))
         file_set_contents(self.basename + '-gtk-doc.h', u('\n').join(self.__docs).encode('utf-8'))
 
+        if self.variant_prefix is not None:
+            self.v('G_END_DECLS')
+            self.v('')
+            file_set_contents(self.basename + '-variant.h',
+                    u('\n').join(self.__variant).encode('utf-8'))
+
 def cmdline_error():
     print("""\
 usage:
@@ -780,6 +1025,22 @@ options:
             void symbol (DBusGMethodInvocation *context)
         and return some sort of "not implemented" error via
             dbus_g_method_return_error (context, ...)
+    --trace-func-prefix='prefix'
+        Call prefix_begin and prefix_end around each method implementation,
+        prefix_unimplemented instead of each unimplemented method, and
+        prefix_signal before emitting each signal, with signatures
+            gpointer prefix_begin (DBusGMethodInvocation *context,
+                const gchar *iface, const gchar *member)
+            void prefix_end (gpointer span)
+            void prefix_unimplemented (const gchar *iface,
+                const gchar *member)
+            void prefix_signal (gpointer instance, const gchar *iface,
+                const gchar *member)
+        where member is the D-Bus name of the method or signal
+    --variant-prefix='prefix'
+        Also generate prefix_iface_implement_method_variant functions in
+        BASENAME-variant.h, for implementations that receive their arguments
+        as a GVariant (only useful inside telepathy-glib)
 """)
     sys.exit(1)
 
@@ -791,7 +1052,9 @@ if __name__ == '__main__':
                                ['filename=', 'signal-marshal-prefix=',
                                 'include=', 'include-end=',
                                 'allow-unstable',
-                                'not-implemented-func='])
+                                'not-implemented-func=',
+                                'trace-func-prefix=',
+                                'variant-prefix='])
 
     try:
         prefix = argv[1]
@@ -804,6 +1067,8 @@ if __name__ == '__main__':
     end_headers = []
     not_implemented_func = ''
     allow_havoc = False
+    trace_func_prefix = ''
+    variant_prefix = None
 
     for option, value in options:
         if option == '--filename':
@@ -822,6 +1087,10 @@ if __name__ == '__main__':
             not_implemented_func = value
         elif option == '--allow-unstable':
             allow_havoc = True
+        elif option == '--trace-func-prefix':
+            trace_func_prefix = value
+        elif option == '--variant-prefix':
+            variant_prefix = value
 
     try:
         dom = xml.dom.minidom.parse(argv[0])
@@ -829,4 +1098,5 @@ if __name__ == '__main__':
         cmdline_error()
 
     Generator(dom, prefix, basename, signal_marshal_prefix, headers,
-              end_headers, not_implemented_func, allow_havoc)()
+              end_headers, not_implemented_func, allow_havoc,
+              trace_func_prefix, variant_prefix)()
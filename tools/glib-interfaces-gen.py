@@ -21,6 +21,7 @@ class Generator(object):
         self.impls = []
         self.decls = []
         self.docs = []
+        self.iface_names = []
         self.spec = get_by_path(dom, "spec")[0]
 
     def h(self, code):
@@ -66,8 +67,34 @@ class Generator(object):
         for iface in self.spec.getElementsByTagName('interface'):
             self.do_iface(iface)
 
+        self.do_known_names()
+
+    def do_known_names(self):
+        # Not declared in the public header: telepathy-glib declares it
+        # privately, to give the interfaces it knows small dense indices
+        self.c("""\
+static const gchar * const known_iface_names[] = {
+""")
+
+        for name in self.iface_names:
+            self.c('    "%s",\n' % name)
+
+        self.c("""\
+    NULL
+};
+
+const gchar * const *_%(prefix)siface_get_known_names (void);
+
+const gchar * const *
+_%(prefix)siface_get_known_names (void)
+{
+  return known_iface_names;
+}
+""" % {'prefix' : self.prefix.lower()})
+
     def do_iface(self, iface):
         parent_name = get_by_path(iface, '../@name')
+        self.iface_names.append(iface.getAttribute('name'))
         self.d("""\
 /**
  * %(IFACE_DEFINE)s:
@@ -11,3 +11,8 @@ VALGRIND = valgrind --tool=memcheck \
 # --show-reachable=yes   reachable objects (many!)
 # --read-var-info=yes    better diagnostics from DWARF3 info
 # --track-origins=yes    better diagnostics for uninit values (slow)
+
+# heap profiling, e.g. for tests/bench's "make bench-massif"
+MASSIF = valgrind --tool=massif \
+    --depth=30 \
+    --detailed-freq=1000000